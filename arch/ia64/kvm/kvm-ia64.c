@@ -1338,6 +1338,12 @@ int kvm_arch_vcpu_ioctl_set_guest_debug(struct kvm_vcpu *vcpu,
 	return -EINVAL;
 }
 
+int kvm_arch_update_irq_posting(struct kvm *kvm, unsigned int host_irq,
+				u32 guest_irq, bool set)
+{
+	return 0;
+}
+
 void kvm_arch_free_vm(struct kvm *kvm)
 {
 	unsigned long vm_base = kvm->arch.vm_base;
@@ -25,11 +25,14 @@
 
 #ifdef CONFIG_KERNEL_BZIP2
 #define BOOT_HEAP_SIZE             0x400000
-#else /* !CONFIG_KERNEL_BZIP2 */
+#elif defined(CONFIG_KERNEL_ZSTD)
+/* decoding tables and a block's worth of literals */
+#define BOOT_HEAP_SIZE             0x30000
+#else /* !CONFIG_KERNEL_BZIP2 && !CONFIG_KERNEL_ZSTD */
 
 #define BOOT_HEAP_SIZE	0x8000
 
-#endif /* !CONFIG_KERNEL_BZIP2 */
+#endif /* !CONFIG_KERNEL_BZIP2 && !CONFIG_KERNEL_ZSTD */
 
 #ifdef CONFIG_X86_64
 #define BOOT_STACK_SIZE	0x4000
@@ -31,6 +31,19 @@ struct msi_msg;
 struct pci_dev;
 struct irq_cfg;
 
+enum irq_remap_cap {
+	IRQ_POSTING_CAP = 0,
+};
+
+/*
+ * Target of a posted interrupt: the physical address of the vCPU's
+ * posted-interrupt descriptor and the guest vector to post.
+ */
+struct vcpu_data {
+	u64 pi_desc_addr;
+	u32 vector;
+};
+
 #ifdef CONFIG_IRQ_REMAP
 
 extern void setup_irq_remapping_ops(void);
@@ -41,6 +54,9 @@ extern int irq_remapping_enable(void);
 extern void irq_remapping_disable(void);
 extern int irq_remapping_reenable(int);
 extern int irq_remap_enable_fault_handling(void);
+extern bool irq_remapping_cap(enum irq_remap_cap cap);
+extern int irq_remapping_set_vcpu_affinity(unsigned int irq,
+					   struct vcpu_data *vcpu_info);
 extern int setup_ioapic_remapped_entry(int irq,
 				       struct IO_APIC_route_entry *entry,
 				       unsigned int destination,
@@ -68,6 +84,12 @@ static inline int irq_remapping_enable(void) { return -ENODEV; }
 static inline void irq_remapping_disable(void) { }
 static inline int irq_remapping_reenable(int eim) { return -ENODEV; }
 static inline int irq_remap_enable_fault_handling(void) { return -ENODEV; }
+static inline bool irq_remapping_cap(enum irq_remap_cap cap) { return false; }
+static inline int irq_remapping_set_vcpu_affinity(unsigned int irq,
+						  struct vcpu_data *vcpu_info)
+{
+	return -ENOSYS;
+}
 static inline int setup_ioapic_remapped_entry(int irq,
 					      struct IO_APIC_route_entry *entry,
 					      unsigned int destination,
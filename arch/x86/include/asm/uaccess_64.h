@@ -23,11 +23,25 @@ copy_user_generic_string(void *to, const void *from, unsigned len);
 __must_check unsigned long
 copy_user_generic_unrolled(void *to, const void *from, unsigned len);
 
+extern long __copy_user_nocache(void *dst, const void __user *src,
+				unsigned size, int zerorest);
+
+/* copies of at least this size use non-temporal stores */
+extern unsigned int copy_user_nt_threshold;
+
 static __always_inline __must_check unsigned long
 copy_user_generic(void *to, const void *from, unsigned len)
 {
 	unsigned ret;
 
+	/*
+	 * Large copies are usually streamed through once by the consumer,
+	 * keep them from flushing the working set out of the caches.
+	 */
+	if (unlikely(len >= copy_user_nt_threshold))
+		return __copy_user_nocache(to, (__force const void __user *)from,
+					   len, 1);
+
 	/*
 	 * If CPU has ERMS feature, use copy_user_enhanced_fast_string.
 	 * Otherwise, if CPU has rep_good feature, use copy_user_generic_string.
@@ -213,9 +227,6 @@ __copy_to_user_inatomic(void __user *dst, const void *src, unsigned size)
 	return __copy_to_user_nocheck(dst, src, size);
 }
 
-extern long __copy_user_nocache(void *dst, const void __user *src,
-				unsigned size, int zerorest);
-
 static inline int
 __copy_from_user_nocache(void *dst, const void __user *src, unsigned size)
 {
@@ -53,6 +53,10 @@ struct arch_uprobe {
 			u8	fixups;
 			u8	ilen;
 		} 			defparam;
+		struct {
+			u8	reg_offset;	/* to the register in pt_regs */
+			u8	ilen;
+		}			push;
 	};
 };
 
@@ -48,6 +48,9 @@
 /* Architectural interrupt line count. */
 #define KVM_NR_INTERRUPTS 256
 
+/* mmap() offset, in pages, of the vcpu dirty ring */
+#define KVM_DIRTY_LOG_PAGE_OFFSET 64
+
 struct kvm_memory_alias {
 	__u32 slot;  /* this has a different namespace than memory slots */
 	__u32 flags;
@@ -24,6 +24,8 @@
 #define KVM_FEATURE_STEAL_TIME		5
 #define KVM_FEATURE_PV_EOI		6
 #define KVM_FEATURE_PV_UNHALT		7
+#define KVM_FEATURE_PV_TLB_FLUSH	9
+#define KVM_FEATURE_LOCK_HINT		10
 
 /* The last 8 bits are used to indicate how to interpret the flags field
  * in pvclock structure. If no bits are set, all flags are ignored.
@@ -40,18 +42,35 @@
 #define MSR_KVM_ASYNC_PF_EN 0x4b564d02
 #define MSR_KVM_STEAL_TIME  0x4b564d03
 #define MSR_KVM_PV_EOI_EN      0x4b564d04
+#define MSR_KVM_LOCK_HINT      0x4b564d05
 
 struct kvm_steal_time {
 	__u64 steal;
 	__u32 version;
 	__u32 flags;
-	__u32 pad[12];
+	__u8  preempted;
+	__u8  u8_pad[3];
+	__u32 pad[11];
 };
 
+#define KVM_VCPU_PREEMPTED          (1 << 0)
+#define KVM_VCPU_FLUSH_TLB          (1 << 1)
+
 #define KVM_STEAL_ALIGNMENT_BITS 5
 #define KVM_STEAL_VALID_BITS ((-1ULL << (KVM_STEAL_ALIGNMENT_BITS + 1)))
 #define KVM_STEAL_RESERVED_MASK (((1 << KVM_STEAL_ALIGNMENT_BITS) - 1 ) << 1)
 
+/* Written by the guest, read by the host when picking a vCPU to yield to */
+struct kvm_lock_hint {
+	__u32 contended;	/* # contended spinlocks this vCPU holds */
+	__u32 pad[15];
+};
+
+#define KVM_LOCK_HINT_ALIGNMENT_BITS 5
+#define KVM_LOCK_HINT_VALID_BITS ((-1ULL << (KVM_LOCK_HINT_ALIGNMENT_BITS + 1)))
+#define KVM_LOCK_HINT_RESERVED_MASK \
+	(((1 << KVM_LOCK_HINT_ALIGNMENT_BITS) - 1) << 1)
+
 #define KVM_MAX_MMU_OP_BATCH           32
 
 #define KVM_ASYNC_PF_ENABLED			(1 << 0)
@@ -78,6 +78,8 @@ early_param("no-kvmclock-vsyscall", parse_no_kvmclock_vsyscall);
 static DEFINE_PER_CPU(struct kvm_vcpu_pv_apf_data, apf_reason) __aligned(64);
 static DEFINE_PER_CPU(struct kvm_steal_time, steal_time) __aligned(64);
 static int has_steal_clock = 0;
+static DEFINE_PER_CPU(struct kvm_lock_hint, lock_hint) __aligned(64);
+static int has_lock_hint;
 
 /*
  * No need for any "IO delay" on KVM
@@ -308,6 +310,25 @@ static void kvm_register_steal_time(void)
 		cpu, (unsigned long long) slow_virt_to_phys(st));
 }
 
+static void kvm_register_lock_hint(void)
+{
+	struct kvm_lock_hint *lh = this_cpu_ptr(&lock_hint);
+
+	if (!has_lock_hint)
+		return;
+
+	memset(lh, 0, sizeof(*lh));
+	wrmsrl(MSR_KVM_LOCK_HINT, slow_virt_to_phys(lh) | KVM_MSR_ENABLED);
+}
+
+static void kvm_disable_lock_hint(void)
+{
+	if (!has_lock_hint)
+		return;
+
+	wrmsrl(MSR_KVM_LOCK_HINT, 0);
+}
+
 static DEFINE_PER_CPU(unsigned long, kvm_apic_eoi) = KVM_PV_EOI_DISABLED;
 
 static void kvm_guest_apic_eoi_write(u32 reg, u32 val)
@@ -353,6 +374,8 @@ void kvm_guest_cpu_init(void)
 
 	if (has_steal_clock)
 		kvm_register_steal_time();
+
+	kvm_register_lock_hint();
 }
 
 static void kvm_pv_disable_apf(void)
@@ -378,6 +401,7 @@ static void kvm_pv_guest_cpu_reboot(void *unused)
 		wrmsrl(MSR_KVM_PV_EOI_EN, 0);
 	kvm_pv_disable_apf();
 	kvm_disable_steal_time();
+	kvm_disable_lock_hint();
 }
 
 static int kvm_pv_reboot_notify(struct notifier_block *nb,
@@ -409,6 +433,39 @@ static u64 kvm_steal_clock(int cpu)
 	return steal;
 }
 
+#ifdef CONFIG_SMP
+static DEFINE_PER_CPU(struct cpumask, __pv_tlb_mask);
+
+/*
+ * A vCPU that the host preempted cannot answer a flush IPI until it runs
+ * again.  Ask the host to flush its TLB before it next enters the guest
+ * instead, and only send IPIs to vCPUs that are running.
+ */
+static void kvm_flush_tlb_others(const struct cpumask *cpumask,
+				 struct mm_struct *mm, unsigned long start,
+				 unsigned long end)
+{
+	struct cpumask *flushmask = this_cpu_ptr(&__pv_tlb_mask);
+	struct kvm_steal_time *src;
+	u8 state;
+	int cpu;
+
+	cpumask_copy(flushmask, cpumask);
+	for_each_cpu(cpu, flushmask) {
+		src = &per_cpu(steal_time, cpu);
+		state = ACCESS_ONCE(src->preempted);
+		if (!(state & KVM_VCPU_PREEMPTED))
+			continue;
+		/* The host clears the byte with an xchg before entry */
+		if (cmpxchg(&src->preempted, state,
+			    state | KVM_VCPU_FLUSH_TLB) == state)
+			cpumask_clear_cpu(cpu, flushmask);
+	}
+
+	native_flush_tlb_others(flushmask, mm, start, end);
+}
+#endif
+
 void kvm_disable_steal_time(void)
 {
 	if (!has_steal_clock)
@@ -433,6 +490,7 @@ static void kvm_guest_cpu_online(void *dummy)
 static void kvm_guest_cpu_offline(void *dummy)
 {
 	kvm_disable_steal_time();
+	kvm_disable_lock_hint();
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		wrmsrl(MSR_KVM_PV_EOI_EN, 0);
 	kvm_pv_disable_apf();
@@ -488,9 +546,21 @@ void __init kvm_guest_init(void)
 		pv_time_ops.steal_clock = kvm_steal_clock;
 	}
 
+#ifdef CONFIG_SMP
+	if (kvm_para_has_feature(KVM_FEATURE_PV_TLB_FLUSH) && has_steal_clock)
+		pv_mmu_ops.flush_tlb_others = kvm_flush_tlb_others;
+#endif
+
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		apic_set_eoi_write(kvm_guest_apic_eoi_write);
 
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUED_SPINLOCKS)
+	/* The hint is kept by the pv qspinlock, see kvm_spinlock_init() */
+	if (kvm_para_has_feature(KVM_FEATURE_PV_UNHALT) &&
+	    kvm_para_has_feature(KVM_FEATURE_LOCK_HINT))
+		has_lock_hint = 1;
+#endif
+
 	if (kvmclock_vsyscall)
 		kvm_setup_vsyscall_timeinfo();
 
@@ -577,6 +647,105 @@ static void kvm_kick_cpu(int cpu)
 	kvm_hypercall2(KVM_HC_KICK_CPU, flags, apicid);
 }
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+
+#include <asm/qspinlock.h>
+
+/* Halt until kicked, unless *ptr already moved away from val */
+static void kvm_wait(u8 *ptr, u8 val)
+{
+	unsigned long flags;
+
+	if (in_nmi())
+		return;
+
+	local_irq_save(flags);
+
+	if (ACCESS_ONCE(*ptr) != val)
+		goto out;
+
+	/*
+	 * halt until it's our turn and kicked. Note that we do safe halt
+	 * for irq enabled case to avoid hang when lock info is overwritten
+	 * in irq spinlock slowpath and no spurious interrupt occur to save us.
+	 */
+	if (arch_irqs_disabled_flags(flags))
+		halt();
+	else
+		safe_halt();
+
+out:
+	local_irq_restore(flags);
+}
+
+/*
+ * Track the locks this vCPU took through the slowpath, i.e. while some
+ * other vCPU held or waited for them, and publish how many it holds so
+ * that the host can pick a preempted lock holder over any other
+ * preempted vCPU when a waiter exits on a pause loop.  The array is only
+ * touched by its own CPU with interrupts off; locks taken in NMI context
+ * are not tracked.
+ */
+#define KVM_HINT_MAX_LOCKS	8
+
+struct kvm_held_locks {
+	struct qspinlock *lock[KVM_HINT_MAX_LOCKS];
+	int nr;
+};
+
+static DEFINE_PER_CPU(struct kvm_held_locks, held_locks);
+
+static void kvm_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
+{
+	struct kvm_held_locks *hl;
+	unsigned long flags;
+
+	__pv_queued_spin_lock_slowpath(lock, val);
+
+	if (in_nmi())
+		return;
+
+	/* raw_: irq tracing may take locks of its own */
+	raw_local_irq_save(flags);
+	hl = this_cpu_ptr(&held_locks);
+	if (hl->nr < KVM_HINT_MAX_LOCKS) {
+		hl->lock[hl->nr++] = lock;
+		this_cpu_write(lock_hint.contended, hl->nr);
+	}
+	raw_local_irq_restore(flags);
+}
+
+static void kvm_lock_hint_release(struct qspinlock *lock)
+{
+	struct kvm_held_locks *hl;
+	unsigned long flags;
+	int i;
+
+	if (in_nmi())
+		return;
+
+	raw_local_irq_save(flags);
+	hl = this_cpu_ptr(&held_locks);
+	for (i = hl->nr - 1; i >= 0; i--) {
+		if (hl->lock[i] == lock) {
+			hl->lock[i] = hl->lock[--hl->nr];
+			this_cpu_write(lock_hint.contended, hl->nr);
+			break;
+		}
+	}
+	raw_local_irq_restore(flags);
+}
+
+__visible void kvm_queued_spin_unlock(struct qspinlock *lock)
+{
+	__pv_queued_spin_unlock(lock);
+	if (unlikely(this_cpu_read(held_locks.nr)))
+		kvm_lock_hint_release(lock);
+}
+PV_CALLEE_SAVE_REGS_THUNK(kvm_queued_spin_unlock);
+
+#else /* !CONFIG_QUEUED_SPINLOCKS */
+
 enum kvm_contention_stat {
 	TAKEN_SLOW,
 	TAKEN_SLOW_PICKUP,
@@ -805,6 +974,8 @@ static void kvm_unlock_kick(struct arch_spinlock *lock, __ticket_t ticket)
 	}
 }
 
+#endif /* !CONFIG_QUEUED_SPINLOCKS */
+
 /*
  * Setup pv_lock_ops to exploit KVM_FEATURE_PV_UNHALT if present.
  */
@@ -816,8 +987,22 @@ void __init kvm_spinlock_init(void)
 	if (!kvm_para_has_feature(KVM_FEATURE_PV_UNHALT))
 		return;
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+	__pv_init_lock_hash();
+	pv_lock_ops.queued_spin_lock_slowpath = __pv_queued_spin_lock_slowpath;
+	pv_lock_ops.queued_spin_unlock = PV_CALLEE_SAVE(__pv_queued_spin_unlock);
+	pv_lock_ops.wait = kvm_wait;
+	pv_lock_ops.kick = kvm_kick_cpu;
+	if (has_lock_hint) {
+		pv_lock_ops.queued_spin_lock_slowpath =
+			kvm_queued_spin_lock_slowpath;
+		pv_lock_ops.queued_spin_unlock =
+			PV_CALLEE_SAVE(kvm_queued_spin_unlock);
+	}
+#else /* !CONFIG_QUEUED_SPINLOCKS */
 	pv_lock_ops.lock_spinning = PV_CALLEE_SAVE(kvm_lock_spinning);
 	pv_lock_ops.unlock_kick = kvm_unlock_kick;
+#endif
 }
 
 static __init int kvm_spinlock_init_jump(void)
@@ -827,7 +1012,9 @@ static __init int kvm_spinlock_init_jump(void)
 	if (!kvm_para_has_feature(KVM_FEATURE_PV_UNHALT))
 		return 0;
 
+#ifndef CONFIG_QUEUED_SPINLOCKS
 	static_key_slow_inc(&paravirt_ticketlocks_enabled);
+#endif
 	printk(KERN_INFO "KVM setup paravirtual spinlock\n");
 
 	return 0;
@@ -274,6 +274,22 @@ dotraplinkage void do_double_fault(struct pt_regs *regs, long error_code)
 	tsk->thread.error_code = error_code;
 	tsk->thread.trap_nr = X86_TRAP_DF;
 
+#ifdef CONFIG_VMAP_STACK
+	/*
+	 * A kernel stack overflow runs into the unmapped guard area below
+	 * a virtually mapped stack; the page fault cannot push its frame
+	 * there and gets promoted to a double fault.  Say so explicitly.
+	 */
+	{
+		unsigned long cr2 = read_cr2();
+
+		if ((unsigned long)task_stack_page(tsk) - 1 - cr2 < PAGE_SIZE)
+			pr_emerg("BUG: stack guard page was hit at %p (stack is %p..%p)\n",
+				 (void *)cr2, task_stack_page(tsk),
+				 task_stack_page(tsk) + THREAD_SIZE);
+	}
+#endif
+
 #ifdef CONFIG_DOUBLEFAULT
 	df_debug(regs, error_code);
 #endif
@@ -192,6 +192,33 @@ static u64 __read_mostly shadow_mmio_mask;
 static void mmu_spte_set(u64 *sptep, u64 spte);
 static void mmu_free_roots(struct kvm_vcpu *vcpu);
 
+static bool is_tdp_mmu_root(struct kvm_vcpu *vcpu, hpa_t root_hpa);
+static bool kvm_tdp_mmu_write_protect_gfn(struct kvm *kvm, gfn_t gfn);
+static void kvm_tdp_mmu_clear_dirty_pt_masked(struct kvm *kvm,
+					      struct kvm_memory_slot *slot,
+					      gfn_t gfn_offset,
+					      unsigned long mask);
+static bool kvm_tdp_mmu_zap_hva_range(struct kvm *kvm, unsigned long start,
+				      unsigned long end);
+static int kvm_tdp_mmu_age_hva_range(struct kvm *kvm, unsigned long start,
+				     unsigned long end, bool clear);
+
+/*
+ * cond_resched_lock() for mmu_lock, which is a rwlock on x86.  There is
+ * no way to tell whether someone is spinning on a rwlock, so only give
+ * the lock up when a reschedule is due.
+ */
+static int mmu_cond_resched_lock(struct kvm *kvm)
+{
+	if (!need_resched())
+		return 0;
+
+	write_unlock(&kvm->mmu_lock);
+	cond_resched();
+	write_lock(&kvm->mmu_lock);
+	return 1;
+}
+
 void kvm_mmu_set_mmio_spte_mask(u64 mmio_mask)
 {
 	shadow_mmio_mask = mmio_mask;
@@ -243,16 +270,23 @@ static unsigned int kvm_current_mmio_generation(struct kvm *kvm)
 	return kvm_memslots(kvm)->generation & MMIO_GEN_MASK;
 }
 
-static void mark_mmio_spte(struct kvm *kvm, u64 *sptep, u64 gfn,
-			   unsigned access)
+static u64 make_mmio_spte(struct kvm *kvm, u64 gfn, unsigned access)
 {
 	unsigned int gen = kvm_current_mmio_generation(kvm);
 	u64 mask = generation_mmio_spte_mask(gen);
 
 	access &= ACC_WRITE_MASK | ACC_USER_MASK;
 	mask |= shadow_mmio_mask | access | gfn << PAGE_SHIFT;
+	return mask;
+}
 
-	trace_mark_mmio_spte(sptep, gfn, access, gen);
+static void mark_mmio_spte(struct kvm *kvm, u64 *sptep, u64 gfn,
+			   unsigned access)
+{
+	u64 mask = make_mmio_spte(kvm, gfn, access);
+
+	access &= ACC_WRITE_MASK | ACC_USER_MASK;
+	trace_mark_mmio_spte(sptep, gfn, access, get_mmio_spte_generation(mask));
 	mmu_spte_set(sptep, mask);
 }
 
@@ -1233,6 +1267,9 @@ void kvm_mmu_write_protect_pt_masked(struct kvm *kvm,
 {
 	unsigned long *rmapp;
 
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_clear_dirty_pt_masked(kvm, slot, gfn_offset, mask);
+
 	while (mask) {
 		rmapp = __gfn_to_rmap(slot->base_gfn + gfn_offset + __ffs(mask),
 				      PT_PAGE_TABLE_LEVEL, slot);
@@ -1258,6 +1295,9 @@ static bool rmap_write_protect(struct kvm *kvm, u64 gfn)
 		write_protected |= __rmap_write_protect(kvm, rmapp, true);
 	}
 
+	if (kvm->arch.tdp_mmu_enabled)
+		write_protected |= kvm_tdp_mmu_write_protect_gfn(kvm, gfn);
+
 	return write_protected;
 }
 
@@ -1396,16 +1436,29 @@ static int kvm_handle_hva(struct kvm *kvm, unsigned long hva,
 
 int kvm_unmap_hva(struct kvm *kvm, unsigned long hva)
 {
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_zap_hva_range(kvm, hva, hva + 1);
+
 	return kvm_handle_hva(kvm, hva, 0, kvm_unmap_rmapp);
 }
 
 int kvm_unmap_hva_range(struct kvm *kvm, unsigned long start, unsigned long end)
 {
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_zap_hva_range(kvm, start, end);
+
 	return kvm_handle_hva_range(kvm, start, end, 0, kvm_unmap_rmapp);
 }
 
 void kvm_set_spte_hva(struct kvm *kvm, unsigned long hva, pte_t pte)
 {
+	/*
+	 * The TDP MMU does not try to repoint the spte, the next fault
+	 * maps the new page.
+	 */
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_zap_hva_range(kvm, hva, hva + 1);
+
 	kvm_handle_hva(kvm, hva, (unsigned long)&pte, kvm_set_pte_rmapp);
 }
 
@@ -1479,6 +1532,8 @@ static void rmap_recycle(struct kvm_vcpu *vcpu, u64 *spte, gfn_t gfn)
 
 int kvm_age_hva(struct kvm *kvm, unsigned long start, unsigned long end)
 {
+	int young = 0;
+
 	/*
 	 * In case of absence of EPT Access and Dirty Bits supports,
 	 * emulate the accessed bit for EPT, by checking if this page has
@@ -1495,16 +1550,26 @@ int kvm_age_hva(struct kvm *kvm, unsigned long start, unsigned long end)
 		 * protected regions (like invalidate_range_start|end does).
 		 */
 		kvm->mmu_notifier_seq++;
-		return kvm_handle_hva_range(kvm, start, end, 0,
-					    kvm_unmap_rmapp);
+		if (kvm->arch.tdp_mmu_enabled)
+			young = kvm_tdp_mmu_zap_hva_range(kvm, start, end);
+		return young | kvm_handle_hva_range(kvm, start, end, 0,
+						    kvm_unmap_rmapp);
 	}
 
-	return kvm_handle_hva_range(kvm, start, end, 0, kvm_age_rmapp);
+	if (kvm->arch.tdp_mmu_enabled)
+		young = kvm_tdp_mmu_age_hva_range(kvm, start, end, true);
+
+	return young | kvm_handle_hva_range(kvm, start, end, 0, kvm_age_rmapp);
 }
 
 int kvm_test_age_hva(struct kvm *kvm, unsigned long hva)
 {
-	return kvm_handle_hva(kvm, hva, 0, kvm_test_age_rmapp);
+	int young = 0;
+
+	if (kvm->arch.tdp_mmu_enabled && shadow_accessed_mask)
+		young = kvm_tdp_mmu_age_hva_range(kvm, hva, hva + 1, false);
+
+	return young | kvm_handle_hva(kvm, hva, 0, kvm_test_age_rmapp);
 }
 
 #ifdef MMU_DEBUG
@@ -1901,7 +1966,7 @@ static void mmu_sync_children(struct kvm_vcpu *vcpu,
 			mmu_pages_clear_parents(&parents);
 		}
 		kvm_mmu_commit_zap_page(vcpu->kvm, &invalid_list);
-		cond_resched_lock(&vcpu->kvm->mmu_lock);
+		mmu_cond_resched_lock(vcpu->kvm);
 		kvm_mmu_pages_init(parent, &parents, &pages);
 	}
 }
@@ -2248,7 +2313,7 @@ void kvm_mmu_change_mmu_pages(struct kvm *kvm, unsigned int goal_nr_mmu_pages)
 {
 	LIST_HEAD(invalid_list);
 
-	spin_lock(&kvm->mmu_lock);
+	write_lock(&kvm->mmu_lock);
 
 	if (kvm->arch.n_used_mmu_pages > goal_nr_mmu_pages) {
 		/* Need to free some mmu pages to achieve the goal. */
@@ -2262,7 +2327,7 @@ void kvm_mmu_change_mmu_pages(struct kvm *kvm, unsigned int goal_nr_mmu_pages)
 
 	kvm->arch.n_max_mmu_pages = goal_nr_mmu_pages;
 
-	spin_unlock(&kvm->mmu_lock);
+	write_unlock(&kvm->mmu_lock);
 }
 
 int kvm_mmu_unprotect_page(struct kvm *kvm, gfn_t gfn)
@@ -2273,7 +2338,7 @@ int kvm_mmu_unprotect_page(struct kvm *kvm, gfn_t gfn)
 
 	pgprintk("%s: looking for gfn %llx\n", __func__, gfn);
 	r = 0;
-	spin_lock(&kvm->mmu_lock);
+	write_lock(&kvm->mmu_lock);
 	for_each_gfn_indirect_valid_sp(kvm, sp, gfn) {
 		pgprintk("%s: gfn %llx role %x\n", __func__, gfn,
 			 sp->role.word);
@@ -2281,7 +2346,7 @@ int kvm_mmu_unprotect_page(struct kvm *kvm, gfn_t gfn)
 		kvm_mmu_prepare_zap_page(kvm, sp, &invalid_list);
 	}
 	kvm_mmu_commit_zap_page(kvm, &invalid_list);
-	spin_unlock(&kvm->mmu_lock);
+	write_unlock(&kvm->mmu_lock);
 
 	return r;
 }
@@ -2907,6 +2972,870 @@ exit:
 	return ret;
 }
 
+#ifdef CONFIG_X86_64
+/*
+ * The TDP MMU.
+ *
+ * With EPT/NPT enabled and no nested guest, the guest physical address
+ * space is mapped by direct page tables that have no reverse mappings,
+ * no unsync pages and no parent pointers to keep in sync.  That lets the
+ * page fault handler run with mmu_lock held for read: every change made
+ * under the read lock is a cmpxchg from the value observed by the walk,
+ * so vcpus racing on the same entry either agree on the result or walk
+ * again.  Anything that takes a mapping away (zapping, splitting a large
+ * page, changing the pfn, write protecting for shadow paging) still needs
+ * mmu_lock for write, and the page tables it unlinks are only freed after
+ * the remote TLB flush and an RCU grace period, so lockless walkers do
+ * not trip over them either.
+ */
+static bool __read_mostly tdp_mmu = false;
+module_param(tdp_mmu, bool, S_IRUGO);
+
+#define TDP_MMU_MAX_GFN		(1ULL << (PT64_ROOT_LEVEL * PT64_LEVEL_BITS))
+
+/* Returned by the map path when the change needs mmu_lock for write. */
+#define TDP_MMU_RETRY_LOCKED	(-EAGAIN)
+
+struct tdp_iter {
+	/* The gfn the walk resumes from after a reschedule. */
+	gfn_t next_gfn;
+	/* The tables on the path from the root, pt_path[level - 1]. */
+	u64 *pt_path[PT64_ROOT_LEVEL];
+	u64 *sptep;
+	u64 old_spte;
+	/* The first gfn mapped by *sptep. */
+	gfn_t gfn;
+	int root_level;
+	int min_level;
+	int level;
+	bool valid;
+};
+
+static void tdp_iter_read_spte(struct tdp_iter *iter)
+{
+	iter->sptep = iter->pt_path[iter->level - 1] +
+		SHADOW_PT_INDEX(iter->gfn << PAGE_SHIFT, iter->level);
+	iter->old_spte = ACCESS_ONCE(*iter->sptep);
+}
+
+static void tdp_iter_start(struct tdp_iter *iter, struct kvm_mmu_page *root,
+			   int min_level, gfn_t start)
+{
+	iter->root_level = root->role.level;
+	iter->min_level = min_level;
+	iter->level = iter->root_level;
+	iter->pt_path[iter->level - 1] = root->spt;
+	iter->next_gfn = start;
+	iter->gfn = start & ~(KVM_PAGES_PER_HPAGE(iter->level) - 1);
+	iter->valid = true;
+	tdp_iter_read_spte(iter);
+}
+
+static bool tdp_iter_step_down(struct tdp_iter *iter)
+{
+	u64 spte = iter->old_spte;
+
+	if (iter->level == iter->min_level)
+		return false;
+
+	if (!is_shadow_present_pte(spte) || is_last_spte(spte, iter->level))
+		return false;
+
+	iter->level--;
+	iter->pt_path[iter->level - 1] = __va(spte & PT64_BASE_ADDR_MASK);
+	iter->gfn = iter->next_gfn & ~(KVM_PAGES_PER_HPAGE(iter->level) - 1);
+	tdp_iter_read_spte(iter);
+	return true;
+}
+
+static bool tdp_iter_step_side(struct tdp_iter *iter)
+{
+	if (SHADOW_PT_INDEX(iter->gfn << PAGE_SHIFT, iter->level) ==
+	    PT64_ENT_PER_PAGE - 1)
+		return false;
+
+	iter->gfn += KVM_PAGES_PER_HPAGE(iter->level);
+	iter->next_gfn = iter->gfn;
+	iter->sptep++;
+	iter->old_spte = ACCESS_ONCE(*iter->sptep);
+	return true;
+}
+
+static bool tdp_iter_step_up(struct tdp_iter *iter)
+{
+	if (iter->level == iter->root_level)
+		return false;
+
+	iter->level++;
+	iter->gfn &= ~(KVM_PAGES_PER_HPAGE(iter->level) - 1);
+	tdp_iter_read_spte(iter);
+	return true;
+}
+
+/*
+ * Pre-order walk: go down into present tables above min_level, otherwise
+ * go to the next entry, moving up as tables run out.  The walk descends
+ * based on iter->old_spte, so whoever changes the entry has to update it.
+ */
+static void tdp_iter_next(struct tdp_iter *iter)
+{
+	if (tdp_iter_step_down(iter))
+		return;
+
+	do {
+		if (tdp_iter_step_side(iter))
+			return;
+	} while (tdp_iter_step_up(iter));
+
+	iter->valid = false;
+}
+
+#define for_each_tdp_pte(_iter, _root, _min_level, _start, _end)	\
+	for (tdp_iter_start(&(_iter), _root, _min_level, _start);	\
+	     (_iter).valid && (_iter).gfn < (_end);			\
+	     tdp_iter_next(&(_iter)))
+
+static struct kvm_mmu_page *tdp_mmu_alloc_sp(struct kvm_vcpu *vcpu,
+					     gfn_t gfn,
+					     union kvm_mmu_page_role role)
+{
+	struct kvm_mmu_page *sp;
+
+	sp = mmu_memory_cache_alloc(&vcpu->arch.mmu_page_header_cache);
+	sp->spt = mmu_memory_cache_alloc(&vcpu->arch.mmu_page_cache);
+	clear_page(sp->spt);
+	set_page_private(virt_to_page(sp->spt), (unsigned long)sp);
+	sp->gfn = gfn;
+	sp->role = role;
+	sp->tdp_mmu_page = true;
+	return sp;
+}
+
+static void tdp_mmu_free_sp(struct kvm_mmu_page *sp)
+{
+	free_page((unsigned long)sp->spt);
+	kmem_cache_free(mmu_page_header_cache, sp);
+}
+
+static void tdp_mmu_free_sp_rcu(struct rcu_head *head)
+{
+	tdp_mmu_free_sp(container_of(head, struct kvm_mmu_page, rcu_head));
+}
+
+/*
+ * Account for a leaf that was just zapped, the same way
+ * mmu_spte_clear_track_bits() does for the shadow MMU.
+ */
+static void tdp_mmu_track_zapped_leaf(u64 old_spte)
+{
+	pfn_t pfn = spte_to_pfn(old_spte);
+
+	if (kvm_is_reserved_pfn(pfn))
+		return;
+
+	if (!shadow_accessed_mask || old_spte & shadow_accessed_mask)
+		kvm_set_pfn_accessed(pfn);
+	if (!shadow_dirty_mask || old_spte & shadow_dirty_mask)
+		kvm_set_pfn_dirty(pfn);
+}
+
+static void tdp_mmu_zap_spte(struct kvm *kvm, u64 old_spte, int level,
+			     struct list_head *invalid_list);
+
+/*
+ * Empty a table that has already been unlinked from its parent and queue
+ * it, and everything below it, on @invalid_list.  The hardware may still
+ * be walking the table until the TLB flush, hence the xchg.
+ */
+static void tdp_mmu_unlink_table(struct kvm *kvm, u64 *pt,
+				 struct list_head *invalid_list)
+{
+	struct kvm_mmu_page *sp = page_header(__pa(pt));
+	int i;
+
+	for (i = 0; i < PT64_ENT_PER_PAGE; i++)
+		tdp_mmu_zap_spte(kvm, xchg(&pt[i], 0ull), sp->role.level,
+				 invalid_list);
+
+	list_add(&sp->link, invalid_list);
+}
+
+static void tdp_mmu_zap_spte(struct kvm *kvm, u64 old_spte, int level,
+			     struct list_head *invalid_list)
+{
+	if (!is_shadow_present_pte(old_spte))
+		return;
+
+	if (is_last_spte(old_spte, level))
+		tdp_mmu_track_zapped_leaf(old_spte);
+	else
+		tdp_mmu_unlink_table(kvm, __va(old_spte & PT64_BASE_ADDR_MASK),
+				     invalid_list);
+}
+
+/* Zap the entry under the iterator; needs mmu_lock held for write. */
+static void tdp_mmu_zap_iter(struct kvm *kvm, struct tdp_iter *iter,
+			     struct list_head *invalid_list)
+{
+	tdp_mmu_zap_spte(kvm, xchg(iter->sptep, 0ull), iter->level,
+			 invalid_list);
+	iter->old_spte = 0;
+}
+
+static void tdp_mmu_commit_zap(struct kvm *kvm, struct list_head *invalid_list,
+			       bool flush)
+{
+	struct kvm_mmu_page *sp, *nsp;
+
+	if (!flush && list_empty(invalid_list))
+		return;
+
+	/*
+	 * The unlinked tables stay in use by the hardware until the flush
+	 * and by lockless walkers until the grace period ends.
+	 */
+	kvm_flush_remote_tlbs(kvm);
+
+	list_for_each_entry_safe(sp, nsp, invalid_list, link) {
+		list_del(&sp->link);
+		call_rcu(&sp->rcu_head, tdp_mmu_free_sp_rcu);
+	}
+}
+
+static void tdp_mmu_zap_iter_flush(struct kvm *kvm, struct tdp_iter *iter)
+{
+	LIST_HEAD(invalid_list);
+
+	tdp_mmu_zap_iter(kvm, iter, &invalid_list);
+	tdp_mmu_commit_zap(kvm, &invalid_list, true);
+}
+
+/*
+ * Drop mmu_lock if a reschedule is due, after committing what was zapped
+ * so far.  The tables on the path may be gone afterwards, so the walk
+ * starts over from the root at the gfn it had reached.  The caller must
+ * hold a reference to @root.
+ */
+static bool tdp_mmu_iter_cond_resched(struct kvm *kvm, struct tdp_iter *iter,
+				      struct kvm_mmu_page *root,
+				      struct list_head *invalid_list,
+				      bool *flush)
+{
+	if (!need_resched())
+		return false;
+
+	tdp_mmu_commit_zap(kvm, invalid_list, *flush);
+	*flush = false;
+
+	write_unlock(&kvm->mmu_lock);
+	cond_resched();
+	write_lock(&kvm->mmu_lock);
+
+	tdp_iter_start(iter, root, iter->min_level, iter->next_gfn);
+	return true;
+}
+
+/*
+ * Zap the mappings of [start, end) under @root.  Tables that lie entirely
+ * inside the range go in one piece, the ones straddling its edges are
+ * walked into.  Returns true if anything was zapped; the TLBs have been
+ * flushed by then.
+ */
+static bool tdp_mmu_zap_range(struct kvm *kvm, struct kvm_mmu_page *root,
+			      gfn_t start, gfn_t end, bool can_yield)
+{
+	LIST_HEAD(invalid_list);
+	struct tdp_iter iter;
+	bool flush = false, zapped = false;
+
+	for_each_tdp_pte(iter, root, PT_PAGE_TABLE_LEVEL, start, end) {
+		if (can_yield &&
+		    tdp_mmu_iter_cond_resched(kvm, &iter, root, &invalid_list,
+					      &flush))
+			continue;
+
+		if (!iter.old_spte)
+			continue;
+
+		if (is_shadow_present_pte(iter.old_spte) &&
+		    !is_last_spte(iter.old_spte, iter.level) &&
+		    (iter.gfn < start ||
+		     iter.gfn + KVM_PAGES_PER_HPAGE(iter.level) > end))
+			continue;
+
+		tdp_mmu_zap_iter(kvm, &iter, &invalid_list);
+		flush = zapped = true;
+	}
+
+	tdp_mmu_commit_zap(kvm, &invalid_list, flush);
+	return zapped;
+}
+
+static void tdp_mmu_put_root(struct kvm *kvm, struct kvm_mmu_page *root)
+{
+	LIST_HEAD(invalid_list);
+
+	if (--root->root_count)
+		return;
+
+	list_del(&root->link);
+	tdp_mmu_zap_range(kvm, root, 0, TDP_MMU_MAX_GFN, true);
+
+	list_add(&root->link, &invalid_list);
+	tdp_mmu_commit_zap(kvm, &invalid_list, true);
+}
+
+/*
+ * Step to the root after @prev, keeping a reference so that it survives
+ * mmu_lock being dropped during the walk.  The reference to @prev is put.
+ */
+static struct kvm_mmu_page *tdp_mmu_next_root(struct kvm *kvm,
+					      struct kvm_mmu_page *prev)
+{
+	struct kvm_mmu_page *next;
+
+	if (prev)
+		next = list_next_entry(prev, link);
+	else
+		next = list_first_entry(&kvm->arch.tdp_mmu_roots,
+					struct kvm_mmu_page, link);
+
+	if (&next->link == &kvm->arch.tdp_mmu_roots)
+		next = NULL;
+	else
+		next->root_count++;
+
+	if (prev)
+		tdp_mmu_put_root(kvm, prev);
+
+	return next;
+}
+
+/* Walkers that may yield mmu_lock; they must not break out of the loop. */
+#define for_each_tdp_mmu_root_yield_safe(_kvm, _root)			\
+	for (_root = tdp_mmu_next_root(_kvm, NULL); _root;		\
+	     _root = tdp_mmu_next_root(_kvm, _root))
+
+#define for_each_tdp_mmu_root(_kvm, _root)				\
+	list_for_each_entry(_root, &(_kvm)->arch.tdp_mmu_roots, link)
+
+static bool is_tdp_mmu_root(struct kvm_vcpu *vcpu, hpa_t root_hpa)
+{
+	if (!vcpu->kvm->arch.tdp_mmu_enabled || !vcpu->arch.mmu.direct_map ||
+	    vcpu->arch.mmu.shadow_root_level != PT64_ROOT_LEVEL)
+		return false;
+
+	return VALID_PAGE(root_hpa) && page_header(root_hpa)->tdp_mmu_page;
+}
+
+static hpa_t kvm_tdp_mmu_get_vcpu_root_hpa(struct kvm_vcpu *vcpu)
+{
+	struct kvm *kvm = vcpu->kvm;
+	union kvm_mmu_page_role role;
+	struct kvm_mmu_page *root;
+
+	role = vcpu->arch.mmu.base_role;
+	role.level = PT64_ROOT_LEVEL;
+	role.direct = 1;
+	role.access = ACC_ALL;
+
+	write_lock(&kvm->mmu_lock);
+	for_each_tdp_mmu_root(kvm, root) {
+		if (root->role.word == role.word) {
+			root->root_count++;
+			goto out;
+		}
+	}
+
+	root = tdp_mmu_alloc_sp(vcpu, 0, role);
+	root->root_count = 1;
+	list_add(&root->link, &kvm->arch.tdp_mmu_roots);
+out:
+	write_unlock(&kvm->mmu_lock);
+	return __pa(root->spt);
+}
+
+static void kvm_tdp_mmu_put_root_hpa(struct kvm *kvm, hpa_t root_hpa)
+{
+	write_lock(&kvm->mmu_lock);
+	tdp_mmu_put_root(kvm, page_header(root_hpa));
+	write_unlock(&kvm->mmu_lock);
+}
+
+/*
+ * Make sure the entry under the iterator points to a table.  Under the
+ * read lock only empty (or mmio) entries can be filled in; a large page
+ * in the way has to be zapped first, which needs the write lock.
+ */
+static int tdp_mmu_link_table(struct kvm_vcpu *vcpu, struct tdp_iter *iter,
+			      struct kvm_mmu_page *root, bool shared)
+{
+	union kvm_mmu_page_role role = root->role;
+	struct kvm_mmu_page *sp;
+	u64 spte;
+
+	for (;;) {
+		if (is_shadow_present_pte(iter->old_spte)) {
+			if (!is_large_pte(iter->old_spte))
+				return 0;
+			if (shared)
+				return TDP_MMU_RETRY_LOCKED;
+
+			/* Do not mix large and small mappings in the TLB. */
+			tdp_mmu_zap_iter_flush(vcpu->kvm, iter);
+			continue;
+		}
+
+		role.level = iter->level - 1;
+		sp = tdp_mmu_alloc_sp(vcpu, iter->gfn, role);
+		spte = __pa(sp->spt) | PT_PRESENT_MASK | PT_WRITABLE_MASK |
+		       shadow_user_mask | shadow_x_mask | shadow_accessed_mask;
+
+		if (cmpxchg64(iter->sptep, iter->old_spte, spte) ==
+		    iter->old_spte) {
+			iter->old_spte = spte;
+			return 0;
+		}
+
+		/* Somebody else got there first, use theirs. */
+		tdp_mmu_free_sp(sp);
+		iter->old_spte = ACCESS_ONCE(*iter->sptep);
+	}
+}
+
+/*
+ * Build the leaf spte for @gfn, following set_spte().  Returns 1 if the
+ * fault should just be retried by the guest, and TDP_MMU_RETRY_LOCKED if
+ * whether the gfn must be write protected can only be decided with
+ * mmu_lock held for write.
+ */
+static int tdp_mmu_make_spte(struct kvm_vcpu *vcpu, int level, gfn_t gfn,
+			     pfn_t pfn, bool prefault, bool map_writable,
+			     bool shared, u64 *sptep, bool *wrprot)
+{
+	u64 spte;
+
+	*wrprot = false;
+
+	if (unlikely(is_noslot_pfn(pfn))) {
+		*sptep = make_mmio_spte(vcpu->kvm, gfn, ACC_ALL);
+		return 0;
+	}
+
+	spte = PT_PRESENT_MASK | shadow_x_mask | shadow_user_mask;
+	if (!prefault)
+		spte |= shadow_accessed_mask;
+	if (level > PT_PAGE_TABLE_LEVEL)
+		spte |= PT_PAGE_SIZE_MASK;
+	spte |= kvm_x86_ops->get_mt_mask(vcpu, gfn, kvm_is_reserved_pfn(pfn));
+	spte |= (u64)pfn << PAGE_SHIFT;
+
+	if (!map_writable)
+		goto out;
+
+	spte |= SPTE_HOST_WRITEABLE;
+
+	if (level > PT_PAGE_TABLE_LEVEL &&
+	    has_wrprotected_page(vcpu->kvm, gfn, level))
+		return 1;
+
+	/* Only a nested guest's shadow pages can write protect a gfn. */
+	if (ACCESS_ONCE(vcpu->kvm->arch.indirect_shadow_pages)) {
+		if (shared)
+			return TDP_MMU_RETRY_LOCKED;
+
+		if (mmu_need_write_protect(vcpu, gfn, true)) {
+			*wrprot = true;
+			goto out;
+		}
+	}
+
+	spte |= PT_WRITABLE_MASK | SPTE_MMU_WRITEABLE;
+out:
+	*sptep = spte;
+	return 0;
+}
+
+static int tdp_mmu_map_leaf(struct kvm_vcpu *vcpu, struct tdp_iter *iter,
+			    int write, bool map_writable, pfn_t pfn,
+			    bool prefault, bool shared)
+{
+	struct kvm *kvm = vcpu->kvm;
+	bool wrprot;
+	u64 spte;
+	int r;
+
+	r = tdp_mmu_make_spte(vcpu, iter->level, iter->gfn, pfn, prefault,
+			      map_writable, shared, &spte, &wrprot);
+	if (r)
+		return r < 0 ? r : 0;
+
+	for (;;) {
+		u64 old_spte = iter->old_spte;
+
+		if (is_shadow_present_pte(old_spte)) {
+			/* A table where the large page goes, or a new pfn. */
+			if (!is_last_spte(old_spte, iter->level) ||
+			    spte_to_pfn(old_spte) != pfn) {
+				if (shared)
+					return TDP_MMU_RETRY_LOCKED;
+
+				tdp_mmu_zap_iter_flush(kvm, iter);
+				continue;
+			}
+
+			/* Another vcpu already installed the mapping. */
+			if (is_writable_pte(old_spte) || !is_writable_pte(spte))
+				goto out;
+		}
+
+		if (cmpxchg64(iter->sptep, old_spte, spte) == old_spte)
+			break;
+
+		iter->old_spte = ACCESS_ONCE(*iter->sptep);
+	}
+
+	++vcpu->stat.pf_fixed;
+
+	if (unlikely(is_mmio_spte(spte)))
+		return 1;
+
+	if (is_writable_pte(spte))
+		mark_page_dirty(kvm, iter->gfn);
+out:
+	if (wrprot) {
+		if (write)
+			r = 1;
+		kvm_make_request(KVM_REQ_TLB_FLUSH, vcpu);
+	}
+
+	return r;
+}
+
+/*
+ * Map @gfn at @level in the vcpu's root.  With @shared the caller holds
+ * mmu_lock for read and gets TDP_MMU_RETRY_LOCKED back when that is not
+ * enough; the tables linked in so far are kept.
+ */
+static int kvm_tdp_mmu_map(struct kvm_vcpu *vcpu, int write, bool map_writable,
+			   int level, gfn_t gfn, pfn_t pfn, bool prefault,
+			   bool shared)
+{
+	struct kvm_mmu_page *root = page_header(vcpu->arch.mmu.root_hpa);
+	struct tdp_iter iter;
+	int r = 0;
+
+	rcu_read_lock();
+	for_each_tdp_pte(iter, root, level, gfn, gfn + 1) {
+		if (iter.level == level) {
+			r = tdp_mmu_map_leaf(vcpu, &iter, write, map_writable,
+					     pfn, prefault, shared);
+			break;
+		}
+
+		r = tdp_mmu_link_table(vcpu, &iter, root, shared);
+		if (r)
+			break;
+	}
+	rcu_read_unlock();
+
+	return r;
+}
+
+static int kvm_tdp_mmu_page_fault(struct kvm_vcpu *vcpu, int write,
+				  bool map_writable, int level, gfn_t gfn,
+				  pfn_t pfn, bool prefault,
+				  int force_pt_level, unsigned long mmu_seq)
+{
+	struct kvm *kvm = vcpu->kvm;
+	int r = 0;
+
+	read_lock(&kvm->mmu_lock);
+	if (mmu_notifier_retry(kvm, mmu_seq)) {
+		read_unlock(&kvm->mmu_lock);
+		goto out;
+	}
+	if (likely(!force_pt_level))
+		transparent_hugepage_adjust(vcpu, &gfn, &pfn, &level);
+	r = kvm_tdp_mmu_map(vcpu, write, map_writable, level, gfn, pfn,
+			    prefault, true);
+	read_unlock(&kvm->mmu_lock);
+
+	if (r != TDP_MMU_RETRY_LOCKED)
+		goto out;
+
+	r = 0;
+	write_lock(&kvm->mmu_lock);
+	if (!mmu_notifier_retry(kvm, mmu_seq))
+		r = kvm_tdp_mmu_map(vcpu, write, map_writable, level, gfn, pfn,
+				    prefault, false);
+	write_unlock(&kvm->mmu_lock);
+out:
+	kvm_release_pfn_clean(pfn);
+	return r;
+}
+
+static bool kvm_tdp_mmu_write_protect_gfn(struct kvm *kvm, gfn_t gfn)
+{
+	struct kvm_mmu_page *root;
+	struct tdp_iter iter;
+	bool flush = false;
+
+	for_each_tdp_mmu_root(kvm, root) {
+		for_each_tdp_pte(iter, root, PT_PAGE_TABLE_LEVEL, gfn, gfn + 1) {
+			u64 spte;
+
+			if (!is_shadow_present_pte(iter.old_spte) ||
+			    !is_last_spte(iter.old_spte, iter.level))
+				continue;
+
+			/* fast_page_fault() may set the W bit under us. */
+			for (;;) {
+				u64 old_spte = iter.old_spte;
+
+				spte = old_spte & ~(PT_WRITABLE_MASK |
+						    SPTE_MMU_WRITEABLE);
+				if (spte == old_spte)
+					break;
+
+				iter.old_spte = cmpxchg64(iter.sptep, old_spte,
+							  spte);
+				if (iter.old_spte == old_spte) {
+					iter.old_spte = spte;
+					flush = true;
+					break;
+				}
+			}
+		}
+	}
+
+	return flush;
+}
+
+/* Dirty logging: write protect the 4K mappings of the gfns in @mask. */
+static void kvm_tdp_mmu_clear_dirty_pt_masked(struct kvm *kvm,
+					      struct kvm_memory_slot *slot,
+					      gfn_t gfn_offset,
+					      unsigned long mask)
+{
+	gfn_t base = slot->base_gfn + gfn_offset;
+	struct kvm_mmu_page *root;
+	struct tdp_iter iter;
+
+	if (!mask)
+		return;
+
+	for_each_tdp_mmu_root(kvm, root) {
+		for_each_tdp_pte(iter, root, PT_PAGE_TABLE_LEVEL,
+				 base + __ffs(mask), base + __fls(mask) + 1) {
+			if (iter.level != PT_PAGE_TABLE_LEVEL ||
+			    !(mask & (1UL << (iter.gfn - base))))
+				continue;
+
+			if (!is_shadow_present_pte(iter.old_spte) ||
+			    !is_writable_pte(iter.old_spte))
+				continue;
+
+			clear_bit(PT_WRITABLE_SHIFT,
+				  (unsigned long *)iter.sptep);
+		}
+	}
+}
+
+/*
+ * Write protect every mapping of @slot, keeping SPTE_MMU_WRITEABLE so
+ * that fast_page_fault() can make them writable again.  The caller
+ * flushes the TLBs.
+ */
+static void kvm_tdp_mmu_wrprot_slot(struct kvm *kvm,
+				    struct kvm_memory_slot *slot)
+{
+	gfn_t end = slot->base_gfn + slot->npages;
+	LIST_HEAD(invalid_list);
+	struct kvm_mmu_page *root;
+	struct tdp_iter iter;
+	bool flush = false;
+
+	for_each_tdp_mmu_root_yield_safe(kvm, root) {
+		for_each_tdp_pte(iter, root, PT_PAGE_TABLE_LEVEL,
+				 slot->base_gfn, end) {
+			if (tdp_mmu_iter_cond_resched(kvm, &iter, root,
+						      &invalid_list, &flush))
+				continue;
+
+			if (!is_shadow_present_pte(iter.old_spte) ||
+			    !is_last_spte(iter.old_spte, iter.level) ||
+			    !is_writable_pte(iter.old_spte))
+				continue;
+
+			clear_bit(PT_WRITABLE_SHIFT,
+				  (unsigned long *)iter.sptep);
+		}
+	}
+}
+
+static int tdp_mmu_handle_hva_range(struct kvm *kvm, unsigned long start,
+				    unsigned long end, unsigned long data,
+				    int (*handler)(struct kvm *kvm,
+						   struct kvm_mmu_page *root,
+						   gfn_t start, gfn_t end,
+						   unsigned long data))
+{
+	struct kvm_memslots *slots = kvm_memslots(kvm);
+	struct kvm_memory_slot *memslot;
+	struct kvm_mmu_page *root;
+	int ret = 0;
+
+	kvm_for_each_memslot(memslot, slots) {
+		unsigned long hva_start, hva_end;
+		gfn_t gfn_start, gfn_end;
+
+		hva_start = max(start, memslot->userspace_addr);
+		hva_end = min(end, memslot->userspace_addr +
+			      (memslot->npages << PAGE_SHIFT));
+		if (hva_start >= hva_end)
+			continue;
+
+		gfn_start = hva_to_gfn_memslot(hva_start, memslot);
+		gfn_end = hva_to_gfn_memslot(hva_end + PAGE_SIZE - 1, memslot);
+
+		/* Invalid roots can still be in use by vcpus, do them too. */
+		for_each_tdp_mmu_root(kvm, root)
+			ret |= handler(kvm, root, gfn_start, gfn_end, data);
+	}
+
+	return ret;
+}
+
+static int tdp_mmu_zap_gfn_range(struct kvm *kvm, struct kvm_mmu_page *root,
+				 gfn_t start, gfn_t end, unsigned long data)
+{
+	return tdp_mmu_zap_range(kvm, root, start, end, false);
+}
+
+static bool kvm_tdp_mmu_zap_hva_range(struct kvm *kvm, unsigned long start,
+				      unsigned long end)
+{
+	return tdp_mmu_handle_hva_range(kvm, start, end, 0,
+					tdp_mmu_zap_gfn_range);
+}
+
+static int tdp_mmu_age_gfn_range(struct kvm *kvm, struct kvm_mmu_page *root,
+				 gfn_t start, gfn_t end, unsigned long clear)
+{
+	struct tdp_iter iter;
+	int young = 0;
+
+	for_each_tdp_pte(iter, root, PT_PAGE_TABLE_LEVEL, start, end) {
+		if (!is_shadow_present_pte(iter.old_spte) ||
+		    !is_last_spte(iter.old_spte, iter.level) ||
+		    !(iter.old_spte & shadow_accessed_mask))
+			continue;
+
+		young = 1;
+		if (!clear)
+			break;
+
+		clear_bit(ffs(shadow_accessed_mask) - 1,
+			  (unsigned long *)iter.sptep);
+	}
+
+	return young;
+}
+
+static int kvm_tdp_mmu_age_hva_range(struct kvm *kvm, unsigned long start,
+				     unsigned long end, bool clear)
+{
+	return tdp_mmu_handle_hva_range(kvm, start, end, clear,
+					tdp_mmu_age_gfn_range);
+}
+
+/*
+ * Counterpart of the mmu_valid_gen bump for the TDP MMU: no new vcpu
+ * picks up the current roots, and what they map goes away.  The roots
+ * themselves are freed once the vcpus have reloaded their MMU.
+ */
+static void kvm_tdp_mmu_invalidate_roots(struct kvm *kvm)
+{
+	struct kvm_mmu_page *root;
+
+	for_each_tdp_mmu_root(kvm, root)
+		root->role.invalid = 1;
+
+	for_each_tdp_mmu_root_yield_safe(kvm, root)
+		tdp_mmu_zap_range(kvm, root, 0, TDP_MMU_MAX_GFN, true);
+}
+
+static void kvm_tdp_mmu_init_vm(struct kvm *kvm)
+{
+	kvm->arch.tdp_mmu_enabled = tdp_enabled && tdp_mmu;
+}
+
+#else /* !CONFIG_X86_64 */
+
+static bool is_tdp_mmu_root(struct kvm_vcpu *vcpu, hpa_t root_hpa)
+{
+	return false;
+}
+
+static hpa_t kvm_tdp_mmu_get_vcpu_root_hpa(struct kvm_vcpu *vcpu)
+{
+	BUG();
+	return INVALID_PAGE;
+}
+
+static void kvm_tdp_mmu_put_root_hpa(struct kvm *kvm, hpa_t root_hpa)
+{
+}
+
+static int kvm_tdp_mmu_page_fault(struct kvm_vcpu *vcpu, int write,
+				  bool map_writable, int level, gfn_t gfn,
+				  pfn_t pfn, bool prefault,
+				  int force_pt_level, unsigned long mmu_seq)
+{
+	BUG();
+	return 0;
+}
+
+static bool kvm_tdp_mmu_write_protect_gfn(struct kvm *kvm, gfn_t gfn)
+{
+	return false;
+}
+
+static void kvm_tdp_mmu_clear_dirty_pt_masked(struct kvm *kvm,
+					      struct kvm_memory_slot *slot,
+					      gfn_t gfn_offset,
+					      unsigned long mask)
+{
+}
+
+static void kvm_tdp_mmu_wrprot_slot(struct kvm *kvm,
+				    struct kvm_memory_slot *slot)
+{
+}
+
+static bool kvm_tdp_mmu_zap_hva_range(struct kvm *kvm, unsigned long start,
+				      unsigned long end)
+{
+	return false;
+}
+
+static int kvm_tdp_mmu_age_hva_range(struct kvm *kvm, unsigned long start,
+				     unsigned long end, bool clear)
+{
+	return 0;
+}
+
+static void kvm_tdp_mmu_invalidate_roots(struct kvm *kvm)
+{
+}
+
+static void kvm_tdp_mmu_init_vm(struct kvm *kvm)
+{
+	kvm->arch.tdp_mmu_enabled = false;
+}
+#endif /* CONFIG_X86_64 */
+
 static bool try_async_pf(struct kvm_vcpu *vcpu, bool prefault, gfn_t gfn,
 			 gva_t gva, pfn_t *pfn, bool write, bool *writable);
 static void make_mmu_pages_available(struct kvm_vcpu *vcpu);
@@ -2948,7 +3877,7 @@ static int nonpaging_map(struct kvm_vcpu *vcpu, gva_t v, u32 error_code,
 	if (handle_abnormal_pfn(vcpu, v, gfn, pfn, ACC_ALL, &r))
 		return r;
 
-	spin_lock(&vcpu->kvm->mmu_lock);
+	write_lock(&vcpu->kvm->mmu_lock);
 	if (mmu_notifier_retry(vcpu->kvm, mmu_seq))
 		goto out_unlock;
 	make_mmu_pages_available(vcpu);
@@ -2956,13 +3885,13 @@ static int nonpaging_map(struct kvm_vcpu *vcpu, gva_t v, u32 error_code,
 		transparent_hugepage_adjust(vcpu, &gfn, &pfn, &level);
 	r = __direct_map(vcpu, v, write, map_writable, level, gfn, pfn,
 			 prefault);
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 
 
 	return r;
 
 out_unlock:
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 	kvm_release_pfn_clean(pfn);
 	return 0;
 }
@@ -2982,19 +3911,25 @@ static void mmu_free_roots(struct kvm_vcpu *vcpu)
 	     vcpu->arch.mmu.direct_map)) {
 		hpa_t root = vcpu->arch.mmu.root_hpa;
 
-		spin_lock(&vcpu->kvm->mmu_lock);
+		if (is_tdp_mmu_root(vcpu, root)) {
+			kvm_tdp_mmu_put_root_hpa(vcpu->kvm, root);
+			vcpu->arch.mmu.root_hpa = INVALID_PAGE;
+			return;
+		}
+
+		write_lock(&vcpu->kvm->mmu_lock);
 		sp = page_header(root);
 		--sp->root_count;
 		if (!sp->root_count && sp->role.invalid) {
 			kvm_mmu_prepare_zap_page(vcpu->kvm, sp, &invalid_list);
 			kvm_mmu_commit_zap_page(vcpu->kvm, &invalid_list);
 		}
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 		vcpu->arch.mmu.root_hpa = INVALID_PAGE;
 		return;
 	}
 
-	spin_lock(&vcpu->kvm->mmu_lock);
+	write_lock(&vcpu->kvm->mmu_lock);
 	for (i = 0; i < 4; ++i) {
 		hpa_t root = vcpu->arch.mmu.pae_root[i];
 
@@ -3009,7 +3944,7 @@ static void mmu_free_roots(struct kvm_vcpu *vcpu)
 		vcpu->arch.mmu.pae_root[i] = INVALID_PAGE;
 	}
 	kvm_mmu_commit_zap_page(vcpu->kvm, &invalid_list);
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 	vcpu->arch.mmu.root_hpa = INVALID_PAGE;
 }
 
@@ -3030,20 +3965,23 @@ static int mmu_alloc_direct_roots(struct kvm_vcpu *vcpu)
 	struct kvm_mmu_page *sp;
 	unsigned i;
 
-	if (vcpu->arch.mmu.shadow_root_level == PT64_ROOT_LEVEL) {
-		spin_lock(&vcpu->kvm->mmu_lock);
+	if (vcpu->arch.mmu.shadow_root_level == PT64_ROOT_LEVEL &&
+	    vcpu->kvm->arch.tdp_mmu_enabled) {
+		vcpu->arch.mmu.root_hpa = kvm_tdp_mmu_get_vcpu_root_hpa(vcpu);
+	} else if (vcpu->arch.mmu.shadow_root_level == PT64_ROOT_LEVEL) {
+		write_lock(&vcpu->kvm->mmu_lock);
 		make_mmu_pages_available(vcpu);
 		sp = kvm_mmu_get_page(vcpu, 0, 0, PT64_ROOT_LEVEL,
 				      1, ACC_ALL, NULL);
 		++sp->root_count;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 		vcpu->arch.mmu.root_hpa = __pa(sp->spt);
 	} else if (vcpu->arch.mmu.shadow_root_level == PT32E_ROOT_LEVEL) {
 		for (i = 0; i < 4; ++i) {
 			hpa_t root = vcpu->arch.mmu.pae_root[i];
 
 			ASSERT(!VALID_PAGE(root));
-			spin_lock(&vcpu->kvm->mmu_lock);
+			write_lock(&vcpu->kvm->mmu_lock);
 			make_mmu_pages_available(vcpu);
 			sp = kvm_mmu_get_page(vcpu, i << (30 - PAGE_SHIFT),
 					      i << 30,
@@ -3051,7 +3989,7 @@ static int mmu_alloc_direct_roots(struct kvm_vcpu *vcpu)
 					      NULL);
 			root = __pa(sp->spt);
 			++sp->root_count;
-			spin_unlock(&vcpu->kvm->mmu_lock);
+			write_unlock(&vcpu->kvm->mmu_lock);
 			vcpu->arch.mmu.pae_root[i] = root | PT_PRESENT_MASK;
 		}
 		vcpu->arch.mmu.root_hpa = __pa(vcpu->arch.mmu.pae_root);
@@ -3082,13 +4020,13 @@ static int mmu_alloc_shadow_roots(struct kvm_vcpu *vcpu)
 
 		ASSERT(!VALID_PAGE(root));
 
-		spin_lock(&vcpu->kvm->mmu_lock);
+		write_lock(&vcpu->kvm->mmu_lock);
 		make_mmu_pages_available(vcpu);
 		sp = kvm_mmu_get_page(vcpu, root_gfn, 0, PT64_ROOT_LEVEL,
 				      0, ACC_ALL, NULL);
 		root = __pa(sp->spt);
 		++sp->root_count;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 		vcpu->arch.mmu.root_hpa = root;
 		return 0;
 	}
@@ -3116,14 +4054,14 @@ static int mmu_alloc_shadow_roots(struct kvm_vcpu *vcpu)
 			if (mmu_check_root(vcpu, root_gfn))
 				return 1;
 		}
-		spin_lock(&vcpu->kvm->mmu_lock);
+		write_lock(&vcpu->kvm->mmu_lock);
 		make_mmu_pages_available(vcpu);
 		sp = kvm_mmu_get_page(vcpu, root_gfn, i << 30,
 				      PT32_ROOT_LEVEL, 0,
 				      ACC_ALL, NULL);
 		root = __pa(sp->spt);
 		++sp->root_count;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 
 		vcpu->arch.mmu.pae_root[i] = root | pm_mask;
 	}
@@ -3199,9 +4137,9 @@ static void mmu_sync_roots(struct kvm_vcpu *vcpu)
 
 void kvm_mmu_sync_roots(struct kvm_vcpu *vcpu)
 {
-	spin_lock(&vcpu->kvm->mmu_lock);
+	write_lock(&vcpu->kvm->mmu_lock);
 	mmu_sync_roots(vcpu);
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 }
 EXPORT_SYMBOL_GPL(kvm_mmu_sync_roots);
 
@@ -3430,7 +4368,12 @@ static int tdp_page_fault(struct kvm_vcpu *vcpu, gva_t gpa, u32 error_code,
 	if (handle_abnormal_pfn(vcpu, 0, gfn, pfn, ACC_ALL, &r))
 		return r;
 
-	spin_lock(&vcpu->kvm->mmu_lock);
+	if (is_tdp_mmu_root(vcpu, vcpu->arch.mmu.root_hpa))
+		return kvm_tdp_mmu_page_fault(vcpu, write, map_writable, level,
+					      gfn, pfn, prefault,
+					      force_pt_level, mmu_seq);
+
+	write_lock(&vcpu->kvm->mmu_lock);
 	if (mmu_notifier_retry(vcpu->kvm, mmu_seq))
 		goto out_unlock;
 	make_mmu_pages_available(vcpu);
@@ -3438,12 +4381,12 @@ static int tdp_page_fault(struct kvm_vcpu *vcpu, gva_t gpa, u32 error_code,
 		transparent_hugepage_adjust(vcpu, &gfn, &pfn, &level);
 	r = __direct_map(vcpu, gpa, write, map_writable,
 			 level, gfn, pfn, prefault);
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 
 	return r;
 
 out_unlock:
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 	kvm_release_pfn_clean(pfn);
 	return 0;
 }
@@ -4122,7 +5065,7 @@ void kvm_mmu_pte_write(struct kvm_vcpu *vcpu, gpa_t gpa,
 	 */
 	mmu_topup_memory_caches(vcpu);
 
-	spin_lock(&vcpu->kvm->mmu_lock);
+	write_lock(&vcpu->kvm->mmu_lock);
 	++vcpu->kvm->stat.mmu_pte_write;
 	kvm_mmu_audit(vcpu, AUDIT_PRE_PTE_WRITE);
 
@@ -4156,7 +5099,7 @@ void kvm_mmu_pte_write(struct kvm_vcpu *vcpu, gpa_t gpa,
 	mmu_pte_write_flush_tlb(vcpu, zap_page, remote_flush, local_flush);
 	kvm_mmu_commit_zap_page(vcpu->kvm, &invalid_list);
 	kvm_mmu_audit(vcpu, AUDIT_POST_PTE_WRITE);
-	spin_unlock(&vcpu->kvm->mmu_lock);
+	write_unlock(&vcpu->kvm->mmu_lock);
 }
 
 int kvm_mmu_unprotect_page_virt(struct kvm_vcpu *vcpu, gva_t gva)
@@ -4314,7 +5257,7 @@ void kvm_mmu_slot_remove_write_access(struct kvm *kvm, int slot)
 	memslot = id_to_memslot(kvm->memslots, slot);
 	last_gfn = memslot->base_gfn + memslot->npages - 1;
 
-	spin_lock(&kvm->mmu_lock);
+	write_lock(&kvm->mmu_lock);
 
 	for (i = PT_PAGE_TABLE_LEVEL;
 	     i < PT_PAGE_TABLE_LEVEL + KVM_NR_PAGE_SIZES; ++i) {
@@ -4328,12 +5271,14 @@ void kvm_mmu_slot_remove_write_access(struct kvm *kvm, int slot)
 			if (*rmapp)
 				__rmap_write_protect(kvm, rmapp, false);
 
-			if (need_resched() || spin_needbreak(&kvm->mmu_lock))
-				cond_resched_lock(&kvm->mmu_lock);
+			mmu_cond_resched_lock(kvm);
 		}
 	}
 
-	spin_unlock(&kvm->mmu_lock);
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_wrprot_slot(kvm, memslot);
+
+	write_unlock(&kvm->mmu_lock);
 
 	/*
 	 * kvm_mmu_slot_remove_write_access() and kvm_vm_ioctl_get_dirty_log()
@@ -4386,8 +5331,7 @@ restart:
 		 * Need not flush tlb since we only zap the sp with invalid
 		 * generation number.
 		 */
-		if (batch >= BATCH_ZAP_PAGES &&
-		      cond_resched_lock(&kvm->mmu_lock)) {
+		if (batch >= BATCH_ZAP_PAGES && mmu_cond_resched_lock(kvm)) {
 			batch = 0;
 			goto restart;
 		}
@@ -4418,7 +5362,7 @@ restart:
  */
 void kvm_mmu_invalidate_zap_all_pages(struct kvm *kvm)
 {
-	spin_lock(&kvm->mmu_lock);
+	write_lock(&kvm->mmu_lock);
 	trace_kvm_mmu_invalidate_zap_all_pages(kvm);
 	kvm->arch.mmu_valid_gen++;
 
@@ -4433,8 +5377,23 @@ void kvm_mmu_invalidate_zap_all_pages(struct kvm *kvm)
 	 */
 	kvm_reload_remote_mmus(kvm);
 
+	if (kvm->arch.tdp_mmu_enabled)
+		kvm_tdp_mmu_invalidate_roots(kvm);
+
 	kvm_zap_obsolete_pages(kvm);
-	spin_unlock(&kvm->mmu_lock);
+	write_unlock(&kvm->mmu_lock);
+}
+
+void kvm_mmu_init_vm(struct kvm *kvm)
+{
+	INIT_LIST_HEAD(&kvm->arch.tdp_mmu_roots);
+	kvm_tdp_mmu_init_vm(kvm);
+}
+
+void kvm_mmu_uninit_vm(struct kvm *kvm)
+{
+	/* Every root goes away with the vcpu that used it. */
+	WARN_ON(!list_empty(&kvm->arch.tdp_mmu_roots));
 }
 
 static bool kvm_has_zapped_obsolete_pages(struct kvm *kvm)
@@ -4486,7 +5445,7 @@ mmu_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 			continue;
 
 		idx = srcu_read_lock(&kvm->srcu);
-		spin_lock(&kvm->mmu_lock);
+		write_lock(&kvm->mmu_lock);
 
 		if (kvm_has_zapped_obsolete_pages(kvm)) {
 			kvm_mmu_commit_zap_page(kvm,
@@ -4499,7 +5458,7 @@ mmu_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 		kvm_mmu_commit_zap_page(kvm, &invalid_list);
 
 unlock:
-		spin_unlock(&kvm->mmu_lock);
+		write_unlock(&kvm->mmu_lock);
 		srcu_read_unlock(&kvm->srcu, idx);
 
 		/*
@@ -4616,6 +5575,8 @@ void kvm_mmu_destroy(struct kvm_vcpu *vcpu)
 
 void kvm_mmu_module_exit(void)
 {
+	/* TDP MMU page tables are freed from RCU callbacks. */
+	rcu_barrier();
 	mmu_destroy_caches();
 	percpu_counter_destroy(&kvm_total_used_mmu_pages);
 	unregister_shrinker(&mmu_shrinker);
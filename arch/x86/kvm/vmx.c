@@ -45,6 +45,7 @@
 #include <asm/perf_event.h>
 #include <asm/debugreg.h>
 #include <asm/kexec.h>
+#include <asm/irq_remapping.h>
 
 #include "trace.h"
 
@@ -411,10 +412,31 @@ struct nested_vmx {
 /* Posted-Interrupt Descriptor */
 struct pi_desc {
 	u32 pir[8];     /* Posted interrupt requested */
-	u32 control;	/* bit 0 of control is outstanding notification bit */
-	u32 rsvd[7];
+	union {
+		struct {
+				/* bit 256 - Outstanding Notification */
+			u16	on	: 1,
+				/* bit 257 - Suppress Notification */
+				sn	: 1,
+				/* bit 271:258 - Reserved */
+				rsvd_1	: 14;
+				/* bit 279:272 - Notification Vector */
+			u8	nv;
+				/* bit 287:280 - Reserved */
+			u8	rsvd_2;
+				/* bit 319:288 - Notification Destination */
+			u32	ndst;
+		};
+		u64 control;
+	};
+	u32 rsvd[6];
 } __aligned(64);
 
+static bool pi_test_on(struct pi_desc *pi_desc)
+{
+	return test_bit(POSTED_INTR_ON, (unsigned long *)&pi_desc->control);
+}
+
 static bool pi_test_and_set_on(struct pi_desc *pi_desc)
 {
 	return test_and_set_bit(POSTED_INTR_ON,
@@ -502,6 +524,14 @@ struct vcpu_vmx {
 	/* Posted interrupt descriptor */
 	struct pi_desc pi_desc;
 
+	/*
+	 * While blocked with device interrupts posted to pi_desc, the vCPU
+	 * sits on the blocked list of pi_pre_cpu, which the IOMMU targets
+	 * with POSTED_INTR_WAKEUP_VECTOR. -1 when not blocked.
+	 */
+	struct list_head pi_blocked_list;
+	int pi_pre_cpu;
+
 	/* Support for a guest hypervisor (nested VMX) */
 	struct nested_vmx nested;
 
@@ -777,6 +807,10 @@ static DEFINE_PER_CPU(struct vmcs *, current_vmcs);
  * when a CPU is brought down, and we need to VMCLEAR all VMCSs loaded on it.
  */
 static DEFINE_PER_CPU(struct list_head, loaded_vmcss_on_cpu);
+
+/* vCPUs blocked with posted device interrupts, see vmx_pre_block() */
+static DEFINE_PER_CPU(struct list_head, blocked_vcpu_on_cpu);
+static DEFINE_PER_CPU(spinlock_t, blocked_vcpu_on_cpu_lock);
 static DEFINE_PER_CPU(struct desc_ptr, host_gdt);
 
 static unsigned long *vmx_io_bitmap_a;
@@ -1813,6 +1847,47 @@ static void vmx_load_host_state(struct vcpu_vmx *vmx)
 	preempt_enable();
 }
 
+/*
+ * Interrupts of assigned devices are posted straight to pi_desc only
+ * with APICv and an interrupt remapping unit that can post.
+ */
+static bool vmx_can_post_device_irqs(struct kvm *kvm)
+{
+	return enable_apicv && irqchip_in_kernel(kvm) &&
+	       irq_remapping_cap(IRQ_POSTING_CAP) &&
+	       !list_empty(&kvm->arch.assigned_dev_head);
+}
+
+static u32 pi_ndst(int cpu)
+{
+	u32 dest = cpu_physical_id(cpu);
+
+	return x2apic_enabled() ? dest : (dest << 8) & 0xff00;
+}
+
+static void vmx_vcpu_pi_load(struct kvm_vcpu *vcpu, int cpu)
+{
+	struct pi_desc *pi_desc = &to_vmx(vcpu)->pi_desc;
+	struct pi_desc old, new;
+
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
+		return;
+
+	do {
+		old.control = new.control = pi_desc->control;
+
+		/*
+		 * A blocked vCPU is woken through the CPU it blocked on,
+		 * vmx_post_block() retargets the descriptor.
+		 */
+		if (old.nv == POSTED_INTR_WAKEUP_VECTOR)
+			return;
+
+		new.ndst = pi_ndst(cpu);
+	} while (cmpxchg(&pi_desc->control, old.control,
+			 new.control) != old.control);
+}
+
 /*
  * Switches to specified vcpu, until a matching vcpu_put(), but assumes
  * vcpu mutex is already taken.
@@ -1863,6 +1938,8 @@ static void vmx_vcpu_load(struct kvm_vcpu *vcpu, int cpu)
 		vmcs_writel(HOST_IA32_SYSENTER_ESP, sysenter_esp); /* 22.2.3 */
 		vmx->loaded_vmcs->cpu = cpu;
 	}
+
+	vmx_vcpu_pi_load(vcpu, cpu);
 }
 
 static void vmx_vcpu_put(struct kvm_vcpu *vcpu)
@@ -4253,6 +4330,8 @@ static void vmx_sync_pir_to_irr(struct kvm_vcpu *vcpu)
 		return;
 
 	kvm_apic_update_irr(vcpu, vmx->pi_desc.pir);
+	/* An IOMMU posts without asking for the vIRR to be re-evaluated */
+	kvm_make_request(KVM_REQ_EVENT, vcpu);
 }
 
 static void vmx_sync_pir_to_irr_dummy(struct kvm_vcpu *vcpu)
@@ -4260,6 +4339,111 @@ static void vmx_sync_pir_to_irr_dummy(struct kvm_vcpu *vcpu)
 	return;
 }
 
+static void vmx_post_block(struct kvm_vcpu *vcpu)
+{
+	struct vcpu_vmx *vmx = to_vmx(vcpu);
+	struct pi_desc *pi_desc = &vmx->pi_desc;
+	struct pi_desc old, new;
+	unsigned long flags;
+
+	if (vmx->pi_pre_cpu == -1)
+		return;
+
+	do {
+		old.control = new.control = pi_desc->control;
+		new.ndst = pi_ndst(vcpu->cpu);
+		new.nv = POSTED_INTR_VECTOR;
+	} while (cmpxchg(&pi_desc->control, old.control,
+			 new.control) != old.control);
+
+	spin_lock_irqsave(&per_cpu(blocked_vcpu_on_cpu_lock, vmx->pi_pre_cpu),
+			  flags);
+	list_del(&vmx->pi_blocked_list);
+	spin_unlock_irqrestore(&per_cpu(blocked_vcpu_on_cpu_lock,
+					vmx->pi_pre_cpu), flags);
+	vmx->pi_pre_cpu = -1;
+}
+
+/*
+ * Before a vCPU with posted device interrupts blocks, make the IOMMU
+ * notify it with POSTED_INTR_WAKEUP_VECTOR on this CPU, where
+ * pi_wakeup_handler() finds it on the blocked list. Returns nonzero if
+ * an interrupt is already pending and the vCPU must not block.
+ */
+static int vmx_pre_block(struct kvm_vcpu *vcpu)
+{
+	struct vcpu_vmx *vmx = to_vmx(vcpu);
+	struct pi_desc *pi_desc = &vmx->pi_desc;
+	struct pi_desc old, new;
+	unsigned long flags;
+
+	if (!vmx_can_post_device_irqs(vcpu->kvm))
+		return 0;
+
+	vmx->pi_pre_cpu = vcpu->cpu;
+	spin_lock_irqsave(&per_cpu(blocked_vcpu_on_cpu_lock, vmx->pi_pre_cpu),
+			  flags);
+	list_add_tail(&vmx->pi_blocked_list,
+		      &per_cpu(blocked_vcpu_on_cpu, vmx->pi_pre_cpu));
+	spin_unlock_irqrestore(&per_cpu(blocked_vcpu_on_cpu_lock,
+					vmx->pi_pre_cpu), flags);
+
+	do {
+		old.control = new.control = pi_desc->control;
+		new.ndst = pi_ndst(vmx->pi_pre_cpu);
+		new.nv = POSTED_INTR_WAKEUP_VECTOR;
+	} while (cmpxchg(&pi_desc->control, old.control,
+			 new.control) != old.control);
+
+	/* Anything posted before the switch notified the old vector */
+	if (pi_test_on(pi_desc)) {
+		vmx_post_block(vcpu);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Handler for POSTED_INTR_WAKEUP_VECTOR */
+static void pi_wakeup_handler(void)
+{
+	struct vcpu_vmx *vmx;
+	int cpu = smp_processor_id();
+
+	spin_lock(&per_cpu(blocked_vcpu_on_cpu_lock, cpu));
+	list_for_each_entry(vmx, &per_cpu(blocked_vcpu_on_cpu, cpu),
+			    pi_blocked_list)
+		if (pi_test_on(&vmx->pi_desc))
+			kvm_vcpu_kick(&vmx->vcpu);
+	spin_unlock(&per_cpu(blocked_vcpu_on_cpu_lock, cpu));
+}
+
+/*
+ * Post the host interrupt @host_irq straight to the vCPU that the MSI
+ * routed through @guest_irq targets, or remap it to the host again if
+ * the route does not target a single vCPU or @set is false.
+ */
+static int vmx_update_pi_irte(struct kvm *kvm, unsigned int host_irq,
+			      u32 guest_irq, bool set)
+{
+	struct kvm_vcpu *vcpu = NULL;
+	struct vcpu_data vcpu_info;
+	u32 vector;
+
+	if (!vmx_can_post_device_irqs(kvm))
+		return 0;
+
+	if (set)
+		vcpu = kvm_msi_route_single_vcpu(kvm, guest_irq, &vector);
+	if (!vcpu)
+		return irq_remapping_set_vcpu_affinity(host_irq, NULL);
+
+	vcpu_info.pi_desc_addr = __pa(&to_vmx(vcpu)->pi_desc);
+	vcpu_info.vector = vector;
+
+	return irq_remapping_set_vcpu_affinity(host_irq, &vcpu_info);
+}
+
 /*
  * Set up the vmcs's constant host-state fields, i.e., host-state fields that
  * will not change in the lifetime of the guest.
@@ -4581,8 +4765,11 @@ static void vmx_vcpu_reset(struct kvm_vcpu *vcpu)
 
 	kvm_make_request(KVM_REQ_APIC_PAGE_RELOAD, vcpu);
 
-	if (vmx_vm_has_apicv(vcpu->kvm))
+	if (vmx_vm_has_apicv(vcpu->kvm)) {
 		memset(&vmx->pi_desc, 0, sizeof(struct pi_desc));
+		vmx->pi_desc.nv = POSTED_INTR_VECTOR;
+		vmx->pi_desc.ndst = pi_ndst(vcpu->cpu);
+	}
 
 	if (vmx->vpid != 0)
 		vmcs_write16(VIRTUAL_PROCESSOR_ID, vmx->vpid);
@@ -7550,6 +7737,15 @@ static void __noclone vmx_vcpu_run(struct kvm_vcpu *vcpu)
 		vmcs_write32(PLE_WINDOW, vmx->ple_window);
 	}
 
+	/*
+	 * An interrupt an IOMMU posted while this vCPU was outside guest
+	 * mode notified the host instead. Interrupts are disabled here, so
+	 * resending the notification to ourselves makes the CPU process the
+	 * PIR right after VM entry.
+	 */
+	if (vmx_can_post_device_irqs(vcpu->kvm) && pi_test_on(&vmx->pi_desc))
+		apic->send_IPI_self(POSTED_INTR_VECTOR);
+
 	if (vmx->nested.sync_shadow_vmcs) {
 		copy_vmcs12_to_shadow(vmx);
 		vmx->nested.sync_shadow_vmcs = false;
@@ -7783,6 +7979,9 @@ static struct kvm_vcpu *vmx_create_vcpu(struct kvm *kvm, unsigned int id)
 		goto uninit_vcpu;
 	}
 
+	INIT_LIST_HEAD(&vmx->pi_blocked_list);
+	vmx->pi_pre_cpu = -1;
+
 	vmx->loaded_vmcs = &vmx->vmcs01;
 	vmx->loaded_vmcs->vmcs = alloc_vmcs();
 	if (!vmx->loaded_vmcs->vmcs)
@@ -9146,6 +9345,7 @@ static struct kvm_x86_ops vmx_x86_ops = {
 	.hwapic_isr_update = vmx_hwapic_isr_update,
 	.sync_pir_to_irr = vmx_sync_pir_to_irr,
 	.deliver_posted_interrupt = vmx_deliver_posted_interrupt,
+	.update_pi_irte = vmx_update_pi_irte,
 
 	.set_tss_addr = vmx_set_tss_addr,
 	.get_tdp_level = get_ept_level,
@@ -9180,11 +9380,14 @@ static struct kvm_x86_ops vmx_x86_ops = {
 	.check_nested_events = vmx_check_nested_events,
 
 	.sched_in = vmx_sched_in,
+
+	.pre_block = vmx_pre_block,
+	.post_block = vmx_post_block,
 };
 
 static int __init vmx_init(void)
 {
-	int r, i, msr;
+	int r, i, msr, cpu;
 
 	rdmsrl_safe(MSR_EFER, &host_efer);
 
@@ -9243,11 +9446,18 @@ static int __init vmx_init(void)
 
 	set_bit(0, vmx_vpid_bitmap); /* 0 is reserved for host */
 
+	for_each_possible_cpu(cpu) {
+		INIT_LIST_HEAD(&per_cpu(blocked_vcpu_on_cpu, cpu));
+		spin_lock_init(&per_cpu(blocked_vcpu_on_cpu_lock, cpu));
+	}
+
 	r = kvm_init(&vmx_x86_ops, sizeof(struct vcpu_vmx),
 		     __alignof__(struct vcpu_vmx), THIS_MODULE);
 	if (r)
 		goto out7;
 
+	kvm_set_posted_intr_wakeup_handler(pi_wakeup_handler);
+
 #ifdef CONFIG_KEXEC
 	rcu_assign_pointer(crash_vmclear_loaded_vmcss,
 			   crash_vmclear_local_loaded_vmcss);
@@ -9319,6 +9529,8 @@ out:
 
 static void __exit vmx_exit(void)
 {
+	kvm_set_posted_intr_wakeup_handler(NULL);
+
 	free_page((unsigned long)vmx_msr_bitmap_legacy_x2apic);
 	free_page((unsigned long)vmx_msr_bitmap_longmode_x2apic);
 	free_page((unsigned long)vmx_msr_bitmap_legacy);
@@ -140,6 +140,8 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "irq_window", VCPU_STAT(irq_window_exits) },
 	{ "nmi_window", VCPU_STAT(nmi_window_exits) },
 	{ "halt_exits", VCPU_STAT(halt_exits) },
+	{ "halt_successful_poll", VCPU_STAT(halt_successful_poll) },
+	{ "halt_attempted_poll", VCPU_STAT(halt_attempted_poll) },
 	{ "halt_wakeup", VCPU_STAT(halt_wakeup) },
 	{ "hypercalls", VCPU_STAT(hypercalls) },
 	{ "request_irq", VCPU_STAT(request_irq_exits) },
@@ -918,7 +920,7 @@ static u32 msrs_to_save[] = {
 	HV_X64_MSR_GUEST_OS_ID, HV_X64_MSR_HYPERCALL,
 	HV_X64_MSR_TIME_REF_COUNT, HV_X64_MSR_REFERENCE_TSC,
 	HV_X64_MSR_APIC_ASSIST_PAGE, MSR_KVM_ASYNC_PF_EN, MSR_KVM_STEAL_TIME,
-	MSR_KVM_PV_EOI_EN,
+	MSR_KVM_PV_EOI_EN, MSR_KVM_LOCK_HINT,
 	MSR_IA32_SYSENTER_CS, MSR_IA32_SYSENTER_ESP, MSR_IA32_SYSENTER_EIP,
 	MSR_STAR,
 #ifdef CONFIG_X86_64
@@ -2064,6 +2066,40 @@ static void accumulate_steal_time(struct kvm_vcpu *vcpu)
 	vcpu->arch.st.accum_steal = delta;
 }
 
+static u8 __user *steal_time_preempted(struct kvm_vcpu *vcpu)
+{
+	struct gfn_to_hva_cache *ghc = &vcpu->arch.st.stime;
+
+	if (kvm_memslots(vcpu->kvm)->generation != ghc->generation ||
+	    !ghc->memslot || kvm_is_error_hva(ghc->hva))
+		return NULL;
+	return (u8 __user *)ghc->hva + offsetof(struct kvm_steal_time, preempted);
+}
+
+/*
+ * Clear the preempted byte and return what it held.  The guest sets
+ * KVM_VCPU_FLUSH_TLB there with a cmpxchg while the vCPU is out, so this
+ * has to be an atomic exchange on guest memory, not on our copy.
+ */
+static u8 steal_time_clear_preempted(struct kvm_vcpu *vcpu)
+{
+	u8 __user *p = steal_time_preempted(vcpu);
+	u8 old = vcpu->arch.st.steal.preempted, cur;
+
+	/* Without access to the byte, flushing is the safe answer */
+	if (!p)
+		return old | KVM_VCPU_FLUSH_TLB;
+
+	while (old) {
+		if (user_atomic_cmpxchg_inatomic(&cur, p, old, 0))
+			return old | KVM_VCPU_FLUSH_TLB;
+		if (cur == old)
+			break;
+		old = cur;
+	}
+	return old;
+}
+
 static void record_steal_time(struct kvm_vcpu *vcpu)
 {
 	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
@@ -2073,6 +2109,14 @@ static void record_steal_time(struct kvm_vcpu *vcpu)
 		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time))))
 		return;
 
+	/*
+	 * Doing the TLB flush here, on behalf of the guest, saved it an IPI
+	 * to this vCPU while it was not running.
+	 */
+	if (steal_time_clear_preempted(vcpu) & KVM_VCPU_FLUSH_TLB)
+		kvm_make_request(KVM_REQ_TLB_FLUSH, vcpu);
+	vcpu->arch.st.steal.preempted = 0;
+
 	vcpu->arch.st.steal.steal += vcpu->arch.st.accum_steal;
 	vcpu->arch.st.steal.version += 2;
 	vcpu->arch.st.accum_steal = 0;
@@ -2212,6 +2256,19 @@ int kvm_set_msr_common(struct kvm_vcpu *vcpu, struct msr_data *msr_info)
 		if (kvm_lapic_enable_pv_eoi(vcpu, data))
 			return 1;
 		break;
+	case MSR_KVM_LOCK_HINT:
+		if (data & KVM_LOCK_HINT_RESERVED_MASK)
+			return 1;
+
+		if ((data & KVM_MSR_ENABLED) &&
+		    kvm_gfn_to_hva_cache_init(vcpu->kvm,
+					      &vcpu->arch.lock_hint.data,
+					      data & KVM_LOCK_HINT_VALID_BITS,
+					      sizeof(struct kvm_lock_hint)))
+			return 1;
+
+		vcpu->arch.lock_hint.msr_val = data;
+		break;
 
 	case MSR_IA32_MCG_CTL:
 	case MSR_IA32_MCG_STATUS:
@@ -2557,6 +2614,9 @@ int kvm_get_msr_common(struct kvm_vcpu *vcpu, u32 msr, u64 *pdata)
 	case MSR_KVM_PV_EOI_EN:
 		data = vcpu->arch.pv_eoi.msr_val;
 		break;
+	case MSR_KVM_LOCK_HINT:
+		data = vcpu->arch.lock_hint.msr_val;
+		break;
 	case MSR_IA32_P5_MC_ADDR:
 	case MSR_IA32_P5_MC_TYPE:
 	case MSR_IA32_MCG_CAP:
@@ -2909,8 +2969,64 @@ void kvm_arch_vcpu_load(struct kvm_vcpu *vcpu, int cpu)
 	kvm_make_request(KVM_REQ_STEAL_UPDATE, vcpu);
 }
 
+static void kvm_steal_time_set_preempted(struct kvm_vcpu *vcpu)
+{
+	u8 __user *p;
+	int idx;
+
+	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
+		return;
+
+	/*
+	 * This runs in atomic context, so the write is skipped if the cache
+	 * needs refreshing or the page is not present.  The guest then just
+	 * keeps sending IPIs to this vCPU.
+	 */
+	idx = srcu_read_lock(&vcpu->kvm->srcu);
+	p = steal_time_preempted(vcpu);
+	if (p) {
+		pagefault_disable();
+		if (!__put_user(KVM_VCPU_PREEMPTED, p)) {
+			vcpu->arch.st.steal.preempted = KVM_VCPU_PREEMPTED;
+			mark_page_dirty(vcpu->kvm,
+					vcpu->arch.st.stime.gpa >> PAGE_SHIFT);
+		}
+		pagefault_enable();
+	}
+	srcu_read_unlock(&vcpu->kvm->srcu, idx);
+}
+
+/*
+ * Does @vcpu say it holds a spinlock that other vCPUs are waiting for?
+ * This is called from the pause loop exit of another vCPU, so the hint
+ * is read without faulting the page in or refreshing the cache; either
+ * of those just means no hint.  The caller holds kvm->srcu.
+ */
+bool kvm_arch_vcpu_holds_contended_lock(struct kvm_vcpu *vcpu)
+{
+	struct gfn_to_hva_cache *ghc = &vcpu->arch.lock_hint.data;
+	u32 __user *p;
+	u32 contended;
+	bool ret;
+
+	if (!(vcpu->arch.lock_hint.msr_val & KVM_MSR_ENABLED))
+		return false;
+
+	if (kvm_memslots(vcpu->kvm)->generation != ghc->generation ||
+	    !ghc->memslot || kvm_is_error_hva(ghc->hva))
+		return false;
+
+	p = (u32 __user *)(ghc->hva + offsetof(struct kvm_lock_hint,
+					       contended));
+	pagefault_disable();
+	ret = !__get_user(contended, p) && contended;
+	pagefault_enable();
+	return ret;
+}
+
 void kvm_arch_vcpu_put(struct kvm_vcpu *vcpu)
 {
+	kvm_steal_time_set_preempted(vcpu);
 	kvm_x86_ops->vcpu_put(vcpu);
 	kvm_put_guest_fpu(vcpu);
 	vcpu->arch.last_host_tsc = native_read_tsc();
@@ -3698,7 +3814,7 @@ int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm, struct kvm_dirty_log *log)
 	dirty_bitmap_buffer = dirty_bitmap + n / sizeof(long);
 	memset(dirty_bitmap_buffer, 0, n);
 
-	spin_lock(&kvm->mmu_lock);
+	write_lock(&kvm->mmu_lock);
 
 	for (i = 0; i < n / sizeof(long); i++) {
 		unsigned long mask;
@@ -3716,7 +3832,7 @@ int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm, struct kvm_dirty_log *log)
 		kvm_mmu_write_protect_pt_masked(kvm, memslot, offset, mask);
 	}
 
-	spin_unlock(&kvm->mmu_lock);
+	write_unlock(&kvm->mmu_lock);
 
 	/* See the comments in kvm_mmu_slot_remove_write_access(). */
 	lockdep_assert_held(&kvm->slots_lock);
@@ -3738,6 +3854,14 @@ out:
 	return r;
 }
 
+void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
+					     struct kvm_memory_slot *slot,
+					     gfn_t gfn_offset,
+					     unsigned long mask)
+{
+	kvm_mmu_write_protect_pt_masked(kvm, slot, gfn_offset, mask);
+}
+
 int kvm_vm_ioctl_irq_line(struct kvm *kvm, struct kvm_irq_level *irq_event,
 			bool line_status)
 {
@@ -5088,9 +5212,9 @@ static bool reexecute_instruction(struct kvm_vcpu *vcpu, gva_t cr2,
 	if (vcpu->arch.mmu.direct_map) {
 		unsigned int indirect_shadow_pages;
 
-		spin_lock(&vcpu->kvm->mmu_lock);
+		write_lock(&vcpu->kvm->mmu_lock);
 		indirect_shadow_pages = vcpu->kvm->arch.indirect_shadow_pages;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 
 		if (indirect_shadow_pages)
 			kvm_mmu_unprotect_page(vcpu->kvm, gpa_to_gfn(gpa));
@@ -6100,6 +6224,14 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 		vcpu->run->request_interrupt_window;
 	bool req_immediate_exit = false;
 
+	/* Let userspace harvest the ring before it overflows */
+	if (unlikely(vcpu->kvm->dirty_ring_size &&
+		     kvm_dirty_ring_soft_full(&vcpu->dirty_ring))) {
+		vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+		r = 0;
+		goto out;
+	}
+
 	if (vcpu->requests) {
 		if (kvm_check_request(KVM_REQ_MMU_RELOAD, vcpu))
 			kvm_mmu_unload(vcpu);
@@ -6321,7 +6453,13 @@ static int __vcpu_run(struct kvm_vcpu *vcpu)
 			r = vcpu_enter_guest(vcpu);
 		else {
 			srcu_read_unlock(&kvm->srcu, vcpu->srcu_idx);
-			kvm_vcpu_block(vcpu);
+			if (!kvm_x86_ops->pre_block ||
+			    !kvm_x86_ops->pre_block(vcpu)) {
+				kvm_vcpu_block(vcpu);
+				if (kvm_x86_ops->post_block)
+					kvm_x86_ops->post_block(vcpu);
+			} else
+				kvm_make_request(KVM_REQ_UNHALT, vcpu);
 			vcpu->srcu_idx = srcu_read_lock(&kvm->srcu);
 			if (kvm_check_request(KVM_REQ_UNHALT, vcpu)) {
 				kvm_apic_accept_events(vcpu);
@@ -7008,6 +7146,7 @@ void kvm_vcpu_reset(struct kvm_vcpu *vcpu)
 	kvm_make_request(KVM_REQ_EVENT, vcpu);
 	vcpu->arch.apf.msr_val = 0;
 	vcpu->arch.st.msr_val = 0;
+	vcpu->arch.lock_hint.msr_val = 0;
 
 	kvmclock_reset(vcpu);
 
@@ -7259,6 +7398,7 @@ int kvm_arch_init_vm(struct kvm *kvm, unsigned long type)
 	INIT_LIST_HEAD(&kvm->arch.active_mmu_pages);
 	INIT_LIST_HEAD(&kvm->arch.zapped_obsolete_pages);
 	INIT_LIST_HEAD(&kvm->arch.assigned_dev_head);
+	kvm_mmu_init_vm(kvm);
 	atomic_set(&kvm->arch.noncoherent_dma_count, 0);
 
 	/* Reserve bit 0 of irq_sources_bitmap for userspace irq source */
@@ -7342,6 +7482,7 @@ void kvm_arch_destroy_vm(struct kvm *kvm)
 	kfree(kvm->arch.vpic);
 	kfree(kvm->arch.vioapic);
 	kvm_free_vcpus(kvm);
+	kvm_mmu_uninit_vm(kvm);
 	kfree(rcu_dereference_check(kvm->arch.apic_map, 1));
 }
 
@@ -7731,6 +7872,15 @@ bool kvm_arch_has_noncoherent_dma(struct kvm *kvm)
 }
 EXPORT_SYMBOL_GPL(kvm_arch_has_noncoherent_dma);
 
+int kvm_arch_update_irq_posting(struct kvm *kvm, unsigned int host_irq,
+				u32 guest_irq, bool set)
+{
+	if (!kvm_x86_ops->update_pi_irte)
+		return 0;
+
+	return kvm_x86_ops->update_pi_irte(kvm, host_irq, guest_irq, set);
+}
+
 EXPORT_TRACEPOINT_SYMBOL_GPL(kvm_exit);
 EXPORT_TRACEPOINT_SYMBOL_GPL(kvm_inj_virq);
 EXPORT_TRACEPOINT_SYMBOL_GPL(kvm_page_fault);
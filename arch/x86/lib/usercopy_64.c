@@ -6,7 +6,42 @@
  * Copyright 2002 Andi Kleen <ak@suse.de>
  */
 #include <linux/module.h>
+#include <linux/init.h>
 #include <asm/uaccess.h>
+#include <asm/processor.h>
+
+/*
+ * Copies of at least this many bytes use non-temporal stores, so that data
+ * the consumer streams through once does not push the working set out of
+ * the last level cache. It defaults to half the LLC which a single copy
+ * would mostly flush anyway, "copy_user_nt=" overrides it and 0 disables.
+ */
+#define COPY_USER_NT_MIN	(64U << 10)
+
+unsigned int copy_user_nt_threshold __read_mostly = UINT_MAX;
+EXPORT_SYMBOL(copy_user_nt_threshold);
+
+static bool copy_user_nt_set __initdata;
+
+static int __init copy_user_nt_setup(char *str)
+{
+	unsigned long long size = memparse(str, &str);
+
+	copy_user_nt_threshold = size && size < UINT_MAX ? size : UINT_MAX;
+	copy_user_nt_set = true;
+	return 1;
+}
+__setup("copy_user_nt=", copy_user_nt_setup);
+
+static int __init copy_user_nt_init(void)
+{
+	int llc = boot_cpu_data.x86_cache_size;
+
+	if (!copy_user_nt_set && llc > 0)
+		copy_user_nt_threshold = max(llc * 1024U / 2, COPY_USER_NT_MIN);
+	return 0;
+}
+core_initcall(copy_user_nt_init);
 
 /*
  * Zero Userspace
@@ -1159,6 +1159,45 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & PF_WRITE)
 		flags |= FAULT_FLAG_WRITE;
 
+#ifdef CONFIG_PER_VMA_LOCK
+	if (!(flags & FAULT_FLAG_USER))
+		goto lock_mmap;
+
+	vma = lock_vma_under_rcu(mm, address);
+	if (!vma)
+		goto lock_mmap;
+
+	if (unlikely(access_error(error_code, vma))) {
+		vma_end_read(vma);
+		goto lock_mmap;
+	}
+
+	/*
+	 * Without FAULT_FLAG_ALLOW_RETRY the fault handlers never try to
+	 * drop mmap_sem, which we do not hold.  Errors are left for the
+	 * mmap_sem path below to report, as mm_fault_error() expects it.
+	 */
+	fault = handle_mm_fault(mm, vma, address,
+				flags & ~(FAULT_FLAG_ALLOW_RETRY |
+					  FAULT_FLAG_KILLABLE));
+	vma_end_read(vma);
+
+	if (likely(!(fault & (VM_FAULT_ERROR | VM_FAULT_RETRY)))) {
+		if (fault & VM_FAULT_MAJOR) {
+			tsk->maj_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1,
+				      regs, address);
+		} else {
+			tsk->min_flt++;
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1,
+				      regs, address);
+		}
+		check_v8086_mode(regs, address, tsk);
+		return;
+	}
+lock_mmap:
+#endif /* CONFIG_PER_VMA_LOCK */
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
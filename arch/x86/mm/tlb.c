@@ -107,7 +107,8 @@ static void flush_tlb_func(void *info)
 
 	inc_irq_stat(irq_tlb_count);
 
-	if (f->flush_mm != this_cpu_read(cpu_tlbstate.active_mm))
+	/* a NULL flush_mm is a batched flush of whatever mm is active */
+	if (f->flush_mm && f->flush_mm != this_cpu_read(cpu_tlbstate.active_mm))
 		return;
 	if (!f->flush_end)
 		f->flush_end = f->flush_start + PAGE_SIZE;
@@ -156,6 +157,29 @@ void native_flush_tlb_others(const struct cpumask *cpumask,
 	smp_call_function_many(cpumask, flush_tlb_func, &info, 1);
 }
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * Flush the TLBs of all CPUs recorded in @batch at once, with a single
+ * IPI per CPU, no matter how many mms and pages were unmapped.
+ */
+void arch_tlbbatch_flush(struct arch_tlbflush_unmap_batch *batch)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, &batch->cpumask)) {
+		count_vm_tlb_event(NR_TLB_LOCAL_FLUSH_ALL);
+		local_flush_tlb();
+		trace_tlb_flush(TLB_LOCAL_SHOOTDOWN, TLB_FLUSH_ALL);
+	}
+
+	if (cpumask_any_but(&batch->cpumask, cpu) < nr_cpu_ids)
+		flush_tlb_others(&batch->cpumask, NULL, 0UL, TLB_FLUSH_ALL);
+
+	cpumask_clear(&batch->cpumask);
+	put_cpu();
+}
+#endif
+
 void flush_tlb_current_task(void)
 {
 	struct mm_struct *mm = current->mm;
@@ -10,6 +10,7 @@
  */
 #include <linux/netdevice.h>
 #include <linux/filter.h>
+#include <linux/bpf.h>
 #include <linux/if_vlan.h>
 #include <asm/cacheflush.h>
 
@@ -186,6 +187,70 @@ struct jit_context {
 #define BPF_MAX_INSN_SIZE	128
 #define BPF_INSN_SAFETY		64
 
+#define STACKSIZE \
+	(MAX_BPF_STACK + \
+	 32 /* space for rbx, r13, r14, r15 */ + \
+	 8 /* space for skb_copy_bits() buffer */)
+
+/* the part of the prologue skipped by tail calls, which reuse the stack
+ * frame of the caller
+ */
+#define PROLOGUE_SIZE 51
+
+/* the tail call count lives in the upper half of the skb_copy_bits()
+ * buffer, which is at most 4 bytes wide
+ */
+#define TAIL_CALL_CNT_OFF (-STACKSIZE + 36)
+
+/* generate the following code:
+ *
+ *   if (index >= array->map.max_entries)
+ *     goto out;
+ *   if (tail_call_cnt > MAX_TAIL_CALL_CNT)
+ *     goto out;
+ *   tail_call_cnt++;
+ *   prog = array->prog[index];
+ *   if (prog == NULL)
+ *     goto out;
+ *   goto *(prog->bpf_func + PROLOGUE_SIZE);
+ * out:
+ *
+ * with rdi holding ctx, rsi the pointer to bpf_array and rdx the index
+ */
+static void emit_bpf_tail_call(u8 **pprog)
+{
+	u8 *prog = *pprog;
+
+	/* the jump offsets below are the number of bytes up to 'out' */
+
+	EMIT2(0x89, 0xD2); /* mov edx, edx */
+	/* cmp dword ptr [rsi + off], edx */
+	EMIT3(0x39, 0x56, offsetof(struct bpf_array, map.max_entries));
+	EMIT2(X86_JBE, 47); /* jbe out */
+
+	/* mov eax, dword ptr [rbp - X] */
+	EMIT2_off32(0x8B, 0x85, TAIL_CALL_CNT_OFF);
+	EMIT3(0x83, 0xF8, MAX_TAIL_CALL_CNT); /* cmp eax, MAX_TAIL_CALL_CNT */
+	EMIT2(X86_JA, 36); /* ja out */
+	EMIT3(0x83, 0xC0, 0x01); /* add eax, 1 */
+	/* mov dword ptr [rbp - X], eax */
+	EMIT2_off32(0x89, 0x85, TAIL_CALL_CNT_OFF);
+
+	/* lea rax, [rsi + rdx * 8 + off] */
+	EMIT4_off32(0x48, 0x8D, 0x84, 0xD6, offsetof(struct bpf_array, prog));
+	EMIT3(0x48, 0x8B, 0x00); /* mov rax, qword ptr [rax] */
+	EMIT4(0x48, 0x83, 0xF8, 0x00); /* cmp rax, 0 */
+	EMIT2(X86_JE, 10); /* je out */
+
+	/* mov rax, qword ptr [rax + off] */
+	EMIT4(0x48, 0x8B, 0x40, offsetof(struct bpf_prog, bpf_func));
+	EMIT4(0x48, 0x83, 0xC0, PROLOGUE_SIZE); /* add rax, PROLOGUE_SIZE */
+	EMIT2(0xFF, 0xE0); /* jmp rax */
+
+	/* out: */
+	*pprog = prog;
+}
+
 static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		  int oldproglen, struct jit_context *ctx)
 {
@@ -196,9 +261,7 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 	int i;
 	int proglen = 0;
 	u8 *prog = temp;
-	int stacksize = MAX_BPF_STACK +
-		32 /* space for rbx, r13, r14, r15 */ +
-		8 /* space for skb_copy_bits() buffer */;
+	int stacksize = STACKSIZE;
 
 	EMIT1(0x55); /* push rbp */
 	EMIT3(0x48, 0x89, 0xE5); /* mov rbp,rsp */
@@ -230,6 +293,16 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 	EMIT2(0x31, 0xc0); /* xor eax, eax */
 	EMIT3(0x4D, 0x31, 0xED); /* xor r13, r13 */
 
+	/* clear tail_call_cnt: mov qword ptr [rbp-X], rax */
+	EMIT3_off32(0x48, 0x89, 0x85, -stacksize + 32);
+
+	/* tail calls jump right here */
+	if (prog - temp != PROLOGUE_SIZE) {
+		pr_err("bpf_jit: prologue size %d != %d\n",
+		       (int)(prog - temp), PROLOGUE_SIZE);
+		return -EFAULT;
+	}
+
 	if (seen_ld_abs) {
 		/* r9d : skb->len - skb->data_len (headlen)
 		 * r10 : skb->data
@@ -710,6 +783,10 @@ xadd:			if (is_imm8(insn->off))
 			}
 			break;
 
+		case BPF_JMP | BPF_CALL | BPF_X:
+			emit_bpf_tail_call(&prog);
+			break;
+
 			/* cond jump */
 		case BPF_JMP | BPF_JEQ | BPF_X:
 		case BPF_JMP | BPF_JNE | BPF_X:
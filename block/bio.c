@@ -31,6 +31,7 @@
 #include <scsi/sg.h>		/* for struct sg_iovec */
 
 #include <trace/events/block.h>
+#include "blk.h"
 
 /*
  * Test patch to inline a certain number of bi_io_vec's inside the bio
@@ -271,6 +272,7 @@ void bio_init(struct bio *bio)
 {
 	memset(bio, 0, sizeof(*bio));
 	bio->bi_flags = 1 << BIO_UPTODATE;
+	bio->bi_cookie = BLK_QC_T_NONE;
 	atomic_set(&bio->bi_remaining, 1);
 	atomic_set(&bio->bi_cnt, 1);
 }
@@ -294,6 +296,7 @@ void bio_reset(struct bio *bio)
 
 	memset(bio, 0, BIO_RESET_BYTES);
 	bio->bi_flags = flags|(1 << BIO_UPTODATE);
+	bio->bi_cookie = BLK_QC_T_NONE;
 	atomic_set(&bio->bi_remaining, 1);
 }
 EXPORT_SYMBOL(bio_reset);
@@ -1778,6 +1781,8 @@ void bio_endio(struct bio *bio, int error)
 		if (!atomic_dec_and_test(&bio->bi_remaining))
 			return;
 
+		blk_throtl_bio_endio(bio);
+
 		/*
 		 * Need to have a real endio function for chained bios,
 		 * otherwise various corner cases will break (like stacking
@@ -2020,6 +2025,25 @@ int bio_associate_current(struct bio *bio)
 	return 0;
 }
 
+/**
+ * bio_associate_blkcg - associate a bio with a blkcg
+ * @bio: target bio
+ * @blkcg_css: css of the blkcg to associate
+ *
+ * Associate @bio with the blkcg of @blkcg_css, for I/O issued on behalf
+ * of a blkcg other than %current's, such as per-blkcg writeback.  Takes a
+ * reference on @blkcg_css which is put when @bio is released.
+ */
+int bio_associate_blkcg(struct bio *bio, struct cgroup_subsys_state *blkcg_css)
+{
+	if (unlikely(bio->bi_css))
+		return -EBUSY;
+	css_get(blkcg_css);
+	bio->bi_css = blkcg_css;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bio_associate_blkcg);
+
 /**
  * bio_disassociate_task - undo bio_associate_current()
  * @bio: target bio
@@ -19,6 +19,7 @@
 #include <linux/genhd.h>
 #include <linux/delay.h>
 #include <linux/atomic.h>
+#include <linux/backing-dev.h>
 #include "blk-cgroup.h"
 #include "blk.h"
 
@@ -441,6 +442,22 @@ struct request_list *__blk_queue_next_rl(struct request_list *rl,
 	return &blkg->rl;
 }
 
+/**
+ * blk_rq_blkcg_css - css of the blkcg a request was allocated for
+ * @rq: request of interest
+ *
+ * Returns %NULL if @rq didn't come from a blkcg request_list, which is the
+ * case for blk-mq requests.  The css stays valid as long as @rq is alive.
+ */
+struct cgroup_subsys_state *blk_rq_blkcg_css(struct request *rq)
+{
+	struct request_list *rl = blk_rq_rl(rq);
+
+	if (!rl || !rl->blkg)
+		return NULL;
+	return &rl->blkg->blkcg->css;
+}
+
 static int blkcg_reset_stats(struct cgroup_subsys_state *css,
 			     struct cftype *cftype, u64 val)
 {
@@ -809,6 +826,8 @@ static void blkcg_css_offline(struct cgroup_subsys_state *css)
 	}
 
 	spin_unlock_irq(&blkcg->lock);
+
+	wb_blkcg_offline(css);
 }
 
 static void blkcg_css_free(struct cgroup_subsys_state *css)
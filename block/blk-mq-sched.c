@@ -0,0 +1,176 @@
+/*
+ * blk-mq io scheduler framework
+ *
+ * An io scheduler attached to a blk-mq queue keeps its requests per
+ * hardware queue. Requests reach it when a hardware queue is run and the
+ * software queues are flushed, and are handed back one at a time as long
+ * as the driver accepts them.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/blktrace_api.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+
+/*
+ * Flush sequences and passthrough commands bypass the scheduler and are
+ * issued in the order they were queued.
+ */
+static bool blk_mq_sched_bypass_insert(struct request *rq)
+{
+	return (rq->cmd_flags & REQ_FLUSH_SEQ) || rq->cmd_type != REQ_TYPE_FS;
+}
+
+/*
+ * Hand the requests on @list to the io scheduler. Requests that must not
+ * be reordered are left on @list for immediate dispatch.
+ */
+void blk_mq_sched_insert_requests(struct blk_mq_hw_ctx *hctx,
+				  struct list_head *list)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+	struct request *rq, *next;
+	LIST_HEAD(sched_list);
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		if (!blk_mq_sched_bypass_insert(rq))
+			list_move_tail(&rq->queuelist, &sched_list);
+	}
+
+	if (!list_empty(&sched_list))
+		e->type->mq_ops.insert_requests(hctx, &sched_list, false);
+}
+
+static void blk_mq_sched_exit_hctxs(struct request_queue *q,
+				    struct elevator_queue *e, unsigned int nr)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (!e->type->mq_ops.exit_hctx)
+		return;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (i == nr)
+			break;
+		e->type->mq_ops.exit_hctx(hctx, i);
+	}
+}
+
+static int blk_mq_sched_alloc(struct request_queue *q, struct elevator_type *e)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+	int ret;
+
+	/* allocates q->elevator, and drops the reference to @e on failure */
+	ret = e->mq_ops.init_sched(q, e);
+	if (ret)
+		return ret;
+
+	if (!e->mq_ops.init_hctx)
+		return 0;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		ret = e->mq_ops.init_hctx(hctx, i);
+		if (ret) {
+			blk_mq_sched_exit_hctxs(q, q->elevator, i);
+			elevator_exit(q->elevator);
+			q->elevator = NULL;
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void blk_mq_sched_free(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+
+	blk_mq_sched_exit_hctxs(q, e, q->nr_hw_queues);
+	q->elevator = NULL;
+	elevator_exit(e);
+}
+
+/*
+ * Make sure nobody is running a hardware queue, so the scheduler can be
+ * changed underneath it. The queue must be frozen already, so no new
+ * requests show up and nothing is left to dispatch.
+ */
+static void blk_mq_sched_quiesce(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	blk_mq_stop_hw_queues(q);
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->run_work);
+		cancel_delayed_work_sync(&hctx->delay_work);
+	}
+
+	/* direct runs happen with preemption disabled */
+	synchronize_sched();
+}
+
+/**
+ * blk_mq_sched_switch - attach a new io scheduler to a blk-mq queue
+ * @q:		the queue
+ * @new_e:	the scheduler to attach, or NULL to detach the current one
+ *
+ * Must be called with q->sysfs_lock held. The queue is drained first, so
+ * neither scheduler ever holds a request across the switch. On failure
+ * the queue is left without a scheduler.
+ */
+int blk_mq_sched_switch(struct request_queue *q, struct elevator_type *new_e)
+{
+	struct elevator_queue *old = q->elevator;
+	int ret = 0;
+
+	lockdep_assert_held(&q->sysfs_lock);
+
+	blk_mq_freeze_queue(q);
+	blk_mq_sched_quiesce(q);
+
+	if (old) {
+		if (old->registered)
+			elv_unregister_queue(q);
+		blk_mq_sched_free(q);
+	}
+
+	if (new_e) {
+		ret = blk_mq_sched_alloc(q, new_e);
+		if (!ret && q->kobj.state_in_sysfs) {
+			ret = elv_register_queue(q);
+			if (ret)
+				blk_mq_sched_free(q);
+		}
+	}
+
+	blk_mq_start_hw_queues(q);
+	blk_mq_unfreeze_queue(q);
+
+	if (ret)
+		pr_err("blk-mq: failed to attach io scheduler %s: %d\n",
+		       new_e->elevator_name, ret);
+	else
+		blk_add_trace_msg(q, "elv switch: %s",
+				  new_e ? new_e->elevator_name : "none");
+
+	return ret;
+}
+
+/*
+ * Called when the queue is released, after it was unregistered and all
+ * requests are gone.
+ */
+void blk_mq_sched_teardown(struct request_queue *q)
+{
+	if (q->elevator)
+		blk_mq_sched_free(q);
+}
@@ -0,0 +1,36 @@
+#ifndef BLK_MQ_SCHED_H
+#define BLK_MQ_SCHED_H
+
+#include <linux/elevator.h>
+
+int blk_mq_sched_switch(struct request_queue *q, struct elevator_type *e);
+void blk_mq_sched_teardown(struct request_queue *q);
+void blk_mq_sched_insert_requests(struct blk_mq_hw_ctx *hctx,
+				  struct list_head *list);
+
+static inline bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+
+	return e && e->type->mq_ops.has_work(hctx);
+}
+
+/*
+ * Refill an empty dispatch list with the next request the io scheduler
+ * wants to see issued, if any.
+ */
+static inline void blk_mq_sched_pull_request(struct blk_mq_hw_ctx *hctx,
+					     struct list_head *list)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+	struct request *rq;
+
+	if (!e || !list_empty(list))
+		return;
+
+	rq = e->type->mq_ops.dispatch_request(hctx);
+	if (rq)
+		list_add(&rq->queuelist, list);
+}
+
+#endif
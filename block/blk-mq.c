@@ -21,6 +21,7 @@
 #include <linux/sched/sysctl.h>
 #include <linux/delay.h>
 #include <linux/crash_dump.h>
+#include <linux/hrtimer.h>
 
 #include <trace/events/block.h>
 
@@ -28,6 +29,8 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
+#include "blk-wbt.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
@@ -77,7 +80,7 @@ static void blk_mq_hctx_clear_pending(struct blk_mq_hw_ctx *hctx,
 	clear_bit(CTX_TO_BIT(hctx, ctx), &bm->word);
 }
 
-static int blk_mq_queue_enter(struct request_queue *q)
+static int blk_mq_queue_enter(struct request_queue *q, gfp_t gfp)
 {
 	while (true) {
 		int ret;
@@ -85,6 +88,9 @@ static int blk_mq_queue_enter(struct request_queue *q)
 		if (percpu_ref_tryget_live(&q->mq_usage_counter))
 			return 0;
 
+		if (!(gfp & __GFP_WAIT))
+			return -EBUSY;
+
 		ret = wait_event_interruptible(q->mq_freeze_wq,
 				!q->mq_freeze_depth || blk_queue_dying(q));
 		if (blk_queue_dying(q))
@@ -135,8 +141,9 @@ void blk_mq_freeze_queue(struct request_queue *q)
 	blk_mq_freeze_queue_start(q);
 	blk_mq_freeze_queue_wait(q);
 }
+EXPORT_SYMBOL_GPL(blk_mq_freeze_queue);
 
-static void blk_mq_unfreeze_queue(struct request_queue *q)
+void blk_mq_unfreeze_queue(struct request_queue *q)
 {
 	bool wake;
 
@@ -149,6 +156,7 @@ static void blk_mq_unfreeze_queue(struct request_queue *q)
 		wake_up_all(&q->mq_freeze_wq);
 	}
 }
+EXPORT_SYMBOL_GPL(blk_mq_unfreeze_queue);
 
 bool blk_mq_can_queue(struct blk_mq_hw_ctx *hctx)
 {
@@ -196,6 +204,7 @@ static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 
 	INIT_LIST_HEAD(&rq->timeout_list);
 	rq->timeout = 0;
+	rq->issue_time_ns = 0;
 
 	rq->end_io = NULL;
 	rq->end_io_data = NULL;
@@ -236,7 +245,7 @@ struct request *blk_mq_alloc_request(struct request_queue *q, int rw, gfp_t gfp,
 	struct blk_mq_alloc_data alloc_data;
 	int ret;
 
-	ret = blk_mq_queue_enter(q);
+	ret = blk_mq_queue_enter(q, gfp);
 	if (ret)
 		return ERR_PTR(ret);
 
@@ -272,10 +281,12 @@ static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
 
 	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
+	wbt_done(q->rq_wb, rq);
 	rq->cmd_flags = 0;
 
 	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
-	blk_mq_put_tag(hctx, tag, &ctx->last_tag);
+	clear_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+	blk_mq_put_tag(hctx, ctx, tag);
 	blk_mq_queue_exit(q);
 }
 
@@ -346,10 +357,29 @@ static void blk_mq_ipi_complete_request(struct request *rq)
 	put_cpu();
 }
 
+/*
+ * Keep a running mean of the completion time of polled requests, which
+ * sets how long the hybrid poll mode sleeps. Racing updates only lose a
+ * sample.
+ */
+static void blk_mq_poll_stat_add(struct request *rq)
+{
+	u64 *mean = &rq->q->poll_mean_nsec[rq_data_dir(rq)];
+	u64 now = ktime_get_ns(), old = ACCESS_ONCE(*mean);
+	s64 delta = now - rq->issue_time_ns;
+
+	if (delta <= 0)
+		return;
+	ACCESS_ONCE(*mean) = old ? old - (old >> 3) + (delta >> 3) : delta;
+}
+
 void __blk_mq_complete_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
 
+	if (rq->issue_time_ns && blk_queue_poll(q))
+		blk_mq_poll_stat_add(rq);
+
 	if (!q->softirq_done_fn)
 		blk_mq_end_request(rq, rq->errors);
 	else
@@ -381,6 +411,10 @@ void blk_mq_start_request(struct request *rq)
 
 	trace_block_rq_issue(q, rq);
 
+	if (blk_queue_poll(q) || wbt_enabled(q->rq_wb))
+		rq->issue_time_ns = ktime_get_ns();
+	wbt_issue(q->rq_wb, rq);
+
 	rq->resid_len = blk_rq_bytes(rq);
 	if (unlikely(blk_bidi_rq(rq)))
 		rq->next_rq->resid_len = blk_rq_bytes(rq->next_rq);
@@ -700,9 +734,12 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	hctx->run++;
 
 	/*
-	 * Touch any software queue that has pending entries.
+	 * Touch any software queue that has pending entries. With an io
+	 * scheduler attached, it takes over everything it may reorder.
 	 */
 	flush_busy_ctxs(hctx, &rq_list);
+	if (q->elevator && !list_empty(&rq_list))
+		blk_mq_sched_insert_requests(hctx, &rq_list);
 
 	/*
 	 * If we have previous entries on our dispatch list, grab them
@@ -716,15 +753,24 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	}
 
 	/*
-	 * Now process all the entries, sending them to the driver.
+	 * Now process all the entries, sending them to the driver. Once
+	 * the local list is empty, keep pulling from the scheduler until
+	 * it runs dry or the driver pushes back.
 	 */
 	queued = 0;
+	blk_mq_sched_pull_request(hctx, &rq_list);
 	while (!list_empty(&rq_list)) {
 		int ret;
 
 		rq = list_first_entry(&rq_list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 
+		/*
+		 * Look ahead into the scheduler, so the driver knows whether
+		 * this is the last request of the batch.
+		 */
+		blk_mq_sched_pull_request(hctx, &rq_list);
+
 		ret = q->mq_ops->queue_rq(hctx, rq, list_empty(&rq_list));
 		switch (ret) {
 		case BLK_MQ_RQ_QUEUE_OK:
@@ -810,7 +856,8 @@ void blk_mq_run_queues(struct request_queue *q, bool async)
 
 	queue_for_each_hw_ctx(q, hctx, i) {
 		if ((!blk_mq_hctx_has_pending(hctx) &&
-		    list_empty_careful(&hctx->dispatch)) ||
+		    list_empty_careful(&hctx->dispatch) &&
+		    !blk_mq_sched_has_work(hctx)) ||
 		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
 			continue;
 
@@ -1098,7 +1145,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 	int rw = bio_data_dir(bio);
 	struct blk_mq_alloc_data alloc_data;
 
-	if (unlikely(blk_mq_queue_enter(q))) {
+	if (unlikely(blk_mq_queue_enter(q, GFP_KERNEL))) {
 		bio_endio(bio, -EIO);
 		return NULL;
 	}
@@ -1144,6 +1191,7 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
 	struct blk_map_ctx data;
 	struct request *rq;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1152,9 +1200,17 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		return;
 	}
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
+	bio->bi_cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1162,7 +1218,11 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		goto run_queue;
 	}
 
-	if (is_sync) {
+	/*
+	 * Sync IO goes straight to the driver, unless an io scheduler wants
+	 * to decide the dispatch order.
+	 */
+	if (is_sync && !q->elevator) {
 		int ret;
 
 		blk_mq_bio_to_request(rq, bio);
@@ -1211,6 +1271,7 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int use_plug, request_count = 0;
 	struct blk_map_ctx data;
 	struct request *rq;
+	bool wb_acct;
 
 	/*
 	 * If we have multiple hardware queues, just go directly to
@@ -1229,9 +1290,17 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count))
 		return;
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
+	bio->bi_cookie = blk_tag_to_qc_t(rq->tag, data.hctx->queue_num);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1275,6 +1344,117 @@ run_queue:
 	blk_mq_put_ctx(data.ctx);
 }
 
+/*
+ * Sleep for part of the expected completion time before starting to poll,
+ * so a spinning submitter does not burn a CPU for the whole request.
+ * Returns true if we slept, in which case the caller should check for
+ * completion before polling.
+ */
+static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
+				     struct request *rq)
+{
+	struct hrtimer_sleeper hs;
+	enum hrtimer_mode mode;
+	u64 nsecs;
+
+	/* only sleep once per request, then poll */
+	if (test_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags))
+		return false;
+
+	if (q->poll_nsec > 0)
+		nsecs = q->poll_nsec;
+	else
+		nsecs = ACCESS_ONCE(q->poll_mean_nsec[rq_data_dir(rq)]) / 2;
+	if (!nsecs)
+		return false;
+
+	set_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+
+	mode = HRTIMER_MODE_REL;
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, mode);
+	hrtimer_set_expires(&hs.timer, ns_to_ktime(nsecs));
+	hrtimer_init_sleeper(&hs, current);
+	do {
+		if (test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
+			break;
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		hrtimer_start_expires(&hs.timer, mode);
+		if (hs.task)
+			io_schedule();
+		hrtimer_cancel(&hs.timer);
+		mode = HRTIMER_MODE_ABS;
+	} while (hs.task && !signal_pending(current));
+
+	__set_current_state(TASK_RUNNING);
+	destroy_hrtimer_on_stack(&hs.timer);
+	return true;
+}
+
+/**
+ * blk_poll - poll for the completion of a request
+ * @q:		the queue the bio was issued to
+ * @cookie:	the bio's ->bi_cookie
+ *
+ * Description:
+ *	Called by a task that has issued a bio and set itself to sleep
+ *	until it completes. Instead of waiting for the interrupt, reap
+ *	completions from the hardware queue directly until our task is
+ *	woken up. Returns true if the task may be running again, false if
+ *	polling is not possible and the caller should sleep.
+ **/
+bool blk_poll(struct request_queue *q, blk_qc_t cookie)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_plug *plug;
+	long state;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_qc_t_valid(cookie) ||
+	    !blk_queue_poll(q))
+		return false;
+
+	plug = current->plug;
+	if (plug)
+		blk_flush_plug_list(plug, false);
+
+	hctx = q->queue_hw_ctx[blk_qc_t_to_queue_num(cookie)];
+
+	if (q->poll_nsec >= 0) {
+		struct request *rq;
+
+		rq = blk_mq_tag_to_rq(hctx->tags, blk_qc_t_to_tag(cookie));
+		if (blk_mq_poll_hybrid_sleep(q, rq))
+			return true;
+	}
+
+	hctx->poll_considered++;
+
+	state = current->state;
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+
+		ret = q->mq_ops->poll(hctx, blk_qc_t_to_tag(cookie));
+		if (ret > 0) {
+			hctx->poll_success++;
+			set_current_state(TASK_RUNNING);
+			return true;
+		}
+
+		if (signal_pending_state(state, current))
+			set_current_state(TASK_RUNNING);
+
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
 /*
  * Default mapping to a software queue, since we use one per CPU.
  */
@@ -1845,6 +2025,7 @@ struct request_queue *blk_mq_init_queue(struct blk_mq_tag_set *set)
 
 	q->mq_ops = set->ops;
 	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	q->poll_nsec = -1;
 
 	if (!(set->flags & BLK_MQ_F_SG_MERGE))
 		q->queue_flags |= 1 << QUEUE_FLAG_NO_SG_MERGE;
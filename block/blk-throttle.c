@@ -26,6 +26,26 @@ static struct blkcg_policy blkcg_policy_throtl;
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 
+/*
+ * Floor applied in the low state to groups which don't have a low limit of
+ * their own, so that they can't starve the groups which do.
+ */
+#define MIN_THROTL_BPS (320 * 1024)
+#define MIN_THROTL_IOPS (10)
+
+/* Default idle thresholds, in usecs */
+#define DFL_IDLE_THRESHOLD_SSD (1000L)
+#define DFL_IDLE_THRESHOLD_HD (100L * 1000)
+
+/*
+ * Either the low or the max limits of all groups are in effect at any
+ * given time, see throtl_data->limit_index.
+ */
+enum {
+	LIMIT_LOW,
+	LIMIT_MAX,
+};
+
 /*
  * To implement hierarchical throttling, throtl_grps form a tree and bios
  * are dispatched upwards level by level until they reach the top and get
@@ -133,6 +153,19 @@ struct throtl_grp {
 	/* IOPS limits */
 	unsigned int iops[2];
 
+	/*
+	 * Low limits, 0 if not configured.  While any group has these set,
+	 * they are enforced until every such group either uses up its low
+	 * limit or goes idle, at which point the max limits take over.
+	 */
+	uint64_t bps_low[2];
+	unsigned int iops_low[2];
+
+	/* usecs without IO completions after which the group is idle */
+	uint64_t idletime_threshold;
+	/* usecs of IO latency the group is happy with */
+	uint64_t latency_target;
+
 	/* Number of bytes disptached in current slice */
 	uint64_t bytes_disp[2];
 	/* Number of bio's dispatched in current slice */
@@ -142,6 +175,22 @@ struct throtl_grp {
 	unsigned long slice_start[2];
 	unsigned long slice_end[2];
 
+	/* Bytes and IOs dispatched since the last low limit check */
+	uint64_t last_bytes_disp[2];
+	unsigned int last_io_disp[2];
+	unsigned long last_check_time;
+
+	/* Last time the group dispatched at or above its low limit */
+	unsigned long last_low_overflow_time[2];
+
+	/* Last IO completion, in usecs */
+	u64 last_finish_time;
+
+	/* IOs completed and those among them which missed latency_target */
+	unsigned int bio_cnt;
+	unsigned int bad_bio_cnt;
+	unsigned long bio_cnt_reset_time;
+
 	/* Per cpu stats pointer */
 	struct tg_stats_cpu __percpu *stats_cpu;
 
@@ -166,6 +215,15 @@ struct throtl_data
 
 	/* Work for dispatching throttled bios */
 	struct work_struct dispatch_work;
+
+	/*
+	 * LIMIT_LOW while any group has a low limit configured and the low
+	 * limits are being enforced, LIMIT_MAX otherwise.
+	 */
+	unsigned int limit_index;
+
+	unsigned long low_upgrade_time;
+	unsigned long low_downgrade_time;
 };
 
 /* list and work item to allocate percpu group stats */
@@ -229,6 +287,50 @@ static struct throtl_data *sq_to_td(struct throtl_service_queue *sq)
 		return container_of(sq, struct throtl_data, service_queue);
 }
 
+static bool tg_has_low_limit(struct throtl_grp *tg)
+{
+	return tg->bps_low[READ] || tg->bps_low[WRITE] ||
+	       tg->iops_low[READ] || tg->iops_low[WRITE];
+}
+
+/*
+ * The limits in effect for @tg.  In the low state, groups with a low
+ * limit are held to it, while leaf groups without one get a small floor
+ * so that they only get to use what the protected groups leave idle.  The
+ * root group is never held back by low limits.
+ */
+static uint64_t tg_bps_limit(struct throtl_grp *tg, int rw)
+{
+	struct blkcg_gq *blkg = tg_to_blkg(tg);
+	uint64_t ret = tg->bps[rw];
+
+	if (tg->td->limit_index != LIMIT_LOW || !blkg->parent)
+		return ret;
+
+	if (tg->bps_low[rw])
+		ret = min(ret, tg->bps_low[rw]);
+	else if (!tg->iops_low[rw] &&
+		 list_empty(&blkg->blkcg->css.children))
+		ret = min_t(uint64_t, ret, MIN_THROTL_BPS);
+	return ret;
+}
+
+static unsigned int tg_iops_limit(struct throtl_grp *tg, int rw)
+{
+	struct blkcg_gq *blkg = tg_to_blkg(tg);
+	unsigned int ret = tg->iops[rw];
+
+	if (tg->td->limit_index != LIMIT_LOW || !blkg->parent)
+		return ret;
+
+	if (tg->iops_low[rw])
+		ret = min(ret, tg->iops_low[rw]);
+	else if (!tg->bps_low[rw] &&
+		 list_empty(&blkg->blkcg->css.children))
+		ret = min_t(unsigned int, ret, MIN_THROTL_IOPS);
+	return ret;
+}
+
 /**
  * throtl_log - log debug message via blktrace
  * @sq: the service_queue being reported
@@ -465,9 +567,15 @@ static void tg_update_has_rules(struct throtl_grp *tg)
 	struct throtl_grp *parent_tg = sq_to_tg(tg->service_queue.parent_sq);
 	int rw;
 
+	/*
+	 * Groups with low limits always go through the slow path as we
+	 * need to watch them to decide which limits to enforce.
+	 */
 	for (rw = READ; rw <= WRITE; rw++)
 		tg->has_rules[rw] = (parent_tg && parent_tg->has_rules[rw]) ||
-				    (tg->bps[rw] != -1 || tg->iops[rw] != -1);
+				    tg_has_low_limit(tg) ||
+				    tg_bps_limit(tg, rw) != -1 ||
+				    tg_iops_limit(tg, rw) != -1;
 }
 
 static void throtl_pd_online(struct blkcg_gq *blkg)
@@ -479,6 +587,23 @@ static void throtl_pd_online(struct blkcg_gq *blkg)
 	tg_update_has_rules(blkg_to_tg(blkg));
 }
 
+static void throtl_update_limit_valid(struct throtl_data *td);
+
+static void throtl_pd_offline(struct blkcg_gq *blkg)
+{
+	struct throtl_grp *tg = blkg_to_tg(blkg);
+
+	if (!tg_has_low_limit(tg) || blk_queue_dying(blkg->q))
+		return;
+
+	/* a removed group no longer protects anything */
+	tg->bps_low[READ] = 0;
+	tg->bps_low[WRITE] = 0;
+	tg->iops_low[READ] = 0;
+	tg->iops_low[WRITE] = 0;
+	throtl_update_limit_valid(tg->td);
+}
+
 static void throtl_pd_exit(struct blkcg_gq *blkg)
 {
 	struct throtl_grp *tg = blkg_to_tg(blkg);
@@ -781,11 +906,11 @@ static inline void throtl_trim_slice(struct throtl_grp *tg, bool rw)
 
 	if (!nr_slices)
 		return;
-	tmp = tg->bps[rw] * throtl_slice * nr_slices;
+	tmp = tg_bps_limit(tg, rw) * throtl_slice * nr_slices;
 	do_div(tmp, HZ);
 	bytes_trim = tmp;
 
-	io_trim = (tg->iops[rw] * throtl_slice * nr_slices)/HZ;
+	io_trim = (tg_iops_limit(tg, rw) * throtl_slice * nr_slices)/HZ;
 
 	if (!bytes_trim && !io_trim)
 		return;
@@ -812,6 +937,7 @@ static bool tg_with_in_iops_limit(struct throtl_grp *tg, struct bio *bio,
 				  unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
+	unsigned int iops_limit = tg_iops_limit(tg, rw);
 	unsigned int io_allowed;
 	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
 	u64 tmp;
@@ -831,7 +957,7 @@ static bool tg_with_in_iops_limit(struct throtl_grp *tg, struct bio *bio,
 	 * have been trimmed.
 	 */
 
-	tmp = (u64)tg->iops[rw] * jiffy_elapsed_rnd;
+	tmp = (u64)iops_limit * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 
 	if (tmp > UINT_MAX)
@@ -846,7 +972,7 @@ static bool tg_with_in_iops_limit(struct throtl_grp *tg, struct bio *bio,
 	}
 
 	/* Calc approx time to dispatch */
-	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/tg->iops[rw] + 1;
+	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/iops_limit + 1;
 
 	if (jiffy_wait > jiffy_elapsed)
 		jiffy_wait = jiffy_wait - jiffy_elapsed;
@@ -862,6 +988,7 @@ static bool tg_with_in_bps_limit(struct throtl_grp *tg, struct bio *bio,
 				 unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
+	u64 bps_limit = tg_bps_limit(tg, rw);
 	u64 bytes_allowed, extra_bytes, tmp;
 	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
 
@@ -873,7 +1000,7 @@ static bool tg_with_in_bps_limit(struct throtl_grp *tg, struct bio *bio,
 
 	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
 
-	tmp = tg->bps[rw] * jiffy_elapsed_rnd;
+	tmp = bps_limit * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 	bytes_allowed = tmp;
 
@@ -885,7 +1012,7 @@ static bool tg_with_in_bps_limit(struct throtl_grp *tg, struct bio *bio,
 
 	/* Calc approx time to dispatch */
 	extra_bytes = tg->bytes_disp[rw] + bio->bi_iter.bi_size - bytes_allowed;
-	jiffy_wait = div64_u64(extra_bytes * HZ, tg->bps[rw]);
+	jiffy_wait = div64_u64(extra_bytes * HZ, bps_limit);
 
 	if (!jiffy_wait)
 		jiffy_wait = 1;
@@ -920,7 +1047,7 @@ static bool tg_may_dispatch(struct throtl_grp *tg, struct bio *bio,
 	       bio != throtl_peek_queued(&tg->service_queue.queued[rw]));
 
 	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
+	if (tg_bps_limit(tg, rw) == -1 && tg_iops_limit(tg, rw) == -1) {
 		if (wait)
 			*wait = 0;
 		return true;
@@ -989,6 +1116,8 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	/* Charge the bio to the group */
 	tg->bytes_disp[rw] += bio->bi_iter.bi_size;
 	tg->io_disp[rw]++;
+	tg->last_bytes_disp[rw] += bio->bi_iter.bi_size;
+	tg->last_io_disp[rw]++;
 
 	/*
 	 * REQ_THROTTLED is used to prevent the same bio to be throttled
@@ -1178,6 +1307,233 @@ static int throtl_select_dispatch(struct throtl_service_queue *parent_sq)
 	return nr_disp;
 }
 
+static u64 throtl_now_usec(void)
+{
+	return ktime_get_ns() >> 10;
+}
+
+/*
+ * The last time @tg dispatched at or above its low limits in every
+ * direction which has one.
+ */
+static unsigned long tg_last_low_overflow_time(struct throtl_grp *tg)
+{
+	unsigned long rtime = jiffies, wtime = jiffies;
+
+	if (tg->bps_low[READ] || tg->iops_low[READ])
+		rtime = tg->last_low_overflow_time[READ];
+	if (tg->bps_low[WRITE] || tg->iops_low[WRITE])
+		wtime = tg->last_low_overflow_time[WRITE];
+	return time_before(rtime, wtime) ? rtime : wtime;
+}
+
+/*
+ * A group is idle if it hasn't completed any IO for its idle threshold, or
+ * if its IO still meets its latency target, so it can do with less.
+ */
+static bool throtl_tg_is_idle(struct throtl_grp *tg)
+{
+	u64 threshold = tg->idletime_threshold;
+
+	if (!threshold)
+		threshold = blk_queue_nonrot(tg->td->queue) ?
+			DFL_IDLE_THRESHOLD_SSD : DFL_IDLE_THRESHOLD_HD;
+
+	return throtl_now_usec() - tg->last_finish_time > threshold ||
+	       (tg->latency_target && tg->bio_cnt &&
+		tg->bad_bio_cnt * 5 < tg->bio_cnt);
+}
+
+/**
+ * throtl_set_limit_index - switch between the low and the max limits
+ * @td: throtl_data of interest
+ * @index: LIMIT_LOW or LIMIT_MAX
+ *
+ * Rules and slices of all groups depend on which limits are in effect, so
+ * refresh all of them and reschedule the groups which have bios queued.
+ * Called with the queue lock held.
+ */
+static void throtl_set_limit_index(struct throtl_data *td, unsigned int index)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+
+	throtl_log(&td->service_queue, "%s",
+		   index == LIMIT_LOW ? "downgrade" : "upgrade");
+
+	td->limit_index = index;
+	if (index == LIMIT_LOW)
+		td->low_downgrade_time = jiffies;
+	else
+		td->low_upgrade_time = jiffies;
+
+	rcu_read_lock();
+	blkg_for_each_descendant_pre(blkg, pos_css, td->queue->root_blkg) {
+		struct throtl_grp *tg = blkg_to_tg(blkg);
+		struct throtl_service_queue *sq = &tg->service_queue;
+		int rw;
+
+		tg_update_has_rules(tg);
+
+		for (rw = READ; rw <= WRITE; rw++) {
+			throtl_start_new_slice(tg, rw);
+			tg->last_bytes_disp[rw] = 0;
+			tg->last_io_disp[rw] = 0;
+		}
+		tg->last_check_time = jiffies;
+
+		if (tg->flags & THROTL_TG_PENDING) {
+			tg_update_disptime(tg);
+			throtl_schedule_next_dispatch(sq->parent_sq, true);
+		}
+	}
+	rcu_read_unlock();
+}
+
+static void throtl_update_limit_valid(struct throtl_data *td)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+	bool low_valid = false;
+
+	rcu_read_lock();
+	blkg_for_each_descendant_post(blkg, pos_css, td->queue->root_blkg) {
+		if (tg_has_low_limit(blkg_to_tg(blkg))) {
+			low_valid = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (td->limit_index != (low_valid ? LIMIT_LOW : LIMIT_MAX))
+		throtl_set_limit_index(td, low_valid ? LIMIT_LOW : LIMIT_MAX);
+}
+
+/*
+ * The low limits can be lifted for @tg if it's either asking for more than
+ * its low limits in every limited direction, or if it doesn't need them.
+ */
+static bool throtl_tg_can_upgrade(struct throtl_grp *tg)
+{
+	struct throtl_service_queue *sq = &tg->service_queue;
+	bool read_limit, write_limit;
+
+	read_limit = tg->bps_low[READ] || tg->iops_low[READ];
+	write_limit = tg->bps_low[WRITE] || tg->iops_low[WRITE];
+	if (!read_limit && !write_limit)
+		return true;
+
+	if ((!read_limit || sq->nr_queued[READ]) &&
+	    (!write_limit || sq->nr_queued[WRITE]))
+		return true;
+
+	if (time_after_eq(jiffies, tg_last_low_overflow_time(tg) + throtl_slice) &&
+	    throtl_tg_is_idle(tg))
+		return true;
+	return false;
+}
+
+static bool throtl_can_upgrade(struct throtl_data *td)
+{
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+	bool ret = true;
+
+	if (td->limit_index != LIMIT_LOW)
+		return false;
+
+	/* give the low limits a chance to show their effect first */
+	if (time_before(jiffies, td->low_downgrade_time + throtl_slice))
+		return false;
+
+	rcu_read_lock();
+	blkg_for_each_descendant_post(blkg, pos_css, td->queue->root_blkg) {
+		if (!throtl_tg_can_upgrade(blkg_to_tg(blkg))) {
+			ret = false;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* returns %true if the max limits took over */
+static bool throtl_upgrade_check(struct throtl_grp *tg)
+{
+	unsigned long now = jiffies;
+
+	if (tg->td->limit_index != LIMIT_LOW)
+		return false;
+
+	if (time_after(tg->last_check_time + throtl_slice, now))
+		return false;
+	tg->last_check_time = now;
+
+	if (!throtl_can_upgrade(tg->td))
+		return false;
+
+	throtl_set_limit_index(tg->td, LIMIT_MAX);
+	return true;
+}
+
+/*
+ * The low limits have to come back if @tg has been getting less than them
+ * for a while without being idle, unless an ancestor with low limits of
+ * its own is happy with what it gets.
+ */
+static bool throtl_tg_can_downgrade(struct throtl_grp *tg)
+{
+	unsigned long now = jiffies;
+
+	return time_after_eq(now, tg->td->low_upgrade_time + throtl_slice) &&
+	       time_after_eq(now, tg_last_low_overflow_time(tg) + throtl_slice) &&
+	       !throtl_tg_is_idle(tg);
+}
+
+static bool throtl_hierarchy_can_downgrade(struct throtl_grp *tg)
+{
+	while (tg) {
+		if (tg_has_low_limit(tg) && !throtl_tg_can_downgrade(tg))
+			return false;
+		tg = sq_to_tg(tg->service_queue.parent_sq);
+	}
+	return true;
+}
+
+static void throtl_downgrade_check(struct throtl_grp *tg)
+{
+	unsigned long now = jiffies;
+	unsigned long elapsed_time;
+	int rw;
+
+	if (tg->td->limit_index != LIMIT_MAX || !tg_has_low_limit(tg) ||
+	    !list_empty(&tg_to_blkg(tg)->blkcg->css.children))
+		return;
+
+	if (time_after(tg->last_check_time + throtl_slice, now))
+		return;
+	elapsed_time = now - tg->last_check_time;
+	tg->last_check_time = now;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		u64 bps = tg->last_bytes_disp[rw] * HZ;
+		u64 iops = (u64)tg->last_io_disp[rw] * HZ;
+
+		do_div(bps, elapsed_time);
+		do_div(iops, elapsed_time);
+		if ((tg->bps_low[rw] && bps >= tg->bps_low[rw]) ||
+		    (tg->iops_low[rw] && iops >= tg->iops_low[rw]))
+			tg->last_low_overflow_time[rw] = now;
+
+		tg->last_bytes_disp[rw] = 0;
+		tg->last_io_disp[rw] = 0;
+	}
+
+	if (throtl_hierarchy_can_downgrade(tg))
+		throtl_set_limit_index(tg->td, LIMIT_LOW);
+}
+
 /**
  * throtl_pending_timer_fn - timer function for service_queue->pending_timer
  * @arg: the throtl_service_queue being serviced
@@ -1204,6 +1560,8 @@ static void throtl_pending_timer_fn(unsigned long arg)
 	int ret;
 
 	spin_lock_irq(q->queue_lock);
+	if (throtl_can_upgrade(td))
+		throtl_set_limit_index(td, LIMIT_MAX);
 again:
 	parent_sq = sq->parent_sq;
 	dispatched = false;
@@ -1316,7 +1674,7 @@ static u64 tg_prfill_conf_u64(struct seq_file *sf, struct blkg_policy_data *pd,
 	struct throtl_grp *tg = pd_to_tg(pd);
 	u64 v = *(u64 *)((void *)tg + off);
 
-	if (v == -1)
+	if (v == -1 || !v)
 		return 0;
 	return __blkg_prfill_u64(sf, pd, v);
 }
@@ -1327,7 +1685,7 @@ static u64 tg_prfill_conf_uint(struct seq_file *sf, struct blkg_policy_data *pd,
 	struct throtl_grp *tg = pd_to_tg(pd);
 	unsigned int v = *(unsigned int *)((void *)tg + off);
 
-	if (v == -1)
+	if (v == -1 || !v)
 		return 0;
 	return __blkg_prfill_u64(sf, pd, v);
 }
@@ -1346,8 +1704,8 @@ static int tg_print_conf_uint(struct seq_file *sf, void *v)
 	return 0;
 }
 
-static ssize_t tg_set_conf(struct kernfs_open_file *of,
-			   char *buf, size_t nbytes, loff_t off, bool is_u64)
+static ssize_t tg_set_conf(struct kernfs_open_file *of, char *buf,
+			   size_t nbytes, loff_t off, bool is_u64, bool is_low)
 {
 	struct blkcg *blkcg = css_to_blkcg(of_css(of));
 	struct blkg_conf_ctx ctx;
@@ -1364,7 +1722,8 @@ static ssize_t tg_set_conf(struct kernfs_open_file *of,
 	tg = blkg_to_tg(ctx.blkg);
 	sq = &tg->service_queue;
 
-	if (!ctx.v)
+	/* 0 lifts a max limit, while it's the unset low value */
+	if (!ctx.v && !is_low)
 		ctx.v = -1;
 
 	if (is_u64)
@@ -1377,6 +1736,9 @@ static ssize_t tg_set_conf(struct kernfs_open_file *of,
 		   tg->bps[READ], tg->bps[WRITE],
 		   tg->iops[READ], tg->iops[WRITE]);
 
+	if (is_low)
+		throtl_update_limit_valid(tg->td);
+
 	/*
 	 * Update has_rules[] flags for the updated tg's subtree.  A tg is
 	 * considered to have rules if either the tg itself or any of its
@@ -1410,14 +1772,28 @@ static ssize_t tg_set_conf(struct kernfs_open_file *of,
 static ssize_t tg_set_conf_u64(struct kernfs_open_file *of,
 			       char *buf, size_t nbytes, loff_t off)
 {
-	return tg_set_conf(of, buf, nbytes, off, true);
+	return tg_set_conf(of, buf, nbytes, off, true, false);
 }
 
 static ssize_t tg_set_conf_uint(struct kernfs_open_file *of,
 				char *buf, size_t nbytes, loff_t off)
 {
-	return tg_set_conf(of, buf, nbytes, off, false);
+	return tg_set_conf(of, buf, nbytes, off, false, false);
+}
+
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+static ssize_t tg_set_low_conf_u64(struct kernfs_open_file *of,
+				   char *buf, size_t nbytes, loff_t off)
+{
+	return tg_set_conf(of, buf, nbytes, off, true, true);
+}
+
+static ssize_t tg_set_low_conf_uint(struct kernfs_open_file *of,
+				    char *buf, size_t nbytes, loff_t off)
+{
+	return tg_set_conf(of, buf, nbytes, off, false, true);
 }
+#endif
 
 static struct cftype throtl_files[] = {
 	{
@@ -1444,6 +1820,44 @@ static struct cftype throtl_files[] = {
 		.seq_show = tg_print_conf_uint,
 		.write = tg_set_conf_uint,
 	},
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+	{
+		.name = "throttle.low_read_bps_device",
+		.private = offsetof(struct throtl_grp, bps_low[READ]),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_low_conf_u64,
+	},
+	{
+		.name = "throttle.low_write_bps_device",
+		.private = offsetof(struct throtl_grp, bps_low[WRITE]),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_low_conf_u64,
+	},
+	{
+		.name = "throttle.low_read_iops_device",
+		.private = offsetof(struct throtl_grp, iops_low[READ]),
+		.seq_show = tg_print_conf_uint,
+		.write = tg_set_low_conf_uint,
+	},
+	{
+		.name = "throttle.low_write_iops_device",
+		.private = offsetof(struct throtl_grp, iops_low[WRITE]),
+		.seq_show = tg_print_conf_uint,
+		.write = tg_set_low_conf_uint,
+	},
+	{
+		.name = "throttle.idle_time_usec_device",
+		.private = offsetof(struct throtl_grp, idletime_threshold),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_low_conf_u64,
+	},
+	{
+		.name = "throttle.latency_target_usec_device",
+		.private = offsetof(struct throtl_grp, latency_target),
+		.seq_show = tg_print_conf_u64,
+		.write = tg_set_low_conf_u64,
+	},
+#endif
 	{
 		.name = "throttle.io_service_bytes",
 		.private = offsetof(struct tg_stats_cpu, service_bytes),
@@ -1470,10 +1884,37 @@ static struct blkcg_policy blkcg_policy_throtl = {
 
 	.pd_init_fn		= throtl_pd_init,
 	.pd_online_fn		= throtl_pd_online,
+	.pd_offline_fn		= throtl_pd_offline,
 	.pd_exit_fn		= throtl_pd_exit,
 	.pd_reset_stats_fn	= throtl_pd_reset_stats,
 };
 
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+/*
+ * Bios of groups with low limits are tracked to completion, which tells
+ * whether the group is idle and whether it meets its latency target.
+ */
+static void blk_throtl_assoc_bio(struct throtl_grp *tg, struct bio *bio)
+{
+	if (bio->bi_cg_private || !tg_has_low_limit(tg))
+		return;
+
+	blkg_get(tg_to_blkg(tg));
+	bio->bi_cg_private = tg;
+	bio->bi_issue_time = 0;
+}
+
+static void blk_throtl_bio_issue(struct bio *bio)
+{
+	if (bio->bi_cg_private && !bio->bi_issue_time)
+		bio->bi_issue_time = throtl_now_usec();
+}
+#else
+static inline void blk_throtl_assoc_bio(struct throtl_grp *tg,
+					struct bio *bio) { }
+static inline void blk_throtl_bio_issue(struct bio *bio) { }
+#endif
+
 bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 {
 	struct throtl_data *td = q->td;
@@ -1515,14 +1956,23 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 
 	sq = &tg->service_queue;
 
+	blk_throtl_assoc_bio(tg, bio);
+
 	while (true) {
+		throtl_downgrade_check(tg);
+
 		/* throtl is FIFO - if bios are already queued, should queue */
 		if (sq->nr_queued[rw])
 			break;
 
 		/* if above limits, break to queue */
-		if (!tg_may_dispatch(tg, bio, NULL))
+		if (!tg_may_dispatch(tg, bio, NULL)) {
+			tg->last_low_overflow_time[rw] = jiffies;
+			/* lifting the low limits may let @bio through */
+			if (throtl_upgrade_check(tg))
+				continue;
 			break;
+		}
 
 		/* within limits, let's charge and dispatch directly */
 		throtl_charge_bio(tg, bio);
@@ -1555,8 +2005,9 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	/* out-of-limit, queue to @tg */
 	throtl_log(sq, "[%c] bio. bdisp=%llu sz=%u bps=%llu iodisp=%u iops=%u queued=%d/%d",
 		   rw == READ ? 'R' : 'W',
-		   tg->bytes_disp[rw], bio->bi_iter.bi_size, tg->bps[rw],
-		   tg->io_disp[rw], tg->iops[rw],
+		   tg->bytes_disp[rw], bio->bi_iter.bi_size,
+		   tg_bps_limit(tg, rw),
+		   tg->io_disp[rw], tg_iops_limit(tg, rw),
 		   sq->nr_queued[READ], sq->nr_queued[WRITE]);
 
 	bio_associate_current(bio);
@@ -1585,11 +2036,45 @@ out:
 	 * don't want bios to leave with the flag set.  Clear the flag if
 	 * being issued.
 	 */
-	if (!throttled)
+	if (!throttled) {
 		bio->bi_rw &= ~REQ_THROTTLED;
+		blk_throtl_bio_issue(bio);
+	}
 	return throttled;
 }
 
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+void blk_throtl_bio_endio(struct bio *bio)
+{
+	struct throtl_grp *tg = bio->bi_cg_private;
+	u64 finish_time;
+
+	if (!tg)
+		return;
+	bio->bi_cg_private = NULL;
+
+	finish_time = throtl_now_usec();
+	tg->last_finish_time = finish_time;
+
+	if (tg->latency_target && bio->bi_issue_time &&
+	    finish_time > bio->bi_issue_time) {
+		tg->bio_cnt++;
+		if (finish_time - bio->bi_issue_time > tg->latency_target)
+			tg->bad_bio_cnt++;
+	}
+
+	/* decay the samples so that old IO doesn't decide forever */
+	if (time_after(jiffies, tg->bio_cnt_reset_time) ||
+	    tg->bio_cnt > 1024) {
+		tg->bio_cnt_reset_time = jiffies + throtl_slice;
+		tg->bio_cnt /= 2;
+		tg->bad_bio_cnt /= 2;
+	}
+
+	blkg_put(tg_to_blkg(tg));
+}
+#endif
+
 /*
  * Dispatch all bios from all children tg's queued on @parent_sq.  On
  * return, @parent_sq is guaranteed to not have any active children tg's
@@ -1668,6 +2153,9 @@ int blk_throtl_init(struct request_queue *q)
 
 	q->td = td;
 	td->queue = q;
+	td->limit_index = LIMIT_MAX;
+	td->low_upgrade_time = jiffies;
+	td->low_downgrade_time = jiffies;
 
 	/* activate policy */
 	ret = blkcg_activate_policy(q, &blkcg_policy_throtl);
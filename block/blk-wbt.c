@@ -0,0 +1,494 @@
+/*
+ * buffered writeback throttling. loosely based on CoDel. We can't drop
+ * packets for IO scheduling, so the logic is something like this:
+ *
+ * - Monitor read latencies in a defined time window.
+ * - If the minimum read latency in that window exceeds the target, we
+ *   scale down the queue depth allowed for buffered writeback by a factor
+ *   of 2, and shrink the monitoring window by 1 / sqrt(scale_step + 1).
+ * - If the minimum latency is below the target again, we scale the depth
+ *   back up, one step per window.
+ * - If we see no reads at all, we can't tell whether writeback hurts
+ *   anyone. Unless a read has been stuck for a whole window, slowly step
+ *   back up towards the full depth.
+ *
+ * Writes that somebody waits for (sync, flush and FUA writes) are never
+ * throttled, nor are reads. Buffered writeback is allowed a quarter of the
+ * device queue while reads have completed recently, half of it otherwise,
+ * and the full depth when written back by kswapd.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+/* default read latency targets, and the monitoring window */
+#define RWB_DEF_NONROT_LAT_NSEC	(2ULL * NSEC_PER_MSEC)
+#define RWB_DEF_ROT_LAT_NSEC	(75ULL * NSEC_PER_MSEC)
+#define RWB_WINDOW_NSEC		(100ULL * NSEC_PER_MSEC)
+
+enum {
+	/*
+	 * Step up the depth after this many windows without reads
+	 */
+	RWB_UNKNOWN_BUMP	= 5,
+};
+
+enum {
+	LAT_OK,
+	LAT_UNKNOWN,
+	LAT_EXCEEDED,
+};
+
+static inline void rwb_wake_all(struct rq_wb *rwb)
+{
+	if (waitqueue_active(&rwb->wait))
+		wake_up_all(&rwb->wait);
+}
+
+/*
+ * Did a read complete in the last 100 msecs?
+ */
+static bool close_io(struct rq_wb *rwb)
+{
+	return time_before(jiffies, ACCESS_ONCE(rwb->last_comp) + HZ / 10);
+}
+
+static unsigned int get_limit(struct rq_wb *rwb)
+{
+	/*
+	 * Reclaim needs pages cleaned as fast as possible, don't stall it
+	 * behind buffered writeback of unrelated files.
+	 */
+	if (current_is_kswapd())
+		return rwb->wb_max;
+	if (close_io(rwb))
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+void __wbt_done(struct rq_wb *rwb)
+{
+	int inflight, limit;
+
+	inflight = atomic_dec_return(&rwb->inflight);
+
+	/*
+	 * wbt got disabled with IO in flight. Wake up any potential
+	 * waiters, we don't have to do more than that.
+	 */
+	if (unlikely(!wbt_enabled(rwb))) {
+		rwb_wake_all(rwb);
+		return;
+	}
+
+	limit = close_io(rwb) ? rwb->wb_background : rwb->wb_normal;
+
+	/*
+	 * Don't wake anyone up if we are above the normal limit.
+	 */
+	if (inflight && inflight >= limit)
+		return;
+
+	if (waitqueue_active(&rwb->wait)) {
+		int diff = limit - inflight;
+
+		if (!inflight || diff >= rwb->wb_background / 2)
+			wake_up_all(&rwb->wait);
+	}
+}
+
+static void wbt_stat_add(struct rq_wb *rwb, u64 lat)
+{
+	struct rq_wb_stat *stat;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	stat = this_cpu_ptr(rwb->stat);
+	if (!stat->nr_samples || lat < stat->min_lat_nsec)
+		stat->min_lat_nsec = lat;
+	stat->nr_samples++;
+	local_irq_restore(flags);
+}
+
+/*
+ * Called when a request is freed. Throttled writes give back their slot,
+ * reads feed the latency statistics.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	unsigned long now;
+	s64 lat;
+
+	if (!rwb)
+		return;
+
+	if (rq->cmd_flags & REQ_WB_TRACKED) {
+		rq->cmd_flags &= ~REQ_WB_TRACKED;
+		__wbt_done(rwb);
+		return;
+	}
+
+	if (rwb->sync_cookie == rq)
+		rwb->sync_cookie = NULL;
+
+	if (!wbt_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ || !rq->issue_time_ns)
+		return;
+
+	now = jiffies;
+	if (rwb->last_comp != now)
+		rwb->last_comp = now;
+
+	lat = ktime_get_ns() - rq->issue_time_ns;
+	if (lat > 0)
+		wbt_stat_add(rwb, lat);
+}
+
+/*
+ * Remember one read in flight, so that a window without completions can
+ * be told apart from one where the reads are stuck behind writeback.
+ */
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	if (!wbt_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ)
+		return;
+
+	if (!rwb->sync_cookie) {
+		rwb->sync_issue = rq->issue_time_ns;
+		rwb->sync_cookie = rq;
+	}
+}
+
+/*
+ * Sum up the per-cpu read statistics of the window that just ended, and
+ * restart them. A completion racing with this may lose its sample.
+ */
+static void rwb_gather_stats(struct rq_wb *rwb, struct rq_wb_stat *sum)
+{
+	int cpu;
+
+	sum->min_lat_nsec = 0;
+	sum->nr_samples = 0;
+
+	for_each_possible_cpu(cpu) {
+		struct rq_wb_stat *stat = per_cpu_ptr(rwb->stat, cpu);
+
+		if (!ACCESS_ONCE(stat->nr_samples))
+			continue;
+
+		if (!sum->nr_samples || stat->min_lat_nsec < sum->min_lat_nsec)
+			sum->min_lat_nsec = stat->min_lat_nsec;
+		sum->nr_samples += stat->nr_samples;
+		stat->nr_samples = 0;
+	}
+}
+
+static int latency_exceeded(struct rq_wb *rwb)
+{
+	struct rq_wb_stat stat;
+
+	rwb_gather_stats(rwb, &stat);
+
+	if (!stat.nr_samples) {
+		/*
+		 * No reads completed. If one has been waiting for longer
+		 * than the window, it's stuck behind our writes.
+		 */
+		if (ACCESS_ONCE(rwb->sync_cookie) &&
+		    ktime_get_ns() - ACCESS_ONCE(rwb->sync_issue) >
+		    rwb->cur_win_nsec)
+			return LAT_EXCEEDED;
+
+		return LAT_UNKNOWN;
+	}
+
+	if (stat.min_lat_nsec > rwb->min_lat_nsec)
+		return LAT_EXCEEDED;
+
+	return LAT_OK;
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth;
+
+	if (!rwb->min_lat_nsec) {
+		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		return;
+	}
+
+	/*
+	 * The full queue depth at scale step 0, halved for every step down,
+	 * but always at least one request.
+	 */
+	depth = min_t(unsigned long, rwb->queue->nr_requests, UINT_MAX);
+	if (rwb->scale_step < 32)
+		depth >>= rwb->scale_step;
+	else
+		depth = 0;
+
+	rwb->wb_max = max(1U, depth);
+	rwb->wb_normal = (rwb->wb_max + 1) / 2;
+	rwb->wb_background = (rwb->wb_max + 3) / 4;
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_wake_all(rwb);
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	/*
+	 * Stop scaling down when we've hit the limit.
+	 */
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	unsigned long expires;
+
+	if (rwb->scale_step > 0) {
+		/*
+		 * We should speed this up, using some variant of a fast
+		 * integer inverse square root calculation. Since we only do
+		 * this for every window expiration, it's not a huge deal,
+		 * though.
+		 */
+		rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+					int_sqrt((rwb->scale_step + 1) << 8));
+	} else {
+		rwb->cur_win_nsec = rwb->win_nsec;
+	}
+
+	expires = jiffies + max(1UL, nsecs_to_jiffies(rwb->cur_win_nsec));
+	mod_timer(&rwb->window_timer, expires);
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+
+	if (!wbt_enabled(rwb))
+		return;
+
+	switch (latency_exceeded(rwb)) {
+	case LAT_EXCEEDED:
+		scale_down(rwb);
+		break;
+	case LAT_OK:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		if (++rwb->unknown_cnt >= RWB_UNKNOWN_BUMP)
+			scale_up(rwb);
+		break;
+	}
+
+	/*
+	 * Keep watching as long as we are throttling, or writeback is
+	 * still going on.
+	 */
+	if (rwb->scale_step || atomic_read(&rwb->inflight))
+		rwb_arm_timer(rwb);
+}
+
+static inline bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static bool may_queue(struct rq_wb *rwb)
+{
+	/*
+	 * inc it here even if disabled, since we'll dec it at completion.
+	 * this only happens if the task was sleeping in wbt_wait(),
+	 * and someone turned it off at the same time.
+	 */
+	if (!wbt_enabled(rwb)) {
+		atomic_inc(&rwb->inflight);
+		return true;
+	}
+
+	return atomic_inc_below(&rwb->inflight, get_limit(rwb));
+}
+
+/*
+ * Only buffered writeback is throttled: writes nobody waits for.
+ */
+static inline bool wbt_should_throttle(struct bio *bio)
+{
+	const unsigned long mask = REQ_WRITE | REQ_SYNC | REQ_FLUSH |
+				   REQ_FUA | REQ_DISCARD;
+
+	return (bio->bi_rw & mask) == REQ_WRITE;
+}
+
+/**
+ * wbt_wait - throttle buffered writeback
+ * @rwb:	the queue's throttle, may be NULL
+ * @bio:	the bio about to get a request
+ * @lock:	if set, held on entry and dropped while sleeping
+ *
+ * Returns true if the request allocated for @bio must be accounted as an
+ * in-flight write, with wbt_track(). If no request is allocated after
+ * all, the caller must give the slot back with __wbt_done().
+ */
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (!wbt_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	if (!may_queue(rwb)) {
+		do {
+			prepare_to_wait_exclusive(&rwb->wait, &wait,
+						  TASK_UNINTERRUPTIBLE);
+			if (may_queue(rwb))
+				break;
+
+			if (lock)
+				spin_unlock_irq(lock);
+
+			io_schedule();
+
+			if (lock)
+				spin_lock_irq(lock);
+		} while (1);
+
+		finish_wait(&rwb->wait, &wait);
+	}
+
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+
+	return true;
+}
+
+void wbt_track(struct request *rq, bool wb_acct)
+{
+	if (wb_acct)
+		rq->cmd_flags |= REQ_WB_TRACKED;
+}
+
+/*
+ * Called when the depth of the queue changed.
+ */
+void wbt_update_limits(struct rq_wb *rwb)
+{
+	if (!rwb)
+		return;
+
+	rwb->scale_step = 0;
+	calc_wb_limits(rwb);
+	rwb_wake_all(rwb);
+}
+
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	if (blk_queue_nonrot(q))
+		return RWB_DEF_NONROT_LAT_NSEC;
+
+	return RWB_DEF_ROT_LAT_NSEC;
+}
+
+static struct rq_wb *wbt_alloc(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return NULL;
+
+	rwb->stat = alloc_percpu(struct rq_wb_stat);
+	if (!rwb->stat) {
+		kfree(rwb);
+		return NULL;
+	}
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long) rwb);
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->cur_win_nsec = RWB_WINDOW_NSEC;
+	rwb->last_comp = jiffies - HZ;
+	rwb->queue = q;
+
+	return rwb;
+}
+
+/**
+ * wbt_set_lat - set the read latency target of a queue
+ * @q:		the queue
+ * @lat_nsec:	the target, or 0 to stop throttling
+ *
+ * Called with q->sysfs_lock held. The throttle is set up the first time
+ * it is enabled, and stays around until the queue is released.
+ */
+int wbt_set_lat(struct request_queue *q, u64 lat_nsec)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb) {
+		if (!lat_nsec)
+			return 0;
+
+		rwb = wbt_alloc(q);
+		if (!rwb)
+			return -ENOMEM;
+
+		/* make the initialized throttle visible before its users */
+		smp_wmb();
+		q->rq_wb = rwb;
+	}
+
+	rwb->min_lat_nsec = lat_nsec;
+	rwb->unknown_cnt = 0;
+	wbt_update_limits(rwb);
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		free_percpu(rwb->stat);
+		kfree(rwb);
+		q->rq_wb = NULL;
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
+
+/*
+ * Read latency seen by one cpu in the current window.
+ */
+struct rq_wb_stat {
+	u64 min_lat_nsec;
+	unsigned int nr_samples;
+};
+
+struct rq_wb {
+	/*
+	 * Settings that govern how we throttle
+	 */
+	unsigned int wb_background;		/* background writeback */
+	unsigned int wb_normal;			/* normal writeback */
+	unsigned int wb_max;			/* max throughput writeback */
+	int scale_step;
+
+	u64 win_nsec;				/* default window size */
+	u64 cur_win_nsec;			/* current window size */
+
+	u64 min_lat_nsec;			/* read latency target, 0 if off */
+	struct request_queue *queue;
+
+	unsigned int unknown_cnt;		/* windows without reads */
+	unsigned long last_comp;		/* jiffies of last read done */
+
+	/* an in-flight read, to notice reads stuck behind writes */
+	u64 sync_issue;
+	void *sync_cookie;
+
+	struct timer_list window_timer;
+	struct rq_wb_stat __percpu *stat;
+
+	atomic_t inflight;			/* throttled writes in flight */
+	wait_queue_head_t wait;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+void __wbt_done(struct rq_wb *rwb);
+void wbt_done(struct rq_wb *rwb, struct request *rq);
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock);
+void wbt_track(struct request *rq, bool wb_acct);
+void wbt_issue(struct rq_wb *rwb, struct request *rq);
+void wbt_update_limits(struct rq_wb *rwb);
+int wbt_set_lat(struct request_queue *q, u64 lat_nsec);
+u64 wbt_default_latency_nsec(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+
+static inline bool wbt_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec;
+}
+
+#else
+
+static inline void __wbt_done(struct rq_wb *rwb)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline bool wbt_wait(struct rq_wb *rwb, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void wbt_track(struct request *rq, bool wb_acct)
+{
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_update_limits(struct rq_wb *rwb)
+{
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_enabled(struct rq_wb *rwb)
+{
+	return false;
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
@@ -0,0 +1,455 @@
+/*
+ *  MQ Deadline i/o scheduler - adaptation of the legacy deadline scheduler,
+ *  for the blk-mq scheduling framework
+ *
+ *  Every hardware queue keeps its own sort and fifo lists, so submitters
+ *  on different hardware queues never contend on scheduler state. The
+ *  tunables are shared by all hardware queues of a device.
+ *
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+/*
+ * See Documentation/block/deadline-iosched.txt
+ */
+static const int read_expire = HZ / 2;  /* max time before a read is submitted. */
+static const int write_expire = 5 * HZ; /* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 2;    /* max times reads can starve a write */
+static const int fifo_batch = 16;       /* # of sequential requests treated as one
+				     by the above parameters. For throughput. */
+
+/*
+ * settings that change how the i/o scheduler behaves, per request queue
+ */
+struct deadline_data {
+	int fifo_expire[2];
+	int fifo_batch;
+	int writes_starved;
+};
+
+/*
+ * run time data, per hardware queue
+ */
+struct deadline_hctx_data {
+	spinlock_t lock;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next in sort order. read, write or both are NULL
+	 */
+	struct request *next_rq[2];
+	unsigned int batching;		/* number of sequential requests made */
+	unsigned int starved;		/* times reads have starved writes */
+
+	/*
+	 * requests inserted at the head bypass sorting and deadlines
+	 */
+	struct list_head dispatch;
+};
+
+static inline struct rb_root *
+deadline_rb_root(struct deadline_hctx_data *dh, struct request *rq)
+{
+	return &dh->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+deadline_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void dd_add_request(struct deadline_data *dd,
+			   struct deadline_hctx_data *dh, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	elv_rb_add(deadline_rb_root(dh, rq), rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
+	list_add_tail(&rq->queuelist, &dh->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void dd_remove_request(struct deadline_hctx_data *dh,
+			      struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	rq_fifo_clear(rq);
+
+	if (dh->next_rq[data_dir] == rq)
+		dh->next_rq[data_dir] = deadline_latter_request(rq);
+
+	elv_rb_del(deadline_rb_root(dh, rq), rq);
+}
+
+/*
+ * take rq off the sort and fifo lists, remembering where the batch goes on
+ */
+static void dd_move_request(struct deadline_hctx_data *dh,
+			    struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	dh->next_rq[READ] = NULL;
+	dh->next_rq[WRITE] = NULL;
+	dh->next_rq[data_dir] = deadline_latter_request(rq);
+
+	dd_remove_request(dh, rq);
+}
+
+/*
+ * deadline_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&dh->fifo_list[data_dir])
+ */
+static inline int deadline_check_fifo(struct deadline_hctx_data *dh, int ddir)
+{
+	struct request *rq = rq_entry_fifo(dh->fifo_list[ddir].next);
+
+	/*
+	 * rq is expired!
+	 */
+	if (time_after_eq(jiffies, rq->fifo_time))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * __dd_dispatch_request selects the best request according to
+ * read/write expire, fifo_batch, etc
+ */
+static struct request *__dd_dispatch_request(struct deadline_data *dd,
+					     struct deadline_hctx_data *dh)
+{
+	struct request *rq;
+	bool reads, writes;
+	int data_dir;
+
+	if (!list_empty(&dh->dispatch)) {
+		rq = list_first_entry(&dh->dispatch, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		return rq;
+	}
+
+	reads = !list_empty(&dh->fifo_list[READ]);
+	writes = !list_empty(&dh->fifo_list[WRITE]);
+
+	/*
+	 * batches are currently reads XOR writes
+	 */
+	if (dh->next_rq[WRITE])
+		rq = dh->next_rq[WRITE];
+	else
+		rq = dh->next_rq[READ];
+
+	if (rq && dh->batching < dd->fifo_batch)
+		/* we have a next request are still entitled to batch */
+		goto dispatch_request;
+
+	/*
+	 * at this point we are not running a batch. select the appropriate
+	 * data direction (read / write)
+	 */
+
+	if (reads) {
+		BUG_ON(RB_EMPTY_ROOT(&dh->sort_list[READ]));
+
+		if (writes && (dh->starved++ >= dd->writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+
+		goto dispatch_find_request;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&dh->sort_list[WRITE]));
+
+		dh->starved = 0;
+
+		data_dir = WRITE;
+
+		goto dispatch_find_request;
+	}
+
+	return NULL;
+
+dispatch_find_request:
+	/*
+	 * we are not running a batch, find best request for selected data_dir
+	 */
+	if (deadline_check_fifo(dh, data_dir) || !dh->next_rq[data_dir]) {
+		/*
+		 * A deadline has expired, the last request was in the other
+		 * direction, or we have run out of higher-sectored requests.
+		 * Start again from the request with the earliest expiry time.
+		 */
+		rq = rq_entry_fifo(dh->fifo_list[data_dir].next);
+	} else {
+		/*
+		 * The last req was the same dir and we have a next request in
+		 * sort order. No expired requests so continue on from here.
+		 */
+		rq = dh->next_rq[data_dir];
+	}
+
+	dh->batching = 0;
+
+dispatch_request:
+	/*
+	 * rq is the selected appropriate request.
+	 */
+	dh->batching++;
+	dd_move_request(dh, rq);
+
+	return rq;
+}
+
+static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct deadline_hctx_data *dh = hctx->sched_data;
+	struct request *rq;
+
+	spin_lock(&dh->lock);
+	rq = __dd_dispatch_request(dd, dh);
+	spin_unlock(&dh->lock);
+
+	return rq;
+}
+
+static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
+			       struct list_head *list, bool at_head)
+{
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct deadline_hctx_data *dh = hctx->sched_data;
+
+	spin_lock(&dh->lock);
+	while (!list_empty(list)) {
+		struct request *rq;
+
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		if (at_head)
+			list_add_tail(&rq->queuelist, &dh->dispatch);
+		else
+			dd_add_request(dd, dh, rq);
+	}
+	spin_unlock(&dh->lock);
+}
+
+static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_hctx_data *dh = hctx->sched_data;
+
+	return !list_empty_careful(&dh->dispatch) ||
+		!list_empty_careful(&dh->fifo_list[READ]) ||
+		!list_empty_careful(&dh->fifo_list[WRITE]);
+}
+
+static int dd_init_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
+{
+	struct deadline_hctx_data *dh;
+
+	dh = kzalloc_node(sizeof(*dh), GFP_KERNEL, hctx->numa_node);
+	if (!dh)
+		return -ENOMEM;
+
+	spin_lock_init(&dh->lock);
+	INIT_LIST_HEAD(&dh->fifo_list[READ]);
+	INIT_LIST_HEAD(&dh->fifo_list[WRITE]);
+	INIT_LIST_HEAD(&dh->dispatch);
+	dh->sort_list[READ] = RB_ROOT;
+	dh->sort_list[WRITE] = RB_ROOT;
+
+	hctx->sched_data = dh;
+	return 0;
+}
+
+static void dd_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
+{
+	struct deadline_hctx_data *dh = hctx->sched_data;
+
+	BUG_ON(!list_empty(&dh->fifo_list[READ]));
+	BUG_ON(!list_empty(&dh->fifo_list[WRITE]));
+	BUG_ON(!list_empty(&dh->dispatch));
+
+	hctx->sched_data = NULL;
+	kfree(dh);
+}
+
+static void dd_exit_queue(struct elevator_queue *e)
+{
+	kfree(e->elevator_data);
+}
+
+/*
+ * initialize elevator private data (deadline_data).
+ */
+static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct deadline_data *dd;
+	struct elevator_queue *eq;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
+	if (!dd) {
+		kobject_put(&eq->kobj);
+		return -ENOMEM;
+	}
+	eq->elevator_data = dd;
+
+	dd->fifo_expire[READ] = read_expire;
+	dd->fifo_expire[WRITE] = write_expire;
+	dd->writes_starved = writes_starved;
+	dd->fifo_batch = fifo_batch;
+
+	q->elevator = eq;
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+deadline_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+deadline_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct deadline_data *dd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return deadline_var_show(__data, (page));			\
+}
+SHOW_FUNCTION(deadline_read_expire_show, dd->fifo_expire[READ], 1);
+SHOW_FUNCTION(deadline_write_expire_show, dd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(deadline_writes_starved_show, dd->writes_starved, 0);
+SHOW_FUNCTION(deadline_fifo_batch_show, dd->fifo_batch, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct deadline_data *dd = e->elevator_data;			\
+	int __data;							\
+	int ret = deadline_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(deadline_read_expire_store, &dd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(deadline_write_expire_store, &dd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+#define DD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, deadline_##name##_show, \
+				      deadline_##name##_store)
+
+static struct elv_fs_entry deadline_attrs[] = {
+	DD_ATTR(read_expire),
+	DD_ATTR(write_expire),
+	DD_ATTR(writes_starved),
+	DD_ATTR(fifo_batch),
+	__ATTR_NULL
+};
+
+static struct elevator_type mq_deadline = {
+	.mq_ops = {
+		.init_sched =		dd_init_queue,
+		.exit_sched =		dd_exit_queue,
+		.init_hctx =		dd_init_hctx,
+		.exit_hctx =		dd_exit_hctx,
+		.insert_requests =	dd_insert_requests,
+		.dispatch_request =	dd_dispatch_request,
+		.has_work =		dd_has_work,
+	},
+
+	.uses_mq = true,
+	.elevator_attrs = deadline_attrs,
+	.elevator_name = "mq-deadline",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init deadline_init(void)
+{
+	return elv_register(&mq_deadline);
+}
+
+static void __exit deadline_exit(void)
+{
+	elv_unregister(&mq_deadline);
+}
+
+module_init(deadline_init);
+module_exit(deadline_exit);
+
+MODULE_ALIAS("mq-deadline-iosched");
+MODULE_AUTHOR("Jens Axboe");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MQ deadline IO scheduler");
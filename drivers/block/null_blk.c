@@ -8,23 +8,36 @@
 #include <linux/slab.h>
 #include <linux/blk-mq.h>
 #include <linux/hrtimer.h>
+#include <linux/random.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 struct nullb_cmd {
 	struct list_head list;
-	struct llist_node ll_list;
 	struct call_single_data csd;
 	struct request *rq;
 	struct bio *bio;
 	unsigned int tag;
 	struct nullb_queue *nq;
+	struct hrtimer timer;
+	u64 start_ns;
 };
 
+/*
+ * Completion latency histogram buckets, in usecs. Bucket 0 is [0, 1),
+ * bucket n is [2^(n-1), 2^n), and the last one catches everything above.
+ */
+#define NULL_LAT_BUCKETS	24
+
 struct nullb_queue {
 	unsigned long *tag_map;
 	wait_queue_head_t wait;
 	unsigned int queue_depth;
+	struct nullb *nullb;
 
 	struct nullb_cmd *cmds;
+
+	atomic_long_t lat_hist[NULL_LAT_BUCKETS];
 };
 
 struct nullb {
@@ -33,10 +46,15 @@ struct nullb {
 	struct request_queue *q;
 	struct gendisk *disk;
 	struct blk_mq_tag_set tag_set;
-	struct hrtimer timer;
 	unsigned int queue_depth;
 	spinlock_t lock;
 
+	/* bandwidth emulation: time at which the media is free again */
+	spinlock_t bw_lock;
+	u64 bw_next_ns;
+
+	struct dentry *dfs_node;
+
 	struct nullb_queue *queues;
 	unsigned int nr_queues;
 };
@@ -45,17 +63,7 @@ static LIST_HEAD(nullb_list);
 static struct mutex lock;
 static int null_major;
 static int nullb_indexes;
-
-struct completion_queue {
-	struct llist_head list;
-	struct hrtimer timer;
-};
-
-/*
- * These are per-cpu for now, they will need to be configured by the
- * complete_queues parameter and appropriately mapped.
- */
-static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+static struct dentry *null_dfs_root;
 
 enum {
 	NULL_IRQ_NONE		= 0,
@@ -63,6 +71,12 @@ enum {
 	NULL_IRQ_TIMER		= 2,
 };
 
+enum {
+	NULL_DIST_FIXED		= 0,
+	NULL_DIST_UNIFORM	= 1,
+	NULL_DIST_BIMODAL	= 2,
+};
+
 enum {
 	NULL_Q_BIO		= 0,
 	NULL_Q_RQ		= 1,
@@ -109,6 +123,30 @@ static bool use_per_node_hctx = false;
 module_param(use_per_node_hctx, bool, S_IRUGO);
 MODULE_PARM_DESC(use_per_node_hctx, "Use per-node allocation for hardware context queues. Default: false");
 
+static int completion_dist = NULL_DIST_FIXED;
+module_param(completion_dist, int, S_IRUGO);
+MODULE_PARM_DESC(completion_dist, "Completion latency distribution with irqmode=2. 0-fixed, 1-uniform, 2-bimodal");
+
+static int completion_max_nsec = 100000;
+module_param(completion_max_nsec, int, S_IRUGO);
+MODULE_PARM_DESC(completion_max_nsec, "Upper bound for uniform latency, lower bound is completion_nsec. Default: 100,000ns");
+
+static int completion_slow_nsec = 1000000;
+module_param(completion_slow_nsec, int, S_IRUGO);
+MODULE_PARM_DESC(completion_slow_nsec, "Slow mode latency for bimodal distribution. Default: 1,000,000ns");
+
+static int completion_slow_pct = 1;
+module_param(completion_slow_pct, int, S_IRUGO);
+MODULE_PARM_DESC(completion_slow_pct, "Percentage of requests taking the slow mode latency in bimodal distribution. Default: 1");
+
+static int mbps;
+module_param(mbps, int, S_IRUGO);
+MODULE_PARM_DESC(mbps, "Emulated device bandwidth in MB/s with irqmode=2, 0 means unlimited. Default: 0");
+
+static bool latency_hist = false;
+module_param(latency_hist, bool, S_IRUGO);
+MODULE_PARM_DESC(latency_hist, "Collect per hardware queue completion latency histograms in debugfs. Default: false");
+
 static void put_tag(struct nullb_queue *nq, unsigned int tag)
 {
 	clear_bit_unlock(tag, nq->tag_map);
@@ -173,8 +211,23 @@ static struct nullb_cmd *alloc_cmd(struct nullb_queue *nq, int can_wait)
 	return cmd;
 }
 
+static void null_account_latency(struct nullb_cmd *cmd)
+{
+	u64 lat_usec = div_u64(ktime_get_ns() - cmd->start_ns, NSEC_PER_USEC);
+	unsigned int bucket = 0;
+
+	if (lat_usec)
+		bucket = min_t(unsigned int, fls64(lat_usec),
+			       NULL_LAT_BUCKETS - 1);
+
+	atomic_long_inc(&cmd->nq->lat_hist[bucket]);
+}
+
 static void end_cmd(struct nullb_cmd *cmd)
 {
+	if (latency_hist)
+		null_account_latency(cmd);
+
 	switch (queue_mode)  {
 	case NULL_Q_MQ:
 		blk_mq_end_request(cmd->rq, 0);
@@ -193,36 +246,72 @@ static void end_cmd(struct nullb_cmd *cmd)
 
 static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
-	struct completion_queue *cq;
-	struct llist_node *entry;
-	struct nullb_cmd *cmd;
+	end_cmd(container_of(timer, struct nullb_cmd, timer));
 
-	cq = &per_cpu(completion_queues, smp_processor_id());
+	return HRTIMER_NORESTART;
+}
 
-	while ((entry = llist_del_all(&cq->list)) != NULL) {
-		entry = llist_reverse_order(entry);
-		do {
-			cmd = container_of(entry, struct nullb_cmd, ll_list);
-			entry = entry->next;
-			end_cmd(cmd);
-		} while (entry);
+static void null_cmd_init_timer(struct nullb_cmd *cmd)
+{
+	hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cmd->timer.function = null_cmd_timer_expired;
+}
+
+static u64 null_cmd_latency(void)
+{
+	switch (completion_dist) {
+	case NULL_DIST_UNIFORM:
+		if (completion_max_nsec <= completion_nsec)
+			break;
+		return completion_nsec +
+			prandom_u32() % (completion_max_nsec - completion_nsec + 1);
+	case NULL_DIST_BIMODAL:
+		if (prandom_u32() % 100 < completion_slow_pct)
+			return completion_slow_nsec;
+		break;
 	}
 
-	return HRTIMER_NORESTART;
+	return completion_nsec;
 }
 
-static void null_cmd_end_timer(struct nullb_cmd *cmd)
+static unsigned int null_cmd_bytes(struct nullb_cmd *cmd)
+{
+	if (queue_mode == NULL_Q_BIO)
+		return cmd->bio->bi_iter.bi_size;
+
+	return blk_rq_bytes(cmd->rq);
+}
+
+/*
+ * Serialize transfers on the emulated media: a command can only start
+ * moving data once the previous one is done, so the device as a whole
+ * never exceeds the configured bandwidth. Returns the extra delay in ns.
+ */
+static u64 null_cmd_bw_delay(struct nullb_cmd *cmd)
 {
-	struct completion_queue *cq = &per_cpu(completion_queues, get_cpu());
+	struct nullb *nullb = cmd->nq->nullb;
+	u64 now = ktime_get_ns();
+	u64 xfer, done;
 
-	cmd->ll_list.next = NULL;
-	if (llist_add(&cmd->ll_list, &cq->list)) {
-		ktime_t kt = ktime_set(0, completion_nsec);
+	xfer = div64_u64((u64)null_cmd_bytes(cmd) * NSEC_PER_SEC,
+			 (u64)mbps << 20);
 
-		hrtimer_start(&cq->timer, kt, HRTIMER_MODE_REL);
-	}
+	spin_lock(&nullb->bw_lock);
+	done = max(now, nullb->bw_next_ns) + xfer;
+	nullb->bw_next_ns = done;
+	spin_unlock(&nullb->bw_lock);
 
-	put_cpu();
+	return done - now;
+}
+
+static void null_cmd_end_timer(struct nullb_cmd *cmd)
+{
+	u64 nsec = null_cmd_latency();
+
+	if (mbps)
+		nsec += null_cmd_bw_delay(cmd);
+
+	hrtimer_start(&cmd->timer, ns_to_ktime(nsec), HRTIMER_MODE_REL);
 }
 
 static void null_softirq_done_fn(struct request *rq)
@@ -235,6 +324,9 @@ static void null_softirq_done_fn(struct request *rq)
 
 static inline void null_handle_cmd(struct nullb_cmd *cmd)
 {
+	if (latency_hist)
+		cmd->start_ns = ktime_get_ns();
+
 	/* Complete IO by inline, softirq or timer */
 	switch (irqmode) {
 	case NULL_IRQ_SOFTIRQ:
@@ -334,6 +426,7 @@ static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 
 	init_waitqueue_head(&nq->wait);
 	nq->queue_depth = nullb->queue_depth;
+	nq->nullb = nullb;
 }
 
 static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
@@ -349,17 +442,102 @@ static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 	return 0;
 }
 
+static int null_init_request(void *data, struct request *rq,
+			     unsigned int hctx_idx, unsigned int request_idx,
+			     unsigned int numa_node)
+{
+	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+	if (irqmode == NULL_IRQ_TIMER)
+		null_cmd_init_timer(cmd);
+
+	return 0;
+}
+
 static struct blk_mq_ops null_mq_ops = {
 	.queue_rq       = null_queue_rq,
 	.map_queue      = blk_mq_map_queue,
 	.init_hctx	= null_init_hctx,
+	.init_request	= null_init_request,
 	.complete	= null_softirq_done_fn,
 };
 
+static int null_lat_hist_show(struct seq_file *m, void *v)
+{
+	struct nullb *nullb = m->private;
+	unsigned int i, b;
+
+	for (i = 0; i < nullb->nr_queues; i++) {
+		struct nullb_queue *nq = &nullb->queues[i];
+
+		seq_printf(m, "queue %u:\n", i);
+		for (b = 0; b < NULL_LAT_BUCKETS; b++) {
+			unsigned long cnt = atomic_long_read(&nq->lat_hist[b]);
+
+			if (!cnt)
+				continue;
+			if (b == NULL_LAT_BUCKETS - 1)
+				seq_printf(m, "\t[%lu, inf) usec: %lu\n",
+					   1UL << (b - 1), cnt);
+			else
+				seq_printf(m, "\t[%lu, %lu) usec: %lu\n",
+					   b ? 1UL << (b - 1) : 0, 1UL << b, cnt);
+		}
+	}
+
+	return 0;
+}
+
+static int null_lat_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, null_lat_hist_show, inode->i_private);
+}
+
+/* Any write clears the histograms of all queues of the device */
+static ssize_t null_lat_hist_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct nullb *nullb = ((struct seq_file *)file->private_data)->private;
+	unsigned int i, b;
+
+	for (i = 0; i < nullb->nr_queues; i++)
+		for (b = 0; b < NULL_LAT_BUCKETS; b++)
+			atomic_long_set(&nullb->queues[i].lat_hist[b], 0);
+
+	return count;
+}
+
+static const struct file_operations null_lat_hist_fops = {
+	.owner		= THIS_MODULE,
+	.open		= null_lat_hist_open,
+	.read		= seq_read,
+	.write		= null_lat_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void null_debugfs_init(struct nullb *nullb)
+{
+	if (!null_dfs_root)
+		return;
+
+	nullb->dfs_node = debugfs_create_dir(nullb->disk->disk_name,
+					     null_dfs_root);
+	if (IS_ERR_OR_NULL(nullb->dfs_node)) {
+		nullb->dfs_node = NULL;
+		return;
+	}
+
+	debugfs_create_file("latency_hist", S_IRUGO | S_IWUSR,
+			    nullb->dfs_node, nullb, &null_lat_hist_fops);
+}
+
 static void null_del_dev(struct nullb *nullb)
 {
 	list_del_init(&nullb->list);
 
+	debugfs_remove_recursive(nullb->dfs_node);
+
 	del_gendisk(nullb->disk);
 	blk_cleanup_queue(nullb->q);
 	if (queue_mode == NULL_Q_MQ)
@@ -402,8 +580,9 @@ static int setup_commands(struct nullb_queue *nq)
 	for (i = 0; i < nq->queue_depth; i++) {
 		cmd = &nq->cmds[i];
 		INIT_LIST_HEAD(&cmd->list);
-		cmd->ll_list.next = NULL;
 		cmd->tag = -1U;
+		if (irqmode == NULL_IRQ_TIMER)
+			null_cmd_init_timer(cmd);
 	}
 
 	return 0;
@@ -470,6 +649,7 @@ static int null_add_dev(void)
 	}
 
 	spin_lock_init(&nullb->lock);
+	spin_lock_init(&nullb->bw_lock);
 
 	if (queue_mode == NULL_Q_MQ && use_per_node_hctx)
 		submit_queues = nr_online_nodes;
@@ -549,6 +729,7 @@ static int null_add_dev(void)
 	disk->queue		= nullb->q;
 	sprintf(disk->disk_name, "nullb%d", nullb->index);
 	add_disk(disk);
+	null_debugfs_init(nullb);
 	return 0;
 
 out_cleanup_blk_queue:
@@ -585,27 +766,35 @@ static int __init null_init(void)
 	else if (!submit_queues)
 		submit_queues = 1;
 
-	mutex_init(&lock);
-
-	/* Initialize a separate list for each CPU for issuing softirqs */
-	for_each_possible_cpu(i) {
-		struct completion_queue *cq = &per_cpu(completion_queues, i);
+	if (completion_dist < NULL_DIST_FIXED ||
+	    completion_dist > NULL_DIST_BIMODAL) {
+		pr_warn("null_blk: invalid completion_dist, using fixed latency\n");
+		completion_dist = NULL_DIST_FIXED;
+	}
 
-		init_llist_head(&cq->list);
+	completion_slow_pct = clamp(completion_slow_pct, 0, 100);
+	if (mbps < 0)
+		mbps = 0;
 
-		if (irqmode != NULL_IRQ_TIMER)
-			continue;
+	if ((completion_dist != NULL_DIST_FIXED || mbps) &&
+	    irqmode != NULL_IRQ_TIMER)
+		pr_warn("null_blk: latency and bandwidth emulation need irqmode=2\n");
 
-		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-		cq->timer.function = null_cmd_timer_expired;
-	}
+	mutex_init(&lock);
 
 	null_major = register_blkdev(0, "nullb");
 	if (null_major < 0)
 		return null_major;
 
+	if (latency_hist) {
+		null_dfs_root = debugfs_create_dir("null_blk", NULL);
+		if (IS_ERR_OR_NULL(null_dfs_root))
+			null_dfs_root = NULL;
+	}
+
 	for (i = 0; i < nr_devices; i++) {
 		if (null_add_dev()) {
+			debugfs_remove_recursive(null_dfs_root);
 			unregister_blkdev(null_major, "nullb");
 			return -EINVAL;
 		}
@@ -627,6 +816,8 @@ static void __exit null_exit(void)
 		null_del_dev(nullb);
 	}
 	mutex_unlock(&lock);
+
+	debugfs_remove_recursive(null_dfs_root);
 }
 
 module_init(null_init);
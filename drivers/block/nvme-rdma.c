@@ -0,0 +1,2076 @@
+/*
+ * NVM Express over Fabrics host driver, RDMA transport
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Each NVMe queue of a remote controller is a reliable connected QP.  A
+ * command is sent as a 64 byte capsule with a single SEND, and its
+ * completion comes back as a 16 byte capsule into one of the receive
+ * buffers posted on the QP.  Data never goes in the capsule: it is
+ * registered with a fast registration work request chained in front of
+ * the SEND, and described to the controller by a keyed SGL so it can RDMA
+ * READ or WRITE it directly.  The controller invalidates the key with its
+ * response where it can, saving us a LOCAL_INV round trip.
+ *
+ * The I/O queues are driven by blk-mq the same way nvme-core does it: one
+ * tag set shared by all namespaces, hardware context N issuing on I/O
+ * queue N + 1.  Admin and Fabrics commands are only ever issued by the
+ * driver itself, one at a time, through a request private to each queue.
+ *
+ * Controllers are created by writing a string of options to
+ * /dev/nvme-rdma, e.g. "traddr=192.168.1.10,nqn=<subsystem nqn>", and
+ * deleted through their delete_controller attribute.
+ */
+
+#include <linux/nvme.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/genhd.h>
+#include <linux/hdreg.h>
+#include <linux/idr.h>
+#include <linux/inet.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/parser.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/uuid.h>
+#include <asm/unaligned.h>
+#include <rdma/ib_verbs.h>
+#include <rdma/rdma_cm.h>
+
+#define NVME_RDMA_IP_PORT	4420
+#define NVME_RDMA_AQ_DEPTH	32
+#define NVME_RDMA_DEF_QSIZE	128
+#define NVME_RDMA_MAX_SEGMENTS	128
+#define NVME_RDMA_CM_TIMEOUT	1000	/* per address/route step, msecs */
+#define NVME_RDMA_CM_WAIT	(4 * NVME_RDMA_CM_TIMEOUT)
+#define ADMIN_TIMEOUT		(admin_timeout * HZ)
+#define IOD_TIMEOUT		(retry_time * HZ)
+
+/* command id of the commands the driver issues itself, above any tag */
+#define NVME_RDMA_PRIV_CID	0xffff
+
+/* how long to back off when a queue is being reconnected, in msecs */
+#define NVME_RDMA_QUEUE_DELAY	10
+
+static unsigned char admin_timeout = 60;
+module_param(admin_timeout, byte, 0644);
+MODULE_PARM_DESC(admin_timeout, "timeout in seconds for admin commands");
+
+static unsigned char io_timeout = 30;
+module_param(io_timeout, byte, 0644);
+MODULE_PARM_DESC(io_timeout, "timeout in seconds for I/O");
+
+static unsigned char retry_time = 30;
+module_param(retry_time, byte, 0644);
+MODULE_PARM_DESC(retry_time, "time in seconds to retry failed I/O");
+
+static int nvme_rdma_major;
+module_param(nvme_rdma_major, int, 0);
+
+static DEFINE_MUTEX(ctrl_list_mutex);
+static LIST_HEAD(ctrl_list);
+static DEFINE_SPINLOCK(instance_lock);
+static DEFINE_IDA(nvme_rdma_instance_ida);
+static struct workqueue_struct *nvme_rdma_wq;
+static struct class *nvme_rdma_class;
+
+static char nvme_rdma_hostnqn[NVMF_NQN_FIELD_LEN];
+static uuid_le nvme_rdma_hostid;
+
+/* RDMA CM private data, exchanged when connecting a queue */
+
+struct nvme_rdma_cm_req {
+	__le16		recfmt;
+	__le16		qid;
+	__le16		hrqsize;
+	__le16		hsqsize;
+	u8		rsvd[24];
+};
+
+struct nvme_rdma_cm_rej {
+	__le16		recfmt;
+	__le16		sts;
+};
+
+struct nvme_rdma_qe {
+	void		*data;
+	u64		dma;
+};
+
+struct nvme_rdma_queue;
+
+/*
+ * Per-command state.  Lives behind the request for the I/O queues, and is
+ * allocated with each queue for the driver's own commands.  The capsule is
+ * mapped once, the fast registration MR and page list are reused by every
+ * command that goes through this slot.
+ */
+struct nvme_rdma_request {
+	struct nvme_command	cmd;
+	struct nvme_rdma_queue	*queue;
+	u64			cmd_dma;
+	struct ib_mr		*mr;
+	struct ib_fast_reg_page_list *page_list;
+	bool			mr_valid;	/* rkey wants invalidating */
+	bool			inflight;
+	u16			status;
+	u64			result;
+	struct completion	done;		/* private request only */
+	int			nents;
+	struct scatterlist	sg[0];
+};
+
+enum {
+	NVME_RDMA_Q_CONNECTED	= 0,	/* CM connection is up */
+	NVME_RDMA_Q_LIVE	= 1,	/* Fabrics connect done, takes I/O */
+};
+
+struct nvme_rdma_queue {
+	struct nvme_rdma_ctrl	*ctrl;
+	struct rdma_cm_id	*cm_id;
+	struct ib_cq		*cq;
+	struct ib_qp		*qp;
+	struct nvme_rdma_qe	*rsp_ring;
+	struct nvme_rdma_request *priv;
+	struct mutex		priv_lock;
+	unsigned long		flags;
+	int			qid;
+	int			queue_size;
+	int			sig_limit;
+	atomic_t		sig_count;
+	struct completion	cm_done;
+	int			cm_error;
+};
+
+enum nvme_rdma_ctrl_state {
+	NVME_RDMA_CTRL_NEW,
+	NVME_RDMA_CTRL_LIVE,
+	NVME_RDMA_CTRL_RESETTING,
+	NVME_RDMA_CTRL_DELETING,
+};
+
+struct nvme_rdma_ctrl {
+	struct list_head	list;
+	struct kref		kref;
+	spinlock_t		lock;
+	enum nvme_rdma_ctrl_state state;
+	int			instance;
+	struct device		*device;
+
+	struct nvme_rdma_queue	*queues;
+	int			queue_count;	/* admin + I/O */
+	int			nr_io_queues;	/* asked for */
+	int			queue_size;	/* of the I/O queues */
+	struct blk_mq_tag_set	tagset;
+	struct list_head	namespaces;
+
+	struct ib_device	*ibdev;
+	struct ib_pd		*pd;
+	struct ib_mr		*mr;		/* lkey for the capsules */
+	u8			max_rd_atom;
+
+	struct sockaddr_storage	addr;
+	char			subsysnqn[NVMF_NQN_FIELD_LEN];
+	char			hostnqn[NVMF_NQN_FIELD_LEN];
+	u16			cntlid;
+	u64			cap;
+	u32			ctrl_config;
+	u32			max_hw_sectors;
+	u32			nn;
+	u16			oncs;
+	u8			vwc;
+	char			serial[20];
+	char			model[40];
+	char			firmware_rev[8];
+
+	struct work_struct	reset_work;
+	struct work_struct	delete_work;
+};
+
+struct nvme_rdma_ns {
+	struct list_head	list;
+	struct nvme_rdma_ctrl	*ctrl;
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+	unsigned		ns_id;
+	int			lba_shift;
+};
+
+static inline void _nvme_rdma_check_size(void)
+{
+	BUILD_BUG_ON(sizeof(struct nvmf_common_command) != 64);
+	BUILD_BUG_ON(sizeof(struct nvmf_connect_command) != 64);
+	BUILD_BUG_ON(sizeof(struct nvmf_property_set_command) != 64);
+	BUILD_BUG_ON(sizeof(struct nvmf_property_get_command) != 64);
+	BUILD_BUG_ON(sizeof(struct nvmf_connect_data) != 1024);
+	BUILD_BUG_ON(sizeof(struct nvme_keyed_sgl_desc) != 16);
+	BUILD_BUG_ON(sizeof(struct nvme_rdma_cm_req) != 32);
+}
+
+static void nvme_rdma_error_recovery(struct nvme_rdma_ctrl *ctrl);
+static void nvme_rdma_del_ctrl(struct nvme_rdma_ctrl *ctrl);
+
+static size_t nvme_rdma_req_size(unsigned nr_sg)
+{
+	return sizeof(struct nvme_rdma_request) +
+		nr_sg * sizeof(struct scatterlist);
+}
+
+static int nvme_rdma_alloc_qe(struct ib_device *ibdev, struct nvme_rdma_qe *qe,
+		size_t size, enum dma_data_direction dir)
+{
+	qe->data = kzalloc(size, GFP_KERNEL);
+	if (!qe->data)
+		return -ENOMEM;
+
+	qe->dma = ib_dma_map_single(ibdev, qe->data, size, dir);
+	if (ib_dma_mapping_error(ibdev, qe->dma)) {
+		kfree(qe->data);
+		qe->data = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void nvme_rdma_free_qe(struct ib_device *ibdev, struct nvme_rdma_qe *qe,
+		size_t size, enum dma_data_direction dir)
+{
+	if (!qe->data)
+		return;
+	ib_dma_unmap_single(ibdev, qe->dma, size, dir);
+	kfree(qe->data);
+	qe->data = NULL;
+}
+
+static int nvme_rdma_alloc_req_mr(struct nvme_rdma_ctrl *ctrl,
+		struct nvme_rdma_request *req)
+{
+	req->mr = ib_alloc_fast_reg_mr(ctrl->pd, NVME_RDMA_MAX_SEGMENTS);
+	if (IS_ERR(req->mr)) {
+		int ret = PTR_ERR(req->mr);
+
+		req->mr = NULL;
+		return ret;
+	}
+	req->mr_valid = false;
+	return 0;
+}
+
+static int nvme_rdma_init_req(struct nvme_rdma_ctrl *ctrl,
+		struct nvme_rdma_request *req, struct nvme_rdma_queue *queue)
+{
+	struct ib_device *ibdev = ctrl->ibdev;
+	int ret;
+
+	req->queue = queue;
+	req->cmd_dma = ib_dma_map_single(ibdev, &req->cmd, sizeof(req->cmd),
+					 DMA_TO_DEVICE);
+	if (ib_dma_mapping_error(ibdev, req->cmd_dma))
+		return -ENOMEM;
+
+	ret = nvme_rdma_alloc_req_mr(ctrl, req);
+	if (ret)
+		goto out_unmap;
+
+	req->page_list = ib_alloc_fast_reg_page_list(ibdev,
+						     NVME_RDMA_MAX_SEGMENTS);
+	if (IS_ERR(req->page_list)) {
+		ret = PTR_ERR(req->page_list);
+		goto out_free_mr;
+	}
+	return 0;
+
+ out_free_mr:
+	ib_dereg_mr(req->mr);
+ out_unmap:
+	ib_dma_unmap_single(ibdev, req->cmd_dma, sizeof(req->cmd),
+			    DMA_TO_DEVICE);
+	return ret;
+}
+
+static void nvme_rdma_exit_req(struct nvme_rdma_ctrl *ctrl,
+		struct nvme_rdma_request *req)
+{
+	ib_free_fast_reg_page_list(req->page_list);
+	ib_dereg_mr(req->mr);
+	ib_dma_unmap_single(ctrl->ibdev, req->cmd_dma, sizeof(req->cmd),
+			    DMA_TO_DEVICE);
+}
+
+static int nvme_rdma_init_request(void *data, struct request *rq,
+		unsigned int hctx_idx, unsigned int rq_idx,
+		unsigned int numa_node)
+{
+	struct nvme_rdma_ctrl *ctrl = data;
+
+	return nvme_rdma_init_req(ctrl, blk_mq_rq_to_pdu(rq),
+				  &ctrl->queues[hctx_idx + 1]);
+}
+
+static void nvme_rdma_exit_request(void *data, struct request *rq,
+		unsigned int hctx_idx, unsigned int rq_idx)
+{
+	nvme_rdma_exit_req(data, blk_mq_rq_to_pdu(rq));
+}
+
+static int nvme_rdma_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+		unsigned int hctx_idx)
+{
+	struct nvme_rdma_ctrl *ctrl = data;
+
+	hctx->driver_data = &ctrl->queues[hctx_idx + 1];
+	return 0;
+}
+
+static int nvme_rdma_post_recv(struct nvme_rdma_queue *queue,
+		struct nvme_rdma_qe *qe)
+{
+	struct ib_recv_wr wr, *bad_wr;
+	struct ib_sge sge;
+	int ret;
+
+	sge.addr = qe->dma;
+	sge.length = sizeof(struct nvme_completion);
+	sge.lkey = queue->ctrl->mr->lkey;
+
+	wr.next = NULL;
+	wr.wr_id = (uintptr_t)qe;
+	wr.sg_list = &sge;
+	wr.num_sge = 1;
+
+	ret = ib_post_recv(queue->qp, &wr, &bad_wr);
+	if (unlikely(ret))
+		dev_err(queue->ctrl->device, "%s failed with error code %d\n",
+			__func__, ret);
+	return ret;
+}
+
+/*
+ * Only every sig_limit-th capsule is sent signaled, which is enough for the
+ * send queue to be reclaimed in time: the completion of a signaled work
+ * request retires all unsignaled ones posted before it.
+ */
+static inline bool nvme_rdma_queue_sig_limit(struct nvme_rdma_queue *queue)
+{
+	return atomic_inc_return(&queue->sig_count) % queue->sig_limit == 0;
+}
+
+static int nvme_rdma_post_send(struct nvme_rdma_queue *queue,
+		struct nvme_rdma_request *req, struct ib_send_wr *first)
+{
+	struct ib_send_wr wr, *bad_wr;
+	struct ib_sge sge;
+	int ret;
+
+	sge.addr = req->cmd_dma;
+	sge.length = sizeof(req->cmd);
+	sge.lkey = queue->ctrl->mr->lkey;
+
+	wr.next = NULL;
+	wr.wr_id = 0;
+	wr.sg_list = &sge;
+	wr.num_sge = 1;
+	wr.opcode = IB_WR_SEND;
+	wr.send_flags = 0;
+	if (nvme_rdma_queue_sig_limit(queue))
+		wr.send_flags |= IB_SEND_SIGNALED;
+
+	if (first)
+		first->next = &wr;
+	else
+		first = &wr;
+
+	ret = ib_post_send(queue->qp, first, &bad_wr);
+	if (unlikely(ret))
+		dev_err(queue->ctrl->device, "%s failed with error code %d\n",
+			__func__, ret);
+	return ret;
+}
+
+static int nvme_rdma_inv_rkey(struct nvme_rdma_queue *queue,
+		struct nvme_rdma_request *req)
+{
+	struct ib_send_wr wr, *bad_wr;
+
+	memset(&wr, 0, sizeof(wr));
+	wr.opcode = IB_WR_LOCAL_INV;
+	wr.wr_id = (uintptr_t)req;
+	wr.send_flags = IB_SEND_SIGNALED;
+	wr.ex.invalidate_rkey = req->mr->rkey;
+
+	return ib_post_send(queue->qp, &wr, &bad_wr);
+}
+
+static void nvme_rdma_set_sgl(struct nvme_command *c, u64 addr, u32 length,
+		u32 key)
+{
+	struct nvme_keyed_sgl_desc *sg = (void *)&c->common.prp1;
+
+	c->common.flags |= NVME_CMD_SGL_METABUF;
+	sg->addr = cpu_to_le64(addr);
+	sg->length[0] = length;
+	sg->length[1] = length >> 8;
+	sg->length[2] = length >> 16;
+	put_unaligned_le32(key, sg->key);
+	sg->type = NVME_KEY_SGL_FMT_DATA_DESC << 4;
+	if (length)
+		sg->type |= NVME_SGL_FMT_INVALIDATE;
+}
+
+/*
+ * Registers the dma mapped req->sg with the request's MR.  The elements are
+ * gap free, QUEUE_FLAG_SG_GAPS sees to that, so the pages of the whole
+ * list make up one virtually contiguous region starting at the first.
+ */
+static void nvme_rdma_build_fr(struct nvme_rdma_queue *queue,
+		struct nvme_rdma_request *req, struct ib_send_wr *wr)
+{
+	struct ib_device *ibdev = queue->ctrl->ibdev;
+	u64 *pages = req->page_list->page_list;
+	struct scatterlist *sg;
+	u64 iova = ib_sg_dma_address(ibdev, req->sg);
+	u32 len = 0;
+	int i, npages = 0;
+
+	for_each_sg(req->sg, sg, req->nents, i) {
+		u64 dma = ib_sg_dma_address(ibdev, sg);
+		u64 end = dma + ib_sg_dma_len(ibdev, sg);
+		u64 page;
+
+		for (page = dma & PAGE_MASK; page < end; page += PAGE_SIZE)
+			pages[npages++] = page;
+		len += ib_sg_dma_len(ibdev, sg);
+	}
+
+	ib_update_fast_reg_key(req->mr, ib_inc_rkey(req->mr->rkey));
+
+	memset(wr, 0, sizeof(*wr));
+	wr->opcode = IB_WR_FAST_REG_MR;
+	wr->wr.fast_reg.iova_start = iova;
+	wr->wr.fast_reg.page_list = req->page_list;
+	wr->wr.fast_reg.page_list_len = npages;
+	wr->wr.fast_reg.page_shift = PAGE_SHIFT;
+	wr->wr.fast_reg.length = len;
+	wr->wr.fast_reg.rkey = req->mr->rkey;
+	wr->wr.fast_reg.access_flags = IB_ACCESS_LOCAL_WRITE |
+				       IB_ACCESS_REMOTE_READ |
+				       IB_ACCESS_REMOTE_WRITE;
+	req->mr_valid = true;
+
+	nvme_rdma_set_sgl(&req->cmd, iova, len, req->mr->rkey);
+}
+
+/*
+ * Maps req->nents worth of req->sg, registers them and sends the capsule
+ * already built in req->cmd.
+ */
+static int nvme_rdma_submit(struct nvme_rdma_queue *queue,
+		struct nvme_rdma_request *req, enum dma_data_direction dir)
+{
+	struct ib_device *ibdev = queue->ctrl->ibdev;
+	struct ib_send_wr reg_wr, *first = NULL;
+	int ret;
+
+	if (req->nents) {
+		req->nents = ib_dma_map_sg(ibdev, req->sg, req->nents, dir);
+		if (!req->nents)
+			return -ENOMEM;
+		nvme_rdma_build_fr(queue, req, &reg_wr);
+		first = &reg_wr;
+	} else {
+		nvme_rdma_set_sgl(&req->cmd, 0, 0, 0);
+	}
+
+	ib_dma_sync_single_for_device(ibdev, req->cmd_dma, sizeof(req->cmd),
+				      DMA_TO_DEVICE);
+
+	req->inflight = true;
+	ret = nvme_rdma_post_send(queue, req, first);
+	if (unlikely(ret)) {
+		req->inflight = false;
+		req->mr_valid = false;
+		if (req->nents)
+			ib_dma_unmap_sg(ibdev, req->sg, req->nents, dir);
+		req->nents = 0;
+	}
+	return ret;
+}
+
+static void nvme_rdma_unmap_data(struct nvme_rdma_request *req,
+		enum dma_data_direction dir)
+{
+	if (!req->nents)
+		return;
+	ib_dma_unmap_sg(req->queue->ctrl->ibdev, req->sg, req->nents, dir);
+	req->nents = 0;
+}
+
+static void nvme_rdma_end_req(struct nvme_rdma_request *req)
+{
+	req->inflight = false;
+	if (req == req->queue->priv)
+		complete(&req->done);
+	else
+		blk_mq_complete_request(blk_mq_rq_from_pdu(req));
+}
+
+static struct nvme_rdma_request *nvme_rdma_find_req(
+		struct nvme_rdma_queue *queue, u16 command_id)
+{
+	struct nvme_rdma_ctrl *ctrl = queue->ctrl;
+	struct request *rq;
+
+	if (command_id == NVME_RDMA_PRIV_CID)
+		return queue->priv;
+	if (!queue->qid || !ctrl->tagset.tags ||
+	    command_id >= ctrl->tagset.queue_depth)
+		return NULL;
+
+	rq = blk_mq_tag_to_rq(ctrl->tagset.tags[queue->qid - 1], command_id);
+	return blk_mq_rq_to_pdu(rq);
+}
+
+static void nvme_rdma_recv_done(struct nvme_rdma_queue *queue,
+		struct ib_wc *wc)
+{
+	struct nvme_rdma_qe *qe = (struct nvme_rdma_qe *)(uintptr_t)wc->wr_id;
+	struct nvme_completion *cqe = qe->data;
+	struct ib_device *ibdev = queue->ctrl->ibdev;
+	struct nvme_rdma_request *req;
+
+	ib_dma_sync_single_for_cpu(ibdev, qe->dma, sizeof(*cqe),
+				   DMA_FROM_DEVICE);
+
+	req = nvme_rdma_find_req(queue, cqe->command_id);
+	if (unlikely(!req || !req->inflight)) {
+		dev_err(queue->ctrl->device,
+			"completion for unknown command %d on QID %d\n",
+			cqe->command_id, queue->qid);
+		nvme_rdma_error_recovery(queue->ctrl);
+		return;
+	}
+
+	/* result is a full 64 bits for an 8 byte property get */
+	req->result = le64_to_cpup((__le64 *)cqe);
+	req->status = le16_to_cpu(cqe->status) >> 1;
+
+	ib_dma_sync_single_for_device(ibdev, qe->dma, sizeof(*cqe),
+				      DMA_FROM_DEVICE);
+	if (nvme_rdma_post_recv(queue, qe)) {
+		nvme_rdma_error_recovery(queue->ctrl);
+		return;
+	}
+
+	if (req->mr_valid) {
+		if ((wc->wc_flags & IB_WC_WITH_INVALIDATE) &&
+		    wc->ex.invalidate_rkey == req->mr->rkey) {
+			req->mr_valid = false;
+		} else {
+			/* completes once the rkey is gone */
+			if (nvme_rdma_inv_rkey(queue, req))
+				nvme_rdma_error_recovery(queue->ctrl);
+			return;
+		}
+	}
+
+	nvme_rdma_end_req(req);
+}
+
+static void nvme_rdma_handle_wc(struct nvme_rdma_queue *queue,
+		struct ib_wc *wc)
+{
+	struct nvme_rdma_request *req;
+
+	if (unlikely(wc->status != IB_WC_SUCCESS)) {
+		/* tearing a QP down flushes what was posted on it */
+		if (wc->status != IB_WC_WR_FLUSH_ERR) {
+			dev_err(queue->ctrl->device,
+				"work request failed, status %d QID %d\n",
+				wc->status, queue->qid);
+			nvme_rdma_error_recovery(queue->ctrl);
+		}
+		return;
+	}
+
+	switch (wc->opcode) {
+	case IB_WC_RECV:
+		nvme_rdma_recv_done(queue, wc);
+		break;
+	case IB_WC_LOCAL_INV:
+		req = (struct nvme_rdma_request *)(uintptr_t)wc->wr_id;
+		req->mr_valid = false;
+		nvme_rdma_end_req(req);
+		break;
+	default:
+		/* signaled SENDs only retire the send queue */
+		break;
+	}
+}
+
+static void nvme_rdma_cq_comp(struct ib_cq *cq, void *cq_context)
+{
+	struct nvme_rdma_queue *queue = cq_context;
+	struct ib_wc wcs[8];
+	int i, n;
+
+	do {
+		while ((n = ib_poll_cq(cq, ARRAY_SIZE(wcs), wcs)) > 0)
+			for (i = 0; i < n; i++)
+				nvme_rdma_handle_wc(queue, &wcs[i]);
+	} while (ib_req_notify_cq(cq, IB_CQ_NEXT_COMP |
+				  IB_CQ_REPORT_MISSED_EVENTS) > 0);
+}
+
+static void nvme_rdma_qp_event(struct ib_event *event, void *context)
+{
+	struct nvme_rdma_queue *queue = context;
+
+	dev_dbg(queue->ctrl->device, "QP event %d on QID %d\n",
+		event->event, queue->qid);
+}
+
+/*
+ * The protection domain is shared by all queues of a controller, and kept
+ * until the controller goes away: the MRs of the I/O requests are
+ * allocated along with the tag set and reused across reconnects.
+ */
+static int nvme_rdma_init_device(struct nvme_rdma_ctrl *ctrl,
+		struct ib_device *ibdev)
+{
+	struct ib_device_attr attr;
+	int ret;
+
+	if (ctrl->ibdev)
+		return ctrl->ibdev == ibdev ? 0 : -EXDEV;
+
+	ret = ib_query_device(ibdev, &attr);
+	if (ret)
+		return ret;
+	if (!(attr.device_cap_flags & IB_DEVICE_MEM_MGT_EXTENSIONS)) {
+		dev_err(ctrl->device, "%s lacks fast registration support\n",
+			ibdev->name);
+		return -EOPNOTSUPP;
+	}
+	ctrl->max_rd_atom = min(attr.max_qp_rd_atom, 255);
+
+	ctrl->pd = ib_alloc_pd(ibdev);
+	if (IS_ERR(ctrl->pd))
+		return PTR_ERR(ctrl->pd);
+
+	ctrl->mr = ib_get_dma_mr(ctrl->pd, IB_ACCESS_LOCAL_WRITE);
+	if (IS_ERR(ctrl->mr)) {
+		ret = PTR_ERR(ctrl->mr);
+		ib_dealloc_pd(ctrl->pd);
+		return ret;
+	}
+
+	ctrl->ibdev = ibdev;
+	return 0;
+}
+
+static void nvme_rdma_free_rsp_ring(struct nvme_rdma_queue *queue)
+{
+	int i;
+
+	if (!queue->rsp_ring)
+		return;
+	for (i = 0; i < queue->queue_size; i++)
+		nvme_rdma_free_qe(queue->ctrl->ibdev, &queue->rsp_ring[i],
+				  sizeof(struct nvme_completion),
+				  DMA_FROM_DEVICE);
+	kfree(queue->rsp_ring);
+	queue->rsp_ring = NULL;
+}
+
+static int nvme_rdma_create_queue_ib(struct nvme_rdma_queue *queue)
+{
+	struct nvme_rdma_ctrl *ctrl = queue->ctrl;
+	struct ib_qp_init_attr init_attr;
+	struct ib_device *ibdev;
+	int i, ret;
+
+	ret = nvme_rdma_init_device(ctrl, queue->cm_id->device);
+	if (ret)
+		return ret;
+	ibdev = ctrl->ibdev;
+
+	/* each command needs a REG_MR, a SEND and a LOCAL_INV at most */
+	queue->cq = ib_create_cq(ibdev, nvme_rdma_cq_comp, NULL, queue,
+				 4 * queue->queue_size + 1,
+				 queue->qid % ibdev->num_comp_vectors);
+	if (IS_ERR(queue->cq)) {
+		ret = PTR_ERR(queue->cq);
+		queue->cq = NULL;
+		return ret;
+	}
+
+	memset(&init_attr, 0, sizeof(init_attr));
+	init_attr.event_handler = nvme_rdma_qp_event;
+	init_attr.qp_context = queue;
+	init_attr.cap.max_send_wr = 3 * queue->queue_size + 1;
+	init_attr.cap.max_recv_wr = queue->queue_size + 1;
+	init_attr.cap.max_send_sge = 1;
+	init_attr.cap.max_recv_sge = 1;
+	init_attr.sq_sig_type = IB_SIGNAL_REQ_WR;
+	init_attr.qp_type = IB_QPT_RC;
+	init_attr.send_cq = queue->cq;
+	init_attr.recv_cq = queue->cq;
+
+	ret = rdma_create_qp(queue->cm_id, ctrl->pd, &init_attr);
+	if (ret)
+		return ret;
+	queue->qp = queue->cm_id->qp;
+
+	queue->rsp_ring = kcalloc(queue->queue_size,
+				  sizeof(struct nvme_rdma_qe), GFP_KERNEL);
+	if (!queue->rsp_ring)
+		return -ENOMEM;
+
+	for (i = 0; i < queue->queue_size; i++) {
+		struct nvme_rdma_qe *qe = &queue->rsp_ring[i];
+
+		ret = nvme_rdma_alloc_qe(ibdev, qe,
+					 sizeof(struct nvme_completion),
+					 DMA_FROM_DEVICE);
+		if (ret)
+			return ret;
+		ret = nvme_rdma_post_recv(queue, qe);
+		if (ret)
+			return ret;
+	}
+
+	return ib_req_notify_cq(queue->cq, IB_CQ_NEXT_COMP);
+}
+
+/* called with the CM id gone, so the QP is ours alone */
+static void nvme_rdma_destroy_queue_ib(struct nvme_rdma_queue *queue)
+{
+	if (queue->qp) {
+		ib_destroy_qp(queue->qp);
+		queue->qp = NULL;
+	}
+	if (queue->cq) {
+		ib_destroy_cq(queue->cq);
+		queue->cq = NULL;
+	}
+	nvme_rdma_free_rsp_ring(queue);
+}
+
+static int nvme_rdma_route_resolved(struct nvme_rdma_queue *queue)
+{
+	struct nvme_rdma_ctrl *ctrl = queue->ctrl;
+	struct rdma_conn_param param = { };
+	struct nvme_rdma_cm_req priv = { };
+
+	priv.recfmt = cpu_to_le16(0);
+	priv.qid = cpu_to_le16(queue->qid);
+	priv.hrqsize = cpu_to_le16(queue->queue_size);
+	priv.hsqsize = cpu_to_le16(queue->queue_size - 1);
+
+	param.qp_num = queue->qp->qp_num;
+	param.flow_control = 1;
+	/* the controller reads the data of our writes */
+	param.responder_resources = ctrl->max_rd_atom;
+	param.initiator_depth = 0;
+	param.retry_count = 7;
+	param.rnr_retry_count = 7;
+	param.private_data = &priv;
+	param.private_data_len = sizeof(priv);
+
+	return rdma_connect(queue->cm_id, &param);
+}
+
+static int nvme_rdma_conn_rejected(struct nvme_rdma_queue *queue,
+		struct rdma_cm_event *ev)
+{
+	const struct nvme_rdma_cm_rej *rej = ev->param.conn.private_data;
+
+	if (rej && ev->param.conn.private_data_len >= sizeof(*rej))
+		dev_err(queue->ctrl->device,
+			"connect of QID %d rejected, status %d\n",
+			queue->qid, le16_to_cpu(rej->sts));
+	else
+		dev_err(queue->ctrl->device,
+			"connect of QID %d rejected, CM status %d\n",
+			queue->qid, ev->status);
+	return -ECONNRESET;
+}
+
+static int nvme_rdma_cm_handler(struct rdma_cm_id *cm_id,
+		struct rdma_cm_event *ev)
+{
+	struct nvme_rdma_queue *queue = cm_id->context;
+	int cm_error = 0;
+
+	switch (ev->event) {
+	case RDMA_CM_EVENT_ADDR_RESOLVED:
+		cm_error = nvme_rdma_create_queue_ib(queue);
+		if (!cm_error)
+			cm_error = rdma_resolve_route(cm_id,
+						      NVME_RDMA_CM_TIMEOUT);
+		break;
+	case RDMA_CM_EVENT_ROUTE_RESOLVED:
+		cm_error = nvme_rdma_route_resolved(queue);
+		break;
+	case RDMA_CM_EVENT_ESTABLISHED:
+		queue->cm_error = 0;
+		complete(&queue->cm_done);
+		return 0;
+	case RDMA_CM_EVENT_REJECTED:
+		cm_error = nvme_rdma_conn_rejected(queue, ev);
+		break;
+	case RDMA_CM_EVENT_ADDR_ERROR:
+	case RDMA_CM_EVENT_ROUTE_ERROR:
+	case RDMA_CM_EVENT_CONNECT_ERROR:
+	case RDMA_CM_EVENT_UNREACHABLE:
+		dev_dbg(queue->ctrl->device, "CM error event %d on QID %d\n",
+			ev->event, queue->qid);
+		cm_error = -ECONNRESET;
+		break;
+	case RDMA_CM_EVENT_DISCONNECTED:
+	case RDMA_CM_EVENT_ADDR_CHANGE:
+	case RDMA_CM_EVENT_TIMEWAIT_EXIT:
+		nvme_rdma_error_recovery(queue->ctrl);
+		break;
+	case RDMA_CM_EVENT_DEVICE_REMOVAL:
+		/* the CM waits for all our ids to be destroyed */
+		nvme_rdma_del_ctrl(queue->ctrl);
+		break;
+	default:
+		break;
+	}
+
+	if (cm_error) {
+		queue->cm_error = cm_error;
+		complete(&queue->cm_done);
+	}
+	return 0;
+}
+
+static void nvme_rdma_free_queue(struct nvme_rdma_queue *queue)
+{
+	struct nvme_rdma_ctrl *ctrl = queue->ctrl;
+
+	if (!queue->cm_id)
+		return;
+
+	clear_bit(NVME_RDMA_Q_LIVE, &queue->flags);
+	if (test_and_clear_bit(NVME_RDMA_Q_CONNECTED, &queue->flags))
+		rdma_disconnect(queue->cm_id);
+
+	/* no more CM events once the id is gone */
+	rdma_destroy_id(queue->cm_id);
+	nvme_rdma_destroy_queue_ib(queue);
+	queue->cm_id = NULL;
+
+	if (queue->priv) {
+		nvme_rdma_exit_req(ctrl, queue->priv);
+		kfree(queue->priv);
+		queue->priv = NULL;
+	}
+}
+
+static int nvme_rdma_init_queue(struct nvme_rdma_ctrl *ctrl, int qid,
+		int queue_size)
+{
+	struct nvme_rdma_queue *queue = &ctrl->queues[qid];
+	int ret;
+
+	queue->ctrl = ctrl;
+	queue->qid = qid;
+	queue->queue_size = queue_size;
+	queue->sig_limit = max(queue_size / 2, 1);
+	queue->flags = 0;
+	atomic_set(&queue->sig_count, 0);
+	mutex_init(&queue->priv_lock);
+	init_completion(&queue->cm_done);
+	queue->cm_error = -ETIMEDOUT;
+
+	queue->cm_id = rdma_create_id(nvme_rdma_cm_handler, queue,
+				      RDMA_PS_TCP, IB_QPT_RC);
+	if (IS_ERR(queue->cm_id)) {
+		ret = PTR_ERR(queue->cm_id);
+		queue->cm_id = NULL;
+		return ret;
+	}
+
+	ret = rdma_resolve_addr(queue->cm_id, NULL,
+				(struct sockaddr *)&ctrl->addr,
+				NVME_RDMA_CM_TIMEOUT);
+	if (ret)
+		goto out_free;
+
+	wait_for_completion_timeout(&queue->cm_done,
+				    msecs_to_jiffies(NVME_RDMA_CM_WAIT));
+	ret = queue->cm_error;
+	if (ret)
+		goto out_free;
+	set_bit(NVME_RDMA_Q_CONNECTED, &queue->flags);
+
+	queue->priv = kzalloc(nvme_rdma_req_size(1), GFP_KERNEL);
+	if (!queue->priv) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	init_completion(&queue->priv->done);
+	ret = nvme_rdma_init_req(ctrl, queue->priv, queue);
+	if (ret) {
+		kfree(queue->priv);
+		queue->priv = NULL;
+		goto out_free;
+	}
+	return 0;
+
+ out_free:
+	dev_err(ctrl->device, "failed to connect QID %d: %d\n", qid, ret);
+	nvme_rdma_free_queue(queue);
+	return ret;
+}
+
+/*
+ * Issues @cmd on @queue and waits for it.  Returns the NVMe status of the
+ * command, or a negative errno if it could not be sent or timed out, in
+ * which case the queue is left for the reset to tear down.
+ */
+static int nvme_rdma_sync_cmd(struct nvme_rdma_queue *queue,
+		struct nvme_command *cmd, void *buf, unsigned len,
+		enum dma_data_direction dir, u64 *result)
+{
+	struct nvme_rdma_request *req = queue->priv;
+	struct ib_device *ibdev = queue->ctrl->ibdev;
+	int ret;
+
+	if (!req)
+		return -ENOTCONN;
+
+	mutex_lock(&queue->priv_lock);
+	ib_dma_sync_single_for_cpu(ibdev, req->cmd_dma, sizeof(req->cmd),
+				   DMA_TO_DEVICE);
+	req->cmd = *cmd;
+	req->cmd.common.command_id = NVME_RDMA_PRIV_CID;
+	req->nents = 0;
+	if (len) {
+		sg_init_one(req->sg, buf, len);
+		req->nents = 1;
+	}
+	reinit_completion(&req->done);
+
+	ret = nvme_rdma_submit(queue, req, dir);
+	if (ret)
+		goto out;
+
+	if (!wait_for_completion_timeout(&req->done, ADMIN_TIMEOUT)) {
+		dev_warn(queue->ctrl->device,
+			 "timeout on command %x, QID %d\n",
+			 cmd->common.opcode, queue->qid);
+		nvme_rdma_error_recovery(queue->ctrl);
+		ret = -ETIMEDOUT;
+	} else {
+		if (result)
+			*result = req->result;
+		ret = req->status;
+	}
+	nvme_rdma_unmap_data(req, dir);
+ out:
+	mutex_unlock(&queue->priv_lock);
+	return ret;
+}
+
+static int nvme_rdma_reg_read(struct nvme_rdma_ctrl *ctrl, u32 off,
+		bool is64, u64 *val)
+{
+	struct nvme_command c = { };
+
+	c.prop_get.opcode = nvme_fabrics_command;
+	c.prop_get.fctype = nvme_fabrics_type_property_get;
+	c.prop_get.attrib = is64;
+	c.prop_get.offset = cpu_to_le32(off);
+
+	return nvme_rdma_sync_cmd(&ctrl->queues[0], &c, NULL, 0,
+				  DMA_NONE, val);
+}
+
+static int nvme_rdma_reg_write32(struct nvme_rdma_ctrl *ctrl, u32 off,
+		u32 val)
+{
+	struct nvme_command c = { };
+
+	c.prop_set.opcode = nvme_fabrics_command;
+	c.prop_set.fctype = nvme_fabrics_type_property_set;
+	c.prop_set.attrib = 0;
+	c.prop_set.offset = cpu_to_le32(off);
+	c.prop_set.value = cpu_to_le64(val);
+
+	return nvme_rdma_sync_cmd(&ctrl->queues[0], &c, NULL, 0,
+				  DMA_NONE, NULL);
+}
+
+static int nvme_rdma_connect_queue(struct nvme_rdma_ctrl *ctrl, int qid)
+{
+	struct nvme_rdma_queue *queue = &ctrl->queues[qid];
+	struct nvmf_connect_data *data;
+	struct nvme_command c = { };
+	u64 result;
+	int ret;
+
+	c.connect.opcode = nvme_fabrics_command;
+	c.connect.fctype = nvme_fabrics_type_connect;
+	c.connect.qid = cpu_to_le16(qid);
+	c.connect.sqsize = cpu_to_le16(queue->queue_size - 1);
+
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+	memcpy(data->hostid, &nvme_rdma_hostid, sizeof(data->hostid));
+	/* the admin queue connect is what assigns the controller id */
+	data->cntlid = cpu_to_le16(qid ? ctrl->cntlid : 0xffff);
+	strncpy(data->subsysnqn, ctrl->subsysnqn, NVMF_NQN_SIZE);
+	strncpy(data->hostnqn, ctrl->hostnqn, NVMF_NQN_SIZE);
+
+	ret = nvme_rdma_sync_cmd(queue, &c, data, sizeof(*data),
+				 DMA_TO_DEVICE, &result);
+	kfree(data);
+	if (ret) {
+		dev_err(ctrl->device, "Fabrics connect of QID %d failed: %d\n",
+			qid, ret);
+		return ret < 0 ? ret : -EIO;
+	}
+
+	if (!qid)
+		ctrl->cntlid = result & 0xffff;
+	set_bit(NVME_RDMA_Q_LIVE, &queue->flags);
+	return 0;
+}
+
+static int nvme_rdma_wait_ready(struct nvme_rdma_ctrl *ctrl, u32 mask,
+		u32 bits)
+{
+	unsigned long timeout;
+	u64 csts;
+	int ret;
+
+	timeout = ((NVME_CAP_TIMEOUT(ctrl->cap) + 1) * HZ / 2) + jiffies;
+
+	while (!(ret = nvme_rdma_reg_read(ctrl, NVMF_PROP_CSTS, false,
+					  &csts))) {
+		if ((csts & mask) == bits)
+			return 0;
+
+		msleep(100);
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		if (time_after(jiffies, timeout)) {
+			dev_err(ctrl->device,
+				"controller not ready, CSTS %llx\n", csts);
+			return -ENODEV;
+		}
+	}
+
+	return ret < 0 ? ret : -EIO;
+}
+
+static int nvme_rdma_enable_ctrl(struct nvme_rdma_ctrl *ctrl)
+{
+	int ret;
+
+	ctrl->ctrl_config = NVME_CC_CSS_NVM;
+	ctrl->ctrl_config |= (PAGE_SHIFT - 12) << NVME_CC_MPS_SHIFT;
+	ctrl->ctrl_config |= NVME_CC_ARB_RR | NVME_CC_SHN_NONE;
+	ctrl->ctrl_config |= NVME_CC_IOSQES | NVME_CC_IOCQES;
+	ctrl->ctrl_config |= NVME_CC_ENABLE;
+
+	ret = nvme_rdma_reg_write32(ctrl, NVMF_PROP_CC, ctrl->ctrl_config);
+	if (ret)
+		return ret < 0 ? ret : -EIO;
+
+	return nvme_rdma_wait_ready(ctrl, NVME_CSTS_RDY, NVME_CSTS_RDY);
+}
+
+static int nvme_rdma_shutdown_ctrl(struct nvme_rdma_ctrl *ctrl)
+{
+	int ret;
+
+	ctrl->ctrl_config &= ~NVME_CC_SHN_MASK;
+	ctrl->ctrl_config |= NVME_CC_SHN_NORMAL;
+
+	ret = nvme_rdma_reg_write32(ctrl, NVMF_PROP_CC, ctrl->ctrl_config);
+	if (ret)
+		return ret < 0 ? ret : -EIO;
+
+	return nvme_rdma_wait_ready(ctrl, NVME_CSTS_SHST_MASK,
+				    NVME_CSTS_SHST_CMPLT);
+}
+
+static int nvme_rdma_configure_admin_queue(struct nvme_rdma_ctrl *ctrl)
+{
+	int ret;
+
+	ret = nvme_rdma_init_queue(ctrl, 0, NVME_RDMA_AQ_DEPTH);
+	if (ret)
+		return ret;
+
+	ret = nvme_rdma_connect_queue(ctrl, 0);
+	if (ret)
+		goto out_free;
+
+	ret = nvme_rdma_reg_read(ctrl, NVMF_PROP_CAP, true, &ctrl->cap);
+	if (ret) {
+		ret = ret < 0 ? ret : -EIO;
+		goto out_free;
+	}
+
+	ret = nvme_rdma_enable_ctrl(ctrl);
+	if (ret)
+		goto out_free;
+	return 0;
+
+ out_free:
+	nvme_rdma_free_queue(&ctrl->queues[0]);
+	return ret;
+}
+
+static void nvme_rdma_free_io_queues(struct nvme_rdma_ctrl *ctrl)
+{
+	int i;
+
+	for (i = 1; i < ctrl->queue_count; i++)
+		nvme_rdma_free_queue(&ctrl->queues[i]);
+}
+
+static int nvme_rdma_connect_io_queues(struct nvme_rdma_ctrl *ctrl)
+{
+	int i, ret;
+
+	for (i = 1; i < ctrl->queue_count; i++) {
+		ret = nvme_rdma_init_queue(ctrl, i, ctrl->queue_size);
+		if (!ret)
+			ret = nvme_rdma_connect_queue(ctrl, i);
+		if (ret) {
+			nvme_rdma_free_io_queues(ctrl);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int nvme_rdma_identify(struct nvme_rdma_ctrl *ctrl, unsigned nsid,
+		unsigned cns, void *buf)
+{
+	struct nvme_command c = { };
+
+	c.identify.opcode = nvme_admin_identify;
+	c.identify.nsid = cpu_to_le32(nsid);
+	c.identify.cns = cpu_to_le32(cns);
+
+	return nvme_rdma_sync_cmd(&ctrl->queues[0], &c, buf, 4096,
+				  DMA_FROM_DEVICE, NULL);
+}
+
+static int nvme_rdma_set_queue_count(struct nvme_rdma_ctrl *ctrl, int count)
+{
+	struct nvme_command c = { };
+	u32 q_count = (count - 1) | ((count - 1) << 16);
+	u64 result;
+	int status;
+
+	c.features.opcode = nvme_admin_set_features;
+	c.features.fid = cpu_to_le32(NVME_FEAT_NUM_QUEUES);
+	c.features.dword11 = cpu_to_le32(q_count);
+
+	status = nvme_rdma_sync_cmd(&ctrl->queues[0], &c, NULL, 0, DMA_NONE,
+				    &result);
+	if (status < 0)
+		return status;
+	if (status > 0) {
+		dev_err(ctrl->device, "Could not set queue count (%d)\n",
+			status);
+		return -EBUSY;
+	}
+	return min(result & 0xffff, (result >> 16) & 0xffff) + 1;
+}
+
+static int nvme_rdma_identify_ctrl(struct nvme_rdma_ctrl *ctrl)
+{
+	struct nvme_id_ctrl *id;
+	u32 max_sectors;
+	int ret;
+
+	id = kmalloc(4096, GFP_KERNEL);
+	if (!id)
+		return -ENOMEM;
+
+	ret = nvme_rdma_identify(ctrl, 0, 1, id);
+	if (ret) {
+		ret = ret < 0 ? ret : -EIO;
+		goto out;
+	}
+
+	ctrl->nn = le32_to_cpup(&id->nn);
+	ctrl->oncs = le16_to_cpup(&id->oncs);
+	ctrl->vwc = id->vwc;
+	memcpy(ctrl->serial, id->sn, sizeof(id->sn));
+	memcpy(ctrl->model, id->mn, sizeof(id->mn));
+	memcpy(ctrl->firmware_rev, id->fr, sizeof(id->fr));
+
+	/* one page per registered page list entry, less the unaligned head */
+	max_sectors = (NVME_RDMA_MAX_SEGMENTS - 1) << (PAGE_SHIFT - 9);
+	if (id->mdts) {
+		int shift = NVME_CAP_MPSMIN(ctrl->cap) + 12;
+
+		max_sectors = min_t(u32, max_sectors,
+				    1 << (id->mdts + shift - 9));
+	}
+	ctrl->max_hw_sectors = max_sectors;
+ out:
+	kfree(id);
+	return ret;
+}
+
+static int nvme_rdma_open(struct block_device *bdev, fmode_t mode)
+{
+	struct nvme_rdma_ns *ns = bdev->bd_disk->private_data;
+
+	kref_get(&ns->ctrl->kref);
+	return 0;
+}
+
+static void nvme_rdma_free_ctrl(struct kref *kref);
+
+static void nvme_rdma_release(struct gendisk *disk, fmode_t mode)
+{
+	struct nvme_rdma_ns *ns = disk->private_data;
+
+	kref_put(&ns->ctrl->kref, nvme_rdma_free_ctrl);
+}
+
+static int nvme_rdma_getgeo(struct block_device *bd, struct hd_geometry *geo)
+{
+	/* some standard values */
+	geo->heads = 1 << 6;
+	geo->sectors = 1 << 5;
+	geo->cylinders = get_capacity(bd->bd_disk) >> 11;
+	return 0;
+}
+
+static const struct block_device_operations nvme_rdma_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nvme_rdma_open,
+	.release	= nvme_rdma_release,
+	.getgeo		= nvme_rdma_getgeo,
+};
+
+static int nvme_rdma_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq,
+		bool last)
+{
+	struct nvme_rdma_ns *ns = hctx->queue->queuedata;
+	struct nvme_rdma_queue *queue = hctx->driver_data;
+	struct nvme_rdma_request *req = blk_mq_rq_to_pdu(rq);
+	struct nvme_command *c = &req->cmd;
+	struct ib_device *ibdev = queue->ctrl->ibdev;
+	enum dma_data_direction dir = rq_data_dir(rq) ? DMA_TO_DEVICE :
+							DMA_FROM_DEVICE;
+	int ret;
+
+	if (unlikely(!test_bit(NVME_RDMA_Q_LIVE, &queue->flags))) {
+		if (ACCESS_ONCE(queue->ctrl->state) == NVME_RDMA_CTRL_DELETING)
+			return BLK_MQ_RQ_QUEUE_ERROR;
+		goto busy;
+	}
+
+	ib_dma_sync_single_for_cpu(ibdev, req->cmd_dma, sizeof(*c),
+				   DMA_TO_DEVICE);
+	memset(c, 0, sizeof(*c));
+	c->common.command_id = rq->tag;
+	c->common.nsid = cpu_to_le32(ns->ns_id);
+
+	if (rq->cmd_flags & REQ_FLUSH) {
+		c->common.opcode = nvme_cmd_flush;
+	} else {
+		u16 control = 0;
+		u32 dsmgmt = 0;
+
+		if (rq->cmd_flags & REQ_FUA)
+			control |= NVME_RW_FUA;
+		if (rq->cmd_flags & (REQ_FAILFAST_DEV | REQ_RAHEAD))
+			control |= NVME_RW_LR;
+		if (rq->cmd_flags & REQ_RAHEAD)
+			dsmgmt |= NVME_RW_DSM_FREQ_PREFETCH;
+
+		c->rw.opcode = rq_data_dir(rq) ? nvme_cmd_write :
+						  nvme_cmd_read;
+		c->rw.slba = cpu_to_le64(blk_rq_pos(rq) >>
+					 (ns->lba_shift - 9));
+		c->rw.length = cpu_to_le16((blk_rq_bytes(rq) >>
+					    ns->lba_shift) - 1);
+		c->rw.control = cpu_to_le16(control);
+		c->rw.dsmgmt = cpu_to_le32(dsmgmt);
+	}
+
+	req->status = 0;
+	req->nents = 0;
+	if (rq->nr_phys_segments) {
+		sg_init_table(req->sg, rq->nr_phys_segments);
+		req->nents = blk_rq_map_sg(rq->q, rq, req->sg);
+		if (!req->nents)
+			return BLK_MQ_RQ_QUEUE_ERROR;
+	}
+
+	blk_mq_start_request(rq);
+	ret = nvme_rdma_submit(queue, req, dir);
+	if (likely(!ret))
+		return BLK_MQ_RQ_QUEUE_OK;
+
+	/* the QP is broken, the reset requeues what it cannot complete */
+	nvme_rdma_error_recovery(queue->ctrl);
+	req->status = NVME_SC_ABORT_REQ;
+	blk_mq_complete_request(rq);
+	return BLK_MQ_RQ_QUEUE_OK;
+
+ busy:
+	blk_mq_stop_hw_queue(hctx);
+	blk_mq_delay_queue(hctx, NVME_RDMA_QUEUE_DELAY);
+	return BLK_MQ_RQ_QUEUE_BUSY;
+}
+
+static void nvme_rdma_complete_rq(struct request *rq)
+{
+	struct nvme_rdma_request *req = blk_mq_rq_to_pdu(rq);
+	u16 status = req->status;
+
+	nvme_rdma_unmap_data(req, rq_data_dir(rq) ? DMA_TO_DEVICE :
+						    DMA_FROM_DEVICE);
+
+	if (unlikely(status)) {
+		if (!(status & NVME_SC_DNR || blk_noretry_request(rq)) &&
+		    (jiffies - rq->start_time) < IOD_TIMEOUT) {
+			blk_mq_requeue_request(rq);
+			if (!blk_queue_stopped(rq->q))
+				blk_mq_kick_requeue_list(rq->q);
+			return;
+		}
+		blk_mq_end_request(rq, status == NVME_SC_CAP_EXCEEDED ?
+				   -ENOSPC : -EIO);
+		return;
+	}
+
+	blk_mq_end_request(rq, 0);
+}
+
+static enum blk_eh_timer_return nvme_rdma_timeout(struct request *rq,
+		bool reserved)
+{
+	struct nvme_rdma_request *req = blk_mq_rq_to_pdu(rq);
+
+	dev_warn(req->queue->ctrl->device, "Timeout I/O %d QID %d\n",
+		 rq->tag, req->queue->qid);
+
+	/*
+	 * There is no abort over a fabric that may have lost the command, so
+	 * reconnect: the reset cancels the request, or it completes first.
+	 */
+	nvme_rdma_error_recovery(req->queue->ctrl);
+	return BLK_EH_RESET_TIMER;
+}
+
+static struct blk_mq_ops nvme_rdma_mq_ops = {
+	.queue_rq	= nvme_rdma_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_hctx	= nvme_rdma_init_hctx,
+	.init_request	= nvme_rdma_init_request,
+	.exit_request	= nvme_rdma_exit_request,
+	.complete	= nvme_rdma_complete_rq,
+	.timeout	= nvme_rdma_timeout,
+};
+
+static int nvme_rdma_alloc_tagset(struct nvme_rdma_ctrl *ctrl)
+{
+	memset(&ctrl->tagset, 0, sizeof(ctrl->tagset));
+	ctrl->tagset.ops = &nvme_rdma_mq_ops;
+	ctrl->tagset.nr_hw_queues = ctrl->queue_count - 1;
+	ctrl->tagset.timeout = io_timeout * HZ;
+	ctrl->tagset.numa_node = NUMA_NO_NODE;
+	ctrl->tagset.queue_depth = min_t(int, ctrl->queue_size - 1,
+					 BLK_MQ_MAX_DEPTH);
+	ctrl->tagset.cmd_size = nvme_rdma_req_size(NVME_RDMA_MAX_SEGMENTS);
+	ctrl->tagset.flags = BLK_MQ_F_SHOULD_MERGE;
+	ctrl->tagset.driver_data = ctrl;
+
+	return blk_mq_alloc_tag_set(&ctrl->tagset);
+}
+
+static void nvme_rdma_alloc_ns(struct nvme_rdma_ctrl *ctrl, unsigned nsid,
+		struct nvme_id_ns *id)
+{
+	struct nvme_rdma_ns *ns;
+	struct gendisk *disk;
+	int lbaf;
+
+	ns = kzalloc(sizeof(*ns), GFP_KERNEL);
+	if (!ns)
+		return;
+	ns->queue = blk_mq_init_queue(&ctrl->tagset);
+	if (IS_ERR(ns->queue))
+		goto out_free_ns;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, ns->queue);
+	queue_flag_set_unlocked(QUEUE_FLAG_SG_GAPS, ns->queue);
+	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, ns->queue);
+	ns->ctrl = ctrl;
+	ns->queue->queuedata = ns;
+
+	disk = alloc_disk(0);
+	if (!disk)
+		goto out_free_queue;
+	ns->ns_id = nsid;
+	ns->disk = disk;
+	lbaf = id->flbas & 0xf;
+	ns->lba_shift = id->lbaf[lbaf].ds;
+	blk_queue_logical_block_size(ns->queue, 1 << ns->lba_shift);
+	blk_queue_max_hw_sectors(ns->queue, ctrl->max_hw_sectors);
+	blk_queue_max_segments(ns->queue, NVME_RDMA_MAX_SEGMENTS - 1);
+	blk_queue_segment_boundary(ns->queue, PAGE_SIZE - 1);
+	if (ctrl->vwc & NVME_CTRL_VWC_PRESENT)
+		blk_queue_flush(ns->queue, REQ_FLUSH | REQ_FUA);
+
+	disk->major = nvme_rdma_major;
+	disk->first_minor = 0;
+	disk->fops = &nvme_rdma_fops;
+	disk->private_data = ns;
+	disk->queue = ns->queue;
+	disk->driverfs_dev = ctrl->device;
+	disk->flags = GENHD_FL_EXT_DEVT;
+	sprintf(disk->disk_name, "nvmf%dn%d", ctrl->instance, nsid);
+	set_capacity(disk, le64_to_cpup(&id->nsze) << (ns->lba_shift - 9));
+
+	list_add_tail(&ns->list, &ctrl->namespaces);
+	return;
+
+ out_free_queue:
+	blk_cleanup_queue(ns->queue);
+ out_free_ns:
+	kfree(ns);
+}
+
+static void nvme_rdma_scan_namespaces(struct nvme_rdma_ctrl *ctrl)
+{
+	struct nvme_rdma_ns *ns;
+	struct nvme_id_ns *id;
+	unsigned i;
+
+	id = kmalloc(4096, GFP_KERNEL);
+	if (!id)
+		return;
+
+	for (i = 1; i <= ctrl->nn; i++) {
+		if (nvme_rdma_identify(ctrl, i, 0, id))
+			continue;
+		if (id->ncap == 0)
+			continue;
+		nvme_rdma_alloc_ns(ctrl, i, id);
+	}
+	kfree(id);
+
+	list_for_each_entry(ns, &ctrl->namespaces, list)
+		add_disk(ns->disk);
+}
+
+static void nvme_rdma_stop_io(struct nvme_rdma_ctrl *ctrl)
+{
+	struct nvme_rdma_ns *ns;
+
+	list_for_each_entry(ns, &ctrl->namespaces, list)
+		blk_mq_stop_hw_queues(ns->queue);
+}
+
+static void nvme_rdma_restart_io(struct nvme_rdma_ctrl *ctrl)
+{
+	struct nvme_rdma_ns *ns;
+
+	list_for_each_entry(ns, &ctrl->namespaces, list) {
+		blk_mq_start_stopped_hw_queues(ns->queue, true);
+		blk_mq_kick_requeue_list(ns->queue);
+	}
+}
+
+static void nvme_rdma_cancel_rq(struct blk_mq_hw_ctx *hctx,
+		struct request *rq, void *data, bool reserved)
+{
+	struct nvme_rdma_ctrl *ctrl = data;
+	struct nvme_rdma_request *req = blk_mq_rq_to_pdu(rq);
+
+	if (!req->inflight)
+		return;
+
+	/* the QP is gone, so is the chance to invalidate the old rkey */
+	if (req->mr_valid) {
+		ib_dereg_mr(req->mr);
+		if (nvme_rdma_alloc_req_mr(ctrl, req))
+			dev_err(ctrl->device, "failed to reallocate an MR\n");
+	}
+
+	dev_warn(ctrl->device, "Cancelling I/O %d QID %d\n", rq->tag,
+		 req->queue->qid);
+	req->inflight = false;
+	req->status = NVME_SC_ABORT_REQ;
+	if (ctrl->state == NVME_RDMA_CTRL_DELETING)
+		req->status |= NVME_SC_DNR;
+	blk_mq_complete_request(rq);
+}
+
+/*
+ * Fails or requeues every command sent on the queues just torn down.
+ * Busy tags can only be walked per request queue, so look at each
+ * namespace's hardware contexts.
+ */
+static void nvme_rdma_cancel_io(struct nvme_rdma_ctrl *ctrl)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct nvme_rdma_ns *ns;
+	int i;
+
+	list_for_each_entry(ns, &ctrl->namespaces, list)
+		queue_for_each_hw_ctx(ns->queue, hctx, i)
+			blk_mq_tag_busy_iter(hctx, nvme_rdma_cancel_rq, ctrl);
+}
+
+static bool nvme_rdma_change_state(struct nvme_rdma_ctrl *ctrl,
+		enum nvme_rdma_ctrl_state old, enum nvme_rdma_ctrl_state new)
+{
+	unsigned long flags;
+	bool changed = false;
+
+	spin_lock_irqsave(&ctrl->lock, flags);
+	if (ctrl->state == old) {
+		ctrl->state = new;
+		changed = true;
+	}
+	spin_unlock_irqrestore(&ctrl->lock, flags);
+	return changed;
+}
+
+static void nvme_rdma_error_recovery(struct nvme_rdma_ctrl *ctrl)
+{
+	if (nvme_rdma_change_state(ctrl, NVME_RDMA_CTRL_LIVE,
+				   NVME_RDMA_CTRL_RESETTING))
+		queue_work(nvme_rdma_wq, &ctrl->reset_work);
+}
+
+/*
+ * Controllers only become DELETING here, so the delete work is queued
+ * once.  One that is still being created is left to its creator.
+ */
+static void nvme_rdma_del_ctrl(struct nvme_rdma_ctrl *ctrl)
+{
+	unsigned long flags;
+	bool queue = false;
+
+	spin_lock_irqsave(&ctrl->lock, flags);
+	if (ctrl->state == NVME_RDMA_CTRL_LIVE ||
+	    ctrl->state == NVME_RDMA_CTRL_RESETTING) {
+		ctrl->state = NVME_RDMA_CTRL_DELETING;
+		queue = true;
+	}
+	spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if (queue)
+		queue_work(nvme_rdma_wq, &ctrl->delete_work);
+}
+
+static void nvme_rdma_reset_work(struct work_struct *work)
+{
+	struct nvme_rdma_ctrl *ctrl = container_of(work,
+					struct nvme_rdma_ctrl, reset_work);
+	int ret;
+
+	dev_warn(ctrl->device, "reconnecting to %s\n", ctrl->subsysnqn);
+
+	nvme_rdma_stop_io(ctrl);
+	nvme_rdma_free_io_queues(ctrl);
+	nvme_rdma_free_queue(&ctrl->queues[0]);
+	nvme_rdma_cancel_io(ctrl);
+
+	ret = nvme_rdma_configure_admin_queue(ctrl);
+	if (ret)
+		goto out_fail;
+
+	ret = nvme_rdma_connect_io_queues(ctrl);
+	if (ret)
+		goto out_fail;
+
+	if (!nvme_rdma_change_state(ctrl, NVME_RDMA_CTRL_RESETTING,
+				    NVME_RDMA_CTRL_LIVE))
+		return;
+	nvme_rdma_restart_io(ctrl);
+	return;
+
+ out_fail:
+	dev_err(ctrl->device, "reconnect failed (%d), removing\n", ret);
+	nvme_rdma_del_ctrl(ctrl);
+}
+
+static void nvme_rdma_free_ctrl(struct kref *kref)
+{
+	struct nvme_rdma_ctrl *ctrl = container_of(kref, struct nvme_rdma_ctrl,
+						   kref);
+	struct nvme_rdma_ns *ns, *next;
+
+	list_for_each_entry_safe(ns, next, &ctrl->namespaces, list) {
+		list_del(&ns->list);
+		put_disk(ns->disk);
+		kfree(ns);
+	}
+
+	spin_lock(&instance_lock);
+	ida_remove(&nvme_rdma_instance_ida, ctrl->instance);
+	spin_unlock(&instance_lock);
+
+	kfree(ctrl->queues);
+	kfree(ctrl);
+}
+
+/*
+ * Tears a controller down, live or not.  Once the state is DELETING no
+ * reset runs any more, and queue_rq fails what it cannot send, so the
+ * disks can go while the queues may still be up to write back to them.
+ */
+static void nvme_rdma_delete_work(struct work_struct *work)
+{
+	struct nvme_rdma_ctrl *ctrl = container_of(work,
+					struct nvme_rdma_ctrl, delete_work);
+	struct nvme_rdma_ns *ns;
+
+	cancel_work_sync(&ctrl->reset_work);
+
+	mutex_lock(&ctrl_list_mutex);
+	list_del_init(&ctrl->list);
+	mutex_unlock(&ctrl_list_mutex);
+
+	/* requeued by a reset, these now fail */
+	nvme_rdma_restart_io(ctrl);
+
+	list_for_each_entry(ns, &ctrl->namespaces, list) {
+		if (ns->disk->flags & GENHD_FL_UP)
+			del_gendisk(ns->disk);
+		blk_cleanup_queue(ns->queue);
+	}
+
+	if (test_bit(NVME_RDMA_Q_LIVE, &ctrl->queues[0].flags))
+		nvme_rdma_shutdown_ctrl(ctrl);
+
+	nvme_rdma_free_io_queues(ctrl);
+	nvme_rdma_free_queue(&ctrl->queues[0]);
+	nvme_rdma_cancel_io(ctrl);
+
+	if (ctrl->tagset.tags)
+		blk_mq_free_tag_set(&ctrl->tagset);
+	if (ctrl->mr)
+		ib_dereg_mr(ctrl->mr);
+	if (ctrl->pd)
+		ib_dealloc_pd(ctrl->pd);
+
+	device_destroy(nvme_rdma_class, MKDEV(0, 0) + ctrl->instance);
+	kref_put(&ctrl->kref, nvme_rdma_free_ctrl);
+}
+
+static ssize_t nvme_rdma_delete_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct nvme_rdma_ctrl *ctrl = dev_get_drvdata(dev);
+
+	nvme_rdma_del_ctrl(ctrl);
+	return count;
+}
+static DEVICE_ATTR(delete_controller, S_IWUSR, NULL, nvme_rdma_delete_store);
+
+static ssize_t nvme_rdma_subsysnqn_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_rdma_ctrl *ctrl = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%s\n", ctrl->subsysnqn);
+}
+static DEVICE_ATTR(subsysnqn, S_IRUGO, nvme_rdma_subsysnqn_show, NULL);
+
+static ssize_t nvme_rdma_address_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_rdma_ctrl *ctrl = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%pISpc\n", &ctrl->addr);
+}
+static DEVICE_ATTR(address, S_IRUGO, nvme_rdma_address_show, NULL);
+
+static ssize_t nvme_rdma_model_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_rdma_ctrl *ctrl = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%.*s\n",
+			(int)sizeof(ctrl->model), ctrl->model);
+}
+static DEVICE_ATTR(model, S_IRUGO, nvme_rdma_model_show, NULL);
+
+static struct attribute *nvme_rdma_ctrl_attrs[] = {
+	&dev_attr_delete_controller.attr,
+	&dev_attr_subsysnqn.attr,
+	&dev_attr_address.attr,
+	&dev_attr_model.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(nvme_rdma_ctrl);
+
+enum {
+	NVMF_OPT_ERR,
+	NVMF_OPT_TRADDR,
+	NVMF_OPT_TRSVCID,
+	NVMF_OPT_NQN,
+	NVMF_OPT_HOSTNQN,
+	NVMF_OPT_NR_IO_QUEUES,
+	NVMF_OPT_QUEUE_SIZE,
+};
+
+static const match_table_t opt_tokens = {
+	{ NVMF_OPT_TRADDR,		"traddr=%s"		},
+	{ NVMF_OPT_TRSVCID,		"trsvcid=%d"		},
+	{ NVMF_OPT_NQN,			"nqn=%s"		},
+	{ NVMF_OPT_HOSTNQN,		"hostnqn=%s"		},
+	{ NVMF_OPT_NR_IO_QUEUES,	"nr_io_queues=%d"	},
+	{ NVMF_OPT_QUEUE_SIZE,		"queue_size=%d"		},
+	{ NVMF_OPT_ERR,			NULL			}
+};
+
+static int nvme_rdma_parse_addr(struct sockaddr_storage *addr, const char *s,
+		int port)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+
+	memset(addr, 0, sizeof(*addr));
+	if (in4_pton(s, -1, (u8 *)&sin->sin_addr.s_addr, '\0', NULL)) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		return 0;
+	}
+	if (in6_pton(s, -1, sin6->sin6_addr.s6_addr, '\0', NULL)) {
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		return 0;
+	}
+	return -EINVAL;
+}
+
+static int nvme_rdma_parse_options(struct nvme_rdma_ctrl *ctrl, char *buf)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *options = buf, *p, *traddr = NULL;
+	int port = NVME_RDMA_IP_PORT, token, val, ret = -EINVAL;
+
+	while ((p = strsep(&options, ",\n")) != NULL) {
+		if (!*p)
+			continue;
+
+		token = match_token(p, opt_tokens, args);
+		switch (token) {
+		case NVMF_OPT_TRADDR:
+			kfree(traddr);
+			traddr = match_strdup(args);
+			if (!traddr) {
+				ret = -ENOMEM;
+				goto out;
+			}
+			break;
+		case NVMF_OPT_TRSVCID:
+			if (match_int(args, &val) || val <= 0 || val > 65535)
+				goto out;
+			port = val;
+			break;
+		case NVMF_OPT_NQN:
+			if (args[0].to - args[0].from > NVMF_NQN_SIZE)
+				goto out;
+			match_strlcpy(ctrl->subsysnqn, args,
+				      sizeof(ctrl->subsysnqn));
+			break;
+		case NVMF_OPT_HOSTNQN:
+			if (args[0].to - args[0].from > NVMF_NQN_SIZE)
+				goto out;
+			match_strlcpy(ctrl->hostnqn, args,
+				      sizeof(ctrl->hostnqn));
+			break;
+		case NVMF_OPT_NR_IO_QUEUES:
+			if (match_int(args, &val) || val <= 0)
+				goto out;
+			ctrl->nr_io_queues = min_t(int, val,
+						   num_online_cpus());
+			break;
+		case NVMF_OPT_QUEUE_SIZE:
+			if (match_int(args, &val) || val < 16 || val > 1024)
+				goto out;
+			ctrl->queue_size = val;
+			break;
+		default:
+			pr_warn("nvme-rdma: unknown option \"%s\"\n", p);
+			goto out;
+		}
+	}
+
+	if (!traddr || !ctrl->subsysnqn[0]) {
+		pr_warn("nvme-rdma: traddr and nqn are required\n");
+		goto out;
+	}
+	ret = nvme_rdma_parse_addr(&ctrl->addr, traddr, port);
+	if (ret)
+		pr_warn("nvme-rdma: invalid traddr \"%s\"\n", traddr);
+ out:
+	kfree(traddr);
+	return ret;
+}
+
+static int nvme_rdma_set_instance(struct nvme_rdma_ctrl *ctrl)
+{
+	int instance, error;
+
+	do {
+		if (!ida_pre_get(&nvme_rdma_instance_ida, GFP_KERNEL))
+			return -ENODEV;
+
+		spin_lock(&instance_lock);
+		error = ida_get_new(&nvme_rdma_instance_ida, &instance);
+		spin_unlock(&instance_lock);
+	} while (error == -EAGAIN);
+
+	if (error)
+		return -ENODEV;
+
+	ctrl->instance = instance;
+	return 0;
+}
+
+static int nvme_rdma_setup_io(struct nvme_rdma_ctrl *ctrl)
+{
+	int ret;
+
+	ret = nvme_rdma_identify_ctrl(ctrl);
+	if (ret)
+		return ret;
+
+	ctrl->queue_size = min_t(int, ctrl->queue_size,
+				 NVME_CAP_MQES(ctrl->cap) + 1);
+
+	ret = nvme_rdma_set_queue_count(ctrl, ctrl->nr_io_queues);
+	if (ret < 0)
+		return ret;
+	ctrl->queue_count = min(ret, ctrl->nr_io_queues) + 1;
+
+	ret = nvme_rdma_connect_io_queues(ctrl);
+	if (ret)
+		return ret;
+
+	ret = nvme_rdma_alloc_tagset(ctrl);
+	if (ret) {
+		nvme_rdma_free_io_queues(ctrl);
+		return ret;
+	}
+	return 0;
+}
+
+static struct nvme_rdma_ctrl *nvme_rdma_create_ctrl(char *buf)
+{
+	struct nvme_rdma_ctrl *ctrl;
+	int ret;
+
+	ctrl = kzalloc(sizeof(*ctrl), GFP_KERNEL);
+	if (!ctrl)
+		return ERR_PTR(-ENOMEM);
+
+	INIT_LIST_HEAD(&ctrl->list);
+	INIT_LIST_HEAD(&ctrl->namespaces);
+	kref_init(&ctrl->kref);
+	spin_lock_init(&ctrl->lock);
+	INIT_WORK(&ctrl->reset_work, nvme_rdma_reset_work);
+	INIT_WORK(&ctrl->delete_work, nvme_rdma_delete_work);
+	ctrl->state = NVME_RDMA_CTRL_NEW;
+	ctrl->nr_io_queues = num_online_cpus();
+	ctrl->queue_size = NVME_RDMA_DEF_QSIZE;
+	strlcpy(ctrl->hostnqn, nvme_rdma_hostnqn, sizeof(ctrl->hostnqn));
+
+	ret = nvme_rdma_parse_options(ctrl, buf);
+	if (ret)
+		goto out_free_ctrl;
+
+	ctrl->queues = kcalloc(ctrl->nr_io_queues + 1, sizeof(*ctrl->queues),
+			       GFP_KERNEL);
+	if (!ctrl->queues) {
+		ret = -ENOMEM;
+		goto out_free_ctrl;
+	}
+	ctrl->queue_count = 1;
+
+	ret = nvme_rdma_set_instance(ctrl);
+	if (ret)
+		goto out_free_queues;
+
+	ctrl->device = device_create_with_groups(nvme_rdma_class, NULL,
+				MKDEV(0, 0) + ctrl->instance, ctrl,
+				nvme_rdma_ctrl_groups, "nvmf%d",
+				ctrl->instance);
+	if (IS_ERR(ctrl->device)) {
+		ret = PTR_ERR(ctrl->device);
+		goto out_release_instance;
+	}
+
+	ret = nvme_rdma_configure_admin_queue(ctrl);
+	if (ret)
+		goto out_destroy_device;
+
+	ret = nvme_rdma_setup_io(ctrl);
+	if (ret)
+		goto out_shutdown;
+
+	nvme_rdma_change_state(ctrl, NVME_RDMA_CTRL_NEW, NVME_RDMA_CTRL_LIVE);
+
+	mutex_lock(&ctrl_list_mutex);
+	list_add_tail(&ctrl->list, &ctrl_list);
+	mutex_unlock(&ctrl_list_mutex);
+
+	nvme_rdma_scan_namespaces(ctrl);
+
+	dev_info(ctrl->device, "connected to %s at %pISpc, %d I/O queues\n",
+		 ctrl->subsysnqn, &ctrl->addr, ctrl->queue_count - 1);
+	return ctrl;
+
+ out_shutdown:
+	nvme_rdma_shutdown_ctrl(ctrl);
+	nvme_rdma_free_queue(&ctrl->queues[0]);
+ out_destroy_device:
+	if (ctrl->mr)
+		ib_dereg_mr(ctrl->mr);
+	if (ctrl->pd)
+		ib_dealloc_pd(ctrl->pd);
+	device_destroy(nvme_rdma_class, MKDEV(0, 0) + ctrl->instance);
+ out_release_instance:
+	spin_lock(&instance_lock);
+	ida_remove(&nvme_rdma_instance_ida, ctrl->instance);
+	spin_unlock(&instance_lock);
+ out_free_queues:
+	kfree(ctrl->queues);
+ out_free_ctrl:
+	kfree(ctrl);
+	return ERR_PTR(ret);
+}
+
+static ssize_t nvme_rdma_dev_write(struct file *file, const char __user *ubuf,
+		size_t count, loff_t *pos)
+{
+	struct nvme_rdma_ctrl *ctrl;
+	char *buf;
+
+	if (count > PAGE_SIZE)
+		return -ENOMEM;
+
+	buf = kzalloc(count + 1, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	if (copy_from_user(buf, ubuf, count)) {
+		kfree(buf);
+		return -EFAULT;
+	}
+
+	ctrl = nvme_rdma_create_ctrl(buf);
+	kfree(buf);
+	if (IS_ERR(ctrl))
+		return PTR_ERR(ctrl);
+	return count;
+}
+
+static const struct file_operations nvme_rdma_dev_fops = {
+	.owner		= THIS_MODULE,
+	.write		= nvme_rdma_dev_write,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice nvme_rdma_misc = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "nvme-rdma",
+	.fops		= &nvme_rdma_dev_fops,
+};
+
+static int __init nvme_rdma_init(void)
+{
+	int result;
+
+	_nvme_rdma_check_size();
+
+	uuid_le_gen(&nvme_rdma_hostid);
+	snprintf(nvme_rdma_hostnqn, sizeof(nvme_rdma_hostnqn),
+		 "nqn.2014-08.org.nvmexpress:NVMf:uuid:%pUl",
+		 &nvme_rdma_hostid);
+
+	nvme_rdma_wq = alloc_workqueue("nvme-rdma", WQ_MEM_RECLAIM, 0);
+	if (!nvme_rdma_wq)
+		return -ENOMEM;
+
+	result = register_blkdev(nvme_rdma_major, "nvme-rdma");
+	if (result < 0)
+		goto kill_workq;
+	else if (result > 0)
+		nvme_rdma_major = result;
+
+	nvme_rdma_class = class_create(THIS_MODULE, "nvme-rdma");
+	if (IS_ERR(nvme_rdma_class)) {
+		result = PTR_ERR(nvme_rdma_class);
+		goto unregister_blkdev;
+	}
+
+	result = misc_register(&nvme_rdma_misc);
+	if (result)
+		goto destroy_class;
+	return 0;
+
+ destroy_class:
+	class_destroy(nvme_rdma_class);
+ unregister_blkdev:
+	unregister_blkdev(nvme_rdma_major, "nvme-rdma");
+ kill_workq:
+	destroy_workqueue(nvme_rdma_wq);
+	return result;
+}
+
+static void __exit nvme_rdma_exit(void)
+{
+	struct nvme_rdma_ctrl *ctrl;
+
+	misc_deregister(&nvme_rdma_misc);
+
+	mutex_lock(&ctrl_list_mutex);
+	list_for_each_entry(ctrl, &ctrl_list, list)
+		nvme_rdma_del_ctrl(ctrl);
+	mutex_unlock(&ctrl_list_mutex);
+
+	/* drains the deletes, and anything they queue */
+	destroy_workqueue(nvme_rdma_wq);
+	class_destroy(nvme_rdma_class);
+	unregister_blkdev(nvme_rdma_major, "nvme-rdma");
+}
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("NVMe over Fabrics RDMA host driver");
+module_init(nvme_rdma_init);
+module_exit(nvme_rdma_exit);
@@ -0,0 +1,84 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/zstd.h>
+
+#include "zcomp_zstd.h"
+
+/*
+ * Decompression has no stream to work in, it runs under the slot lock, so
+ * its tables live per cpu for as long as any zstd stream exists.
+ */
+static DEFINE_MUTEX(zcomp_zstd_lock);
+static void __percpu *zcomp_zstd_dwrkmem;
+static unsigned int zcomp_zstd_users;
+
+static void *zcomp_zstd_create(void)
+{
+	void *wrkmem;
+
+	mutex_lock(&zcomp_zstd_lock);
+	if (!zcomp_zstd_users) {
+		zcomp_zstd_dwrkmem = __alloc_percpu(ZSTD_MEM_DECOMPRESS,
+						    sizeof(long));
+		if (!zcomp_zstd_dwrkmem) {
+			mutex_unlock(&zcomp_zstd_lock);
+			return NULL;
+		}
+	}
+	/* ZSTD_MEM_COMPRESS is too large for a reliable kmalloc */
+	wrkmem = vzalloc(ZSTD_MEM_COMPRESS);
+	if (wrkmem)
+		zcomp_zstd_users++;
+	else if (!zcomp_zstd_users)
+		free_percpu(zcomp_zstd_dwrkmem);
+	mutex_unlock(&zcomp_zstd_lock);
+	return wrkmem;
+}
+
+static void zcomp_zstd_destroy(void *private)
+{
+	vfree(private);
+	mutex_lock(&zcomp_zstd_lock);
+	if (!--zcomp_zstd_users)
+		free_percpu(zcomp_zstd_dwrkmem);
+	mutex_unlock(&zcomp_zstd_lock);
+}
+
+static int zcomp_zstd_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	/* the stream buffer is two pages, more than any page needs */
+	*dst_len = zstd_compress_bound(PAGE_SIZE);
+	/* return  : Success if return 0 */
+	return zstd_compress(src, PAGE_SIZE, dst, dst_len, private);
+}
+
+static int zcomp_zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst)
+{
+	size_t dst_len = PAGE_SIZE;
+	void *wrkmem = get_cpu_ptr(zcomp_zstd_dwrkmem);
+	int ret;
+
+	/* return  : Success if return 0 */
+	ret = zstd_decompress(src, src_len, dst, &dst_len, wrkmem);
+	put_cpu_ptr(zcomp_zstd_dwrkmem);
+	return ret;
+}
+
+struct zcomp_backend zcomp_zstd = {
+	.compress = zcomp_zstd_compress,
+	.decompress = zcomp_zstd_decompress,
+	.create = zcomp_zstd_create,
+	.destroy = zcomp_zstd_destroy,
+	.name = "zstd",
+};
@@ -32,6 +32,8 @@
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 #include <linux/err.h>
+#include <linux/file.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -110,17 +112,14 @@ static ssize_t mem_used_total_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", val << PAGE_SHIFT);
 }
 
+/*
+ * Every CPU has its own compression stream, so the number of streams is
+ * no longer tunable; the attribute is kept for existing tools.
+ */
 static ssize_t max_comp_streams_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	int val;
-	struct zram *zram = dev_to_zram(dev);
-
-	down_read(&zram->init_lock);
-	val = zram->max_comp_streams;
-	up_read(&zram->init_lock);
-
-	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", num_online_cpus());
 }
 
 static ssize_t mem_limit_show(struct device *dev,
@@ -194,7 +193,6 @@ static ssize_t max_comp_streams_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	int num;
-	struct zram *zram = dev_to_zram(dev);
 	int ret;
 
 	ret = kstrtoint(buf, 0, &num);
@@ -203,20 +201,7 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	if (num < 1)
 		return -EINVAL;
 
-	down_write(&zram->init_lock);
-	if (init_done(zram)) {
-		if (!zcomp_set_max_streams(zram->comp, num)) {
-			pr_info("Cannot change max compression streams\n");
-			ret = -EINVAL;
-			goto out;
-		}
-	}
-
-	zram->max_comp_streams = num;
-	ret = len;
-out:
-	up_write(&zram->init_lock);
-	return ret;
+	return len;
 }
 
 static ssize_t comp_algorithm_show(struct device *dev,
@@ -247,6 +232,40 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!zcomp_available_algorithm(buf))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->recomp_algorithm, buf, sizeof(zram->recomp_algorithm));
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
 /* flag operations needs meta->tb_lock */
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
@@ -279,11 +298,292 @@ static void zram_set_obj_size(struct zram_meta *meta,
 	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+/* the compressor the page at @index was stored with */
+static struct zcomp *zram_page_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram_test_flag(zram->meta, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
 static inline int is_partial_io(struct bio_vec *bvec)
 {
 	return bvec->bv_len != PAGE_SIZE;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static inline bool zram_wb_enabled(struct zram *zram)
+{
+	return zram->backing_dev;
+}
+
+static void reset_bdev(struct zram *zram)
+{
+	struct block_device *bdev;
+
+	if (!zram_wb_enabled(zram))
+		return;
+
+	bdev = zram->bdev;
+	if (zram->old_block_size)
+		set_blocksize(bdev, zram->old_block_size);
+	blkdev_put(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL);
+	/* hope filp_close flush all of IO */
+	filp_close(zram->backing_dev, NULL);
+	zram->backing_dev = NULL;
+	zram->old_block_size = 0;
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file;
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	file = zram->backing_dev;
+	if (!file) {
+		memcpy(buf, "none\n", 5);
+		up_read(&zram->init_lock);
+		return 5;
+	}
+
+	p = d_path(&file->f_path, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *file_name;
+	size_t sz;
+	struct file *backing_dev = NULL;
+	struct inode *inode;
+	struct address_space *mapping;
+	unsigned int old_block_size = 0;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev = NULL;
+	int err;
+	struct zram *zram = dev_to_zram(dev);
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	backing_dev = filp_open(file_name, O_RDWR|O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	mapping = backing_dev->f_mapping;
+	inode = mapping->host;
+
+	/* Support only block device in this moment */
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0) {
+		bdev = NULL;
+		goto out;
+	}
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	old_block_size = block_size(bdev);
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out;
+
+	reset_bdev(zram);
+
+	zram->old_block_size = old_block_size;
+	zram->bdev = bdev;
+	zram->backing_dev = backing_dev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+out:
+	if (bitmap)
+		vfree(bitmap);
+
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+
+	up_write(&zram->init_lock);
+
+	kfree(file_name);
+
+	return err;
+}
+
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx = 1;
+retry:
+	/* skip 0 bit to confuse zram.handle = 0 */
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx == zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+
+static struct bio *zram_bdev_bio(struct zram *zram, unsigned long entry,
+				 struct page *page, unsigned int len,
+				 unsigned int offset)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_iter.bi_sector = entry * SECTORS_PER_PAGE;
+	bio_add_page(bio, page, len, offset);
+	return bio;
+}
+
+/*
+ * Read a full page from the backing device as part of @parent, which
+ * completes once the read does.
+ */
+static void read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
+				 unsigned long entry, struct bio *parent)
+{
+	struct bio *bio;
+
+	bio = zram_bdev_bio(zram, entry, bvec->bv_page, bvec->bv_len,
+			    bvec->bv_offset);
+	bio_chain(bio, parent);
+	atomic64_inc(&zram->stats.bd_reads);
+	submit_bio(READ, bio);
+}
+
+struct zram_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long entry;
+	struct page *page;
+	int ret;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+	struct bio *bio;
+
+	bio = zram_bdev_bio(zw->zram, zw->entry, zw->page, PAGE_SIZE, 0);
+	zw->ret = submit_bio_wait(READ, bio);
+	bio_put(bio);
+}
+
+/*
+ * Block layer want one ->make_request_fn to be active at a time
+ * so if we use chained IO with parent IO in same context,
+ * it's a deadlock. To avoid, it uses worker thread context.
+ */
+static int read_from_bdev_sync(struct zram *zram, struct page *page,
+			       unsigned long entry)
+{
+	struct zram_work work;
+
+	work.zram = zram;
+	work.entry = entry;
+	work.page = page;
+
+	INIT_WORK_ONSTACK(&work.work, zram_sync_read);
+	queue_work(system_unbound_wq, &work.work);
+	flush_work(&work.work);
+	destroy_work_on_stack(&work.work);
+
+	atomic64_inc(&zram->stats.bd_reads);
+	return work.ret;
+}
+
+static int write_to_bdev(struct zram *zram, struct page *page,
+			 unsigned long entry)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = zram_bdev_bio(zram, entry, page, PAGE_SIZE, 0);
+	ret = submit_bio_wait(WRITE, bio);
+	bio_put(bio);
+	if (!ret)
+		atomic64_inc(&zram->stats.bd_writes);
+	return ret;
+}
+#else
+static inline bool zram_wb_enabled(struct zram *zram) { return false; }
+static inline void reset_bdev(struct zram *zram) {};
+static inline void free_block_bdev(struct zram *zram, unsigned long blk_idx) {};
+static inline void read_from_bdev_async(struct zram *zram,
+		struct bio_vec *bvec, unsigned long entry, struct bio *parent) {};
+static inline int read_from_bdev_sync(struct zram *zram, struct page *page,
+		unsigned long entry) { return -EIO; };
+#endif
+
 /*
  * Check if request is within bounds and aligned on zram logical blocks.
  */
@@ -395,6 +695,22 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+	zram_clear_flag(meta, index, ZRAM_RECOMP);
+
+	if (zram_test_flag(meta, index, ZRAM_HUGE)) {
+		zram_clear_flag(meta, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		meta->table[index].handle = 0;
+		return;
+	}
+
 	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
@@ -426,6 +742,11 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	size_t size;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return -EAGAIN;
+	}
+
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
@@ -439,7 +760,8 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	if (size == PAGE_SIZE)
 		copy_page(mem, cmem);
 	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		ret = zcomp_decompress(zram_page_comp(zram, index), cmem,
+				       size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
@@ -452,6 +774,80 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
+/*
+ * Copy the page at @index into @mem, fetching it from the backing device
+ * if it has been written back.  May sleep.
+ */
+static int zram_read_page(struct zram *zram, char *mem, u32 index)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long entry;
+	struct page *page;
+	void *src;
+	int ret;
+
+	for (;;) {
+		ret = zram_decompress_page(zram, mem, index);
+		if (ret != -EAGAIN)
+			return ret;
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (zram_test_flag(meta, index, ZRAM_WB))
+			break;
+		/* the page was freed or rewritten in the meantime */
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	}
+	entry = meta->table[index].handle;
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = read_from_bdev_sync(zram, page, entry);
+	if (!ret) {
+		src = kmap_atomic(page);
+		copy_page(mem, src);
+		kunmap_atomic(src);
+	}
+	__free_page(page);
+	return ret;
+}
+
+/*
+ * Read the written back page at @entry into @bvec.  A full page is read
+ * directly into the bio's page; a partial one through a bounce page.
+ */
+static int zram_bvec_read_from_bdev(struct zram *zram, struct bio_vec *bvec,
+				    unsigned long entry, int offset,
+				    struct bio *bio)
+{
+	struct page *page;
+	void *src, *dst;
+	int ret;
+
+	if (!is_partial_io(bvec)) {
+		read_from_bdev_async(zram, bvec, entry, bio);
+		return 0;
+	}
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = read_from_bdev_sync(zram, page, entry);
+	if (!ret) {
+		src = kmap_atomic(page);
+		dst = kmap_atomic(bvec->bv_page);
+		memcpy(dst + bvec->bv_offset, src + offset, bvec->bv_len);
+		kunmap_atomic(dst);
+		kunmap_atomic(src);
+		flush_dcache_page(bvec->bv_page);
+	}
+	__free_page(page);
+	return ret;
+}
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
@@ -461,7 +857,16 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	struct zram_meta *meta = zram->meta;
 	page = bvec->bv_page;
 
+again:
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		unsigned long entry = meta->table[index].handle;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return zram_bvec_read_from_bdev(zram, bvec, entry, offset, bio);
+	}
+
 	if (unlikely(!meta->table[index].handle) ||
 			zram_test_flag(meta, index, ZRAM_ZERO)) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
@@ -485,6 +890,14 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	}
 
 	ret = zram_decompress_page(zram, uncmem, index);
+	if (unlikely(ret == -EAGAIN)) {
+		/* written back since we looked at it */
+		kunmap_atomic(user_mem);
+		if (is_partial_io(bvec))
+			kfree(uncmem);
+		uncmem = NULL;
+		goto again;
+	}
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
 		goto out_cleanup;
@@ -541,7 +954,7 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_decompress_page(zram, uncmem, index);
+		ret = zram_read_page(zram, uncmem, index);
 		if (ret)
 			goto out;
 	}
@@ -631,6 +1044,10 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 	meta->table[index].handle = handle;
 	zram_set_obj_size(meta, index, clen);
+	if (clen == PAGE_SIZE) {
+		zram_set_flag(meta, index, ZRAM_HUGE);
+		atomic64_inc(&zram->stats.huge_pages);
+	}
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
 	/* Update stats */
@@ -725,14 +1142,19 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = meta->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(meta, index, ZRAM_WB))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
 	}
+	reset_bdev(zram);
 
 	zcomp_destroy(zram->comp);
-	zram->max_comp_streams = 1;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram->recomp)
+		zcomp_destroy(zram->recomp);
+	zram->recomp = NULL;
+#endif
 
 	zram_meta_free(zram->meta);
 	zram->meta = NULL;
@@ -759,6 +1181,7 @@ static ssize_t disksize_store(struct device *dev,
 {
 	u64 disksize;
 	struct zcomp *comp;
+	struct zcomp *recomp = NULL;
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
@@ -772,7 +1195,7 @@ static ssize_t disksize_store(struct device *dev,
 	if (!meta)
 		return -ENOMEM;
 
-	comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	comp = zcomp_create(zram->compressor);
 	if (IS_ERR(comp)) {
 		pr_info("Cannot initialise %s compressing backend\n",
 				zram->compressor);
@@ -780,6 +1203,19 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram->recomp_algorithm[0]) {
+		recomp = zcomp_create(zram->recomp_algorithm);
+		if (IS_ERR(recomp)) {
+			pr_info("Cannot initialise %s recompressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			zcomp_destroy(comp);
+			goto out_free_meta;
+		}
+	}
+#endif
+
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
@@ -789,6 +1225,9 @@ static ssize_t disksize_store(struct device *dev,
 
 	zram->meta = meta;
 	zram->comp = comp;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	zram->recomp = recomp;
+#endif
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	up_write(&zram->init_lock);
@@ -804,6 +1243,8 @@ static ssize_t disksize_store(struct device *dev,
 
 out_destroy_comp:
 	up_write(&zram->init_lock);
+	if (recomp)
+		zcomp_destroy(recomp);
 	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(meta);
@@ -851,6 +1292,292 @@ out:
 	return ret;
 }
 
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (meta->table[index].handle &&
+		    !zram_test_flag(meta, index, ZRAM_WB))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * Recompress the idle page at @index with the secondary algorithm and keep
+ * the result if it is smaller.  @page is a scratch page.
+ */
+static int zram_recompress_page(struct zram *zram, struct page *page,
+				u32 index)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	unsigned long handle, new_handle;
+	size_t size, clen;
+	unsigned char *mem, *cmem;
+	int ret;
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	handle = meta->table[index].handle;
+	size = zram_get_obj_size(meta, index);
+	if (!handle || !zram_test_flag(meta, index, ZRAM_IDLE) ||
+	    zram_test_flag(meta, index, ZRAM_WB) ||
+	    zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+	    zram_test_flag(meta, index, ZRAM_RECOMP)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return 0;
+	}
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	mem = kmap(page);
+	ret = zram_decompress_page(zram, mem, index);
+	if (ret) {
+		kunmap(page);
+		/* -EAGAIN: written back in the meantime */
+		return ret == -EAGAIN ? 0 : ret;
+	}
+
+	zstrm = zcomp_strm_find(zram->recomp);
+	ret = zcomp_compress(zram->recomp, zstrm, mem, &clen);
+	kunmap(page);
+	if (ret || clen >= size || clen > max_zpage_size) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		return 0;
+	}
+
+	new_handle = zs_malloc(meta->mem_pool, clen);
+	if (!new_handle) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		return -ENOMEM;
+	}
+
+	cmem = zs_map_object(meta->mem_pool, new_handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(meta->mem_pool, new_handle);
+	zcomp_strm_release(zram->recomp, zstrm);
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	/* the page was accessed, freed or rewritten in the meantime */
+	if (meta->table[index].handle != handle ||
+	    !zram_test_flag(meta, index, ZRAM_IDLE) ||
+	    zram_test_flag(meta, index, ZRAM_UNDER_WB)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zs_free(meta->mem_pool, new_handle);
+		return 0;
+	}
+
+	zram_free_page(zram, index);
+	meta->table[index].handle = new_handle;
+	zram_set_obj_size(meta, index, clen);
+	zram_set_flag(meta, index, ZRAM_RECOMP);
+	/* still idle, so it remains a writeback candidate */
+	zram_set_flag(meta, index, ZRAM_IDLE);
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	atomic64_add(clen, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.num_recompressed);
+	return 0;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+	struct page *page;
+	ssize_t ret = len;
+
+	if (!sysfs_streq(buf, "idle"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		int err = zram_recompress_page(zram, page, index);
+
+		if (err) {
+			ret = err;
+			break;
+		}
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+#define IDLE_WRITEBACK	1
+#define HUGE_WRITEBACK	2
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+	struct page *page;
+	ssize_t ret = len;
+	int mode;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		unsigned long blk_idx;
+		void *mem;
+		int err;
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!meta->table[index].handle)
+			goto next;
+
+		if (zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_UNDER_WB))
+			goto next;
+
+		if (mode == IDLE_WRITEBACK &&
+		    !zram_test_flag(meta, index, ZRAM_IDLE))
+			goto next;
+		if (mode == HUGE_WRITEBACK &&
+		    !zram_test_flag(meta, index, ZRAM_HUGE))
+			goto next;
+		zram_set_flag(meta, index, ZRAM_UNDER_WB);
+		/* Need for hugepage writeback racing */
+		zram_set_flag(meta, index, ZRAM_IDLE);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		blk_idx = alloc_block_bdev(zram);
+		if (!blk_idx) {
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_clear_flag(meta, index, ZRAM_IDLE);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			ret = -ENOSPC;
+			break;
+		}
+
+		mem = kmap(page);
+		err = zram_decompress_page(zram, mem, index);
+		kunmap(page);
+		if (!err)
+			err = write_to_bdev(zram, page, blk_idx);
+		if (err) {
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_clear_flag(meta, index, ZRAM_IDLE);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			free_block_bdev(zram, blk_idx);
+			ret = err;
+			continue;
+		}
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		/*
+		 * The page was freed (which clears ZRAM_UNDER_WB) or accessed
+		 * (which clears ZRAM_IDLE) while it was being written back,
+		 * so the copy on the backing device is stale.
+		 */
+		if (!zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+		    !zram_test_flag(meta, index, ZRAM_IDLE)) {
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_clear_flag(meta, index, ZRAM_IDLE);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			free_block_bdev(zram, blk_idx);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_set_flag(meta, index, ZRAM_WB);
+		meta->table[index].handle = blk_idx;
+next:
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE, "%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count),
+			(u64)atomic64_read(&zram->stats.bd_reads),
+			(u64)atomic64_read(&zram->stats.bd_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -964,6 +1691,18 @@ static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
 		max_comp_streams_show, max_comp_streams_store);
 static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
 		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR(recomp_algorithm, S_IRUGO | S_IWUSR,
+		recomp_algorithm_show, recomp_algorithm_store);
+static DEVICE_ATTR(recompress, S_IWUSR, NULL, recompress_store);
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_stat, S_IRUGO, bd_stat_show, NULL);
+#endif
 
 ZRAM_ATTR_RO(num_reads);
 ZRAM_ATTR_RO(num_writes);
@@ -973,6 +1712,10 @@ ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
 ZRAM_ATTR_RO(zero_pages);
 ZRAM_ATTR_RO(compr_data_size);
+ZRAM_ATTR_RO(huge_pages);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+ZRAM_ATTR_RO(num_recompressed);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -992,6 +1735,18 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_huge_pages.attr,
+	&dev_attr_idle.attr,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+	&dev_attr_num_recompressed.attr,
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1070,7 +1825,6 @@ static int create_device(struct zram *zram, int device_id)
 	}
 	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	zram->meta = NULL;
-	zram->max_comp_streams = 1;
 	return 0;
 
 out_free_disk:
@@ -68,6 +68,11 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO = ZRAM_FLAG_SHIFT + 1,
 	ZRAM_ACCESS,	/* page in now accessed */
+	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_UNDER_WB,	/* page is under writeback */
+	ZRAM_HUGE,	/* Incompressible page */
+	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -76,6 +81,7 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct zram_table_entry {
+	/* zsmalloc handle, or the backing device block for ZRAM_WB pages */
 	unsigned long handle;
 	unsigned long value;
 };
@@ -91,6 +97,15 @@ struct zram_stats {
 	atomic64_t zero_pages;		/* no. of zero filled pages */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
+	atomic64_t huge_pages;		/* no. of huge pages */
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	atomic64_t num_recompressed;	/* no. of recompressed pages */
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes from backing device */
+#endif
 };
 
 struct zram_meta {
@@ -111,7 +126,6 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	int max_comp_streams;
 	struct zram_stats stats;
 	/*
 	 * the number of pages zram can consume for storing compressed data
@@ -119,5 +133,18 @@ struct zram {
 	unsigned long limit_pages;
 
 	char compressor[10];
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* secondary algorithm for recompressing idle pages, if any */
+	char recomp_algorithm[10];
+	struct zcomp *recomp;
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned int old_block_size;
+	/* allocation bitmap of the backing device, in PAGE_SIZE blocks */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+#endif
 };
 #endif
@@ -23,6 +23,7 @@
 #include <linux/cpu.h>
 #include <linux/cpufreq.h>
 #include <linux/cpumask.h>
+#include <linux/energy_model.h>
 #include <linux/export.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -423,6 +424,73 @@ put_clusters:
 }
 
 /* Per-CPU initialization */
+/*
+ * Estimate the active power of a cpu at the lowest OPP at or above *freq,
+ * from the DT "dynamic-power-coefficient" C of its node:
+ *
+ *	P(mW) = C * V(mV)^2 * f(MHz) / 10^9
+ */
+static int __maybe_unused bL_get_cpu_power(unsigned long *power,
+					   unsigned long *freq, int cpu)
+{
+	struct device *cpu_dev = get_cpu_device(cpu);
+	unsigned long mV, Hz, MHz;
+	struct dev_pm_opp *opp;
+	u32 cap;
+	u64 tmp;
+
+	if (!cpu_dev || !cpu_dev->of_node)
+		return -ENODEV;
+
+	if (of_property_read_u32(cpu_dev->of_node, "dynamic-power-coefficient",
+				 &cap) || !cap)
+		return -EINVAL;
+
+	Hz = *freq * 1000;
+	rcu_read_lock();
+	opp = dev_pm_opp_find_freq_ceil(cpu_dev, &Hz);
+	if (IS_ERR(opp)) {
+		rcu_read_unlock();
+		return -EINVAL;
+	}
+	mV = dev_pm_opp_get_voltage(opp) / 1000;
+	rcu_read_unlock();
+
+	MHz = Hz / 1000000;
+	if (!mV || !MHz)
+		return -EINVAL;
+
+	tmp = (u64)cap * mV * mV * MHz;
+	do_div(tmp, 1000000000);
+
+	*power = (unsigned long)tmp;
+	*freq = Hz / 1000;
+
+	return 0;
+}
+
+static void bL_register_em(struct cpufreq_policy *policy,
+			   struct device *cpu_dev)
+{
+#ifdef CONFIG_ENERGY_MODEL
+	struct em_data_callback em_cb = EM_DATA_CB(bL_get_cpu_power);
+	int nr_opp;
+
+	/* The switcher hides the clusters behind virtual cpus */
+	if (is_bL_switching_enabled())
+		return;
+
+	rcu_read_lock();
+	nr_opp = dev_pm_opp_get_opp_count(cpu_dev);
+	rcu_read_unlock();
+	if (nr_opp <= 0)
+		return;
+
+	/* Platforms without a power coefficient simply don't get an EM */
+	em_register_perf_domain(policy->cpus, nr_opp, &em_cb);
+#endif
+}
+
 static int bL_cpufreq_init(struct cpufreq_policy *policy)
 {
 	u32 cur_cluster = cpu_to_cluster(policy->cpu);
@@ -469,6 +537,8 @@ static int bL_cpufreq_init(struct cpufreq_policy *policy)
 	if (is_bL_switching_enabled())
 		per_cpu(cpu_last_req_freq, policy->cpu) = clk_get_cpu_rate(policy->cpu);
 
+	bL_register_em(policy, cpu_dev);
+
 	dev_info(cpu_dev, "%s: CPU %d initialized\n", __func__, policy->cpu);
 	return 0;
 }
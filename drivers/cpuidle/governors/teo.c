@@ -0,0 +1,413 @@
+/*
+ * teo.c - the timer events oriented (TEO) idle governor
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ *
+ * The idea of this governor is that the next timer event on the CPU is the
+ * most important piece of information for idle state selection, so the
+ * sleep length (the time until that event) is used as the starting point.
+ * Other wakeup sources are accounted for through the recent history of the
+ * idle durations actually observed:
+ *
+ * For every idle state three metrics are maintained:
+ *
+ * "hits"	- the sleep length and the measured idle duration both fell
+ *		  into the range matching the state,
+ * "misses"	- the sleep length matched the state, but the CPU was woken
+ *		  up earlier by something else than the timer,
+ * "early_hits"	- the CPU was woken up early and the measured idle duration
+ *		  matched the state.
+ *
+ * All of them decay exponentially, so only the recent past matters. If the
+ * "early_hits" of a shallower state outweigh the "hits" and "misses" of the
+ * state matching the sleep length, the shallower state is picked. A small
+ * ring of recent idle durations additionally catches repetitive wakeup
+ * patterns.
+ *
+ * When the selected state is shallow enough for the tick to matter, the
+ * governor asks for the tick not to be stopped, so short idle periods do
+ * not pay for stopping and restarting it.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+
+/*
+ * The PULSE value is added to metrics when they grow and the DECAY_SHIFT
+ * value is used for decreasing metrics on a regular basis.
+ */
+#define PULSE		1024
+#define DECAY_SHIFT	3
+
+/*
+ * Number of the most recent idle duration values to take into
+ * consideration for the detection of wakeup patterns.
+ */
+#define INTERVALS	8
+
+/* Length of one tick in microseconds */
+#define TICK_USEC_HZ	(USEC_PER_SEC / HZ)
+
+/**
+ * struct teo_idle_state - idle state data used by the TEO cpuidle governor
+ * @early_hits: "Early" CPU wakeups "matching" this state.
+ * @hits: "On time" CPU wakeups "matching" this state.
+ * @misses: CPU wakeups "missing" this state.
+ */
+struct teo_idle_state {
+	unsigned int early_hits;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+/**
+ * struct teo_cpu - CPU data used by the TEO cpuidle governor
+ * @time_span_ns: Time between idle state selection and post-wakeup update.
+ * @sleep_length_us: Time till the closest timer event (at the selection time).
+ * @states: Idle states data corresponding to this CPU.
+ * @last_state: Idle state entered by the CPU last time.
+ * @interval_idx: Index of the most recent saved idle interval.
+ * @intervals: Saved idle duration values.
+ * @needs_update: The metrics have to be updated at the next selection.
+ * @tick_wakeup: The CPU was woken up by the tick it was told to retain.
+ */
+struct teo_cpu {
+	u64 time_span_ns;
+	unsigned int sleep_length_us;
+	struct teo_idle_state states[CPUIDLE_STATE_MAX];
+	int last_state;
+	int interval_idx;
+	unsigned int intervals[INTERVALS];
+	int needs_update;
+	int tick_wakeup;
+};
+
+static DEFINE_PER_CPU(struct teo_cpu, teo_cpus);
+
+/**
+ * teo_update - update CPU data after wakeup
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void teo_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	unsigned int sleep_length_us = cpu_data->sleep_length_us;
+	int i, idx_hit = -1, idx_timer = -1;
+	unsigned int measured_us;
+
+	if (cpu_data->tick_wakeup) {
+		/*
+		 * The tick was retained and woke the CPU up. Nothing can be
+		 * said about whether or not the CPU would have slept until the
+		 * next timer event, so assume it would have.
+		 */
+		measured_us = sleep_length_us;
+	} else if (cpu_data->last_state < 0 ||
+		   cpu_data->time_span_ns >=
+		   (u64)sleep_length_us * NSEC_PER_USEC) {
+		/*
+		 * The wakeup is most likely due to the timer event the sleep
+		 * length was computed for, so this is a hit.
+		 */
+		measured_us = sleep_length_us;
+	} else {
+		struct cpuidle_state *target;
+
+		target = &drv->states[cpu_data->last_state];
+		measured_us = cpuidle_get_last_residency(dev);
+		if (unlikely(!(target->flags & CPUIDLE_FLAG_TIME_VALID)))
+			measured_us = sleep_length_us;
+		else if (measured_us > target->exit_latency)
+			measured_us -= target->exit_latency;
+	}
+
+	/*
+	 * Decay the "early hits" metric for all of the states and find the
+	 * states matching the sleep length and the measured idle duration.
+	 */
+	for (i = 0; i < drv->state_count; i++) {
+		unsigned int early_hits = cpu_data->states[i].early_hits;
+
+		cpu_data->states[i].early_hits -= early_hits >> DECAY_SHIFT;
+
+		if (drv->states[i].target_residency <= sleep_length_us) {
+			idx_timer = i;
+			if (drv->states[i].target_residency <= measured_us)
+				idx_hit = i;
+		}
+	}
+
+	/*
+	 * Update the "hits" and "misses" data for the state matching the sleep
+	 * length. If it matches the measured idle duration too, this is a hit,
+	 * otherwise it is a miss and the state that matches the measured idle
+	 * duration gets an early hit.
+	 */
+	if (idx_timer >= 0) {
+		struct teo_idle_state *s = &cpu_data->states[idx_timer];
+		unsigned int hits = s->hits;
+		unsigned int misses = s->misses;
+
+		hits -= hits >> DECAY_SHIFT;
+		misses -= misses >> DECAY_SHIFT;
+
+		if (idx_timer > idx_hit) {
+			misses += PULSE;
+			if (idx_hit >= 0)
+				cpu_data->states[idx_hit].early_hits += PULSE;
+		} else {
+			hits += PULSE;
+		}
+
+		s->misses = misses;
+		s->hits = hits;
+	}
+
+	/*
+	 * Save idle duration values corresponding to non-timer wakeups for
+	 * pattern detection.
+	 */
+	if (measured_us < sleep_length_us)
+		cpu_data->intervals[cpu_data->interval_idx] = measured_us;
+	else
+		cpu_data->intervals[cpu_data->interval_idx] = UINT_MAX;
+
+	if (++cpu_data->interval_idx >= INTERVALS)
+		cpu_data->interval_idx = 0;
+}
+
+/**
+ * teo_find_shallower_state - find shallower idle state matching given duration
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ * @state_idx: index of the capping idle state
+ * @duration_us: idle duration value to match
+ */
+static int teo_find_shallower_state(struct cpuidle_driver *drv,
+				    struct cpuidle_device *dev, int state_idx,
+				    unsigned int duration_us)
+{
+	int i;
+
+	for (i = state_idx - 1; i >= 0; i--) {
+		if (drv->states[i].disabled || dev->states_usage[i].disable)
+			continue;
+
+		state_idx = i;
+		if (drv->states[i].target_residency <= duration_us)
+			break;
+	}
+	return state_idx;
+}
+
+/**
+ * teo_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ * @stop_tick: indication on whether or not to stop the tick
+ */
+static int teo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
+		      bool *stop_tick)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int duration_us, count, max_early_idx_us = 0;
+	unsigned int hits, misses, early_hits;
+	int max_early_idx, idx, i;
+
+	if (cpu_data->needs_update) {
+		teo_update(drv, dev);
+		cpu_data->needs_update = 0;
+	}
+
+	/* Reset the tick indication, it is checked again in teo_reflect() */
+	tick_nohz_idle_got_tick();
+
+	cpu_data->time_span_ns = local_clock();
+	cpu_data->last_state = -1;
+
+	duration_us = ktime_to_us(tick_nohz_get_sleep_length());
+	cpu_data->sleep_length_us = duration_us;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0)) {
+		*stop_tick = false;
+		return 0;
+	}
+
+	count = 0;
+	hits = 0;
+	misses = 0;
+	early_hits = 0;
+	max_early_idx = -1;
+	idx = -1;
+
+	for (i = 0; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct teo_idle_state *t = &cpu_data->states[i];
+
+		if (s->disabled || dev->states_usage[i].disable) {
+			/*
+			 * If the "early hits" metric of a disabled state is
+			 * greater than the current maximum, it should be taken
+			 * into account, because it would be a mistake to select
+			 * a deeper state with lower "early hits" metric. The
+			 * index cannot be changed to point to it, however, so
+			 * just increase the max count alone and let the index
+			 * still point to a shallower idle state.
+			 */
+			if (max_early_idx >= 0 && count < t->early_hits)
+				count = t->early_hits;
+
+			continue;
+		}
+
+		if (idx < 0)
+			idx = i; /* first enabled state */
+
+		if (s->target_residency > duration_us)
+			break;
+
+		if (s->exit_latency > latency_req) {
+			/*
+			 * If we break out of the loop for latency reasons, use
+			 * the target residency of the selected state as the
+			 * expected idle duration to avoid stopping the tick
+			 * as long as that target residency is low enough.
+			 */
+			duration_us = drv->states[idx].target_residency;
+			goto refine;
+		}
+
+		idx = i;
+		hits = t->hits;
+		misses = t->misses;
+		early_hits = t->early_hits;
+
+		if (count < early_hits) {
+			count = early_hits;
+			max_early_idx = i;
+			max_early_idx_us = s->target_residency;
+		}
+	}
+
+	/*
+	 * If the "hits" metric of the idle state matching the sleep length is
+	 * greater than its "misses" metric, that is the one to use. Otherwise,
+	 * it is more likely that one of the shallower states will match the
+	 * idle duration observed after wakeup, so take the one with the maximum
+	 * "early hits" metric, but if that cannot be determined, just use the
+	 * state selected so far.
+	 */
+	if (hits <= misses && max_early_idx >= 0) {
+		idx = max_early_idx;
+		duration_us = max_early_idx_us;
+	}
+
+refine:
+	if (idx < 0) {
+		idx = 0; /* No states enabled. Must use 0. */
+	} else if (idx > 0) {
+		unsigned int sum = 0, nr = 0, avg_us;
+
+		/*
+		 * Look for a repetitive pattern in the recent idle durations:
+		 * if most of them are below the duration picked so far, their
+		 * average is a better estimate.
+		 */
+		for (i = 0; i < INTERVALS; i++) {
+			unsigned int val = cpu_data->intervals[i];
+
+			if (val >= duration_us)
+				continue;
+
+			sum += val;
+			nr++;
+		}
+
+		if (nr > INTERVALS / 2) {
+			avg_us = sum / nr;
+			idx = teo_find_shallower_state(drv, dev, idx, avg_us);
+			duration_us = avg_us;
+		}
+	}
+
+	/*
+	 * Don't stop the tick if the selected state is expected to be left
+	 * before the next tick anyway.
+	 */
+	if (duration_us < TICK_USEC_HZ)
+		*stop_tick = false;
+
+	return idx;
+}
+
+/**
+ * teo_reflect - note that governor data for the CPU need to be updated
+ * @dev: the CPU
+ * @state: the index of the idle state actually entered
+ */
+static void teo_reflect(struct cpuidle_device *dev, int state)
+{
+	struct teo_cpu *cpu_data = this_cpu_ptr(&teo_cpus);
+
+	cpu_data->last_state = state;
+	if (state < 0)
+		return;
+
+	cpu_data->time_span_ns = local_clock() - cpu_data->time_span_ns;
+
+	/*
+	 * A wakeup by the retained tick only counts if the tick came before
+	 * the timer event the selection was based on.
+	 */
+	cpu_data->tick_wakeup = tick_nohz_idle_got_tick() &&
+		cpu_data->time_span_ns <
+		(u64)cpu_data->sleep_length_us * NSEC_PER_USEC;
+	cpu_data->needs_update = 1;
+}
+
+/**
+ * teo_enable_device - initialize the governor's data for the target CPU
+ * @drv: cpuidle driver (not used)
+ * @dev: the CPU
+ */
+static int teo_enable_device(struct cpuidle_driver *drv,
+			     struct cpuidle_device *dev)
+{
+	struct teo_cpu *cpu_data = &per_cpu(teo_cpus, dev->cpu);
+	int i;
+
+	memset(cpu_data, 0, sizeof(*cpu_data));
+
+	for (i = 0; i < INTERVALS; i++)
+		cpu_data->intervals[i] = UINT_MAX;
+
+	return 0;
+}
+
+static struct cpuidle_governor teo_governor = {
+	.name =		"teo",
+	.rating =	19,
+	.enable =	teo_enable_device,
+	.select =	teo_select,
+	.reflect =	teo_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * teo_governor_init - initializes the governor
+ */
+static int __init teo_governor_init(void)
+{
+	return cpuidle_register_governor(&teo_governor);
+}
+
+postcore_initcall(teo_governor_init);
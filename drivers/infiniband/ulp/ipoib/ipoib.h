@@ -215,10 +215,29 @@ enum ipoib_cm_state {
 	IPOIB_CM_RX_FLUSH  /* Last WQE Reached event observed */
 };
 
+/*
+ * Connected mode receive QPs are spread over several completion queues,
+ * each polled by its own NAPI context, so that receive processing scales
+ * with the number of connections.  Ring 0 completes on priv->recv_cq and
+ * is polled by priv->napi together with datagram mode receives.
+ */
+struct ipoib_cm_rx_ring {
+	struct net_device      *dev;
+	struct ib_cq	       *cq;	/* NULL for ring 0 */
+	struct napi_struct	napi;
+	struct ib_wc		ibwc[IPOIB_NUM_WC];
+	struct ib_sge		rx_sge[IPOIB_CM_RX_SG];
+	struct ib_recv_wr       rx_wr;
+	unsigned long		rx_packets;
+	unsigned long		rx_bytes;
+	unsigned long		rx_dropped;
+};
+
 struct ipoib_cm_rx {
 	struct ib_cm_id	       *id;
 	struct ib_qp	       *qp;
 	struct ipoib_cm_rx_buf *rx_ring;
+	struct ipoib_cm_rx_ring *ring;
 	struct list_head	list;
 	struct net_device      *dev;
 	unsigned long		jiffies;
@@ -265,6 +284,9 @@ struct ipoib_cm_dev_priv {
 	struct ib_wc		ibwc[IPOIB_NUM_WC];
 	struct ib_sge		rx_sge[IPOIB_CM_RX_SG];
 	struct ib_recv_wr       rx_wr;
+	struct ipoib_cm_rx_ring *rx_rings;
+	int			num_rx_rings;
+	atomic_t		next_rx_ring;
 	int			nonsrq_conn_qp;
 	int			max_cm_mtu;
 	int			num_frags;
@@ -601,6 +623,12 @@ void ipoib_cm_dev_stop(struct net_device *dev);
 int ipoib_cm_dev_init(struct net_device *dev);
 int ipoib_cm_add_mode_attr(struct net_device *dev);
 void ipoib_cm_dev_cleanup(struct net_device *dev);
+void ipoib_cm_init_rx_rings(struct net_device *dev, int cq_size);
+void ipoib_cm_napi_enable(struct net_device *dev);
+void ipoib_cm_napi_disable(struct net_device *dev);
+void ipoib_cm_drain_rx_rings(struct net_device *dev);
+void ipoib_cm_get_stats64(struct net_device *dev,
+			  struct rtnl_link_stats64 *stats);
 struct ipoib_cm_tx *ipoib_cm_create_tx(struct net_device *dev, struct ipoib_path *path,
 				    struct ipoib_neigh *neigh);
 void ipoib_cm_destroy_tx(struct ipoib_cm_tx *tx);
@@ -679,6 +707,28 @@ void ipoib_cm_dev_cleanup(struct net_device *dev)
 	return;
 }
 
+static inline
+void ipoib_cm_init_rx_rings(struct net_device *dev, int cq_size)
+{
+}
+
+static inline void ipoib_cm_napi_enable(struct net_device *dev)
+{
+}
+
+static inline void ipoib_cm_napi_disable(struct net_device *dev)
+{
+}
+
+static inline void ipoib_cm_drain_rx_rings(struct net_device *dev)
+{
+}
+
+static inline void ipoib_cm_get_stats64(struct net_device *dev,
+					struct rtnl_link_stats64 *stats)
+{
+}
+
 static inline
 struct ipoib_cm_tx *ipoib_cm_create_tx(struct net_device *dev, struct ipoib_path *path,
 				    struct ipoib_neigh *neigh)
@@ -48,6 +48,15 @@ MODULE_PARM_DESC(max_nonsrq_conn_qp,
 		 "Max number of connected-mode QPs per interface "
 		 "(applied only if shared receive queue is not available)");
 
+static int ipoib_cm_rx_rings;
+
+module_param_named(cm_rx_rings, ipoib_cm_rx_rings, int, 0444);
+MODULE_PARM_DESC(cm_rx_rings,
+		 "Number of connected-mode receive rings per interface "
+		 "(default: one per completion vector and online cpu)");
+
+#define IPOIB_CM_MAX_RX_RINGS 16
+
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG_DATA
 static int data_debug_level;
 
@@ -88,18 +97,20 @@ static void ipoib_cm_dma_unmap_rx(struct ipoib_dev_priv *priv, int frags,
 		ib_dma_unmap_page(priv->ca, mapping[i + 1], PAGE_SIZE, DMA_FROM_DEVICE);
 }
 
-static int ipoib_cm_post_receive_srq(struct net_device *dev, int id)
+static int ipoib_cm_post_receive_srq(struct net_device *dev,
+				     struct ib_recv_wr *wr,
+				     struct ib_sge *sge, int id)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	struct ib_recv_wr *bad_wr;
 	int i, ret;
 
-	priv->cm.rx_wr.wr_id = id | IPOIB_OP_CM | IPOIB_OP_RECV;
+	wr->wr_id = id | IPOIB_OP_CM | IPOIB_OP_RECV;
 
 	for (i = 0; i < priv->cm.num_frags; ++i)
-		priv->cm.rx_sge[i].addr = priv->cm.srq_ring[id].mapping[i];
+		sge[i].addr = priv->cm.srq_ring[id].mapping[i];
 
-	ret = ib_post_srq_recv(priv->cm.srq, &priv->cm.rx_wr, &bad_wr);
+	ret = ib_post_srq_recv(priv->cm.srq, wr, &bad_wr);
 	if (unlikely(ret)) {
 		ipoib_warn(priv, "post srq failed for buf %d (%d)\n", id, ret);
 		ipoib_cm_dma_unmap_rx(priv, priv->cm.num_frags - 1,
@@ -207,9 +218,17 @@ static void ipoib_cm_free_rx_ring(struct net_device *dev,
 	vfree(rx_ring);
 }
 
-static void ipoib_cm_start_rx_drain(struct ipoib_dev_priv *priv)
+static void ipoib_cm_post_rx_drain(struct ipoib_dev_priv *priv,
+				   struct ipoib_cm_rx *p)
 {
 	struct ib_send_wr *bad_wr;
+
+	if (ib_post_send(p->qp, &ipoib_cm_rx_drain_wr, &bad_wr))
+		ipoib_warn(priv, "failed to post drain wr\n");
+}
+
+static void ipoib_cm_start_rx_drain(struct ipoib_dev_priv *priv)
+{
 	struct ipoib_cm_rx *p;
 
 	/* We only reserved 1 extra slot in CQ for drain WRs, so
@@ -223,12 +242,34 @@ static void ipoib_cm_start_rx_drain(struct ipoib_dev_priv *priv)
 	 * error" WC will be immediately generated for each WR we post.
 	 */
 	p = list_entry(priv->cm.rx_flush_list.next, typeof(*p), list);
-	if (ib_post_send(p->qp, &ipoib_cm_rx_drain_wr, &bad_wr))
-		ipoib_warn(priv, "failed to post drain wr\n");
+	ipoib_cm_post_rx_drain(priv, p);
 
 	list_splice_init(&priv->cm.rx_flush_list, &priv->cm.rx_drain_list);
 }
 
+/*
+ * A drain WR completing only proves that the CQ of its own ring has been
+ * flushed, so QPs on the drain list that complete on other rings stay
+ * there until a drain WR posted to one of them comes back too.
+ */
+static void ipoib_cm_rx_drain_done(struct ipoib_dev_priv *priv,
+				   struct ipoib_cm_rx_ring *ring)
+{
+	struct ipoib_cm_rx *p, *n;
+
+	list_for_each_entry_safe(p, n, &priv->cm.rx_drain_list, list)
+		if (p->ring == ring)
+			list_move(&p->list, &priv->cm.rx_reap_list);
+
+	if (list_empty(&priv->cm.rx_drain_list)) {
+		ipoib_cm_start_rx_drain(priv);
+		return;
+	}
+
+	p = list_entry(priv->cm.rx_drain_list.next, typeof(*p), list);
+	ipoib_cm_post_rx_drain(priv, p);
+}
+
 static void ipoib_cm_rx_event_handler(struct ib_event *event, void *ctx)
 {
 	struct ipoib_cm_rx *p = ctx;
@@ -249,10 +290,10 @@ static struct ib_qp *ipoib_cm_create_rx_qp(struct net_device *dev,
 					   struct ipoib_cm_rx *p)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	unsigned int n;
 	struct ib_qp_init_attr attr = {
 		.event_handler = ipoib_cm_rx_event_handler,
-		.send_cq = priv->recv_cq, /* For drain WR */
-		.recv_cq = priv->recv_cq,
 		.srq = priv->cm.srq,
 		.cap.max_send_wr = 1, /* For drain WR */
 		.cap.max_send_sge = 1, /* FIXME: 0 Seems not to work */
@@ -261,6 +302,13 @@ static struct ib_qp *ipoib_cm_create_rx_qp(struct net_device *dev,
 		.qp_context = p,
 	};
 
+	/* spread connections over the receive rings round robin */
+	n = atomic_inc_return(&priv->cm.next_rx_ring);
+	ring = &priv->cm.rx_rings[n % priv->cm.num_rx_rings];
+	p->ring = ring;
+	attr.send_cq = ring->cq ?: priv->recv_cq; /* For drain WR */
+	attr.recv_cq = ring->cq ?: priv->recv_cq;
+
 	if (!ipoib_cm_has_srq(dev)) {
 		attr.cap.max_recv_wr  = ipoib_recvq_size;
 		attr.cap.max_recv_sge = IPOIB_CM_RX_SG;
@@ -573,9 +621,9 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 
 	if (unlikely(wr_id >= ipoib_recvq_size)) {
 		if (wr_id == (IPOIB_CM_RX_DRAIN_WRID & ~(IPOIB_OP_CM | IPOIB_OP_RECV))) {
+			p = wc->qp->qp_context;
 			spin_lock_irqsave(&priv->lock, flags);
-			list_splice_init(&priv->cm.rx_drain_list, &priv->cm.rx_reap_list);
-			ipoib_cm_start_rx_drain(priv);
+			ipoib_cm_rx_drain_done(priv, p->ring);
 			queue_work(ipoib_workqueue, &priv->cm.rx_reap_task);
 			spin_unlock_irqrestore(&priv->lock, flags);
 		} else
@@ -595,7 +643,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		ipoib_dbg(priv, "cm recv error "
 			   "(status=%d, wrid=%d vend_err %x)\n",
 			   wc->status, wr_id, wc->vendor_err);
-		++dev->stats.rx_dropped;
+		++p->ring->rx_dropped;
 		if (has_srq)
 			goto repost;
 		else {
@@ -649,7 +697,7 @@ void ipoib_cm_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		 * this packet and reuse the old buffer.
 		 */
 		ipoib_dbg(priv, "failed to allocate receive buffer %d\n", wr_id);
-		++dev->stats.rx_dropped;
+		++p->ring->rx_dropped;
 		goto repost;
 	}
 
@@ -666,8 +714,8 @@ copied:
 	skb_reset_mac_header(skb);
 	skb_pull(skb, IPOIB_ENCAP_LEN);
 
-	++dev->stats.rx_packets;
-	dev->stats.rx_bytes += skb->len;
+	++p->ring->rx_packets;
+	p->ring->rx_bytes += skb->len;
 
 	skb->dev = dev;
 	/* XXX get correct PACKET_ type here */
@@ -676,13 +724,14 @@ copied:
 
 repost:
 	if (has_srq) {
-		if (unlikely(ipoib_cm_post_receive_srq(dev, wr_id)))
+		if (unlikely(ipoib_cm_post_receive_srq(dev, &p->ring->rx_wr,
+						       p->ring->rx_sge, wr_id)))
 			ipoib_warn(priv, "ipoib_cm_post_receive_srq failed "
 				   "for buf %d\n", wr_id);
 	} else {
 		if (unlikely(ipoib_cm_post_receive_nonsrq(dev, p,
-							  &priv->cm.rx_wr,
-							  priv->cm.rx_sge,
+							  &p->ring->rx_wr,
+							  p->ring->rx_sge,
 							  wr_id))) {
 			--p->recv_count;
 			ipoib_warn(priv, "ipoib_cm_post_receive_nonsrq failed "
@@ -1493,6 +1542,166 @@ int ipoib_cm_add_mode_attr(struct net_device *dev)
 	return device_create_file(&dev->dev, &dev_attr_mode);
 }
 
+static int ipoib_cm_rx_ring_poll(struct napi_struct *napi, int budget)
+{
+	struct ipoib_cm_rx_ring *ring =
+		container_of(napi, struct ipoib_cm_rx_ring, napi);
+	int done = 0;
+	int t, n, i;
+
+poll_more:
+	while (done < budget) {
+		t = min(IPOIB_NUM_WC, budget - done);
+		n = ib_poll_cq(ring->cq, t, ring->ibwc);
+
+		/* only receive QPs and their drain WRs complete here */
+		for (i = 0; i < n; i++, ++done)
+			ipoib_cm_handle_rx_wc(ring->dev, ring->ibwc + i);
+
+		if (n != t)
+			break;
+	}
+
+	if (done < budget) {
+		napi_complete(napi);
+		if (unlikely(ib_req_notify_cq(ring->cq,
+					      IB_CQ_NEXT_COMP |
+					      IB_CQ_REPORT_MISSED_EVENTS)) &&
+		    napi_reschedule(napi))
+			goto poll_more;
+	}
+
+	return done;
+}
+
+static void ipoib_cm_rx_ring_completion(struct ib_cq *cq, void *ring_ptr)
+{
+	struct ipoib_cm_rx_ring *ring = ring_ptr;
+
+	napi_schedule(&ring->napi);
+}
+
+/*
+ * Creates the completion queues of all rings but ring 0, which uses the
+ * interface's recv_cq.  Rings whose CQ cannot be created are not used.
+ */
+void ipoib_cm_init_rx_rings(struct net_device *dev, int cq_size)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 1; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		ring->cq = ib_create_cq(priv->ca, ipoib_cm_rx_ring_completion,
+					NULL, ring, cq_size,
+					i % priv->ca->num_comp_vectors);
+		if (IS_ERR(ring->cq)) {
+			ipoib_warn(priv, "failed to create CQ for CM receive "
+				   "ring %d, using %d rings\n", i, i);
+			ring->cq = NULL;
+			break;
+		}
+
+		if (ib_req_notify_cq(ring->cq, IB_CQ_NEXT_COMP)) {
+			ib_destroy_cq(ring->cq);
+			ring->cq = NULL;
+			break;
+		}
+
+		netif_napi_add(dev, &ring->napi, ipoib_cm_rx_ring_poll,
+			       NAPI_POLL_WEIGHT);
+	}
+
+	priv->cm.num_rx_rings = i;
+}
+
+static void ipoib_cm_free_rx_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 1; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		if (!ring->cq)
+			continue;
+
+		netif_napi_del(&ring->napi);
+		if (ib_destroy_cq(ring->cq))
+			ipoib_warn(priv, "ib_cq_destroy (ring %d) failed\n", i);
+		ring->cq = NULL;
+	}
+
+	kfree(priv->cm.rx_rings);
+	priv->cm.rx_rings = NULL;
+	priv->cm.num_rx_rings = 0;
+}
+
+void ipoib_cm_napi_enable(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 1; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		napi_enable(&ring->napi);
+		if (ib_req_notify_cq(ring->cq, IB_CQ_NEXT_COMP |
+				     IB_CQ_REPORT_MISSED_EVENTS) > 0)
+			napi_schedule(&ring->napi);
+	}
+}
+
+void ipoib_cm_napi_disable(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	int i;
+
+	for (i = 1; i < priv->cm.num_rx_rings; ++i)
+		napi_disable(&priv->cm.rx_rings[i].napi);
+}
+
+/*
+ * Counterpart of ipoib_drain_cq() for the rings with a CQ of their own,
+ * called with BHs disabled and the NAPI contexts stopped.
+ */
+void ipoib_cm_drain_rx_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i, j, n;
+
+	for (i = 1; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		do {
+			n = ib_poll_cq(ring->cq, IPOIB_NUM_WC, ring->ibwc);
+			for (j = 0; j < n; ++j) {
+				struct ib_wc *wc = ring->ibwc + j;
+
+				if (wc->status == IB_WC_SUCCESS)
+					wc->status = IB_WC_WR_FLUSH_ERR;
+				ipoib_cm_handle_rx_wc(dev, wc);
+			}
+		} while (n == IPOIB_NUM_WC);
+	}
+}
+
+void ipoib_cm_get_stats64(struct net_device *dev,
+			  struct rtnl_link_stats64 *stats)
+{
+	struct ipoib_dev_priv *priv = netdev_priv(dev);
+	struct ipoib_cm_rx_ring *ring;
+	int i;
+
+	for (i = 0; i < priv->cm.num_rx_rings; ++i) {
+		ring = &priv->cm.rx_rings[i];
+		stats->rx_packets += ring->rx_packets;
+		stats->rx_bytes	  += ring->rx_bytes;
+		stats->rx_dropped += ring->rx_dropped;
+	}
+}
+
 static void ipoib_cm_create_srq(struct net_device *dev, int max_sge)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
@@ -1527,7 +1736,7 @@ static void ipoib_cm_create_srq(struct net_device *dev, int max_sge)
 int ipoib_cm_dev_init(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
-	int i, ret;
+	int i, n, ret;
 	struct ib_device_attr attr;
 
 	INIT_LIST_HEAD(&priv->cm.passive_ids);
@@ -1567,6 +1776,21 @@ int ipoib_cm_dev_init(struct net_device *dev)
 
 	ipoib_cm_init_rx_wr(dev, &priv->cm.rx_wr, priv->cm.rx_sge);
 
+	n = ipoib_cm_rx_rings ? ipoib_cm_rx_rings :
+		min_t(int, num_online_cpus(), priv->ca->num_comp_vectors);
+	n = clamp(n, 1, IPOIB_CM_MAX_RX_RINGS);
+	priv->cm.rx_rings = kcalloc(n, sizeof *priv->cm.rx_rings, GFP_KERNEL);
+	if (!priv->cm.rx_rings) {
+		ipoib_cm_dev_cleanup(dev);
+		return -ENOMEM;
+	}
+	priv->cm.num_rx_rings = n;
+	for (i = 0; i < n; ++i) {
+		priv->cm.rx_rings[i].dev = dev;
+		ipoib_cm_init_rx_wr(dev, &priv->cm.rx_rings[i].rx_wr,
+				    priv->cm.rx_rings[i].rx_sge);
+	}
+
 	if (ipoib_cm_has_srq(dev)) {
 		for (i = 0; i < ipoib_recvq_size; ++i) {
 			if (!ipoib_cm_alloc_rx_skb(dev, priv->cm.srq_ring, i,
@@ -1579,7 +1803,8 @@ int ipoib_cm_dev_init(struct net_device *dev)
 				return -ENOMEM;
 			}
 
-			if (ipoib_cm_post_receive_srq(dev, i)) {
+			if (ipoib_cm_post_receive_srq(dev, &priv->cm.rx_wr,
+						      priv->cm.rx_sge, i)) {
 				ipoib_warn(priv, "ipoib_cm_post_receive_srq "
 					   "failed for buf %d\n", i);
 				ipoib_cm_dev_cleanup(dev);
@@ -1597,6 +1822,8 @@ void ipoib_cm_dev_cleanup(struct net_device *dev)
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	int ret;
 
+	ipoib_cm_free_rx_rings(dev);
+
 	if (!priv->cm.srq)
 		return;
 
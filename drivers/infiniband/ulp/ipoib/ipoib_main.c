@@ -1328,6 +1328,16 @@ void ipoib_dev_cleanup(struct net_device *dev)
 	ipoib_neigh_hash_uninit(dev);
 }
 
+static struct rtnl_link_stats64 *ipoib_get_stats64(struct net_device *dev,
+						   struct rtnl_link_stats64 *stats)
+{
+	netdev_stats_to_stats64(stats, &dev->stats);
+	/* connected mode receive rings count on their own */
+	ipoib_cm_get_stats64(dev, stats);
+
+	return stats;
+}
+
 static const struct header_ops ipoib_header_ops = {
 	.create	= ipoib_hard_header,
 };
@@ -1341,6 +1351,7 @@ static const struct net_device_ops ipoib_netdev_ops = {
 	.ndo_start_xmit	 	 = ipoib_start_xmit,
 	.ndo_tx_timeout		 = ipoib_timeout,
 	.ndo_set_rx_mode	 = ipoib_set_mcast_list,
+	.ndo_get_stats64	 = ipoib_get_stats64,
 };
 
 void ipoib_setup(struct net_device *dev)
@@ -142,7 +142,7 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 		.qp_type     = IB_QPT_UD
 	};
 
-	int ret, size;
+	int ret, size, cm_size = 0;
 	int i;
 
 	priv->pd = ib_alloc_pd(priv->ca);
@@ -160,11 +160,11 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 	size = ipoib_recvq_size + 1;
 	ret = ipoib_cm_dev_init(dev);
 	if (!ret) {
-		size += ipoib_sendq_size;
 		if (ipoib_cm_has_srq(dev))
-			size += ipoib_recvq_size + 1; /* 1 extra for rx_drain_qp */
+			cm_size = ipoib_recvq_size + 1; /* 1 extra for rx_drain_qp */
 		else
-			size += ipoib_recvq_size * ipoib_max_conn_qp;
+			cm_size = ipoib_recvq_size * ipoib_max_conn_qp;
+		size += ipoib_sendq_size + cm_size;
 	}
 
 	priv->recv_cq = ib_create_cq(priv->ca, ipoib_ib_completion, NULL, dev, size, 0);
@@ -183,6 +183,9 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 	if (ib_req_notify_cq(priv->recv_cq, IB_CQ_NEXT_COMP))
 		goto out_free_send_cq;
 
+	if (!ret)
+		ipoib_cm_init_rx_rings(dev, cm_size);
+
 	init_attr.send_cq = priv->send_cq;
 	init_attr.recv_cq = priv->recv_cq;
 
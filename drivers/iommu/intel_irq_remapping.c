@@ -34,6 +34,10 @@ struct hpet_scope {
 #define IR_X2APIC_MODE(mode) (mode ? (1 << 11) : 0)
 #define IRTE_DEST(dest) ((x2apic_mode) ? dest : dest << 8)
 
+/* Split of the posted-interrupt descriptor address in a posted IRTE */
+#define PDA_LOW_BIT	26
+#define PDA_HIGH_BIT	32
+
 static struct ioapic_scope ir_ioapic[MAX_IO_APICS];
 static struct hpet_scope ir_hpet[MAX_HPET_TBS];
 static int ir_ioapic_num, ir_hpet_num;
@@ -191,8 +195,25 @@ static int modify_irte(int irq, struct irte *irte_modified)
 	index = irq_iommu->irte_index + irq_iommu->sub_handle;
 	irte = &iommu->ir_table->base[index];
 
-	set_64bit(&irte->low, irte_modified->low);
-	set_64bit(&irte->high, irte_modified->high);
+#ifdef CONFIG_X86_64
+	/*
+	 * The posted descriptor address spans both halves of the IRTE, so
+	 * an entry entering or leaving posted mode has to be written with
+	 * a single 128-bit store, or the IOMMU could see a torn entry.
+	 */
+	if (irte->pst || irte_modified->pst) {
+		bool ret;
+
+		ret = cmpxchg_double(&irte->low, &irte->high,
+				     irte->low, irte->high,
+				     irte_modified->low, irte_modified->high);
+		WARN_ON(!ret);
+	} else
+#endif
+	{
+		set_64bit(&irte->low, irte_modified->low);
+		set_64bit(&irte->high, irte_modified->high);
+	}
 	__iommu_flush_cache(iommu, irte, sizeof(*irte));
 
 	rc = qi_flush_iec(iommu, index, 0);
@@ -274,6 +295,7 @@ static int free_irte(int irq)
 	irq_iommu->irte_index = 0;
 	irq_iommu->sub_handle = 0;
 	irq_iommu->irte_mask = 0;
+	irq_iommu->irte_pi_mode = 0;
 
 	raw_spin_unlock_irqrestore(&irq_2_ir_lock, flags);
 
@@ -677,6 +699,20 @@ static int __init intel_enable_irq_remapping(void)
 
 	irq_remapping_enabled = 1;
 
+	/*
+	 * Posted interrupts need every remapping unit to support them, and
+	 * a 128-bit atomic IRTE update to switch entries between the modes.
+	 */
+	if (config_enabled(CONFIG_X86_64) && cpu_has_cx16 && !disable_irq_post) {
+		intel_irq_remap_ops.capability |= 1 << IRQ_POSTING_CAP;
+		for_each_iommu(iommu, drhd)
+			if (!cap_pi_support(iommu->cap)) {
+				intel_irq_remap_ops.capability &=
+					~(1 << IRQ_POSTING_CAP);
+				break;
+			}
+	}
+
 	/*
 	 * VT-d has a different layout for IO-APIC entries when
 	 * interrupt remapping is enabled. So it needs a special routine
@@ -1033,14 +1069,21 @@ intel_ioapic_set_affinity(struct irq_data *data, const struct cpumask *mask,
 		return err;
 	}
 
-	irte.vector = cfg->vector;
-	irte.dest_id = IRTE_DEST(dest);
-
 	/*
-	 * Atomically updates the IRTE with the new destination, vector
-	 * and flushes the interrupt entry cache.
+	 * A posted interrupt does not target the host vector; the new
+	 * affinity takes effect once intel_ir_set_vcpu_affinity() puts
+	 * the entry back in remapped mode.
 	 */
-	modify_irte(irq, &irte);
+	if (!cfg->irq_2_iommu.irte_pi_mode) {
+		irte.vector = cfg->vector;
+		irte.dest_id = IRTE_DEST(dest);
+
+		/*
+		 * Atomically updates the IRTE with the new destination,
+		 * vector and flushes the interrupt entry cache.
+		 */
+		modify_irte(irq, &irte);
+	}
 
 	/*
 	 * After this point, all the interrupts will start arriving
@@ -1077,6 +1120,7 @@ static void intel_compose_msi_msg(struct pci_dev *pdev,
 		set_hpet_sid(&irte, hpet_id);
 
 	modify_irte(irq, &irte);
+	cfg->irq_2_iommu.irte_pi_mode = 0;
 
 	msg->address_hi = MSI_ADDR_BASE_HI;
 	msg->data = sub_handle;
@@ -1156,6 +1200,57 @@ static int intel_alloc_hpet_msi(unsigned int irq, unsigned int id)
 	return ret;
 }
 
+static int intel_ir_set_vcpu_affinity(unsigned int irq,
+				      struct vcpu_data *vcpu_pi_info)
+{
+	struct irq_data *data = irq_get_irq_data(irq);
+	struct irq_cfg *cfg = irq_get_chip_data(irq);
+	struct irte irte_old, irte;
+	unsigned int dest;
+
+	if (!data || !cfg || get_irte(irq, &irte_old))
+		return -ENODEV;
+
+	if (!vcpu_pi_info) {
+		/* Back to remapped mode, towards the current host affinity */
+		if (apic->cpu_mask_to_apicid_and(cfg->domain, data->affinity,
+						 &dest))
+			return -EINVAL;
+
+		prepare_irte(&irte, cfg->vector, dest);
+		irte.sid = irte_old.sid;
+		irte.sq = irte_old.sq;
+		irte.svt = irte_old.svt;
+
+		modify_irte(irq, &irte);
+		cfg->irq_2_iommu.irte_pi_mode = 0;
+		return 0;
+	}
+
+	/*
+	 * Keep the source-id validation and the fault processing setting,
+	 * the rest of the entry is rebuilt in posted format.
+	 */
+	memset(&irte, 0, sizeof(irte));
+	irte.p_present = irte_old.present;
+	irte.p_fpd = irte_old.fpd;
+	irte.p_pst = 1;
+	irte.p_urgent = 0;
+	irte.p_vector = vcpu_pi_info->vector;
+	irte.pda_l = (vcpu_pi_info->pi_desc_addr >> (32 - PDA_LOW_BIT)) &
+		     ~(-1UL << PDA_LOW_BIT);
+	irte.pda_h = (vcpu_pi_info->pi_desc_addr >> 32) &
+		     ~(-1UL << PDA_HIGH_BIT);
+	irte.sid = irte_old.sid;
+	irte.sq = irte_old.sq;
+	irte.svt = irte_old.svt;
+
+	modify_irte(irq, &irte);
+	cfg->irq_2_iommu.irte_pi_mode = 1;
+
+	return 0;
+}
+
 struct irq_remap_ops intel_irq_remap_ops = {
 	.supported		= intel_irq_remapping_supported,
 	.prepare		= dmar_table_init,
@@ -1170,4 +1265,5 @@ struct irq_remap_ops intel_irq_remap_ops = {
 	.msi_alloc_irq		= intel_msi_alloc_irq,
 	.msi_setup_irq		= intel_msi_setup_irq,
 	.alloc_hpet_msi		= intel_alloc_hpet_msi,
+	.set_vcpu_affinity	= intel_ir_set_vcpu_affinity,
 };
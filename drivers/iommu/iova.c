@@ -18,6 +18,12 @@
  */
 
 #include <linux/iova.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+
+static void init_iova_rcaches(struct iova_domain *iovad);
+static void free_iova_rcaches(struct iova_domain *iovad);
 
 void
 init_iova_domain(struct iova_domain *iovad, unsigned long pfn_32bit)
@@ -26,6 +32,7 @@ init_iova_domain(struct iova_domain *iovad, unsigned long pfn_32bit)
 	iovad->rbroot = RB_ROOT;
 	iovad->cached32_node = NULL;
 	iovad->dma_32bit_pfn = pfn_32bit;
+	init_iova_rcaches(iovad);
 }
 
 static struct rb_node *
@@ -320,6 +327,9 @@ void put_iova_domain(struct iova_domain *iovad)
 	struct rb_node *node;
 	unsigned long flags;
 
+	/* the cached iovas are still in the rbtree, freed below */
+	free_iova_rcaches(iovad);
+
 	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
 	node = rb_first(&iovad->rbroot);
 	while (node) {
@@ -485,3 +495,375 @@ error:
 		free_iova_mem(prev);
 	return NULL;
 }
+
+/*
+ * Magazine caches for IOVA ranges.  For an introduction to magazines,
+ * see the USENIX 2001 paper "Magazines and Vmem: Extending the Slab
+ * Allocator to Many CPUs and Arbitrary Resources" by Bonwick and Adams.
+ * For simplicity, we use a static magazine size and don't implement the
+ * dynamic size tuning described in the paper.
+ *
+ * A cached iova stays in the rbtree, it is only handed out again without
+ * walking the tree or taking iova_rbtree_lock.
+ */
+
+#define IOVA_MAG_SIZE 128
+
+struct iova_magazine {
+	unsigned long size;
+	struct iova *iovas[IOVA_MAG_SIZE];
+};
+
+struct iova_cpu_rcache {
+	spinlock_t lock;
+	struct iova_magazine *loaded;
+	struct iova_magazine *prev;
+};
+
+static struct iova_magazine *iova_magazine_alloc(gfp_t flags)
+{
+	return kzalloc(sizeof(struct iova_magazine), flags);
+}
+
+static void iova_magazine_free(struct iova_magazine *mag)
+{
+	kfree(mag);
+}
+
+/* Give the cached ranges back to the rbtree */
+static void
+iova_magazine_free_iovas(struct iova_magazine *mag, struct iova_domain *iovad)
+{
+	unsigned long flags;
+	int i;
+
+	if (!mag)
+		return;
+
+	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	for (i = 0; i < mag->size; ++i) {
+		struct iova *iova = mag->iovas[i];
+
+		__cached_rbnode_delete_update(iovad, iova);
+		rb_erase(&iova->node, &iovad->rbroot);
+		free_iova_mem(iova);
+	}
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+
+	mag->size = 0;
+}
+
+static bool iova_magazine_full(struct iova_magazine *mag)
+{
+	return mag->size == IOVA_MAG_SIZE;
+}
+
+static bool iova_magazine_empty(struct iova_magazine *mag)
+{
+	return !mag || mag->size == 0;
+}
+
+static struct iova *iova_magazine_pop(struct iova_magazine *mag,
+				      unsigned long limit_pfn)
+{
+	BUG_ON(iova_magazine_empty(mag));
+
+	if (mag->iovas[mag->size - 1]->pfn_hi > limit_pfn)
+		return NULL;
+
+	return mag->iovas[--mag->size];
+}
+
+static void iova_magazine_push(struct iova_magazine *mag, struct iova *iova)
+{
+	BUG_ON(iova_magazine_full(mag));
+
+	mag->iovas[mag->size++] = iova;
+}
+
+/*
+ * Domains may be set up from atomic context, so magazines are only
+ * allocated, with GFP_ATOMIC, once a CPU first frees into its cache.
+ * Called with cpu_rcache->lock held.
+ */
+static bool iova_cpu_rcache_fill(struct iova_cpu_rcache *cpu_rcache)
+{
+	if (!cpu_rcache->loaded)
+		cpu_rcache->loaded = iova_magazine_alloc(GFP_ATOMIC);
+	if (!cpu_rcache->prev)
+		cpu_rcache->prev = iova_magazine_alloc(GFP_ATOMIC);
+
+	return cpu_rcache->loaded && cpu_rcache->prev;
+}
+
+static void init_iova_rcaches(struct iova_domain *iovad)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_rcache *rcache;
+	unsigned int cpu;
+	int i;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+		rcache = &iovad->rcaches[i];
+		spin_lock_init(&rcache->lock);
+		rcache->depot_size = 0;
+		/* without it that size class just isn't cached */
+		rcache->cpu_rcaches = alloc_percpu_gfp(struct iova_cpu_rcache,
+						       GFP_NOWAIT);
+		if (!rcache->cpu_rcaches)
+			continue;
+		for_each_possible_cpu(cpu) {
+			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
+			spin_lock_init(&cpu_rcache->lock);
+			cpu_rcache->loaded = NULL;
+			cpu_rcache->prev = NULL;
+		}
+	}
+}
+
+/*
+ * Try inserting IOVA range into the rcache.  If the rcache can't take
+ * it, return false and let the caller give it back to the rbtree.
+ */
+static bool __iova_rcache_insert(struct iova_domain *iovad,
+				 struct iova_rcache *rcache,
+				 struct iova *iova)
+{
+	struct iova_magazine *mag_to_free = NULL;
+	struct iova_cpu_rcache *cpu_rcache;
+	bool can_insert = false;
+	unsigned long flags;
+
+	cpu_rcache = raw_cpu_ptr(rcache->cpu_rcaches);
+	spin_lock_irqsave(&cpu_rcache->lock, flags);
+
+	/* no magazines yet and none to be had, try again next time */
+	if (!iova_cpu_rcache_fill(cpu_rcache))
+		goto out_unlock;
+
+	if (!iova_magazine_full(cpu_rcache->loaded)) {
+		can_insert = true;
+	} else if (!iova_magazine_full(cpu_rcache->prev)) {
+		swap(cpu_rcache->prev, cpu_rcache->loaded);
+		can_insert = true;
+	} else {
+		struct iova_magazine *new_mag = iova_magazine_alloc(GFP_ATOMIC);
+
+		if (new_mag) {
+			spin_lock(&rcache->lock);
+			if (rcache->depot_size < MAX_GLOBAL_MAGS)
+				rcache->depot[rcache->depot_size++] =
+						cpu_rcache->loaded;
+			else
+				mag_to_free = cpu_rcache->loaded;
+			spin_unlock(&rcache->lock);
+
+			cpu_rcache->loaded = new_mag;
+			can_insert = true;
+		}
+	}
+
+	if (can_insert)
+		iova_magazine_push(cpu_rcache->loaded, iova);
+
+out_unlock:
+	spin_unlock_irqrestore(&cpu_rcache->lock, flags);
+
+	if (mag_to_free) {
+		iova_magazine_free_iovas(mag_to_free, iovad);
+		iova_magazine_free(mag_to_free);
+	}
+
+	return can_insert;
+}
+
+static bool iova_rcache_insert(struct iova_domain *iovad, struct iova *iova)
+{
+	unsigned long size = iova_size(iova);
+	unsigned int log_size = order_base_2(size);
+
+	/* only naturally aligned power of two ranges come back out */
+	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE || !is_power_of_2(size) ||
+	    (iova->pfn_lo & (size - 1)))
+		return false;
+
+	if (!iovad->rcaches[log_size].cpu_rcaches)
+		return false;
+
+	return __iova_rcache_insert(iovad, &iovad->rcaches[log_size], iova);
+}
+
+/*
+ * Caller wants to allocate a new IOVA range from 'rcache'.  If we can
+ * satisfy the request, return a matching iova whose pfn_hi is at most
+ * limit_pfn.  Otherwise return NULL.
+ */
+static struct iova *__iova_rcache_get(struct iova_rcache *rcache,
+				      unsigned long limit_pfn)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova *iova = NULL;
+	bool has_iova = false;
+	unsigned long flags;
+
+	cpu_rcache = raw_cpu_ptr(rcache->cpu_rcaches);
+	spin_lock_irqsave(&cpu_rcache->lock, flags);
+
+	if (!iova_magazine_empty(cpu_rcache->loaded)) {
+		has_iova = true;
+	} else if (!iova_magazine_empty(cpu_rcache->prev)) {
+		swap(cpu_rcache->prev, cpu_rcache->loaded);
+		has_iova = true;
+	} else {
+		spin_lock(&rcache->lock);
+		if (rcache->depot_size > 0) {
+			iova_magazine_free(cpu_rcache->loaded);
+			cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+			has_iova = true;
+		}
+		spin_unlock(&rcache->lock);
+	}
+
+	if (has_iova)
+		iova = iova_magazine_pop(cpu_rcache->loaded, limit_pfn);
+
+	spin_unlock_irqrestore(&cpu_rcache->lock, flags);
+
+	return iova;
+}
+
+static struct iova *iova_rcache_get(struct iova_domain *iovad,
+				    unsigned long size,
+				    unsigned long limit_pfn)
+{
+	unsigned int log_size = order_base_2(size);
+
+	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+		return NULL;
+
+	if (!iovad->rcaches[log_size].cpu_rcaches)
+		return NULL;
+
+	return __iova_rcache_get(&iovad->rcaches[log_size], limit_pfn);
+}
+
+/*
+ * Give back every range cached by the domain to the rbtree, so that a
+ * failing allocation sees all of the free space.
+ */
+static void free_cached_iovas(struct iova_domain *iovad)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_rcache *rcache;
+	struct iova_magazine *mag;
+	unsigned long flags;
+	unsigned int cpu;
+	int i;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+		rcache = &iovad->rcaches[i];
+		if (!rcache->cpu_rcaches)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
+			spin_lock_irqsave(&cpu_rcache->lock, flags);
+			iova_magazine_free_iovas(cpu_rcache->loaded, iovad);
+			iova_magazine_free_iovas(cpu_rcache->prev, iovad);
+			spin_unlock_irqrestore(&cpu_rcache->lock, flags);
+		}
+
+		for (;;) {
+			spin_lock_irqsave(&rcache->lock, flags);
+			mag = rcache->depot_size ?
+			      rcache->depot[--rcache->depot_size] : NULL;
+			spin_unlock_irqrestore(&rcache->lock, flags);
+			if (!mag)
+				break;
+			iova_magazine_free_iovas(mag, iovad);
+			iova_magazine_free(mag);
+		}
+	}
+}
+
+/*
+ * Free the magazines only, the iovas in them are still in the rbtree and
+ * put_iova_domain() frees them with the rest.
+ */
+static void free_iova_rcaches(struct iova_domain *iovad)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_rcache *rcache;
+	unsigned int cpu;
+	int i, j;
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+		rcache = &iovad->rcaches[i];
+		if (!rcache->cpu_rcaches)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
+			iova_magazine_free(cpu_rcache->loaded);
+			iova_magazine_free(cpu_rcache->prev);
+		}
+		free_percpu(rcache->cpu_rcaches);
+		rcache->cpu_rcaches = NULL;
+
+		for (j = 0; j < rcache->depot_size; ++j)
+			iova_magazine_free(rcache->depot[j]);
+		rcache->depot_size = 0;
+	}
+}
+
+/**
+ * alloc_iova_fast - allocates an iova from the rcache
+ * @iovad: - iova domain in question
+ * @size: - size of page frames to allocate
+ * @limit_pfn: - max limit address
+ * This function tries to satisfy an iova allocation from the rcache,
+ * and falls back to regular allocation on failure. The allocated range
+ * is always size aligned, as with alloc_iova(..., true), and must be
+ * freed with free_iova_fast().
+ */
+struct iova *
+alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
+		unsigned long limit_pfn)
+{
+	bool flushed_rcache = false;
+	struct iova *new_iova;
+
+	size = __roundup_pow_of_two(size);
+
+	new_iova = iova_rcache_get(iovad, size, limit_pfn);
+	if (new_iova)
+		return new_iova;
+
+retry:
+	new_iova = alloc_iova(iovad, size, limit_pfn, true);
+	if (!new_iova && !flushed_rcache) {
+		/* try again with whatever the caches were sitting on */
+		flushed_rcache = true;
+		free_cached_iovas(iovad);
+		goto retry;
+	}
+
+	return new_iova;
+}
+
+/**
+ * free_iova_fast - free iova into the rcache
+ * @iovad: - iova domain in question.
+ * @iova: - iova from alloc_iova_fast() in question.
+ * This functions frees an iova range by trying to put it into the rcache,
+ * falling back to regular iova deallocation via __free_iova() if this
+ * fails.
+ */
+void
+free_iova_fast(struct iova_domain *iovad, struct iova *iova)
+{
+	if (iova_rcache_insert(iovad, iova))
+		return;
+
+	__free_iova(iovad, iova);
+}
@@ -6,6 +6,7 @@
 #include <linux/msi.h>
 #include <linux/irq.h>
 #include <linux/pci.h>
+#include <linux/export.h>
 
 #include <asm/hw_irq.h>
 #include <asm/irq_remapping.h>
@@ -22,6 +23,7 @@ int disable_irq_remap;
 int irq_remap_broken;
 int disable_sourceid_checking;
 int no_x2apic_optout;
+int disable_irq_post;
 
 static struct irq_remap_ops *remap_ops;
 
@@ -192,6 +194,8 @@ static __init int setup_irqremap(char *str)
 			disable_sourceid_checking = 1;
 		else if (!strncmp(str, "no_x2apic_optout", 16))
 			no_x2apic_optout = 1;
+		else if (!strncmp(str, "nopost", 6))
+			disable_irq_post = 1;
 
 		str += strcspn(str, ",");
 		while (*str == ',')
@@ -282,6 +286,39 @@ int __init irq_remap_enable_fault_handling(void)
 	return remap_ops->enable_faulting();
 }
 
+bool irq_remapping_cap(enum irq_remap_cap cap)
+{
+	if (!remap_ops || disable_irq_post)
+		return false;
+
+	return (remap_ops->capability & (1 << cap));
+}
+EXPORT_SYMBOL_GPL(irq_remapping_cap);
+
+/*
+ * Switch a remapped interrupt to posted mode towards @vcpu_info, or back
+ * to remapped mode towards its host affinity if @vcpu_info is NULL. The
+ * descriptor lock serializes this against irq_set_affinity().
+ */
+int irq_remapping_set_vcpu_affinity(unsigned int irq,
+				    struct vcpu_data *vcpu_info)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	unsigned long flags;
+	int ret;
+
+	if (!desc || !irq_remapping_cap(IRQ_POSTING_CAP) ||
+	    !remap_ops->set_vcpu_affinity)
+		return -ENOSYS;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	ret = remap_ops->set_vcpu_affinity(irq, vcpu_info);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_remapping_set_vcpu_affinity);
+
 int setup_ioapic_remapped_entry(int irq,
 				struct IO_APIC_route_entry *entry,
 				unsigned int destination, int vector,
@@ -30,14 +30,19 @@ struct irq_data;
 struct cpumask;
 struct pci_dev;
 struct msi_msg;
+struct vcpu_data;
 
 extern int disable_irq_remap;
 extern int irq_remap_broken;
 extern int disable_sourceid_checking;
 extern int no_x2apic_optout;
 extern int irq_remapping_enabled;
+extern int disable_irq_post;
 
 struct irq_remap_ops {
+	/* The supported capabilities, a bitmap of enum irq_remap_cap */
+	int capability;
+
 	/* Check whether Interrupt Remapping is supported */
 	int (*supported)(void);
 
@@ -81,6 +86,9 @@ struct irq_remap_ops {
 
 	/* Setup interrupt remapping for an HPET MSI */
 	int (*alloc_hpet_msi)(unsigned int, unsigned int);
+
+	/* Post an interrupt to a vCPU, or restore remapping if NULL */
+	int (*set_vcpu_affinity)(unsigned int, struct vcpu_data *);
 };
 
 extern struct irq_remap_ops intel_irq_remap_ops;
@@ -91,6 +99,7 @@ extern struct irq_remap_ops amd_iommu_irq_ops;
 #define irq_remapping_enabled 0
 #define disable_irq_remap     1
 #define irq_remap_broken      0
+#define disable_irq_post      1
 
 #endif /* CONFIG_IRQ_REMAP */
 
@@ -598,6 +598,10 @@ struct cache_set {
 	struct gc_stat		gc_stats;
 	size_t			nbuckets;
 
+	/* Root children checked so far by bch_btree_check(), for sysfs */
+	atomic_t		btree_check_done;
+	unsigned		btree_check_total;
+
 	struct task_struct	*gc_thread;
 	/* Where in the btree gc currently is */
 	struct bkey		gc_done;
@@ -1805,17 +1805,32 @@ int bch_gc_thread_start(struct cache_set *c)
 
 /* Initial partial gc */
 
-static int bch_btree_check_recurse(struct btree *b, struct btree_op *op)
+#define BTREE_CHECK_THREADS_MAX	16
+
+static void bch_btree_check_mark(struct btree *b)
 {
-	int ret = 0;
-	struct bkey *k, *p = NULL;
+	struct bkey *k;
 	struct btree_iter iter;
 
+	/* sibling subtrees may be checked in parallel and share buckets */
+	mutex_lock(&b->c->bucket_lock);
+
 	for_each_key_filter(&b->keys, k, &iter, bch_ptr_invalid)
 		bch_initial_mark_key(b->c, b->level, k);
 
 	bch_initial_mark_key(b->c, b->level + 1, &b->key);
 
+	mutex_unlock(&b->c->bucket_lock);
+}
+
+static int bch_btree_check_recurse(struct btree *b, struct btree_op *op)
+{
+	int ret = 0;
+	struct bkey *k, *p = NULL;
+	struct btree_iter iter;
+
+	bch_btree_check_mark(b);
+
 	if (b->level) {
 		bch_btree_iter_init(&b->keys, &iter, NULL);
 
@@ -1835,13 +1850,140 @@ static int bch_btree_check_recurse(struct btree *b, struct btree_op *op)
 	return ret;
 }
 
-int bch_btree_check(struct cache_set *c)
+/*
+ * The children of the root are handed out one at a time from a shared
+ * iterator, so each thread checks whole subtrees and a big tree spreads
+ * its reads over all of them.
+ */
+struct btree_check_state {
+	struct cache_set	*c;
+	struct btree		*root;
+
+	spinlock_t		lock;
+	struct btree_iter	iter;
+	int			ret;
+
+	atomic_t		running;
+	struct completion	done;
+};
+
+static void bch_btree_check_subtrees(struct btree_check_state *s)
 {
+	struct cache_set *c = s->c;
 	struct btree_op op;
+	struct bkey *k;
+	BKEY_PADDED(key) tmp;
+	int ret = 0;
 
 	bch_btree_op_init(&op, SHRT_MAX);
 
-	return btree_root(check_recurse, c, &op);
+	while (1) {
+		spin_lock(&s->lock);
+		k = s->ret ? NULL
+			   : bch_btree_iter_next_filter(&s->iter, &s->root->keys,
+							bch_ptr_bad);
+		if (k)
+			bkey_copy(&tmp.key, k);
+		spin_unlock(&s->lock);
+
+		if (!k)
+			break;
+
+		do {
+			ret = btree(check_recurse, &tmp.key, s->root, &op);
+			bch_cannibalize_unlock(c);
+			if (ret == -EINTR)
+				schedule();
+		} while (ret == -EINTR);
+
+		finish_wait(&c->btree_cache_wait, &op.wait);
+
+		if (ret) {
+			spin_lock(&s->lock);
+			if (!s->ret)
+				s->ret = ret;
+			spin_unlock(&s->lock);
+			break;
+		}
+
+		atomic_inc(&c->btree_check_done);
+	}
+}
+
+static int bch_btree_check_thread(void *arg)
+{
+	struct btree_check_state *s = arg;
+
+	bch_btree_check_subtrees(s);
+
+	if (atomic_dec_and_test(&s->running))
+		complete(&s->done);
+
+	return 0;
+}
+
+int bch_btree_check(struct cache_set *c)
+{
+	struct btree_check_state s;
+	struct btree_iter iter;
+	struct btree *b;
+	struct bkey *k;
+	unsigned i, nr_threads;
+
+	atomic_set(&c->btree_check_done, 0);
+	c->btree_check_total = 0;
+
+	nr_threads = min_t(unsigned, num_online_cpus(),
+			   BTREE_CHECK_THREADS_MAX);
+
+	if (!c->root->level || nr_threads <= 1) {
+		struct btree_op op;
+
+		bch_btree_op_init(&op, SHRT_MAX);
+
+		return btree_root(check_recurse, c, &op);
+	}
+
+	/* nothing else touches the btree before the cache set is running */
+	b = c->root;
+	rw_lock(true, b, b->level);
+
+	bch_btree_check_mark(b);
+
+	for_each_key_filter(&b->keys, k, &iter, bch_ptr_bad)
+		c->btree_check_total++;
+
+	s.c = c;
+	s.root = b;
+	s.ret = 0;
+	spin_lock_init(&s.lock);
+	bch_btree_iter_init(&b->keys, &s.iter, NULL);
+	init_completion(&s.done);
+
+	/* one reference for us, we check subtrees as well */
+	atomic_set(&s.running, 1);
+
+	for (i = 1; i < nr_threads; i++) {
+		struct task_struct *t;
+
+		atomic_inc(&s.running);
+		t = kthread_run(bch_btree_check_thread, &s,
+				"bcache_btree_check%u", i);
+		if (IS_ERR(t)) {
+			atomic_dec(&s.running);
+			pr_warn("btree check thread %u failed to start", i);
+			break;
+		}
+	}
+
+	bch_btree_check_subtrees(&s);
+
+	if (!atomic_dec_and_test(&s.running))
+		wait_for_completion(&s.done);
+
+	rw_unlock(true, b);
+
+	return s.ret;
 }
 
 void bch_initial_gc_finish(struct cache_set *c)
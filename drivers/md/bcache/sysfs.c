@@ -56,6 +56,7 @@ sysfs_time_stats_attribute(btree_sort,	ms,  us);
 sysfs_time_stats_attribute(btree_read,	ms,  us);
 
 read_attribute(btree_nodes);
+read_attribute(btree_check_progress);
 read_attribute(btree_used_percent);
 read_attribute(average_key_size);
 read_attribute(dirty_data);
@@ -575,7 +576,25 @@ SHOW(__bch_cache_set)
 
 	return 0;
 }
-SHOW_LOCKED(bch_cache_set)
+
+SHOW(bch_cache_set)
+{
+	struct cache_set *c = container_of(kobj, struct cache_set, kobj);
+	ssize_t ret;
+
+	/*
+	 * Registration holds bch_register_lock while the btree is checked,
+	 * so the progress is readable without it.
+	 */
+	sysfs_printf(btree_check_progress, "%u/%u",
+		     atomic_read(&c->btree_check_done),
+		     c->btree_check_total);
+
+	mutex_lock(&bch_register_lock);
+	ret = __bch_cache_set_show(kobj, attr, buf);
+	mutex_unlock(&bch_register_lock);
+	return ret;
+}
 
 STORE(__bch_cache_set)
 {
@@ -688,6 +707,7 @@ static struct attribute *bch_cache_set_files[] = {
 	&sysfs_cache_available_percent,
 
 	&sysfs_average_key_size,
+	&sysfs_btree_check_progress,
 
 	&sysfs_errors,
 	&sysfs_io_error_limit,
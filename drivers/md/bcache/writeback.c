@@ -14,6 +14,7 @@
 #include <linux/delay.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
+#include <linux/slab.h>
 #include <trace/events/bcache.h>
 
 /* Rate limiting */
@@ -445,9 +446,14 @@ static int bch_writeback_thread(void *arg)
 
 /* Init */
 
+#define DIRTY_INIT_THREADS_MAX	16
+
 struct sectors_dirty_init {
 	struct btree_op	op;
 	unsigned	inode;
+	/* only keys in (start, end] are counted */
+	struct bkey	start;
+	struct bkey	end;
 };
 
 static int sectors_dirty_init_fn(struct btree_op *_op, struct btree *b,
@@ -455,9 +461,13 @@ static int sectors_dirty_init_fn(struct btree_op *_op, struct btree *b,
 {
 	struct sectors_dirty_init *op = container_of(_op,
 						struct sectors_dirty_init, op);
-	if (KEY_INODE(k) > op->inode)
+	if (KEY_INODE(k) > op->inode ||
+	    bkey_cmp(k, &op->end) > 0)
 		return MAP_DONE;
 
+	if (bkey_cmp(k, &op->start) <= 0)
+		return MAP_CONTINUE;
+
 	if (KEY_DIRTY(k))
 		bcache_dev_sectors_dirty_add(b->c, KEY_INODE(k),
 					     KEY_START(k), KEY_SIZE(k));
@@ -465,16 +475,156 @@ static int sectors_dirty_init_fn(struct btree_op *_op, struct btree *b,
 	return MAP_CONTINUE;
 }
 
-void bch_sectors_dirty_init(struct cached_dev *dc)
+static void sectors_dirty_init_range(struct cache_set *c, unsigned inode,
+				     struct bkey *start, struct bkey *end)
 {
 	struct sectors_dirty_init op;
 
 	bch_btree_op_init(&op.op, -1);
-	op.inode = dc->disk.id;
+	op.inode = inode;
+	op.start = *start;
+	op.end = *end;
+
+	bch_btree_map_keys(&op.op, c, start, sectors_dirty_init_fn, 0);
+}
+
+/*
+ * The keys of the root node split the device's part of the keyspace into
+ * ranges, bounds[i] to bounds[i + 1], that threads count independently.
+ */
+struct dirty_init_state {
+	struct cache_set	*c;
+	unsigned		inode;
+	struct bkey		*bounds;
+	unsigned		nr_ranges;
+
+	atomic_t		next;
+	atomic_t		running;
+	struct completion	done;
+};
+
+static void sectors_dirty_init_ranges(struct dirty_init_state *s)
+{
+	unsigned i;
+
+	while ((i = atomic_inc_return(&s->next) - 1) < s->nr_ranges)
+		sectors_dirty_init_range(s->c, s->inode,
+					 &s->bounds[i], &s->bounds[i + 1]);
+}
+
+static int sectors_dirty_init_thread(void *arg)
+{
+	struct dirty_init_state *s = arg;
+
+	sectors_dirty_init_ranges(s);
+
+	if (atomic_dec_and_test(&s->running))
+		complete(&s->done);
+
+	return 0;
+}
+
+/*
+ * Snapshot the root's keys within the device's range.  The btree may be
+ * split under us afterwards, but the bounds still partition the keyspace,
+ * which is all the counting needs.
+ */
+static unsigned sectors_dirty_init_bounds(struct cache_set *c, unsigned inode,
+					  struct bkey **bounds)
+{
+	struct bkey first = KEY(inode, 0, 0), last = KEY(inode + 1, 0, 0);
+	struct btree_iter iter;
+	struct btree *b;
+	struct bkey *k;
+	unsigned nr = 0;
+
+	*bounds = NULL;
+again:
+	b = c->root;
+	rw_lock(false, b, b->level);
+	if (b != c->root) {
+		rw_unlock(false, b);
+		goto again;
+	}
+
+	if (!b->level)
+		goto out;
+
+	for_each_key_filter(&b->keys, k, &iter, bch_ptr_bad)
+		if (bkey_cmp(k, &first) > 0 && bkey_cmp(k, &last) < 0)
+			nr++;
+
+	if (!nr)
+		goto out;
+
+	*bounds = kmalloc_array(nr + 2, sizeof(struct bkey), GFP_NOIO);
+	if (!*bounds) {
+		nr = 0;
+		goto out;
+	}
+
+	(*bounds)[0] = first;
+	nr = 1;
+
+	for_each_key_filter(&b->keys, k, &iter, bch_ptr_bad)
+		if (bkey_cmp(k, &first) > 0 && bkey_cmp(k, &last) < 0)
+			(*bounds)[nr++] = KEY(KEY_INODE(k), KEY_OFFSET(k), 0);
+
+	(*bounds)[nr] = last;
+out:
+	rw_unlock(false, b);
+	return nr;
+}
+
+void bch_sectors_dirty_init(struct cached_dev *dc)
+{
+	struct cache_set *c = dc->disk.c;
+	unsigned i, inode = dc->disk.id;
+	unsigned nr_threads = min_t(unsigned, num_online_cpus(),
+				    DIRTY_INIT_THREADS_MAX);
+	struct dirty_init_state s;
+
+	s.bounds = NULL;
+	s.nr_ranges = nr_threads > 1
+		? sectors_dirty_init_bounds(c, inode, &s.bounds)
+		: 0;
+
+	if (s.nr_ranges <= 1) {
+		struct bkey first = KEY(inode, 0, 0), last = KEY(inode + 1, 0, 0);
+
+		kfree(s.bounds);
+		sectors_dirty_init_range(c, inode, &first, &last);
+		goto out;
+	}
+
+	s.c = c;
+	s.inode = inode;
+	atomic_set(&s.next, 0);
+	init_completion(&s.done);
+
+	/* one reference for us, we count ranges as well */
+	atomic_set(&s.running, 1);
+
+	nr_threads = min(nr_threads, s.nr_ranges);
+	for (i = 1; i < nr_threads; i++) {
+		struct task_struct *t;
+
+		atomic_inc(&s.running);
+		t = kthread_run(sectors_dirty_init_thread, &s,
+				"bcache_dirty_init%u", i);
+		if (IS_ERR(t)) {
+			atomic_dec(&s.running);
+			break;
+		}
+	}
+
+	sectors_dirty_init_ranges(&s);
 
-	bch_btree_map_keys(&op.op, dc->disk.c, &KEY(op.inode, 0, 0),
-			   sectors_dirty_init_fn, 0);
+	if (!atomic_dec_and_test(&s.running))
+		wait_for_completion(&s.done);
 
+	kfree(s.bounds);
+out:
 	dc->disk.sectors_dirty_last = bcache_dev_sectors_dirty(&dc->disk);
 }
 
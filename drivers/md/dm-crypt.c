@@ -18,6 +18,7 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/interrupt.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
@@ -43,6 +44,7 @@ struct convert_context {
 	sector_t cc_sector;
 	atomic_t cc_pending;
 	struct ablkcipher_request *req;
+	bool restart_pending;	/* backlogged while atomic */
 };
 
 /*
@@ -52,6 +54,7 @@ struct dm_crypt_io {
 	struct crypt_config *cc;
 	struct bio *base_bio;
 	struct work_struct work;
+	struct list_head list;
 
 	struct convert_context ctx;
 
@@ -108,7 +111,8 @@ struct iv_tcw_private {
  * Crypt: maps a linear range of a block device
  * and encrypts / decrypts at the same time.
  */
-enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID };
+enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
+	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE };
 
 /*
  * The fields in here must be read only after initialization.
@@ -176,8 +180,22 @@ struct crypt_config {
 
 static struct kmem_cache *_crypt_io_pool;
 
+/*
+ * Reads completed in hard interrupt context are decrypted from a tasklet
+ * on the same cpu when kcryptd is bypassed.
+ */
+struct kcryptd_cpu_queue {
+	spinlock_t lock;
+	struct list_head list;
+	struct tasklet_struct tasklet;
+};
+
+static DEFINE_PER_CPU(struct kcryptd_cpu_queue, kcryptd_cpu_queue);
+
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
+static void kcryptd_queue_tasklet(struct dm_crypt_io *io);
+static void kcryptd_crypt_read_convert(struct dm_crypt_io *io);
 static u8 *iv_of_dmreq(struct crypt_config *cc, struct dm_crypt_request *dmreq);
 
 /*
@@ -877,18 +895,25 @@ static int crypt_convert_block(struct crypt_config *cc,
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+static int crypt_alloc_req(struct crypt_config *cc,
+			   struct convert_context *ctx, bool atomic)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
-	if (!ctx->req)
-		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->req) {
+		ctx->req = mempool_alloc(cc->req_pool,
+					 atomic ? GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->req)
+			return -ENOMEM;
+	}
 
 	ablkcipher_request_set_tfm(ctx->req, cc->tfms[key_index]);
+	/* in atomic context the cipher must not yield the cpu */
 	ablkcipher_request_set_callback(ctx->req,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    atomic ? CRYPTO_TFM_REQ_MAY_BACKLOG :
+		     CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
+	return 0;
 }
 
 static void crypt_free_req(struct crypt_config *cc,
@@ -902,17 +927,24 @@ static void crypt_free_req(struct crypt_config *cc,
 
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * In @atomic context this returns -EAGAIN when it would have to allocate
+ * or wait: the caller then finishes the conversion from kcryptd, calling
+ * it again without @reset_pending.
  */
 static int crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool atomic,
+			 bool reset_pending)
 {
 	int r;
 
-	atomic_set(&ctx->cc_pending, 1);
+	if (reset_pending)
+		atomic_set(&ctx->cc_pending, 1);
 
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		if (unlikely(crypt_alloc_req(cc, ctx, atomic)))
+			return -EAGAIN;
 
 		atomic_inc(&ctx->cc_pending);
 
@@ -921,6 +953,12 @@ static int crypt_convert(struct crypt_config *cc,
 		switch (r) {
 		/* async */
 		case -EBUSY:
+			if (unlikely(atomic)) {
+				ctx->req = NULL;
+				ctx->cc_sector++;
+				ctx->restart_pending = true;
+				return -EAGAIN;
+			}
 			wait_for_completion(&ctx->restart);
 			reinit_completion(&ctx->restart);
 			/* fall through*/
@@ -933,7 +971,8 @@ static int crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector++;
-			cond_resched();
+			if (!atomic)
+				cond_resched();
 			continue;
 
 		/* error */
@@ -1022,6 +1061,7 @@ static void crypt_io_init(struct dm_crypt_io *io, struct crypt_config *cc,
 	io->error = 0;
 	io->base_io = NULL;
 	io->ctx.req = NULL;
+	io->ctx.restart_pending = false;
 	atomic_set(&io->io_pending, 0);
 }
 
@@ -1094,7 +1134,12 @@ static void crypt_endio(struct bio *clone, int error)
 	bio_put(clone);
 
 	if (rw == READ && !error) {
-		kcryptd_queue_crypt(io);
+		if (!test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+			kcryptd_queue_crypt(io);
+		else if (in_irq() || irqs_disabled())
+			kcryptd_queue_tasklet(io);
+		else
+			kcryptd_crypt_read_convert(io);
 		return;
 	}
 
@@ -1224,7 +1269,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		crypt_inc_pending(io);
 
-		r = crypt_convert(cc, &io->ctx);
+		r = crypt_convert(cc, &io->ctx, false, true);
 		if (r < 0)
 			io->error = -EIO;
 
@@ -1287,6 +1332,32 @@ static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+static void kcryptd_crypt_read_continue(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->cc;
+	int r;
+
+	if (io->ctx.restart_pending) {
+		wait_for_completion(&io->ctx.restart);
+		reinit_completion(&io->ctx.restart);
+		io->ctx.restart_pending = false;
+	}
+
+	r = crypt_convert(cc, &io->ctx, false, false);
+	if (r < 0)
+		io->error = -EIO;
+
+	if (atomic_dec_and_test(&io->ctx.cc_pending))
+		kcryptd_crypt_read_done(io);
+
+	crypt_dec_pending(io);
+}
+
+/*
+ * With DM_CRYPT_NO_READ_WORKQUEUE this runs from the completion of the
+ * read, in atomic context.
+ */
 static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
@@ -1297,7 +1368,13 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx,
+			  test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags), true);
+	if (r == -EAGAIN) {
+		INIT_WORK(&io->work, kcryptd_crypt_read_continue);
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
 	if (r < 0)
 		io->error = -EIO;
 
@@ -1355,6 +1432,41 @@ static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 	queue_work(cc->crypt_queue, &io->work);
 }
 
+/*
+ * The queue is drained by the tasklet it belongs to, wherever that runs:
+ * tasklets pending on a cpu going offline are taken over by another one.
+ */
+static void kcryptd_tasklet(unsigned long data)
+{
+	struct kcryptd_cpu_queue *q = (struct kcryptd_cpu_queue *)data;
+	struct dm_crypt_io *io;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&q->lock);
+	list_splice_init(&q->list, &list);
+	spin_unlock_irq(&q->lock);
+
+	while (!list_empty(&list)) {
+		io = list_first_entry(&list, struct dm_crypt_io, list);
+		list_del(&io->list);
+		kcryptd_crypt_read_convert(io);
+	}
+}
+
+static void kcryptd_queue_tasklet(struct dm_crypt_io *io)
+{
+	struct kcryptd_cpu_queue *q;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	q = this_cpu_ptr(&kcryptd_cpu_queue);
+	spin_lock(&q->lock);
+	list_add_tail(&io->list, &q->list);
+	spin_unlock(&q->lock);
+	tasklet_schedule(&q->tasklet);
+	local_irq_restore(flags);
+}
+
 /*
  * Decode key from its hex representation
  */
@@ -1688,7 +1800,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 1, "Invalid number of feature args"},
+		{0, 3, "Invalid number of feature args"},
 	};
 
 	if (argc < 5) {
@@ -1788,15 +1900,24 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		if (ret)
 			goto bad;
 
-		opt_string = dm_shift_arg(&as);
+		ret = -EINVAL;
+		while (opt_params--) {
+			opt_string = dm_shift_arg(&as);
+			if (!opt_string) {
+				ti->error = "Not enough feature arguments";
+				goto bad;
+			}
 
-		if (opt_params == 1 && opt_string &&
-		    !strcasecmp(opt_string, "allow_discards"))
-			ti->num_discard_bios = 1;
-		else if (opt_params) {
-			ret = -EINVAL;
-			ti->error = "Invalid feature arguments";
-			goto bad;
+			if (!strcasecmp(opt_string, "allow_discards"))
+				ti->num_discard_bios = 1;
+			else if (!strcasecmp(opt_string, "no_read_workqueue"))
+				set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+			else if (!strcasecmp(opt_string, "no_write_workqueue"))
+				set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+			else {
+				ti->error = "Invalid feature arguments";
+				goto bad;
+			}
 		}
 	}
 
@@ -1849,7 +1970,9 @@ static int crypt_map(struct dm_target *ti, struct bio *bio)
 	if (bio_data_dir(io->base_bio) == READ) {
 		if (kcryptd_io_read(io, GFP_NOWAIT))
 			kcryptd_queue_io(io);
-	} else
+	} else if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+		kcryptd_crypt_write_convert(io);
+	else
 		kcryptd_queue_crypt(io);
 
 	return DM_MAPIO_SUBMITTED;
@@ -1860,6 +1983,7 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 {
 	struct crypt_config *cc = ti->private;
 	unsigned i, sz = 0;
+	int num_feature_args = 0;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
@@ -1878,8 +2002,20 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		DMEMIT(" %llu %s %llu", (unsigned long long)cc->iv_offset,
 				cc->dev->name, (unsigned long long)cc->start);
 
-		if (ti->num_discard_bios)
-			DMEMIT(" 1 allow_discards");
+		num_feature_args += !!ti->num_discard_bios;
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE,
+					     &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE,
+					     &cc->flags);
+		if (num_feature_args) {
+			DMEMIT(" %d", num_feature_args);
+			if (ti->num_discard_bios)
+				DMEMIT(" allow_discards");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
+		}
 
 		break;
 	}
@@ -1976,7 +2112,7 @@ static int crypt_iterate_devices(struct dm_target *ti,
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 13, 0},
+	.version = {1, 14, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -1992,7 +2128,15 @@ static struct target_type crypt_target = {
 
 static int __init dm_crypt_init(void)
 {
-	int r;
+	int r, cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct kcryptd_cpu_queue *q = &per_cpu(kcryptd_cpu_queue, cpu);
+
+		spin_lock_init(&q->lock);
+		INIT_LIST_HEAD(&q->list);
+		tasklet_init(&q->tasklet, kcryptd_tasklet, (unsigned long)q);
+	}
 
 	_crypt_io_pool = KMEM_CACHE(dm_crypt_io, 0);
 	if (!_crypt_io_pool)
@@ -2009,7 +2153,11 @@ static int __init dm_crypt_init(void)
 
 static void __exit dm_crypt_exit(void)
 {
+	int cpu;
+
 	dm_unregister_target(&crypt_target);
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu(kcryptd_cpu_queue, cpu).tasklet);
 	kmem_cache_destroy(_crypt_io_pool);
 }
 
@@ -14,10 +14,12 @@ struct dm_stats {
 	struct dm_stats_last_position __percpu *last;
 	sector_t last_sector;
 	unsigned last_rw;
+	bool precise_timestamps;
 };
 
 struct dm_stats_aux {
 	bool merged;
+	unsigned long long duration_ns;
 };
 
 void dm_stats_init(struct dm_stats *st);
@@ -827,6 +827,7 @@ static int dm_table_set_type(struct dm_table *t)
 {
 	unsigned i;
 	unsigned bio_based = 0, request_based = 0, hybrid = 0;
+	bool use_blk_mq = false, use_legacy = false;
 	struct dm_target *tgt;
 	struct dm_dev_internal *dd;
 	struct list_head *devices;
@@ -855,7 +856,8 @@ static int dm_table_set_type(struct dm_table *t)
 		 * Default to bio-based if device is new.
 		 */
 		live_md_type = dm_get_md_type(t->md);
-		if (live_md_type == DM_TYPE_REQUEST_BASED)
+		if (live_md_type == DM_TYPE_REQUEST_BASED ||
+		    live_md_type == DM_TYPE_MQ_REQUEST_BASED)
 			request_based = 1;
 		else
 			bio_based = 1;
@@ -872,11 +874,28 @@ static int dm_table_set_type(struct dm_table *t)
 	/* Non-request-stackable devices can't be used for request-based dm */
 	devices = dm_table_get_devices(t);
 	list_for_each_entry(dd, devices, list) {
-		if (!blk_queue_stackable(bdev_get_queue(dd->dm_dev->bdev))) {
+		struct request_queue *q = bdev_get_queue(dd->dm_dev->bdev);
+
+		if (!blk_queue_stackable(q)) {
 			DMWARN("table load rejected: including"
 			       " non-request-stackable devices");
 			return -EINVAL;
 		}
+
+		if (q->mq_ops)
+			use_blk_mq = true;
+		else
+			use_legacy = true;
+	}
+
+	/*
+	 * Clones for blk-mq devices must be allocated from the underlying
+	 * queue, so all paths have to agree on the request allocator.
+	 */
+	if (use_blk_mq && use_legacy) {
+		DMWARN("table load rejected: not all devices"
+		       " are blk-mq request-stackable");
+		return -EINVAL;
 	}
 
 	/*
@@ -890,6 +909,17 @@ static int dm_table_set_type(struct dm_table *t)
 		return -EINVAL;
 	}
 
+	if (use_blk_mq) {
+		tgt = t->targets;
+		if (!tgt->type->clone_and_map_rq) {
+			DMWARN("table load rejected: target can't map"
+			       " to blk-mq devices");
+			return -EINVAL;
+		}
+		t->type = DM_TYPE_MQ_REQUEST_BASED;
+		return 0;
+	}
+
 	t->type = DM_TYPE_REQUEST_BASED;
 
 	return 0;
@@ -907,7 +937,10 @@ struct target_type *dm_table_get_immutable_target_type(struct dm_table *t)
 
 bool dm_table_request_based(struct dm_table *t)
 {
-	return dm_table_get_type(t) == DM_TYPE_REQUEST_BASED;
+	unsigned type = dm_table_get_type(t);
+
+	return type == DM_TYPE_REQUEST_BASED ||
+	       type == DM_TYPE_MQ_REQUEST_BASED;
 }
 
 static int dm_table_alloc_md_mempools(struct dm_table *t)
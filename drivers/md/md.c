@@ -5051,6 +5051,12 @@ static void __md_stop_writes(struct mddev *mddev)
 
 	del_timer_sync(&mddev->safemode_timer);
 
+	/* let the personality finish writes it completed early */
+	if (mddev->pers && mddev->pers->quiesce) {
+		mddev->pers->quiesce(mddev, 1);
+		mddev->pers->quiesce(mddev, 0);
+	}
+
 	bitmap_flush(mddev);
 	md_super_wait(mddev);
 
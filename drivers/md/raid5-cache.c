@@ -0,0 +1,944 @@
+/*
+ * raid5-cache.c : write journal for raid4/5/6 on a fast device
+ *
+ * Writes to the array are copied, written to the journal with FUA and
+ * completed as soon as that write is durable.  The copies are written to
+ * the array later, in batches, so that neighbouring writes meet in the
+ * stripe cache and become full stripe writes instead of read-modify-write
+ * cycles.  The journal is circular: once a record is on the array, the
+ * superblock checkpoint can move past it and the space is reused.
+ *
+ * After an unclean shutdown the records after the checkpoint are written
+ * to the array again, with reconstruct-write, so the parity of every
+ * stripe that was being written when the array stopped is computed afresh
+ * from the data instead of being updated from a possibly torn stripe.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/crc32c.h>
+#include <linux/random.h>
+#include <linux/raid/md_p.h>
+#include "md.h"
+#include "raid5.h"
+
+#define R5L_BLOCK_SIZE		(R5L_BLOCK_SECTORS << 9)
+/* a record is a header page and data pages; larger writes bypass the log */
+#define R5L_MAX_PAGES		(BIO_MAX_PAGES - 1)
+#define R5L_MAX_SECTORS		(R5L_MAX_PAGES << (PAGE_SHIFT - 9))
+/* data kept in memory until it is on the array, in sectors */
+#define R5L_MAX_PENDING		(64 << (20 - 9))
+/* how long a record waits for others before it is written to the array */
+#define R5L_DESTAGE_DELAY	HZ
+/* records replayed concurrently */
+#define R5L_REPLAY_DEPTH	64
+
+struct r5l_record {
+	struct list_head	list;
+	struct r5l_log		*log;
+	struct bio		*orig;		/* not yet completed write */
+	struct bio		*bio;		/* copy, to the array */
+	struct page		*hdr;
+	u64			seq;
+	sector_t		position;	/* of the header in the journal */
+	sector_t		sector;		/* of the data in the array */
+	unsigned int		sectors;
+	atomic_t		log_ios;
+	int			error;
+	bool			logged;
+	int			nr_pages;
+	struct page		*pages[0];
+};
+
+struct r5l_log {
+	struct r5conf		*conf;
+	struct block_device	*bdev;
+	sector_t		size;		/* in sectors */
+	u32			uuid_csum;	/* checksum seed */
+
+	spinlock_t		lock;
+	u64			seq;		/* of the next record */
+	sector_t		head;		/* where it goes */
+	sector_t		tail;		/* checkpoint on disk */
+	u64			tail_seq;
+	struct list_head	logging;	/* in flight to the journal */
+	struct list_head	pending;	/* completed, not yet destaged */
+	struct list_head	destaging;	/* in flight to the array */
+	sector_t		pending_sectors; /* held by all three */
+	bool			replaying;
+	bool			draining;
+	bool			failed;		/* journal write error */
+
+	struct page		*sb_page;
+	struct block_device	*md_bdev;	/* for replayed bios */
+	atomic_t		replay_ios;
+
+	wait_queue_head_t	wait;
+	struct workqueue_struct	*wq;
+	struct delayed_work	destage_work;
+	struct work_struct	reclaim_work;
+	struct work_struct	recover_work;
+};
+
+static void r5l_destage_endio(struct bio *bio, int error);
+static void r5l_replay_endio(struct bio *bio, int error);
+
+static sector_t r5l_capacity(struct r5l_log *log)
+{
+	return log->size - R5L_LOG_START;
+}
+
+static sector_t r5l_ring_distance(struct r5l_log *log, sector_t from,
+				  sector_t to)
+{
+	if (to >= from)
+		return to - from;
+	return log->size - from + to - R5L_LOG_START;
+}
+
+static sector_t r5l_record_size(unsigned int sectors)
+{
+	return R5L_BLOCK_SECTORS + round_up(sectors, R5L_BLOCK_SECTORS);
+}
+
+/* bytes of data in page @i of @rec */
+static unsigned int r5l_page_len(struct r5l_record *rec, int i)
+{
+	return min_t(unsigned int, PAGE_SIZE,
+		     (rec->sectors << 9) - i * PAGE_SIZE);
+}
+
+static void r5l_free_record(struct r5l_record *rec)
+{
+	int i;
+
+	if (rec->bio)
+		bio_put(rec->bio);
+	for (i = 0; i < rec->nr_pages; i++)
+		if (rec->pages[i])
+			__free_page(rec->pages[i]);
+	if (rec->hdr)
+		__free_page(rec->hdr);
+	kfree(rec);
+}
+
+static struct r5l_record *r5l_alloc_record(struct r5l_log *log,
+					   sector_t sector,
+					   unsigned int sectors)
+{
+	int nr_pages = DIV_ROUND_UP(sectors, PAGE_SIZE >> 9);
+	struct r5l_record *rec;
+	struct bio *bio;
+	int i;
+
+	rec = kzalloc(sizeof(*rec) + nr_pages * sizeof(struct page *),
+		      GFP_NOIO);
+	if (!rec)
+		return NULL;
+	rec->log = log;
+	rec->sector = sector;
+	rec->sectors = sectors;
+	rec->nr_pages = nr_pages;
+
+	rec->hdr = alloc_page(GFP_NOIO);
+	if (!rec->hdr)
+		goto fail;
+	for (i = 0; i < nr_pages; i++) {
+		rec->pages[i] = alloc_page(GFP_NOIO);
+		if (!rec->pages[i])
+			goto fail;
+	}
+
+	/* the array takes the pages as they are, whatever its limits */
+	bio = bio_kmalloc(GFP_NOIO, nr_pages);
+	if (!bio)
+		goto fail;
+	for (i = 0; i < nr_pages; i++) {
+		bio->bi_io_vec[i].bv_page = rec->pages[i];
+		bio->bi_io_vec[i].bv_len = r5l_page_len(rec, i);
+		bio->bi_io_vec[i].bv_offset = 0;
+	}
+	bio->bi_vcnt = nr_pages;
+	bio->bi_iter.bi_size = sectors << 9;
+	bio->bi_iter.bi_sector = sector;
+	bio->bi_rw = WRITE;
+	bio->bi_private = rec;
+	rec->bio = bio;
+	return rec;
+fail:
+	r5l_free_record(rec);
+	return NULL;
+}
+
+static u32 r5l_data_checksum(struct r5l_log *log, struct r5l_record *rec)
+{
+	u32 crc = log->uuid_csum;
+	int i;
+
+	for (i = 0; i < rec->nr_pages; i++)
+		crc = crc32c(crc, page_address(rec->pages[i]),
+			     r5l_page_len(rec, i));
+	return crc;
+}
+
+/* the journal is written in whole blocks: do not leak what follows */
+static void r5l_pad_record(struct r5l_record *rec)
+{
+	unsigned int len = r5l_page_len(rec, rec->nr_pages - 1);
+
+	memset(page_address(rec->pages[rec->nr_pages - 1]) + len, 0,
+	       round_up(len, R5L_BLOCK_SIZE) - len);
+}
+
+static void r5l_copy_bio(struct r5l_record *rec, struct bio *bio)
+{
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int off = 0;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		char *src = kmap_atomic(bvec.bv_page);
+		unsigned int done = 0;
+
+		while (done < bvec.bv_len) {
+			unsigned int n = min_t(unsigned int,
+					       bvec.bv_len - done,
+					       PAGE_SIZE - offset_in_page(off));
+
+			memcpy(page_address(rec->pages[off >> PAGE_SHIFT]) +
+			       offset_in_page(off),
+			       src + bvec.bv_offset + done, n);
+			done += n;
+			off += n;
+		}
+		kunmap_atomic(src);
+	}
+}
+
+static void r5l_fill_header(struct r5l_log *log, struct r5l_record *rec,
+			    u32 data_csum)
+{
+	struct r5l_record_header *hdr = page_address(rec->hdr);
+
+	memset(hdr, 0, R5L_BLOCK_SIZE);
+	hdr->magic = cpu_to_le32(R5L_RECORD_MAGIC);
+	hdr->version = cpu_to_le32(R5L_VERSION);
+	hdr->data_checksum = cpu_to_le32(data_csum);
+	hdr->seq = cpu_to_le64(rec->seq);
+	hdr->position = cpu_to_le64(rec->position);
+	hdr->location = cpu_to_le64(rec->sector);
+	hdr->size = cpu_to_le32(rec->sectors);
+	hdr->checksum = cpu_to_le32(crc32c(log->uuid_csum, hdr,
+					   R5L_BLOCK_SIZE));
+}
+
+static int r5l_sync_io(struct r5l_log *log, sector_t sector,
+		       struct page *page, unsigned int len, int rw)
+{
+	struct bio *bio = bio_alloc_mddev(GFP_NOIO, 1, log->conf->mddev);
+	int ret;
+
+	bio->bi_bdev = log->bdev;
+	bio->bi_iter.bi_sector = sector;
+	bio_add_page(bio, page, len, 0);
+	ret = submit_bio_wait(rw, bio);
+	bio_put(bio);
+	return ret;
+}
+
+static int r5l_write_super(struct r5l_log *log, sector_t checkpoint,
+			   u64 seq)
+{
+	struct r5l_super *sb = page_address(log->sb_page);
+
+	memset(sb, 0, R5L_BLOCK_SIZE);
+	sb->magic = cpu_to_le32(R5L_SUPER_MAGIC);
+	sb->version = cpu_to_le32(R5L_VERSION);
+	memcpy(sb->set_uuid, log->conf->mddev->uuid, sizeof(sb->set_uuid));
+	sb->log_size = cpu_to_le64(log->size);
+	sb->checkpoint = cpu_to_le64(checkpoint);
+	sb->seq = cpu_to_le64(seq);
+	sb->checksum = cpu_to_le32(crc32c(log->uuid_csum, sb,
+					  R5L_BLOCK_SIZE));
+	return r5l_sync_io(log, 0, log->sb_page, R5L_BLOCK_SIZE, WRITE_FUA);
+}
+
+/* The oldest record that may not be on the array yet, or the head */
+static void r5l_checkpoint(struct r5l_log *log, sector_t *pos, u64 *seq)
+{
+	struct r5l_record *rec = NULL;
+
+	if (!list_empty(&log->destaging))
+		rec = list_first_entry(&log->destaging, struct r5l_record,
+				       list);
+	else if (!list_empty(&log->pending))
+		rec = list_first_entry(&log->pending, struct r5l_record, list);
+	else if (!list_empty(&log->logging))
+		rec = list_first_entry(&log->logging, struct r5l_record, list);
+
+	if (rec) {
+		*pos = rec->position;
+		*seq = rec->seq;
+	} else {
+		*pos = log->head;
+		*seq = log->seq;
+	}
+}
+
+static bool __r5l_has_room(struct r5l_log *log, sector_t size,
+			   unsigned int sectors, sector_t *wasted)
+{
+	sector_t head = log->head;
+
+	if (log->pending_sectors &&
+	    log->pending_sectors + sectors > R5L_MAX_PENDING)
+		return false;
+	/* a record that would cross the end starts over at the beginning */
+	*wasted = head + size > log->size ? log->size - head : 0;
+	return r5l_ring_distance(log, log->tail, head) + *wasted + size <
+		r5l_capacity(log);
+}
+
+static bool r5l_has_room(struct r5l_log *log, sector_t size,
+			 unsigned int sectors)
+{
+	sector_t wasted;
+	bool ret;
+
+	spin_lock_irq(&log->lock);
+	ret = __r5l_has_room(log, size, sectors, &wasted) || log->failed;
+	spin_unlock_irq(&log->lock);
+	return ret;
+}
+
+static void r5l_schedule_destage(struct r5l_log *log)
+{
+	if (log->draining || log->pending_sectors >= R5L_MAX_PENDING / 2)
+		mod_delayed_work(log->wq, &log->destage_work, 0);
+	else
+		queue_delayed_work(log->wq, &log->destage_work,
+				   R5L_DESTAGE_DELAY);
+}
+
+/*
+ * Journal writes complete in any order, but a write may only be completed
+ * once all the records before it are durable too: recovery stops at the
+ * first record that is missing.
+ */
+static void r5l_record_logged(struct r5l_record *rec)
+{
+	struct r5l_log *log = rec->log;
+	struct bio_list done;
+	struct bio *bio;
+	unsigned long flags;
+	bool moved = false;
+
+	bio_list_init(&done);
+	spin_lock_irqsave(&log->lock, flags);
+	rec->logged = true;
+	while (!list_empty(&log->logging)) {
+		rec = list_first_entry(&log->logging, struct r5l_record, list);
+		if (!rec->logged)
+			break;
+		if (rec->error && !log->failed) {
+			log->failed = true;
+			printk(KERN_ERR "md/raid:%s: journal write error, "
+			       "writes go to the array directly\n",
+			       mdname(log->conf->mddev));
+		}
+		/* after a failure, writes complete once on the array */
+		if (!log->failed) {
+			bio_list_add(&done, rec->orig);
+			rec->orig = NULL;
+		}
+		list_move_tail(&rec->list, &log->pending);
+		moved = true;
+	}
+	if (moved)
+		r5l_schedule_destage(log);
+	spin_unlock_irqrestore(&log->lock, flags);
+
+	while ((bio = bio_list_pop(&done)))
+		bio_endio(bio, 0);
+	wake_up(&log->wait);
+}
+
+static void r5l_log_endio(struct bio *bio, int error)
+{
+	struct r5l_record *rec = bio->bi_private;
+
+	if (error)
+		rec->error = error;
+	bio_put(bio);
+	if (atomic_dec_and_test(&rec->log_ios))
+		r5l_record_logged(rec);
+}
+
+static struct bio *r5l_alloc_log_bio(struct r5l_log *log,
+				     struct r5l_record *rec,
+				     sector_t sector, int nr_pages)
+{
+	struct bio *bio = bio_alloc_mddev(GFP_NOIO, nr_pages,
+					  log->conf->mddev);
+
+	bio->bi_bdev = log->bdev;
+	bio->bi_iter.bi_sector = sector;
+	bio->bi_end_io = r5l_log_endio;
+	bio->bi_private = rec;
+	return bio;
+}
+
+/* The header and data, split into as many bios as the device wants */
+static void r5l_write_record(struct r5l_log *log, struct r5l_record *rec)
+{
+	struct bio *bio = NULL;
+	sector_t sector = rec->position;
+	int i;
+
+	atomic_set(&rec->log_ios, 1);
+	for (i = -1; i < rec->nr_pages; i++) {
+		struct page *page = i < 0 ? rec->hdr : rec->pages[i];
+		unsigned int len = i < 0 ? R5L_BLOCK_SIZE :
+			round_up(r5l_page_len(rec, i), R5L_BLOCK_SIZE);
+
+		if (bio && bio_add_page(bio, page, len, 0))
+			continue;
+		if (bio) {
+			sector += bio_sectors(bio);
+			atomic_inc(&rec->log_ios);
+			submit_bio(WRITE_FUA, bio);
+		}
+		bio = r5l_alloc_log_bio(log, rec, sector, rec->nr_pages - i);
+		bio_add_page(bio, page, len, 0);
+	}
+	submit_bio(WRITE_FUA, bio);
+}
+
+static bool r5l_log_bio(struct r5l_log *log, struct bio *bio)
+{
+	unsigned int sectors = bio_sectors(bio);
+	sector_t size = r5l_record_size(sectors);
+	struct r5l_record *rec;
+	sector_t wasted;
+	u32 data_csum;
+
+	rec = r5l_alloc_record(log, bio->bi_iter.bi_sector, sectors);
+	if (!rec)
+		return false;
+	rec->orig = bio;
+	rec->bio->bi_bdev = bio->bi_bdev;
+	rec->bio->bi_end_io = r5l_destage_endio;
+	r5l_copy_bio(rec, bio);
+	r5l_pad_record(rec);
+	data_csum = r5l_data_checksum(log, rec);
+
+	spin_lock_irq(&log->lock);
+	while (!log->failed && !__r5l_has_room(log, size, sectors, &wasted)) {
+		spin_unlock_irq(&log->lock);
+		mod_delayed_work(log->wq, &log->destage_work, 0);
+		queue_work(log->wq, &log->reclaim_work);
+		wait_event(log->wait, r5l_has_room(log, size, sectors));
+		spin_lock_irq(&log->lock);
+	}
+	if (log->failed) {
+		spin_unlock_irq(&log->lock);
+		rec->orig = NULL;
+		r5l_free_record(rec);
+		return false;
+	}
+	if (wasted)
+		log->head = R5L_LOG_START;
+	rec->position = log->head;
+	rec->seq = log->seq++;
+	log->head += size;
+	if (log->head == log->size)
+		log->head = R5L_LOG_START;
+	log->pending_sectors += sectors;
+	list_add_tail(&rec->list, &log->logging);
+	spin_unlock_irq(&log->lock);
+
+	r5l_fill_header(log, rec, data_csum);
+	r5l_write_record(log, rec);
+	return true;
+}
+
+static bool r5l_overlaps(struct r5l_log *log, sector_t start, sector_t end)
+{
+	struct list_head *lists[] = {
+		&log->logging, &log->pending, &log->destaging,
+	};
+	struct r5l_record *rec;
+	bool ret = false;
+	int i;
+
+	spin_lock_irq(&log->lock);
+	for (i = 0; i < ARRAY_SIZE(lists) && !ret; i++)
+		list_for_each_entry(rec, lists[i], list)
+			if (rec->sector < end &&
+			    rec->sector + rec->sectors > start) {
+				ret = true;
+				break;
+			}
+	spin_unlock_irq(&log->lock);
+	return ret;
+}
+
+/* Anything not journaled must not pass the journaled writes it overlaps */
+static void r5l_wait_overlap(struct r5l_log *log, struct bio *bio)
+{
+	sector_t start = bio->bi_iter.bi_sector;
+	sector_t end = bio_end_sector(bio);
+
+	if (!r5l_overlaps(log, start, end))
+		return;
+	mod_delayed_work(log->wq, &log->destage_work, 0);
+	wait_event(log->wait, !r5l_overlaps(log, start, end));
+}
+
+/*
+ * Called by make_request for every bio after md_write_start().  Returns
+ * true when the journal took @bio over; it is then completed once it is
+ * in the journal, and its md_write_end() comes when it is on the array.
+ */
+bool r5l_handle_bio(struct r5l_log *log, struct bio *bio)
+{
+	if (bio->bi_end_io == r5l_destage_endio ||
+	    bio->bi_end_io == r5l_replay_endio)
+		return false;
+
+	wait_event(log->wait, !ACCESS_ONCE(log->replaying));
+
+	if (bio_data_dir(bio) == WRITE && !(bio->bi_rw & REQ_DISCARD) &&
+	    bio_sectors(bio) && bio_sectors(bio) <= R5L_MAX_SECTORS &&
+	    !ACCESS_ONCE(log->failed) && r5l_log_bio(log, bio))
+		return true;
+
+	r5l_wait_overlap(log, bio);
+	return false;
+}
+
+static void r5l_destage_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(to_delayed_work(work),
+					   struct r5l_log, destage_work);
+	struct mddev *mddev = log->conf->mddev;
+	struct r5l_record *rec;
+	struct blk_plug plug;
+	struct bio_list bios;
+	struct bio *bio;
+
+	bio_list_init(&bios);
+	spin_lock_irq(&log->lock);
+	while (!list_empty(&log->pending)) {
+		rec = list_first_entry(&log->pending, struct r5l_record, list);
+		list_move_tail(&rec->list, &log->destaging);
+		bio_list_add(&bios, rec->bio);
+	}
+	spin_unlock_irq(&log->lock);
+
+	/* the whole batch reaches the stripe cache before any stripe runs */
+	blk_start_plug(&plug);
+	while ((bio = bio_list_pop(&bios)))
+		mddev->pers->make_request(mddev, bio);
+	blk_finish_plug(&plug);
+}
+
+static void r5l_destage_endio(struct bio *bio, int error)
+{
+	struct r5l_record *rec = bio->bi_private;
+	struct r5l_log *log = rec->log;
+	struct mddev *mddev = log->conf->mddev;
+	unsigned long flags;
+	sector_t pos;
+	u64 seq;
+	bool reclaim;
+
+	spin_lock_irqsave(&log->lock, flags);
+	list_del(&rec->list);
+	log->pending_sectors -= rec->sectors;
+	r5l_checkpoint(log, &pos, &seq);
+	reclaim = r5l_ring_distance(log, log->tail, pos) >
+		r5l_capacity(log) / 4;
+	spin_unlock_irqrestore(&log->lock, flags);
+
+	if (rec->orig)
+		bio_endio(rec->orig, error);
+	md_write_end(mddev);
+	r5l_free_record(rec);
+
+	if (reclaim)
+		queue_work(log->wq, &log->reclaim_work);
+	wake_up(&log->wait);
+}
+
+/* what is on the array must be on stable media before the log forgets it */
+static void r5l_flush_array(struct r5l_log *log)
+{
+	struct r5conf *conf = log->conf;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < 2 * conf->raid_disks; i++) {
+		struct md_rdev *rdev;
+
+		if (i & 1)
+			rdev = rcu_dereference(conf->disks[i / 2].replacement);
+		else
+			rdev = rcu_dereference(conf->disks[i / 2].rdev);
+		if (!rdev || test_bit(Faulty, &rdev->flags))
+			continue;
+		atomic_inc(&rdev->nr_pending);
+		rcu_read_unlock();
+		blkdev_issue_flush(rdev->bdev, GFP_NOIO, NULL);
+		rdev_dec_pending(rdev, conf->mddev);
+		rcu_read_lock();
+	}
+	rcu_read_unlock();
+}
+
+static void r5l_reclaim_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(work, struct r5l_log,
+					   reclaim_work);
+	sector_t pos;
+	u64 seq;
+
+	spin_lock_irq(&log->lock);
+	r5l_checkpoint(log, &pos, &seq);
+	spin_unlock_irq(&log->lock);
+	if (pos == log->tail)
+		return;
+
+	r5l_flush_array(log);
+	if (r5l_write_super(log, pos, seq)) {
+		printk(KERN_ERR "md/raid:%s: cannot update journal checkpoint\n",
+		       mdname(log->conf->mddev));
+		spin_lock_irq(&log->lock);
+		log->failed = true;
+		spin_unlock_irq(&log->lock);
+	} else {
+		spin_lock_irq(&log->lock);
+		log->tail = pos;
+		log->tail_seq = seq;
+		spin_unlock_irq(&log->lock);
+	}
+	wake_up(&log->wait);
+}
+
+static bool r5l_idle(struct r5l_log *log)
+{
+	bool ret;
+
+	spin_lock_irq(&log->lock);
+	ret = !log->replaying && list_empty(&log->logging) &&
+		list_empty(&log->pending) && list_empty(&log->destaging);
+	spin_unlock_irq(&log->lock);
+	return ret;
+}
+
+/*
+ * Called from raid5_quiesce(): writes everything in the journal to the
+ * array and moves the checkpoint to the head, so that a stopped array
+ * needs no replay.
+ */
+void r5l_quiesce(struct r5l_log *log)
+{
+	log->draining = true;
+	mod_delayed_work(log->wq, &log->destage_work, 0);
+	wait_event(log->wait, r5l_idle(log));
+	log->draining = false;
+	queue_work(log->wq, &log->reclaim_work);
+	flush_work(&log->reclaim_work);
+}
+
+bool r5l_replaying(struct r5l_log *log)
+{
+	return ACCESS_ONCE(log->replaying);
+}
+
+static bool r5l_valid_header(struct r5l_log *log,
+			     struct r5l_record_header *hdr,
+			     sector_t pos, u64 seq)
+{
+	u32 csum = le32_to_cpu(hdr->checksum);
+	sector_t location = le64_to_cpu(hdr->location);
+	unsigned int sectors = le32_to_cpu(hdr->size);
+
+	if (le32_to_cpu(hdr->magic) != R5L_RECORD_MAGIC ||
+	    le32_to_cpu(hdr->version) != R5L_VERSION ||
+	    le64_to_cpu(hdr->seq) != seq ||
+	    le64_to_cpu(hdr->position) != pos)
+		return false;
+	hdr->checksum = 0;
+	if (crc32c(log->uuid_csum, hdr, R5L_BLOCK_SIZE) != csum)
+		return false;
+	return sectors && sectors <= R5L_MAX_SECTORS &&
+		pos + r5l_record_size(sectors) <= log->size &&
+		location + sectors <= log->conf->mddev->array_sectors;
+}
+
+/* Reads the record at *pos, or at the start if it wrapped, NULL at the end */
+static struct r5l_record *r5l_read_record(struct r5l_log *log,
+					  struct page *page,
+					  sector_t *pos, u64 seq)
+{
+	struct r5l_record_header *hdr = page_address(page);
+	struct r5l_record *rec;
+	sector_t sector;
+	int i;
+
+	if (r5l_sync_io(log, *pos, page, R5L_BLOCK_SIZE, READ) ||
+	    !r5l_valid_header(log, hdr, *pos, seq)) {
+		if (*pos == R5L_LOG_START)
+			return NULL;
+		*pos = R5L_LOG_START;
+		if (r5l_sync_io(log, *pos, page, R5L_BLOCK_SIZE, READ) ||
+		    !r5l_valid_header(log, hdr, *pos, seq))
+			return NULL;
+	}
+
+	rec = r5l_alloc_record(log, le64_to_cpu(hdr->location),
+			       le32_to_cpu(hdr->size));
+	if (!rec)
+		return NULL;
+	rec->seq = seq;
+	rec->position = *pos;
+	sector = *pos + R5L_BLOCK_SECTORS;
+	for (i = 0; i < rec->nr_pages; i++) {
+		unsigned int len = round_up(r5l_page_len(rec, i),
+					    R5L_BLOCK_SIZE);
+
+		if (r5l_sync_io(log, sector, rec->pages[i], len, READ))
+			goto fail;
+		sector += len >> 9;
+	}
+	if (r5l_data_checksum(log, rec) != le32_to_cpu(hdr->data_checksum))
+		goto fail;
+	return rec;
+fail:
+	r5l_free_record(rec);
+	return NULL;
+}
+
+static void r5l_replay_endio(struct bio *bio, int error)
+{
+	struct r5l_record *rec = bio->bi_private;
+	struct r5l_log *log = rec->log;
+
+	r5l_free_record(rec);
+	atomic_dec(&log->replay_ios);
+	wake_up(&log->wait);
+}
+
+/*
+ * Runs from the log workqueue, never under reconfig_mutex: replayed writes
+ * go through md_write_start(), which may wait for a superblock update.
+ * Stripe handling uses reconstruct-write while log->replaying is set.
+ */
+static void r5l_recover_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(work, struct r5l_log,
+					   recover_work);
+	struct mddev *mddev = log->conf->mddev;
+	struct r5l_record *rec;
+	struct page *page;
+	sector_t pos = log->tail;
+	u64 seq = log->tail_seq;
+	int count = 0;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		goto out;
+	while ((rec = r5l_read_record(log, page, &pos, seq))) {
+		wait_event(log->wait, atomic_read(&log->replay_ios) <
+			   R5L_REPLAY_DEPTH);
+		pos += r5l_record_size(rec->sectors);
+		if (pos == log->size)
+			pos = R5L_LOG_START;
+		seq++;
+		count++;
+		rec->bio->bi_bdev = log->md_bdev;
+		rec->bio->bi_end_io = r5l_replay_endio;
+		atomic_inc(&log->replay_ios);
+		mddev->pers->make_request(mddev, rec->bio);
+	}
+	__free_page(page);
+	wait_event(log->wait, !atomic_read(&log->replay_ios));
+
+	if (count) {
+		printk(KERN_INFO "md/raid:%s: replayed %d journal records\n",
+		       mdname(mddev), count);
+		r5l_flush_array(log);
+	}
+	/* new records start after the last good one */
+	log->head = pos;
+	log->seq = seq;
+	if (!r5l_write_super(log, pos, seq)) {
+		log->tail = pos;
+		log->tail_seq = seq;
+	} else {
+		log->failed = true;
+	}
+out:
+	if (!page)
+		log->failed = true;
+	bdput(log->md_bdev);
+	log->md_bdev = NULL;
+	spin_lock_irq(&log->lock);
+	log->replaying = false;
+	spin_unlock_irq(&log->lock);
+	wake_up(&log->wait);
+}
+
+/* Returns true if the superblock describes an earlier journal of this array */
+static bool r5l_load_super(struct r5l_log *log)
+{
+	struct r5l_super *sb = page_address(log->sb_page);
+	u32 csum;
+
+	if (r5l_sync_io(log, 0, log->sb_page, R5L_BLOCK_SIZE, READ))
+		return false;
+	csum = le32_to_cpu(sb->checksum);
+	sb->checksum = 0;
+	if (le32_to_cpu(sb->magic) != R5L_SUPER_MAGIC ||
+	    le32_to_cpu(sb->version) != R5L_VERSION ||
+	    crc32c(log->uuid_csum, sb, R5L_BLOCK_SIZE) != csum ||
+	    memcmp(sb->set_uuid, log->conf->mddev->uuid,
+		   sizeof(sb->set_uuid)) ||
+	    le64_to_cpu(sb->log_size) != log->size)
+		return false;
+
+	log->tail = le64_to_cpu(sb->checkpoint);
+	log->tail_seq = le64_to_cpu(sb->seq);
+	return log->tail >= R5L_LOG_START && log->tail < log->size;
+}
+
+/*
+ * Attaches the journal on @dev, replaying what it holds if it was used by
+ * this array before and formatting it otherwise.  Called with
+ * reconfig_mutex held.
+ */
+int r5l_init_log(struct r5conf *conf, dev_t dev)
+{
+	struct mddev *mddev = conf->mddev;
+	struct r5l_log *log;
+	char b[BDEVNAME_SIZE];
+	bool replay;
+	int ret = -ENOMEM;
+
+	log = kzalloc(sizeof(*log), GFP_KERNEL);
+	if (!log)
+		return -ENOMEM;
+	log->conf = conf;
+	spin_lock_init(&log->lock);
+	INIT_LIST_HEAD(&log->logging);
+	INIT_LIST_HEAD(&log->pending);
+	INIT_LIST_HEAD(&log->destaging);
+	init_waitqueue_head(&log->wait);
+	atomic_set(&log->replay_ios, 0);
+	INIT_DELAYED_WORK(&log->destage_work, r5l_destage_work);
+	INIT_WORK(&log->reclaim_work, r5l_reclaim_work);
+	INIT_WORK(&log->recover_work, r5l_recover_work);
+	log->uuid_csum = crc32c(~0, mddev->uuid, sizeof(mddev->uuid));
+
+	log->sb_page = alloc_page(GFP_KERNEL);
+	if (!log->sb_page)
+		goto out_free;
+
+	log->bdev = blkdev_get_by_dev(dev, FMODE_READ | FMODE_WRITE |
+				      FMODE_EXCL, log);
+	if (IS_ERR(log->bdev)) {
+		ret = PTR_ERR(log->bdev);
+		goto out_free;
+	}
+	log->size = round_down(i_size_read(log->bdev->bd_inode) >> 9,
+			       R5L_BLOCK_SECTORS);
+	/* room for a largest record, even when it has to wrap */
+	ret = -ENOSPC;
+	if (log->size < R5L_LOG_START + 3 * r5l_record_size(R5L_MAX_SECTORS))
+		goto out_put;
+
+	ret = -ENOMEM;
+	log->wq = alloc_workqueue("r5l_%s", WQ_MEM_RECLAIM | WQ_UNBOUND, 0,
+				  mdname(mddev));
+	if (!log->wq)
+		goto out_put;
+
+	replay = r5l_load_super(log);
+	if (replay) {
+		log->md_bdev = bdget_disk(mddev->gendisk, 0);
+		if (!log->md_bdev)
+			goto out_wq;
+	} else {
+		get_random_bytes(&log->tail_seq, sizeof(log->tail_seq));
+		log->tail = R5L_LOG_START;
+		ret = r5l_write_super(log, log->tail, log->tail_seq);
+		if (ret)
+			goto out_wq;
+	}
+	log->head = log->tail;
+	log->seq = log->tail_seq;
+	log->replaying = replay;
+
+	mddev_suspend(mddev);
+	conf->log = log;
+	mddev_resume(mddev);
+
+	if (replay)
+		queue_work(log->wq, &log->recover_work);
+	printk(KERN_INFO "md/raid:%s: journal on %s, %llu sectors\n",
+	       mdname(mddev), bdevname(log->bdev, b),
+	       (unsigned long long)log->size);
+	return 0;
+
+out_wq:
+	destroy_workqueue(log->wq);
+out_put:
+	blkdev_put(log->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_free:
+	if (log->sb_page)
+		__free_page(log->sb_page);
+	kfree(log);
+	return ret;
+}
+
+/*
+ * Releases a journal that is no longer reachable from make_request.
+ * Records that did not reach the array stay in the journal, to be
+ * replayed at the next attach.
+ */
+void r5l_exit_log(struct r5l_log *log)
+{
+	struct list_head *lists[] = {
+		&log->logging, &log->pending, &log->destaging,
+	};
+	struct r5l_record *rec, *next;
+	int i;
+
+	flush_work(&log->recover_work);
+	cancel_delayed_work_sync(&log->destage_work);
+	flush_workqueue(log->wq);
+	destroy_workqueue(log->wq);
+
+	for (i = 0; i < ARRAY_SIZE(lists); i++)
+		list_for_each_entry_safe(rec, next, lists[i], list) {
+			list_del(&rec->list);
+			r5l_free_record(rec);
+		}
+
+	blkdev_put(log->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	__free_page(log->sb_page);
+	kfree(log);
+}
+
+int r5l_show_journal(struct r5l_log *log, char *page)
+{
+	char b[BDEVNAME_SIZE];
+
+	return sprintf(page, "%s\n", bdevname(log->bdev, b));
+}
@@ -3097,9 +3097,12 @@ static void handle_stripe_dirtying(struct r5conf *conf,
 	 * In this case, we need to always do reconstruct-write, to ensure
 	 * that in case of drive failure or read-error correction, we
 	 * generate correct data from the parity.
+	 * Journal replay does the same: the parity of the replayed stripes
+	 * is not to be trusted either.
 	 */
 	if (conf->max_degraded == 2 ||
-	    (recovery_cp < MaxSector && sh->sector >= recovery_cp)) {
+	    (recovery_cp < MaxSector && sh->sector >= recovery_cp) ||
+	    (conf->log && r5l_replaying(conf->log))) {
 		/* Calculate the real rcw later - for now make it
 		 * look like rcw is cheaper
 		 */
@@ -4589,6 +4592,9 @@ static void make_request(struct mddev *mddev, struct bio * bi)
 
 	md_write_start(mddev, bi);
 
+	if (conf->log && r5l_handle_bio(conf->log, bi))
+		return;
+
 	if (rw == READ &&
 	     mddev->reshape_position == MaxSector &&
 	     chunk_aligned_read(mddev,bi))
@@ -5510,12 +5516,68 @@ raid5_group_thread_cnt = __ATTR(group_thread_cnt, S_IRUGO | S_IWUSR,
 				raid5_show_group_thread_cnt,
 				raid5_store_group_thread_cnt);
 
+static ssize_t
+raid5_show_journal(struct mddev *mddev, char *page)
+{
+	struct r5conf *conf = mddev->private;
+
+	if (!conf)
+		return 0;
+	if (!conf->log)
+		return sprintf(page, "none\n");
+	return r5l_show_journal(conf->log, page);
+}
+
+/* "major:minor" attaches a journal device, "none" detaches it */
+static ssize_t
+raid5_store_journal(struct mddev *mddev, const char *page, size_t len)
+{
+	struct r5conf *conf = mddev->private;
+	struct r5l_log *log;
+	unsigned int major, minor;
+	int err;
+
+	if (len >= PAGE_SIZE)
+		return -EINVAL;
+	if (!conf)
+		return -ENODEV;
+
+	if (sysfs_streq(page, "none")) {
+		log = conf->log;
+		if (!log)
+			return len;
+		/* suspending drains the journal through raid5_quiesce */
+		mddev_suspend(mddev);
+		conf->log = NULL;
+		mddev_resume(mddev);
+		r5l_exit_log(log);
+		return len;
+	}
+
+	if (sscanf(page, "%u:%u", &major, &minor) != 2)
+		return -EINVAL;
+	if (conf->log)
+		return -EBUSY;
+	if (mddev->ro == 1)
+		return -EROFS;
+	err = r5l_init_log(conf, MKDEV(major, minor));
+	if (err)
+		return err;
+	return len;
+}
+
+static struct md_sysfs_entry
+raid5_journal = __ATTR(journal, S_IRUGO | S_IWUSR,
+		       raid5_show_journal,
+		       raid5_store_journal);
+
 static struct attribute *raid5_attrs[] =  {
 	&raid5_stripecache_size.attr,
 	&raid5_stripecache_active.attr,
 	&raid5_preread_bypass_threshold.attr,
 	&raid5_group_thread_cnt.attr,
 	&raid5_skip_copy.attr,
+	&raid5_journal.attr,
 	NULL,
 };
 static struct attribute_group raid5_attrs_group = {
@@ -5638,6 +5700,8 @@ static void raid5_free_percpu(struct r5conf *conf)
 
 static void free_conf(struct r5conf *conf)
 {
+	if (conf->log)
+		r5l_exit_log(conf->log);
 	free_thread_groups(conf);
 	shrink_stripes(conf);
 	raid5_free_percpu(conf);
@@ -6769,6 +6833,9 @@ static void raid5_quiesce(struct mddev *mddev, int state)
 		break;
 
 	case 1: /* stop all writes */
+		/* what the journal holds must reach the stripes first */
+		if (conf->log)
+			r5l_quiesce(conf->log);
 		lock_all_device_hash_locks_irq(conf);
 		/* '2' tells resync/reshape to pause so that all
 		 * active stripes can drain
@@ -390,6 +390,8 @@ struct r5worker_group {
 	int stripes_cnt;
 };
 
+struct r5l_log;
+
 struct r5conf {
 	struct hlist_head	*stripe_hashtbl;
 	/* only protect corresponding hash list and inactive_list */
@@ -495,6 +497,8 @@ struct r5conf {
 	struct r5worker_group	*worker_groups;
 	int			group_cnt;
 	int			worker_cnt_per_group;
+
+	struct r5l_log		*log;		/* write journal, if any */
 };
 
 /*
@@ -561,4 +565,12 @@ static inline int algorithm_is_DDF(int layout)
 extern int md_raid5_congested(struct mddev *mddev, int bits);
 extern void md_raid5_kick_device(struct r5conf *conf);
 extern int raid5_set_cache_size(struct mddev *mddev, int size);
+
+/* raid5-cache.c */
+extern int r5l_init_log(struct r5conf *conf, dev_t dev);
+extern void r5l_exit_log(struct r5l_log *log);
+extern bool r5l_handle_bio(struct r5l_log *log, struct bio *bio);
+extern void r5l_quiesce(struct r5l_log *log);
+extern bool r5l_replaying(struct r5l_log *log);
+extern int r5l_show_journal(struct r5l_log *log, char *page);
 #endif
@@ -1555,7 +1555,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 		unblock_netpoll_tx();
 	}
 
-	if (bond_mode_uses_xmit_hash(bond))
+	if (bond_mode_uses_slave_arr(bond))
 		bond_update_slave_arr(bond, NULL);
 
 	netdev_info(bond_dev, "Enslaving %s as %s interface with %s link\n",
@@ -1675,7 +1675,7 @@ static int __bond_release_one(struct net_device *bond_dev,
 	if (BOND_MODE(bond) == BOND_MODE_8023AD)
 		bond_3ad_unbind_slave(slave);
 
-	if (bond_mode_uses_xmit_hash(bond))
+	if (bond_mode_uses_slave_arr(bond))
 		bond_update_slave_arr(bond, slave);
 
 	netdev_info(bond_dev, "Releasing %s interface %s\n",
@@ -1980,7 +1980,8 @@ static void bond_miimon_commit(struct bonding *bond)
 				bond_alb_handle_link_change(bond, slave,
 							    BOND_LINK_UP);
 
-			if (BOND_MODE(bond) == BOND_MODE_XOR)
+			if (BOND_MODE(bond) == BOND_MODE_XOR ||
+			    BOND_MODE(bond) == BOND_MODE_ROUNDROBIN)
 				bond_update_slave_arr(bond, NULL);
 
 			if (!bond->curr_active_slave || slave == primary)
@@ -2010,7 +2011,8 @@ static void bond_miimon_commit(struct bonding *bond)
 				bond_alb_handle_link_change(bond, slave,
 							    BOND_LINK_DOWN);
 
-			if (BOND_MODE(bond) == BOND_MODE_XOR)
+			if (BOND_MODE(bond) == BOND_MODE_XOR ||
+			    BOND_MODE(bond) == BOND_MODE_ROUNDROBIN)
 				bond_update_slave_arr(bond, NULL);
 
 			if (slave == rcu_access_pointer(bond->curr_active_slave))
@@ -2469,7 +2471,8 @@ static void bond_loadbalance_arp_mon(struct work_struct *work)
 
 		if (slave_state_changed) {
 			bond_slave_state_change(bond);
-			if (BOND_MODE(bond) == BOND_MODE_XOR)
+			if (BOND_MODE(bond) == BOND_MODE_XOR ||
+			    BOND_MODE(bond) == BOND_MODE_ROUNDROBIN)
 				bond_update_slave_arr(bond, NULL);
 		}
 		if (do_failover) {
@@ -2856,11 +2859,11 @@ static int bond_slave_netdev_event(unsigned long event,
 		 * events. If these (miimon/arpmon) parameters are configured
 		 * then array gets refreshed twice and that should be fine!
 		 */
-		if (bond_mode_uses_xmit_hash(bond))
+		if (bond_mode_uses_slave_arr(bond))
 			bond_update_slave_arr(bond, NULL);
 		break;
 	case NETDEV_DOWN:
-		if (bond_mode_uses_xmit_hash(bond))
+		if (bond_mode_uses_slave_arr(bond))
 			bond_update_slave_arr(bond, NULL);
 		break;
 	case NETDEV_CHANGEMTU:
@@ -3101,7 +3104,7 @@ static int bond_open(struct net_device *bond_dev)
 		bond_3ad_initiate_agg_selection(bond, 1);
 	}
 
-	if (bond_mode_uses_xmit_hash(bond))
+	if (bond_mode_uses_slave_arr(bond))
 		bond_update_slave_arr(bond, NULL);
 
 	return 0;
@@ -3579,11 +3582,15 @@ static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev
 		else
 			bond_xmit_slave_id(bond, skb, 0);
 	} else {
-		int slave_cnt = ACCESS_ONCE(bond->slave_cnt);
+		struct bond_up_slave *slaves;
+		unsigned int count;
 
-		if (likely(slave_cnt)) {
+		slaves = rcu_dereference(bond->slave_arr);
+		count = slaves ? ACCESS_ONCE(slaves->count) : 0;
+		if (likely(count)) {
 			slave_id = bond_rr_gen_slave_id(bond);
-			bond_xmit_slave_id(bond, skb, slave_id % slave_cnt);
+			slave = slaves->arr[slave_id % count];
+			bond_dev_queue_xmit(bond, skb, slave->dev);
 		} else {
 			dev_kfree_skb_any(skb);
 		}
@@ -3645,6 +3652,7 @@ err:
  * (a) BOND_MODE_8023AD
  * (b) BOND_MODE_XOR
  * (c) BOND_MODE_TLB && tlb_dynamic_lb == 0
+ * and for BOND_MODE_ROUNDROBIN, which cycles through it.
  *
  * The caller is expected to hold RTNL only and NO other lock!
  */
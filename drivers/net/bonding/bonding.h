@@ -289,6 +289,13 @@ static inline bool bond_mode_uses_xmit_hash(const struct bonding *bond)
 		bond_is_nondyn_tlb(bond));
 }
 
+/* Modes that transmit through the usable slaves array */
+static inline bool bond_mode_uses_slave_arr(const struct bonding *bond)
+{
+	return bond_mode_uses_xmit_hash(bond) ||
+	       BOND_MODE(bond) == BOND_MODE_ROUNDROBIN;
+}
+
 static inline bool bond_mode_uses_arp(int mode)
 {
 	return mode != BOND_MODE_8023AD && mode != BOND_MODE_TLB &&
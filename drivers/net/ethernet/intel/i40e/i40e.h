@@ -199,6 +199,24 @@ struct i40e_fdir_filter {
 	u32 fd_id;
 };
 
+#ifdef CONFIG_RFS_ACCEL
+#define I40E_ARFS_HASH_BITS	8
+#define I40E_ARFS_MAX_FILTERS	1024
+/* rps_may_expire_flow() calls per service task run */
+#define I40E_ARFS_EXPIRY_QUOTA	64
+
+struct i40e_arfs_filter {
+	struct list_head list;
+	struct list_head dirty_list;	/* waiting to be programmed */
+	struct hlist_node hash_node;
+	struct i40e_fdir_filter fd;	/* input set and Rx queue */
+	u32 flow_id;			/* RFS infrastructure id */
+	u16 id;				/* RFS filter id */
+	bool dirty;
+	bool programmed;
+};
+#endif /* CONFIG_RFS_ACCEL */
+
 #define I40E_ETH_P_LLDP			0x88cc
 
 #define I40E_DCB_PRIO_TYPE_STRICT	0
@@ -257,6 +275,13 @@ struct i40e_pf {
 	u32 fd_add_err;
 	u32 fd_atr_cnt;
 	u32 fd_tcp_rule;
+#ifdef CONFIG_RFS_ACCEL
+	spinlock_t arfs_lock;
+	struct list_head arfs_list;
+	struct list_head arfs_dirty;
+	struct hlist_head arfs_hash[1 << I40E_ARFS_HASH_BITS];
+	DECLARE_BITMAP(arfs_ids, I40E_ARFS_MAX_FILTERS);
+#endif
 
 #ifdef CONFIG_I40E_VXLAN
 	__be16  vxlan_ports[I40E_MAX_PF_UDP_OFFLOAD_PORTS];
@@ -447,6 +472,7 @@ struct i40e_vsi {
 	/* These are containers of ring pointers, allocated at run-time */
 	struct i40e_ring **rx_rings;
 	struct i40e_ring **tx_rings;
+	struct bpf_prog __rcu *xdp_prog;	/* XDP program run on rx_rings */
 
 	u16 work_limit;
 	/* high bit set means dynamic, use accessor routines to read/write.
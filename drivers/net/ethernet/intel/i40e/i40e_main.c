@@ -25,6 +25,9 @@
  ******************************************************************************/
 
 /* Local includes */
+#include <linux/bpf.h>
+#include <linux/cpu_rmap.h>
+#include <linux/hash.h>
 #include "i40e.h"
 #include "i40e_diag.h"
 #ifdef CONFIG_I40E_VXLAN
@@ -2939,6 +2942,371 @@ static irqreturn_t i40e_msix_clean_rings(int irq, void *data)
 	return IRQ_HANDLED;
 }
 
+#ifdef CONFIG_RFS_ACCEL
+static struct hlist_head *i40e_arfs_bucket(struct i40e_pf *pf,
+					   const struct i40e_fdir_filter *fd)
+{
+	u32 key = (__force u32)fd->src_ip[0] ^ (__force u32)fd->dst_ip[0] ^
+		  ((__force u32)fd->src_port << 16 | (__force u32)fd->dst_port);
+
+	return &pf->arfs_hash[hash_32(key, I40E_ARFS_HASH_BITS)];
+}
+
+static struct i40e_arfs_filter *
+i40e_arfs_find(struct i40e_pf *pf, const struct i40e_fdir_filter *fd)
+{
+	struct i40e_arfs_filter *f;
+
+	hlist_for_each_entry(f, i40e_arfs_bucket(pf, fd), hash_node) {
+		if (f->fd.flow_type == fd->flow_type &&
+		    f->fd.src_ip[0] == fd->src_ip[0] &&
+		    f->fd.dst_ip[0] == fd->dst_ip[0] &&
+		    f->fd.src_port == fd->src_port &&
+		    f->fd.dst_port == fd->dst_port)
+			return f;
+	}
+
+	return NULL;
+}
+
+/* leave every queue a fair share of the filters */
+static bool i40e_arfs_queue_full(struct i40e_vsi *vsi, u16 rxq)
+{
+	return vsi->rx_rings[rxq]->arfs_filters >=
+	       I40E_ARFS_MAX_FILTERS / vsi->num_queue_pairs;
+}
+
+static void i40e_arfs_mark_dirty(struct i40e_pf *pf,
+				 struct i40e_arfs_filter *f)
+{
+	if (!f->dirty)
+		list_add_tail(&f->dirty_list, &pf->arfs_dirty);
+	f->dirty = true;
+}
+
+/**
+ * i40e_rx_flow_steer - steer a flow to an Rx queue with a sideband filter
+ * @netdev: network interface device structure
+ * @skb: packet of the flow
+ * @rxq_index: Rx queue the flow should go to
+ * @flow_id: RFS flow id
+ *
+ * Returns the filter id for rps_may_expire_flow(), or a negative errno.
+ * The filter itself is programmed by the service task.
+ **/
+static int i40e_rx_flow_steer(struct net_device *netdev,
+			      const struct sk_buff *skb,
+			      u16 rxq_index, u32 flow_id)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+	struct i40e_pf *pf = vsi->back;
+	int nhoff = skb_network_offset(skb);
+	struct i40e_fdir_filter fd;
+	struct i40e_arfs_filter *f;
+	const struct iphdr *ip;
+	const __be16 *ports;
+	int id, ret;
+
+	if (vsi->type != I40E_VSI_MAIN ||
+	    !(pf->flags & I40E_FLAG_FD_SB_ENABLED) ||
+	    (pf->auto_disable_flags & I40E_FLAG_FD_SB_ENABLED))
+		return -EOPNOTSUPP;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return -EPROTONOSUPPORT;
+
+	ip = (const struct iphdr *)(skb->data + nhoff);
+	if (ip_is_fragment(ip))
+		return -EPROTONOSUPPORT;
+
+	memset(&fd, 0, sizeof(fd));
+	switch (ip->protocol) {
+	case IPPROTO_TCP:
+		fd.flow_type = TCP_V4_FLOW;
+		break;
+	case IPPROTO_UDP:
+		fd.flow_type = UDP_V4_FLOW;
+		break;
+	default:
+		return -EPROTONOSUPPORT;
+	}
+	ports = (const __be16 *)(skb->data + nhoff + 4 * ip->ihl);
+
+	/* the hardware wants the Tx view of the flow, see i40e_ethtool.c */
+	fd.dst_ip[0] = ip->saddr;
+	fd.src_ip[0] = ip->daddr;
+	fd.dst_port = ports[0];
+	fd.src_port = ports[1];
+
+	spin_lock_bh(&pf->arfs_lock);
+
+	if (test_bit(__I40E_DOWN, &vsi->state)) {
+		ret = -ENETDOWN;
+		goto out;
+	}
+
+	f = i40e_arfs_find(pf, &fd);
+	if (f) {
+		ret = f->id;
+		if (f->fd.q_index == rxq_index)
+			goto out;
+
+		if (i40e_arfs_queue_full(vsi, rxq_index)) {
+			ret = -EBUSY;
+			goto out;
+		}
+		vsi->rx_rings[f->fd.q_index]->arfs_filters--;
+	} else {
+		if (i40e_arfs_queue_full(vsi, rxq_index)) {
+			ret = -EBUSY;
+			goto out;
+		}
+
+		id = find_first_zero_bit(pf->arfs_ids, I40E_ARFS_MAX_FILTERS);
+		if (id >= I40E_ARFS_MAX_FILTERS) {
+			ret = -EBUSY;
+			goto out;
+		}
+
+		f = kzalloc(sizeof(*f), GFP_ATOMIC);
+		if (!f) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		f->fd = fd;
+		f->fd.dest_vsi = vsi->id;
+		f->fd.dest_ctl =
+			I40E_FILTER_PROGRAM_DESC_DEST_DIRECT_PACKET_QINDEX;
+		f->fd.fd_status = I40E_FILTER_PROGRAM_DESC_FD_STATUS_FD_ID;
+		f->fd.cnt_index = pf->fd_sb_cnt_idx;
+		f->id = id;
+		set_bit(id, pf->arfs_ids);
+		list_add_tail(&f->list, &pf->arfs_list);
+		hlist_add_head(&f->hash_node, i40e_arfs_bucket(pf, &fd));
+		ret = id;
+	}
+
+	f->flow_id = flow_id;
+	f->fd.q_index = rxq_index;
+	vsi->rx_rings[rxq_index]->arfs_filters++;
+	i40e_arfs_mark_dirty(pf, f);
+	spin_unlock_bh(&pf->arfs_lock);
+
+	i40e_service_event_schedule(pf);
+	return ret;
+
+out:
+	spin_unlock_bh(&pf->arfs_lock);
+	return ret;
+}
+
+/* must be called with arfs_lock held */
+static void i40e_arfs_unlink(struct i40e_pf *pf, struct i40e_arfs_filter *f)
+{
+	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+
+	list_del(&f->list);
+	if (f->dirty)
+		list_del(&f->dirty_list);
+	hlist_del(&f->hash_node);
+	clear_bit(f->id, pf->arfs_ids);
+	if (f->fd.q_index < vsi->num_queue_pairs)
+		vsi->rx_rings[f->fd.q_index]->arfs_filters--;
+}
+
+/**
+ * i40e_arfs_subtask - program new aRFS filters and expire idle ones
+ * @pf: board private structure
+ *
+ * Programming a filter sleeps, so it happens with arfs_lock dropped, on a
+ * copy of the filter.
+ **/
+static void i40e_arfs_subtask(struct i40e_pf *pf)
+{
+	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+	struct i40e_arfs_filter *f, *tmp, *last = NULL;
+	int quota = I40E_ARFS_EXPIRY_QUOTA;
+	struct i40e_fdir_filter fd;
+	bool programmed;
+	LIST_HEAD(expired);
+
+	if (!(pf->flags & I40E_FLAG_FD_SB_ENABLED) ||
+	    test_bit(__I40E_FD_FLUSH_REQUESTED, &pf->state) ||
+	    test_bit(__I40E_DOWN, &vsi->state))
+		return;
+
+	/* remove idle filters first, a flow coming back is added after */
+	spin_lock_bh(&pf->arfs_lock);
+	list_for_each_entry_safe(f, tmp, &pf->arfs_list, list) {
+		if (quota-- <= 0)
+			break;
+		if (f->dirty) {
+			last = f;
+			continue;
+		}
+
+		if (rps_may_expire_flow(vsi->netdev, f->fd.q_index,
+					f->flow_id, f->id)) {
+			i40e_arfs_unlink(pf, f);
+			list_add_tail(&f->list, &expired);
+		} else {
+			last = f;
+		}
+	}
+
+	/* continue after the last filter checked next time */
+	if (last && !list_is_last(&last->list, &pf->arfs_list))
+		list_move(&pf->arfs_list, &last->list);
+	spin_unlock_bh(&pf->arfs_lock);
+
+	list_for_each_entry_safe(f, tmp, &expired, list) {
+		if (f->programmed)
+			i40e_add_del_fdir(vsi, &f->fd, false);
+		list_del(&f->list);
+		kfree(f);
+	}
+
+	for (;;) {
+		spin_lock_bh(&pf->arfs_lock);
+		f = list_first_entry_or_null(&pf->arfs_dirty,
+					     struct i40e_arfs_filter,
+					     dirty_list);
+		if (!f) {
+			spin_unlock_bh(&pf->arfs_lock);
+			break;
+		}
+		list_del(&f->dirty_list);
+		f->dirty = false;
+		programmed = f->programmed;
+		f->programmed = true;
+		fd = f->fd;
+		spin_unlock_bh(&pf->arfs_lock);
+
+		/* keep the TCP sideband rule count, which gates ATR, right */
+		if (programmed)
+			i40e_add_del_fdir(vsi, &fd, false);
+		if (!i40e_add_del_fdir(vsi, &fd, true))
+			continue;
+
+		/*
+		 * Drop the filter, or RPS would keep believing the flow is
+		 * steered.  It may have been re-steered or flushed meanwhile.
+		 */
+		spin_lock_bh(&pf->arfs_lock);
+		if (i40e_arfs_find(pf, &fd) == f && !f->dirty) {
+			i40e_arfs_unlink(pf, f);
+			kfree(f);
+		}
+		spin_unlock_bh(&pf->arfs_lock);
+	}
+}
+
+/**
+ * i40e_arfs_replay - have all aRFS filters programmed again
+ * @pf: board private structure
+ *
+ * Used once the sideband filters are replayed after the Flow Director
+ * table was cleared.  Filters for Rx queues that are gone are dropped.
+ **/
+static void i40e_arfs_replay(struct i40e_pf *pf)
+{
+	struct i40e_vsi *vsi = pf->vsi[pf->lan_vsi];
+	struct i40e_arfs_filter *f, *tmp;
+	int i;
+
+	if (!vsi)
+		return;
+
+	spin_lock_bh(&pf->arfs_lock);
+	for (i = 0; i < vsi->num_queue_pairs; i++)
+		vsi->rx_rings[i]->arfs_filters = 0;
+
+	list_for_each_entry_safe(f, tmp, &pf->arfs_list, list) {
+		if (f->fd.q_index >= vsi->num_queue_pairs) {
+			if (f->dirty)
+				list_del(&f->dirty_list);
+			list_del(&f->list);
+			hlist_del(&f->hash_node);
+			clear_bit(f->id, pf->arfs_ids);
+			kfree(f);
+			continue;
+		}
+
+		vsi->rx_rings[f->fd.q_index]->arfs_filters++;
+		f->programmed = false;
+		i40e_arfs_mark_dirty(pf, f);
+	}
+	spin_unlock_bh(&pf->arfs_lock);
+}
+
+/**
+ * i40e_arfs_flush - forget all aRFS filters
+ * @pf: board private structure
+ *
+ * Nothing is removed from the hardware, callers reset it afterwards.
+ **/
+static void i40e_arfs_flush(struct i40e_pf *pf)
+{
+	struct i40e_arfs_filter *f, *tmp;
+
+	spin_lock_bh(&pf->arfs_lock);
+	list_for_each_entry_safe(f, tmp, &pf->arfs_list, list) {
+		i40e_arfs_unlink(pf, f);
+		kfree(f);
+	}
+	spin_unlock_bh(&pf->arfs_lock);
+}
+
+/**
+ * i40e_set_rx_cpu_rmap - map Rx queues to the cpus their vectors run on
+ * @vsi: the main VSI
+ *
+ * The rmap index has to be the Rx queue index, which holds when the
+ * first num_queue_pairs vectors serve one queue pair each, in order.
+ **/
+static void i40e_set_rx_cpu_rmap(struct i40e_vsi *vsi)
+{
+	struct i40e_pf *pf = vsi->back;
+	struct net_device *netdev = vsi->netdev;
+	int i, err;
+
+	if (vsi->type != I40E_VSI_MAIN || !netdev ||
+	    vsi->num_q_vectors < vsi->num_queue_pairs)
+		return;
+
+	netdev->rx_cpu_rmap = alloc_irq_cpu_rmap(vsi->num_queue_pairs);
+	if (!netdev->rx_cpu_rmap)
+		return;
+
+	for (i = 0; i < vsi->num_queue_pairs; i++) {
+		err = irq_cpu_rmap_add(netdev->rx_cpu_rmap,
+			pf->msix_entries[vsi->base_vector + i].vector);
+		if (err) {
+			free_irq_cpu_rmap(netdev->rx_cpu_rmap);
+			netdev->rx_cpu_rmap = NULL;
+			return;
+		}
+	}
+}
+
+static void i40e_free_rx_cpu_rmap(struct i40e_vsi *vsi)
+{
+	if (!vsi->netdev)
+		return;
+
+	free_irq_cpu_rmap(vsi->netdev->rx_cpu_rmap);
+	vsi->netdev->rx_cpu_rmap = NULL;
+}
+#else
+static inline void i40e_arfs_subtask(struct i40e_pf *pf) {}
+static inline void i40e_arfs_replay(struct i40e_pf *pf) {}
+static inline void i40e_arfs_flush(struct i40e_pf *pf) {}
+static inline void i40e_set_rx_cpu_rmap(struct i40e_vsi *vsi) {}
+static inline void i40e_free_rx_cpu_rmap(struct i40e_vsi *vsi) {}
+#endif /* CONFIG_RFS_ACCEL */
+
 /**
  * i40e_vsi_request_irq_msix - Initialize MSI-X interrupts
  * @vsi: the VSI being configured
@@ -2988,6 +3356,7 @@ static int i40e_vsi_request_irq_msix(struct i40e_vsi *vsi, char *basename)
 				      &q_vector->affinity_mask);
 	}
 
+	i40e_set_rx_cpu_rmap(vsi);
 	vsi->irqs_ready = true;
 	return 0;
 
@@ -3625,6 +3994,7 @@ static void i40e_vsi_free_irq(struct i40e_vsi *vsi)
 			return;
 
 		vsi->irqs_ready = false;
+		i40e_free_rx_cpu_rmap(vsi);
 		for (i = 0; i < vsi->num_q_vectors; i++) {
 			u16 vector = i + base;
 
@@ -4525,6 +4895,7 @@ static int i40e_up_complete(struct i40e_vsi *vsi)
 			pf->fd_tcp_rule = 0;
 		}
 		i40e_fdir_filter_restore(vsi);
+		i40e_arfs_replay(pf);
 	}
 	i40e_service_event_schedule(pf);
 
@@ -5236,6 +5607,7 @@ static void i40e_fdir_flush_and_replay(struct i40e_pf *pf)
 		} else {
 			/* replay sideband filters */
 			i40e_fdir_filter_restore(pf->vsi[pf->lan_vsi]);
+			i40e_arfs_replay(pf);
 
 			pf->flags |= I40E_FLAG_FD_ATR_ENABLED;
 			pf->auto_disable_flags &= ~I40E_FLAG_FD_ATR_ENABLED;
@@ -5898,6 +6270,7 @@ static void i40e_fdir_teardown(struct i40e_pf *pf)
 	int i;
 
 	i40e_fdir_filter_exit(pf);
+	i40e_arfs_flush(pf);
 	for (i = 0; i < pf->num_alloc_vsi; i++) {
 		if (pf->vsi[i] && pf->vsi[i]->type == I40E_VSI_FDIR) {
 			i40e_vsi_release(pf->vsi[i]);
@@ -6298,6 +6671,7 @@ static void i40e_service_task(struct work_struct *work)
 	i40e_vc_process_vflr_event(pf);
 	i40e_watchdog_subtask(pf);
 	i40e_fdir_reinit_subtask(pf);
+	i40e_arfs_subtask(pf);
 	i40e_check_hang_subtask(pf);
 	i40e_sync_filters_subtask(pf);
 #ifdef CONFIG_I40E_VXLAN
@@ -6563,6 +6937,9 @@ static int i40e_vsi_clear(struct i40e_vsi *vsi)
 
 	i40e_vsi_free_arrays(vsi, true);
 
+	if (rcu_access_pointer(vsi->xdp_prog))
+		bpf_prog_put(rcu_dereference_protected(vsi->xdp_prog, 1));
+
 	pf->vsi[vsi->idx] = NULL;
 	if (vsi->idx < pf->next_vsi)
 		pf->next_vsi = vsi->idx;
@@ -7171,6 +7548,11 @@ static int i40e_sw_init(struct i40e_pf *pf)
 	pf->tx_timeout_recovery_level = 1;
 
 	mutex_init(&pf->switch_mutex);
+#ifdef CONFIG_RFS_ACCEL
+	spin_lock_init(&pf->arfs_lock);
+	INIT_LIST_HEAD(&pf->arfs_list);
+	INIT_LIST_HEAD(&pf->arfs_dirty);
+#endif
 
 sw_init_done:
 	return err;
@@ -7200,6 +7582,7 @@ bool i40e_set_ntuple(struct i40e_pf *pf, netdev_features_t features)
 		if (pf->flags & I40E_FLAG_FD_SB_ENABLED) {
 			need_reset = true;
 			i40e_fdir_filter_exit(pf);
+			i40e_arfs_flush(pf);
 		}
 		pf->flags &= ~I40E_FLAG_FD_SB_ENABLED;
 		pf->auto_disable_flags &= ~I40E_FLAG_FD_SB_ENABLED;
@@ -7356,6 +7739,50 @@ static int i40e_get_phys_port_id(struct net_device *netdev,
 	return 0;
 }
 
+static int i40e_xdp_setup(struct i40e_vsi *vsi, struct bpf_prog *prog)
+{
+	struct bpf_prog *old_prog;
+
+	/* the program runs on the skb data area in single buffer mode,
+	 * header split frames would need to be linearized first
+	 */
+	if (prog && !(vsi->back->flags & I40E_FLAG_RX_1BUF_ENABLED)) {
+		netdev_err(vsi->netdev,
+			   "XDP requires single buffer receive mode\n");
+		return -EOPNOTSUPP;
+	}
+
+	old_prog = rtnl_dereference(vsi->xdp_prog);
+	rcu_assign_pointer(vsi->xdp_prog, prog);
+
+	if (old_prog) {
+		/* wait for in-flight NAPI polls still running the old prog */
+		synchronize_net();
+		bpf_prog_put(old_prog);
+	}
+
+	return 0;
+}
+
+static int i40e_xdp(struct net_device *netdev, struct netdev_xdp *xdp)
+{
+	struct i40e_netdev_priv *np = netdev_priv(netdev);
+	struct i40e_vsi *vsi = np->vsi;
+
+	if (vsi->type != I40E_VSI_MAIN)
+		return -EINVAL;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return i40e_xdp_setup(vsi, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(vsi->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 #ifdef HAVE_FDB_OPS
 #ifdef USE_CONST_DEV_UC_CHAR
 static int i40e_ndo_fdb_add(struct ndmsg *ndm, struct nlattr *tb[],
@@ -7469,6 +7896,9 @@ static const struct net_device_ops i40e_netdev_ops = {
 	.ndo_fcoe_disable	= i40e_fcoe_disable,
 #endif
 	.ndo_set_features	= i40e_set_features,
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer	= i40e_rx_flow_steer,
+#endif
 	.ndo_set_vf_mac		= i40e_ndo_set_vf_mac,
 	.ndo_set_vf_vlan	= i40e_ndo_set_vf_port_vlan,
 	.ndo_set_vf_rate	= i40e_ndo_set_vf_bw,
@@ -7480,6 +7910,7 @@ static const struct net_device_ops i40e_netdev_ops = {
 	.ndo_del_vxlan_port	= i40e_del_vxlan_port,
 #endif
 	.ndo_get_phys_port_id	= i40e_get_phys_port_id,
+	.ndo_xdp		= i40e_xdp,
 #ifdef HAVE_FDB_OPS
 	.ndo_fdb_add		= i40e_ndo_fdb_add,
 #ifndef USE_DEFAULT_FDB_DEL_DUMP
@@ -25,6 +25,7 @@
  ******************************************************************************/
 
 #include <linux/prefetch.h>
+#include <linux/filter.h>
 #include "i40e.h"
 #include "i40e_prototype.h"
 
@@ -226,8 +227,10 @@ static int i40e_add_del_fdir_udpv4(struct i40e_vsi *vsi,
 		dev_info(&pf->pdev->dev,
 			 "PCTYPE:%d, Filter command send failed for fd_id:%d (ret = %d)\n",
 			 fd_data->pctype, fd_data->fd_id, ret);
+		/* the buffer was not handed to the ring */
+		kfree(raw_packet);
 		err = true;
-	} else {
+	} else if (I40E_DEBUG_FD & pf->hw.debug_mask) {
 		if (add)
 			dev_info(&pf->pdev->dev,
 				 "Filter OK for PCTYPE %d loc = %d\n",
@@ -301,8 +304,10 @@ static int i40e_add_del_fdir_tcpv4(struct i40e_vsi *vsi,
 		dev_info(&pf->pdev->dev,
 			 "PCTYPE:%d, Filter command send failed for fd_id:%d (ret = %d)\n",
 			 fd_data->pctype, fd_data->fd_id, ret);
+		/* the buffer was not handed to the ring */
+		kfree(raw_packet);
 		err = true;
-	} else {
+	} else if (I40E_DEBUG_FD & pf->hw.debug_mask) {
 		if (add)
 			dev_info(&pf->pdev->dev, "Filter OK for PCTYPE %d loc = %d)\n",
 				 fd_data->pctype, fd_data->fd_id);
@@ -374,8 +379,10 @@ static int i40e_add_del_fdir_ipv4(struct i40e_vsi *vsi,
 			dev_info(&pf->pdev->dev,
 				 "PCTYPE:%d, Filter command send failed for fd_id:%d (ret = %d)\n",
 				 fd_data->pctype, fd_data->fd_id, ret);
+			/* the buffer was not handed to the ring */
+			kfree(raw_packet);
 			err = true;
-		} else {
+		} else if (I40E_DEBUG_FD & pf->hw.debug_mask) {
 			if (add)
 				dev_info(&pf->pdev->dev,
 					 "Filter OK for PCTYPE %d loc = %d\n",
@@ -1364,6 +1371,53 @@ static inline enum pkt_hash_types i40e_ptype_to_hash(u8 ptype)
 		return PKT_HASH_TYPE_L2;
 }
 
+/**
+ * i40e_run_xdp - run XDP program on a received frame
+ * @xdp_prog: XDP program attached to the VSI
+ * @rx_ring: rx ring the frame was received on
+ * @rx_bi: buffer holding the frame
+ * @len: length of the frame
+ *
+ * Only used in single buffer mode, where the frame sits in the data area
+ * of the skb the ring was refilled with.  Returns true if the program
+ * consumed the frame, in which case the skb stays mapped on the ring to
+ * be reused for the next frame.
+ **/
+static bool i40e_run_xdp(struct bpf_prog *xdp_prog, struct i40e_ring *rx_ring,
+			 struct i40e_rx_buffer *rx_bi, u16 len)
+{
+	struct sk_buff *skb = rx_bi->skb;
+	struct xdp_buff xdp;
+	u32 act;
+
+	dma_sync_single_for_cpu(rx_ring->dev, rx_bi->dma,
+				rx_ring->rx_buf_len, DMA_FROM_DEVICE);
+
+	xdp.data = skb->data;
+	xdp.data_end = skb->data + len;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		xdp_do_tx(rx_ring->netdev, &xdp, rx_ring->queue_index);
+		break;
+	case XDP_REDIRECT:
+		xdp_do_redirect(rx_ring->netdev, &xdp);
+		break;
+	default:
+	case XDP_ABORTED:
+	case XDP_DROP:
+		break;
+	}
+
+	/* hand the untouched buffer back to the device */
+	dma_sync_single_for_device(rx_ring->dev, rx_bi->dma,
+				   rx_ring->rx_buf_len, DMA_FROM_DEVICE);
+	return true;
+}
+
 /**
  * i40e_clean_rx_irq - Reclaim resources after receive completes
  * @rx_ring:  rx ring to clean
@@ -1380,6 +1434,7 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 	struct i40e_vsi *vsi = rx_ring->vsi;
 	u16 i = rx_ring->next_to_clean;
 	union i40e_rx_desc *rx_desc;
+	struct bpf_prog *xdp_prog;
 	u32 rx_error, rx_status;
 	u8 rx_ptype;
 	u64 qword;
@@ -1387,6 +1442,9 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 	if (budget <= 0)
 		return 0;
 
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(vsi->xdp_prog);
+
 	rx_desc = I40E_RX_DESC(rx_ring, i);
 	qword = le64_to_cpu(rx_desc->wb.qword1.status_error_len);
 	rx_status = (qword & I40E_RXD_QW1_STATUS_MASK) >>
@@ -1428,6 +1486,19 @@ static int i40e_clean_rx_irq(struct i40e_ring *rx_ring, int budget)
 		 */
 		rmb();
 
+		if (xdp_prog && rx_bi->dma && !ring_is_ps_enabled(rx_ring) &&
+		    (rx_status & (1 << I40E_RX_DESC_STATUS_EOF_SHIFT)) &&
+		    !(rx_error & (1 << I40E_RX_DESC_ERROR_RXE_SHIFT)) &&
+		    i40e_run_xdp(xdp_prog, rx_ring, rx_bi, rx_packet_len)) {
+			/* keep the skb on the ring for the next frame */
+			rx_bi->skb = skb;
+			total_rx_bytes += rx_packet_len;
+			total_rx_packets++;
+			I40E_RX_NEXT_DESC_PREFETCH(rx_ring, i, next_rxd);
+			budget--;
+			goto next_desc;
+		}
+
 		/* Get the header and possibly the whole packet
 		 * If this is an skb from previous receive dma will be 0
 		 */
@@ -1551,6 +1622,8 @@ next_desc:
 			    I40E_RXD_QW1_STATUS_SHIFT;
 	}
 
+	rcu_read_unlock();
+
 	rx_ring->next_to_clean = i;
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
@@ -240,6 +240,9 @@ struct i40e_ring {
 
 	u8 atr_sample_rate;
 	u8 atr_count;
+#ifdef CONFIG_RFS_ACCEL
+	u16 arfs_filters;		/* aRFS filters steering to this ring */
+#endif
 
 	unsigned long last_rx_timestamp;
 
@@ -211,6 +211,8 @@ struct ixgbe_rx_queue_stats {
 	u64 alloc_rx_page_failed;
 	u64 alloc_rx_buff_failed;
 	u64 csum_err;
+	u64 xdp_drops;
+	u64 xdp_tx_failed;
 };
 
 enum ixgbe_ring_state_t {
@@ -597,6 +599,27 @@ struct ixgbe_mac_addr {
 /* default to trying for four seconds */
 #define IXGBE_TRY_LINK_TIMEOUT (4 * HZ)
 
+#ifdef CONFIG_RFS_ACCEL
+#define IXGBE_ARFS_HASH_BITS	8
+#define IXGBE_ARFS_MAX_FILTERS	1024
+/* above the soft IDs ethtool rules can use, see ixgbe_add_ethtool_fdir_entry */
+#define IXGBE_ARFS_SW_IDX_BASE	0x2000
+/* rps_may_expire_flow() calls per service task run */
+#define IXGBE_ARFS_EXPIRY_QUOTA	64
+
+struct ixgbe_arfs_filter {
+	struct list_head list;
+	struct hlist_node hash_node;
+	union ixgbe_atr_input filter;
+	u32 flow_id;			/* RFS infrastructure id */
+	u16 id;				/* RFS filter id, also the soft ID slot */
+	u16 rxq_index;
+	bool dirty;			/* steering changed since programmed */
+	bool programmed;
+};
+
+#endif /* CONFIG_RFS_ACCEL */
+
 /* board specific private data structure */
 struct ixgbe_adapter {
 	unsigned long active_vlans[BITS_TO_LONGS(VLAN_N_VID)];
@@ -665,6 +688,7 @@ struct ixgbe_adapter {
 
 	/* RX */
 	struct ixgbe_ring *rx_ring[MAX_RX_QUEUES];
+	struct bpf_prog __rcu *xdp_prog;	/* XDP program run on all rings */
 	int num_rx_pools;		/* == num_rx_queues in 82598 */
 	int num_rx_queues_per_pool;	/* 1 if 82598, can be many if 82599 */
 	u64 hw_csum_rx_error;
@@ -674,6 +698,8 @@ struct ixgbe_adapter {
 	u64 non_eop_descs;
 	u32 alloc_rx_page_failed;
 	u32 alloc_rx_buff_failed;
+	u64 xdp_drops;
+	u64 xdp_tx_failed;
 
 	struct ixgbe_q_vector *q_vector[MAX_Q_VECTORS];
 
@@ -718,6 +744,14 @@ struct ixgbe_adapter {
 	u32 fdir_pballoc;
 	u32 atr_sample_rate;
 	spinlock_t fdir_perfect_lock;
+#ifdef CONFIG_RFS_ACCEL
+	int arfs_hw_filters;	/* programmed, under fdir_perfect_lock */
+	spinlock_t arfs_lock;
+	struct list_head arfs_list;
+	struct hlist_head arfs_hash[1 << IXGBE_ARFS_HASH_BITS];
+	DECLARE_BITMAP(arfs_ids, IXGBE_ARFS_MAX_FILTERS);
+	u16 arfs_queue_filters[MAX_RX_QUEUES];
+#endif
 
 #ifdef IXGBE_FCOE
 	struct ixgbe_fcoe fcoe;
@@ -776,6 +810,16 @@ struct ixgbe_fdir_filter {
 	u16 action;
 };
 
+/* no perfect filter is programmed, so the input mask may be changed */
+static inline bool ixgbe_fdir_mask_unused(struct ixgbe_adapter *adapter)
+{
+#ifdef CONFIG_RFS_ACCEL
+	if (adapter->arfs_hw_filters)
+		return false;
+#endif
+	return hlist_empty(&adapter->fdir_filter_list);
+}
+
 enum ixgbe_state_t {
 	__IXGBE_TESTING,
 	__IXGBE_RESETTING,
@@ -106,6 +106,8 @@ static const struct ixgbe_stats ixgbe_gstrings_stats[] = {
 	{"rx_csum_offload_errors", IXGBE_STAT(hw_csum_rx_error)},
 	{"alloc_rx_page_failed", IXGBE_STAT(alloc_rx_page_failed)},
 	{"alloc_rx_buff_failed", IXGBE_STAT(alloc_rx_buff_failed)},
+	{"rx_xdp_drops", IXGBE_STAT(xdp_drops)},
+	{"rx_xdp_tx_failed", IXGBE_STAT(xdp_tx_failed)},
 	{"rx_no_dma_resources", IXGBE_STAT(hw_rx_no_dma_resources)},
 	{"os2bmc_rx_by_bmc", IXGBE_STAT(stats.o2bgptc)},
 	{"os2bmc_tx_by_bmc", IXGBE_STAT(stats.b2ospc)},
@@ -2650,7 +2652,7 @@ static int ixgbe_add_ethtool_fdir_entry(struct ixgbe_adapter *adapter,
 
 	spin_lock(&adapter->fdir_perfect_lock);
 
-	if (hlist_empty(&adapter->fdir_filter_list)) {
+	if (ixgbe_fdir_mask_unused(adapter)) {
 		/* save mask and program input mask into HW */
 		memcpy(&adapter->fdir_mask, &mask, sizeof(mask));
 		err = ixgbe_fdir_set_input_mask_82599(hw, &mask);
@@ -34,6 +34,8 @@
 #include <linux/string.h>
 #include <linux/in.h>
 #include <linux/interrupt.h>
+#include <linux/cpu_rmap.h>
+#include <linux/hash.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
 #include <linux/sctp.h>
@@ -41,6 +43,7 @@
 #include <linux/ipv6.h>
 #include <linux/slab.h>
 #include <net/checksum.h>
+#include <net/ip.h>
 #include <net/ip6_checksum.h>
 #include <linux/ethtool.h>
 #include <linux/if.h>
@@ -48,6 +51,9 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
+#include <linux/rtnetlink.h>
 #include <scsi/fc/fc_fcoe.h>
 
 #include "ixgbe.h"
@@ -1966,6 +1972,78 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_run_xdp - run XDP program on a received frame before skb allocation
+ * @xdp_prog: XDP program attached to the adapter
+ * @rx_ring: rx descriptor ring to transact packets on
+ * @rx_desc: descriptor of the frame
+ *
+ * Frames that fit a single buffer are handed to the program straight from
+ * the receive page.  Returns true if the program consumed the frame, in
+ * which case the buffer has already been recycled and next_to_clean moved
+ * on, or false if the frame has to go through the regular skb path.
+ **/
+static bool ixgbe_run_xdp(struct bpf_prog *xdp_prog,
+			  struct ixgbe_ring *rx_ring,
+			  union ixgbe_adv_rx_desc *rx_desc)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	struct xdp_buff xdp;
+	unsigned int size;
+	u32 ntc, act;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+
+	/* frames spanning several buffers and bad frames take the slow path */
+	if (rx_buffer->skb ||
+	    !ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP) ||
+	    ixgbe_test_staterr(rx_desc, IXGBE_RXDADV_ERR_FRAME_ERR_MASK))
+		return false;
+
+	size = le16_to_cpu(rx_desc->wb.upper.length);
+
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.data_end = xdp.data + size;
+	prefetch(xdp.data);
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		if (xdp_do_tx(rx_ring->netdev, &xdp, rx_ring->queue_index))
+			rx_ring->rx_stats.xdp_tx_failed++;
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(rx_ring->netdev, &xdp))
+			rx_ring->rx_stats.xdp_tx_failed++;
+		break;
+	default:
+	case XDP_ABORTED:
+	case XDP_DROP:
+		rx_ring->rx_stats.xdp_drops++;
+		break;
+	}
+
+	/* the frame was never handed to the stack, recycle the buffer as is */
+	ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+	rx_buffer->dma = 0;
+	rx_buffer->page = NULL;
+
+	ntc = rx_ring->next_to_clean + 1;
+	ntc = (ntc < rx_ring->count) ? ntc : 0;
+	rx_ring->next_to_clean = ntc;
+	prefetch(IXGBE_RX_DESC(rx_ring, ntc));
+
+	return true;
+}
+
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -1990,6 +2068,10 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	unsigned int mss = 0;
 #endif /* IXGBE_FCOE */
 	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
+	struct bpf_prog *xdp_prog;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(q_vector->adapter->xdp_prog);
 
 	while (likely(total_rx_packets < budget)) {
 		union ixgbe_adv_rx_desc *rx_desc;
@@ -2013,6 +2095,13 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		rmb();
 
+		if (xdp_prog && ixgbe_run_xdp(xdp_prog, rx_ring, rx_desc)) {
+			total_rx_bytes += le16_to_cpu(rx_desc->wb.upper.length);
+			total_rx_packets++;
+			cleaned_count++;
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -2068,6 +2157,8 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		total_rx_packets++;
 	}
 
+	rcu_read_unlock();
+
 	u64_stats_update_begin(&rx_ring->syncp);
 	rx_ring->stats.packets += total_rx_packets;
 	rx_ring->stats.bytes += total_rx_bytes;
@@ -2699,6 +2790,325 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 	return 0;
 }
 
+#ifdef CONFIG_RFS_ACCEL
+static void ixgbe_arfs_input_mask(union ixgbe_atr_input *mask)
+{
+	memset(mask, 0, sizeof(*mask));
+	mask->formatted.flow_type = IXGBE_ATR_L4TYPE_IPV6_MASK |
+				    IXGBE_ATR_L4TYPE_MASK;
+	mask->formatted.src_ip[0] = htonl(~0);
+	mask->formatted.dst_ip[0] = htonl(~0);
+	mask->formatted.src_port = htons(~0);
+	mask->formatted.dst_port = htons(~0);
+}
+
+static struct hlist_head *ixgbe_arfs_bucket(struct ixgbe_adapter *adapter,
+					    const union ixgbe_atr_input *input)
+{
+	u32 key = (__force u32)input->formatted.src_ip[0] ^
+		  (__force u32)input->formatted.dst_ip[0] ^
+		  ((__force u32)input->formatted.src_port << 16 |
+		   (__force u32)input->formatted.dst_port);
+
+	return &adapter->arfs_hash[hash_32(key, IXGBE_ARFS_HASH_BITS)];
+}
+
+static struct ixgbe_arfs_filter *
+ixgbe_arfs_find(struct ixgbe_adapter *adapter,
+		const union ixgbe_atr_input *input)
+{
+	struct ixgbe_arfs_filter *f;
+
+	hlist_for_each_entry(f, ixgbe_arfs_bucket(adapter, input), hash_node) {
+		if (f->filter.formatted.flow_type ==
+		    input->formatted.flow_type &&
+		    f->filter.formatted.src_ip[0] ==
+		    input->formatted.src_ip[0] &&
+		    f->filter.formatted.dst_ip[0] ==
+		    input->formatted.dst_ip[0] &&
+		    f->filter.formatted.src_port == input->formatted.src_port &&
+		    f->filter.formatted.dst_port == input->formatted.dst_port)
+			return f;
+	}
+
+	return NULL;
+}
+
+/* leave every queue a fair share of the filter table */
+static bool ixgbe_arfs_queue_full(struct ixgbe_adapter *adapter, u16 rxq)
+{
+	return adapter->arfs_queue_filters[rxq] >=
+	       IXGBE_ARFS_MAX_FILTERS / adapter->num_rx_queues;
+}
+
+static int ixgbe_rx_flow_steer(struct net_device *netdev,
+			       const struct sk_buff *skb,
+			       u16 rxq_index, u32 flow_id)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+	int nhoff = skb_network_offset(skb);
+	union ixgbe_atr_input input, mask;
+	struct ixgbe_arfs_filter *f;
+	const struct iphdr *ip;
+	const __be16 *ports;
+	int id, ret;
+
+	if (!(adapter->flags & IXGBE_FLAG_FDIR_PERFECT_CAPABLE))
+		return -EOPNOTSUPP;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return -EPROTONOSUPPORT;
+
+	ip = (const struct iphdr *)(skb->data + nhoff);
+	if (ip_is_fragment(ip))
+		return -EPROTONOSUPPORT;
+
+	memset(&input, 0, sizeof(input));
+	switch (ip->protocol) {
+	case IPPROTO_TCP:
+		input.formatted.flow_type = IXGBE_ATR_FLOW_TYPE_TCPV4;
+		break;
+	case IPPROTO_UDP:
+		input.formatted.flow_type = IXGBE_ATR_FLOW_TYPE_UDPV4;
+		break;
+	default:
+		return -EPROTONOSUPPORT;
+	}
+	ports = (const __be16 *)(skb->data + nhoff + 4 * ip->ihl);
+
+	input.formatted.src_ip[0] = ip->saddr;
+	input.formatted.dst_ip[0] = ip->daddr;
+	input.formatted.src_port = ports[0];
+	input.formatted.dst_port = ports[1];
+
+	spin_lock_bh(&adapter->arfs_lock);
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state)) {
+		ret = -ENETDOWN;
+		goto out;
+	}
+
+	f = ixgbe_arfs_find(adapter, &input);
+	if (f) {
+		ret = f->id;
+		if (f->rxq_index == rxq_index)
+			goto out;
+
+		if (ixgbe_arfs_queue_full(adapter, rxq_index)) {
+			ret = -EBUSY;
+			goto out;
+		}
+		adapter->arfs_queue_filters[f->rxq_index]--;
+	} else {
+		if (ixgbe_arfs_queue_full(adapter, rxq_index)) {
+			ret = -EBUSY;
+			goto out;
+		}
+
+		id = find_first_zero_bit(adapter->arfs_ids,
+					 IXGBE_ARFS_MAX_FILTERS);
+		if (id >= IXGBE_ARFS_MAX_FILTERS) {
+			ret = -EBUSY;
+			goto out;
+		}
+
+		f = kzalloc(sizeof(*f), GFP_ATOMIC);
+		if (!f) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		ixgbe_arfs_input_mask(&mask);
+		ixgbe_atr_compute_perfect_hash_82599(&input, &mask);
+		f->filter = input;
+		f->id = id;
+		set_bit(id, adapter->arfs_ids);
+		list_add_tail(&f->list, &adapter->arfs_list);
+		hlist_add_head(&f->hash_node, ixgbe_arfs_bucket(adapter, &input));
+		ret = id;
+	}
+
+	f->flow_id = flow_id;
+	f->rxq_index = rxq_index;
+	f->dirty = true;
+	adapter->arfs_queue_filters[rxq_index]++;
+	spin_unlock_bh(&adapter->arfs_lock);
+
+	/* program the filter from the service task */
+	ixgbe_service_event_schedule(adapter);
+	return ret;
+
+out:
+	spin_unlock_bh(&adapter->arfs_lock);
+	return ret;
+}
+
+static void ixgbe_arfs_free(struct ixgbe_adapter *adapter,
+			    struct ixgbe_arfs_filter *f)
+{
+	list_del(&f->list);
+	hlist_del(&f->hash_node);
+	clear_bit(f->id, adapter->arfs_ids);
+	adapter->arfs_queue_filters[f->rxq_index]--;
+	kfree(f);
+}
+
+/* must be called with both arfs_lock and fdir_perfect_lock held */
+static int ixgbe_arfs_program(struct ixgbe_adapter *adapter,
+			      struct ixgbe_arfs_filter *f)
+{
+	struct ixgbe_hw *hw = &adapter->hw;
+	union ixgbe_atr_input mask;
+	int err;
+
+	ixgbe_arfs_input_mask(&mask);
+
+	/* all perfect filters on the port share one input mask */
+	if (ixgbe_fdir_mask_unused(adapter)) {
+		memcpy(&adapter->fdir_mask, &mask, sizeof(mask));
+		err = ixgbe_fdir_set_input_mask_82599(hw, &mask);
+		if (err)
+			return err;
+	} else if (memcmp(&adapter->fdir_mask, &mask, sizeof(mask))) {
+		return -EINVAL;
+	}
+
+	err = ixgbe_fdir_write_perfect_filter_82599(hw, &f->filter,
+				IXGBE_ARFS_SW_IDX_BASE + f->id,
+				adapter->rx_ring[f->rxq_index]->reg_idx);
+	if (err)
+		return err;
+
+	if (!f->programmed)
+		adapter->arfs_hw_filters++;
+	f->programmed = true;
+	f->dirty = false;
+	return 0;
+}
+
+/* must be called with both arfs_lock and fdir_perfect_lock held */
+static void ixgbe_arfs_erase(struct ixgbe_adapter *adapter,
+			     struct ixgbe_arfs_filter *f)
+{
+	if (!f->programmed)
+		return;
+
+	ixgbe_fdir_erase_perfect_filter_82599(&adapter->hw, &f->filter,
+					      IXGBE_ARFS_SW_IDX_BASE + f->id);
+	adapter->arfs_hw_filters--;
+	f->programmed = false;
+}
+
+/**
+ * ixgbe_arfs_subtask - program new aRFS filters and expire idle ones
+ * @adapter: pointer to the device adapter structure
+ **/
+static void ixgbe_arfs_subtask(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_arfs_filter *f, *tmp, *last = NULL;
+	int quota = IXGBE_ARFS_EXPIRY_QUOTA;
+
+	/*
+	 * fdir_perfect_lock nests outside arfs_lock: it is taken without
+	 * disabling BHs, and ixgbe_rx_flow_steer() takes arfs_lock from
+	 * softirq context.
+	 */
+	spin_lock(&adapter->fdir_perfect_lock);
+	spin_lock_bh(&adapter->arfs_lock);
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		goto out;
+
+	list_for_each_entry_safe(f, tmp, &adapter->arfs_list, list) {
+		if (f->dirty) {
+			/* e.g. an ethtool rule took a different mask */
+			if (ixgbe_arfs_program(adapter, f)) {
+				ixgbe_arfs_erase(adapter, f);
+				ixgbe_arfs_free(adapter, f);
+			}
+			continue;
+		}
+
+		if (quota <= 0)
+			continue;
+		quota--;
+
+		if (rps_may_expire_flow(adapter->netdev, f->rxq_index,
+					f->flow_id, f->id)) {
+			ixgbe_arfs_erase(adapter, f);
+			ixgbe_arfs_free(adapter, f);
+		} else {
+			last = f;
+		}
+	}
+
+	/* continue after the last filter checked next time */
+	if (last && !list_is_last(&last->list, &adapter->arfs_list))
+		list_move(&adapter->arfs_list, &last->list);
+out:
+	spin_unlock_bh(&adapter->arfs_lock);
+	spin_unlock(&adapter->fdir_perfect_lock);
+}
+
+/**
+ * ixgbe_arfs_flush - forget all aRFS filters
+ * @adapter: pointer to the device adapter structure
+ *
+ * Called once the Flow Director table has been reset, so nothing is
+ * erased from the hardware.
+ **/
+static void ixgbe_arfs_flush(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_arfs_filter *f, *tmp;
+
+	spin_lock_bh(&adapter->arfs_lock);
+	list_for_each_entry_safe(f, tmp, &adapter->arfs_list, list)
+		ixgbe_arfs_free(adapter, f);
+	spin_unlock_bh(&adapter->arfs_lock);
+
+	spin_lock(&adapter->fdir_perfect_lock);
+	adapter->arfs_hw_filters = 0;
+	spin_unlock(&adapter->fdir_perfect_lock);
+}
+
+static void ixgbe_set_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+	struct net_device *netdev = adapter->netdev;
+	int i, err;
+
+	/*
+	 * The rmap index has to be the Rx queue index, which holds when the
+	 * first num_rx_queues vectors serve one Rx queue each, in order.
+	 */
+	if (adapter->num_q_vectors < adapter->num_rx_queues)
+		return;
+
+	netdev->rx_cpu_rmap = alloc_irq_cpu_rmap(adapter->num_rx_queues);
+	if (!netdev->rx_cpu_rmap)
+		return;
+
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		err = irq_cpu_rmap_add(netdev->rx_cpu_rmap,
+				       adapter->msix_entries[i].vector);
+		if (err) {
+			free_irq_cpu_rmap(netdev->rx_cpu_rmap);
+			netdev->rx_cpu_rmap = NULL;
+			return;
+		}
+	}
+}
+
+static void ixgbe_free_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+	free_irq_cpu_rmap(adapter->netdev->rx_cpu_rmap);
+	adapter->netdev->rx_cpu_rmap = NULL;
+}
+#else
+static inline void ixgbe_arfs_subtask(struct ixgbe_adapter *adapter) {}
+static inline void ixgbe_arfs_flush(struct ixgbe_adapter *adapter) {}
+static inline void ixgbe_set_rx_cpu_rmap(struct ixgbe_adapter *adapter) {}
+static inline void ixgbe_free_rx_cpu_rmap(struct ixgbe_adapter *adapter) {}
+#endif /* CONFIG_RFS_ACCEL */
+
 /**
  * ixgbe_request_msix_irqs - Initialize MSI-X interrupts
  * @adapter: board private structure
@@ -2752,6 +3162,8 @@ static int ixgbe_request_msix_irqs(struct ixgbe_adapter *adapter)
 		goto free_queue_irqs;
 	}
 
+	ixgbe_set_rx_cpu_rmap(adapter);
+
 	return 0;
 
 free_queue_irqs:
@@ -2876,6 +3288,8 @@ static void ixgbe_free_irq(struct ixgbe_adapter *adapter)
 		return;
 	}
 
+	ixgbe_free_rx_cpu_rmap(adapter);
+
 	for (vector = 0; vector < adapter->num_q_vectors; vector++) {
 		struct ixgbe_q_vector *q_vector = adapter->q_vector[vector];
 		struct msix_entry *entry = &adapter->msix_entries[vector];
@@ -4970,6 +5384,9 @@ void ixgbe_down(struct ixgbe_adapter *adapter)
 	ixgbe_clean_all_tx_rings(adapter);
 	ixgbe_clean_all_rx_rings(adapter);
 
+	/* the reset above cleared the Flow Director table */
+	ixgbe_arfs_flush(adapter);
+
 #ifdef CONFIG_IXGBE_DCA
 	/* since we reset the hardware DCA settings were cleared */
 	ixgbe_setup_dca(adapter);
@@ -5082,6 +5499,10 @@ static int ixgbe_sw_init(struct ixgbe_adapter *adapter)
 #endif
 	/* n-tuple support exists, always init our spinlock */
 	spin_lock_init(&adapter->fdir_perfect_lock);
+#ifdef CONFIG_RFS_ACCEL
+	spin_lock_init(&adapter->arfs_lock);
+	INIT_LIST_HEAD(&adapter->arfs_list);
+#endif
 
 #ifdef CONFIG_IXGBE_DCB
 	switch (hw->mac.type) {
@@ -5435,6 +5856,11 @@ static int ixgbe_change_mtu(struct net_device *netdev, int new_mtu)
 	if ((new_mtu < 68) || (max_frame > IXGBE_MAX_JUMBO_FRAME_SIZE))
 		return -EINVAL;
 
+	/* an attached XDP program needs every frame in a single buffer */
+	if (rcu_access_pointer(adapter->xdp_prog) &&
+	    max_frame + VLAN_HLEN > IXGBE_RXBUFFER_2K)
+		return -EINVAL;
+
 	/*
 	 * For 82599EB we cannot allow legacy VFs to enable their receive
 	 * paths when MTU greater than 1500 is configured.  So display a
@@ -5738,6 +6164,7 @@ void ixgbe_update_stats(struct ixgbe_adapter *adapter)
 	u64 non_eop_descs = 0, restart_queue = 0, tx_busy = 0;
 	u64 alloc_rx_page_failed = 0, alloc_rx_buff_failed = 0;
 	u64 bytes = 0, packets = 0, hw_csum_rx_error = 0;
+	u64 xdp_drops = 0, xdp_tx_failed = 0;
 
 	if (test_bit(__IXGBE_DOWN, &adapter->state) ||
 	    test_bit(__IXGBE_RESETTING, &adapter->state))
@@ -5760,6 +6187,8 @@ void ixgbe_update_stats(struct ixgbe_adapter *adapter)
 		alloc_rx_page_failed += rx_ring->rx_stats.alloc_rx_page_failed;
 		alloc_rx_buff_failed += rx_ring->rx_stats.alloc_rx_buff_failed;
 		hw_csum_rx_error += rx_ring->rx_stats.csum_err;
+		xdp_drops += rx_ring->rx_stats.xdp_drops;
+		xdp_tx_failed += rx_ring->rx_stats.xdp_tx_failed;
 		bytes += rx_ring->stats.bytes;
 		packets += rx_ring->stats.packets;
 	}
@@ -5767,6 +6196,8 @@ void ixgbe_update_stats(struct ixgbe_adapter *adapter)
 	adapter->alloc_rx_page_failed = alloc_rx_page_failed;
 	adapter->alloc_rx_buff_failed = alloc_rx_buff_failed;
 	adapter->hw_csum_rx_error = hw_csum_rx_error;
+	adapter->xdp_drops = xdp_drops;
+	adapter->xdp_tx_failed = xdp_tx_failed;
 	netdev->stats.rx_bytes = bytes;
 	netdev->stats.rx_packets = packets;
 
@@ -6542,6 +6973,7 @@ static void ixgbe_service_task(struct work_struct *work)
 	ixgbe_check_overtemp_subtask(adapter);
 	ixgbe_watchdog_subtask(adapter);
 	ixgbe_fdir_reinit_subtask(adapter);
+	ixgbe_arfs_subtask(adapter);
 	ixgbe_check_hang_subtask(adapter);
 
 	if (test_bit(__IXGBE_PTP_RUNNING, &adapter->state)) {
@@ -7562,6 +7994,10 @@ static netdev_features_t ixgbe_fix_features(struct net_device *netdev,
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE))
 		features &= ~NETIF_F_LRO;
 
+	/* XDP programs must see every frame in a single buffer */
+	if (rcu_access_pointer(adapter->xdp_prog))
+		features &= ~NETIF_F_LRO;
+
 	return features;
 }
 
@@ -7811,6 +8247,56 @@ static void ixgbe_fwd_del(struct net_device *pdev, void *priv)
 	kfree(fwd_adapter);
 }
 
+static int ixgbe_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+	int frame_size = dev->mtu + ETH_HLEN + ETH_FCS_LEN + VLAN_HLEN;
+	struct bpf_prog *old_prog;
+
+	if (prog) {
+		/* the program only ever sees frames in a single rx buffer */
+		if (frame_size > IXGBE_RXBUFFER_2K) {
+			e_dev_err("MTU too large to enable XDP\n");
+			return -EINVAL;
+		}
+
+		/* hardware coalesced frames would bypass the program */
+		if (dev->features & NETIF_F_LRO) {
+			e_dev_err("LRO must be disabled to enable XDP\n");
+			return -EINVAL;
+		}
+	}
+
+	old_prog = rtnl_dereference(adapter->xdp_prog);
+	rcu_assign_pointer(adapter->xdp_prog, prog);
+
+	/* LRO is not offered anymore while a program is attached */
+	netdev_update_features(dev);
+
+	if (old_prog) {
+		/* wait for in-flight NAPI polls still running the old prog */
+		synchronize_net();
+		bpf_prog_put(old_prog);
+	}
+
+	return 0;
+}
+
+static int ixgbe_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return ixgbe_xdp_setup(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(adapter->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -7850,11 +8336,15 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #endif /* IXGBE_FCOE */
 	.ndo_set_features = ixgbe_set_features,
 	.ndo_fix_features = ixgbe_fix_features,
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer	= ixgbe_rx_flow_steer,
+#endif
 	.ndo_fdb_add		= ixgbe_ndo_fdb_add,
 	.ndo_bridge_setlink	= ixgbe_ndo_bridge_setlink,
 	.ndo_bridge_getlink	= ixgbe_ndo_bridge_getlink,
 	.ndo_dfwd_add_station	= ixgbe_fwd_add,
 	.ndo_dfwd_del_station	= ixgbe_fwd_del,
+	.ndo_xdp		= ixgbe_xdp,
 };
 
 /**
@@ -8426,6 +8916,9 @@ static void ixgbe_remove(struct pci_dev *pdev)
 	if (netdev->reg_state == NETREG_REGISTERED)
 		unregister_netdev(netdev);
 
+	if (rcu_access_pointer(adapter->xdp_prog))
+		bpf_prog_put(rcu_dereference_protected(adapter->xdp_prog, 1));
+
 #ifdef CONFIG_PCI_IOV
 	/*
 	 * Only disable SR-IOV on unload if the user specified the now
@@ -66,6 +66,9 @@ int mlx4_en_create_cq(struct mlx4_en_priv *priv,
 
 	cq->ring = ring;
 	cq->is_tx = mode;
+	if (!cq->is_tx)
+		net_dim_init(&cq->dim, NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE,
+			     mlx4_en_rx_dim_work);
 
 	/* Allocate HW buffers on provided NUMA node.
 	 * dev->numa_node is used in mtt range allocation flow.
@@ -177,6 +180,17 @@ int mlx4_en_activate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
 
 		netif_napi_add(cq->dev, &cq->napi, mlx4_en_poll_rx_cq, 64);
 		napi_hash_add(&cq->napi);
+
+		/* Adaptive moderation starts over from its default profile */
+		net_dim_init(&cq->dim, NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE,
+			     mlx4_en_rx_dim_work);
+		if (priv->adaptive_rx_coal) {
+			struct net_dim_cq_moder moder =
+				net_dim_get_def_rx_moderation(cq->dim.mode);
+
+			cq->moder_time = moder.usec;
+			cq->moder_cnt = moder.pkts;
+		}
 	}
 
 	napi_enable(&cq->napi);
@@ -205,6 +219,7 @@ void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 {
 	napi_disable(&cq->napi);
 	if (!cq->is_tx) {
+		cancel_work_sync(&cq->dim.work);
 		napi_hash_del(&cq->napi);
 		synchronize_rcu();
 		irq_set_affinity_hint(cq->mcq.irq, NULL);
@@ -64,9 +64,11 @@ static int mlx4_en_moderation_update(struct mlx4_en_priv *priv)
 		return 0;
 
 	for (i = 0; i < priv->rx_ring_num; i++) {
+		/* a pending adaptive update must not override these */
+		cancel_work_sync(&priv->rx_cq[i]->dim.work);
+		priv->rx_cq[i]->dim.state = NET_DIM_START_MEASURE;
 		priv->rx_cq[i]->moder_cnt = priv->rx_frames;
 		priv->rx_cq[i]->moder_time = priv->rx_usecs;
-		priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
 		if (priv->port_up) {
 			err = mlx4_en_set_cq_moder(priv, priv->rx_cq[i]);
 			if (err)
@@ -40,6 +40,7 @@
 #include <net/ip.h>
 #include <net/busy_poll.h>
 #include <net/vxlan.h>
+#include <linux/bpf.h>
 
 #include <linux/mlx4/driver.h>
 #include <linux/mlx4/device.h>
@@ -1339,9 +1340,6 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 		cq = priv->rx_cq[i];
 		cq->moder_cnt = priv->rx_frames;
 		cq->moder_time = priv->rx_usecs;
-		priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
-		priv->last_moder_packets[i] = 0;
-		priv->last_moder_bytes[i] = 0;
 	}
 
 	for (i = 0; i < priv->tx_ring_num; i++) {
@@ -1357,71 +1355,6 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 	priv->rx_usecs_high = MLX4_EN_RX_COAL_TIME_HIGH;
 	priv->sample_interval = MLX4_EN_SAMPLE_INTERVAL;
 	priv->adaptive_rx_coal = 1;
-	priv->last_moder_jiffies = 0;
-	priv->last_moder_tx_packets = 0;
-}
-
-static void mlx4_en_auto_moderation(struct mlx4_en_priv *priv)
-{
-	unsigned long period = (unsigned long) (jiffies - priv->last_moder_jiffies);
-	struct mlx4_en_cq *cq;
-	unsigned long packets;
-	unsigned long rate;
-	unsigned long avg_pkt_size;
-	unsigned long rx_packets;
-	unsigned long rx_bytes;
-	unsigned long rx_pkt_diff;
-	int moder_time;
-	int ring, err;
-
-	if (!priv->adaptive_rx_coal || period < priv->sample_interval * HZ)
-		return;
-
-	for (ring = 0; ring < priv->rx_ring_num; ring++) {
-		spin_lock_bh(&priv->stats_lock);
-		rx_packets = priv->rx_ring[ring]->packets;
-		rx_bytes = priv->rx_ring[ring]->bytes;
-		spin_unlock_bh(&priv->stats_lock);
-
-		rx_pkt_diff = ((unsigned long) (rx_packets -
-				priv->last_moder_packets[ring]));
-		packets = rx_pkt_diff;
-		rate = packets * HZ / period;
-		avg_pkt_size = packets ? ((unsigned long) (rx_bytes -
-				priv->last_moder_bytes[ring])) / packets : 0;
-
-		/* Apply auto-moderation only when packet rate
-		 * exceeds a rate that it matters */
-		if (rate > (MLX4_EN_RX_RATE_THRESH / priv->rx_ring_num) &&
-		    avg_pkt_size > MLX4_EN_AVG_PKT_SMALL) {
-			if (rate < priv->pkt_rate_low)
-				moder_time = priv->rx_usecs_low;
-			else if (rate > priv->pkt_rate_high)
-				moder_time = priv->rx_usecs_high;
-			else
-				moder_time = (rate - priv->pkt_rate_low) *
-					(priv->rx_usecs_high - priv->rx_usecs_low) /
-					(priv->pkt_rate_high - priv->pkt_rate_low) +
-					priv->rx_usecs_low;
-		} else {
-			moder_time = priv->rx_usecs_low;
-		}
-
-		if (moder_time != priv->last_moder_time[ring]) {
-			priv->last_moder_time[ring] = moder_time;
-			cq = priv->rx_cq[ring];
-			cq->moder_time = moder_time;
-			cq->moder_cnt = priv->rx_frames;
-			err = mlx4_en_set_cq_moder(priv, cq);
-			if (err)
-				en_err(priv, "Failed modifying moderation for cq:%d\n",
-				       ring);
-		}
-		priv->last_moder_packets[ring] = rx_packets;
-		priv->last_moder_bytes[ring] = rx_bytes;
-	}
-
-	priv->last_moder_jiffies = jiffies;
 }
 
 static void mlx4_en_do_get_stats(struct work_struct *work)
@@ -1438,8 +1371,6 @@ static void mlx4_en_do_get_stats(struct work_struct *work)
 			err = mlx4_en_DUMP_ETH_STATS(mdev, priv->port, 0);
 			if (err)
 				en_dbg(HW, priv, "Could not update stats\n");
-
-			mlx4_en_auto_moderation(priv);
 		}
 
 		queue_delayed_work(mdev->workqueue, &priv->stats_task, STATS_DELAY);
@@ -2066,6 +1997,9 @@ void mlx4_en_destroy_netdev(struct net_device *dev)
 
 	mlx4_en_free_resources(priv);
 
+	if (rcu_access_pointer(priv->xdp_prog))
+		bpf_prog_put(rcu_dereference_protected(priv->xdp_prog, 1));
+
 	kfree(priv->tx_ring);
 	kfree(priv->tx_cq);
 
@@ -2085,6 +2019,12 @@ static int mlx4_en_change_mtu(struct net_device *dev, int new_mtu)
 		en_err(priv, "Bad MTU size:%d.\n", new_mtu);
 		return -EPERM;
 	}
+	if (rtnl_dereference(priv->xdp_prog) &&
+	    new_mtu + ETH_HLEN + VLAN_HLEN > FRAG_SZ0) {
+		en_err(priv, "MTU size:%d requires more than one fragment, not supported with XDP\n",
+		       new_mtu);
+		return -EOPNOTSUPP;
+	}
 	dev->mtu = new_mtu;
 
 	if (netif_running(dev)) {
@@ -2362,6 +2302,45 @@ static bool mlx4_en_gso_check(struct sk_buff *skb, struct net_device *dev)
 }
 #endif
 
+static int mlx4_en_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct mlx4_en_priv *priv = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+
+	/* the program only ever sees frames held in the first fragment */
+	if (prog && dev->mtu + ETH_HLEN + VLAN_HLEN > FRAG_SZ0) {
+		en_err(priv, "MTU size:%d requires more than one fragment, not supported with XDP\n",
+		       dev->mtu);
+		return -EOPNOTSUPP;
+	}
+
+	old_prog = rtnl_dereference(priv->xdp_prog);
+	rcu_assign_pointer(priv->xdp_prog, prog);
+
+	if (old_prog) {
+		/* wait for in-flight NAPI polls still running the old prog */
+		synchronize_net();
+		bpf_prog_put(old_prog);
+	}
+
+	return 0;
+}
+
+static int mlx4_en_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct mlx4_en_priv *priv = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return mlx4_en_xdp_setup(dev, xdp->prog);
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(priv->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops mlx4_netdev_ops = {
 	.ndo_open		= mlx4_en_open,
 	.ndo_stop		= mlx4_en_close,
@@ -2393,6 +2372,7 @@ static const struct net_device_ops mlx4_netdev_ops = {
 	.ndo_del_vxlan_port	= mlx4_en_del_vxlan_port,
 	.ndo_gso_check		= mlx4_en_gso_check,
 #endif
+	.ndo_xdp		= mlx4_en_xdp,
 };
 
 static const struct net_device_ops mlx4_netdev_ops_master = {
@@ -2427,6 +2407,7 @@ static const struct net_device_ops mlx4_netdev_ops_master = {
 	.ndo_del_vxlan_port	= mlx4_en_del_vxlan_port,
 	.ndo_gso_check		= mlx4_en_gso_check,
 #endif
+	.ndo_xdp		= mlx4_en_xdp,
 };
 
 int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
@@ -41,6 +41,7 @@
 #include <linux/if_vlan.h>
 #include <linux/vmalloc.h>
 #include <linux/irq.h>
+#include <linux/filter.h>
 
 #include "mlx4_en.h"
 
@@ -643,6 +644,50 @@ static void mlx4_en_refill_rx_buffers(struct mlx4_en_priv *priv,
 	}
 }
 
+/* Run the attached XDP program on a frame held in the first fragment.
+ * Returns true when the program consumed the frame; the fragments are
+ * then released by the caller exactly as for a dropped packet.
+ */
+static bool mlx4_en_run_xdp(struct mlx4_en_priv *priv,
+			    struct bpf_prog *xdp_prog,
+			    struct mlx4_en_rx_desc *rx_desc,
+			    struct mlx4_en_rx_alloc *frags,
+			    unsigned int length, int ring)
+{
+	struct xdp_buff xdp;
+	dma_addr_t dma;
+	u32 act;
+
+	if (length > priv->frag_info[0].frag_size || !frags[0].page)
+		return false;
+
+	dma = be64_to_cpu(rx_desc->data[0].addr);
+	dma_sync_single_for_cpu(priv->ddev, dma, length, DMA_FROM_DEVICE);
+
+	xdp.data = page_address(frags[0].page) + frags[0].page_offset;
+	xdp.data_end = xdp.data + length;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		return false;
+	case XDP_TX:
+		if (xdp_do_tx(priv->dev, &xdp, ring))
+			priv->stats.tx_dropped++;
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(priv->dev, &xdp))
+			priv->stats.tx_dropped++;
+		break;
+	default:
+	case XDP_ABORTED:
+	case XDP_DROP:
+		priv->stats.rx_dropped++;
+		break;
+	}
+	return true;
+}
+
 int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int budget)
 {
 	struct mlx4_en_priv *priv = netdev_priv(dev);
@@ -651,6 +696,7 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 	struct mlx4_en_rx_ring *ring = priv->rx_ring[cq->ring];
 	struct mlx4_en_rx_alloc *frags;
 	struct mlx4_en_rx_desc *rx_desc;
+	struct bpf_prog *xdp_prog;
 	struct sk_buff *skb;
 	int index;
 	int nr;
@@ -673,6 +719,10 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 	index = cq->mcq.cons_index & ring->size_mask;
 	cqe = mlx4_en_get_cqe(cq->buf, index, priv->cqe_size) + factor;
 
+	/* Protect accesses to the XDP program across the polling loop */
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(priv->xdp_prog);
+
 	/* Process all completed CQEs */
 	while (XNOR(cqe->owner_sr_opcode & MLX4_CQE_OWNER_MASK,
 		    cq->mcq.cons_index & cq->size)) {
@@ -740,6 +790,12 @@ int mlx4_en_process_rx_cq(struct net_device *dev, struct mlx4_en_cq *cq, int bud
 		length -= ring->fcs_del;
 		ring->bytes += length;
 		ring->packets++;
+
+		if (xdp_prog &&
+		    mlx4_en_run_xdp(priv, xdp_prog, rx_desc, frags, length,
+				    cq->ring))
+			goto next;
+
 		l2_tunnel = (dev->hw_enc_features & NETIF_F_RXCSUM) &&
 			(cqe->vlan_my_qpn & cpu_to_be32(MLX4_CQE_L2_TUNNEL));
 
@@ -864,6 +920,7 @@ next:
 	}
 
 out:
+	rcu_read_unlock();
 	AVG_PERF_COUNTER(priv->pstats.rx_coal_avg, polled);
 	mlx4_cq_set_ci(&cq->mcq);
 	wmb(); /* ensure HW sees CQ consumer before we post new buffers */
@@ -879,12 +936,39 @@ void mlx4_en_rx_irq(struct mlx4_cq *mcq)
 	struct mlx4_en_cq *cq = container_of(mcq, struct mlx4_en_cq, mcq);
 	struct mlx4_en_priv *priv = netdev_priv(cq->dev);
 
+	cq->event_ctr++;
 	if (priv->port_up)
 		napi_schedule(&cq->napi);
 	else
 		mlx4_en_arm_cq(priv, cq);
 }
 
+void mlx4_en_rx_dim_work(struct work_struct *work)
+{
+	struct net_dim *dim = container_of(work, struct net_dim, work);
+	struct mlx4_en_cq *cq = container_of(dim, struct mlx4_en_cq, dim);
+	struct mlx4_en_priv *priv = netdev_priv(cq->dev);
+	struct net_dim_cq_moder moder;
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	cq->moder_time = moder.usec;
+	cq->moder_cnt = moder.pkts;
+	if (mlx4_en_set_cq_moder(priv, cq))
+		en_err(priv, "Failed modifying moderation for cq:%d\n",
+		       cq->ring);
+
+	dim->state = NET_DIM_START_MEASURE;
+}
+
+static void mlx4_en_rx_dim(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
+{
+	struct mlx4_en_rx_ring *ring = priv->rx_ring[cq->ring];
+	struct net_dim_sample sample;
+
+	net_dim_sample(cq->event_ctr, ring->packets, ring->bytes, &sample);
+	net_dim(&cq->dim, sample);
+}
+
 /* Rx CQ polling - called by NAPI */
 int mlx4_en_poll_rx_cq(struct napi_struct *napi, int budget)
 {
@@ -922,6 +1006,8 @@ int mlx4_en_poll_rx_cq(struct napi_struct *napi, int budget)
 	} else {
 		/* Done for now */
 		napi_complete(napi);
+		if (priv->adaptive_rx_coal)
+			mlx4_en_rx_dim(priv, cq);
 		mlx4_en_arm_cq(priv, cq);
 	}
 	return done;
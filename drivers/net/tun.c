@@ -787,7 +787,7 @@ static netdev_tx_t tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 			  >= dev->tx_queue_len)
 		goto drop;
 
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		goto drop;
 
 	if (skb->sk) {
@@ -1009,6 +1009,97 @@ static struct sk_buff *tun_alloc_skb(struct tun_file *tfile,
 	return skb;
 }
 
+/* Set protocol and offloads of a frame whose headers were already parsed.
+ * Frees the skb on error.
+ */
+static int tun_skb_from_hdrs(struct tun_struct *tun, struct sk_buff *skb,
+			     struct tun_pi *pi, struct virtio_net_hdr *gso)
+{
+	if (gso->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+		if (!skb_partial_csum_set(skb, gso->csum_start,
+					  gso->csum_offset)) {
+			tun->dev->stats.rx_frame_errors++;
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+	}
+
+	switch (tun->flags & TUN_TYPE_MASK) {
+	case TUN_TUN_DEV:
+		if (tun->flags & TUN_NO_PI) {
+			switch (skb->data[0] & 0xf0) {
+			case 0x40:
+				pi->proto = htons(ETH_P_IP);
+				break;
+			case 0x60:
+				pi->proto = htons(ETH_P_IPV6);
+				break;
+			default:
+				tun->dev->stats.rx_dropped++;
+				kfree_skb(skb);
+				return -EINVAL;
+			}
+		}
+
+		skb_reset_mac_header(skb);
+		skb->protocol = pi->proto;
+		skb->dev = tun->dev;
+		break;
+	case TUN_TAP_DEV:
+		skb->protocol = eth_type_trans(skb, tun->dev);
+		break;
+	}
+
+	skb_reset_network_header(skb);
+
+	if (gso->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+		pr_debug("GSO!\n");
+		switch (gso->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+		case VIRTIO_NET_HDR_GSO_TCPV4:
+			skb_shinfo(skb)->gso_type = SKB_GSO_TCPV4;
+			break;
+		case VIRTIO_NET_HDR_GSO_TCPV6:
+			skb_shinfo(skb)->gso_type = SKB_GSO_TCPV6;
+			break;
+		case VIRTIO_NET_HDR_GSO_UDP:
+		{
+			static bool warned;
+
+			if (!warned) {
+				warned = true;
+				netdev_warn(tun->dev,
+					    "%s: using disabled UFO feature; please fix this program\n",
+					    current->comm);
+			}
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
+			if (skb->protocol == htons(ETH_P_IPV6))
+				ipv6_proxy_select_ident(skb);
+			break;
+		}
+		default:
+			tun->dev->stats.rx_frame_errors++;
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+
+		if (gso->gso_type & VIRTIO_NET_HDR_GSO_ECN)
+			skb_shinfo(skb)->gso_type |= SKB_GSO_TCP_ECN;
+
+		skb_shinfo(skb)->gso_size = gso->gso_size;
+		if (skb_shinfo(skb)->gso_size == 0) {
+			tun->dev->stats.rx_frame_errors++;
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+
+		/* Header must be checked, and gso_segs computed. */
+		skb_shinfo(skb)->gso_type |= SKB_GSO_DODGY;
+		skb_shinfo(skb)->gso_segs = 0;
+	}
+
+	return 0;
+}
+
 /* Get packet from user space buffer */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, const struct iovec *iv,
@@ -1105,87 +1196,9 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 		return -EFAULT;
 	}
 
-	if (gso.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
-		if (!skb_partial_csum_set(skb, gso.csum_start,
-					  gso.csum_offset)) {
-			tun->dev->stats.rx_frame_errors++;
-			kfree_skb(skb);
-			return -EINVAL;
-		}
-	}
-
-	switch (tun->flags & TUN_TYPE_MASK) {
-	case TUN_TUN_DEV:
-		if (tun->flags & TUN_NO_PI) {
-			switch (skb->data[0] & 0xf0) {
-			case 0x40:
-				pi.proto = htons(ETH_P_IP);
-				break;
-			case 0x60:
-				pi.proto = htons(ETH_P_IPV6);
-				break;
-			default:
-				tun->dev->stats.rx_dropped++;
-				kfree_skb(skb);
-				return -EINVAL;
-			}
-		}
-
-		skb_reset_mac_header(skb);
-		skb->protocol = pi.proto;
-		skb->dev = tun->dev;
-		break;
-	case TUN_TAP_DEV:
-		skb->protocol = eth_type_trans(skb, tun->dev);
-		break;
-	}
-
-	skb_reset_network_header(skb);
-
-	if (gso.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
-		pr_debug("GSO!\n");
-		switch (gso.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
-		case VIRTIO_NET_HDR_GSO_TCPV4:
-			skb_shinfo(skb)->gso_type = SKB_GSO_TCPV4;
-			break;
-		case VIRTIO_NET_HDR_GSO_TCPV6:
-			skb_shinfo(skb)->gso_type = SKB_GSO_TCPV6;
-			break;
-		case VIRTIO_NET_HDR_GSO_UDP:
-		{
-			static bool warned;
-
-			if (!warned) {
-				warned = true;
-				netdev_warn(tun->dev,
-					    "%s: using disabled UFO feature; please fix this program\n",
-					    current->comm);
-			}
-			skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
-			if (skb->protocol == htons(ETH_P_IPV6))
-				ipv6_proxy_select_ident(skb);
-			break;
-		}
-		default:
-			tun->dev->stats.rx_frame_errors++;
-			kfree_skb(skb);
-			return -EINVAL;
-		}
-
-		if (gso.gso_type & VIRTIO_NET_HDR_GSO_ECN)
-			skb_shinfo(skb)->gso_type |= SKB_GSO_TCP_ECN;
-
-		skb_shinfo(skb)->gso_size = gso.gso_size;
-		if (skb_shinfo(skb)->gso_size == 0) {
-			tun->dev->stats.rx_frame_errors++;
-			kfree_skb(skb);
-			return -EINVAL;
-		}
-
-		/* Header must be checked, and gso_segs computed. */
-		skb_shinfo(skb)->gso_type |= SKB_GSO_DODGY;
-		skb_shinfo(skb)->gso_segs = 0;
-	}
+	err = tun_skb_from_hdrs(tun, skb, &pi, &gso);
+	if (err)
+		return err;
 
 	/* copy skb_ubuf_info for callback when skb has no error */
 	if (zerocopy) {
@@ -1206,6 +1219,97 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	return total_len;
 }
 
+static struct sk_buff *tun_build_frame(struct tun_struct *tun,
+				       struct tun_frame *frame)
+{
+	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
+	struct virtio_net_hdr gso = { 0 };
+	void *data = frame->buf + frame->offset;
+	size_t len = frame->len, hlen = 0;
+	struct sk_buff *skb;
+	int err = -EINVAL;
+
+	if (!(tun->flags & TUN_NO_PI)) {
+		if (len < sizeof(pi))
+			goto drop;
+		memcpy(&pi, data, sizeof(pi));
+		hlen += sizeof(pi);
+	}
+
+	if (tun->flags & TUN_VNET_HDR) {
+		if (len - hlen < tun->vnet_hdr_sz)
+			goto drop;
+		memcpy(&gso, data + hlen, sizeof(gso));
+		hlen += tun->vnet_hdr_sz;
+	}
+	len -= hlen;
+
+	if (!len ||
+	    ((tun->flags & TUN_TYPE_MASK) == TUN_TAP_DEV && len < ETH_HLEN))
+		goto drop;
+
+	skb = build_skb(frame->buf, frame->buflen);
+	if (!skb) {
+		err = -ENOMEM;
+		goto drop;
+	}
+	skb_reserve(skb, frame->offset + hlen);
+	skb_put(skb, len);
+
+	err = tun_skb_from_hdrs(tun, skb, &pi, &gso);
+	if (err)
+		return ERR_PTR(err);
+
+	tun->dev->stats.rx_packets++;
+	tun->dev->stats.rx_bytes += len;
+
+	return skb;
+
+drop:
+	tun->dev->stats.rx_dropped++;
+	put_page(virt_to_head_page(frame->buf));
+	return ERR_PTR(err);
+}
+
+static void tun_put_frames(struct tun_frame *frames, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		put_page(virt_to_head_page(frames[i].buf));
+}
+
+/* Frames the sender already copied in, as a batch: build the skbs around
+ * them and pass them up as a list, without going through the backlog.
+ */
+static void tun_get_frames(struct tun_struct *tun, struct tun_file *tfile,
+			   struct tun_frame *frames, int n)
+{
+	struct sk_buff *skb;
+	LIST_HEAD(list);
+	u32 rxhash;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		skb = tun_build_frame(tun, &frames[i]);
+		if (IS_ERR(skb))
+			continue;
+
+		skb_probe_transport_header(skb, 0);
+
+		rxhash = skb_get_hash(skb);
+		tun_flow_update(tun, rxhash, tfile);
+		list_add_tail(&skb->list, &list);
+	}
+
+	if (list_empty(&list))
+		return;
+
+	local_bh_disable();
+	netif_receive_skb_list(&list);
+	local_bh_enable();
+}
+
 static ssize_t tun_chr_aio_write(struct kiocb *iocb, const struct iovec *iv,
 			      unsigned long count, loff_t pos)
 {
@@ -1459,11 +1563,24 @@ static int tun_sendmsg(struct kiocb *iocb, struct socket *sock,
 	int ret;
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
 
-	if (!tun)
+	if (!tun) {
+		if (ctl && ctl->type == TUN_MSG_PTR)
+			tun_put_frames(ctl->ptr, ctl->num);
 		return -EBADFD;
-	ret = tun_get_user(tun, tfile, m->msg_control, m->msg_iov, total_len,
+	}
+
+	if (ctl && ctl->type == TUN_MSG_PTR) {
+		tun_get_frames(tun, tfile, ctl->ptr, ctl->num);
+		ret = total_len;
+		goto out;
+	}
+
+	ret = tun_get_user(tun, tfile, ctl && ctl->type == TUN_MSG_UBUF ?
+			   ctl->ptr : NULL, m->msg_iov, total_len,
 			   m->msg_iovlen, m->msg_flags & MSG_DONTWAIT);
+out:
 	tun_put(tun);
 	return ret;
 }
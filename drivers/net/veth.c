@@ -13,6 +13,7 @@
 #include <linux/ethtool.h>
 #include <linux/etherdevice.h>
 #include <linux/u64_stats_sync.h>
+#include <linux/ptr_ring.h>
 
 #include <net/rtnetlink.h>
 #include <net/dst.h>
@@ -26,17 +27,52 @@
 #define MIN_MTU 68		/* Min L3 MTU */
 #define MAX_MTU 65535		/* Max L3 MTU (arbitrary) */
 
+#define VETH_RING_SIZE	256
+
 struct pcpu_vstats {
 	u64			packets;
 	u64			bytes;
 	struct u64_stats_sync	syncp;
 };
 
+/*
+ * Receive queue of a veth device.  The peer's xmit queues skbs on the ring
+ * and schedules the napi, which then runs them through GRO on the cpu the
+ * napi was scheduled on.  napi_ptr is only set while the device is up, the
+ * peer falls back to netif_rx() when it finds it NULL.
+ */
+struct veth_rq {
+	struct napi_struct	napi;
+	struct napi_struct __rcu *napi_ptr;
+	struct ptr_ring		ring;
+	bool			rx_notify_masked;
+} ____cacheline_aligned_in_smp;
+
 struct veth_priv {
 	struct net_device __rcu	*peer;
 	atomic64_t		dropped;
+	struct veth_rq		*rq;
 };
 
+/* without sysfs the core keeps no rx queue state, there is a single one */
+static unsigned int veth_num_rxqs(const struct net_device *dev)
+{
+#ifdef CONFIG_SYSFS
+	return dev->num_rx_queues;
+#else
+	return 1;
+#endif
+}
+
+static unsigned int veth_real_rxqs(const struct net_device *dev)
+{
+#ifdef CONFIG_SYSFS
+	return dev->real_num_rx_queues;
+#else
+	return 1;
+#endif
+}
+
 /*
  * ethtool interface
  */
@@ -96,6 +132,15 @@ static void veth_get_ethtool_stats(struct net_device *dev,
 	data[0] = peer ? peer->ifindex : 0;
 }
 
+static void veth_get_channels(struct net_device *dev,
+			      struct ethtool_channels *channels)
+{
+	channels->max_rx = veth_num_rxqs(dev);
+	channels->max_tx = dev->num_tx_queues;
+	channels->rx_count = veth_real_rxqs(dev);
+	channels->tx_count = dev->real_num_tx_queues;
+}
+
 static const struct ethtool_ops veth_ethtool_ops = {
 	.get_settings		= veth_get_settings,
 	.get_drvinfo		= veth_get_drvinfo,
@@ -103,13 +148,36 @@ static const struct ethtool_ops veth_ethtool_ops = {
 	.get_strings		= veth_get_strings,
 	.get_sset_count		= veth_get_sset_count,
 	.get_ethtool_stats	= veth_get_ethtool_stats,
+	.get_channels		= veth_get_channels,
 };
 
+static int veth_forward_skb(struct net_device *rcv, struct sk_buff *skb,
+			    struct veth_rq *rq)
+{
+	if (__dev_forward_skb(rcv, skb))
+		return NET_RX_DROP;
+
+	if (unlikely(ptr_ring_produce(&rq->ring, skb))) {
+		dev_kfree_skb_any(skb);
+		return NET_RX_DROP;
+	}
+
+	/* pairs with the barrier after unmasking in veth_poll() */
+	smp_mb();
+	if (!rq->rx_notify_masked) {
+		rq->rx_notify_masked = true;
+		napi_schedule(&rq->napi);
+	}
+	return NET_RX_SUCCESS;
+}
+
 static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 {
-	struct veth_priv *priv = netdev_priv(dev);
+	struct veth_priv *rcv_priv, *priv = netdev_priv(dev);
 	struct net_device *rcv;
+	struct veth_rq *rq;
 	int length = skb->len;
+	int ret;
 
 	rcu_read_lock();
 	rcv = rcu_dereference(priv->peer);
@@ -124,7 +192,15 @@ static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 	    rcv->features & NETIF_F_RXCSUM)
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 
-	if (likely(dev_forward_skb(rcv, skb) == NET_RX_SUCCESS)) {
+	rcv_priv = netdev_priv(rcv);
+	rq = &rcv_priv->rq[skb_get_queue_mapping(skb) %
+			   veth_real_rxqs(rcv)];
+	if (rcu_access_pointer(rq->napi_ptr))
+		ret = veth_forward_skb(rcv, skb, rq);
+	else
+		ret = dev_forward_skb(rcv, skb);
+
+	if (likely(ret == NET_RX_SUCCESS)) {
 		struct pcpu_vstats *stats = this_cpu_ptr(dev->vstats);
 
 		u64_stats_update_begin(&stats->syncp);
@@ -194,14 +270,89 @@ static void veth_set_multicast_list(struct net_device *dev)
 {
 }
 
+static int veth_poll(struct napi_struct *napi, int budget)
+{
+	struct veth_rq *rq = container_of(napi, struct veth_rq, napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget && (skb = __ptr_ring_consume(&rq->ring))) {
+		napi_gro_receive(napi, skb);
+		done++;
+	}
+
+	if (done < budget) {
+		napi_complete(napi);
+		set_mb(rq->rx_notify_masked, false);
+		if (unlikely(!__ptr_ring_empty(&rq->ring)) &&
+		    napi_schedule_prep(napi)) {
+			rq->rx_notify_masked = true;
+			__napi_schedule(napi);
+		}
+	}
+
+	return done;
+}
+
+static void veth_ptr_free(void *ptr)
+{
+	kfree_skb(ptr);
+}
+
+static void veth_napi_del(struct net_device *dev, unsigned int nr)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		RCU_INIT_POINTER(priv->rq[i].napi_ptr, NULL);
+	/* the peer no longer queues on the rings once this returns */
+	synchronize_net();
+
+	for (i = 0; i < nr; i++) {
+		struct veth_rq *rq = &priv->rq[i];
+
+		napi_disable(&rq->napi);
+		netif_napi_del(&rq->napi);
+		ptr_ring_cleanup(&rq->ring, veth_ptr_free);
+		rq->rx_notify_masked = false;
+	}
+}
+
+static int veth_napi_add(struct net_device *dev)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < veth_real_rxqs(dev); i++) {
+		struct veth_rq *rq = &priv->rq[i];
+
+		err = ptr_ring_init(&rq->ring, VETH_RING_SIZE, GFP_KERNEL);
+		if (err) {
+			veth_napi_del(dev, i);
+			return err;
+		}
+		netif_napi_add(dev, &rq->napi, veth_poll, NAPI_POLL_WEIGHT);
+		napi_enable(&rq->napi);
+		rcu_assign_pointer(rq->napi_ptr, &rq->napi);
+	}
+	return 0;
+}
+
 static int veth_open(struct net_device *dev)
 {
 	struct veth_priv *priv = netdev_priv(dev);
 	struct net_device *peer = rtnl_dereference(priv->peer);
+	int err;
 
 	if (!peer)
 		return -ENOTCONN;
 
+	err = veth_napi_add(dev);
+	if (err)
+		return err;
+
 	if (peer->flags & IFF_UP) {
 		netif_carrier_on(dev);
 		netif_carrier_on(peer);
@@ -218,6 +369,7 @@ static int veth_close(struct net_device *dev)
 	if (peer)
 		netif_carrier_off(peer);
 
+	veth_napi_del(dev, veth_real_rxqs(dev));
 	return 0;
 }
 
@@ -236,14 +388,25 @@ static int veth_change_mtu(struct net_device *dev, int new_mtu)
 
 static int veth_dev_init(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+
 	dev->vstats = netdev_alloc_pcpu_stats(struct pcpu_vstats);
 	if (!dev->vstats)
 		return -ENOMEM;
+
+	priv->rq = kcalloc(veth_num_rxqs(dev), sizeof(*priv->rq), GFP_KERNEL);
+	if (!priv->rq) {
+		free_percpu(dev->vstats);
+		return -ENOMEM;
+	}
 	return 0;
 }
 
 static void veth_dev_free(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+
+	kfree(priv->rq);
 	free_percpu(dev->vstats);
 	free_netdev(dev);
 }
@@ -251,10 +414,9 @@ static void veth_dev_free(struct net_device *dev)
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static void veth_poll_controller(struct net_device *dev)
 {
-	/* veth only receives frames when its peer sends one
-	 * Since it's a synchronous operation, we are guaranteed
-	 * never to have pending data when we poll for it so
-	 * there is nothing to do here.
+	/* veth only receives frames when its peer sends one, and
+	 * those queued on the rings are picked up by netpoll through
+	 * the napi contexts, so there is nothing to do here.
 	 *
 	 * We need this though so netpoll recognizes us as an interface that
 	 * supports polling, which enables bridge devices in virt setups to
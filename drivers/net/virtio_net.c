@@ -50,6 +50,20 @@ module_param(gso, bool, 0444);
 /* Minimum alignment for mergeable packet buffers. */
 #define MERGEABLE_BUFFER_ALIGN max(L1_CACHE_BYTES, 256)
 
+/* Mergeable buffers are turned into skbs in place with build_skb(), so each
+ * one carries headroom in front of the virtio header, which also leaves room
+ * for a packet hook to push headers, and the skb_shared_info at the end.
+ */
+#define VIRTNET_RX_HEADROOM	256
+#define VIRTNET_RX_TAILROOM	SKB_DATA_ALIGN(sizeof(struct skb_shared_info))
+#define VIRTNET_RX_ROOM		(VIRTNET_RX_HEADROOM + VIRTNET_RX_TAILROOM)
+
+/* Number of used up receive pages kept around per queue for reuse, and the
+ * order of the pages mergeable buffers are carved from.
+ */
+#define VIRTNET_PAGE_POOL_SIZE	64
+#define MERGEABLE_RX_PAGE_ORDER	get_order(32768)
+
 #define VIRTNET_DRIVER_VERSION "1.0.0"
 
 struct virtnet_stats {
@@ -90,6 +104,13 @@ struct receive_queue {
 	/* Page frag for packet buffer allocation. */
 	struct page_frag alloc_frag;
 
+	/* Used up frag pages waiting for the stack to release them,
+	 * oldest first, starting at pool_head.
+	 */
+	struct page *page_pool[VIRTNET_PAGE_POOL_SIZE];
+	unsigned int pool_head;
+	unsigned int pool_count;
+
 	/* RX: fragments + linear part + virtio header */
 	struct scatterlist sg[MAX_SKB_FRAGS + 2];
 
@@ -260,13 +281,8 @@ static struct sk_buff *page_to_skb(struct receive_queue *rq,
 
 	hdr = skb_vnet_hdr(skb);
 
-	if (vi->mergeable_rx_bufs) {
-		hdr_len = sizeof hdr->mhdr;
-		hdr_padded_len = sizeof hdr->mhdr;
-	} else {
-		hdr_len = sizeof hdr->hdr;
-		hdr_padded_len = sizeof(struct padded_vnet_hdr);
-	}
+	hdr_len = sizeof hdr->hdr;
+	hdr_padded_len = sizeof(struct padded_vnet_hdr);
 
 	memcpy(hdr, p, hdr_len);
 
@@ -282,14 +298,6 @@ static struct sk_buff *page_to_skb(struct receive_queue *rq,
 	len -= copy;
 	offset += copy;
 
-	if (vi->mergeable_rx_bufs) {
-		if (len)
-			skb_add_rx_frag(skb, 0, page, offset, len, truesize);
-		else
-			put_page(page);
-		return skb;
-	}
-
 	/*
 	 * Verify that we can indeed put this data into a skb.
 	 * This is here to handle cases when the device erroneously
@@ -352,24 +360,38 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 					 unsigned int len)
 {
 	void *buf = mergeable_ctx_to_buf_address(ctx);
-	struct skb_vnet_hdr *hdr = buf;
-	int num_buf = hdr->mhdr.num_buffers;
+	struct virtio_net_hdr_mrg_rxbuf *hdr = buf + VIRTNET_RX_HEADROOM;
+	int num_buf = hdr->num_buffers;
 	struct page *page = virt_to_head_page(buf);
-	int offset = buf - page_address(page);
-	unsigned int truesize = max(len, mergeable_ctx_to_buf_truesize(ctx));
-
-	struct sk_buff *head_skb = page_to_skb(rq, page, offset, len, truesize);
-	struct sk_buff *curr_skb = head_skb;
+	int offset;
+	unsigned int truesize = mergeable_ctx_to_buf_truesize(ctx);
+	struct sk_buff *head_skb = NULL;
+	struct sk_buff *curr_skb;
+
+	if (unlikely(len > truesize - VIRTNET_RX_ROOM)) {
+		pr_debug("%s: rx error: len %u exceeds buffer size %u\n",
+			 dev->name, len, truesize - VIRTNET_RX_ROOM);
+		dev->stats.rx_length_errors++;
+		goto err_skb;
+	}
 
-	if (unlikely(!curr_skb))
+	/* Build the skb around the buffer the device wrote into */
+	head_skb = build_skb(buf, truesize);
+	if (unlikely(!head_skb))
 		goto err_skb;
+	skb_reserve(head_skb, VIRTNET_RX_HEADROOM);
+	skb_put(head_skb, len);
+	memcpy(&skb_vnet_hdr(head_skb)->mhdr, hdr, sizeof(*hdr));
+	__skb_pull(head_skb, sizeof(*hdr));
+
+	curr_skb = head_skb;
 	while (--num_buf) {
 		int num_skb_frags;
 
 		ctx = (unsigned long)virtqueue_get_buf(rq->vq, &len);
 		if (unlikely(!ctx)) {
 			pr_debug("%s: rx error: %d buffers out of %d missing\n",
-				 dev->name, num_buf, hdr->mhdr.num_buffers);
+				 dev->name, num_buf, hdr->num_buffers);
 			dev->stats.rx_length_errors++;
 			goto err_buf;
 		}
@@ -391,13 +413,19 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			head_skb->truesize += nskb->truesize;
 			num_skb_frags = 0;
 		}
-		truesize = max(len, mergeable_ctx_to_buf_truesize(ctx));
+		truesize = mergeable_ctx_to_buf_truesize(ctx);
+		if (unlikely(len > truesize - VIRTNET_RX_ROOM)) {
+			pr_debug("%s: rx error: len %u exceeds buffer size %u\n",
+				 dev->name, len, truesize - VIRTNET_RX_ROOM);
+			dev->stats.rx_length_errors++;
+			goto err_skb;
+		}
 		if (curr_skb != head_skb) {
 			head_skb->data_len += len;
 			head_skb->len += len;
 			head_skb->truesize += truesize;
 		}
-		offset = buf - page_address(page);
+		offset = buf + VIRTNET_RX_HEADROOM - page_address(page);
 		if (skb_can_coalesce(curr_skb, num_skb_frags, page, offset)) {
 			put_page(page);
 			skb_coalesce_rx_frag(curr_skb, num_skb_frags - 1,
@@ -614,8 +642,97 @@ static unsigned int get_mergeable_buf_len(struct ewma *avg_pkt_len)
 	unsigned int len;
 
 	len = hdr_len + clamp_t(unsigned int, ewma_read(avg_pkt_len),
-			GOOD_PACKET_LEN, PAGE_SIZE - hdr_len);
-	return ALIGN(len, MERGEABLE_BUFFER_ALIGN);
+			GOOD_PACKET_LEN, PAGE_SIZE - hdr_len - VIRTNET_RX_ROOM);
+	return ALIGN(len + VIRTNET_RX_ROOM, MERGEABLE_BUFFER_ALIGN);
+}
+
+static void virtnet_pool_put(struct receive_queue *rq, struct page *page)
+{
+	unsigned int tail;
+
+	if (rq->pool_count == VIRTNET_PAGE_POOL_SIZE) {
+		put_page(rq->page_pool[rq->pool_head]);
+		rq->pool_head = (rq->pool_head + 1) % VIRTNET_PAGE_POOL_SIZE;
+		rq->pool_count--;
+	}
+	tail = (rq->pool_head + rq->pool_count) % VIRTNET_PAGE_POOL_SIZE;
+	rq->page_pool[tail] = page;
+	rq->pool_count++;
+}
+
+/* Buffers complete in ring order, so the oldest page is the one to check. */
+static struct page *virtnet_pool_get(struct receive_queue *rq)
+{
+	struct page *page;
+
+	if (!rq->pool_count)
+		return NULL;
+	page = rq->page_pool[rq->pool_head];
+	if (page_count(page) != 1)
+		return NULL;
+	rq->pool_head = (rq->pool_head + 1) % VIRTNET_PAGE_POOL_SIZE;
+	rq->pool_count--;
+	return page;
+}
+
+static void virtnet_pool_free(struct receive_queue *rq)
+{
+	while (rq->pool_count) {
+		put_page(rq->page_pool[rq->pool_head]);
+		rq->pool_head = (rq->pool_head + 1) % VIRTNET_PAGE_POOL_SIZE;
+		rq->pool_count--;
+	}
+}
+
+/*
+ * Like skb_page_frag_refill(), but a used up page is parked in the queue's
+ * pool instead of being released, and taken back from there once the stack
+ * has dropped all its buffers, so that pages cycle between the ring and the
+ * stack without going through the page allocator.
+ */
+static bool virtnet_page_frag_refill(struct receive_queue *rq,
+				     unsigned int sz, gfp_t gfp)
+{
+	struct page_frag *pfrag = &rq->alloc_frag;
+	struct page *page;
+
+	if (pfrag->page) {
+		if (page_count(pfrag->page) == 1) {
+			pfrag->offset = 0;
+			return true;
+		}
+		if (pfrag->offset + sz <= pfrag->size)
+			return true;
+		virtnet_pool_put(rq, pfrag->page);
+		pfrag->page = NULL;
+	}
+
+	page = virtnet_pool_get(rq);
+	if (page) {
+		pfrag->page = page;
+		pfrag->size = PAGE_SIZE << compound_order(page);
+		pfrag->offset = 0;
+		return true;
+	}
+
+	if (MERGEABLE_RX_PAGE_ORDER) {
+		page = alloc_pages(gfp | __GFP_COMP | __GFP_NOWARN |
+				   __GFP_NORETRY, MERGEABLE_RX_PAGE_ORDER);
+		if (likely(page)) {
+			pfrag->page = page;
+			pfrag->size = PAGE_SIZE << MERGEABLE_RX_PAGE_ORDER;
+			pfrag->offset = 0;
+			return true;
+		}
+	}
+	page = alloc_page(gfp);
+	if (likely(page)) {
+		pfrag->page = page;
+		pfrag->size = PAGE_SIZE;
+		pfrag->offset = 0;
+		return true;
+	}
+	return false;
 }
 
 static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
@@ -627,25 +744,25 @@ static int add_recvbuf_mergeable(struct receive_queue *rq, gfp_t gfp)
 	unsigned int len, hole;
 
 	len = get_mergeable_buf_len(&rq->mrg_avg_pkt_len);
-	if (unlikely(!skb_page_frag_refill(len, alloc_frag, gfp)))
+	if (unlikely(!virtnet_page_frag_refill(rq, len, gfp)))
 		return -ENOMEM;
 
 	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
-	ctx = mergeable_buf_to_ctx(buf, len);
 	get_page(alloc_frag->page);
 	alloc_frag->offset += len;
 	hole = alloc_frag->size - alloc_frag->offset;
 	if (hole < len) {
 		/* To avoid internal fragmentation, if there is very likely not
 		 * enough space for another buffer, add the remaining space to
-		 * the current buffer. This extra space is not included in
-		 * the truesize stored in ctx.
+		 * the current buffer.
 		 */
 		len += hole;
 		alloc_frag->offset += hole;
 	}
+	ctx = mergeable_buf_to_ctx(buf, len);
 
-	sg_init_one(rq->sg, buf, len);
+	/* The device gets the part between the headroom and the tailroom */
+	sg_init_one(rq->sg, buf + VIRTNET_RX_HEADROOM, len - VIRTNET_RX_ROOM);
 	err = virtqueue_add_inbuf(rq->vq, rq->sg, 1, (void *)ctx, gfp);
 	if (err < 0)
 		put_page(virt_to_head_page(buf));
@@ -1472,9 +1589,12 @@ static void free_receive_bufs(struct virtnet_info *vi)
 static void free_receive_page_frags(struct virtnet_info *vi)
 {
 	int i;
-	for (i = 0; i < vi->max_queue_pairs; i++)
+
+	for (i = 0; i < vi->max_queue_pairs; i++) {
 		if (vi->rq[i].alloc_frag.page)
 			put_page(vi->rq[i].alloc_frag.page);
+		virtnet_pool_free(&vi->rq[i]);
+	}
 }
 
 static void free_unused_bufs(struct virtnet_info *vi)
@@ -1656,7 +1776,8 @@ static ssize_t mergeable_rx_buffer_size_show(struct netdev_rx_queue *queue,
 
 	BUG_ON(queue_index >= vi->max_queue_pairs);
 	avg = &vi->rq[queue_index].mrg_avg_pkt_len;
-	return sprintf(buf, "%u\n", get_mergeable_buf_len(avg));
+	return sprintf(buf, "%u\n",
+		       get_mergeable_buf_len(avg) - VIRTNET_RX_ROOM);
 }
 
 static struct rx_queue_attribute mergeable_rx_buffer_size_attribute =
@@ -366,6 +366,8 @@ static void free_msi_irqs(struct pci_dev *dev)
 			nvec = 1 << entry->msi_attrib.multiple;
 		for (i = 0; i < nvec; i++)
 			BUG_ON(irq_has_action(entry->irq + i));
+		if (entry->affinity)
+			irq_set_managed_affinity(entry->irq, NULL);
 	}
 
 	arch_teardown_msi_irqs(dev);
@@ -377,6 +379,7 @@ static void free_msi_irqs(struct pci_dev *dev)
 		}
 
 		list_del(&entry->list);
+		kfree(entry->affinity);
 		kfree(entry);
 	}
 
@@ -680,18 +683,32 @@ static void __iomem *msix_map_region(struct pci_dev *dev, unsigned nr_entries)
 }
 
 static int msix_setup_entries(struct pci_dev *dev, void __iomem *base,
-			      struct msix_entry *entries, int nvec)
+			      struct msix_entry *entries, int nvec,
+			      const struct irq_affinity *affd)
 {
+	struct cpumask *masks = NULL;
 	struct msi_desc *entry;
 	int i;
 
+	if (affd)
+		masks = irq_create_affinity_masks(nvec, affd);
+
 	for (i = 0; i < nvec; i++) {
 		entry = alloc_msi_entry(dev);
+		if (entry && masks) {
+			entry->affinity = kmemdup(masks + i, sizeof(*masks),
+						  GFP_KERNEL);
+			if (!entry->affinity) {
+				kfree(entry);
+				entry = NULL;
+			}
+		}
 		if (!entry) {
 			if (!i)
 				iounmap(base);
 			else
 				free_msi_irqs(dev);
+			kfree(masks);
 			/* No enough memory. Don't try again */
 			return -ENOMEM;
 		}
@@ -705,6 +722,7 @@ static int msix_setup_entries(struct pci_dev *dev, void __iomem *base,
 		list_add_tail(&entry->list, &dev->msi_list);
 	}
 
+	kfree(masks);
 	return 0;
 }
 
@@ -720,6 +738,8 @@ static void msix_program_entries(struct pci_dev *dev,
 
 		entries[i].vector = entry->irq;
 		irq_set_msi_desc(entry->irq, entry);
+		if (entry->affinity)
+			irq_set_managed_affinity(entry->irq, entry->affinity);
 		entry->masked = readl(entry->mask_base + offset);
 		msix_mask_irq(entry, 1);
 		i++;
@@ -731,13 +751,15 @@ static void msix_program_entries(struct pci_dev *dev,
  * @dev: pointer to the pci_dev data structure of MSI-X device function
  * @entries: pointer to an array of struct msix_entry entries
  * @nvec: number of @entries
+ * @affd: optional pointer to enable automatic affinity assignement
  *
  * Setup the MSI-X capability structure of device function with a
  * single MSI-X irq. A return of zero indicates the successful setup of
  * requested MSI-X entries with allocated irqs or non-zero for otherwise.
  **/
 static int msix_capability_init(struct pci_dev *dev,
-				struct msix_entry *entries, int nvec)
+				struct msix_entry *entries, int nvec,
+				const struct irq_affinity *affd)
 {
 	int ret;
 	u16 control;
@@ -752,7 +774,7 @@ static int msix_capability_init(struct pci_dev *dev,
 	if (!base)
 		return -ENOMEM;
 
-	ret = msix_setup_entries(dev, base, entries, nvec);
+	ret = msix_setup_entries(dev, base, entries, nvec, affd);
 	if (ret)
 		return ret;
 
@@ -931,22 +953,8 @@ int pci_msix_vec_count(struct pci_dev *dev)
 }
 EXPORT_SYMBOL(pci_msix_vec_count);
 
-/**
- * pci_enable_msix - configure device's MSI-X capability structure
- * @dev: pointer to the pci_dev data structure of MSI-X device function
- * @entries: pointer to an array of MSI-X entries
- * @nvec: number of MSI-X irqs requested for allocation by device driver
- *
- * Setup the MSI-X capability structure of device function with the number
- * of requested irqs upon its software driver call to request for
- * MSI-X mode enabled on its hardware device function. A return of zero
- * indicates the successful configuration of MSI-X capability structure
- * with new allocated MSI-X irqs. A return of < 0 indicates a failure.
- * Or a return of > 0 indicates that driver request is exceeding the number
- * of irqs or MSI-X vectors available. Driver should use the returned value to
- * re-send its request.
- **/
-int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+static int __pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries,
+			     int nvec, const struct irq_affinity *affd)
 {
 	int nr_entries;
 	int i, j;
@@ -979,7 +987,27 @@ int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
 		dev_info(&dev->dev, "can't enable MSI-X (MSI IRQ already assigned)\n");
 		return -EINVAL;
 	}
-	return msix_capability_init(dev, entries, nvec);
+	return msix_capability_init(dev, entries, nvec, affd);
+}
+
+/**
+ * pci_enable_msix - configure device's MSI-X capability structure
+ * @dev: pointer to the pci_dev data structure of MSI-X device function
+ * @entries: pointer to an array of MSI-X entries
+ * @nvec: number of MSI-X irqs requested for allocation by device driver
+ *
+ * Setup the MSI-X capability structure of device function with the number
+ * of requested irqs upon its software driver call to request for
+ * MSI-X mode enabled on its hardware device function. A return of zero
+ * indicates the successful configuration of MSI-X capability structure
+ * with new allocated MSI-X irqs. A return of < 0 indicates a failure.
+ * Or a return of > 0 indicates that driver request is exceeding the number
+ * of irqs or MSI-X vectors available. Driver should use the returned value to
+ * re-send its request.
+ **/
+int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+{
+	return __pci_enable_msix(dev, entries, nvec, NULL);
 }
 EXPORT_SYMBOL(pci_enable_msix);
 
@@ -1117,6 +1145,30 @@ EXPORT_SYMBOL(pci_enable_msi_range);
  **/
 int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 			       int minvec, int maxvec)
+{
+	return pci_enable_msix_range_affinity(dev, entries, minvec, maxvec,
+					      NULL);
+}
+EXPORT_SYMBOL(pci_enable_msix_range);
+
+/**
+ * pci_enable_msix_range_affinity - enable MSI-X with managed irq affinity
+ * @dev: pointer to the pci_dev data structure of MSI-X device function
+ * @entries: pointer to an array of MSI-X entries
+ * @minvec: minimum number of MSI-X irqs requested
+ * @maxvec: maximum number of MSI-X irqs requested
+ * @affd: optional description of the vectors to leave alone, or %NULL
+ *
+ * Same as pci_enable_msix_range(), but when @affd is given the allocated
+ * vectors, except for @affd->pre_vectors and @affd->post_vectors, are
+ * spread evenly over the NUMA nodes and cores of the system and marked
+ * as kernel managed: their affinity can't be changed from user space and
+ * follows CPU hotplug.
+ **/
+int pci_enable_msix_range_affinity(struct pci_dev *dev,
+				   struct msix_entry *entries,
+				   int minvec, int maxvec,
+				   const struct irq_affinity *affd)
 {
 	int nvec = maxvec;
 	int rc;
@@ -1125,7 +1177,7 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 		return -ERANGE;
 
 	do {
-		rc = pci_enable_msix(dev, entries, nvec);
+		rc = __pci_enable_msix(dev, entries, nvec, affd);
 		if (rc < 0) {
 			return rc;
 		} else if (rc > 0) {
@@ -1137,4 +1189,4 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 
 	return nvec;
 }
-EXPORT_SYMBOL(pci_enable_msix_range);
+EXPORT_SYMBOL(pci_enable_msix_range_affinity);
@@ -1059,6 +1059,17 @@ int se_dev_set_emulate_rest_reord(struct se_device *dev, int flag)
 	return 0;
 }
 
+int se_dev_set_direct_complete(struct se_device *dev, int flag)
+{
+	if ((flag != 0) && (flag != 1)) {
+		pr_err("Illegal value %d\n", flag);
+		return -EINVAL;
+	}
+	dev->dev_attrib.direct_complete = flag;
+	pr_debug("dev[%p]: SE Device direct_complete: %d\n", dev, flag);
+	return 0;
+}
+
 /*
  * Note, this can only be called on unexported SE Device Object.
  */
@@ -1564,6 +1575,7 @@ struct se_device *target_alloc_device(struct se_hba *hba, const char *name)
 	dev->dev_attrib.force_pr_aptpl = DA_FORCE_PR_APTPL;
 	dev->dev_attrib.is_nonrot = DA_IS_NONROT;
 	dev->dev_attrib.emulate_rest_reord = DA_EMULATE_REST_REORD;
+	dev->dev_attrib.direct_complete = DA_DIRECT_COMPLETE;
 	dev->dev_attrib.max_unmap_lba_count = DA_MAX_UNMAP_LBA_COUNT;
 	dev->dev_attrib.max_unmap_block_desc_count =
 		DA_MAX_UNMAP_BLOCK_DESC_COUNT;
@@ -703,7 +703,20 @@ void target_complete_cmd(struct se_cmd *cmd, u8 scsi_status)
 	cmd->transport_state |= (CMD_T_COMPLETE | CMD_T_ACTIVE);
 	spin_unlock_irqrestore(&cmd->t_state_lock, flags);
 
-	queue_work(target_completion_wq, &cmd->work);
+	/*
+	 * Backends completing from process context (e.g. fileio or
+	 * rd_mcp, which complete from the submitting thread) can run the
+	 * completion right away if the device asks for it. Everything
+	 * else goes through target_completion_wq, on the CPU the command
+	 * was received on.
+	 */
+	if (dev && dev->dev_attrib.direct_complete &&
+	    !in_interrupt() && !irqs_disabled()) {
+		cmd->work.func(&cmd->work);
+		return;
+	}
+
+	queue_work_on(cmd->cpuid, target_completion_wq, &cmd->work);
 }
 EXPORT_SYMBOL(target_complete_cmd);
 
@@ -1142,6 +1155,7 @@ void transport_init_se_cmd(
 	cmd->data_direction = data_direction;
 	cmd->sam_task_attr = task_attr;
 	cmd->sense_buffer = sense_buffer;
+	cmd->cpuid = raw_smp_processor_id();
 
 	cmd->state_active = false;
 }
@@ -436,6 +436,9 @@ static int clamp_thread(void *arg)
 		 */
 		preempt_disable();
 		tick_nohz_idle_enter();
+		local_irq_disable();
+		tick_nohz_idle_stop_tick();
+		local_irq_enable();
 		/* mwait until target jiffies is reached */
 		while (time_before(jiffies, target_jiffies)) {
 			unsigned long ecx = 1;
@@ -30,6 +30,7 @@
 #include <linux/iommu.h>
 #include <linux/module.h>
 #include <linux/mm.h>
+#include <linux/padata.h>
 #include <linux/rbtree.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
@@ -227,17 +228,25 @@ static int put_pfn(unsigned long pfn, int prot)
 	return 0;
 }
 
-static int vaddr_get_pfn(unsigned long vaddr, int prot, unsigned long *pfn)
+/*
+ * Pin up to @npage pages from @vaddr into @pages.  Returns the number
+ * pinned, with the pfn of the first one in @pfn.  A VM_PFNMAP page has
+ * nothing to pin; 0 is returned with its pfn in @pfn.
+ */
+static long vaddr_get_pfns(unsigned long vaddr, long npage, int prot,
+			   unsigned long *pfn, struct page **pages)
 {
-	struct page *page[1];
 	struct vm_area_struct *vma;
-	int ret = -EFAULT;
+	long ret;
 
-	if (get_user_pages_fast(vaddr, 1, !!(prot & IOMMU_WRITE), page) == 1) {
-		*pfn = page_to_pfn(page[0]);
-		return 0;
+	ret = get_user_pages_fast(vaddr, npage, !!(prot & IOMMU_WRITE), pages);
+	if (ret > 0) {
+		*pfn = page_to_pfn(pages[0]);
+		return ret;
 	}
 
+	ret = -EFAULT;
+
 	down_read(&current->mm->mmap_sem);
 
 	vma = find_vma_intersection(current->mm, vaddr, vaddr + 1);
@@ -253,64 +262,196 @@ static int vaddr_get_pfn(unsigned long vaddr, int prot, unsigned long *pfn)
 	return ret;
 }
 
+/*
+ * Pages pinned by a single get_user_pages_fast() call.  Pages left over
+ * when a contiguous run ends are the start of the next one.
+ */
+#define VFIO_BATCH_MAX_CAPACITY	(PAGE_SIZE / sizeof(struct page *))
+
+struct vfio_batch {
+	struct page		**pages;
+	struct page		*fallback_page;	/* if pages alloc fails */
+	int			capacity;	/* length of pages array */
+	int			size;		/* pinned pages still in it */
+	int			offset;		/* of the next one */
+};
+
+static void vfio_batch_init(struct vfio_batch *batch)
+{
+	batch->size = 0;
+	batch->offset = 0;
+
+	if (unlikely(disable_hugepages))
+		goto fallback;
+
+	batch->pages = (struct page **)__get_free_page(GFP_KERNEL);
+	if (!batch->pages)
+		goto fallback;
+
+	batch->capacity = VFIO_BATCH_MAX_CAPACITY;
+	return;
+
+fallback:
+	batch->pages = &batch->fallback_page;
+	batch->capacity = 1;
+}
+
+static void vfio_batch_unpin(struct vfio_batch *batch, int prot)
+{
+	while (batch->size) {
+		put_pfn(page_to_pfn(batch->pages[batch->offset]), prot);
+		batch->offset++;
+		batch->size--;
+	}
+}
+
+static void vfio_batch_fini(struct vfio_batch *batch)
+{
+	if (batch->capacity == VFIO_BATCH_MAX_CAPACITY)
+		free_page((unsigned long)batch->pages);
+}
+
 /*
  * Attempt to pin pages.  We really don't want to track all the pfns and
  * the iommu can only map chunks of consecutive pfns anyway, so get the
- * first page and all consecutive pages with the same locking.
+ * first page and all consecutive pages with the same locking.  Pages are
+ * pinned a batch at a time, so hugetlbfs and THP backed ranges come out
+ * as long runs at the cost of a pfn compare per page.
  */
 static long vfio_pin_pages(unsigned long vaddr, long npage,
-			   int prot, unsigned long *pfn_base)
+			   int prot, unsigned long *pfn_base,
+			   struct vfio_batch *batch)
 {
 	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
 	bool lock_cap = capable(CAP_IPC_LOCK);
-	long ret, i;
+	unsigned long pfn = 0;
+	long ret = 0, pinned = 0;
+	bool rsvd = false;
 
 	if (!current->mm)
 		return -ENODEV;
 
-	ret = vaddr_get_pfn(vaddr, prot, pfn_base);
-	if (ret)
-		return ret;
+	if (batch->size) {
+		/* Leftover pages in batch from an earlier call */
+		*pfn_base = page_to_pfn(batch->pages[batch->offset]);
+		pfn = *pfn_base;
+		rsvd = is_invalid_reserved_pfn(*pfn_base);
+	}
 
-	if (is_invalid_reserved_pfn(*pfn_base))
-		return 1;
+	while (npage) {
+		if (!batch->size) {
+			/* Empty batch, so refill it */
+			long req_pages = min_t(long, npage, batch->capacity);
 
-	if (!lock_cap && current->mm->locked_vm + 1 > limit) {
-		put_pfn(*pfn_base, prot);
-		pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n", __func__,
-			limit << PAGE_SHIFT);
-		return -ENOMEM;
-	}
+			ret = vaddr_get_pfns(vaddr, req_pages, prot, &pfn,
+					     batch->pages);
+			if (ret < 0)
+				break;
 
-	if (unlikely(disable_hugepages)) {
-		vfio_lock_acct(1);
-		return 1;
-	}
+			if (!pinned) {
+				*pfn_base = pfn;
+				rsvd = is_invalid_reserved_pfn(*pfn_base);
+			}
 
-	/* Lock all the consecutive pages from pfn_base */
-	for (i = 1, vaddr += PAGE_SIZE; i < npage; i++, vaddr += PAGE_SIZE) {
-		unsigned long pfn = 0;
+			if (!ret) {
+				/* VM_PFNMAP: no reference to keep around */
+				if (pfn != *pfn_base + pinned || !rsvd)
+					break;
+				pinned++;
+				npage--;
+				vaddr += PAGE_SIZE;
+				continue;
+			}
 
-		ret = vaddr_get_pfn(vaddr, prot, &pfn);
-		if (ret)
-			break;
+			batch->size = ret;
+			batch->offset = 0;
+			ret = 0;
+		}
 
-		if (pfn != *pfn_base + i || is_invalid_reserved_pfn(pfn)) {
-			put_pfn(pfn, prot);
-			break;
+		/* Take the contiguous pfns off the batch */
+		while (true) {
+			if (pfn != *pfn_base + pinned ||
+			    rsvd != is_invalid_reserved_pfn(pfn))
+				goto out;
+
+			if (!rsvd && !lock_cap &&
+			    current->mm->locked_vm + pinned + 1 > limit) {
+				pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
+					__func__, limit << PAGE_SHIFT);
+				ret = -ENOMEM;
+				goto out;
+			}
+
+			pinned++;
+			npage--;
+			vaddr += PAGE_SIZE;
+			batch->offset++;
+			batch->size--;
+
+			if (!batch->size)
+				break;
+
+			pfn = page_to_pfn(batch->pages[batch->offset]);
 		}
 
-		if (!lock_cap && current->mm->locked_vm + i + 1 > limit) {
-			put_pfn(pfn, prot);
-			pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
-				__func__, limit << PAGE_SHIFT);
+		if (unlikely(disable_hugepages))
 			break;
-		}
 	}
 
-	vfio_lock_acct(i);
+out:
+	if (!pinned)
+		return ret ? ret : -EFAULT;
 
-	return i;
+	if (!rsvd)
+		vfio_lock_acct(pinned);
+
+	return pinned;
+}
+
+/*
+ * Faulting in a large mapping dominates the time vfio_pin_pages() takes:
+ * most guest memory is first touched here. Fault it in by several threads
+ * first, then pin it from the already populated page tables.
+ */
+#define VFIO_PREFAULT_MIN_CHUNK	(128UL << 20)
+
+struct vfio_prefault_arg {
+	struct mm_struct	*mm;
+	int			write;
+};
+
+static void vfio_prefault_chunk(unsigned long start, unsigned long end,
+				void *arg)
+{
+	struct vfio_prefault_arg *pf = arg;
+
+	/* Only populating: errors are reported when the pages get pinned */
+	down_read(&pf->mm->mmap_sem);
+	get_user_pages(NULL, pf->mm, start, (end - start) >> PAGE_SHIFT,
+		       pf->write, 0, NULL, NULL);
+	up_read(&pf->mm->mmap_sem);
+}
+
+static void vfio_prefault_pages(unsigned long vaddr, size_t size, int prot)
+{
+	struct vfio_prefault_arg pf = {
+		.mm	= current->mm,
+		.write	= !!(prot & IOMMU_WRITE),
+	};
+	struct padata_mt_job job = {
+		.thread_fn	= vfio_prefault_chunk,
+		.fn_arg		= &pf,
+		.start		= vaddr,
+		.size		= size,
+		.align		= PAGE_SIZE,
+		.min_chunk	= VFIO_PREFAULT_MIN_CHUNK,
+		.max_threads	= num_online_nodes() * 4,
+	};
+
+	if (!pf.mm || size < 2 * VFIO_PREFAULT_MIN_CHUNK)
+		return;
+
+	padata_do_multithreaded(&job);
 }
 
 static long vfio_unpin_pages(unsigned long pfn, long npage,
@@ -532,6 +673,7 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 	int ret = 0, prot = 0;
 	uint64_t mask;
 	struct vfio_dma *dma;
+	struct vfio_batch batch;
 	unsigned long pfn;
 
 	/* Verify that none of our __u64 fields overflow */
@@ -575,10 +717,14 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 	/* Insert zero-sized and grow as we map chunks of it */
 	vfio_link_dma(iommu, dma);
 
+	vfio_prefault_pages(vaddr, size, prot);
+
+	vfio_batch_init(&batch);
+
 	while (size) {
 		/* Pin a contiguous chunk of memory */
 		npage = vfio_pin_pages(vaddr + dma->size,
-				       size >> PAGE_SHIFT, prot, &pfn);
+				       size >> PAGE_SHIFT, prot, &pfn, &batch);
 		if (npage <= 0) {
 			WARN_ON(!npage);
 			ret = (int)npage;
@@ -596,6 +742,9 @@ static int vfio_dma_do_map(struct vfio_iommu *iommu,
 		dma->size += npage << PAGE_SHIFT;
 	}
 
+	vfio_batch_unpin(&batch, prot);
+	vfio_batch_fini(&batch);
+
 	if (ret)
 		vfio_remove_dma(iommu, dma);
 
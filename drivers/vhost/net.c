@@ -43,6 +43,9 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
 
+/* Max number of TX frames copied before handing them to tun in one go */
+#define VHOST_NET_BATCH 64
+
 /*
  * For transmit, used buffer len is unused; we override it to track buffer
  * status internally; used for zerocopy tx only.
@@ -113,6 +116,12 @@ struct vhost_net {
 	unsigned tx_zcopy_err;
 	/* Flush in progress. Protected by tx vq lock. */
 	bool tx_flush;
+	/* TX frames copied but not yet sent, see vhost_tx_batch().
+	 * Protected by tx vq lock. */
+	struct tun_frame tx_frames[VHOST_NET_BATCH];
+	int tx_batched;
+	/* Pages the TX frames are copied to. Protected by tx vq lock. */
+	struct page_frag page_frag;
 };
 
 static unsigned vhost_net_zcopy_mask __read_mostly;
@@ -329,6 +338,117 @@ static void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool success)
 	rcu_read_unlock_bh();
 }
 
+/* Roughly microseconds. The clock may be read on different CPUs if the
+ * worker migrates while polling; that only stretches or shortens the window. */
+static unsigned long busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_virtqueue *vq,
+				unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_vq_has_work(vq);
+}
+
+/* Like vhost_get_vq_desc, but if the ring is empty spin for up to the vq's
+ * busyloop_timeout waiting for the guest to add buffers, instead of going
+ * through a notification and a wakeup. Notifications must be disabled. */
+static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
+				    struct vhost_virtqueue *vq,
+				    unsigned int *out_num,
+				    unsigned int *in_num)
+{
+	unsigned long uninitialized_var(endtime);
+	int r;
+
+	r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
+			      out_num, in_num, NULL, NULL);
+	if (r == vq->num && vq->busyloop_timeout) {
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(vq, endtime) &&
+		       vhost_vq_avail_empty(&net->dev, vq))
+			cpu_relax_lowlatency();
+		r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
+				      out_num, in_num, NULL, NULL);
+	}
+
+	return r;
+}
+
+/* Copy a TX frame into a page fragment for the next batch. Frames that do
+ * not fit a page with the skb_shared_info tun puts behind them are left to
+ * a single sendmsg, as is everything on error. */
+static int vhost_net_build_frame(struct vhost_net *net,
+				 struct vhost_virtqueue *vq,
+				 int head, size_t len)
+{
+	struct page_frag *pfrag = &net->page_frag;
+	struct tun_frame *frame = &net->tx_frames[net->tx_batched];
+	unsigned int pad = NET_SKB_PAD + NET_IP_ALIGN;
+	unsigned int buflen;
+	void *buf;
+
+	buflen = SKB_DATA_ALIGN(pad + len) +
+		 SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	if (buflen > PAGE_SIZE)
+		return -ENOSPC;
+
+	pfrag->offset = ALIGN(pfrag->offset, SMP_CACHE_BYTES);
+	if (!skb_page_frag_refill(buflen, pfrag, GFP_KERNEL))
+		return -ENOMEM;
+
+	buf = page_address(pfrag->page) + pfrag->offset;
+	if (memcpy_fromiovecend(buf + pad, vq->iov, 0, len))
+		return -EFAULT;
+
+	frame->buf = buf;
+	frame->buflen = buflen;
+	frame->offset = pad;
+	frame->len = len;
+	get_page(pfrag->page);
+	pfrag->offset += buflen;
+
+	/* The copy is done, so the buffers can go back to the guest with
+	 * the batch. heads are only used for zerocopy otherwise. */
+	vq->heads[net->tx_batched].id = head;
+	vq->heads[net->tx_batched].len = 0;
+	net->tx_batched++;
+	return 0;
+}
+
+/* Send the copied TX frames with a single sendmsg and return their
+ * buffers to the guest. The socket owns the frames even on error. */
+static void vhost_tx_batch(struct vhost_net *net,
+			   struct vhost_virtqueue *vq,
+			   struct socket *sock)
+{
+	struct tun_msg_ctl ctl = {
+		.type = TUN_MSG_PTR,
+		.num = net->tx_batched,
+		.ptr = net->tx_frames,
+	};
+	struct msghdr msg = {
+		.msg_control = &ctl,
+		.msg_flags = MSG_DONTWAIT,
+	};
+	int err;
+
+	if (!net->tx_batched)
+		return;
+
+	err = sock->ops->sendmsg(NULL, sock, &msg, 0);
+	if (unlikely(err < 0))
+		vq_err(vq, "Failed to send batched TX packets: %d\n", err);
+
+	vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
+				    net->tx_batched);
+	net->tx_batched = 0;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -350,7 +470,8 @@ static void handle_tx(struct vhost_net *net)
 	size_t hdr_size;
 	struct socket *sock;
 	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
-	bool zcopy, zcopy_used;
+	struct tun_msg_ctl ctl;
+	bool zcopy, zcopy_used, batch;
 
 	mutex_lock(&vq->mutex);
 	sock = vq->private_data;
@@ -361,6 +482,8 @@ static void handle_tx(struct vhost_net *net)
 
 	hdr_size = nvq->vhost_hlen;
 	zcopy = nvq->ubufs;
+	/* Only tun takes frames in batches; zerocopy owns vq->heads. */
+	batch = !zcopy && !IS_ERR(tun_get_socket(sock->file));
 
 	for (;;) {
 		/* Release DMAs done buffers first */
@@ -374,10 +497,7 @@ static void handle_tx(struct vhost_net *net)
 			      % UIO_MAXIOV == nvq->done_idx))
 			break;
 
-		head = vhost_get_vq_desc(vq, vq->iov,
-					 ARRAY_SIZE(vq->iov),
-					 &out, &in,
-					 NULL, NULL);
+		head = vhost_net_tx_get_vq_desc(net, vq, &out, &in);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -406,6 +526,20 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 
+		if (batch && !vhost_net_build_frame(net, vq, head, len)) {
+			total_len += len;
+			vhost_net_tx_packet(net);
+			if (net->tx_batched == VHOST_NET_BATCH)
+				vhost_tx_batch(net, vq, sock);
+			if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
+				vhost_poll_queue(&vq->poll);
+				break;
+			}
+			continue;
+		}
+		/* Keep the frames in order. */
+		vhost_tx_batch(net, vq, sock);
+
 		zcopy_used = zcopy && len >= VHOST_GOODCOPY_LEN
 				   && (nvq->upend_idx + 1) % UIO_MAXIOV !=
 				      nvq->done_idx
@@ -421,8 +555,10 @@ static void handle_tx(struct vhost_net *net)
 			ubuf->callback = vhost_zerocopy_callback;
 			ubuf->ctx = nvq->ubufs;
 			ubuf->desc = nvq->upend_idx;
-			msg.msg_control = ubuf;
-			msg.msg_controllen = sizeof(ubuf);
+			ctl.type = TUN_MSG_UBUF;
+			ctl.ptr = ubuf;
+			msg.msg_control = &ctl;
+			msg.msg_controllen = sizeof(ctl);
 			ubufs = nvq->ubufs;
 			atomic_inc(&ubufs->refcount);
 			nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
@@ -455,6 +591,7 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_tx_batch(net, vq, sock);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -477,6 +614,25 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+/* If the socket is empty, spin for up to the RX vq's busyloop_timeout
+ * waiting for a packet before giving up and waiting for a wakeup. */
+static int vhost_net_rx_peek_head_len(struct vhost_virtqueue *vq,
+				      struct sock *sk)
+{
+	unsigned long uninitialized_var(endtime);
+	int len = peek_head_len(sk);
+
+	if (!len && vq->busyloop_timeout) {
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(vq, endtime) &&
+		       skb_queue_empty(&sk->sk_receive_queue))
+			cpu_relax_lowlatency();
+		len = peek_head_len(sk);
+	}
+
+	return len;
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -589,7 +745,7 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(vq, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(vq, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
 		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
@@ -732,10 +888,14 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
 	}
+	n->tx_batched = 0;
+	n->page_frag.page = NULL;
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 
@@ -832,6 +992,8 @@ static int vhost_net_release(struct inode *inode, struct file *f)
 	 * since jobs can re-queue themselves. */
 	vhost_net_flush(n);
 	kfree(n->dev.vqs);
+	if (n->page_frag.page)
+		put_page(n->page_frag.page);
 	kvfree(n);
 	return 0;
 }
@@ -68,14 +68,17 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 }
 EXPORT_SYMBOL_GPL(vhost_work_init);
 
-/* Init poll structure */
+/* Init poll structure. Work is run by the worker of @vq if set, or by the
+ * default device worker otherwise. */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev)
+		     unsigned long mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -152,25 +155,60 @@ void vhost_poll_flush(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
-void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+/* Caller must hold dev->work_lock. The wakeup is done under the lock so that
+ * the worker can't be freed under us once it has run the work. */
+static void __vhost_worker_queue(struct vhost_worker *worker,
+				 struct vhost_work *work)
 {
-	unsigned long flags;
-
-	spin_lock_irqsave(&dev->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		spin_unlock_irqrestore(&dev->work_lock, flags);
-		wake_up_process(dev->worker);
-	} else {
-		spin_unlock_irqrestore(&dev->work_lock, flags);
+		wake_up_process(worker->task);
 	}
 }
+
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&worker->dev->work_lock, flags);
+	__vhost_worker_queue(worker, work);
+	spin_unlock_irqrestore(&worker->dev->work_lock, flags);
+}
+
+void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
+{
+	vhost_worker_queue(dev->worker, work);
+}
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+/* Queue work on the worker the vq is currently attached to. */
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	struct vhost_dev *dev = vq->dev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->work_lock, flags);
+	__vhost_worker_queue(vq->worker, work);
+	spin_unlock_irqrestore(&dev->work_lock, flags);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
+/* Is there work pending for the worker running this vq? Lockless, callers
+ * only use it as a hint to stop busy polling. */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	return !list_empty(&vq->worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_vq_work_queue(poll->vq, &poll->work);
+	else
+		vhost_work_queue(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -186,6 +224,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->last_used_idx = 0;
 	vq->signalled_used = 0;
 	vq->signalled_used_valid = false;
+	vq->avail_wrap_counter = true;
+	vq->used_wrap_counter = true;
 	vq->used_flags = 0;
 	vq->log_used = false;
 	vq->log_addr = -1ull;
@@ -199,11 +239,13 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->call = NULL;
 	vq->log_ctx = NULL;
 	vq->memory = NULL;
+	vq->busyloop_timeout = 0;
 }
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 	mm_segment_t oldfs = get_fs();
@@ -227,8 +269,8 @@ static int vhost_worker(void *data)
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
@@ -258,6 +300,9 @@ static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 	vq->log = NULL;
 	kfree(vq->heads);
 	vq->heads = NULL;
+	kfree(vq->packed_count);
+	vq->packed_count = NULL;
+	vq->packed_last_id = NULL;
 }
 
 /* Helper to allocate iovec buffers for all vqs. */
@@ -305,20 +350,23 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->memory = NULL;
 	dev->mm = NULL;
 	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
 	dev->worker = NULL;
+	idr_init(&dev->worker_idr);
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		vq = dev->vqs[i];
 		vq->log = NULL;
 		vq->indirect = NULL;
 		vq->heads = NULL;
+		vq->packed_count = NULL;
+		vq->packed_last_id = NULL;
 		vq->dev = dev;
+		vq->worker = NULL;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					POLLIN, dev);
+					POLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -345,17 +393,193 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_worker_queue(worker, &attach.work);
+	vhost_work_flush(worker->dev, &attach.work);
 	return attach.ret;
 }
 
+static void vhost_flush_work(struct vhost_work *work)
+{
+}
+
+/* Wait for everything queued on @worker so far to complete. */
+static void vhost_worker_flush(struct vhost_worker *worker)
+{
+	struct vhost_work flush;
+
+	vhost_work_init(&flush, vhost_flush_work);
+	vhost_worker_queue(worker, &flush);
+	vhost_work_flush(worker->dev, &flush);
+}
+
+static void vhost_worker_destroy(struct vhost_dev *dev,
+				 struct vhost_worker *worker)
+{
+	WARN_ON(!list_empty(&worker->work_list));
+	idr_remove(&dev->worker_idr, worker->id);
+	kthread_stop(worker->task);
+	kfree(worker);
+}
+
+static void vhost_workers_free(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	int i, id;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = NULL;
+	idr_for_each_entry(&dev->worker_idr, worker, id)
+		vhost_worker_destroy(dev, worker);
+	idr_destroy(&dev->worker_idr);
+	dev->worker = NULL;
+}
+
+/* Caller should have device mutex */
+static struct vhost_worker *vhost_worker_create(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int id, err;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return ERR_PTR(-ENOMEM);
+
+	worker->dev = dev;
+	INIT_LIST_HEAD(&worker->work_list);
+
+	id = idr_alloc(&dev->worker_idr, worker, 0, 0, GFP_KERNEL);
+	if (id < 0) {
+		err = id;
+		goto err_idr;
+	}
+	worker->id = id;
+
+	if (id)
+		task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+				      current->pid, id);
+	else
+		task = kthread_create(vhost_worker, worker, "vhost-%d",
+				      current->pid);
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto err_task;
+	}
+
+	worker->task = task;
+	wake_up_process(task);	/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_cgroup;
+
+	return worker;
+err_cgroup:
+	kthread_stop(task);
+err_task:
+	idr_remove(&dev->worker_idr, id);
+err_idr:
+	kfree(worker);
+	return ERR_PTR(err);
+}
+
+/* Caller should have device mutex */
+static long vhost_new_worker(struct vhost_dev *dev, void __user *argp)
+{
+	struct vhost_worker_state state;
+	struct vhost_worker *worker;
+	long r;
+
+	if (copy_from_user(&state, argp, sizeof state))
+		return -EFAULT;
+	if (state.cpu >= 0 &&
+	    (state.cpu >= nr_cpu_ids || !cpu_online(state.cpu)))
+		return -EINVAL;
+
+	worker = vhost_worker_create(dev);
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+
+	if (state.cpu >= 0) {
+		r = set_cpus_allowed_ptr(worker->task, cpumask_of(state.cpu));
+		if (r)
+			goto err;
+	}
+
+	state.worker_id = worker->id;
+	if (copy_to_user(argp, &state, sizeof state)) {
+		r = -EFAULT;
+		goto err;
+	}
+	return 0;
+err:
+	vhost_worker_destroy(dev, worker);
+	return r;
+}
+
+/* Caller should have device mutex */
+static long vhost_free_worker(struct vhost_dev *dev, void __user *argp)
+{
+	struct vhost_worker_state state;
+	struct vhost_worker *worker;
+
+	if (copy_from_user(&state, argp, sizeof state))
+		return -EFAULT;
+
+	worker = idr_find(&dev->worker_idr, state.worker_id);
+	if (!worker)
+		return -ENODEV;
+	/* The default worker also runs device wide work, keep it. */
+	if (worker == dev->worker || worker->attachment_cnt)
+		return -EBUSY;
+
+	vhost_worker_flush(worker);
+	vhost_worker_destroy(dev, worker);
+	return 0;
+}
+
+/* Caller should have device mutex. Can't hold the vq mutex: work queued on
+ * the old worker may need it to complete. */
+static long vhost_attach_vring_worker(struct vhost_dev *dev,
+				      void __user *argp)
+{
+	struct vhost_vring_worker w;
+	struct vhost_worker *worker, *old;
+	struct vhost_virtqueue *vq;
+
+	if (copy_from_user(&w, argp, sizeof w))
+		return -EFAULT;
+	if (w.index >= dev->nvqs)
+		return -ENOBUFS;
+
+	worker = idr_find(&dev->worker_idr, w.worker_id);
+	if (!worker)
+		return -ENODEV;
+
+	vq = dev->vqs[w.index];
+	old = vq->worker;
+	if (old == worker)
+		return 0;
+
+	spin_lock_irq(&dev->work_lock);
+	vq->worker = worker;
+	spin_unlock_irq(&dev->work_lock);
+	worker->attachment_cnt++;
+	old->attachment_cnt--;
+
+	/* Work already queued on the old worker still runs there. Handlers
+	 * are serialized by the vq mutex, but make sure the old worker is
+	 * done with this vq before userspace goes on to free it. */
+	vhost_worker_flush(old);
+	return 0;
+}
+
 /* Caller should have device mutex */
 bool vhost_dev_has_owner(struct vhost_dev *dev)
 {
@@ -366,8 +590,8 @@ EXPORT_SYMBOL_GPL(vhost_dev_has_owner);
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
-	int err;
+	struct vhost_worker *worker;
+	int i, err;
 
 	/* Is there an owner already? */
 	if (vhost_dev_has_owner(dev)) {
@@ -377,27 +601,24 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
+	worker = vhost_worker_create(dev);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
 		goto err_worker;
 	}
 
 	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
-	if (err)
-		goto err_cgroup;
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = worker;
+	worker->attachment_cnt = dev->nvqs;
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_iovecs;
 
 	return 0;
-err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+err_iovecs:
+	vhost_workers_free(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -472,11 +693,7 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 	/* No one will access memory at this point */
 	kfree(dev->memory);
 	dev->memory = NULL;
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	vhost_workers_free(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -552,6 +769,14 @@ static int vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 			struct vring_used __user *used)
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+
+	if (vhost_vq_is_packed(vq))
+		return access_ok(VERIFY_WRITE, desc,
+				 num * sizeof(struct vring_packed_desc)) &&
+		       access_ok(VERIFY_READ, avail,
+				 sizeof(struct vring_packed_desc_event)) &&
+		       access_ok(VERIFY_WRITE, used,
+				 sizeof(struct vring_packed_desc_event));
 	return access_ok(VERIFY_READ, desc, num * sizeof *desc) &&
 	       access_ok(VERIFY_READ, avail,
 			 sizeof *avail + num * sizeof *avail->ring + s) &&
@@ -573,12 +798,19 @@ static int vq_log_access_ok(struct vhost_virtqueue *vq,
 			    void __user *log_base)
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+	unsigned long sz;
+
+	/* The packed ring is written in place, up to the device event area
+	 * that follows it. */
+	if (vhost_vq_is_packed(vq))
+		sz = (void __user *)(vq->device_event + 1) -
+		     (void __user *)vq->desc_packed;
+	else
+		sz = sizeof *vq->used + vq->num * sizeof *vq->used->ring + s;
 
 	return vq_memory_access_ok(log_base, vq->memory,
 				   vhost_has_feature(vq, VHOST_F_LOG_ALL)) &&
-		(!vq->log_used || log_access_ok(log_base, vq->log_addr,
-					sizeof *vq->used +
-					vq->num * sizeof *vq->used->ring + s));
+		(!vq->log_used || log_access_ok(log_base, vq->log_addr, sz));
 }
 
 /* Can we start vq? */
@@ -670,6 +902,10 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			break;
 		}
 		vq->num = s.num;
+		/* Sized by num, reallocated by vhost_init_used. */
+		kfree(vq->packed_count);
+		vq->packed_count = NULL;
+		vq->packed_last_id = NULL;
 		break;
 	case VHOST_SET_VRING_BASE:
 		/* Moving base with an active backend?
@@ -682,6 +918,15 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EFAULT;
 			break;
 		}
+		if (vhost_vq_is_packed(vq)) {
+			/* Ring offsets and wrap counters, available in the
+			 * low half and used in the high half. */
+			vq->last_avail_idx = s.num & 0x7fff;
+			vq->avail_wrap_counter = !!(s.num & 0x8000);
+			vq->last_used_idx = (s.num >> 16) & 0x7fff;
+			vq->used_wrap_counter = !!(s.num & 0x80000000);
+			break;
+		}
 		if (s.num > 0xffff) {
 			r = -EINVAL;
 			break;
@@ -692,7 +937,26 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 		break;
 	case VHOST_GET_VRING_BASE:
 		s.index = idx;
-		s.num = vq->last_avail_idx;
+		if (vhost_vq_is_packed(vq))
+			s.num = (vq->last_avail_idx |
+				 vq->avail_wrap_counter << 15) |
+				(vq->last_used_idx |
+				 vq->used_wrap_counter << 15) << 16;
+		else
+			s.num = vq->last_avail_idx;
+		if (copy_to_user(argp, &s, sizeof s))
+			r = -EFAULT;
+		break;
+	case VHOST_SET_VRING_BUSYLOOP_TIMEOUT:
+		if (copy_from_user(&s, argp, sizeof s)) {
+			r = -EFAULT;
+			break;
+		}
+		vq->busyloop_timeout = s.num;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
+		s.index = idx;
+		s.num = vq->busyloop_timeout;
 		if (copy_to_user(argp, &s, sizeof s))
 			r = -EFAULT;
 		break;
@@ -713,9 +977,24 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EFAULT;
 			break;
 		}
-		if ((a.avail_user_addr & (sizeof *vq->avail->ring - 1)) ||
-		    (a.used_user_addr & (sizeof *vq->used->ring - 1)) ||
-		    (a.log_guest_addr & (sizeof *vq->used->ring - 1))) {
+		if (vhost_vq_is_packed(vq)) {
+			/* The device writes the ring in place, and the
+			 * device event area is logged relative to it. */
+			if ((a.desc_user_addr &
+			     (sizeof *vq->desc_packed - 1)) ||
+			    (a.avail_user_addr &
+			     (sizeof *vq->driver_event - 1)) ||
+			    (a.used_user_addr &
+			     (sizeof *vq->device_event - 1)) ||
+			    (a.log_guest_addr &
+			     (sizeof *vq->desc_packed - 1)) ||
+			    a.used_user_addr < a.desc_user_addr) {
+				r = -EINVAL;
+				break;
+			}
+		} else if ((a.avail_user_addr & (sizeof *vq->avail->ring - 1)) ||
+			   (a.used_user_addr & (sizeof *vq->used->ring - 1)) ||
+			   (a.log_guest_addr & (sizeof *vq->used->ring - 1))) {
 			r = -EINVAL;
 			break;
 		}
@@ -735,6 +1014,9 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			/* Also validate log access for used ring if enabled. */
 			if ((a.flags & (0x1 << VHOST_VRING_F_LOG)) &&
 			    !log_access_ok(vq->log_base, a.log_guest_addr,
+					   vhost_vq_is_packed(vq) ?
+					   a.used_user_addr - a.desc_user_addr +
+					   sizeof *vq->device_event :
 					   sizeof *vq->used +
 					   vq->num * sizeof *vq->used->ring)) {
 				r = -EINVAL;
@@ -849,6 +1131,31 @@ long vhost_dev_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *argp)
 	case VHOST_SET_MEM_TABLE:
 		r = vhost_set_memory(d, argp);
 		break;
+	case VHOST_NEW_WORKER:
+		r = vhost_new_worker(d, argp);
+		break;
+	case VHOST_FREE_WORKER:
+		r = vhost_free_worker(d, argp);
+		break;
+	case VHOST_ATTACH_VRING_WORKER:
+		r = vhost_attach_vring_worker(d, argp);
+		break;
+	case VHOST_GET_VRING_WORKER: {
+		struct vhost_vring_worker w;
+
+		if (copy_from_user(&w, argp, sizeof w)) {
+			r = -EFAULT;
+			break;
+		}
+		if (w.index >= d->nvqs) {
+			r = -ENOBUFS;
+			break;
+		}
+		w.worker_id = d->vqs[w.index]->worker->id;
+		if (copy_to_user(argp, &w, sizeof w))
+			r = -EFAULT;
+		break;
+	}
 	case VHOST_SET_LOG_BASE:
 		if (copy_from_user(&p, argp, sizeof p)) {
 			r = -EFAULT;
@@ -1036,12 +1343,73 @@ static int vhost_update_avail_event(struct vhost_virtqueue *vq, u16 avail_event)
 	return 0;
 }
 
+/* Log a write to the packed ring or its device event area. Both are covered
+ * by log_addr, which is the guest address of the descriptor ring. */
+static void vhost_log_packed(struct vhost_virtqueue *vq,
+			     void __user *addr, u64 len)
+{
+	/* Make sure the data is seen before log. */
+	smp_wmb();
+	log_write(vq->log_base, vq->log_addr +
+		  (addr - (void __user *)vq->desc_packed), len);
+}
+
+/* Publish whether and where we want a kick, following used_flags. */
+static int vhost_update_device_event(struct vhost_virtqueue *vq)
+{
+	u16 flags, off_wrap;
+
+	if (vq->used_flags & VRING_USED_F_NO_NOTIFY) {
+		flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+	} else if (vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+		flags = VRING_PACKED_EVENT_FLAG_DESC;
+		off_wrap = vq->last_avail_idx |
+			   vq->avail_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR;
+		if (__put_user(off_wrap, &vq->device_event->off_wrap))
+			return -EFAULT;
+		/* The offset must be seen before the flags that enable it. */
+		smp_wmb();
+	} else {
+		flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+	}
+
+	if (__put_user(flags, &vq->device_event->flags))
+		return -EFAULT;
+	if (unlikely(vq->log_used)) {
+		vhost_log_packed(vq, vq->device_event,
+				 sizeof *vq->device_event);
+		if (vq->log_ctx)
+			eventfd_signal(vq->log_ctx, 1);
+	}
+	return 0;
+}
+
+static int vhost_init_used_packed(struct vhost_virtqueue *vq)
+{
+	if (vq->last_avail_idx >= vq->num || vq->last_used_idx >= vq->num)
+		return -EINVAL;
+
+	if (!vq->packed_count) {
+		vq->packed_count = kmalloc(2 * vq->num * sizeof(u16),
+					   GFP_KERNEL);
+		if (!vq->packed_count)
+			return -ENOMEM;
+		vq->packed_last_id = vq->packed_count + vq->num;
+	}
+
+	vq->signalled_used_valid = false;
+	return vhost_update_device_event(vq);
+}
+
 int vhost_init_used(struct vhost_virtqueue *vq)
 {
 	int r;
 	if (!vq->private_data)
 		return 0;
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_init_used_packed(vq);
+
 	r = vhost_update_used_flags(vq);
 	if (r)
 		return r;
@@ -1193,6 +1561,199 @@ static int get_indirect(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+static bool vhost_desc_is_avail(u16 flags, bool wrap_counter)
+{
+	bool avail = !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL));
+	bool used = !!(flags & (1 << VRING_PACKED_DESC_F_USED));
+
+	return avail == wrap_counter && used != wrap_counter;
+}
+
+/* Translate one packed descriptor, direct or from an indirect table, and
+ * account it as input or output. */
+static int vhost_packed_desc_iov(struct vhost_virtqueue *vq,
+				 struct vring_packed_desc *desc,
+				 struct iovec iov[], unsigned int iov_size,
+				 unsigned int *out_num, unsigned int *in_num,
+				 struct vhost_log *log, unsigned int *log_num)
+{
+	unsigned iov_count = *in_num + *out_num;
+	int ret;
+
+	ret = translate_desc(vq, desc->addr, desc->len, iov + iov_count,
+			     iov_size - iov_count);
+	if (unlikely(ret < 0)) {
+		vq_err(vq, "Translation failure %d in packed descriptor\n",
+		       ret);
+		return ret;
+	}
+	if (desc->flags & VRING_DESC_F_WRITE) {
+		/* If this is an input descriptor,
+		 * increment that count. */
+		*in_num += ret;
+		if (unlikely(log)) {
+			log[*log_num].addr = desc->addr;
+			log[*log_num].len = desc->len;
+			++*log_num;
+		}
+	} else {
+		/* If it's an output descriptor, they're all supposed
+		 * to come before any input descriptors. */
+		if (unlikely(*in_num)) {
+			vq_err(vq, "Packed descriptor has out after in\n");
+			return -EINVAL;
+		}
+		*out_num += ret;
+	}
+	return 0;
+}
+
+static int get_indirect_packed(struct vhost_virtqueue *vq,
+			       struct iovec iov[], unsigned int iov_size,
+			       unsigned int *out_num, unsigned int *in_num,
+			       struct vhost_log *log, unsigned int *log_num,
+			       struct vring_packed_desc *indirect)
+{
+	struct vring_packed_desc desc;
+	unsigned int i, count;
+	int ret;
+
+	/* Sanity check */
+	if (unlikely(indirect->len % sizeof desc)) {
+		vq_err(vq, "Invalid length in indirect descriptor: "
+		       "len 0x%llx not multiple of 0x%zx\n",
+		       (unsigned long long)indirect->len,
+		       sizeof desc);
+		return -EINVAL;
+	}
+
+	ret = translate_desc(vq, indirect->addr, indirect->len, vq->indirect,
+			     UIO_MAXIOV);
+	if (unlikely(ret < 0)) {
+		vq_err(vq, "Translation failure %d in indirect.\n", ret);
+		return ret;
+	}
+
+	/* We will use the result as an address to read from, so most
+	 * architectures only need a compiler barrier here. */
+	read_barrier_depends();
+
+	/* Entries are used in order: there is no next field to chase. */
+	count = indirect->len / sizeof desc;
+	if (unlikely(count > USHRT_MAX + 1)) {
+		vq_err(vq, "Indirect buffer length too big: %d\n",
+		       indirect->len);
+		return -E2BIG;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (unlikely(memcpy_fromiovec((unsigned char *)&desc,
+					      vq->indirect, sizeof desc))) {
+			vq_err(vq, "Failed indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)indirect->addr + i * sizeof desc);
+			return -EINVAL;
+		}
+		if (unlikely(desc.flags & VRING_DESC_F_INDIRECT)) {
+			vq_err(vq, "Nested indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)indirect->addr + i * sizeof desc);
+			return -EINVAL;
+		}
+
+		ret = vhost_packed_desc_iov(vq, &desc, iov, iov_size,
+					    out_num, in_num, log, log_num);
+		if (unlikely(ret < 0))
+			return ret;
+	}
+	return 0;
+}
+
+/* vhost_get_vq_desc for the packed ring. The guest hands over a buffer by
+ * flipping the flags of its first descriptor, so once that one is available
+ * the rest of the chain can be read in order. */
+static int vhost_get_vq_desc_packed(struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num,
+				    unsigned int *in_num,
+				    struct vhost_log *log,
+				    unsigned int *log_num)
+{
+	struct vring_packed_desc desc;
+	unsigned int i = vq->last_avail_idx, found = 0;
+	bool wrap_counter = vq->avail_wrap_counter;
+	u16 flags;
+	int ret;
+
+	if (unlikely(__get_user(flags, &vq->desc_packed[i].flags))) {
+		vq_err(vq, "Failed to access descriptor flags at %p\n",
+		       &vq->desc_packed[i].flags);
+		return -EFAULT;
+	}
+
+	/* If there's nothing new since last we looked, return invalid. */
+	if (!vhost_desc_is_avail(flags, wrap_counter))
+		return vq->num;
+
+	/* Only read the descriptors after they have been exposed by guest. */
+	smp_rmb();
+
+	/* When we start there are none of either input nor output. */
+	*out_num = *in_num = 0;
+	if (unlikely(log))
+		*log_num = 0;
+
+	do {
+		if (unlikely(++found > vq->num)) {
+			vq_err(vq, "Loop detected: last one at %u "
+			       "vq size %u head %u\n",
+			       i, vq->num, vq->last_avail_idx);
+			return -EINVAL;
+		}
+		ret = __copy_from_user(&desc, vq->desc_packed + i, sizeof desc);
+		if (unlikely(ret)) {
+			vq_err(vq, "Failed to get descriptor: idx %d addr %p\n",
+			       i, vq->desc_packed + i);
+			return -EFAULT;
+		}
+		if (desc.flags & VRING_DESC_F_INDIRECT)
+			ret = get_indirect_packed(vq, iov, iov_size,
+						  out_num, in_num,
+						  log, log_num, &desc);
+		else
+			ret = vhost_packed_desc_iov(vq, &desc, iov, iov_size,
+						    out_num, in_num,
+						    log, log_num);
+		if (unlikely(ret < 0)) {
+			vq_err(vq, "Failure detected at idx %d\n", i);
+			return ret;
+		}
+
+		if (++i >= vq->num) {
+			i = 0;
+			wrap_counter ^= 1;
+		}
+	} while (desc.flags & VRING_DESC_F_NEXT);
+
+	/* The buffer id is in the last descriptor. */
+	if (unlikely(desc.id >= vq->num)) {
+		vq_err(vq, "Guest says index %u > %u is available",
+		       desc.id, vq->num);
+		return -EINVAL;
+	}
+
+	/* Remember how far to move when it is used, or discarded. */
+	vq->packed_count[desc.id] = found;
+	vq->packed_last_id[i ? i - 1 : vq->num - 1] = desc.id;
+
+	/* On success, move past the chain. */
+	vq->last_avail_idx = i;
+	vq->avail_wrap_counter = wrap_counter;
+
+	/* Assume notifications from guest are disabled at this point,
+	 * if they aren't we would need to update the device event area. */
+	BUG_ON(!(vq->used_flags & VRING_USED_F_NO_NOTIFY));
+	return desc.id;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -1211,6 +1772,11 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 	u16 last_avail_idx;
 	int ret;
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_get_vq_desc_packed(vq, iov, iov_size,
+						out_num, in_num,
+						log, log_num);
+
 	/* Check it isn't doing very strange things with descriptor numbers. */
 	last_avail_idx = vq->last_avail_idx;
 	if (unlikely(__get_user(vq->avail_idx, &vq->avail->idx))) {
@@ -1324,9 +1890,87 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 }
 EXPORT_SYMBOL_GPL(vhost_get_vq_desc);
 
+static void vhost_discard_vq_desc_packed(struct vhost_virtqueue *vq, int n)
+{
+	u16 last, id;
+
+	/* Walk back over the chains, most recent first. */
+	while (n--) {
+		last = vq->last_avail_idx ? vq->last_avail_idx - 1 :
+					    vq->num - 1;
+		id = vq->packed_last_id[last];
+		if (vq->last_avail_idx < vq->packed_count[id]) {
+			vq->last_avail_idx += vq->num;
+			vq->avail_wrap_counter ^= 1;
+		}
+		vq->last_avail_idx -= vq->packed_count[id];
+	}
+}
+
+/* Write used buffers back in place into the ring, in the order they are
+ * used. Each one skips as many slots as its chain took. */
+static int vhost_add_used_n_packed(struct vhost_virtqueue *vq,
+				   struct vring_used_elem *heads,
+				   unsigned count)
+{
+	struct vring_packed_desc __user *desc;
+	unsigned int i;
+	u16 flags, old, new;
+
+	for (i = 0; i < count; i++) {
+		if (unlikely(heads[i].id >= vq->num)) {
+			vq_err(vq, "Used id %u > %u", heads[i].id, vq->num);
+			return -EINVAL;
+		}
+
+		desc = vq->desc_packed + vq->last_used_idx;
+		flags = vq->used_wrap_counter ?
+			1 << VRING_PACKED_DESC_F_AVAIL |
+			1 << VRING_PACKED_DESC_F_USED : 0;
+		if (heads[i].len)
+			flags |= VRING_DESC_F_WRITE;
+
+		if (__put_user(heads[i].id, &desc->id) ||
+		    __put_user(heads[i].len, &desc->len)) {
+			vq_err(vq, "Failed to write used");
+			return -EFAULT;
+		}
+		/* The guest owns the buffer as soon as it sees the flags. */
+		smp_wmb();
+		if (__put_user(flags, &desc->flags)) {
+			vq_err(vq, "Failed to write used flags");
+			return -EFAULT;
+		}
+		if (unlikely(vq->log_used))
+			vhost_log_packed(vq, desc, sizeof *desc);
+
+		old = vq->last_used_idx;
+		new = old + vq->packed_count[heads[i].id];
+		if (new >= vq->num) {
+			new -= vq->num;
+			vq->used_wrap_counter ^= 1;
+			/* Keep the old positions comparable with new ones. */
+			old -= vq->num;
+			vq->signalled_used -= vq->num;
+		}
+		vq->last_used_idx = new;
+		/* See __vhost_add_used_n. */
+		if (unlikely((u16)(new - vq->signalled_used) < (u16)(new - old)))
+			vq->signalled_used_valid = false;
+	}
+
+	if (unlikely(vq->log_used) && vq->log_ctx)
+		eventfd_signal(vq->log_ctx, 1);
+	return 0;
+}
+
 /* Reverse the effect of vhost_get_vq_desc. Useful for error handling. */
 void vhost_discard_vq_desc(struct vhost_virtqueue *vq, int n)
 {
+	if (vhost_vq_is_packed(vq)) {
+		vhost_discard_vq_desc_packed(vq, n);
+		return;
+	}
 	vq->last_avail_idx -= n;
 }
 EXPORT_SYMBOL_GPL(vhost_discard_vq_desc);
@@ -1391,6 +2035,9 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 {
 	int start, n, r;
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_add_used_n_packed(vq, heads, count);
+
 	start = vq->last_used_idx % vq->num;
 	n = vq->num - start;
 	if (n < count) {
@@ -1420,6 +2067,47 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 }
 EXPORT_SYMBOL_GPL(vhost_add_used_n);
 
+static bool vhost_notify_packed(struct vhost_dev *dev,
+				struct vhost_virtqueue *vq)
+{
+	__u16 old, new, off_wrap, flags, event;
+	bool v;
+
+	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
+	    unlikely(vhost_vq_avail_empty(dev, vq)))
+		return true;
+
+	if (__get_user(flags, &vq->driver_event->flags)) {
+		vq_err(vq, "Failed to get driver event flags");
+		return true;
+	}
+	if (flags == VRING_PACKED_EVENT_FLAG_DISABLE)
+		return false;
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC ||
+	    !vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX))
+		return true;
+
+	old = vq->signalled_used;
+	v = vq->signalled_used_valid;
+	new = vq->signalled_used = vq->last_used_idx;
+	vq->signalled_used_valid = true;
+
+	if (unlikely(!v))
+		return true;
+
+	/* The guest writes the offset before the flags enabling it. */
+	smp_rmb();
+	if (__get_user(off_wrap, &vq->driver_event->off_wrap)) {
+		vq_err(vq, "Failed to get driver event offset");
+		return true;
+	}
+	event = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) !=
+	    vq->used_wrap_counter)
+		event -= vq->num;
+	return vring_need_event(event, new, old);
+}
+
 static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__u16 old, new, event;
@@ -1429,6 +2117,9 @@ static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	 * interrupts. */
 	smp_mb();
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_notify_packed(dev, vq);
+
 	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
 	    unlikely(vq->avail_idx == vq->last_avail_idx))
 		return true;
@@ -1494,6 +2185,18 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY))
 		return false;
 	vq->used_flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vhost_vq_is_packed(vq)) {
+		r = vhost_update_device_event(vq);
+		if (r) {
+			vq_err(vq, "Failed to enable notification at %p: %d\n",
+			       vq->device_event, r);
+			return false;
+		}
+		/* They could have slipped one in as we were doing that: make
+		 * sure it's written, then check again. */
+		smp_mb();
+		return !vhost_vq_avail_empty(dev, vq);
+	}
 	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r) {
@@ -1523,6 +2226,26 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(vhost_enable_notify);
 
+/* Is the avail ring empty? Used to busy poll for new buffers while
+ * notifications are disabled. */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	u16 avail_idx, flags;
+
+	if (vhost_vq_is_packed(vq)) {
+		if (__get_user(flags,
+			       &vq->desc_packed[vq->last_avail_idx].flags))
+			return false;
+		return !vhost_desc_is_avail(flags, vq->avail_wrap_counter);
+	}
+
+	if (__get_user(avail_idx, &vq->avail->idx))
+		return false;
+
+	return avail_idx == vq->avail_idx;
+}
+EXPORT_SYMBOL_GPL(vhost_vq_avail_empty);
+
 /* We don't need to be notified again. */
 void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
@@ -1531,6 +2254,13 @@ void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (vq->used_flags & VRING_USED_F_NO_NOTIFY)
 		return;
 	vq->used_flags |= VRING_USED_F_NO_NOTIFY;
+	if (vhost_vq_is_packed(vq)) {
+		r = vhost_update_device_event(vq);
+		if (r)
+			vq_err(vq, "Failed to disable notification at %p: %d\n",
+			       vq->device_event, r);
+		return;
+	}
 	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r)
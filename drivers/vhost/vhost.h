@@ -11,6 +11,7 @@
 #include <linux/virtio_config.h>
 #include <linux/virtio_ring.h>
 #include <linux/atomic.h>
+#include <linux/idr.h>
 
 struct vhost_device;
 
@@ -35,13 +36,27 @@ struct vhost_poll {
 	struct vhost_work	  work;
 	unsigned long		  mask;
 	struct vhost_dev	 *dev;
+	struct vhost_virtqueue	 *vq;
+};
+
+/* A kernel thread running the work of a device, or of some of its vqs. */
+struct vhost_worker {
+	struct task_struct	  *task;
+	struct list_head	  work_list;
+	struct vhost_dev	  *dev;
+	/* Number of vqs using this worker. Protected by device mutex. */
+	int			  attachment_cnt;
+	u32			  id;
 };
 
 void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn);
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work);
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work);
+bool vhost_vq_has_work(struct vhost_virtqueue *vq);
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev);
+		     unsigned long mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq);
 int vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_flush(struct vhost_poll *poll);
@@ -63,9 +78,20 @@ struct vhost_virtqueue {
 	/* The actual ring of buffers. */
 	struct mutex mutex;
 	unsigned int num;
-	struct vring_desc __user *desc;
-	struct vring_avail __user *avail;
-	struct vring_used __user *used;
+	/* With VIRTIO_RING_F_PACKED, the descriptor ring and the driver and
+	 * device event suppression areas. */
+	union {
+		struct vring_desc __user *desc;
+		struct vring_packed_desc __user *desc_packed;
+	};
+	union {
+		struct vring_avail __user *avail;
+		struct vring_packed_desc_event __user *driver_event;
+	};
+	union {
+		struct vring_used __user *used;
+		struct vring_packed_desc_event __user *device_event;
+	};
 	struct file *kick;
 	struct file *call;
 	struct file *error;
@@ -75,6 +101,9 @@ struct vhost_virtqueue {
 
 	struct vhost_poll poll;
 
+	/* Worker running this vq's work. Changed under device work_lock. */
+	struct vhost_worker *worker;
+
 	/* The routine to call when the Guest pings us, or timeout. */
 	vhost_work_fn_t handle_kick;
 
@@ -96,6 +125,14 @@ struct vhost_virtqueue {
 	/* Last used index value we have signalled on */
 	bool signalled_used_valid;
 
+	/* Packed ring: wrap counters for last_avail_idx and last_used_idx. */
+	bool avail_wrap_counter;
+	bool used_wrap_counter;
+	/* Packed ring: ring slots used by each buffer id in flight, and the id
+	 * of the buffer ending at each slot. */
+	u16 *packed_count;
+	u16 *packed_last_id;
+
 	/* Log writes to used structure. */
 	bool log_used;
 	u64 log_addr;
@@ -110,6 +147,8 @@ struct vhost_virtqueue {
 	/* Log write descriptors */
 	void __user *log_base;
 	struct vhost_log *log;
+	/* How long to busy poll before sleeping, in us. 0 disables. */
+	u32 busyloop_timeout;
 };
 
 struct vhost_dev {
@@ -121,8 +160,9 @@ struct vhost_dev {
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
 	spinlock_t work_lock;
-	struct list_head work_list;
-	struct task_struct *worker;
+	/* Default worker, used by the device and by all vqs initially */
+	struct vhost_worker *worker;
+	struct idr worker_idr;
 };
 
 void vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue **vqs, int nvqs);
@@ -155,6 +195,7 @@ void vhost_add_used_and_signal_n(struct vhost_dev *, struct vhost_virtqueue *,
 void vhost_signal(struct vhost_dev *, struct vhost_virtqueue *);
 void vhost_disable_notify(struct vhost_dev *, struct vhost_virtqueue *);
 bool vhost_enable_notify(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_vq_avail_empty(struct vhost_dev *, struct vhost_virtqueue *);
 
 int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 		    unsigned int log_num, u64 len);
@@ -169,11 +210,17 @@ enum {
 	VHOST_FEATURES = (1ULL << VIRTIO_F_NOTIFY_ON_EMPTY) |
 			 (1ULL << VIRTIO_RING_F_INDIRECT_DESC) |
 			 (1ULL << VIRTIO_RING_F_EVENT_IDX) |
+			 (1ULL << VIRTIO_RING_F_PACKED) |
 			 (1ULL << VHOST_F_LOG_ALL),
 };
 
 static inline int vhost_has_feature(struct vhost_virtqueue *vq, int bit)
 {
-	return vq->acked_features & (1 << bit);
+	return !!(vq->acked_features & (1U << bit));
+}
+
+static inline bool vhost_vq_is_packed(struct vhost_virtqueue *vq)
+{
+	return vhost_has_feature(vq, VIRTIO_RING_F_PACKED);
 }
 #endif
@@ -28,6 +28,7 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/balloon_compaction.h>
+#include <linux/page_reporting.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -40,7 +41,7 @@
 struct virtio_balloon
 {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* Where the ballooning thread waits for config to change. */
 	wait_queue_head_t config_change;
@@ -71,6 +72,9 @@ struct virtio_balloon
 	/* Memory statistics */
 	int need_stats_update;
 	struct virtio_balloon_stat stats[VIRTIO_BALLOON_S_NR];
+
+	/* Free page reporting device */
+	struct page_reporting_dev_info pr_dev_info;
 };
 
 static struct virtio_device_id id_table[] = {
@@ -320,25 +324,35 @@ static int balloon(void *_vballoon)
 
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	const char *names[] = { "inflate", "deflate", "stats" };
-	int err, nvqs;
+	struct virtqueue *vqs[4];
+	vq_callback_t *callbacks[4] = { balloon_ack, balloon_ack };
+	const char *names[4] = { "inflate", "deflate" };
+	int err, nvqs = 2, stats = -1, reporting = -1;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and reporting, in that order.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+		stats = nvqs++;
+		callbacks[stats] = stats_request;
+		names[stats] = "stats";
+	}
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING)) {
+		reporting = nvqs++;
+		callbacks[reporting] = balloon_ack;
+		names[reporting] = "reporting";
+	}
 	err = vb->vdev->config->find_vqs(vb->vdev, nvqs, vqs, callbacks, names);
 	if (err)
 		return err;
 
 	vb->inflate_vq = vqs[0];
 	vb->deflate_vq = vqs[1];
-	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+	vb->reporting_vq = reporting >= 0 ? vqs[reporting] : NULL;
+	if (stats >= 0) {
 		struct scatterlist sg;
-		vb->stats_vq = vqs[2];
+		vb->stats_vq = vqs[stats];
 
 		/*
 		 * Prime this virtqueue with one buffer so the hypervisor can
@@ -353,6 +367,50 @@ static int init_vqs(struct virtio_balloon *vb)
 	return 0;
 }
 
+/*
+ * virtballoon_free_page_report - tell the host about free blocks of memory
+ *
+ * The blocks stay allocated to page reporting until we return, and the
+ * host may discard their contents, hence device writable buffers.
+ */
+static int virtballoon_free_page_report(struct page_reporting_dev_info *prdev,
+					struct scatterlist *sg,
+					unsigned int nents)
+{
+	struct virtio_balloon *vb =
+		container_of(prdev, struct virtio_balloon, pr_dev_info);
+	struct virtqueue *vq = vb->reporting_vq;
+	unsigned int len;
+	int err;
+
+	/* We should always be able to add these buffers to an empty queue. */
+	err = virtqueue_add_inbuf(vq, sg, nents, vb, GFP_NOWAIT | __GFP_NOWARN);
+	if (WARN_ON_ONCE(err))
+		return err;
+	virtqueue_kick(vq);
+
+	/* When host has read buffer, this completes via balloon_ack */
+	wait_event(vb->acked, virtqueue_get_buf(vq, &len));
+	return 0;
+}
+
+static int virtballoon_register_reporting(struct virtio_balloon *vb)
+{
+	/* Poisoned free pages must keep their contents */
+	if (!vb->reporting_vq || !IS_ENABLED(CONFIG_PAGE_REPORTING) ||
+	    IS_ENABLED(CONFIG_PAGE_POISONING))
+		return 0;
+
+	vb->pr_dev_info.report = virtballoon_free_page_report;
+	return page_reporting_register(&vb->pr_dev_info);
+}
+
+static void virtballoon_unregister_reporting(struct virtio_balloon *vb)
+{
+	if (vb->reporting_vq)
+		page_reporting_unregister(&vb->pr_dev_info);
+}
+
 #ifdef CONFIG_BALLOON_COMPACTION
 /*
  * virtballoon_migratepage - perform the balloon page migration on behalf of
@@ -443,14 +501,20 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	if (err)
 		goto out_free_vb;
 
+	err = virtballoon_register_reporting(vb);
+	if (err)
+		goto out_del_vqs;
+
 	vb->thread = kthread_run(balloon, vb, "vballoon");
 	if (IS_ERR(vb->thread)) {
 		err = PTR_ERR(vb->thread);
-		goto out_del_vqs;
+		goto out_unregister;
 	}
 
 	return 0;
 
+out_unregister:
+	virtballoon_unregister_reporting(vb);
 out_del_vqs:
 	vdev->config->del_vqs(vdev);
 out_free_vb:
@@ -461,6 +525,8 @@ out:
 
 static void remove_common(struct virtio_balloon *vb)
 {
+	virtballoon_unregister_reporting(vb);
+
 	/* There might be pages left in the balloon: free them. */
 	while (vb->num_pages)
 		leak_balloon(vb, vb->num_pages);
@@ -504,6 +570,12 @@ static int virtballoon_restore(struct virtio_device *vdev)
 	if (ret)
 		return ret;
 
+	ret = virtballoon_register_reporting(vb);
+	if (ret) {
+		vdev->config->del_vqs(vdev);
+		return ret;
+	}
+
 	virtio_device_ready(vdev);
 
 	fill_balloon(vb, towards_target(vb));
@@ -515,6 +587,7 @@ static int virtballoon_restore(struct virtio_device *vdev)
 static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
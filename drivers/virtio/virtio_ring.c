@@ -54,12 +54,31 @@
 #define END_USE(vq)
 #endif
 
+struct vring_packed_desc_state {
+	/* Token of the buffer, NULL if this id is free. */
+	void *data;
+	/* Indirect descriptor table, if any. */
+	struct vring_packed_desc *indir_desc;
+	/* Number of ring slots the buffer uses. */
+	u16 num;
+	/* Next id on the free list. */
+	u16 next;
+	/* Last id of the chain. */
+	u16 last;
+};
+
 struct vring_virtqueue
 {
 	struct virtqueue vq;
 
 	/* Actual memory layout for this queue */
-	struct vring vring;
+	union {
+		struct vring vring;
+		struct vring_packed vring_packed;
+	};
+
+	/* Is this a packed ring? */
+	bool packed;
 
 	/* Can we use weak barriers? */
 	bool weak_barriers;
@@ -81,6 +100,19 @@ struct vring_virtqueue
 	/* Last used index we've seen. */
 	u16 last_used_idx;
 
+	/* Packed ring only: */
+	/* Wrap counters for the next slot we make available and use. */
+	bool avail_wrap_counter;
+	bool used_wrap_counter;
+	/* AVAIL/USED flag bits for descriptors made available in this lap. */
+	u16 avail_used_flags;
+	/* Next slot to make available. */
+	u16 next_avail_idx;
+	/* Last written value of driver->flags. */
+	u16 event_flags_shadow;
+	/* Per buffer id state, and free list of ids. */
+	struct vring_packed_desc_state *desc_state;
+
 	/* How to notify other side. FIXME: commonalize hcalls! */
 	bool (*notify)(struct virtqueue *vq);
 
@@ -120,6 +152,444 @@ static struct vring_desc *alloc_indirect(unsigned int total_sg, gfp_t gfp)
 	return desc;
 }
 
+/*
+ * Packed ring.
+ *
+ * The driver writes descriptors in order into a single ring and flips the
+ * AVAIL/USED flag bits on each lap around it, so the device finds new work
+ * and used buffers in the same cache lines it already touched, instead of
+ * reading an index, an avail entry and a descriptor in three places.
+ */
+
+static inline bool is_used_desc_packed(const struct vring_virtqueue *vq,
+				       u16 idx, bool used_wrap_counter)
+{
+	u16 flags = vq->vring_packed.desc[idx].flags;
+	bool avail = !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL));
+	bool used = !!(flags & (1 << VRING_PACKED_DESC_F_USED));
+
+	return avail == used && used == used_wrap_counter;
+}
+
+static inline bool more_used_packed(const struct vring_virtqueue *vq)
+{
+	return is_used_desc_packed(vq, vq->last_used_idx,
+				   vq->used_wrap_counter);
+}
+
+/* Move past one descriptor slot, flipping the flags on each lap. */
+static inline u16 packed_next_avail(struct vring_virtqueue *vq, u16 i)
+{
+	if (++i >= vq->vring_packed.num) {
+		i = 0;
+		vq->avail_used_flags ^= 1 << VRING_PACKED_DESC_F_AVAIL |
+					1 << VRING_PACKED_DESC_F_USED;
+		vq->avail_wrap_counter ^= 1;
+	}
+	return i;
+}
+
+static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
+					 struct scatterlist *sgs[],
+					 unsigned int total_sg,
+					 unsigned int out_sgs,
+					 unsigned int in_sgs,
+					 void *data,
+					 gfp_t gfp)
+{
+	struct vring_packed_desc *desc;
+	struct scatterlist *sg;
+	unsigned int i, n;
+	u16 head, id, flags;
+
+	head = vq->next_avail_idx;
+
+	/* See alloc_indirect(). */
+	gfp &= ~(__GFP_HIGHMEM | __GFP_HIGH);
+	desc = kmalloc(total_sg * sizeof(struct vring_packed_desc), gfp);
+	if (!desc)
+		return -ENOMEM;
+
+	if (unlikely(vq->vq.num_free < 1)) {
+		pr_debug("Can't add buf len 1 - avail = 0\n");
+		kfree(desc);
+		END_USE(vq);
+		return -ENOSPC;
+	}
+
+	i = 0;
+	id = vq->free_head;
+	BUG_ON(id == vq->vring_packed.num);
+
+	for (n = 0; n < out_sgs + in_sgs; n++) {
+		for (sg = sgs[n]; sg; sg = sg_next(sg)) {
+			desc[i].flags = n < out_sgs ? 0 : VRING_DESC_F_WRITE;
+			desc[i].addr = sg_phys(sg);
+			desc[i].len = sg->length;
+			i++;
+		}
+	}
+
+	vq->vring_packed.desc[head].addr = virt_to_phys(desc);
+	/* avoid kmemleak false positive (hidden by virt_to_phys) */
+	kmemleak_ignore(desc);
+	vq->vring_packed.desc[head].len =
+		total_sg * sizeof(struct vring_packed_desc);
+	vq->vring_packed.desc[head].id = id;
+
+	flags = VRING_DESC_F_INDIRECT | vq->avail_used_flags;
+	vq->next_avail_idx = packed_next_avail(vq, head);
+
+	vq->vq.num_free -= 1;
+	vq->free_head = vq->desc_state[id].next;
+
+	vq->desc_state[id].num = 1;
+	vq->desc_state[id].data = data;
+	vq->desc_state[id].indir_desc = desc;
+	vq->desc_state[id].last = id;
+
+	/* The descriptor must be complete before the device can see it. */
+	virtio_wmb(vq->weak_barriers);
+	vq->vring_packed.desc[head].flags = flags;
+	vq->num_added += 1;
+
+	pr_debug("Added buffer head %i to %p\n", head, vq);
+	END_USE(vq);
+
+	return 0;
+}
+
+static int virtqueue_add_packed(struct virtqueue *_vq,
+				struct scatterlist *sgs[],
+				unsigned int total_sg,
+				unsigned int out_sgs,
+				unsigned int in_sgs,
+				void *data,
+				gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	struct vring_packed_desc *desc;
+	struct scatterlist *sg;
+	unsigned int i, n, c, descs_used;
+	u16 head, id, uninitialized_var(prev), curr, flags, head_flags = 0;
+	int err;
+
+	START_USE(vq);
+
+	BUG_ON(data == NULL);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return -EIO;
+	}
+
+	BUG_ON(total_sg > vq->vring_packed.num);
+	BUG_ON(total_sg == 0);
+
+	if (vq->indirect && total_sg > 1 && vq->vq.num_free) {
+		err = virtqueue_add_indirect_packed(vq, sgs, total_sg, out_sgs,
+						    in_sgs, data, gfp);
+		if (err != -ENOMEM)
+			return err;
+		/* Fall back to direct descriptors. */
+	}
+
+	head = vq->next_avail_idx;
+	desc = vq->vring_packed.desc;
+	descs_used = total_sg;
+
+	if (vq->vq.num_free < descs_used) {
+		pr_debug("Can't add buf len %i - avail = %i\n",
+			 descs_used, vq->vq.num_free);
+		if (out_sgs)
+			vq->notify(&vq->vq);
+		END_USE(vq);
+		return -ENOSPC;
+	}
+
+	i = head;
+	id = vq->free_head;
+	BUG_ON(id == vq->vring_packed.num);
+
+	curr = id;
+	c = 0;
+	for (n = 0; n < out_sgs + in_sgs; n++) {
+		for (sg = sgs[n]; sg; sg = sg_next(sg)) {
+			flags = vq->avail_used_flags |
+				(++c == total_sg ? 0 : VRING_DESC_F_NEXT) |
+				(n < out_sgs ? 0 : VRING_DESC_F_WRITE);
+			/* The head is made available last, below. */
+			if (i == head)
+				head_flags = flags;
+			else
+				desc[i].flags = flags;
+
+			desc[i].addr = sg_phys(sg);
+			desc[i].len = sg->length;
+			desc[i].id = id;
+
+			prev = curr;
+			curr = vq->desc_state[curr].next;
+			i = packed_next_avail(vq, i);
+		}
+	}
+
+	vq->vq.num_free -= descs_used;
+	vq->next_avail_idx = i;
+	vq->free_head = curr;
+
+	vq->desc_state[id].num = descs_used;
+	vq->desc_state[id].data = data;
+	vq->desc_state[id].indir_desc = NULL;
+	vq->desc_state[id].last = prev;
+
+	/* The rest of the chain must be visible before the head, which hands
+	 * the whole buffer to the device. */
+	virtio_wmb(vq->weak_barriers);
+	desc[head].flags = head_flags;
+	vq->num_added += descs_used;
+
+	/* This is very unlikely, but theoretically possible.  Kick
+	 * just in case. */
+	if (unlikely(vq->num_added >= (1 << 16) - vq->vring_packed.num))
+		virtqueue_kick(_vq);
+
+	pr_debug("Added buffer head %i to %p\n", head, vq);
+	END_USE(vq);
+
+	return 0;
+}
+
+static bool virtqueue_kick_prepare_packed(struct vring_virtqueue *vq)
+{
+	u16 new, old, off_wrap, flags, wrap_counter, event_idx;
+	bool needs_kick;
+	union {
+		struct vring_packed_desc_event ev;
+		u32 u32;
+	} snapshot;
+
+	START_USE(vq);
+	/* We need to expose the new flags before checking the device event
+	 * suppression area. */
+	virtio_mb(vq->weak_barriers);
+
+	old = vq->next_avail_idx - vq->num_added;
+	new = vq->next_avail_idx;
+	vq->num_added = 0;
+
+	/* Read both fields at once, they're updated together. */
+	snapshot.u32 = ACCESS_ONCE(*(u32 *)vq->vring_packed.device);
+	flags = snapshot.ev.flags;
+	off_wrap = snapshot.ev.off_wrap;
+
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC) {
+		needs_kick = (flags != VRING_PACKED_EVENT_FLAG_DISABLE);
+		goto out;
+	}
+
+	wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if (wrap_counter != vq->avail_wrap_counter)
+		event_idx -= vq->vring_packed.num;
+
+	needs_kick = vring_need_event(event_idx, new, old);
+out:
+	END_USE(vq);
+	return needs_kick;
+}
+
+static void detach_buf_packed(struct vring_virtqueue *vq, unsigned int id)
+{
+	struct vring_packed_desc_state *state = &vq->desc_state[id];
+
+	state->data = NULL;
+
+	/* Put the ids of the chain back on the free list. */
+	vq->desc_state[state->last].next = vq->free_head;
+	vq->free_head = id;
+	vq->vq.num_free += state->num;
+
+	kfree(state->indir_desc);
+	state->indir_desc = NULL;
+}
+
+static void *virtqueue_get_buf_packed(struct vring_virtqueue *vq,
+				      unsigned int *len)
+{
+	u16 last_used, id;
+	void *ret;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (!more_used_packed(vq)) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return NULL;
+	}
+
+	/* Only get used elements after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	last_used = vq->last_used_idx;
+	id = vq->vring_packed.desc[last_used].id;
+	*len = vq->vring_packed.desc[last_used].len;
+
+	if (unlikely(id >= vq->vring_packed.num)) {
+		BAD_RING(vq, "id %u out of range\n", id);
+		return NULL;
+	}
+	if (unlikely(!vq->desc_state[id].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", id);
+		return NULL;
+	}
+
+	/* detach_buf_packed clears data, so grab it now. */
+	ret = vq->desc_state[id].data;
+	detach_buf_packed(vq, id);
+
+	/* The device skips the rest of the chain, so do we. */
+	vq->last_used_idx += vq->desc_state[id].num;
+	if (vq->last_used_idx >= vq->vring_packed.num) {
+		vq->last_used_idx -= vq->vring_packed.num;
+		vq->used_wrap_counter ^= 1;
+	}
+
+	/* If we expect an interrupt for the next entry, tell host
+	 * by writing event index and flush out the write before
+	 * the read in the next get_buf call. */
+	if (vq->event_flags_shadow == VRING_PACKED_EVENT_FLAG_DESC) {
+		vq->vring_packed.driver->off_wrap = vq->last_used_idx |
+			(vq->used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+		virtio_mb(vq->weak_barriers);
+	}
+
+#ifdef DEBUG
+	vq->last_add_time_valid = false;
+#endif
+
+	END_USE(vq);
+	return ret;
+}
+
+static void virtqueue_disable_cb_packed(struct vring_virtqueue *vq)
+{
+	if (vq->event_flags_shadow != VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+		vq->vring_packed.driver->flags = vq->event_flags_shadow;
+	}
+}
+
+static unsigned virtqueue_enable_cb_prepare_packed(struct vring_virtqueue *vq)
+{
+	START_USE(vq);
+
+	/* We optimistically turn back on interrupts, then check if there was
+	 * more to do. */
+	if (vq->event) {
+		vq->vring_packed.driver->off_wrap = vq->last_used_idx |
+			(vq->used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+		/* The event offset must be visible before the flags. */
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->event_flags_shadow = vq->event ?
+				VRING_PACKED_EVENT_FLAG_DESC :
+				VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->vring_packed.driver->flags = vq->event_flags_shadow;
+	}
+
+	END_USE(vq);
+	return vq->last_used_idx |
+		(vq->used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+}
+
+static bool virtqueue_poll_packed(struct vring_virtqueue *vq, u16 off_wrap)
+{
+	bool wrap_counter;
+	u16 used_idx;
+
+	wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	used_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+	return is_used_desc_packed(vq, used_idx, wrap_counter);
+}
+
+static bool virtqueue_enable_cb_delayed_packed(struct vring_virtqueue *vq)
+{
+	u16 used_idx, wrap_counter, bufs;
+
+	START_USE(vq);
+
+	/* We optimistically turn back on interrupts, then check if there was
+	 * more to do. */
+	if (vq->event) {
+		/* TODO: tune this threshold */
+		bufs = (vq->vring_packed.num - vq->vq.num_free) * 3 / 4;
+		wrap_counter = vq->used_wrap_counter;
+
+		used_idx = vq->last_used_idx + bufs;
+		if (used_idx >= vq->vring_packed.num) {
+			used_idx -= vq->vring_packed.num;
+			wrap_counter ^= 1;
+		}
+
+		vq->vring_packed.driver->off_wrap = used_idx |
+			(wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+		/* The event offset must be visible before the flags. */
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->event_flags_shadow = vq->event ?
+				VRING_PACKED_EVENT_FLAG_DESC :
+				VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->vring_packed.driver->flags = vq->event_flags_shadow;
+	}
+
+	/* Update the event suppression area before checking for more used
+	 * buffers. */
+	virtio_mb(vq->weak_barriers);
+
+	if (is_used_desc_packed(vq, vq->last_used_idx,
+				vq->used_wrap_counter)) {
+		END_USE(vq);
+		return false;
+	}
+
+	END_USE(vq);
+	return true;
+}
+
+static void *virtqueue_detach_unused_buf_packed(struct vring_virtqueue *vq)
+{
+	unsigned int i;
+	void *buf;
+
+	START_USE(vq);
+
+	for (i = 0; i < vq->vring_packed.num; i++) {
+		if (!vq->desc_state[i].data)
+			continue;
+		/* detach_buf_packed clears data, so grab it now. */
+		buf = vq->desc_state[i].data;
+		detach_buf_packed(vq, i);
+		END_USE(vq);
+		return buf;
+	}
+	/* That should have freed everything. */
+	BUG_ON(vq->vq.num_free != vq->vring_packed.num);
+
+	END_USE(vq);
+	return NULL;
+}
+
 static inline int virtqueue_add(struct virtqueue *_vq,
 				struct scatterlist *sgs[],
 				unsigned int total_sg,
@@ -135,6 +605,10 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 	int head;
 	bool indirect;
 
+	if (vq->packed)
+		return virtqueue_add_packed(_vq, sgs, total_sg, out_sgs, in_sgs,
+					    data, gfp);
+
 	START_USE(vq);
 
 	BUG_ON(data == NULL);
@@ -349,6 +823,9 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 	u16 new, old;
 	bool needs_kick;
 
+	if (vq->packed)
+		return virtqueue_kick_prepare_packed(vq);
+
 	START_USE(vq);
 	/* We need to expose available array entries before checking avail
 	 * event. */
@@ -448,6 +925,8 @@ static void detach_buf(struct vring_virtqueue *vq, unsigned int head)
 
 static inline bool more_used(const struct vring_virtqueue *vq)
 {
+	if (vq->packed)
+		return more_used_packed(vq);
 	return vq->last_used_idx != vq->vring.used->idx;
 }
 
@@ -474,6 +953,9 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	unsigned int i;
 	u16 last_used;
 
+	if (vq->packed)
+		return virtqueue_get_buf_packed(vq, len);
+
 	START_USE(vq);
 
 	if (unlikely(vq->broken)) {
@@ -537,6 +1019,10 @@ void virtqueue_disable_cb(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
+	if (vq->packed) {
+		virtqueue_disable_cb_packed(vq);
+		return;
+	}
 	vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
 }
 EXPORT_SYMBOL_GPL(virtqueue_disable_cb);
@@ -558,6 +1044,9 @@ unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 last_used_idx;
 
+	if (vq->packed)
+		return virtqueue_enable_cb_prepare_packed(vq);
+
 	START_USE(vq);
 
 	/* We optimistically turn back on interrupts, then check if there was
@@ -586,6 +1075,8 @@ bool virtqueue_poll(struct virtqueue *_vq, unsigned last_used_idx)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
 	virtio_mb(vq->weak_barriers);
+	if (vq->packed)
+		return virtqueue_poll_packed(vq, last_used_idx);
 	return (u16)last_used_idx != vq->vring.used->idx;
 }
 EXPORT_SYMBOL_GPL(virtqueue_poll);
@@ -626,6 +1117,9 @@ bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 bufs;
 
+	if (vq->packed)
+		return virtqueue_enable_cb_delayed_packed(vq);
+
 	START_USE(vq);
 
 	/* We optimistically turn back on interrupts, then check if there was
@@ -662,6 +1156,9 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 	unsigned int i;
 	void *buf;
 
+	if (vq->packed)
+		return virtqueue_detach_unused_buf_packed(vq);
+
 	START_USE(vq);
 
 	for (i = 0; i < vq->vring.num; i++) {
@@ -714,6 +1211,7 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 {
 	struct vring_virtqueue *vq;
 	unsigned int i;
+	bool packed = virtio_has_feature(vdev, VIRTIO_RING_F_PACKED);
 
 	/* We assume num is a power of 2. */
 	if (num & (num - 1)) {
@@ -721,11 +1219,25 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 		return NULL;
 	}
 
-	vq = kmalloc(sizeof(*vq) + sizeof(void *)*num, GFP_KERNEL);
+	/* The packed ring keeps its tokens in desc_state. */
+	vq = kmalloc(sizeof(*vq) + (packed ? 0 : sizeof(void *)*num),
+		     GFP_KERNEL);
 	if (!vq)
 		return NULL;
 
-	vring_init(&vq->vring, num, pages, vring_align);
+	vq->packed = packed;
+	if (packed) {
+		vq->desc_state = kcalloc(num, sizeof(*vq->desc_state),
+					 GFP_KERNEL);
+		if (!vq->desc_state) {
+			kfree(vq);
+			return NULL;
+		}
+		vring_packed_init(&vq->vring_packed, num, pages, vring_align);
+	} else {
+		vq->desc_state = NULL;
+		vring_init(&vq->vring, num, pages, vring_align);
+	}
 	vq->vq.callback = callback;
 	vq->vq.vdev = vdev;
 	vq->vq.name = name;
@@ -745,6 +1257,29 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC);
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
 
+	if (packed) {
+		vq->avail_wrap_counter = 1;
+		vq->used_wrap_counter = 1;
+		vq->avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+		vq->next_avail_idx = 0;
+		vq->event_flags_shadow = 0;
+
+		/* No callback?  Tell other side not to bother us. */
+		if (!callback) {
+			vq->event_flags_shadow =
+				VRING_PACKED_EVENT_FLAG_DISABLE;
+			vq->vring_packed.driver->flags =
+				vq->event_flags_shadow;
+		}
+
+		/* Put all ids in the free list. */
+		vq->free_head = 0;
+		for (i = 0; i < num-1; i++)
+			vq->desc_state[i].next = i+1;
+
+		return &vq->vq;
+	}
+
 	/* No callback?  Tell other side not to bother us. */
 	if (!callback)
 		vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
@@ -764,6 +1299,7 @@ EXPORT_SYMBOL_GPL(vring_new_virtqueue);
 void vring_del_virtqueue(struct virtqueue *vq)
 {
 	list_del(&vq->list);
+	kfree(to_vvq(vq)->desc_state);
 	kfree(to_vvq(vq));
 }
 EXPORT_SYMBOL_GPL(vring_del_virtqueue);
@@ -779,6 +1315,8 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_RING_F_EVENT_IDX:
 			break;
+		case VIRTIO_RING_F_PACKED:
+			break;
 		default:
 			/* We don't understand this bit. */
 			clear_bit(i, vdev->features);
@@ -799,7 +1337,7 @@ unsigned int virtqueue_get_vring_size(struct virtqueue *_vq)
 
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
-	return vq->vring.num;
+	return vq->packed ? vq->vring_packed.num : vq->vring.num;
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_vring_size);
 
@@ -40,6 +40,11 @@
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
 #include <linux/mount.h>
+#include <linux/kthread.h>
+#include <linux/fdtable.h>
+#include <linux/cred.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -149,8 +154,31 @@ struct kioctx {
 	struct file		*aio_ring_file;
 
 	unsigned		id;
+
+	/*
+	 * Submission ring, see io_setup2(). Its pages follow the completion
+	 * ring in aio_ring_file and are never migrated, the kernel accesses
+	 * them through the sq_ring vmap.
+	 */
+	struct aio_sq_ring	*sq_ring;
+	struct page		**sq_pages;
+	unsigned		nr_sq_pages;
+	unsigned		sq_entries;
+	unsigned		sq_offset;
+	unsigned		sq_head;	/* trusted copy */
+	struct mutex		sq_lock;
+
+	/* submission ring polling thread, and the context it submits in */
+	struct task_struct	*sq_thread;
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_thread_idle;
+	struct mm_struct	*sq_mm;
+	struct files_struct	*sq_files;
+	const struct cred	*sq_cred;
 };
 
+#define AIO_SQ_MAX_ENTRIES	4096
+
 /*------ sysctl variables----*/
 static DEFINE_SPINLOCK(aio_nr_lock);
 unsigned long aio_nr;		/* current system wide number of aio requests */
@@ -160,6 +188,14 @@ unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio request
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
+/*
+ * Buffered reads and writes and fsync have no asynchronous implementation,
+ * so they are handed to this workqueue instead of blocking io_submit().
+ * max_active bounds the number of requests that run at the same time and
+ * can be tuned in /sys/devices/virtual/workqueue/aio/.
+ */
+static struct workqueue_struct *aio_wq;
+
 static struct vfsmount *aio_mnt;
 
 static const struct file_operations aio_ring_fops;
@@ -236,6 +272,10 @@ static int __init aio_setup(void)
 	kiocb_cachep = KMEM_CACHE(kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
+	aio_wq = alloc_workqueue("aio", WQ_UNBOUND | WQ_SYSFS, 0);
+	if (!aio_wq)
+		panic("Failed to create aio workqueue.");
+
 	pr_debug("sizeof(struct page) = %zu\n", sizeof(struct page));
 
 	return 0;
@@ -282,6 +322,16 @@ static void aio_free_ring(struct kioctx *ctx)
 		kfree(ctx->ring_pages);
 		ctx->ring_pages = NULL;
 	}
+
+	if (ctx->sq_ring) {
+		vunmap(ctx->sq_ring);
+		ctx->sq_ring = NULL;
+	}
+	for (i = 0; i < ctx->nr_sq_pages; i++)
+		put_page(ctx->sq_pages[i]);
+	ctx->nr_sq_pages = 0;
+	kfree(ctx->sq_pages);
+	ctx->sq_pages = NULL;
 }
 
 static int aio_ring_mmap(struct file *file, struct vm_area_struct *vma)
@@ -322,6 +372,7 @@ static int aio_migratepage(struct address_space *mapping, struct page *new,
 		goto out;
 	}
 
+	/* Submission ring pages are vmapped, so they can't be migrated */
 	idx = old->index;
 	if (idx < (pgoff_t)ctx->nr_pages) {
 		/* Make sure the old page hasn't already been changed */
@@ -371,13 +422,13 @@ static const struct address_space_operations aio_ctx_aops = {
 #endif
 };
 
-static int aio_setup_ring(struct kioctx *ctx)
+static int aio_setup_ring(struct kioctx *ctx, unsigned sq_entries)
 {
 	struct aio_ring *ring;
 	unsigned nr_events = ctx->max_reqs;
 	struct mm_struct *mm = current->mm;
 	unsigned long size, unused;
-	int nr_pages;
+	int nr_pages, nr_sq_pages = 0;
 	int i;
 	struct file *file;
 
@@ -391,7 +442,11 @@ static int aio_setup_ring(struct kioctx *ctx)
 	if (nr_pages < 0)
 		return -EINVAL;
 
-	file = aio_private_file(ctx, nr_pages);
+	if (sq_entries)
+		nr_sq_pages = PFN_UP(sizeof(struct aio_sq_ring) +
+				     sq_entries * sizeof(struct iocb));
+
+	file = aio_private_file(ctx, nr_pages + nr_sq_pages);
 	if (IS_ERR(file)) {
 		ctx->aio_ring_file = NULL;
 		return -ENOMEM;
@@ -431,7 +486,42 @@ static int aio_setup_ring(struct kioctx *ctx)
 		return -ENOMEM;
 	}
 
-	ctx->mmap_size = nr_pages * PAGE_SIZE;
+	if (nr_sq_pages) {
+		ctx->sq_pages = kcalloc(nr_sq_pages, sizeof(struct page *),
+					GFP_KERNEL);
+		if (!ctx->sq_pages) {
+			aio_free_ring(ctx);
+			return -ENOMEM;
+		}
+
+		for (i = 0; i < nr_sq_pages; i++) {
+			struct page *page;
+			page = find_or_create_page(file->f_inode->i_mapping,
+						   nr_pages + i,
+						   GFP_HIGHUSER | __GFP_ZERO);
+			if (!page)
+				break;
+			SetPageUptodate(page);
+			unlock_page(page);
+
+			ctx->sq_pages[i] = page;
+		}
+		ctx->nr_sq_pages = i;
+
+		if (i == nr_sq_pages)
+			ctx->sq_ring = vmap(ctx->sq_pages, nr_sq_pages, VM_MAP,
+					    PAGE_KERNEL);
+		if (!ctx->sq_ring) {
+			aio_free_ring(ctx);
+			return -ENOMEM;
+		}
+
+		ctx->sq_entries = sq_entries;
+		ctx->sq_offset = nr_pages * PAGE_SIZE;
+		ctx->sq_ring->nr = sq_entries;
+	}
+
+	ctx->mmap_size = (nr_pages + nr_sq_pages) * PAGE_SIZE;
 	pr_debug("attempting mmap of %lu bytes\n", ctx->mmap_size);
 
 	down_write(&mm->mmap_sem);
@@ -623,8 +713,9 @@ static void aio_nr_sub(unsigned nr)
 
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
+ *	A non-zero sq_entries also sets up a submission ring of that size.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned sq_entries)
 {
 	struct mm_struct *mm = current->mm;
 	struct kioctx *ctx;
@@ -665,6 +756,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	 * the ring_lock mutex held until setup is complete. */
 	mutex_lock(&ctx->ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_lock);
+	init_waitqueue_head(&ctx->sq_wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 
@@ -678,7 +771,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (!ctx->cpu)
 		goto err;
 
-	err = aio_setup_ring(ctx);
+	err = aio_setup_ring(ctx, sq_entries);
 	if (err < 0)
 		goto err;
 
@@ -726,6 +819,19 @@ err:
 	return ERR_PTR(err);
 }
 
+static void aio_sq_thread_stop(struct kioctx *ctx)
+{
+	if (!ctx->sq_thread)
+		return;
+
+	kthread_stop(ctx->sq_thread);
+	put_task_struct(ctx->sq_thread);
+	ctx->sq_thread = NULL;
+
+	put_files_struct(ctx->sq_files);
+	put_cred(ctx->sq_cred);
+}
+
 /* kill_ioctx
  *	Cancels all outstanding aio requests on an aio context.  Used
  *	when the processes owning a context have all exited to encourage
@@ -739,6 +845,7 @@ static int kill_ioctx(struct mm_struct *mm, struct kioctx *ctx,
 	if (atomic_xchg(&ctx->dead, 1))
 		return -EINVAL;
 
+	aio_sq_thread_stop(ctx);
 
 	spin_lock(&mm->ioctx_lock);
 	table = rcu_dereference_raw(mm->ioctx_table);
@@ -1006,6 +1113,11 @@ void aio_complete(struct kiocb *iocb, long res, long res2)
 	unsigned tail, pos, head;
 	unsigned long	flags;
 
+	if (iocb->ki_complete) {
+		iocb->ki_complete(iocb, res, res2);
+		return;
+	}
+
 	/*
 	 * Special case handling for sync iocbs:
 	 *  - events go directly into the iocb for fast handling
@@ -1267,7 +1379,7 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, 0);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1360,44 +1472,219 @@ static ssize_t aio_setup_single_vector(struct kiocb *kiocb,
 	return 0;
 }
 
+/*
+ * A request deferred to aio_wq. The iovec is copied here since the one
+ * aio_run_iocb() set up lives on the submitter's stack.
+ */
+struct aio_work {
+	struct work_struct	work;
+	struct kiocb		*req;
+	struct mm_struct	*mm;
+	unsigned		opcode;
+	unsigned long		nr_segs;
+	struct iovec		*iovec;
+	struct iovec		inline_vecs[UIO_FASTIOV];
+};
+
+/*
+ * Only O_DIRECT I/O on regular files and block devices is implemented
+ * asynchronously, buffered I/O would block in the submitter.
+ */
+static bool aio_needs_worker(struct file *file)
+{
+	umode_t mode = file_inode(file)->i_mode;
+
+	if (file->f_flags & O_DIRECT)
+		return false;
+	return S_ISREG(mode) || S_ISBLK(mode);
+}
+
+/*
+ * Check whether a buffered read can be served from the page cache, in
+ * which case it's cheap enough to just do it inline.
+ */
+static bool aio_read_cached(struct kiocb *req)
+{
+	struct address_space *mapping = req->ki_filp->f_mapping;
+	pgoff_t index, end;
+
+	if (!req->ki_nbytes)
+		return true;
+
+	index = req->ki_pos >> PAGE_CACHE_SHIFT;
+	end = (req->ki_pos + req->ki_nbytes - 1) >> PAGE_CACHE_SHIFT;
+	for (; index <= end; index++) {
+		struct page *page = find_get_page(mapping, index);
+		bool uptodate;
+
+		if (!page)
+			return false;
+		uptodate = PageUptodate(page);
+		page_cache_release(page);
+		if (!uptodate)
+			return false;
+	}
+	return true;
+}
+
+static ssize_t aio_rw(struct kiocb *req, int rw, const struct iovec *iovec,
+		      unsigned long nr_segs)
+{
+	struct file *file = req->ki_filp;
+	struct iov_iter iter;
+	rw_iter_op *iter_op;
+	aio_rw_op *rw_op;
+	ssize_t ret;
+
+	if (rw == READ) {
+		rw_op	= file->f_op->aio_read;
+		iter_op	= file->f_op->read_iter;
+	} else {
+		rw_op	= file->f_op->aio_write;
+		iter_op	= file->f_op->write_iter;
+		file_start_write(file);
+	}
+
+	if (iter_op) {
+		iov_iter_init(&iter, rw, iovec, nr_segs, req->ki_nbytes);
+		ret = iter_op(req, &iter);
+	} else {
+		ret = rw_op(req, iovec, nr_segs, req->ki_pos);
+	}
+
+	if (rw == WRITE)
+		file_end_write(file);
+	return ret;
+}
+
+static void aio_complete_rw(struct kiocb *req, ssize_t ret)
+{
+	if (ret != -EIOCBQUEUED) {
+		/*
+		 * There's no easy way to restart the syscall since other AIO's
+		 * may be already running. Just fail this IO with EINTR.
+		 */
+		if (unlikely(ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+			     ret == -ERESTARTNOHAND ||
+			     ret == -ERESTART_RESTARTBLOCK))
+			ret = -EINTR;
+		aio_complete(req, ret, 0);
+	}
+}
+
+static void aio_work_fn(struct work_struct *work)
+{
+	struct aio_work *aw = container_of(work, struct aio_work, work);
+	struct kiocb *req = aw->req;
+	mm_segment_t oldfs;
+	ssize_t ret;
+
+	switch (aw->opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PREADV:
+	case IOCB_CMD_PWRITE:
+	case IOCB_CMD_PWRITEV:
+		oldfs = get_fs();
+		set_fs(USER_DS);
+		use_mm(aw->mm);
+		ret = aio_rw(req, (aw->opcode == IOCB_CMD_PREAD ||
+				   aw->opcode == IOCB_CMD_PREADV) ? READ : WRITE,
+			     aw->iovec, aw->nr_segs);
+		unuse_mm(aw->mm);
+		set_fs(oldfs);
+		break;
+	case IOCB_CMD_FDSYNC:
+		ret = vfs_fsync(req->ki_filp, 1);
+		break;
+	default:
+		ret = vfs_fsync(req->ki_filp, 0);
+		break;
+	}
+
+	if (aw->iovec != aw->inline_vecs)
+		kfree(aw->iovec);
+
+	/* complete first, dropping the mm can tear down the ioctx */
+	aio_complete_rw(req, ret);
+	mmput(aw->mm);
+	kfree(aw);
+}
+
+/*
+ * aio_defer_iocb:
+ *	Hands a request that would block to aio_wq. The worker runs with the
+ *	submitter's mm so that it can access the user buffers.
+ */
+static ssize_t aio_defer_iocb(struct kiocb *req, unsigned opcode,
+			      const struct iovec *iovec, unsigned long nr_segs)
+{
+	struct aio_work *aw;
+
+	aw = kmalloc(sizeof(*aw), GFP_KERNEL);
+	if (!aw)
+		return -ENOMEM;
+
+	aw->iovec = aw->inline_vecs;
+	if (nr_segs > UIO_FASTIOV) {
+		aw->iovec = kmalloc(nr_segs * sizeof(*iovec), GFP_KERNEL);
+		if (!aw->iovec) {
+			kfree(aw);
+			return -ENOMEM;
+		}
+	}
+	if (nr_segs)
+		memcpy(aw->iovec, iovec, nr_segs * sizeof(*iovec));
+
+	INIT_WORK(&aw->work, aio_work_fn);
+	aw->req = req;
+	aw->opcode = opcode;
+	aw->nr_segs = nr_segs;
+	aw->mm = current->mm;
+
+	/* the submission ring thread can race with the exiting owner */
+	if (!atomic_inc_not_zero(&aw->mm->mm_users)) {
+		if (aw->iovec != aw->inline_vecs)
+			kfree(aw->iovec);
+		kfree(aw);
+		return -EINVAL;
+	}
+
+	queue_work(aio_wq, &aw->work);
+	return -EIOCBQUEUED;
+}
+
 /*
  * aio_run_iocb:
  *	Performs the initial checks and io submission.
  */
 static ssize_t aio_run_iocb(struct kiocb *req, unsigned opcode,
-			    char __user *buf, bool compat)
+			    char __user *buf, unsigned flags, bool compat)
 {
 	struct file *file = req->ki_filp;
 	ssize_t ret;
 	unsigned long nr_segs;
 	int rw;
 	fmode_t mode;
-	aio_rw_op *rw_op;
-	rw_iter_op *iter_op;
 	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
-	struct iov_iter iter;
 
 	switch (opcode) {
 	case IOCB_CMD_PREAD:
 	case IOCB_CMD_PREADV:
 		mode	= FMODE_READ;
 		rw	= READ;
-		rw_op	= file->f_op->aio_read;
-		iter_op	= file->f_op->read_iter;
 		goto rw_common;
 
 	case IOCB_CMD_PWRITE:
 	case IOCB_CMD_PWRITEV:
 		mode	= FMODE_WRITE;
 		rw	= WRITE;
-		rw_op	= file->f_op->aio_write;
-		iter_op	= file->f_op->write_iter;
 		goto rw_common;
 rw_common:
 		if (unlikely(!(file->f_mode & mode)))
 			return -EBADF;
 
-		if (!rw_op && !iter_op)
+		if (rw == READ ? !file->f_op->aio_read && !file->f_op->read_iter
+			       : !file->f_op->aio_write && !file->f_op->write_iter)
 			return -EINVAL;
 
 		ret = (opcode == IOCB_CMD_PREADV ||
@@ -1423,32 +1710,42 @@ rw_common:
 			break;
 		}
 
-		if (rw == WRITE)
-			file_start_write(file);
-
-		if (iter_op) {
-			iov_iter_init(&iter, rw, iovec, nr_segs, req->ki_nbytes);
-			ret = iter_op(req, &iter);
-		} else {
-			ret = rw_op(req, iovec, nr_segs, req->ki_pos);
+		if (aio_needs_worker(file) &&
+		    (rw == WRITE || !aio_read_cached(req))) {
+			if (flags & IOCB_FLAG_NOWAIT) {
+				if (iovec != inline_vecs)
+					kfree(iovec);
+				return -EAGAIN;
+			}
+			ret = aio_defer_iocb(req, opcode, iovec, nr_segs);
+			if (ret != -EIOCBQUEUED) {
+				if (iovec != inline_vecs)
+					kfree(iovec);
+				return ret;
+			}
+			break;
 		}
 
-		if (rw == WRITE)
-			file_end_write(file);
+		ret = aio_rw(req, rw, iovec, nr_segs);
 		break;
 
 	case IOCB_CMD_FDSYNC:
-		if (!file->f_op->aio_fsync)
-			return -EINVAL;
-
-		ret = file->f_op->aio_fsync(req, 1);
-		break;
-
 	case IOCB_CMD_FSYNC:
-		if (!file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync) {
+			ret = file->f_op->aio_fsync(req,
+						    opcode == IOCB_CMD_FDSYNC);
+			break;
+		}
+
+		/* No async fsync, run a plain one in a worker instead */
+		if (!file->f_op->fsync)
 			return -EINVAL;
+		if (flags & IOCB_FLAG_NOWAIT)
+			return -EAGAIN;
 
-		ret = file->f_op->aio_fsync(req, 0);
+		ret = aio_defer_iocb(req, opcode, NULL, 0);
+		if (ret != -EIOCBQUEUED)
+			return ret;
 		break;
 
 	default:
@@ -1459,18 +1756,7 @@ rw_common:
 	if (iovec != inline_vecs)
 		kfree(iovec);
 
-	if (ret != -EIOCBQUEUED) {
-		/*
-		 * There's no easy way to restart the syscall since other AIO's
-		 * may be already running. Just fail this IO with EINTR.
-		 */
-		if (unlikely(ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
-			     ret == -ERESTARTNOHAND ||
-			     ret == -ERESTART_RESTARTBLOCK))
-			ret = -EINTR;
-		aio_complete(req, ret, 0);
-	}
-
+	aio_complete_rw(req, ret);
 	return 0;
 }
 
@@ -1534,7 +1820,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 
 	ret = aio_run_iocb(req, iocb->aio_lio_opcode,
 			   (char __user *)(unsigned long)iocb->aio_buf,
-			   compat);
+			   iocb->aio_flags, compat);
 	if (ret)
 		goto out_put_req;
 
@@ -1617,6 +1903,293 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	return do_io_submit(ctx_id, nr, iocbpp, 0);
 }
 
+/*
+ * aio_sq_submit:
+ *	Submits up to max iocbs from the submission ring. The polling thread
+ *	skips iocbs that fail, counting them in ->dropped, since it has no
+ *	way to return the error; io_ring_enter() stops at the first failure
+ *	and leaves that iocb on the ring. -EAGAIN always stops, the iocb is
+ *	retried once requests have completed.
+ */
+static int aio_sq_submit(struct kioctx *ctx, unsigned max, bool polling)
+{
+	struct aio_sq_ring *ring = ctx->sq_ring;
+	struct aio_sq_ring __user *user_ring;
+	struct blk_plug plug;
+	unsigned head, tail;
+	int submitted = 0;
+	int ret = 0;
+
+	user_ring = (void __user *)(ctx->mmap_base + ctx->sq_offset);
+
+	mutex_lock(&ctx->sq_lock);
+	head = ctx->sq_head;
+	tail = ACCESS_ONCE(ring->tail);
+	/* read the iocbs only after reading the tail that covers them */
+	smp_rmb();
+	if (tail - head > ctx->sq_entries)
+		tail = head + ctx->sq_entries;
+
+	blk_start_plug(&plug);
+	while (head != tail && submitted < max) {
+		unsigned idx = head & (ctx->sq_entries - 1);
+		struct iocb tmp;
+
+		memcpy(&tmp, &ring->iocbs[idx], sizeof(tmp));
+		ret = io_submit_one(ctx, &user_ring->iocbs[idx], &tmp, false);
+		if (ret) {
+			if (!polling || ret == -EAGAIN)
+				break;
+			ring->dropped++;
+		} else
+			submitted++;
+		head++;
+	}
+	blk_finish_plug(&plug);
+
+	/* the iocbs must be read before their slots are handed back */
+	smp_mb();
+	ctx->sq_head = head;
+	ring->head = head;
+	mutex_unlock(&ctx->sq_lock);
+
+	return submitted ? submitted : ret;
+}
+
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	struct aio_sq_ring *ring = ctx->sq_ring;
+	struct files_struct *old_files;
+	const struct cred *old_cred;
+	unsigned long timeout;
+	mm_segment_t oldfs;
+	DEFINE_WAIT(wait);
+	int ret;
+
+	/* Submit on behalf of the task that set up the ring */
+	oldfs = get_fs();
+	set_fs(USER_DS);
+	use_mm(ctx->sq_mm);
+	old_cred = override_creds(ctx->sq_cred);
+	task_lock(current);
+	old_files = current->files;
+	current->files = ctx->sq_files;
+	task_unlock(current);
+
+	timeout = jiffies + ctx->sq_thread_idle;
+	while (!kthread_should_stop()) {
+		ret = aio_sq_submit(ctx, ctx->sq_entries, true);
+		if (ret > 0) {
+			timeout = jiffies + ctx->sq_thread_idle;
+			cond_resched();
+			continue;
+		}
+		if (ret == -EAGAIN) {
+			/* out of requests, give completions a chance */
+			schedule_timeout_interruptible(1);
+			continue;
+		}
+		if (time_before(jiffies, timeout)) {
+			cond_resched();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		ring->flags |= AIO_SQ_NEED_WAKEUP;
+		/*
+		 * Order setting the flag against reading the tail, userspace
+		 * does the opposite: update the tail, then check the flag.
+		 */
+		smp_mb();
+		if (ACCESS_ONCE(ring->tail) == ctx->sq_head &&
+		    !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+		ring->flags &= ~AIO_SQ_NEED_WAKEUP;
+		timeout = jiffies + ctx->sq_thread_idle;
+	}
+
+	task_lock(current);
+	current->files = old_files;
+	task_unlock(current);
+	revert_creds(old_cred);
+	unuse_mm(ctx->sq_mm);
+	set_fs(oldfs);
+	return 0;
+}
+
+/*
+ * aio_sq_thread_start:
+ *	The polling thread doesn't take a reference on the mm, the owner's
+ *	exit_aio() stops it through kill_ioctx() before the mm goes away.
+ */
+static int aio_sq_thread_start(struct kioctx *ctx, struct aio_setup_params *p)
+{
+	struct task_struct *tsk;
+
+	ctx->sq_mm = current->mm;
+	ctx->sq_files = get_files_struct(current);
+	ctx->sq_cred = get_current_cred();
+	ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
+	if (!ctx->sq_thread_idle)
+		ctx->sq_thread_idle = HZ;
+
+	tsk = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+			     task_pid_nr(current));
+	if (IS_ERR(tsk)) {
+		put_files_struct(ctx->sq_files);
+		put_cred(ctx->sq_cred);
+		return PTR_ERR(tsk);
+	}
+	if (p->sq_thread_cpu >= 0)
+		kthread_bind(tsk, p->sq_thread_cpu);
+
+	get_task_struct(tsk);
+	ctx->sq_thread = tsk;
+	wake_up_process(tsk);
+	return 0;
+}
+
+/* sys_io_setup2:
+ *	Like io_setup(), with flags to add a submission ring to the ring
+ *	mapping and optionally a kernel thread that polls it. The offset of
+ *	the submission ring is returned in params->sq_offset.
+ */
+SYSCALL_DEFINE4(io_setup2, unsigned, nr_events, unsigned, flags,
+		struct aio_setup_params __user *, params,
+		aio_context_t __user *, ctxp)
+{
+	struct aio_setup_params p;
+	struct kioctx *ioctx;
+	unsigned long ctx;
+	long ret;
+	int i;
+
+	if (flags & ~(IOCTX_FLAG_SQRING | IOCTX_FLAG_SQTHREAD))
+		return -EINVAL;
+
+	if (flags & IOCTX_FLAG_SQTHREAD) {
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		flags |= IOCTX_FLAG_SQRING;
+	}
+
+	memset(&p, 0, sizeof(p));
+	if (flags & IOCTX_FLAG_SQRING) {
+		if (copy_from_user(&p, params, sizeof(p)))
+			return -EFAULT;
+		for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+			if (p.resv[i])
+				return -EINVAL;
+		if (!p.sq_entries || p.sq_entries > AIO_SQ_MAX_ENTRIES)
+			return -EINVAL;
+		p.sq_entries = roundup_pow_of_two(p.sq_entries);
+
+		if (!(flags & IOCTX_FLAG_SQTHREAD))
+			p.sq_thread_cpu = -1;
+		else if (p.sq_thread_cpu >= 0 &&
+			 (p.sq_thread_cpu >= nr_cpu_ids ||
+			  !cpu_online(p.sq_thread_cpu)))
+			return -EINVAL;
+	}
+
+	ret = get_user(ctx, ctxp);
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely(ctx || nr_events == 0)) {
+		pr_debug("EINVAL: io_setup2: ctx %lu nr_events %u\n",
+			 ctx, nr_events);
+		return -EINVAL;
+	}
+
+	ioctx = ioctx_alloc(nr_events, p.sq_entries);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+
+	if (flags & IOCTX_FLAG_SQTHREAD)
+		ret = aio_sq_thread_start(ioctx, &p);
+	if (!ret && (flags & IOCTX_FLAG_SQRING)) {
+		p.sq_offset = ioctx->sq_offset;
+		if (copy_to_user(params, &p, sizeof(p)))
+			ret = -EFAULT;
+	}
+	if (!ret)
+		ret = put_user(ioctx->user_id, ctxp);
+	if (ret)
+		kill_ioctx(current->mm, ioctx, NULL);
+	percpu_ref_put(&ioctx->users);
+
+	return ret;
+}
+
+/* Number of events in the completion ring that userspace hasn't reaped */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring *ring;
+	unsigned long flags;
+	unsigned head, tail;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	ring = kmap_atomic(ctx->ring_pages[0]);
+	head = ring->head;
+	kunmap_atomic(ring);
+	tail = ctx->tail;
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	head %= ctx->nr_events;
+	return (tail + ctx->nr_events - head) % ctx->nr_events;
+}
+
+/* sys_io_ring_enter:
+ *	Submits up to to_submit iocbs from the submission ring of an ioctx
+ *	set up with io_setup2(), or wakes up its polling thread. With
+ *	IORING_ENTER_GETEVENTS it then waits until at least min_complete
+ *	events are in the completion ring, which userspace reaps itself.
+ *	Returns the number of iocbs submitted.
+ */
+SYSCALL_DEFINE4(io_ring_enter, aio_context_t, ctx_id, u32, to_submit,
+		u32, min_complete, u32, flags)
+{
+	struct kioctx *ctx;
+	long ret = 0;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx)) {
+		pr_debug("EINVAL: invalid context id\n");
+		return -EINVAL;
+	}
+
+	if (!ctx->sq_ring) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (ctx->sq_thread) {
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sq_wait);
+	} else if (to_submit) {
+		ret = aio_sq_submit(ctx, to_submit, false);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->nr_events - 1);
+		if (wait_event_interruptible(ctx->wait,
+				aio_ring_events(ctx) >= min_complete ||
+				atomic_read(&ctx->dead)) && !ret)
+			ret = -EINTR;
+	}
+out:
+	percpu_ref_put(&ctx->users);
+	return ret;
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
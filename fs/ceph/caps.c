@@ -840,6 +840,8 @@ int __ceph_caps_used(struct ceph_inode_info *ci)
 		used |= CEPH_CAP_FILE_WR;
 	if (ci->i_wb_ref || ci->i_wrbuffer_ref)
 		used |= CEPH_CAP_FILE_BUFFER;
+	if (ci->i_fx_ref)
+		used |= CEPH_CAP_FILE_EXCL;
 	return used;
 }
 
@@ -2030,7 +2032,7 @@ static void kick_flushing_inode_caps(struct ceph_mds_client *mdsc,
  *
  * Protected by i_ceph_lock.
  */
-static void __take_cap_refs(struct ceph_inode_info *ci, int got)
+void __ceph_take_cap_refs(struct ceph_inode_info *ci, int got)
 {
 	if (got & CEPH_CAP_PIN)
 		ci->i_pin_ref++;
@@ -2047,6 +2049,8 @@ static void __take_cap_refs(struct ceph_inode_info *ci, int got)
 		dout("__take_cap_refs %p wb %d -> %d (?)\n",
 		     &ci->vfs_inode, ci->i_wb_ref-1, ci->i_wb_ref);
 	}
+	if (got & CEPH_CAP_FILE_EXCL)
+		ci->i_fx_ref++;
 }
 
 /*
@@ -2121,7 +2125,7 @@ static int try_get_cap_refs(struct ceph_inode_info *ci, int need, int want,
 		     ceph_cap_string(revoking));
 		if ((revoking & not) == 0) {
 			*got = need | (have & want);
-			__take_cap_refs(ci, *got);
+			__ceph_take_cap_refs(ci, *got);
 			ret = 1;
 		}
 	} else {
@@ -2196,7 +2200,7 @@ retry:
 void ceph_get_cap_refs(struct ceph_inode_info *ci, int caps)
 {
 	spin_lock(&ci->i_ceph_lock);
-	__take_cap_refs(ci, caps);
+	__ceph_take_cap_refs(ci, caps);
 	spin_unlock(&ci->i_ceph_lock);
 }
 
@@ -2209,7 +2213,8 @@ void ceph_get_cap_refs(struct ceph_inode_info *ci, int caps)
  * If we are releasing a WR cap (from a sync write), finalize any affected
  * cap_snap, and wake up any waiters.
  */
-void ceph_put_cap_refs(struct ceph_inode_info *ci, int had)
+static void __ceph_put_cap_refs(struct ceph_inode_info *ci, int had,
+				bool skip_checkcaps)
 {
 	struct inode *inode = &ci->vfs_inode;
 	int last = 0, put = 0, flushsnaps = 0, wake = 0;
@@ -2224,6 +2229,9 @@ void ceph_put_cap_refs(struct ceph_inode_info *ci, int had)
 	if (had & CEPH_CAP_FILE_CACHE)
 		if (--ci->i_rdcache_ref == 0)
 			last++;
+	if (had & CEPH_CAP_FILE_EXCL)
+		if (--ci->i_fx_ref == 0)
+			last++;
 	if (had & CEPH_CAP_FILE_BUFFER) {
 		if (--ci->i_wb_ref == 0) {
 			last++;
@@ -2248,6 +2256,16 @@ void ceph_put_cap_refs(struct ceph_inode_info *ci, int had)
 				}
 			}
 		}
+	/*
+	 * The caller may hold locks that ceph_check_caps needs (e.g.
+	 * mdsc->mutex when an async request is torn down), so let the
+	 * delayed work do the check instead.
+	 */
+	if (last && !flushsnaps && skip_checkcaps) {
+		__cap_delay_requeue_front(ceph_inode_to_client(inode)->mdsc,
+					  ci);
+		last = 0;
+	}
 	spin_unlock(&ci->i_ceph_lock);
 
 	dout("put_cap_refs %p had %s%s%s\n", inode, ceph_cap_string(had),
@@ -2263,6 +2281,16 @@ void ceph_put_cap_refs(struct ceph_inode_info *ci, int had)
 		iput(inode);
 }
 
+void ceph_put_cap_refs(struct ceph_inode_info *ci, int had)
+{
+	__ceph_put_cap_refs(ci, had, false);
+}
+
+void ceph_put_cap_refs_no_check_caps(struct ceph_inode_info *ci, int had)
+{
+	__ceph_put_cap_refs(ci, had, true);
+}
+
 /*
  * Release @nr WRBUFFER refs on dirty pages for the given @snapc snap
  * context.  Adjust per-snap dirty page accounting as appropriate.
@@ -183,7 +183,7 @@ more:
 	spin_unlock(&parent->d_lock);
 
 	/* make sure a dentry wasn't dropped while we didn't have parent lock */
-	if (!ceph_dir_is_complete(dir)) {
+	if (!ceph_dir_is_complete_ordered(dir)) {
 		dout(" lost dir complete on %p; falling back to mds\n", dir);
 		dput(dentry);
 		err = -EAGAIN;
@@ -264,6 +264,7 @@ static int ceph_readdir(struct file *file, struct dir_context *ctx)
 		/* note dir version at start of readdir so we can tell
 		 * if any dentries get dropped */
 		fi->dir_release_count = atomic_read(&ci->i_release_count);
+		fi->dir_ordered_count = atomic_read(&ci->i_ordered_count);
 
 		dout("readdir off 0 -> '.'\n");
 		if (!dir_emit(ctx, ".", 1, 
@@ -289,7 +290,7 @@ static int ceph_readdir(struct file *file, struct dir_context *ctx)
 	if ((ctx->pos == 2 || fi->dentry) &&
 	    !ceph_test_mount_opt(fsc, NOASYNCREADDIR) &&
 	    ceph_snap(inode) != CEPH_SNAPDIR &&
-	    __ceph_dir_is_complete(ci) &&
+	    __ceph_dir_is_complete_ordered(ci) &&
 	    __ceph_caps_issued_mask(ci, CEPH_CAP_FILE_SHARED, 1)) {
 		u32 shared_gen = ci->i_shared_gen;
 		spin_unlock(&ci->i_ceph_lock);
@@ -447,7 +448,8 @@ more:
 	spin_lock(&ci->i_ceph_lock);
 	if (atomic_read(&ci->i_release_count) == fi->dir_release_count) {
 		dout(" marking %p complete\n", inode);
-		__ceph_dir_set_complete(ci, fi->dir_release_count);
+		__ceph_dir_set_complete(ci, fi->dir_release_count,
+					fi->dir_ordered_count);
 	}
 	spin_unlock(&ci->i_ceph_lock);
 
@@ -874,6 +876,62 @@ static int drop_caps_for_unlink(struct inode *inode)
 	return drop;
 }
 
+static void ceph_async_unlink_cb(struct ceph_mds_client *mdsc,
+				 struct ceph_mds_request *req)
+{
+	int result = req->r_err ? req->r_err :
+			le32_to_cpu(req->r_reply_info.head->result);
+
+	/* the dentry is already gone; all we can do is complain */
+	if (result) {
+		int pathlen;
+		u64 base;
+		char *path = ceph_mdsc_build_path(req->r_dentry, &pathlen,
+						  &base, 0);
+
+		pr_warn("ceph: async unlink failure path=(%llx)%s result=%d!\n",
+			base, IS_ERR(path) ? "<<bad>>" : path, result);
+		if (!IS_ERR(path))
+			kfree(path);
+
+		mapping_set_error(req->r_parent->i_mapping, result);
+		ceph_dir_clear_complete(req->r_parent);
+	}
+	ceph_mdsc_release_dir_caps(req);
+}
+
+/*
+ * We can unlink without waiting for the mds if we hold Fx and the
+ * unlink cap on the dir, and the inode's link count is known to go
+ * to zero.  On success, take refs on the dir caps and return the mds
+ * they came from; otherwise return -1.
+ */
+static int get_caps_for_async_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	struct ceph_inode_info *ici = ceph_inode(dentry->d_inode);
+	int want = CEPH_CAP_FILE_EXCL | CEPH_CAP_DIR_UNLINK;
+	bool nlink_known;
+	int mds = -1;
+
+	spin_lock(&ici->i_ceph_lock);
+	nlink_known = dentry->d_inode->i_nlink == 1 &&
+		__ceph_caps_issued_mask(ici, CEPH_CAP_LINK_SHARED, 0);
+	spin_unlock(&ici->i_ceph_lock);
+	if (!nlink_known)
+		return -1;
+
+	spin_lock(&ci->i_ceph_lock);
+	if (ci->i_auth_cap &&
+	    (__ceph_caps_issued(ci, NULL) & want) == want &&
+	    !__ceph_caps_revoking_other(ci, NULL, want)) {
+		__ceph_take_cap_refs(ci, want);
+		mds = ci->i_auth_cap->session->s_mds;
+	}
+	spin_unlock(&ci->i_ceph_lock);
+	return mds;
+}
+
 /*
  * rmdir and unlink are differ only by the metadata op code
  */
@@ -883,7 +941,9 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 	struct ceph_mds_client *mdsc = fsc->mdsc;
 	struct inode *inode = dentry->d_inode;
 	struct ceph_mds_request *req;
+	bool try_async = ceph_test_mount_opt(fsc, ASYNC_DIROPS);
 	int err = -EROFS;
+	int async_mds;
 	int op;
 
 	if (ceph_snap(dir) == CEPH_SNAPDIR) {
@@ -898,6 +958,7 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 			CEPH_MDS_OP_RMDIR : CEPH_MDS_OP_UNLINK;
 	} else
 		goto out;
+retry:
 	req = ceph_mdsc_create_request(mdsc, op, USE_AUTH_MDS);
 	if (IS_ERR(req)) {
 		err = PTR_ERR(req);
@@ -905,13 +966,38 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 	}
 	req->r_dentry = dget(dentry);
 	req->r_num_caps = 2;
-	req->r_locked_dir = dir;
 	req->r_dentry_drop = CEPH_CAP_FILE_SHARED;
 	req->r_dentry_unless = CEPH_CAP_FILE_EXCL;
 	req->r_inode_drop = drop_caps_for_unlink(inode);
-	err = ceph_mdsc_do_request(mdsc, dir, req);
-	if (!err && !req->r_reply_info.head->is_dentry)
-		d_delete(dentry);
+
+	async_mds = -1;
+	if (try_async && op == CEPH_MDS_OP_UNLINK)
+		async_mds = get_caps_for_async_unlink(dir, dentry);
+	if (async_mds >= 0) {
+		dout("async unlink on %llx/%.*s\n", ceph_ino(dir),
+		     dentry->d_name.len, dentry->d_name.name);
+		req->r_async_mds = async_mds;
+		req->r_dir_caps = CEPH_CAP_FILE_EXCL | CEPH_CAP_DIR_UNLINK;
+		req->r_callback = ceph_async_unlink_cb;
+		err = ceph_mdsc_submit_async_request(mdsc, dir, req);
+		if (!err) {
+			/*
+			 * We have enough caps, so we assume that the unlink
+			 * will succeed. Fix up the target inode and dcache.
+			 */
+			drop_nlink(inode);
+			d_delete(dentry);
+		} else if (err == -EJUKEBOX) {
+			try_async = false;
+			ceph_mdsc_put_request(req);
+			goto retry;
+		}
+	} else {
+		req->r_locked_dir = dir;
+		err = ceph_mdsc_do_request(mdsc, dir, req);
+		if (!err && !req->r_reply_info.head->is_dentry)
+			d_delete(dentry);
+	}
 	ceph_mdsc_put_request(req);
 out:
 	return err;
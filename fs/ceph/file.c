@@ -223,6 +223,151 @@ out:
 }
 
 
+static void ceph_async_create_cb(struct ceph_mds_client *mdsc,
+				 struct ceph_mds_request *req)
+{
+	int result = req->r_err ? req->r_err :
+			le32_to_cpu(req->r_reply_info.head->result);
+
+	/* the file is already open; make sure nobody else finds it */
+	if (result) {
+		int pathlen;
+		u64 base;
+		char *path = ceph_mdsc_build_path(req->r_dentry, &pathlen,
+						  &base, 0);
+
+		pr_warn("ceph: async create failure path=(%llx)%s result=%d!\n",
+			base, IS_ERR(path) ? "<<bad>>" : path, result);
+		if (!IS_ERR(path))
+			kfree(path);
+
+		d_drop(req->r_dentry);
+		mapping_set_error(req->r_parent->i_mapping, result);
+		ceph_dir_clear_complete(req->r_parent);
+	}
+	ceph_mdsc_release_dir_caps(req);
+}
+
+/*
+ * We can create without waiting for the mds if we hold Fx and the
+ * create cap on the dir, know the name does not exist, know what
+ * layout the new file will get, and have an ino to give it.  On
+ * success, take refs on the dir caps and return the auth mds session
+ * (with a ref) and the ino; otherwise return NULL.
+ */
+static struct ceph_mds_session *
+get_caps_for_async_create(struct inode *dir, struct dentry *dentry, u64 *pino)
+{
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	struct ceph_dentry_info *di = ceph_dentry(dentry);
+	struct ceph_mds_session *session = NULL;
+	int want = CEPH_CAP_FILE_EXCL | CEPH_CAP_DIR_CREATE;
+
+	spin_lock(&ci->i_ceph_lock);
+	if (!ci->i_auth_cap || !ci->i_cached_layout.fl_stripe_unit)
+		goto out;
+	if ((__ceph_caps_issued(ci, NULL) & want) != want ||
+	    __ceph_caps_revoking_other(ci, NULL, want))
+		goto out;
+
+	/* is the name known not to exist? */
+	if (d_unhashed(dentry)) {
+		if (!__ceph_dir_is_complete(ci))
+			goto out;
+	} else if (di->lease_shared_gen != ci->i_shared_gen) {
+		goto out;
+	}
+
+	*pino = ceph_get_deleg_ino(ci->i_auth_cap->session);
+	if (!*pino)
+		goto out;
+	session = ceph_get_mds_session(ci->i_auth_cap->session);
+	__ceph_take_cap_refs(ci, want);
+out:
+	spin_unlock(&ci->i_ceph_lock);
+	return session;
+}
+
+/*
+ * Set up the new inode of an async create from what we know it will
+ * look like, and open it.  The mds reply fills in the real thing; if
+ * it raced ahead of us the inode is already filled in.
+ */
+static int ceph_finish_async_create(struct inode *dir, struct dentry *dentry,
+				    struct file *file, umode_t mode,
+				    struct ceph_mds_request *req,
+				    int *opened)
+{
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	struct ceph_mds_session *session = req->r_session;
+	struct ceph_mds_client *mdsc = session->s_mdsc;
+	struct ceph_mds_reply_inode in = { };
+	struct ceph_mds_reply_info_in iinfo = { .in = &in };
+	struct ceph_vino vino = { .ino = req->r_deleg_ino,
+				  .snap = CEPH_NOSNAP };
+	struct inode *inode;
+	int ret = 0;
+
+	mutex_lock(&session->s_mutex);
+	inode = ceph_get_inode(dir->i_sb, vino);
+	if (IS_ERR(inode)) {
+		mutex_unlock(&session->s_mutex);
+		return PTR_ERR(inode);
+	}
+
+	if (ceph_inode(inode)->i_version == 0) {
+		kgid_t gid = (dir->i_mode & S_ISGID) ? dir->i_gid :
+						       current_fsgid();
+
+		in.ino = cpu_to_le64(vino.ino);
+		in.snapid = cpu_to_le64(CEPH_NOSNAP);
+		in.version = cpu_to_le64(1);
+		in.xattr_version = cpu_to_le64(1);
+		in.cap.caps = in.cap.wanted = cpu_to_le32(CEPH_CAP_PIN |
+				CEPH_CAP_ANY_SHARED | CEPH_CAP_ANY_EXCL |
+				CEPH_CAP_ANY_FILE_WR | CEPH_CAP_FILE_RD |
+				CEPH_CAP_FILE_CACHE);
+		in.cap.cap_id = cpu_to_le64(1);
+		in.cap.realm = cpu_to_le64(ci->i_snap_realm->ino);
+		in.cap.flags = CEPH_CAP_FLAG_AUTH;
+		in.layout = ci->i_cached_layout;
+		ceph_encode_timespec(&in.ctime, &req->r_stamp);
+		ceph_encode_timespec(&in.mtime, &req->r_stamp);
+		ceph_encode_timespec(&in.atime, &req->r_stamp);
+		in.max_size = cpu_to_le64(
+			le32_to_cpu(ci->i_cached_layout.fl_stripe_unit));
+		in.truncate_size = cpu_to_le64((u64)-1);
+		in.truncate_seq = cpu_to_le32(1);
+		in.mode = cpu_to_le32((u32)mode);
+		in.uid = cpu_to_le32(from_kuid(&init_user_ns, current_fsuid()));
+		in.gid = cpu_to_le32(from_kgid(&init_user_ns, gid));
+		in.nlink = cpu_to_le32(1);
+
+		down_read(&mdsc->snap_rwsem);
+		ret = ceph_fill_inode(inode, &iinfo, NULL, session,
+				      req->r_request_started, -1, NULL);
+		up_read(&mdsc->snap_rwsem);
+	}
+	mutex_unlock(&session->s_mutex);
+	if (ret) {
+		dout("finish_async_create fill_inode failed %d\n", ret);
+		iput(inode);
+		return ret;
+	}
+
+	if (d_unhashed(dentry))
+		d_add(dentry, inode);
+	else
+		d_instantiate(dentry, inode);
+	ceph_dentry(dentry)->lease_shared_gen = ci->i_shared_gen;
+
+	/* the new dentry has no readdir offset */
+	ceph_dir_clear_ordered(dir);
+
+	*opened |= FILE_CREATED;
+	return finish_open(file, dentry, ceph_open, opened);
+}
+
 /*
  * Do a lookup + open with a single request.  If we get a non-existent
  * file or symlink, return 1 so the VFS can retry.
@@ -234,8 +379,11 @@ int ceph_atomic_open(struct inode *dir, struct dentry *dentry,
 	struct ceph_fs_client *fsc = ceph_sb_to_client(dir->i_sb);
 	struct ceph_mds_client *mdsc = fsc->mdsc;
 	struct ceph_mds_request *req;
+	struct ceph_mds_session *session;
 	struct dentry *dn;
 	struct ceph_acls_info acls = {};
+	bool try_async = ceph_test_mount_opt(fsc, ASYNC_DIROPS);
+	u64 ino;
 	int err;
 
 	dout("atomic_open %p dentry %p '%.*s' %s flags %d mode 0%o\n",
@@ -256,6 +404,7 @@ int ceph_atomic_open(struct inode *dir, struct dentry *dentry,
 	}
 
 	/* do the open */
+retry:
 	req = prepare_open_request(dir->i_sb, flags, mode);
 	if (IS_ERR(req)) {
 		err = PTR_ERR(req);
@@ -271,6 +420,34 @@ int ceph_atomic_open(struct inode *dir, struct dentry *dentry,
 			acls.pagelist = NULL;
 		}
 	}
+
+	session = NULL;
+	if (try_async && (flags & O_CREAT) && !req->r_pagelist)
+		session = get_caps_for_async_create(dir, dentry, &ino);
+	if (session) {
+		dout("async create on %llx/%.*s ino %llx\n", ceph_ino(dir),
+		     dentry->d_name.len, dentry->d_name.name, ino);
+		req->r_dir_caps = CEPH_CAP_FILE_EXCL | CEPH_CAP_DIR_CREATE;
+		req->r_deleg_ino = ino;
+		req->r_async_mds = session->s_mds;
+		req->r_callback = ceph_async_create_cb;
+		/* the open below takes its own file mode ref */
+		req->r_fmode = -1;
+		err = ceph_mdsc_submit_async_request(mdsc, dir, req);
+		if (!err) {
+			err = ceph_finish_async_create(dir, dentry, file,
+						       mode, req, opened);
+		} else if (err == -EJUKEBOX) {
+			ceph_restore_deleg_ino(session, ino);
+			ceph_put_mds_session(session);
+			try_async = false;
+			ceph_mdsc_put_request(req);
+			goto retry;
+		}
+		ceph_put_mds_session(session);
+		goto out_req_async;
+	}
+
 	req->r_locked_dir = dir;           /* caller holds dir->i_mutex */
 	err = ceph_mdsc_do_request(mdsc,
 				   (flags & (O_CREAT|O_TRUNC)) ? dir : NULL,
@@ -299,14 +476,22 @@ int ceph_atomic_open(struct inode *dir, struct dentry *dentry,
 	} else {
 		dout("atomic_open finish_open on dn %p\n", dn);
 		if (req->r_op == CEPH_MDS_OP_CREATE && req->r_reply_info.has_create_ino) {
+			struct ceph_inode_info *ci = ceph_inode(dir);
+
 			ceph_init_inode_acls(dentry->d_inode, &acls);
 			*opened |= FILE_CREATED;
+
+			/* later async creates here will get the same layout */
+			spin_lock(&ci->i_ceph_lock);
+			ci->i_cached_layout = ceph_inode(dentry->d_inode)->i_layout;
+			spin_unlock(&ci->i_ceph_lock);
 		}
 		err = finish_open(file, dentry, ceph_open, opened);
 	}
 out_req:
 	if (!req->r_err && req->r_target_inode)
 		ceph_put_fmode(ceph_inode(req->r_target_inode), req->r_fmode);
+out_req_async:
 	ceph_mdsc_put_request(req);
 out_acl:
 	ceph_release_acls_info(&acls);
@@ -390,10 +390,13 @@ struct inode *ceph_alloc_inode(struct super_block *sb)
 	ci->i_time_warp_seq = 0;
 	ci->i_ceph_flags = 0;
 	atomic_set(&ci->i_release_count, 1);
+	atomic_set(&ci->i_ordered_count, 1);
 	atomic_set(&ci->i_complete_count, 0);
+	atomic_set(&ci->i_complete_ordered_count, 0);
 	ci->i_symlink = NULL;
 
 	memset(&ci->i_dir_layout, 0, sizeof(ci->i_dir_layout));
+	memset(&ci->i_cached_layout, 0, sizeof(ci->i_cached_layout));
 
 	ci->i_fragtree = RB_ROOT;
 	mutex_init(&ci->i_fragtree_mutex);
@@ -443,6 +446,7 @@ struct inode *ceph_alloc_inode(struct super_block *sb)
 	ci->i_rdcache_ref = 0;
 	ci->i_wr_ref = 0;
 	ci->i_wb_ref = 0;
+	ci->i_fx_ref = 0;
 	ci->i_wrbuffer_ref = 0;
 	ci->i_wrbuffer_ref_head = 0;
 	ci->i_shared_gen = 0;
@@ -657,12 +661,12 @@ void ceph_fill_file_time(struct inode *inode, int issued,
  * Populate an inode based on info from mds.  May be called on new or
  * existing inodes.
  */
-static int fill_inode(struct inode *inode,
-		      struct ceph_mds_reply_info_in *iinfo,
-		      struct ceph_mds_reply_dirfrag *dirinfo,
-		      struct ceph_mds_session *session,
-		      unsigned long ttl_from, int cap_fmode,
-		      struct ceph_cap_reservation *caps_reservation)
+int ceph_fill_inode(struct inode *inode,
+		    struct ceph_mds_reply_info_in *iinfo,
+		    struct ceph_mds_reply_dirfrag *dirinfo,
+		    struct ceph_mds_session *session,
+		    unsigned long ttl_from, int cap_fmode,
+		    struct ceph_cap_reservation *caps_reservation)
 {
 	struct ceph_mds_client *mdsc = ceph_inode_to_client(inode)->mdsc;
 	struct ceph_mds_reply_inode *info = iinfo->in;
@@ -845,7 +849,8 @@ static int fill_inode(struct inode *inode,
 	    (issued & CEPH_CAP_FILE_EXCL) == 0 &&
 	    !__ceph_dir_is_complete(ci)) {
 		dout(" marking %p complete (empty)\n", inode);
-		__ceph_dir_set_complete(ci, atomic_read(&ci->i_release_count));
+		__ceph_dir_set_complete(ci, atomic_read(&ci->i_release_count),
+					atomic_read(&ci->i_ordered_count));
 	}
 
 	/* were we issued a capability? */
@@ -1033,9 +1038,9 @@ int ceph_fill_trace(struct super_block *sb, struct ceph_mds_request *req,
 			req->r_tid, ceph_mds_op_name(rinfo->head->op));
 		if (rinfo->head->is_dentry) {
 			rinfo->head->is_dentry = 0;
-			err = fill_inode(req->r_locked_dir,
-					 &rinfo->diri, rinfo->dirfrag,
-					 session, req->r_request_started, -1);
+			err = ceph_fill_inode(req->r_locked_dir,
+					      &rinfo->diri, rinfo->dirfrag,
+					      session, req->r_request_started, -1);
 		}
 		if (rinfo->head->is_target) {
 			rinfo->head->is_target = 0;
@@ -1043,9 +1048,9 @@ int ceph_fill_trace(struct super_block *sb, struct ceph_mds_request *req,
 			vino.ino = le64_to_cpu(ininfo->ino);
 			vino.snap = le64_to_cpu(ininfo->snapid);
 			in = ceph_get_inode(sb, vino);
-			err = fill_inode(in, &rinfo->targeti, NULL,
-					 session, req->r_request_started,
-					 req->r_fmode);
+			err = ceph_fill_inode(in, &rinfo->targeti, NULL,
+					      session, req->r_request_started,
+					      req->r_fmode);
 			iput(in);
 		}
 	}
@@ -1059,12 +1064,13 @@ int ceph_fill_trace(struct super_block *sb, struct ceph_mds_request *req,
 	}
 
 	if (rinfo->head->is_dentry) {
-		struct inode *dir = req->r_locked_dir;
+		/* async ops have no locked dir, only the pinned parent */
+		struct inode *dir = req->r_locked_dir ?: req->r_parent;
 
 		if (dir) {
-			err = fill_inode(dir, &rinfo->diri, rinfo->dirfrag,
-					 session, req->r_request_started, -1,
-					 &req->r_caps_reservation);
+			err = ceph_fill_inode(dir, &rinfo->diri, rinfo->dirfrag,
+					      session, req->r_request_started, -1,
+					      &req->r_caps_reservation);
 			if (err < 0)
 				goto done;
 		} else {
@@ -1132,7 +1138,7 @@ retry_lookup:
 		}
 		req->r_target_inode = in;
 
-		err = fill_inode(in, &rinfo->targeti, NULL,
+		err = ceph_fill_inode(in, &rinfo->targeti, NULL,
 				session, req->r_request_started,
 				(!req->r_aborted && rinfo->head->result == 0) ?
 				req->r_fmode : -1,
@@ -1302,7 +1308,7 @@ static int readdir_prepopulate_inodes_only(struct ceph_mds_request *req,
 			dout("new_inode badness got %d\n", err);
 			continue;
 		}
-		rc = fill_inode(in, &rinfo->dir_in[i], NULL, session,
+		rc = ceph_fill_inode(in, &rinfo->dir_in[i], NULL, session,
 				req->r_request_started, -1,
 				&req->r_caps_reservation);
 		if (rc < 0) {
@@ -1418,9 +1424,9 @@ retry_lookup:
 			}
 		}
 
-		if (fill_inode(in, &rinfo->dir_in[i], NULL, session,
-			       req->r_request_started, -1,
-			       &req->r_caps_reservation) < 0) {
+		if (ceph_fill_inode(in, &rinfo->dir_in[i], NULL, session,
+				    req->r_request_started, -1,
+				    &req->r_caps_reservation) < 0) {
 			pr_err("fill_inode badness on %p\n", in);
 			if (!dn->d_inode)
 				iput(in);
@@ -248,6 +248,20 @@ static int parse_reply_info_create(void **p, void *end,
 		}
 	}
 
+	/* newer mds hand out a batch of inos to use for async creates */
+	info->num_deleg_inos = 0;
+	info->deleg_inos = NULL;
+	if (*p != end) {
+		u32 n;
+
+		ceph_decode_32_safe(p, end, n, bad);
+		if (n > (end - *p) / (2 * sizeof(u64)))
+			goto bad;
+		info->num_deleg_inos = n;
+		info->deleg_inos = *p;
+		*p += n * 2 * sizeof(u64);
+	}
+
 	if (unlikely(*p != end))
 		goto bad;
 	return 0;
@@ -361,6 +375,95 @@ static struct ceph_mds_session *get_session(struct ceph_mds_session *s)
 	}
 }
 
+/*
+ * inode numbers the mds has delegated to this session, so that creates
+ * can be done without waiting for a reply.  protected by s_cap_lock.
+ */
+struct ceph_deleg_ino_range {
+	struct list_head list;
+	u64 start;
+	u64 len;
+};
+
+static void add_deleg_inos(struct ceph_mds_session *s,
+			   struct ceph_mds_reply_info_parsed *info)
+{
+	void *p = info->deleg_inos;
+	u32 i;
+
+	for (i = 0; i < info->num_deleg_inos; i++) {
+		struct ceph_deleg_ino_range *r;
+		u64 start = ceph_decode_64(&p);
+		u64 len = ceph_decode_64(&p);
+
+		if (!len)
+			continue;
+		r = kmalloc(sizeof(*r), GFP_NOFS);
+		if (!r)
+			break;	/* we just do fewer async creates */
+		dout("add_deleg_inos mds%d %llx~%llu\n", s->s_mds, start, len);
+		r->start = start;
+		r->len = len;
+		spin_lock(&s->s_cap_lock);
+		list_add_tail(&r->list, &s->s_delegated_inos);
+		spin_unlock(&s->s_cap_lock);
+	}
+}
+
+static void cleanup_deleg_inos(struct ceph_mds_session *s)
+{
+	struct ceph_deleg_ino_range *r, *tmp;
+	LIST_HEAD(tmp_list);
+
+	spin_lock(&s->s_cap_lock);
+	list_splice_init(&s->s_delegated_inos, &tmp_list);
+	spin_unlock(&s->s_cap_lock);
+
+	list_for_each_entry_safe(r, tmp, &tmp_list, list) {
+		list_del(&r->list);
+		kfree(r);
+	}
+}
+
+/*
+ * take a delegated ino for an async create.  returns 0 if we have none.
+ */
+u64 ceph_get_deleg_ino(struct ceph_mds_session *s)
+{
+	struct ceph_deleg_ino_range *r;
+	u64 ino = 0;
+
+	spin_lock(&s->s_cap_lock);
+	if (!list_empty(&s->s_delegated_inos)) {
+		r = list_first_entry(&s->s_delegated_inos,
+				     struct ceph_deleg_ino_range, list);
+		ino = r->start++;
+		if (--r->len == 0) {
+			list_del(&r->list);
+			kfree(r);
+		}
+	}
+	spin_unlock(&s->s_cap_lock);
+	return ino;
+}
+
+/*
+ * give back an ino we took but did not use
+ */
+void ceph_restore_deleg_ino(struct ceph_mds_session *s, u64 ino)
+{
+	struct ceph_deleg_ino_range *r;
+
+	r = kmalloc(sizeof(*r), GFP_NOFS);
+	if (!r)
+		return;
+	r->start = ino;
+	r->len = 1;
+	spin_lock(&s->s_cap_lock);
+	list_add(&r->list, &s->s_delegated_inos);
+	spin_unlock(&s->s_cap_lock);
+}
+
 void ceph_put_mds_session(struct ceph_mds_session *s)
 {
 	dout("mdsc put_session %p %d -> %d\n", s,
@@ -370,6 +473,7 @@ void ceph_put_mds_session(struct ceph_mds_session *s)
 			ceph_auth_destroy_authorizer(
 				s->s_mdsc->fsc->client->monc.auth,
 				s->s_auth.authorizer);
+		cleanup_deleg_inos(s);
 		kfree(s);
 	}
 }
@@ -449,6 +553,7 @@ static struct ceph_mds_session *register_session(struct ceph_mds_client *mdsc,
 	s->s_cap_iterator = NULL;
 	INIT_LIST_HEAD(&s->s_cap_releases);
 	INIT_LIST_HEAD(&s->s_cap_releases_done);
+	INIT_LIST_HEAD(&s->s_delegated_inos);
 	INIT_LIST_HEAD(&s->s_cap_flushing);
 	INIT_LIST_HEAD(&s->s_cap_snaps_flushing);
 
@@ -524,6 +629,12 @@ void ceph_mdsc_release_request(struct kref *kref)
 	}
 	if (req->r_locked_dir)
 		ceph_put_cap_refs(ceph_inode(req->r_locked_dir), CEPH_CAP_PIN);
+	if (req->r_parent) {
+		ceph_mdsc_release_dir_caps(req);
+		ceph_put_cap_refs_no_check_caps(ceph_inode(req->r_parent),
+						CEPH_CAP_PIN);
+		iput(req->r_parent);
+	}
 	if (req->r_target_inode)
 		iput(req->r_target_inode);
 	if (req->r_dentry)
@@ -831,6 +942,8 @@ static struct ceph_msg *create_session_open_msg(struct ceph_mds_client *mdsc, u6
 	int metadata_bytes = 0;
 	int metadata_key_count = 0;
 	struct ceph_options *opt = mdsc->fsc->client->options;
+	static const int feature_bits[] = CEPHFS_FEATURES_CLIENT_SUPPORTED;
+	u8 features[8] = { 0 };
 	void *p;
 
 	const char* metadata[3][2] = {
@@ -847,9 +960,12 @@ static struct ceph_msg *create_session_open_msg(struct ceph_mds_client *mdsc, u6
 		metadata_key_count++;
 	}
 
+	for (i = 0; i < ARRAY_SIZE(feature_bits); i++)
+		features[feature_bits[i] / 8] |= 1 << (feature_bits[i] % 8);
+
 	/* Allocate the message */
-	msg = ceph_msg_new(CEPH_MSG_CLIENT_SESSION, sizeof(*h) + metadata_bytes,
-			   GFP_NOFS, false);
+	msg = ceph_msg_new(CEPH_MSG_CLIENT_SESSION, sizeof(*h) + metadata_bytes +
+			   4 + sizeof(features), GFP_NOFS, false);
 	if (!msg) {
 		pr_err("create_session_msg ENOMEM creating msg\n");
 		return NULL;
@@ -862,7 +978,7 @@ static struct ceph_msg *create_session_open_msg(struct ceph_mds_client *mdsc, u6
 	 * Serialize client metadata into waiting buffer space, using
 	 * the format that userspace expects for map<string, string>
 	 */
-	msg->hdr.version = 2;  /* ClientSession messages with metadata are v2 */
+	msg->hdr.version = 3;  /* v2 adds metadata, v3 the feature bitmap */
 
 	/* The write pointer, following the session_head structure */
 	p = msg->front.iov_base + sizeof(*h);
@@ -883,6 +999,11 @@ static struct ceph_msg *create_session_open_msg(struct ceph_mds_client *mdsc, u6
 		p += val_len;
 	}
 
+	/* supported feature bitmap */
+	ceph_encode_32(&p, sizeof(features));
+	memcpy(p, features, sizeof(features));
+	p += sizeof(features);
+
 	return msg;
 }
 
@@ -1162,6 +1283,7 @@ static void remove_session_caps(struct ceph_mds_session *session)
 	BUG_ON(session->s_nr_caps > 0);
 	BUG_ON(!list_empty(&session->s_cap_flushing));
 	cleanup_cap_releases(session);
+	cleanup_deleg_inos(session);
 }
 
 /*
@@ -2029,12 +2151,21 @@ static int __prepare_send_request(struct ceph_mds_client *mdsc,
 	rhead->flags = cpu_to_le32(flags);
 	rhead->num_fwd = req->r_num_fwd;
 	rhead->num_retry = req->r_attempts - 1;
-	rhead->ino = 0;
+	rhead->ino = cpu_to_le64(req->r_deleg_ino);
 
 	dout(" r_locked_dir = %p\n", req->r_locked_dir);
 	return 0;
 }
 
+/*
+ * An async request that has never been sent can still be handed back
+ * to its submitter, which then does the op synchronously.
+ */
+static bool __async_first_attempt(struct ceph_mds_request *req)
+{
+	return req->r_async && req->r_attempts == 0;
+}
+
 /*
  * send request, or put it on the appropriate wait list.
  */
@@ -2063,6 +2194,10 @@ static int __do_request(struct ceph_mds_client *mdsc,
 	mds = __choose_mds(mdsc, req);
 	if (mds < 0 ||
 	    ceph_mdsmap_get_state(mdsc->mdsmap, mds) < CEPH_MDS_STATE_ACTIVE) {
+		if (__async_first_attempt(req)) {
+			err = -EJUKEBOX;
+			goto finish;
+		}
 		dout("do_request no mds or not active, waiting for map\n");
 		list_add(&req->r_wait, &mdsc->waiting_for_map);
 		goto out;
@@ -2081,6 +2216,14 @@ static int __do_request(struct ceph_mds_client *mdsc,
 
 	dout("do_request mds%d session %p state %s\n", mds, session,
 	     ceph_session_state_name(session->s_state));
+	if (__async_first_attempt(req) &&
+	    (mds != req->r_async_mds ||
+	     session->s_state != CEPH_MDS_SESSION_OPEN)) {
+		/* the caps this was based on may be going away */
+		err = -EJUKEBOX;
+		req->r_err = err;
+		goto out_session;
+	}
 	if (session->s_state != CEPH_MDS_SESSION_OPEN &&
 	    session->s_state != CEPH_MDS_SESSION_HUNG) {
 		if (session->s_state == CEPH_MDS_SESSION_NEW ||
@@ -2109,7 +2252,9 @@ out:
 
 finish:
 	req->r_err = err;
-	complete_request(mdsc, req);
+	/* the submitter falls back to a sync request; no callback */
+	if (!__async_first_attempt(req))
+		complete_request(mdsc, req);
 	goto out;
 }
 
@@ -2167,6 +2312,55 @@ void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
 	mutex_unlock(&mdsc->mutex);
 }
 
+/*
+ * Submit a request without waiting for the reply.  The caller must hold
+ * dir caps (r_dir_caps) on @dir that make the outcome predictable;
+ * r_callback is called once the mds replies.  Returns -EJUKEBOX if the
+ * request could not be sent right away, in which case the caller should
+ * fall back to a synchronous request.
+ */
+int ceph_mdsc_submit_async_request(struct ceph_mds_client *mdsc,
+				   struct inode *dir,
+				   struct ceph_mds_request *req)
+{
+	int err;
+
+	dout("submit_async_request on %p\n", req);
+
+	req->r_async = true;
+	ihold(dir);
+	req->r_parent = dir;
+	ceph_get_cap_refs(ceph_inode(dir), CEPH_CAP_PIN);
+
+	mutex_lock(&mdsc->mutex);
+	__register_request(mdsc, req, dir);
+	__do_request(mdsc, req);
+	err = req->r_err;
+	if (err) {
+		__unregister_request(mdsc, req);
+		dout("submit_async_request early error %d\n", err);
+	}
+	mutex_unlock(&mdsc->mutex);
+	return err;
+}
+
+/*
+ * Drop the dir cap refs an async request was issued under.  May be
+ * called with mdsc->mutex held, so leave the cap check to the delayed
+ * work.
+ */
+void ceph_mdsc_release_dir_caps(struct ceph_mds_request *req)
+{
+	int dcaps;
+
+	dcaps = xchg(&req->r_dir_caps, 0);
+	if (dcaps) {
+		dout("release_dir_caps %s\n", ceph_cap_string(dcaps));
+		ceph_put_cap_refs_no_check_caps(ceph_inode(req->r_parent),
+						dcaps);
+	}
+}
+
 /*
  * Synchrously perform an mds request.  Take care of all of the
  * session setup, forwarding, retry details.
@@ -2386,6 +2580,8 @@ static void handle_reply(struct ceph_mds_session *session, struct ceph_msg *msg)
 		ceph_msg_dump(msg);
 		goto out_err;
 	}
+	if (req->r_op == CEPH_MDS_OP_CREATE && rinfo->num_deleg_inos)
+		add_deleg_inos(session, rinfo);
 
 	/* snap trace */
 	if (rinfo->snapblob_len) {
@@ -2687,20 +2883,16 @@ static int encode_caps_cb(struct inode *inode, struct ceph_cap *cap,
 		struct ceph_filelock *flocks;
 
 encode_again:
-		spin_lock(&inode->i_lock);
 		ceph_count_locks(inode, &num_fcntl_locks, &num_flock_locks);
-		spin_unlock(&inode->i_lock);
 		flocks = kmalloc((num_fcntl_locks+num_flock_locks) *
 				 sizeof(struct ceph_filelock), GFP_NOFS);
 		if (!flocks) {
 			err = -ENOMEM;
 			goto out_free;
 		}
-		spin_lock(&inode->i_lock);
 		err = ceph_encode_locks_to_buffer(inode, flocks,
 						  num_fcntl_locks,
 						  num_flock_locks);
-		spin_unlock(&inode->i_lock);
 		if (err) {
 			kfree(flocks);
 			if (err == -ENOSPC)
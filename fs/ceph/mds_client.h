@@ -27,6 +27,15 @@
  *
  */
 
+/*
+ * client feature bits advertised to the mds at session open
+ */
+#define CEPHFS_FEATURE_DELEG_INO	13
+
+#define CEPHFS_FEATURES_CLIENT_SUPPORTED {	\
+	CEPHFS_FEATURE_DELEG_INO,		\
+}
+
 struct ceph_fs_client;
 struct ceph_cap;
 
@@ -80,6 +89,9 @@ struct ceph_mds_reply_info_parsed {
 		struct {
 			bool has_create_ino;
 			u64 ino;
+			/* (start, len) pairs of inos delegated to us */
+			u32 num_deleg_inos;
+			void *deleg_inos;
 		};
 	};
 
@@ -136,6 +148,8 @@ struct ceph_mds_session {
 	int		  s_cap_reconnect;
 	struct list_head  s_cap_releases; /* waiting cap_release messages */
 	struct list_head  s_cap_releases_done; /* ready to send */
+	struct list_head  s_delegated_inos; /* inos we may use for async
+					       creates */
 	struct ceph_cap  *s_cap_iterator;
 
 	/* protected by mutex */
@@ -186,6 +200,8 @@ struct ceph_mds_request {
 	struct ceph_vino r_ino1, r_ino2;
 
 	struct inode *r_locked_dir; /* dir (if any) i_mutex locked by vfs */
+	struct inode *r_parent;     /* parent dir of an async op; pinned */
+	int r_dir_caps;             /* dir caps held by an async op */
 	struct inode *r_target_inode;       /* resulting inode */
 
 	struct mutex r_fill_mutex;
@@ -217,6 +233,9 @@ struct ceph_mds_request {
 	struct ceph_mds_reply_info_parsed r_reply_info;
 	int r_err;
 	bool r_aborted;
+	bool r_async;             /* caller is not waiting for the reply */
+	int r_async_mds;          /* mds whose caps allowed the async op */
+	u64 r_deleg_ino;          /* delegated ino for an async create */
 
 	unsigned long r_timeout;  /* optional.  jiffies */
 	unsigned long r_started;  /* start time to measure timeout against */
@@ -357,6 +376,10 @@ extern void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
 extern int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 				struct inode *dir,
 				struct ceph_mds_request *req);
+extern int ceph_mdsc_submit_async_request(struct ceph_mds_client *mdsc,
+					  struct inode *dir,
+					  struct ceph_mds_request *req);
+extern void ceph_mdsc_release_dir_caps(struct ceph_mds_request *req);
 static inline void ceph_mdsc_get_request(struct ceph_mds_request *req)
 {
 	kref_get(&req->r_kref);
@@ -374,6 +397,9 @@ extern void ceph_send_cap_releases(struct ceph_mds_client *mdsc,
 
 extern void ceph_mdsc_pre_umount(struct ceph_mds_client *mdsc);
 
+extern u64 ceph_get_deleg_ino(struct ceph_mds_session *session);
+extern void ceph_restore_deleg_ino(struct ceph_mds_session *session, u64 ino);
+
 extern char *ceph_mdsc_build_path(struct dentry *dentry, int *plen, u64 *base,
 				  int stop_on_nosnap);
 
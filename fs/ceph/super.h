@@ -35,6 +35,7 @@
 #define CEPH_MOUNT_OPT_INO32           (1<<8) /* 32 bit inos */
 #define CEPH_MOUNT_OPT_DCACHE          (1<<9) /* use dcache for readdir etc */
 #define CEPH_MOUNT_OPT_FSCACHE         (1<<10) /* use fscache */
+#define CEPH_MOUNT_OPT_ASYNC_DIROPS    (1<<11) /* allow async creates/unlinks */
 
 #define CEPH_MOUNT_OPT_DEFAULT    (CEPH_MOUNT_OPT_RBYTES)
 
@@ -257,10 +258,13 @@ struct ceph_inode_info {
 
 	unsigned i_ceph_flags;
 	atomic_t i_release_count;
+	atomic_t i_ordered_count;
 	atomic_t i_complete_count;
+	atomic_t i_complete_ordered_count;
 
 	struct ceph_dir_layout i_dir_layout;
 	struct ceph_file_layout i_layout;
+	struct ceph_file_layout i_cached_layout; /* for async creates */
 	char *i_symlink;
 
 	/* for dirs */
@@ -308,7 +312,7 @@ struct ceph_inode_info {
 
 	/* held references to caps */
 	int i_pin_ref;
-	int i_rd_ref, i_rdcache_ref, i_wr_ref, i_wb_ref;
+	int i_rd_ref, i_rdcache_ref, i_wr_ref, i_wb_ref, i_fx_ref;
 	int i_wrbuffer_ref, i_wrbuffer_ref_head;
 	u32 i_shared_gen;       /* increment each time we get FILE_SHARED */
 	u32 i_rdcache_gen;      /* incremented each time we get FILE_CACHE. */
@@ -438,9 +442,18 @@ static inline struct inode *ceph_find_inode(struct super_block *sb,
 #define CEPH_I_FLUSH     8  /* do not delay flush of dirty metadata */
 #define CEPH_I_NOFLUSH  16  /* do not flush dirty caps */
 
+/*
+ * A complete dir has all of its dentries in the dcache, so a negative
+ * lookup can be answered locally.  It is also ordered if d_subdirs
+ * matches the mds readdir order, so readdir can be satisfied from the
+ * dcache too.  Async creates add dentries out of order, so they only
+ * clear the ordered state.
+ */
 static inline void __ceph_dir_set_complete(struct ceph_inode_info *ci,
-					   int release_count)
+					   int release_count,
+					   int ordered_count)
 {
+	atomic_set(&ci->i_complete_ordered_count, ordered_count);
 	atomic_set(&ci->i_complete_count, release_count);
 }
 
@@ -449,22 +462,44 @@ static inline void __ceph_dir_clear_complete(struct ceph_inode_info *ci)
 	atomic_inc(&ci->i_release_count);
 }
 
+static inline void __ceph_dir_clear_ordered(struct ceph_inode_info *ci)
+{
+	atomic_inc(&ci->i_ordered_count);
+}
+
 static inline bool __ceph_dir_is_complete(struct ceph_inode_info *ci)
 {
 	return atomic_read(&ci->i_complete_count) ==
 		atomic_read(&ci->i_release_count);
 }
 
+static inline bool __ceph_dir_is_complete_ordered(struct ceph_inode_info *ci)
+{
+	return __ceph_dir_is_complete(ci) &&
+		atomic_read(&ci->i_complete_ordered_count) ==
+		atomic_read(&ci->i_ordered_count);
+}
+
 static inline void ceph_dir_clear_complete(struct inode *inode)
 {
 	__ceph_dir_clear_complete(ceph_inode(inode));
 }
 
+static inline void ceph_dir_clear_ordered(struct inode *inode)
+{
+	__ceph_dir_clear_ordered(ceph_inode(inode));
+}
+
 static inline bool ceph_dir_is_complete(struct inode *inode)
 {
 	return __ceph_dir_is_complete(ceph_inode(inode));
 }
 
+static inline bool ceph_dir_is_complete_ordered(struct inode *inode)
+{
+	return __ceph_dir_is_complete_ordered(ceph_inode(inode));
+}
+
 
 /* find a specific frag @f */
 extern struct ceph_inode_frag *__ceph_find_frag(struct ceph_inode_info *ci,
@@ -580,6 +615,7 @@ struct ceph_file_info {
 	char *last_name;       /* last entry in previous chunk */
 	struct dentry *dentry; /* next dentry (for dcache readdir) */
 	int dir_release_count;
+	int dir_ordered_count;
 
 	/* used for -o dirstat read() on directory thing */
 	char *dir_info;
@@ -700,6 +736,15 @@ extern int ceph_fill_file_size(struct inode *inode, int issued,
 extern void ceph_fill_file_time(struct inode *inode, int issued,
 				u64 time_warp_seq, struct timespec *ctime,
 				struct timespec *mtime, struct timespec *atime);
+struct ceph_mds_reply_info_in;
+struct ceph_mds_reply_dirfrag;
+
+extern int ceph_fill_inode(struct inode *inode,
+			   struct ceph_mds_reply_info_in *iinfo,
+			   struct ceph_mds_reply_dirfrag *dirinfo,
+			   struct ceph_mds_session *session,
+			   unsigned long ttl_from, int cap_fmode,
+			   struct ceph_cap_reservation *caps_reservation);
 extern int ceph_fill_trace(struct super_block *sb,
 			   struct ceph_mds_request *req,
 			   struct ceph_mds_session *session);
@@ -812,8 +857,11 @@ extern void ceph_kick_flushing_caps(struct ceph_mds_client *mdsc,
 extern struct ceph_cap *ceph_get_cap_for_mds(struct ceph_inode_info *ci,
 					     int mds);
 extern int ceph_get_cap_mds(struct inode *inode);
+extern void __ceph_take_cap_refs(struct ceph_inode_info *ci, int caps);
 extern void ceph_get_cap_refs(struct ceph_inode_info *ci, int caps);
 extern void ceph_put_cap_refs(struct ceph_inode_info *ci, int had);
+extern void ceph_put_cap_refs_no_check_caps(struct ceph_inode_info *ci,
+					    int had);
 extern void ceph_put_wrbuffer_cap_refs(struct ceph_inode_info *ci, int nr,
 				       struct ceph_snap_context *snapc);
 extern void __ceph_flush_snaps(struct ceph_inode_info *ci,
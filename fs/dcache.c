@@ -116,6 +116,34 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
+static DEFINE_PER_CPU(long, nr_dentry_negative);
+
+/*
+ * Unused negative dentries sit on their own per-superblock LRU. Beyond
+ * sysctl_negative_dentry_limit percent of memory in total, or beyond
+ * sysctl_negative_dentry_sb_max on one superblock, they are trimmed by a
+ * background work item, so that neither d_alloc() nor the lookups filling
+ * the cache ever wait for it. 0 disables a limit.
+ */
+int sysctl_negative_dentry_limit __read_mostly = 2;
+unsigned long sysctl_negative_dentry_sb_max __read_mostly;
+
+/* the limits are checked every NEG_DENTRY_BATCH negative dentries per cpu */
+#define NEG_DENTRY_BATCH	1024
+/* dentries isolated per LRU lock hold when trimming */
+#define NEG_DENTRY_TRIM_BATCH	128UL
+
+static void neg_dentry_trim_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(neg_dentry_trim_work, neg_dentry_trim_workfn);
+
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
@@ -154,6 +182,7 @@ int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -335,6 +364,7 @@ static void dentry_unlink_inode(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	__d_clear_type(dentry);
+	d_lru_refile(dentry);
 	dentry->d_inode = NULL;
 	hlist_del_init(&dentry->d_alias);
 	dentry_rcuwalk_barrier(dentry);
@@ -359,24 +389,69 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * The per-cpu "nr_dentry_unused" counters are updated with
  * the DCACHE_LRU_LIST bit.
  *
+ * The DCACHE_NEGATIVE_LRU bit is set whenever the dentry is on
+ * the per-superblock negative dentry LRU list instead of the
+ * regular one, and the per-cpu "nr_dentry_negative" counters
+ * are updated with it.
+ *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
  */
 #define D_FLAG_VERIFY(dentry,x) WARN_ON_ONCE(((dentry)->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) != (x))
 static void d_lru_add(struct dentry *dentry)
 {
+	struct list_lru *lru = &dentry->d_sb->s_dentry_lru;
+
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
-	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+	if (d_is_negative(dentry)) {
+		dentry->d_flags |= DCACHE_NEGATIVE_LRU;
+		lru = &dentry->d_sb->s_dentry_neg_lru;
+		if (unlikely(!(this_cpu_inc_return(nr_dentry_negative) &
+			       (NEG_DENTRY_BATCH - 1))) &&
+		    (sysctl_negative_dentry_limit ||
+		     sysctl_negative_dentry_sb_max))
+			schedule_delayed_work(&neg_dentry_trim_work, 0);
+	}
+	WARN_ON_ONCE(!list_lru_add(lru, &dentry->d_lru));
+}
+
+/* the dentry is leaving the negative LRU, by other means than list_lru_del */
+static void d_neg_lru_clear(struct dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_NEGATIVE_LRU) {
+		dentry->d_flags &= ~DCACHE_NEGATIVE_LRU;
+		this_cpu_dec(nr_dentry_negative);
+	}
 }
 
 static void d_lru_del(struct dentry *dentry)
 {
+	struct list_lru *lru = &dentry->d_sb->s_dentry_lru;
+
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
-	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+	if (dentry->d_flags & DCACHE_NEGATIVE_LRU)
+		lru = &dentry->d_sb->s_dentry_neg_lru;
+	d_neg_lru_clear(dentry);
+	WARN_ON_ONCE(!list_lru_del(lru, &dentry->d_lru));
+}
+
+/*
+ * A dentry on an LRU list that turns positive or negative is moved to
+ * the matching list.
+ */
+static void d_lru_refile(struct dentry *dentry)
+{
+	if ((dentry->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) !=
+	    DCACHE_LRU_LIST)
+		return;
+	if (!(dentry->d_flags & DCACHE_NEGATIVE_LRU) == !d_is_negative(dentry))
+		return;
+	d_lru_del(dentry);
+	d_lru_add(dentry);
 }
 
 static void d_shrink_del(struct dentry *dentry)
@@ -406,6 +481,7 @@ static void d_lru_isolate(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	d_neg_lru_clear(dentry);
 	list_del_init(&dentry->d_lru);
 }
 
@@ -413,6 +489,7 @@ static void d_lru_shrink_move(struct dentry *dentry, struct list_head *list)
 {
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	d_neg_lru_clear(dentry);
 	list_move_tail(&dentry->d_lru, list);
 }
 
@@ -947,12 +1024,76 @@ long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
 	LIST_HEAD(dispose);
 	long freed;
 
-	freed = list_lru_walk_node(&sb->s_dentry_lru, nid, dentry_lru_isolate,
+	/* negative dentries are the cheapest to recreate, they go first */
+	freed = list_lru_walk_node(&sb->s_dentry_neg_lru, nid,
+				   dentry_lru_isolate, &dispose, &nr_to_scan);
+	freed += list_lru_walk_node(&sb->s_dentry_lru, nid, dentry_lru_isolate,
 				       &dispose, &nr_to_scan);
 	shrink_dentry_list(&dispose);
 	return freed;
 }
 
+struct neg_dentry_trim {
+	unsigned long excess;	/* over the global limit */
+	unsigned long total;	/* negative dentries on all LRUs */
+	unsigned long sb_max;
+	bool again;
+};
+
+static void trim_negative_dentries_sb(struct super_block *sb, void *arg)
+{
+	struct neg_dentry_trim *trim = arg;
+	unsigned long nr = list_lru_count(&sb->s_dentry_neg_lru);
+	unsigned long nr_to_trim = 0;
+
+	if (trim->sb_max && nr > trim->sb_max)
+		nr_to_trim = nr - trim->sb_max;
+	/* superblocks share the global excess by their negative dentries */
+	if (trim->excess && trim->total)
+		nr_to_trim = max(nr_to_trim, mult_frac(trim->excess, nr,
+						       trim->total));
+
+	while (nr_to_trim) {
+		LIST_HEAD(dispose);
+		unsigned long freed;
+
+		freed = list_lru_walk(&sb->s_dentry_neg_lru,
+				      dentry_lru_isolate, &dispose,
+				      min(nr_to_trim, NEG_DENTRY_TRIM_BATCH));
+		shrink_dentry_list(&dispose);
+		if (!freed) {
+			/* in use, locked or referenced, try again later */
+			trim->again = true;
+			break;
+		}
+		nr_to_trim -= min(freed, nr_to_trim);
+		cond_resched();
+	}
+}
+
+static void neg_dentry_trim_workfn(struct work_struct *work)
+{
+	int pct = ACCESS_ONCE(sysctl_negative_dentry_limit);
+	struct neg_dentry_trim trim = {
+		.total = get_nr_dentry_negative(),
+		.sb_max = ACCESS_ONCE(sysctl_negative_dentry_sb_max),
+	};
+	unsigned long limit;
+
+	if (pct) {
+		limit = totalram_pages / 100 * pct *
+			(PAGE_SIZE / sizeof(struct dentry));
+		if (trim.total > limit)
+			trim.excess = trim.total - limit;
+	}
+	if (!trim.excess && !trim.sb_max)
+		return;
+
+	iterate_supers(trim_negative_dentries_sb, &trim);
+	if (trim.again)
+		schedule_delayed_work(&neg_dentry_trim_work, HZ);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 						spinlock_t *lru_lock, void *arg)
 {
@@ -990,6 +1131,8 @@ void shrink_dcache_sb(struct super_block *sb)
 
 		freed = list_lru_walk(&sb->s_dentry_lru,
 			dentry_lru_isolate_shrink, &dispose, UINT_MAX);
+		freed += list_lru_walk(&sb->s_dentry_neg_lru,
+			dentry_lru_isolate_shrink, &dispose, UINT_MAX);
 
 		this_cpu_sub(nr_dentry_unused, freed);
 		shrink_dentry_list(&dispose);
@@ -1493,6 +1636,154 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 }
 EXPORT_SYMBOL(d_alloc);
 
+/*
+ * Dentries being looked up without the parent's i_mutex (FS_PARALLEL_LOOKUP)
+ * are kept on a small hash until ->lookup() is done with them, so that
+ * concurrent lookups of the same name can find the one in progress and wait
+ * for it instead of issuing another.  Entries are added with the parent's
+ * i_mutex held; they are removed, and waiters woken, without it.
+ */
+#define IN_LOOKUP_SHIFT 10
+static struct hlist_bl_head in_lookup_hashtable[1 << IN_LOOKUP_SHIFT];
+static wait_queue_head_t in_lookup_waitqueues[1 << IN_LOOKUP_SHIFT];
+
+static inline struct hlist_bl_head *in_lookup_hash(const struct dentry *parent,
+						   unsigned int hash)
+{
+	hash += (unsigned long) parent / L1_CACHE_BYTES;
+	return in_lookup_hashtable + hash_32(hash, IN_LOOKUP_SHIFT);
+}
+
+static inline wait_queue_head_t *in_lookup_waitqueue(const struct dentry *dentry)
+{
+	return in_lookup_waitqueues + hash_ptr((void *)dentry, IN_LOOKUP_SHIFT);
+}
+
+/**
+ * d_alloc_parallel - allocate a dentry to be looked up without i_mutex
+ * @parent: parent of entry to allocate
+ * @name: qstr of the name
+ *
+ * Like d_alloc(), but the new dentry is marked as being looked up until
+ * d_lookup_done() is called on it, and d_find_in_lookup() will return it
+ * in the meantime.  The caller must hold the parent's i_mutex and must have
+ * checked that neither the dcache nor d_find_in_lookup() knows the name.
+ */
+struct dentry *d_alloc_parallel(struct dentry *parent, const struct qstr *name)
+{
+	struct hlist_bl_head *b = in_lookup_hash(parent, name->hash);
+	struct dentry *dentry = d_alloc(parent, name);
+
+	if (!dentry)
+		return NULL;
+
+	spin_lock(&dentry->d_lock);
+	/* d_find_in_lookup() looks at it under RCU */
+	dentry->d_flags |= DCACHE_PAR_LOOKUP | DCACHE_RCUACCESS;
+	hlist_bl_lock(b);
+	hlist_bl_add_head(&dentry->d_in_lookup_hash, b);
+	hlist_bl_unlock(b);
+	spin_unlock(&dentry->d_lock);
+	return dentry;
+}
+EXPORT_SYMBOL(d_alloc_parallel);
+
+/**
+ * d_find_in_lookup - find a dentry whose lookup is in progress
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ *
+ * Returns a reference to the dentry allocated by d_alloc_parallel() for
+ * @name in @parent if its lookup has not finished yet, or %NULL.  The caller
+ * must hold the parent's i_mutex so that the answer stays valid until it
+ * drops it.
+ */
+struct dentry *d_find_in_lookup(struct dentry *parent, const struct qstr *name)
+{
+	unsigned int hash = name->hash;
+	struct hlist_bl_head *b = in_lookup_hash(parent, hash);
+	struct hlist_bl_node *node;
+	struct dentry *dentry, *found = NULL;
+
+	/*
+	 * The names of in-lookup dentries can't change while they are on the
+	 * hash: __d_move() takes them off it first, under the bucket lock.
+	 * That happens with d_lock held, so the reference has to be taken
+	 * after dropping the bucket lock; RCU keeps the dentry around.
+	 */
+	rcu_read_lock();
+	hlist_bl_lock(b);
+	hlist_bl_for_each_entry(dentry, node, b, d_in_lookup_hash) {
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+		if (parent->d_flags & DCACHE_OP_COMPARE) {
+			if (parent->d_op->d_compare(parent, dentry,
+						    dentry->d_name.len,
+						    dentry->d_name.name, name))
+				continue;
+		} else {
+			if (dentry->d_name.len != name->len)
+				continue;
+			if (dentry_cmp(dentry, name->name, name->len))
+				continue;
+		}
+		found = dentry;
+		break;
+	}
+	hlist_bl_unlock(b);
+	/* a dead one is past d_lookup_done() already */
+	if (found && !lockref_get_not_dead(&found->d_lockref))
+		found = NULL;
+	rcu_read_unlock();
+	return found;
+}
+EXPORT_SYMBOL(d_find_in_lookup);
+
+/**
+ * d_wait_lookup - wait for the lookup of a dentry to finish
+ * @dentry: dentry returned by d_find_in_lookup()
+ *
+ * Once this returns the dentry is hashed if the lookup succeeded, and
+ * unhashed if it failed or the filesystem used another dentry instead.
+ */
+void d_wait_lookup(struct dentry *dentry)
+{
+	wait_event(*in_lookup_waitqueue(dentry), !d_in_lookup(dentry));
+}
+EXPORT_SYMBOL(d_wait_lookup);
+
+/* dentry->d_lock must be held */
+static void __d_lookup_done(struct dentry *dentry)
+{
+	struct hlist_bl_head *b = in_lookup_hash(dentry->d_parent,
+						 dentry->d_name.hash);
+
+	hlist_bl_lock(b);
+	dentry->d_flags &= ~DCACHE_PAR_LOOKUP;
+	hlist_bl_del(&dentry->d_in_lookup_hash);
+	hlist_bl_unlock(b);
+	INIT_LIST_HEAD(&dentry->d_lru);
+	wake_up_all(in_lookup_waitqueue(dentry));
+}
+
+/**
+ * d_lookup_done - finish the lookup of a dentry from d_alloc_parallel()
+ * @dentry: the dentry
+ *
+ * Must be called once ->lookup() has returned, and before the dentry is
+ * dropped.  Wakes up everyone waiting in d_wait_lookup().
+ */
+void d_lookup_done(struct dentry *dentry)
+{
+	spin_lock(&dentry->d_lock);
+	if (d_in_lookup(dentry))
+		__d_lookup_done(dentry);
+	spin_unlock(&dentry->d_lock);
+}
+EXPORT_SYMBOL(d_lookup_done);
+
 /**
  * d_alloc_pseudo - allocate a dentry (for lookup-less filesystems)
  * @sb: the superblock
@@ -1578,6 +1869,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 
 	spin_lock(&dentry->d_lock);
 	__d_set_type(dentry, add_flags);
+	d_lru_refile(dentry);
 	if (inode)
 		hlist_add_head(&dentry->d_alias, &inode->i_dentry);
 	dentry->d_inode = inode;
@@ -2493,6 +2785,10 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 
 	dentry_lock_for_move(dentry, target);
 
+	/* d_splice_alias() moving an alias over a dentry still in lookup */
+	if (unlikely(d_in_lookup(target)))
+		__d_lookup_done(target);
+
 	write_seqcount_begin(&dentry->d_seq);
 	write_seqcount_begin_nested(&target->d_seq, DENTRY_D_LOCK_NESTED);
 
@@ -3380,6 +3676,9 @@ static void __init dcache_init(void)
 	dentry_cache = KMEM_CACHE(dentry,
 		SLAB_RECLAIM_ACCOUNT|SLAB_PANIC|SLAB_MEM_SPREAD);
 
+	for (loop = 0; loop < (1U << IN_LOOKUP_SHIFT); loop++)
+		init_waitqueue_head(in_lookup_waitqueues + loop);
+
 	/* Hash may have been set up in dcache_init_early */
 	if (!hashdist)
 		return;
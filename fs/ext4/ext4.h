@@ -809,6 +809,7 @@ do {									       \
 #endif /* defined(__KERNEL__) || defined(__linux__) */
 
 #include "extents_status.h"
+#include "fast_commit.h"
 
 /*
  * fourth extended file system inode data in memory
@@ -941,6 +942,16 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Fast commit tracking: the inode is on s_fc_q if it was changed in
+	 * transaction i_fc_tid, and i_fc_lblk_* is the range of blocks whose
+	 * mapping changed.  [s_fc_lock]
+	 */
+	struct list_head i_fc_list;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_len;
+	tid_t i_fc_tid;
+
 	/* Precomputed uuid+inum+igen checksum for seeding inode checksums */
 	__u32 i_csum_seed;
 };
@@ -1004,6 +1015,8 @@ struct ext4_inode_info {
 						      blocks */
 #define EXT4_MOUNT2_HURD_COMPAT		0x00000004 /* Support HURD-castrated
 						      file systems */
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000008 /* fsync writes fast
+						      commits */
 
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
@@ -1264,6 +1277,13 @@ struct ext4_sb_info {
 	unsigned short *s_mb_offsets;
 	unsigned int *s_mb_maxs;
 	unsigned int s_group_info_size;
+	/* initialized groups, by order of their largest free extent */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	/* initialized groups, by order of their average free extent */
+	struct list_head *s_mb_avg_fragment_size;
+	rwlock_t *s_mb_avg_fragment_size_locks;
+	atomic_t s_mb_uninit_groups;	/* groups with NEED_INIT set */
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1273,6 +1293,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_max_dir_size_kb;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1342,6 +1363,20 @@ struct ext4_sb_info {
 	struct ratelimit_state s_err_ratelimit_state;
 	struct ratelimit_state s_warning_ratelimit_state;
 	struct ratelimit_state s_msg_ratelimit_state;
+
+	/*
+	 * Fast commit: inodes and directory entries changed in the running
+	 * transaction, and whether the transaction did something a fast
+	 * commit can't describe.  [s_fc_lock]
+	 */
+	spinlock_t s_fc_lock;
+	struct list_head s_fc_q;
+	struct list_head s_fc_dentry_q;
+	bool s_fc_ineligible;
+	tid_t s_fc_ineligible_tid;
+	/* fast commits to replay after journal recovery */
+	bool s_fc_replay;
+	tid_t s_fc_replay_tid;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1509,6 +1544,7 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
 #define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
 #define EXT4_FEATURE_COMPAT_SPARSE_SUPER2	0x0200
+#define EXT4_FEATURE_COMPAT_FAST_COMMIT		0x0400
 
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
@@ -2033,6 +2069,24 @@ static inline  unsigned char get_dtype(struct super_block *sb, int filetype)
 extern int ext4_check_all_de(struct inode *dir, struct buffer_head *bh,
 			     void *buf, int buf_size);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb);
+extern void ext4_fc_init_inode(struct inode *inode);
+extern void ext4_fc_del(struct inode *inode);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t len);
+extern void ext4_fc_track_create(handle_t *handle, struct inode *inode,
+				 struct dentry *dentry);
+extern void ext4_fc_track_link(handle_t *handle, struct inode *inode,
+			       struct dentry *dentry);
+extern void ext4_fc_track_unlink(handle_t *handle, struct inode *inode,
+				 struct dentry *dentry);
+extern int ext4_fc_commit(journal_t *journal, tid_t commit_tid);
+extern void ext4_fc_cleanup(journal_t *journal, tid_t tid);
+extern int ext4_fc_replay(struct super_block *sb);
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 
@@ -2056,6 +2110,8 @@ extern struct inode *__ext4_new_inode(handle_t *, struct inode *, umode_t,
 
 
 extern void ext4_free_inode(handle_t *, struct inode *);
+extern int ext4_mark_inode_used(handle_t *handle, struct super_block *sb,
+				unsigned long ino);
 extern struct inode * ext4_orphan_get(struct super_block *, unsigned long);
 extern unsigned long ext4_count_free_inodes(struct super_block *);
 extern unsigned long ext4_count_dirs(struct super_block *);
@@ -2079,6 +2135,8 @@ extern void ext4_exit_mballoc(void);
 extern void ext4_free_blocks(handle_t *handle, struct inode *inode,
 			     struct buffer_head *bh, ext4_fsblk_t block,
 			     unsigned long count, int flags);
+extern int ext4_mb_mark_bb(handle_t *handle, struct super_block *sb,
+			   ext4_fsblk_t block, int len);
 extern int ext4_mb_alloc_groupinfo(struct super_block *sb,
 				   ext4_group_t ngroups);
 extern int ext4_mb_add_groupinfo(struct super_block *sb,
@@ -2178,6 +2236,10 @@ extern int ext4_generic_delete_entry(handle_t *handle,
 				     void *entry_buf,
 				     int buf_size,
 				     int csum_size);
+extern int ext4_fc_replay_link(struct inode *dir, struct inode *inode,
+			       struct qstr *name);
+extern int ext4_fc_replay_unlink(struct inode *dir, unsigned long ino,
+				 struct qstr *name);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
@@ -2486,7 +2548,12 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size_order;	/* order of average
+							 * frag in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct          list_head bb_largest_free_order_node;
+	struct          list_head bb_avg_fragment_size_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -2746,6 +2813,10 @@ extern struct ext4_ext_path *ext4_find_extent(struct inode *, ext4_lblk_t,
 					      struct ext4_ext_path **,
 					      int flags);
 extern void ext4_ext_drop_refs(struct ext4_ext_path *);
+extern unsigned int ext4_ext_check_overlap(struct ext4_sb_info *sbi,
+					   struct inode *inode,
+					   struct ext4_extent *newext,
+					   struct ext4_ext_path *path);
 extern int ext4_ext_check_inode(struct inode *inode);
 extern int ext4_find_delalloc_range(struct inode *inode,
 				    ext4_lblk_t lblk_start,
@@ -1877,10 +1877,10 @@ static void ext4_ext_try_to_merge(handle_t *handle,
  * such that there will be no overlap, and then returns 1.
  * If there is no overlap found, it returns 0.
  */
-static unsigned int ext4_ext_check_overlap(struct ext4_sb_info *sbi,
-					   struct inode *inode,
-					   struct ext4_extent *newext,
-					   struct ext4_ext_path *path)
+unsigned int ext4_ext_check_overlap(struct ext4_sb_info *sbi,
+				    struct inode *inode,
+				    struct ext4_extent *newext,
+				    struct ext4_ext_path *path)
 {
 	ext4_lblk_t b1, b2;
 	unsigned int depth, len1;
@@ -4866,6 +4866,7 @@ static long ext4_zero_range(struct file *file, loff_t offset,
 		ext4_std_error(inode->i_sb, ret);
 		goto out_dio;
 	}
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
 	if (new_size) {
@@ -5455,6 +5456,7 @@ int ext4_collapse_range(struct inode *inode, loff_t offset, loff_t len)
 		ret = PTR_ERR(handle);
 		goto out_dio;
 	}
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	down_write(&EXT4_I(inode)->i_data_sem);
 	ext4_discard_preallocations(inode);
@@ -0,0 +1,1108 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits for fsync.
+ *
+ * A full jbd2 commit writes every metadata block changed by the running
+ * transaction, however little of it the fsync()ing task cares about.  A
+ * fast commit instead writes a few logical records describing the changes
+ * made to the inodes and directory entries tracked in the running
+ * transaction (see fast_commit.h), into a small area at the end of the
+ * journal.  On the next mount, after jbd2 has recovered the committed
+ * transactions, the records of the transaction that was still running are
+ * replayed on top of them.
+ *
+ * Only the simple operations are described by records: data block
+ * allocation and freeing, inode updates, and creating, linking and
+ * unlinking regular files.  Anything else marks the running transaction
+ * ineligible, and fsync() falls back to a full commit until it is done.
+ */
+
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/crc32.h>
+#include <linux/writeback.h>
+#include <linux/blkdev.h>
+#include <linux/quotaops.h>
+#include <linux/jbd2.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+void ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock_init(&sbi->s_fc_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_q);
+	INIT_LIST_HEAD(&sbi->s_fc_dentry_q);
+	sbi->s_fc_ineligible = false;
+}
+
+void ext4_fc_init_inode(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_lblk_start = 0;
+	ei->i_fc_lblk_len = 0;
+	ei->i_fc_tid = 0;
+}
+
+static bool ext4_fc_disabled(struct super_block *sb)
+{
+	return !test_opt2(sb, JOURNAL_FAST_COMMIT) ||
+	       EXT4_SB(sb)->s_fc_replay;
+}
+
+/* Called with s_fc_lock held */
+static void __ext4_fc_mark_ineligible(struct ext4_sb_info *sbi, tid_t tid)
+{
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid)) {
+		sbi->s_fc_ineligible = true;
+		sbi->s_fc_ineligible_tid = tid;
+	}
+}
+
+/*
+ * Make fsync() do a full commit of the transaction of @handle, because it
+ * contains changes fast commit records can't describe.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (ext4_fc_disabled(sb) || !ext4_handle_valid(handle))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	__ext4_fc_mark_ineligible(sbi, handle->h_transaction->t_tid);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Can the changes to @inode be described by fast commit records?  Only
+ * the blocks of extent mapped files are tracked, and not the contents of
+ * quota files, which are journalled like metadata.
+ */
+static bool ext4_fc_inode_eligible(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	return ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	       !ext4_has_inline_data(inode) &&
+	       !IS_NOQUOTA(inode) &&
+	       !ext4_should_journal_data(inode) &&
+	       test_opt(sb, DELALLOC) &&
+	       !EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_BIGALLOC);
+}
+
+/*
+ * Queue @inode for the next fast commit, remembering that blocks
+ * [start, start + len) of it may have been remapped.
+ */
+static void __ext4_fc_track(handle_t *handle, struct inode *inode,
+			    ext4_lblk_t start, ext4_lblk_t len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	ext4_lblk_t end;
+	tid_t tid;
+
+	if (ext4_fc_disabled(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+
+	/*
+	 * Directories are brought up to date by replaying the entries
+	 * added and removed by the tracked dentry operations, which all
+	 * run under EXT4_HT_DIR handles.  Any other change to anything
+	 * but a regular file needs a full commit.
+	 */
+	if (!S_ISREG(inode->i_mode)) {
+		if (handle->h_type != EXT4_HT_DIR)
+			ext4_fc_mark_ineligible(inode->i_sb, handle);
+		return;
+	}
+	if (!ext4_fc_inode_eligible(inode)) {
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+		return;
+	}
+
+	tid = handle->h_transaction->t_tid;
+	spin_lock(&sbi->s_fc_lock);
+	if (ei->i_fc_tid != tid) {
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_len = 0;
+	}
+	if (len) {
+		if (!ei->i_fc_lblk_len) {
+			ei->i_fc_lblk_start = start;
+			ei->i_fc_lblk_len = len;
+		} else {
+			end = max(ei->i_fc_lblk_start + ei->i_fc_lblk_len,
+				  start + len);
+			ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+			ei->i_fc_lblk_len = end - ei->i_fc_lblk_start;
+		}
+	}
+	if (list_empty(&ei->i_fc_list))
+		list_add_tail(&ei->i_fc_list, &sbi->s_fc_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	__ext4_fc_track(handle, inode, 0, 0);
+}
+
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t len)
+{
+	if (len)
+		__ext4_fc_track(handle, inode, start, len);
+}
+
+/* @inode is going away, stop tracking it */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	if (list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!list_empty(&ei->i_fc_list)) {
+		/* its changes can't be fast committed any more */
+		list_del_init(&ei->i_fc_list);
+		__ext4_fc_mark_ineligible(sbi, ei->i_fc_tid);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static void __ext4_fc_track_dentry(handle_t *handle, struct inode *inode,
+				   struct dentry *dentry, int op)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd;
+	unsigned char *name;
+
+	if (ext4_fc_disabled(sb) || !ext4_handle_valid(handle))
+		return;
+
+	/* Only the link counts of regular files are replayed */
+	if (!S_ISREG(inode->i_mode)) {
+		ext4_fc_mark_ineligible(sb, handle);
+		return;
+	}
+
+	fcd = kmalloc(sizeof(*fcd), GFP_NOFS);
+	name = kmemdup(dentry->d_name.name, dentry->d_name.len, GFP_NOFS);
+	if (!fcd || !name) {
+		kfree(fcd);
+		kfree(name);
+		ext4_fc_mark_ineligible(sb, handle);
+		return;
+	}
+
+	fcd->fcd_op = op;
+	fcd->fcd_tid = handle->h_transaction->t_tid;
+	fcd->fcd_parent = dentry->d_parent->d_inode->i_ino;
+	fcd->fcd_ino = inode->i_ino;
+	fcd->fcd_name.name = name;
+	fcd->fcd_name.len = dentry->d_name.len;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_add_tail(&fcd->fcd_list, &sbi->s_fc_dentry_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_track_create(handle_t *handle, struct inode *inode,
+			  struct dentry *dentry)
+{
+	__ext4_fc_track_dentry(handle, inode, dentry, EXT4_FC_TAG_CREAT);
+}
+
+void ext4_fc_track_link(handle_t *handle, struct inode *inode,
+			struct dentry *dentry)
+{
+	__ext4_fc_track_dentry(handle, inode, dentry, EXT4_FC_TAG_LINK);
+}
+
+void ext4_fc_track_unlink(handle_t *handle, struct inode *inode,
+			  struct dentry *dentry)
+{
+	__ext4_fc_track_dentry(handle, inode, dentry, EXT4_FC_TAG_UNLINK);
+}
+
+static void ext4_fc_free_dentry(struct ext4_fc_dentry_update *fcd)
+{
+	kfree(fcd->fcd_name.name);
+	kfree(fcd);
+}
+
+/*
+ * Transaction @tid has committed: forget what was tracked for it.
+ * Called from the jbd2 commit callback.
+ */
+void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *ei_n;
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+
+	if (!test_opt2(sb, JOURNAL_FAST_COMMIT))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, ei_n, &sbi->s_fc_q, i_fc_list) {
+		if (tid_geq(tid, ei->i_fc_tid)) {
+			list_del_init(&ei->i_fc_list);
+			ei->i_fc_lblk_len = 0;
+		}
+	}
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		if (tid_geq(tid, fcd->fcd_tid)) {
+			list_del(&fcd->fcd_list);
+			ext4_fc_free_dentry(fcd);
+		}
+	}
+	if (sbi->s_fc_ineligible && tid_geq(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Writing fast commits
+ */
+
+/* State of the fast commit being written */
+struct ext4_fc_wr {
+	journal_t *journal;
+	struct buffer_head *bh;		/* block being filled */
+	int off;			/* offset of the next record in bh */
+	int nblks;			/* blocks used so far */
+	u32 crc;			/* crc32 of the blocks filled so far */
+};
+
+static void ext4_fc_submit_bh(struct buffer_head *bh)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(WRITE_SYNC, bh);
+}
+
+/* Pad out the current block, submit it, and start the next one */
+static int ext4_fc_next_block(struct ext4_fc_wr *wr)
+{
+	int bsize = wr->journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (wr->bh) {
+		if (bsize - wr->off >= sizeof(*tl)) {
+			tl = (struct ext4_fc_tl *)(wr->bh->b_data + wr->off);
+			tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl->fc_len = cpu_to_le16(bsize - wr->off - sizeof(*tl));
+		}
+		wr->crc = crc32_le(wr->crc, wr->bh->b_data, bsize);
+		ext4_fc_submit_bh(wr->bh);
+		wr->bh = NULL;
+	}
+
+	ret = jbd2_fc_get_buf(wr->journal, &wr->bh);
+	if (ret)
+		return ret;
+	wr->nblks++;
+	wr->off = 0;
+	return 0;
+}
+
+/* Append a record made of @hdr followed by @data */
+static int ext4_fc_add_tlv(struct ext4_fc_wr *wr, u16 tag,
+			   const void *hdr, int hdr_len,
+			   const void *data, int data_len)
+{
+	struct ext4_fc_tl tl;
+	u8 *dst;
+	int ret;
+
+	if (!wr->bh || wr->off + sizeof(tl) + hdr_len + data_len >
+		       wr->journal->j_blocksize) {
+		ret = ext4_fc_next_block(wr);
+		if (ret)
+			return ret;
+	}
+
+	tl.fc_tag = cpu_to_le16(tag);
+	tl.fc_len = cpu_to_le16(hdr_len + data_len);
+	dst = wr->bh->b_data + wr->off;
+	memcpy(dst, &tl, sizeof(tl));
+	memcpy(dst + sizeof(tl), hdr, hdr_len);
+	if (data_len)
+		memcpy(dst + sizeof(tl) + hdr_len, data, data_len);
+	wr->off += sizeof(tl) + hdr_len + data_len;
+	return 0;
+}
+
+/* Close the fast commit with a tail record */
+static int ext4_fc_add_tail(struct ext4_fc_wr *wr, tid_t tid)
+{
+	struct ext4_fc_tail tail;
+	int ret;
+
+	tail.fc_tid = cpu_to_le32(tid);
+	tail.fc_crc = 0;
+	ret = ext4_fc_add_tlv(wr, EXT4_FC_TAG_TAIL, &tail, sizeof(tail),
+			      NULL, 0);
+	if (ret)
+		return ret;
+
+	/* the checksum covers everything up to and including fc_tid */
+	wr->crc = crc32_le(wr->crc, wr->bh->b_data,
+			   wr->off - sizeof(tail.fc_crc));
+	tail.fc_crc = cpu_to_le32(wr->crc);
+	memcpy(wr->bh->b_data + wr->off - sizeof(tail.fc_crc),
+	       &tail.fc_crc, sizeof(tail.fc_crc));
+	ext4_fc_submit_bh(wr->bh);
+	wr->bh = NULL;
+	return 0;
+}
+
+static int ext4_fc_write_inode(struct ext4_fc_wr *wr, struct inode *inode)
+{
+	struct ext4_iloc iloc;
+	__le32 ino = cpu_to_le32(inode->i_ino);
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+	ret = ext4_fc_add_tlv(wr, EXT4_FC_TAG_INODE, &ino, sizeof(ino),
+			      ext4_raw_inode(&iloc),
+			      EXT4_INODE_SIZE(inode->i_sb));
+	brelse(iloc.bh);
+	return ret;
+}
+
+/* Describe the current mapping of blocks [start, start + len) of @inode */
+static int ext4_fc_write_range(struct ext4_fc_wr *wr, struct inode *inode,
+			       ext4_lblk_t start, ext4_lblk_t len)
+{
+	struct ext4_fc_add_range add;
+	struct ext4_fc_del_range del;
+	struct ext4_map_blocks map;
+	struct extent_status es;
+	struct ext4_extent ex;
+	ext4_lblk_t cur = start, end = start + len, n;
+	int ret;
+
+	while (cur < end) {
+		map.m_lblk = cur;
+		map.m_len = end - cur;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+
+		if (ret == 0) {
+			n = 1;
+			if (ext4_es_lookup_extent(inode, cur, &es) &&
+			    (ext4_es_is_hole(&es) || ext4_es_is_delayed(&es)))
+				n = es.es_lblk + es.es_len - cur;
+			n = min(n, end - cur);
+			del.fc_ino = cpu_to_le32(inode->i_ino);
+			del.fc_lblk = cpu_to_le32(cur);
+			del.fc_len = cpu_to_le32(n);
+			ret = ext4_fc_add_tlv(wr, EXT4_FC_TAG_DEL_RANGE,
+					      &del, sizeof(del), NULL, 0);
+		} else {
+			n = ret;
+			if (map.m_flags & EXT4_MAP_UNWRITTEN)
+				n = min_t(ext4_lblk_t, n,
+					  EXT_UNWRITTEN_MAX_LEN);
+			else
+				n = min_t(ext4_lblk_t, n, EXT_INIT_MAX_LEN);
+			ex.ee_block = cpu_to_le32(cur);
+			ex.ee_len = cpu_to_le16(n);
+			ext4_ext_store_pblock(&ex, map.m_pblk);
+			if (map.m_flags & EXT4_MAP_UNWRITTEN)
+				ext4_ext_mark_unwritten(&ex);
+			add.fc_ino = cpu_to_le32(inode->i_ino);
+			memcpy(add.fc_ex, &ex, sizeof(ex));
+			ret = ext4_fc_add_tlv(wr, EXT4_FC_TAG_ADD_RANGE,
+					      &add, sizeof(add), NULL, 0);
+		}
+		if (ret)
+			return ret;
+		cur += n;
+	}
+	return 0;
+}
+
+static int ext4_fc_write_dentry(struct ext4_fc_wr *wr,
+				struct ext4_fc_dentry_update *fcd)
+{
+	struct ext4_fc_dentry_info di;
+
+	di.fc_parent_ino = cpu_to_le32(fcd->fcd_parent);
+	di.fc_ino = cpu_to_le32(fcd->fcd_ino);
+	return ext4_fc_add_tlv(wr, fcd->fcd_op, &di, sizeof(di),
+			       fcd->fcd_name.name, fcd->fcd_name.len);
+}
+
+/*
+ * Write out the data of @inode that has blocks allocated already, without
+ * starting a handle: ->writepage() redirties pages still needing block
+ * allocation.  No handle may be started while a fast commit is running,
+ * because the full commit a handle might have to wait for can't start.
+ */
+static int ext4_fc_write_data(struct inode *inode)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_ALL,
+		.nr_to_write = LONG_MAX,
+		.range_start = 0,
+		.range_end = LLONG_MAX,
+	};
+	int ret;
+
+	ret = generic_writepages(inode->i_mapping, &wbc);
+	if (ret)
+		return ret;
+	return filemap_fdatawait(inode->i_mapping);
+}
+
+/*
+ * Snapshot the tracked changes of transaction @tid into fast commit
+ * records, and grab the inodes whose data must be written before the
+ * records.  Called with updates locked, so nothing can change under us.
+ */
+static int ext4_fc_write_records(struct super_block *sb, struct ext4_fc_wr *wr,
+				 tid_t tid, struct inode **inodes, int *nr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	struct ext4_inode_info *ei, *ei_n;
+	LIST_HEAD(inode_q);
+	LIST_HEAD(dentry_q);
+	ext4_lblk_t start, len;
+	int i, max = *nr, ret = 0;
+
+	*nr = 0;
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible && tid_geq(sbi->s_fc_ineligible_tid, tid)) {
+		spin_unlock(&sbi->s_fc_lock);
+		return -EAGAIN;
+	}
+	list_for_each_entry_safe(ei, ei_n, &sbi->s_fc_q, i_fc_list) {
+		if (ei->i_fc_tid != tid)
+			continue;
+		if (*nr == max) {
+			ret = -EAGAIN;
+			break;
+		}
+		/* an inode being evicted marks the transaction ineligible */
+		if (!igrab(&ei->vfs_inode)) {
+			ret = -EAGAIN;
+			break;
+		}
+		inodes[(*nr)++] = &ei->vfs_inode;
+		list_move_tail(&ei->i_fc_list, &inode_q);
+	}
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		if (fcd->fcd_tid == tid)
+			list_move_tail(&fcd->fcd_list, &dentry_q);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	/* inodes come first, so that the dentries find them on replay */
+	for (i = 0; !ret && i < *nr; i++) {
+		ei = EXT4_I(inodes[i]);
+		ret = ext4_fc_write_inode(wr, inodes[i]);
+		if (ret || !ei->i_fc_lblk_len)
+			continue;
+		start = ei->i_fc_lblk_start;
+		len = ei->i_fc_lblk_len;
+		ret = ext4_fc_write_range(wr, inodes[i], start, len);
+	}
+	list_for_each_entry(fcd, &dentry_q, fcd_list) {
+		if (ret)
+			break;
+		ret = ext4_fc_write_dentry(wr, fcd);
+	}
+
+	/*
+	 * What has been written out stays valid for the rest of the
+	 * transaction, so later fast commits only need what changes next.
+	 */
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, ei_n, &inode_q, i_fc_list) {
+		list_del_init(&ei->i_fc_list);
+		ei->i_fc_lblk_len = 0;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(fcd, fcd_n, &dentry_q, fcd_list) {
+		list_del(&fcd->fcd_list);
+		ext4_fc_free_dentry(fcd);
+	}
+	return ret;
+}
+
+/*
+ * Try to make the changes tracked in transaction @commit_tid durable with a
+ * fast commit.  Returns 0 if that worked, 1 if the caller must do a full
+ * commit instead, or a negative error.
+ */
+int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei;
+	struct inode **inodes;
+	struct ext4_fc_wr wr = {
+		.journal = journal,
+		.crc = ~0,
+	};
+	int i, nr = 0, ret;
+
+	if (!test_opt2(sb, JOURNAL_FAST_COMMIT))
+		return 1;
+
+	read_lock(&journal->j_state_lock);
+	ret = !journal->j_running_transaction ||
+	      journal->j_running_transaction->t_tid != commit_tid;
+	read_unlock(&journal->j_state_lock);
+	if (ret)
+		return 1;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible &&
+	    tid_geq(sbi->s_fc_ineligible_tid, commit_tid)) {
+		spin_unlock(&sbi->s_fc_lock);
+		return 1;
+	}
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list)
+		nr++;
+	spin_unlock(&sbi->s_fc_lock);
+
+	/* updates are locked below, so the queue can only shrink */
+	inodes = kmalloc_array(max(nr, 1), sizeof(*inodes), GFP_NOFS);
+	if (!inodes)
+		return 1;
+
+	ret = jbd2_fc_begin_commit(journal, commit_tid);
+	if (ret) {
+		kfree(inodes);
+		return 1;
+	}
+
+	jbd2_journal_lock_updates(journal);
+	ret = ext4_fc_write_records(sb, &wr, commit_tid, inodes, &nr);
+	jbd2_journal_unlock_updates(journal);
+
+	/* the data of the blocks described must be on disk first */
+	for (i = 0; !ret && i < nr; i++)
+		ret = ext4_fc_write_data(inodes[i]);
+	if (!ret)
+		ret = ext4_fc_add_tail(&wr, commit_tid);
+	if (wr.nblks) {
+		i = jbd2_fc_wait_bufs(journal, wr.nblks);
+		if (!ret)
+			ret = i;
+	}
+	if (!ret && (journal->j_flags & JBD2_BARRIER)) {
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		ret = blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
+	}
+
+	if (ret) {
+		/*
+		 * Part of what was tracked may have been dropped from the
+		 * queues already: only a full commit will do now.
+		 */
+		spin_lock(&sbi->s_fc_lock);
+		__ext4_fc_mark_ineligible(sbi, commit_tid);
+		spin_unlock(&sbi->s_fc_lock);
+		jbd2_fc_end_commit_fallback(journal, commit_tid);
+	} else {
+		jbd2_fc_end_commit(journal);
+	}
+
+	/* only now, as dropping the last reference may start a handle */
+	for (i = 0; i < nr; i++)
+		iput(inodes[i]);
+	kfree(inodes);
+
+	return ret ? 1 : 0;
+}
+
+/*
+ * Replaying fast commits
+ */
+
+static struct buffer_head *ext4_fc_read_block(journal_t *journal, int blk)
+{
+	unsigned long long pblock;
+
+	if (jbd2_journal_bmap(journal, journal->j_fc_first + blk, &pblock))
+		return NULL;
+	return __bread(journal->j_dev, pblock, journal->j_blocksize);
+}
+
+/*
+ * Find the end of the fast commits of the transaction to replay: the
+ * number of blocks up to the last fast commit whose tail has the right
+ * tid and checksum.
+ */
+static int ext4_fc_scan(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int bsize = journal->j_blocksize;
+	int nblks = journal->j_fc_last - journal->j_fc_first;
+	struct buffer_head *bh;
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	int blk, off, end = 0;
+	u32 crc = ~0;
+
+	for (blk = 0; blk < nblks; blk++) {
+		bh = ext4_fc_read_block(journal, blk);
+		if (!bh)
+			return end ? end : -EIO;
+		for (off = 0; off + sizeof(tl) <= bsize;
+		     off += sizeof(tl) + le16_to_cpu(tl.fc_len)) {
+			memcpy(&tl, bh->b_data + off, sizeof(tl));
+			if (off + sizeof(tl) + le16_to_cpu(tl.fc_len) > bsize ||
+			    !tl.fc_tag ||
+			    le16_to_cpu(tl.fc_tag) > EXT4_FC_TAG_TAIL)
+				goto out;
+			if (le16_to_cpu(tl.fc_tag) != EXT4_FC_TAG_TAIL)
+				continue;
+
+			memcpy(&tail, bh->b_data + off + sizeof(tl),
+			       sizeof(tail));
+			crc = crc32_le(crc, bh->b_data,
+				       off + sizeof(tl) + sizeof(tail.fc_tid));
+			if (le32_to_cpu(tail.fc_tid) != sbi->s_fc_replay_tid ||
+			    le32_to_cpu(tail.fc_crc) != crc)
+				goto out;
+			/* good; the next fast commit starts a new block */
+			end = blk + 1;
+			crc = ~0;
+			break;
+		}
+		if (end != blk + 1)
+			crc = crc32_le(crc, bh->b_data, bsize);
+		brelse(bh);
+	}
+	return end;
+out:
+	brelse(bh);
+	return end;
+}
+
+typedef int (*ext4_fc_replay_fn)(struct super_block *sb, u16 tag,
+				 u8 *val, int len);
+
+/* Call @fn for each record in the first @nblks fast commit blocks */
+static int ext4_fc_walk(struct super_block *sb, int nblks, ext4_fc_replay_fn fn)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int bsize = journal->j_blocksize;
+	struct buffer_head *bh;
+	struct ext4_fc_tl tl;
+	int blk, off, ret = 0;
+	u16 tag;
+
+	for (blk = 0; !ret && blk < nblks; blk++) {
+		bh = ext4_fc_read_block(journal, blk);
+		if (!bh)
+			return -EIO;
+		for (off = 0; !ret && off + sizeof(tl) <= bsize;
+		     off += sizeof(tl) + le16_to_cpu(tl.fc_len)) {
+			memcpy(&tl, bh->b_data + off, sizeof(tl));
+			tag = le16_to_cpu(tl.fc_tag);
+			if (tag == EXT4_FC_TAG_PAD || tag == EXT4_FC_TAG_TAIL)
+				break;
+			ret = fn(sb, tag, (u8 *)bh->b_data + off + sizeof(tl),
+				 le16_to_cpu(tl.fc_len));
+		}
+		brelse(bh);
+	}
+	return ret;
+}
+
+/*
+ * First pass: mark the blocks and inodes used by the fast commits in the
+ * bitmaps, so that nothing done by the second pass can allocate them.
+ */
+static int ext4_fc_replay_mark(struct super_block *sb, u16 tag,
+			       u8 *val, int len)
+{
+	struct ext4_fc_add_range *add = (struct ext4_fc_add_range *)val;
+	struct ext4_fc_dentry_info *di = (struct ext4_fc_dentry_info *)val;
+	struct ext4_extent ex;
+	handle_t *handle;
+	int ret;
+
+	if (tag != EXT4_FC_TAG_ADD_RANGE && tag != EXT4_FC_TAG_CREAT)
+		return 0;
+
+	handle = ext4_journal_start_sb(sb, EXT4_HT_MISC,
+				       EXT4_DATA_TRANS_BLOCKS(sb));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	if (tag == EXT4_FC_TAG_ADD_RANGE) {
+		memcpy(&ex, add->fc_ex, sizeof(ex));
+		ret = ext4_mb_mark_bb(handle, sb, ext4_ext_pblock(&ex),
+				      ext4_ext_get_actual_len(&ex));
+	} else {
+		ret = ext4_mark_inode_used(handle, sb,
+					   le32_to_cpu(di->fc_ino));
+		if (ret > 0)
+			ret = 0;
+	}
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/* Set the checksum of a raw inode that need not be in core */
+static void ext4_fc_inode_csum_set(struct super_block *sb, unsigned long ino,
+				   struct ext4_inode *raw)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	__le32 inum = cpu_to_le32(ino);
+	bool has_hi;
+	__u32 csum;
+
+	if (sbi->s_es->s_creator_os != cpu_to_le32(EXT4_OS_LINUX) ||
+	    !ext4_has_metadata_csum(sb))
+		return;
+
+	has_hi = EXT4_INODE_SIZE(sb) > EXT4_GOOD_OLD_INODE_SIZE &&
+		 offsetof(struct ext4_inode, i_checksum_hi) +
+		 sizeof(raw->i_checksum_hi) <=
+		 EXT4_GOOD_OLD_INODE_SIZE + le16_to_cpu(raw->i_extra_isize);
+	raw->i_checksum_lo = 0;
+	if (has_hi)
+		raw->i_checksum_hi = 0;
+	csum = ext4_chksum(sbi, sbi->s_csum_seed, (__u8 *)&inum, sizeof(inum));
+	csum = ext4_chksum(sbi, csum, (__u8 *)&raw->i_generation,
+			   sizeof(raw->i_generation));
+	csum = ext4_chksum(sbi, csum, (__u8 *)raw, EXT4_INODE_SIZE(sb));
+	raw->i_checksum_lo = cpu_to_le16(csum & 0xFFFF);
+	if (has_hi)
+		raw->i_checksum_hi = cpu_to_le16(csum >> 16);
+}
+
+/*
+ * Write the inode from an EXT4_FC_TAG_INODE record to the inode table.
+ * If the inode on disk is the same one, its block map is kept and brought
+ * up to date by the range records; otherwise it starts out empty.
+ */
+static int ext4_fc_replay_inode(struct super_block *sb, u8 *val, int len)
+{
+	struct ext4_fc_inode *fci = (struct ext4_fc_inode *)val;
+	unsigned long ino = le32_to_cpu(fci->fc_ino);
+	int isize = EXT4_INODE_SIZE(sb);
+	struct ext4_extent_header *eh;
+	struct ext4_group_desc *gdp;
+	struct ext4_inode *raw;
+	struct buffer_head *bh;
+	__le32 i_block[EXT4_N_BLOCKS];
+	__le32 blocks_lo;
+	__le16 blocks_hi;
+	ext4_fsblk_t block;
+	handle_t *handle;
+	bool same;
+	int offset, ret;
+
+	if (len - (int)sizeof(*fci) < EXT4_GOOD_OLD_INODE_SIZE ||
+	    ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return -EIO;
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EIO;
+	offset = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	block = ext4_inode_table(sb, gdp) +
+		offset / EXT4_SB(sb)->s_inodes_per_block;
+	offset = (offset % EXT4_SB(sb)->s_inodes_per_block) * isize;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	handle = ext4_journal_start_sb(sb, EXT4_HT_INODE, 1);
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out;
+	}
+	ret = ext4_journal_get_write_access(handle, bh);
+	if (ret)
+		goto out_stop;
+
+	raw = (struct ext4_inode *)(bh->b_data + offset);
+	same = raw->i_links_count &&
+	       raw->i_generation == ((struct ext4_inode *)fci->fc_raw_inode)->
+				    i_generation;
+	memcpy(i_block, raw->i_block, sizeof(i_block));
+	blocks_lo = raw->i_blocks_lo;
+	blocks_hi = raw->osd2.linux2.l_i_blocks_high;
+
+	memset(raw, 0, isize);
+	memcpy(raw, fci->fc_raw_inode, min_t(int, len - sizeof(*fci), isize));
+	if (same) {
+		memcpy(raw->i_block, i_block, sizeof(i_block));
+		raw->i_blocks_lo = blocks_lo;
+		raw->osd2.linux2.l_i_blocks_high = blocks_hi;
+	} else {
+		memset(raw->i_block, 0, sizeof(raw->i_block));
+		eh = (struct ext4_extent_header *)raw->i_block;
+		eh->eh_magic = EXT4_EXT_MAGIC;
+		eh->eh_max = cpu_to_le16((sizeof(raw->i_block) - sizeof(*eh)) /
+					 sizeof(struct ext4_extent));
+		raw->i_blocks_lo = 0;
+		raw->osd2.linux2.l_i_blocks_high = 0;
+	}
+	ext4_fc_inode_csum_set(sb, ino, raw);
+	ret = ext4_handle_dirty_metadata(handle, NULL, bh);
+out_stop:
+	ext4_journal_stop(handle);
+out:
+	brelse(bh);
+	return ret;
+}
+
+/* Unmap blocks [start, start + len) of @inode */
+static int ext4_fc_punch(struct inode *inode, ext4_lblk_t start,
+			 ext4_lblk_t len)
+{
+	handle_t *handle;
+	int ret;
+
+	handle = ext4_journal_start(inode, EXT4_HT_TRUNCATE,
+				    ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_discard_preallocations(inode);
+	ret = ext4_es_remove_extent(inode, start, len);
+	if (!ret)
+		ret = ext4_ext_remove_space(inode, start, start + len - 1);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!ret)
+		ret = ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/* Map blocks [lblk, lblk + len) of @inode, a hole, to @pblk onwards */
+static int ext4_fc_insert(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_fsblk_t pblk, ext4_lblk_t len, bool unwritten)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent newex;
+	handle_t *handle;
+	int ret;
+
+	handle = ext4_journal_start(inode, EXT4_HT_MAP_BLOCKS,
+				    ext4_chunk_trans_blocks(inode, len));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	path = ext4_find_extent(inode, lblk, NULL, 0);
+	if (IS_ERR(path)) {
+		up_write(&EXT4_I(inode)->i_data_sem);
+		ret = PTR_ERR(path);
+		goto out;
+	}
+	newex.ee_block = cpu_to_le32(lblk);
+	newex.ee_len = cpu_to_le16(len);
+	ext4_ext_store_pblock(&newex, pblk);
+	ext4_ext_check_overlap(EXT4_SB(inode->i_sb), inode, &newex, path);
+	len = ext4_ext_get_actual_len(&newex);
+	if (unwritten)
+		ext4_ext_mark_unwritten(&newex);
+	ret = ext4_ext_insert_extent(handle, inode, &path, &newex, 0);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	if (ret)
+		goto out;
+
+	ext4_es_remove_extent(inode, lblk, len);
+	dquot_alloc_block_nofail(inode, len);
+	ret = ext4_mark_inode_dirty(handle, inode);
+	if (!ret)
+		ret = len;
+out:
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/* Make the blocks of an EXT4_FC_TAG_ADD_RANGE record mapped as recorded */
+static int ext4_fc_replay_add_range(struct super_block *sb, u8 *val)
+{
+	struct ext4_fc_add_range *add = (struct ext4_fc_add_range *)val;
+	struct ext4_map_blocks map;
+	struct ext4_extent ex;
+	struct inode *inode;
+	ext4_lblk_t start, cur, end;
+	ext4_fsblk_t pblk;
+	bool unwritten;
+	int ret = 0;
+
+	memcpy(&ex, add->fc_ex, sizeof(ex));
+	start = le32_to_cpu(ex.ee_block);
+	end = start + ext4_ext_get_actual_len(&ex);
+	pblk = ext4_ext_pblock(&ex);
+	unwritten = ext4_ext_is_unwritten(&ex);
+
+	inode = ext4_iget(sb, le32_to_cpu(add->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+
+	for (cur = start; cur < end; ) {
+		map.m_lblk = cur;
+		map.m_len = end - cur;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			break;
+		if (ret == 0) {
+			ret = ext4_fc_insert(inode, cur, pblk + cur - start,
+					     end - cur, unwritten);
+			if (ret < 0)
+				break;
+		} else if (map.m_pblk != pblk + cur - start) {
+			/* mapped elsewhere: unmap, then insert next time */
+			ret = ext4_fc_punch(inode, cur, ret);
+			if (ret)
+				break;
+			continue;
+		} else if ((map.m_flags & EXT4_MAP_UNWRITTEN) && !unwritten) {
+			ret = ext4_convert_unwritten_extents(NULL, inode,
+				(loff_t)cur << inode->i_blkbits,
+				(ssize_t)ret << inode->i_blkbits);
+			if (ret)
+				break;
+			ret = map.m_len;
+		}
+		cur += ret;
+		ret = 0;
+	}
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_del_range(struct super_block *sb, u8 *val)
+{
+	struct ext4_fc_del_range *del = (struct ext4_fc_del_range *)val;
+	struct inode *inode;
+	int ret;
+
+	inode = ext4_iget(sb, le32_to_cpu(del->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+	ret = ext4_fc_punch(inode, le32_to_cpu(del->fc_lblk),
+			    le32_to_cpu(del->fc_len));
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_dentry(struct super_block *sb, u16 tag,
+				 u8 *val, int len)
+{
+	struct ext4_fc_dentry_info *di = (struct ext4_fc_dentry_info *)val;
+	unsigned long ino = le32_to_cpu(di->fc_ino);
+	struct inode *dir, *inode;
+	struct qstr name;
+	int ret;
+
+	name.name = di->fc_dname;
+	name.len = len - sizeof(*di);
+
+	dir = ext4_iget(sb, le32_to_cpu(di->fc_parent_ino));
+	if (IS_ERR(dir))
+		return PTR_ERR(dir);
+
+	if (tag == EXT4_FC_TAG_UNLINK) {
+		ret = ext4_fc_replay_unlink(dir, ino, &name);
+	} else {
+		inode = ext4_iget(sb, ino);
+		if (IS_ERR(inode)) {
+			ret = PTR_ERR(inode);
+		} else {
+			ret = ext4_fc_replay_link(dir, inode, &name);
+			iput(inode);
+		}
+	}
+	iput(dir);
+	return ret;
+}
+
+/* Second pass: apply the records in the order they were written */
+static int ext4_fc_replay_tag(struct super_block *sb, u16 tag,
+			      u8 *val, int len)
+{
+	switch (tag) {
+	case EXT4_FC_TAG_INODE:
+		return ext4_fc_replay_inode(sb, val, len);
+	case EXT4_FC_TAG_ADD_RANGE:
+		return ext4_fc_replay_add_range(sb, val);
+	case EXT4_FC_TAG_DEL_RANGE:
+		return ext4_fc_replay_del_range(sb, val);
+	case EXT4_FC_TAG_CREAT:
+	case EXT4_FC_TAG_LINK:
+	case EXT4_FC_TAG_UNLINK:
+		return ext4_fc_replay_dentry(sb, tag, val, len);
+	}
+	return 0;
+}
+
+/*
+ * Replay the fast commits of the transaction that was running when the
+ * filesystem went down, after jbd2 recovery.  Called at mount time, with
+ * the filesystem writable.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int nblks, ret;
+
+	if (!sbi->s_fc_replay)
+		return 0;
+
+	nblks = ext4_fc_scan(sb);
+	if (nblks <= 0) {
+		sbi->s_fc_replay = false;
+		return nblks;
+	}
+
+	ext4_msg(sb, KERN_INFO, "replaying fast commits of transaction %u",
+		 sbi->s_fc_replay_tid);
+	ret = ext4_fc_walk(sb, nblks, ext4_fc_replay_mark);
+	if (!ret)
+		ret = ext4_fc_walk(sb, nblks, ext4_fc_replay_tag);
+	sbi->s_fc_replay = false;
+
+	/*
+	 * The fast commit area gets reused by the next fast commit, which
+	 * describes none of this: commit it for good first.
+	 */
+	if (!ret)
+		ret = ext4_force_commit(sb);
+	return ret;
+}
@@ -0,0 +1,79 @@
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * On-disk format of ext4 fast commits.
+ *
+ * A fast commit is a sequence of tag-length-value records written to the
+ * fast commit area of the journal.  It describes the changes made to some
+ * inodes in the running transaction, and ends with a tail record holding
+ * the transaction ID and a checksum of the whole fast commit.  Records
+ * never cross block boundaries; the unused end of a block is covered by a
+ * pad record.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/* Fast commit tags */
+#define EXT4_FC_TAG_ADD_RANGE		0x0001
+#define EXT4_FC_TAG_DEL_RANGE		0x0002
+#define EXT4_FC_TAG_CREAT		0x0003
+#define EXT4_FC_TAG_LINK		0x0004
+#define EXT4_FC_TAG_UNLINK		0x0005
+#define EXT4_FC_TAG_INODE		0x0006
+#define EXT4_FC_TAG_PAD			0x0007
+#define EXT4_FC_TAG_TAIL		0x0008
+
+/* Header of every record, followed by fc_len bytes of value */
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+};
+
+/* EXT4_FC_TAG_ADD_RANGE: blocks mapped by an extent of the inode */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	__u8 fc_ex[12];			/* struct ext4_extent */
+};
+
+/* EXT4_FC_TAG_DEL_RANGE: blocks no longer mapped in the inode */
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+/* EXT4_FC_TAG_CREAT, _LINK and _UNLINK: a directory entry, then its name */
+struct ext4_fc_dentry_info {
+	__le32 fc_parent_ino;
+	__le32 fc_ino;
+	__u8 fc_dname[0];
+};
+
+/* EXT4_FC_TAG_INODE: the inode number, then the raw on-disk inode */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/* EXT4_FC_TAG_TAIL: crc32 of the fast commit up to and including fc_tid */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+#ifdef __KERNEL__
+
+/* A directory entry change waiting for the next fast commit */
+struct ext4_fc_dentry_update {
+	int fcd_op;			/* EXT4_FC_TAG_CREAT, _LINK, _UNLINK */
+	tid_t fcd_tid;			/* transaction of the change */
+	__u32 fcd_parent;
+	__u32 fcd_ino;
+	struct qstr fcd_name;		/* kmalloc'ed copy of the name */
+	struct list_head fcd_list;	/* on s_fc_dentry_q */
+};
+
+#endif /* __KERNEL__ */
+
+#endif /* _EXT4_FAST_COMMIT_H */
@@ -1158,6 +1158,89 @@ error:
 	return ERR_PTR(err);
 }
 
+/*
+ * Mark inode @ino in use in the inode bitmap and the group descriptor.
+ * Used by fast commit replay, for inodes created in a fast commit.
+ * Returns 0 if the inode was free, 1 if it was in use already.
+ */
+int ext4_mark_inode_used(handle_t *handle, struct super_block *sb,
+			 unsigned long ino)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *inode_bitmap_bh = NULL, *group_desc_bh;
+	struct ext4_group_desc *gdp;
+	ext4_group_t group;
+	int bit, free;
+	int err;
+
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(sbi->s_es->s_inodes_count))
+		return -EINVAL;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	bit = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	inode_bitmap_bh = ext4_read_inode_bitmap(sb, group);
+	if (!inode_bitmap_bh)
+		return -EIO;
+
+	gdp = ext4_get_group_desc(sb, group, &group_desc_bh);
+	err = -EIO;
+	if (!gdp)
+		goto out;
+
+	BUFFER_TRACE(inode_bitmap_bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, inode_bitmap_bh);
+	if (err)
+		goto out;
+	BUFFER_TRACE(group_desc_bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, group_desc_bh);
+	if (err)
+		goto out;
+
+	ext4_lock_group(sb, group);
+	if (ext4_test_and_set_bit(bit, inode_bitmap_bh->b_data)) {
+		ext4_unlock_group(sb, group);
+		err = 1;
+		goto out;
+	}
+
+	if (ext4_has_group_desc_csum(sb)) {
+		free = EXT4_INODES_PER_GROUP(sb) -
+			ext4_itable_unused_count(sb, gdp);
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT)) {
+			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_INODE_UNINIT);
+			free = 0;
+		}
+		if (bit + 1 > free)
+			ext4_itable_unused_set(sb, gdp,
+				(EXT4_INODES_PER_GROUP(sb) - bit - 1));
+	}
+	ext4_free_inodes_set(sb, gdp, ext4_free_inodes_count(sb, gdp) - 1);
+	if (ext4_has_group_desc_csum(sb)) {
+		ext4_inode_bitmap_csum_set(sb, group, gdp, inode_bitmap_bh,
+					   EXT4_INODES_PER_GROUP(sb) / 8);
+		ext4_group_desc_csum_set(sb, group, gdp);
+	}
+	ext4_unlock_group(sb, group);
+
+	percpu_counter_dec(&sbi->s_freeinodes_counter);
+	if (sbi->s_log_groups_per_flex) {
+		ext4_group_t f = ext4_flex_group(sbi, group);
+
+		atomic_dec(&sbi->s_flex_groups[f].free_inodes);
+	}
+
+	BUFFER_TRACE(inode_bitmap_bh, "call ext4_handle_dirty_metadata");
+	err = ext4_handle_dirty_metadata(handle, NULL, inode_bitmap_bh);
+	if (!err) {
+		BUFFER_TRACE(group_desc_bh, "call ext4_handle_dirty_metadata");
+		err = ext4_handle_dirty_metadata(handle, NULL, group_desc_bh);
+	}
+out:
+	brelse(inode_bitmap_bh);
+	return err;
+}
+
 unsigned long ext4_count_free_inodes(struct super_block *sb)
 {
 	unsigned long desc_count;
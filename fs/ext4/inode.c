@@ -655,6 +655,8 @@ found:
 
 has_zeroout:
 	up_write((&EXT4_I(inode)->i_data_sem));
+	if (retval > 0)
+		ext4_fc_track_range(handle, inode, map->m_lblk, map->m_len);
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -3488,6 +3490,8 @@ int ext4_punch_hole(struct inode *inode, loff_t offset, loff_t length)
 					    stop_block);
 
 	up_write(&EXT4_I(inode)->i_data_sem);
+	ext4_fc_track_range(handle, inode, first_block,
+			    stop_block - first_block);
 	if (IS_SYNC(inode))
 		ext4_handle_sync(handle);
 
@@ -4827,6 +4831,8 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 		 */
 		if ((jbd2_journal_extend(handle,
 			     EXT4_DATA_TRANS_BLOCKS(inode->i_sb))) == 0) {
+			/* this may move xattrs out to the xattr block */
+			ext4_fc_mark_ineligible(inode->i_sb, handle);
 			ret = ext4_expand_extra_isize(inode,
 						      sbi->s_want_extra_isize,
 						      iloc, handle);
@@ -4847,6 +4853,8 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 	}
 	if (!err)
 		err = ext4_mark_iloc_dirty(handle, inode, &iloc);
+	if (!err)
+		ext4_fc_track_inode(handle, inode);
 	return err;
 }
 
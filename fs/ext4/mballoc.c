@@ -698,13 +698,16 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the list of groups with that order.
+ * Called with the group lock held.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
 	int bits;
+	int old = grp->bb_largest_free_order;
 
 	grp->bb_largest_free_order = -1; /* uninit */
 
@@ -715,6 +718,67 @@ mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 			break;
 		}
 	}
+
+	if (old == grp->bb_largest_free_order)
+		return;
+
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	i = grp->bb_largest_free_order;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+}
+
+/*
+ * Order of the average free extent size.  A group on list i of
+ * s_mb_avg_fragment_size has 2^i <= bb_free / bb_fragments < 2^(i+1).
+ */
+static int mb_avg_fragment_size_order(struct super_block *sb,
+				      ext4_grpblk_t len)
+{
+	int order = fls(len) - 1;
+
+	if (order >= MB_NUM_ORDERS(sb))
+		order = MB_NUM_ORDERS(sb) - 1;
+	return order;
+}
+
+/*
+ * Keep the group on the list matching the order of its average free
+ * extent.  Called with the group lock held.
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_avg_fragment_size_order;
+	int new = -1;
+
+	if (grp->bb_free && grp->bb_fragments)
+		new = mb_avg_fragment_size_order(sb,
+					grp->bb_free / grp->bb_fragments);
+	if (old == new)
+		return;
+
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[old]);
+		list_del_init(&grp->bb_avg_fragment_size_node);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[old]);
+	}
+	grp->bb_avg_fragment_size_order = new;
+	if (new >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[new]);
+		list_add_tail(&grp->bb_avg_fragment_size_node,
+			      &sbi->s_mb_avg_fragment_size[new]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[new]);
+	}
 }
 
 static noinline_for_stack
@@ -766,8 +830,10 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 		set_bit(EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT, &grp->bb_state);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
-	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
+	if (test_and_clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state)))
+		atomic_dec(&sbi->s_mb_uninit_groups);
 
 	period = get_cycles() - period;
 	spin_lock(&EXT4_SB(sb)->s_bal_lock);
@@ -1484,6 +1550,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1608,6 +1675,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -2073,11 +2141,119 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Check a group found on one of the per-order lists.  Groups still being
+ * initialized may already be on the lists; leave them alone, since
+ * ext4_mb_good_group() would try to initialize them and sleep.
+ */
+static inline int
+ext4_mb_good_listed_group(struct ext4_allocation_context *ac,
+			  struct ext4_group_info *grp, ext4_group_t ngroups,
+			  int cr)
+{
+	return grp->bb_group < ngroups && !EXT4_MB_GRP_NEED_INIT(grp) &&
+		ext4_mb_good_group(ac, grp->bb_group, cr);
+}
+
+/*
+ * cr 0: pick a group whose largest free extent is at least 2^ac_2order.
+ * The group handed out goes to the tail of its list, so that concurrent
+ * and repeated allocations spread over the suitable groups.
+ */
+static int ext4_mb_choose_next_group_cr0(struct ext4_allocation_context *ac,
+					 ext4_group_t ngroups,
+					 ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *grp;
+	struct list_head *head;
+	rwlock_t *lock;
+	int i;
+
+	for (i = ac->ac_2order; i < MB_NUM_ORDERS(ac->ac_sb); i++) {
+		head = &sbi->s_mb_largest_free_orders[i];
+		lock = &sbi->s_mb_largest_free_orders_locks[i];
+		if (list_empty(head))
+			continue;
+		write_lock(lock);
+		list_for_each_entry(grp, head, bb_largest_free_order_node) {
+			if (ext4_mb_good_listed_group(ac, grp, ngroups, 0)) {
+				list_move_tail(&grp->bb_largest_free_order_node,
+					       head);
+				write_unlock(lock);
+				*group = grp->bb_group;
+				return 1;
+			}
+		}
+		write_unlock(lock);
+	}
+	return 0;
+}
+
+/*
+ * cr 1: pick a group whose average free extent is at least the goal length.
+ */
+static int ext4_mb_choose_next_group_cr1(struct ext4_allocation_context *ac,
+					 ext4_group_t ngroups,
+					 ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *grp;
+	struct list_head *head;
+	rwlock_t *lock;
+	int i;
+
+	i = mb_avg_fragment_size_order(ac->ac_sb, ac->ac_g_ex.fe_len);
+	for (; i < MB_NUM_ORDERS(ac->ac_sb); i++) {
+		head = &sbi->s_mb_avg_fragment_size[i];
+		lock = &sbi->s_mb_avg_fragment_size_locks[i];
+		if (list_empty(head))
+			continue;
+		write_lock(lock);
+		list_for_each_entry(grp, head, bb_avg_fragment_size_node) {
+			if (ext4_mb_good_listed_group(ac, grp, ngroups, 1)) {
+				list_move_tail(&grp->bb_avg_fragment_size_node,
+					       head);
+				write_unlock(lock);
+				*group = grp->bb_group;
+				return 1;
+			}
+		}
+		write_unlock(lock);
+	}
+	return 0;
+}
+
+/*
+ * Find the next group to try for criteria @cr in the per-order lists.
+ * Returns 0 if none of the listed groups will do.
+ */
+static int ext4_mb_choose_next_group(struct ext4_allocation_context *ac,
+				     int cr, ext4_group_t ngroups,
+				     ext4_group_t *group)
+{
+	if (cr == 0)
+		return ext4_mb_choose_next_group_cr0(ac, ngroups, group);
+	return ext4_mb_choose_next_group_cr1(ac, ngroups, group);
+}
+
+static inline bool
+ext4_mb_use_optimized_scan(struct ext4_allocation_context *ac, int cr)
+{
+	struct super_block *sb = ac->ac_sb;
+
+	if (!EXT4_SB(sb)->s_mb_optimize_scan || cr >= 2)
+		return false;
+	/* cr 0 requests bigger than the buddy orders are taken by cr 1 */
+	return cr == 1 || ac->ac_2order < MB_NUM_ORDERS(sb);
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
 	int cr;
+	bool optimized;
 	int err = 0;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
@@ -2143,9 +2319,22 @@ repeat:
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		optimized = ext4_mb_use_optimized_scan(ac, cr);
 
 		for (i = 0; i < ngroups; group++, i++) {
 			cond_resched();
+			if (optimized && !ext4_mb_choose_next_group(ac, cr,
+							ngroups, &group)) {
+				/*
+				 * Groups not initialized yet aren't on the
+				 * lists, scan for them the old way.
+				 */
+				if (!atomic_read(&sbi->s_mb_uninit_groups))
+					break;
+				optimized = false;
+				group = ac->ac_g_ex.fe_group;
+				i = 0;
+			}
 			/*
 			 * Artificially restricted ngroups for non-extent
 			 * files makes group > ngroups possible on first loop.
@@ -2406,6 +2595,7 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 	set_bit(EXT4_GROUP_INFO_NEED_INIT_BIT,
 		&(meta_group_info[i]->bb_state));
+	atomic_inc(&sbi->s_mb_uninit_groups);
 
 	/*
 	 * initialize bb_free to be able to skip
@@ -2423,6 +2613,10 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_size_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_avg_fragment_size_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2572,6 +2766,26 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	i = MB_NUM_ORDERS(sb) * sizeof(struct list_head);
+	sbi->s_mb_largest_free_orders = kmalloc(i, GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size = kmalloc(i, GFP_KERNEL);
+	i = MB_NUM_ORDERS(sb) * sizeof(rwlock_t);
+	sbi->s_mb_largest_free_orders_locks = kmalloc(i, GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size_locks = kmalloc(i, GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders || !sbi->s_mb_avg_fragment_size ||
+	    !sbi->s_mb_largest_free_orders_locks ||
+	    !sbi->s_mb_avg_fragment_size_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+		INIT_LIST_HEAD(&sbi->s_mb_avg_fragment_size[i]);
+		rwlock_init(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+	atomic_set(&sbi->s_mb_uninit_groups, 0);
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2599,6 +2813,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2655,6 +2870,14 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
+	kfree(sbi->s_mb_avg_fragment_size);
+	sbi->s_mb_avg_fragment_size = NULL;
+	kfree(sbi->s_mb_avg_fragment_size_locks);
+	sbi->s_mb_avg_fragment_size_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2710,6 +2933,10 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		ext4_kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_avg_fragment_size);
+	kfree(sbi->s_mb_avg_fragment_size_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	if (sbi->s_buddy_cache)
@@ -2974,6 +3201,108 @@ out_err:
 	return err;
 }
 
+/*
+ * Mark @len blocks starting at @block in use, outside of the allocator.
+ * Used by fast commit replay for blocks that were allocated in a
+ * transaction which didn't make it to the journal.  Blocks already in use
+ * are left alone.  No bigalloc: fast commits are off there.
+ */
+int ext4_mb_mark_bb(handle_t *handle, struct super_block *sb,
+		    ext4_fsblk_t block, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh = NULL;
+	struct ext4_group_desc *gdp;
+	struct buffer_head *gdp_bh;
+	struct ext4_group_info *grp;
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	ext4_group_t group;
+	ext4_grpblk_t blkoff;
+	bool loaded;
+	int i, n, changed, err = 0;
+
+	while (len > 0) {
+		ext4_get_group_no_and_offset(sb, block, &group, &blkoff);
+		n = min_t(int, len, EXT4_BLOCKS_PER_GROUP(sb) - blkoff);
+		grp = ext4_get_group_info(sb, group);
+
+		err = -EIO;
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (!bitmap_bh)
+			break;
+		BUFFER_TRACE(bitmap_bh, "getting write access");
+		err = ext4_journal_get_write_access(handle, bitmap_bh);
+		if (err)
+			break;
+		err = -EIO;
+		gdp = ext4_get_group_desc(sb, group, &gdp_bh);
+		if (!gdp)
+			break;
+		BUFFER_TRACE(gdp_bh, "get_write_access");
+		err = ext4_journal_get_write_access(handle, gdp_bh);
+		if (err)
+			break;
+
+		/* keep the buddy in step if it has been loaded already */
+		loaded = !EXT4_MB_GRP_NEED_INIT(grp);
+		if (loaded) {
+			err = ext4_mb_load_buddy(sb, group, &e4b);
+			if (err)
+				break;
+		}
+
+		changed = 0;
+		ext4_lock_group(sb, group);
+		for (i = 0; i < n; i++) {
+			if (mb_test_bit(blkoff + i, bitmap_bh->b_data))
+				continue;
+			mb_set_bit(blkoff + i, bitmap_bh->b_data);
+			changed++;
+			if (!loaded || mb_test_bit(blkoff + i, e4b.bd_bitmap))
+				continue;
+			ex.fe_group = group;
+			ex.fe_start = blkoff + i;
+			ex.fe_len = 1;
+			mb_mark_used(&e4b, &ex);
+		}
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_clusters_after_init(sb, group, gdp));
+		}
+		ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_group_clusters(sb, gdp) - changed);
+		ext4_block_bitmap_csum_set(sb, group, gdp, bitmap_bh);
+		ext4_group_desc_csum_set(sb, group, gdp);
+		ext4_unlock_group(sb, group);
+		if (loaded)
+			ext4_mb_unload_buddy(&e4b);
+
+		percpu_counter_sub(&sbi->s_freeclusters_counter, changed);
+		if (sbi->s_log_groups_per_flex) {
+			ext4_group_t flex_group = ext4_flex_group(sbi, group);
+
+			atomic64_sub(changed,
+				     &sbi->s_flex_groups[flex_group].free_clusters);
+		}
+
+		err = ext4_handle_dirty_metadata(handle, NULL, bitmap_bh);
+		if (!err)
+			err = ext4_handle_dirty_metadata(handle, NULL, gdp_bh);
+		if (err)
+			break;
+		brelse(bitmap_bh);
+		bitmap_bh = NULL;
+
+		block += n;
+		len -= n;
+	}
+
+	brelse(bitmap_bh);
+	return err;
+}
+
 /*
  * here we normalize request for locality group
  * Group request are normalized to s_mb_group_prealloc, which goes to
@@ -89,6 +89,17 @@ extern ushort ext4_mballoc_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * use the per-order group lists to pick groups for cr 0 and cr 1,
+ * instead of scanning all groups in order
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * number of orders the group lists are kept for: a free extent
+ * can be anything up to a whole group of blocksize * 8 blocks
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
 
 struct ext4_free_data {
 	/* MUST be the first member */
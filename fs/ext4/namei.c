@@ -2238,6 +2238,8 @@ retry:
 		inode->i_fop = &ext4_file_operations;
 		ext4_set_aops(inode);
 		err = ext4_add_nondir(handle, dentry, inode);
+		if (!err)
+			ext4_fc_track_create(handle, inode, dentry);
 		if (!err && IS_DIRSYNC(dir))
 			ext4_handle_sync(handle);
 	}
@@ -2268,6 +2270,7 @@ retry:
 	handle = ext4_journal_current_handle();
 	err = PTR_ERR(inode);
 	if (!IS_ERR(inode)) {
+		ext4_fc_mark_ineligible(dir->i_sb, handle);
 		init_special_inode(inode, inode->i_mode, rdev);
 		inode->i_op = &ext4_special_inode_operations;
 		err = ext4_add_nondir(handle, dentry, inode);
@@ -2298,6 +2301,7 @@ retry:
 	handle = ext4_journal_current_handle();
 	err = PTR_ERR(inode);
 	if (!IS_ERR(inode)) {
+		ext4_fc_mark_ineligible(dir->i_sb, handle);
 		inode->i_op = &ext4_file_inode_operations;
 		inode->i_fop = &ext4_file_operations;
 		ext4_set_aops(inode);
@@ -2413,6 +2417,7 @@ retry:
 	if (IS_ERR(inode))
 		goto out_stop;
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	inode->i_op = &ext4_dir_inode_operations;
 	inode->i_fop = &ext4_dir_operations;
 	err = ext4_init_new_dir(handle, dir, inode);
@@ -2551,6 +2556,9 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		return 0;
 
+	/* Fast commit replay knows nothing of the orphan list */
+	ext4_fc_mark_ineligible(sb, handle);
+
 	/*
 	 * Orphan handling is only valid for files with data blocks
 	 * being truncated, or files being unlinked. Note that we either
@@ -2630,6 +2638,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	if (list_empty(&ei->i_orphan))
 		return 0;
 
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 	if (handle) {
 		/* Grab inode buffer early before taking global s_orphan_lock */
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
@@ -2729,6 +2738,7 @@ static int ext4_rmdir(struct inode *dir, struct dentry *dentry)
 		goto end_rmdir;
 	}
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
@@ -2806,6 +2816,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	retval = ext4_delete_entry(handle, dir, de, bh);
 	if (retval)
 		goto end_unlink;
+	ext4_fc_track_unlink(handle, inode, dentry);
 	dir->i_ctime = dir->i_mtime = ext4_current_time(dir);
 	ext4_update_dx_flag(dir);
 	ext4_mark_inode_dirty(handle, dir);
@@ -2866,6 +2877,7 @@ retry:
 	if (IS_ERR(inode))
 		goto out_stop;
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	if (l > EXT4_N_BLOCKS * 4) {
 		inode->i_op = &ext4_symlink_inode_operations;
 		ext4_set_aops(inode);
@@ -2958,6 +2970,7 @@ retry:
 	err = ext4_add_entry(handle, dentry, inode);
 	if (!err) {
 		ext4_mark_inode_dirty(handle, inode);
+		ext4_fc_track_link(handle, inode, dentry);
 		/* this can happen only for tmpfile being
 		 * linked the first time
 		 */
@@ -2974,6 +2987,83 @@ retry:
 	return err;
 }
 
+/*
+ * Fast commit replay: add the entry @name for @inode to @dir, unless it
+ * is there already.  The link count comes from the replayed inode, so
+ * it is left alone here.
+ */
+int ext4_fc_replay_link(struct inode *dir, struct inode *inode,
+			struct qstr *name)
+{
+	struct dentry *dentry_dir, *dentry;
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	handle_t *handle;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (bh) {
+		err = le32_to_cpu(de->inode) == inode->i_ino ? 0 : -EEXIST;
+		brelse(bh);
+		return err;
+	}
+
+	dentry_dir = d_obtain_alias(igrab(dir));
+	if (IS_ERR(dentry_dir))
+		return PTR_ERR(dentry_dir);
+	dentry = d_alloc(dentry_dir, name);
+	if (!dentry) {
+		dput(dentry_dir);
+		return -ENOMEM;
+	}
+
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+		(EXT4_DATA_TRANS_BLOCKS(dir->i_sb) +
+		 EXT4_INDEX_EXTRA_TRANS_BLOCKS));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+	} else {
+		err = ext4_add_entry(handle, dentry, inode);
+		ext4_journal_stop(handle);
+	}
+	dput(dentry);
+	dput(dentry_dir);
+	return err;
+}
+
+/*
+ * Fast commit replay: remove the entry @name for inode @ino from @dir,
+ * if it is still there.
+ */
+int ext4_fc_replay_unlink(struct inode *dir, unsigned long ino,
+			  struct qstr *name)
+{
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	handle_t *handle;
+	int err = 0;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (!bh)
+		return 0;
+
+	if (le32_to_cpu(de->inode) == ino) {
+		handle = ext4_journal_start(dir, EXT4_HT_DIR,
+					    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
+		if (IS_ERR(handle)) {
+			err = PTR_ERR(handle);
+		} else {
+			err = ext4_delete_entry(handle, dir, de, bh);
+			ext4_journal_stop(handle);
+		}
+	}
+	brelse(bh);
+	return err;
+}
 
 /*
  * Try to find buffer head where contains the parent block.
@@ -3267,6 +3357,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 			return PTR_ERR(whiteout);
 	}
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
@@ -3431,6 +3522,7 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
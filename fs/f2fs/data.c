@@ -73,6 +73,39 @@ static void f2fs_write_end_io(struct bio *bio, int err)
 	bio_put(bio);
 }
 
+/*
+ * Find the device that holds blk_addr when the volume spans several.
+ */
+int f2fs_target_device_index(struct f2fs_sb_info *sbi, block_t blk_addr)
+{
+	int i;
+
+	for (i = 0; i < sbi->s_ndevs; i++)
+		if (FDEV(i).start_blk <= blk_addr && FDEV(i).end_blk >= blk_addr)
+			return i;
+	return 0;
+}
+
+/*
+ * Return the device that holds blk_addr, and in *sector, if it is given,
+ * where the block is on that device.
+ */
+struct block_device *f2fs_target_device(struct f2fs_sb_info *sbi,
+				block_t blk_addr, sector_t *sector)
+{
+	struct block_device *bdev = sbi->sb->s_bdev;
+
+	if (sbi->s_ndevs) {
+		int devi = f2fs_target_device_index(sbi, blk_addr);
+
+		bdev = FDEV(devi).bdev;
+		blk_addr -= FDEV(devi).start_blk;
+	}
+	if (sector)
+		*sector = SECTOR_FROM_BLOCK(blk_addr);
+	return bdev;
+}
+
 /*
  * Low-level block read/write IO operations.
  */
@@ -84,8 +117,8 @@ static struct bio *__bio_alloc(struct f2fs_sb_info *sbi, block_t blk_addr,
 	/* No failure on bio allocation */
 	bio = bio_alloc(GFP_NOIO, npages);
 
-	bio->bi_bdev = sbi->sb->s_bdev;
-	bio->bi_iter.bi_sector = SECTOR_FROM_BLOCK(blk_addr);
+	bio->bi_bdev = f2fs_target_device(sbi, blk_addr,
+						&bio->bi_iter.bi_sector);
 	bio->bi_end_io = is_read ? f2fs_read_end_io : f2fs_write_end_io;
 	bio->bi_private = sbi;
 
@@ -189,7 +222,9 @@ void f2fs_submit_page_mbio(struct f2fs_sb_info *sbi, struct page *page,
 		inc_page_count(sbi, F2FS_WRITEBACK);
 
 	if (io->bio && (io->last_block_in_bio != blk_addr - 1 ||
-						io->fio.rw != fio->rw))
+			io->fio.rw != fio->rw ||
+			io->bio->bi_bdev != f2fs_target_device(sbi, blk_addr,
+								NULL)))
 		__submit_merged_bio(io);
 alloc_new:
 	if (io->bio == NULL) {
@@ -718,8 +753,38 @@ out:
 	return err;
 }
 
+/*
+ * Point a mapping at the device holding it, so that readahead and direct
+ * I/O go to the right one.  The mapping must not cross into the next device.
+ */
+static void f2fs_map_bh_device(struct f2fs_sb_info *sbi,
+				struct buffer_head *bh)
+{
+	unsigned int blkbits = sbi->log_blocksize;
+	struct f2fs_dev_info *dev;
+
+	dev = &FDEV(f2fs_target_device_index(sbi, bh->b_blocknr));
+	if (((bh->b_size >> blkbits) - 1) > dev->end_blk - bh->b_blocknr)
+		bh->b_size = (size_t)(dev->end_blk - bh->b_blocknr + 1) <<
+								blkbits;
+	bh->b_bdev = dev->bdev;
+	bh->b_blocknr -= dev->start_blk;
+}
+
 static int get_data_block(struct inode *inode, sector_t iblock,
 			struct buffer_head *bh_result, int create)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	int err;
+
+	err = __get_data_block(inode, iblock, bh_result, create, false);
+	if (!err && sbi->s_ndevs && buffer_mapped(bh_result))
+		f2fs_map_bh_device(sbi, bh_result);
+	return err;
+}
+
+static int get_data_block_bmap(struct inode *inode, sector_t iblock,
+			struct buffer_head *bh_result, int create)
 {
 	return __get_data_block(inode, iblock, bh_result, create, false);
 }
@@ -1155,7 +1220,7 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
-	return generic_block_bmap(mapping, block, get_data_block);
+	return generic_block_bmap(mapping, block, get_data_block_bmap);
 }
 
 const struct address_space_operations f2fs_dblock_aops = {
@@ -470,6 +470,16 @@ struct f2fs_bio_info {
 	struct rw_semaphore io_rwsem;	/* blocking op for bio */
 };
 
+#define FDEV(i)				(sbi->devs[i])
+#define RDEV(i)				(raw_super->devs[i])
+struct f2fs_dev_info {
+	struct block_device *bdev;	/* device, NULL until opened */
+	char path[MAX_PATH_LEN];	/* device path */
+	unsigned int total_segments;	/* # of segments on the device */
+	block_t start_blk;		/* first block address on the device */
+	block_t end_blk;		/* last block address on the device */
+};
+
 struct f2fs_sb_info {
 	struct super_block *sb;			/* pointer to VFS super block */
 	struct proc_dir_entry *s_proc;		/* proc entry */
@@ -490,6 +500,10 @@ struct f2fs_sb_info {
 	struct f2fs_bio_info write_io[NR_PAGE_TYPE];	/* for write bios */
 	struct completion *wait_io;		/* for completion bios */
 
+	/* for multiple devices */
+	struct f2fs_dev_info *devs;		/* devices of the volume */
+	int s_ndevs;				/* # of devices, 0 for one */
+
 	/* for checkpoint */
 	struct f2fs_checkpoint *ckpt;		/* raw checkpoint pointer */
 	struct inode *meta_inode;		/* cache meta blocks */
@@ -1362,6 +1376,9 @@ void destroy_checkpoint_caches(void);
 /*
  * data.c
  */
+int f2fs_target_device_index(struct f2fs_sb_info *, block_t);
+struct block_device *f2fs_target_device(struct f2fs_sb_info *, block_t,
+							sector_t *);
 void f2fs_submit_merged_bio(struct f2fs_sb_info *, enum page_type, int);
 int f2fs_submit_page_bio(struct f2fs_sb_info *, struct page *, block_t, int);
 void f2fs_submit_page_mbio(struct f2fs_sb_info *, struct page *, block_t,
@@ -252,6 +252,28 @@ void f2fs_balance_fs_bg(struct f2fs_sb_info *sbi)
 		f2fs_sync_fs(sbi->sb, true);
 }
 
+static int __submit_flush_wait(struct block_device *bdev)
+{
+	struct bio *bio = bio_alloc(GFP_NOIO, 0);
+	int ret;
+
+	bio->bi_bdev = bdev;
+	ret = submit_bio_wait(WRITE_FLUSH, bio);
+	bio_put(bio);
+	return ret;
+}
+
+/* flush the caches of all the devices the volume spans */
+static int submit_flush_wait(struct f2fs_sb_info *sbi)
+{
+	int ret = __submit_flush_wait(sbi->sb->s_bdev);
+	int i;
+
+	for (i = 1; i < sbi->s_ndevs && !ret; i++)
+		ret = __submit_flush_wait(FDEV(i).bdev);
+	return ret;
+}
+
 static int issue_flush_thread(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
@@ -262,22 +284,19 @@ repeat:
 		return 0;
 
 	if (!llist_empty(&fcc->issue_list)) {
-		struct bio *bio = bio_alloc(GFP_NOIO, 0);
 		struct flush_cmd *cmd, *next;
 		int ret;
 
 		fcc->dispatch_list = llist_del_all(&fcc->issue_list);
 		fcc->dispatch_list = llist_reverse_order(fcc->dispatch_list);
 
-		bio->bi_bdev = sbi->sb->s_bdev;
-		ret = submit_bio_wait(WRITE_FLUSH, bio);
+		ret = submit_flush_wait(sbi);
 
 		llist_for_each_entry_safe(cmd, next,
 					  fcc->dispatch_list, llnode) {
 			cmd->ret = ret;
 			complete(&cmd->wait);
 		}
-		bio_put(bio);
 		fcc->dispatch_list = NULL;
 	}
 
@@ -298,7 +317,7 @@ int f2fs_issue_flush(struct f2fs_sb_info *sbi)
 		return 0;
 
 	if (!test_opt(sbi, FLUSH_MERGE))
-		return blkdev_issue_flush(sbi->sb->s_bdev, GFP_KERNEL, NULL);
+		return submit_flush_wait(sbi);
 
 	init_completion(&cmd.wait);
 
@@ -425,10 +444,30 @@ static void locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno)
 static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 				block_t blkstart, block_t blklen)
 {
-	sector_t start = SECTOR_FROM_BLOCK(blkstart);
-	sector_t len = SECTOR_FROM_BLOCK(blklen);
+	struct block_device *bdev;
+	sector_t start;
+	block_t len;
+	int err;
+
 	trace_f2fs_issue_discard(sbi->sb, blkstart, blklen);
-	return blkdev_issue_discard(sbi->sb->s_bdev, start, len, GFP_NOFS, 0);
+
+	/* the range may span devices, discard it piece by piece */
+	while (blklen) {
+		len = blklen;
+		if (sbi->s_ndevs) {
+			int devi = f2fs_target_device_index(sbi, blkstart);
+
+			len = min(len, FDEV(devi).end_blk - blkstart + 1);
+		}
+		bdev = f2fs_target_device(sbi, blkstart, &start);
+		err = blkdev_issue_discard(bdev, start, SECTOR_FROM_BLOCK(len),
+							GFP_NOFS, 0);
+		if (err)
+			return err;
+		blkstart += len;
+		blklen -= len;
+	}
+	return 0;
 }
 
 void discard_next_dnode(struct f2fs_sb_info *sbi, block_t blkaddr)
@@ -864,6 +903,24 @@ static void new_curseg(struct f2fs_sb_info *sbi, int type, bool new_sec)
 	if (test_opt(sbi, NOHEAP))
 		dir = ALLOC_RIGHT;
 
+	/*
+	 * Keep each log on a device of its own as far as we can, so that the
+	 * logs are written to the devices in parallel.
+	 */
+	if (sbi->s_ndevs > 1) {
+		int devi = type % sbi->s_ndevs;
+
+		if (f2fs_target_device_index(sbi,
+					START_BLOCK(sbi, segno)) != devi) {
+			block_t start = max(FDEV(devi).start_blk,
+						MAIN_BLKADDR(sbi));
+
+			segno = GET_SEGNO(sbi, start);
+			new_sec = true;
+			dir = ALLOC_RIGHT;
+		}
+	}
+
 	get_new_segment(sbi, &segno, new_sec, dir);
 	curseg->next_segno = segno;
 	reset_curseg(sbi, type, 1);
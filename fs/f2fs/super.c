@@ -422,6 +422,16 @@ static void f2fs_destroy_inode(struct inode *inode)
 	call_rcu(&inode->i_rcu, f2fs_i_callback);
 }
 
+static void destroy_device_list(struct f2fs_sb_info *sbi)
+{
+	int i;
+
+	/* the first device is the one we are mounted from */
+	for (i = 1; i < sbi->s_ndevs; i++)
+		blkdev_put(FDEV(i).bdev, sbi->sb->s_mode);
+	kfree(sbi->devs);
+}
+
 static void f2fs_put_super(struct super_block *sb)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(sb);
@@ -463,6 +473,7 @@ static void f2fs_put_super(struct super_block *sb)
 
 	sb->s_fs_info = NULL;
 	brelse(sbi->raw_super_buf);
+	destroy_device_list(sbi);
 	kfree(sbi);
 }
 
@@ -875,6 +886,99 @@ static void init_sb_info(struct f2fs_sb_info *sbi)
 	sbi->need_fsck = false;
 }
 
+/*
+ * Open the other devices of a volume that spans several, and work out the
+ * range of block addresses each of them holds.
+ */
+static int f2fs_scan_devices(struct f2fs_sb_info *sbi)
+{
+	struct f2fs_super_block *raw_super = F2FS_RAW_SUPER(sbi);
+	struct super_block *sb = sbi->sb;
+	unsigned int meta_segs, segs = 0;
+	int max_devices = 0;
+	int i;
+
+	for (i = 0; i < MAX_DEVICES; i++) {
+		if (!RDEV(i).path[0])
+			break;
+		max_devices++;
+	}
+	/* a single device needs no mapping */
+	if (!max_devices)
+		return 0;
+
+	sbi->devs = kcalloc(max_devices, sizeof(struct f2fs_dev_info),
+								GFP_KERNEL);
+	if (!sbi->devs)
+		return -ENOMEM;
+
+	meta_segs = (le32_to_cpu(raw_super->main_blkaddr) -
+			le32_to_cpu(raw_super->segment0_blkaddr)) >>
+						sbi->log_blocks_per_seg;
+
+	for (i = 0; i < max_devices; i++) {
+		struct block_device *bdev;
+		block_t blocks;
+
+		memcpy(FDEV(i).path, RDEV(i).path, MAX_PATH_LEN);
+		if (FDEV(i).path[MAX_PATH_LEN - 1]) {
+			f2fs_msg(sb, KERN_ERR, "Invalid path of device %d", i);
+			return -EINVAL;
+		}
+		FDEV(i).total_segments = le32_to_cpu(RDEV(i).total_segments);
+		blocks = FDEV(i).total_segments << sbi->log_blocks_per_seg;
+
+		if (i == 0) {
+			FDEV(i).start_blk = 0;
+			FDEV(i).end_blk = le32_to_cpu(raw_super->segment0_blkaddr)
+								+ blocks - 1;
+			bdev = sb->s_bdev;
+		} else {
+			FDEV(i).start_blk = FDEV(i - 1).end_blk + 1;
+			FDEV(i).end_blk = FDEV(i).start_blk + blocks - 1;
+			bdev = blkdev_get_by_path(FDEV(i).path, sb->s_mode,
+							sb->s_type);
+			if (IS_ERR(bdev)) {
+				f2fs_msg(sb, KERN_ERR,
+					"Unable to open device %s",
+					FDEV(i).path);
+				return PTR_ERR(bdev);
+			}
+		}
+		FDEV(i).bdev = bdev;
+		sbi->s_ndevs = i + 1;
+
+		if ((u64)(FDEV(i).end_blk - FDEV(i).start_blk + 1) >
+			i_size_read(bdev->bd_inode) >> sbi->log_blocksize) {
+			f2fs_msg(sb, KERN_ERR, "Device %s is too small",
+							FDEV(i).path);
+			return -EINVAL;
+		}
+
+		/* sections must not straddle devices */
+		segs += FDEV(i).total_segments;
+		if (segs <= meta_segs || (segs - meta_segs) % sbi->segs_per_sec) {
+			f2fs_msg(sb, KERN_ERR,
+				"Device %s does not end on a section boundary",
+				FDEV(i).path);
+			return -EINVAL;
+		}
+
+		f2fs_msg(sb, KERN_INFO,
+			"Mount Device [%2d]: %20s, %8u, %8x - %8x",
+			i, FDEV(i).path, FDEV(i).total_segments,
+			FDEV(i).start_blk, FDEV(i).end_blk);
+	}
+
+	if (segs != le32_to_cpu(raw_super->segment_count)) {
+		f2fs_msg(sb, KERN_ERR,
+			"Devices hold %u segments, volume has %u", segs,
+			le32_to_cpu(raw_super->segment_count));
+		return -EINVAL;
+	}
+	return 0;
+}
+
 /*
  * Read f2fs raw super block.
  * Because we have two copies of super block, so read the first one at first,
@@ -999,12 +1103,18 @@ try_onemore:
 	init_waitqueue_head(&sbi->cp_wait);
 	init_sb_info(sbi);
 
+	err = f2fs_scan_devices(sbi);
+	if (err) {
+		f2fs_msg(sb, KERN_ERR, "Failed to find devices");
+		goto free_devices;
+	}
+
 	/* get an inode for meta space */
 	sbi->meta_inode = f2fs_iget(sb, F2FS_META_INO(sbi));
 	if (IS_ERR(sbi->meta_inode)) {
 		f2fs_msg(sb, KERN_ERR, "Failed to read F2FS meta data inode");
 		err = PTR_ERR(sbi->meta_inode);
-		goto free_sb_buf;
+		goto free_devices;
 	}
 
 	err = get_valid_checkpoint(sbi);
@@ -1153,6 +1263,8 @@ free_cp:
 free_meta_inode:
 	make_bad_inode(sbi->meta_inode);
 	iput(sbi->meta_inode);
+free_devices:
+	destroy_device_list(sbi);
 free_sb_buf:
 	brelse(raw_super_buf);
 free_sbi:
@@ -27,6 +27,8 @@
 #include <linux/backing-dev.h>
 #include <linux/tracepoint.h>
 #include <linux/device.h>
+#include <linux/sysctl.h>
+#include <linux/cgroup.h>
 #include "internal.h"
 
 /*
@@ -34,6 +36,17 @@
  */
 #define MIN_WRITEBACK_PAGES	(4096UL >> (PAGE_CACHE_SHIFT - 10))
 
+/*
+ * Flags for move_expired_inodes()
+ */
+#define EXPIRE_DIRTY_ATIME	0x0001
+
+/*
+ * Inodes with only dirty timestamps get written back after at most this
+ * many seconds, see the lazytime mount option.
+ */
+unsigned int dirtytime_expire_interval = 24 * 60 * 60;
+
 /*
  * Passed into wb_writeback(), essentially a subset of writeback_control
  */
@@ -91,12 +104,369 @@ static inline struct inode *wb_inode(struct list_head *head)
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(wbc_writepage);
 
-static void bdi_wakeup_thread(struct backing_dev_info *bdi)
+#ifdef CONFIG_CGROUP_WRITEBACK
+
+/*
+ * Per-blkcg writeback.  Every blkcg which dirties inodes on a bdi gets a
+ * bdi_writeback of its own there, with separate dirty lists and flusher
+ * work, so one cgroup's backlog is flushed apart from the others'.  The
+ * bios issued for it are associated with the blkcg, which lets the
+ * blk-cgroup policies account and throttle buffered writes as well.
+ *
+ * An inode belongs to the blkcg which dirtied it while it was clean, see
+ * inode_attach_wb().  When the blkcg or the bdi goes away, cgwb_kill()
+ * hands its dirty inodes over to bdi->wb.
+ *
+ * cgwb_lock protects all the bdi->cgwb_tree's and cgwb_list, which links
+ * every per-blkcg wb in the system.
+ */
+static DEFINE_SPINLOCK(cgwb_lock);
+static LIST_HEAD(cgwb_list);
+static DECLARE_WAIT_QUEUE_HEAD(cgwb_release_wait);
+
+static inline bool wb_is_root(struct bdi_writeback *wb)
 {
-	spin_lock_bh(&bdi->wb_lock);
+	return !wb->blkcg_css;
+}
+
+static inline bool wb_dying(struct bdi_writeback *wb)
+{
+	return wb->dying;
+}
+
+static inline void wbc_set_wb(struct writeback_control *wbc,
+			      struct bdi_writeback *wb)
+{
+	wbc->wb = wb;
+}
+
+/* Called under rcu_read_lock() */
+static struct bdi_writeback *inode_to_wb(struct inode *inode)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	int id = ACCESS_ONCE(inode->i_wb_blkcg_id);
+	struct bdi_writeback *wb;
+
+	if (id) {
+		wb = radix_tree_lookup(&bdi->cgwb_tree, id);
+		if (wb)
+			return wb;
+	}
+	return &bdi->wb;
+}
+
+/*
+ * Find the wb whose lists the inode goes on and lock them.  Rechecks after
+ * locking, as inode_attach_wb() or cgwb_kill() may have just moved it.
+ */
+static struct bdi_writeback *inode_to_wb_and_lock_list(struct inode *inode)
+{
+	struct bdi_writeback *wb;
+
+	rcu_read_lock();
+	for (;;) {
+		wb = inode_to_wb(inode);
+		spin_lock(&wb->list_lock);
+		if (likely(!wb->dead && inode_to_wb(inode) == wb))
+			break;
+		spin_unlock(&wb->list_lock);
+		cpu_relax();
+	}
+	rcu_read_unlock();
+	return wb;
+}
+
+static int cgwb_create(struct backing_dev_info *bdi,
+		       struct cgroup_subsys_state *blkcg_css)
+{
+	struct bdi_writeback *wb;
+	int ret = -ENODEV;
+
+	wb = kzalloc(sizeof(*wb), GFP_ATOMIC);
+	if (!wb) {
+		css_put(blkcg_css);
+		return -ENOMEM;
+	}
+
+	wb->bdi = bdi;
+	wb->last_old_flush = jiffies;
+	INIT_LIST_HEAD(&wb->b_dirty);
+	INIT_LIST_HEAD(&wb->b_io);
+	INIT_LIST_HEAD(&wb->b_more_io);
+	INIT_LIST_HEAD(&wb->b_dirty_time);
+	spin_lock_init(&wb->list_lock);
+	INIT_DELAYED_WORK(&wb->dwork, bdi_writeback_workfn);
+	wb->blkcg_css = blkcg_css;
+	atomic_set(&wb->refcnt, 1);
+
+	/* bdi_cgwb_destroy() looks at the tree after BDI_registered is gone */
+	spin_lock(&cgwb_lock);
 	if (test_bit(BDI_registered, &bdi->state))
-		mod_delayed_work(bdi_wq, &bdi->wb.dwork, 0);
+		ret = radix_tree_insert(&bdi->cgwb_tree, blkcg_css->id, wb);
+	if (!ret)
+		list_add(&wb->cgwb_node, &cgwb_list);
+	spin_unlock(&cgwb_lock);
+
+	if (ret) {
+		css_put(blkcg_css);
+		kfree(wb);
+	}
+	return ret == -EEXIST ? 0 : ret;
+}
+
+/*
+ * Give a clean inode to the blkcg of the task dirtying it.  The owner of an
+ * inode only changes while it is on no writeback list, so it is checked
+ * under bdi->wb.list_lock which protects the lists of unowned inodes.
+ */
+static void inode_attach_wb(struct inode *inode)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct cgroup_subsys_state *css;
+	int id;
+
+	if (inode->i_wb_blkcg_id || !bdi_cap_writeback_dirty(bdi))
+		return;
+
+	rcu_read_lock();
+	css = task_css(current, blkio_cgrp_id);
+	/* the root blkcg uses bdi->wb */
+	if (!css->parent) {
+		rcu_read_unlock();
+		return;
+	}
+	id = css->id;
+	if (!radix_tree_lookup(&bdi->cgwb_tree, id)) {
+		if (!css_tryget_online(css)) {
+			rcu_read_unlock();
+			return;
+		}
+		rcu_read_unlock();
+		if (cgwb_create(bdi, css))
+			return;
+	} else {
+		rcu_read_unlock();
+	}
+
+	spin_lock(&bdi->wb.list_lock);
+	if (!inode->i_wb_blkcg_id && list_empty(&inode->i_wb_list))
+		inode->i_wb_blkcg_id = id;
+	spin_unlock(&bdi->wb.list_lock);
+}
+
+/*
+ * Return the next per-blkcg wb of @bdi whose blkcg id is at least *@next,
+ * with a reference held, and move *@next past it.
+ */
+static struct bdi_writeback *cgwb_next(struct backing_dev_info *bdi,
+				       unsigned long *next)
+{
+	struct bdi_writeback *wb;
+
+	rcu_read_lock();
+	while (radix_tree_gang_lookup(&bdi->cgwb_tree, (void **)&wb,
+				      *next, 1)) {
+		*next = wb->blkcg_css->id + 1;
+		if (atomic_inc_not_zero(&wb->refcnt)) {
+			rcu_read_unlock();
+			return wb;
+		}
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
+static void cgwb_put(struct bdi_writeback *wb)
+{
+	if (atomic_dec_and_test(&wb->refcnt))
+		wake_up_all(&cgwb_release_wait);
+}
+
+static void wb_wakeup(struct bdi_writeback *wb);
+
+/*
+ * Shut down a per-blkcg wb which has been taken off cgwb_list, move its
+ * inodes to bdi->wb and free it.
+ */
+static void cgwb_kill(struct bdi_writeback *wb)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+	struct bdi_writeback *root = &bdi->wb;
+
+	/* stop new flusher work, then wait for walkers and the flusher */
+	spin_lock_bh(&bdi->wb_lock);
+	wb->dying = true;
 	spin_unlock_bh(&bdi->wb_lock);
+	cgwb_put(wb);
+	wait_event(cgwb_release_wait, !atomic_read(&wb->refcnt));
+	cancel_delayed_work_sync(&wb->dwork);
+
+	/*
+	 * Everything goes to b_more_io so that the next pass of bdi->wb picks
+	 * it up regardless of how the dirtied_when stamps interleave.
+	 */
+	spin_lock(&root->list_lock);
+	spin_lock_nested(&wb->list_lock, SINGLE_DEPTH_NESTING);
+	list_splice_init(&wb->b_io, &root->b_more_io);
+	list_splice_init(&wb->b_more_io, &root->b_more_io);
+	list_splice_init(&wb->b_dirty, &root->b_more_io);
+	list_splice_init(&wb->b_dirty_time, &root->b_dirty_time);
+	wb->dead = true;
+	spin_unlock(&wb->list_lock);
+	spin_unlock(&root->list_lock);
+
+	if (wb_has_dirty_io(root))
+		wb_wakeup(root);
+
+	spin_lock(&cgwb_lock);
+	radix_tree_delete(&bdi->cgwb_tree, wb->blkcg_css->id);
+	spin_unlock(&cgwb_lock);
+	wake_up_all(&cgwb_release_wait);
+
+	css_put(wb->blkcg_css);
+	kfree_rcu(wb, rcu);
+}
+
+void bdi_cgwb_init(struct backing_dev_info *bdi)
+{
+	INIT_RADIX_TREE(&bdi->cgwb_tree, GFP_ATOMIC);
+}
+
+static bool bdi_cgwb_tree_empty(struct backing_dev_info *bdi)
+{
+	void *wb;
+	bool empty;
+
+	rcu_read_lock();
+	empty = !radix_tree_gang_lookup(&bdi->cgwb_tree, &wb, 0, 1);
+	rcu_read_unlock();
+	return empty;
+}
+
+void bdi_cgwb_destroy(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb, *next;
+	LIST_HEAD(victims);
+
+	spin_lock(&cgwb_lock);
+	list_for_each_entry_safe(wb, next, &cgwb_list, cgwb_node)
+		if (wb->bdi == bdi)
+			list_move(&wb->cgwb_node, &victims);
+	spin_unlock(&cgwb_lock);
+
+	list_for_each_entry_safe(wb, next, &victims, cgwb_node)
+		cgwb_kill(wb);
+
+	/* wb_blkcg_offline() may still be busy with some of ours */
+	wait_event(cgwb_release_wait, bdi_cgwb_tree_empty(bdi));
+}
+
+/**
+ * wb_blkcg_offline - shut down the writebacks of a blkcg going away
+ * @blkcg_css: the blkcg's css
+ *
+ * Called from the blkcg css_offline callback.  The inodes the blkcg still
+ * has dirty are handed over to the root writeback of their bdi.
+ */
+void wb_blkcg_offline(struct cgroup_subsys_state *blkcg_css)
+{
+	struct bdi_writeback *wb, *next;
+	LIST_HEAD(victims);
+
+	spin_lock(&cgwb_lock);
+	list_for_each_entry_safe(wb, next, &cgwb_list, cgwb_node)
+		if (wb->blkcg_css == blkcg_css)
+			list_move(&wb->cgwb_node, &victims);
+	spin_unlock(&cgwb_lock);
+
+	list_for_each_entry_safe(wb, next, &victims, cgwb_node)
+		cgwb_kill(wb);
+}
+
+/**
+ * wbc_init_bio - charge a writeback bio to the right blkcg
+ * @wbc: writeback_control of the writeback issuing @bio
+ * @bio: the bio
+ *
+ * Filesystems call this on bios built for ->writepage(s) so that the I/O of
+ * a per-blkcg writeback is accounted to that blkcg however it is issued.
+ */
+void wbc_init_bio(struct writeback_control *wbc, struct bio *bio)
+{
+	if (wbc->wb && !wb_is_root(wbc->wb))
+		bio_associate_blkcg(bio, wbc->wb->blkcg_css);
+}
+EXPORT_SYMBOL_GPL(wbc_init_bio);
+
+#else	/* CONFIG_CGROUP_WRITEBACK */
+
+static inline bool wb_is_root(struct bdi_writeback *wb)
+{
+	return true;
+}
+
+static inline bool wb_dying(struct bdi_writeback *wb)
+{
+	return false;
+}
+
+static inline void wbc_set_wb(struct writeback_control *wbc,
+			      struct bdi_writeback *wb)
+{
+}
+
+static struct bdi_writeback *inode_to_wb_and_lock_list(struct inode *inode)
+{
+	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
+
+	spin_lock(&wb->list_lock);
+	return wb;
+}
+
+static inline void inode_attach_wb(struct inode *inode)
+{
+}
+
+static inline struct bdi_writeback *cgwb_next(struct backing_dev_info *bdi,
+					      unsigned long *next)
+{
+	return NULL;
+}
+
+static inline void cgwb_put(struct bdi_writeback *wb)
+{
+}
+
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
+static void wb_wakeup(struct bdi_writeback *wb)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+
+	spin_lock_bh(&bdi->wb_lock);
+	if (test_bit(BDI_registered, &bdi->state) && !wb_dying(wb))
+		mod_delayed_work(bdi_wq, &wb->dwork, 0);
+	spin_unlock_bh(&bdi->wb_lock);
+}
+
+/*
+ * Like bdi_wakeup_thread_delayed(), for any wb of the bdi.
+ */
+static void wb_wakeup_delayed(struct bdi_writeback *wb)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+	unsigned long timeout;
+
+	timeout = msecs_to_jiffies(dirty_writeback_interval * 10);
+	spin_lock_bh(&bdi->wb_lock);
+	if (test_bit(BDI_registered, &bdi->state) && !wb_dying(wb))
+		queue_delayed_work(bdi_wq, &wb->dwork, timeout);
+	spin_unlock_bh(&bdi->wb_lock);
+}
+
+static void bdi_wakeup_thread(struct backing_dev_info *bdi)
+{
+	wb_wakeup(&bdi->wb);
 }
 
 static void bdi_queue_work(struct backing_dev_info *bdi,
@@ -184,11 +554,10 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
  */
 void inode_wb_list_del(struct inode *inode)
 {
-	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct bdi_writeback *wb = inode_to_wb_and_lock_list(inode);
 
-	spin_lock(&bdi->wb.list_lock);
 	list_del_init(&inode->i_wb_list);
-	spin_unlock(&bdi->wb.list_lock);
+	spin_unlock(&wb->list_lock);
 }
 
 /*
@@ -249,12 +618,17 @@ static bool inode_dirtied_after(struct inode *inode, unsigned long t)
 
 /*
  * Move expired (dirtied before work->older_than_this) dirty inodes from
- * @delaying_queue to @dispatch_queue.
+ * @delaying_queue to @dispatch_queue. With EXPIRE_DIRTY_ATIME, inodes with
+ * only dirty timestamps expire after dirtytime_expire_interval instead, or
+ * right away for sync(2).
  */
 static int move_expired_inodes(struct list_head *delaying_queue,
 			       struct list_head *dispatch_queue,
+			       int flags,
 			       struct wb_writeback_work *work)
 {
+	unsigned long *older_than_this = NULL;
+	unsigned long expire_time;
 	LIST_HEAD(tmp);
 	struct list_head *pos, *node;
 	struct super_block *sb = NULL;
@@ -262,10 +636,16 @@ static int move_expired_inodes(struct list_head *delaying_queue,
 	int do_sb_sort = 0;
 	int moved = 0;
 
+	if ((flags & EXPIRE_DIRTY_ATIME) == 0)
+		older_than_this = work->older_than_this;
+	else if (!work->for_sync) {
+		expire_time = jiffies - (dirtytime_expire_interval * HZ);
+		older_than_this = &expire_time;
+	}
 	while (!list_empty(delaying_queue)) {
 		inode = wb_inode(delaying_queue->prev);
-		if (work->older_than_this &&
-		    inode_dirtied_after(inode, *work->older_than_this))
+		if (older_than_this &&
+		    inode_dirtied_after(inode, *older_than_this))
 			break;
 		list_move(&inode->i_wb_list, &tmp);
 		moved++;
@@ -311,7 +691,9 @@ static void queue_io(struct bdi_writeback *wb, struct wb_writeback_work *work)
 	int moved;
 	assert_spin_locked(&wb->list_lock);
 	list_splice_init(&wb->b_more_io, &wb->b_io);
-	moved = move_expired_inodes(&wb->b_dirty, &wb->b_io, work);
+	moved = move_expired_inodes(&wb->b_dirty, &wb->b_io, 0, work);
+	moved += move_expired_inodes(&wb->b_dirty_time, &wb->b_io,
+				     EXPIRE_DIRTY_ATIME, work);
 	trace_writeback_queue_io(wb, work, moved);
 }
 
@@ -435,6 +817,10 @@ static void requeue_inode(struct inode *inode, struct bdi_writeback *wb,
 		 * updates after data IO completion.
 		 */
 		redirty_tail(inode, wb);
+	} else if (inode->i_state & I_DIRTY_TIME) {
+		/* Only the timestamps are left, park until they expire */
+		inode->dirtied_when = jiffies;
+		list_move(&inode->i_wb_list, &wb->b_dirty_time);
 	} else {
 		/* The inode is clean. Remove from writeback lists. */
 		list_del_init(&inode->i_wb_list);
@@ -473,6 +859,19 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 			ret = err;
 	}
 
+	/*
+	 * If the inode has dirty timestamps and we need to write them, call
+	 * mark_inode_dirty_sync() to notify the filesystem about it and to
+	 * turn I_DIRTY_TIME into I_DIRTY_SYNC.
+	 */
+	if ((inode->i_state & I_DIRTY_TIME) &&
+	    (wbc->sync_mode == WB_SYNC_ALL || wbc->for_sync ||
+	     time_after(jiffies, inode->dirtied_time_when +
+			dirtytime_expire_interval * HZ))) {
+		trace_writeback_lazytime(inode);
+		mark_inode_dirty_sync(inode);
+	}
+
 	/*
 	 * Some filesystems may redirty the inode during the writeback
 	 * due to delalloc, clear dirty metadata flags right before
@@ -504,9 +903,9 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
  * and does more profound writeback list handling in writeback_sb_inodes().
  */
 static int
-writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
-		       struct writeback_control *wbc)
+writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 {
+	struct bdi_writeback *wb;
 	int ret = 0;
 
 	spin_lock(&inode->i_lock);
@@ -534,7 +933,7 @@ writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
 	 * make sure inode is on some writeback list and leave it there unless
 	 * we have completely cleaned the inode.
 	 */
-	if (!(inode->i_state & I_DIRTY) &&
+	if (!(inode->i_state & I_DIRTY_ALL) &&
 	    (wbc->sync_mode != WB_SYNC_ALL ||
 	     !mapping_tagged(inode->i_mapping, PAGECACHE_TAG_WRITEBACK)))
 		goto out;
@@ -543,13 +942,13 @@ writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
 
 	ret = __writeback_single_inode(inode, wbc);
 
-	spin_lock(&wb->list_lock);
+	wb = inode_to_wb_and_lock_list(inode);
 	spin_lock(&inode->i_lock);
 	/*
 	 * If inode is clean, remove it from writeback lists. Otherwise don't
 	 * touch it. See comment above for explanation.
 	 */
-	if (!(inode->i_state & I_DIRTY))
+	if (!(inode->i_state & I_DIRTY_ALL))
 		list_del_init(&inode->i_wb_list);
 	spin_unlock(&wb->list_lock);
 	inode_sync_complete(inode);
@@ -612,6 +1011,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 	long write_chunk;
 	long wrote = 0;  /* count both pages and inodes */
 
+	wbc_set_wb(&wbc, wb);
 	while (!list_empty(&wb->b_io)) {
 		struct inode *inode = wb_inode(wb->b_io.prev);
 
@@ -691,7 +1091,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 		wrote += write_chunk - wbc.nr_to_write;
 		spin_lock(&wb->list_lock);
 		spin_lock(&inode->i_lock);
-		if (!(inode->i_state & I_DIRTY))
+		if (!(inode->i_state & I_DIRTY_ALL))
 			wrote++;
 		requeue_inode(inode, wb, &wbc);
 		inode_sync_complete(inode);
@@ -901,6 +1301,36 @@ static long wb_writeback(struct bdi_writeback *wb,
 	return nr_pages - work->nr_pages;
 }
 
+static bool cgwb_has_dirty_io(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb;
+	unsigned long next = 0;
+	bool ret = false;
+
+	while (!ret && (wb = cgwb_next(bdi, &next))) {
+		ret = wb_has_dirty_io(wb);
+		cgwb_put(wb);
+	}
+	return ret;
+}
+
+/*
+ * Run a bdi-wide work item over the bdi's per-blkcg writebacks as well.
+ */
+static long cgwb_writeback(struct backing_dev_info *bdi,
+			   struct wb_writeback_work *work)
+{
+	struct bdi_writeback *wb;
+	unsigned long next = 0;
+	long wrote = 0;
+
+	while (work->nr_pages > 0 && (wb = cgwb_next(bdi, &next))) {
+		wrote += wb_writeback(wb, work);
+		cgwb_put(wb);
+	}
+	return wrote;
+}
+
 /*
  * Return the next wb_writeback_work struct that hasn't been processed yet.
  */
@@ -983,7 +1413,9 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 }
 
 /*
- * Retrieve work items and do the writeback they describe
+ * Retrieve work items and do the writeback they describe.  Work items are
+ * queued on the bdi and handled by bdi->wb, per-blkcg writebacks only do
+ * their own periodic and background writeback.
  */
 static long wb_do_writeback(struct bdi_writeback *wb)
 {
@@ -991,12 +1423,19 @@ static long wb_do_writeback(struct bdi_writeback *wb)
 	struct wb_writeback_work *work;
 	long wrote = 0;
 
+	if (!wb_is_root(wb)) {
+		wrote += wb_check_old_data_flush(wb);
+		wrote += wb_check_background_flush(wb);
+		return wrote;
+	}
+
 	set_bit(BDI_writeback_running, &wb->bdi->state);
 	while ((work = get_next_work_item(bdi)) != NULL) {
 
 		trace_writeback_exec(bdi, work);
 
 		wrote += wb_writeback(wb, work);
+		wrote += cgwb_writeback(bdi, work);
 
 		/*
 		 * Notify the caller of completion if this is a synchronous
@@ -1043,22 +1482,22 @@ void bdi_writeback_workfn(struct work_struct *work)
 		do {
 			pages_written = wb_do_writeback(wb);
 			trace_writeback_pages_written(pages_written);
-		} while (!list_empty(&bdi->work_list));
+		} while (wb_is_root(wb) && !list_empty(&bdi->work_list));
 	} else {
 		/*
 		 * bdi_wq can't get enough workers and we're running off
 		 * the emergency worker.  Don't hog it.  Hopefully, 1024 is
 		 * enough for efficient IO.
 		 */
-		pages_written = writeback_inodes_wb(&bdi->wb, 1024,
+		pages_written = writeback_inodes_wb(wb, 1024,
 						    WB_REASON_FORKER_THREAD);
 		trace_writeback_pages_written(pages_written);
 	}
 
-	if (!list_empty(&bdi->work_list))
+	if (wb_is_root(wb) && !list_empty(&bdi->work_list))
 		mod_delayed_work(bdi_wq, &wb->dwork, 0);
 	else if (wb_has_dirty_io(wb) && dirty_writeback_interval)
-		bdi_wakeup_thread_delayed(bdi);
+		wb_wakeup_delayed(wb);
 
 	current->flags &= ~PF_SWAPWRITE;
 }
@@ -1076,13 +1515,74 @@ void wakeup_flusher_threads(long nr_pages, enum wb_reason reason)
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
-		if (!bdi_has_dirty_io(bdi))
+		if (!bdi_has_dirty_io(bdi) && !cgwb_has_dirty_io(bdi))
 			continue;
 		__bdi_start_writeback(bdi, nr_pages, false, reason);
 	}
 	rcu_read_unlock();
 }
 
+/*
+ * Wake up bdi's periodically to make sure dirtytime inodes gets
+ * written back periodically.  We deliberately do *not* check the
+ * b_dirtytime list in wb_has_dirty_io(), since this would cause the
+ * kernel to be constantly waking up once there are any dirtytime
+ * inodes on the system.  So instead we define a separate delayed work
+ * function which gets called much more rarely.  (By default, only
+ * once every 24 hours.)
+ *
+ * If there is any other write activity going on in the file system,
+ * this function won't be necessary.  But if the only thing that has
+ * happened on the file system is a dirtytime inode caused by an atime
+ * update, we need this infrastructure below to make sure that inode
+ * eventually gets pushed out to disk.
+ */
+static void wakeup_dirtytime_writeback(struct work_struct *w);
+static DECLARE_DELAYED_WORK(dirtytime_work, wakeup_dirtytime_writeback);
+
+static void wakeup_dirtytime_writeback(struct work_struct *w)
+{
+	struct backing_dev_info *bdi;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
+		struct bdi_writeback *wb;
+		unsigned long next = 0;
+
+		if (!list_empty(&bdi->wb.b_dirty_time))
+			bdi_wakeup_thread(bdi);
+		while ((wb = cgwb_next(bdi, &next))) {
+			if (!list_empty(&wb->b_dirty_time))
+				wb_wakeup(wb);
+			cgwb_put(wb);
+		}
+	}
+	rcu_read_unlock();
+	if (dirtytime_expire_interval)
+		schedule_delayed_work(&dirtytime_work,
+				      dirtytime_expire_interval * HZ);
+}
+
+static int __init start_dirtytime_writeback(void)
+{
+	if (dirtytime_expire_interval)
+		schedule_delayed_work(&dirtytime_work,
+				      dirtytime_expire_interval * HZ);
+	return 0;
+}
+__initcall(start_dirtytime_writeback);
+
+int dirtytime_interval_handler(struct ctl_table *table, int write,
+			       void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (ret == 0 && write)
+		mod_delayed_work(system_wq, &dirtytime_work, 0);
+	return ret;
+}
+
 static noinline void block_dump___mark_inode_dirty(struct inode *inode)
 {
 	if (inode->i_ino || strcmp(inode->i_sb->s_id, "bdev")) {
@@ -1128,24 +1628,33 @@ static noinline void block_dump___mark_inode_dirty(struct inode *inode)
  * blockdev's pages.  This is why for I_DIRTY_PAGES we always use
  * page->mapping->host, so the page-dirtying time is recorded in the internal
  * blockdev inode.
+ *
+ * I_DIRTY_TIME only ever comes on its own, and inodes which have nothing
+ * but dirty timestamps are kept on b_dirty_time rather than b_dirty, so
+ * that periodic writeback leaves them alone until they expire.
  */
 void __mark_inode_dirty(struct inode *inode, int flags)
 {
 	struct super_block *sb = inode->i_sb;
 	struct backing_dev_info *bdi = NULL;
+	int dirtytime = 0;
 
 	/*
-	 * Don't do this for I_DIRTY_PAGES - that doesn't actually
-	 * dirty the inode itself
+	 * Don't do this for I_DIRTY_PAGES or I_DIRTY_TIME - that doesn't
+	 * actually dirty the inode itself
 	 */
-	if (flags & (I_DIRTY_SYNC | I_DIRTY_DATASYNC)) {
+	if (flags & I_DIRTY_INODE) {
 		trace_writeback_dirty_inode_start(inode, flags);
 
 		if (sb->s_op->dirty_inode)
 			sb->s_op->dirty_inode(inode, flags);
 
 		trace_writeback_dirty_inode(inode, flags);
-	}
+
+		/* I_DIRTY_INODE supersedes I_DIRTY_TIME */
+		flags &= ~I_DIRTY_TIME;
+	} else
+		dirtytime = flags & I_DIRTY_TIME;
 
 	/*
 	 * make sure that changes are seen by all cpus before we test i_state
@@ -1154,16 +1663,25 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 	smp_mb();
 
 	/* avoid the locking if we can */
-	if ((inode->i_state & flags) == flags)
+	if (((inode->i_state & flags) == flags) ||
+	    (dirtytime && (inode->i_state & I_DIRTY_INODE)))
 		return;
 
 	if (unlikely(block_dump > 1))
 		block_dump___mark_inode_dirty(inode);
 
+	inode_attach_wb(inode);
+
 	spin_lock(&inode->i_lock);
+	if (dirtytime && (inode->i_state & I_DIRTY_INODE))
+		goto out_unlock_inode;
 	if ((inode->i_state & flags) != flags) {
 		const int was_dirty = inode->i_state & I_DIRTY;
 
+		if (dirtytime)
+			inode->dirtied_time_when = jiffies;
+		if (flags & I_DIRTY_INODE)
+			inode->i_state &= ~I_DIRTY_TIME;
 		inode->i_state |= flags;
 
 		/*
@@ -1188,13 +1706,18 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		/*
 		 * If the inode was already on b_dirty/b_io/b_more_io, don't
 		 * reposition it (that would break b_dirty time-ordering).
+		 * An inode with only dirty timestamps moves from b_dirty_time
+		 * to b_dirty once it really becomes dirty.
 		 */
 		if (!was_dirty) {
+			struct bdi_writeback *wb;
 			bool wakeup_bdi = false;
 			bdi = inode_to_bdi(inode);
 
 			spin_unlock(&inode->i_lock);
-			spin_lock(&bdi->wb.list_lock);
+			/* RCU keeps a per-blkcg wb around for the wakeup */
+			rcu_read_lock();
+			wb = inode_to_wb_and_lock_list(inode);
 			if (bdi_cap_writeback_dirty(bdi)) {
 				WARN(!test_bit(BDI_registered, &bdi->state),
 				     "bdi-%s not registered\n", bdi->name);
@@ -1203,18 +1726,23 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 				 * If this is the first dirty inode for this
 				 * bdi, we have to wake-up the corresponding
 				 * bdi thread to make sure background
-				 * write-back happens later.
+				 * write-back happens later. Dirty timestamps
+				 * are picked up by the dirtytime work.
 				 */
-				if (!wb_has_dirty_io(&bdi->wb))
+				if (!dirtytime && !wb_has_dirty_io(wb))
 					wakeup_bdi = true;
 			}
 
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_wb_list, &bdi->wb.b_dirty);
-			spin_unlock(&bdi->wb.list_lock);
+			if (dirtytime)
+				list_move(&inode->i_wb_list, &wb->b_dirty_time);
+			else
+				list_move(&inode->i_wb_list, &wb->b_dirty);
+			spin_unlock(&wb->list_lock);
 
 			if (wakeup_bdi)
-				bdi_wakeup_thread_delayed(bdi);
+				wb_wakeup_delayed(wb);
+			rcu_read_unlock();
 			return;
 		}
 	}
@@ -1407,7 +1935,6 @@ EXPORT_SYMBOL(sync_inodes_sb);
  */
 int write_inode_now(struct inode *inode, int sync)
 {
-	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
 	struct writeback_control wbc = {
 		.nr_to_write = LONG_MAX,
 		.sync_mode = sync ? WB_SYNC_ALL : WB_SYNC_NONE,
@@ -1419,7 +1946,7 @@ int write_inode_now(struct inode *inode, int sync)
 		wbc.nr_to_write = 0;
 
 	might_sleep();
-	return writeback_single_inode(inode, wb, &wbc);
+	return writeback_single_inode(inode, &wbc);
 }
 EXPORT_SYMBOL(write_inode_now);
 
@@ -1436,7 +1963,7 @@ EXPORT_SYMBOL(write_inode_now);
  */
 int sync_inode(struct inode *inode, struct writeback_control *wbc)
 {
-	return writeback_single_inode(inode, &inode_to_bdi(inode)->wb, wbc);
+	return writeback_single_inode(inode, wbc);
 }
 EXPORT_SYMBOL(sync_inode);
 
@@ -27,7 +27,7 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
@@ -300,59 +300,125 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+void fuse_iqueue_init(struct fuse_iqueue *iq, unsigned idx)
 {
-	fc->reqctr++;
+	memset(iq, 0, sizeof(*iq));
+	spin_lock_init(&iq->lock);
+	init_waitqueue_head(&iq->waitq);
+	INIT_LIST_HEAD(&iq->pending);
+	INIT_LIST_HEAD(&iq->processing);
+	INIT_LIST_HEAD(&iq->io);
+	INIT_LIST_HEAD(&iq->interrupts);
+	iq->forget_list_tail = &iq->forget_list_head;
+	iq->reqctr = idx;
+	iq->connected = 1;
+}
+
+/*
+ * Pick the input queue for a request submitted on this cpu and lock it:
+ * the queue of the cpu if a device is bound to it, else the default one.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue __percpu *cpu_iqs = ACCESS_ONCE(fc->cpu_iqs);
+	struct fuse_iqueue *iq;
+
+	if (cpu_iqs) {
+		smp_read_barrier_depends();
+		iq = raw_cpu_ptr(cpu_iqs);
+		if (ACCESS_ONCE(iq->nr_devs)) {
+			spin_lock(&iq->lock);
+			if (likely(iq->nr_devs))
+				return iq;
+			spin_unlock(&iq->lock);
+		}
+	}
+	iq = &fc->iq;
+	spin_lock(&iq->lock);
+	return iq;
+}
+
+/*
+ * A pending request can be handed to another queue when the devices of
+ * its queue go away, so recheck req->iq once its lock is held.
+ */
+struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_req *req)
+{
+	struct fuse_iqueue *iq;
+
+	for (;;) {
+		iq = ACCESS_ONCE(req->iq);
+		spin_lock(&iq->lock);
+		if (likely(iq == req->iq))
+			return iq;
+		spin_unlock(&iq->lock);
+	}
+}
+
+/*
+ * Unique ids of queue N are N modulo FUSE_REQCTR_STEP, so they never
+ * collide between queues and need no shared counter.
+ */
+static u64 fuse_get_unique(struct fuse_iqueue *iq)
+{
+	iq->reqctr += FUSE_REQCTR_STEP;
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if (iq->reqctr == 0)
+		iq->reqctr += FUSE_REQCTR_STEP;
 
-	return fc->reqctr;
+	return iq->reqctr;
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_request(struct fuse_conn *fc, struct fuse_iqueue *iq,
+			  struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->iq = iq;
+	list_add_tail(&req->list, &iq->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&iq->waitq);
+	kill_fasync(&iq->fasync, SIGIO, POLL_IN);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_iqueue *iq;
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	iq = fuse_lock_iqueue(fc);
+	if (iq->connected) {
+		iq->forget_list_tail->next = forget;
+		iq->forget_list_tail = forget;
+		wake_up(&iq->waitq);
+		kill_fasync(&iq->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 }
 
 static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_iqueue *iq;
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		iq = fuse_lock_iqueue(fc);
+		req->in.h.unique = fuse_get_unique(iq);
+		queue_request(fc, iq, req);
+		spin_unlock(&iq->lock);
 	}
 }
 
@@ -364,19 +430,22 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with req->iq->lock, unlocks it
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->iq->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
+	unsigned background = req->background;
+
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
-	if (req->background) {
-		req->background = 0;
-
+	req->background = 0;
+	spin_unlock(&req->iq->lock);
+	if (background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background)
 			fc->blocked = 0;
 
@@ -392,50 +461,47 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void wait_answer_interruptible(struct fuse_req *req)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_interrupt(struct fuse_iqueue *iq, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &iq->interrupts);
+	wake_up(&iq->waitq);
+	kill_fasync(&iq->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
 {
+	struct fuse_iqueue *iq;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 
+		iq = fuse_lock_req_iqueue(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(iq, req);
+		spin_unlock(&iq->lock);
 	}
 
 	if (!req->force) {
@@ -443,36 +509,36 @@ __acquires(fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 		restore_sigs(&oldset);
 
+		iq = fuse_lock_req_iqueue(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
-			return;
+			goto out_unlock;
 		}
+		spin_unlock(&iq->lock);
 	}
 
 	/*
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
-
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	iq = fuse_lock_req_iqueue(req);
 
 	if (!req->aborted)
-		return;
+		goto out_unlock;
 
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
@@ -482,30 +548,36 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		return;
 	}
+ out_unlock:
+	spin_unlock(&iq->lock);
 }
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_iqueue *iq;
+
 	BUG_ON(req->background);
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	iq = fuse_lock_iqueue(fc);
+	if (!iq->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(iq);
+		queue_request(fc, iq, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
+		spin_unlock(&iq->lock);
 
 		request_wait_answer(fc, req);
+		return;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -538,7 +610,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
+		req->iq = &fc->iq;
+		spin_lock(&req->iq->lock);
 		request_end(fc, req);
 	}
 }
@@ -553,16 +628,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_iqueue *iq = &fc->iq;
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		queue_request(fc, req);
+	spin_lock(&iq->lock);
+	if (iq->connected) {
+		queue_request(fc, iq, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 
 	return err;
 }
@@ -605,16 +681,16 @@ void fuse_force_forget(struct file *file, u64 nodeid)
  * anything that could cause a page-fault.  If the request was already
  * aborted bail out.
  */
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->iq->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->iq->lock);
 	}
 	return err;
 }
@@ -624,14 +700,14 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
  * requester thread is currently waiting for it to be unlocked, so
  * wake it up.
  */
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->iq->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->iq->lock);
 	}
 }
 
@@ -691,7 +767,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	struct page *page;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
@@ -746,7 +822,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		cs->addr += cs->len;
 	}
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->req);
 }
 
 /* Do as much copy to/from userspace buffer as we can */
@@ -797,7 +873,7 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	struct page *newpage;
 	struct pipe_buffer *buf = cs->pipebufs;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	err = buf->ops->confirm(cs->pipe, buf);
@@ -851,12 +927,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->iq->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->iq->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -876,7 +952,7 @@ out_fallback:
 	cs->pg = buf->page;
 	cs->offset = buf->offset;
 
-	err = lock_request(cs->fc, cs->req);
+	err = lock_request(cs->req);
 	if (err)
 		return err;
 
@@ -891,7 +967,7 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 	if (cs->nr_segs == cs->pipe->buffers)
 		return -EIO;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	buf = cs->pipebufs;
@@ -1002,36 +1078,36 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
+static int forget_pending(struct fuse_iqueue *iq)
 {
-	return fc->forget_list_head.next != NULL;
+	return iq->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_iqueue *iq)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	return !list_empty(&iq->pending) || !list_empty(&iq->interrupts) ||
+		forget_pending(iq);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void request_wait(struct fuse_iqueue *iq)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&iq->waitq, &wait);
+	while (iq->connected && !request_pending(iq)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&iq->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&iq->waitq, &wait);
 }
 
 /*
@@ -1040,11 +1116,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with iq->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_iqueue *iq,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -1052,7 +1129,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(iq);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -1060,7 +1137,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1072,21 +1149,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_iqueue *iq,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = iq->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	iq->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (iq->forget_list_head.next == NULL)
+		iq->forget_list_tail = &iq->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -1094,24 +1171,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_conn *fc,
+static int fuse_read_single_forget(struct fuse_iqueue *iq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(iq, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(iq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1127,9 +1204,9 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_conn *fc,
+static int fuse_read_batch_forget(struct fuse_iqueue *iq,
 				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1138,18 +1215,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(iq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(iq, max_forgets, &count);
+	spin_unlock(&iq->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1176,14 +1253,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			    size_t nbytes)
-__releases(fc->lock)
+static int fuse_read_forget(struct fuse_conn *fc, struct fuse_iqueue *iq,
+			    struct fuse_copy_state *cs, size_t nbytes)
+__releases(iq->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (fc->minor < 16 || iq->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(iq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(iq, cs, nbytes);
 }
 
 /*
@@ -1195,46 +1272,48 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq = fud->iq;
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	if ((file->f_flags & O_NONBLOCK) && iq->connected &&
+	    !request_pending(iq))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(iq);
 	err = -ENODEV;
-	if (!fc->connected)
+	if (!iq->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(iq))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&iq->interrupts)) {
+		req = list_entry(iq->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(iq, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(iq)) {
+		if (list_empty(&iq->pending) || iq->forget_batch-- > 0)
+			return fuse_read_forget(fc, iq, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (iq->forget_batch <= -8)
+			iq->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(iq->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &iq->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1247,14 +1326,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1269,15 +1348,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &iq->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(iq, req);
+		spin_unlock(&iq->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	return err;
 }
 
@@ -1286,13 +1365,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1304,18 +1383,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1751,11 +1830,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_iqueue *iq, u64 unique)
 {
 	struct fuse_req *req;
 
-	list_for_each_entry(req, &fc->processing, list) {
+	list_for_each_entry(req, &iq->processing, list) {
 		if (req->in.h.unique == unique || req->intr_unique == unique)
 			return req;
 	}
@@ -1792,9 +1871,11 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq = fud->iq;
 	int err;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
@@ -1823,19 +1904,19 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	err = -ENOENT;
-	if (!fc->connected)
+	if (!iq->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(iq, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&iq->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1848,26 +1929,26 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(iq, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &iq->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1879,7 +1960,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1889,13 +1970,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(fud, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1906,12 +1987,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_dev *fud;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	fud = fuse_get_dev(out);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
@@ -1958,14 +2039,14 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, fud->fc, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(fud, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1979,18 +2060,21 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_iqueue *iq;
+
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	iq = fud->iq;
+	poll_wait(file, &iq->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&iq->lock);
+	if (!iq->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(iq))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 
 	return mask;
 }
@@ -1998,18 +2082,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires iq->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_iqueue *iq,
+			 struct list_head *head)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&iq->lock);
 	}
 }
 
@@ -2024,13 +2109,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_iqueue *iq)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&iq->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(iq->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -2041,25 +2126,31 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&iq->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&iq->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Shut down an input queue: requests under I/O are aborted first, then
+ * the queued requests are ended and the pending forgets dropped.
+ */
+static void end_iqueue(struct fuse_conn *fc, struct fuse_iqueue *iq)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	spin_lock(&iq->lock);
+	iq->connected = 0;
+	end_io_requests(fc, iq);
+	end_requests(fc, iq, &iq->pending);
+	end_requests(fc, iq, &iq->processing);
+	while (forget_pending(iq))
+		kfree(dequeue_forget(iq, 1, NULL));
+	spin_unlock(&iq->lock);
+	wake_up_all(&iq->waitq);
+	kill_fasync(&iq->fasync, SIGIO, POLL_IN);
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -2077,6 +2168,36 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * End all requests of the connection, on every input queue.
+ *
+ * Progression of new requests onto the queues is prevented by
+ * fc->connected and iq->connected being false.  Progression of
+ * requests under I/O to the processing list is prevented by the
+ * req->aborted flag being true for these requests.  For this reason
+ * requests on the io list must be aborted first.
+ */
+static void fuse_end_conn(struct fuse_conn *fc)
+{
+	int cpu;
+
+	spin_lock(&fc->lock);
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->initialized = 1;
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	end_polls(fc);
+	spin_unlock(&fc->lock);
+
+	end_iqueue(fc, &fc->iq);
+	if (fc->cpu_iqs) {
+		for_each_possible_cpu(cpu)
+			end_iqueue(fc, per_cpu_ptr(fc->cpu_iqs, cpu));
+	}
+	wake_up_all(&fc->blocked_waitq);
+}
+
 /*
  * Abort all requests.
  *
@@ -2087,60 +2208,274 @@ static void end_polls(struct fuse_conn *fc)
  * filesystem daemon and all users of the filesystem.  The exception
  * is the combination of an asynchronous request and the tricky
  * deadlock (see Documentation/filesystems/fuse.txt).
- *
- * During the aborting, progression of requests from the pending and
- * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
- *
- * Progression of requests under I/O to the processing list is
- * prevented by the req->aborted flag being true for these requests.
- * For this reason requests on the io list must be aborted first.
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	unsigned connected;
+
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		fc->initialized = 1;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
-	}
+	connected = fc->connected;
+	fc->connected = 0;
 	spin_unlock(&fc->lock);
+
+	if (connected)
+		fuse_end_conn(fc);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
-int fuse_dev_release(struct inode *inode, struct file *file)
+static void disconnect_iqueue(struct fuse_iqueue *iq)
+{
+	spin_lock(&iq->lock);
+	iq->connected = 0;
+	spin_unlock(&iq->lock);
+	wake_up_all(&iq->waitq);
+	kill_fasync(&iq->fasync, SIGIO, POLL_IN);
+}
+
+void fuse_disconnect_iqueues(struct fuse_conn *fc)
+{
+	int cpu;
+
+	disconnect_iqueue(&fc->iq);
+	if (fc->cpu_iqs) {
+		for_each_possible_cpu(cpu)
+			disconnect_iqueue(per_cpu_ptr(fc->cpu_iqs, cpu));
+	}
+}
+
+/*
+ * The last device bound to a cpu queue went away.  Hand the requests and
+ * forgets still pending on it to the default queue, and end those that
+ * were already read through it, since nobody is left to reply to them.
+ */
+static void orphan_iqueue(struct fuse_conn *fc, struct fuse_iqueue *iq)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_iqueue *def = &fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&iq->lock);
+	if (iq->nr_devs)
+		goto out_unlock;
+
+	spin_lock_nested(&def->lock, SINGLE_DEPTH_NESTING);
+	if (def->connected) {
+		list_for_each_entry(req, &iq->pending, list)
+			req->iq = def;
+		list_splice_tail_init(&iq->pending, &def->pending);
+		if (forget_pending(iq)) {
+			def->forget_list_tail->next = iq->forget_list_head.next;
+			def->forget_list_tail = iq->forget_list_tail;
+			iq->forget_list_head.next = NULL;
+			iq->forget_list_tail = &iq->forget_list_head;
+		}
+		wake_up(&def->waitq);
+		kill_fasync(&def->fasync, SIGIO, POLL_IN);
+	}
+	spin_unlock(&def->lock);
+
+	end_requests(fc, iq, &iq->pending);
+	end_requests(fc, iq, &iq->processing);
+	while (forget_pending(iq))
+		kfree(dequeue_forget(iq, 1, NULL));
+ out_unlock:
+	spin_unlock(&iq->lock);
+}
+
+static struct fuse_dev *__fuse_dev_alloc(struct fuse_conn *fc,
+					 struct fuse_iqueue *iq)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (fud) {
+		fud->fc = fuse_conn_get(fc);
+		fud->iq = iq;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		fc->initialized = 1;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		fc->dev_count++;
+		spin_lock(&iq->lock);
+		iq->nr_devs++;
+		spin_unlock(&iq->lock);
 		spin_unlock(&fc->lock);
-		fuse_conn_put(fc);
 	}
 
+	return fud;
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	return __fuse_dev_alloc(fc, &fc->iq);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+/*
+ * Detach a device from its connection.  Closing the last device ends all
+ * requests of the connection.
+ */
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq = fud->iq;
+	bool last, orphan;
+
+	spin_lock(&fc->lock);
+	last = !--fc->dev_count;
+	spin_lock(&iq->lock);
+	orphan = !--iq->nr_devs && iq != &fc->iq;
+	spin_unlock(&iq->lock);
+	spin_unlock(&fc->lock);
+
+	if (last)
+		fuse_end_conn(fc);
+	else if (orphan)
+		orphan_iqueue(fc, iq);
+
+	kfree(fud);
+	fuse_conn_put(fc);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_free);
+
+int fuse_dev_release(struct inode *inode, struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	if (fud)
+		fuse_dev_free(fud);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fud->iq->fasync);
+}
+
+/*
+ * Return the input queue of @cpu, allocating the per-cpu queues of the
+ * connection when the first device is bound to one.
+ *
+ * Called with fuse_mutex held
+ */
+static struct fuse_iqueue *fuse_cpu_iqueue(struct fuse_conn *fc, int cpu)
+{
+	struct fuse_iqueue __percpu *cpu_iqs = fc->cpu_iqs;
+	int i;
+
+	if (!cpu_iqs) {
+		cpu_iqs = alloc_percpu(struct fuse_iqueue);
+		if (!cpu_iqs)
+			return ERR_PTR(-ENOMEM);
+
+		for_each_possible_cpu(i)
+			fuse_iqueue_init(per_cpu_ptr(cpu_iqs, i), i + 1);
+
+		spin_lock(&fc->lock);
+		if (!fc->connected) {
+			spin_unlock(&fc->lock);
+			free_percpu(cpu_iqs);
+			return ERR_PTR(-ENOTCONN);
+		}
+		/* pairs with the barrier in fuse_lock_iqueue() */
+		smp_wmb();
+		fc->cpu_iqs = cpu_iqs;
+		spin_unlock(&fc->lock);
+	}
+
+	return per_cpu_ptr(cpu_iqs, cpu);
+}
+
+/*
+ * Attach @file to the connection of the device file @oldfd, reading
+ * either the default queue (@cpu < 0) or the queue of @cpu.
+ */
+static int fuse_dev_clone(struct file *file, u32 oldfd, int cpu)
+{
+	struct fuse_dev *fud, *old_fud;
+	struct fuse_iqueue *iq;
+	struct file *old;
+	int err = -EINVAL;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	if (old->f_op != file->f_op)
+		goto out_fput;
+
+	mutex_lock(&fuse_mutex);
+	old_fud = fuse_get_dev(old);
+	if (!old_fud || fuse_get_dev(file))
+		goto out_unlock;
+
+	iq = &old_fud->fc->iq;
+	if (cpu >= 0) {
+		iq = fuse_cpu_iqueue(old_fud->fc, cpu);
+		err = PTR_ERR(iq);
+		if (IS_ERR(iq))
+			goto out_unlock;
+	}
+
+	err = -ENOMEM;
+	fud = __fuse_dev_alloc(old_fud->fc, iq);
+	if (!fud)
+		goto out_unlock;
+
+	file->private_data = fud;
+	err = 0;
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+ out_fput:
+	fput(old);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev_clone_cpu clone;
+	struct fuse_backing_map map;
+	struct fuse_dev *fud;
+	u32 oldfd;
+	u32 backing_id;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(oldfd, (__u32 __user *) arg))
+			return -EFAULT;
+		return fuse_dev_clone(file, oldfd, -1);
+
+	case FUSE_DEV_IOC_CLONE_CPU:
+		if (copy_from_user(&clone, (void __user *) arg, sizeof(clone)))
+			return -EFAULT;
+		if (clone.cpu >= nr_cpu_ids || !cpu_possible(clone.cpu))
+			return -EINVAL;
+		return fuse_dev_clone(file, clone.fd, clone.cpu);
+
+	case FUSE_DEV_IOC_BACKING_OPEN:
+		fud = fuse_get_dev(file);
+		if (!fud)
+			return -EPERM;
+		if (copy_from_user(&map, (void __user *) arg, sizeof(map)))
+			return -EFAULT;
+		return fuse_backing_open(fud->fc, &map);
+
+	case FUSE_DEV_IOC_BACKING_CLOSE:
+		fud = fuse_get_dev(file);
+		if (!fud)
+			return -EPERM;
+		if (get_user(backing_id, (__u32 __user *) arg))
+			return -EFAULT;
+		return fuse_backing_close(fud->fc, backing_id);
+
+	default:
+		return -ENOTTY;
+	}
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -2155,6 +2490,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl = fuse_dev_ioctl,
+	.compat_ioctl   = fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -482,6 +482,8 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry,
 	fuse_change_entry_timeout(entry, &outentry);
 	fuse_invalidate_attr(dir);
 	err = finish_open(file, entry, generic_file_open, opened);
+	if (!err)
+		err = fuse_passthrough_open(fc, ff, file, outopen.backing_id);
 	if (err) {
 		fuse_sync_release(ff, flags);
 	} else {
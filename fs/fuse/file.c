@@ -69,6 +69,8 @@ struct fuse_file *fuse_file_alloc(struct fuse_conn *fc)
 	atomic_set(&ff->count, 0);
 	RB_CLEAR_NODE(&ff->polled_node);
 	init_waitqueue_head(&ff->poll_wait);
+	ff->passthrough = NULL;
+	ff->passthrough_cred = NULL;
 
 	spin_lock(&fc->lock);
 	ff->kh = ++fc->khctr;
@@ -145,6 +147,7 @@ static void fuse_file_put(struct fuse_file *ff, bool sync)
 			req->background = 1;
 			fuse_request_send_background(ff->fc, req);
 		}
+		fuse_passthrough_release(ff);
 		kfree(ff);
 	}
 }
@@ -170,6 +173,13 @@ int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 			ff->fh = outarg.fh;
 			ff->open_flags = outarg.open_flags;
 
+			err = fuse_passthrough_open(fc, ff, file,
+						    outarg.backing_id);
+			if (err) {
+				ff->nodeid = nodeid;
+				fuse_sync_release(ff, file->f_flags);
+				return err;
+			}
 		} else if (err != -ENOSYS || isdir) {
 			fuse_file_free(ff);
 			return err;
@@ -209,7 +219,8 @@ void fuse_finish_open(struct inode *inode, struct file *file)
 	struct fuse_file *ff = file->private_data;
 	struct fuse_conn *fc = get_fuse_conn(inode);
 
-	if (ff->open_flags & FOPEN_DIRECT_IO)
+	/* passthrough takes precedence over direct I/O */
+	if ((ff->open_flags & FOPEN_DIRECT_IO) && !ff->passthrough)
 		file->f_op = &fuse_direct_io_file_operations;
 	if (!(ff->open_flags & FOPEN_KEEP_CACHE))
 		invalidate_inode_pages2(inode->i_mapping);
@@ -340,6 +351,7 @@ void fuse_sync_release(struct fuse_file *ff, int flags)
 	ff->reserved_req->background = 0;
 	fuse_request_send(ff->fc, ff->reserved_req);
 	fuse_put_request(ff->fc, ff->reserved_req);
+	fuse_passthrough_release(ff);
 	kfree(ff);
 }
 EXPORT_SYMBOL_GPL(fuse_sync_release);
@@ -937,6 +949,10 @@ static ssize_t fuse_file_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
 	struct inode *inode = iocb->ki_filp->f_mapping->host;
 	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+
+	if (ff->passthrough)
+		return fuse_passthrough_read_iter(iocb, to);
 
 	/*
 	 * In auto invalidate mode, always update attributes on read.
@@ -1191,6 +1207,10 @@ static ssize_t fuse_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	ssize_t err;
 	loff_t endbyte = 0;
 	loff_t pos = iocb->ki_pos;
+	struct fuse_file *ff = file->private_data;
+
+	if (ff->passthrough)
+		return fuse_passthrough_write_iter(iocb, from);
 
 	if (get_fuse_conn(inode)->writeback_cache) {
 		/* Update size (EOF optimization) and mode (SUID clearing) */
@@ -1778,8 +1798,8 @@ static bool fuse_writepage_in_flight(struct fuse_req *new_req,
 {
 	struct fuse_conn *fc = get_fuse_conn(new_req->inode);
 	struct fuse_inode *fi = get_fuse_inode(new_req->inode);
-	struct fuse_req *tmp;
 	struct fuse_req *old_req;
+	struct fuse_iqueue *iq;
 	bool found = false;
 	pgoff_t curr_index;
 
@@ -1811,11 +1831,20 @@ static bool fuse_writepage_in_flight(struct fuse_req *new_req,
 		}
 	}
 
+	/*
+	 * A request still on bg_queue is kept there by fc->lock, one that
+	 * was queued can only be read by the server under its iq->lock.
+	 */
+	iq = NULL;
+	if (old_req->num_pages == 1 && old_req->iq)
+		iq = fuse_lock_req_iqueue(old_req);
 	if (old_req->num_pages == 1 && (old_req->state == FUSE_REQ_INIT ||
 					old_req->state == FUSE_REQ_PENDING)) {
 		struct backing_dev_info *bdi = page->mapping->backing_dev_info;
 
 		copy_highpage(old_req->pages[0], page);
+		if (iq)
+			spin_unlock(&iq->lock);
 		spin_unlock(&fc->lock);
 
 		dec_bdi_stat(bdi, BDI_WRITEBACK);
@@ -1825,6 +1854,8 @@ static bool fuse_writepage_in_flight(struct fuse_req *new_req,
 		fuse_request_free(new_req);
 		goto out;
 	} else {
+		if (iq)
+			spin_unlock(&iq->lock);
 		new_req->misc.write.next = old_req->misc.write.next;
 		old_req->misc.write.next = new_req;
 	}
@@ -2112,6 +2143,11 @@ static const struct vm_operations_struct fuse_file_vm_ops = {
 
 static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct fuse_file *ff = file->private_data;
+
+	if (ff->passthrough)
+		return fuse_passthrough_mmap(file, vma);
+
 	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE))
 		fuse_link_write_file(file);
 
@@ -22,6 +22,10 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
+
+/** Magic number in the super block of fuse mounts */
+#define FUSE_SUPER_MAGIC 0x65735546
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -47,6 +51,9 @@
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
 
+/** Unique ids of each input queue are spaced this far apart */
+#define FUSE_REQCTR_STEP ((u64)nr_cpu_ids + 1)
+
 /** List of active connections */
 extern struct list_head fuse_conn_list;
 
@@ -157,6 +164,24 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file for FOPEN_PASSTHROUGH, or NULL */
+	struct file *passthrough;
+
+	/** Credentials of the server, used for passthrough I/O */
+	const struct cred *passthrough_cred;
+};
+
+/** A file registered with FUSE_DEV_IOC_BACKING_OPEN */
+struct fuse_backing {
+	/** The file opened by the server */
+	struct file *file;
+
+	/** Credentials of the server at registration time */
+	const struct cred *cred;
+
+	/** Refcount */
+	atomic_t count;
 };
 
 /** One input argument of a request */
@@ -251,7 +276,7 @@ struct fuse_io_priv {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_iqueue */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -266,7 +291,7 @@ struct fuse_req {
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * the lock of the queue the request is on (req->iq->lock)
 	 */
 
 	/** True if the request has reply */
@@ -293,6 +318,10 @@ struct fuse_req {
 	/** State of the request */
 	enum fuse_req_state state;
 
+	/** Input queue the request was queued on, NULL before that.  Only
+	    changed with the lock of both the old and the new queue held */
+	struct fuse_iqueue *iq;
+
 	/** The request input */
 	struct fuse_in in;
 
@@ -364,6 +393,66 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A queue of requests for userspace.
+ *
+ * Every connection has a default queue, read through the device file
+ * the filesystem was mounted with and its plain clones.  Daemons can
+ * also clone device files bound to the queue of one cpu, in which case
+ * requests submitted on that cpu go to that queue and are only seen by
+ * its devices.  Each queue has its own lock, so the submission, read
+ * and reply paths of different queues do not contend.
+ */
+struct fuse_iqueue {
+	/** Lock protecting the lists below and the requests on them */
+	spinlock_t lock;
+
+	/** Cleared when the connection is shut down */
+	unsigned connected;
+
+	/** Number of device files reading this queue */
+	unsigned nr_devs;
+
+	/** Readers of the queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** The next unique request id, in steps of FUSE_REQCTR_STEP */
+	u64 reqctr;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+};
+
+/**
+ * An open fuse device file attached to a connection
+ */
+struct fuse_dev {
+	/** The connection of this device */
+	struct fuse_conn *fc;
+
+	/** The queue this device reads requests from */
+	struct fuse_iqueue *iq;
+};
+
 /**
  * A Fuse connection.
  *
@@ -395,17 +484,14 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
-
-	/** The list of pending requests */
-	struct list_head pending;
+	/** The default input queue */
+	struct fuse_iqueue iq;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Per-cpu input queues, allocated when first bound */
+	struct fuse_iqueue __percpu *cpu_iqs;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of device files attached to the connection */
+	unsigned dev_count;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -428,16 +514,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating that INIT reply has been received. Allocating
 	 * any fuse request will be suspended until the flag is set */
 	int initialized;
@@ -453,9 +529,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -557,6 +630,12 @@ struct fuse_conn {
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
+	/** May files be opened with FOPEN_PASSTHROUGH? */
+	unsigned passthrough:1;
+
+	/** Backing files registered by the server, protected by fc->lock */
+	struct idr backing_files;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -578,9 +657,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -790,6 +866,22 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue.  @idx is 0 for the default queue and
+ * cpu + 1 for the queue of a cpu.
+ */
+void fuse_iqueue_init(struct fuse_iqueue *iq, unsigned idx);
+
+/**
+ * Disconnect all input queues and wake up their readers
+ */
+void fuse_disconnect_iqueues(struct fuse_conn *fc);
+
+/**
+ * Lock the input queue a queued request is on
+ */
+struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_req *req);
+
 /**
  * Invalidate inode attributes
  */
@@ -888,6 +980,8 @@ long fuse_ioctl_common(struct file *file, unsigned int cmd,
 		       unsigned long arg, unsigned int flags);
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+void fuse_dev_free(struct fuse_dev *fud);
 
 bool fuse_write_update_size(struct inode *inode, loff_t pos);
 
@@ -897,4 +991,15 @@ int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
 int fuse_do_setattr(struct inode *inode, struct iattr *attr,
 		    struct file *file);
 
+/* passthrough.c */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+void fuse_backing_files_free(struct fuse_conn *fc);
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  struct file *file, int backing_id);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
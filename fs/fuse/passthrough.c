@@ -0,0 +1,282 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2001-2008  Miklos Szeredi <miklos@szeredi.hu>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough of file I/O to a backing file.
+ *
+ * The server registers an open file with FUSE_DEV_IOC_BACKING_OPEN and
+ * names it in the reply to OPEN or CREATE with FOPEN_PASSTHROUGH.  The
+ * kernel then opens the backing file on behalf of the fuse file, and
+ * read, write and mmap of the fuse file go to it directly, without
+ * requests being sent to the server.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/aio.h>
+#include <linux/cred.h>
+#include <linux/fsnotify.h>
+
+static void fuse_backing_put(struct fuse_backing *fb)
+{
+	if (atomic_dec_and_test(&fb->count)) {
+		fput(fb->file);
+		put_cred(fb->cred);
+		kfree(fb);
+	}
+}
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct fuse_backing *fb;
+	struct file *file;
+	int err;
+
+	/* The server gets to do I/O on this file in the user's name */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (!fc->passthrough || map->flags || map->padding)
+		return -EINVAL;
+
+	file = fget(map->fd);
+	if (!file)
+		return -EBADF;
+
+	err = -EINVAL;
+	if (!S_ISREG(file_inode(file)->i_mode) ||
+	    !file->f_op->read_iter || !file->f_op->write_iter)
+		goto out_fput;
+
+	/* Don't stack fuse passthrough on top of fuse */
+	if (file_inode(file)->i_sb->s_magic == FUSE_SUPER_MAGIC)
+		goto out_fput;
+
+	err = -ENOMEM;
+	fb = kmalloc(sizeof(*fb), GFP_KERNEL);
+	if (!fb)
+		goto out_fput;
+
+	fb->file = file;
+	fb->cred = prepare_creds();
+	if (!fb->cred) {
+		kfree(fb);
+		goto out_fput;
+	}
+	atomic_set(&fb->count, 1);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	err = idr_alloc_cyclic(&fc->backing_files, fb, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+
+	if (err < 0)
+		fuse_backing_put(fb);
+
+	return err;
+
+ out_fput:
+	fput(file);
+	return err;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct fuse_backing *fb;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_find(&fc->backing_files, backing_id);
+	if (fb)
+		idr_remove(&fc->backing_files, backing_id);
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	fuse_backing_put(fb);
+	return 0;
+}
+
+static int fuse_backing_free_one(int id, void *p, void *data)
+{
+	fuse_backing_put(p);
+	return 0;
+}
+
+/*
+ * Drop the backing files still registered when the connection goes
+ * away.  Files already opened for passthrough hold their own reference.
+ */
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->backing_files, fuse_backing_free_one, NULL);
+	idr_destroy(&fc->backing_files);
+}
+
+/*
+ * Set up passthrough for a file being opened, if the server asked for it.
+ *
+ * The backing file is reopened with the flags of the fuse file, so that
+ * it gets its own file position and access mode.  The access mode can't
+ * exceed that of the file registered by the server.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  struct file *file, int backing_id)
+{
+	struct fuse_backing *fb;
+	struct file *backing;
+	int flags;
+	int err;
+
+	if (!(ff->open_flags & FOPEN_PASSTHROUGH))
+		return 0;
+
+	if (!fc->passthrough || !S_ISREG(file_inode(file)->i_mode))
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	fb = idr_find(&fc->backing_files, backing_id);
+	if (fb)
+		atomic_inc(&fb->count);
+	spin_unlock(&fc->lock);
+
+	if (!fb)
+		return -ENOENT;
+
+	err = -EACCES;
+	if (((file->f_mode & FMODE_READ) && !(fb->file->f_mode & FMODE_READ)) ||
+	    ((file->f_mode & FMODE_WRITE) && !(fb->file->f_mode & FMODE_WRITE)))
+		goto out_put;
+
+	flags = file->f_flags & ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
+	backing = dentry_open(&fb->file->f_path, flags, fb->cred);
+	err = PTR_ERR(backing);
+	if (IS_ERR(backing))
+		goto out_put;
+
+	ff->passthrough = backing;
+	ff->passthrough_cred = get_cred(fb->cred);
+	err = 0;
+ out_put:
+	fuse_backing_put(fb);
+	return err;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough) {
+		fput(ff->passthrough);
+		put_cred(ff->passthrough_cred);
+		ff->passthrough = NULL;
+	}
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough_cred);
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = iov_iter_count(to);
+	ret = backing->f_op->read_iter(&kiocb, to);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	iocb->ki_pos = kiocb.ki_pos;
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		fsnotify_access(backing);
+	file_accessed(iocb->ki_filp);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	mutex_lock(&inode->i_mutex);
+	old_cred = override_creds(ff->passthrough_cred);
+	file_start_write(backing);
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = iov_iter_count(from);
+	ret = backing->f_op->write_iter(&kiocb, from);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		fsnotify_modify(backing);
+		iocb->ki_pos = kiocb.ki_pos;
+		fuse_write_update_size(inode, kiocb.ki_pos);
+	}
+	/* size and times changed behind the server, refetch them */
+	fuse_invalidate_attr(inode);
+	mutex_unlock(&inode->i_mutex);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	/* The mapping is served by the backing file from now on */
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(ff->passthrough_cred);
+	ret = backing->f_op->mmap(backing, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		vma->vm_file = file;
+		fput(backing);
+	} else {
+		fput(file);
+	}
+	file_accessed(file);
+
+	return ret;
+}
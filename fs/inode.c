@@ -18,6 +18,7 @@
 #include <linux/buffer_head.h> /* for inode_has_buffers */
 #include <linux/ratelimit.h>
 #include <linux/list_lru.h>
+#include <trace/events/writeback.h>
 #include "internal.h"
 
 /*
@@ -29,8 +30,9 @@
  *   inode->i_sb->s_inode_lru, inode->i_lru
  * inode_sb_list_lock protects:
  *   sb->s_inodes, inode->i_sb_list
- * bdi->wb.list_lock protects:
- *   bdi->wb.b_{dirty,io,more_io}, inode->i_wb_list
+ * bdi_writeback->list_lock protects:
+ *   wb->b_{dirty,io,more_io,dirty_time}, inode->i_wb_list
+ *   (the wb is bdi->wb, or the per-blkcg one named by inode->i_wb_blkcg_id)
  * inode_hash_lock protects:
  *   inode_hashtable, inode->i_hash
  *
@@ -40,7 +42,7 @@
  *   inode->i_lock
  *     Inode LRU list locks
  *
- * bdi->wb.list_lock
+ * bdi_writeback->list_lock
  *   inode->i_lock
  *
  * inode_hash_lock
@@ -150,7 +152,11 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	inode->i_bdev = NULL;
 	inode->i_cdev = NULL;
 	inode->i_rdev = 0;
+	inode->i_flctx = NULL;
 	inode->dirtied_when = 0;
+#ifdef CONFIG_CGROUP_WRITEBACK
+	inode->i_wb_blkcg_id = 0;
+#endif
 
 	if (security_inode_alloc(inode))
 		goto out;
@@ -239,6 +245,7 @@ void __destroy_inode(struct inode *inode)
 		WARN_ON(atomic_long_read(&inode->i_sb->s_remove_count) == 0);
 		atomic_long_dec(&inode->i_sb->s_remove_count);
 	}
+	locks_free_lock_context(inode->i_flctx);
 
 #ifdef CONFIG_FS_POSIX_ACL
 	if (inode->i_acl && inode->i_acl != ACL_NOT_CACHED)
@@ -414,7 +421,8 @@ static void inode_lru_list_add(struct inode *inode)
  */
 void inode_add_lru(struct inode *inode)
 {
-	if (!(inode->i_state & (I_DIRTY | I_SYNC | I_FREEING | I_WILL_FREE)) &&
+	if (!(inode->i_state & (I_DIRTY_ALL | I_SYNC |
+				I_FREEING | I_WILL_FREE)) &&
 	    !atomic_read(&inode->i_count) && inode->i_sb->s_flags & MS_ACTIVE)
 		inode_lru_list_add(inode);
 }
@@ -1430,11 +1438,23 @@ static void iput_final(struct inode *inode)
  */
 void iput(struct inode *inode)
 {
-	if (inode) {
-		BUG_ON(inode->i_state & I_CLEAR);
-
-		if (atomic_dec_and_lock(&inode->i_count, &inode->i_lock))
-			iput_final(inode);
+	if (!inode)
+		return;
+	BUG_ON(inode->i_state & I_CLEAR);
+retry:
+	if (atomic_dec_and_lock(&inode->i_count, &inode->i_lock)) {
+		/*
+		 * Lazily updated timestamps must reach the disk before the
+		 * last reference goes away, or they would be lost on eviction.
+		 */
+		if (inode->i_nlink && (inode->i_state & I_DIRTY_TIME)) {
+			atomic_inc(&inode->i_count);
+			spin_unlock(&inode->i_lock);
+			trace_writeback_lazytime_iput(inode);
+			mark_inode_dirty_sync(inode);
+			goto retry;
+		}
+		iput_final(inode);
 	}
 }
 EXPORT_SYMBOL(iput);
@@ -1493,14 +1513,20 @@ static int relatime_need_update(struct vfsmount *mnt, struct inode *inode,
 	return 0;
 }
 
-/*
- * This does the actual work of updating an inodes time or version.  Must have
- * had called mnt_want_write() before calling this.
+/**
+ *	generic_update_time	-	update the timestamps of an inode
+ *	@inode: inode to update
+ *	@time: new timestamp
+ *	@flags: S_ATIME, S_CTIME, S_MTIME and/or S_VERSION
+ *
+ *	On a lazytime mount a pure timestamp update only marks the inode
+ *	I_DIRTY_TIME, which keeps the change in memory until the inode is
+ *	written out for another reason, is synced, evicted or the dirty
+ *	timestamps expire.  An i_version bump has to be persisted right away.
  */
-static int update_time(struct inode *inode, struct timespec *time, int flags)
+int generic_update_time(struct inode *inode, struct timespec *time, int flags)
 {
-	if (inode->i_op->update_time)
-		return inode->i_op->update_time(inode, time, flags);
+	int iflags = I_DIRTY_TIME;
 
 	if (flags & S_ATIME)
 		inode->i_atime = *time;
@@ -1510,9 +1536,25 @@ static int update_time(struct inode *inode, struct timespec *time, int flags)
 		inode->i_ctime = *time;
 	if (flags & S_MTIME)
 		inode->i_mtime = *time;
-	mark_inode_dirty_sync(inode);
+
+	if (!(inode->i_sb->s_flags & MS_LAZYTIME) || (flags & S_VERSION))
+		iflags = I_DIRTY_SYNC;
+	__mark_inode_dirty(inode, iflags);
 	return 0;
 }
+EXPORT_SYMBOL(generic_update_time);
+
+/*
+ * This does the actual work of updating an inodes time or version.  Must have
+ * had called mnt_want_write() before calling this.
+ */
+static int update_time(struct inode *inode, struct timespec *time, int flags)
+{
+	if (inode->i_op->update_time)
+		return inode->i_op->update_time(inode, time, flags);
+
+	return generic_update_time(inode, time, flags);
+}
 
 /**
  *	touch_atime	-	update the access time
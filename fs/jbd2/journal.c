@@ -754,6 +754,158 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits.
+ *
+ * A fast commit is a block of records written by the client filesystem
+ * into a small area at the end of the log, which persists the changes it
+ * tracks in the running transaction without committing the transaction.
+ * The records are only valid until that transaction has committed, so the
+ * area is reused from its start after every full commit.  Fast and full
+ * commits exclude each other: a full commit waits for the ongoing fast
+ * commit to finish, and a fast commit waits for the ongoing full commit.
+ */
+
+/*
+ * Start a fast commit of transaction @tid.  Returns -EALREADY if the
+ * transaction is already being committed, in which case the caller should
+ * just wait for that commit instead.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	while (1) {
+		DEFINE_WAIT(wait);
+
+		if (is_journal_aborted(journal)) {
+			write_unlock(&journal->j_state_lock);
+			return -EIO;
+		}
+		if (tid_geq(journal->j_commit_request, tid)) {
+			write_unlock(&journal->j_state_lock);
+			return -EALREADY;
+		}
+		if (!(journal->j_flags & (JBD2_FULL_COMMIT_ONGOING |
+					  JBD2_FAST_COMMIT_ONGOING)))
+			break;
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+static int __jbd2_fc_end_commit(journal_t *journal, tid_t tid, bool fallback)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	if (fallback)
+		__jbd2_log_start_commit(journal, tid);
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+
+	return 0;
+}
+
+/*
+ * End a fast commit started with jbd2_fc_begin_commit(), once its blocks
+ * have been written with jbd2_fc_wait_bufs().
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	return __jbd2_fc_end_commit(journal, 0, false);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/*
+ * End a fast commit that couldn't be completed, and kick off a full commit
+ * of @tid instead.
+ */
+int jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid)
+{
+	return __jbd2_fc_end_commit(journal, tid, true);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
+/*
+ * Get a zeroed buffer for the next block of the fast commit area.
+ * Returns -ENOSPC once the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int ret;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last) {
+		write_unlock(&journal->j_state_lock);
+		return -ENOSPC;
+	}
+	blocknr = journal->j_fc_first + journal->j_fc_off;
+	write_unlock(&journal->j_state_lock);
+
+	ret = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (ret)
+		return ret;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	write_lock(&journal->j_state_lock);
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	write_unlock(&journal->j_state_lock);
+
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+/*
+ * Wait for the last @num_blks fast commit blocks handed out by
+ * jbd2_fc_get_buf() to be written, and release them.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, j_fc_off;
+	int ret = 0;
+
+	read_lock(&journal->j_state_lock);
+	j_fc_off = journal->j_fc_off;
+	read_unlock(&journal->j_state_lock);
+
+	for (i = j_fc_off - 1; i >= j_fc_off - num_blks; i--) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			ret = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+
 /*
  * Log buffer allocation routines:
  */
@@ -1082,6 +1234,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1255,6 +1408,44 @@ out_err:
 	return NULL;
 }
 
+/*
+ * Take the fast commit area out of the end of the log, if the journal has
+ * the feature.  Must be called with no transactions in the log.
+ */
+static int jbd2_journal_init_fc(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc_blks;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+
+	num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+	if (!num_fc_blks)
+		num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+	if (journal->j_last < journal->j_first + JBD2_MIN_JOURNAL_BLOCKS +
+			      num_fc_blks) {
+		printk(KERN_ERR "JBD2: Journal too short for %lu fast commit "
+		       "blocks.\n", num_fc_blks);
+		return -EINVAL;
+	}
+
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kcalloc(num_fc_blks,
+					     sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+
+	journal->j_fc_last = journal->j_last;
+	journal->j_last = journal->j_fc_last - num_fc_blks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
 /*
  * If the journal init or create aborts, we need to mark the journal
  * superblock as being NULL to prevent the journal destroy from writing
@@ -1290,10 +1481,14 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	if (jbd2_journal_init_fc(journal)) {
+		journal_fail_superblock(journal);
+		return -EINVAL;
+	}
 
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
@@ -1596,7 +1791,7 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
-	return 0;
+	return jbd2_journal_init_fc(journal);
 }
 
 
@@ -1721,6 +1916,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1867,6 +2063,37 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 			~cpu_to_be32(JBD2_FEATURE_INCOMPAT_CSUM_V2 |
 				     JBD2_FEATURE_INCOMPAT_CSUM_V3);
 
+	/*
+	 * The fast commit area is carved out of the log, which can only be
+	 * done while the log is empty, i.e. right after loading the journal.
+	 */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		int busy;
+
+		read_lock(&journal->j_state_lock);
+		busy = journal->j_running_transaction ||
+		       journal->j_committing_transaction ||
+		       journal->j_head != journal->j_first ||
+		       journal->j_tail != journal->j_first;
+		read_unlock(&journal->j_state_lock);
+		if (busy)
+			return 0;
+
+		if (!sb->s_num_fc_blks)
+			sb->s_num_fc_blks =
+				cpu_to_be32(JBD2_DEFAULT_FAST_COMMIT_BLOCKS);
+		sb->s_feature_incompat |=
+			cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+		if (jbd2_journal_init_fc(journal)) {
+			sb->s_feature_incompat &=
+				~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+			return 0;
+		}
+		write_lock(&journal->j_state_lock);
+		journal->j_free = journal->j_last - journal->j_first;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	sb->s_feature_compat    |= cpu_to_be32(compat);
 	sb->s_feature_ro_compat |= cpu_to_be32(ro);
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
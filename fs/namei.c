@@ -1299,6 +1299,19 @@ static struct dentry *lookup_dcache(struct qstr *name, struct dentry *dir,
 	int error;
 
 	*need_lookup = false;
+
+	/*
+	 * A lookup of this name running without i_mutex has to finish first.
+	 * No new one can start while we hold i_mutex.
+	 */
+	if (dir->d_sb->s_type->fs_flags & FS_PARALLEL_LOOKUP) {
+		dentry = d_find_in_lookup(dir, name);
+		if (dentry) {
+			d_wait_lookup(dentry);
+			dput(dentry);
+		}
+	}
+
 	dentry = d_lookup(dir, name);
 	if (dentry) {
 		if (dentry->d_flags & DCACHE_OP_REVALIDATE) {
@@ -1458,6 +1471,73 @@ need_lookup:
 	return 1;
 }
 
+/*
+ * Slow lookup for filesystems that can run ->lookup() without the
+ * directory's i_mutex.  The mutex is only held while the name is checked
+ * against the dcache and, on a miss, reserved with d_alloc_parallel(); the
+ * filesystem lookup itself runs unlocked, so cache misses on different names
+ * in one directory proceed in parallel.  Lookups of a name that is already
+ * being looked up wait for that one and use its result.
+ */
+static struct dentry *lookup_parallel(struct qstr *name, struct dentry *dir,
+				      unsigned int flags)
+{
+	struct inode *inode = dir->d_inode;
+	struct dentry *dentry, *old;
+	int error;
+
+again:
+	mutex_lock(&inode->i_mutex);
+	dentry = d_find_in_lookup(dir, name);
+	if (!dentry) {
+		dentry = d_lookup(dir, name);
+		if (!dentry) {
+			dentry = d_alloc_parallel(dir, name);
+			mutex_unlock(&inode->i_mutex);
+			if (unlikely(!dentry))
+				return ERR_PTR(-ENOMEM);
+			goto lookup;
+		}
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	if (d_in_lookup(dentry)) {
+		d_wait_lookup(dentry);
+		if (unlikely(d_unhashed(dentry))) {
+			dput(dentry);
+			goto again;
+		}
+		return dentry;
+	}
+
+	if (dentry->d_flags & DCACHE_OP_REVALIDATE) {
+		error = d_revalidate(dentry, flags);
+		if (unlikely(error <= 0)) {
+			if (error < 0) {
+				dput(dentry);
+				return ERR_PTR(error);
+			}
+			d_invalidate(dentry);
+			dput(dentry);
+			goto again;
+		}
+	}
+	return dentry;
+
+lookup:
+	/* Don't create child dentry for a dead directory. */
+	if (unlikely(IS_DEADDIR(inode)))
+		old = ERR_PTR(-ENOENT);
+	else
+		old = inode->i_op->lookup(inode, dentry, flags);
+	d_lookup_done(dentry);
+	if (unlikely(old)) {
+		dput(dentry);
+		dentry = old;
+	}
+	return dentry;
+}
+
 /* Fast lookup failed, do it the slow way */
 static int lookup_slow(struct nameidata *nd, struct path *path)
 {
@@ -1467,9 +1547,13 @@ static int lookup_slow(struct nameidata *nd, struct path *path)
 	parent = nd->path.dentry;
 	BUG_ON(nd->inode != parent->d_inode);
 
-	mutex_lock(&parent->d_inode->i_mutex);
-	dentry = __lookup_hash(&nd->last, parent, nd->flags);
-	mutex_unlock(&parent->d_inode->i_mutex);
+	if (parent->d_sb->s_type->fs_flags & FS_PARALLEL_LOOKUP) {
+		dentry = lookup_parallel(&nd->last, parent, nd->flags);
+	} else {
+		mutex_lock(&parent->d_inode->i_mutex);
+		dentry = __lookup_hash(&nd->last, parent, nd->flags);
+		mutex_unlock(&parent->d_inode->i_mutex);
+	}
 	if (IS_ERR(dentry))
 		return PTR_ERR(dentry);
 	path->mnt = nd->path.mnt;
@@ -65,6 +65,11 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_READDIR_PAGES 8
 
+/*
+ * Maximum number of TCP connections a client may open to one server.
+ */
+#define NFS_MAX_CONNECTIONS	16
+
 struct nfs_client_initdata {
 	unsigned long init_flags;
 	const char *hostname;
@@ -72,6 +77,7 @@ struct nfs_client_initdata {
 	size_t addrlen;
 	struct nfs_subversion *nfs_mod;
 	int proto;
+	unsigned int nconnect;
 	u32 minorversion;
 	struct net *net;
 };
@@ -83,6 +89,7 @@ struct nfs_parsed_mount_data {
 	int			flags;
 	unsigned int		rsize, wsize;
 	unsigned int		timeo, retrans;
+	unsigned int		nconnect;
 	unsigned int		acregmin, acregmax,
 				acdirmin, acdirmax;
 	unsigned int		namlen;
@@ -7,6 +7,7 @@
 
 /* nfs4.2proc.c */
 loff_t nfs42_proc_llseek(struct file *, loff_t, int);
+ssize_t nfs42_proc_copy(struct file *, loff_t, struct file *, loff_t, size_t);
 
 /* nfs4.2xdr.h */
 extern struct rpc_procinfo nfs4_2_procedures[];
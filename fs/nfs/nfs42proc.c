@@ -67,3 +67,94 @@ loff_t nfs42_proc_llseek(struct file *filep, loff_t offset, int whence)
 
 	return vfs_setpos(filep, res.sr_offset, inode->i_sb->s_maxbytes);
 }
+
+static int nfs42_proc_commit(struct inode *inode, loff_t pos, u64 count,
+			     struct nfs_write_verifier *verf)
+{
+	struct nfs_server *server = NFS_SERVER(inode);
+	struct nfs_writeverf res_verf;
+	struct nfs_commitargs args = {
+		.fh		= NFS_FH(inode),
+		.offset		= pos,
+		/* zero means up to the end of the file */
+		.count		= count > U32_MAX ? 0 : count,
+	};
+	struct nfs_commitres res = {
+		.verf		= &res_verf,
+		.server		= server,
+	};
+	struct rpc_message msg = {
+		.rpc_proc = &nfs4_procedures[NFSPROC4_CLNT_COMMIT],
+		.rpc_argp = &args,
+		.rpc_resp = &res,
+	};
+	int status;
+
+	status = nfs4_call_sync(server->client, server, &msg,
+				&args.seq_args, &res.seq_res, 0);
+	if (status)
+		return status;
+
+	/* the server rebooted and may have lost the copied data */
+	if (memcmp(verf, &res_verf.verifier, sizeof(*verf)))
+		return -EAGAIN;
+	return 0;
+}
+
+ssize_t nfs42_proc_copy(struct file *src, loff_t pos_src,
+			struct file *dst, loff_t pos_dst,
+			size_t count)
+{
+	struct nfs42_copy_args args = {
+		.src_fh		= NFS_FH(file_inode(src)),
+		.src_pos	= pos_src,
+		.dst_fh		= NFS_FH(file_inode(dst)),
+		.dst_pos	= pos_dst,
+		.count		= count,
+	};
+	struct nfs42_copy_res res;
+	struct rpc_message msg = {
+		.rpc_proc = &nfs4_procedures[NFSPROC4_CLNT_COPY],
+		.rpc_argp = &args,
+		.rpc_resp = &res,
+	};
+	struct inode *dst_inode = file_inode(dst);
+	struct nfs_server *server = NFS_SERVER(dst_inode);
+	int status;
+
+	if (!(server->caps & NFS_CAP_COPY))
+		return -EOPNOTSUPP;
+
+	status = nfs42_set_rw_stateid(&args.src_stateid, src, FMODE_READ);
+	if (status)
+		return status;
+
+	status = nfs42_set_rw_stateid(&args.dst_stateid, dst, FMODE_WRITE);
+	if (status)
+		return status;
+
+	status = nfs4_call_sync(server->client, server, &msg,
+				&args.seq_args, &res.seq_res, 0);
+	if (status == -ENOTSUPP) {
+		server->caps &= ~NFS_CAP_COPY;
+		return -EOPNOTSUPP;
+	}
+	if (status)
+		return status;
+
+	if (res.write_res.verifier.committed != NFS_FILE_SYNC) {
+		status = nfs42_proc_commit(dst_inode, pos_dst,
+					   res.write_res.count,
+					   &res.write_res.verifier.verifier);
+		if (status)
+			return status;
+	}
+
+	/* the server changed the file behind our page cache */
+	if (res.write_res.count)
+		truncate_pagecache_range(dst_inode, pos_dst,
+					 pos_dst + res.write_res.count - 1);
+	nfs_mark_for_revalidate(dst_inode);
+
+	return res.write_res.count;
+}
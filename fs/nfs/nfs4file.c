@@ -134,6 +134,31 @@ static loff_t nfs4_file_llseek(struct file *filep, loff_t offset, int whence)
 		return nfs_file_llseek(filep, offset, whence);
 	}
 }
+
+static ssize_t nfs4_copy_file_range(struct file *file_in, loff_t pos_in,
+				    struct file *file_out, loff_t pos_out,
+				    size_t count, unsigned int flags)
+{
+	struct inode *in_inode = file_inode(file_in);
+	struct inode *out_inode = file_inode(file_out);
+	ssize_t ret;
+
+	/* let the VFS deal with copies within a file */
+	if (in_inode == out_inode)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&out_inode->i_mutex);
+	/* the server must see any data that is still dirty on the client */
+	ret = nfs_wb_all(in_inode);
+	if (!ret)
+		ret = nfs_wb_all(out_inode);
+	if (!ret)
+		ret = nfs42_proc_copy(file_in, pos_in, file_out, pos_out,
+				      count);
+	mutex_unlock(&out_inode->i_mutex);
+
+	return ret;
+}
 #endif /* CONFIG_NFS_V4_2 */
 
 const struct file_operations nfs4_file_operations = {
@@ -157,4 +182,7 @@ const struct file_operations nfs4_file_operations = {
 	.splice_write	= iter_file_splice_write,
 	.check_flags	= nfs_check_flags,
 	.setlease	= simple_nosetlease,
+#ifdef CONFIG_NFS_V4_2
+	.copy_file_range = nfs4_copy_file_range,
+#endif
 };
@@ -23,6 +23,7 @@
 
 #include <net/net_namespace.h>
 #include <net/netns/generic.h>
+#include <linux/idr.h>
 
 /* Hash tables for nfs4_clientid state */
 #define CLIENT_HASH_BITS                 4
@@ -111,6 +112,11 @@ struct nfsd_net {
 
 	u32 clientid_counter;
 
+	/* stateids of asynchronous COPYs */
+	spinlock_t s2s_cp_lock;
+	struct idr s2s_cp_stateids;
+	u32 s2s_cp_cl_id;
+
 	struct svc_serv *nfsd_serv;
 };
 
@@ -34,6 +34,7 @@
  */
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
 
 #include "idmap.h"
 #include "cache.h"
@@ -776,7 +777,8 @@ nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 
 	/* check stateid */
 	if ((status = nfs4_preprocess_stateid_op(SVC_NET(rqstp),
-						 cstate, &read->rd_stateid,
+						 cstate, &cstate->current_fh,
+						 &read->rd_stateid,
 						 RD_STATE, &read->rd_filp))) {
 		dprintk("NFSD: nfsd4_read: couldn't process stateid!\n");
 		goto out;
@@ -922,7 +924,8 @@ nfsd4_setattr(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 
 	if (setattr->sa_iattr.ia_valid & ATTR_SIZE) {
 		status = nfs4_preprocess_stateid_op(SVC_NET(rqstp), cstate,
-			&setattr->sa_stateid, WR_STATE, NULL);
+			&cstate->current_fh, &setattr->sa_stateid,
+			WR_STATE, NULL);
 		if (status) {
 			dprintk("NFSD: nfsd4_setattr: couldn't process stateid!\n");
 			return status;
@@ -989,7 +992,8 @@ nfsd4_write(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 		return nfserr_inval;
 
 	status = nfs4_preprocess_stateid_op(SVC_NET(rqstp),
-					cstate, stateid, WR_STATE, &filp);
+					cstate, &cstate->current_fh,
+					stateid, WR_STATE, &filp);
 	if (status) {
 		dprintk("NFSD: nfsd4_write: couldn't process stateid!\n");
 		return status;
@@ -1022,6 +1026,7 @@ nfsd4_seek(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	struct file *file;
 
 	status = nfs4_preprocess_stateid_op(SVC_NET(rqstp), cstate,
+					    &cstate->current_fh,
 					    &seek->seek_stateid,
 					    RD_STATE, &file);
 	if (status) {
@@ -1056,6 +1061,357 @@ out:
 	return status;
 }
 
+static __be32
+nfsd4_verify_copy(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
+		  stateid_t *src_stateid, struct file **src,
+		  stateid_t *dst_stateid, struct file **dst)
+{
+	__be32 status;
+
+	if (!cstate->save_fh.fh_dentry)
+		return nfserr_nofilehandle;
+
+	status = nfs4_preprocess_stateid_op(SVC_NET(rqstp), cstate,
+					    &cstate->save_fh, src_stateid,
+					    RD_STATE, src);
+	if (status) {
+		dprintk("NFSD: %s: couldn't process src stateid!\n", __func__);
+		goto out;
+	}
+	/* special stateids leave the file for us to open */
+	if (!*src) {
+		status = nfsd_open(rqstp, &cstate->save_fh, S_IFREG,
+				   NFSD_MAY_READ, src);
+		if (status)
+			goto out;
+	}
+
+	status = nfs4_preprocess_stateid_op(SVC_NET(rqstp), cstate,
+					    &cstate->current_fh, dst_stateid,
+					    WR_STATE, dst);
+	if (status) {
+		dprintk("NFSD: %s: couldn't process dst stateid!\n", __func__);
+		goto out_put_src;
+	}
+	if (!*dst) {
+		status = nfsd_open(rqstp, &cstate->current_fh, S_IFREG,
+				   NFSD_MAY_WRITE, dst);
+		if (status)
+			goto out_put_src;
+	}
+
+	/* fix up for NFS-specific error code */
+	if (!S_ISREG(file_inode(*src)->i_mode) ||
+	    !S_ISREG(file_inode(*dst)->i_mode)) {
+		status = nfserr_wrong_type;
+		goto out_put_dst;
+	}
+
+out:
+	return status;
+out_put_dst:
+	fput(*dst);
+	*dst = NULL;
+out_put_src:
+	fput(*src);
+	*src = NULL;
+	goto out;
+}
+
+static __be32
+nfsd4_clone(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
+		struct nfsd4_clone *clone)
+{
+	struct file *src = NULL, *dst = NULL;
+	u64 count = clone->cl_count;
+	__be32 status;
+
+	status = nfsd4_verify_copy(rqstp, cstate, &clone->cl_src_stateid, &src,
+				   &clone->cl_dst_stateid, &dst);
+	if (status)
+		goto out;
+
+	/* a count of zero means everything up to the end of the source */
+	if (!count) {
+		loff_t isize = i_size_read(file_inode(src));
+
+		if (clone->cl_src_pos > isize) {
+			status = nfserr_inval;
+			goto out_put;
+		}
+		count = isize - clone->cl_src_pos;
+		if (!count)
+			goto out_put;
+	}
+
+	status = nfsd4_clone_file_range(src, clone->cl_src_pos,
+			dst, clone->cl_dst_pos, count);
+
+out_put:
+	fput(dst);
+	fput(src);
+out:
+	return status;
+}
+
+static int nfsd4_cb_offload_done(struct nfsd4_callback *cb,
+				 struct rpc_task *task)
+{
+	switch (task->tk_status) {
+	case -NFS4ERR_DELAY:
+		rpc_delay(task, 1 * HZ);
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static void nfsd4_cb_offload_release(struct nfsd4_callback *cb)
+{
+	struct nfsd4_copy *copy = container_of(cb, struct nfsd4_copy, cp_cb);
+
+	kfree(copy);
+}
+
+static struct nfsd4_callback_ops nfsd4_cb_offload_ops = {
+	.done = nfsd4_cb_offload_done,
+	.release = nfsd4_cb_offload_release,
+};
+
+static void nfs4_put_copy(struct nfsd4_copy *copy)
+{
+	if (!atomic_dec_and_test(&copy->refcount))
+		return;
+	kfree(copy);
+}
+
+static ssize_t _nfsd_copy_file_range(struct nfsd4_copy *copy)
+{
+	ssize_t bytes_copied = 0;
+	u64 bytes_total = copy->cp_count;
+	u64 src_pos = copy->cp_src_pos;
+	u64 dst_pos = copy->cp_dst_pos;
+
+	/* a synchronous copy may come up short, the client resends the rest */
+	do {
+		if (ACCESS_ONCE(copy->stopped))
+			break;
+		bytes_copied = nfsd_copy_file_range(copy->file_src, src_pos,
+				copy->file_dst, dst_pos, bytes_total);
+		if (bytes_copied <= 0)
+			break;
+		bytes_total -= bytes_copied;
+		copy->cp_res.wr_bytes_written += bytes_copied;
+		src_pos += bytes_copied;
+		dst_pos += bytes_copied;
+	} while (bytes_total > 0 && !copy->cp_synchronous);
+	return bytes_copied;
+}
+
+static __be32 nfsd4_do_copy(struct nfsd4_copy *copy, struct net *net)
+{
+	ssize_t bytes;
+
+	bytes = _nfsd_copy_file_range(copy);
+	if (bytes < 0 && !copy->cp_res.wr_bytes_written)
+		return nfserrno(bytes);
+
+	/* the data is not committed, the client follows up with COMMIT */
+	copy->cp_res.wr_stable_how = NFS_UNSTABLE;
+	gen_boot_verifier(&copy->cp_res.wr_verifier, net);
+	return nfs_ok;
+}
+
+static int nfsd4_do_async_copy(void *data)
+{
+	struct nfsd4_copy *copy = data;
+	struct nfs4_client *clp = copy->cp_clp;
+	struct nfsd_net *nn = net_generic(clp->net, nfsd_net_id);
+	struct nfsd4_copy *cb_copy;
+
+	copy->nfserr = nfsd4_do_copy(copy, clp->net);
+
+	spin_lock(&clp->async_lock);
+	list_del_init(&copy->copies);
+	spin_unlock(&clp->async_lock);
+
+	/* a cancelled copy is not reported back to the client */
+	if (!ACCESS_ONCE(copy->stopped)) {
+		cb_copy = kzalloc(sizeof(*cb_copy), GFP_KERNEL);
+		if (cb_copy) {
+			cb_copy->cp_res = copy->cp_res;
+			cb_copy->fh = copy->fh;
+			cb_copy->nfserr = copy->nfserr;
+			cb_copy->cp_clp = clp;
+			nfsd4_init_cb(&cb_copy->cp_cb, clp,
+				      &nfsd4_cb_offload_ops,
+				      NFSPROC4_CLNT_CB_OFFLOAD);
+			nfsd4_run_cb(&cb_copy->cp_cb);
+		}
+	}
+
+	nfs4_free_copy_state(nn, copy);
+	fput(copy->file_dst);
+	fput(copy->file_src);
+	/* the client may go away as soon as we signal completion */
+	complete(&copy->cp_done);
+	nfs4_put_copy(copy);
+	return 0;
+}
+
+static __be32
+nfsd4_copy(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
+		struct nfsd4_copy *copy)
+{
+	struct nfsd_net *nn = net_generic(SVC_NET(rqstp), nfsd_net_id);
+	struct nfs4_client *clp = cstate->clp;
+	struct nfsd4_copy *async_copy;
+	__be32 status;
+
+	memset(&copy->cp_res, 0, sizeof(copy->cp_res));
+	copy->file_src = copy->file_dst = NULL;
+	status = nfsd4_verify_copy(rqstp, cstate, &copy->cp_src_stateid,
+				   &copy->file_src, &copy->cp_dst_stateid,
+				   &copy->file_dst);
+	if (status)
+		goto out;
+
+	/* a count of zero means everything up to the end of the source */
+	if (!copy->cp_count) {
+		loff_t isize = i_size_read(file_inode(copy->file_src));
+
+		if (copy->cp_src_pos < isize)
+			copy->cp_count = isize - copy->cp_src_pos;
+	}
+
+	if (copy->cp_synchronous) {
+		status = nfsd4_do_copy(copy, SVC_NET(rqstp));
+		goto out_put;
+	}
+
+	status = nfserrno(-ENOMEM);
+	async_copy = kzalloc(sizeof(*async_copy), GFP_KERNEL);
+	if (!async_copy)
+		goto out_put;
+	if (!nfs4_init_copy_state(nn, async_copy)) {
+		kfree(async_copy);
+		goto out_put;
+	}
+	async_copy->cp_src_pos = copy->cp_src_pos;
+	async_copy->cp_dst_pos = copy->cp_dst_pos;
+	async_copy->cp_count = copy->cp_count;
+	async_copy->cp_consecutive = copy->cp_consecutive;
+	async_copy->cp_clp = clp;
+	fh_copy_shallow(&async_copy->fh, &cstate->current_fh.fh_handle);
+	async_copy->cp_res.cb_stateid = async_copy->cp_stateid;
+	INIT_LIST_HEAD(&async_copy->copies);
+	atomic_set(&async_copy->refcount, 1);
+	init_completion(&async_copy->cp_done);
+
+	async_copy->copy_task = kthread_create(nfsd4_do_async_copy,
+					       async_copy, "%s", "copy thread");
+	if (IS_ERR(async_copy->copy_task)) {
+		nfs4_free_copy_state(nn, async_copy);
+		kfree(async_copy);
+		goto out_put;
+	}
+
+	/* the copy thread now owns the file references */
+	async_copy->file_src = copy->file_src;
+	async_copy->file_dst = copy->file_dst;
+	copy->file_src = copy->file_dst = NULL;
+
+	copy->cp_res.cb_stateid = async_copy->cp_stateid;
+	copy->cp_res.wr_stable_how = NFS_UNSTABLE;
+	gen_boot_verifier(&copy->cp_res.wr_verifier, SVC_NET(rqstp));
+
+	spin_lock(&clp->async_lock);
+	list_add(&async_copy->copies, &clp->async_copies);
+	spin_unlock(&clp->async_lock);
+	wake_up_process(async_copy->copy_task);
+	status = nfs_ok;
+
+out_put:
+	if (copy->file_dst)
+		fput(copy->file_dst);
+	if (copy->file_src)
+		fput(copy->file_src);
+out:
+	return status;
+}
+
+static struct nfsd4_copy *
+find_async_copy(struct nfs4_client *clp, stateid_t *stateid)
+{
+	struct nfsd4_copy *copy;
+
+	spin_lock(&clp->async_lock);
+	list_for_each_entry(copy, &clp->async_copies, copies) {
+		if (memcmp(&copy->cp_stateid, stateid, NFS4_STATEID_SIZE))
+			continue;
+		atomic_inc(&copy->refcount);
+		spin_unlock(&clp->async_lock);
+		return copy;
+	}
+	spin_unlock(&clp->async_lock);
+	return NULL;
+}
+
+static void nfsd4_stop_copy(struct nfsd4_copy *copy)
+{
+	copy->stopped = true;
+	wait_for_completion(&copy->cp_done);
+	nfs4_put_copy(copy);
+}
+
+void nfsd4_shutdown_copy(struct nfs4_client *clp)
+{
+	struct nfsd4_copy *copy;
+
+	for (;;) {
+		spin_lock(&clp->async_lock);
+		if (list_empty(&clp->async_copies)) {
+			spin_unlock(&clp->async_lock);
+			break;
+		}
+		copy = list_first_entry(&clp->async_copies, struct nfsd4_copy,
+					copies);
+		list_del_init(&copy->copies);
+		atomic_inc(&copy->refcount);
+		spin_unlock(&clp->async_lock);
+		nfsd4_stop_copy(copy);
+	}
+}
+
+static __be32
+nfsd4_offload_cancel(struct svc_rqst *rqstp,
+		     struct nfsd4_compound_state *cstate,
+		     struct nfsd4_offload_status *os)
+{
+	struct nfsd4_copy *copy;
+
+	copy = find_async_copy(cstate->clp, &os->stateid);
+	if (!copy)
+		return nfserr_bad_stateid;
+	nfsd4_stop_copy(copy);
+	return nfs_ok;
+}
+
+static __be32
+nfsd4_offload_status(struct svc_rqst *rqstp,
+		     struct nfsd4_compound_state *cstate,
+		     struct nfsd4_offload_status *os)
+{
+	struct nfsd4_copy *copy;
+
+	copy = find_async_copy(cstate->clp, &os->stateid);
+	if (!copy)
+		return nfserr_bad_stateid;
+	os->count = copy->cp_res.wr_bytes_written;
+	nfs4_put_copy(copy);
+	return nfs_ok;
+}
+
 /* This routine never returns NFS_OK!  If there are no other errors, it
  * will return NFSERR_SAME or NFSERR_NOT_SAME depending on whether the
  * attributes matched.  VERIFY is implemented by mapping NFSERR_SAME
@@ -1610,6 +1966,26 @@ static inline u32 nfsd4_write_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
 	return (op_encode_hdr_size + 2 + op_encode_verifier_maxsz) * sizeof(__be32);
 }
 
+static inline u32 nfsd4_copy_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
+{
+	return (op_encode_hdr_size +
+		1 /* wr_callback */ +
+		op_encode_stateid_maxsz /* wr_callback */ +
+		2 /* wr_count */ +
+		1 /* wr_committed */ +
+		op_encode_verifier_maxsz +
+		1 /* cr_consecutive */ +
+		1 /* cr_synchronous */) * sizeof(__be32);
+}
+
+static inline u32 nfsd4_offload_status_rsize(struct svc_rqst *rqstp,
+					     struct nfsd4_op *op)
+{
+	return (op_encode_hdr_size +
+		2 /* osr_count */ +
+		1 /* osr_complete<1> */) * sizeof(__be32);
+}
+
 static inline u32 nfsd4_exchange_id_rsize(struct svc_rqst *rqstp, struct nfsd4_op *op)
 {
 	return (op_encode_hdr_size + 2 + 1 + /* eir_clientid, eir_sequenceid */\
@@ -1933,6 +2309,29 @@ static struct nfsd4_operation nfsd4_ops[] = {
 		.op_func = (nfsd4op_func)nfsd4_seek,
 		.op_name = "OP_SEEK",
 	},
+	[OP_COPY] = {
+		.op_func = (nfsd4op_func)nfsd4_copy,
+		.op_flags = OP_MODIFIES_SOMETHING | OP_CACHEME,
+		.op_name = "OP_COPY",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_copy_rsize,
+	},
+	[OP_OFFLOAD_STATUS] = {
+		.op_func = (nfsd4op_func)nfsd4_offload_status,
+		.op_name = "OP_OFFLOAD_STATUS",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_offload_status_rsize,
+	},
+	[OP_OFFLOAD_CANCEL] = {
+		.op_func = (nfsd4op_func)nfsd4_offload_cancel,
+		.op_flags = OP_MODIFIES_SOMETHING,
+		.op_name = "OP_OFFLOAD_CANCEL",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_only_status_rsize,
+	},
+	[OP_CLONE] = {
+		.op_func = (nfsd4op_func)nfsd4_clone,
+		.op_flags = OP_MODIFIES_SOMETHING | OP_CACHEME,
+		.op_name = "OP_CLONE",
+		.op_rsize_bop = (nfsd4op_rsize)nfsd4_only_status_rsize,
+	},
 };
 
 int nfsd4_max_reply(struct svc_rqst *rqstp, struct nfsd4_op *op)
@@ -346,6 +346,10 @@ struct nfs4_client {
 	struct rpc_wait_queue	cl_cb_waitq;	/* backchannel callers may */
 						/* wait here for slots */
 	struct net		*net;
+
+	/* asynchronous COPYs still running for this client */
+	struct list_head	async_copies;
+	spinlock_t		async_lock;
 };
 
 /* struct nfs4_client_reset
@@ -528,6 +532,7 @@ static inline struct nfs4_ol_stateid *openlockstateid(struct nfs4_stid *s)
 enum nfsd4_cb_op {
 	NFSPROC4_CLNT_CB_NULL = 0,
 	NFSPROC4_CLNT_CB_RECALL,
+	NFSPROC4_CLNT_CB_OFFLOAD,
 	NFSPROC4_CLNT_CB_SEQUENCE,
 };
 
@@ -535,9 +540,14 @@ enum nfsd4_cb_op {
 struct nfsd4_compound_state;
 struct nfsd_net;
 
+struct nfsd4_copy;
+
 extern __be32 nfs4_preprocess_stateid_op(struct net *net,
-		struct nfsd4_compound_state *cstate,
+		struct nfsd4_compound_state *cstate, struct svc_fh *fhp,
 		stateid_t *stateid, int flags, struct file **filp);
+extern bool nfs4_init_copy_state(struct nfsd_net *nn, struct nfsd4_copy *copy);
+extern void nfs4_free_copy_state(struct nfsd_net *nn, struct nfsd4_copy *copy);
+extern void nfsd4_shutdown_copy(struct nfs4_client *clp);
 void nfs4_put_stid(struct nfs4_stid *s);
 void nfs4_remove_reclaim_record(struct nfs4_client_reclaim *, struct nfsd_net *);
 extern void nfs4_release_reclaim(struct nfsd_net *);
@@ -439,6 +439,65 @@ struct nfsd4_seek {
 	loff_t		seek_pos;
 };
 
+struct nfsd4_clone {
+	/* request */
+	stateid_t	cl_src_stateid;
+	stateid_t	cl_dst_stateid;
+	u64		cl_src_pos;
+	u64		cl_dst_pos;
+	u64		cl_count;
+};
+
+struct nfsd42_write_res {
+	u64		wr_bytes_written;
+	u32		wr_stable_how;
+	nfs4_verifier	wr_verifier;
+	stateid_t	cb_stateid;
+};
+
+struct nfsd4_copy {
+	/* request */
+	stateid_t	cp_src_stateid;
+	stateid_t	cp_dst_stateid;
+	u64		cp_src_pos;
+	u64		cp_dst_pos;
+	u64		cp_count;
+
+	/* both */
+	bool		cp_consecutive;
+	bool		cp_synchronous;
+
+	/* response */
+	struct nfsd42_write_res	cp_res;
+
+	/* for asynchronous copies */
+	struct nfsd4_callback	cp_cb;
+	__be32			nfserr;
+	struct knfsd_fh		fh;
+
+	struct nfs4_client	*cp_clp;
+
+	struct file		*file_src;
+	struct file		*file_dst;
+
+	stateid_t		cp_stateid;
+
+	struct list_head	copies;
+	struct task_struct	*copy_task;
+	atomic_t		refcount;
+	bool			stopped;
+	struct completion	cp_done;
+};
+
+struct nfsd4_offload_status {
+	/* request */
+	stateid_t	stateid;
+
+	/* response */
+	u64		count;
+	u32		status;
+};
+
 struct nfsd4_op {
 	int					opnum;
 	__be32					status;
@@ -487,6 +546,9 @@ struct nfsd4_op {
 
 		/* NFSv4.2 */
 		struct nfsd4_seek		seek;
+		struct nfsd4_copy		copy;
+		struct nfsd4_offload_status	offload_status;
+		struct nfsd4_clone		clone;
 	} u;
 	struct nfs4_replay *			replay;
 };
@@ -6,6 +6,8 @@
 #include <linux/kernel.h> /* UINT_MAX */
 #include <linux/mount.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/types.h>
 #include <linux/wait.h>
 
@@ -20,6 +22,21 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	old = FANOTIFY_E(old_fsn);
 	new = FANOTIFY_E(new_fsn);
 
+	if (fanotify_is_name_event(old_fsn) || fanotify_is_name_event(new_fsn)) {
+		struct fanotify_name_event *old_ne, *new_ne;
+
+		if (!fanotify_is_name_event(old_fsn) ||
+		    !fanotify_is_name_event(new_fsn))
+			return false;
+
+		old_ne = FANOTIFY_NE(old_fsn);
+		new_ne = FANOTIFY_NE(new_fsn);
+		return old_fsn->inode == new_fsn->inode &&
+		       old->tgid == new->tgid &&
+		       old_ne->name_len == new_ne->name_len &&
+		       !memcmp(old_ne->name, new_ne->name, old_ne->name_len);
+	}
+
 	if (old_fsn->inode == new_fsn->inode && old->tgid == new->tgid &&
 	    old->path.mnt == new->path.mnt &&
 	    old->path.dentry == new->path.dentry)
@@ -105,19 +122,30 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 {
 	__u32 marks_mask, marks_ignored_mask;
 	struct path *path = data;
+	bool isdir;
 
 	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p mask=%x data=%p"
 		 " data_type=%d\n", __func__, inode_mark, vfsmnt_mark,
 		 event_mask, data, data_type);
 
-	/* if we don't have enough info to send an event to userspace say no */
-	if (data_type != FSNOTIFY_EVENT_PATH)
-		return false;
+	if (event_mask & FAN_ALL_DIRENT_EVENTS) {
+		/*
+		 * directory entry events are reported by the handle of the
+		 * directory, the object itself need not be opened.
+		 */
+		isdir = event_mask & FS_ISDIR;
+	} else {
+		/* if we don't have enough info to send an event to userspace say no */
+		if (data_type != FSNOTIFY_EVENT_PATH)
+			return false;
 
-	/* sorry, fanotify only gives a damn about files and dirs */
-	if (!S_ISREG(path->dentry->d_inode->i_mode) &&
-	    !S_ISDIR(path->dentry->d_inode->i_mode))
-		return false;
+		/* sorry, fanotify only gives a damn about files and dirs */
+		if (!S_ISREG(path->dentry->d_inode->i_mode) &&
+		    !S_ISDIR(path->dentry->d_inode->i_mode))
+			return false;
+
+		isdir = S_ISDIR(path->dentry->d_inode->i_mode);
+	}
 
 	if (inode_mark && vfsmnt_mark) {
 		marks_mask = (vfsmnt_mark->mask | inode_mark->mask);
@@ -128,6 +156,7 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 		 * events on the child, don't send it!
 		 */
 		if ((event_mask & FS_EVENT_ON_CHILD) &&
+		    !(event_mask & FAN_ALL_DIRENT_EVENTS) &&
 		    !(inode_mark->mask & FS_EVENT_ON_CHILD))
 			return false;
 		marks_mask = inode_mark->mask;
@@ -139,8 +168,7 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 		BUG();
 	}
 
-	if (S_ISDIR(path->dentry->d_inode->i_mode) &&
-	    (marks_ignored_mask & FS_ISDIR))
+	if (isdir && (marks_ignored_mask & FS_ISDIR))
 		return false;
 
 	if (event_mask & marks_mask & ~marks_ignored_mask)
@@ -183,6 +211,47 @@ init: __maybe_unused
 	return event;
 }
 
+struct fanotify_event_info *fanotify_alloc_name_event(struct inode *dir,
+						      u32 mask,
+						      __kernel_fsid_t *fsid,
+						      const unsigned char *name)
+{
+	struct fanotify_name_event *ne;
+	unsigned int name_len = name ? strlen(name) : 0;
+	int dwords = MAX_HANDLE_SZ >> 2;
+	int type;
+
+	ne = kmalloc(sizeof(*ne) + name_len + 1, GFP_KERNEL);
+	if (!ne)
+		return NULL;
+
+	fsnotify_init_event(&ne->fae.fse, dir, mask);
+	ne->fae.tgid = get_pid(task_tgid(current));
+	ne->fae.path.mnt = NULL;
+	ne->fae.path.dentry = NULL;
+	ne->fsid = *fsid;
+
+	type = exportfs_encode_inode_fh(dir, (struct fid *)ne->fh, &dwords,
+					NULL);
+	if (type <= 0 || type == FILEID_INVALID ||
+	    dwords > (MAX_HANDLE_SZ >> 2)) {
+		/* still report the event, userspace just can't open the dir */
+		pr_warn_ratelimited("fanotify: failed to encode fid (type=%d, len=%d)\n",
+				    type, dwords << 2);
+		type = FILEID_INVALID;
+		dwords = 0;
+	}
+	ne->fh_type = type;
+	ne->fh_len = dwords << 2;
+
+	ne->name_len = name_len;
+	if (name_len)
+		memcpy(ne->name, name, name_len);
+	ne->name[name_len] = '\0';
+
+	return &ne->fae;
+}
+
 static int fanotify_handle_event(struct fsnotify_group *group,
 				 struct inode *inode,
 				 struct fsnotify_mark *inode_mark,
@@ -204,6 +273,11 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	BUILD_BUG_ON(FAN_OPEN_PERM != FS_OPEN_PERM);
 	BUILD_BUG_ON(FAN_ACCESS_PERM != FS_ACCESS_PERM);
 	BUILD_BUG_ON(FAN_ONDIR != FS_ISDIR);
+	BUILD_BUG_ON(FAN_MOVED_FROM != FS_MOVED_FROM);
+	BUILD_BUG_ON(FAN_MOVED_TO != FS_MOVED_TO);
+	BUILD_BUG_ON(FAN_CREATE != FS_CREATE);
+	BUILD_BUG_ON(FAN_DELETE != FS_DELETE);
+	BUILD_BUG_ON(FAN_ALL_DIRENT_EVENTS != ALL_FSNOTIFY_DIRENT_EVENTS);
 
 	if (!fanotify_should_send_event(inode_mark, fanotify_mark, mask, data,
 					data_type))
@@ -212,7 +286,15 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	pr_debug("%s: group=%p inode=%p mask=%x\n", __func__, group, inode,
 		 mask);
 
-	event = fanotify_alloc_event(inode, mask, data);
+	if (mask & FAN_ALL_DIRENT_EVENTS) {
+		struct fsnotify_mark *fsn_mark = fanotify_mark ?: inode_mark;
+
+		event = fanotify_alloc_name_event(inode, mask,
+						  &FANOTIFY_M(fsn_mark)->fsid,
+						  file_name);
+	} else {
+		event = fanotify_alloc_event(inode, mask, data);
+	}
 	if (unlikely(!event))
 		return -ENOMEM;
 
@@ -252,6 +334,10 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 	event = FANOTIFY_E(fsn_event);
 	path_put(&event->path);
 	put_pid(event->tgid);
+	if (fanotify_is_name_event(fsn_event)) {
+		kfree(FANOTIFY_NE(fsn_event));
+		return;
+	}
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	if (fsn_event->mask & FAN_ALL_PERM_EVENTS) {
 		kmem_cache_free(fanotify_perm_event_cachep,
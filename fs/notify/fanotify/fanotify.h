@@ -1,3 +1,5 @@
+#include <linux/exportfs.h>
+#include <linux/fanotify.h>
 #include <linux/fsnotify_backend.h>
 #include <linux/path.h>
 #include <linux/slab.h>
@@ -5,6 +7,20 @@
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+/*
+ * fanotify marks remember the fsid of the filesystem they are attached to
+ * so that it can be reported along with directory file handles.
+ */
+struct fanotify_mark {
+	struct fsnotify_mark fsn_mark;
+	__kernel_fsid_t fsid;
+};
+
+static inline struct fanotify_mark *FANOTIFY_M(struct fsnotify_mark *fsn_mark)
+{
+	return container_of(fsn_mark, struct fanotify_mark, fsn_mark);
+}
+
 /*
  * Structure for normal fanotify events. It gets allocated in
  * fanotify_handle_event() and freed when the information is retrieved by
@@ -41,10 +57,42 @@ FANOTIFY_PE(struct fsnotify_event *fse)
 }
 #endif
 
+/*
+ * Structure for directory entry events.  These carry no path, userspace gets
+ * the file handle of the directory and the name of the entry instead.
+ */
+struct fanotify_name_event {
+	struct fanotify_event_info fae;
+	__kernel_fsid_t fsid;
+	u32 fh[MAX_HANDLE_SZ >> 2];	/* directory file handle */
+	u8 fh_type;
+	u8 fh_len;			/* in bytes */
+	unsigned int name_len;
+	char name[];
+};
+
+/* info records are padded to keep the next event metadata aligned */
+#define FANOTIFY_INFO_ALIGN	4
+
 static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 {
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+static inline bool fanotify_is_name_event(struct fsnotify_event *fse)
+{
+	return fse->mask & FAN_ALL_DIRENT_EVENTS;
+}
+
+static inline struct fanotify_name_event *
+FANOTIFY_NE(struct fsnotify_event *fse)
+{
+	return container_of(fse, struct fanotify_name_event, fae.fse);
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 						 struct path *path);
+struct fanotify_event_info *fanotify_alloc_name_event(struct inode *dir,
+						      u32 mask,
+						      __kernel_fsid_t *fsid,
+						      const unsigned char *name);
@@ -138,6 +138,12 @@ static int fanotify_fdinfo(struct seq_file *m, struct fsnotify_mark *mark)
 		ret = seq_printf(m, "fanotify mnt_id:%x mflags:%x mask:%x "
 				 "ignored_mask:%x\n", mnt->mnt_id, mflags,
 				 mark->mask, mark->ignored_mask);
+	} else if (mark->flags & FSNOTIFY_MARK_FLAG_SB) {
+		struct super_block *sb = mark->s.sb;
+
+		ret = seq_printf(m, "fanotify sdev:%x mflags:%x mask:%x "
+				 "ignored_mask:%x\n", sb->s_dev, mflags,
+				 mark->mask, mark->ignored_mask);
 	}
 out:
 	return ret;
@@ -166,6 +172,8 @@ int fanotify_show_fdinfo(struct seq_file *m, struct file *f)
 	if (group->fanotify_data.max_marks == UINT_MAX)
 		flags |= FAN_UNLIMITED_MARKS;
 
+	flags |= group->fanotify_data.flags;
+
 	seq_printf(m, "fanotify flags:%x event-flags:%x\n",
 		   flags, group->fanotify_data.f_flags);
 
@@ -0,0 +1,198 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+
+#include <linux/atomic.h>
+
+#include <linux/fsnotify_backend.h>
+#include "fsnotify.h"
+
+/*
+ * Protects sb->s_fsnotify_marks and sb->s_fsnotify_mask.  Super block marks
+ * are rare and only change from the mark syscalls, so unlike inode and
+ * vfsmount marks there is no need for a finer grained lock.
+ */
+static DEFINE_SPINLOCK(sb_mark_lock);
+
+void fsnotify_clear_marks_by_sb(struct super_block *sb)
+{
+	struct fsnotify_mark *mark, *lmark;
+	struct hlist_node *n;
+	LIST_HEAD(free_list);
+
+	spin_lock(&sb_mark_lock);
+	hlist_for_each_entry_safe(mark, n, &sb->s_fsnotify_marks, s.s_list) {
+		list_add(&mark->s.free_s_list, &free_list);
+		hlist_del_init_rcu(&mark->s.s_list);
+		fsnotify_get_mark(mark);
+	}
+	spin_unlock(&sb_mark_lock);
+
+	list_for_each_entry_safe(mark, lmark, &free_list, s.free_s_list) {
+		struct fsnotify_group *group;
+
+		spin_lock(&mark->lock);
+		fsnotify_get_group(mark->group);
+		group = mark->group;
+		spin_unlock(&mark->lock);
+
+		fsnotify_destroy_mark(mark, group);
+		fsnotify_put_mark(mark);
+		fsnotify_put_group(group);
+	}
+}
+
+void fsnotify_clear_sb_marks_by_group(struct fsnotify_group *group)
+{
+	fsnotify_clear_marks_by_group_flags(group, FSNOTIFY_MARK_FLAG_SB);
+}
+
+/*
+ * Recalculate the mask of events relevant to a given super block locked.
+ */
+static void fsnotify_recalc_sb_mask_locked(struct super_block *sb)
+{
+	struct fsnotify_mark *mark;
+	__u32 new_mask = 0;
+
+	assert_spin_locked(&sb_mark_lock);
+
+	hlist_for_each_entry(mark, &sb->s_fsnotify_marks, s.s_list)
+		new_mask |= mark->mask;
+	sb->s_fsnotify_mask = new_mask;
+}
+
+/*
+ * Recalculate the sb->s_fsnotify_mask, or the mask of all FS_* event types
+ * any notifier is interested in hearing for this super block
+ */
+void fsnotify_recalc_sb_mask(struct super_block *sb)
+{
+	spin_lock(&sb_mark_lock);
+	fsnotify_recalc_sb_mask_locked(sb);
+	spin_unlock(&sb_mark_lock);
+}
+
+void fsnotify_destroy_sb_mark(struct fsnotify_mark *mark)
+{
+	struct super_block *sb = mark->s.sb;
+
+	BUG_ON(!mutex_is_locked(&mark->group->mark_mutex));
+	assert_spin_locked(&mark->lock);
+
+	spin_lock(&sb_mark_lock);
+
+	hlist_del_init_rcu(&mark->s.s_list);
+	mark->s.sb = NULL;
+
+	fsnotify_recalc_sb_mask_locked(sb);
+
+	spin_unlock(&sb_mark_lock);
+}
+
+static struct fsnotify_mark *fsnotify_find_sb_mark_locked(struct fsnotify_group *group,
+							  struct super_block *sb)
+{
+	struct fsnotify_mark *mark;
+
+	assert_spin_locked(&sb_mark_lock);
+
+	hlist_for_each_entry(mark, &sb->s_fsnotify_marks, s.s_list) {
+		if (mark->group == group) {
+			fsnotify_get_mark(mark);
+			return mark;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * given a group and super block, find the mark associated with that
+ * combination.  if found take a reference to that mark and return it, else
+ * return NULL
+ */
+struct fsnotify_mark *fsnotify_find_sb_mark(struct fsnotify_group *group,
+					    struct super_block *sb)
+{
+	struct fsnotify_mark *mark;
+
+	spin_lock(&sb_mark_lock);
+	mark = fsnotify_find_sb_mark_locked(group, sb);
+	spin_unlock(&sb_mark_lock);
+
+	return mark;
+}
+
+/*
+ * Attach an initialized mark to a given group and super block.
+ * These marks may be used for the fsnotify backend to determine which
+ * event types should be delivered to which groups.
+ */
+int fsnotify_add_sb_mark(struct fsnotify_mark *mark,
+			 struct fsnotify_group *group, struct super_block *sb,
+			 int allow_dups)
+{
+	struct fsnotify_mark *lmark, *last = NULL;
+	int ret = 0;
+	int cmp;
+
+	mark->flags |= FSNOTIFY_MARK_FLAG_SB;
+
+	BUG_ON(!mutex_is_locked(&group->mark_mutex));
+	assert_spin_locked(&mark->lock);
+
+	spin_lock(&sb_mark_lock);
+
+	mark->s.sb = sb;
+
+	/* is mark the first mark? */
+	if (hlist_empty(&sb->s_fsnotify_marks)) {
+		hlist_add_head_rcu(&mark->s.s_list, &sb->s_fsnotify_marks);
+		goto out;
+	}
+
+	/* should mark be in the middle of the current list? */
+	hlist_for_each_entry(lmark, &sb->s_fsnotify_marks, s.s_list) {
+		last = lmark;
+
+		if ((lmark->group == group) && !allow_dups) {
+			ret = -EEXIST;
+			goto out;
+		}
+
+		cmp = fsnotify_compare_groups(lmark->group, mark->group);
+		if (cmp < 0)
+			continue;
+
+		hlist_add_before_rcu(&mark->s.s_list, &lmark->s.s_list);
+		goto out;
+	}
+
+	BUG_ON(last == NULL);
+	/* mark should be the last entry.  last is the current last entry */
+	hlist_add_behind_rcu(&mark->s.s_list, &last->s.s_list);
+out:
+	fsnotify_recalc_sb_mask_locked(sb);
+	spin_unlock(&sb_mark_lock);
+
+	return ret;
+}
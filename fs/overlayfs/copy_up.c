@@ -76,6 +76,7 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 	struct file *new_file;
 	loff_t old_pos = 0;
 	loff_t new_pos = 0;
+	bool offload;
 	int error = 0;
 
 	if (len == 0)
@@ -91,6 +92,13 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 		goto out_fput;
 	}
 
+	/*
+	 * If both layers are on the same filesystem, let it clone or
+	 * offload the copy.  Fall back to splice on the first failure.
+	 */
+	offload = file_inode(old_file)->i_sb == file_inode(new_file)->i_sb &&
+		  new_file->f_op->copy_file_range;
+
 	/* FIXME: copy up sparse files efficiently */
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
@@ -104,9 +112,22 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 
-		bytes = do_splice_direct(old_file, &old_pos,
-					 new_file, &new_pos,
-					 this_len, SPLICE_F_MOVE);
+		bytes = 0;
+		if (offload) {
+			bytes = new_file->f_op->copy_file_range(old_file,
+						old_pos, new_file, new_pos,
+						this_len, 0);
+			if (bytes > 0) {
+				old_pos += bytes;
+				new_pos += bytes;
+			} else {
+				offload = false;
+			}
+		}
+		if (bytes <= 0)
+			bytes = do_splice_direct(old_file, &old_pos,
+						 new_file, &new_pos,
+						 this_len, SPLICE_F_MOVE);
 		if (bytes <= 0) {
 			error = bytes;
 			break;
@@ -197,7 +218,7 @@ int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 			      struct dentry *dentry, struct path *lowerpath,
 			      struct kstat *stat, struct iattr *attr,
-			      const char *link)
+			      const char *link, bool metacopy)
 {
 	struct inode *wdir = workdir->d_inode;
 	struct inode *udir = upperdir->d_inode;
@@ -224,7 +245,7 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out2;
 
-	if (S_ISREG(stat->mode)) {
+	if (S_ISREG(stat->mode) && !metacopy) {
 		struct path upperpath;
 		ovl_path_upper(dentry, &upperpath);
 		BUG_ON(upperpath.dentry != NULL);
@@ -239,8 +260,23 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	if (metacopy) {
+		err = ovl_do_setxattr(newdentry, ovl_metacopy_xattr, "y", 1, 0);
+		if (err)
+			goto out_cleanup;
+	}
+
 	mutex_lock(&newdentry->d_inode->i_mutex);
-	err = ovl_set_attr(newdentry, stat);
+	if (metacopy) {
+		/* Reads see the lower data, but stat must see its size */
+		struct iattr sattr = {
+			.ia_valid = ATTR_SIZE,
+			.ia_size = stat->size,
+		};
+		err = notify_change(newdentry, &sattr, NULL);
+	}
+	if (!err)
+		err = ovl_set_attr(newdentry, stat);
 	if (!err && attr)
 		err = notify_change(newdentry, attr, NULL);
 	mutex_unlock(&newdentry->d_inode->i_mutex);
@@ -251,6 +287,9 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	/* ovl_dentry_update() orders this before the upper becomes visible */
+	if (metacopy)
+		ovl_dentry_set_metacopy(dentry, true);
 	ovl_dentry_update(dentry, newdentry);
 	newdentry = NULL;
 
@@ -271,6 +310,40 @@ out_cleanup:
 	goto out;
 }
 
+/*
+ * Take the credentials needed for copy up, with fsuid and fsgid of the
+ * file being copied up.  Returns the old credentials to revert to.
+ */
+static const struct cred *ovl_override_copy_up_creds(struct kstat *stat,
+						     struct cred **override)
+{
+	struct cred *override_cred;
+
+	override_cred = prepare_creds();
+	if (!override_cred)
+		return NULL;
+
+	override_cred->fsuid = stat->uid;
+	override_cred->fsgid = stat->gid;
+	/*
+	 * CAP_SYS_ADMIN for copying up extended attributes
+	 * CAP_DAC_OVERRIDE for create
+	 * CAP_FOWNER for chmod, timestamp update
+	 * CAP_FSETID for chmod
+	 * CAP_CHOWN for chown
+	 * CAP_MKNOD for mknod
+	 */
+	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
+	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
+	cap_raise(override_cred->cap_effective, CAP_FOWNER);
+	cap_raise(override_cred->cap_effective, CAP_FSETID);
+	cap_raise(override_cred->cap_effective, CAP_CHOWN);
+	cap_raise(override_cred->cap_effective, CAP_MKNOD);
+
+	*override = override_cred;
+	return override_creds(override_cred);
+}
+
 /*
  * Copy up a single dentry
  *
@@ -285,10 +358,14 @@ out_cleanup:
  * up uses upper parent i_mutex for exclusion.  Since rename can change
  * d_parent it is possible that the copy up will lock the old parent.  At
  * that point the file will have already been copied up anyway.
+ *
+ * With @metacopy a regular file is copied up without its data, if the
+ * "metacopy" mount option is on.  The data is copied up later by
+ * ovl_copy_up(), when the file is opened for write.
  */
 int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		    struct path *lowerpath, struct kstat *stat,
-		    struct iattr *attr)
+		    struct iattr *attr, bool metacopy)
 {
 	struct dentry *workdir = ovl_workdir(dentry);
 	int err;
@@ -313,29 +390,16 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			return PTR_ERR(link);
 	}
 
+	/* A size change must be applied to the data */
+	metacopy = metacopy && ovl_metacopy_enabled(dentry) &&
+		   S_ISREG(stat->mode) && stat->size &&
+		   !(attr && (attr->ia_valid & ATTR_SIZE));
+
 	err = -ENOMEM;
-	override_cred = prepare_creds();
-	if (!override_cred)
+	old_cred = ovl_override_copy_up_creds(stat, &override_cred);
+	if (!old_cred)
 		goto out_free_link;
 
-	override_cred->fsuid = stat->uid;
-	override_cred->fsgid = stat->gid;
-	/*
-	 * CAP_SYS_ADMIN for copying up extended attributes
-	 * CAP_DAC_OVERRIDE for create
-	 * CAP_FOWNER for chmod, timestamp update
-	 * CAP_FSETID for chmod
-	 * CAP_CHOWN for chown
-	 * CAP_MKNOD for mknod
-	 */
-	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
-	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
-	cap_raise(override_cred->cap_effective, CAP_FOWNER);
-	cap_raise(override_cred->cap_effective, CAP_FSETID);
-	cap_raise(override_cred->cap_effective, CAP_CHOWN);
-	cap_raise(override_cred->cap_effective, CAP_MKNOD);
-	old_cred = override_creds(override_cred);
-
 	err = -EIO;
 	if (lock_rename(workdir, upperdir) != NULL) {
 		pr_err("overlayfs: failed to lock workdir+upperdir\n");
@@ -355,7 +419,7 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 
 	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
-				 stat, attr, link);
+				 stat, attr, link, metacopy);
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
@@ -373,7 +437,68 @@ out_free_link:
 	return err;
 }
 
-int ovl_copy_up(struct dentry *dentry)
+/*
+ * Copy up the data of a metacopy file into its upper file, then drop the
+ * metacopy xattr so that the upper file is used for reads as well.
+ */
+static int ovl_copy_up_meta_data(struct dentry *dentry)
+{
+	struct dentry *workdir = ovl_workdir(dentry);
+	struct dentry *upperdir = ovl_dentry_upper(dentry->d_parent);
+	struct path lowerpath, upperpath;
+	const struct cred *old_cred;
+	struct cred *override_cred;
+	struct kstat stat;
+	loff_t len;
+	int err;
+
+	ovl_path_upper(dentry, &upperpath);
+	err = vfs_getattr(&upperpath, &stat);
+	if (err)
+		return err;
+
+	err = -ENOMEM;
+	old_cred = ovl_override_copy_up_creds(&stat, &override_cred);
+	if (!old_cred)
+		return err;
+
+	err = -EIO;
+	if (lock_rename(workdir, upperdir) != NULL) {
+		pr_err("overlayfs: failed to lock workdir+upperdir\n");
+		goto out_unlock;
+	}
+
+	/* Raced with another copy-up? */
+	err = 0;
+	if (!ovl_dentry_is_metacopy(dentry))
+		goto out_unlock;
+
+	ovl_path_lower(dentry, &lowerpath);
+	len = min_t(loff_t, i_size_read(lowerpath.dentry->d_inode),
+		    stat.size);
+	err = ovl_copy_up_data(&lowerpath, &upperpath, len);
+	if (err)
+		goto out_unlock;
+
+	err = vfs_removexattr(upperpath.dentry, ovl_metacopy_xattr);
+	if (err)
+		goto out_unlock;
+
+	ovl_dentry_set_metacopy(dentry, false);
+
+	/* Writing the data changed mtime, restore it (best effort) */
+	mutex_lock(&upperpath.dentry->d_inode->i_mutex);
+	ovl_set_timestamps(upperpath.dentry, &stat);
+	mutex_unlock(&upperpath.dentry->d_inode->i_mutex);
+out_unlock:
+	unlock_rename(workdir, upperdir);
+	revert_creds(old_cred);
+	put_cred(override_cred);
+
+	return err;
+}
+
+static int __ovl_copy_up(struct dentry *dentry, bool metacopy)
 {
 	int err;
 
@@ -385,8 +510,11 @@ int ovl_copy_up(struct dentry *dentry)
 		struct kstat stat;
 		enum ovl_path_type type = ovl_path_type(dentry);
 
-		if (type != OVL_PATH_LOWER)
+		if (type != OVL_PATH_LOWER) {
+			if (!metacopy && ovl_dentry_is_metacopy(dentry))
+				err = ovl_copy_up_meta_data(dentry);
 			break;
+		}
 
 		next = dget(dentry);
 		/* find the topmost dentry not yet copied up */
@@ -404,7 +532,8 @@ int ovl_copy_up(struct dentry *dentry)
 		ovl_path_lower(next, &lowerpath);
 		err = vfs_getattr(&lowerpath, &stat);
 		if (!err)
-			err = ovl_copy_up_one(parent, next, &lowerpath, &stat, NULL);
+			err = ovl_copy_up_one(parent, next, &lowerpath, &stat,
+					      NULL, metacopy && next == dentry);
 
 		dput(parent);
 		dput(next);
@@ -412,3 +541,15 @@ int ovl_copy_up(struct dentry *dentry)
 
 	return err;
 }
+
+/* Copy up the dentry and its ancestors, including the data of files */
+int ovl_copy_up(struct dentry *dentry)
+{
+	return __ovl_copy_up(dentry, false);
+}
+
+/* Copy up, but leave the data of a regular file on the lower layer */
+int ovl_copy_up_meta(struct dentry *dentry)
+{
+	return __ovl_copy_up(dentry, true);
+}
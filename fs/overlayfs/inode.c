@@ -13,7 +13,7 @@
 #include "overlayfs.h"
 
 static int ovl_copy_up_last(struct dentry *dentry, struct iattr *attr,
-			    bool no_data)
+			    bool no_data, bool metacopy)
 {
 	int err;
 	struct dentry *parent;
@@ -33,7 +33,8 @@ static int ovl_copy_up_last(struct dentry *dentry, struct iattr *attr,
 	if (no_data)
 		stat.size = 0;
 
-	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat, attr);
+	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat, attr,
+			      metacopy);
 
 out_dput_parent:
 	dput(parent);
@@ -49,14 +50,23 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
+	/* Truncating a metacopy file needs its data first */
+	if ((attr->ia_valid & ATTR_SIZE) && ovl_dentry_is_metacopy(dentry)) {
+		err = ovl_copy_up(dentry);
+		if (err)
+			goto out_drop_write;
+	}
+
 	upperdentry = ovl_dentry_upper(dentry);
 	if (upperdentry) {
 		mutex_lock(&upperdentry->d_inode->i_mutex);
 		err = notify_change(upperdentry, attr, NULL);
 		mutex_unlock(&upperdentry->d_inode->i_mutex);
 	} else {
-		err = ovl_copy_up_last(dentry, attr, false);
+		/* Attribute changes don't need the data on the upper layer */
+		err = ovl_copy_up_last(dentry, attr, false, true);
 	}
+out_drop_write:
 	ovl_drop_write(dentry);
 out:
 	return err;
@@ -66,9 +76,21 @@ static int ovl_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
 	struct path realpath;
+	struct kstat lowerstat;
+	int err;
 
 	ovl_path_real(dentry, &realpath);
-	return vfs_getattr(&realpath, stat);
+	err = vfs_getattr(&realpath, stat);
+	if (err || !ovl_dentry_is_metacopy(dentry))
+		return err;
+
+	/* The blocks of a metacopy file are still allocated on lower */
+	ovl_path_lower(dentry, &realpath);
+	err = vfs_getattr(&realpath, &lowerstat);
+	if (!err)
+		stat->blocks = lowerstat.blocks;
+
+	return err;
 }
 
 int ovl_permission(struct inode *inode, int mask)
@@ -222,7 +244,7 @@ int ovl_setxattr(struct dentry *dentry, const char *name,
 	if (ovl_is_private_xattr(name))
 		goto out_drop_write;
 
-	err = ovl_copy_up(dentry);
+	err = ovl_copy_up_meta(dentry);
 	if (err)
 		goto out_drop_write;
 
@@ -238,7 +260,8 @@ out:
 static bool ovl_need_xattr_filter(struct dentry *dentry,
 				  enum ovl_path_type type)
 {
-	return type == OVL_PATH_UPPER && S_ISDIR(dentry->d_inode->i_mode);
+	return type == OVL_PATH_UPPER && (S_ISDIR(dentry->d_inode->i_mode) ||
+					  S_ISREG(dentry->d_inode->i_mode));
 }
 
 ssize_t ovl_getxattr(struct dentry *dentry, const char *name,
@@ -304,7 +327,7 @@ int ovl_removexattr(struct dentry *dentry, const char *name)
 		if (err < 0)
 			goto out_drop_write;
 
-		err = ovl_copy_up(dentry);
+		err = ovl_copy_up_meta(dentry);
 		if (err)
 			goto out_drop_write;
 
@@ -318,10 +341,11 @@ out:
 	return err;
 }
 
-static bool ovl_open_need_copy_up(int flags, enum ovl_path_type type,
+static bool ovl_open_need_copy_up(struct dentry *dentry, int flags,
+				  enum ovl_path_type type,
 				  struct dentry *realdentry)
 {
-	if (type != OVL_PATH_LOWER)
+	if (type != OVL_PATH_LOWER && !ovl_dentry_is_metacopy(dentry))
 		return false;
 
 	if (special_file(realdentry->d_inode->i_mode))
@@ -342,20 +366,24 @@ static int ovl_dentry_open(struct dentry *dentry, struct file *file,
 	bool want_write = false;
 
 	type = ovl_path_real(dentry, &realpath);
-	if (ovl_open_need_copy_up(file->f_flags, type, realpath.dentry)) {
+	if (ovl_open_need_copy_up(dentry, file->f_flags, type,
+				  realpath.dentry)) {
 		want_write = true;
 		err = ovl_want_write(dentry);
 		if (err)
 			goto out;
 
-		if (file->f_flags & O_TRUNC)
-			err = ovl_copy_up_last(dentry, NULL, true);
+		if ((file->f_flags & O_TRUNC) && type == OVL_PATH_LOWER)
+			err = ovl_copy_up_last(dentry, NULL, true, false);
 		else
 			err = ovl_copy_up(dentry);
 		if (err)
 			goto out_drop_write;
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (ovl_dentry_is_metacopy(dentry)) {
+		/* Read-only open of a metacopy file, data is on lower */
+		ovl_path_lower(dentry, &realpath);
 	}
 
 	err = vfs_open(&realpath, file, cred);
@@ -30,6 +30,7 @@ struct ovl_config {
 	char *lowerdir;
 	char *upperdir;
 	char *workdir;
+	bool metacopy;
 };
 
 /* private information held for overlayfs's superblock */
@@ -53,12 +54,14 @@ struct ovl_entry {
 		struct {
 			u64 version;
 			bool opaque;
+			bool metacopy;
 		};
 		struct rcu_head rcu;
 	};
 };
 
 const char *ovl_opaque_xattr = "trusted.overlay.opaque";
+const char *ovl_metacopy_xattr = "trusted.overlay.metacopy";
 
 
 enum ovl_path_type ovl_path_type(struct dentry *dentry)
@@ -202,6 +205,31 @@ void ovl_dentry_set_opaque(struct dentry *dentry, bool opaque)
 	oe->opaque = opaque;
 }
 
+bool ovl_metacopy_enabled(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	return ofs->config.metacopy;
+}
+
+/*
+ * A metacopy entry has all of its metadata on the upper layer, but the
+ * data is still read from the lower file.
+ */
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	/* Pairs with smp_wmb() in ovl_dentry_update() */
+	smp_rmb();
+	return ACCESS_ONCE(oe->metacopy);
+}
+
+void ovl_dentry_set_metacopy(struct dentry *dentry, bool metacopy)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+	ACCESS_ONCE(oe->metacopy) = metacopy;
+}
+
 void ovl_dentry_update(struct dentry *dentry, struct dentry *upperdentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -256,6 +284,22 @@ static bool ovl_is_opaquedir(struct dentry *dentry)
 	return false;
 }
 
+static bool ovl_is_metacopy(struct dentry *dentry)
+{
+	int res;
+	char val;
+	struct inode *inode = dentry->d_inode;
+
+	if (!S_ISREG(inode->i_mode) || !inode->i_op->getxattr)
+		return false;
+
+	res = inode->i_op->getxattr(dentry, ovl_metacopy_xattr, &val, 1);
+	if (res == 1 && val == 'y')
+		return true;
+
+	return false;
+}
+
 static void ovl_dentry_release(struct dentry *dentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -327,6 +371,8 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 				oe->opaque = true;
 			} else if (ovl_is_opaquedir(upperdentry)) {
 				oe->opaque = true;
+			} else if (ovl_is_metacopy(upperdentry)) {
+				oe->metacopy = true;
 			}
 		}
 	}
@@ -337,9 +383,17 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 			goto out_dput_upper;
 	}
 
-	if (lowerdentry && upperdentry &&
-	    (!S_ISDIR(upperdentry->d_inode->i_mode) ||
-	     !S_ISDIR(lowerdentry->d_inode->i_mode))) {
+	if (oe->metacopy) {
+		/* The data of a metacopy file lives on the lower file */
+		err = -EIO;
+		if (!lowerdentry || !S_ISREG(lowerdentry->d_inode->i_mode)) {
+			pr_warn_ratelimited("overlayfs: no data for %pd2\n",
+					    dentry);
+			goto out_dput;
+		}
+	} else if (lowerdentry && upperdentry &&
+		   (!S_ISDIR(upperdentry->d_inode->i_mode) ||
+		    !S_ISDIR(lowerdentry->d_inode->i_mode))) {
 		dput(lowerdentry);
 		lowerdentry = NULL;
 		oe->opaque = true;
@@ -434,6 +488,8 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	seq_printf(m, ",lowerdir=%s", ufs->config.lowerdir);
 	seq_printf(m, ",upperdir=%s", ufs->config.upperdir);
 	seq_printf(m, ",workdir=%s", ufs->config.workdir);
+	if (ufs->config.metacopy)
+		seq_puts(m, ",metacopy=on");
 	return 0;
 }
 
@@ -447,6 +503,8 @@ enum {
 	OPT_LOWERDIR,
 	OPT_UPPERDIR,
 	OPT_WORKDIR,
+	OPT_METACOPY_ON,
+	OPT_METACOPY_OFF,
 	OPT_ERR,
 };
 
@@ -454,6 +512,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_LOWERDIR,			"lowerdir=%s"},
 	{OPT_UPPERDIR,			"upperdir=%s"},
 	{OPT_WORKDIR,			"workdir=%s"},
+	{OPT_METACOPY_ON,		"metacopy=on"},
+	{OPT_METACOPY_OFF,		"metacopy=off"},
 	{OPT_ERR,			NULL}
 };
 
@@ -514,6 +574,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 				return -ENOMEM;
 			break;
 
+		case OPT_METACOPY_ON:
+			config->metacopy = true;
+			break;
+
+		case OPT_METACOPY_OFF:
+			config->metacopy = false;
+			break;
+
 		default:
 			return -EINVAL;
 		}
@@ -77,7 +77,11 @@ static u64 get_iowait_time(int cpu)
 
 #endif
 
-static int show_stat(struct seq_file *p, void *v)
+/*
+ * With @per_irq false the "intr" line only carries the total, which keeps
+ * the cost of a read independent of the number of interrupts.
+ */
+static int __show_stat(struct seq_file *p, bool per_irq)
 {
 	int i, j;
 	unsigned long jif;
@@ -158,8 +162,9 @@ static int show_stat(struct seq_file *p, void *v)
 	seq_printf(p, "intr %llu", (unsigned long long)sum);
 
 	/* sum again ? it could be updated? */
-	for_each_irq_nr(j)
-		seq_put_decimal_ull(p, ' ', kstat_irqs(j));
+	if (per_irq)
+		for_each_irq_nr(j)
+			seq_put_decimal_ull(p, ' ', kstat_irqs(j));
 
 	seq_printf(p,
 		"\nctxt %llu\n"
@@ -182,6 +187,16 @@ static int show_stat(struct seq_file *p, void *v)
 	return 0;
 }
 
+static int show_stat(struct seq_file *p, void *v)
+{
+	return __show_stat(p, true);
+}
+
+static int show_stat_nointr(struct seq_file *p, void *v)
+{
+	return __show_stat(p, false);
+}
+
 static int stat_open(struct inode *inode, struct file *file)
 {
 	size_t size = 1024 + 128 * num_online_cpus();
@@ -191,6 +206,13 @@ static int stat_open(struct inode *inode, struct file *file)
 	return single_open_size(file, show_stat, NULL, size);
 }
 
+static int stat_nointr_open(struct inode *inode, struct file *file)
+{
+	size_t size = 1024 + 128 * num_online_cpus();
+
+	return single_open_size(file, show_stat_nointr, NULL, size);
+}
+
 static const struct file_operations proc_stat_operations = {
 	.open		= stat_open,
 	.read		= seq_read,
@@ -198,9 +220,17 @@ static const struct file_operations proc_stat_operations = {
 	.release	= single_release,
 };
 
+static const struct file_operations proc_stat_nointr_operations = {
+	.open		= stat_nointr_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init proc_stat_init(void)
 {
 	proc_create("stat", 0, NULL, &proc_stat_operations);
+	proc_create("stat_nointr", 0, NULL, &proc_stat_nointr_operations);
 	return 0;
 }
 fs_initcall(proc_stat_init);
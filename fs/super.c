@@ -78,7 +78,8 @@ static unsigned long super_cache_scan(struct shrinker *shrink,
 		fs_objects = sb->s_op->nr_cached_objects(sb, sc->nid);
 
 	inodes = list_lru_count_node(&sb->s_inode_lru, sc->nid);
-	dentries = list_lru_count_node(&sb->s_dentry_lru, sc->nid);
+	dentries = list_lru_count_node(&sb->s_dentry_lru, sc->nid) +
+		   list_lru_count_node(&sb->s_dentry_neg_lru, sc->nid);
 	total_objects = dentries + inodes + fs_objects + 1;
 	if (!total_objects)
 		total_objects = 1;
@@ -127,6 +128,8 @@ static unsigned long super_cache_count(struct shrinker *shrink,
 
 	total_objects += list_lru_count_node(&sb->s_dentry_lru,
 						 sc->nid);
+	total_objects += list_lru_count_node(&sb->s_dentry_neg_lru,
+						 sc->nid);
 	total_objects += list_lru_count_node(&sb->s_inode_lru,
 						 sc->nid);
 
@@ -144,6 +147,7 @@ static void destroy_super(struct super_block *s)
 {
 	int i;
 	list_lru_destroy(&s->s_dentry_lru);
+	list_lru_destroy(&s->s_dentry_neg_lru);
 	list_lru_destroy(&s->s_inode_lru);
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_counter_destroy(&s->s_writers.counter[i]);
@@ -193,6 +197,8 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 
 	if (list_lru_init(&s->s_dentry_lru))
 		goto fail;
+	if (list_lru_init(&s->s_dentry_neg_lru))
+		goto fail;
 	if (list_lru_init(&s->s_inode_lru))
 		goto fail;
 
@@ -395,6 +401,7 @@ void generic_shutdown_super(struct super_block *sb)
 		sb->s_flags &= ~MS_ACTIVE;
 
 		fsnotify_unmount_inodes(&sb->s_inodes);
+		fsnotify_sb_delete(sb);
 
 		evict_inodes(sb);
 
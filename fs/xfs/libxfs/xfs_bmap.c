@@ -594,10 +594,11 @@ xfs_bmap_validate_ret(
  * Add the extent to the list of extents to be free at transaction end.
  * The list is maintained sorted (by block number).
  */
-void
-xfs_bmap_add_free(
+STATIC void
+__xfs_bmap_add_free(
 	xfs_fsblock_t		bno,		/* fs block number of extent */
 	xfs_filblks_t		len,		/* length of extent */
+	bool			shared,		/* extent may be shared */
 	xfs_bmap_free_t		*flist,		/* list of extents */
 	xfs_mount_t		*mp)		/* mount point structure */
 {
@@ -623,6 +624,7 @@ xfs_bmap_add_free(
 	new = kmem_zone_alloc(xfs_bmap_free_item_zone, KM_SLEEP);
 	new->xbfi_startblock = bno;
 	new->xbfi_blockcount = (xfs_extlen_t)len;
+	new->xbfi_shared = shared;
 	for (prev = NULL, cur = flist->xbf_first;
 	     cur != NULL;
 	     prev = cur, cur = cur->xbfi_next) {
@@ -637,6 +639,31 @@ xfs_bmap_add_free(
 	flist->xbf_count++;
 }
 
+void
+xfs_bmap_add_free(
+	xfs_fsblock_t		bno,
+	xfs_filblks_t		len,
+	xfs_bmap_free_t		*flist,
+	xfs_mount_t		*mp)
+{
+	__xfs_bmap_add_free(bno, len, false, flist, mp);
+}
+
+/*
+ * Add an extent of a reflinked file.  Other files may own its blocks too,
+ * so it drops a reference to them, and only the blocks left without owners
+ * are freed.
+ */
+void
+xfs_bmap_add_free_shared(
+	xfs_fsblock_t		bno,
+	xfs_filblks_t		len,
+	xfs_bmap_free_t		*flist,
+	xfs_mount_t		*mp)
+{
+	__xfs_bmap_add_free(bno, len, true, flist, mp);
+}
+
 /*
  * Remove the entry "free" from the free item list.  Prev points to the
  * previous entry, unless "free" is the head of the list.
@@ -4700,6 +4727,114 @@ error0:
 	return error;
 }
 
+/*
+ * Map an extent of blocks that are already allocated, such as blocks shared
+ * with another file, into a hole in the data fork.  The blocks are accounted
+ * to the inode and its quota as if they had just been allocated.
+ */
+int
+xfs_bmapi_remap(
+	struct xfs_trans	*tp,		/* transaction pointer */
+	struct xfs_inode	*ip,		/* incore inode */
+	xfs_fileoff_t		bno,		/* starting file offs. mapped */
+	xfs_filblks_t		len,		/* length to map in file */
+	xfs_fsblock_t		startblock,	/* first block to map */
+	xfs_exntst_t		state,		/* extent state */
+	xfs_fsblock_t		*firstblock,	/* first allocated block
+						   controls a.g. for allocs */
+	struct xfs_bmap_free	*flist)		/* i/o: list extents to free */
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_ifork	*ifp = XFS_IFORK_PTR(ip, XFS_DATA_FORK);
+	struct xfs_bmalloca	bma = { NULL };
+	int			eof;
+	int			error;
+
+	ASSERT(len > 0);
+	ASSERT(len <= (xfs_filblks_t)MAXEXTLEN);
+	ASSERT(xfs_isilocked(ip, XFS_ILOCK_EXCL));
+	ASSERT(!XFS_IS_REALTIME_INODE(ip));
+
+	if (unlikely(XFS_TEST_ERROR(
+	    (XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_EXTENTS &&
+	     XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_BTREE),
+	     mp, XFS_ERRTAG_BMAPIFORMAT, XFS_RANDOM_BMAPIFORMAT))) {
+		XFS_ERROR_REPORT("xfs_bmapi_remap", XFS_ERRLEVEL_LOW, mp);
+		return -EFSCORRUPTED;
+	}
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return -EIO;
+
+	if (!(ifp->if_flags & XFS_IFEXTENTS)) {
+		error = xfs_iread_extents(tp, ip, XFS_DATA_FORK);
+		if (error)
+			return error;
+	}
+
+	xfs_bmap_search_extents(ip, bno, XFS_DATA_FORK, &eof, &bma.idx,
+				&bma.got, &bma.prev);
+	/* The range has to be a hole, the caller unmapped it */
+	if (!eof && bma.got.br_startoff < bno + len) {
+		ASSERT(0);
+		return -EFSCORRUPTED;
+	}
+
+	bma.tp = tp;
+	bma.ip = ip;
+	bma.flist = flist;
+	bma.firstblock = firstblock;
+	if (ifp->if_flags & XFS_IFBROOT) {
+		bma.cur = xfs_bmbt_init_cursor(mp, tp, ip, XFS_DATA_FORK);
+		bma.cur->bc_private.b.firstblock = *firstblock;
+		bma.cur->bc_private.b.flist = flist;
+	}
+
+	bma.got.br_startoff = bno;
+	bma.got.br_startblock = startblock;
+	bma.got.br_blockcount = len;
+	bma.got.br_state = state;
+
+	error = xfs_bmap_add_extent_hole_real(&bma, XFS_DATA_FORK);
+	if (error)
+		goto error0;
+
+	/*
+	 * Transform from btree to extents, give it cur.
+	 */
+	if (xfs_bmap_wants_extents(ip, XFS_DATA_FORK)) {
+		int		tmp_logflags = 0;
+
+		ASSERT(bma.cur);
+		error = xfs_bmap_btree_to_extents(tp, ip, bma.cur,
+			&tmp_logflags, XFS_DATA_FORK);
+		bma.logflags |= tmp_logflags;
+		if (error)
+			goto error0;
+	}
+
+	ip->i_d.di_nblocks += len;
+	xfs_trans_mod_dquot_byino(tp, ip, XFS_TRANS_DQ_BCOUNT, (long)len);
+
+error0:
+	if ((bma.logflags & xfs_ilog_fext(XFS_DATA_FORK)) &&
+	    XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_EXTENTS)
+		bma.logflags &= ~xfs_ilog_fext(XFS_DATA_FORK);
+	else if ((bma.logflags & xfs_ilog_fbroot(XFS_DATA_FORK)) &&
+		 XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_BTREE)
+		bma.logflags &= ~xfs_ilog_fbroot(XFS_DATA_FORK);
+	/* di_nblocks changed too */
+	xfs_trans_log_inode(tp, ip, bma.logflags | XFS_ILOG_CORE);
+
+	if (bma.cur) {
+		if (!error)
+			*firstblock = bma.cur->bc_private.b.firstblock;
+		xfs_btree_del_cursor(bma.cur,
+			error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	}
+	return error;
+}
+
 /*
  * Called by xfs_bmapi to update file extent records and the btree
  * after removing space (or undoing a delayed allocation).
@@ -4994,7 +5129,10 @@ xfs_bmap_del_extent(
 	/*
 	 * If we need to, add to list of extents to delete.
 	 */
-	if (do_fx)
+	if (do_fx && whichfork == XFS_DATA_FORK && xfs_is_reflink_inode(ip))
+		xfs_bmap_add_free_shared(del->br_startblock,
+				del->br_blockcount, flist, mp);
+	else if (do_fx)
 		xfs_bmap_add_free(del->br_startblock, del->br_blockcount, flist,
 			mp);
 	/*
@@ -240,4 +240,12 @@ static inline void xfs_dinode_put_rdev(struct xfs_dinode *dip, xfs_dev_t rdev)
 	 XFS_DIFLAG_PROJINHERIT | XFS_DIFLAG_NOSYMLINKS | XFS_DIFLAG_EXTSIZE | \
 	 XFS_DIFLAG_EXTSZINHERIT | XFS_DIFLAG_NODEFRAG | XFS_DIFLAG_FILESTREAM)
 
+/*
+ * Values for di_flags2
+ */
+#define XFS_DIFLAG2_REFLINK_BIT	0	/* file's blocks may be shared */
+#define XFS_DIFLAG2_REFLINK	(1 << XFS_DIFLAG2_REFLINK_BIT)
+
+#define XFS_DIFLAG2_ANY		(XFS_DIFLAG2_REFLINK)
+
 #endif	/* __XFS_DINODE_H__ */
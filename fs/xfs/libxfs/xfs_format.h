@@ -246,10 +246,57 @@ typedef __be32 xfs_inobt_ptr_t;
 
 /*
  * The first data block of an AG depends on whether the filesystem was formatted
- * with the finobt feature. If so, account for the finobt reserved root btree
- * block.
+ * with the finobt and reflink features. If so, account for the finobt and
+ * refcount btree reserved root blocks.
  */
 #define XFS_PREALLOC_BLOCKS(mp) \
+	(xfs_sb_version_hasreflink(&((mp)->m_sb)) ? \
+	 XFS_REFC_BLOCK(mp) + 1 : \
+	 (xfs_sb_version_hasfinobt(&((mp)->m_sb)) ? \
+	  XFS_FIBT_BLOCK(mp) + 1 : \
+	  XFS_IBT_BLOCK(mp) + 1))
+
+
+/*
+ * Reference Count Btree format definitions
+ *
+ * There is a btree per allocation group counting the owners of the data
+ * blocks shared by reflinked files.  Only blocks with two or more owners
+ * have a record; a data block that is not in the tree has one owner.
+ */
+#define	XFS_REFC_CRC_MAGIC	0x52334643	/* 'R3FC' */
+
+/*
+ * Data record structure
+ */
+struct xfs_refcount_rec {
+	__be32		rc_startblock;	/* starting block number */
+	__be32		rc_blockcount;	/* count of blocks */
+	__be32		rc_refcount;	/* number of owners of the blocks */
+};
+
+struct xfs_refcount_irec {
+	xfs_agblock_t	rc_startblock;	/* starting block number */
+	xfs_extlen_t	rc_blockcount;	/* count of blocks */
+	xfs_nlink_t	rc_refcount;	/* number of owners of the blocks */
+};
+
+/*
+ * Key structure
+ */
+struct xfs_refcount_key {
+	__be32		rc_startblock;	/* starting block number */
+};
+
+#define	MAXREFCOUNT	((xfs_nlink_t)~0U)
+
+/* btree pointer type */
+typedef __be32 xfs_refcount_ptr_t;
+
+/*
+ * The refcount btree root block follows the inode btree root blocks.
+ */
+#define	XFS_REFC_BLOCK(mp) \
 	(xfs_sb_version_hasfinobt(&((mp)->m_sb)) ? \
 	 XFS_FIBT_BLOCK(mp) + 1 : \
 	 XFS_IBT_BLOCK(mp) + 1)
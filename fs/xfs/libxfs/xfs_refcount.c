@@ -0,0 +1,469 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "xfs.h"
+#include "xfs_fs.h"
+#include "xfs_shared.h"
+#include "xfs_format.h"
+#include "xfs_log_format.h"
+#include "xfs_trans_resv.h"
+#include "xfs_bit.h"
+#include "xfs_sb.h"
+#include "xfs_ag.h"
+#include "xfs_mount.h"
+#include "xfs_btree.h"
+#include "xfs_refcount_btree.h"
+#include "xfs_refcount.h"
+#include "xfs_alloc.h"
+#include "xfs_error.h"
+#include "xfs_trace.h"
+#include "xfs_trans.h"
+
+/*
+ * Reference counts of shared data blocks.
+ *
+ * The refcount btree of an AG only has records for the blocks owned by more
+ * than one file.  A data block without a record has a single owner, and a
+ * free block has none.  The records never overlap, but two adjacent records
+ * may have the same count.  Taking a reference to a range first splits the
+ * records straddling its ends, then walks the range: holes become records
+ * with a count of two, and the counts of the records covering the range go
+ * up by one.  Dropping a reference does the opposite, and frees the blocks
+ * of the holes.  Records made equal to their neighbours at the ends of the
+ * range are merged with them again.
+ */
+
+STATIC int
+xfs_refcount_lookup(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno,
+	xfs_lookup_t		dir,
+	int			*stat)
+{
+	cur->bc_rec.rc.rc_startblock = bno;
+	cur->bc_rec.rc.rc_blockcount = 0;
+	cur->bc_rec.rc.rc_refcount = 0;
+	return xfs_btree_lookup(cur, dir, stat);
+}
+
+int
+xfs_refcount_lookup_le(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno,
+	int			*stat)
+{
+	return xfs_refcount_lookup(cur, bno, XFS_LOOKUP_LE, stat);
+}
+
+int
+xfs_refcount_lookup_ge(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno,
+	int			*stat)
+{
+	return xfs_refcount_lookup(cur, bno, XFS_LOOKUP_GE, stat);
+}
+
+int
+xfs_refcount_get_rec(
+	struct xfs_btree_cur		*cur,
+	struct xfs_refcount_irec	*irec,
+	int				*stat)
+{
+	union xfs_btree_rec	*rec;
+	int			error;
+
+	error = xfs_btree_get_rec(cur, &rec, stat);
+	if (!error && *stat == 1) {
+		irec->rc_startblock = be32_to_cpu(rec->refc.rc_startblock);
+		irec->rc_blockcount = be32_to_cpu(rec->refc.rc_blockcount);
+		irec->rc_refcount = be32_to_cpu(rec->refc.rc_refcount);
+	}
+	return error;
+}
+
+/*
+ * Update the record referred to by cur to the value given.
+ * This either works (return 0) or gets an EFSCORRUPTED error.
+ */
+STATIC int
+xfs_refcount_update(
+	struct xfs_btree_cur		*cur,
+	struct xfs_refcount_irec	*irec)
+{
+	union xfs_btree_rec	rec;
+
+	rec.refc.rc_startblock = cpu_to_be32(irec->rc_startblock);
+	rec.refc.rc_blockcount = cpu_to_be32(irec->rc_blockcount);
+	rec.refc.rc_refcount = cpu_to_be32(irec->rc_refcount);
+	return xfs_btree_update(cur, &rec);
+}
+
+/*
+ * Insert a record, which must not overlap any in the btree.
+ */
+STATIC int
+xfs_refcount_insert(
+	struct xfs_btree_cur		*cur,
+	struct xfs_refcount_irec	*irec)
+{
+	int			i;
+	int			error;
+
+	error = xfs_refcount_lookup(cur, irec->rc_startblock, XFS_LOOKUP_EQ,
+				    &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 0);
+
+	cur->bc_rec.rc = *irec;
+	error = xfs_btree_insert(cur, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+	return 0;
+}
+
+/*
+ * Delete the record referred to by cur.
+ */
+STATIC int
+xfs_refcount_delete(
+	struct xfs_btree_cur	*cur)
+{
+	int			i;
+	int			error;
+
+	error = xfs_btree_delete(cur, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+	return 0;
+}
+
+/*
+ * Split the record containing agbno, if any, into two records meeting at
+ * agbno.
+ */
+STATIC int
+xfs_refcount_split_at(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		agbno)
+{
+	struct xfs_refcount_irec rcext;
+	struct xfs_refcount_irec tmp;
+	int			found_rec;
+	int			error;
+
+	error = xfs_refcount_lookup_le(cur, agbno, &found_rec);
+	if (error || !found_rec)
+		return error;
+	error = xfs_refcount_get_rec(cur, &rcext, &found_rec);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(found_rec == 1);
+
+	if (rcext.rc_startblock == agbno ||
+	    rcext.rc_startblock + rcext.rc_blockcount <= agbno)
+		return 0;
+
+	/* Cut the record short at agbno and insert the rest after it */
+	tmp = rcext;
+	tmp.rc_blockcount = agbno - rcext.rc_startblock;
+	error = xfs_refcount_update(cur, &tmp);
+	if (error)
+		return error;
+
+	tmp.rc_startblock = agbno;
+	tmp.rc_blockcount = rcext.rc_startblock + rcext.rc_blockcount - agbno;
+	return xfs_refcount_insert(cur, &tmp);
+}
+
+/*
+ * Merge the record ending at agbno with the one starting there, if they
+ * have the same count.
+ */
+STATIC int
+xfs_refcount_merge_at(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		agbno)
+{
+	struct xfs_refcount_irec left;
+	struct xfs_refcount_irec right;
+	int			found_rec;
+	int			error;
+
+	if (agbno == 0)
+		return 0;
+
+	error = xfs_refcount_lookup_le(cur, agbno - 1, &found_rec);
+	if (error || !found_rec)
+		return error;
+	error = xfs_refcount_get_rec(cur, &left, &found_rec);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(found_rec == 1);
+	if (left.rc_startblock + left.rc_blockcount != agbno)
+		return 0;
+
+	error = xfs_btree_increment(cur, 0, &found_rec);
+	if (error || !found_rec)
+		return error;
+	error = xfs_refcount_get_rec(cur, &right, &found_rec);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(found_rec == 1);
+	if (right.rc_startblock != agbno ||
+	    right.rc_refcount != left.rc_refcount)
+		return 0;
+
+	error = xfs_refcount_delete(cur);
+	if (error)
+		return error;
+
+	error = xfs_refcount_lookup_le(cur, left.rc_startblock, &found_rec);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(found_rec == 1);
+	left.rc_blockcount += right.rc_blockcount;
+	return xfs_refcount_update(cur, &left);
+}
+
+/*
+ * Adjust the counts of the blocks from *agbno up to end, whose ends are
+ * record boundaries.  At most XFS_REFCOUNT_MAX_OPS records or holes are
+ * changed; *agbno is moved to where the adjustment stopped.
+ */
+STATIC int
+xfs_refcount_adjust_range(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		*agbno,
+	xfs_agblock_t		end,
+	int			adj)
+{
+	struct xfs_mount	*mp = cur->bc_mp;
+	struct xfs_refcount_irec ext;
+	struct xfs_refcount_irec tmp;
+	int			nr_ops = 0;
+	int			found_rec;
+	int			error;
+
+	while (*agbno < end && nr_ops < XFS_REFCOUNT_MAX_OPS) {
+		error = xfs_refcount_lookup_ge(cur, *agbno, &found_rec);
+		if (error)
+			return error;
+		if (found_rec) {
+			error = xfs_refcount_get_rec(cur, &ext, &found_rec);
+			if (error)
+				return error;
+			XFS_WANT_CORRUPTED_RETURN(found_rec == 1);
+		}
+		if (!found_rec || ext.rc_startblock > end)
+			ext.rc_startblock = end;
+
+		nr_ops++;
+		if (ext.rc_startblock > *agbno) {
+			/* The blocks up to the next record have one owner */
+			tmp.rc_startblock = *agbno;
+			tmp.rc_blockcount = ext.rc_startblock - *agbno;
+			tmp.rc_refcount = 2;
+			if (adj > 0)
+				error = xfs_refcount_insert(cur, &tmp);
+			else
+				error = xfs_free_extent(cur->bc_tp,
+						XFS_AGB_TO_FSB(mp,
+							cur->bc_private.a.agno,
+							tmp.rc_startblock),
+						tmp.rc_blockcount);
+			if (error)
+				return error;
+			*agbno += tmp.rc_blockcount;
+			continue;
+		}
+
+		XFS_WANT_CORRUPTED_RETURN(ext.rc_startblock == *agbno &&
+				ext.rc_startblock + ext.rc_blockcount <= end);
+
+		/* A saturated count is never changed again */
+		if (ext.rc_refcount != MAXREFCOUNT) {
+			ext.rc_refcount += adj;
+			if (ext.rc_refcount > 1)
+				error = xfs_refcount_update(cur, &ext);
+			else
+				error = xfs_refcount_delete(cur);
+			if (error)
+				return error;
+		}
+		*agbno += ext.rc_blockcount;
+	}
+	return 0;
+}
+
+STATIC int
+xfs_refcount_adjust(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		fsbno,
+	xfs_extlen_t		len,
+	int			adj,
+	xfs_extlen_t		*done)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, fsbno);
+	xfs_agblock_t		agbno = XFS_FSB_TO_AGBNO(mp, fsbno);
+	xfs_agblock_t		bno = agbno;
+	int			error;
+
+	ASSERT(len > 0);
+	ASSERT(agbno + len <= mp->m_sb.sb_agblocks);
+
+	error = xfs_alloc_read_agf(mp, tp, agno, 0, &agbp);
+	if (error)
+		return error;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+
+	error = xfs_refcount_split_at(cur, agbno);
+	if (error)
+		goto out_error;
+	error = xfs_refcount_split_at(cur, agbno + len);
+	if (error)
+		goto out_error;
+
+	error = xfs_refcount_adjust_range(cur, &bno, agbno + len, adj);
+	if (error)
+		goto out_error;
+
+	error = xfs_refcount_merge_at(cur, agbno);
+	if (error)
+		goto out_error;
+	error = xfs_refcount_merge_at(cur, bno);
+	if (error)
+		goto out_error;
+
+	xfs_btree_del_cursor(cur, XFS_BTREE_NOERROR);
+	*done = bno - agbno;
+	return 0;
+
+out_error:
+	xfs_btree_del_cursor(cur, XFS_BTREE_ERROR);
+	return error;
+}
+
+int
+xfs_refcount_increase_extent(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		fsbno,
+	xfs_extlen_t		len,
+	xfs_extlen_t		*done)
+{
+	return xfs_refcount_adjust(tp, fsbno, len, 1, done);
+}
+
+int
+xfs_refcount_decrease_extent(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		fsbno,
+	xfs_extlen_t		len,
+	xfs_extlen_t		*done)
+{
+	return xfs_refcount_adjust(tp, fsbno, len, -1, done);
+}
+
+int
+xfs_refcount_find_shared(
+	struct xfs_mount	*mp,
+	xfs_agnumber_t		agno,
+	xfs_agblock_t		agbno,
+	xfs_extlen_t		aglen,
+	xfs_agblock_t		*fbno,
+	xfs_extlen_t		*flen)
+{
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	struct xfs_refcount_irec tmp;
+	xfs_agblock_t		end = agbno + aglen;
+	xfs_agblock_t		fend;
+	int			found_rec;
+	int			error;
+
+	*fbno = NULLAGBLOCK;
+	*flen = 0;
+
+	error = xfs_alloc_read_agf(mp, NULL, agno, 0, &agbp);
+	if (error)
+		return error;
+
+	cur = xfs_refcountbt_init_cursor(mp, NULL, agbp, agno);
+
+	/* Find the first record ending after agbno */
+	error = xfs_refcount_lookup_le(cur, agbno, &found_rec);
+	if (error)
+		goto out_error;
+	if (!found_rec) {
+		error = xfs_refcount_lookup_ge(cur, agbno, &found_rec);
+		if (error)
+			goto out_error;
+	}
+	if (!found_rec)
+		goto out;
+	error = xfs_refcount_get_rec(cur, &tmp, &found_rec);
+	if (error)
+		goto out_error;
+	XFS_WANT_CORRUPTED_GOTO(found_rec == 1, out_error);
+	if (tmp.rc_startblock + tmp.rc_blockcount <= agbno) {
+		error = xfs_btree_increment(cur, 0, &found_rec);
+		if (error)
+			goto out_error;
+		if (!found_rec)
+			goto out;
+		error = xfs_refcount_get_rec(cur, &tmp, &found_rec);
+		if (error)
+			goto out_error;
+		XFS_WANT_CORRUPTED_GOTO(found_rec == 1, out_error);
+	}
+	if (tmp.rc_startblock >= end)
+		goto out;
+
+	*fbno = max(tmp.rc_startblock, agbno);
+	fend = tmp.rc_startblock + tmp.rc_blockcount;
+
+	/* Take in the records that follow on without a gap */
+	while (fend < end) {
+		error = xfs_btree_increment(cur, 0, &found_rec);
+		if (error)
+			goto out_error;
+		if (!found_rec)
+			break;
+		error = xfs_refcount_get_rec(cur, &tmp, &found_rec);
+		if (error)
+			goto out_error;
+		XFS_WANT_CORRUPTED_GOTO(found_rec == 1, out_error);
+		if (tmp.rc_startblock != fend)
+			break;
+		fend += tmp.rc_blockcount;
+	}
+	*flen = min(fend, end) - *fbno;
+
+out:
+	xfs_btree_del_cursor(cur, XFS_BTREE_NOERROR);
+	xfs_buf_relse(agbp);
+	return 0;
+
+out_error:
+	xfs_btree_del_cursor(cur, XFS_BTREE_ERROR);
+	xfs_buf_relse(agbp);
+	return error;
+}
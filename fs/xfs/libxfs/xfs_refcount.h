@@ -0,0 +1,61 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __XFS_REFCOUNT_H__
+#define	__XFS_REFCOUNT_H__
+
+struct xfs_btree_cur;
+struct xfs_mount;
+struct xfs_trans;
+
+/*
+ * Lookup the first record less than or equal to [bno] in the btree
+ * given by cur.
+ */
+int xfs_refcount_lookup_le(struct xfs_btree_cur *cur, xfs_agblock_t bno,
+		int *stat);
+
+/*
+ * Lookup the first record greater than or equal to [bno] in the btree
+ * given by cur.
+ */
+int xfs_refcount_lookup_ge(struct xfs_btree_cur *cur, xfs_agblock_t bno,
+		int *stat);
+
+/*
+ * Get the data from the pointed-to record.
+ */
+int xfs_refcount_get_rec(struct xfs_btree_cur *cur,
+		struct xfs_refcount_irec *irec, int *stat);
+
+/*
+ * Add an owner to the blocks of an extent, or drop one and free the blocks
+ * left without owners.  *done is set to the number of blocks at the start
+ * of the extent that were adjusted; the caller adjusts the rest in a new
+ * transaction.
+ */
+int xfs_refcount_increase_extent(struct xfs_trans *tp, xfs_fsblock_t fsbno,
+		xfs_extlen_t len, xfs_extlen_t *done);
+int xfs_refcount_decrease_extent(struct xfs_trans *tp, xfs_fsblock_t fsbno,
+		xfs_extlen_t len, xfs_extlen_t *done);
+
+/*
+ * Find the first run of shared blocks in [agbno, agbno + aglen).
+ * *fbno is NULLAGBLOCK if none of the blocks are shared.
+ */
+int xfs_refcount_find_shared(struct xfs_mount *mp, xfs_agnumber_t agno,
+		xfs_agblock_t agbno, xfs_extlen_t aglen, xfs_agblock_t *fbno,
+		xfs_extlen_t *flen);
+
+#endif	/* __XFS_REFCOUNT_H__ */
@@ -0,0 +1,78 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __XFS_REFCOUNT_BTREE_H__
+#define	__XFS_REFCOUNT_BTREE_H__
+
+/*
+ * Reference count btree on-disk structures
+ */
+
+struct xfs_buf;
+struct xfs_btree_cur;
+struct xfs_mount;
+
+/*
+ * The refcount btree only exists on v5 filesystems, so its blocks always
+ * have the CRC enabled header.
+ */
+#define XFS_REFCOUNT_BLOCK_LEN	XFS_BTREE_SBLOCK_CRC_LEN
+
+/*
+ * Record, key, and pointer address macros for btree blocks.
+ *
+ * (note that some of these may appear unused, but they are used in userspace)
+ */
+#define XFS_REFCOUNT_REC_ADDR(block, index) \
+	((struct xfs_refcount_rec *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN + \
+		 (((index) - 1) * sizeof(struct xfs_refcount_rec))))
+
+#define XFS_REFCOUNT_KEY_ADDR(block, index) \
+	((struct xfs_refcount_key *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN + \
+		 ((index) - 1) * sizeof(struct xfs_refcount_key)))
+
+#define XFS_REFCOUNT_PTR_ADDR(block, index, maxrecs) \
+	((xfs_refcount_ptr_t *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN + \
+		 (maxrecs) * sizeof(struct xfs_refcount_key) + \
+		 ((index) - 1) * sizeof(xfs_refcount_ptr_t)))
+
+/*
+ * Number of records changed in the interior of a range by one reference
+ * count adjustment.  A longer range is adjusted over several transactions.
+ * The adjustment also changes up to two records at each end of the range.
+ */
+#define XFS_REFCOUNT_MAX_OPS	2
+#define XFS_REFCOUNT_ADJUST_OPS	(XFS_REFCOUNT_MAX_OPS + 4)
+
+/*
+ * Worst case number of refcount btree blocks a reference count adjustment
+ * can modify, and the number of blocks it can allocate for btree splits.
+ */
+#define XFS_REFCOUNT_LOG_COUNT(mp) \
+	(XFS_REFCOUNT_ADJUST_OPS * (2 * (mp)->m_refc_maxlevels - 1))
+#define XFS_REFCOUNT_SPACE_RES(mp) \
+	(XFS_REFCOUNT_ADJUST_OPS * (mp)->m_refc_maxlevels)
+
+extern struct xfs_btree_cur *xfs_refcountbt_init_cursor(struct xfs_mount *,
+		struct xfs_trans *, struct xfs_buf *, xfs_agnumber_t);
+extern int xfs_refcountbt_maxrecs(struct xfs_mount *, int, int);
+extern void xfs_refcountbt_compute_maxlevels(struct xfs_mount *);
+
+#endif	/* __XFS_REFCOUNT_BTREE_H__ */
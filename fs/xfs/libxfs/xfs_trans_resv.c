@@ -34,6 +34,7 @@
 #include "xfs_trans.h"
 #include "xfs_qm.h"
 #include "xfs_trans_space.h"
+#include "xfs_refcount_btree.h"
 #include "xfs_trace.h"
 
 /*
@@ -167,6 +168,29 @@ xfs_calc_finobt_res(
  */
 
 
+/*
+ * On reflink filesystems a transaction that maps or unmaps data blocks may
+ * also adjust their reference counts.  This can modify:
+ *    the agf of the ag holding the blocks: sector size
+ *    the refcount btree: worst case record changes * (2 * max depth - 1)
+ *	* block size
+ *    the allocation btrees for the blocks it frees and its own splits:
+ *	max ops exts * 2 trees * (2 * max depth - 1) * block size
+ */
+STATIC uint
+xfs_calc_refcount_reservation(
+	struct xfs_mount	*mp)
+{
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return 0;
+	return xfs_calc_buf_res(1, mp->m_sb.sb_sectsize) +
+		xfs_calc_buf_res(XFS_REFCOUNT_LOG_COUNT(mp),
+				 XFS_FSB_TO_B(mp, 1)) +
+		xfs_calc_buf_res(XFS_ALLOCFREE_LOG_COUNT(mp,
+						XFS_REFCOUNT_MAX_OPS),
+				 XFS_FSB_TO_B(mp, 1));
+}
+
 /*
  * In a write transaction we can allocate a maximum of 2
  * extents.  This gives:
@@ -185,7 +209,7 @@ STATIC uint
 xfs_calc_write_reservation(
 	struct xfs_mount	*mp)
 {
-	return XFS_DQUOT_LOGRES(mp) +
+	return XFS_DQUOT_LOGRES(mp) + xfs_calc_refcount_reservation(mp) +
 		MAX((xfs_calc_inode_res(mp, 1) +
 		     xfs_calc_buf_res(XFS_BM_MAXLEVELS(mp, XFS_DATA_FORK),
 				      XFS_FSB_TO_B(mp, 1)) +
@@ -214,7 +238,7 @@ STATIC uint
 xfs_calc_itruncate_reservation(
 	struct xfs_mount	*mp)
 {
-	return XFS_DQUOT_LOGRES(mp) +
+	return XFS_DQUOT_LOGRES(mp) + xfs_calc_refcount_reservation(mp) +
 		MAX((xfs_calc_inode_res(mp, 1) +
 		     xfs_calc_buf_res(XFS_BM_MAXLEVELS(mp, XFS_DATA_FORK) + 1,
 				      XFS_FSB_TO_B(mp, 1))),
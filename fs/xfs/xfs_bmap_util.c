@@ -43,6 +43,8 @@
 #include "xfs_icache.h"
 #include "xfs_log.h"
 #include "xfs_dinode.h"
+#include "xfs_refcount.h"
+#include "xfs_reflink.h"
 
 /* Kernel only BMAP related definitions and functions */
 
@@ -59,12 +61,63 @@ xfs_fsb_to_db(struct xfs_inode *ip, xfs_fsblock_t fsb)
 		 XFS_FSB_TO_DADDR((ip)->i_mount, (fsb)));
 }
 
+/*
+ * Commit the transaction and start a new one with the same log reservation
+ * and what is left of the block reservation.
+ */
+STATIC int
+xfs_bmap_finish_roll(
+	struct xfs_trans	**tp,
+	struct xfs_trans_res	*tres)
+{
+	struct xfs_trans	*ntp;
+	int			error;
+
+	ntp = xfs_trans_dup(*tp);
+	error = xfs_trans_commit(*tp, 0);
+	*tp = ntp;
+	if (error)
+		return error;
+
+	/*
+	 * transaction commit worked ok so we can drop the extra ticket
+	 * reference that we gained in xfs_trans_dup()
+	 */
+	xfs_log_ticket_put(ntp->t_ticket);
+
+	return xfs_trans_reserve(ntp, tres, 0, 0);
+}
+
+STATIC void
+xfs_bmap_finish_shutdown(
+	struct xfs_mount	*mp,
+	int			error)
+{
+	/*
+	 * The bmap free list will be cleaned up at a higher level.  The EFI
+	 * will be canceled when this transaction is aborted.  Need to force
+	 * shutdown here to make sure it happens, since this transaction may
+	 * not be dirty yet.
+	 */
+	if (!XFS_FORCED_SHUTDOWN(mp))
+		xfs_force_shutdown(mp, (error == -EFSCORRUPTED) ?
+				   SHUTDOWN_CORRUPT_INCORE :
+				   SHUTDOWN_META_IO_ERROR);
+}
+
 /*
  * Routine to be called at transaction's end by xfs_bmapi, xfs_bunmapi
  * caller.  Frees all the extents that need freeing, which must be done
  * last due to locking considerations.  We never free any extents in
  * the first transaction.
  *
+ * Extents of reflinked files drop a reference to their blocks instead,
+ * after the other extents are freed.  Each does so in transactions of its
+ * own, as a bounded amount of refcount btree work fits in one.  They are
+ * not covered by the EFI: if we crash before the reference is dropped,
+ * the blocks are left with one owner too many, which leaks them but never
+ * frees blocks that are still in use.
+ *
  * Return 1 if the given transaction was committed and a new one
  * started, and 0 otherwise in the committed parameter.
  */
@@ -79,9 +132,12 @@ xfs_bmap_finish(
 	int			error;		/* error return value */
 	xfs_bmap_free_item_t	*free;		/* free extent item */
 	struct xfs_trans_res	tres;		/* new log reservation */
-	xfs_mount_t		*mp;		/* filesystem mount structure */
 	xfs_bmap_free_item_t	*next;		/* next item on free list */
+	xfs_bmap_free_item_t	*prev;		/* previous item kept on list */
 	xfs_trans_t		*ntp;		/* new transaction pointer */
+	xfs_extlen_t		done;		/* blocks of shared item done */
+	int			nefi;		/* extents in the EFI */
+	bool			roll;		/* new transaction for item */
 
 	ASSERT((*tp)->t_flags & XFS_TRANS_PERM_LOG_RES);
 	if (flist->xbf_count == 0) {
@@ -89,58 +145,71 @@ xfs_bmap_finish(
 		return 0;
 	}
 	ntp = *tp;
-	efi = xfs_trans_get_efi(ntp, flist->xbf_count);
+	nefi = 0;
 	for (free = flist->xbf_first; free; free = free->xbfi_next)
-		xfs_trans_log_efi_extent(ntp, efi, free->xbfi_startblock,
-			free->xbfi_blockcount);
+		if (!free->xbfi_shared)
+			nefi++;
+	efi = NULL;
+	if (nefi) {
+		efi = xfs_trans_get_efi(ntp, nefi);
+		for (free = flist->xbf_first; free; free = free->xbfi_next)
+			if (!free->xbfi_shared)
+				xfs_trans_log_efi_extent(ntp, efi,
+					free->xbfi_startblock,
+					free->xbfi_blockcount);
+	}
 
 	tres.tr_logres = ntp->t_log_res;
 	tres.tr_logcount = ntp->t_log_count;
 	tres.tr_logflags = XFS_TRANS_PERM_LOG_RES;
-	ntp = xfs_trans_dup(*tp);
-	error = xfs_trans_commit(*tp, 0);
-	*tp = ntp;
-	*committed = 1;
 	/*
 	 * We have a new transaction, so we should return committed=1,
 	 * even though we're returning an error.
 	 */
+	*committed = 1;
+	error = xfs_bmap_finish_roll(tp, &tres);
 	if (error)
 		return error;
+	ntp = *tp;
 
-	/*
-	 * transaction commit worked ok so we can drop the extra ticket
-	 * reference that we gained in xfs_trans_dup()
-	 */
-	xfs_log_ticket_put(ntp->t_ticket);
+	if (efi) {
+		efd = xfs_trans_get_efd(ntp, efi, nefi);
+		for (prev = NULL, free = flist->xbf_first; free; free = next) {
+			next = free->xbfi_next;
+			if (free->xbfi_shared) {
+				prev = free;
+				continue;
+			}
+			error = xfs_free_extent(ntp, free->xbfi_startblock,
+					free->xbfi_blockcount);
+			if (error) {
+				xfs_bmap_finish_shutdown(ntp->t_mountp, error);
+				return error;
+			}
+			xfs_trans_log_efd_extent(ntp, efd,
+				free->xbfi_startblock, free->xbfi_blockcount);
+			xfs_bmap_del_free(flist, prev, free);
+		}
+	}
 
-	error = xfs_trans_reserve(ntp, &tres, 0, 0);
-	if (error)
-		return error;
-	efd = xfs_trans_get_efd(ntp, efi, flist->xbf_count);
-	for (free = flist->xbf_first; free != NULL; free = next) {
-		next = free->xbfi_next;
-		if ((error = xfs_free_extent(ntp, free->xbfi_startblock,
-				free->xbfi_blockcount))) {
-			/*
-			 * The bmap free list will be cleaned up at a
-			 * higher level.  The EFI will be canceled when
-			 * this transaction is aborted.
-			 * Need to force shutdown here to make sure it
-			 * happens, since this transaction may not be
-			 * dirty yet.
-			 */
-			mp = ntp->t_mountp;
-			if (!XFS_FORCED_SHUTDOWN(mp))
-				xfs_force_shutdown(mp,
-						   (error == -EFSCORRUPTED) ?
-						   SHUTDOWN_CORRUPT_INCORE :
-						   SHUTDOWN_META_IO_ERROR);
+	for (roll = efi != NULL; (free = flist->xbf_first); roll = true) {
+		if (roll) {
+			error = xfs_bmap_finish_roll(tp, &tres);
+			if (error)
+				return error;
+			ntp = *tp;
+		}
+
+		error = xfs_refcount_decrease_extent(ntp, free->xbfi_startblock,
+				free->xbfi_blockcount, &done);
+		if (error) {
+			xfs_bmap_finish_shutdown(ntp->t_mountp, error);
 			return error;
 		}
-		xfs_trans_log_efd_extent(ntp, efd, free->xbfi_startblock,
-			free->xbfi_blockcount);
-		xfs_bmap_del_free(flist, NULL, free);
+		free->xbfi_startblock += done;
+		free->xbfi_blockcount -= done;
+		if (!free->xbfi_blockcount)
+			xfs_bmap_del_free(flist, NULL, free);
 	}
 	return 0;
 }
@@ -1122,6 +1191,11 @@ xfs_zero_remaining_bytes(
 	if (endoff > XFS_ISIZE(ip))
 		endoff = XFS_ISIZE(ip);
 
+	/* Don't zero the data of the other owners of shared blocks */
+	error = xfs_reflink_unshare(ip, startoff, endoff - startoff + 1);
+	if (error)
+		return error;
+
 	for (offset = startoff; offset <= endoff; offset = lastoffset + 1) {
 		uint lock_mode;
 
@@ -1656,6 +1730,12 @@ xfs_swap_extents(
 		goto out_unlock;
 	}
 
+	/* Shared blocks must stay in files that know they may be shared */
+	if (xfs_is_reflink_inode(ip) || xfs_is_reflink_inode(tip)) {
+		error = -EINVAL;
+		goto out_unlock;
+	}
+
 	error = xfs_swap_extent_flush(ip);
 	if (error)
 		goto out_unlock;
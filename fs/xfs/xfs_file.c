@@ -39,6 +39,7 @@
 #include "xfs_log.h"
 #include "xfs_dinode.h"
 #include "xfs_icache.h"
+#include "xfs_reflink.h"
 
 #include <linux/aio.h>
 #include <linux/dcache.h>
@@ -101,6 +102,11 @@ xfs_iozero(
 	struct address_space	*mapping;
 	int			status;
 
+	/* Zeroing shared blocks in place would zero the other owners' data */
+	status = xfs_reflink_unshare(ip, pos, count);
+	if (status)
+		return status;
+
 	mapping = VFS_I(ip)->i_mapping;
 	do {
 		unsigned offset, bytes;
@@ -503,7 +509,7 @@ xfs_zero_eof(
  *
  * Called with the iolocked held either shared and exclusive according to
  * @iolock, and returns with it held.  Might upgrade the iolock to exclusive
- * if called for a direct write beyond i_size.
+ * if called for a direct write beyond i_size or to a reflinked file.
  */
 STATIC ssize_t
 xfs_file_aio_write_checks(
@@ -540,6 +546,22 @@ restart:
 			return error;
 	}
 
+	/*
+	 * Shared blocks get new blocks of their own before they are written.
+	 * Serialise the unsharing against other writers of the file.
+	 */
+	if (xfs_is_reflink_inode(ip)) {
+		if (*iolock == XFS_IOLOCK_SHARED) {
+			xfs_rw_iunlock(ip, *iolock);
+			*iolock = XFS_IOLOCK_EXCL;
+			xfs_rw_ilock(ip, *iolock);
+			goto restart;
+		}
+		error = xfs_reflink_unshare(ip, *pos, *count);
+		if (error)
+			return error;
+	}
+
 	/*
 	 * Updating the timestamps will grab the ilock again from
 	 * xfs_fs_dirty_inode, so we have to call it after dropping the
@@ -881,6 +903,64 @@ out_unlock:
 	return error;
 }
 
+/*
+ * Share the blocks of the source range instead of copying the data when
+ * we can; anything else is copied by the VFS.
+ */
+STATIC ssize_t
+xfs_file_copy_range(
+	struct file		*file_in,
+	loff_t			pos_in,
+	struct file		*file_out,
+	loff_t			pos_out,
+	size_t			len,
+	unsigned int		flags)
+{
+	struct xfs_inode	*src = XFS_I(file_inode(file_in));
+	struct xfs_mount	*mp = src->i_mount;
+	loff_t			isize = i_size_read(VFS_I(src));
+	int			error;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return -EOPNOTSUPP;
+	if (pos_in >= isize)
+		return 0;
+	if (len > isize - pos_in)
+		len = isize - pos_in;
+
+	/* Only whole blocks, or the tail of the source, can be shared */
+	if ((pos_in | pos_out) & mp->m_blockmask)
+		return -EOPNOTSUPP;
+	if ((len & mp->m_blockmask) && pos_in + len != isize)
+		return -EOPNOTSUPP;
+	if ((len & mp->m_blockmask) &&
+	    pos_out + len < i_size_read(file_inode(file_out)))
+		return -EOPNOTSUPP;
+	if (src == XFS_I(file_inode(file_out)) &&
+	    pos_in < pos_out + len && pos_out < pos_in + len)
+		return -EOPNOTSUPP;
+
+	error = xfs_reflink_clone_file(file_in, pos_in, file_out, pos_out, len);
+	if (error)
+		return error;
+	return len;
+}
+
+STATIC int
+xfs_file_clone_range(
+	struct file		*file_in,
+	loff_t			pos_in,
+	struct file		*file_out,
+	loff_t			pos_out,
+	u64			len)
+{
+	struct xfs_mount	*mp = XFS_I(file_inode(file_in))->i_mount;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return -EOPNOTSUPP;
+	return xfs_reflink_clone_file(file_in, pos_in, file_out, pos_out, len);
+}
+
 
 STATIC int
 xfs_file_open(
@@ -978,6 +1058,14 @@ xfs_vm_page_mkwrite(
 	struct vm_area_struct	*vma,
 	struct vm_fault		*vmf)
 {
+	struct inode		*inode = file_inode(vma->vm_file);
+	int			error;
+
+	error = xfs_reflink_unshare(XFS_I(inode), page_offset(vmf->page),
+				    PAGE_CACHE_SIZE);
+	if (error)
+		return block_page_mkwrite_return(error);
+
 	return block_page_mkwrite(vma, vmf, xfs_get_blocks);
 }
 
@@ -1373,6 +1461,8 @@ const struct file_operations xfs_file_operations = {
 	.release	= xfs_file_release,
 	.fsync		= xfs_file_fsync,
 	.fallocate	= xfs_file_fallocate,
+	.copy_file_range = xfs_file_copy_range,
+	.clone_file_range = xfs_file_clone_range,
 };
 
 const struct file_operations xfs_dir_file_operations = {
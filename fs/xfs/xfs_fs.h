@@ -239,6 +239,7 @@ typedef struct xfs_fsop_resblks {
 #define XFS_FSOP_GEOM_FLAGS_V5SB	0x8000	/* version 5 superblock */
 #define XFS_FSOP_GEOM_FLAGS_FTYPE	0x10000	/* inode directory types */
 #define XFS_FSOP_GEOM_FLAGS_FINOBT	0x20000	/* free inode btree */
+#define XFS_FSOP_GEOM_FLAGS_REFLINK	0x40000	/* files can share blocks */
 
 /*
  * Minimum and maximum sizes need for growth checks.
@@ -481,6 +482,16 @@ typedef struct xfs_swapext
 	xfs_bstat_t	sx_stat;	/* stat of target b4 copy */
 } xfs_swapext_t;
 
+/*
+ * Structure passed to XFS_IOC_CLONE_RANGE
+ */
+struct xfs_clone_args {
+	__s64		src_fd;		/* fd of source file */
+	__u64		src_offset;	/* offset into source file */
+	__u64		src_length;	/* length to share, 0 for all */
+	__u64		dest_offset;	/* offset into dest file */
+};
+
 /*
  * Flags for going down operation
  */
@@ -558,6 +569,13 @@ typedef struct xfs_swapext
 #define XFS_IOC_GOINGDOWN	     _IOR ('X', 125, __uint32_t)
 /*	XFS_IOC_GETFSUUID ---------- deprecated 140	 */
 
+/*
+ * Block sharing ioctls, compatible with btrfs' BTRFS_IOC_CLONE and
+ * BTRFS_IOC_CLONE_RANGE.
+ */
+#define XFS_IOC_CLONE		     _IOW (0x94, 9, int)
+#define XFS_IOC_CLONE_RANGE	     _IOW (0x94, 13, struct xfs_clone_args)
+
 
 #ifndef HAVE_BBMACROS
 /*
@@ -202,6 +202,16 @@ xfs_get_initial_prid(struct xfs_inode *dp)
 	return XFS_PROJID_DEFAULT;
 }
 
+/*
+ * Data blocks of a reflinked file may be shared with other files, and must
+ * be unshared before they are written.
+ */
+static inline bool
+xfs_is_reflink_inode(struct xfs_inode *ip)
+{
+	return ip->i_d.di_flags2 & XFS_DIFLAG2_REFLINK;
+}
+
 /*
  * In-core inode flags.
  */
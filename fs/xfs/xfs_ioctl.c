@@ -1512,6 +1512,47 @@ xfs_ioc_swapext(
 	return error;
 }
 
+/*
+ * Share the blocks of a range of the file open on srcfd with the file the
+ * ioctl was issued on.
+ */
+STATIC int
+xfs_ioc_clone(
+	struct file	*file,
+	int		srcfd,
+	loff_t		srcoff,
+	u64		len,
+	loff_t		destoff)
+{
+	struct fd	src;
+	int		error;
+
+	if (!(file->f_mode & FMODE_WRITE) || (file->f_flags & O_APPEND))
+		return -EBADF;
+
+	src = fdget(srcfd);
+	if (!src.file)
+		return -EBADF;
+
+	error = -EBADF;
+	if (!(src.file->f_mode & FMODE_READ))
+		goto out_put_file;
+
+	error = -EXDEV;
+	if (src.file->f_path.mnt != file->f_path.mnt)
+		goto out_put_file;
+
+	error = mnt_want_write_file(file);
+	if (error)
+		goto out_put_file;
+	error = xfs_reflink_clone_file(src.file, srcoff, file, destoff, len);
+	mnt_drop_write_file(file);
+
+ out_put_file:
+	fdput(src);
+	return error;
+}
+
 /*
  * Note: some of the ioctl's return positive numbers as a
  * byte count indicating success, such as readlink_by_handle.
@@ -1661,6 +1702,21 @@ xfs_file_ioctl(
 		return error;
 	}
 
+	case XFS_IOC_CLONE:
+		return xfs_ioc_clone(filp, (unsigned long)arg, 0, 0, 0);
+
+	case XFS_IOC_CLONE_RANGE: {
+		struct xfs_clone_args	args;
+
+		if (copy_from_user(&args, arg, sizeof(args)))
+			return -EFAULT;
+		if ((loff_t)args.src_offset < 0 ||
+		    (loff_t)args.dest_offset < 0)
+			return -EINVAL;
+		return xfs_ioc_clone(filp, args.src_fd, args.src_offset,
+				     args.src_length, args.dest_offset);
+	}
+
 	case XFS_IOC_FSCOUNTS: {
 		xfs_fsop_counts_t out;
 
@@ -40,6 +40,7 @@
 #include "xfs_dir2_priv.h"
 #include "xfs_dinode.h"
 #include "xfs_trans_space.h"
+#include "xfs_reflink.h"
 
 #include <linux/capability.h>
 #include <linux/xattr.h>
@@ -844,6 +845,12 @@ xfs_setattr_size(
 	 * much we can do about this, except to hope that the caller sees ENOMEM
 	 * and retries the truncate operation.
 	 */
+	if (newsize & mp->m_blockmask) {
+		/* The tail of the new EOF block is zeroed in place */
+		error = xfs_reflink_unshare(ip, newsize, 1);
+		if (error)
+			return error;
+	}
 	error = block_truncate_page(inode->i_mapping, newsize, xfs_get_blocks);
 	if (error)
 		return error;
@@ -996,6 +1003,9 @@ xfs_vn_update_time(
 
 	trace_xfs_update_time(ip);
 
+	if (inode->i_sb->s_flags & MS_LAZYTIME)
+		return generic_update_time(inode, now, flags);
+
 	tp = xfs_trans_alloc(mp, XFS_TRANS_FSYNC_TS);
 	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_fsyncts, 0, 0);
 	if (error) {
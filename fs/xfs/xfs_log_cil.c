@@ -274,6 +274,10 @@ insert:
  * if the change requires additional log metadata. If it does, take that space
  * as well. Remove the amount of space we added to the checkpoint ticket from
  * the current transaction ticket so that the accounting works out correctly.
+ *
+ * All of this goes to the per-cpu part of the CIL, so that concurrent
+ * commits only share the context lock, held in read mode. The push works out
+ * the checkpoint order of the items from the order ids handed out here.
  */
 static void
 xlog_cil_insert_items(
@@ -283,9 +287,12 @@ xlog_cil_insert_items(
 	struct xfs_cil		*cil = log->l_cilp;
 	struct xfs_cil_ctx	*ctx = cil->xc_ctx;
 	struct xfs_log_item_desc *lidp;
+	struct xfs_cil_pcp	*cilpcp;
 	int			len = 0;
 	int			diff_iovecs = 0;
 	int			iclog_space;
+	int			order;
+	bool			inserted = false;
 
 	ASSERT(tp);
 
@@ -295,12 +302,16 @@ xlog_cil_insert_items(
 	 */
 	xlog_cil_insert_format_items(log, tp, &len, &diff_iovecs);
 
+	cilpcp = get_cpu_ptr(cil->xc_pcp);
+	if (!cpumask_test_cpu(smp_processor_id(), &ctx->cil_pcpmask))
+		cpumask_set_cpu(smp_processor_id(), &ctx->cil_pcpmask);
+
 	/*
-	 * Now (re-)position everything modified at the tail of the CIL.
-	 * We do this here so we only need to take the CIL lock once during
-	 * the transaction commit.
+	 * Now (re-)position everything modified at the tail of the CIL. Items
+	 * that are already in the CIL stay on whichever cpu list they are on,
+	 * only their order id moves them to the tail of the checkpoint.
 	 */
-	spin_lock(&cil->xc_cil_lock);
+	order = atomic_inc_return(&ctx->order_id);
 	list_for_each_entry(lidp, &tp->t_items, lid_trans) {
 		struct xfs_log_item	*lip = lidp->lid_item;
 
@@ -308,47 +319,106 @@ xlog_cil_insert_items(
 		if (!(lidp->lid_flags & XFS_LID_DIRTY))
 			continue;
 
-		list_move_tail(&lip->li_cil, &cil->xc_cil);
+		inserted = true;
+		lip->li_order_id = order;
+		if (list_empty(&lip->li_cil))
+			list_add_tail(&lip->li_cil, &cilpcp->log_items);
 	}
 
 	/* account for space used by new iovec headers  */
 	len += diff_iovecs * sizeof(xlog_op_header_t);
-	ctx->nvecs += diff_iovecs;
+	cilpcp->nvecs += diff_iovecs;
 
 	/* attach the transaction to the CIL if it has any busy extents */
 	if (!list_empty(&tp->t_busy))
-		list_splice_init(&tp->t_busy, &ctx->busy_extents);
+		list_splice_init(&tp->t_busy, &cilpcp->busy_extents);
 
 	/*
 	 * Now transfer enough transaction reservation to the context ticket
 	 * for the checkpoint. The context ticket is special - the unit
 	 * reservation has to grow as well as the current reservation as we
 	 * steal from tickets so we can correctly determine the space used
-	 * during the transaction commit.
+	 * during the transaction commit. Only the first commit into the
+	 * context clears XLOG_CIL_EMPTY, so only it touches the ticket here.
 	 */
-	if (ctx->ticket->t_curr_res == 0) {
+	if (inserted && test_bit(XLOG_CIL_EMPTY, &cil->xc_flags) &&
+	    test_and_clear_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
 		ctx->ticket->t_curr_res = ctx->ticket->t_unit_res;
 		tp->t_ticket->t_curr_res -= ctx->ticket->t_unit_res;
 	}
 
-	/* do we need space for more log record headers? */
+	/*
+	 * Do we need space for more log record headers? Every cpu steals the
+	 * headers for the space it adds to the checkpoint itself, which may
+	 * be a few more than the checkpoint as a whole ends up needing.
+	 */
 	iclog_space = log->l_iclog_size - log->l_iclog_hsize;
-	if (len > 0 && (ctx->space_used / iclog_space !=
-				(ctx->space_used + len) / iclog_space)) {
-		int hdrs;
+	if (len > cilpcp->iclog_left) {
+		int nr, hdrs;
 
-		hdrs = (len + iclog_space - 1) / iclog_space;
+		nr = (len - cilpcp->iclog_left + iclog_space - 1) / iclog_space;
+		cilpcp->iclog_left += nr * iclog_space;
 		/* need to take into account split region headers, too */
-		hdrs *= log->l_iclog_hsize + sizeof(struct xlog_op_header);
-		ctx->ticket->t_unit_res += hdrs;
-		ctx->ticket->t_curr_res += hdrs;
+		hdrs = nr * (log->l_iclog_hsize + sizeof(struct xlog_op_header));
+		cilpcp->space_reserved += hdrs;
 		tp->t_ticket->t_curr_res -= hdrs;
 		ASSERT(tp->t_ticket->t_curr_res >= len);
 	}
+	cilpcp->iclog_left -= max(len, 0);
 	tp->t_ticket->t_curr_res -= len;
-	ctx->space_used += len;
 
-	spin_unlock(&cil->xc_cil_lock);
+	if (cilpcp->space_used + len > XLOG_CIL_PCP_SPACE_LIMIT(log)) {
+		atomic_add(cilpcp->space_used + len, &ctx->space_used);
+		cilpcp->space_used = 0;
+	} else {
+		cilpcp->space_used += len;
+	}
+	put_cpu_ptr(cil->xc_pcp);
+}
+
+static int
+xlog_cil_order_cmp(
+	void			*priv,
+	struct list_head	*a,
+	struct list_head	*b)
+{
+	struct xfs_log_item	*l1 = container_of(a, struct xfs_log_item,
+						   li_cil);
+	struct xfs_log_item	*l2 = container_of(b, struct xfs_log_item,
+						   li_cil);
+
+	return l1->li_order_id > l2->li_order_id;
+}
+
+/*
+ * Fold the per-cpu parts of the CIL into the context that is about to be
+ * pushed and return its log items in commit order. Called with the context
+ * lock held exclusively, so no commits are running.
+ */
+static void
+xlog_cil_pcp_aggregate(
+	struct xfs_cil		*cil,
+	struct xfs_cil_ctx	*ctx,
+	struct list_head	*items)
+{
+	int			cpu;
+
+	for_each_cpu(cpu, &ctx->cil_pcpmask) {
+		struct xfs_cil_pcp	*cilpcp = per_cpu_ptr(cil->xc_pcp, cpu);
+
+		ctx->ticket->t_unit_res += cilpcp->space_reserved;
+		ctx->ticket->t_curr_res += cilpcp->space_reserved;
+		ctx->nvecs += cilpcp->nvecs;
+		atomic_add(cilpcp->space_used, &ctx->space_used);
+		list_splice_init(&cilpcp->busy_extents, &ctx->busy_extents);
+		list_splice_tail_init(&cilpcp->log_items, items);
+
+		cilpcp->space_reserved = 0;
+		cilpcp->iclog_left = 0;
+		cilpcp->nvecs = 0;
+		cilpcp->space_used = 0;
+	}
+	list_sort(NULL, items, xlog_cil_order_cmp);
 }
 
 static void
@@ -439,6 +509,7 @@ xlog_cil_push(
 	struct xfs_log_vec	lvhdr = { NULL };
 	xfs_lsn_t		commit_lsn;
 	xfs_lsn_t		push_seq;
+	LIST_HEAD(items);
 
 	if (!cil)
 		return 0;
@@ -458,7 +529,7 @@ xlog_cil_push(
 	 * move on to a new sequence number and so we have to be able to push
 	 * this sequence again later.
 	 */
-	if (list_empty(&cil->xc_cil)) {
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
 		cil->xc_push_seq = 0;
 		spin_unlock(&cil->xc_push_lock);
 		goto out_skip;
@@ -500,17 +571,17 @@ xlog_cil_push(
 
 	/*
 	 * pull all the log vectors off the items in the CIL, and
-	 * remove the items from the CIL. We don't need the CIL lock
-	 * here because it's only needed on the transaction commit
-	 * side which is currently locked out by the flush lock.
+	 * remove the items from the CIL. We don't need any per-cpu
+	 * locking here because the transaction commit side is
+	 * currently locked out by the flush lock.
 	 */
+	xlog_cil_pcp_aggregate(cil, ctx, &items);
 	lv = NULL;
 	num_iovecs = 0;
-	while (!list_empty(&cil->xc_cil)) {
+	while (!list_empty(&items)) {
 		struct xfs_log_item	*item;
 
-		item = list_first_entry(&cil->xc_cil,
-					struct xfs_log_item, li_cil);
+		item = list_first_entry(&items, struct xfs_log_item, li_cil);
 		list_del_init(&item->li_cil);
 		if (!ctx->lv_chain)
 			ctx->lv_chain = item->li_lv;
@@ -532,6 +603,7 @@ xlog_cil_push(
 	new_ctx->sequence = ctx->sequence + 1;
 	new_ctx->cil = cil;
 	cil->xc_ctx = new_ctx;
+	set_bit(XLOG_CIL_EMPTY, &cil->xc_flags);
 
 	/*
 	 * The switch is now done, so we can drop the context lock and move out
@@ -688,13 +760,13 @@ xlog_cil_push_background(
 	 * The cil won't be empty because we are called while holding the
 	 * context lock so whatever we added to the CIL will still be there
 	 */
-	ASSERT(!list_empty(&cil->xc_cil));
+	ASSERT(!test_bit(XLOG_CIL_EMPTY, &cil->xc_flags));
 
 	/*
 	 * don't do a background push if we haven't used up all the
 	 * space available yet.
 	 */
-	if (cil->xc_ctx->space_used < XLOG_CIL_SPACE_LIMIT(log))
+	if (atomic_read(&cil->xc_ctx->space_used) < XLOG_CIL_SPACE_LIMIT(log))
 		return;
 
 	spin_lock(&cil->xc_push_lock);
@@ -732,7 +804,8 @@ xlog_cil_push_now(
 	 * there's no work we need to do.
 	 */
 	spin_lock(&cil->xc_push_lock);
-	if (list_empty(&cil->xc_cil) || push_seq <= cil->xc_push_seq) {
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags) ||
+	    push_seq <= cil->xc_push_seq) {
 		spin_unlock(&cil->xc_push_lock);
 		return;
 	}
@@ -750,7 +823,7 @@ xlog_cil_empty(
 	bool		empty = false;
 
 	spin_lock(&cil->xc_push_lock);
-	if (list_empty(&cil->xc_cil))
+	if (test_bit(XLOG_CIL_EMPTY, &cil->xc_flags))
 		empty = true;
 	spin_unlock(&cil->xc_push_lock);
 	return empty;
@@ -893,7 +966,7 @@ restart:
 	 * we would have found the context on the committing list.
 	 */
 	if (sequence == cil->xc_current_sequence &&
-	    !list_empty(&cil->xc_cil)) {
+	    !test_bit(XLOG_CIL_EMPTY, &cil->xc_flags)) {
 		spin_unlock(&cil->xc_push_lock);
 		goto restart;
 	}
@@ -952,21 +1025,35 @@ xlog_cil_init(
 {
 	struct xfs_cil	*cil;
 	struct xfs_cil_ctx *ctx;
+	int		cpu;
 
 	cil = kmem_zalloc(sizeof(*cil), KM_SLEEP|KM_MAYFAIL);
 	if (!cil)
 		return -ENOMEM;
 
+	cil->xc_pcp = alloc_percpu(struct xfs_cil_pcp);
+	if (!cil->xc_pcp) {
+		kmem_free(cil);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct xfs_cil_pcp	*cilpcp = per_cpu_ptr(cil->xc_pcp, cpu);
+
+		INIT_LIST_HEAD(&cilpcp->busy_extents);
+		INIT_LIST_HEAD(&cilpcp->log_items);
+	}
+
 	ctx = kmem_zalloc(sizeof(*ctx), KM_SLEEP|KM_MAYFAIL);
 	if (!ctx) {
+		free_percpu(cil->xc_pcp);
 		kmem_free(cil);
 		return -ENOMEM;
 	}
 
 	INIT_WORK(&cil->xc_push_work, xlog_cil_push_work);
-	INIT_LIST_HEAD(&cil->xc_cil);
 	INIT_LIST_HEAD(&cil->xc_committing);
-	spin_lock_init(&cil->xc_cil_lock);
+	set_bit(XLOG_CIL_EMPTY, &cil->xc_flags);
 	spin_lock_init(&cil->xc_push_lock);
 	init_rwsem(&cil->xc_ctx_lock);
 	init_waitqueue_head(&cil->xc_commit_wait);
@@ -993,7 +1080,8 @@ xlog_cil_destroy(
 		kmem_free(log->l_cilp->xc_ctx);
 	}
 
-	ASSERT(list_empty(&log->l_cilp->xc_cil));
+	ASSERT(test_bit(XLOG_CIL_EMPTY, &log->l_cilp->xc_flags));
+	free_percpu(log->l_cilp->xc_pcp);
 	kmem_free(log->l_cilp);
 }
 
@@ -252,11 +252,29 @@ struct xfs_cil_ctx {
 	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
 	int			nvecs;		/* number of regions */
-	int			space_used;	/* aggregate size of regions */
+	atomic_t		space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* last commit order id */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct xfs_log_callback	log_cb;		/* completion callback hook. */
 	struct list_head	committing;	/* ctx committing list */
+	cpumask_t		cil_pcpmask;	/* cpus with items in xc_pcp */
+};
+
+/*
+ * Per-cpu part of the CIL. Transaction commits add their log items, busy
+ * extents and stolen reservation here under the context lock held shared,
+ * and the push folds everything into the context with the lock held
+ * exclusively. Space used is folded into the context as it accumulates so
+ * that background pushes still trigger in time.
+ */
+struct xfs_cil_pcp {
+	int			space_used;	/* not yet in ctx->space_used */
+	int			space_reserved;	/* stolen for iclog headers */
+	int			iclog_left;	/* covered by stolen headers */
+	int			nvecs;
+	struct list_head	busy_extents;
+	struct list_head	log_items;
 };
 
 /*
@@ -277,8 +295,8 @@ struct xfs_cil_ctx {
  */
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xfs_cil_pcp __percpu *xc_pcp;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
 	struct xfs_cil_ctx	*xc_ctx;
@@ -340,6 +358,17 @@ struct xfs_cil {
  */
 #define XLOG_CIL_SPACE_LIMIT(log)	(log->l_logsize >> 3)
 
+/*
+ * Space used on a cpu is folded into the context once it exceeds this share
+ * of the background push threshold, so the push can start late by at most
+ * half of XLOG_CIL_SPACE_LIMIT.
+ */
+#define XLOG_CIL_PCP_SPACE_LIMIT(log)	\
+	(XLOG_CIL_SPACE_LIMIT(log) / (num_online_cpus() * 2))
+
+/* xc_flags bits */
+#define XLOG_CIL_EMPTY		0	/* nothing committed to the context */
+
 /*
  * ticket grant locks, queues and accounting have their own cachlines
  * as these are quite hot and can be operated on concurrently.
@@ -1851,7 +1851,8 @@ xlog_recover_get_buf_lsn(
 	case XFS_ABTB_MAGIC:
 	case XFS_ABTC_MAGIC:
 	case XFS_IBT_CRC_MAGIC:
-	case XFS_IBT_MAGIC: {
+	case XFS_IBT_MAGIC:
+	case XFS_REFC_CRC_MAGIC: {
 		struct xfs_btree_block *btb = blk;
 
 		lsn = be64_to_cpu(btb->bb_u.s.bb_lsn);
@@ -2003,6 +2004,9 @@ xlog_recover_validate_buf_type(
 		case XFS_BMAP_MAGIC:
 			bp->b_ops = &xfs_bmbt_buf_ops;
 			break;
+		case XFS_REFC_CRC_MAGIC:
+			bp->b_ops = &xfs_refcountbt_buf_ops;
+			break;
 		default:
 			xfs_warn(mp, "Bad btree block magic!");
 			ASSERT(0);
@@ -43,6 +43,7 @@
 #include "xfs_icache.h"
 #include "xfs_dinode.h"
 #include "xfs_sysfs.h"
+#include "xfs_refcount_btree.h"
 
 
 #ifdef HAVE_PERCPU_SB
@@ -721,6 +722,7 @@ xfs_mountfs(
 	xfs_bmap_compute_maxlevels(mp, XFS_DATA_FORK);
 	xfs_bmap_compute_maxlevels(mp, XFS_ATTR_FORK);
 	xfs_ialloc_compute_maxlevels(mp);
+	xfs_refcountbt_compute_maxlevels(mp);
 
 	xfs_set_maxicount(mp);
 
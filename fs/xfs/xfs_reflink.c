@@ -0,0 +1,700 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "xfs.h"
+#include "xfs_fs.h"
+#include "xfs_shared.h"
+#include "xfs_format.h"
+#include "xfs_log_format.h"
+#include "xfs_trans_resv.h"
+#include "xfs_sb.h"
+#include "xfs_ag.h"
+#include "xfs_mount.h"
+#include "xfs_da_format.h"
+#include "xfs_inode.h"
+#include "xfs_btree.h"
+#include "xfs_trans.h"
+#include "xfs_alloc.h"
+#include "xfs_bmap.h"
+#include "xfs_bmap_util.h"
+#include "xfs_error.h"
+#include "xfs_quota.h"
+#include "xfs_trans_space.h"
+#include "xfs_dinode.h"
+#include "xfs_refcount.h"
+#include "xfs_refcount_btree.h"
+#include "xfs_reflink.h"
+
+#include <linux/pagemap.h>
+
+/*
+ * Copy on write data sharing.
+ *
+ * Data blocks may be owned by more than one file.  The refcount btree of
+ * each AG records how many owners its shared blocks have; a block that is
+ * not in the tree has a single owner.  Files that may share blocks have
+ * XFS_DIFLAG2_REFLINK set.
+ *
+ * Cloning a range maps the blocks of the source into the destination and
+ * bumps their reference counts; no data is copied.  Unmapping the blocks
+ * of a reflinked file drops a reference and frees the blocks left without
+ * owners, see xfs_bmap_finish().
+ *
+ * Before shared blocks are written, the writer unshares them: it allocates
+ * new blocks, copies the data over, and remaps the file range to the new
+ * blocks, dropping its reference to the old ones.  All of this is done
+ * synchronously before the write goes ahead, so the rest of the write
+ * path never sees shared blocks.  If we crash after the new blocks are
+ * allocated and before they are mapped, they are leaked.
+ */
+
+/* Amount of data copied per I/O when unsharing blocks. */
+#define XFS_REFLINK_COPY_BYTES	(1024 * 1024)
+
+/*
+ * Copy len blocks of file data from oldfsb to newfsb.
+ */
+STATIC int
+xfs_reflink_copy_blocks(
+	struct xfs_mount	*mp,
+	xfs_fsblock_t		oldfsb,
+	xfs_fsblock_t		newfsb,
+	xfs_extlen_t		len)
+{
+	struct xfs_buf		*bp;
+	xfs_extlen_t		chunk;
+	int			error;
+
+	while (len > 0) {
+		chunk = min_t(xfs_extlen_t, len,
+			      XFS_B_TO_FSBT(mp, XFS_REFLINK_COPY_BYTES));
+
+		error = xfs_buf_read_uncached(mp->m_ddev_targp,
+				XFS_FSB_TO_DADDR(mp, oldfsb),
+				XFS_FSB_TO_BB(mp, chunk), 0, &bp, NULL);
+		if (error)
+			return error;
+
+		XFS_BUF_SET_ADDR(bp, XFS_FSB_TO_DADDR(mp, newfsb));
+		error = xfs_bwrite(bp);
+		xfs_buf_relse(bp);
+		if (error)
+			return error;
+
+		oldfsb += chunk;
+		newfsb += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+/*
+ * Point the buffer heads of cached pages over [offset_fsb, offset_fsb + len)
+ * at the blocks the range was remapped to.  The pages are clean: shared
+ * blocks are unshared before their pages are dirtied.
+ */
+STATIC void
+xfs_reflink_remap_pages(
+	struct xfs_inode	*ip,
+	xfs_fileoff_t		offset_fsb,
+	xfs_fsblock_t		newfsb,
+	xfs_filblks_t		len)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct inode		*inode = VFS_I(ip);
+	struct buffer_head	*bh, *head;
+	struct page		*page;
+	xfs_fileoff_t		fsb;
+	pgoff_t			index, last;
+
+	index = XFS_FSB_TO_B(mp, offset_fsb) >> PAGE_CACHE_SHIFT;
+	last = (XFS_FSB_TO_B(mp, offset_fsb + len) - 1) >> PAGE_CACHE_SHIFT;
+
+	for (; index <= last; index++) {
+		page = find_lock_page(inode->i_mapping, index);
+		if (!page)
+			continue;
+		if (page_has_buffers(page)) {
+			fsb = XFS_B_TO_FSBT(mp, page_offset(page));
+			bh = head = page_buffers(page);
+			do {
+				if (buffer_mapped(bh) && fsb >= offset_fsb &&
+				    fsb < offset_fsb + len)
+					bh->b_blocknr = XFS_FSB_TO_DADDR(mp,
+							newfsb + fsb - offset_fsb) >>
+						(inode->i_blkbits - BBSHIFT);
+				fsb++;
+			} while ((bh = bh->b_this_page) != head);
+		}
+		unlock_page(page);
+		page_cache_release(page);
+	}
+}
+
+/*
+ * Free blocks that were allocated for unsharing but never mapped.
+ */
+STATIC int
+xfs_reflink_free_blocks(
+	struct xfs_inode	*ip,
+	xfs_fsblock_t		fsb,
+	xfs_extlen_t		len)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_trans	*tp;
+	struct xfs_bmap_free	free_list;
+	xfs_fsblock_t		firstfsb;
+	int			committed;
+	int			error;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_write, 0, 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	xfs_bmap_init(&free_list, &firstfsb);
+	xfs_bmap_add_free(fsb, len, &free_list, mp);
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error) {
+		xfs_bmap_cancel(&free_list);
+		xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+		return error;
+	}
+	return xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+}
+
+/*
+ * Give the file range starting at offset_fsb, currently mapped to len
+ * shared blocks at oldfsb, blocks of its own.  Some or all of the range
+ * may be left shared; the caller looks at the mapping again and calls us
+ * for what is left.
+ */
+STATIC int
+xfs_reflink_unshare_extent(
+	struct xfs_inode	*ip,
+	xfs_fileoff_t		offset_fsb,
+	xfs_fsblock_t		oldfsb,
+	xfs_extlen_t		len,
+	xfs_exntst_t		state)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_trans	*tp;
+	struct xfs_alloc_arg	args;
+	struct xfs_bmap_free	free_list;
+	struct xfs_bmbt_irec	imap;
+	xfs_fsblock_t		firstfsb;
+	xfs_fsblock_t		newfsb;
+	xfs_extlen_t		alen;
+	int			committed;
+	int			nimaps;
+	int			done;
+	int			error;
+
+	/*
+	 * Allocate the new blocks as close to the old ones as we can, in a
+	 * transaction of their own so that no locks are held while we copy
+	 * the data.
+	 */
+	tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_write,
+				  XFS_DIOSTRAT_SPACE_RES(mp, len), 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.tp = tp;
+	args.mp = mp;
+	args.type = XFS_ALLOCTYPE_START_BNO;
+	args.fsbno = oldfsb;
+	args.minlen = 1;
+	args.maxlen = len;
+	args.prod = 1;
+	args.alignment = 1;
+	args.total = len;
+	args.userdata = XFS_ALLOC_USERDATA;
+	error = xfs_alloc_vextent(&args);
+	if (!error && args.fsbno == NULLFSBLOCK)
+		error = -ENOSPC;
+	if (error) {
+		xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+		return error;
+	}
+	newfsb = args.fsbno;
+	len = args.len;
+
+	error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+	if (error)
+		return error;
+
+	/* Unwritten extents read back as zeroes, there's nothing to copy. */
+	if (state == XFS_EXT_NORM) {
+		error = xfs_reflink_copy_blocks(mp, oldfsb, newfsb, len);
+		if (error)
+			goto out_free;
+	}
+
+	/*
+	 * Swap the new blocks in for the old ones.  Dropping our reference
+	 * to the old blocks is done by xfs_bmap_finish() once they are
+	 * unmapped.
+	 */
+	tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_write,
+			2 * XFS_EXTENTADD_SPACE_RES(mp, XFS_DATA_FORK) +
+			XFS_REFCOUNT_SPACE_RES(mp), 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		goto out_free;
+	}
+
+	xfs_ilock(ip, XFS_ILOCK_EXCL);
+	xfs_trans_ijoin(tp, ip, 0);
+	xfs_bmap_init(&free_list, &firstfsb);
+
+	/*
+	 * The mapping may have changed while we copied the data; if so we
+	 * give the new blocks back and let the caller look again.
+	 */
+	nimaps = 1;
+	error = xfs_bmapi_read(ip, offset_fsb, len, &imap, &nimaps, 0);
+	if (error)
+		goto out_cancel;
+	if (imap.br_startoff != offset_fsb || imap.br_startblock != oldfsb ||
+	    imap.br_state != state)
+		alen = 0;
+	else
+		alen = min_t(xfs_filblks_t, len, imap.br_blockcount);
+	if (alen < len)
+		xfs_bmap_add_free(newfsb + alen, len - alen, &free_list, mp);
+
+	if (alen) {
+		error = xfs_bunmapi(tp, ip, offset_fsb, alen, 0, 1, &firstfsb,
+				    &free_list, &done);
+		if (error)
+			goto out_bmap_cancel;
+		ASSERT(done);
+
+		error = xfs_bmapi_remap(tp, ip, offset_fsb, alen, newfsb,
+					state, &firstfsb, &free_list);
+		if (error)
+			goto out_bmap_cancel;
+	}
+
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error)
+		goto out_bmap_cancel;
+
+	error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	if (error)
+		return error;
+
+	if (alen)
+		xfs_reflink_remap_pages(ip, offset_fsb, newfsb, alen);
+	return 0;
+
+out_bmap_cancel:
+	xfs_bmap_cancel(&free_list);
+out_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	return error;
+
+out_free:
+	xfs_reflink_free_blocks(ip, newfsb, len);
+	return error;
+}
+
+/*
+ * Make sure the byte range [offset, offset + count) of a reflinked file is
+ * not mapped to shared blocks, so that it can be written in place.  The
+ * caller holds the iolock.
+ */
+int
+xfs_reflink_unshare(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	xfs_off_t		count)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_bmbt_irec	imap;
+	xfs_fileoff_t		offset_fsb;
+	xfs_fileoff_t		end_fsb;
+	xfs_agnumber_t		agno;
+	xfs_agblock_t		agbno;
+	xfs_agblock_t		fbno;
+	xfs_extlen_t		flen;
+	uint			lock_mode;
+	int			nimaps;
+	int			error;
+
+	if (!xfs_is_reflink_inode(ip) || count <= 0)
+		return 0;
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return -EIO;
+
+	offset_fsb = XFS_B_TO_FSBT(mp, offset);
+	end_fsb = XFS_B_TO_FSB(mp, offset + count);
+
+	while (offset_fsb < end_fsb) {
+		lock_mode = xfs_ilock_data_map_shared(ip);
+		nimaps = 1;
+		error = xfs_bmapi_read(ip, offset_fsb, end_fsb - offset_fsb,
+				       &imap, &nimaps, 0);
+		xfs_iunlock(ip, lock_mode);
+		if (error)
+			return error;
+		ASSERT(nimaps == 1);
+
+		if (imap.br_startblock == HOLESTARTBLOCK ||
+		    imap.br_startblock == DELAYSTARTBLOCK) {
+			offset_fsb = imap.br_startoff + imap.br_blockcount;
+			continue;
+		}
+
+		agno = XFS_FSB_TO_AGNO(mp, imap.br_startblock);
+		agbno = XFS_FSB_TO_AGBNO(mp, imap.br_startblock);
+		error = xfs_refcount_find_shared(mp, agno, agbno,
+				imap.br_blockcount, &fbno, &flen);
+		if (error)
+			return error;
+		if (fbno == NULLAGBLOCK) {
+			offset_fsb = imap.br_startoff + imap.br_blockcount;
+			continue;
+		}
+
+		error = xfs_reflink_unshare_extent(ip,
+				imap.br_startoff + (fbno - agbno),
+				XFS_AGB_TO_FSB(mp, agno, fbno), flen,
+				imap.br_state);
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+/*
+ * Mark both inodes as possibly sharing blocks.  The flag is never cleared.
+ */
+STATIC int
+xfs_reflink_set_inode_flag(
+	struct xfs_inode	*src,
+	struct xfs_inode	*dest)
+{
+	struct xfs_mount	*mp = src->i_mount;
+	struct xfs_trans	*tp;
+	int			error;
+
+	if (xfs_is_reflink_inode(src) && xfs_is_reflink_inode(dest))
+		return 0;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_SETATTR_NOT_SIZE);
+	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_ichange, 0, 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	if (src == dest)
+		xfs_ilock(src, XFS_ILOCK_EXCL);
+	else
+		xfs_lock_two_inodes(src, dest, XFS_ILOCK_EXCL);
+
+	src->i_d.di_flags2 |= XFS_DIFLAG2_REFLINK;
+	xfs_trans_ijoin(tp, src, XFS_ILOCK_EXCL);
+	xfs_trans_log_inode(tp, src, XFS_ILOG_CORE);
+	if (src != dest) {
+		dest->i_d.di_flags2 |= XFS_DIFLAG2_REFLINK;
+		xfs_trans_ijoin(tp, dest, XFS_ILOCK_EXCL);
+		xfs_trans_log_inode(tp, dest, XFS_ILOG_CORE);
+	}
+	return xfs_trans_commit(tp, 0);
+}
+
+/*
+ * Map the source extent imap into dest at destoff_fsb, which is a hole,
+ * taking a reference to its blocks.
+ */
+STATIC int
+xfs_reflink_remap_extent(
+	struct xfs_inode	*dest,
+	struct xfs_bmbt_irec	*imap,
+	xfs_fileoff_t		destoff_fsb)
+{
+	struct xfs_mount	*mp = dest->i_mount;
+	struct xfs_trans	*tp;
+	struct xfs_bmap_free	free_list;
+	xfs_fsblock_t		firstfsb;
+	xfs_fsblock_t		fsb = imap->br_startblock;
+	xfs_filblks_t		len = imap->br_blockcount;
+	xfs_extlen_t		done;
+	int			committed;
+	int			error;
+
+	error = xfs_qm_dqattach(dest, 0);
+	if (error)
+		return error;
+
+	while (len > 0) {
+		tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+		error = xfs_trans_reserve(tp, &M_RES(mp)->tr_write,
+				XFS_EXTENTADD_SPACE_RES(mp, XFS_DATA_FORK) +
+				XFS_REFCOUNT_SPACE_RES(mp), 0);
+		if (error) {
+			xfs_trans_cancel(tp, 0);
+			return error;
+		}
+
+		xfs_ilock(dest, XFS_ILOCK_EXCL);
+		error = xfs_trans_reserve_quota_nblks(tp, dest, len, 0,
+						      XFS_QMOPT_RES_REGBLKS);
+		if (error)
+			goto out_cancel;
+		xfs_trans_ijoin(tp, dest, 0);
+		xfs_bmap_init(&free_list, &firstfsb);
+
+		error = xfs_refcount_increase_extent(tp, fsb, len, &done);
+		if (error)
+			goto out_cancel;
+
+		/*
+		 * The refcount btree update locked the AGF of the shared
+		 * blocks, so bmap btree blocks must come from that AG or a
+		 * higher one.
+		 */
+		firstfsb = fsb;
+		error = xfs_bmapi_remap(tp, dest, destoff_fsb, done, fsb,
+					imap->br_state, &firstfsb, &free_list);
+		if (error)
+			goto out_bmap_cancel;
+
+		error = xfs_bmap_finish(&tp, &free_list, &committed);
+		if (error)
+			goto out_bmap_cancel;
+
+		error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+		xfs_iunlock(dest, XFS_ILOCK_EXCL);
+		if (error)
+			return error;
+
+		fsb += done;
+		destoff_fsb += done;
+		len -= done;
+	}
+	return 0;
+
+out_bmap_cancel:
+	xfs_bmap_cancel(&free_list);
+out_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	xfs_iunlock(dest, XFS_ILOCK_EXCL);
+	return error;
+}
+
+/*
+ * Extend dest to newsize if it is shorter, and update its timestamps.
+ */
+STATIC int
+xfs_reflink_update_dest(
+	struct xfs_inode	*dest,
+	xfs_off_t		newsize)
+{
+	struct xfs_mount	*mp = dest->i_mount;
+	struct xfs_trans	*tp;
+	int			error;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_SETATTR_SIZE);
+	error = xfs_trans_reserve(tp, &M_RES(mp)->tr_ichange, 0, 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	xfs_ilock(dest, XFS_ILOCK_EXCL);
+	xfs_trans_ijoin(tp, dest, XFS_ILOCK_EXCL);
+
+	if (newsize > i_size_read(VFS_I(dest))) {
+		i_size_write(VFS_I(dest), newsize);
+		dest->i_d.di_size = newsize;
+	}
+	xfs_trans_ichgtime(tp, dest, XFS_ICHGTIME_MOD | XFS_ICHGTIME_CHG);
+	xfs_trans_log_inode(tp, dest, XFS_ILOG_CORE);
+
+	return xfs_trans_commit(tp, 0);
+}
+
+/*
+ * Make the len bytes of dest at destoff share the blocks of the len bytes
+ * of src at srcoff, replacing whatever dest had there.  A len of zero
+ * means up to the end of src.  The offsets must be block aligned, and so
+ * must len unless the range ends at the end of src.
+ */
+int
+xfs_reflink_remap_range(
+	struct xfs_inode	*src,
+	xfs_off_t		srcoff,
+	struct xfs_inode	*dest,
+	xfs_off_t		destoff,
+	xfs_off_t		len)
+{
+	struct xfs_mount	*mp = src->i_mount;
+	struct xfs_bmbt_irec	imap;
+	xfs_fileoff_t		srcoff_fsb;
+	xfs_fileoff_t		end_fsb;
+	xfs_off_t		isize;
+	xfs_off_t		blen;
+	uint			lock_mode;
+	int			nimaps;
+	int			error;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return -EOPNOTSUPP;
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return -EIO;
+	if (src->i_mount != dest->i_mount)
+		return -EXDEV;
+	if (XFS_IS_REALTIME_INODE(src) || XFS_IS_REALTIME_INODE(dest))
+		return -EINVAL;
+	if (srcoff < 0 || destoff < 0 || len < 0)
+		return -EINVAL;
+
+	if (src == dest)
+		xfs_ilock(src, XFS_IOLOCK_EXCL);
+	else
+		xfs_lock_two_inodes(src, dest, XFS_IOLOCK_EXCL);
+
+	error = -EINVAL;
+	isize = i_size_read(VFS_I(src));
+	if (srcoff > isize)
+		goto out_unlock;
+	if (len == 0)
+		len = isize - srcoff;
+	if (len > isize - srcoff || destoff + len < destoff)
+		goto out_unlock;
+	if (len == 0) {
+		error = 0;
+		goto out_unlock;
+	}
+
+	/*
+	 * Only the tail block of src can be shared partially, and only if
+	 * the data in dest past the end of the range goes away with it.
+	 */
+	if ((srcoff | destoff) & (mp->m_sb.sb_blocksize - 1))
+		goto out_unlock;
+	blen = len;
+	if (len & (mp->m_sb.sb_blocksize - 1)) {
+		if (srcoff + len != isize ||
+		    destoff + len < i_size_read(VFS_I(dest)))
+			goto out_unlock;
+		blen = XFS_FSB_TO_B(mp, XFS_B_TO_FSB(mp, len));
+	}
+
+	if (src == dest && srcoff < destoff + blen && destoff < srcoff + blen)
+		goto out_unlock;
+
+	inode_dio_wait(VFS_I(src));
+	if (src != dest)
+		inode_dio_wait(VFS_I(dest));
+
+	error = xfs_reflink_set_inode_flag(src, dest);
+	if (error)
+		goto out_unlock;
+
+	/*
+	 * Get the source data onto disk, and clear out the blocks dest has
+	 * in the range now.
+	 */
+	error = filemap_write_and_wait_range(VFS_I(src)->i_mapping, srcoff,
+					     srcoff + len - 1);
+	if (error)
+		goto out_unlock;
+	error = xfs_free_file_space(dest, destoff, blen);
+	if (error)
+		goto out_unlock;
+
+	srcoff_fsb = XFS_B_TO_FSBT(mp, srcoff);
+	end_fsb = srcoff_fsb + XFS_B_TO_FSB(mp, blen);
+	while (srcoff_fsb < end_fsb) {
+		if (fatal_signal_pending(current)) {
+			error = -EINTR;
+			goto out_unlock;
+		}
+
+		lock_mode = xfs_ilock_data_map_shared(src);
+		nimaps = 1;
+		error = xfs_bmapi_read(src, srcoff_fsb, end_fsb - srcoff_fsb,
+				       &imap, &nimaps, 0);
+		xfs_iunlock(src, lock_mode);
+		if (error)
+			goto out_unlock;
+		ASSERT(nimaps == 1);
+
+		if (imap.br_startblock != HOLESTARTBLOCK &&
+		    imap.br_startblock != DELAYSTARTBLOCK) {
+			error = xfs_reflink_remap_extent(dest, &imap,
+					XFS_B_TO_FSBT(mp, destoff) +
+					imap.br_startoff -
+					XFS_B_TO_FSBT(mp, srcoff));
+			if (error)
+				goto out_unlock;
+		}
+		srcoff_fsb = imap.br_startoff + imap.br_blockcount;
+	}
+
+	error = xfs_reflink_update_dest(dest, destoff + len);
+
+out_unlock:
+	xfs_iunlock(src, XFS_IOLOCK_EXCL);
+	if (src != dest)
+		xfs_iunlock(dest, XFS_IOLOCK_EXCL);
+	return error;
+}
+
+/*
+ * Clone a range between two open files for the clone ioctls and
+ * copy_file_range.
+ */
+int
+xfs_reflink_clone_file(
+	struct file		*src_file,
+	loff_t			srcoff,
+	struct file		*dest_file,
+	loff_t			destoff,
+	u64			len)
+{
+	struct inode		*src = file_inode(src_file);
+	struct inode		*dest = file_inode(dest_file);
+	int			error;
+
+	if (!S_ISREG(src->i_mode) || !S_ISREG(dest->i_mode))
+		return -EINVAL;
+	if (IS_IMMUTABLE(dest) || IS_APPEND(dest))
+		return -EPERM;
+	if (len > LLONG_MAX)
+		return -EINVAL;
+
+	mutex_lock(&dest->i_mutex);
+	error = file_remove_suid(dest_file);
+	mutex_unlock(&dest->i_mutex);
+	if (error)
+		return error;
+
+	return xfs_reflink_remap_range(XFS_I(src), srcoff, XFS_I(dest),
+				       destoff, len);
+}
@@ -35,6 +35,12 @@ struct kiocb {
 	kiocb_cancel_fn		*ki_cancel;
 	void			*private;
 
+	/*
+	 * Set by in-kernel submitters that want the result of an async
+	 * request delivered to them instead of to an aio ring.
+	 */
+	void (*ki_complete)(struct kiocb *iocb, long ret, long ret2);
+
 	union {
 		void __user		*user;
 		struct task_struct	*tsk;
@@ -56,7 +62,7 @@ struct kiocb {
 
 static inline bool is_sync_kiocb(struct kiocb *kiocb)
 {
-	return kiocb->ki_ctx == NULL;
+	return kiocb->ki_ctx == NULL && !kiocb->ki_complete;
 }
 
 static inline void init_sync_kiocb(struct kiocb *kiocb, struct file *filp)
@@ -79,7 +85,11 @@ extern long do_io_submit(aio_context_t ctx_id, long nr,
 void kiocb_set_cancel_fn(struct kiocb *req, kiocb_cancel_fn *cancel);
 #else
 static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
-static inline void aio_complete(struct kiocb *iocb, long res, long res2) { }
+static inline void aio_complete(struct kiocb *iocb, long res, long res2)
+{
+	if (iocb->ki_complete)
+		iocb->ki_complete(iocb, res, res2);
+}
 struct mm_struct;
 static inline void exit_aio(struct mm_struct *mm) { }
 static inline long do_io_submit(aio_context_t ctx_id, long nr,
@@ -19,6 +19,7 @@
 #include <linux/atomic.h>
 #include <linux/sysctl.h>
 #include <linux/workqueue.h>
+#include <linux/radix-tree.h>
 
 struct page;
 struct device;
@@ -55,7 +56,21 @@ struct bdi_writeback {
 	struct list_head b_dirty;	/* dirty inodes */
 	struct list_head b_io;		/* parked for writeback */
 	struct list_head b_more_io;	/* parked for more writeback */
+	struct list_head b_dirty_time;	/* time stamps are dirty */
 	spinlock_t list_lock;		/* protects the b_* lists */
+
+#ifdef CONFIG_CGROUP_WRITEBACK
+	/*
+	 * Only used by the per-blkcg writebacks hanging off bdi->cgwb_tree;
+	 * the bdi's own wb has a NULL blkcg_css.
+	 */
+	struct cgroup_subsys_state *blkcg_css;	/* the blkcg we write for */
+	struct list_head cgwb_node;	/* on the global cgwb list */
+	atomic_t refcnt;		/* users walking the bdi's cgwbs */
+	bool dying;			/* no more wakeups, under bdi->wb_lock */
+	bool dead;			/* lists moved to bdi->wb, under list_lock */
+	struct rcu_head rcu;
+#endif
 };
 
 struct backing_dev_info {
@@ -96,6 +111,10 @@ struct backing_dev_info {
 
 	struct list_head work_list;
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct radix_tree_root cgwb_tree; /* blkcg css id -> bdi_writeback */
+#endif
+
 	struct device *dev;
 
 	struct timer_list laptop_mode_wb_timer;
@@ -122,6 +141,27 @@ void bdi_writeback_workfn(struct work_struct *work);
 int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi);
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * bdi_init() and bdi_destroy() call these to set up and tear down the
+ * per-blkcg writebacks of @bdi.  Teardown hands every dirty inode over to
+ * bdi->wb, so bdi_destroy() must call it before dealing with bdi->wb.
+ */
+void bdi_cgwb_init(struct backing_dev_info *bdi);
+void bdi_cgwb_destroy(struct backing_dev_info *bdi);
+void wb_blkcg_offline(struct cgroup_subsys_state *blkcg_css);
+#else
+static inline void bdi_cgwb_init(struct backing_dev_info *bdi)
+{
+}
+static inline void bdi_cgwb_destroy(struct backing_dev_info *bdi)
+{
+}
+static inline void wb_blkcg_offline(struct cgroup_subsys_state *blkcg_css)
+{
+}
+#endif
+
 extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
 
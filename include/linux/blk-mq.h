@@ -38,6 +38,7 @@ struct blk_mq_hw_ctx {
 	struct blk_flush_queue	*fq;
 
 	void			*driver_data;
+	void			*sched_data;	/* io scheduler private */
 
 	struct blk_mq_ctxmap	ctx_map;
 
@@ -58,6 +59,10 @@ struct blk_mq_hw_ctx {
 
 	atomic_t		nr_active;
 
+	unsigned long		poll_considered;
+	unsigned long		poll_invoked;
+	unsigned long		poll_success;
+
 	struct blk_mq_cpu_notifier	cpu_notifier;
 	struct kobject		kobj;
 };
@@ -89,6 +94,8 @@ typedef int (init_request_fn)(void *, struct request *, unsigned int,
 typedef void (exit_request_fn)(void *, struct request *, unsigned int,
 		unsigned int);
 
+typedef int (poll_fn)(struct blk_mq_hw_ctx *, unsigned int);
+
 typedef void (busy_iter_fn)(struct blk_mq_hw_ctx *, struct request *, void *,
 		bool);
 
@@ -110,6 +117,13 @@ struct blk_mq_ops {
 
 	softirq_done_fn		*complete;
 
+	/*
+	 * Called to reap completions from the hardware queue without
+	 * waiting for an interrupt. Returns > 0 if the passed in tag was
+	 * completed, 0 if it should be called again, and < 0 to give up.
+	 */
+	poll_fn			*poll;
+
 	/*
 	 * Called when the block layer side of a hardware queue has been
 	 * set up, allowing the driver to allocate/init matching structures.
@@ -187,6 +201,8 @@ void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async);
 void blk_mq_delay_queue(struct blk_mq_hw_ctx *hctx, unsigned long msecs);
 void blk_mq_tag_busy_iter(struct blk_mq_hw_ctx *hctx, busy_iter_fn *fn,
 		void *priv);
+void blk_mq_freeze_queue(struct request_queue *q);
+void blk_mq_unfreeze_queue(struct request_queue *q);
 
 /*
  * Driver command data is immediately after the request. So subtract request
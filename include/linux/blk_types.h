@@ -28,6 +28,34 @@ struct bio_vec {
 
 #ifdef CONFIG_BLOCK
 
+/*
+ * Identifies the hardware queue and tag a bio was issued with, so the
+ * submitter can poll that queue for its completion.
+ */
+typedef unsigned int blk_qc_t;
+#define BLK_QC_T_NONE		-1U
+#define BLK_QC_T_SHIFT		16
+
+static inline bool blk_qc_t_valid(blk_qc_t cookie)
+{
+	return cookie != BLK_QC_T_NONE;
+}
+
+static inline blk_qc_t blk_tag_to_qc_t(unsigned int tag, unsigned int queue_num)
+{
+	return tag | (queue_num << BLK_QC_T_SHIFT);
+}
+
+static inline unsigned int blk_qc_t_to_queue_num(blk_qc_t cookie)
+{
+	return cookie >> BLK_QC_T_SHIFT;
+}
+
+static inline unsigned int blk_qc_t_to_tag(blk_qc_t cookie)
+{
+	return cookie & ((1u << BLK_QC_T_SHIFT) - 1);
+}
+
 struct bvec_iter {
 	sector_t		bi_sector;	/* device address in 512 byte
 						   sectors */
@@ -77,6 +105,10 @@ struct bio {
 	 */
 	struct io_context	*bi_ioc;
 	struct cgroup_subsys_state *bi_css;
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+	void			*bi_cg_private;	/* throtl_grp tracking the bio */
+	u64			bi_issue_time;	/* usecs, for blk-throttle */
+#endif
 #endif
 	union {
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -86,6 +118,8 @@ struct bio {
 
 	unsigned short		bi_vcnt;	/* how many bio_vec's */
 
+	blk_qc_t		bi_cookie;	/* where to poll for completion */
+
 	/*
 	 * Everything starting with bi_max_vecs will be preserved by bio_reset()
 	 */
@@ -190,6 +224,7 @@ enum rq_flag_bits {
 	__REQ_PM,		/* runtime pm request */
 	__REQ_HASHED,		/* on IO scheduler merge hash */
 	__REQ_MQ_INFLIGHT,	/* track inflight for MQ */
+	__REQ_WB_TRACKED,	/* counted by the writeback throttle */
 	__REQ_NR_BITS,		/* stops here */
 };
 
@@ -243,5 +278,6 @@ enum rq_flag_bits {
 #define REQ_PM			(1ULL << __REQ_PM)
 #define REQ_HASHED		(1ULL << __REQ_HASHED)
 #define REQ_MQ_INFLIGHT		(1ULL << __REQ_MQ_INFLIGHT)
+#define REQ_WB_TRACKED		(1ULL << __REQ_WB_TRACKED)
 
 #endif /* __LINUX_BLK_TYPES_H */
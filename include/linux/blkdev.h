@@ -29,6 +29,7 @@ struct module;
 struct scsi_ioctl_command;
 
 struct request_queue;
+struct rq_wb;
 struct elevator_queue;
 struct request_pm_state;
 struct blk_trace;
@@ -37,6 +38,7 @@ struct sg_io_hdr;
 struct bsg_job;
 struct blkcg_gq;
 struct blk_flush_queue;
+struct cgroup_subsys_state;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -198,6 +200,7 @@ struct request {
 
 	unsigned long deadline;
 	struct list_head timeout_list;
+	u64 issue_time_ns;	/* when issued, on queues that poll */
 	unsigned int timeout;
 	int retries;
 
@@ -484,6 +487,16 @@ struct request_queue {
 
 	struct blk_mq_tag_set	*tag_set;
 	struct list_head	tag_set_list;
+
+	/*
+	 * Polled completions: how long to sleep before polling (-1 for no
+	 * sleep, 0 for half the mean completion time), and the mean
+	 * completion time of polled reads and writes.
+	 */
+	int			poll_nsec;
+	u64			poll_mean_nsec[2];
+
+	struct rq_wb		*rq_wb;
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -509,6 +522,7 @@ struct request_queue {
 #define QUEUE_FLAG_INIT_DONE   20	/* queue is initialized */
 #define QUEUE_FLAG_NO_SG_MERGE 21	/* don't attempt to merge SG segments*/
 #define QUEUE_FLAG_SG_GAPS     22	/* queue doesn't support SG gaps */
+#define QUEUE_FLAG_POLL	       23	/* IO polling enabled if set */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -516,6 +530,7 @@ struct request_queue {
 				 (1 << QUEUE_FLAG_ADD_RANDOM))
 
 #define QUEUE_FLAG_MQ_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
+				 (1 << QUEUE_FLAG_STACKABLE) |		\
 				 (1 << QUEUE_FLAG_SAME_COMP))
 
 static inline void queue_lockdep_assert_held(struct request_queue *q)
@@ -586,6 +601,7 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_bypass(q)	test_bit(QUEUE_FLAG_BYPASS, &(q)->queue_flags)
 #define blk_queue_init_done(q)	test_bit(QUEUE_FLAG_INIT_DONE, &(q)->queue_flags)
 #define blk_queue_nomerges(q)	test_bit(QUEUE_FLAG_NOMERGES, &(q)->queue_flags)
+#define blk_queue_poll(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
 #define blk_queue_noxmerges(q)	\
 	test_bit(QUEUE_FLAG_NOXMERGES, &(q)->queue_flags)
 #define blk_queue_nonrot(q)	test_bit(QUEUE_FLAG_NONROT, &(q)->queue_flags)
@@ -1106,6 +1122,7 @@ extern struct blk_plug_cb *blk_check_plugged(blk_plug_cb_fn unplug,
 extern void blk_start_plug(struct blk_plug *);
 extern void blk_finish_plug(struct blk_plug *);
 extern void blk_flush_plug_list(struct blk_plug *, bool);
+extern bool blk_poll(struct request_queue *q, blk_qc_t cookie);
 
 static inline void blk_flush_plug(struct task_struct *tsk)
 {
@@ -1436,6 +1453,8 @@ static inline uint64_t rq_io_start_time_ns(struct request *req)
 {
         return req->io_start_time_ns;
 }
+
+extern struct cgroup_subsys_state *blk_rq_blkcg_css(struct request *req);
 #else
 static inline void set_start_time_ns(struct request *req) {}
 static inline void set_io_start_time_ns(struct request *req) {}
@@ -1447,6 +1466,10 @@ static inline uint64_t rq_io_start_time_ns(struct request *req)
 {
 	return 0;
 }
+static inline struct cgroup_subsys_state *blk_rq_blkcg_css(struct request *req)
+{
+	return NULL;
+}
 #endif
 
 #define MODULE_ALIAS_BLOCKDEV(major,minor) \
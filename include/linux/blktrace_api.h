@@ -21,6 +21,9 @@ struct blk_trace {
 	u64 end_lba;
 	u32 pid;
 	u32 dev;
+	u64 cgroup;		/* blkio cgroup inode number, 0 for any */
+	u64 min_latency;	/* ns, shorter completions are not logged */
+	bool latency_only;	/* log BLK_TA_LATENCY events only */
 	struct dentry *dir;
 	struct dentry *dropped_file;
 	struct dentry *msg_file;
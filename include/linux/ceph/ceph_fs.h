@@ -594,6 +594,14 @@ int ceph_flags_to_mode(int flags);
 #define CEPH_CAP_FLOCK_SHARED  (CEPH_CAP_GSHARED   << CEPH_CAP_SFLOCK)
 #define CEPH_CAP_FLOCK_EXCL    (CEPH_CAP_GEXCL     << CEPH_CAP_SFLOCK)
 
+/*
+ * Directory caps.  The file rd/cache bits mean nothing on a directory;
+ * together with Fx they let the client create or unlink entries
+ * without waiting for the MDS.
+ */
+#define CEPH_CAP_DIR_CREATE    CEPH_CAP_FILE_CACHE
+#define CEPH_CAP_DIR_UNLINK    CEPH_CAP_FILE_RD
+
 
 /* cap masks (for getattr) */
 #define CEPH_STAT_CAP_INODE    CEPH_CAP_PIN
@@ -22,6 +22,7 @@
 #include <linux/seq_file.h>
 #include <linux/kernfs.h>
 #include <linux/wait.h>
+#include <linux/psi_types.h>
 
 #ifdef CONFIG_CGROUPS
 
@@ -88,6 +89,12 @@ struct cgroup_subsys_state {
 	 */
 	u64 serial_nr;
 
+	/*
+	 * Linked on ->cgroup->rstat_css_list if the subsystem implements
+	 * ->css_rstat_flush().  Protected by cgroup_rstat_lock.
+	 */
+	struct list_head rstat_css_node;
+
 	/* percpu_ref killing and RCU release */
 	struct rcu_head rcu_head;
 	struct work_struct destroy_work;
@@ -171,6 +178,23 @@ enum {
 	CGRP_CPUSET_CLONE_CHILDREN,
 };
 
+/*
+ * Per-cpu node of the updated tree used by cgroup_rstat_updated() and
+ * cgroup_rstat_flush().  A cgroup which had its stats updated on a cpu
+ * is linked, together with all its ancestors, on that cpu's tree so
+ * that a flush only visits the cgroups which actually have something
+ * to propagate.
+ *
+ * ->updated_children lists the children which have been updated since
+ * the last flush.  The list is singly linked through ->updated_next and
+ * terminated by the parent itself, so a NULL ->updated_next tells that
+ * the cgroup isn't on the list.
+ */
+struct cgroup_rstat_cpu {
+	struct cgroup *updated_children;	/* terminated by self cgroup */
+	struct cgroup *updated_next;		/* NULL iff not on the list */
+};
+
 struct cgroup {
 	/* self css with NULL ->ss, points back to this cgroup */
 	struct cgroup_subsys_state self;
@@ -241,6 +265,15 @@ struct cgroup {
 
 	/* used to schedule release agent */
 	struct work_struct release_agent_work;
+
+	/* per-cpu updated trees for recursive stats, see cgroup_rstat_*() */
+	struct cgroup_rstat_cpu __percpu *rstat_cpu;
+
+	/* csses to flush, on their ->rstat_css_node, see above */
+	struct list_head rstat_css_list;
+
+	/* used to track pressure stalls */
+	struct psi_group psi;
 };
 
 #define MAX_CGROUP_ROOT_NAMELEN 64
@@ -521,6 +554,15 @@ static inline bool cgroup_on_dfl(const struct cgroup *cgrp)
 	return cgrp->root == &cgrp_dfl_root;
 }
 
+static inline struct cgroup *cgroup_parent(struct cgroup *cgrp)
+{
+	struct cgroup_subsys_state *parent_css = cgrp->self.parent;
+
+	if (parent_css)
+		return container_of(parent_css, struct cgroup, self);
+	return NULL;
+}
+
 /* no synchronization, the result can only be used as a hint */
 static inline bool cgroup_has_tasks(struct cgroup *cgrp)
 {
@@ -586,6 +628,11 @@ int cgroup_rm_cftypes(struct cftype *cfts);
 
 bool cgroup_is_descendant(struct cgroup *cgrp, struct cgroup *ancestor);
 
+void cgroup_rstat_updated(struct cgroup *cgrp, int cpu);
+void cgroup_rstat_flush(struct cgroup *cgrp);
+void cgroup_rstat_flush_hold(struct cgroup *cgrp);
+void cgroup_rstat_flush_release(void);
+
 /*
  * Control Group taskset, used to pass around set of tasks to cgroup_subsys
  * methods.
@@ -614,6 +661,7 @@ struct cgroup_subsys {
 	void (*css_offline)(struct cgroup_subsys_state *css);
 	void (*css_free)(struct cgroup_subsys_state *css);
 	void (*css_reset)(struct cgroup_subsys_state *css);
+	void (*css_rstat_flush)(struct cgroup_subsys_state *css, int cpu);
 
 	int (*allow_attach)(struct cgroup_subsys_state *css,
 			    struct cgroup_taskset *tset);
@@ -300,6 +300,7 @@ struct compat_linux_dirent;
 struct linux_dirent64;
 struct compat_msghdr;
 struct compat_mmsghdr;
+struct mq_msgvec;
 struct compat_sysinfo;
 struct compat_sysctl_args;
 struct compat_kexec_segment;
@@ -659,6 +660,14 @@ asmlinkage ssize_t compat_sys_mq_timedreceive(mqd_t mqdes,
 			char __user *u_msg_ptr,
 			compat_size_t msg_len, unsigned int __user *u_msg_prio,
 			const struct compat_timespec __user *u_abs_timeout);
+asmlinkage long compat_sys_mq_timedsend_batch(mqd_t mqdes,
+			const struct mq_msgvec __user *u_vec,
+			unsigned int vlen, unsigned int flags,
+			const struct compat_timespec __user *u_abs_timeout);
+asmlinkage long compat_sys_mq_timedreceive_batch(mqd_t mqdes,
+			struct mq_msgvec __user *u_vec,
+			unsigned int vlen, unsigned int flags,
+			const struct compat_timespec __user *u_abs_timeout);
 asmlinkage long compat_sys_socketcall(int call, u32 __user *args);
 asmlinkage long compat_sys_sysctl(struct compat_sysctl_args __user *args);
 
@@ -72,6 +72,8 @@ enum {
 	/* bring up workqueues before normal notifiers and down after */
 	CPU_PRI_WORKQUEUE_UP	= 5,
 	CPU_PRI_WORKQUEUE_DOWN	= -5,
+	/* retarget managed irqs after the queue maps have been rebuilt */
+	CPU_PRI_IRQ_AFFINITY	= -10,
 };
 
 #define CPU_ONLINE		0x0002 /* CPU (unsigned)v is up */
@@ -61,7 +61,8 @@ struct dentry_stat_t {
 	long nr_unused;
 	long age_limit;          /* age in seconds */
 	long want_pages;         /* pages requested by system */
-	long dummy[2];
+	long nr_negative;        /* # of unused negative dentries */
+	long dummy;
 };
 extern struct dentry_stat_t dentry_stat;
 
@@ -123,7 +124,10 @@ struct dentry {
 	unsigned long d_time;		/* used by d_revalidate */
 	void *d_fsdata;			/* fs-specific data */
 
-	struct list_head d_lru;		/* LRU list */
+	union {
+		struct list_head d_lru;		/* LRU list */
+		struct hlist_bl_node d_in_lookup_hash;	/* only for in-lookup ones */
+	};
 	/*
 	 * d_child and d_rcu can share memory
 	 */
@@ -222,6 +226,8 @@ struct dentry_operations {
 #define DCACHE_FILE_TYPE		0x00400000 /* Other file type */
 
 #define DCACHE_MAY_FREE			0x00800000
+#define DCACHE_PAR_LOOKUP		0x01000000 /* being looked up without i_mutex */
+#define DCACHE_NEGATIVE_LRU		0x02000000 /* on the negative dentry LRU */
 
 extern seqlock_t rename_lock;
 
@@ -239,6 +245,10 @@ extern void d_set_d_op(struct dentry *dentry, const struct dentry_operations *op
 
 /* allocate/de-allocate */
 extern struct dentry * d_alloc(struct dentry *, const struct qstr *);
+extern struct dentry * d_alloc_parallel(struct dentry *, const struct qstr *);
+extern struct dentry * d_find_in_lookup(struct dentry *, const struct qstr *);
+extern void d_wait_lookup(struct dentry *);
+extern void d_lookup_done(struct dentry *);
 extern struct dentry * d_alloc_pseudo(struct super_block *, const struct qstr *);
 extern struct dentry * d_splice_alias(struct inode *, struct dentry *);
 extern struct dentry * d_add_ci(struct dentry *, struct inode *, struct qstr *);
@@ -463,9 +473,16 @@ static inline bool d_is_positive(const struct dentry *dentry)
 }
 
 extern int sysctl_vfs_cache_pressure;
+extern int sysctl_negative_dentry_limit;
+extern unsigned long sysctl_negative_dentry_sb_max;
 
 static inline unsigned long vfs_pressure_ratio(unsigned long val)
 {
 	return mult_frac(val, sysctl_vfs_cache_pressure, 100);
 }
+static inline bool d_in_lookup(struct dentry *dentry)
+{
+	return dentry->d_flags & DCACHE_PAR_LOOKUP;
+}
+
 #endif	/* __LINUX_DCACHE_H */
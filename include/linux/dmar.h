@@ -147,6 +147,7 @@ static inline int dmar_iommu_notify_scope_dev(struct dmar_pci_notify_info *info)
 
 struct irte {
 	union {
+		/* Remapped mode (pst == 0) */
 		struct {
 			__u64	present 	: 1,
 				fpd		: 1,
@@ -155,20 +156,37 @@ struct irte {
 				trigger_mode	: 1,
 				dlvry_mode	: 3,
 				avail		: 4,
-				__reserved_1	: 4,
+				__reserved_1	: 3,
+				pst		: 1,
 				vector		: 8,
 				__reserved_2	: 8,
 				dest_id		: 32;
 		};
+
+		/* Posted mode (pst == 1) */
+		struct {
+			__u64	p_present	: 1,
+				p_fpd		: 1,
+				p_res0		: 6,
+				p_avail		: 4,
+				p_res1		: 2,
+				p_urgent	: 1,
+				p_pst		: 1,
+				p_vector	: 8,
+				p_res2		: 14,
+				pda_l		: 26;
+		};
 		__u64 low;
 	};
 
 	union {
+		/* Shared between remapped and posted mode */
 		struct {
 			__u64	sid		: 16,
 				sq		: 2,
 				svt		: 2,
-				__reserved_3	: 44;
+				__reserved_3	: 12,
+				pda_h		: 32;
 		};
 		__u64 high;
 	};
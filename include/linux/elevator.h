@@ -8,6 +8,7 @@
 
 struct io_cq;
 struct elevator_type;
+struct blk_mq_hw_ctx;
 
 typedef int (elevator_merge_fn) (struct request_queue *, struct request **,
 				 struct bio *);
@@ -70,6 +71,22 @@ struct elevator_ops
 	elevator_exit_fn *elevator_exit_fn;
 };
 
+/*
+ * Operations of a blk-mq io scheduler. Requests are handed to the
+ * scheduler per hardware queue when that queue is run, and pulled back
+ * out one at a time while the driver has room for them.
+ */
+struct elevator_mq_ops {
+	int (*init_sched)(struct request_queue *, struct elevator_type *);
+	void (*exit_sched)(struct elevator_queue *);
+	int (*init_hctx)(struct blk_mq_hw_ctx *, unsigned int);
+	void (*exit_hctx)(struct blk_mq_hw_ctx *, unsigned int);
+
+	void (*insert_requests)(struct blk_mq_hw_ctx *, struct list_head *, bool);
+	struct request *(*dispatch_request)(struct blk_mq_hw_ctx *);
+	bool (*has_work)(struct blk_mq_hw_ctx *);
+};
+
 #define ELV_NAME_MAX	(16)
 
 struct elv_fs_entry {
@@ -88,6 +105,8 @@ struct elevator_type
 
 	/* fields provided by elevator implementation */
 	struct elevator_ops ops;
+	struct elevator_mq_ops mq_ops;
+	bool uses_mq;		/* scheduler for blk-mq queues */
 	size_t icq_size;	/* see iocontext.h */
 	size_t icq_align;	/* ditto */
 	struct elv_fs_entry *elevator_attrs;
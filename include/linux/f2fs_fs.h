@@ -48,6 +48,19 @@
 /*
  * For superblock
  */
+#define MAX_DEVICES		8	/* # of devices a volume can span */
+#define MAX_PATH_LEN		64	/* length of a device path */
+
+/*
+ * The volume is laid out across the devices in the order they are listed.
+ * The first one holds segment 0 and the metadata areas, and is the one the
+ * volume is mounted from.  An empty first path means a single device.
+ */
+struct f2fs_device {
+	__u8 path[MAX_PATH_LEN];	/* device path */
+	__le32 total_segments;		/* # of segments on the device */
+} __packed;
+
 struct f2fs_super_block {
 	__le32 magic;			/* Magic Number */
 	__le16 major_ver;		/* Major Version */
@@ -81,6 +94,7 @@ struct f2fs_super_block {
 	__le32 extension_count;		/* # of extensions below */
 	__u8 extension_list[F2FS_MAX_EXTENSION][8];	/* extension array */
 	__le32 cp_payload;
+	struct f2fs_device devs[MAX_DEVICES];	/* device list */
 } __packed;
 
 /*
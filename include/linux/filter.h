@@ -20,6 +20,7 @@
 
 struct sk_buff;
 struct sock;
+struct net_device;
 struct seccomp_data;
 struct bpf_prog_aux;
 
@@ -330,6 +331,29 @@ struct sk_filter {
 
 #define BPF_PROG_RUN(filter, ctx)  (*filter->bpf_func)(ctx, filter->insnsi)
 
+/* in-kernel context of BPF_PROG_TYPE_XDP programs, the program itself sees
+ * it as 'struct xdp_md'
+ */
+struct xdp_buff {
+	void *data;
+	void *data_end;
+};
+
+/* run XDP program on a raw receive buffer, called by drivers from their
+ * NAPI poll loop before any sk_buff is allocated
+ */
+static inline u32 bpf_prog_run_xdp(const struct bpf_prog *prog,
+				   struct xdp_buff *xdp)
+{
+	u32 ret;
+
+	rcu_read_lock();
+	ret = BPF_PROG_RUN(prog, (void *)xdp);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 static inline unsigned int bpf_prog_size(unsigned int proglen)
 {
 	return max(sizeof(struct bpf_prog),
@@ -360,6 +384,10 @@ static inline void bpf_prog_unlock_ro(struct bpf_prog *fp)
 
 int sk_filter(struct sock *sk, struct sk_buff *skb);
 
+int xdp_do_tx(struct net_device *dev, struct xdp_buff *xdp, u16 queue_index);
+int xdp_do_redirect(struct net_device *dev, struct xdp_buff *xdp);
+int skb_do_redirect(struct sk_buff *skb);
+
 void bpf_prog_select_runtime(struct bpf_prog *fp);
 void bpf_prog_free(struct bpf_prog *fp);
 
@@ -381,6 +409,8 @@ int bpf_prog_create(struct bpf_prog **pfp, struct sock_fprog_kern *fprog);
 void bpf_prog_destroy(struct bpf_prog *fp);
 
 int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
+int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk);
+int sk_reuseport_attach_bpf(u32 ufd, struct sock *sk);
 int sk_detach_filter(struct sock *sk);
 
 int bpf_check_classic(const struct sock_filter *filter, unsigned int flen);
@@ -63,6 +63,9 @@
 
 #define FS_MOVE			(FS_MOVED_FROM | FS_MOVED_TO)
 
+/* Events which change the name space of a directory */
+#define ALL_FSNOTIFY_DIRENT_EVENTS (FS_CREATE | FS_DELETE | FS_MOVE)
+
 #define ALL_FSNOTIFY_PERM_EVENTS (FS_OPEN_PERM | FS_ACCESS_PERM)
 
 #define ALL_FSNOTIFY_EVENTS (FS_ACCESS | FS_MODIFY | FS_ATTRIB | \
@@ -184,6 +187,7 @@ struct fsnotify_group {
 			atomic_t bypass_perm;
 #endif /* CONFIG_FANOTIFY_ACCESS_PERMISSIONS */
 			int f_flags;
+			unsigned int flags;	/* FAN_REPORT_* init flags */
 			unsigned int max_marks;
 			struct user_struct *user;
 		} fanotify_data;
@@ -214,6 +218,15 @@ struct fsnotify_vfsmount_mark {
 	struct list_head free_m_list;	/* tmp list used when freeing this mark */
 };
 
+/*
+ * Superblock specific fields in an fsnotify_mark
+ */
+struct fsnotify_sb_mark {
+	struct super_block *sb;		/* super block this mark is associated with */
+	struct hlist_node s_list;	/* list of marks by sb->s_fsnotify_marks */
+	struct list_head free_s_list;	/* tmp list used when freeing this mark */
+};
+
 /*
  * a mark is simply an object attached to an in core inode which allows an
  * fsnotify listener to indicate they are either no longer interested in events
@@ -235,6 +248,7 @@ struct fsnotify_mark {
 	union {
 		struct fsnotify_inode_mark i;
 		struct fsnotify_vfsmount_mark m;
+		struct fsnotify_sb_mark s;
 	};
 	__u32 ignored_mask;		/* events types to ignore */
 #define FSNOTIFY_MARK_FLAG_INODE		0x01
@@ -242,7 +256,8 @@ struct fsnotify_mark {
 #define FSNOTIFY_MARK_FLAG_OBJECT_PINNED	0x04
 #define FSNOTIFY_MARK_FLAG_IGNORED_SURV_MODIFY	0x08
 #define FSNOTIFY_MARK_FLAG_ALIVE		0x10
-	unsigned int flags;		/* vfsmount or inode mark? */
+#define FSNOTIFY_MARK_FLAG_SB			0x20
+	unsigned int flags;		/* vfsmount, sb or inode mark? */
 	struct list_head destroy_list;
 	void (*free_mark)(struct fsnotify_mark *mark); /* called on final put+free */
 };
@@ -261,9 +276,13 @@ extern u32 fsnotify_get_cookie(void);
 
 static inline int fsnotify_inode_watches_children(struct inode *inode)
 {
-	/* FS_EVENT_ON_CHILD is set if the inode may care */
+	/*
+	 * FS_EVENT_ON_CHILD is set if the inode may care, name removal is
+	 * reported to the directory regardless since it is an event on the
+	 * directory itself that happens to be generated by the child.
+	 */
 	if (!(inode->i_fsnotify_mask & FS_EVENT_ON_CHILD))
-		return 0;
+		return inode->i_fsnotify_mask & FS_DELETE;
 	/* this inode might care about child events, does it care about the
 	 * specific set of events that can happen on a child? */
 	return inode->i_fsnotify_mask & FS_EVENTS_POSS_ON_CHILD;
@@ -339,6 +358,8 @@ extern struct fsnotify_event *fsnotify_remove_first_event(struct fsnotify_group
 
 /* run all marks associated with a vfsmount and update mnt->mnt_fsnotify_mask */
 extern void fsnotify_recalc_vfsmount_mask(struct vfsmount *mnt);
+/* run all marks associated with a super block and update sb->s_fsnotify_mask */
+extern void fsnotify_recalc_sb_mask(struct super_block *sb);
 /* run all marks associated with an inode and update inode->i_fsnotify_mask */
 extern void fsnotify_recalc_inode_mask(struct inode *inode);
 extern void fsnotify_init_mark(struct fsnotify_mark *mark, void (*free_mark)(struct fsnotify_mark *mark));
@@ -346,6 +367,8 @@ extern void fsnotify_init_mark(struct fsnotify_mark *mark, void (*free_mark)(str
 extern struct fsnotify_mark *fsnotify_find_inode_mark(struct fsnotify_group *group, struct inode *inode);
 /* find (and take a reference) to a mark associated with group and vfsmount */
 extern struct fsnotify_mark *fsnotify_find_vfsmount_mark(struct fsnotify_group *group, struct vfsmount *mnt);
+/* find (and take a reference) to a mark associated with group and super block */
+extern struct fsnotify_mark *fsnotify_find_sb_mark(struct fsnotify_group *group, struct super_block *sb);
 /* copy the values from old into new */
 extern void fsnotify_duplicate_mark(struct fsnotify_mark *new, struct fsnotify_mark *old);
 /* set the ignored_mask of a mark */
@@ -357,6 +380,9 @@ extern int fsnotify_add_mark(struct fsnotify_mark *mark, struct fsnotify_group *
 			     struct inode *inode, struct vfsmount *mnt, int allow_dups);
 extern int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct fsnotify_group *group,
 				    struct inode *inode, struct vfsmount *mnt, int allow_dups);
+/* attach the mark to both the group and the super block */
+extern int fsnotify_add_sb_mark_locked(struct fsnotify_mark *mark, struct fsnotify_group *group,
+				       struct super_block *sb, int allow_dups);
 /* given a group and a mark, flag mark to be freed when all references are dropped */
 extern void fsnotify_destroy_mark(struct fsnotify_mark *mark,
 				  struct fsnotify_group *group);
@@ -364,6 +390,8 @@ extern void fsnotify_destroy_mark_locked(struct fsnotify_mark *mark,
 					 struct fsnotify_group *group);
 /* run all the marks in a group, and clear all of the vfsmount marks */
 extern void fsnotify_clear_vfsmount_marks_by_group(struct fsnotify_group *group);
+/* run all the marks in a group, and clear all of the super block marks */
+extern void fsnotify_clear_sb_marks_by_group(struct fsnotify_group *group);
 /* run all the marks in a group, and clear all of the inode marks */
 extern void fsnotify_clear_inode_marks_by_group(struct fsnotify_group *group);
 /* run all the marks in a group, and clear all of the marks where mark->flags & flags is true*/
@@ -397,6 +425,9 @@ static inline void __fsnotify_inode_delete(struct inode *inode)
 static inline void __fsnotify_vfsmount_delete(struct vfsmount *mnt)
 {}
 
+static inline void __fsnotify_sb_delete(struct super_block *sb)
+{}
+
 static inline void __fsnotify_update_dcache_flags(struct dentry *dentry)
 {}
 
@@ -68,4 +68,21 @@ static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
 #endif
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+extern void futex_hash_allocate_default(void);
+extern void futex_hash_free(struct mm_struct *mm);
+extern int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
+#else
+static inline void futex_hash_allocate_default(void)
+{
+}
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
+#endif
 #endif
@@ -17,6 +17,32 @@
 
 #include <uapi/linux/if_tun.h>
 
+/*
+ * msg_control of a sendmsg() on the socket returned by tun_get_socket():
+ * TUN_MSG_UBUF passes the struct ubuf_info of a zerocopy frame in the
+ * iovec, TUN_MSG_PTR an array of num struct tun_frame instead of one.
+ */
+#define TUN_MSG_UBUF 1
+#define TUN_MSG_PTR  2
+struct tun_msg_ctl {
+	unsigned short type;
+	unsigned short num;
+	void *ptr;
+};
+
+/*
+ * A frame already copied into the kernel, laid out as for a write() on
+ * the device: len bytes at buf + offset.  buf is a page fragment of
+ * buflen bytes with room for struct skb_shared_info behind the frame, so
+ * the skb is built around it.  The receiver owns the page reference.
+ */
+struct tun_frame {
+	void *buf;
+	unsigned int buflen;
+	unsigned int offset;
+	unsigned int len;
+};
+
 #if defined(CONFIG_TUN) || defined(CONFIG_TUN_MODULE)
 struct socket *tun_get_socket(struct file *);
 #else
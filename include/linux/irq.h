@@ -174,6 +174,8 @@ struct irq_data {
  * IRQD_IRQ_MASKED		- Masked state of the interrupt
  * IRQD_IRQ_INPROGRESS		- In progress state of the interrupt
  * IRQD_WAKEUP_ARMED		- Wakeup mode armed
+ * IRQD_AFFINITY_MANAGED	- Affinity is managed by the kernel, not by
+ *				  user space
  */
 enum {
 	IRQD_TRIGGER_MASK		= 0xf,
@@ -188,6 +190,7 @@ enum {
 	IRQD_IRQ_MASKED			= (1 << 17),
 	IRQD_IRQ_INPROGRESS		= (1 << 18),
 	IRQD_WAKEUP_ARMED		= (1 << 19),
+	IRQD_AFFINITY_MANAGED		= (1 << 20),
 };
 
 static inline bool irqd_is_setaffinity_pending(struct irq_data *d)
@@ -264,6 +267,11 @@ static inline bool irqd_is_wakeup_armed(struct irq_data *d)
 	return d->state_use_accessors & IRQD_WAKEUP_ARMED;
 }
 
+static inline bool irqd_affinity_is_managed(struct irq_data *d)
+{
+	return d->state_use_accessors & IRQD_AFFINITY_MANAGED;
+}
+
 
 /*
  * Functions for chained handlers which can be enabled/disabled by the
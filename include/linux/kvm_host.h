@@ -30,6 +30,7 @@
 #include <linux/kvm_para.h>
 
 #include <linux/kvm_types.h>
+#include <linux/kvm_dirty_ring.h>
 
 #include <asm/kvm_host.h>
 
@@ -281,7 +282,10 @@ struct kvm_vcpu {
 	} spin_loop;
 #endif
 	bool preempted;
+	/* how long kvm_vcpu_block() polls before sleeping */
+	unsigned int halt_poll_ns;
 	struct kvm_vcpu_arch arch;
+	struct kvm_dirty_ring dirty_ring;
 };
 
 static inline int kvm_vcpu_exiting_guest_mode(struct kvm_vcpu *vcpu)
@@ -356,7 +360,11 @@ struct kvm_memslots {
 };
 
 struct kvm {
+#ifdef KVM_HAVE_MMU_RWLOCK
+	rwlock_t mmu_lock;
+#else
 	spinlock_t mmu_lock;
+#endif
 	struct mutex slots_lock;
 	struct mm_struct *mm; /* userspace tied to this vm */
 	struct kvm_memslots *memslots;
@@ -383,6 +391,10 @@ struct kvm {
 	struct kvm_vm_stat stat;
 	struct kvm_arch arch;
 	atomic_t users_count;
+	/* upper bound of vcpu->halt_poll_ns, see KVM_CAP_HALT_POLL */
+	unsigned int max_halt_poll_ns;
+	/* bytes in each vcpu's dirty ring, 0 if KVM_CAP_DIRTY_LOG_RING is off */
+	u32 dirty_ring_size;
 #ifdef KVM_COALESCED_MMIO_PAGE_OFFSET
 	struct kvm_coalesced_mmio_ring *coalesced_mmio_ring;
 	spinlock_t ring_lock;
@@ -577,6 +589,7 @@ struct kvm_memory_slot *gfn_to_memslot(struct kvm *kvm, gfn_t gfn);
 int kvm_is_visible_gfn(struct kvm *kvm, gfn_t gfn);
 unsigned long kvm_host_page_size(struct kvm *kvm, gfn_t gfn);
 void mark_page_dirty(struct kvm *kvm, gfn_t gfn);
+struct kvm_vcpu *kvm_get_running_vcpu(void);
 
 void kvm_vcpu_block(struct kvm_vcpu *vcpu);
 void kvm_vcpu_kick(struct kvm_vcpu *vcpu);
@@ -603,6 +616,11 @@ int kvm_get_dirty_log(struct kvm *kvm,
 			struct kvm_dirty_log *log, int *is_dirty);
 int kvm_vm_ioctl_get_dirty_log(struct kvm *kvm,
 				struct kvm_dirty_log *log);
+/* Re-arm dirty tracking of the gfns in @mask, called under mmu_lock */
+void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
+					     struct kvm_memory_slot *slot,
+					     gfn_t gfn_offset,
+					     unsigned long mask);
 
 int kvm_vm_ioctl_irq_line(struct kvm *kvm, struct kvm_irq_level *irq_level,
 			bool line_status);
@@ -687,6 +705,15 @@ static inline bool kvm_arch_has_noncoherent_dma(struct kvm *kvm)
 }
 #endif
 
+#ifdef __KVM_HAVE_ARCH_LOCK_HINT
+bool kvm_arch_vcpu_holds_contended_lock(struct kvm_vcpu *vcpu);
+#else
+static inline bool kvm_arch_vcpu_holds_contended_lock(struct kvm_vcpu *vcpu)
+{
+	return false;
+}
+#endif
+
 static inline wait_queue_head_t *kvm_arch_vcpu_wq(struct kvm_vcpu *vcpu)
 {
 #ifdef __KVM_HAVE_ARCH_WQP
@@ -1017,6 +1044,9 @@ long kvm_vm_ioctl_assigned_device(struct kvm *kvm, unsigned ioctl,
 				  unsigned long arg);
 
 void kvm_free_all_assigned_devices(struct kvm *kvm);
+void kvm_assigned_dev_update_routing(struct kvm *kvm);
+int kvm_arch_update_irq_posting(struct kvm *kvm, unsigned int host_irq,
+				u32 guest_irq, bool set);
 
 #else
 
@@ -1027,6 +1057,7 @@ static inline long kvm_vm_ioctl_assigned_device(struct kvm *kvm, unsigned ioctl,
 }
 
 static inline void kvm_free_all_assigned_devices(struct kvm *kvm) {}
+static inline void kvm_assigned_dev_update_routing(struct kvm *kvm) {}
 
 #endif
 
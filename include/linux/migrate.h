@@ -46,6 +46,7 @@ extern int migrate_page_move_mapping(struct address_space *mapping,
 		struct page *newpage, struct page *page,
 		struct buffer_head *head, enum migrate_mode mode,
 		int extra_count);
+extern void migrate_copy_pages(struct page **to, struct page **from, int nr);
 #else
 
 static inline void putback_movable_pages(struct list_head *l) {}
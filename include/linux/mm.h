@@ -111,8 +111,10 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_MAYSHARE	0x00000080
 
 #define VM_GROWSDOWN	0x00000100	/* general info on the segment */
+#define VM_UFFD_MISSING	0x00000200	/* missing pages tracking */
 #define VM_PFNMAP	0x00000400	/* Page-ranges managed without "struct page", just pure PFN */
 #define VM_DENYWRITE	0x00000800	/* ETXTBSY on write attempts.. */
+#define VM_UFFD_WP	0x00001000	/* wrprotect pages tracking */
 
 #define VM_LOCKED	0x00002000
 #define VM_IO           0x00004000	/* Memory mapped I/O or similar */
@@ -693,11 +695,12 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
  * sets it, so none of the operations on it need to be atomic.
  */
 
-/* Page flags: | [SECTION] | [NODE] | ZONE | [LAST_CPUPID] | ... | FLAGS | */
+/* Page flags: | [SECTION] | [NODE] | ZONE | [LRU_GEN] | [LAST_CPUPID] | ... | FLAGS | */
 #define SECTIONS_PGOFF		((sizeof(unsigned long)*8) - SECTIONS_WIDTH)
 #define NODES_PGOFF		(SECTIONS_PGOFF - NODES_WIDTH)
 #define ZONES_PGOFF		(NODES_PGOFF - ZONES_WIDTH)
-#define LAST_CPUPID_PGOFF	(ZONES_PGOFF - LAST_CPUPID_WIDTH)
+#define LRU_GEN_PGOFF		(ZONES_PGOFF - LRU_GEN_WIDTH)
+#define LAST_CPUPID_PGOFF	(LRU_GEN_PGOFF - LAST_CPUPID_WIDTH)
 
 /*
  * Define the bit shifts to access each section.  For non-existent
@@ -730,6 +733,7 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
 #define NODES_MASK		((1UL << NODES_WIDTH) - 1)
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define LAST_CPUPID_MASK	((1UL << LAST_CPUPID_SHIFT) - 1)
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << LRU_GEN_PGOFF)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
 
 static inline enum zone_type page_zonenum(const struct page *page)
@@ -1973,6 +1977,91 @@ static inline struct vm_area_struct *find_exact_vma(struct mm_struct *mm,
 	return vma;
 }
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Per-VMA locks let page faults run without mmap_sem.  A writer holding
+ * mmap_sem for writing calls vma_start_write() on every VMA it is about to
+ * change; the VMA then stays write-locked until the writer calls
+ * vma_end_write_all() right before dropping mmap_sem.  Readers only ever
+ * trylock, and fall back to mmap_sem when they fail.
+ */
+static inline void vma_lock_init(struct vm_area_struct *vma)
+{
+	init_rwsem(&vma->vm_lock);
+	vma->vm_lock_seq = -1;
+	vma->detached = false;
+}
+
+static inline bool vma_start_read(struct vm_area_struct *vma)
+{
+	/* check before locking to avoid bouncing the lock's cacheline */
+	if (vma->vm_lock_seq == ACCESS_ONCE(vma->vm_mm->mm_lock_seq))
+		return false;
+
+	if (unlikely(!down_read_trylock(&vma->vm_lock)))
+		return false;
+
+	/*
+	 * Overflow of mm_lock_seq might produce a false locked result, which
+	 * only sends us down the mmap_sem path.  The acquire pairs with the
+	 * release in vma_end_write_all().
+	 */
+	if (unlikely(vma->vm_lock_seq == smp_load_acquire(&vma->vm_mm->mm_lock_seq))) {
+		up_read(&vma->vm_lock);
+		return false;
+	}
+	return true;
+}
+
+static inline void vma_end_read(struct vm_area_struct *vma)
+{
+	up_read(&vma->vm_lock);
+}
+
+static inline void vma_start_write(struct vm_area_struct *vma)
+{
+	int mm_lock_seq;
+
+	VM_BUG_ON_MM(!rwsem_is_locked(&vma->vm_mm->mmap_sem), vma->vm_mm);
+
+	mm_lock_seq = vma->vm_mm->mm_lock_seq;
+	if (vma->vm_lock_seq == mm_lock_seq)
+		return;
+
+	/* wait for the page faults that are still running on this VMA */
+	down_write(&vma->vm_lock);
+	vma->vm_lock_seq = mm_lock_seq;
+	up_write(&vma->vm_lock);
+}
+
+static inline void vma_mark_detached(struct vm_area_struct *vma, bool detached)
+{
+	if (detached)
+		vma_start_write(vma);
+	vma->detached = detached;
+}
+
+static inline void vma_end_write_all(struct mm_struct *mm)
+{
+	VM_BUG_ON_MM(!rwsem_is_locked(&mm->mmap_sem), mm);
+	smp_store_release(&mm->mm_lock_seq, mm->mm_lock_seq + 1);
+}
+
+extern struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+						 unsigned long address);
+#else
+static inline void vma_lock_init(struct vm_area_struct *vma) {}
+static inline bool vma_start_read(struct vm_area_struct *vma)
+{
+	return false;
+}
+static inline void vma_end_read(struct vm_area_struct *vma) {}
+static inline void vma_start_write(struct vm_area_struct *vma) {}
+static inline void vma_mark_detached(struct vm_area_struct *vma,
+				     bool detached) {}
+static inline void vma_end_write_all(struct mm_struct *mm) {}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 #ifdef CONFIG_MMU
 pgprot_t vm_get_page_prot(unsigned long vm_flags);
 void vma_set_page_prot(struct vm_area_struct *vma);
@@ -3,6 +3,7 @@
 
 #include <linux/huge_mm.h>
 #include <linux/swap.h>
+#include <linux/jump_label.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -22,10 +23,128 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+
+extern struct static_key lru_gen_key;
+
+static inline bool lru_gen_enabled(void)
+{
+#ifdef CONFIG_LRU_GEN_ENABLED
+	return static_key_true(&lru_gen_key);
+#else
+	return static_key_false(&lru_gen_key);
+#endif
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Returns the generation @page is on, or -1 if it is on none. */
+static inline int page_lru_gen(struct page *page)
+{
+	return ((page->flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * The generation is stored off by one so that a zero field means the page
+ * is not on a generation list.  page->flags can be changed concurrently by
+ * the page flag operations, hence the cmpxchg loop.
+ */
+static inline void page_set_lru_gen(struct page *page, int gen)
+{
+	unsigned long old, new;
+
+	do {
+		old = ACCESS_ONCE(page->flags);
+		new = (old & ~LRU_GEN_MASK) |
+		      ((unsigned long)(gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+
+/*
+ * Put @page on a generation list instead of the active or inactive lists.
+ * Pages that were active go to the youngest generation, everything else
+ * to the oldest generation of its type.  The page is accounted as an
+ * inactive page of its type so that the zone and memcg counters keep
+ * their meaning.  Returns false if the page is not managed by generations.
+ */
+static inline bool lru_gen_add_page(struct page *page, struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int nr_pages = hpage_nr_pages(page);
+	int type = page_is_file_cache(page);
+	enum lru_list lru = type * LRU_FILE;
+	unsigned long seq;
+	int gen;
+
+	if (!lru_gen_enabled() || PageUnevictable(page))
+		return false;
+
+	if (PageActive(page)) {
+		ClearPageActive(page);
+		seq = lrugen->max_seq;
+	} else {
+		seq = lrugen->min_seq[type];
+	}
+	gen = lru_gen_from_seq(seq);
+	page_set_lru_gen(page, gen);
+
+	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
+	list_add(&page->lru, &lrugen->lists[gen][type]);
+	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct page *page, struct lruvec *lruvec)
+{
+	int nr_pages = hpage_nr_pages(page);
+	enum lru_list lru = page_is_file_cache(page) * LRU_FILE;
+
+	if (page_lru_gen(page) < 0)
+		return false;
+
+	page_set_lru_gen(page, -1);
+
+	mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
+	list_del(&page->lru);
+	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
+	return true;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline int page_lru_gen(struct page *page)
+{
+	return -1;
+}
+
+static inline bool lru_gen_add_page(struct page *page, struct lruvec *lruvec)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct page *page, struct lruvec *lruvec)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
 	int nr_pages = hpage_nr_pages(page);
+
+	if (lru_gen_add_page(page, lruvec))
+		return;
+
 	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
 	list_add(&page->lru, &lruvec->lists[lru]);
 	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
@@ -35,6 +154,10 @@ static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
 	int nr_pages = hpage_nr_pages(page);
+
+	if (lru_gen_del_page(page, lruvec))
+		return;
+
 	mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
 	list_del(&page->lru);
 	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
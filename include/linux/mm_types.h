@@ -8,6 +8,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -238,6 +239,16 @@ struct vm_region {
 						* this region */
 };
 
+#ifdef CONFIG_USERFAULTFD
+#define NULL_VM_UFFD_CTX ((struct vm_userfaultfd_ctx) { NULL, })
+struct vm_userfaultfd_ctx {
+	struct userfaultfd_ctx *ctx;
+};
+#else /* CONFIG_USERFAULTFD */
+#define NULL_VM_UFFD_CTX ((struct vm_userfaultfd_ctx) {})
+struct vm_userfaultfd_ctx {};
+#endif /* CONFIG_USERFAULTFD */
+
 /*
  * This struct defines a memory VMM memory area. There is one of these
  * per VM-area/task.  A VM area is any part of the process virtual memory
@@ -313,6 +324,26 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * NUMA hinting faults on this VMA since it was last scanned, remote
+	 * and local.  VMAs found node-local sit out numab_skip scan passes,
+	 * numab_backoff being how many the next such finding skips.
+	 */
+	unsigned int numab_faults[2];
+	unsigned int numab_skip;
+	unsigned int numab_backoff;
+#endif
+	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Page faults hold vm_lock for reading instead of mmap_sem.  The
+	 * VMA is write-locked while vm_lock_seq equals mm->mm_lock_seq.
+	 */
+	int vm_lock_seq;
+	struct rw_semaphore vm_lock;
+	bool detached;			/* unlinked from the mm's VMA tree */
+#endif
 };
 
 struct core_thread {
@@ -347,6 +378,7 @@ struct mm_rss_stat {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -368,6 +400,15 @@ struct mm_struct {
 
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
 	struct rw_semaphore mmap_sem;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Bumped when a writer drops mmap_sem, which unlocks all VMAs that
+	 * were write-locked under it.  Protected by mmap_sem for writing.
+	 */
+	int mm_lock_seq;
+	/* lets page faults walk mm_rb under RCU, see lock_vma_under_rcu() */
+	seqcount_t mm_rb_seq;
+#endif
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
 						 * together off init_mm.mmlist, and are protected
@@ -459,6 +500,14 @@ struct mm_struct {
 	bool tlb_flush_pending;
 #endif
 	struct uprobes_state uprobes_state;
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	/* hash table for the private futexes of this mm, NULL: global */
+	struct futex_private_hash *futex_phash;
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* entry on the list of mms walked by the multi-generational LRU */
+	struct list_head lru_gen_list;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -516,6 +565,18 @@ static inline void clear_tlb_flush_pending(struct mm_struct *mm)
 }
 #endif
 
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_add_mm(struct mm_struct *mm);
+extern void lru_gen_del_mm(struct mm_struct *mm);
+#else
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 /* Return the name for an anonymous mapping or NULL for a file-backed mapping */
 static inline const char __user *vma_get_anon_name(struct vm_area_struct *vma)
 {
@@ -213,9 +213,37 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#define ANON_AND_FILE 2
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU sorts evictable pages into generations instead
+ * of the active and inactive lists.  A page's generation number is derived
+ * from a sequence number: max_seq is the youngest generation and is shared
+ * by both types, min_seq[] are the oldest generations of anon and file pages.
+ * New generations are created by aging (walking page tables for accessed
+ * bits); eviction always happens from the oldest generation.  There are
+ * between MIN_NR_GENS and MAX_NR_GENS generations per type at any time.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+struct lru_gen_struct {
+	/* the youngest generation, protected by the zone lru_lock */
+	unsigned long max_seq;
+	/* the oldest generation of each type */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* the generation lists, indexed by seq % MAX_NR_GENS */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE];
+};
+#endif
+
 struct lruvec {
 	struct list_head lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct zone *zone;
 #endif
@@ -753,6 +781,12 @@ typedef struct pglist_data {
 					   mem_hotplug_begin/end() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	/* Lock serializing the migrate rate limiting window */
 	spinlock_t numabalancing_migrate_lock;
@@ -805,6 +839,13 @@ extern int init_currently_empty_zone(struct zone *zone, unsigned long start_pfn,
 				     enum memmap_context context);
 
 extern void lruvec_init(struct lruvec *lruvec);
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_init_lruvec(struct lruvec *lruvec);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
 
 static inline struct zone *lruvec_zone(struct lruvec *lruvec)
 {
@@ -46,6 +46,9 @@ struct msi_desc {
 
 	/* Last set MSI message */
 	struct msi_msg msg;
+
+	/* Kernel managed affinity of the vector, if spread at allocation */
+	struct cpumask *affinity;
 };
 
 /*
@@ -0,0 +1,119 @@
+/*
+ * Net DIM - dynamic interrupt moderation for network devices
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A driver feeds net_dim() a sample of its packet, byte and interrupt
+ * event counters at the end of each NAPI poll.  Every NET_DIM_NEVENTS
+ * events the rates since the last decision are compared with the ones
+ * before it, and the moderation profile is stepped towards whichever side
+ * improved them: a higher profile coalesces more for throughput, a lower
+ * one interrupts sooner for latency.  When stepping no longer helps, the
+ * state machine parks on the best profile until the traffic changes.
+ *
+ * When a new profile is chosen, dim->work is scheduled; the driver looks
+ * the profile up with net_dim_get_rx_moderation() or
+ * net_dim_get_tx_moderation(), programs the device, and sets dim->state
+ * back to NET_DIM_START_MEASURE.
+ *
+ * net_dim() must be serialized per instance, which NAPI provides.
+ */
+#ifndef _LINUX_NET_DIM_H
+#define _LINUX_NET_DIM_H
+
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+struct net_dim_cq_moder {
+	u16 usec;
+	u16 pkts;
+	u8 cq_period_mode;
+};
+
+struct net_dim_sample {
+	ktime_t time;
+	u32 pkt_ctr;
+	u32 byte_ctr;
+	u16 event_ctr;
+};
+
+/* rates per millisecond */
+struct net_dim_stats {
+	int ppms;	/* packets */
+	int bpms;	/* bytes */
+	int epms;	/* events */
+};
+
+struct net_dim {
+	u8 state;
+	struct net_dim_stats prev_stats;
+	struct net_dim_sample start_sample;
+	struct work_struct work;
+	u8 profile_ix;
+	u8 mode;
+	u8 tune_state;
+	u8 steps_right;
+	u8 steps_left;
+	u8 tired;
+};
+
+/* Whether the device restarts its moderation timer on events or on CQEs */
+enum {
+	NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE = 0x0,
+	NET_DIM_CQ_PERIOD_MODE_START_FROM_CQE = 0x1,
+	NET_DIM_CQ_PERIOD_NUM_MODES
+};
+
+/* dim->state */
+enum {
+	NET_DIM_START_MEASURE,
+	NET_DIM_MEASURE_IN_PROGRESS,
+	NET_DIM_APPLY_NEW_PROFILE,
+};
+
+/* dim->tune_state */
+enum {
+	NET_DIM_PARKING_ON_TOP,
+	NET_DIM_PARKING_TIRED,
+	NET_DIM_GOING_RIGHT,
+	NET_DIM_GOING_LEFT,
+};
+
+#define NET_DIM_PARAMS_NUM_PROFILES	5
+#define NET_DIM_DEF_PROFILE_CQE		1
+#define NET_DIM_DEF_PROFILE_EQE		1
+
+/* events per decision */
+#define NET_DIM_NEVENTS			64
+
+static inline void net_dim_sample(u16 event_ctr, u64 packets, u64 bytes,
+				  struct net_dim_sample *s)
+{
+	s->time	     = ktime_get();
+	s->pkt_ctr   = packets;
+	s->byte_ctr  = bytes;
+	s->event_ctr = event_ctr;
+}
+
+/* Start @dim off on the default profile for @cq_period_mode */
+static inline void net_dim_init(struct net_dim *dim, u8 cq_period_mode,
+				work_func_t work_fn)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->mode = cq_period_mode;
+	dim->profile_ix = cq_period_mode == NET_DIM_CQ_PERIOD_MODE_START_FROM_CQE ?
+			  NET_DIM_DEF_PROFILE_CQE : NET_DIM_DEF_PROFILE_EQE;
+	INIT_WORK(&dim->work, work_fn);
+}
+
+struct net_dim_cq_moder net_dim_get_rx_moderation(u8 cq_period_mode, int ix);
+struct net_dim_cq_moder net_dim_get_def_rx_moderation(u8 cq_period_mode);
+struct net_dim_cq_moder net_dim_get_tx_moderation(u8 cq_period_mode, int ix);
+struct net_dim_cq_moder net_dim_get_def_tx_moderation(u8 cq_period_mode);
+void net_dim(struct net_dim *dim, struct net_dim_sample end_sample);
+
+#endif /* _LINUX_NET_DIM_H */
@@ -316,6 +316,28 @@ nf_nat_decode_session(struct sk_buff *skb, struct flowi *fl, u_int8_t family)
 }
 #endif /*CONFIG_NETFILTER*/
 
+/* Run a hook over every skb on @head.  Packets the hook accepts are left
+ * on @head for the caller to continue with; the rest are consumed exactly
+ * as with NF_HOOK().
+ */
+static inline void
+NF_HOOK_LIST(uint8_t pf, unsigned int hook, struct list_head *head,
+	     struct net_device *in, struct net_device *out,
+	     int (*okfn)(struct sk_buff *))
+{
+	struct sk_buff *skb, *next;
+	struct list_head sublist;
+
+	INIT_LIST_HEAD(&sublist);
+	list_for_each_entry_safe(skb, next, head, list) {
+		skb_list_del_init(skb);
+		if (nf_hook(pf, hook, skb, in, out, okfn) == 1)
+			list_add_tail(&skb->list, &sublist);
+	}
+	/* Put passed packets back on main list */
+	list_splice(&sublist, head);
+}
+
 #if defined(CONFIG_NF_CONNTRACK) || defined(CONFIG_NF_CONNTRACK_MODULE)
 extern void (*ip_ct_attach)(struct sk_buff *, const struct sk_buff *) __rcu;
 void nf_ct_attach(struct sk_buff *, const struct sk_buff *);
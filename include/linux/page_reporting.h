@@ -0,0 +1,68 @@
+#ifndef _LINUX_PAGE_REPORTING_H
+#define _LINUX_PAGE_REPORTING_H
+
+#include <linux/errno.h>
+#include <linux/mm_types.h>
+#include <linux/mmzone.h>
+#include <linux/scatterlist.h>
+#include <linux/static_key.h>
+#include <linux/workqueue.h>
+
+/* Free blocks smaller than this are not worth reporting */
+#define PAGE_REPORTING_MIN_ORDER	pageblock_order
+
+/* Number of blocks handed to the device per report() call */
+#define PAGE_REPORTING_CAPACITY		32
+
+struct page_reporting_dev_info {
+	/*
+	 * Tell the device that the blocks in @sg are free.  Called from
+	 * process context; the blocks stay allocated to the caller until
+	 * it returns, so the device may discard their contents.
+	 */
+	int (*report)(struct page_reporting_dev_info *prdev,
+		      struct scatterlist *sg, unsigned int nents);
+
+	/* work that collects and reports free blocks */
+	struct delayed_work work;
+};
+
+#ifdef CONFIG_PAGE_REPORTING
+extern struct static_key page_reporting_enabled;
+
+extern int page_reporting_register(struct page_reporting_dev_info *prdev);
+extern void page_reporting_unregister(struct page_reporting_dev_info *prdev);
+extern void __page_reporting_notify_free(struct page *page, unsigned int order);
+
+/*
+ * page_reporting_notify_free - note a block going back to the buddy lists
+ *
+ * To be called by __free_one_page() after merging, with zone->lock held.
+ */
+static inline void page_reporting_notify_free(struct page *page,
+					      unsigned int order)
+{
+	if (!static_key_false(&page_reporting_enabled))
+		return;
+	if (order < PAGE_REPORTING_MIN_ORDER)
+		return;
+	__page_reporting_notify_free(page, order);
+}
+#else
+static inline int page_reporting_register(struct page_reporting_dev_info *prdev)
+{
+	return -ENODEV;
+}
+
+static inline void
+page_reporting_unregister(struct page_reporting_dev_info *prdev)
+{
+}
+
+static inline void page_reporting_notify_free(struct page *page,
+					      unsigned int order)
+{
+}
+#endif /* CONFIG_PAGE_REPORTING */
+
+#endif /* _LINUX_PAGE_REPORTING_H */
@@ -1193,6 +1193,8 @@ struct msix_entry {
 };
 
 
+struct irq_affinity;
+
 #ifdef CONFIG_PCI_MSI
 int pci_msi_vec_count(struct pci_dev *dev);
 void pci_msi_shutdown(struct pci_dev *dev);
@@ -1213,6 +1215,10 @@ static inline int pci_enable_msi_exact(struct pci_dev *dev, int nvec)
 }
 int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 			  int minvec, int maxvec);
+int pci_enable_msix_range_affinity(struct pci_dev *dev,
+				   struct msix_entry *entries,
+				   int minvec, int maxvec,
+				   const struct irq_affinity *affd);
 static inline int pci_enable_msix_exact(struct pci_dev *dev,
 					struct msix_entry *entries, int nvec)
 {
@@ -1241,6 +1247,10 @@ static inline int pci_enable_msi_exact(struct pci_dev *dev, int nvec)
 static inline int pci_enable_msix_range(struct pci_dev *dev,
 		      struct msix_entry *entries, int minvec, int maxvec)
 { return -ENOSYS; }
+static inline int pci_enable_msix_range_affinity(struct pci_dev *dev,
+		      struct msix_entry *entries, int minvec, int maxvec,
+		      const struct irq_affinity *affd)
+{ return -ENOSYS; }
 static inline int pci_enable_msix_exact(struct pci_dev *dev,
 		      struct msix_entry *entries, int nvec)
 { return -ENOSYS; }
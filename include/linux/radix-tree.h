@@ -40,6 +40,11 @@
  * Indirect pointer in fact is also used to tag the last pointer of a node
  * when it is shrunk, before we rcu free the node. See shrink code for
  * details.
+ *
+ * Every pointer from one node to another carries the bit as well, so that
+ * a multi-order item stored in an interior slot can be told apart from a
+ * child node.  The other slots covered by a multi-order item hold sibling
+ * entries: indirect pointers to the item's canonical slot in the same node.
  */
 #define RADIX_TREE_INDIRECT_PTR		1
 /*
@@ -261,8 +266,15 @@ static inline void radix_tree_replace_slot(void **pslot, void *item)
 }
 
 int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
-			struct radix_tree_node **nodep, void ***slotp);
-int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
+			unsigned order, struct radix_tree_node **nodep,
+			void ***slotp);
+int __radix_tree_insert(struct radix_tree_root *, unsigned long index,
+			unsigned order, void *);
+static inline int radix_tree_insert(struct radix_tree_root *root,
+			unsigned long index, void *entry)
+{
+	return __radix_tree_insert(root, index, 0, entry);
+}
 void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
 			  struct radix_tree_node **nodep, void ***slotp);
 void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
@@ -312,6 +324,7 @@ static inline void radix_tree_preload_end(void)
  * @index:	index of current slot
  * @next_index:	next-to-last index for this chunk
  * @tags:	bit-mask for tag-iterating
+ * @shift:	number of index bits covered by each slot of the chunk
  *
  * This radix tree iterator works in terms of "chunks" of slots.  A chunk is a
  * subinterval of slots contained within one radix tree leaf node.  It is
@@ -319,13 +332,29 @@ static inline void radix_tree_preload_end(void)
  * which holds the chunk's position in the tree and its size.  For tagged
  * iteration radix_tree_iter also holds the slots' bit-mask for one chosen
  * radix tree tag.
+ *
+ * A multi-order item is visited once, through its canonical slot, with
+ * @index at the first index it covers past the starting point.  When the
+ * item sits above the leaf level it makes up a chunk of its own.
  */
 struct radix_tree_iter {
 	unsigned long	index;
 	unsigned long	next_index;
 	unsigned long	tags;
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+	unsigned int	shift;
+#endif
 };
 
+static inline unsigned int iter_shift(struct radix_tree_iter *iter)
+{
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+	return iter->shift;
+#else
+	return 0;
+#endif
+}
+
 #define RADIX_TREE_ITER_TAG_MASK	0x00FF	/* tag index in lower byte */
 #define RADIX_TREE_ITER_TAGGED		0x0100	/* lookup tagged slots */
 #define RADIX_TREE_ITER_CONTIG		0x0200	/* stop at first hole */
@@ -350,6 +379,9 @@ radix_tree_iter_init(struct radix_tree_iter *iter, unsigned long start)
 	 */
 	iter->index = 0;
 	iter->next_index = start;
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+	iter->shift = 0;
+#endif
 	return NULL;
 }
 
@@ -373,12 +405,12 @@ void **radix_tree_next_chunk(struct radix_tree_root *root,
  * radix_tree_chunk_size - get current chunk size
  *
  * @iter:	pointer to radix tree iterator
- * Returns:	current chunk size
+ * Returns:	current chunk size, in slots
  */
-static __always_inline unsigned
+static __always_inline long
 radix_tree_chunk_size(struct radix_tree_iter *iter)
 {
-	return iter->next_index - iter->index;
+	return (iter->next_index - iter->index) >> iter_shift(iter);
 }
 
 /**
@@ -409,13 +441,23 @@ radix_tree_next_slot(void **slot, struct radix_tree_iter *iter, unsigned flags)
 			return slot + offset + 1;
 		}
 	} else {
-		unsigned size = radix_tree_chunk_size(iter) - 1;
+		long size = radix_tree_chunk_size(iter);
 
-		while (size--) {
+		while (--size > 0) {
 			slot++;
-			iter->index++;
-			if (likely(*slot))
-				return slot;
+			iter->index += 1UL << iter_shift(iter);
+			if (likely(*slot)) {
+				/*
+				 * Only the first slot of a chunk can hold
+				 * a retry entry, so an indirect pointer
+				 * further on is the sibling of an item
+				 * already returned.
+				 */
+				if (!IS_ENABLED(CONFIG_RADIX_TREE_MULTIORDER) ||
+				    !radix_tree_is_indirect_ptr(*slot))
+					return slot;
+				continue;
+			}
 			if (flags & RADIX_TREE_ITER_CONTIG) {
 				/* forbid switching to the next chunk */
 				iter->next_index = 0;
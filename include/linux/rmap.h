@@ -79,6 +79,10 @@ enum ttu_flags {
 	TTU_IGNORE_MLOCK = (1 << 8),	/* ignore mlock */
 	TTU_IGNORE_ACCESS = (1 << 9),	/* don't age */
 	TTU_IGNORE_HWPOISON = (1 << 10),/* corrupted page is recoverable */
+	TTU_BATCH_FLUSH = (1 << 11),	/* Batch TLB flushes where possible
+					 * and caller guarantees they will
+					 * be done before IO is submitted or
+					 * page freed */
 };
 
 #ifdef CONFIG_MMU
@@ -187,6 +191,29 @@ int page_referenced(struct page *, int is_locked,
 
 int try_to_unmap(struct page *, enum ttu_flags flags);
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+void try_to_unmap_flush(void);
+void try_to_unmap_flush_dirty(void);
+bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags);
+void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable);
+#else
+static inline void try_to_unmap_flush(void)
+{
+}
+static inline void try_to_unmap_flush_dirty(void)
+{
+}
+static inline bool should_defer_flush(struct mm_struct *mm,
+				      enum ttu_flags flags)
+{
+	return false;
+}
+static inline void set_tlb_ubc_flush_pending(struct mm_struct *mm,
+					     bool writable)
+{
+}
+#endif
+
 /*
  * Called from mm/filemap_xip.c to unmap empty zero page
  */
@@ -30,9 +30,10 @@ struct rw_semaphore {
 	raw_spinlock_t wait_lock;
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	struct optimistic_spin_queue osq; /* spinner MCS lock */
+	int handoff; /* a starving waiter is owed the lock */
 	/*
-	 * Write owner. Used as a speculative check to see
-	 * if the owner is running on the cpu.
+	 * Write owner, or RWSEM_READER_OWNED. Used as a speculative
+	 * check to see if the owner is running on the cpu.
 	 */
 	struct task_struct *owner;
 #endif
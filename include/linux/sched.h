@@ -62,6 +62,7 @@ struct sched_param {
 #include <asm/processor.h>
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
 
 /*
  * Extended scheduling parameters data structure.
@@ -99,6 +100,13 @@ struct sched_param {
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
  *
+ * The utilization clamps (SCHED_FLAG_UTIL_CLAMP_{MIN,MAX}) bound the
+ * utilization the CPU frequency is selected for while the task is queued,
+ * in SCHED_CAPACITY_SCALE units, for tasks of any policy:
+ *
+ *  @sched_util_min	minimum utilization to provide to the task
+ *  @sched_util_max	maximum utilization to allow the task
+ *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
  * timing constraints.
@@ -123,6 +131,10 @@ struct sched_attr {
 	u64 sched_runtime;
 	u64 sched_deadline;
 	u64 sched_period;
+
+	/* Utilization hints */
+	u32 sched_util_min;
+	u32 sched_util_max;
 };
 
 struct exec_domain;
@@ -133,6 +145,7 @@ struct fs_struct;
 struct perf_event_context;
 struct blk_plug;
 struct filename;
+struct vm_struct;
 
 #define VMACACHE_BITS 2
 #define VMACACHE_SIZE (1U << VMACACHE_BITS)
@@ -455,6 +468,7 @@ static inline int get_dumpable(struct mm_struct *mm)
 
 #define MMF_HAS_UPROBES		19	/* has uprobes */
 #define MMF_RECALC_UPROBES	20	/* MMF_HAS_UPROBES can be wrong */
+#define MMF_FUTEX_GLOBAL_HASH	21	/* no private futex hash wanted */
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK)
 
@@ -768,7 +782,7 @@ struct user_struct {
 	struct hlist_node uidhash_node;
 	kuid_t uid;
 
-#ifdef CONFIG_PERF_EVENTS
+#if defined(CONFIG_PERF_EVENTS) || defined(CONFIG_NET)
 	atomic_long_t locked_vm;
 #endif
 };
@@ -784,6 +798,26 @@ extern struct user_struct root_user;
 struct backing_dev_info;
 struct reclaim_state;
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+#include <asm/tlbbatch.h>
+
+/* Track pages that require TLB flushes */
+struct tlbflush_unmap_batch {
+	/* What the architecture needs to flush the recorded mms */
+	struct arch_tlbflush_unmap_batch arch;
+
+	/* True if a flush is needed. */
+	bool flush_required;
+
+	/*
+	 * If true then the PTE was dirty when unmapped. The entry must be
+	 * flushed before IO is initiated or a stale TLB entry potentially
+	 * allows an update without redirtying the page.
+	 */
+	bool writable;
+};
+#endif
+
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 struct sched_info {
 	/* cumulative counters */
@@ -865,6 +899,7 @@ enum cpu_idle_type {
 #define SD_BALANCE_FORK		0x0008	/* Balance on fork, clone */
 #define SD_BALANCE_WAKE		0x0010  /* Balance on wakeup */
 #define SD_WAKE_AFFINE		0x0020	/* Wake task to waking CPU */
+#define SD_ASYM_CPUCAPACITY	0x0040  /* Domain members have different cpu capacities */
 #define SD_SHARE_CPUCAPACITY	0x0080	/* Domain members share cpu power */
 #define SD_SHARE_POWERDOMAIN	0x0100	/* Domain members share power domain */
 #define SD_SHARE_PKG_RESOURCES	0x0200	/* Domain members share cpu pkg resources */
@@ -907,6 +942,15 @@ extern int sched_domain_level_max;
 
 struct sched_group;
 
+/*
+ * State shared by all the CPUs of a domain with SD_SHARE_PKG_RESOURCES,
+ * hung off the domain of the first CPU in its span.
+ */
+struct sched_domain_shared {
+	atomic_t	ref;
+	int		has_idle_cores;	/* hint: some core of the LLC is idle */
+};
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -937,6 +981,9 @@ struct sched_domain {
 	u64 max_newidle_lb_cost;
 	unsigned long next_decay_max_lb_cost;
 
+	/* select_idle_cpu() stats */
+	u64 avg_scan_cost;
+
 #ifdef CONFIG_SCHEDSTATS
 	/* load_balance() stats */
 	unsigned int lb_count[CPU_MAX_IDLE_TYPES];
@@ -976,6 +1023,8 @@ struct sched_domain {
 		struct rcu_head rcu;	/* used during destruction */
 	};
 
+	struct sched_domain_shared *shared;
+
 	unsigned int span_weight;
 	/*
 	 * Span of all CPUs in this domain.
@@ -1010,6 +1059,7 @@ struct sd_data {
 	struct sched_domain **__percpu sd;
 	struct sched_group **__percpu sg;
 	struct sched_group_capacity **__percpu sgc;
+	struct sched_domain_shared **__percpu sds;
 };
 
 struct sched_domain_topology_level {
@@ -1028,6 +1078,12 @@ extern struct sched_domain_topology_level *sched_domain_topology;
 extern void set_sched_topology(struct sched_domain_topology_level *tl);
 extern void wake_up_if_idle(int cpu);
 
+/*
+ * Capacity of @cpu relative to the biggest one at its highest frequency,
+ * SCHED_CAPACITY_SCALE meaning the same.  @sd may be NULL.
+ */
+extern unsigned long arch_scale_cpu_capacity(struct sched_domain *sd, int cpu);
+
 #ifdef CONFIG_SCHED_DEBUG
 # define SD_INIT_NAME(type)		.name = #type
 #else
@@ -1077,10 +1133,16 @@ struct sched_avg {
 	 * above by 1024/(1-y).  Thus we only need a u32 to store them for all
 	 * choices of y < 1-2^(-32)*1024.
 	 */
-	u32 runnable_avg_sum, runnable_avg_period;
+	u32 runnable_avg_sum, runnable_avg_period, running_avg_sum;
 	u64 last_runnable_update;
 	s64 decay_count;
-	unsigned long load_avg_contrib;
+	/*
+	 * utilization_avg_contrib describes the amount of time that a
+	 * sched_entity is running on a CPU.  It is scaled to
+	 * SCHED_CAPACITY_SCALE, so a task that always runs has a
+	 * contribution of SCHED_CAPACITY_SCALE whatever its weight.
+	 */
+	unsigned long load_avg_contrib, utilization_avg_contrib;
 };
 
 #ifdef CONFIG_SCHEDSTATS
@@ -1206,8 +1268,14 @@ struct sched_dl_entity {
 	 *
 	 * @dl_yielded tells if task gave up the cpu before consuming
 	 * all its available runtime during the last job.
+	 *
+	 * @dl_contending tells if our bandwidth is accounted in the
+	 * running_bw of our dl_rq, i.e. if we are runnable (possibly
+	 * throttled) there. Tasks with SCHED_FLAG_RECLAIM reclaim the
+	 * bandwidth of the tasks that are not.
 	 */
 	int dl_throttled, dl_new, dl_boosted, dl_yielded;
+	int dl_contending;
 
 	/*
 	 * Bandwidth enforcement timer. Each -deadline task has its
@@ -1225,6 +1293,26 @@ union rcu_special {
 };
 struct rcu_node;
 
+#ifdef CONFIG_UCLAMP_TASK
+enum uclamp_id {
+	UCLAMP_MIN = 0,	/* minimum utilization */
+	UCLAMP_MAX,	/* maximum utilization */
+	UCLAMP_CNT
+};
+
+/*
+ * A utilization clamp value, in SCHED_CAPACITY_SCALE units, and the
+ * runqueue bucket it is accounted in while the task is queued.
+ * user_defined tells a value set with sched_setattr() from the default.
+ */
+struct uclamp_se {
+	unsigned int value;
+	unsigned int bucket_id;
+	unsigned int active : 1;
+	unsigned int user_defined : 1;
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 enum perf_event_task_context {
 	perf_invalid_context = -1,
 	perf_hw_context = 0,
@@ -1235,6 +1323,9 @@ enum perf_event_task_context {
 struct task_struct {
 	volatile long state;	/* -1 unrunnable, 0 runnable, >0 stopped */
 	void *stack;
+#ifdef CONFIG_VMAP_STACK
+	struct vm_struct *stack_vm_area;
+#endif
 	atomic_t usage;
 	unsigned int flags;	/* per process flags, defined below */
 	unsigned int ptrace;
@@ -1260,6 +1351,13 @@ struct task_struct {
 #endif
 	struct sched_dl_entity dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* clamps requested with sched_setattr() */
+	struct uclamp_se uclamp_req[UCLAMP_CNT];
+	/* effective clamps, accounted on the rq while the task is queued */
+	struct uclamp_se uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	/* list of struct preempt_notifier: */
 	struct hlist_head preempt_notifiers;
@@ -1324,6 +1422,9 @@ struct task_struct {
 	/* Revert to default priority/policy when forking */
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
+#ifdef CONFIG_PSI
+	unsigned sched_psi_wake_requeue:1;
+#endif
 
 	unsigned long atomic_flags; /* Flags needing atomic access. */
 
@@ -1497,6 +1598,9 @@ struct task_struct {
 
 /* VM state */
 	struct reclaim_state *reclaim_state;
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	struct tlbflush_unmap_batch tlb_ubc;
+#endif
 
 	struct backing_dev_info *backing_dev_info;
 
@@ -1522,6 +1626,10 @@ struct task_struct {
 	/* cg_list protected by css_set_lock and tsk->alloc_lock */
 	struct list_head cg_list;
 #endif
+#ifdef CONFIG_PSI
+	/* Pressure stall state, protected by the rq lock */
+	unsigned int psi_flags;
+#endif
 #ifdef CONFIG_FUTEX
 	struct robust_list_head __user *robust_list;
 #ifdef CONFIG_COMPAT
@@ -1549,6 +1657,8 @@ struct task_struct {
 	unsigned int numa_scan_period_max;
 	int numa_preferred_nid;
 	unsigned long numa_migrate_retry;
+	/* placement passes the preferred node has held, and been run on */
+	unsigned int numa_stable_scans;
 	u64 node_stamp;			/* migration stamp  */
 	u64 last_task_numa_placement;
 	u64 last_sum_exec_runtime;
@@ -1678,6 +1788,17 @@ extern void set_numabalancing_state(bool enabled);
 extern void task_numa_free(struct task_struct *p);
 extern bool should_numa_migrate_memory(struct task_struct *p, struct page *page,
 					int src_nid, int dst_cpu);
+
+/*
+ * Accounts a NUMA hinting fault to the VMA it hit, alongside
+ * task_numa_fault(), so that task_numa_work() can leave VMAs whose
+ * memory is already local alone.
+ */
+static inline void vma_numa_fault(struct vm_area_struct *vma, int pages,
+				  int flags)
+{
+	vma->numab_faults[!!(flags & TNF_FAULT_LOCAL)] += pages;
+}
 #else
 static inline void task_numa_fault(int last_node, int node, int pages,
 				   int flags)
@@ -1698,6 +1819,10 @@ static inline bool should_numa_migrate_memory(struct task_struct *p,
 {
 	return true;
 }
+static inline void vma_numa_fault(struct vm_area_struct *vma, int pages,
+				  int flags)
+{
+}
 #endif
 
 static inline struct pid *task_pid(struct task_struct *task)
@@ -1923,6 +2048,7 @@ extern int task_free_unregister(struct notifier_block *n);
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
 #define PF_SWAPWRITE	0x00800000	/* Allowed to write to swap */
+#define PF_MEMSTALL	0x01000000	/* Stalled due to lack of memory */
 #define PF_NO_SETAFFINITY 0x04000000	/* Userland is not allowed to meddle with cpus_allowed */
 #define PF_MCE_EARLY    0x08000000      /* Early kill for mce process policy */
 #define PF_MUTEX_TESTER	0x20000000	/* Thread belongs to the rt mutex tester */
@@ -2177,7 +2303,6 @@ static inline void wake_up_nohz_cpu(int cpu) { }
 
 #ifdef CONFIG_NO_HZ_FULL
 extern bool sched_can_stop_tick(void);
-extern u64 scheduler_tick_max_deferment(void);
 #else
 static inline bool sched_can_stop_tick(void) { return false; }
 #endif
@@ -2623,6 +2748,15 @@ static inline void threadgroup_lock(struct task_struct *tsk) {}
 static inline void threadgroup_unlock(struct task_struct *tsk) {}
 #endif
 
+static inline struct vm_struct *task_stack_vm_area(const struct task_struct *t)
+{
+#ifdef CONFIG_VMAP_STACK
+	return t->stack_vm_area;
+#else
+	return NULL;
+#endif
+}
+
 #ifndef __HAVE_THREAD_FUNCTIONS
 
 #define task_thread_info(task)	((struct thread_info *)(task)->stack)
@@ -3034,4 +3168,23 @@ static inline unsigned long rlimit_max(unsigned int limit)
 	return task_rlimit_max(current, limit);
 }
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Hooks for the scheduler to tell a cpufreq governor that the utilization
+ * of a CPU changed.  @util and @max are in the same units; a @util of
+ * ULONG_MAX asks for the maximum frequency (RT and deadline tasks).  The
+ * callback runs with the runqueue lock of that CPU held, from the CPU
+ * itself, and so must not sleep.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned long util, unsigned long max);
+};
+
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+			void (*func)(struct update_util_data *data, u64 time,
+				     unsigned long util, unsigned long max));
+void cpufreq_remove_update_util_hook(int cpu);
+#endif /* CONFIG_CPU_FREQ */
+
 #endif
@@ -28,6 +28,14 @@
 
 struct rpc_inode;
 
+/*
+ * Additional transports to the same server, used in turn with cl_xprt
+ */
+struct rpc_xprt_set {
+	unsigned int		nr;
+	struct rpc_xprt *	xprt[];
+};
+
 /*
  * The high-level client handle
  */
@@ -38,6 +46,8 @@ struct rpc_clnt {
 	struct list_head	cl_tasks;	/* List of tasks */
 	spinlock_t		cl_lock;	/* spinlock */
 	struct rpc_xprt __rcu *	cl_xprt;	/* transport */
+	struct rpc_xprt_set __rcu *cl_xprt_set;	/* extra transports */
+	atomic_t		cl_xprt_next;	/* next transport to use */
 	struct rpc_procinfo *	cl_procinfo;	/* procedure info */
 	u32			cl_prog,	/* RPC program number */
 				cl_vers,	/* RPC version number */
@@ -116,6 +126,7 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* transports to open */
 };
 
 /* Values for "flags" field */
@@ -45,6 +45,7 @@ struct rpc_task {
 	struct list_head	tk_task;	/* global list of tasks */
 	struct rpc_clnt *	tk_client;	/* RPC client */
 	struct rpc_rqst *	tk_rqstp;	/* RPC request */
+	struct rpc_xprt *	tk_xprt;	/* transport for this task */
 
 	/*
 	 * RPC call state
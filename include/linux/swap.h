@@ -356,6 +356,18 @@ static inline int zone_reclaim(struct zone *z, gfp_t mask, unsigned int order)
 extern int page_evictable(struct page *page);
 extern void check_move_unevictable_pages(struct page **, int nr_pages);
 
+#ifdef CONFIG_LRU_GEN
+/* linux/mm/lru_gen.c */
+extern bool lru_gen_need_aging(struct lruvec *lruvec, int swappiness);
+extern void lru_gen_age_lruvec(struct lruvec *lruvec);
+extern unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+					   struct lruvec *lruvec,
+					   struct list_head *dst,
+					   unsigned long *nr_scanned,
+					   isolate_mode_t mode,
+					   int swappiness, int *file);
+#endif
+
 extern int kswapd_run(int nid);
 extern void kswapd_stop(int nid);
 #ifdef CONFIG_MEMCG
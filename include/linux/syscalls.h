@@ -11,6 +11,7 @@
 #ifndef _LINUX_SYSCALLS_H
 #define _LINUX_SYSCALLS_H
 
+struct aio_setup_params;
 struct epoll_event;
 struct iattr;
 struct inode;
@@ -57,6 +58,7 @@ struct timezone;
 struct tms;
 struct utimbuf;
 struct mq_attr;
+struct mq_msgvec;
 struct compat_stat;
 struct compat_timeval;
 struct robust_list_head;
@@ -877,4 +879,21 @@ asmlinkage long sys_seccomp(unsigned int op, unsigned int flags,
 asmlinkage long sys_getrandom(char __user *buf, size_t count,
 			      unsigned int flags);
 asmlinkage long sys_bpf(int cmd, union bpf_attr *attr, unsigned int size);
+asmlinkage long sys_io_setup2(unsigned nr_events, unsigned flags,
+			      struct aio_setup_params __user *params,
+			      aio_context_t __user *ctx);
+asmlinkage long sys_io_ring_enter(aio_context_t ctx_id, u32 to_submit,
+				  u32 min_complete, u32 flags);
+asmlinkage long sys_copy_file_range(int fd_in, loff_t __user *off_in,
+				    int fd_out, loff_t __user *off_out,
+				    size_t len, unsigned int flags);
+asmlinkage long sys_userfaultfd(int flags);
+asmlinkage long sys_mq_timedsend_batch(mqd_t mqdes,
+				const struct mq_msgvec __user *u_vec,
+				unsigned int vlen, unsigned int flags,
+				const struct timespec __user *abs_timeout);
+asmlinkage long sys_mq_timedreceive_batch(mqd_t mqdes,
+				struct mq_msgvec __user *u_vec,
+				unsigned int vlen, unsigned int flags,
+				const struct timespec __user *abs_timeout);
 #endif
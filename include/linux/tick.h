@@ -41,6 +41,7 @@ enum tick_nohz_mode {
  *			to resume the tick timer operation in the timeline
  *			when the CPU returns from nohz sleep.
  * @tick_stopped:	Indicator that the idle tick has been stopped
+ * @got_idle_tick:	Tick timer function has run with @inidle set
  * @idle_jiffies:	jiffies at the entry to idle for idle time accounting
  * @idle_calls:		Total number of idle calls
  * @idle_sleeps:	Number of idle calls, where the sched tick was stopped
@@ -59,6 +60,7 @@ struct tick_sched {
 	ktime_t				last_tick;
 	int				inidle;
 	int				tick_stopped;
+	int				got_idle_tick;
 	unsigned long			idle_jiffies;
 	unsigned long			idle_calls;
 	unsigned long			idle_sleeps;
@@ -134,8 +136,15 @@ static inline int tick_nohz_tick_stopped(void)
 	return __this_cpu_read(tick_cpu_sched.tick_stopped);
 }
 
+static inline int tick_nohz_tick_stopped_cpu(int cpu)
+{
+	return per_cpu(tick_cpu_sched, cpu).tick_stopped;
+}
+
 extern void tick_nohz_idle_enter(void);
+extern void tick_nohz_idle_stop_tick(void);
 extern void tick_nohz_idle_exit(void);
+extern bool tick_nohz_idle_got_tick(void);
 extern void tick_nohz_irq_exit(void);
 extern ktime_t tick_nohz_get_sleep_length(void);
 extern u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time);
@@ -147,8 +156,15 @@ static inline int tick_nohz_tick_stopped(void)
 	return 0;
 }
 
+static inline int tick_nohz_tick_stopped_cpu(int cpu)
+{
+	return 0;
+}
+
 static inline void tick_nohz_idle_enter(void) { }
+static inline void tick_nohz_idle_stop_tick(void) { }
 static inline void tick_nohz_idle_exit(void) { }
+static inline bool tick_nohz_idle_got_tick(void) { return false; }
 
 static inline ktime_t tick_nohz_get_sleep_length(void)
 {
@@ -0,0 +1,111 @@
+#ifndef __ZSTD_H__
+#define __ZSTD_H__
+/*
+ * Zstandard Kernel Interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+
+#define ZSTD_MEM_COMPRESS	(320 * 1024)
+#define ZSTD_MEM_DECOMPRESS	(10 * 1024)
+
+/* Largest amount of data a single block of a frame may decompress to */
+#define ZSTD_BLOCK_MAX		(128 * 1024)
+
+#define ZSTD_CONTENT_SIZE_UNKNOWN	(~0ULL)
+
+/*
+ * zstd_compress_bound()
+ * Provides the maximum size that zstd may output in a "worst case" scenario
+ * (input data not compressible)
+ */
+static inline size_t zstd_compress_bound(size_t isize)
+{
+	return isize + (isize >> 8) + 32;
+}
+
+/*
+ * zstd_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : is the size of 'dst' on entry and the output size, which is
+ *		returned after compress done.  A 'dst' of zstd_compress_bound()
+ *		bytes always suffices.
+ *	wrkmem  : address of the working memory.
+ *		This requires 'wrkmem' of size ZSTD_MEM_COMPRESS.
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *	note :  The output is a single zstd frame, readable by any zstd
+ *		decoder.
+ */
+int zstd_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * zstd_decompress()
+ *	src     : source address of the compressed data, one or more frames
+ *	src_len : is the input size, therefore the compressed size
+ *	dst	: output buffer address of the decompressed data, which
+ *		must not overlap 'src'
+ *	dst_len : is the size of 'dst' on entry and the size of the
+ *		decompressed data, which is returned after decompress done
+ *	wrkmem  : address of the working memory.
+ *		This requires 'wrkmem' of size ZSTD_MEM_DECOMPRESS.
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ */
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Frame and block level interface, for callers that cannot hand the whole
+ * output buffer to zstd_decompress() at once.
+ */
+struct zstd_frame_header {
+	/* ZSTD_CONTENT_SIZE_UNKNOWN unless the frame records it */
+	unsigned long long content_size;
+	unsigned long long window_size;	/* history blocks may refer to */
+	unsigned int header_size;	/* bytes to skip to the first block */
+	bool checksum;		/* 4 checksum bytes follow the last block */
+	bool skippable;		/* header_size covers the whole frame */
+};
+
+/*
+ * zstd_frame_header()
+ *	Parses the frame header at 'src'.  Returns 0 on success, -EAGAIN if
+ *	more than 'src_len' bytes are needed to tell, and another negative
+ *	errno if 'src' is not a frame this decoder can handle.
+ */
+int zstd_frame_header(const unsigned char *src, size_t src_len,
+		struct zstd_frame_header *fh);
+
+/*
+ * zstd_decompress_begin()
+ *	Resets the decoding state kept in 'wrkmem' for a new frame.
+ */
+void zstd_decompress_begin(void *wrkmem);
+
+/*
+ * zstd_decompress_block()
+ *	wrkmem  : working memory set up by zstd_decompress_begin()
+ *	src     : address of the block header
+ *	src_len : is the input size on entry and the size of the block,
+ *		which is returned after decompress done
+ *	dst	: start of the output buffer; the 'pos' bytes before the
+ *		block's output are the history its matches may refer to
+ *	dst_len : is the space left after 'pos' on entry and the size of
+ *		the decompressed block, which is returned after decompress
+ *		done
+ *	last    : set when this was the last block of the frame
+ *	return  : Success if return 0
+ *		  -EAGAIN if the block is not complete in 'src'
+ *		  Error if return (< 0)
+ */
+int zstd_decompress_block(void *wrkmem, const unsigned char *src,
+		size_t *src_len, unsigned char *dst, size_t pos,
+		size_t *dst_len, bool *last);
+#endif
@@ -72,15 +72,18 @@ static inline bool busy_loop_timeout(unsigned long end_time)
 	return time_after(now, end_time);
 }
 
-/* when used in sock_poll() nonblock is known at compile time to be true
- * so the loop and end_time will be optimized out
+/* Busy poll the NAPI context identified by @napi_id until @loop_end
+ * reports progress, @end_time passes or we need to reschedule.  Returns
+ * false if the context could not be busy polled at all.
  */
-static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+static inline bool napi_busy_loop(unsigned int napi_id,
+				  unsigned long end_time, int nonblock,
+				  bool (*loop_end)(void *), void *loop_end_arg)
 {
-	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
 	const struct net_device_ops *ops;
 	struct napi_struct *napi;
-	int rc = false;
+	bool ret = false;
+	int rc;
 
 	/*
 	 * rcu read lock for napi hash
@@ -88,7 +91,7 @@ static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 	 */
 	rcu_read_lock_bh();
 
-	napi = napi_by_id(sk->sk_napi_id);
+	napi = napi_by_id(napi_id);
 	if (!napi)
 		goto out;
 
@@ -104,17 +107,38 @@ static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 
 		if (rc > 0)
 			/* local bh are disabled so it is ok to use _BH */
-			NET_ADD_STATS_BH(sock_net(sk),
+			NET_ADD_STATS_BH(dev_net(napi->dev),
 					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
 		cpu_relax();
 
-	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
+	} while (!nonblock && !loop_end(loop_end_arg) &&
 		 !need_resched() && !busy_loop_timeout(end_time));
 
-	rc = !skb_queue_empty(&sk->sk_receive_queue);
+	ret = true;
 out:
 	rcu_read_unlock_bh();
-	return rc;
+	return ret;
+}
+
+static inline bool sk_busy_loop_end(void *p)
+{
+	struct sock *sk = p;
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
+}
+
+/* when used in sock_poll() nonblock is known at compile time to be true
+ * so the loop and end_time will be optimized out
+ */
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+
+	if (!napi_busy_loop(sk->sk_napi_id, end_time, nonblock,
+			    sk_busy_loop_end, sk))
+		return false;
+
+	return !skb_queue_empty(&sk->sk_receive_queue);
 }
 
 /* used in the NIC receive handler to mark the skb */
@@ -1,7 +1,12 @@
 #ifndef __NET_FRAG_H__
 #define __NET_FRAG_H__
 
+#include <linux/in6.h>
 #include <linux/percpu_counter.h>
+#include <linux/rbtree.h>
+#include <linux/rhashtable.h>
+
+struct inet_frags;
 
 struct netns_frags {
 	/* The percpu_counter "mem" need to be cacheline aligned.
@@ -13,6 +18,9 @@ struct netns_frags {
 	int			timeout;
 	int			high_thresh;
 	int			low_thresh;
+	struct inet_frags	*f;
+
+	struct rhashtable	rhashtable ____cacheline_aligned_in_smp;
 };
 
 /**
@@ -21,7 +29,7 @@ struct netns_frags {
  * @INET_FRAG_FIRST_IN: first fragment has arrived
  * @INET_FRAG_LAST_IN: final fragment has arrived
  * @INET_FRAG_COMPLETE: frag queue has been processed and is due for destruction
- * @INET_FRAG_EVICTED: frag queue is being evicted
+ * @INET_FRAG_EVICTED: frag queue is being evicted along with its namespace
  */
 enum {
 	INET_FRAG_FIRST_IN	= BIT(0),
@@ -30,72 +38,67 @@ enum {
 	INET_FRAG_EVICTED	= BIT(3)
 };
 
+/* The hash key of a queue: zero padded keys are compared as memory. */
+struct frag_v4_compare_key {
+	__be32		saddr;
+	__be32		daddr;
+	u32		user;
+	__be16		id;
+	u16		protocol;
+};
+
+struct frag_v6_compare_key {
+	struct in6_addr	saddr;
+	struct in6_addr	daddr;
+	u32		user;
+	__be32		id;
+};
+
 /**
  * struct inet_frag_queue - fragment queue
  *
+ * @node: rhash node in the namespace's table
+ * @key: keys identifying this frag
  * @lock: spinlock protecting the queue
  * @timer: queue expiration timer
- * @list: hash bucket list
  * @refcnt: reference count of the queue
- * @fragments: received fragments head
- * @fragments_tail: received fragments tail
+ * @fragments: received fragments head, for queues kept as a list
+ * @rb_fragments: received fragments rb-tree root, keyed by offset (ipv4)
+ * @fragments_tail: received fragment of the highest offset
  * @stamp: timestamp of the last received fragment
  * @len: total length of the original datagram
  * @meat: length of received fragments so far
+ * @mem: memory charged for this queue, its fragments included
  * @flags: fragment queue flags
  * @max_size: (ipv4 only) maximum received fragment size with IP_DF set
  * @net: namespace that this frag belongs to
+ * @rcu: rcu head for freeing, lookups run under rcu_read_lock()
  */
 struct inet_frag_queue {
+	struct rhash_head	node;
+	union {
+		struct frag_v4_compare_key v4;
+		struct frag_v6_compare_key v6;
+	} key;
 	spinlock_t		lock;
 	struct timer_list	timer;
-	struct hlist_node	list;
 	atomic_t		refcnt;
 	struct sk_buff		*fragments;
+	struct rb_root		rb_fragments;
 	struct sk_buff		*fragments_tail;
 	ktime_t			stamp;
 	int			len;
 	int			meat;
+	int			mem;
 	__u8			flags;
 	u16			max_size;
 	struct netns_frags	*net;
-};
-
-#define INETFRAGS_HASHSZ	1024
-
-/* averaged:
- * max_depth = default ipfrag_high_thresh / INETFRAGS_HASHSZ /
- *	       rounded up (SKB_TRUELEN(0) + sizeof(struct ipq or
- *	       struct frag_queue))
- */
-#define INETFRAGS_MAXDEPTH	128
-
-struct inet_frag_bucket {
-	struct hlist_head	chain;
-	spinlock_t		chain_lock;
+	struct rcu_head		rcu;
 };
 
 struct inet_frags {
-	struct inet_frag_bucket	hash[INETFRAGS_HASHSZ];
-
-	struct work_struct	frags_work;
-	unsigned int next_bucket;
-	unsigned long last_rebuild_jiffies;
-	bool rebuild;
-
-	/* The first call to hashfn is responsible to initialize
-	 * rnd. This is best done with net_get_random_once.
-	 *
-	 * rnd_seqlock is used to let hash insertion detect
-	 * when it needs to re-lookup the hash chain to use.
-	 */
-	u32			rnd;
-	seqlock_t		rnd_seqlock;
 	int			qsize;
 
-	unsigned int		(*hashfn)(const struct inet_frag_queue *);
-	bool			(*match)(const struct inet_frag_queue *q,
-					 const void *arg);
 	void			(*constructor)(struct inet_frag_queue *q,
 					       const void *arg);
 	void			(*destructor)(struct inet_frag_queue *);
@@ -103,21 +106,19 @@ struct inet_frags {
 	void			(*frag_expire)(unsigned long data);
 	struct kmem_cache	*frags_cachep;
 	const char		*frags_cache_name;
+	struct rhashtable_params rhash_params;
 };
 
 int inet_frags_init(struct inet_frags *);
 void inet_frags_fini(struct inet_frags *);
 
-void inet_frags_init_net(struct netns_frags *nf);
+int inet_frags_init_net(struct netns_frags *nf);
 void inet_frags_exit_net(struct netns_frags *nf, struct inet_frags *f);
 
 void inet_frag_kill(struct inet_frag_queue *q, struct inet_frags *f);
 void inet_frag_destroy(struct inet_frag_queue *q, struct inet_frags *f);
-struct inet_frag_queue *inet_frag_find(struct netns_frags *nf,
-		struct inet_frags *f, void *key, unsigned int hash);
-
-void inet_frag_maybe_warn_overflow(struct inet_frag_queue *q,
-				   const char *prefix);
+struct inet_frag_queue *inet_frag_find(struct netns_frags *nf, void *key);
+unsigned int inet_frag_rbtree_purge(struct rb_root *root);
 
 static inline void inet_frag_put(struct inet_frag_queue *q, struct inet_frags *f)
 {
@@ -141,14 +142,25 @@ static inline int frag_mem_limit(struct netns_frags *nf)
 
 static inline void sub_frag_mem_limit(struct inet_frag_queue *q, int i)
 {
+	q->mem -= i;
 	__percpu_counter_add(&q->net->mem, -i, frag_percpu_counter_batch);
 }
 
 static inline void add_frag_mem_limit(struct inet_frag_queue *q, int i)
 {
+	q->mem += i;
 	__percpu_counter_add(&q->net->mem, i, frag_percpu_counter_batch);
 }
 
+/* A single queue may take at most a quarter of high_thresh, so that one
+ * datagram flooded with tiny fragments cannot starve all the others.
+ */
+static inline bool frag_queue_mem_full(const struct inet_frag_queue *q,
+				       int truesize)
+{
+	return q->mem + truesize > q->net->high_thresh / 4;
+}
+
 static inline void init_frag_mem_limit(struct netns_frags *nf)
 {
 	percpu_counter_init(&nf->mem, 0, GFP_KERNEL);
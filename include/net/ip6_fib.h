@@ -99,6 +99,11 @@ struct rt6_info {
 
 	struct in6_addr			rt6i_gateway;
 
+	/* Per-CPU copies of a route in the tree, made on first use, so
+	 * that lookups don't share the refcount of the tree entry.
+	 */
+	struct rt6_info * __percpu	*rt6i_pcpu;
+
 	/* Multipath routes:
 	 * siblings is a list of rt6_info that have the the same metric/weight,
 	 * destination, but not the same gateway. nsiblings is just a cache
@@ -193,6 +198,15 @@ static inline void rt6_set_from(struct rt6_info *rt, struct rt6_info *from)
 	rt->dst.from = new;
 }
 
+/* The serial number of the tree node a route hangs off, for dst_check() */
+static inline u32 rt6_get_cookie(const struct rt6_info *rt)
+{
+	if (rt->rt6i_flags & RTF_PCPU)
+		rt = (struct rt6_info *)rt->dst.from;
+
+	return rt->rt6i_node ? rt->rt6i_node->fn_sernum : 0;
+}
+
 static inline void ip6_rt_put(struct rt6_info *rt)
 {
 	/* dst_release() accepts a NULL parameter.
@@ -77,7 +77,7 @@ struct fib_nh {
 	unsigned char		nh_scope;
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 	int			nh_weight;
-	int			nh_power;
+	atomic_t		nh_upper_bound;
 #endif
 #ifdef CONFIG_IP_ROUTE_CLASSID
 	__u32			nh_tclassid;
@@ -114,9 +114,6 @@ struct fib_info {
 #define fib_rtt fib_metrics[RTAX_RTT-1]
 #define fib_advmss fib_metrics[RTAX_ADVMSS-1]
 	int			fib_nhs;
-#ifdef CONFIG_IP_ROUTE_MULTIPATH
-	int			fib_power;
-#endif
 	struct rcu_head		rcu;
 	struct fib_nh		fib_nh[0];
 #define fib_dev		fib_nh[0].nh_dev
@@ -188,12 +185,21 @@ struct fib_table {
 	unsigned long		tb_data[0];
 };
 
+/* Restricts a route dump to one table and to the routes inside a prefix */
+struct fib_dump_filter {
+	u32			table;		/* 0 for all tables */
+	__be32			dst;
+	int			dst_len;	/* 0 for all routes */
+	unsigned int		flags;		/* NLM_F_* of dumped routes */
+};
+
 int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 		     struct fib_result *res, int fib_flags);
 int fib_table_insert(struct fib_table *, struct fib_config *);
 int fib_table_delete(struct fib_table *, struct fib_config *);
 int fib_table_dump(struct fib_table *table, struct sk_buff *skb,
-		   struct netlink_callback *cb);
+		   struct netlink_callback *cb,
+		   const struct fib_dump_filter *filter);
 int fib_table_flush(struct fib_table *table);
 void fib_free_table(struct fib_table *tb);
 
@@ -292,7 +298,13 @@ int ip_fib_check_default(__be32 gw, struct net_device *dev);
 int fib_sync_down_dev(struct net_device *dev, int force);
 int fib_sync_down_addr(struct net *net, __be32 local);
 int fib_sync_up(struct net_device *dev);
-void fib_select_multipath(struct fib_result *res);
+void fib_select_multipath(struct fib_result *res, int hash);
+
+/* Exported by route.c */
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+int fib_multipath_hash(const struct net *net, const struct flowi4 *fl4,
+		       const struct sk_buff *skb);
+#endif
 
 /* Exported by fib_trie.c */
 void fib_trie_init(void);
@@ -15,6 +15,7 @@
 #include <linux/compiler.h>
 #include <linux/timer.h>
 #include <linux/bug.h>
+#include <linux/rhashtable.h>
 
 #include <net/checksum.h>
 #include <linux/netfilter.h>		/* for union nf_inet_addr */
@@ -499,7 +500,8 @@ struct ip_vs_conn_param {
 
 /* IP_VS structure allocated for each dynamically scheduled connection */
 struct ip_vs_conn {
-	struct hlist_node	c_list;         /* hashed list heads */
+	struct rhash_head	c_node;         /* netns conn_tab node */
+	u32			hashkey;        /* hash of proto, caddr, cport */
 	/* Protocol, addresses and port numbers */
 	__be16                  cport;
 	__be16                  dport;
@@ -868,6 +870,7 @@ struct netns_ipvs {
 #endif
 	/* ip_vs_conn */
 	atomic_t		conn_count;      /* connection counter */
+	struct rhashtable	conn_tab;        /* connection table */
 
 	/* ip_vs_ctl */
 	struct ip_vs_stats		tot_stats;  /* Statistics & est. */
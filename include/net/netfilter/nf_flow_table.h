@@ -0,0 +1,96 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/jiffies.h>
+#include <linux/netdevice.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack.h>
+
+/*
+ * The flow table caches established, forwarded conntrack entries so that
+ * their packets can be NATed and transmitted straight from the first
+ * netfilter hook, without going through conntrack, routing and the rest
+ * of the hooks again.  Entries are added by the nf_tables "flow_offload"
+ * expression and kept for as long as packets keep hitting them.
+ */
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+struct flow_offload_tuple {
+	__be32				src_v4;
+	__be32				dst_v4;
+	__be16				src_port;
+	__be16				dst_port;
+	int				iifidx;
+	u8				l3proto;
+	u8				l4proto;
+
+	/* All members above are the lookup key. */
+	u8				dir;
+	int				oifidx;
+	struct dst_entry		*dst_cache;
+};
+
+#define NF_FLOW_TUPLE_KEY_LEN	offsetof(struct flow_offload_tuple, dir)
+
+struct flow_offload_tuple_rhash {
+	struct hlist_node		node;
+	struct flow_offload_tuple	tuple;
+};
+
+#define FLOW_OFFLOAD_SNAT	0x1
+#define FLOW_OFFLOAD_DNAT	0x2
+#define FLOW_OFFLOAD_TEARDOWN	0x4
+
+struct flow_offload {
+	struct flow_offload_tuple_rhash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	u32				flags;
+	unsigned long			timeout;
+	struct rcu_head			rcu_head;
+};
+
+/* idle time after which a flow goes back to the slow path */
+#define NF_FLOW_TIMEOUT		(30 * HZ)
+
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+		int			ifindex;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct net *net, struct flow_offload *flow);
+void flow_offload_teardown(struct flow_offload *flow);
+struct flow_offload_tuple_rhash *flow_offload_lookup(struct net *net,
+						     struct flow_offload_tuple *tuple);
+
+static inline struct flow_offload *
+flow_offload_from_tuplehash(struct flow_offload_tuple_rhash *tuplehash)
+{
+	return container_of(tuplehash, struct flow_offload,
+			    tuplehash[tuplehash->tuple.dir]);
+}
+
+static inline void flow_offload_refresh(struct flow_offload *flow)
+{
+	unsigned long timeout = jiffies + NF_FLOW_TIMEOUT;
+
+	/* written at most once per jiffy however busy the flow is */
+	if (flow->timeout != timeout)
+		flow->timeout = timeout;
+}
+
+#endif /* _NF_FLOW_TABLE_H */
@@ -124,6 +124,7 @@ int nft_validate_data_load(const struct nft_ctx *ctx, enum nft_registers reg,
  *
  *	@cookie: implementation specific element cookie
  *	@key: element key
+ *	@key_end: closing element key of a range (concatenated sets only)
  *	@data: element data (maps only)
  *	@flags: element flags (end of interval)
  *
@@ -133,6 +134,7 @@ int nft_validate_data_load(const struct nft_ctx *ctx, enum nft_registers reg,
 struct nft_set_elem {
 	void			*cookie;
 	struct nft_data		key;
+	struct nft_data		key_end;
 	struct nft_data		data;
 	u32			flags;
 };
@@ -148,17 +150,24 @@ struct nft_set_iter {
 			      const struct nft_set_elem *elem);
 };
 
+/* each field of a concatenated key is at least one byte long */
+#define NFT_SET_MAXFIELDS	FIELD_SIZEOF(struct nft_data, data)
+
 /**
  *	struct nft_set_desc - description of set elements
  *
  *	@klen: key length
  *	@dlen: data length
  *	@size: number of set elements
+ *	@field_len: length of each field of a concatenated key
+ *	@field_count: number of fields of a concatenated key
  */
 struct nft_set_desc {
 	unsigned int		klen;
 	unsigned int		dlen;
 	unsigned int		size;
+	u8			field_len[NFT_SET_MAXFIELDS];
+	u8			field_count;
 };
 
 /**
@@ -193,6 +202,7 @@ struct nft_set_estimate {
  *	@insert: insert new element into set
  *	@remove: remove element from set
  *	@walk: iterate over all set elemeennts
+ *	@commit: make element changes of a transaction visible to lookups
  *	@privsize: function to return size of set private data
  *	@init: initialize private data of new set instance
  *	@destroy: destroy private data of set instance
@@ -213,6 +223,7 @@ struct nft_set_ops {
 	void				(*walk)(const struct nft_ctx *ctx,
 						const struct nft_set *set,
 						struct nft_set_iter *iter);
+	void				(*commit)(const struct nft_set *set);
 
 	unsigned int			(*privsize)(const struct nlattr * const nla[]);
 	bool				(*estimate)(const struct nft_set_desc *desc,
@@ -246,6 +257,9 @@ void nft_unregister_set(struct nft_set_ops *ops);
  * 	@flags: set flags
  * 	@klen: key length
  * 	@dlen: data length
+ *	@field_len: length of each field of a concatenated key
+ *	@field_count: number of fields of a concatenated key
+ *	@pending_update: list node of sets to be committed
  * 	@data: private set data
  */
 struct nft_set {
@@ -262,6 +276,9 @@ struct nft_set {
 	u16				flags;
 	u8				klen;
 	u8				dlen;
+	u8				field_len[NFT_SET_MAXFIELDS];
+	u8				field_count;
+	struct list_head		pending_update;
 	unsigned char			data[]
 		__attribute__((aligned(__alignof__(u64))));
 };
@@ -32,6 +32,7 @@ struct netns_sysctl_ipv6 {
 	int icmpv6_time;
 	int anycast_src_echo_reply;
 	int fwmark_reflect;
+	int multipath_hash_policy;
 };
 
 struct netns_ipv6 {
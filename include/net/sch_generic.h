@@ -27,6 +27,7 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_MISSED,
 };
 
 /*
@@ -61,6 +62,13 @@ struct Qdisc {
 				      */
 #define TCQ_F_WARN_NONWC	(1 << 16)
 #define TCQ_F_CPUSTATS		0x20 /* run using percpu statistics */
+#define TCQ_F_NOLOCK		0x100 /* qdisc does not require locking: its
+				       * enqueue and dequeue do their own
+				       * synchronization, it is run under
+				       * seqlock instead of the root lock,
+				       * and uses percpu statistics.  Only
+				       * honoured at the root of a tx queue.
+				       */
 	u32			limit;
 	const struct Qdisc_ops	*ops;
 	struct qdisc_size_table	__rcu *stab;
@@ -100,15 +108,30 @@ struct Qdisc {
 	atomic_t		refcnt;
 
 	spinlock_t		busylock ____cacheline_aligned_in_smp;
+	spinlock_t		seqlock; /* TCQ_F_NOLOCK runner */
 };
 
-static inline bool qdisc_is_running(const struct Qdisc *qdisc)
+static inline bool qdisc_is_running(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return spin_is_locked(&qdisc->seqlock);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (spin_trylock(&qdisc->seqlock))
+			return true;
+
+		/* Tell the running CPU to look at the queue once more
+		 * before it gives up seqlock, and retry in case it already
+		 * did so before seeing the bit.
+		 */
+		set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		smp_mb__after_atomic();
+		return spin_trylock(&qdisc->seqlock);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -117,6 +140,13 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_unlock(&qdisc->seqlock);
+		smp_mb();
+		if (unlikely(test_bit(__QDISC_STATE_MISSED, &qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -184,6 +214,7 @@ struct Qdisc_ops {
 	const struct Qdisc_class_ops	*cl_ops;
 	char			id[IFNAMSIZ];
 	int			priv_size;
+	unsigned int		static_flags;
 
 	int 			(*enqueue)(struct sk_buff *, struct Qdisc *);
 	struct sk_buff *	(*dequeue)(struct Qdisc *);
@@ -255,7 +286,7 @@ struct tcf_proto {
 struct qdisc_skb_cb {
 	unsigned int		pkt_len;
 	u16			slave_dev_queue_mapping;
-	u16			_pad;
+	u16			tc_classid;
 #define QDISC_CB_PRIV_LEN 20
 	unsigned char		data[QDISC_CB_PRIV_LEN];
 };
@@ -569,6 +600,73 @@ static inline void qdisc_qstats_drop_cpu(struct Qdisc *sch)
 	qstats->drops++;
 }
 
+static inline void qdisc_qstats_cpu_backlog_add(struct Qdisc *sch,
+						unsigned int len)
+{
+	this_cpu_add(sch->cpu_qstats->backlog, len);
+}
+
+static inline void qdisc_qstats_cpu_backlog_dec(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_sub(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+/* A percpu qlen only makes sense summed up, see qdisc_qlen_sum() */
+static inline void qdisc_qstats_cpu_qlen_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_qlen_dec(struct Qdisc *sch)
+{
+	this_cpu_dec(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_requeues_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->requeues);
+}
+
+static inline __u32 qdisc_qlen_sum(const struct Qdisc *q)
+{
+	__u32 qlen = 0;
+	int i;
+
+	if (!(q->flags & TCQ_F_NOLOCK))
+		return q->q.qlen;
+
+	for_each_possible_cpu(i)
+		qlen += per_cpu_ptr(q->cpu_qstats, i)->qlen;
+
+	return qlen;
+}
+
+/* Add the statistics of @q to the totals of a parent that sums up its
+ * children at dump time, like mq and mqprio.  qstats->qlen is left alone,
+ * use qdisc_qlen_sum() for that.
+ */
+static inline void qdisc_stats_add(struct gnet_stats_basic_packed *bstats,
+				   struct gnet_stats_queue *qstats,
+				   const struct Qdisc *q)
+{
+	if (qdisc_is_percpu_stats(q)) {
+		__u32 qlen = qstats->qlen;
+
+		/* the percpu variants add to what is already there */
+		__gnet_stats_copy_basic(bstats, q->cpu_bstats, NULL);
+		__gnet_stats_copy_queue(qstats, q->cpu_qstats, NULL, qlen);
+		return;
+	}
+
+	bstats->bytes		+= q->bstats.bytes;
+	bstats->packets		+= q->bstats.packets;
+	qstats->backlog		+= q->qstats.backlog;
+	qstats->drops		+= q->qstats.drops;
+	qstats->requeues	+= q->qstats.requeues;
+	qstats->overlimits	+= q->qstats.overlimits;
+}
+
 static inline void qdisc_qstats_overlimit(struct Qdisc *sch)
 {
 	sch->qstats.overlimits++;
@@ -124,6 +124,15 @@ struct xfrm_state_walk {
 	struct xfrm_address_filter *filter;
 };
 
+/* A state whose crypto is done by a network device. 'dev' is only set
+ * once the driver accepted the state, 'offload_handle' is the driver's own.
+ */
+struct xfrm_state_offload {
+	struct net_device	*dev;
+	unsigned long		offload_handle;
+	u8			flags;		/* XFRM_OFFLOAD_* */
+};
+
 /* Full description of state of transformer. */
 struct xfrm_state {
 #ifdef CONFIG_NET_NS
@@ -174,6 +183,9 @@ struct xfrm_state {
 	/* Data for encapsulator */
 	struct xfrm_encap_tmpl	*encap;
 
+	/* Data for crypto offload to a network device */
+	struct xfrm_state_offload xso;
+
 	/* Data for care-of address */
 	xfrm_address_t	*coaddr;
 
@@ -979,12 +991,56 @@ static inline void xfrm_dst_destroy(struct xfrm_dst *xdst)
 
 void xfrm_dst_ifdown(struct dst_entry *dst, struct net_device *dev);
 
+#define XFRM_MAX_OFFLOAD_DEPTH	1
+
+/* Crypto offload status of a packet, attached to the outermost state of
+ * its sec_path. On receive the driver sets CRYPTO_DONE in 'flags' and the
+ * outcome in 'status'; on transmit the stack fills 'seq' and 'proto' for
+ * the driver to build the ESP packet.
+ */
+struct xfrm_offload {
+	struct {
+		__u32		low;
+		__u32		hi;
+	} seq;
+
+	__u32			flags;
+#define CRYPTO_DONE		1
+
+	__u32			status;
+#define CRYPTO_SUCCESS		1
+#define CRYPTO_GENERIC_ERROR	2
+#define CRYPTO_AUTH_FAILED	4
+#define CRYPTO_INVALID_PROTOCOL	8
+
+	__u8			proto;		/* inner protocol */
+};
+
 struct sec_path {
 	atomic_t		refcnt;
 	int			len;
+	int			olen;
 	struct xfrm_state	*xvec[XFRM_MAX_DEPTH];
+	struct xfrm_offload	ovec[XFRM_MAX_OFFLOAD_DEPTH];
 };
 
+/* the offload status of a packet, if its last transformation is the
+ * one offloaded
+ */
+static inline struct xfrm_offload *xfrm_offload(struct sk_buff *skb)
+{
+#ifdef CONFIG_XFRM
+	struct sec_path *sp = skb->sp;
+
+	if (!sp || !sp->olen || sp->len != sp->olen)
+		return NULL;
+
+	return &sp->ovec[sp->olen - 1];
+#else
+	return NULL;
+#endif
+}
+
 static inline int secpath_exists(struct sk_buff *skb)
 {
 #ifdef CONFIG_XFRM
@@ -1771,6 +1827,68 @@ static inline struct xfrm_state *xfrm_input_state(struct sk_buff *skb)
 }
 #endif
 
+#ifdef CONFIG_XFRM_OFFLOAD
+int xfrm_dev_state_flush(struct net *net, struct net_device *dev);
+int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+		       struct xfrm_user_offload *xuo);
+bool xfrm_dev_offload_ok(struct sk_buff *skb, struct xfrm_state *x);
+struct xfrm_offload *xfrm_dev_offload_attach(struct sk_buff *skb,
+					     struct xfrm_state *x);
+
+static inline void xfrm_dev_state_delete(struct xfrm_state *x)
+{
+	struct xfrm_state_offload *xso = &x->xso;
+
+	if (xso->dev)
+		xso->dev->xfrmdev_ops->xdo_dev_state_delete(x);
+}
+
+static inline void xfrm_dev_state_free(struct xfrm_state *x)
+{
+	struct xfrm_state_offload *xso = &x->xso;
+	struct net_device *dev = xso->dev;
+
+	if (dev) {
+		if (dev->xfrmdev_ops->xdo_dev_state_free)
+			dev->xfrmdev_ops->xdo_dev_state_free(x);
+		xso->dev = NULL;
+		dev_put(dev);
+	}
+}
+#else
+static inline int xfrm_dev_state_flush(struct net *net,
+				       struct net_device *dev)
+{
+	return 0;
+}
+
+static inline int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+				     struct xfrm_user_offload *xuo)
+{
+	return 0;
+}
+
+static inline bool xfrm_dev_offload_ok(struct sk_buff *skb,
+				       struct xfrm_state *x)
+{
+	return false;
+}
+
+static inline struct xfrm_offload *
+xfrm_dev_offload_attach(struct sk_buff *skb, struct xfrm_state *x)
+{
+	return NULL;
+}
+
+static inline void xfrm_dev_state_delete(struct xfrm_state *x)
+{
+}
+
+static inline void xfrm_dev_state_free(struct xfrm_state *x)
+{
+}
+#endif
+
 static inline int xfrm_mark_get(struct nlattr **attrs, struct xfrm_mark *m)
 {
 	if (attrs[XFRMA_MARK])
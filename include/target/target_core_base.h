@@ -116,6 +116,8 @@
 #define DA_IS_NONROT				0
 /* Queue Algorithm Modifier default for restricted reordering in control mode page */
 #define DA_EMULATE_REST_REORD			0
+/* Complete commands through target_completion_wq by default */
+#define DA_DIRECT_COMPLETE			0
 
 #define SE_INQUIRY_BUF				1024
 #define SE_MODE_PAGE_BUF			512
@@ -484,6 +486,8 @@ struct se_cmd {
 	u16			scsi_sense_length;
 	/* Delay for ALUA Active/NonOptimized state access in milliseconds */
 	int			alua_nonop_delay;
+	/* CPU the command was received on, completions are queued there */
+	int			cpuid;
 	/* See include/linux/dma-mapping.h */
 	enum dma_data_direction	data_direction;
 	/* For SAM Task Attribute */
@@ -685,6 +689,7 @@ struct se_dev_attrib {
 	int		force_pr_aptpl;
 	int		is_nonrot;
 	int		emulate_rest_reord;
+	int		direct_complete;
 	u32		hw_block_size;
 	u32		block_size;
 	u32		hw_max_sectors;
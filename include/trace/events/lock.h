@@ -7,6 +7,12 @@
 #include <linux/lockdep.h>
 #include <linux/tracepoint.h>
 
+/* flags for lock:contention_begin */
+#define LCB_F_SPIN	(1U << 0)
+#define LCB_F_READ	(1U << 1)
+#define LCB_F_WRITE	(1U << 2)
+#define LCB_F_MUTEX	(1U << 3)
+
 #ifdef CONFIG_LOCKDEP
 
 TRACE_EVENT(lock_acquire,
@@ -80,6 +86,56 @@ DEFINE_EVENT(lock, lock_acquired,
 #endif
 #endif
 
+/*
+ * Unlike the events above these don't need lockdep: they sit in the
+ * slow paths of the lock implementations, so they cost a static branch
+ * when disabled and only fire when a lock is actually contended. The
+ * wait time is the distance between a contention_begin and the next
+ * contention_end on the same CPU.
+ */
+TRACE_EVENT(contention_begin,
+
+	TP_PROTO(void *lock, unsigned int flags),
+
+	TP_ARGS(lock, flags),
+
+	TP_STRUCT__entry(
+		__field(void *, lock_addr)
+		__field(unsigned int, flags)
+	),
+
+	TP_fast_assign(
+		__entry->lock_addr = lock;
+		__entry->flags = flags;
+	),
+
+	TP_printk("%p (flags=%s)", __entry->lock_addr,
+		  __print_flags(__entry->flags, "|",
+				{ LCB_F_SPIN,	"SPIN"	},
+				{ LCB_F_READ,	"READ"	},
+				{ LCB_F_WRITE,	"WRITE"	},
+				{ LCB_F_MUTEX,	"MUTEX"	}))
+);
+
+TRACE_EVENT(contention_end,
+
+	TP_PROTO(void *lock, int ret),
+
+	TP_ARGS(lock, ret),
+
+	TP_STRUCT__entry(
+		__field(void *, lock_addr)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->lock_addr = lock;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%p (ret=%d)", __entry->lock_addr, __entry->ret)
+);
+
 #endif /* _TRACE_LOCK_H */
 
 /* This part must be outside protection */
@@ -707,9 +707,23 @@ __SYSCALL(__NR_getrandom, sys_getrandom)
 __SYSCALL(__NR_memfd_create, sys_memfd_create)
 #define __NR_bpf 280
 __SYSCALL(__NR_bpf, sys_bpf)
+#define __NR_io_setup2 281
+__SYSCALL(__NR_io_setup2, sys_io_setup2)
+#define __NR_io_ring_enter 282
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
+#define __NR_copy_file_range 283
+__SYSCALL(__NR_copy_file_range, sys_copy_file_range)
+#define __NR_userfaultfd 284
+__SYSCALL(__NR_userfaultfd, sys_userfaultfd)
+#define __NR_mq_timedsend_batch 285
+__SC_COMP(__NR_mq_timedsend_batch, sys_mq_timedsend_batch, \
+	  compat_sys_mq_timedsend_batch)
+#define __NR_mq_timedreceive_batch 286
+__SC_COMP(__NR_mq_timedreceive_batch, sys_mq_timedreceive_batch, \
+	  compat_sys_mq_timedreceive_batch)
 
 #undef __NR_syscalls
-#define __NR_syscalls 281
+#define __NR_syscalls 287
 
 /*
  * All syscalls below here should go away really,
@@ -51,8 +51,12 @@ enum {
  *
  * IOCB_FLAG_RESFD - Set if the "aio_resfd" member of the "struct iocb"
  *                   is valid.
+ * IOCB_FLAG_NOWAIT - Fail with -EAGAIN instead of handing a request that
+ *                    cannot be issued without blocking, such as buffered
+ *                    I/O or fsync, to a kernel worker.
  */
 #define IOCB_FLAG_RESFD		(1 << 0)
+#define IOCB_FLAG_NOWAIT	(1 << 1)
 
 /* read() from /dev/aio returns these structures. */
 struct io_event {
@@ -104,6 +108,55 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Flags for io_setup2().
+ *
+ * IOCTX_FLAG_SQRING   - Add a submission ring (struct aio_sq_ring) to the
+ *                       ring mapping, see io_ring_enter().
+ * IOCTX_FLAG_SQTHREAD - Start a kernel thread that polls the submission ring,
+ *                       so no syscall is needed to submit. Implies
+ *                       IOCTX_FLAG_SQRING and requires CAP_SYS_ADMIN.
+ */
+#define IOCTX_FLAG_SQRING	(1 << 0)
+#define IOCTX_FLAG_SQTHREAD	(1 << 1)
+
+struct aio_setup_params {
+	__u32	sq_entries;	/* submission ring size, rounded up to a power of 2 */
+	__u32	sq_thread_idle;	/* ms the polling thread spins before it sleeps */
+	__s32	sq_thread_cpu;	/* cpu to bind the polling thread to, or -1 */
+	__u32	sq_offset;	/* set by the kernel: offset of the submission
+				 * ring from the start of the ring mapping */
+	__u32	resv[4];
+};
+
+/*
+ * The submission ring. The application fills iocbs[tail & (nr - 1)] and then
+ * advances tail, the kernel consumes entries and advances head. Both indices
+ * are free running.
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by the application */
+	__u32	nr;		/* number of entries in iocbs[] */
+	__u32	flags;		/* AIO_SQ_NEED_WAKEUP */
+	__u32	dropped;	/* invalid iocbs skipped by the polling thread */
+	__u32	resv[11];
+	struct iocb	iocbs[0];
+}; /* 64 bytes + ring size */
+
+/* The polling thread went to sleep, io_ring_enter() must wake it up */
+#define AIO_SQ_NEED_WAKEUP	(1U << 0)
+
+/*
+ * Flags for io_ring_enter().
+ *
+ * IORING_ENTER_GETEVENTS - Wait until at least min_complete events are in
+ *                          the completion ring.
+ * IORING_ENTER_SQ_WAKEUP - Wake up the submission ring polling thread.
+ */
+#define IORING_ENTER_GETEVENTS	(1 << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1 << 1)
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -52,6 +52,7 @@ enum blktrace_act {
 	__BLK_TA_REMAP,			/* bio was remapped */
 	__BLK_TA_ABORT,			/* request aborted */
 	__BLK_TA_DRV_DATA,		/* driver-specific binary data */
+	__BLK_TA_LATENCY,		/* completed, with request latency */
 };
 
 /*
@@ -84,6 +85,7 @@ enum blktrace_notify {
 #define BLK_TA_REMAP		(__BLK_TA_REMAP | BLK_TC_ACT(BLK_TC_QUEUE))
 #define BLK_TA_ABORT		(__BLK_TA_ABORT | BLK_TC_ACT(BLK_TC_QUEUE))
 #define BLK_TA_DRV_DATA	(__BLK_TA_DRV_DATA | BLK_TC_ACT(BLK_TC_DRV_DATA))
+#define BLK_TA_LATENCY		(__BLK_TA_LATENCY | BLK_TC_ACT(BLK_TC_COMPLETE))
 
 #define BLK_TN_PROCESS		(__BLK_TN_PROCESS | BLK_TC_ACT(BLK_TC_NOTIFY))
 #define BLK_TN_TIMESTAMP	(__BLK_TN_TIMESTAMP | BLK_TC_ACT(BLK_TC_NOTIFY))
@@ -118,6 +120,14 @@ struct blk_io_trace_remap {
 	__be64 sector_from;
 };
 
+/*
+ * The latency event, logged instead of completions in latency-only mode
+ */
+struct blk_io_trace_latency {
+	__be64 total_ns;		/* since the request was allocated */
+	__be64 io_ns;			/* since it was issued, 0 if unknown */
+};
+
 enum {
 	Blktrace_setup = 1,
 	Blktrace_running,
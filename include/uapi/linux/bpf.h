@@ -82,7 +82,7 @@ enum bpf_cmd {
 
 	/* create or update key/value pair in a given map
 	 * err = bpf(BPF_MAP_UPDATE_ELEM, union bpf_attr *attr, u32 size)
-	 * Using attr->map_fd, attr->key, attr->value
+	 * Using attr->map_fd, attr->key, attr->value, attr->flags
 	 * returns zero or negative error
 	 */
 	BPF_MAP_UPDATE_ELEM,
@@ -111,12 +111,27 @@ enum bpf_cmd {
 
 enum bpf_map_type {
 	BPF_MAP_TYPE_UNSPEC,
+	BPF_MAP_TYPE_HASH,
+	BPF_MAP_TYPE_ARRAY,
+	BPF_MAP_TYPE_PERCPU_HASH,
+	BPF_MAP_TYPE_PERCPU_ARRAY,
+	BPF_MAP_TYPE_PROG_ARRAY,
 };
 
 enum bpf_prog_type {
 	BPF_PROG_TYPE_UNSPEC,
+	BPF_PROG_TYPE_XDP,
+	BPF_PROG_TYPE_KPROBE,
+	BPF_PROG_TYPE_TRACEPOINT,
+	BPF_PROG_TYPE_SOCKET_FILTER,
+	BPF_PROG_TYPE_SCHED_CLS,
 };
 
+/* flags for BPF_MAP_UPDATE_ELEM command */
+#define BPF_ANY		0 /* create new element or update existing */
+#define BPF_NOEXIST	1 /* create new element if it didn't exist */
+#define BPF_EXIST	2 /* update existing element */
+
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
 		__u32	map_type;	/* one of enum bpf_map_type */
@@ -132,6 +147,7 @@ union bpf_attr {
 			__aligned_u64 value;
 			__aligned_u64 next_key;
 		};
+		__u64		flags;
 	};
 
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
@@ -142,6 +158,7 @@ union bpf_attr {
 		__u32		log_level;	/* verbosity level of verifier */
 		__u32		log_size;	/* size of user buffer */
 		__aligned_u64	log_buf;	/* user supplied buffer */
+		__u32		kern_version;	/* checked when prog_type=kprobe */
 	};
 } __attribute__((aligned(8)));
 
@@ -150,7 +167,148 @@ union bpf_attr {
  */
 enum bpf_func_id {
 	BPF_FUNC_unspec,
+
+	/* int bpf_redirect(int ifindex, int flags)
+	 * transmit the packet out of the device with index 'ifindex'
+	 * XDP: flags must be zero, return XDP_REDIRECT on success or
+	 * XDP_ABORTED on error
+	 * sched_cls: BPF_F_INGRESS in flags hands the packet to the receive
+	 * path of the device instead, return TC_ACT_REDIRECT on success or
+	 * TC_ACT_SHOT on error
+	 */
+	BPF_FUNC_redirect,
+
+	/* void *map_lookup_elem(&map, &key)
+	 * Return: Map value or NULL
+	 */
+	BPF_FUNC_map_lookup_elem,
+
+	/* int map_update_elem(&map, &key, &value, flags)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_map_update_elem,
+
+	/* int map_delete_elem(&map, &key)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_map_delete_elem,
+
+	/* int bpf_probe_read(void *dst, int size, void *src)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_probe_read,
+
+	/* u64 bpf_ktime_get_ns(void)
+	 * Return: current ktime in nanoseconds
+	 */
+	BPF_FUNC_ktime_get_ns,
+
+	/* int bpf_trace_printk(const char *fmt, int fmt_size, ...)
+	 * Return: number of bytes written or negative error
+	 */
+	BPF_FUNC_trace_printk,
+
+	/* u32 bpf_get_smp_processor_id(void)
+	 * Return: id of the current cpu
+	 */
+	BPF_FUNC_get_smp_processor_id,
+
+	/* int bpf_skb_store_bytes(skb, offset, from, len, flags)
+	 * store 'len' bytes from address 'from' into packet at 'offset'
+	 * flags: BPF_F_RECOMPUTE_CSUM to update skb->csum
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_skb_store_bytes,
+
+	/* int bpf_l3_csum_replace(skb, offset, from, to, flags)
+	 * incrementally update the IP checksum at 'offset' for a 'from' to
+	 * 'to' change of a header field, flags & BPF_F_HDR_FIELD_MASK is the
+	 * size of the field (2 or 4)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_l3_csum_replace,
+
+	/* int bpf_l4_csum_replace(skb, offset, from, to, flags)
+	 * same for the TCP/UDP checksum at 'offset', BPF_F_PSEUDO_HDR in
+	 * flags tells that the field is part of the pseudo header
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_l4_csum_replace,
+
+	/* int bpf_clone_redirect(skb, ifindex, flags)
+	 * send a clone of the packet to the device with index 'ifindex',
+	 * its receive path when BPF_F_INGRESS is set in flags, out of it
+	 * otherwise. The original packet stays with the program
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_clone_redirect,
+
+	/* int bpf_skb_load_bytes(skb, offset, to, len)
+	 * copy 'len' bytes of the packet at 'offset' to address 'to'
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_skb_load_bytes,
+
+	/* void bpf_tail_call(ctx, prog_array_map, index)
+	 * jump into the program stored at 'index' of a
+	 * BPF_MAP_TYPE_PROG_ARRAY map, reusing the stack frame of the
+	 * caller. Does not return on success. Falls through to the next
+	 * instruction if 'index' is out of range, the slot is empty or
+	 * the maximum chain of tail calls was reached
+	 */
+	BPF_FUNC_tail_call,
 	__BPF_FUNC_MAX_ID,
 };
 
+/* BPF_FUNC_skb_store_bytes flags. */
+#define BPF_F_RECOMPUTE_CSUM		(1ULL << 0)
+
+/* BPF_FUNC_l3_csum_replace and BPF_FUNC_l4_csum_replace flags. */
+#define BPF_F_HDR_FIELD_MASK		0xfULL
+
+/* BPF_FUNC_l4_csum_replace flags. */
+#define BPF_F_PSEUDO_HDR		(1ULL << 4)
+
+/* BPF_FUNC_redirect and BPF_FUNC_clone_redirect flags. */
+#define BPF_F_INGRESS			(1ULL << 0)
+
+/* User return codes for XDP prog type.
+ * A valid XDP program must return one of these defined values. All other
+ * return codes are reserved for future use. Unknown return codes will result
+ * in packet drop.
+ */
+enum xdp_action {
+	XDP_ABORTED = 0,	/* program error, the packet is dropped */
+	XDP_DROP,		/* drop the packet, recycle the buffer */
+	XDP_PASS,		/* hand the packet to the regular stack */
+	XDP_TX,			/* send it back out of the receiving port */
+	XDP_REDIRECT,		/* send it out of the port set by bpf_redirect() */
+};
+
+/* user accessible metadata for XDP packet hook
+ * new fields must be added to the end of this structure
+ */
+struct xdp_md {
+	__u32 data;
+	__u32 data_end;
+};
+
+/* user accessible mirror of in-kernel sk_buff, the context of
+ * BPF_PROG_TYPE_SOCKET_FILTER and BPF_PROG_TYPE_SCHED_CLS programs.
+ * sched_cls programs may also write mark, priority, tc_index and
+ * tc_classid, the latter is only available to them
+ * new fields must be added to the end of this structure
+ */
+struct __sk_buff {
+	__u32 len;
+	__u32 mark;
+	__u32 queue_mapping;
+	__u32 protocol;
+	__u32 hash;
+	__u32 priority;
+	__u32 ingress_ifindex;
+	__u32 tc_index;
+	__u32 tc_classid;
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
@@ -20,6 +20,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAIT_MULTIPLE	13
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -39,6 +40,25 @@
 					 FUTEX_PRIVATE_FLAG)
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAIT_MULTIPLE_PRIVATE	(FUTEX_WAIT_MULTIPLE | \
+					 FUTEX_PRIVATE_FLAG)
+
+/*
+ * FUTEX_WAIT_MULTIPLE: uaddr points to an array of val of these, and the
+ * call blocks until any of the futexes is woken, returning its index.
+ * The uaddr field is 64 bits wide so that 32 and 64 bit tasks share the
+ * same layout.
+ *
+ * NOTE: this structure is part of the syscall ABI, and must not be
+ * changed.
+ */
+struct futex_wait_block {
+	__u64 uaddr;
+	__u32 val;
+	__u32 bitset;
+};
+
+#define FUTEX_WAIT_MULTIPLE_MAX	128
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
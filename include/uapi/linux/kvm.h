@@ -172,6 +172,7 @@ struct kvm_pit_config {
 #define KVM_EXIT_S390_TSCH        22
 #define KVM_EXIT_EPR              23
 #define KVM_EXIT_SYSTEM_EVENT     24
+#define KVM_EXIT_DIRTY_RING_FULL  25
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -761,6 +762,8 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_PPC_FIXUP_HCALL 103
 #define KVM_CAP_PPC_ENABLE_HCALL 104
 #define KVM_CAP_CHECK_EXTENSION_VM 105
+#define KVM_CAP_HALT_POLL 106
+#define KVM_CAP_DIRTY_LOG_RING 107
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1188,4 +1191,33 @@ struct kvm_assigned_msix_entry {
 	__u16 padding[3];
 };
 
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS		_IO(KVMIO, 0xc7)
+
+/*
+ * The ring of a vcpu is mapped from its fd at KVM_DIRTY_LOG_PAGE_OFFSET
+ * pages, and holds the size passed to KVM_ENABLE_CAP divided by
+ * sizeof(struct kvm_dirty_gfn) entries.  Each entry goes through:
+ *
+ *   0 --KVM pushes--> DIRTY --userspace collects--> RESET
+ *     --KVM_RESET_DIRTY_RINGS--> 0
+ *
+ * Userspace reads slot and offset only after seeing DIRTY set, and sets
+ * RESET with release semantics.  When the ring fills up the vcpu exits
+ * with KVM_EXIT_DIRTY_RING_FULL and has to be resumed after a reset.
+ */
+#ifndef KVM_DIRTY_LOG_PAGE_OFFSET
+#define KVM_DIRTY_LOG_PAGE_OFFSET 0
+#endif
+
+#define KVM_DIRTY_GFN_F_DIRTY		(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET		(1 << 1)
+#define KVM_DIRTY_GFN_F_MASK		0x3
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;	/* memory slot id */
+	__u64 offset;	/* page offset into the slot */
+};
+
 #endif /* __LINUX_KVM_H */
@@ -18,6 +18,8 @@
 #ifndef _LINUX_MQUEUE_H
 #define _LINUX_MQUEUE_H
 
+#include <linux/types.h>
+
 #define MQ_PRIO_MAX 	32768
 /* per-uid limit of kernel memory used by mqueue, in bytes */
 #define MQ_BYTES_MAX	819200
@@ -30,6 +32,18 @@ struct mq_attr {
 	__kernel_long_t	__reserved[4];	/* ignored for input, zeroed for output */
 };
 
+/*
+ * One message of mq_timedsend_batch() and mq_timedreceive_batch(). On
+ * receive msg_len is the size of the buffer on input and the size of the
+ * message on output, and msg_prio is filled in.
+ */
+struct mq_msgvec {
+	__u64		msg_ptr;	/* user address of the message buffer	*/
+	__u64		msg_len;	/* buffer/message size			*/
+	__u32		msg_prio;	/* message priority			*/
+	__u32		__reserved;	/* ignored for input			*/
+};
+
 /*
  * SIGEV_THREAD implementation:
  * SIGEV_THREAD must be implemented in user space. If SIGEV_THREAD is passed
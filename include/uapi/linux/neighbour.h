@@ -36,6 +36,7 @@ enum {
 
 #define NTF_USE		0x01
 #define NTF_PROXY	0x08	/* == ATF_PUBL */
+#define NTF_EXT_LEARNED	0x10
 #define NTF_ROUTER	0x80
 
 #define NTF_SELF	0x02
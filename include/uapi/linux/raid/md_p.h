@@ -305,4 +305,49 @@ struct mdp_superblock_1 {
 					|MD_FEATURE_RECOVERY_BITMAP	\
 					)
 
+/*
+ * raid4/5/6 write journal.
+ *
+ * The journal device starts with a superblock in its first 4k; records
+ * follow from R5L_LOG_START and are written circularly.  Each record is a
+ * 4k header followed by the data of one write to the array, padded to a
+ * multiple of 4k.  A record that does not fit before the end of the
+ * device is written at R5L_LOG_START instead.
+ *
+ * 'checkpoint' is the position of the oldest record that may not be on
+ * the array yet and 'seq' its sequence number: recovery replays records
+ * from there for as long as their sequence numbers follow each other and
+ * their checksums match.  All checksums are crc32c, seeded with the crc32c
+ * of the array uuid and computed with the checksum field itself zeroed.
+ */
+#define R5L_SUPER_MAGIC		0x6433c509
+#define R5L_RECORD_MAGIC	0x7b4d1a26
+#define R5L_VERSION		1
+
+#define R5L_BLOCK_SECTORS	8
+#define R5L_LOG_START		R5L_BLOCK_SECTORS	/* first record */
+
+struct r5l_super {
+	__le32	magic;
+	__le32	checksum;
+	__le32	version;
+	__le32	pad;
+	__u8	set_uuid[16];	/* of the array */
+	__le64	log_size;	/* in sectors, as formatted */
+	__le64	checkpoint;	/* sector of the first record to replay */
+	__le64	seq;		/* its sequence number */
+};
+
+struct r5l_record_header {
+	__le32	magic;
+	__le32	checksum;	/* of this header */
+	__le32	version;
+	__le32	data_checksum;
+	__le64	seq;
+	__le64	position;	/* sector of this header in the journal */
+	__le64	location;	/* sector of the data in the array */
+	__le32	size;		/* of the data, in sectors */
+	__le32	pad;
+};
+
 #endif
@@ -0,0 +1,48 @@
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - first page of a mapped per-CPU ring buffer
+ * @meta_page_size:	Size of this meta page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer, including its page header.
+ * @nr_subbufs:		Number of sub-buffers, including the reader one.
+ * @reader.lost_events:	Events overwritten before the reader sub-buffer.
+ * @reader.id:		Id of the reader sub-buffer.
+ * @reader.read:	Start of the data handed to user space in that
+ *			sub-buffer, as an offset after the page header.
+ * @reader.commit:	End of the data handed to user space.
+ * @entries:		Number of entries in the ring buffer.
+ * @overrun:		Number of entries lost to overwriting.
+ * @read:		Number of entries consumed.
+ *
+ * Sub-buffer id N is mapped at page N + 1 of the mapping.  Every
+ * TRACE_MMAP_IOCTL_GET_READER call consumes the previous range and
+ * updates @reader with the next one, which is empty when @reader.read
+ * equals @reader.commit.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__reserved;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
@@ -27,6 +27,16 @@ struct vhost_vring_file {
 
 };
 
+struct vhost_vring_worker {
+	unsigned int index;
+	unsigned int worker_id;
+};
+
+struct vhost_worker_state {
+	unsigned int worker_id;
+	int cpu; /* Pass -1 to leave the worker unbound. */
+};
+
 struct vhost_vring_addr {
 	unsigned int index;
 	/* Option flags. */
@@ -92,6 +102,13 @@ struct vhost_memory {
 /* Specify an eventfd file descriptor to signal on log write. */
 #define VHOST_SET_LOG_FD _IOW(VHOST_VIRTIO, 0x07, int)
 
+/* Workers. By default all rings are run by a single worker thread created
+ * at VHOST_SET_OWNER time, with worker_id 0. */
+/* Create a worker, bound to cpu unless it is -1. Returns the new worker_id. */
+#define VHOST_NEW_WORKER _IOWR(VHOST_VIRTIO, 0x08, struct vhost_worker_state)
+/* Free a worker. Fails while a ring is still attached to it. */
+#define VHOST_FREE_WORKER _IOW(VHOST_VIRTIO, 0x09, struct vhost_worker_state)
+
 /* Ring setup. */
 /* Set number of descriptors in ring. This parameter can not
  * be modified while ring is running (bound to a device). */
@@ -102,6 +119,18 @@ struct vhost_memory {
 #define VHOST_SET_VRING_BASE _IOW(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
 /* Get accessor: reads index, writes value in num */
 #define VHOST_GET_VRING_BASE _IOWR(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
+/* With VIRTIO_RING_F_PACKED acked, which must be done first, the base is
+ * the next available slot with the wrap counter in bit 15, and the next used
+ * slot with its wrap counter in the upper 16 bits. The ring addresses are
+ * the descriptor ring, the driver and the device event areas, and the log
+ * address is that of the descriptor ring; the device event area must follow
+ * it. */
+/* Run a ring on the given worker. Can be changed while the ring is running. */
+#define VHOST_ATTACH_VRING_WORKER _IOW(VHOST_VIRTIO, 0x15,		\
+				       struct vhost_vring_worker)
+/* Get accessor: reads index, writes worker_id */
+#define VHOST_GET_VRING_WORKER _IOWR(VHOST_VIRTIO, 0x16,		\
+				     struct vhost_vring_worker)
 
 /* The following ioctls use eventfd file descriptors to signal and poll
  * for events. */
@@ -112,6 +141,12 @@ struct vhost_memory {
 #define VHOST_SET_VRING_CALL _IOW(VHOST_VIRTIO, 0x21, struct vhost_vring_file)
 /* Set eventfd to signal an error */
 #define VHOST_SET_VRING_ERR _IOW(VHOST_VIRTIO, 0x22, struct vhost_vring_file)
+/* Set the time to busy poll for new work before sleeping, in us in num.
+ * Zero, the default, disables busy polling. */
+#define VHOST_SET_VRING_BUSYLOOP_TIMEOUT _IOW(VHOST_VIRTIO, 0x23,	\
+					 struct vhost_vring_state)
+#define VHOST_GET_VRING_BUSYLOOP_TIMEOUT _IOW(VHOST_VIRTIO, 0x24,	\
+					 struct vhost_vring_state)
 
 /* VHOST_NET specific defines */
 
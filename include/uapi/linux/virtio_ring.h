@@ -58,6 +58,25 @@
  * at the end of the used ring. Guest should ignore the used->flags field. */
 #define VIRTIO_RING_F_EVENT_IDX		29
 
+/* The ring uses the packed layout: a single ring of descriptors that the
+ * driver marks available and the device marks used in place, instead of the
+ * separate descriptor table, available and used rings. */
+#define VIRTIO_RING_F_PACKED		31
+
+/* Packed ring descriptor flags, in addition to the VRING_DESC_F_* above.
+ * A descriptor is available when its AVAIL bit matches the driver's wrap
+ * counter and its USED bit doesn't, and used when both match the device's. */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Packed ring event suppression flags. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/* Notify once the ring reaches off_wrap. Needs VIRTIO_RING_F_EVENT_IDX. */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+/* Bit of off_wrap that holds the wrap counter. */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
 /* Virtio ring descriptors: 16 bytes.  These can chain together via "next". */
 struct vring_desc {
 	/* Address (guest-physical). */
@@ -100,6 +119,37 @@ struct vring {
 	struct vring_used *used;
 };
 
+/* Packed ring descriptors: 16 bytes. The buffer id is in the last descriptor
+ * of a chain, and is what the device writes back when it is used. */
+struct vring_packed_desc {
+	/* Address (guest-physical). */
+	__u64 addr;
+	/* Length. */
+	__u32 len;
+	/* Buffer id. */
+	__u16 id;
+	/* VRING_DESC_F_* and VRING_PACKED_DESC_F_* flags. */
+	__u16 flags;
+};
+
+/* Event suppression area, one written by each side. */
+struct vring_packed_desc_event {
+	/* Ring offset and wrap counter to notify at, for FLAG_DESC. */
+	__u16 off_wrap;
+	/* VRING_PACKED_EVENT_FLAG_* */
+	__u16 flags;
+};
+
+struct vring_packed {
+	unsigned int num;
+
+	struct vring_packed_desc *desc;
+
+	struct vring_packed_desc_event *driver;
+
+	struct vring_packed_desc_event *device;
+};
+
 /* The standard layout for the ring is a continuous chunk of memory which looks
  * like this.  We assume num is a power of 2.
  *
@@ -146,6 +196,42 @@ static inline unsigned vring_size(unsigned int num, unsigned long align)
 		+ sizeof(__u16) * 3 + sizeof(struct vring_used_elem) * num;
 }
 
+/* The packed layout is smaller than the split one for the same num and align,
+ * so a transport can always allocate vring_size() bytes for either.
+ *
+ * struct vring_packed
+ * {
+ *	// The descriptor ring (16 bytes each)
+ *	struct vring_packed_desc desc[num];
+ *
+ *	// Written by the driver, read by the device.
+ *	struct vring_packed_desc_event driver;
+ *
+ *	// Padding to the next align boundary, so the two event areas
+ *	// don't share a cache line.
+ *	char pad[];
+ *
+ *	// Written by the device, read by the driver.
+ *	struct vring_packed_desc_event device;
+ * };
+ */
+static inline void vring_packed_init(struct vring_packed *vr, unsigned int num,
+				     void *p, unsigned long align)
+{
+	vr->num = num;
+	vr->desc = p;
+	vr->driver = p + num * sizeof(struct vring_packed_desc);
+	vr->device = (void *)(((unsigned long)(vr->driver + 1) + align - 1)
+			      & ~(align - 1));
+}
+
+static inline unsigned vring_packed_size(unsigned int num, unsigned long align)
+{
+	return ((sizeof(struct vring_packed_desc) * num +
+		 sizeof(struct vring_packed_desc_event) + align - 1)
+		& ~(align - 1)) + sizeof(struct vring_packed_desc_event);
+}
+
 /* The following is used with USED_EVENT_IDX and AVAIL_EVENT_IDX */
 /* Assuming a given event_idx value from the other size, if
  * we have just incremented index from old to new_idx,
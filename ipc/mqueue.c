@@ -35,6 +35,7 @@
 #include <linux/ipc_namespace.h>
 #include <linux/user_namespace.h>
 #include <linux/slab.h>
+#include <linux/uio.h>
 
 #include <net/sock.h>
 #include "util.h"
@@ -1174,6 +1175,308 @@ out:
 	return ret;
 }
 
+/*
+ * Look up and check a message queue descriptor for the batched calls.
+ * Returns the mqueue info with a reference on @f, or an error pointer.
+ */
+static struct mqueue_inode_info *mq_batch_get(mqd_t mqdes, struct fd *f,
+					      fmode_t mode)
+{
+	*f = fdget(mqdes);
+	if (unlikely(!f->file))
+		return ERR_PTR(-EBADF);
+
+	if (unlikely(f->file->f_op != &mqueue_file_operations) ||
+	    unlikely(!(f->file->f_mode & mode))) {
+		fdput(*f);
+		return ERR_PTR(-EBADF);
+	}
+	audit_inode(NULL, f->file->f_path.dentry, 0);
+
+	return MQUEUE_I(file_inode(f->file));
+}
+
+static struct mq_msgvec *mq_batch_load_vec(const struct mq_msgvec __user *u_vec,
+					   unsigned int vlen)
+{
+	struct mq_msgvec *vec;
+
+	vec = kmalloc_array(vlen, sizeof(*vec), GFP_KERNEL);
+	if (!vec)
+		return ERR_PTR(-ENOMEM);
+
+	if (copy_from_user(vec, u_vec, vlen * sizeof(*vec))) {
+		kfree(vec);
+		return ERR_PTR(-EFAULT);
+	}
+	return vec;
+}
+
+/*
+ * mq_timedsend_batch() - send up to @vlen messages under one hold of the
+ * queue lock. Only the first message may block for free space, the call
+ * returns as soon as the queue is full again. Returns the number of
+ * messages sent.
+ */
+SYSCALL_DEFINE5(mq_timedsend_batch, mqd_t, mqdes,
+		const struct mq_msgvec __user *, u_vec, unsigned int, vlen,
+		unsigned int, flags,
+		const struct timespec __user *, u_abs_timeout)
+{
+	struct fd f;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct ext_wait_queue *receiver;
+	struct msg_msg **msgs;
+	struct mq_msgvec *vec;
+	struct mqueue_inode_info *info;
+	ktime_t expires, *timeout = NULL;
+	struct timespec ts;
+	struct posix_msg_tree_node *new_leaf = NULL;
+	unsigned int i, sent = 0;
+	long ret = 0;
+
+	if (flags || !vlen)
+		return -EINVAL;
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+
+	if (u_abs_timeout) {
+		int res = prepare_timeout(u_abs_timeout, &expires, &ts);
+		if (res)
+			return res;
+		timeout = &expires;
+	}
+
+	vec = mq_batch_load_vec(u_vec, vlen);
+	if (IS_ERR(vec))
+		return PTR_ERR(vec);
+
+	audit_mq_sendrecv(mqdes, vec[0].msg_len, vec[0].msg_prio,
+			  timeout ? &ts : NULL);
+
+	info = mq_batch_get(mqdes, &f, FMODE_WRITE);
+	if (IS_ERR(info)) {
+		ret = PTR_ERR(info);
+		goto out_free_vec;
+	}
+	inode = file_inode(f.file);
+
+	msgs = kcalloc(vlen, sizeof(*msgs), GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto out_fput;
+	}
+
+	/* Copy all the messages in before touching the queue */
+	for (i = 0; i < vlen; i++) {
+		if (unlikely(vec[i].msg_prio >= (unsigned long) MQ_PRIO_MAX)) {
+			ret = -EINVAL;
+			goto out_free_msgs;
+		}
+		if (unlikely(vec[i].msg_len > info->attr.mq_msgsize)) {
+			ret = -EMSGSIZE;
+			goto out_free_msgs;
+		}
+		msgs[i] = load_msg((const void __user *)(unsigned long)
+				   vec[i].msg_ptr, vec[i].msg_len);
+		if (IS_ERR(msgs[i])) {
+			ret = PTR_ERR(msgs[i]);
+			msgs[i] = NULL;
+			goto out_free_msgs;
+		}
+		msgs[i]->m_ts = vec[i].msg_len;
+		msgs[i]->m_type = vec[i].msg_prio;
+	}
+
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
+	spin_lock(&info->lock);
+
+	if (!info->node_cache && new_leaf) {
+		INIT_LIST_HEAD(&new_leaf->msg_list);
+		info->node_cache = new_leaf;
+		info->qsize += sizeof(*new_leaf);
+	} else {
+		kfree(new_leaf);
+	}
+
+	for (; sent < vlen; sent++) {
+		if (info->attr.mq_curmsgs == info->attr.mq_maxmsg)
+			break;
+
+		receiver = wq_get_first_waiter(info, RECV);
+		if (receiver) {
+			pipelined_send(info, msgs[sent], receiver);
+		} else {
+			ret = msg_insert(msgs[sent], info);
+			if (ret)
+				break;
+			__do_notify(info);
+		}
+		msgs[sent] = NULL;
+	}
+
+	if (sent) {
+		inode->i_atime = inode->i_mtime = inode->i_ctime =
+				CURRENT_TIME;
+		spin_unlock(&info->lock);
+		ret = sent;
+	} else if (ret || (f.file->f_flags & O_NONBLOCK)) {
+		spin_unlock(&info->lock);
+		if (!ret)
+			ret = -EAGAIN;
+	} else {
+		wait.task = current;
+		wait.msg = (void *) msgs[0];
+		wait.state = STATE_NONE;
+		/* returns with info->lock released */
+		ret = wq_sleep(info, SEND, timeout, &wait);
+		if (!ret) {
+			msgs[0] = NULL;
+			ret = 1;
+		}
+	}
+
+out_free_msgs:
+	for (i = 0; i < vlen; i++)
+		if (msgs[i])
+			free_msg(msgs[i]);
+	kfree(msgs);
+out_fput:
+	fdput(f);
+out_free_vec:
+	kfree(vec);
+	return ret;
+}
+
+/*
+ * mq_timedreceive_batch() - receive up to @vlen messages under one hold of
+ * the queue lock. Blocks until at least one message is queued, then drains
+ * whatever else is there without sleeping again. The size and priority of
+ * each message are stored back into @u_vec. Returns the number of messages
+ * received.
+ */
+SYSCALL_DEFINE5(mq_timedreceive_batch, mqd_t, mqdes,
+		struct mq_msgvec __user *, u_vec, unsigned int, vlen,
+		unsigned int, flags,
+		const struct timespec __user *, u_abs_timeout)
+{
+	struct fd f;
+	struct inode *inode;
+	struct msg_msg **msgs;
+	struct mq_msgvec *vec;
+	struct mqueue_inode_info *info;
+	struct ext_wait_queue wait;
+	ktime_t expires, *timeout = NULL;
+	struct timespec ts;
+	struct posix_msg_tree_node *new_leaf = NULL;
+	unsigned int i, nr = 0;
+	long ret = 0;
+
+	if (flags || !vlen)
+		return -EINVAL;
+	if (vlen > UIO_MAXIOV)
+		vlen = UIO_MAXIOV;
+
+	if (u_abs_timeout) {
+		int res = prepare_timeout(u_abs_timeout, &expires, &ts);
+		if (res)
+			return res;
+		timeout = &expires;
+	}
+
+	audit_mq_sendrecv(mqdes, 0, 0, timeout ? &ts : NULL);
+
+	vec = mq_batch_load_vec(u_vec, vlen);
+	if (IS_ERR(vec))
+		return PTR_ERR(vec);
+
+	info = mq_batch_get(mqdes, &f, FMODE_READ);
+	if (IS_ERR(info)) {
+		ret = PTR_ERR(info);
+		goto out_free_vec;
+	}
+	inode = file_inode(f.file);
+
+	/* checks if all the buffers are big enough */
+	for (i = 0; i < vlen; i++) {
+		if (unlikely(vec[i].msg_len < info->attr.mq_msgsize)) {
+			ret = -EMSGSIZE;
+			goto out_fput;
+		}
+	}
+
+	msgs = kcalloc(vlen, sizeof(*msgs), GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto out_fput;
+	}
+
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
+	spin_lock(&info->lock);
+
+	if (!info->node_cache && new_leaf) {
+		INIT_LIST_HEAD(&new_leaf->msg_list);
+		info->node_cache = new_leaf;
+		info->qsize += sizeof(*new_leaf);
+	} else {
+		kfree(new_leaf);
+	}
+
+	if (info->attr.mq_curmsgs == 0) {
+		if (f.file->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+			goto out_free_msgs;
+		}
+
+		wait.task = current;
+		wait.state = STATE_NONE;
+		/* returns with info->lock released */
+		ret = wq_sleep(info, RECV, timeout, &wait);
+		if (ret)
+			goto out_free_msgs;
+		msgs[nr++] = wait.msg;
+
+		/* pick up whatever else has been queued meanwhile */
+		spin_lock(&info->lock);
+	}
+
+	while (nr < vlen && info->attr.mq_curmsgs) {
+		msgs[nr++] = msg_get(info);
+		/* There is now free space in queue. */
+		pipelined_receive(info);
+	}
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	spin_unlock(&info->lock);
+
+	for (i = 0; i < nr; i++) {
+		vec[i].msg_len = msgs[i]->m_ts;
+		vec[i].msg_prio = msgs[i]->m_type;
+		if (store_msg((void __user *)(unsigned long)vec[i].msg_ptr,
+			      msgs[i], msgs[i]->m_ts))
+			ret = -EFAULT;
+	}
+	if (!ret && copy_to_user(u_vec, vec, nr * sizeof(*vec)))
+		ret = -EFAULT;
+	if (!ret)
+		ret = nr;
+
+out_free_msgs:
+	for (i = 0; i < nr; i++)
+		free_msg(msgs[i]);
+	kfree(msgs);
+out_fput:
+	fdput(f);
+out_free_vec:
+	kfree(vec);
+	return ret;
+}
+
 /*
  * Notes: the case when user wants us to deregister (with NULL as pointer)
  * and he isn't currently owner of notification, will be silently discarded.
@@ -54,7 +54,8 @@ static const struct bpf_context_access {
 	},
 };
 
-static bool test_is_valid_access(int off, int size, enum bpf_access_type type)
+static bool test_is_valid_access(int off, int size, enum bpf_access_type type,
+				 enum bpf_reg_type *reg_type)
 {
 	const struct bpf_context_access *access;
 
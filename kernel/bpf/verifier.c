@@ -123,21 +123,21 @@
  *
  * After the call R0 is set to return type of the function and registers R1-R5
  * are set to NOT_INIT to indicate that they are no longer readable.
+ *
+ * Program types that see raw packet data (like XDP) load PTR_TO_PACKET and
+ * PTR_TO_PACKET_END registers from their bpf_context. A packet pointer can be
+ * advanced by a constant and dereferenced only after it was compared against
+ * the end of the packet:
+ *    BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1, 0), // R2 = PTR_TO_PACKET
+ *    BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_1, 4), // R3 = PTR_TO_PACKET_END
+ *    BPF_MOV64_REG(BPF_REG_4, BPF_REG_2),
+ *    BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, 14),       // R4 = pkt(off=14)
+ *    BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+ *    BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 12), // ok: [0, 14) is in bounds
+ * In the fall-through branch of the comparison all packet pointers learn that
+ * [start, start + 14) is accessible (their 'range'). See check_cond_jmp_op().
  */
 
-/* types of values stored in eBPF registers */
-enum bpf_reg_type {
-	NOT_INIT = 0,		 /* nothing was written into register */
-	UNKNOWN_VALUE,		 /* reg doesn't contain a valid pointer */
-	PTR_TO_CTX,		 /* reg points to bpf_context */
-	CONST_PTR_TO_MAP,	 /* reg points to struct bpf_map */
-	PTR_TO_MAP_VALUE,	 /* reg points to map element value */
-	PTR_TO_MAP_VALUE_OR_NULL,/* points to map elem value or NULL */
-	FRAME_PTR,		 /* reg == frame_pointer */
-	PTR_TO_STACK,		 /* reg == frame_pointer + imm */
-	CONST_IMM,		 /* constant integer value */
-};
-
 struct reg_state {
 	enum bpf_reg_type type;
 	union {
@@ -148,6 +148,15 @@ struct reg_state {
 		 *   PTR_TO_MAP_VALUE_OR_NULL
 		 */
 		struct bpf_map *map_ptr;
+
+		/* valid when type == PTR_TO_PACKET
+		 * 'off' is the constant offset from the start of the packet,
+		 * [start, start + range) is known to be within packet bounds
+		 */
+		struct {
+			u16 off;
+			u16 range;
+		};
 	};
 };
 
@@ -202,6 +211,7 @@ struct verifier_env {
 	struct verifier_state_list **explored_states; /* search pruning optimization */
 	struct bpf_map *used_maps[MAX_USED_MAPS]; /* array of map's used by eBPF program */
 	u32 used_map_cnt;		/* number of used maps */
+	enum bpf_reg_type *insn_ptr_type; /* base pointer of each ld/st insn */
 };
 
 /* verbose verifier prints what it's seeing
@@ -239,6 +249,8 @@ static const char * const reg_type_str[] = {
 	[FRAME_PTR]		= "fp",
 	[PTR_TO_STACK]		= "fp",
 	[CONST_IMM]		= "imm",
+	[PTR_TO_PACKET]		= "pkt",
+	[PTR_TO_PACKET_END]	= "pkt_end",
 };
 
 static void print_verifier_state(struct verifier_env *env)
@@ -258,6 +270,10 @@ static void print_verifier_state(struct verifier_env *env)
 			verbose("(ks=%d,vs=%d)",
 				env->cur_state.regs[i].map_ptr->key_size,
 				env->cur_state.regs[i].map_ptr->value_size);
+		else if (t == PTR_TO_PACKET)
+			verbose("(off=%d,r=%d)",
+				env->cur_state.regs[i].off,
+				env->cur_state.regs[i].range);
 	}
 	for (i = 0; i < MAX_BPF_STACK; i++) {
 		if (env->cur_state.stack[i].stype == STACK_SPILL)
@@ -545,7 +561,9 @@ static int check_stack_write(struct verifier_state *state, int off, int size,
 	if (value_regno >= 0 &&
 	    (state->regs[value_regno].type == PTR_TO_MAP_VALUE ||
 	     state->regs[value_regno].type == PTR_TO_STACK ||
-	     state->regs[value_regno].type == PTR_TO_CTX)) {
+	     state->regs[value_regno].type == PTR_TO_CTX ||
+	     state->regs[value_regno].type == PTR_TO_PACKET ||
+	     state->regs[value_regno].type == PTR_TO_PACKET_END)) {
 
 		/* register containing pointer is being spilled into stack */
 		if (size != 8) {
@@ -631,12 +649,29 @@ static int check_map_access(struct verifier_env *env, u32 regno, int off,
 	return 0;
 }
 
+#define MAX_PACKET_OFF 0xffff
+
+/* check read/write into packet data via PTR_TO_PACKET register */
+static int check_packet_access(struct verifier_env *env, u32 regno, int off,
+			       int size)
+{
+	struct reg_state *reg = &env->cur_state.regs[regno];
+
+	off += reg->off;
+	if (off < 0 || off + size > reg->range) {
+		verbose("invalid access to packet, off=%d size=%d, R%d(off=%d,r=%d)\n",
+			off, size, regno, reg->off, reg->range);
+		return -EACCES;
+	}
+	return 0;
+}
+
 /* check access to 'struct bpf_context' fields */
 static int check_ctx_access(struct verifier_env *env, int off, int size,
-			    enum bpf_access_type t)
+			    enum bpf_access_type t, enum bpf_reg_type *reg_type)
 {
 	if (env->prog->aux->ops->is_valid_access &&
-	    env->prog->aux->ops->is_valid_access(off, size, t))
+	    env->prog->aux->ops->is_valid_access(off, size, t, reg_type))
 		return 0;
 
 	verbose("invalid bpf_context access off=%d size=%d\n", off, size);
@@ -660,7 +695,17 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 	if (size < 0)
 		return size;
 
-	if (off % size != 0) {
+	if (state->regs[regno].type == PTR_TO_PACKET) {
+		/* packet data has no alignment guarantees, so only insist
+		 * on aligned access where unaligned loads are expensive
+		 */
+		if (!IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) &&
+		    (NET_IP_ALIGN + state->regs[regno].off + off) % size != 0) {
+			verbose("misaligned packet access off %d+%d size %d\n",
+				state->regs[regno].off, off, size);
+			return -EACCES;
+		}
+	} else if (off % size != 0) {
 		verbose("misaligned access off %d size %d\n", off, size);
 		return -EACCES;
 	}
@@ -671,7 +716,28 @@ static int check_mem_access(struct verifier_env *env, u32 regno, int off,
 			mark_reg_unknown_value(state->regs, value_regno);
 
 	} else if (state->regs[regno].type == PTR_TO_CTX) {
-		err = check_ctx_access(env, off, size, t);
+		enum bpf_reg_type reg_type = UNKNOWN_VALUE;
+
+		if (t == BPF_WRITE && value_regno >= 0 &&
+		    state->regs[value_regno].type != UNKNOWN_VALUE &&
+		    state->regs[value_regno].type != CONST_IMM) {
+			verbose("R%d leaks addr into ctx\n", value_regno);
+			return -EACCES;
+		}
+		err = check_ctx_access(env, off, size, t, &reg_type);
+		if (!err && t == BPF_READ && value_regno >= 0) {
+			mark_reg_unknown_value(state->regs, value_regno);
+			state->regs[value_regno].type = reg_type;
+		}
+
+	} else if (state->regs[regno].type == PTR_TO_PACKET) {
+		if (t == BPF_WRITE && value_regno >= 0 &&
+		    state->regs[value_regno].type != UNKNOWN_VALUE &&
+		    state->regs[value_regno].type != CONST_IMM) {
+			verbose("R%d leaks addr into packet\n", value_regno);
+			return -EACCES;
+		}
+		err = check_packet_access(env, regno, off, size);
 		if (!err && t == BPF_READ && value_regno >= 0)
 			mark_reg_unknown_value(state->regs, value_regno);
 
@@ -713,6 +779,15 @@ static int check_xadd(struct verifier_env *env, struct bpf_insn *insn)
 	if (err)
 		return err;
 
+	/* ctx fields are rewritten to plain loads and stores, which cannot
+	 * keep the atomic semantics
+	 */
+	if (regs[insn->dst_reg].type == PTR_TO_CTX) {
+		verbose("BPF_XADD stores into R%d context is not allowed\n",
+			insn->dst_reg);
+		return -EACCES;
+	}
+
 	/* check whether atomic_add can read the memory */
 	err = check_mem_access(env, insn->dst_reg, insn->off,
 			       BPF_SIZE(insn->code), BPF_READ, -1);
@@ -778,6 +853,8 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 		expected_type = CONST_IMM;
 	} else if (arg_type == ARG_CONST_MAP_PTR) {
 		expected_type = CONST_PTR_TO_MAP;
+	} else if (arg_type == ARG_PTR_TO_CTX) {
+		expected_type = PTR_TO_CTX;
 	} else {
 		verbose("unsupported arg_type %d\n", arg_type);
 		return -EFAULT;
@@ -836,6 +913,23 @@ static int check_func_arg(struct verifier_env *env, u32 regno,
 	return err;
 }
 
+/* a prog_array holds program references and is only usable for tail
+ * calls, which in turn only accept a prog_array
+ */
+static int check_map_func_compatibility(struct bpf_map *map, int func_id)
+{
+	if (!map)
+		return 0;
+
+	if ((map->map_type == BPF_MAP_TYPE_PROG_ARRAY) !=
+	    (func_id == BPF_FUNC_tail_call)) {
+		verbose("cannot pass map_type %d into func %d\n",
+			map->map_type, func_id);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int check_call(struct verifier_env *env, int func_id)
 {
 	struct verifier_state *state = &env->cur_state;
@@ -882,6 +976,10 @@ static int check_call(struct verifier_env *env, int func_id)
 	if (err)
 		return err;
 
+	err = check_map_func_compatibility(map, func_id);
+	if (err)
+		return err;
+
 	/* reset caller saved regs */
 	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		reg = regs + caller_saved[i];
@@ -994,6 +1092,8 @@ static int check_alu_op(struct reg_state *regs, struct bpf_insn *insn)
 	} else {	/* all other ALU ops: and, sub, xor, add, ... */
 
 		bool stack_relative = false;
+		bool pkt_relative = false;
+		struct reg_state dst_reg;
 
 		if (BPF_SRC(insn->code) == BPF_X) {
 			if (insn->imm != 0 || insn->off != 0) {
@@ -1028,6 +1128,23 @@ static int check_alu_op(struct reg_state *regs, struct bpf_insn *insn)
 		    BPF_SRC(insn->code) == BPF_K)
 			stack_relative = true;
 
+		/* pattern match 'bpf_add Rx, imm' on a packet pointer,
+		 * the pointer keeps its range and moves by 'imm' bytes
+		 */
+		if (opcode == BPF_ADD && BPF_CLASS(insn->code) == BPF_ALU64 &&
+		    regs[insn->dst_reg].type == PTR_TO_PACKET &&
+		    BPF_SRC(insn->code) == BPF_K) {
+			if (insn->imm < 0 ||
+			    regs[insn->dst_reg].off + insn->imm > MAX_PACKET_OFF) {
+				verbose("invalid packet offset %d+%d\n",
+					regs[insn->dst_reg].off, insn->imm);
+				return -EACCES;
+			}
+			dst_reg = regs[insn->dst_reg];
+			dst_reg.off += insn->imm;
+			pkt_relative = true;
+		}
+
 		/* check dest operand */
 		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
 		if (err)
@@ -1036,12 +1153,60 @@ static int check_alu_op(struct reg_state *regs, struct bpf_insn *insn)
 		if (stack_relative) {
 			regs[insn->dst_reg].type = PTR_TO_STACK;
 			regs[insn->dst_reg].imm = insn->imm;
+		} else if (pkt_relative) {
+			regs[insn->dst_reg] = dst_reg;
 		}
 	}
 
 	return 0;
 }
 
+/* all packet pointers of the current state (in registers and spilled to
+ * the stack) learn that [start, start + range) is within packet bounds
+ */
+static void mark_pkt_range(struct verifier_state *state, u16 range)
+{
+	struct reg_state *reg;
+	int i;
+
+	for (i = 0; i < MAX_BPF_REG; i++) {
+		reg = &state->regs[i];
+		if (reg->type == PTR_TO_PACKET && reg->range < range)
+			reg->range = range;
+	}
+
+	for (i = 0; i < MAX_BPF_STACK; i++) {
+		if (state->stack[i].stype != STACK_SPILL)
+			continue;
+		reg = &state->stack[i].reg_st;
+		if (reg->type == PTR_TO_PACKET && reg->range < range)
+			reg->range = range;
+	}
+}
+
+/* detect 'if (pkt + off > pkt_end) goto' and its mirrored forms and mark
+ * the branch that proved [start, start + off) to be in bounds
+ */
+static void check_pkt_end_cmp(struct verifier_env *env, struct bpf_insn *insn,
+			      struct verifier_state *other_branch)
+{
+	struct reg_state *regs = env->cur_state.regs;
+	struct reg_state *dst = &regs[insn->dst_reg];
+	struct reg_state *src = &regs[insn->src_reg];
+	u8 opcode = BPF_OP(insn->code);
+
+	if (BPF_SRC(insn->code) != BPF_X ||
+	    (opcode != BPF_JGT && opcode != BPF_JGE))
+		return;
+
+	if (dst->type == PTR_TO_PACKET && src->type == PTR_TO_PACKET_END)
+		/* pkt + off > pkt_end: fall-through is safe */
+		mark_pkt_range(&env->cur_state, dst->off);
+	else if (dst->type == PTR_TO_PACKET_END && src->type == PTR_TO_PACKET)
+		/* pkt_end > pkt + off: branch target is safe */
+		mark_pkt_range(other_branch, src->off);
+}
+
 static int check_cond_jmp_op(struct verifier_env *env,
 			     struct bpf_insn *insn, int *insn_idx)
 {
@@ -1135,6 +1300,8 @@ static int check_cond_jmp_op(struct verifier_env *env,
 			regs[insn->dst_reg].type = CONST_IMM;
 			regs[insn->dst_reg].imm = insn->imm;
 		}
+	} else {
+		check_pkt_end_cmp(env, insn, other_branch);
 	}
 	if (log_level)
 		print_verifier_state(env);
@@ -1465,6 +1632,26 @@ static int is_state_visited(struct verifier_env *env, int insn_idx)
 	return 0;
 }
 
+/* remember the type of the base register a load or store insn was verified
+ * with, so that accesses to bpf_context can be rewritten after verification.
+ * The same insn reached through different paths must not mix ctx with
+ * other pointer types, since only one of them could be rewritten
+ */
+static int record_insn_ptr_type(struct verifier_env *env, int insn_idx,
+				enum bpf_reg_type type)
+{
+	enum bpf_reg_type *prev_type = &env->insn_ptr_type[insn_idx];
+
+	if (*prev_type == NOT_INIT) {
+		*prev_type = type;
+	} else if (*prev_type != type &&
+		   (*prev_type == PTR_TO_CTX || type == PTR_TO_CTX)) {
+		verbose("same insn cannot be used with different pointers\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int do_check(struct verifier_env *env)
 {
 	struct verifier_state *state = &env->cur_state;
@@ -1529,6 +1716,8 @@ static int do_check(struct verifier_env *env)
 				return err;
 
 		} else if (class == BPF_LDX) {
+			enum bpf_reg_type src_reg_type;
+
 			if (BPF_MODE(insn->code) != BPF_MEM ||
 			    insn->imm != 0) {
 				verbose("BPF_LDX uses reserved fields\n");
@@ -1543,6 +1732,8 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
+			src_reg_type = regs[insn->src_reg].type;
+
 			/* check that memory (src_reg + off) is readable,
 			 * the state of dst_reg will be updated by this func
 			 */
@@ -1552,7 +1743,13 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
+			err = record_insn_ptr_type(env, insn_idx, src_reg_type);
+			if (err)
+				return err;
+
 		} else if (class == BPF_STX) {
+			enum bpf_reg_type dst_reg_type;
+
 			if (BPF_MODE(insn->code) == BPF_XADD) {
 				err = check_xadd(env, insn);
 				if (err)
@@ -1575,6 +1772,8 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
+			dst_reg_type = regs[insn->dst_reg].type;
+
 			/* check that memory (dst_reg + off) is writeable */
 			err = check_mem_access(env, insn->dst_reg, insn->off,
 					       BPF_SIZE(insn->code), BPF_WRITE,
@@ -1582,6 +1781,10 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
+			err = record_insn_ptr_type(env, insn_idx, dst_reg_type);
+			if (err)
+				return err;
+
 		} else if (class == BPF_ST) {
 			if (BPF_MODE(insn->code) != BPF_MEM ||
 			    insn->src_reg != BPF_REG_0) {
@@ -1593,6 +1796,12 @@ static int do_check(struct verifier_env *env)
 			if (err)
 				return err;
 
+			if (regs[insn->dst_reg].type == PTR_TO_CTX) {
+				verbose("BPF_ST stores into R%d context is not allowed\n",
+					insn->dst_reg);
+				return -EACCES;
+			}
+
 			/* check that memory (dst_reg + off) is writeable */
 			err = check_mem_access(env, insn->dst_reg, insn->off,
 					       BPF_SIZE(insn->code), BPF_WRITE,
@@ -1788,6 +1997,38 @@ static void convert_pseudo_ld_imm64(struct verifier_env *env)
 			insn->src_reg = 0;
 }
 
+/* convert verified loads and stores of user visible bpf_context into
+ * accesses of the in-kernel structure that the program type really runs on
+ */
+static void convert_ctx_accesses(struct verifier_env *env)
+{
+	struct bpf_verifier_ops *ops = env->prog->aux->ops;
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+	int i;
+
+	if (!ops->convert_ctx_access)
+		return;
+
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		enum bpf_access_type type;
+
+		if (BPF_CLASS(insn->code) == BPF_LDX)
+			type = BPF_READ;
+		else if (BPF_CLASS(insn->code) == BPF_STX &&
+			 BPF_MODE(insn->code) == BPF_MEM)
+			type = BPF_WRITE;
+		else
+			continue;
+
+		if (env->insn_ptr_type[i] != PTR_TO_CTX)
+			continue;
+
+		ops->convert_ctx_access(type, insn->dst_reg, insn->src_reg,
+					insn->off, insn);
+	}
+}
+
 static void free_states(struct verifier_env *env)
 {
 	struct verifier_state_list *sl, *sln;
@@ -1865,15 +2106,24 @@ int bpf_check(struct bpf_prog *prog, union bpf_attr *attr)
 	if (!env->explored_states)
 		goto skip_full_check;
 
+	env->insn_ptr_type = kcalloc(prog->len, sizeof(enum bpf_reg_type),
+				     GFP_USER);
+	ret = -ENOMEM;
+	if (!env->insn_ptr_type)
+		goto skip_full_check;
+
 	ret = check_cfg(env);
 	if (ret < 0)
 		goto skip_full_check;
 
 	ret = do_check(env);
+	if (ret == 0)
+		convert_ctx_accesses(env);
 
 skip_full_check:
 	while (pop_stack(env, NULL) >= 0);
 	free_states(env);
+	kfree(env->insn_ptr_type);
 
 	if (log_level && log_len >= log_size - 1) {
 		BUG_ON(log_len >= log_size);
@@ -57,6 +57,7 @@
 #include <linux/vmalloc.h> /* TODO: replace with more sophisticated array */
 #include <linux/kthread.h>
 #include <linux/delay.h>
+#include <linux/psi.h>
 
 #include <linux/atomic.h>
 
@@ -103,6 +104,16 @@ static DEFINE_SPINLOCK(cgroup_idr_lock);
  */
 static DEFINE_SPINLOCK(release_agent_path_lock);
 
+/*
+ * Serializes cgroup_rstat_flush() and protects ->rstat_css_list.  The
+ * percpu locks protect the per-cpu updated trees.
+ */
+static DEFINE_SPINLOCK(cgroup_rstat_lock);
+static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
+
+/* the default hierarchy's root can't allocate its rstat_cpu this early */
+static DEFINE_PER_CPU(struct cgroup_rstat_cpu, cgrp_dfl_root_rstat_cpu);
+
 #define cgroup_assert_mutex_or_rcu_locked()				\
 	rcu_lockdep_assert(rcu_read_lock_held() ||			\
 			   lockdep_is_held(&cgroup_mutex),		\
@@ -226,15 +237,6 @@ static void cgroup_idr_remove(struct idr *idr, int id)
 	spin_unlock_bh(&cgroup_idr_lock);
 }
 
-static struct cgroup *cgroup_parent(struct cgroup *cgrp)
-{
-	struct cgroup_subsys_state *parent_css = cgrp->self.parent;
-
-	if (parent_css)
-		return container_of(parent_css, struct cgroup, self);
-	return NULL;
-}
-
 /**
  * cgroup_css - obtain a cgroup's css for the specified subsystem
  * @cgrp: the cgroup of interest
@@ -329,6 +331,293 @@ bool cgroup_is_descendant(struct cgroup *cgrp, struct cgroup *ancestor)
 	return false;
 }
 
+/*
+ * Recursive stats.
+ *
+ * Propagating a stat update up the hierarchy on every event makes the
+ * cost of the hot path proportional to the depth of the hierarchy.
+ * Instead, a subsystem implementing ->css_rstat_flush() keeps the
+ * updates in per-cpu counters of the css they happened in and calls
+ * cgroup_rstat_updated().  That links the cgroup, and all of its
+ * ancestors which aren't linked yet, on the cpu's updated tree.  When
+ * the stats are read, cgroup_rstat_flush() walks the updated trees of
+ * the subtree in post order - children before parents - and invokes
+ * ->css_rstat_flush() for each css, which folds the per-cpu deltas of
+ * the css into its own totals and into the pending deltas of its
+ * parent.  Cgroups which haven't seen an update since the last flush
+ * are never visited.
+ */
+static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
+{
+	return per_cpu_ptr(cgrp->rstat_cpu, cpu);
+}
+
+/**
+ * cgroup_rstat_updated - keep track of updated rstat_cpu
+ * @cgrp: target cgroup
+ * @cpu: cpu on which rstat_cpu was updated
+ *
+ * @cgrp's per-cpu stats on @cpu have been updated.  Put it on the
+ * updated tree of @cpu so that the next cgroup_rstat_flush() of @cgrp
+ * or one of its ancestors finds it.  The fast path, where @cgrp is
+ * already on the tree, is a single load.
+ */
+void cgroup_rstat_updated(struct cgroup *cgrp, int cpu)
+{
+	raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu);
+	struct cgroup *parent;
+	unsigned long flags;
+
+	/* nothing to do for root, it is always visited by the flush */
+	if (!cgroup_parent(cgrp))
+		return;
+
+	/*
+	 * Paired with the one in cgroup_rstat_cpu_pop_updated().  Either
+	 * we see NULL ->updated_next or the flusher sees our update.
+	 */
+	smp_mb();
+
+	/*
+	 * Because ->updated_children is terminated with the parent
+	 * instead of NULL, we can tell whether @cgrp is on the list by
+	 * testing the next pointer for NULL.
+	 */
+	if (cgroup_rstat_cpu(cgrp, cpu)->updated_next)
+		return;
+
+	raw_spin_lock_irqsave(cpu_lock, flags);
+
+	/* put @cgrp and all ancestors on the corresponding updated lists */
+	for (parent = cgroup_parent(cgrp); parent;
+	     cgrp = parent, parent = cgroup_parent(cgrp)) {
+		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
+		struct cgroup_rstat_cpu *prstatc = cgroup_rstat_cpu(parent, cpu);
+
+		/*
+		 * Both additions and removals are bottom-up.  If a cgroup
+		 * is already in the tree, all ancestors are.
+		 */
+		if (rstatc->updated_next)
+			break;
+
+		rstatc->updated_next = prstatc->updated_children;
+		prstatc->updated_children = cgrp;
+	}
+
+	raw_spin_unlock_irqrestore(cpu_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cgroup_rstat_updated);
+
+/**
+ * cgroup_rstat_cpu_pop_updated - iterate and dismantle rstat_cpu updated tree
+ * @pos: current position
+ * @root: root of the tree to traversal
+ * @cpu: target cpu
+ *
+ * Walks the updated rstat_cpu tree on @cpu from @root.  %NULL @pos
+ * starts the traversal and %NULL return indicates the end.  During
+ * traversal, each returned cgroup is unlinked from the tree.  Must be
+ * called with the matching cgroup_rstat_cpu_lock held.
+ *
+ * The only ordering guarantee is that, for a parent and a child pair
+ * covered by a given traversal, if a child is visited, its parent is
+ * guaranteed to be visited afterwards.  A hierarchy root is never on
+ * the tree; it is returned last so that its own stats get flushed too.
+ */
+static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
+						   struct cgroup *root, int cpu)
+{
+	struct cgroup_rstat_cpu *rstatc;
+
+	if (pos == root)
+		return NULL;
+
+	/*
+	 * We're gonna walk down to the first leaf and visit/remove it.
+	 * We can pick whatever unvisited node as the starting point.
+	 */
+	if (!pos)
+		pos = root;
+	else
+		pos = cgroup_parent(pos);
+
+	/* walk down to the first leaf */
+	while (true) {
+		rstatc = cgroup_rstat_cpu(pos, cpu);
+		if (rstatc->updated_children == pos)
+			break;
+		pos = rstatc->updated_children;
+	}
+
+	/*
+	 * Unlink @pos from the tree.  As the updated_children list is
+	 * singly linked, we have to walk it to find the removal point.
+	 * However, due to the way we traverse, @pos will be the first
+	 * child in most cases.  The only exception is @root.
+	 */
+	if (rstatc->updated_next) {
+		struct cgroup *parent = cgroup_parent(pos);
+		struct cgroup_rstat_cpu *prstatc = cgroup_rstat_cpu(parent, cpu);
+		struct cgroup_rstat_cpu *nrstatc;
+		struct cgroup **nextp;
+
+		nextp = &prstatc->updated_children;
+		while (true) {
+			nrstatc = cgroup_rstat_cpu(*nextp, cpu);
+			if (*nextp == pos)
+				break;
+
+			WARN_ON_ONCE(*nextp == parent);
+			nextp = &nrstatc->updated_next;
+		}
+
+		*nextp = rstatc->updated_next;
+		rstatc->updated_next = NULL;
+
+		/* paired with the one in cgroup_rstat_updated() */
+		smp_mb();
+		return pos;
+	}
+
+	/* @pos is @root and isn't on any list */
+	return cgroup_parent(pos) ? NULL : pos;
+}
+
+/* see cgroup_rstat_flush() */
+static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
+	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+{
+	int cpu;
+
+	lockdep_assert_held(&cgroup_rstat_lock);
+
+	for_each_possible_cpu(cpu) {
+		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
+						       cpu);
+		struct cgroup *pos = NULL;
+
+		raw_spin_lock(cpu_lock);
+		while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
+			struct cgroup_subsys_state *css;
+
+			list_for_each_entry(css, &pos->rstat_css_list,
+					    rstat_css_node)
+				css->ss->css_rstat_flush(css, cpu);
+		}
+		raw_spin_unlock(cpu_lock);
+
+		/* if @may_sleep, play nice and yield if necessary */
+		if (may_sleep && (need_resched() ||
+				  spin_needbreak(&cgroup_rstat_lock))) {
+			spin_unlock_irq(&cgroup_rstat_lock);
+			if (!cond_resched())
+				cpu_relax();
+			spin_lock_irq(&cgroup_rstat_lock);
+		}
+	}
+}
+
+/**
+ * cgroup_rstat_flush - flush stats in @cgrp's subtree
+ * @cgrp: target cgroup
+ *
+ * Collect all per-cpu stats in @cgrp's subtree into the global counters
+ * and propagate them upwards.  After this function returns, all cgroups
+ * in the subtree have up-to-date stats.
+ *
+ * This also gets all cgroups in the subtree including @cgrp off the
+ * updated lists.
+ *
+ * This function may block.
+ */
+void cgroup_rstat_flush(struct cgroup *cgrp)
+{
+	might_sleep();
+
+	spin_lock_irq(&cgroup_rstat_lock);
+	cgroup_rstat_flush_locked(cgrp, true);
+	spin_unlock_irq(&cgroup_rstat_lock);
+}
+EXPORT_SYMBOL_GPL(cgroup_rstat_flush);
+
+/**
+ * cgroup_rstat_flush_hold - flush stats in @cgrp's subtree and hold
+ * @cgrp: target cgroup
+ *
+ * Flush stats in @cgrp's subtree and prevent further flushes.  Must be
+ * paired with cgroup_rstat_flush_release().  The totals the subsystems
+ * maintain in ->css_rstat_flush() can be read in between.
+ *
+ * This function may block.
+ */
+void cgroup_rstat_flush_hold(struct cgroup *cgrp)
+	__acquires(&cgroup_rstat_lock)
+{
+	might_sleep();
+	spin_lock_irq(&cgroup_rstat_lock);
+	cgroup_rstat_flush_locked(cgrp, true);
+}
+EXPORT_SYMBOL_GPL(cgroup_rstat_flush_hold);
+
+/**
+ * cgroup_rstat_flush_release - release cgroup_rstat_flush_hold()
+ */
+void cgroup_rstat_flush_release(void)
+	__releases(&cgroup_rstat_lock)
+{
+	spin_unlock_irq(&cgroup_rstat_lock);
+}
+EXPORT_SYMBOL_GPL(cgroup_rstat_flush_release);
+
+static int cgroup_rstat_init(struct cgroup *cgrp)
+{
+	int cpu;
+
+	/* the root cgrp on the default hierarchy has its rstat_cpu preset */
+	if (!cgrp->rstat_cpu) {
+		cgrp->rstat_cpu = alloc_percpu(struct cgroup_rstat_cpu);
+		if (!cgrp->rstat_cpu)
+			return -ENOMEM;
+	}
+
+	/* ->updated_children list is self terminated */
+	for_each_possible_cpu(cpu)
+		cgroup_rstat_cpu(cgrp, cpu)->updated_children = cgrp;
+
+	return 0;
+}
+
+static void cgroup_rstat_exit(struct cgroup *cgrp)
+{
+	int cpu;
+
+	if (!cgrp->rstat_cpu)
+		return;
+
+	cgroup_rstat_flush(cgrp);
+
+	/* sanity check */
+	for_each_possible_cpu(cpu) {
+		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
+
+		if (WARN_ON_ONCE(rstatc->updated_children != cgrp) ||
+		    WARN_ON_ONCE(rstatc->updated_next))
+			return;
+	}
+
+	free_percpu(cgrp->rstat_cpu);
+	cgrp->rstat_cpu = NULL;
+}
+
+static void __init cgroup_rstat_boot(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		raw_spin_lock_init(per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu));
+}
+
 static int notify_on_release(const struct cgroup *cgrp)
 {
 	return test_bit(CGRP_NOTIFY_ON_RELEASE, &cgrp->flags);
@@ -889,6 +1178,7 @@ static void cgroup_destroy_root(struct cgroup_root *root)
 	mutex_unlock(&cgroup_mutex);
 
 	kernfs_destroy_root(root->kf_root);
+	cgroup_rstat_exit(cgrp);
 	cgroup_free_root(root);
 }
 
@@ -1236,6 +1526,13 @@ static int rebind_subsystems(struct cgroup_root *dst_root, unsigned int ss_mask)
 		ss->root = dst_root;
 		css->cgroup = &dst_root->cgrp;
 
+		if (ss->css_rstat_flush) {
+			spin_lock_irq(&cgroup_rstat_lock);
+			list_move(&css->rstat_css_node,
+				  &dst_root->cgrp.rstat_css_list);
+			spin_unlock_irq(&cgroup_rstat_lock);
+		}
+
 		down_write(&css_set_rwsem);
 		hash_for_each(css_set_table, i, cset, hlist)
 			list_move_tail(&cset->e_cset_node[ss->id],
@@ -1561,6 +1858,7 @@ static void init_cgroup_housekeeping(struct cgroup *cgrp)
 	INIT_LIST_HEAD(&cgrp->self.children);
 	INIT_LIST_HEAD(&cgrp->cset_links);
 	INIT_LIST_HEAD(&cgrp->pidlists);
+	INIT_LIST_HEAD(&cgrp->rstat_css_list);
 	mutex_init(&cgrp->pidlist_mutex);
 	cgrp->self.cgroup = cgrp;
 	cgrp->self.flags |= CSS_ONLINE;
@@ -1612,6 +1910,10 @@ static int cgroup_setup_root(struct cgroup_root *root, unsigned int ss_mask)
 	if (ret)
 		goto out;
 
+	ret = cgroup_rstat_init(root_cgrp);
+	if (ret)
+		goto cancel_ref;
+
 	/*
 	 * We're accessing css_set_count without locking css_set_rwsem here,
 	 * but that's OK - it can only be increased by someone holding
@@ -1620,11 +1922,11 @@ static int cgroup_setup_root(struct cgroup_root *root, unsigned int ss_mask)
 	 */
 	ret = allocate_cgrp_cset_links(css_set_count, &tmp_links);
 	if (ret)
-		goto cancel_ref;
+		goto exit_rstat;
 
 	ret = cgroup_init_root_id(root);
 	if (ret)
-		goto cancel_ref;
+		goto exit_rstat;
 
 	root->kf_root = kernfs_create_root(&cgroup_kf_syscall_ops,
 					   KERNFS_ROOT_CREATE_DEACTIVATED,
@@ -1677,6 +1979,8 @@ destroy_root:
 	root->kf_root = NULL;
 exit_root_id:
 	cgroup_exit_root_id(root);
+exit_rstat:
+	cgroup_rstat_exit(root_cgrp);
 cancel_ref:
 	percpu_ref_exit(&root_cgrp->self.refcnt);
 out:
@@ -2011,7 +2315,7 @@ static void cgroup_task_migrate(struct cgroup *old_cgrp,
 	old_cset = task_css_set(tsk);
 
 	get_css_set(new_cset);
-	rcu_assign_pointer(tsk->cgroups, new_cset);
+	cgroup_move_task(tsk, new_cset);
 
 	/*
 	 * Use move_tail so that cgroup_taskset_first() still returns the
@@ -2861,6 +3165,23 @@ static int cgroup_populated_show(struct seq_file *seq, void *v)
 	return 0;
 }
 
+#ifdef CONFIG_PSI
+static int cgroup_io_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, &seq_css(seq)->cgroup->psi, PSI_IO);
+}
+
+static int cgroup_memory_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, &seq_css(seq)->cgroup->psi, PSI_MEM);
+}
+
+static int cgroup_cpu_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, &seq_css(seq)->cgroup->psi, PSI_CPU);
+}
+#endif
+
 static ssize_t cgroup_file_write(struct kernfs_open_file *of, char *buf,
 				 size_t nbytes, loff_t off)
 {
@@ -4201,6 +4522,23 @@ static struct cftype cgroup_dfl_base_files[] = {
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = cgroup_populated_show,
 	},
+#ifdef CONFIG_PSI
+	{
+		.name = "io.pressure",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = cgroup_io_pressure_show,
+	},
+	{
+		.name = "memory.pressure",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = cgroup_memory_pressure_show,
+	},
+	{
+		.name = "cpu.pressure",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = cgroup_cpu_pressure_show,
+	},
+#endif
 	{ }	/* terminate */
 };
 
@@ -4334,6 +4672,8 @@ static void css_free_work_fn(struct work_struct *work)
 			 */
 			cgroup_put(cgroup_parent(cgrp));
 			kernfs_put(cgrp->kn);
+			psi_cgroup_free(cgrp);
+			cgroup_rstat_exit(cgrp);
 			kfree(cgrp);
 		} else {
 			/*
@@ -4369,6 +4709,14 @@ static void css_release_work_fn(struct work_struct *work)
 
 	if (ss) {
 		/* css release path */
+		if (ss->css_rstat_flush) {
+			/* hand the remaining deltas over to the parent */
+			spin_lock_irq(&cgroup_rstat_lock);
+			cgroup_rstat_flush_locked(cgrp, true);
+			list_del_init(&css->rstat_css_node);
+			spin_unlock_irq(&cgroup_rstat_lock);
+		}
+
 		cgroup_idr_remove(&ss->css_idr, css->id);
 	} else {
 		/* cgroup release path */
@@ -4411,6 +4759,7 @@ static void init_and_link_css(struct cgroup_subsys_state *css,
 	css->ss = ss;
 	INIT_LIST_HEAD(&css->sibling);
 	INIT_LIST_HEAD(&css->children);
+	INIT_LIST_HEAD(&css->rstat_css_node);
 	css->serial_nr = css_serial_nr_next++;
 
 	if (cgroup_parent(cgrp)) {
@@ -4434,6 +4783,16 @@ static int online_css(struct cgroup_subsys_state *css)
 	if (!ret) {
 		css->flags |= CSS_ONLINE;
 		rcu_assign_pointer(css->cgroup->subsys[ss->id], css);
+
+		/* irqsave, root csses of early subsystems get here early */
+		if (ss->css_rstat_flush) {
+			unsigned long flags;
+
+			spin_lock_irqsave(&cgroup_rstat_lock, flags);
+			list_add(&css->rstat_css_node,
+				 &css->cgroup->rstat_css_list);
+			spin_unlock_irqrestore(&cgroup_rstat_lock, flags);
+		}
 	}
 	return ret;
 }
@@ -4575,6 +4934,16 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	cgrp->self.parent = &parent->self;
 	cgrp->root = root;
 
+	ret = cgroup_rstat_init(cgrp);
+	if (ret)
+		goto out_free_id;
+
+	if (cgroup_on_dfl(cgrp)) {
+		ret = psi_cgroup_alloc(cgrp);
+		if (ret)
+			goto out_free_rstat;
+	}
+
 	if (notify_on_release(parent))
 		set_bit(CGRP_NOTIFY_ON_RELEASE, &cgrp->flags);
 
@@ -4585,7 +4954,7 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	kn = kernfs_create_dir(parent->kn, name, mode, cgrp);
 	if (IS_ERR(kn)) {
 		ret = PTR_ERR(kn);
-		goto out_free_id;
+		goto out_free_psi;
 	}
 	cgrp->kn = kn;
 
@@ -4645,6 +5014,10 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	ret = 0;
 	goto out_unlock;
 
+out_free_psi:
+	psi_cgroup_free(cgrp);
+out_free_rstat:
+	cgroup_rstat_exit(cgrp);
 out_free_id:
 	cgroup_idr_remove(&root->cgroup_idr, cgrp->id);
 out_cancel_ref:
@@ -4887,6 +5260,7 @@ int __init cgroup_init_early(void)
 
 	init_cgroup_root(&cgrp_dfl_root, &opts);
 	cgrp_dfl_root.cgrp.self.flags |= CSS_NO_REF;
+	cgrp_dfl_root.cgrp.rstat_cpu = &cgrp_dfl_root_rstat_cpu;
 
 	RCU_INIT_POINTER(init_task.cgroups, &init_css_set);
 
@@ -4922,6 +5296,8 @@ int __init cgroup_init(void)
 	BUG_ON(cgroup_init_cftypes(NULL, cgroup_dfl_base_files));
 	BUG_ON(cgroup_init_cftypes(NULL, cgroup_legacy_base_files));
 
+	cgroup_rstat_boot();
+
 	mutex_lock(&cgroup_mutex);
 
 	/* Add init_css_set to the hash table */
@@ -5214,7 +5590,7 @@ void cgroup_exit(struct task_struct *tsk)
 
 	/* Reassign the task to the init_css_set. */
 	cset = task_css_set(tsk);
-	RCU_INIT_POINTER(tsk->cgroups, &init_css_set);
+	cgroup_move_task(tsk, &init_css_set);
 
 	if (need_forkexit_callback) {
 		/* see cgroup_post_fork() for details */
@@ -42,6 +42,7 @@
 #include <linux/module.h>
 #include <linux/mman.h>
 #include <linux/compat.h>
+#include <linux/bpf.h>
 
 #include "internal.h"
 
@@ -314,6 +315,17 @@ static void cpu_ctx_sched_in(struct perf_cpu_context *cpuctx,
 
 static void update_context_time(struct perf_event_context *ctx);
 static u64 perf_event_time(struct perf_event *event);
+static void update_group_times(struct perf_event *leader);
+
+static void group_sched_out(struct perf_event *group_event,
+			    struct perf_cpu_context *cpuctx,
+			    struct perf_event_context *ctx);
+static int group_sched_in(struct perf_event *group_event,
+			  struct perf_cpu_context *cpuctx,
+			  struct perf_event_context *ctx);
+static int group_can_go_on(struct perf_event *event,
+			   struct perf_cpu_context *cpuctx,
+			   int can_add_hw);
 
 void __weak perf_event_print_debug(void)	{ }
 
@@ -358,6 +370,7 @@ static void perf_ctx_unlock(struct perf_cpu_context *cpuctx,
 struct perf_cgroup_info {
 	u64				time;
 	u64				timestamp;
+	struct list_head		groups;	/* group leaders on this cpu */
 };
 
 struct perf_cgroup {
@@ -407,6 +420,31 @@ static inline void perf_detach_cgroup(struct perf_event *event)
 	event->cgrp = NULL;
 }
 
+static inline struct perf_cgroup *
+perf_cgroup_parent(struct perf_cgroup *cgrp)
+{
+	struct cgroup_subsys_state *css = cgrp->css.parent;
+
+	return css ? container_of(css, struct perf_cgroup, css) : NULL;
+}
+
+/*
+ * Index the cgroup group leaders per cpu and cgroup, so that a cgroup
+ * switch only needs to look at the groups of the cgroups involved.
+ */
+static inline void perf_cgroup_add_group(struct perf_event *event)
+{
+	struct perf_cgroup_info *info;
+
+	info = per_cpu_ptr(event->cgrp->info, event->cpu);
+	list_add_tail(&event->cgrp_entry, &info->groups);
+}
+
+static inline void perf_cgroup_del_group(struct perf_event *event)
+{
+	list_del_init(&event->cgrp_entry);
+}
+
 static inline int is_cgroup_event(struct perf_event *event)
 {
 	return event->cgrp != NULL;
@@ -552,30 +590,147 @@ void perf_cgroup_switch(struct task_struct *task, int mode)
 	local_irq_restore(flags);
 }
 
-static inline void perf_cgroup_sched_out(struct task_struct *task,
-					 struct task_struct *next)
+static inline void
+perf_cgroup_mark_enabled(struct perf_event *event,
+			 struct perf_event_context *ctx);
+
+static void perf_cgroup_sched_out_groups(struct perf_cgroup *from,
+					 struct perf_cgroup *to)
 {
-	struct perf_cgroup *cgrp1;
-	struct perf_cgroup *cgrp2 = NULL;
+	struct perf_event_context *ctx;
+	struct perf_cgroup_info *info;
+	struct perf_event *event;
 
 	/*
-	 * we come here when we know perf_cgroup_events > 0
+	 * Stop at the first common ancestor, it and everything above
+	 * it stays in.
 	 */
-	cgrp1 = perf_cgroup_from_task(task);
+	for (; from; from = perf_cgroup_parent(from)) {
+		if (cgroup_is_descendant(to->css.cgroup, from->css.cgroup))
+			break;
+
+		info = this_cpu_ptr(from->info);
+		if (list_empty(&info->groups))
+			continue;
+
+		__update_cgrp_time(from);
+
+		list_for_each_entry(event, &info->groups, cgrp_entry) {
+			if (event->state != PERF_EVENT_STATE_ACTIVE)
+				continue;
+
+			ctx = event->ctx;
+			raw_spin_lock(&ctx->lock);
+			perf_pmu_disable(ctx->pmu);
+			update_context_time(ctx);
+			group_sched_out(event, __get_cpu_context(ctx), ctx);
+			perf_pmu_enable(ctx->pmu);
+			raw_spin_unlock(&ctx->lock);
+		}
+	}
+}
+
+static void perf_cgroup_sched_in_groups(struct perf_cgroup *from,
+					struct perf_cgroup *to, bool pinned)
+{
+	enum event_type_t type = pinned ? EVENT_PINNED : EVENT_FLEXIBLE;
+	struct perf_cpu_context *cpuctx;
+	struct perf_event_context *ctx;
+	struct perf_cgroup_info *info;
+	struct perf_event *event;
 
 	/*
-	 * next is NULL when called from perf_event_enable_on_exec()
-	 * that will systematically cause a cgroup_switch()
+	 * Common ancestors are walked as well, their groups may have been
+	 * left out by a full switch out or for lack of counters.
 	 */
-	if (next)
-		cgrp2 = perf_cgroup_from_task(next);
+	for (; to; to = perf_cgroup_parent(to)) {
+		info = this_cpu_ptr(to->info);
+		if (list_empty(&info->groups))
+			continue;
+
+		if (pinned &&
+		    !cgroup_is_descendant(from->css.cgroup, to->css.cgroup))
+			info->timestamp = perf_clock();
+
+		list_for_each_entry(event, &info->groups, cgrp_entry) {
+			if (event->state != PERF_EVENT_STATE_INACTIVE ||
+			    !!event->attr.pinned != pinned)
+				continue;
+
+			ctx = event->ctx;
+			cpuctx = __get_cpu_context(ctx);
+			raw_spin_lock(&ctx->lock);
+			if (!(ctx->is_active & type))
+				goto unlock;
+
+			perf_pmu_disable(ctx->pmu);
+			perf_cgroup_mark_enabled(event, ctx);
+			if (group_can_go_on(event, cpuctx, 1))
+				group_sched_in(event, cpuctx, ctx);
+
+			/* see ctx_pinned_sched_in() */
+			if (pinned &&
+			    event->state == PERF_EVENT_STATE_INACTIVE) {
+				update_group_times(event);
+				event->state = PERF_EVENT_STATE_ERROR;
+			}
+			perf_pmu_enable(ctx->pmu);
+unlock:
+			raw_spin_unlock(&ctx->lock);
+		}
+	}
+}
+
+/*
+ * Cgroup events count in their cgroup and all its descendants, so moving
+ * from cgroup @from to @to only concerns the groups of the cgroups that
+ * are an ancestor (or self) of just one of the two.  Take those out, point
+ * the cpu contexts at @to and bring in the others, rather than cycling
+ * every cpu context event through perf_cgroup_switch().
+ */
+static void perf_cgroup_move(struct perf_cgroup *from, struct perf_cgroup *to)
+{
+	struct perf_cpu_context *cpuctx;
+	struct pmu *pmu;
+	unsigned long flags;
+
+	local_irq_save(flags);
+
+	perf_cgroup_sched_out_groups(from, to);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(pmu, &pmus, entry) {
+		cpuctx = this_cpu_ptr(pmu->pmu_cpu_context);
+		if (cpuctx->unique_pmu != pmu)
+			continue; /* ensure we process each cpuctx once */
+
+		if (cpuctx->ctx.nr_cgroups > 0) {
+			perf_ctx_lock(cpuctx, NULL);
+			update_cgrp_time_from_cpuctx(cpuctx);
+			cpuctx->cgrp = to;
+			perf_ctx_unlock(cpuctx, NULL);
+		}
+	}
+	rcu_read_unlock();
 
+	perf_cgroup_sched_in_groups(from, to, true);
+	perf_cgroup_sched_in_groups(from, to, false);
+
+	local_irq_restore(flags);
+}
+
+static inline void perf_cgroup_sched_out(struct task_struct *task,
+					 struct task_struct *next)
+{
 	/*
-	 * only schedule out current cgroup events if we know
-	 * that we are switching to a different cgroup. Otherwise,
-	 * do no touch the cgroup events.
+	 * we come here when we know perf_cgroup_events > 0
+	 *
+	 * On a context switch only the events that differ between the two
+	 * cgroups are moved, all in perf_cgroup_sched_in().  next is NULL
+	 * when called from perf_event_enable_on_exec() that will
+	 * systematically cause a cgroup_switch()
 	 */
-	if (cgrp1 != cgrp2)
+	if (!next)
 		perf_cgroup_switch(task, PERF_CGROUP_SWOUT);
 }
 
@@ -594,12 +749,11 @@ static inline void perf_cgroup_sched_in(struct task_struct *prev,
 	cgrp2 = perf_cgroup_from_task(prev);
 
 	/*
-	 * only need to schedule in cgroup events if we are changing
-	 * cgroup during ctxsw. Cgroup events were not scheduled
-	 * out of ctxsw out if that was not the case.
+	 * only need to move cgroup events if we are changing
+	 * cgroup during ctxsw.
 	 */
 	if (cgrp1 != cgrp2)
-		perf_cgroup_switch(task, PERF_CGROUP_SWIN);
+		perf_cgroup_move(cgrp2, cgrp1);
 }
 
 static inline int perf_cgroup_connect(int fd, struct perf_event *event,
@@ -713,6 +867,14 @@ static inline void perf_cgroup_sched_out(struct task_struct *task,
 {
 }
 
+static inline void perf_cgroup_add_group(struct perf_event *event)
+{
+}
+
+static inline void perf_cgroup_del_group(struct perf_event *event)
+{
+}
+
 static inline void perf_cgroup_sched_in(struct task_struct *prev,
 					struct task_struct *task)
 {
@@ -1148,8 +1310,11 @@ list_add_event(struct perf_event *event, struct perf_event_context *ctx)
 		list_add_tail(&event->group_entry, list);
 	}
 
-	if (is_cgroup_event(event))
+	if (is_cgroup_event(event)) {
 		ctx->nr_cgroups++;
+		if (event->group_leader == event)
+			perf_cgroup_add_group(event);
+	}
 
 	if (has_branch_stack(event))
 		ctx->nr_branch_stack++;
@@ -1306,6 +1471,7 @@ list_del_event(struct perf_event *event, struct perf_event_context *ctx)
 
 	if (is_cgroup_event(event)) {
 		ctx->nr_cgroups--;
+		perf_cgroup_del_group(event);
 		cpuctx = __get_cpu_context(ctx);
 		/*
 		 * if there are no more cgroup events
@@ -1374,8 +1540,11 @@ static void perf_group_detach(struct perf_event *event)
 	 * to whatever list we are on.
 	 */
 	list_for_each_entry_safe(sibling, tmp, &event->sibling_list, group_entry) {
-		if (list)
+		if (list) {
 			list_move_tail(&sibling->group_entry, list);
+			if (is_cgroup_event(sibling))
+				perf_cgroup_add_group(sibling);
+		}
 		sibling->group_leader = sibling;
 
 		/* Inherit group flags from the previous leader */
@@ -3283,6 +3452,8 @@ errout:
 }
 
 static void perf_event_free_filter(struct perf_event *event);
+static void perf_event_detach_bpf_prog(struct perf_event *event);
+static void perf_event_free_bpf_prog(struct perf_event *event);
 
 static void free_event_rcu(struct rcu_head *head)
 {
@@ -3292,10 +3463,10 @@ static void free_event_rcu(struct rcu_head *head)
 	if (event->ns)
 		put_pid_ns(event->ns);
 	perf_event_free_filter(event);
+	perf_event_free_bpf_prog(event);
 	kfree(event);
 }
 
-static void ring_buffer_put(struct ring_buffer *rb);
 static void ring_buffer_attach(struct perf_event *event,
 			       struct ring_buffer *rb);
 
@@ -3342,6 +3513,8 @@ static void __free_event(struct perf_event *event)
 			put_callchain_buffers();
 	}
 
+	perf_event_detach_bpf_prog(event);
+
 	if (event->destroy)
 		event->destroy(event);
 
@@ -3795,6 +3968,7 @@ static inline int perf_fget_light(int fd, struct fd *p)
 static int perf_event_set_output(struct perf_event *event,
 				 struct perf_event *output_event);
 static int perf_event_set_filter(struct perf_event *event, void __user *arg);
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd);
 
 static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
@@ -3849,6 +4023,9 @@ static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case PERF_EVENT_IOC_SET_FILTER:
 		return perf_event_set_filter(event, (void __user *)arg);
 
+	case PERF_EVENT_IOC_SET_BPF:
+		return perf_event_set_bpf_prog(event, arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -3945,6 +4122,9 @@ static void perf_event_init_userpage(struct perf_event *event)
 	userpg->cap_bit0_is_deprecated = 1;
 	userpg->size = offsetof(struct perf_event_mmap_page, __reserved);
 
+	userpg->data_offset = PAGE_SIZE;
+	userpg->data_size = perf_data_size(rb);
+
 unlock:
 	rcu_read_unlock();
 }
@@ -4110,7 +4290,7 @@ static void rb_free_rcu(struct rcu_head *rcu_head)
 	rb_free(rb);
 }
 
-static struct ring_buffer *ring_buffer_get(struct perf_event *event)
+struct ring_buffer *ring_buffer_get(struct perf_event *event)
 {
 	struct ring_buffer *rb;
 
@@ -4125,7 +4305,7 @@ static struct ring_buffer *ring_buffer_get(struct perf_event *event)
 	return rb;
 }
 
-static void ring_buffer_put(struct ring_buffer *rb)
+void ring_buffer_put(struct ring_buffer *rb)
 {
 	if (!atomic_dec_and_test(&rb->refcount))
 		return;
@@ -4141,6 +4321,9 @@ static void perf_mmap_open(struct vm_area_struct *vma)
 
 	atomic_inc(&event->mmap_count);
 	atomic_inc(&event->rb->mmap_count);
+
+	if (vma->vm_pgoff)
+		atomic_inc(&event->rb->aux_mmap_count);
 }
 
 /*
@@ -4160,6 +4343,20 @@ static void perf_mmap_close(struct vm_area_struct *vma)
 	int mmap_locked = rb->mmap_locked;
 	unsigned long size = perf_data_size(rb);
 
+	/*
+	 * rb->aux_mmap_count will always drop before rb->mmap_count and
+	 * event->mmap_count, so it is ok to use event->mmap_mutex to
+	 * serialize with perf_mmap here.
+	 */
+	if (rb_has_aux(rb) && vma->vm_pgoff == rb->aux_pgoff &&
+	    atomic_dec_and_mutex_lock(&rb->aux_mmap_count, &event->mmap_mutex)) {
+		atomic_long_sub(rb->aux_nr_pages, &mmap_user->locked_vm);
+		vma->vm_mm->pinned_vm -= rb->aux_mmap_locked;
+
+		rb_free_aux(rb);
+		mutex_unlock(&event->mmap_mutex);
+	}
+
 	atomic_dec(&rb->mmap_count);
 
 	if (!atomic_dec_and_mutex_lock(&event->mmap_count, &event->mmap_mutex))
@@ -4244,10 +4441,10 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 	unsigned long user_locked, user_lock_limit;
 	struct user_struct *user = current_user();
 	unsigned long locked, lock_limit;
-	struct ring_buffer *rb;
+	struct ring_buffer *rb = NULL;
 	unsigned long vma_size;
 	unsigned long nr_pages;
-	long user_extra, extra;
+	long user_extra = 0, extra = 0;
 	int ret = 0, flags = 0;
 
 	/*
@@ -4262,7 +4459,66 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 		return -EINVAL;
 
 	vma_size = vma->vm_end - vma->vm_start;
-	nr_pages = (vma_size / PAGE_SIZE) - 1;
+
+	if (vma->vm_pgoff == 0) {
+		nr_pages = (vma_size / PAGE_SIZE) - 1;
+	} else {
+		/*
+		 * AUX area mapping: if rb->aux_nr_pages != 0, it's already
+		 * mapped, all subsequent mappings should have the same size
+		 * and offset. Must be above the normal perf buffer.
+		 */
+		u64 aux_offset, aux_size;
+
+		if (!event->rb)
+			return -EINVAL;
+
+		nr_pages = vma_size / PAGE_SIZE;
+
+		mutex_lock(&event->mmap_mutex);
+		ret = -EINVAL;
+
+		rb = event->rb;
+		if (!rb)
+			goto aux_unlock;
+
+		aux_offset = ACCESS_ONCE(rb->user_page->aux_offset);
+		aux_size = ACCESS_ONCE(rb->user_page->aux_size);
+
+		if (aux_offset < perf_data_size(rb) + PAGE_SIZE)
+			goto aux_unlock;
+
+		if (aux_offset != vma->vm_pgoff << PAGE_SHIFT)
+			goto aux_unlock;
+
+		/* already mapped with a different offset */
+		if (rb_has_aux(rb) && rb->aux_pgoff != vma->vm_pgoff)
+			goto aux_unlock;
+
+		if (aux_size != vma_size || aux_size != nr_pages * PAGE_SIZE)
+			goto aux_unlock;
+
+		/* already mapped with a different size */
+		if (rb_has_aux(rb) && rb->aux_nr_pages != nr_pages)
+			goto aux_unlock;
+
+		if (!is_power_of_2(nr_pages))
+			goto aux_unlock;
+
+		if (!atomic_inc_not_zero(&rb->mmap_count))
+			goto aux_unlock;
+
+		if (rb_has_aux(rb)) {
+			atomic_inc(&rb->aux_mmap_count);
+			ret = 0;
+			goto unlock;
+		}
+
+		atomic_set(&rb->aux_mmap_count, 1);
+		user_extra = nr_pages;
+
+		goto accounting;
+	}
 
 	/*
 	 * If we have rb pages ensure they're a power-of-two number, so we
@@ -4274,9 +4530,6 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 	if (vma_size != PAGE_SIZE * (1 + nr_pages))
 		return -EINVAL;
 
-	if (vma->vm_pgoff != 0)
-		return -EINVAL;
-
 	WARN_ON_ONCE(event->ctx->parent_ctx);
 again:
 	mutex_lock(&event->mmap_mutex);
@@ -4300,6 +4553,8 @@ again:
 	}
 
 	user_extra = nr_pages + 1;
+
+accounting:
 	user_lock_limit = sysctl_perf_event_mlock >> (PAGE_SHIFT - 10);
 
 	/*
@@ -4323,35 +4578,46 @@ again:
 		goto unlock;
 	}
 
-	WARN_ON(event->rb);
+	WARN_ON(!rb && event->rb);
 
 	if (vma->vm_flags & VM_WRITE)
 		flags |= RING_BUFFER_WRITABLE;
 
-	rb = rb_alloc(nr_pages, 
-		event->attr.watermark ? event->attr.wakeup_watermark : 0,
-		event->cpu, flags);
-
 	if (!rb) {
-		ret = -ENOMEM;
-		goto unlock;
-	}
+		rb = rb_alloc(nr_pages,
+			event->attr.watermark ? event->attr.wakeup_watermark : 0,
+			event->cpu, flags);
 
-	atomic_set(&rb->mmap_count, 1);
-	rb->mmap_locked = extra;
-	rb->mmap_user = get_current_user();
+		if (!rb) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
 
-	atomic_long_add(user_extra, &user->locked_vm);
-	vma->vm_mm->pinned_vm += extra;
+		atomic_set(&rb->mmap_count, 1);
+		rb->mmap_user = get_current_user();
+		rb->mmap_locked = extra;
 
-	ring_buffer_attach(event, rb);
+		ring_buffer_attach(event, rb);
 
-	perf_event_init_userpage(event);
-	perf_event_update_userpage(event);
+		perf_event_init_userpage(event);
+		perf_event_update_userpage(event);
+	} else {
+		ret = rb_alloc_aux(rb, event, vma->vm_pgoff, nr_pages,
+				   event->attr.aux_watermark, flags);
+		if (!ret)
+			rb->aux_mmap_locked = extra;
+	}
 
 unlock:
-	if (!ret)
+	if (!ret) {
+		atomic_long_add(user_extra, &user->locked_vm);
+		vma->vm_mm->pinned_vm += extra;
+
 		atomic_inc(&event->mmap_count);
+	} else if (rb) {
+		atomic_dec(&rb->mmap_count);
+	}
+aux_unlock:
 	mutex_unlock(&event->mmap_mutex);
 
 	/*
@@ -5523,6 +5789,40 @@ void perf_event_mmap(struct vm_area_struct *vma)
 	perf_event_mmap_event(&mmap_event);
 }
 
+void perf_event_aux_event(struct perf_event *event, unsigned long head,
+			  unsigned long size, u64 flags)
+{
+	struct perf_output_handle handle;
+	struct perf_sample_data sample;
+	struct perf_aux_event {
+		struct perf_event_header	header;
+		u64				offset;
+		u64				size;
+		u64				flags;
+	} rec = {
+		.header = {
+			.type = PERF_RECORD_AUX,
+			.misc = 0,
+			.size = sizeof(rec),
+		},
+		.offset		= head,
+		.size		= size,
+		.flags		= flags,
+	};
+	int ret;
+
+	perf_event_header__init_id(&rec.header, &sample, event);
+	ret = perf_output_begin(&handle, event, rec.header.size);
+
+	if (ret)
+		return;
+
+	perf_output_put(&handle, rec);
+	perf_event__output_id_sample(event, &handle, &sample);
+
+	perf_output_end(&handle);
+}
+
 /*
  * IRQ throttle logging
  */
@@ -6229,6 +6529,56 @@ static void perf_event_free_filter(struct perf_event *event)
 	ftrace_profile_free_filter(event);
 }
 
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
+{
+	enum bpf_prog_type type;
+	struct bpf_prog *prog;
+
+	if (event->attr.type != PERF_TYPE_TRACEPOINT)
+		return -EINVAL;
+
+	if (event->prog)
+		return -EEXIST;
+
+	if (event->tp_event->flags & TRACE_EVENT_FL_KPROBE)
+		type = BPF_PROG_TYPE_KPROBE;
+	else
+		type = BPF_PROG_TYPE_TRACEPOINT;
+
+	prog = bpf_prog_get_type(prog_fd, type);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	/* only one program per event source, it sees every hit of the
+	 * probe regardless of how many perf events are attached to it
+	 */
+	if (cmpxchg(&event->tp_event->prog, NULL, prog)) {
+		bpf_prog_put(prog);
+		return -EEXIST;
+	}
+
+	event->prog = prog;
+	return 0;
+}
+
+/*
+ * Detach the program from the event source; the reference is dropped
+ * in free_event_rcu() once running handlers can no longer see it.
+ */
+static void perf_event_detach_bpf_prog(struct perf_event *event)
+{
+	if (event->prog)
+		event->tp_event->prog = NULL;
+}
+
+static void perf_event_free_bpf_prog(struct perf_event *event)
+{
+	if (event->prog) {
+		bpf_prog_put(event->prog);
+		event->prog = NULL;
+	}
+}
+
 #else
 
 static inline void perf_tp_register(void)
@@ -6244,6 +6594,19 @@ static void perf_event_free_filter(struct perf_event *event)
 {
 }
 
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
+{
+	return -ENOENT;
+}
+
+static void perf_event_detach_bpf_prog(struct perf_event *event)
+{
+}
+
+static void perf_event_free_bpf_prog(struct perf_event *event)
+{
+}
+
 #endif /* CONFIG_EVENT_TRACING */
 
 #ifdef CONFIG_HAVE_HW_BREAKPOINT
@@ -7185,6 +7548,13 @@ perf_event_set_output(struct perf_event *event, struct perf_event *output_event)
 	if (output_event->cpu == -1 && output_event->ctx != event->ctx)
 		goto out;
 
+	/*
+	 * If both events generate aux data, they must be on the same PMU
+	 */
+	if (has_aux(event) && has_aux(output_event) &&
+	    event->pmu != output_event->pmu)
+		goto out;
+
 set:
 	mutex_lock(&event->mmap_mutex);
 	/* Can't redirect output if we've got an active mmap() */
@@ -8267,6 +8637,7 @@ static struct cgroup_subsys_state *
 perf_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 {
 	struct perf_cgroup *jc;
+	int cpu;
 
 	jc = kzalloc(sizeof(*jc), GFP_KERNEL);
 	if (!jc)
@@ -8278,6 +8649,9 @@ perf_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 		return ERR_PTR(-ENOMEM);
 	}
 
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(&per_cpu_ptr(jc->info, cpu)->groups);
+
 	return &jc->css;
 }
 
@@ -147,6 +147,103 @@ void __weak arch_release_thread_info(struct thread_info *ti)
  * kmemcache based allocator.
  */
 # if THREAD_SIZE >= PAGE_SIZE
+#  ifdef CONFIG_VMAP_STACK
+/*
+ * vmalloc() leaves an unmapped guard page after every area, so a stack
+ * that overflows runs into the guard page of the area below it instead
+ * of silently corrupting memory.  Setting up and tearing down the kernel
+ * mappings is much more expensive than grabbing a few pages though, so
+ * keep a couple of freed stacks per cpu and hand them out again on the
+ * next fork.
+ */
+#define NR_CACHED_STACKS 2
+static DEFINE_PER_CPU(struct vm_struct *, cached_stacks[NR_CACHED_STACKS]);
+
+static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
+						  int node)
+{
+	void *stack;
+	int i;
+
+	local_irq_disable();
+	for (i = 0; i < NR_CACHED_STACKS; i++) {
+		struct vm_struct *s = this_cpu_read(cached_stacks[i]);
+
+		if (!s)
+			continue;
+		this_cpu_write(cached_stacks[i], NULL);
+		local_irq_enable();
+
+		/* Fresh stacks are zeroed, recycled ones need it too */
+		if (THREADINFO_GFP & __GFP_ZERO)
+			memset(s->addr, 0, THREAD_SIZE);
+
+		tsk->stack_vm_area = s;
+		return s->addr;
+	}
+	local_irq_enable();
+
+	stack = __vmalloc_node_range(THREAD_SIZE, THREAD_SIZE,
+				     VMALLOC_START, VMALLOC_END,
+				     THREADINFO_GFP | __GFP_HIGHMEM,
+				     PAGE_KERNEL, node,
+				     __builtin_return_address(0));
+
+	/*
+	 * We can't call find_vm_area() in interrupt context, and
+	 * free_thread_info() can be called in interrupt context,
+	 * so cache the vm_struct.
+	 */
+	if (stack)
+		tsk->stack_vm_area = find_vm_area(stack);
+	return stack;
+}
+
+static void free_thread_info_vm(struct task_struct *tsk)
+{
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	for (i = 0; i < NR_CACHED_STACKS; i++) {
+		if (this_cpu_read(cached_stacks[i]))
+			continue;
+
+		this_cpu_write(cached_stacks[i], tsk->stack_vm_area);
+		local_irq_restore(flags);
+		return;
+	}
+	local_irq_restore(flags);
+
+	/* vfree() defers the unmap itself when called from interrupts */
+	vfree(tsk->stack);
+}
+
+static int free_cached_stacks_cpu_notify(struct notifier_block *nfb,
+					 unsigned long action, void *hcpu)
+{
+	int cpu = (long)hcpu;
+	int i;
+
+	if ((action & ~CPU_TASKS_FROZEN) != CPU_DEAD)
+		return NOTIFY_DONE;
+
+	for (i = 0; i < NR_CACHED_STACKS; i++) {
+		struct vm_struct *vm_stack = per_cpu(cached_stacks[i], cpu);
+
+		if (!vm_stack)
+			continue;
+		vfree(vm_stack->addr);
+		per_cpu(cached_stacks[i], cpu) = NULL;
+	}
+	return NOTIFY_OK;
+}
+
+static void __init vmap_stack_cache_init(void)
+{
+	hotcpu_notifier(free_cached_stacks_cpu_notify, 0);
+}
+#  else
 static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
 						  int node)
 {
@@ -155,12 +252,20 @@ static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
 
 	return page ? page_address(page) : NULL;
 }
+#  endif
 
-static inline void free_thread_info(struct thread_info *ti)
+static inline void free_thread_info(struct task_struct *tsk)
 {
-	free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
+#  ifdef CONFIG_VMAP_STACK
+	free_thread_info_vm(tsk);
+#  else
+	free_kmem_pages((unsigned long)tsk->stack, THREAD_SIZE_ORDER);
+#  endif
 }
 # else
+#  ifdef CONFIG_VMAP_STACK
+#   error "CONFIG_VMAP_STACK requires THREAD_SIZE >= PAGE_SIZE"
+#  endif
 static struct kmem_cache *thread_info_cache;
 
 static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
@@ -169,9 +274,9 @@ static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
 	return kmem_cache_alloc_node(thread_info_cache, THREADINFO_GFP, node);
 }
 
-static void free_thread_info(struct thread_info *ti)
+static void free_thread_info(struct task_struct *tsk)
 {
-	kmem_cache_free(thread_info_cache, ti);
+	kmem_cache_free(thread_info_cache, tsk->stack);
 }
 
 void thread_info_cache_init(void)
@@ -206,7 +311,12 @@ static ATOMIC_NOTIFIER_HEAD(task_free_notifier);
 
 static void account_kernel_stack(struct thread_info *ti, int account)
 {
-	struct zone *zone = page_zone(virt_to_page(ti));
+	struct zone *zone;
+
+	if (IS_ENABLED(CONFIG_VMAP_STACK))
+		zone = page_zone(vmalloc_to_page(ti));
+	else
+		zone = page_zone(virt_to_page(ti));
 
 	mod_zone_page_state(zone, NR_KERNEL_STACK, account);
 }
@@ -215,7 +325,7 @@ void free_task(struct task_struct *tsk)
 {
 	account_kernel_stack(tsk->stack, -1);
 	arch_release_thread_info(tsk->stack);
-	free_thread_info(tsk->stack);
+	free_thread_info(tsk);
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
 	put_seccomp_filter(tsk);
@@ -284,6 +394,10 @@ void __init fork_init(unsigned long mempages)
 	/* do the arch specific task caches init */
 	arch_task_cache_init();
 
+#ifdef CONFIG_VMAP_STACK
+	vmap_stack_cache_init();
+#endif
+
 	/*
 	 * The default maximum number of threads is set to a safe
 	 * value: the thread structures can take up at most half
@@ -322,6 +436,7 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 {
 	struct task_struct *tsk;
 	struct thread_info *ti;
+	struct vm_struct *stack_vm_area;
 	int node = tsk_fork_get_node(orig);
 	int err;
 
@@ -333,11 +448,21 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	if (!ti)
 		goto free_tsk;
 
+	stack_vm_area = task_stack_vm_area(tsk);
+
 	err = arch_dup_task_struct(tsk, orig);
+
+	/*
+	 * arch_dup_task_struct() clobbers the stack related fields; restore
+	 * them before anything, including the error path, looks at them.
+	 */
+	tsk->stack = ti;
+#ifdef CONFIG_VMAP_STACK
+	tsk->stack_vm_area = stack_vm_area;
+#endif
 	if (err)
 		goto free_ti;
 
-	tsk->stack = ti;
 #ifdef CONFIG_SECCOMP
 	/*
 	 * We must handle setting up seccomp filters once we're under
@@ -373,7 +498,7 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	return tsk;
 
 free_ti:
-	free_thread_info(ti);
+	free_thread_info(tsk);
 free_tsk:
 	free_task_struct(tsk);
 	return NULL;
@@ -431,7 +556,10 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 		tmp = kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 		if (!tmp)
 			goto fail_nomem;
+		/* copy_page_range() below write-protects the parent's ptes */
+		vma_start_write(mpnt);
 		*tmp = *mpnt;
+		vma_lock_init(tmp);
 		INIT_LIST_HEAD(&tmp->anon_vma_chain);
 		retval = vma_dup_policy(mpnt, tmp);
 		if (retval)
@@ -439,8 +567,10 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 		tmp->vm_mm = mm;
 		if (anon_vma_fork(tmp, mpnt))
 			goto fail_nomem_anon_vma_fork;
-		tmp->vm_flags &= ~VM_LOCKED;
+		tmp->vm_flags &= ~(VM_LOCKED | VM_UFFD_MISSING | VM_UFFD_WP);
 		tmp->vm_next = tmp->vm_prev = NULL;
+		/* the child's faults are not reported to the parent's uffd */
+		tmp->vm_userfaultfd_ctx = NULL_VM_UFFD_CTX;
 		file = tmp->vm_file;
 		if (file) {
 			struct inode *inode = file_inode(file);
@@ -499,6 +629,7 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 out:
 	up_write(&mm->mmap_sem);
 	flush_tlb_mm(oldmm);
+	vma_end_write_all(oldmm);
 	up_write(&oldmm->mmap_sem);
 	uprobe_end_dup_mmap();
 	return retval;
@@ -572,6 +703,10 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 	atomic_set(&mm->mm_users, 1);
 	atomic_set(&mm->mm_count, 1);
 	init_rwsem(&mm->mmap_sem);
+#ifdef CONFIG_PER_VMA_LOCK
+	mm->mm_lock_seq = 0;
+	seqcount_init(&mm->mm_rb_seq);
+#endif
 	INIT_LIST_HEAD(&mm->mmlist);
 	mm->core_state = NULL;
 	atomic_long_set(&mm->nr_ptes, 0);
@@ -588,6 +723,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	mm->futex_phash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -603,6 +741,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 	if (init_new_context(p, mm))
 		goto fail_nocontext;
 
+	lru_gen_add_mm(mm);
 	return mm;
 
 fail_nocontext:
@@ -655,6 +794,7 @@ void __mmdrop(struct mm_struct *mm)
 	destroy_context(mm);
 	mmu_notifier_mm_destroy(mm);
 	check_mm(mm);
+	futex_hash_free(mm);
 	free_mm(mm);
 }
 EXPORT_SYMBOL_GPL(__mmdrop);
@@ -667,6 +807,7 @@ void mmput(struct mm_struct *mm)
 	might_sleep();
 
 	if (atomic_dec_and_test(&mm->mm_users)) {
+		lru_gen_del_mm(mm);
 		uprobe_clear_state(mm);
 		exit_aio(mm);
 		ksm_exit(mm);
@@ -1253,6 +1394,13 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	if (retval)
 		goto fork_out;
 
+	/*
+	 * The first thread of a process: set up the private futex hash
+	 * while we are still the only user of the mm.
+	 */
+	if (clone_flags & CLONE_THREAD)
+		futex_hash_allocate_default();
+
 	retval = -ENOMEM;
 	p = dup_task_struct(current);
 	if (!p)
@@ -1292,7 +1440,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 		goto bad_fork_cleanup_count;
 
 	delayacct_tsk_init(p);	/* Must remain after dup_task_struct() */
-	p->flags &= ~(PF_SUPERPRIV | PF_WQ_WORKER);
+	p->flags &= ~(PF_SUPERPRIV | PF_WQ_WORKER | PF_MEMSTALL);
 	p->flags |= PF_FORKNOEXEC;
 	INIT_LIST_HEAD(&p->children);
 	INIT_LIST_HEAD(&p->sibling);
@@ -1331,6 +1479,9 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	if (clone_flags & CLONE_THREAD)
 		threadgroup_change_begin(current);
 	cgroup_fork(p);
+#ifdef CONFIG_PSI
+	p->psi_flags = 0;
+#endif
 #ifdef CONFIG_NUMA
 	p->mempolicy = mpol_dup(p->mempolicy);
 	if (IS_ERR(p->mempolicy)) {
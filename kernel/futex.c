@@ -64,6 +64,8 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
+#include <linux/vmalloc.h>
+#include <linux/prctl.h>
 
 #include <asm/futex.h>
 
@@ -303,14 +305,62 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * Multi-threaded processes get their own hash table for FUTEX_PRIVATE_FLAG
+ * futexes, so that they neither contend on bucket locks with unrelated
+ * processes nor touch remote memory for every wait and wake on NUMA.
+ *
+ * The table of an mm is only ever installed or replaced while the mm has
+ * a single user, which is the task doing it. Private futex keys can only
+ * be used by tasks sharing the mm, so no waiter can be queued on a table
+ * while it changes, and lookups need no further synchronization.
+ */
+struct futex_private_hash {
+	unsigned long hash_mask;
+	struct futex_hash_bucket queues[0];
+};
+
+/* Hash slots per CPU of a table sized by default */
+#define FUTEX_PHASH_SLOTS_PER_CPU	4
+#define FUTEX_PHASH_MIN_SLOTS		16
+
+static struct futex_hash_bucket *hash_futex_private(union futex_key *key,
+						    u32 hash)
+{
+	struct futex_private_hash *fph;
+
+	if (key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))
+		return NULL;
+
+	fph = ACCESS_ONCE(key->private.mm->futex_phash);
+	if (!fph)
+		return NULL;
+
+	return &fph->queues[hash & fph->hash_mask];
+}
+#else
+static inline struct futex_hash_bucket *
+hash_futex_private(union futex_key *key, u32 hash)
+{
+	return NULL;
+}
+#endif
+
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash_bucket *hb;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	hb = hash_futex_private(key, hash);
+	if (hb)
+		return hb;
+
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
@@ -2252,6 +2302,207 @@ static long futex_wait_restart(struct restart_block *restart)
 }
 
 
+struct futex_vector {
+	struct futex_q q;
+	u32 __user *uaddr;
+	u32 val;
+};
+
+/**
+ * unqueue_multiple() - Remove all the futexes of a multiple wait
+ * @vs:		the futexes to unqueue
+ * @count:	number of entries of @vs that were queued
+ *
+ * Drops the key references of all the entries.
+ *
+ * Return:
+ *  >=0 - index of the first futex that was already removed by a waker;
+ *   -1 - if no futex was woken
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int i, ret = -1;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q) && ret < 0)
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on several futexes
+ * @vs:		the futexes to wait on
+ * @count:	number of entries in @vs
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @woken:	index of the futex that was woken while queueing
+ *
+ * Queue the current task on all the futexes, with the same value check
+ * as futex_wait_setup() for each one: an entry is only queued once its
+ * value is known to match, with its hash bucket locked.
+ *
+ * The task state is set before the first entry is queued, so a wakeup on
+ * any of them after that point is not lost.
+ *
+ * Return:
+ *  0 - all the futexes are queued;
+ *  1 - one of them was woken while queueing the others, see @woken;
+ * <0 - -EFAULT or -EWOULDBLOCK, nothing queued
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     unsigned int flags, int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int i, ret;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(vs[i].uaddr, flags & FLAGS_SHARED,
+				    &vs[i].q.key, VERIFY_READ);
+		if (unlikely(ret)) {
+			while (--i >= 0)
+				put_futex_key(&vs[i].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		struct futex_vector *v = &vs[i];
+
+		hb = queue_lock(&v->q);
+		ret = get_futex_value_locked(&uval, v->uaddr);
+		if (!ret && uval == v->val) {
+			/* queue_me() releases the hb lock */
+			queue_me(&v->q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/* unqueue what we have and drop the refs of the rest */
+		*woken = unqueue_multiple(vs, i);
+		for (; i < count; i++)
+			put_futex_key(&vs[i].q.key);
+		if (*woken >= 0)
+			return 1;
+
+		if (!ret)
+			return -EWOULDBLOCK;
+
+		if (get_user(uval, v->uaddr))
+			return -EFAULT;
+		goto retry;
+	}
+
+	return 0;
+}
+
+/*
+ * Wait on up to FUTEX_WAIT_MULTIPLE_MAX futexes at once, and return the
+ * index of the one that woke us. The keys are all of the same kind (shared
+ * or private) and the timeout is relative, like FUTEX_WAIT.
+ */
+static int futex_wait_multiple(u32 __user *uaddr, unsigned int flags,
+			       u32 count, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_wait_block __user *uwb = (void __user *)uaddr;
+	struct futex_wait_block wb;
+	struct futex_vector *vs;
+	int i, ret, woken = -1;
+
+	if (!count || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	vs = kcalloc(count, sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&wb, &uwb[i], sizeof(wb)))
+			goto out_free;
+
+		ret = -EINVAL;
+		if (!wb.bitset || wb.uaddr != (unsigned long)wb.uaddr)
+			goto out_free;
+
+		vs[i].q = futex_q_init;
+		vs[i].q.bitset = wb.bitset;
+		vs[i].uaddr = (u32 __user *)(unsigned long)wb.uaddr;
+		vs[i].val = wb.val;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+	while (true) {
+		ret = futex_wait_multiple_setup(vs, count, flags, &woken);
+		if (ret) {
+			if (ret > 0)
+				ret = woken;
+			break;
+		}
+
+		if (to) {
+			hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+			if (!hrtimer_active(&to->timer))
+				to->task = NULL;
+		}
+
+		/*
+		 * Skip the schedule() if any of the futexes was already
+		 * woken or the timer has expired.
+		 */
+		for (i = 0; i < count; i++) {
+			if (plist_node_empty(&vs[i].q.list))
+				break;
+		}
+		if (i == count && (!to || to->task))
+			freezable_schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* unqueue_multiple() drops all the key refs */
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			break;
+
+		ret = -ETIMEDOUT;
+		if (to && !to->task)
+			break;
+
+		/*
+		 * A relative timeout was turned into an absolute one, so do
+		 * not restart transparently when there is one.
+		 */
+		if (signal_pending(current)) {
+			ret = abs_time ? -EINTR : -ERESTARTSYS;
+			break;
+		}
+
+		/* spurious wakeup, queue up again */
+	}
+
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(vs);
+	return ret;
+}
+
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
  * and failed. The kernel side here does the whole locking operation:
@@ -2964,6 +3215,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple(uaddr, flags, val, timeout);
 	}
 	return -ENOSYS;
 }
@@ -2980,14 +3233,15 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -3022,6 +3276,130 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+static void futex_private_hash_free(struct futex_private_hash *fph)
+{
+	if (is_vmalloc_addr(fph))
+		vfree(fph);
+	else
+		kfree(fph);
+}
+
+/*
+ * Allocate a table of @slots buckets, rounded up to a power of two and
+ * capped at the size of the global table, on the node of the caller.
+ */
+static struct futex_private_hash *futex_private_hash_alloc(unsigned long slots)
+{
+	struct futex_private_hash *fph;
+	int node = numa_node_id();
+	unsigned long i;
+	size_t size;
+
+	slots = roundup_pow_of_two(clamp_t(unsigned long, slots,
+					   FUTEX_PHASH_MIN_SLOTS,
+					   futex_hashsize));
+	size = sizeof(*fph) + slots * sizeof(struct futex_hash_bucket);
+
+	fph = kmalloc_node(size, GFP_KERNEL | __GFP_NOWARN, node);
+	if (!fph)
+		fph = vmalloc_node(size, node);
+	if (!fph)
+		return NULL;
+
+	fph->hash_mask = slots - 1;
+	for (i = 0; i < slots; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	return fph;
+}
+
+static void futex_private_hash_install(struct mm_struct *mm,
+				       struct futex_private_hash *fph)
+{
+	struct futex_private_hash *old = mm->futex_phash;
+
+	/* publish the initialized buckets */
+	smp_store_release(&mm->futex_phash, fph);
+	if (old)
+		futex_private_hash_free(old);
+}
+
+/*
+ * Called from copy_process() when the current task is about to create
+ * a thread. Give the process a private table the first time, while the
+ * caller is still its only user, unless it asked for the global one.
+ * Failing to allocate is not fatal: the global table keeps working.
+ */
+void futex_hash_allocate_default(void)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph;
+
+	if (!mm || mm->futex_phash || atomic_read(&mm->mm_users) != 1 ||
+	    test_bit(MMF_FUTEX_GLOBAL_HASH, &mm->flags))
+		return;
+
+	fph = futex_private_hash_alloc(FUTEX_PHASH_SLOTS_PER_CPU *
+				       num_online_cpus());
+	if (fph)
+		futex_private_hash_install(mm, fph);
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	if (mm->futex_phash)
+		futex_private_hash_free(mm->futex_phash);
+	mm->futex_phash = NULL;
+}
+
+/*
+ * prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots): size the private
+ * table of the current process, or with 0 slots keep it on the global
+ * table. Only possible while the process is single threaded.
+ *
+ * prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS): number of private hash
+ * slots, 0 when the global table is in use.
+ */
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph = NULL;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg3 > futex_hashsize)
+			return -EINVAL;
+		if (atomic_read(&mm->mm_users) != 1)
+			return -EBUSY;
+
+		if (arg3) {
+			fph = futex_private_hash_alloc(arg3);
+			if (!fph)
+				return -ENOMEM;
+			clear_bit(MMF_FUTEX_GLOBAL_HASH, &mm->flags);
+		} else {
+			set_bit(MMF_FUTEX_GLOBAL_HASH, &mm->flags);
+		}
+		futex_private_hash_install(mm, fph);
+		return 0;
+
+	case PR_FUTEX_HASH_GET_SLOTS:
+		fph = mm->futex_phash;
+		return fph ? fph->hash_mask + 1 : 0;
+	}
+
+	return -EINVAL;
+}
+#endif
+
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
@@ -3042,11 +3420,8 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
 
 	return 0;
 }
@@ -0,0 +1,217 @@
+/*
+ * Kernel managed interrupt affinity
+ *
+ * Spread the vectors of multiqueue devices over the NUMA nodes and cores
+ * of the system, and keep managed interrupts on their target CPUs across
+ * CPU hotplug.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/irq.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+
+#include "internals.h"
+
+/*
+ * Move @cpus_per_vec CPUs from @nmsk to @irqmsk, taking the hyperthread
+ * siblings of a core together so a vector never splits a core.
+ */
+static void irq_spread_init_one(struct cpumask *irqmsk, struct cpumask *nmsk,
+				int cpus_per_vec)
+{
+	const struct cpumask *siblmsk;
+	int cpu, sibl;
+
+	while (cpus_per_vec > 0) {
+		cpu = cpumask_first(nmsk);
+
+		/* Can only happen if the caller asked for too many CPUs */
+		if (cpu >= nr_cpu_ids)
+			return;
+
+		cpumask_clear_cpu(cpu, nmsk);
+		cpumask_set_cpu(cpu, irqmsk);
+		cpus_per_vec--;
+
+		/* If the cpu has siblings, use them first */
+		siblmsk = topology_thread_cpumask(cpu);
+		for (sibl = -1; cpus_per_vec > 0; ) {
+			sibl = cpumask_next(sibl, siblmsk);
+			if (sibl >= nr_cpu_ids)
+				break;
+			if (!cpumask_test_and_clear_cpu(sibl, nmsk))
+				continue;
+			cpumask_set_cpu(sibl, irqmsk);
+			cpus_per_vec--;
+		}
+	}
+}
+
+static int get_nodes_in_cpumask(const struct cpumask *mask,
+				nodemask_t *nodemsk)
+{
+	int n, nodes = 0;
+
+	for_each_node(n) {
+		if (cpumask_intersects(mask, cpumask_of_node(n))) {
+			node_set(n, *nodemsk);
+			nodes++;
+		}
+	}
+	return nodes;
+}
+
+/**
+ * irq_create_affinity_masks - Create affinity masks for multiqueue spreading
+ * @nvecs:	The total number of vectors
+ * @affd:	Description of the affinity requirements
+ *
+ * The vectors between @affd->pre_vectors and @affd->post_vectors are
+ * spread evenly over the nodes first, and over the cores of each node
+ * next. All possible CPUs are covered, so that a CPU brought online later
+ * already has a vector to go to. The reserved vectors at both ends get
+ * the default affinity.
+ *
+ * Returns the masks array, to be freed by the caller with kfree(), or
+ * %NULL on allocation failure.
+ */
+struct cpumask *
+irq_create_affinity_masks(int nvecs, const struct irq_affinity *affd)
+{
+	int affv = nvecs - affd->pre_vectors - affd->post_vectors;
+	int last_affv = affv + affd->pre_vectors;
+	int n, nodes, vecs_per_node, extra_vecs, curvec;
+	nodemask_t nodemsk = NODE_MASK_NONE;
+	struct cpumask *masks;
+	cpumask_var_t nmsk;
+
+	if (affv <= 0)
+		return NULL;
+
+	if (!zalloc_cpumask_var(&nmsk, GFP_KERNEL))
+		return NULL;
+
+	masks = kcalloc(nvecs, sizeof(*masks), GFP_KERNEL);
+	if (!masks)
+		goto out;
+
+	/* Fill out vectors at the beginning that don't need affinity */
+	for (curvec = 0; curvec < affd->pre_vectors; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+
+	nodes = get_nodes_in_cpumask(cpu_possible_mask, &nodemsk);
+
+	/*
+	 * If there are no more vectors than nodes, just hand out one
+	 * node per vector.
+	 */
+	if (affv <= nodes) {
+		for_each_node_mask(n, nodemsk) {
+			cpumask_and(masks + curvec, cpu_possible_mask,
+				    cpumask_of_node(n));
+			if (++curvec == last_affv)
+				break;
+		}
+		goto done;
+	}
+
+	/* Spread the vectors per node, the first nodes take the remainder */
+	vecs_per_node = affv / nodes;
+	extra_vecs = affv - nodes * vecs_per_node;
+
+	for_each_node_mask(n, nodemsk) {
+		int ncpus, v, vecs_to_assign = vecs_per_node;
+
+		if (extra_vecs) {
+			vecs_to_assign++;
+			extra_vecs--;
+		}
+
+		/* Get the cpus on this node */
+		cpumask_and(nmsk, cpu_possible_mask, cpumask_of_node(n));
+		ncpus = cpumask_weight(nmsk);
+
+		for (v = 0; curvec < last_affv && v < vecs_to_assign;
+		     curvec++, v++) {
+			int cpus_per_vec = ncpus / vecs_to_assign;
+
+			/* The first vectors take the CPUs left over */
+			if (v < ncpus % vecs_to_assign)
+				cpus_per_vec++;
+
+			/* More vectors than CPUs: share the whole node */
+			if (!cpus_per_vec) {
+				cpumask_and(masks + curvec, cpu_possible_mask,
+					    cpumask_of_node(n));
+				continue;
+			}
+			irq_spread_init_one(masks + curvec, nmsk, cpus_per_vec);
+		}
+
+		if (curvec >= last_affv)
+			break;
+	}
+
+done:
+	/* Fill out vectors at the end that don't need affinity */
+	for (; curvec < nvecs; curvec++)
+		cpumask_copy(masks + curvec, irq_default_affinity);
+out:
+	free_cpumask_var(nmsk);
+	return masks;
+}
+
+/*
+ * Retarget every managed interrupt to the online part of its managed
+ * mask. The arch code breaks the affinity of interrupts whose CPUs all
+ * went away, and a CPU coming back, or a queue map rebuilt by its owner,
+ * needs the interrupt to follow.
+ */
+static void irq_affinity_retarget(void)
+{
+	unsigned int irq;
+
+	for_each_active_irq(irq) {
+		struct irq_desc *desc = irq_to_desc(irq);
+		const struct cpumask *m;
+		unsigned long flags;
+
+		if (!desc)
+			continue;
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		m = desc->managed_affinity;
+		if (irqd_affinity_is_managed(&desc->irq_data) && desc->action &&
+		    cpumask_intersects(m, cpu_online_mask))
+			irq_set_affinity_locked(&desc->irq_data, m, false);
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+}
+
+static int irq_affinity_cpu_notify(struct notifier_block *nfb,
+				   unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+	case CPU_DEAD:
+		irq_affinity_retarget();
+		break;
+	default:
+		return NOTIFY_DONE;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init irq_affinity_init(void)
+{
+	hotcpu_notifier(irq_affinity_cpu_notify, CPU_PRI_IRQ_AFFINITY);
+	return 0;
+}
+core_initcall(irq_affinity_init);
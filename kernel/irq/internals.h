@@ -189,12 +189,23 @@ static inline bool irqd_has_set(struct irq_data *d, unsigned int mask)
 	return d->state_use_accessors & mask;
 }
 
-static inline void kstat_incr_irqs_this_cpu(unsigned int irq, struct irq_desc *desc)
+static inline void __kstat_incr_irqs_this_cpu(struct irq_desc *desc)
 {
 	__this_cpu_inc(*desc->kstat_irqs);
 	__this_cpu_inc(kstat.irqs_sum);
 }
 
+/*
+ * Also keeps the running total which saves kstat_irqs() the summation
+ * over all possible cpus. Per cpu interrupts run the flow handler on
+ * several cpus at once and must use __kstat_incr_irqs_this_cpu().
+ */
+static inline void kstat_incr_irqs_this_cpu(unsigned int irq, struct irq_desc *desc)
+{
+	__kstat_incr_irqs_this_cpu(desc);
+	desc->tot_count++;
+}
+
 #ifdef CONFIG_PM_SLEEP
 bool irq_pm_check_wakeup(struct irq_desc *desc);
 void irq_pm_install_action(struct irq_desc *desc, struct irqaction *action);
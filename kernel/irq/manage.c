@@ -125,6 +125,21 @@ int irq_can_set_affinity(unsigned int irq)
 	return 1;
 }
 
+/**
+ *	irq_can_set_affinity_usr - Check if user space may set the affinity
+ *	@irq:		Interrupt to check
+ *
+ *	Like irq_can_set_affinity(), but also refuses interrupts whose
+ *	affinity is managed by the kernel.
+ */
+int irq_can_set_affinity_usr(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return irq_can_set_affinity(irq) &&
+		!irqd_affinity_is_managed(&desc->irq_data);
+}
+
 /**
  *	irq_set_thread_affinity - Notify irq threads to adjust affinity
  *	@desc:		irq descriptor which has affitnity changed
@@ -246,6 +261,39 @@ int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 }
 EXPORT_SYMBOL_GPL(irq_set_affinity_hint);
 
+/**
+ *	irq_set_managed_affinity - hand the affinity of an irq to the kernel
+ *	@irq:		Interrupt to manage
+ *	@m:		cpumask the interrupt should be delivered to, or %NULL
+ *			to give the affinity back to user space
+ *
+ *	Marks @irq as kernel managed: user space can no longer change its
+ *	affinity, and it is retargeted to the online part of @m whenever the
+ *	irq is set up or a CPU comes or goes. @m is referenced, not copied,
+ *	so its owner may update it (e.g. a queue map rebuilt on hotplug)
+ *	and must keep it alive until the irq is unmanaged again.
+ */
+int irq_set_managed_affinity(unsigned int irq, const struct cpumask *m)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags, IRQ_GET_DESC_CHECK_GLOBAL);
+
+	if (!desc)
+		return -EINVAL;
+
+	desc->managed_affinity = m;
+	if (m) {
+		irqd_set(&desc->irq_data, IRQD_AFFINITY_MANAGED);
+		if (desc->action && cpumask_intersects(m, cpu_online_mask))
+			irq_set_affinity_locked(&desc->irq_data, m, false);
+	} else {
+		irqd_clear(&desc->irq_data, IRQD_AFFINITY_MANAGED);
+	}
+	irq_put_desc_unlock(desc, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_managed_affinity);
+
 static void irq_affinity_notify(struct work_struct *work)
 {
 	struct irq_affinity_notify *notify =
@@ -328,6 +376,17 @@ setup_affinity(unsigned int irq, struct irq_desc *desc, struct cpumask *mask)
 	if (!irq_can_set_affinity(irq))
 		return 0;
 
+	/*
+	 * A kernel managed affinity goes first, and is not narrowed down
+	 * to the irq's node: it was laid out on purpose.
+	 */
+	if (irqd_affinity_is_managed(&desc->irq_data) &&
+	    cpumask_intersects(desc->managed_affinity, cpu_online_mask)) {
+		cpumask_and(mask, cpu_online_mask, desc->managed_affinity);
+		irq_do_set_affinity(&desc->irq_data, mask, false);
+		return 0;
+	}
+
 	/*
 	 * Preserve an userspace affinity setup, but make sure that
 	 * one of the targets is online.
@@ -51,6 +51,7 @@ extern const u8 kallsyms_token_table[] __weak;
 extern const u16 kallsyms_token_index[] __weak;
 
 extern const unsigned long kallsyms_markers[] __weak;
+extern const u8 kallsyms_seqs_of_names[] __weak;
 
 static inline int is_kernel_inittext(unsigned long addr)
 {
@@ -176,18 +177,51 @@ static unsigned int get_symbol_offset(unsigned long pos)
 	return name - kallsyms_names;
 }
 
+/*
+ * kallsyms_seqs_of_names[] lists the symbol table positions in name
+ * order, 3 bytes each.  Ties are ordered by position.
+ */
+static unsigned int get_symbol_seq(unsigned long index)
+{
+	unsigned int i, seq = 0;
+
+	for (i = 0; i < 3; i++)
+		seq = (seq << 8) | kallsyms_seqs_of_names[3 * index + i];
+
+	return seq;
+}
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
 	char namebuf[KSYM_NAME_LEN];
-	unsigned long i;
-	unsigned int off;
+	unsigned long low, high, mid;
+	unsigned int seq;
 
-	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
-		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+	/*
+	 * Binary search for the first entry not below @name; of several
+	 * symbols of the same name, that is the one a linear walk of the
+	 * table would have found.
+	 */
+	low = 0;
+	high = kallsyms_num_syms;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		seq = get_symbol_seq(mid);
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf,
+				       ARRAY_SIZE(namebuf));
+		if (strcmp(namebuf, name) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
 
+	if (low < kallsyms_num_syms) {
+		seq = get_symbol_seq(low);
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf,
+				       ARRAY_SIZE(namebuf));
 		if (strcmp(namebuf, name) == 0)
-			return kallsyms_addresses[i];
+			return kallsyms_addresses[seq];
 	}
 	return module_kallsyms_lookup_name(name);
 }
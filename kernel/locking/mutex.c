@@ -27,6 +27,12 @@
 #include <linux/debug_locks.h>
 #include "mcs_spinlock.h"
 
+/* lockdep.c instantiates the lock events when it is built */
+#ifndef CONFIG_LOCKDEP
+#define CREATE_TRACE_POINTS
+#endif
+#include <trace/events/lock.h>
+
 /*
  * In the DEBUG case we are using the "NULL fastpath" for mutexes,
  * which forces all calls into the slowpath:
@@ -502,8 +508,10 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	preempt_disable();
 	mutex_acquire_nest(&lock->dep_map, subclass, 0, nest_lock, ip);
 
+	trace_contention_begin(lock, LCB_F_MUTEX | LCB_F_SPIN);
 	if (mutex_optimistic_spin(lock, ww_ctx, use_ww_ctx)) {
 		/* got the lock, yay! */
+		trace_contention_end(lock, 0);
 		preempt_enable();
 		return 0;
 	}
@@ -525,6 +533,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	waiter.task = task;
 
 	lock_contended(&lock->dep_map, ip);
+	trace_contention_begin(lock, LCB_F_MUTEX);
 
 	for (;;) {
 		/*
@@ -572,6 +581,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 skip_wait:
 	/* got the lock - cleanup and rejoice! */
 	lock_acquired(&lock->dep_map, ip);
+	trace_contention_end(lock, 0);
 	mutex_set_owner(lock);
 
 	if (use_ww_ctx) {
@@ -603,6 +613,7 @@ err:
 	mutex_remove_waiter(lock, &waiter, task_thread_info(task));
 	spin_unlock_mutex(&lock->wait_lock, flags);
 	debug_mutex_free_waiter(&waiter);
+	trace_contention_end(lock, ret);
 	mutex_release(&lock->dep_map, 1, ip);
 	preempt_enable();
 	return ret;
@@ -15,7 +15,10 @@
 #include <linux/export.h>
 #include <linux/sched/rt.h>
 
+#include <trace/events/lock.h>
+
 #include "mcs_spinlock.h"
+#include "rwsem.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -84,6 +87,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = 0;
 	osq_lock_init(&sem->osq);
 #endif
 }
@@ -99,8 +103,36 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;
 };
 
+/*
+ * A waiter at the head of the queue that keeps losing the lock to
+ * optimistic spinners for longer than this asks them to back off.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+	ACCESS_ONCE(sem->handoff) = 1;
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	if (sem->handoff)
+		ACCESS_ONCE(sem->handoff) = 0;
+}
+#else
+static inline void rwsem_set_handoff(struct rw_semaphore *sem)
+{
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
+#endif
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -149,8 +181,11 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
 			/* A writer stole the lock. Undo our reader grant. */
 			if (rwsem_atomic_update(-adjustment, sem) &
-						RWSEM_ACTIVE_MASK)
+						RWSEM_ACTIVE_MASK) {
+				if (time_after(jiffies, waiter->timeout))
+					rwsem_set_handoff(sem);
 				goto out;
+			}
 			/* Last active locker left. Retry waking readers. */
 			goto try_reader_grant;
 		}
@@ -179,6 +214,7 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 
 	if (adjustment)
 		rwsem_atomic_add(adjustment, sem);
+	rwsem_clear_handoff(sem);
 
 	next = sem->wait_list.next;
 	loop = woken;
@@ -199,112 +235,73 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 /*
- * Wait for the read lock to be granted
+ * Try to acquire write lock before the writer has been put on wait queue.
  */
-__visible
-struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 {
-	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
-	struct rwsem_waiter waiter;
-	struct task_struct *tsk = current;
-
-	/* set up my own style of waitqueue */
-	waiter.task = tsk;
-	waiter.type = RWSEM_WAITING_FOR_READ;
-	get_task_struct(tsk);
-
-	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
-		adjustment += RWSEM_WAITING_BIAS;
-	list_add_tail(&waiter.list, &sem->wait_list);
-
-	/* we're now waiting on the lock, but no longer actively locking */
-	count = rwsem_atomic_update(adjustment, sem);
-
-	/* If there are no active locks, wake the front queued process(es).
-	 *
-	 * If there are no writers and we are first in the queue,
-	 * wake our own waiter to join the existing active readers !
-	 */
-	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
-
-	raw_spin_unlock_irq(&sem->wait_lock);
+	long old, count = ACCESS_ONCE(sem->count);
 
-	/* wait to be given the lock */
 	while (true) {
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
-		if (!waiter.task)
-			break;
-		schedule();
-	}
-
-	tsk->state = TASK_RUNNING;
+		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
+			return false;
 
-	return sem;
-}
-EXPORT_SYMBOL(rwsem_down_read_failed);
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return true;
 
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
-{
-	/*
-	 * Try acquiring the write lock. Check count first in order
-	 * to reduce unnecessary expensive cmpxchg() operations.
-	 */
-	if (count == RWSEM_WAITING_BIAS &&
-	    cmpxchg(&sem->count, RWSEM_WAITING_BIAS,
-		    RWSEM_ACTIVE_WRITE_BIAS) == RWSEM_WAITING_BIAS) {
-		if (!list_is_singular(&sem->wait_list))
-			rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
-		return true;
+		count = old;
 	}
-
-	return false;
 }
 
-#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 /*
- * Try to acquire write lock before the writer has been put on wait queue.
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * Only succeeds while there are neither writers nor queued waiters, so a
+ * spinning reader never jumps ahead of anyone sleeping on the lock.
  */
-static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
 {
 	long old, count = ACCESS_ONCE(sem->count);
 
-	while (true) {
-		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
-			return false;
-
-		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_WRITE_BIAS);
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_READ_BIAS);
 		if (old == count)
 			return true;
 
 		count = old;
 	}
+	return false;
 }
 
-static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
-	bool on_cpu = false;
+	bool ret = true;
 
 	if (need_resched())
 		return false;
 
+	if (ACCESS_ONCE(sem->handoff))
+		return false;
+
 	rcu_read_lock();
 	owner = ACCESS_ONCE(sem->owner);
-	if (owner)
-		on_cpu = owner->on_cpu;
+	if (rwsem_owner_is_writer(owner))
+		ret = owner->on_cpu;
+	else if (!wlock)
+		/* readers only spin on a running writer */
+		ret = false;
+	else if (rwsem_owner_is_reader(owner))
+		/*
+		 * Readers leave no trace of whether they are running, so
+		 * only writers spin on them, and only until one of them has
+		 * given up on this batch of readers.
+		 */
+		ret = rwsem_owner_is_spinnable(owner);
 	rcu_read_unlock();
 
-	/*
-	 * If sem->owner is not set, yet we have just recently entered the
-	 * slowpath, then there is a possibility reader(s) may have the lock.
-	 * To be safe, avoid spinning in these situations.
-	 */
-	return on_cpu;
+	return ret;
 }
 
 static inline bool owner_running(struct rw_semaphore *sem,
@@ -338,37 +335,94 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 
 	/*
 	 * We break out the loop above on need_resched() or when the
-	 * owner changed, which is a sign for heavy contention. Return
-	 * success only when sem->owner is NULL.
+	 * owner changed. A new writer owner is a sign for heavy contention;
+	 * keep spinning only when the lock was released or handed to
+	 * readers.
 	 */
-	return sem->owner == NULL;
+	return !rwsem_owner_is_writer(ACCESS_ONCE(sem->owner));
+}
+
+/*
+ * How long a writer may spin on a reader owned lock: 10us plus 0.5us
+ * per active reader, capped at 25us.
+ */
+static inline u64 rwsem_rspin_threshold(struct rw_semaphore *sem)
+{
+	long readers = ACCESS_ONCE(sem->count) & RWSEM_ACTIVE_MASK;
+
+	if (readers > 30)
+		readers = 30;
+
+	return sched_clock() + (20 + readers) * NSEC_PER_USEC / 2;
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline void rwsem_set_nonspinnable(struct rw_semaphore *sem)
+{
+	struct task_struct *owner = ACCESS_ONCE(sem->owner);
+
+	if (rwsem_owner_is_reader(owner) && rwsem_owner_is_spinnable(owner))
+		cmpxchg(&sem->owner, owner, (struct task_struct *)
+			((unsigned long)owner | RWSEM_NONSPINNABLE));
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
 	bool taken = false;
+	u64 rspin_threshold = 0;
 
 	preempt_disable();
 
 	/* sem->wait_lock should not be held when doing optimistic spinning */
-	if (!rwsem_can_spin_on_owner(sem))
+	if (!rwsem_can_spin_on_owner(sem, wlock))
 		goto done;
 
 	if (!osq_lock(&sem->osq))
 		goto done;
 
 	while (true) {
-		owner = ACCESS_ONCE(sem->owner);
-		if (owner && !rwsem_spin_on_owner(sem, owner))
+		/* A waiter has been starved for too long, let it in. */
+		if (ACCESS_ONCE(sem->handoff))
 			break;
 
+		owner = ACCESS_ONCE(sem->owner);
+		if (rwsem_owner_is_writer(owner)) {
+			if (!rwsem_spin_on_owner(sem, owner))
+				break;
+			rspin_threshold = 0;
+		} else if (wlock && rwsem_owner_is_reader(owner)) {
+			/*
+			 * We cannot tell whether the readers are running, so
+			 * bound the time spent waiting for them. On timeout,
+			 * stop other writers from trying the same until the
+			 * next writer takes the lock.
+			 */
+			if (!rwsem_owner_is_spinnable(owner))
+				break;
+			if (!rspin_threshold) {
+				rspin_threshold = rwsem_rspin_threshold(sem);
+			} else if (sched_clock() > rspin_threshold) {
+				rwsem_set_nonspinnable(sem);
+				break;
+			}
+			if (need_resched())
+				break;
+		}
+
 		/* wait_lock will be acquired if write_lock is obtained */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		/*
+		 * Once the writer is gone, a reader that still cannot get in
+		 * has waiters queued ahead of it and must queue as well.
+		 */
+		if (!wlock && !rwsem_owner_is_writer(owner))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -393,12 +447,103 @@ done:
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool wlock)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	return false;
 }
 #endif
 
+/*
+ * Wait for the read lock to be granted
+ */
+__visible
+struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+{
+	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	bool waiting = true; /* any queued threads before us */
+	struct rwsem_waiter waiter;
+	struct task_struct *tsk = current;
+
+	trace_contention_begin(sem, LCB_F_READ);
+
+	/*
+	 * A running writer is likely to release the lock soon: undo the
+	 * read bias from down_read and spin for it instead of sleeping.
+	 */
+	if (rwsem_can_spin_on_owner(sem, false)) {
+		rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		if (rwsem_optimistic_spin(sem, false)) {
+			trace_contention_end(sem, 0);
+			return sem;
+		}
+		adjustment = 0;
+	}
+
+	/* set up my own style of waitqueue */
+	waiter.task = tsk;
+	waiter.type = RWSEM_WAITING_FOR_READ;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	get_task_struct(tsk);
+
+	raw_spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list)) {
+		waiting = false;
+		adjustment += RWSEM_WAITING_BIAS;
+	}
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	/* we're now waiting on the lock, but no longer actively locking */
+	count = rwsem_atomic_update(adjustment, sem);
+
+	/* If there are no active locks, wake the front queued process(es).
+	 *
+	 * If there are no writers and we are first in the queue,
+	 * wake our own waiter to join the existing active readers !
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS && !waiting))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+
+	raw_spin_unlock_irq(&sem->wait_lock);
+
+	/* wait to be given the lock */
+	while (true) {
+		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
+			break;
+		schedule();
+	}
+
+	tsk->state = TASK_RUNNING;
+	trace_contention_end(sem, 0);
+
+	return sem;
+}
+EXPORT_SYMBOL(rwsem_down_read_failed);
+
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+{
+	/*
+	 * Try acquiring the write lock. Check count first in order
+	 * to reduce unnecessary expensive cmpxchg() operations.
+	 */
+	if (count == RWSEM_WAITING_BIAS &&
+	    cmpxchg(&sem->count, RWSEM_WAITING_BIAS,
+		    RWSEM_ACTIVE_WRITE_BIAS) == RWSEM_WAITING_BIAS) {
+		if (!list_is_singular(&sem->wait_list))
+			rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
+		rwsem_clear_handoff(sem);
+		return true;
+	}
+
+	return false;
+}
+
 /*
  * Wait until we successfully acquire the write lock
  */
@@ -409,12 +554,16 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	bool waiting = true; /* any queued threads before us */
 	struct rwsem_waiter waiter;
 
+	trace_contention_begin(sem, LCB_F_WRITE);
+
 	/* undo write bias from down_write operation, stop active locking */
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true)) {
+		trace_contention_end(sem, 0);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -422,6 +571,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -451,6 +601,14 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	while (true) {
 		if (rwsem_try_write_lock(count, sem))
 			break;
+
+		/*
+		 * Spinners kept stealing the lock from under us; make them
+		 * queue behind us instead.
+		 */
+		if (sem->wait_list.next == &waiter.list &&
+		    time_after(jiffies, waiter.timeout))
+			rwsem_set_handoff(sem);
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
@@ -465,6 +623,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	trace_contention_end(sem, 0);
 
 	return sem;
 }
@@ -60,6 +60,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <uapi/linux/module.h>
 #include "module-internal.h"
 
@@ -175,7 +177,8 @@ struct load_info {
 	unsigned long len;
 	Elf_Shdr *sechdrs;
 	char *secstrings, *strtab;
-	unsigned long symoffs, stroffs;
+	unsigned long symoffs, stroffs, hashoffs;
+	unsigned int hash_size;
 	struct _ddebug *debug;
 	unsigned int num_debug;
 	bool sig_ok;
@@ -2258,6 +2261,11 @@ static char elf_type(const Elf_Sym *sym, const struct load_info *info)
 	return '?';
 }
 
+static inline u32 symname_hash(const char *name)
+{
+	return jhash(name, strlen(name), 0);
+}
+
 static bool is_core_symbol(const Elf_Sym *src, const Elf_Shdr *sechdrs,
                            unsigned int shnum)
 {
@@ -2316,6 +2324,12 @@ static void layout_symtab(struct module *mod, struct load_info *info)
 	info->stroffs = mod->core_size = info->symoffs + ndst * sizeof(Elf_Sym);
 	mod->core_size += strtab_size;
 
+	/* And for their name hash: buckets followed by the chains. */
+	info->hash_size = roundup_pow_of_two(ndst);
+	info->hashoffs = ALIGN(mod->core_size, sizeof(unsigned int));
+	mod->core_size = info->hashoffs +
+		(info->hash_size + ndst) * sizeof(unsigned int);
+
 	/* Put string table section at end of init part of module. */
 	strsect->sh_flags |= SHF_ALLOC;
 	strsect->sh_entsize = get_offset(mod, &mod->init_size, strsect,
@@ -2353,6 +2367,24 @@ static void add_kallsyms(struct module *mod, const struct load_info *info)
 		}
 	}
 	mod->core_num_syms = ndst;
+
+	/*
+	 * Chain the core symbols by name hash, inserting backwards so
+	 * that walking a chain still finds the first of several
+	 * symbols of the same name.  Index 0 is the null symbol, so it
+	 * doubles as the end marker.
+	 */
+	mod->core_symhash = mod->module_core + info->hashoffs;
+	mod->core_symhash_size = info->hash_size;
+	memset(mod->core_symhash, 0,
+	       (info->hash_size + ndst) * sizeof(unsigned int));
+	for (i = ndst - 1; i > 0; i--) {
+		const char *name = mod->core_strtab + dst[i].st_name;
+		unsigned int b = symname_hash(name) & (info->hash_size - 1);
+
+		mod->core_symhash[info->hash_size + i] = mod->core_symhash[b];
+		mod->core_symhash[b] = i;
+	}
 }
 #else
 static inline void layout_symtab(struct module *mod, struct load_info *info)
@@ -3063,8 +3095,11 @@ static int do_init_module(struct module *mod)
 	 * Please refer to the following thread for details.
 	 *
 	 * http://thread.gmane.org/gmane.linux.kernel/1420814
+	 *
+	 * Modules loaded with "async_probe" asked for their drivers to be
+	 * bound in the background, so don't wait for them here.
 	 */
-	if (current->flags & PF_USED_ASYNC)
+	if (!mod->async_probe_requested && (current->flags & PF_USED_ASYNC))
 		async_synchronize_full();
 
 	mutex_lock(&module_mutex);
@@ -3174,10 +3209,19 @@ out:
 	return err;
 }
 
-static int unknown_module_param_cb(char *param, char *val, const char *modname)
+static int unknown_module_param_cb(char *param, char *val, const char *modname,
+				   void *arg)
 {
-	/* Check for magic 'dyndbg' arg */ 
-	int ret = ddebug_dyndbg_module_param_cb(param, val, modname);
+	struct module *mod = arg;
+	int ret;
+
+	if (strcmp(param, "async_probe") == 0) {
+		mod->async_probe_requested = true;
+		return 0;
+	}
+
+	/* Check for magic 'dyndbg' arg */
+	ret = ddebug_dyndbg_module_param_cb(param, val, modname);
 	if (ret != 0)
 		pr_warn("%s: unknown parameter '%s' ignored\n", modname, param);
 	return 0;
@@ -3279,7 +3323,8 @@ static int load_module(struct load_info *info, const char __user *uargs,
 
 	/* Module is ready to execute: parsing args may do that. */
 	after_dashes = parse_args(mod->name, mod->args, mod->kp, mod->num_kp,
-				  -32768, 32767, unknown_module_param_cb);
+				  -32768, 32767, mod,
+				  unknown_module_param_cb);
 	if (IS_ERR(after_dashes)) {
 		err = PTR_ERR(after_dashes);
 		goto bug_cleanup;
@@ -3550,6 +3595,23 @@ static unsigned long mod_find_symname(struct module *mod, const char *name)
 {
 	unsigned int i;
 
+	/*
+	 * Once init is done only the core symbols are left, and those
+	 * are indexed by add_kallsyms().
+	 */
+	if (mod->symtab == mod->core_symtab) {
+		const unsigned int *chain = mod->core_symhash +
+					    mod->core_symhash_size;
+		unsigned int b = symname_hash(name) &
+				 (mod->core_symhash_size - 1);
+
+		for (i = mod->core_symhash[b]; i; i = chain[i])
+			if (!strcmp(name, mod->strtab+mod->symtab[i].st_name) &&
+			    mod->symtab[i].st_info != 'U')
+				return mod->symtab[i].st_value;
+		return 0;
+	}
+
 	for (i = 0; i < mod->num_symtab; i++)
 		if (strcmp(name, mod->strtab+mod->symtab[i].st_name) == 0 &&
 		    mod->symtab[i].st_info != 'U')
@@ -30,6 +30,8 @@
 #include <linux/slab.h>
 #include <linux/sysfs.h>
 #include <linux/rcupdate.h>
+#include <linux/completion.h>
+#include <linux/nodemask.h>
 
 #define MAX_OBJ_NUM 1000
 
@@ -1108,3 +1110,146 @@ void padata_free(struct padata_instance *pinst)
 	kobject_put(&pinst->kobj);
 }
 EXPORT_SYMBOL(padata_free);
+
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_work {
+	struct work_struct		pw_work;
+	struct padata_mt_job_state	*pw_ps;
+};
+
+static void padata_mt_helper(struct work_struct *w)
+{
+	struct padata_work *pw = container_of(w, struct padata_work, pw_work);
+	struct padata_mt_job_state *ps = pw->pw_ps;
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+
+	while (job->size > 0) {
+		unsigned long start, size, end;
+
+		start = job->start;
+		/* So end is chunk size aligned if enough work remains. */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+		end = start + size;
+
+		job->start = end;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, end, job->fn_arg);
+		spin_lock(&ps->lock);
+	}
+
+	++ps->nworks_fini;
+	done = (ps->nworks_fini == ps->nworks);
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+/*
+ * Pick a CPU on the node after @nid for the next helper, so the helpers of
+ * a job are spread over the nodes instead of piling up on the caller's.
+ */
+static int padata_mt_next_cpu(int *nid)
+{
+	int cpu;
+
+	*nid = next_node(*nid, node_online_map);
+	if (*nid == MAX_NUMNODES)
+		*nid = first_node(node_online_map);
+
+	cpu = cpumask_any_and(cpumask_of_node(*nid), cpu_online_mask);
+	return cpu < nr_cpu_ids ? cpu : WORK_CPU_UNBOUND;
+}
+
+/**
+ * padata_do_multithreaded - run a multithreaded job
+ * @job: Description of the job.
+ *
+ * The range [@job->start, @job->start + @job->size) is cut into chunks
+ * which the calling thread and up to @job->max_threads - 1 unbound
+ * workqueue helpers, spread over the NUMA nodes, pick up until the whole
+ * range is done. Chunks are small enough that a helper finishing early
+ * takes more of them, which balances the load between the threads.
+ *
+ * Must be called from process context. Returns when the whole job is done.
+ */
+void padata_do_multithreaded(struct padata_mt_job *job)
+{
+	/* In case threads finish at different times. */
+	static const unsigned long load_balance_factor = 4;
+	struct padata_work my_work, *works;
+	struct padata_mt_job_state ps;
+	unsigned long nworks;
+	int i, nid;
+
+	might_sleep();
+
+	if (job->size == 0)
+		return;
+
+	/* Ensure at least one thread when size < min_chunk. */
+	nworks = max(job->size / job->min_chunk, 1ul);
+	nworks = min(nworks, (unsigned long)job->max_threads);
+
+	works = NULL;
+	if (nworks > 1)
+		works = kcalloc(nworks - 1, sizeof(*works), GFP_KERNEL);
+
+	if (!works) {
+		/* Single thread, no coordination needed, cut to the chase. */
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job	       = job;
+	ps.nworks      = nworks;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Chunk size is the amount of work a helper does per call to the
+	 * thread function.  Load balance large jobs between threads by
+	 * increasing the number of chunks, guarantee at least the minimum
+	 * chunk size from the caller, and honor the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (ps.nworks * load_balance_factor);
+	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
+	ps.chunk_size = roundup(ps.chunk_size, job->align);
+
+	nid = numa_node_id();
+	for (i = 0; i < nworks - 1; i++) {
+		struct padata_work *pw = &works[i];
+
+		INIT_WORK(&pw->pw_work, padata_mt_helper);
+		pw->pw_ps = &ps;
+		queue_work_on(padata_mt_next_cpu(&nid), system_unbound_wq,
+			      &pw->pw_work);
+	}
+
+	/* Use the current thread, which saves starting a workqueue worker. */
+	INIT_WORK_ONSTACK(&my_work.pw_work, padata_mt_helper);
+	my_work.pw_ps = &ps;
+	padata_mt_helper(&my_work.pw_work);
+	destroy_work_on_stack(&my_work.pw_work);
+
+	/* Wait for all the helpers to finish. */
+	wait_for_completion(&ps.completion);
+
+	kfree(works);
+}
+EXPORT_SYMBOL_GPL(padata_do_multithreaded);
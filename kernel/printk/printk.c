@@ -46,6 +46,7 @@
 #include <linux/irq_work.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -1499,6 +1500,39 @@ static int console_trylock_for_printk(void)
 	return 1;
 }
 
+/*
+ * Printing to slow (serial) consoles is done by the "printk" kthread,
+ * so that a burst of messages doesn't stall whoever happens to call
+ * printk() while the backlog is flushed.  Boot it with printk.offload=0
+ * to get the old behaviour of printing from the caller's context.
+ */
+static struct task_struct *printk_kthread;
+static bool printk_offload = true;
+module_param_named(offload, printk_offload, bool, S_IRUGO | S_IWUSR);
+
+/*
+ * Oopses, panics and the early boot and shutdown phases print directly:
+ * the kthread may never get to run again, and the messages matter most.
+ */
+static bool printk_offload_console(void)
+{
+	return printk_offload && printk_kthread && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+static void printk_kthread_wake_func(struct irq_work *irq_work)
+{
+	wake_up_process(printk_kthread);
+}
+
+/*
+ * vprintk_emit() can be called with scheduler locks held, so the wakeup
+ * itself is bounced through irq_work.
+ */
+static struct irq_work printk_kthread_work = {
+	.func = printk_kthread_wake_func,
+};
+
 int printk_delay_msec __read_mostly;
 
 static inline void printk_delay(void)
@@ -1769,6 +1803,11 @@ asmlinkage int vprintk_emit(int facility, int level,
 	lockdep_on();
 	local_irq_restore(flags);
 
+	if (printk_offload_console()) {
+		irq_work_queue(&printk_kthread_work);
+		return printed_len;
+	}
+
 	/* If called from the scheduler, we can not call up(). */
 	if (!in_sched) {
 		lockdep_off();
@@ -2611,8 +2650,10 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
+		if (printk_offload_console())
+			wake_up_process(printk_kthread);
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -2635,6 +2676,47 @@ void wake_up_klogd(void)
 	preempt_enable();
 }
 
+static bool printk_kthread_pending(void)
+{
+	unsigned long flags;
+	bool pending;
+
+	raw_spin_lock_irqsave(&logbuf_lock, flags);
+	pending = console_seq != log_next_seq;
+	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+
+	return pending;
+}
+
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_kthread_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: unable to create printing thread\n");
+		return PTR_ERR(tsk);
+	}
+	printk_kthread = tsk;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 int printk_deferred(const char *fmt, ...)
 {
 	va_list args;
@@ -56,6 +56,9 @@
 #include <linux/random.h>
 #include <linux/ftrace_event.h>
 #include <linux/suspend.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/tick.h>
 
 #include "tree.h"
 #include "rcu.h"
@@ -102,6 +105,7 @@ struct rcu_state sname##_state = { \
 	.orphan_donetail = &sname##_state.orphan_donelist, \
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.onoff_mutex = __MUTEX_INITIALIZER(sname##_state.onoff_mutex), \
+	.expedited_mutex = __MUTEX_INITIALIZER(sname##_state.expedited_mutex), \
 	.name = RCU_STATE_NAME(sname), \
 	.abbr = sabbr, \
 }; \
@@ -281,9 +285,25 @@ static void rcu_momentary_dyntick_idle(void)
 	local_irq_restore(flags);
 }
 
+/*
+ * Report an expedited RCU-sched quiescent state for the current CPU,
+ * waking up synchronize_sched_expedited() if it was waiting only on
+ * this CPU.  The caller must have disabled preemption.
+ */
+static void rcu_sched_exp_report(void)
+{
+	struct rcu_state *rsp = &rcu_sched_state;
+
+	__this_cpu_write(rcu_sched_data.exp_need_qs, false);
+	if (atomic_dec_and_test(&rsp->expedited_need_qs))
+		wake_up(&rsp->expedited_wq);
+}
+
 /*
  * Note a context switch.  This is a quiescent state for RCU-sched,
- * and requires special handling for preemptible RCU.
+ * and requires special handling for preemptible RCU.  An expedited
+ * quiescent state is reported only after any preempted RCU reader
+ * has been queued on its ->blkd_tasks list.
  * The caller must have disabled preemption.
  */
 void rcu_note_context_switch(int cpu)
@@ -291,6 +311,8 @@ void rcu_note_context_switch(int cpu)
 	trace_rcu_utilization(TPS("Start context switch"));
 	rcu_sched_qs();
 	rcu_preempt_note_context_switch(cpu);
+	if (unlikely(__this_cpu_read(rcu_sched_data.exp_need_qs)))
+		rcu_sched_exp_report();
 	if (unlikely(raw_cpu_read(rcu_sched_qs_mask)))
 		rcu_momentary_dyntick_idle();
 	trace_rcu_utilization(TPS("End context switch"));
@@ -2744,19 +2766,214 @@ void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
- * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * kfree_rcu() batching: rather than one callback per object, which then
+ * takes a cache miss on every object it frees, the pointers are gathered
+ * into per-CPU page-sized arrays. After KFREE_DRAIN_JIFFIES the collected
+ * batch waits for a single grace period and is handed to kfree_bulk().
+ * Objects that arrive when no page can be had are chained through their
+ * rcu_head as before, and freed with the same batch.
+ */
+#define KFREE_DRAIN_JIFFIES	(HZ / 50)
+
+struct kfree_rcu_bulk_data {
+	unsigned long nr_records;
+	struct kfree_rcu_bulk_data *next;
+	void *records[];
+};
+
+#define KFREE_BULK_MAX_ENTR \
+	((PAGE_SIZE - sizeof(struct kfree_rcu_bulk_data)) / sizeof(void *))
+
+/**
+ * struct kfree_rcu_cpu - per-CPU state of batched kfree_rcu() requests
+ * @lock: protects all the fields below, taken with interrupts disabled
+ * @bhead: pointer arrays being filled
+ * @head: objects queued through their rcu_head, no array was available
+ * @bhead_free: pointer arrays waiting for the grace period in flight
+ * @head_free: rcu_head objects waiting for the grace period in flight
+ * @bcached: a spare page kept around to avoid reallocating it
+ * @rcu: the grace period of the batch in flight
+ * @monitor_work: drains @bhead and @head after KFREE_DRAIN_JIFFIES
+ * @monitor_todo: @monitor_work is pending
+ */
+struct kfree_rcu_cpu {
+	spinlock_t lock;
+	struct kfree_rcu_bulk_data *bhead;
+	struct rcu_head *head;
+	struct kfree_rcu_bulk_data *bhead_free;
+	struct rcu_head *head_free;
+	struct kfree_rcu_bulk_data *bcached;
+	struct rcu_head rcu;
+	struct delayed_work monitor_work;
+	bool monitor_todo;
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc);
+
+/* Set once workqueues are up, kfree_rcu() batches until then */
+static bool kfree_rcu_monitor_ready;
+
+/*
+ * Invoked after the grace period of a batch: free everything in it.
+ */
+static void kfree_rcu_batch_free(struct rcu_head *rcu)
+{
+	struct kfree_rcu_cpu *krcp = container_of(rcu, struct kfree_rcu_cpu, rcu);
+	struct kfree_rcu_bulk_data *bhead, *bnext;
+	struct rcu_head *head, *next;
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	bhead = krcp->bhead_free;
+	head = krcp->head_free;
+	krcp->bhead_free = NULL;
+	krcp->head_free = NULL;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	for (; bhead; bhead = bnext) {
+		bnext = bhead->next;
+
+		rcu_lock_acquire(&rcu_callback_map);
+		kfree_bulk(bhead->nr_records, bhead->records);
+		rcu_lock_release(&rcu_callback_map);
+
+		if (cmpxchg(&krcp->bcached, NULL, bhead))
+			free_page((unsigned long)bhead);
+	}
+
+	for (; head; head = next) {
+		unsigned long offset = (unsigned long)head->func;
+
+		next = head->next;
+		rcu_lock_acquire(&rcu_callback_map);
+		kfree((void *)head - offset);
+		rcu_lock_release(&rcu_callback_map);
+	}
+}
+
+/*
+ * Hand the collected objects to a grace period, unless the previous batch
+ * is still waiting for its own. Called with krcp->lock held.
+ */
+static bool kfree_rcu_queue_batch(struct kfree_rcu_cpu *krcp)
+{
+	if (krcp->bhead_free || krcp->head_free)
+		return false;
+
+	krcp->bhead_free = krcp->bhead;
+	krcp->head_free = krcp->head;
+	krcp->bhead = NULL;
+	krcp->head = NULL;
+
+	if (krcp->bhead_free || krcp->head_free)
+		__call_rcu(&krcp->rcu, kfree_rcu_batch_free, rcu_state_p, -1, 1);
+	return true;
+}
+
+static void kfree_rcu_monitor(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						  monitor_work.work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	if (kfree_rcu_queue_batch(krcp))
+		krcp->monitor_todo = false;
+	else
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+static bool kfree_rcu_bulk_add(struct kfree_rcu_cpu *krcp, void *ptr)
+{
+	struct kfree_rcu_bulk_data *bnode = krcp->bhead;
+
+	if (!bnode || bnode->nr_records == KFREE_BULK_MAX_ENTR) {
+		bnode = xchg(&krcp->bcached, NULL);
+		if (!bnode)
+			bnode = (struct kfree_rcu_bulk_data *)
+				__get_free_page(GFP_NOWAIT | __GFP_NOWARN);
+		if (!bnode)
+			return false;
+
+		bnode->nr_records = 0;
+		bnode->next = krcp->bhead;
+		krcp->bhead = bnode;
+	}
+
+	bnode->records[bnode->nr_records++] = ptr;
+	return true;
+}
+
+/*
+ * Queue an object for kfree() after a grace period. This function may
+ * only be called from __kfree_rcu(), @func is the offset of @head in
+ * the object.
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, rcu_state_p, -1, 1);
+	struct kfree_rcu_cpu *krcp;
+	unsigned long flags;
+	void *ptr = (void *)head - (unsigned long)func;
+
+	local_irq_save(flags);
+	krcp = this_cpu_ptr(&krc);
+	spin_lock(&krcp->lock);
+
+	if (!kfree_rcu_bulk_add(krcp, ptr)) {
+		head->func = func;
+		head->next = krcp->head;
+		krcp->head = head;
+	}
+
+	if (kfree_rcu_monitor_ready && !krcp->monitor_todo) {
+		krcp->monitor_todo = true;
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	}
+
+	spin_unlock(&krcp->lock);
+	local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+static void __init kfree_rcu_batch_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_init(&krcp->lock);
+		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
+	}
+}
+
+/*
+ * Start draining whatever kfree_rcu() gathered before workqueues were
+ * available.
+ */
+static int __init kfree_rcu_monitor_start(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	kfree_rcu_monitor_ready = true;
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_irqsave(&krcp->lock, flags);
+		if ((krcp->bhead || krcp->head) && !krcp->monitor_todo) {
+			krcp->monitor_todo = true;
+			schedule_delayed_work(&krcp->monitor_work,
+					      KFREE_DRAIN_JIFFIES);
+		}
+		spin_unlock_irqrestore(&krcp->lock, flags);
+	}
+	return 0;
+}
+core_initcall(kfree_rcu_monitor_start);
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -2912,21 +3129,95 @@ void cond_synchronize_rcu(unsigned long oldstate)
 }
 EXPORT_SYMBOL_GPL(cond_synchronize_rcu);
 
-static int synchronize_sched_expedited_cpu_stop(void *data)
+/*
+ * Handler for the expedited RCU-sched IPI.  If this CPU was interrupted
+ * from idle or from nohz_full usermode, it was already in a quiescent
+ * state, so report it right away.  Otherwise, ask for a context switch
+ * and have rcu_note_context_switch() report the quiescent state.
+ */
+static void sync_sched_exp_handler(void *unused)
 {
-	/*
-	 * There must be a full memory barrier on each affected CPU
-	 * between the time that try_stop_cpus() is called and the
-	 * time that it returns.
-	 *
-	 * In the current initial implementation of cpu_stop, the
-	 * above condition is already met when the control reaches
-	 * this point and the following smp_mb() is not strictly
-	 * necessary.  Do smp_mb() anyway for documentation and
-	 * robustness against future implementation changes.
-	 */
-	smp_mb(); /* See above comment block. */
-	return 0;
+	if (rcu_is_cpu_rrupt_from_idle()) {
+		rcu_sched_exp_report();
+		return;
+	}
+	__this_cpu_write(rcu_sched_data.exp_need_qs, true);
+	resched_cpu(smp_processor_id());
+}
+
+/*
+ * Scan the CPUs covered by the specified leaf rcu_node structure, and
+ * send an IPI to each of them that is neither idle nor in nohz_full
+ * usermode.  The CPUs that are skipped are in an extended quiescent
+ * state and need not be disturbed at all.
+ */
+static void sync_sched_exp_select_cpus(struct rcu_state *rsp,
+				       struct rcu_node *rnp)
+{
+	struct rcu_data *rdp;
+	int cpu;
+
+	for (cpu = rnp->grplo; cpu <= rnp->grphi; cpu++) {
+		if (!cpu_online(cpu))
+			continue;
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (!(atomic_add_return(0, &rdp->dynticks->dynticks) & 0x1)) {
+			atomic_long_inc(&rsp->expedited_idle);
+			continue;
+		}
+		atomic_inc(&rsp->expedited_need_qs);
+		atomic_long_inc(&rsp->expedited_ipis);
+		smp_call_function_single(cpu, sync_sched_exp_handler, NULL, 0);
+	}
+}
+
+static void sync_sched_exp_select_cpus_work(struct work_struct *wp)
+{
+	struct rcu_node *rnp = container_of(wp, struct rcu_node, exp_work);
+
+	sync_sched_exp_select_cpus(&rcu_sched_state, rnp);
+}
+
+/*
+ * Pick an online CPU covered by the specified leaf rcu_node structure
+ * that is not an adaptive-ticks CPU, so that scanning this leaf does
+ * not itself disturb an isolated CPU.  Return -1 if there is none.
+ */
+static int sync_sched_exp_work_cpu(struct rcu_node *rnp)
+{
+	int cpu;
+
+	for (cpu = rnp->grplo; cpu <= rnp->grphi; cpu++)
+		if (cpu_online(cpu) && !tick_nohz_full_cpu(cpu))
+			return cpu;
+	return -1;
+}
+
+/*
+ * Send IPIs to all CPUs that might be in an RCU-sched read-side critical
+ * section.  With more than one leaf rcu_node structure, the leaves are
+ * scanned in parallel from workqueues running on CPUs local to each leaf,
+ * and any leaf with no suitable CPU is scanned directly by the caller.
+ */
+static void sync_sched_exp_ipi_cpus(struct rcu_state *rsp)
+{
+	struct rcu_node *rnp;
+	int cpu;
+
+	if (rcu_num_nodes == 1) {
+		sync_sched_exp_select_cpus(rsp, rcu_get_root(rsp));
+		return;
+	}
+	rcu_for_each_leaf_node(rsp, rnp) {
+		INIT_WORK(&rnp->exp_work, sync_sched_exp_select_cpus_work);
+		cpu = sync_sched_exp_work_cpu(rnp);
+		if (cpu < 0)
+			sync_sched_exp_select_cpus(rsp, rnp);
+		else
+			queue_work_on(cpu, system_highpri_wq, &rnp->exp_work);
+	}
+	rcu_for_each_leaf_node(rsp, rnp)
+		flush_work(&rnp->exp_work);
 }
 
 /**
@@ -2934,37 +3225,34 @@ static int synchronize_sched_expedited_cpu_stop(void *data)
  *
  * Wait for an RCU-sched grace period to elapse, but use a "big hammer"
  * approach to force the grace period to end quickly.  This consumes
- * significant time on all CPUs and is unfriendly to real-time workloads,
- * so is thus not recommended for any sort of common-case code.  In fact,
- * if you are using synchronize_sched_expedited() in a loop, please
- * restructure your code to batch your updates, and then use a single
- * synchronize_sched() instead.
+ * significant time on all non-idle CPUs and is unfriendly to real-time
+ * workloads, so is thus not recommended for any sort of common-case code.
+ * In fact, if you are using synchronize_sched_expedited() in a loop,
+ * please restructure your code to batch your updates, and then use a
+ * single synchronize_sched() instead.
  *
  * This implementation can be thought of as an application of ticket
  * locking to RCU, with sync_sched_expedited_started and
  * sync_sched_expedited_done taking on the roles of the halves
  * of the ticket-lock word.  Each task atomically increments
  * sync_sched_expedited_started upon entry, snapshotting the old value,
- * then attempts to stop all the CPUs.  If this succeeds, then each
- * CPU will have executed a context switch, resulting in an RCU-sched
- * grace period.  We are then done, so we use atomic_cmpxchg() to
- * update sync_sched_expedited_done to match our snapshot -- but
- * only if someone else has not already advanced past our snapshot.
+ * then acquires ->expedited_mutex.  If sync_sched_expedited_done has
+ * advanced past the snapshot by then, someone else forced a grace
+ * period some time after we took our snapshot, so our work is done
+ * for us and we can simply return.
  *
- * On the other hand, if try_stop_cpus() fails, we check the value
- * of sync_sched_expedited_done.  If it has advanced past our
- * initial snapshot, then someone else must have forced a grace period
- * some time after we took our snapshot.  In this case, our work is
- * done for us, and we can simply return.  Otherwise, we try again,
- * but keep our initial snapshot for purposes of checking for someone
- * doing our work for us.
- *
- * If we fail too many times in a row, we fall back to synchronize_sched().
+ * Otherwise, each online CPU whose dynticks counter shows it to be
+ * idle or in nohz_full usermode is in an extended quiescent state and
+ * is left alone.  Each remaining CPU is sent an IPI, which reports a
+ * quiescent state immediately if it interrupted idle, and otherwise
+ * forces a context switch that reports one.  Once all of these CPUs
+ * have checked in, we use atomic_cmpxchg() to update
+ * sync_sched_expedited_done to match our snapshot -- but only if
+ * someone else has not already advanced past our snapshot.
  */
 void synchronize_sched_expedited(void)
 {
 	long firstsnap, s, snap;
-	int trycount = 0;
 	struct rcu_state *rsp = &rcu_sched_state;
 
 	/*
@@ -2997,60 +3285,47 @@ void synchronize_sched_expedited(void)
 	}
 	WARN_ON_ONCE(cpu_is_offline(raw_smp_processor_id()));
 
-	/*
-	 * Each pass through the following loop attempts to force a
-	 * context switch on each CPU.
-	 */
-	while (try_stop_cpus(cpu_online_mask,
-			     synchronize_sched_expedited_cpu_stop,
-			     NULL) == -EAGAIN) {
+	/* Check to see if someone else did our work for us. */
+	s = atomic_long_read(&rsp->expedited_done);
+	if (ULONG_CMP_GE((ulong)s, (ulong)firstsnap)) {
+		/* ensure test happens before caller kfree */
+		smp_mb__before_atomic(); /* ^^^ */
+		atomic_long_inc(&rsp->expedited_workdone1);
 		put_online_cpus();
-		atomic_long_inc(&rsp->expedited_tryfail);
+		return;
+	}
 
-		/* Check to see if someone else did our work for us. */
-		s = atomic_long_read(&rsp->expedited_done);
-		if (ULONG_CMP_GE((ulong)s, (ulong)firstsnap)) {
-			/* ensure test happens before caller kfree */
-			smp_mb__before_atomic(); /* ^^^ */
-			atomic_long_inc(&rsp->expedited_workdone1);
-			return;
-		}
+	mutex_lock(&rsp->expedited_mutex);
 
-		/* No joy, try again later.  Or just synchronize_sched(). */
-		if (trycount++ < 10) {
-			udelay(trycount * num_online_cpus());
-		} else {
-			wait_rcu_gp(call_rcu_sched);
-			atomic_long_inc(&rsp->expedited_normal);
-			return;
-		}
+	/* Recheck, someone may have finished while we waited for the mutex. */
+	s = atomic_long_read(&rsp->expedited_done);
+	if (ULONG_CMP_GE((ulong)s, (ulong)firstsnap)) {
+		/* ensure test happens before caller kfree */
+		smp_mb__before_atomic(); /* ^^^ */
+		atomic_long_inc(&rsp->expedited_workdone2);
+		mutex_unlock(&rsp->expedited_mutex);
+		put_online_cpus();
+		return;
+	}
 
-		/* Recheck to see if someone else did our work for us. */
-		s = atomic_long_read(&rsp->expedited_done);
-		if (ULONG_CMP_GE((ulong)s, (ulong)firstsnap)) {
-			/* ensure test happens before caller kfree */
-			smp_mb__before_atomic(); /* ^^^ */
-			atomic_long_inc(&rsp->expedited_workdone2);
-			return;
-		}
+	/*
+	 * Refetching sync_sched_expedited_started allows later callers
+	 * to piggyback on our grace period.  They started before we
+	 * send any IPIs, so our grace period works for them.
+	 */
+	snap = atomic_long_read(&rsp->expedited_start);
+	smp_mb(); /* ensure read is before the dynticks checks and IPIs. */
 
-		/*
-		 * Refetching sync_sched_expedited_started allows later
-		 * callers to piggyback on our grace period.  We retry
-		 * after they started, so our grace period works for them,
-		 * and they started after our first try, so their grace
-		 * period works for us.
-		 */
-		if (!try_get_online_cpus()) {
-			/* CPU hotplug operation in flight, use normal GP. */
-			wait_rcu_gp(call_rcu_sched);
-			atomic_long_inc(&rsp->expedited_normal);
-			return;
-		}
-		snap = atomic_long_read(&rsp->expedited_start);
-		smp_mb(); /* ensure read is before try_stop_cpus(). */
-	}
-	atomic_long_inc(&rsp->expedited_stoppedcpus);
+	/*
+	 * Hold an extra count so that CPUs checking in while the IPIs are
+	 * still being sent cannot end the grace period early.
+	 */
+	atomic_set(&rsp->expedited_need_qs, 1);
+	sync_sched_exp_ipi_cpus(rsp);
+	if (!atomic_dec_and_test(&rsp->expedited_need_qs))
+		wait_event(rsp->expedited_wq,
+			   !atomic_read(&rsp->expedited_need_qs));
+	smp_mb(); /* ensure check-ins are before the _done update. */
 
 	/*
 	 * Everyone up to our most recent fetch is covered by our grace
@@ -3070,6 +3345,7 @@ void synchronize_sched_expedited(void)
 	} while (atomic_long_cmpxchg(&rsp->expedited_done, s, snap) != s);
 	atomic_long_inc(&rsp->expedited_done_exit);
 
+	mutex_unlock(&rsp->expedited_mutex);
 	put_online_cpus();
 }
 EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
@@ -3659,6 +3935,7 @@ static void __init rcu_init_one(struct rcu_state *rsp,
 
 	rsp->rda = rda;
 	init_waitqueue_head(&rsp->gp_wq);
+	init_waitqueue_head(&rsp->expedited_wq);
 	rnp = rsp->level[rcu_num_lvls - 1];
 	for_each_possible_cpu(i) {
 		while (i > rnp->grphi)
@@ -3752,6 +4029,7 @@ void __init rcu_init(void)
 
 	rcu_bootup_announce();
 	rcu_init_geometry();
+	kfree_rcu_batch_init();
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	__rcu_init_preempt();
@@ -181,15 +181,15 @@ static int show_rcuexp(struct seq_file *m, void *v)
 {
 	struct rcu_state *rsp = (struct rcu_state *)m->private;
 
-	seq_printf(m, "s=%lu d=%lu w=%lu tf=%lu wd1=%lu wd2=%lu n=%lu sc=%lu dt=%lu dl=%lu dx=%lu\n",
+	seq_printf(m, "s=%lu d=%lu w=%lu wd1=%lu wd2=%lu n=%lu id=%lu ip=%lu dt=%lu dl=%lu dx=%lu\n",
 		   atomic_long_read(&rsp->expedited_start),
 		   atomic_long_read(&rsp->expedited_done),
 		   atomic_long_read(&rsp->expedited_wrap),
-		   atomic_long_read(&rsp->expedited_tryfail),
 		   atomic_long_read(&rsp->expedited_workdone1),
 		   atomic_long_read(&rsp->expedited_workdone2),
 		   atomic_long_read(&rsp->expedited_normal),
-		   atomic_long_read(&rsp->expedited_stoppedcpus),
+		   atomic_long_read(&rsp->expedited_idle),
+		   atomic_long_read(&rsp->expedited_ipis),
 		   atomic_long_read(&rsp->expedited_done_tries),
 		   atomic_long_read(&rsp->expedited_done_lost),
 		   atomic_long_read(&rsp->expedited_done_exit));
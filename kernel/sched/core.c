@@ -307,7 +307,7 @@ int sysctl_sched_rt_runtime = 950000;
 /*
  * __task_rq_lock - lock the rq @p resides on.
  */
-static inline struct rq *__task_rq_lock(struct task_struct *p)
+struct rq *__task_rq_lock(struct task_struct *p)
 	__acquires(rq->lock)
 {
 	struct rq *rq;
@@ -329,7 +329,7 @@ static inline struct rq *__task_rq_lock(struct task_struct *p)
 /*
  * task_rq_lock - lock p->pi_lock and lock the rq @p resides on.
  */
-static struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
+struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
 	__acquires(p->pi_lock)
 	__acquires(rq->lock)
 {
@@ -349,14 +349,13 @@ static struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
 	}
 }
 
-static void __task_rq_unlock(struct rq *rq)
+void __task_rq_unlock(struct rq *rq)
 	__releases(rq->lock)
 {
 	raw_spin_unlock(&rq->lock);
 }
 
-static inline void
-task_rq_unlock(struct rq *rq, struct task_struct *p, unsigned long *flags)
+void task_rq_unlock(struct rq *rq, struct task_struct *p, unsigned long *flags)
 	__releases(rq->lock)
 	__releases(p->pi_lock)
 {
@@ -835,10 +834,221 @@ static void set_load_weight(struct task_struct *p)
 	load->inv_weight = prio_to_wmult[prio];
 }
 
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * Utilization clamping
+ *
+ * A task can ask, with sched_setattr(), for the frequency of the CPU it is
+ * queued on to be selected as if the CPU utilization were at least
+ * uclamp[UCLAMP_MIN] and at most uclamp[UCLAMP_MAX].  The clamps of the
+ * queued tasks are max-aggregated per rq, in buckets (see struct
+ * uclamp_rq), and the cpufreq governor reads the result with
+ * uclamp_rq_{min,max}().  Both aggregates are max ones: the rq gets the
+ * highest boost any queued task asks for, and is only capped when all of
+ * them accept it.
+ */
+static inline unsigned int uclamp_bucket_id(unsigned int clamp_value)
+{
+	return min_t(unsigned int, clamp_value / UCLAMP_BUCKET_DELTA,
+		     UCLAMP_BUCKETS - 1);
+}
+
+static inline unsigned int uclamp_none(enum uclamp_id clamp_id)
+{
+	if (clamp_id == UCLAMP_MIN)
+		return 0;
+	return SCHED_CAPACITY_SCALE;
+}
+
+static inline void uclamp_se_set(struct uclamp_se *uc_se,
+				 unsigned int value, bool user_defined)
+{
+	uc_se->value = value;
+	uc_se->bucket_id = uclamp_bucket_id(value);
+	uc_se->user_defined = user_defined;
+}
+
+static inline unsigned int uclamp_rq_max_value(struct rq *rq,
+					       enum uclamp_id clamp_id)
+{
+	struct uclamp_bucket *bucket = rq->uclamp[clamp_id].bucket;
+	int bucket_id;
+
+	for (bucket_id = UCLAMP_BUCKETS - 1; bucket_id >= 0; bucket_id--) {
+		if (bucket[bucket_id].tasks)
+			return bucket[bucket_id].value;
+	}
+
+	/* No tasks -- default clamp values */
+	return uclamp_none(clamp_id);
+}
+
+/*
+ * The effective clamp of a task is its request capped by the clamp of its
+ * group, or the group clamp if it made no request.  Tasks in the root
+ * group and in autogroups are not restricted.
+ */
+static inline struct uclamp_se
+uclamp_eff_get(struct task_struct *p, enum uclamp_id clamp_id)
+{
+	struct uclamp_se uc_req = p->uclamp_req[clamp_id];
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	struct task_group *tg = task_group(p);
+	unsigned int tg_value;
+
+	if (task_group_is_autogroup(tg) || tg == &root_task_group)
+		return uc_req;
+
+	tg_value = ACCESS_ONCE(tg->uclamp[clamp_id]);
+	if (!uc_req.user_defined || uc_req.value > tg_value)
+		uclamp_se_set(&uc_req, tg_value, false);
+#endif
+	return uc_req;
+}
+
+static inline void uclamp_rq_inc_id(struct rq *rq, struct task_struct *p,
+				    enum uclamp_id clamp_id)
+{
+	struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+	struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+	struct uclamp_bucket *bucket;
+
+	*uc_se = uclamp_eff_get(p, clamp_id);
+	uc_se->active = true;
+
+	bucket = &uc_rq->bucket[uc_se->bucket_id];
+	bucket->tasks++;
+	if (bucket->tasks == 1 || uc_se->value > bucket->value)
+		bucket->value = uc_se->value;
+
+	if (uc_se->value > uc_rq->value || bucket->tasks == 1)
+		uc_rq->value = uclamp_rq_max_value(rq, clamp_id);
+}
+
+static inline void uclamp_rq_dec_id(struct rq *rq, struct task_struct *p,
+				    enum uclamp_id clamp_id)
+{
+	struct uclamp_rq *uc_rq = &rq->uclamp[clamp_id];
+	struct uclamp_se *uc_se = &p->uclamp[clamp_id];
+	struct uclamp_bucket *bucket;
+
+	bucket = &uc_rq->bucket[uc_se->bucket_id];
+	if (likely(bucket->tasks))
+		bucket->tasks--;
+	uc_se->active = false;
+
+	/* the bucket keeps its value until it drains */
+	if (!bucket->tasks)
+		uc_rq->value = uclamp_rq_max_value(rq, clamp_id);
+}
+
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+		uclamp_rq_inc_id(rq, p, clamp_id);
+}
+
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		if (p->uclamp[clamp_id].active)
+			uclamp_rq_dec_id(rq, p, clamp_id);
+	}
+}
+
+static int uclamp_validate(struct task_struct *p,
+			   const struct sched_attr *attr)
+{
+	unsigned int lower = p->uclamp_req[UCLAMP_MIN].value;
+	unsigned int upper = p->uclamp_req[UCLAMP_MAX].value;
+
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		lower = attr->sched_util_min;
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		upper = attr->sched_util_max;
+
+	if (lower > upper || upper > SCHED_CAPACITY_SCALE)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * A queued task keeps the clamps it was accounted with; the new request
+ * is accounted at its next enqueue.
+ */
+static void __setscheduler_uclamp(struct task_struct *p,
+				  const struct sched_attr *attr)
+{
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MIN)
+		uclamp_se_set(&p->uclamp_req[UCLAMP_MIN],
+			      attr->sched_util_min, true);
+
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP_MAX)
+		uclamp_se_set(&p->uclamp_req[UCLAMP_MAX],
+			      attr->sched_util_max, true);
+}
+
+static void uclamp_fork(struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+		p->uclamp[clamp_id].active = false;
+
+	if (likely(!p->sched_reset_on_fork))
+		return;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+		uclamp_se_set(&p->uclamp_req[clamp_id],
+			      uclamp_none(clamp_id), false);
+}
+
+static void __init init_uclamp(void)
+{
+	enum uclamp_id clamp_id;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+			cpu_rq(cpu)->uclamp[clamp_id].value =
+				uclamp_none(clamp_id);
+	}
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		uclamp_se_set(&init_task.uclamp_req[clamp_id],
+			      uclamp_none(clamp_id), false);
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+		root_task_group.uclamp_req[clamp_id] = uclamp_none(clamp_id);
+		root_task_group.uclamp[clamp_id] = uclamp_none(clamp_id);
+#endif
+	}
+}
+#else /* CONFIG_UCLAMP_TASK */
+static inline void uclamp_rq_inc(struct rq *rq, struct task_struct *p) { }
+static inline void uclamp_rq_dec(struct rq *rq, struct task_struct *p) { }
+static inline int uclamp_validate(struct task_struct *p,
+				  const struct sched_attr *attr)
+{
+	return -EOPNOTSUPP;
+}
+static inline void __setscheduler_uclamp(struct task_struct *p,
+					 const struct sched_attr *attr) { }
+static inline void uclamp_fork(struct task_struct *p) { }
+static inline void init_uclamp(void) { }
+#endif /* CONFIG_UCLAMP_TASK */
+
 static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	sched_info_queued(rq, p);
+	/* before the class reports the new utilization to cpufreq */
+	uclamp_rq_inc(rq, p);
+	psi_enqueue(p, flags & ENQUEUE_WAKEUP);
 	p->sched_class->enqueue_task(rq, p, flags);
 }
 
@@ -846,6 +1056,8 @@ static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	sched_info_dequeued(rq, p);
+	uclamp_rq_dec(rq, p);
+	psi_dequeue(p, flags & DEQUEUE_SLEEP);
 	p->sched_class->dequeue_task(rq, p, flags);
 }
 
@@ -1719,6 +1931,7 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	cpu = select_task_rq(p, p->wake_cpu, SD_BALANCE_WAKE, wake_flags);
 	if (task_cpu(p) != cpu) {
 		wake_flags |= WF_MIGRATED;
+		psi_ttwu_dequeue(p);
 		set_task_cpu(p, cpu);
 	}
 #endif /* CONFIG_SMP */
@@ -1831,6 +2044,7 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	RB_CLEAR_NODE(&p->dl.rb_node);
 	hrtimer_init(&p->dl.dl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	__dl_clear_params(p);
+	p->dl.dl_contending = 0;
 
 	INIT_LIST_HEAD(&p->rt.run_list);
 
@@ -1852,6 +2066,7 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	p->node_stamp = 0ULL;
 	p->numa_scan_seq = p->mm ? p->mm->numa_scan_seq : 0;
 	p->numa_scan_period = sysctl_numa_balancing_scan_delay;
+	p->numa_stable_scans = 0;
 	p->numa_work.next = &p->numa_work;
 	p->numa_faults_memory = NULL;
 	p->numa_faults_buffer_memory = NULL;
@@ -1913,6 +2128,7 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 	int cpu = get_cpu();
 
 	__sched_fork(clone_flags, p);
+	uclamp_fork(p);
 	/*
 	 * We mark the process as running here. This guarantees that
 	 * nobody will actually run it, and a signal or other external
@@ -2053,6 +2269,47 @@ bool __dl_overflow(struct dl_bw *dl_b, int cpus, u64 old_bw, u64 new_bw)
 	       dl_b->bw * cpus < dl_b->total_bw - old_bw + new_bw;
 }
 
+#ifdef CONFIG_CGROUP_SCHED
+/*
+ * A task group may reserve -deadline bandwidth (cpu.dl_runtime_us over
+ * cpu.dl_period_us).  The reservation is allocated from the root domain
+ * as a whole, and the -deadline tasks of the group are then admitted
+ * against the reservation rather than against the root domain.  The
+ * group's total_bw counts the bandwidth of its -deadline tasks whether
+ * it has a reservation or not, so that one can be set up or dropped
+ * while they run.
+ */
+static inline struct dl_bw *task_dl_group_bw(struct task_struct *p)
+{
+	return &task_group(p)->dl_bw;
+}
+#else
+static inline struct dl_bw *task_dl_group_bw(struct task_struct *p)
+{
+	return NULL;
+}
+#endif
+
+/*
+ * Release the bandwidth of a -deadline task that is going away.
+ *
+ * This function is called while holding dl_b->lock.
+ */
+void dl_release_bw(struct dl_bw *dl_b, struct task_struct *p)
+{
+	struct dl_bw *tg_b = task_dl_group_bw(p);
+
+	if (tg_b) {
+		raw_spin_lock(&tg_b->lock);
+		__dl_clear(tg_b, p->dl.dl_bw);
+		if (tg_b->bw == -1)
+			__dl_clear(dl_b, p->dl.dl_bw);
+		raw_spin_unlock(&tg_b->lock);
+	} else {
+		__dl_clear(dl_b, p->dl.dl_bw);
+	}
+}
+
 /*
  * We must be sure that accepting a new task (or allowing changing the
  * parameters of an existing one) is consistent with the bandwidth
@@ -2066,9 +2323,12 @@ static int dl_overflow(struct task_struct *p, int policy,
 {
 
 	struct dl_bw *dl_b = dl_bw_of(task_cpu(p));
+	struct dl_bw *tg_b = task_dl_group_bw(p);
+	struct dl_bw *b = dl_b;
 	u64 period = attr->sched_period ?: attr->sched_deadline;
 	u64 runtime = attr->sched_runtime;
 	u64 new_bw = dl_policy(policy) ? to_ratio(period, runtime) : 0;
+	u64 old_bw = task_has_dl_policy(p) ? p->dl.dl_bw : 0;
 	int cpus, err = -1;
 
 	if (new_bw == p->dl.dl_bw)
@@ -2077,23 +2337,34 @@ static int dl_overflow(struct task_struct *p, int policy,
 	/*
 	 * Either if a task, enters, leave, or stays -deadline but changes
 	 * its parameters, we may need to update accordingly the total
-	 * allocated bandwidth of the container.
+	 * allocated bandwidth of the container: the task group, if it has
+	 * a reservation, or else the root domain.
 	 */
 	raw_spin_lock(&dl_b->lock);
 	cpus = dl_bw_cpus(task_cpu(p));
-	if (dl_policy(policy) && !task_has_dl_policy(p) &&
-	    !__dl_overflow(dl_b, cpus, 0, new_bw)) {
-		__dl_add(dl_b, new_bw);
-		err = 0;
-	} else if (dl_policy(policy) && task_has_dl_policy(p) &&
-		   !__dl_overflow(dl_b, cpus, p->dl.dl_bw, new_bw)) {
-		__dl_clear(dl_b, p->dl.dl_bw);
-		__dl_add(dl_b, new_bw);
-		err = 0;
-	} else if (!dl_policy(policy) && task_has_dl_policy(p)) {
-		__dl_clear(dl_b, p->dl.dl_bw);
-		err = 0;
+	if (tg_b) {
+		raw_spin_lock(&tg_b->lock);
+		if (tg_b->bw != -1) {
+			b = tg_b;
+			cpus = 1;
+		}
+	}
+
+	if (!dl_policy(policy) && !task_has_dl_policy(p))
+		goto unlock;
+	if (dl_policy(policy) && __dl_overflow(b, cpus, old_bw, new_bw))
+		goto unlock;
+
+	__dl_clear(b, old_bw);
+	__dl_add(b, new_bw);
+	if (tg_b && b != tg_b) {
+		__dl_clear(tg_b, old_bw);
+		__dl_add(tg_b, new_bw);
 	}
+	err = 0;
+unlock:
+	if (tg_b)
+		raw_spin_unlock(&tg_b->lock);
 	raw_spin_unlock(&dl_b->lock);
 
 	return err;
@@ -2537,39 +2808,132 @@ void scheduler_tick(void)
 
 	perf_event_task_tick();
 
+	if (curr->flags & PF_WQ_WORKER)
+		wq_worker_tick(curr);
+
 #ifdef CONFIG_SMP
 	rq->idle_balance = idle_cpu(cpu);
 	trigger_load_balance(rq);
 #endif
-	rq_last_tick_reset(rq);
 }
 
 #ifdef CONFIG_NO_HZ_FULL
-/**
- * scheduler_tick_max_deferment
- *
- * Keep at least one tick per second when a single
- * active task is running because the scheduler doesn't
- * yet completely support full dynticks environment.
- *
- * This makes sure that uptime, CFS vruntime, load
- * balancing, etc... continue to move forward, even
- * with a very low granularity.
- *
- * Return: Maximum deferment in nanoseconds.
- */
-u64 scheduler_tick_max_deferment(void)
+/*
+ * A full dynticks CPU running a single task doesn't get a scheduler tick.
+ * The scheduler still needs one now and then to keep uptime, CFS vruntime,
+ * load tracking etc... moving forward, so a housekeeping CPU runs it on the
+ * isolated CPU's behalf, remotely, once per second. The isolated CPU itself
+ * takes no interrupt and keeps no tick hrtimer armed for it.
+ */
+struct tick_work {
+	int			cpu;
+	struct delayed_work	work;
+};
+
+static struct tick_work __percpu *tick_work_cpu;
+
+static void sched_tick_queue(struct tick_work *twork)
 {
-	struct rq *rq = this_rq();
-	unsigned long next, now = ACCESS_ONCE(jiffies);
+	int cpu = cpumask_any_and(housekeeping_mask, cpu_online_mask);
 
-	next = rq->last_sched_tick + HZ;
+	if (cpu >= nr_cpu_ids)
+		cpu = WORK_CPU_UNBOUND;
 
-	if (time_before_eq(next, now))
-		return 0;
+	/*
+	 * Run the remote tick once per second (1Hz). This arbitrary
+	 * frequency is large enough to avoid overload but short enough
+	 * to keep scheduler internal stats reasonably up to date.
+	 */
+	queue_delayed_work_on(cpu, system_wq, &twork->work, HZ);
+}
+
+static void sched_tick_remote(struct work_struct *work)
+{
+	struct delayed_work *dwork = to_delayed_work(work);
+	struct tick_work *twork = container_of(dwork, struct tick_work, work);
+	int cpu = twork->cpu;
+	struct rq *rq = cpu_rq(cpu);
+	unsigned long flags;
+
+	/*
+	 * Handle the tick only if it appears the remote CPU is running in
+	 * full dynticks mode. The check is racy by nature, but missing a
+	 * tick or having one too much is no big deal because the scheduler
+	 * tick updates statistics and checks timeslices in a time-independent
+	 * way, regardless of when exactly it is running.
+	 */
+	if (!idle_cpu(cpu) && tick_nohz_tick_stopped_cpu(cpu)) {
+		struct task_struct *curr;
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		curr = rq->curr;
+		if (!is_idle_task(curr)) {
+			update_rq_clock(rq);
+			curr->sched_class->task_tick(rq, curr, 0);
+		}
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+
+	sched_tick_queue(twork);
+}
+
+static void sched_tick_start(int cpu)
+{
+	struct tick_work *twork;
+
+	if (!tick_nohz_full_cpu(cpu) || !tick_work_cpu)
+		return;
 
-	return jiffies_to_nsecs(next - now);
+	twork = per_cpu_ptr(tick_work_cpu, cpu);
+	twork->cpu = cpu;
+	INIT_DELAYED_WORK(&twork->work, sched_tick_remote);
+	sched_tick_queue(twork);
 }
+
+static void sched_tick_stop(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu) || !tick_work_cpu)
+		return;
+
+	cancel_delayed_work_sync(&per_cpu_ptr(tick_work_cpu, cpu)->work);
+}
+
+static int sched_tick_cpu_notify(struct notifier_block *nfb,
+				 unsigned long action, void *hcpu)
+{
+	int cpu = (long)hcpu;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+	case CPU_DOWN_FAILED:
+		sched_tick_start(cpu);
+		break;
+	case CPU_DOWN_PREPARE:
+		sched_tick_stop(cpu);
+		break;
+	default:
+		return NOTIFY_DONE;
+	}
+	return NOTIFY_OK;
+}
+
+static void __init sched_tick_offload_init(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_enabled())
+		return;
+
+	tick_work_cpu = alloc_percpu(struct tick_work);
+	BUG_ON(!tick_work_cpu);
+
+	for_each_online_cpu(cpu)
+		sched_tick_start(cpu);
+
+	hotcpu_notifier(sched_tick_cpu_notify, 0);
+}
+#else
+static inline void sched_tick_offload_init(void) { }
 #endif
 
 notrace unsigned long get_parent_ip(unsigned long addr)
@@ -3311,6 +3675,8 @@ static void __setscheduler_params(struct task_struct *p,
 	p->rt_priority = attr->sched_priority;
 	p->normal_prio = normal_prio(p);
 	set_load_weight(p);
+
+	__setscheduler_uclamp(p, attr);
 }
 
 /* Actually do priority change: must hold pi & rq lock. */
@@ -3432,7 +3798,19 @@ recheck:
 			return -EINVAL;
 	}
 
-	if (attr->sched_flags & ~(SCHED_FLAG_RESET_ON_FORK))
+	if (attr->sched_flags &
+		~(SCHED_FLAG_RESET_ON_FORK | SCHED_FLAG_RECLAIM |
+		  SCHED_FLAG_UTIL_CLAMP))
+		return -EINVAL;
+
+	if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP) {
+		retval = uclamp_validate(p, attr);
+		if (retval)
+			return retval;
+	}
+
+	/* only -deadline tasks have bandwidth to reclaim with */
+	if ((attr->sched_flags & SCHED_FLAG_RECLAIM) && !dl_policy(policy))
 		return -EINVAL;
 
 	/*
@@ -3532,6 +3910,8 @@ recheck:
 			goto change;
 		if (dl_policy(policy))
 			goto change;
+		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &flags);
@@ -3996,6 +4376,14 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	else
 		attr.sched_nice = task_nice(p);
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* callers of the smaller struct don't know about the clamps */
+	if (size >= SCHED_ATTR_SIZE_VER1) {
+		attr.sched_util_min = p->uclamp_req[UCLAMP_MIN].value;
+		attr.sched_util_max = p->uclamp_req[UCLAMP_MAX].value;
+	}
+#endif
+
 	rcu_read_unlock();
 
 	retval = sched_read_attr(uattr, &attr, size);
@@ -5475,6 +5863,7 @@ static int sd_degenerate(struct sched_domain *sd)
 			 SD_BALANCE_FORK |
 			 SD_BALANCE_EXEC |
 			 SD_SHARE_CPUCAPACITY |
+			 SD_ASYM_CPUCAPACITY |
 			 SD_SHARE_PKG_RESOURCES |
 			 SD_SHARE_POWERDOMAIN)) {
 		if (sd->groups != sd->groups->next)
@@ -5506,6 +5895,7 @@ sd_parent_degenerate(struct sched_domain *sd, struct sched_domain *parent)
 				SD_BALANCE_FORK |
 				SD_BALANCE_EXEC |
 				SD_SHARE_CPUCAPACITY |
+				SD_ASYM_CPUCAPACITY |
 				SD_SHARE_PKG_RESOURCES |
 				SD_PREFER_SIBLING |
 				SD_SHARE_POWERDOMAIN);
@@ -5663,6 +6053,8 @@ static void free_sched_domain(struct rcu_head *rcu)
 		kfree(sd->groups->sgc);
 		kfree(sd->groups);
 	}
+	if (sd->shared && atomic_dec_and_test(&sd->shared->ref))
+		kfree(sd->shared);
 	kfree(sd);
 }
 
@@ -5689,12 +6081,16 @@ static void destroy_sched_domains(struct sched_domain *sd, int cpu)
 DEFINE_PER_CPU(struct sched_domain *, sd_llc);
 DEFINE_PER_CPU(int, sd_llc_size);
 DEFINE_PER_CPU(int, sd_llc_id);
+DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_busy);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
+DEFINE_PER_CPU(struct sched_domain *, sd_asym_cpucapacity);
+struct static_key sched_asym_cpucapacity = STATIC_KEY_INIT_FALSE;
 
 static void update_top_cache_domain(int cpu)
 {
+	struct sched_domain_shared *sds = NULL;
 	struct sched_domain *sd;
 	struct sched_domain *busy_sd = NULL;
 	int id = cpu;
@@ -5705,18 +6101,23 @@ static void update_top_cache_domain(int cpu)
 		id = cpumask_first(sched_domain_span(sd));
 		size = cpumask_weight(sched_domain_span(sd));
 		busy_sd = sd->parent; /* sd_busy */
+		sds = sd->shared;
 	}
 	rcu_assign_pointer(per_cpu(sd_busy, cpu), busy_sd);
 
 	rcu_assign_pointer(per_cpu(sd_llc, cpu), sd);
 	per_cpu(sd_llc_size, cpu) = size;
 	per_cpu(sd_llc_id, cpu) = id;
+	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
 
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
 
 	sd = highest_flag_domain(cpu, SD_ASYM_PACKING);
 	rcu_assign_pointer(per_cpu(sd_asym, cpu), sd);
+
+	sd = lowest_flag_domain(cpu, SD_ASYM_CPUCAPACITY);
+	rcu_assign_pointer(per_cpu(sd_asym_cpucapacity, cpu), sd);
 }
 
 /*
@@ -6099,6 +6500,9 @@ static void claim_allocations(int cpu, struct sched_domain *sd)
 
 	if (atomic_read(&(*per_cpu_ptr(sdd->sgc, cpu))->ref))
 		*per_cpu_ptr(sdd->sgc, cpu) = NULL;
+
+	if (atomic_read(&(*per_cpu_ptr(sdd->sds, cpu))->ref))
+		*per_cpu_ptr(sdd->sds, cpu) = NULL;
 }
 
 #ifdef CONFIG_NUMA
@@ -6508,10 +6912,15 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 		if (!sdd->sgc)
 			return -ENOMEM;
 
+		sdd->sds = alloc_percpu(struct sched_domain_shared *);
+		if (!sdd->sds)
+			return -ENOMEM;
+
 		for_each_cpu(j, cpu_map) {
 			struct sched_domain *sd;
 			struct sched_group *sg;
 			struct sched_group_capacity *sgc;
+			struct sched_domain_shared *sds;
 
 		       	sd = kzalloc_node(sizeof(struct sched_domain) + cpumask_size(),
 					GFP_KERNEL, cpu_to_node(j));
@@ -6535,6 +6944,13 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 				return -ENOMEM;
 
 			*per_cpu_ptr(sdd->sgc, j) = sgc;
+
+			sds = kzalloc_node(sizeof(struct sched_domain_shared),
+					GFP_KERNEL, cpu_to_node(j));
+			if (!sds)
+				return -ENOMEM;
+
+			*per_cpu_ptr(sdd->sds, j) = sds;
 		}
 	}
 
@@ -6563,6 +6979,8 @@ static void __sdt_free(const struct cpumask *cpu_map)
 				kfree(*per_cpu_ptr(sdd->sg, j));
 			if (sdd->sgc)
 				kfree(*per_cpu_ptr(sdd->sgc, j));
+			if (sdd->sds)
+				kfree(*per_cpu_ptr(sdd->sds, j));
 		}
 		free_percpu(sdd->sd);
 		sdd->sd = NULL;
@@ -6570,7 +6988,26 @@ static void __sdt_free(const struct cpumask *cpu_map)
 		sdd->sg = NULL;
 		free_percpu(sdd->sgc);
 		sdd->sgc = NULL;
+		free_percpu(sdd->sds);
+		sdd->sds = NULL;
+	}
+}
+
+/*
+ * Do the CPUs of @span have different original capacities, as on
+ * big.LITTLE?
+ */
+static bool sched_domain_asym_cpucapacity(const struct cpumask *span)
+{
+	unsigned long cap = arch_scale_cpu_capacity(NULL, cpumask_first(span));
+	int i;
+
+	for_each_cpu(i, span) {
+		if (arch_scale_cpu_capacity(NULL, i) != cap)
+			return true;
 	}
+
+	return false;
 }
 
 struct sched_domain *build_sched_domain(struct sched_domain_topology_level *tl,
@@ -6582,6 +7019,8 @@ struct sched_domain *build_sched_domain(struct sched_domain_topology_level *tl,
 		return child;
 
 	cpumask_and(sched_domain_span(sd), cpu_map, tl->mask(cpu));
+	if (sched_domain_asym_cpucapacity(sched_domain_span(sd)))
+		sd->flags |= SD_ASYM_CPUCAPACITY;
 	if (child) {
 		sd->level = child->level + 1;
 		sched_domain_level_max = max(sched_domain_level_max, sd->level);
@@ -6602,6 +7041,18 @@ struct sched_domain *build_sched_domain(struct sched_domain_topology_level *tl,
 		}
 
 	}
+
+	/*
+	 * All the CPUs of a cache domain share the instance of the first
+	 * CPU in its span, so that they can see each other's hints.
+	 */
+	if (sd->flags & SD_SHARE_PKG_RESOURCES) {
+		struct sd_data *sdd = sd->private;
+		int sd_id = cpumask_first(sched_domain_span(sd));
+
+		sd->shared = *per_cpu_ptr(sdd->sds, sd_id);
+		atomic_inc(&sd->shared->ref);
+	}
 	set_domain_attribute(sd, attr);
 
 	return sd;
@@ -6617,6 +7068,7 @@ static int build_sched_domains(const struct cpumask *cpu_map,
 	enum s_alloc alloc_state;
 	struct sched_domain *sd;
 	struct s_data d;
+	bool has_asym = false;
 	int i, ret = -ENOMEM;
 
 	alloc_state = __visit_domain_allocation_hell(&d, cpu_map);
@@ -6634,6 +7086,8 @@ static int build_sched_domains(const struct cpumask *cpu_map,
 				*per_cpu_ptr(d.sd, i) = sd;
 			if (tl->flags & SDTL_OVERLAP || sched_feat(FORCE_SD_OVERLAP))
 				sd->flags |= SD_OVERLAP;
+			if (sd->flags & SD_ASYM_CPUCAPACITY)
+				has_asym = true;
 			if (cpumask_equal(cpu_map, sched_domain_span(sd)))
 				break;
 		}
@@ -6672,6 +7126,10 @@ static int build_sched_domains(const struct cpumask *cpu_map,
 	}
 	rcu_read_unlock();
 
+	/* Once enabled, stays enabled: capacities don't change at runtime. */
+	if (has_asym && !static_key_enabled(&sched_asym_cpucapacity))
+		static_key_slow_inc(&sched_asym_cpucapacity);
+
 	ret = 0;
 error:
 	__free_domain_allocs(&d, alloc_state, cpu_map);
@@ -6953,6 +7411,7 @@ void __init sched_init_smp(void)
 	hotcpu_notifier(cpuset_cpu_inactive, CPU_PRI_CPUSET_INACTIVE);
 
 	init_hrtick();
+	sched_tick_offload_init();
 
 	/* Move init over to a non-isolated CPU */
 	if (set_cpus_allowed_ptr(current, non_isolated_cpus) < 0)
@@ -6986,6 +7445,14 @@ int in_sched_functions(unsigned long addr)
  */
 struct task_group root_task_group;
 LIST_HEAD(task_groups);
+
+static void init_dl_group_bandwidth(struct task_group *tg)
+{
+	init_dl_bandwidth(&tg->dl_bandwidth, global_rt_period(), RUNTIME_INF);
+	raw_spin_lock_init(&tg->dl_bw.lock);
+	tg->dl_bw.bw = -1;
+	tg->dl_bw.total_bw = 0;
+}
 #endif
 
 DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
@@ -7046,6 +7513,7 @@ void __init sched_init(void)
 #endif /* CONFIG_RT_GROUP_SCHED */
 
 #ifdef CONFIG_CGROUP_SCHED
+	init_dl_group_bandwidth(&root_task_group);
 	list_add(&root_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&root_task_group.children);
 	INIT_LIST_HEAD(&root_task_group.siblings);
@@ -7103,7 +7571,7 @@ void __init sched_init(void)
 #ifdef CONFIG_SMP
 		rq->sd = NULL;
 		rq->rd = NULL;
-		rq->cpu_capacity = SCHED_CAPACITY_SCALE;
+		rq->cpu_capacity = rq->cpu_capacity_orig = SCHED_CAPACITY_SCALE;
 		rq->post_schedule = 0;
 		rq->active_balance = 0;
 		rq->next_balance = jiffies;
@@ -7120,9 +7588,6 @@ void __init sched_init(void)
 #ifdef CONFIG_NO_HZ_COMMON
 		rq->nohz_flags = 0;
 #endif
-#ifdef CONFIG_NO_HZ_FULL
-		rq->last_sched_tick = 0;
-#endif
 #endif
 		init_rq_hrtick(rq);
 		atomic_set(&rq->nr_iowait, 0);
@@ -7165,6 +7630,10 @@ void __init sched_init(void)
 #endif
 	init_sched_fair_class();
 
+	init_uclamp();
+
+	psi_init();
+
 	scheduler_running = 1;
 }
 
@@ -7344,6 +7813,180 @@ static void free_sched_group(struct task_group *tg)
 }
 
 /* allocate runqueue etc for a new task group */
+static DEFINE_MUTEX(dl_group_mutex);
+
+/*
+ * Reserve runtime every period of -deadline bandwidth for @tg, or drop
+ * its reservation if runtime is RUNTIME_INF.  The reservation is taken
+ * from (and given back to) the root domain of the CPU we run on; it
+ * must cover the bandwidth of the -deadline tasks already in the group.
+ */
+static int tg_set_dl_bandwidth(struct task_group *tg, u64 period, u64 runtime)
+{
+	u64 new_bw = -1, old_take, new_take;
+	struct dl_bw *dl_b;
+	int cpu, cpus, err = 0;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	if (runtime != RUNTIME_INF) {
+		if (period == 0)
+			return -EINVAL;
+		new_bw = to_ratio(period, runtime);
+	}
+
+	mutex_lock(&dl_group_mutex);
+	rcu_read_lock_sched();
+	cpu = smp_processor_id();
+	dl_b = dl_bw_of(cpu);
+	cpus = dl_bw_cpus(cpu);
+
+	raw_spin_lock_irq(&dl_b->lock);
+	raw_spin_lock(&tg->dl_bw.lock);
+
+	/* what the group takes from the root domain, now and after */
+	old_take = tg->dl_bw.bw == -1 ? tg->dl_bw.total_bw : tg->dl_bw.bw;
+	new_take = new_bw == -1 ? tg->dl_bw.total_bw : new_bw;
+
+	if ((new_bw != -1 && new_bw < tg->dl_bw.total_bw) ||
+	    (new_take > old_take &&
+	     __dl_overflow(dl_b, cpus, old_take, new_take))) {
+		err = -EBUSY;
+	} else {
+		__dl_clear(dl_b, old_take);
+		__dl_add(dl_b, new_take);
+		tg->dl_bw.bw = new_bw;
+		tg->dl_bandwidth.dl_period = period;
+		tg->dl_bandwidth.dl_runtime = runtime;
+	}
+
+	raw_spin_unlock(&tg->dl_bw.lock);
+	raw_spin_unlock_irq(&dl_b->lock);
+	rcu_read_unlock_sched();
+	mutex_unlock(&dl_group_mutex);
+
+	return err;
+}
+
+/*
+ * Can the -deadline task @tsk move into @tg without overflowing the
+ * reservation of @tg or, when it leaves a reservation for none, the
+ * root domain?
+ */
+static int sched_dl_can_attach(struct task_group *tg, struct task_struct *tsk)
+{
+	struct task_group *src = task_group(tsk);
+	struct dl_bw *dl_b;
+	unsigned long flags;
+	int cpus, ret = 1;
+
+	if (src == tg)
+		return 1;
+
+	rcu_read_lock_sched();
+	dl_b = dl_bw_of(task_cpu(tsk));
+	cpus = dl_bw_cpus(task_cpu(tsk));
+
+	raw_spin_lock_irqsave(&dl_b->lock, flags);
+	raw_spin_lock(&tg->dl_bw.lock);
+	if (tg->dl_bw.bw != -1)
+		ret = !__dl_overflow(&tg->dl_bw, 1, 0, tsk->dl.dl_bw);
+	else if (ACCESS_ONCE(src->dl_bw.bw) != -1)
+		ret = !__dl_overflow(dl_b, cpus, 0, tsk->dl.dl_bw);
+	raw_spin_unlock(&tg->dl_bw.lock);
+	raw_spin_unlock_irqrestore(&dl_b->lock, flags);
+	rcu_read_unlock_sched();
+
+	return ret;
+}
+
+/*
+ * Move the bandwidth of the -deadline task @tsk from group @from to @to,
+ * after sched_dl_can_attach() said it fits.
+ *
+ * This function is called while holding tsk's rq->lock.
+ */
+static void dl_move_task_group(struct task_struct *tsk,
+			       struct task_group *from, struct task_group *to)
+{
+	struct dl_bw *dl_b = dl_bw_of(task_cpu(tsk));
+	u64 bw = tsk->dl.dl_bw;
+
+	if (from == to)
+		return;
+
+	raw_spin_lock(&dl_b->lock);
+
+	raw_spin_lock(&from->dl_bw.lock);
+	__dl_clear(&from->dl_bw, bw);
+	if (from->dl_bw.bw == -1)
+		__dl_clear(dl_b, bw);
+	raw_spin_unlock(&from->dl_bw.lock);
+
+	raw_spin_lock(&to->dl_bw.lock);
+	__dl_add(&to->dl_bw, bw);
+	if (to->dl_bw.bw == -1)
+		__dl_add(dl_b, bw);
+	raw_spin_unlock(&to->dl_bw.lock);
+
+	raw_spin_unlock(&dl_b->lock);
+}
+
+static int sched_group_set_dl_runtime(struct task_group *tg, long dl_runtime_us)
+{
+	u64 dl_runtime = (u64)dl_runtime_us * NSEC_PER_USEC;
+
+	if (dl_runtime_us < 0)
+		dl_runtime = RUNTIME_INF;
+
+	return tg_set_dl_bandwidth(tg, tg->dl_bandwidth.dl_period, dl_runtime);
+}
+
+static long sched_group_dl_runtime(struct task_group *tg)
+{
+	u64 dl_runtime_us;
+
+	if (tg->dl_bandwidth.dl_runtime == RUNTIME_INF)
+		return -1;
+
+	dl_runtime_us = tg->dl_bandwidth.dl_runtime;
+	do_div(dl_runtime_us, NSEC_PER_USEC);
+	return dl_runtime_us;
+}
+
+static int sched_group_set_dl_period(struct task_group *tg, long dl_period_us)
+{
+	u64 dl_period = (u64)dl_period_us * NSEC_PER_USEC;
+
+	if (dl_period == 0)
+		return -EINVAL;
+
+	return tg_set_dl_bandwidth(tg, dl_period, tg->dl_bandwidth.dl_runtime);
+}
+
+static long sched_group_dl_period(struct task_group *tg)
+{
+	u64 dl_period_us;
+
+	dl_period_us = tg->dl_bandwidth.dl_period;
+	do_div(dl_period_us, NSEC_PER_USEC);
+	return dl_period_us;
+}
+
+static inline void alloc_uclamp_sched_group(struct task_group *tg,
+					    struct task_group *parent)
+{
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	enum uclamp_id clamp_id;
+
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		tg->uclamp_req[clamp_id] = uclamp_none(clamp_id);
+		tg->uclamp[clamp_id] = parent->uclamp[clamp_id];
+	}
+#endif
+}
+
 struct task_group *sched_create_group(struct task_group *parent)
 {
 	struct task_group *tg;
@@ -7358,6 +8001,9 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+	init_dl_group_bandwidth(tg);
+	alloc_uclamp_sched_group(tg, parent);
+
 	return tg;
 
 err:
@@ -7407,6 +8053,11 @@ void sched_offline_group(struct task_group *tg)
 	list_del_rcu(&tg->list);
 	list_del_rcu(&tg->siblings);
 	spin_unlock_irqrestore(&task_group_lock, flags);
+
+	/* give the -deadline reservation back to the root domain */
+	if (tg->dl_bw.bw != -1)
+		tg_set_dl_bandwidth(tg, tg->dl_bandwidth.dl_period,
+				    RUNTIME_INF);
 }
 
 /* change task's runqueue when it moves between groups.
@@ -7439,6 +8090,8 @@ void sched_move_task(struct task_struct *tsk)
 	tg = container_of(task_css_check(tsk, cpu_cgrp_id, true),
 			  struct task_group, css);
 	tg = autogroup_task_group(tsk, tg);
+	if (task_has_dl_policy(tsk))
+		dl_move_task_group(tsk, tsk->sched_task_group, tg);
 	tsk->sched_task_group = tg;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -7736,6 +8389,7 @@ static void sched_dl_do_global(void)
 		raw_spin_unlock_irqrestore(&dl_b->lock, flags);
 
 		rcu_read_unlock_sched();
+		init_dl_rq_bw_ratio(&cpu_rq(cpu)->dl);
 	}
 }
 
@@ -7841,6 +8495,78 @@ cpu_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 	return &tg->css;
 }
 
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+/* Serializes updates of the group clamps */
+static DEFINE_MUTEX(uclamp_mutex);
+
+static void uclamp_update_active(struct task_struct *p)
+{
+	enum uclamp_id clamp_id;
+	unsigned long flags;
+	struct rq *rq;
+
+	/*
+	 * Lock the task and the rq where the task is (or was) queued, so
+	 * that the task cannot be queued or dequeued under us; a task that
+	 * is not queued picks the new clamps up at its next enqueue.
+	 */
+	rq = task_rq_lock(p, &flags);
+	for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++) {
+		if (p->uclamp[clamp_id].active) {
+			uclamp_rq_dec_id(rq, p, clamp_id);
+			uclamp_rq_inc_id(rq, p, clamp_id);
+		}
+	}
+	task_rq_unlock(rq, p, &flags);
+}
+
+static void uclamp_update_active_tasks(struct cgroup_subsys_state *css)
+{
+	struct css_task_iter it;
+	struct task_struct *p;
+
+	css_task_iter_start(css, &it);
+	while ((p = css_task_iter_next(&it)))
+		uclamp_update_active(p);
+	css_task_iter_end(&it);
+}
+
+/*
+ * Propagate the clamps of @css down its subtree, each group being capped
+ * by its parent, and refresh the clamps of the tasks queued in them.
+ */
+static void cpu_util_update_eff(struct cgroup_subsys_state *css)
+{
+	struct cgroup_subsys_state *top_css = css;
+	enum uclamp_id clamp_id;
+	struct task_group *tg;
+
+	lockdep_assert_held(&uclamp_mutex);
+
+	rcu_read_lock();
+	css_for_each_descendant_pre(css, top_css) {
+		tg = css_tg(css);
+		if (!tg->parent)
+			continue;
+
+		for (clamp_id = 0; clamp_id < UCLAMP_CNT; clamp_id++)
+			ACCESS_ONCE(tg->uclamp[clamp_id]) =
+				min(tg->uclamp_req[clamp_id],
+				    tg->parent->uclamp[clamp_id]);
+
+		if (!css_tryget_online(css))
+			continue;
+		rcu_read_unlock();
+
+		uclamp_update_active_tasks(css);
+
+		rcu_read_lock();
+		css_put(css);
+	}
+	rcu_read_unlock();
+}
+#endif /* CONFIG_UCLAMP_TASK_GROUP */
+
 static int cpu_cgroup_css_online(struct cgroup_subsys_state *css)
 {
 	struct task_group *tg = css_tg(css);
@@ -7848,6 +8574,13 @@ static int cpu_cgroup_css_online(struct cgroup_subsys_state *css)
 
 	if (parent)
 		sched_online_group(tg, parent);
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/* the parent clamps may have changed since the group was allocated */
+	mutex_lock(&uclamp_mutex);
+	cpu_util_update_eff(css);
+	mutex_unlock(&uclamp_mutex);
+#endif
 	return 0;
 }
 
@@ -7894,6 +8627,12 @@ static int cpu_cgroup_can_attach(struct cgroup_subsys_state *css,
 	struct task_struct *task;
 
 	cgroup_taskset_for_each(task, tset) {
+		/* -deadline tasks are admitted by their bandwidth instead */
+		if (task_has_dl_policy(task)) {
+			if (!sched_dl_can_attach(css_tg(css), task))
+				return -EBUSY;
+			continue;
+		}
 #ifdef CONFIG_RT_GROUP_SCHED
 		if (!sched_rt_can_attach(css_tg(css), task))
 			return -EINVAL;
@@ -8216,6 +8955,70 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+static int cpu_dl_runtime_write(struct cgroup_subsys_state *css,
+				struct cftype *cft, s64 val)
+{
+	return sched_group_set_dl_runtime(css_tg(css), val);
+}
+
+static s64 cpu_dl_runtime_read(struct cgroup_subsys_state *css,
+			       struct cftype *cft)
+{
+	return sched_group_dl_runtime(css_tg(css));
+}
+
+static int cpu_dl_period_write_uint(struct cgroup_subsys_state *css,
+				    struct cftype *cftype, u64 dl_period_us)
+{
+	return sched_group_set_dl_period(css_tg(css), dl_period_us);
+}
+
+static u64 cpu_dl_period_read_uint(struct cgroup_subsys_state *css,
+				   struct cftype *cft)
+{
+	return sched_group_dl_period(css_tg(css));
+}
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+static int cpu_uclamp_write(struct cgroup_subsys_state *css, u64 val,
+			    enum uclamp_id clamp_id)
+{
+	if (val > SCHED_CAPACITY_SCALE)
+		return -ERANGE;
+
+	mutex_lock(&uclamp_mutex);
+	css_tg(css)->uclamp_req[clamp_id] = val;
+	cpu_util_update_eff(css);
+	mutex_unlock(&uclamp_mutex);
+
+	return 0;
+}
+
+static int cpu_uclamp_min_write_u64(struct cgroup_subsys_state *css,
+				    struct cftype *cft, u64 val)
+{
+	return cpu_uclamp_write(css, val, UCLAMP_MIN);
+}
+
+static int cpu_uclamp_max_write_u64(struct cgroup_subsys_state *css,
+				    struct cftype *cft, u64 val)
+{
+	return cpu_uclamp_write(css, val, UCLAMP_MAX);
+}
+
+static u64 cpu_uclamp_min_read_u64(struct cgroup_subsys_state *css,
+				   struct cftype *cft)
+{
+	return css_tg(css)->uclamp_req[UCLAMP_MIN];
+}
+
+static u64 cpu_uclamp_max_read_u64(struct cgroup_subsys_state *css,
+				   struct cftype *cft)
+{
+	return css_tg(css)->uclamp_req[UCLAMP_MAX];
+}
+#endif /* CONFIG_UCLAMP_TASK_GROUP */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -8251,6 +9054,32 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+#endif
+	{
+		.name = "dl_runtime_us",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_dl_runtime_read,
+		.write_s64 = cpu_dl_runtime_write,
+	},
+	{
+		.name = "dl_period_us",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_dl_period_read_uint,
+		.write_u64 = cpu_dl_period_write_uint,
+	},
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	{
+		.name = "uclamp.min",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_uclamp_min_read_u64,
+		.write_u64 = cpu_uclamp_min_write_u64,
+	},
+	{
+		.name = "uclamp.max",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_uclamp_max_read_u64,
+		.write_u64 = cpu_uclamp_max_write_u64,
+	},
 #endif
 	{ }	/* terminate */
 };
@@ -6,6 +6,7 @@
 #include <linux/seq_file.h>
 #include <linux/rcupdate.h>
 #include <linux/kernel_stat.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/err.h>
 
 #include "sched.h"
@@ -25,12 +26,32 @@ enum cpuacct_stat_index {
 	CPUACCT_STAT_NSTATS,
 };
 
+/*
+ * Per-cpu state of a group.  The hot paths only charge the group the
+ * task is in; the charges reach the ancestors when the stats are read
+ * and cgroup_rstat_flush() invokes cpuacct_css_rstat_flush().
+ */
+struct cpuacct_cpu {
+	/* charged on this cpu, under the rq lock */
+	u64 usage;
+	struct u64_stats_sync syncp;
+	/* charged on this cpu by cpuacct_account_field() */
+	u64 cpustat[NR_STATS];
+
+	/* the rest is protected by cgroup_rstat_lock */
+	u64 last_usage;			/* part of ->usage already flushed */
+	u64 last_cpustat[NR_STATS];
+	u64 pending_usage;		/* flushed up from the children */
+	u64 pending_cpustat[NR_STATS];
+	u64 rusage;			/* this group and its descendants */
+};
+
 /* track cpu usage of a group of tasks and its child groups */
 struct cpuacct {
 	struct cgroup_subsys_state css;
-	/* cpuusage holds pointer to a u64-type object on every cpu */
-	u64 __percpu *cpuusage;
-	struct kernel_cpustat __percpu *cpustat;
+	struct cpuacct_cpu __percpu *cpu;
+	/* hierarchical user/system time, protected by cgroup_rstat_lock */
+	u64 cpustat[NR_STATS];
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -49,10 +70,13 @@ static inline struct cpuacct *parent_ca(struct cpuacct *ca)
 	return css_ca(ca->css.parent);
 }
 
-static DEFINE_PER_CPU(u64, root_cpuacct_cpuusage);
+/*
+ * The root group reports the system wide kernel_cpustat for its user and
+ * system time; the callers of cpuacct_account_field() update those.
+ */
+static DEFINE_PER_CPU(struct cpuacct_cpu, root_cpuacct_cpu);
 static struct cpuacct root_cpuacct = {
-	.cpustat	= &kernel_cpustat,
-	.cpuusage	= &root_cpuacct_cpuusage,
+	.cpu		= &root_cpuacct_cpu,
 };
 
 /* create a new cpu accounting group */
@@ -68,18 +92,12 @@ cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
 	if (!ca)
 		goto out;
 
-	ca->cpuusage = alloc_percpu(u64);
-	if (!ca->cpuusage)
+	ca->cpu = alloc_percpu(struct cpuacct_cpu);
+	if (!ca->cpu)
 		goto out_free_ca;
 
-	ca->cpustat = alloc_percpu(struct kernel_cpustat);
-	if (!ca->cpustat)
-		goto out_free_cpuusage;
-
 	return &ca->css;
 
-out_free_cpuusage:
-	free_percpu(ca->cpuusage);
 out_free_ca:
 	kfree(ca);
 out:
@@ -91,44 +109,51 @@ static void cpuacct_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuacct *ca = css_ca(css);
 
-	free_percpu(ca->cpustat);
-	free_percpu(ca->cpuusage);
+	free_percpu(ca->cpu);
 	kfree(ca);
 }
 
-static u64 cpuacct_cpuusage_read(struct cpuacct *ca, int cpu)
-{
-	u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
-	u64 data;
-
-#ifndef CONFIG_64BIT
-	/*
-	 * Take rq->lock to make 64-bit read safe on 32-bit platforms.
-	 */
-	raw_spin_lock_irq(&cpu_rq(cpu)->lock);
-	data = *cpuusage;
-	raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
-#else
-	data = *cpuusage;
-#endif
-
-	return data;
-}
-
-static void cpuacct_cpuusage_write(struct cpuacct *ca, int cpu, u64 val)
+/*
+ * Fold what @css got charged on @cpu since the last flush, along with
+ * what its children handed up, into its totals and pass it on to the
+ * parent.  Called by cgroup_rstat_flush() children first.
+ */
+static void cpuacct_css_rstat_flush(struct cgroup_subsys_state *css, int cpu)
 {
-	u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
+	struct cpuacct *ca = css_ca(css);
+	struct cpuacct *parent = parent_ca(ca);
+	struct cpuacct_cpu *cac = per_cpu_ptr(ca->cpu, cpu);
+	struct cpuacct_cpu *pcac = parent ? per_cpu_ptr(parent->cpu, cpu) : NULL;
+	unsigned int seq;
+	u64 usage, delta;
+	int i;
 
-#ifndef CONFIG_64BIT
-	/*
-	 * Take rq->lock to make 64-bit write safe on 32-bit platforms.
-	 */
-	raw_spin_lock_irq(&cpu_rq(cpu)->lock);
-	*cpuusage = val;
-	raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
-#else
-	*cpuusage = val;
-#endif
+	do {
+		seq = u64_stats_fetch_begin(&cac->syncp);
+		usage = cac->usage;
+	} while (u64_stats_fetch_retry(&cac->syncp, seq));
+
+	delta = usage - cac->last_usage + cac->pending_usage;
+	cac->last_usage = usage;
+	cac->pending_usage = 0;
+	cac->rusage += delta;
+	if (pcac)
+		pcac->pending_usage += delta;
+
+	/* the root's user and system time come from kernel_cpustat */
+	if (ca == &root_cpuacct)
+		return;
+
+	for (i = 0; i < NR_STATS; i++) {
+		u64 val = ACCESS_ONCE(cac->cpustat[i]);
+
+		delta = val - cac->last_cpustat[i] + cac->pending_cpustat[i];
+		cac->last_cpustat[i] = val;
+		cac->pending_cpustat[i] = 0;
+		ca->cpustat[i] += delta;
+		if (parent != &root_cpuacct)
+			pcac->pending_cpustat[i] += delta;
+	}
 }
 
 /* return total cpu usage (in nanoseconds) of a group */
@@ -138,8 +163,10 @@ static u64 cpuusage_read(struct cgroup_subsys_state *css, struct cftype *cft)
 	u64 totalcpuusage = 0;
 	int i;
 
+	cgroup_rstat_flush_hold(css->cgroup);
 	for_each_present_cpu(i)
-		totalcpuusage += cpuacct_cpuusage_read(ca, i);
+		totalcpuusage += per_cpu_ptr(ca->cpu, i)->rusage;
+	cgroup_rstat_flush_release();
 
 	return totalcpuusage;
 }
@@ -156,8 +183,14 @@ static int cpuusage_write(struct cgroup_subsys_state *css, struct cftype *cft,
 		goto out;
 	}
 
+	/*
+	 * Everything charged so far has to be accounted as flushed, or
+	 * it would show up again after the reset.
+	 */
+	cgroup_rstat_flush_hold(css->cgroup);
 	for_each_present_cpu(i)
-		cpuacct_cpuusage_write(ca, i, 0);
+		per_cpu_ptr(ca->cpu, i)->rusage = 0;
+	cgroup_rstat_flush_release();
 
 out:
 	return err;
@@ -169,10 +202,12 @@ static int cpuacct_percpu_seq_show(struct seq_file *m, void *V)
 	u64 percpu;
 	int i;
 
+	cgroup_rstat_flush_hold(seq_css(m)->cgroup);
 	for_each_present_cpu(i) {
-		percpu = cpuacct_cpuusage_read(ca, i);
+		percpu = per_cpu_ptr(ca->cpu, i)->rusage;
 		seq_printf(m, "%llu ", (unsigned long long) percpu);
 	}
+	cgroup_rstat_flush_release();
 	seq_printf(m, "\n");
 	return 0;
 }
@@ -185,25 +220,30 @@ static const char * const cpuacct_stat_desc[] = {
 static int cpuacct_stats_show(struct seq_file *sf, void *v)
 {
 	struct cpuacct *ca = css_ca(seq_css(sf));
-	int cpu;
-	s64 val = 0;
-
-	for_each_online_cpu(cpu) {
-		struct kernel_cpustat *kcpustat = per_cpu_ptr(ca->cpustat, cpu);
-		val += kcpustat->cpustat[CPUTIME_USER];
-		val += kcpustat->cpustat[CPUTIME_NICE];
+	u64 cpustat[NR_STATS];
+	int cpu, i;
+	s64 val;
+
+	if (ca == &root_cpuacct) {
+		memset(cpustat, 0, sizeof(cpustat));
+		for_each_online_cpu(cpu) {
+			struct kernel_cpustat *kcpustat = &kcpustat_cpu(cpu);
+
+			for (i = 0; i < NR_STATS; i++)
+				cpustat[i] += kcpustat->cpustat[i];
+		}
+	} else {
+		cgroup_rstat_flush_hold(ca->css.cgroup);
+		memcpy(cpustat, ca->cpustat, sizeof(cpustat));
+		cgroup_rstat_flush_release();
 	}
+
+	val = cpustat[CPUTIME_USER] + cpustat[CPUTIME_NICE];
 	val = cputime64_to_clock_t(val);
 	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_USER], val);
 
-	val = 0;
-	for_each_online_cpu(cpu) {
-		struct kernel_cpustat *kcpustat = per_cpu_ptr(ca->cpustat, cpu);
-		val += kcpustat->cpustat[CPUTIME_SYSTEM];
-		val += kcpustat->cpustat[CPUTIME_IRQ];
-		val += kcpustat->cpustat[CPUTIME_SOFTIRQ];
-	}
-
+	val = cpustat[CPUTIME_SYSTEM] + cpustat[CPUTIME_IRQ] +
+	      cpustat[CPUTIME_SOFTIRQ];
 	val = cputime64_to_clock_t(val);
 	seq_printf(sf, "%s %lld\n", cpuacct_stat_desc[CPUACCT_STAT_SYSTEM], val);
 
@@ -228,12 +268,14 @@ static struct cftype files[] = {
 };
 
 /*
- * charge this task's execution time to its accounting group.
+ * charge this task's execution time to its accounting group.  The
+ * ancestors pick it up on the next flush.
  *
  * called with rq->lock held.
  */
 void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 {
+	struct cpuacct_cpu *cac;
 	struct cpuacct *ca;
 	int cpu;
 
@@ -242,15 +284,13 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 	rcu_read_lock();
 
 	ca = task_ca(tsk);
+	cac = per_cpu_ptr(ca->cpu, cpu);
 
-	while (true) {
-		u64 *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
-		*cpuusage += cputime;
+	u64_stats_update_begin(&cac->syncp);
+	cac->usage += cputime;
+	u64_stats_update_end(&cac->syncp);
 
-		ca = parent_ca(ca);
-		if (!ca)
-			break;
-	}
+	cgroup_rstat_updated(ca->css.cgroup, cpu);
 
 	rcu_read_unlock();
 }
@@ -262,15 +302,13 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
  */
 void cpuacct_account_field(struct task_struct *p, int index, u64 val)
 {
-	struct kernel_cpustat *kcpustat;
 	struct cpuacct *ca;
 
 	rcu_read_lock();
 	ca = task_ca(p);
-	while (ca != &root_cpuacct) {
-		kcpustat = this_cpu_ptr(ca->cpustat);
-		kcpustat->cpustat[index] += val;
-		ca = parent_ca(ca);
+	if (ca != &root_cpuacct) {
+		this_cpu_ptr(ca->cpu)->cpustat[index] += val;
+		cgroup_rstat_updated(ca->css.cgroup, smp_processor_id());
 	}
 	rcu_read_unlock();
 }
@@ -278,6 +316,7 @@ void cpuacct_account_field(struct task_struct *p, int index, u64 val)
 struct cgroup_subsys cpuacct_cgrp_subsys = {
 	.css_alloc	= cpuacct_css_alloc,
 	.css_free	= cpuacct_css_free,
+	.css_rstat_flush = cpuacct_css_rstat_flush,
 	.legacy_cftypes	= files,
 	.early_init	= 1,
 };
@@ -0,0 +1,434 @@
+/*
+ * CPUFreq governor based on scheduler-provided CPU utilization data.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Rather than sampling the CPU load from a timer, the scheduler calls
+ * into this governor through cpufreq_update_util() whenever the PELT
+ * utilization of a runqueue changes, so the frequency follows a burst as
+ * soon as the scheduler sees it.  The frequency is then picked as
+ *
+ *	next_freq = 1.25 * cur_freq * util / max
+ *
+ * PELT utilization is not frequency invariant in this tree: a CPU that is
+ * busy 80% of the time at the current frequency needs that frequency, one
+ * that is never idle needs more.  The 1.25 factor is the headroom that
+ * gets a fully busy CPU to ramp up.  The utilization clamps of the tasks
+ * queued on the runqueue (see uclamp in kernel/sched/core.c) then bound
+ * the result to a fraction of the maximum frequency.
+ *
+ * The driver may sleep, so the change itself is made from a work item
+ * kicked by an irq_work, at most once every rate_limit_us (a global
+ * tunable in /sys/devices/system/cpu/cpufreq/schedutil/).
+ */
+
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "sched.h"
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+
+	raw_spinlock_t update_lock;	/* For shared policies */
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+
+	struct irq_work irq_work;
+	struct work_struct work;
+	struct mutex work_lock;
+	bool work_in_progress;
+
+	bool need_freq_update;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+	int cpu;
+
+	/* The fields below are only needed when sharing a policy. */
+	unsigned long util;
+	unsigned long max;
+	unsigned long uclamp_min;
+	unsigned long uclamp_max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+/* Tunables, shared by all the policies using the governor. */
+#define SUGOV_DEFAULT_RATE_LIMIT_US	(10 * USEC_PER_MSEC)
+
+static unsigned int rate_limit_us = SUGOV_DEFAULT_RATE_LIMIT_US;
+static unsigned int sugov_usage_count;
+static DEFINE_MUTEX(sugov_tunables_lock);
+
+/************************ Governor internals ***********************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress)
+		return false;
+
+	if (unlikely(sg_policy->need_freq_update)) {
+		sg_policy->need_freq_update = false;
+		return true;
+	}
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= (s64)ACCESS_ONCE(rate_limit_us) * NSEC_PER_USEC;
+}
+
+static void sugov_update_commit(struct sugov_policy *sg_policy, u64 time,
+				unsigned int next_freq)
+{
+	sg_policy->last_freq_update_time = time;
+
+	if (sg_policy->next_freq == next_freq &&
+	    next_freq == sg_policy->policy->cur)
+		return;
+
+	sg_policy->next_freq = next_freq;
+	sg_policy->work_in_progress = true;
+	irq_work_queue(&sg_policy->irq_work);
+}
+
+/**
+ * get_next_freq - Compute a new frequency for a given cpufreq policy.
+ * @policy: cpufreq policy object to compute the new frequency for.
+ * @util: Current CPU utilization.
+ * @max: CPU capacity.
+ * @umin: Minimum utilization asked for by the queued tasks.
+ * @umax: Maximum utilization allowed to the queued tasks.
+ *
+ * @umin and @umax are fractions of @max and are applied to the maximum
+ * frequency, since a clamp asks for an absolute amount of CPU capacity.
+ * When they conflict, @umax wins.
+ */
+static unsigned int get_next_freq(struct cpufreq_policy *policy,
+				  unsigned long util, unsigned long max,
+				  unsigned long umin, unsigned long umax)
+{
+	unsigned int max_freq = policy->cpuinfo.max_freq;
+	unsigned long long freq;
+	unsigned long long fmin, fmax;
+
+	if (util >= max)
+		freq = max_freq;
+	else
+		freq = div_u64((u64)(policy->cur + (policy->cur >> 2)) * util,
+			       max);
+
+	fmin = div_u64((u64)max_freq * min(umin, max), max);
+	fmax = div_u64((u64)max_freq * min(umax, max), max);
+	freq = max(freq, fmin);
+	freq = min(freq, fmax);
+
+	return clamp_t(unsigned int, freq, policy->min, policy->max);
+}
+
+static void sugov_update_single(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct rq *rq = cpu_rq(sg_cpu->cpu);
+	unsigned int next_f;
+
+	if (!sugov_should_update_freq(sg_policy, time))
+		return;
+
+	next_f = get_next_freq(sg_policy->policy, util, max,
+			       uclamp_rq_min(rq), uclamp_rq_max(rq));
+	sugov_update_commit(sg_policy, time, next_f);
+}
+
+/*
+ * Go with the busiest CPU of the policy, skipping those whose data has not
+ * been refreshed for a tick: they are idle, or run something that does not
+ * report, and their last value is stale.
+ */
+static unsigned int sugov_next_freq_shared(struct sugov_policy *sg_policy,
+					   u64 time)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util = 0, max = 1, umin = 0, umax = 0;
+	bool clamped = false;
+	unsigned int j;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+		unsigned long j_util, j_max;
+		s64 delta_ns;
+
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > TICK_NSEC)
+			continue;
+
+		j_util = j_sg_cpu->util;
+		j_max = j_sg_cpu->max;
+		if (j_util * max > j_max * util) {
+			util = j_util;
+			max = j_max;
+		}
+
+		/* the clamps are in SCHED_CAPACITY_SCALE units on all CPUs */
+		umin = max(umin, j_sg_cpu->uclamp_min);
+		umax = max(umax, j_sg_cpu->uclamp_max);
+		clamped = true;
+	}
+
+	if (!clamped)
+		umax = SCHED_CAPACITY_SCALE;
+
+	util = min(util * SCHED_CAPACITY_SCALE / max,
+		   (unsigned long)SCHED_CAPACITY_SCALE);
+
+	return get_next_freq(policy, util, SCHED_CAPACITY_SCALE, umin, umax);
+}
+
+static void sugov_update_shared(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct rq *rq = cpu_rq(sg_cpu->cpu);
+	unsigned int next_f;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = min(util, max);
+	sg_cpu->max = max;
+	sg_cpu->uclamp_min = uclamp_rq_min(rq);
+	sg_cpu->uclamp_max = uclamp_rq_max(rq);
+	sg_cpu->last_update = time;
+
+	if (sugov_should_update_freq(sg_policy, time)) {
+		next_f = sugov_next_freq_shared(sg_policy, time);
+		sugov_update_commit(sg_policy, time, next_f);
+	}
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct work_struct *work)
+{
+	struct sugov_policy *sg_policy = container_of(work, struct sugov_policy,
+						      work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy;
+
+	sg_policy = container_of(irq_work, struct sugov_policy, irq_work);
+	schedule_work_on(smp_processor_id(), &sg_policy->work);
+}
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *kobj,
+				   struct attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	ACCESS_ONCE(rate_limit_us) = val;
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+/********************** cpufreq governor interface *********************/
+
+static int sugov_init(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	int ret = 0;
+
+	/* State should be equivalent to EXIT */
+	if (policy->governor_data)
+		return -EBUSY;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	INIT_WORK(&sg_policy->work, sugov_work);
+	mutex_init(&sg_policy->work_lock);
+	raw_spin_lock_init(&sg_policy->update_lock);
+
+	mutex_lock(&sugov_tunables_lock);
+	if (!sugov_usage_count++) {
+		WARN_ON(cpufreq_get_global_kobject());
+		ret = sysfs_create_group(cpufreq_global_kobject,
+					 &sugov_attr_group);
+		if (ret) {
+			sugov_usage_count--;
+			cpufreq_put_global_kobject();
+		}
+	}
+	mutex_unlock(&sugov_tunables_lock);
+
+	if (ret) {
+		kfree(sg_policy);
+		return ret;
+	}
+
+	policy->governor_data = sg_policy;
+	return 0;
+}
+
+static int sugov_exit(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	mutex_lock(&sugov_tunables_lock);
+	if (!--sugov_usage_count) {
+		sysfs_remove_group(cpufreq_global_kobject, &sugov_attr_group);
+		cpufreq_put_global_kobject();
+	}
+	mutex_unlock(&sugov_tunables_lock);
+
+	policy->governor_data = NULL;
+	kfree(sg_policy);
+	return 0;
+}
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	sg_policy->last_freq_update_time = 0;
+	sg_policy->next_freq = UINT_MAX;
+	sg_policy->work_in_progress = false;
+	sg_policy->need_freq_update = false;
+
+	for_each_cpu(cpu, policy->cpus) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
+
+		sg_cpu->sg_policy = sg_policy;
+		sg_cpu->cpu = cpu;
+		if (policy_is_shared(policy)) {
+			sg_cpu->util = 0;
+			sg_cpu->max = 1;
+			sg_cpu->uclamp_min = 0;
+			sg_cpu->uclamp_max = SCHED_CAPACITY_SCALE;
+			sg_cpu->last_update = 0;
+			cpufreq_add_update_util_hook(cpu, &sg_cpu->update_util,
+						     sugov_update_shared);
+		} else {
+			cpufreq_add_update_util_hook(cpu, &sg_cpu->update_util,
+						     sugov_update_single);
+		}
+	}
+	return 0;
+}
+
+static int sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, policy->cpus)
+		cpufreq_remove_update_util_hook(cpu);
+
+	synchronize_sched();
+
+	irq_work_sync(&sg_policy->irq_work);
+	cancel_work_sync(&sg_policy->work);
+	return 0;
+}
+
+static int sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	mutex_lock(&sg_policy->work_lock);
+
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->need_freq_update = true;
+	return 0;
+}
+
+static int sugov_governor(struct cpufreq_policy *policy, unsigned int event)
+{
+	if (event == CPUFREQ_GOV_POLICY_INIT)
+		return sugov_init(policy);
+
+	if (policy->governor_data) {
+		switch (event) {
+		case CPUFREQ_GOV_POLICY_EXIT:
+			return sugov_exit(policy);
+		case CPUFREQ_GOV_START:
+			return sugov_start(policy);
+		case CPUFREQ_GOV_STOP:
+			return sugov_stop(policy);
+		case CPUFREQ_GOV_LIMITS:
+			return sugov_limits(policy);
+		}
+	}
+	return -EINVAL;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name = "schedutil",
+	.governor = sugov_governor,
+	.owner = THIS_MODULE,
+};
+
+static int __init sugov_register(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+fs_initcall(sugov_register);
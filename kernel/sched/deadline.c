@@ -83,6 +83,44 @@ void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq)
 #else
 	init_dl_bw(&dl_rq->dl_bw);
 #endif
+
+	dl_rq->running_bw = 0;
+	init_dl_rq_bw_ratio(dl_rq);
+}
+
+void init_dl_rq_bw_ratio(struct dl_rq *dl_rq)
+{
+	if (global_rt_runtime() == RUNTIME_INF)
+		dl_rq->bw_ratio = 1 << RATIO_SHIFT;
+	else
+		dl_rq->bw_ratio = to_ratio(global_rt_runtime(),
+			global_rt_period()) >> (BW_SHIFT - RATIO_SHIFT);
+}
+
+/*
+ * The bandwidth of a task is accounted in running_bw of the rq it is
+ * runnable on, for as long as it stays enqueued in the -deadline class
+ * there; throttling does not count as leaving.
+ */
+static inline void add_running_bw(struct sched_dl_entity *dl_se,
+				  struct dl_rq *dl_rq)
+{
+	if (dl_se->dl_contending)
+		return;
+
+	dl_se->dl_contending = 1;
+	dl_rq->running_bw += dl_se->dl_bw;
+}
+
+static inline void sub_running_bw(struct sched_dl_entity *dl_se,
+				  struct dl_rq *dl_rq)
+{
+	if (!dl_se->dl_contending)
+		return;
+
+	dl_se->dl_contending = 0;
+	WARN_ON_ONCE(dl_rq->running_bw < dl_se->dl_bw);
+	dl_rq->running_bw -= min(dl_rq->running_bw, dl_se->dl_bw);
 }
 
 #ifdef CONFIG_SMP
@@ -597,6 +635,29 @@ int dl_runtime_exceeded(struct rq *rq, struct sched_dl_entity *dl_se)
 
 extern bool sched_rt_bandwidth_account(struct rt_rq *rt_rq);
 
+/*
+ * GRUB reclaiming: a task with SCHED_FLAG_RECLAIM depletes its runtime
+ * at the rate of the bandwidth actually used on the rq, rather than of
+ * wall time, so that it may also consume the bandwidth that the other
+ * -deadline tasks reserved and are not using:
+ *
+ *   dq = -(max{u, Uact} / Umax) dt
+ *
+ * where u is the task's own bandwidth, Uact is running_bw and Umax the
+ * maximum -deadline bandwidth, so that what is left for the other
+ * scheduling classes is never reclaimed.
+ */
+static u64 grub_reclaim(u64 delta, struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	u64 u_act = max(rq->dl.running_bw, dl_se->dl_bw);
+
+	u_act = (u_act * rq->dl.bw_ratio) >> RATIO_SHIFT;
+	if (u_act > BW_UNIT)
+		u_act = BW_UNIT;
+
+	return (delta * u_act) >> BW_SHIFT;
+}
+
 /*
  * Update the current task's runtime statistics (provided it is still
  * a -deadline task and has not been removed from the dl_rq).
@@ -605,7 +666,7 @@ static void update_curr_dl(struct rq *rq)
 {
 	struct task_struct *curr = rq->curr;
 	struct sched_dl_entity *dl_se = &curr->dl;
-	u64 delta_exec;
+	u64 delta_exec, scaled_delta_exec;
 
 	if (!dl_task(curr) || !on_dl_rq(dl_se))
 		return;
@@ -622,6 +683,9 @@ static void update_curr_dl(struct rq *rq)
 	if (unlikely((s64)delta_exec <= 0))
 		return;
 
+	/* -deadline runtimes are budgeted at the maximum frequency */
+	cpufreq_update_util(rq, ULONG_MAX, SCHED_CAPACITY_SCALE);
+
 	schedstat_set(curr->se.statistics.exec_max,
 		      max(curr->se.statistics.exec_max, delta_exec));
 
@@ -633,7 +697,11 @@ static void update_curr_dl(struct rq *rq)
 
 	sched_rt_avg_update(rq, delta_exec);
 
-	dl_se->runtime -= delta_exec;
+	scaled_delta_exec = delta_exec;
+	if (unlikely(dl_se->flags & SCHED_FLAG_RECLAIM))
+		scaled_delta_exec = grub_reclaim(delta_exec, rq, dl_se);
+
+	dl_se->runtime -= scaled_delta_exec;
 	if (dl_runtime_exceeded(rq, dl_se)) {
 		__dequeue_task_dl(rq, curr, 0);
 		if (likely(start_dl_timer(dl_se, curr->dl.dl_boosted)))
@@ -869,6 +937,8 @@ static void enqueue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 		return;
 	}
 
+	add_running_bw(&p->dl, &rq->dl);
+
 	/*
 	 * If p is throttled, we do nothing. In fact, if it exhausted
 	 * its budget it needs a replenishment and, since it now is on
@@ -894,6 +964,7 @@ static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_curr_dl(rq);
 	__dequeue_task_dl(rq, p, flags);
+	sub_running_bw(&p->dl, &rq->dl);
 }
 
 /*
@@ -1116,7 +1187,7 @@ static void task_dead_dl(struct task_struct *p)
 	 * Since we are TASK_DEAD we won't slip out of the domain!
 	 */
 	raw_spin_lock_irq(&dl_b->lock);
-	dl_b->total_bw -= p->dl.dl_bw;
+	dl_release_bw(dl_b, p);
 	raw_spin_unlock_irq(&dl_b->lock);
 
 	hrtimer_cancel(timer);
@@ -24,6 +24,7 @@
 #include <linux/sched.h>
 #include <linux/cpumask.h>
 #include <linux/cpuidle.h>
+#include <linux/energy_model.h>
 #include <linux/slab.h>
 #include <linux/profile.h>
 #include <linux/interrupt.h>
@@ -680,6 +681,7 @@ void init_task_runnable_average(struct task_struct *p)
 	slice = sched_slice(task_cfs_rq(p), &p->se) >> 10;
 	p->se.avg.runnable_avg_sum = slice;
 	p->se.avg.runnable_avg_period = slice;
+	p->se.avg.running_avg_sum = 0;
 	__update_task_entity_contrib(&p->se);
 }
 #else
@@ -884,6 +886,18 @@ struct numa_group {
 	 * more by CPU use than by memory faults.
 	 */
 	unsigned long *faults_cpu;
+
+	/*
+	 * Shared pages that would move between two nodes the group actively
+	 * uses, out of the shared faults seen, over a window.  When enough of
+	 * them would move, they are bouncing between the nodes, and
+	 * hold_shared keeps them where they are for the next window.
+	 */
+	unsigned long bounce_pages;
+	unsigned long shared_faults;
+	unsigned long bounce_window_end;
+	bool hold_shared;
+
 	unsigned long faults[0];
 };
 
@@ -1019,7 +1033,12 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	 * heavily used ones, spreading the load around.
 	 * Use a 1/4 hysteresis to avoid spurious page movement.
 	 */
-	return group_faults(p, dst_nid) < (group_faults(p, src_nid) * 3 / 4);
+	if (group_faults(p, dst_nid) >= (group_faults(p, src_nid) * 3 / 4))
+		return false;
+
+	/* counted while held too, so the hold lasts as long as the bouncing */
+	ng->bounce_pages += hpage_nr_pages(page);
+	return !ACCESS_ONCE(ng->hold_shared);
 }
 
 static unsigned long weighted_cpuload(const int cpu);
@@ -1478,6 +1497,28 @@ static void update_numa_active_node_mask(struct numa_group *numa_group)
 	}
 }
 
+/* hold shared pages once more than 1/NUMA_BOUNCE_RATIO of them would move */
+#define NUMA_BOUNCE_RATIO 8
+
+/*
+ * Called with the group lock held, once per placement of a member, with
+ * the shared faults it saw over its last scan.  The window is a scan
+ * period of the member that happens to close it.
+ */
+static void update_numa_bounce(struct numa_group *numa_group,
+			       unsigned long shared, unsigned int period)
+{
+	numa_group->shared_faults += shared;
+	if (time_before(jiffies, numa_group->bounce_window_end))
+		return;
+
+	numa_group->hold_shared = numa_group->bounce_pages * NUMA_BOUNCE_RATIO >
+				  numa_group->shared_faults;
+	numa_group->bounce_pages = 0;
+	numa_group->shared_faults = 0;
+	numa_group->bounce_window_end = jiffies + msecs_to_jiffies(period);
+}
+
 /*
  * When adapting the scan rate, the period is divided into NUMA_PERIOD_SLOTS
  * increments. The more local the fault statistics are, the higher the scan
@@ -1488,6 +1529,12 @@ static void update_numa_active_node_mask(struct numa_group *numa_group)
 #define NUMA_PERIOD_SLOTS 10
 #define NUMA_PERIOD_THRESHOLD 7
 
+/*
+ * Placement passes the preferred node must hold for a mostly local task
+ * to have its scan period doubled rather than stretched by slots.
+ */
+#define NUMA_STABLE_SCANS 3
+
 /*
  * Increase the scan period (slow down scanning) if the majority of
  * our memory is already on our local node, or if the majority of
@@ -1532,6 +1579,13 @@ static void update_task_scan_period(struct task_struct *p,
 		if (!slot)
 			slot = 1;
 		diff = slot * period_slot;
+
+		/*
+		 * Placement has settled and the memory followed: hinting
+		 * faults have little left to find, so back off quickly.
+		 */
+		if (p->numa_stable_scans >= NUMA_STABLE_SCANS)
+			diff = max_t(int, diff, p->numa_scan_period);
 	} else {
 		diff = -(NUMA_PERIOD_THRESHOLD - ratio) * period_slot;
 
@@ -1661,14 +1715,21 @@ static void task_numa_placement(struct task_struct *p)
 
 	if (p->numa_group) {
 		update_numa_active_node_mask(p->numa_group);
+		update_numa_bounce(p->numa_group, fault_types[0],
+				   p->numa_scan_period);
 		spin_unlock_irq(group_lock);
 		max_nid = max_group_nid;
 	}
 
 	if (max_faults) {
 		/* Set the new preferred node */
-		if (max_nid != p->numa_preferred_nid)
+		if (max_nid != p->numa_preferred_nid) {
 			sched_setnuma(p, max_nid);
+			p->numa_stable_scans = 0;
+		} else if (task_node(p) == max_nid &&
+			   p->numa_stable_scans < NUMA_STABLE_SCANS) {
+			p->numa_stable_scans++;
+		}
 
 		if (task_node(p) != p->numa_preferred_nid)
 			numa_migrate_preferred(p);
@@ -1904,6 +1965,40 @@ void task_numa_fault(int last_cpupid, int mem_node, int pages, int flags)
 	p->numa_faults_locality[local] += pages;
 }
 
+/*
+ * A VMA whose hinting faults since its last scan were all local, and
+ * numerous enough to tell, sits out the next passes, twice as many each
+ * time it is found local again.  A single remote fault resets that.
+ */
+#define NUMA_VMA_MIN_FAULTS	16
+#define NUMA_VMA_MAX_SKIP	16
+
+static bool vma_numa_skip(struct vm_area_struct *vma)
+{
+	unsigned int remote = vma->numab_faults[0];
+	unsigned int local = vma->numab_faults[1];
+
+	if (vma->numab_skip) {
+		vma->numab_skip--;
+		return true;
+	}
+
+	vma->numab_faults[0] = 0;
+	vma->numab_faults[1] = 0;
+
+	if (remote) {
+		vma->numab_backoff = 0;
+		return false;
+	}
+	if (local < NUMA_VMA_MIN_FAULTS)
+		return false;
+
+	vma->numab_backoff = clamp(vma->numab_backoff * 2, 1U,
+				   (unsigned int)NUMA_VMA_MAX_SKIP);
+	vma->numab_skip = vma->numab_backoff - 1;
+	return true;
+}
+
 static void reset_ptenuma_scan(struct task_struct *p)
 {
 	ACCESS_ONCE(p->mm->numa_scan_seq)++;
@@ -1999,6 +2094,10 @@ void task_numa_work(struct callback_head *work)
 		if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
 			continue;
 
+		/* judged once per pass, when the scan gets to its start */
+		if (start <= vma->vm_start && vma_numa_skip(vma))
+			continue;
+
 		do {
 			start = max(start, vma->vm_start);
 			end = ALIGN(start + (pages << PAGE_SHIFT), HPAGE_SIZE);
@@ -2197,6 +2296,27 @@ static inline void update_cfs_shares(struct cfs_rq *cfs_rq)
 }
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
+/*
+ * Only the root cfs_rq describes how busy the CPU is; a group cfs_rq feeds
+ * into it through its group entity.  Without PELT on UP there is no
+ * utilization to report, so ask for the maximum frequency instead.
+ */
+static inline void cfs_rq_util_change(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+
+	if (&rq->cfs != cfs_rq)
+		return;
+#ifdef CONFIG_SMP
+	cpufreq_update_util(rq, min_t(unsigned long,
+				      cfs_rq->utilization_load_avg,
+				      SCHED_CAPACITY_SCALE),
+			    SCHED_CAPACITY_SCALE);
+#else
+	cpufreq_update_util(rq, ULONG_MAX, SCHED_CAPACITY_SCALE);
+#endif
+}
+
 #ifdef CONFIG_SMP
 /*
  * We choose a half-life close to 1 scheduling period.
@@ -2317,7 +2437,8 @@ static u32 __compute_runnable_contrib(u64 n)
  */
 static __always_inline int __update_entity_runnable_avg(u64 now,
 							struct sched_avg *sa,
-							int runnable)
+							int runnable,
+							int running)
 {
 	u64 delta, periods;
 	u32 runnable_contrib;
@@ -2356,6 +2477,8 @@ static __always_inline int __update_entity_runnable_avg(u64 now,
 		delta_w = 1024 - delta_w;
 		if (runnable)
 			sa->runnable_avg_sum += delta_w;
+		if (running)
+			sa->running_avg_sum += delta_w;
 		sa->runnable_avg_period += delta_w;
 
 		delta -= delta_w;
@@ -2366,6 +2489,8 @@ static __always_inline int __update_entity_runnable_avg(u64 now,
 
 		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
 						  periods + 1);
+		sa->running_avg_sum = decay_load(sa->running_avg_sum,
+						  periods + 1);
 		sa->runnable_avg_period = decay_load(sa->runnable_avg_period,
 						     periods + 1);
 
@@ -2373,12 +2498,16 @@ static __always_inline int __update_entity_runnable_avg(u64 now,
 		runnable_contrib = __compute_runnable_contrib(periods);
 		if (runnable)
 			sa->runnable_avg_sum += runnable_contrib;
+		if (running)
+			sa->running_avg_sum += runnable_contrib;
 		sa->runnable_avg_period += runnable_contrib;
 	}
 
 	/* Remainder of delta accrued against u_0` */
 	if (runnable)
 		sa->runnable_avg_sum += delta;
+	if (running)
+		sa->running_avg_sum += delta;
 	sa->runnable_avg_period += delta;
 
 	return decayed;
@@ -2395,6 +2524,8 @@ static inline u64 __synchronize_entity_decay(struct sched_entity *se)
 		return 0;
 
 	se->avg.load_avg_contrib = decay_load(se->avg.load_avg_contrib, decays);
+	se->avg.utilization_avg_contrib =
+		decay_load(se->avg.utilization_avg_contrib, decays);
 	se->avg.decay_count = 0;
 
 	return decays;
@@ -2484,7 +2615,8 @@ static inline void __update_group_entity_contrib(struct sched_entity *se)
 
 static inline void update_rq_runnable_avg(struct rq *rq, int runnable)
 {
-	__update_entity_runnable_avg(rq_clock_task(rq), &rq->avg, runnable);
+	__update_entity_runnable_avg(rq_clock_task(rq), &rq->avg, runnable,
+				     runnable);
 	__update_tg_runnable_avg(&rq->avg, &rq->cfs);
 }
 #else /* CONFIG_FAIR_GROUP_SCHED */
@@ -2521,6 +2653,34 @@ static long __update_entity_load_avg_contrib(struct sched_entity *se)
 	return se->avg.load_avg_contrib - old_contrib;
 }
 
+static inline void __update_task_entity_utilization(struct sched_entity *se)
+{
+	u32 contrib;
+
+	/* running_avg_sum <= LOAD_AVG_MAX, so this fits in 32 bits */
+	contrib = se->avg.running_avg_sum * SCHED_CAPACITY_SCALE;
+	contrib /= (se->avg.runnable_avg_period + 1);
+	se->avg.utilization_avg_contrib = contrib;
+}
+
+/*
+ * Compute the current contribution to utilization_load_avg by se, return
+ * any delta.  A group entity is running whenever one of its children is,
+ * so it simply mirrors the utilization of the cfs_rq it owns.
+ */
+static long __update_entity_utilization_avg_contrib(struct sched_entity *se)
+{
+	long old_contrib = se->avg.utilization_avg_contrib;
+
+	if (entity_is_task(se))
+		__update_task_entity_utilization(se);
+	else
+		se->avg.utilization_avg_contrib =
+			group_cfs_rq(se)->utilization_load_avg;
+
+	return se->avg.utilization_avg_contrib - old_contrib;
+}
+
 static inline void subtract_blocked_load_contrib(struct cfs_rq *cfs_rq,
 						 long load_contrib)
 {
@@ -2537,7 +2697,7 @@ static inline void update_entity_load_avg(struct sched_entity *se,
 					  int update_cfs_rq)
 {
 	struct cfs_rq *cfs_rq = cfs_rq_of(se);
-	long contrib_delta;
+	long contrib_delta, utilization_delta;
 	u64 now;
 
 	/*
@@ -2549,18 +2709,24 @@ static inline void update_entity_load_avg(struct sched_entity *se,
 	else
 		now = cfs_rq_clock_task(group_cfs_rq(se));
 
-	if (!__update_entity_runnable_avg(now, &se->avg, se->on_rq))
+	if (!__update_entity_runnable_avg(now, &se->avg, se->on_rq,
+					  cfs_rq->curr == se))
 		return;
 
 	contrib_delta = __update_entity_load_avg_contrib(se);
+	utilization_delta = __update_entity_utilization_avg_contrib(se);
 
 	if (!update_cfs_rq)
 		return;
 
-	if (se->on_rq)
+	if (se->on_rq) {
 		cfs_rq->runnable_load_avg += contrib_delta;
-	else
+		cfs_rq->utilization_load_avg += utilization_delta;
+		if (utilization_delta)
+			cfs_rq_util_change(cfs_rq);
+	} else {
 		subtract_blocked_load_contrib(cfs_rq, -contrib_delta);
+	}
 }
 
 /*
@@ -2635,8 +2801,10 @@ static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
 	}
 
 	cfs_rq->runnable_load_avg += se->avg.load_avg_contrib;
+	cfs_rq->utilization_load_avg += se->avg.utilization_avg_contrib;
 	/* we force update consideration on load-balancer moves */
 	update_cfs_rq_blocked_load(cfs_rq, !wakeup);
+	cfs_rq_util_change(cfs_rq);
 }
 
 /*
@@ -2653,6 +2821,8 @@ static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
 	update_cfs_rq_blocked_load(cfs_rq, !sleep);
 
 	cfs_rq->runnable_load_avg -= se->avg.load_avg_contrib;
+	cfs_rq->utilization_load_avg -= se->avg.utilization_avg_contrib;
+	cfs_rq_util_change(cfs_rq);
 	if (sleep) {
 		cfs_rq->blocked_load_avg += se->avg.load_avg_contrib;
 		se->avg.decay_count = atomic64_read(&cfs_rq->decay_counter);
@@ -2684,7 +2854,11 @@ static int idle_balance(struct rq *this_rq);
 #else /* CONFIG_SMP */
 
 static inline void update_entity_load_avg(struct sched_entity *se,
-					  int update_cfs_rq) {}
+					  int update_cfs_rq)
+{
+	if (update_cfs_rq)
+		cfs_rq_util_change(cfs_rq_of(se));
+}
 static inline void update_rq_runnable_avg(struct rq *rq, int runnable) {}
 static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
 					   struct sched_entity *se,
@@ -2990,6 +3164,8 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 */
 		update_stats_wait_end(cfs_rq, se);
 		__dequeue_entity(cfs_rq, se);
+		/* close the waiting period before se starts running */
+		update_entity_load_avg(se, 1);
 	}
 
 	update_stats_curr_start(cfs_rq, se);
@@ -3958,6 +4134,94 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_SMP
+/*
+ * The margin used when comparing utilization with CPU capacity:
+ * util * margin < capacity * 1024
+ *
+ * (default: ~20%)
+ */
+static unsigned int capacity_margin = 1280;
+
+static inline unsigned long capacity_orig_of(int cpu)
+{
+	return cpu_rq(cpu)->cpu_capacity_orig;
+}
+
+/*
+ * task_util: the utilization of @p on the CPU it last ran on.
+ *
+ * utilization_avg_contrib is the fraction of time @p has been running,
+ * in SCHED_CAPACITY_SCALE units, and is not invariant with respect to the
+ * CPU micro-architecture. Scale it by the capacity of the CPU it was
+ * measured on so that it can be compared against other CPUs.
+ */
+static inline unsigned long task_util(struct task_struct *p)
+{
+	return (p->se.avg.utilization_avg_contrib *
+		capacity_orig_of(task_cpu(p))) >> SCHED_CAPACITY_SHIFT;
+}
+
+/*
+ * cpu_util: the utilization of the CFS tasks queued on @cpu, in the same
+ * units as task_util() and capped to the original capacity of the CPU.
+ *
+ * The utilization of a sleeping task is not accounted for: it only comes
+ * back with the task, which is what the wakeup path needs anyway.
+ */
+static inline unsigned long cpu_util(int cpu)
+{
+	unsigned long util = cpu_rq(cpu)->cfs.utilization_load_avg;
+	unsigned long capacity = capacity_orig_of(cpu);
+
+	util = min_t(unsigned long, util, SCHED_CAPACITY_SCALE);
+
+	return (util * capacity) >> SCHED_CAPACITY_SHIFT;
+}
+
+static inline bool util_fits_capacity(unsigned long util, unsigned long capacity)
+{
+	return capacity * 1024 > util * capacity_margin;
+}
+
+static inline bool task_fits_capacity(struct task_struct *p, long capacity)
+{
+	return util_fits_capacity(task_util(p), capacity);
+}
+
+static inline bool cpu_overutilized(int cpu)
+{
+	return (cpu_rq(cpu)->cpu_capacity * 1024) < (cpu_util(cpu) * capacity_margin);
+}
+
+static inline void update_overutilized_status(struct rq *rq)
+{
+	if (!rq->rd->overutilized && cpu_overutilized(cpu_of(rq)))
+		rq->rd->overutilized = true;
+}
+
+static inline void update_misfit_status(struct task_struct *p, struct rq *rq)
+{
+	if (!static_key_false(&sched_asym_cpucapacity))
+		return;
+
+	if (!p) {
+		rq->misfit_task_load = 0;
+		return;
+	}
+
+	if (task_fits_capacity(p, rq->cpu_capacity)) {
+		rq->misfit_task_load = 0;
+		return;
+	}
+
+	rq->misfit_task_load = task_h_load(p);
+}
+#else
+static inline void update_overutilized_status(struct rq *rq) { }
+static inline void update_misfit_status(struct task_struct *p, struct rq *rq) { }
+#endif
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -3968,6 +4232,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 {
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
+	int task_new = !(flags & ENQUEUE_WAKEUP);
 
 	for_each_sched_entity(se) {
 		if (se->on_rq)
@@ -4002,6 +4267,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se) {
 		update_rq_runnable_avg(rq, rq->nr_running);
 		add_nr_running(rq, 1);
+		if (!task_new)
+			update_overutilized_status(rq);
 	}
 	hrtick_update(rq);
 }
@@ -4481,13 +4748,190 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return shallowest_idle_cpu != -1 ? shallowest_idle_cpu : least_loaded_cpu;
 }
 
+#ifdef CONFIG_SCHED_SMT
+
+/* borrowed from load_balance(); wakeups run with interrupts disabled */
+DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
+
+static inline void set_idle_cores(int cpu, int val)
+{
+	struct sched_domain_shared *sds;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds)
+		ACCESS_ONCE(sds->has_idle_cores) = val;
+}
+
+static inline bool test_idle_cores(int cpu, bool def)
+{
+	struct sched_domain_shared *sds;
+
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds)
+		return ACCESS_ONCE(sds->has_idle_cores);
+
+	return def;
+}
+
+/*
+ * Called when @rq goes idle: scan the local SMT mask to see if the entire
+ * core is idle now, and record this in sd_llc_shared->has_idle_cores.
+ *
+ * Since SMT siblings share all cache levels, inspecting this limited remote
+ * state should be fairly cheap.
+ */
+void update_idle_core(struct rq *rq)
+{
+	int core = cpu_of(rq);
+	int cpu;
+
+	rcu_read_lock();
+	if (test_idle_cores(core, true))
+		goto unlock;
+
+	for_each_cpu(cpu, cpu_smt_mask(core)) {
+		if (cpu == core)
+			continue;
+
+		if (!idle_cpu(cpu))
+			goto unlock;
+	}
+
+	set_idle_cores(core, 1);
+unlock:
+	rcu_read_unlock();
+}
+
 /*
- * Try and locate an idle CPU in the sched_domain.
+ * Scan the entire LLC domain for idle cores; this dynamically switches off if
+ * there are no idle cores left in the system; tracked through
+ * sd_llc->shared->has_idle_cores and enabled through update_idle_core() above.
+ */
+static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(load_balance_mask);
+	int core, cpu;
+
+	if (!test_idle_cores(target, false))
+		return -1;
+
+	cpumask_and(cpus, sched_domain_span(sd), tsk_cpus_allowed(p));
+
+	for_each_cpu_wrap(core, cpus, target) {
+		bool idle = true;
+
+		for_each_cpu(cpu, cpu_smt_mask(core)) {
+			cpumask_clear_cpu(cpu, cpus);
+			if (!idle_cpu(cpu))
+				idle = false;
+		}
+
+		if (idle)
+			return core;
+	}
+
+	/*
+	 * Failed to find an idle core; stop looking for one.
+	 */
+	set_idle_cores(target, 0);
+
+	return -1;
+}
+
+/*
+ * Scan the local SMT mask for idle CPUs.
+ */
+static int select_idle_smt(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	int cpu;
+
+	for_each_cpu(cpu, cpu_smt_mask(target)) {
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
+#else /* CONFIG_SCHED_SMT */
+
+static inline int select_idle_core(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	return -1;
+}
+
+static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	return -1;
+}
+
+#endif /* CONFIG_SCHED_SMT */
+
+/*
+ * Scan the LLC domain for idle CPUs; the number of CPUs looked at is
+ * bounded by comparing the average scan cost (tracked in
+ * sd->avg_scan_cost) against the average idle time of this rq (as found
+ * in rq->avg_idle): a CPU that is only briefly idle cannot afford to
+ * spend long searching for another one.
+ */
+static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	struct sched_domain *this_sd;
+	u64 avg_cost, avg_idle;
+	u64 time, cost;
+	s64 delta;
+	int cpu, nr = INT_MAX;
+
+	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
+	if (!this_sd)
+		return -1;
+
+	if (sched_feat(SIS_PROP)) {
+		u64 span_avg;
+
+		/*
+		 * Due to large variance we need a large fuzz factor;
+		 * hackbench in particularly is sensitive here.
+		 */
+		avg_idle = this_rq()->avg_idle / 512;
+		avg_cost = this_sd->avg_scan_cost + 1;
+
+		span_avg = sd->span_weight * avg_idle;
+		if (span_avg > 4*avg_cost)
+			nr = div_u64(span_avg, avg_cost);
+		else
+			nr = 4;
+	}
+
+	time = local_clock();
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!--nr)
+			return -1;
+		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
+			continue;
+		if (idle_cpu(cpu))
+			break;
+	}
+
+	time = local_clock() - time;
+	cost = this_sd->avg_scan_cost;
+	delta = (s64)(time - cost) / 8;
+	this_sd->avg_scan_cost += delta;
+
+	return cpu;
+}
+
+/*
+ * Try and locate an idle core/thread in the LLC cache domain: a fully
+ * idle core first, then any idle CPU within the scan budget, and then
+ * an idle SMT sibling of @target.
  */
 static int select_idle_sibling(struct task_struct *p, int target)
 {
 	struct sched_domain *sd;
-	struct sched_group *sg;
 	int i = task_cpu(p);
 
 	if (idle_cpu(target))
@@ -4499,32 +4943,202 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	if (i != target && cpus_share_cache(i, target) && idle_cpu(i))
 		return i;
 
+	sd = rcu_dereference(per_cpu(sd_llc, target));
+	if (!sd)
+		return target;
+
+	i = select_idle_core(p, sd, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
+
+	i = select_idle_cpu(p, sd, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
+
+	i = select_idle_smt(p, sd, target);
+	if ((unsigned)i < nr_cpu_ids)
+		return i;
+
+	return target;
+}
+
+#ifdef CONFIG_ENERGY_MODEL
+/*
+ * compute_energy(): Estimates the energy that the CPUs of @sd would consume
+ * if @p was enqueued on @dst_cpu.
+ *
+ * @p is waking up, so its utilization is in none of the cpu_util() sums
+ * and only has to be added to @dst_cpu.
+ */
+static unsigned long
+compute_energy(struct task_struct *p, int dst_cpu, struct sched_domain *sd)
+{
+	unsigned long max_util, sum_util, util, energy = 0;
+	struct em_perf_domain *pd;
+	int cpu, i;
+
+	for_each_cpu_and(cpu, sched_domain_span(sd), cpu_online_mask) {
+		pd = em_cpu_get(cpu);
+
+		/* Account each performance domain once, from its first cpu */
+		if (cpu != cpumask_first_and(to_cpumask(pd->cpus),
+					     cpu_online_mask))
+			continue;
+
+		max_util = sum_util = 0;
+		for_each_cpu_and(i, to_cpumask(pd->cpus), cpu_online_mask) {
+			util = cpu_util(i);
+			if (i == dst_cpu)
+				util += task_util(p);
+			util = min(util, capacity_orig_of(i));
+
+			sum_util += util;
+			max_util = max(max_util, util);
+		}
+
+		energy += em_pd_energy(pd, max_util, sum_util);
+	}
+
+	return energy;
+}
+
+/*
+ * find_energy_efficient_cpu(): Find the most energy-efficient target CPU for
+ * the waking task. find_energy_efficient_cpu() looks for the CPU with maximum
+ * spare capacity in each performance domain and uses it as a potential
+ * candidate to execute the task. Then, it uses the Energy Model to figure
+ * out which of the CPU candidates is the most energy-efficient.
+ *
+ * The rationale for this heuristic is as follows. In a performance domain,
+ * all the most energy efficient CPU candidates (according to the Energy
+ * Model) are those for which we'll request a low frequency. When there are
+ * several CPUs for which the frequency request will be the same, we don't
+ * have enough data to break the tie between them, because the Energy Model
+ * only includes active power costs. With this model, if we assume that
+ * frequency requests follow utilization (e.g. using schedutil), the CPU with
+ * the maximum spare capacity in a performance domain is guaranteed to be among
+ * the best candidates of the performance domain.
+ *
+ * Energy-aware wake-up only makes sense on asymmetric CPU capacity systems
+ * with an Energy Model for all the CPUs, and can only be trusted while no CPU
+ * is over-utilized: past the tipping point, utilization stops reflecting how
+ * much capacity the tasks actually need and load balancing takes over.
+ *
+ * Returns the target CPU, or -1 to fall back to the usual wake-up path.
+ */
+static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu)
+{
+	unsigned long prev_energy = ULONG_MAX, best_energy = ULONG_MAX;
+	unsigned long cpu_cap, util, spare, max_spare;
+	int cpu, i, best_energy_cpu = -1, max_spare_cpu;
+	struct root_domain *rd = cpu_rq(smp_processor_id())->rd;
+	struct em_perf_domain *pd;
+	struct sched_domain *sd;
+	unsigned long energy;
+
+	if (!sched_feat(ENERGY_AWARE) ||
+	    !static_key_false(&sched_asym_cpucapacity))
+		return -1;
+
+	if (ACCESS_ONCE(rd->overutilized))
+		return -1;
+
+	rcu_read_lock();
 	/*
-	 * Otherwise, iterate the domains and find an elegible idle cpu.
+	 * Energy-aware wake-up happens on the lowest sched_domain starting
+	 * from sd_asym_cpucapacity spanning over this_cpu and prev_cpu.
 	 */
-	sd = rcu_dereference(per_cpu(sd_llc, target));
-	for_each_lower_domain(sd) {
-		sg = sd->groups;
-		do {
-			if (!cpumask_intersects(sched_group_cpus(sg),
-						tsk_cpus_allowed(p)))
-				goto next;
+	sd = rcu_dereference(*this_cpu_ptr(&sd_asym_cpucapacity));
+	while (sd && !cpumask_test_cpu(prev_cpu, sched_domain_span(sd)))
+		sd = sd->parent;
+	if (!sd)
+		goto fail;
+
+	for_each_cpu_and(cpu, sched_domain_span(sd), cpu_online_mask) {
+		if (!em_cpu_get(cpu))
+			goto fail;
+	}
+
+	/* Nothing to place: stay where the task's cache is. */
+	if (!task_util(p)) {
+		rcu_read_unlock();
+		return prev_cpu;
+	}
+
+	for_each_cpu_and(cpu, sched_domain_span(sd), cpu_online_mask) {
+		pd = em_cpu_get(cpu);
+		if (cpu != cpumask_first_and(to_cpumask(pd->cpus),
+					     cpu_online_mask))
+			continue;
+
+		max_spare = 0;
+		max_spare_cpu = -1;
+
+		for_each_cpu_and(i, to_cpumask(pd->cpus), cpu_online_mask) {
+			if (!cpumask_test_cpu(i, tsk_cpus_allowed(p)))
+				continue;
+
+			/* Skip CPUs that will be overutilized. */
+			util = cpu_util(i) + task_util(p);
+			cpu_cap = capacity_of(i);
+			if (!util_fits_capacity(util, cpu_cap))
+				continue;
 
-			for_each_cpu(i, sched_group_cpus(sg)) {
-				if (i == target || !idle_cpu(i))
-					goto next;
+			/* Always use prev_cpu as a candidate. */
+			if (i == prev_cpu) {
+				prev_energy = compute_energy(p, prev_cpu, sd);
+				if (prev_energy < best_energy) {
+					best_energy = prev_energy;
+					best_energy_cpu = prev_cpu;
+				}
+				continue;
 			}
 
-			target = cpumask_first_and(sched_group_cpus(sg),
-					tsk_cpus_allowed(p));
-			goto done;
-next:
-			sg = sg->next;
-		} while (sg != sd->groups);
+			/*
+			 * Find the CPU with the maximum spare capacity in
+			 * the performance domain
+			 */
+			spare = cpu_cap - util;
+			if (spare > max_spare) {
+				max_spare = spare;
+				max_spare_cpu = i;
+			}
+		}
+
+		/* Evaluate the energy impact of using this CPU. */
+		if (max_spare_cpu >= 0) {
+			energy = compute_energy(p, max_spare_cpu, sd);
+			if (energy < best_energy) {
+				best_energy = energy;
+				best_energy_cpu = max_spare_cpu;
+			}
+		}
 	}
-done:
-	return target;
+	rcu_read_unlock();
+
+	/*
+	 * Pick the best CPU if prev_cpu cannot be used, or if it saves at
+	 * least 6% of the energy used by prev_cpu.
+	 */
+	if (prev_energy == ULONG_MAX)
+		return best_energy_cpu;
+
+	if ((prev_energy - best_energy) > (prev_energy >> 4))
+		return best_energy_cpu;
+
+	return prev_cpu;
+
+fail:
+	rcu_read_unlock();
+
+	return -1;
+}
+#else
+static inline int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu)
+{
+	return -1;
 }
+#endif
 
 /*
  * select_task_rq_fair: Select target runqueue for the waking task in domains
@@ -4550,8 +5164,14 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 	if (p->nr_cpus_allowed == 1)
 		return prev_cpu;
 
-	if (sd_flag & SD_BALANCE_WAKE)
+	if (sd_flag & SD_BALANCE_WAKE) {
+		new_cpu = find_energy_efficient_cpu(p, prev_cpu);
+		if (new_cpu >= 0)
+			return new_cpu;
+		new_cpu = cpu;
+
 		want_affine = cpumask_test_cpu(cpu, tsk_cpus_allowed(p));
+	}
 
 	rcu_read_lock();
 	for_each_domain(cpu, tmp) {
@@ -4890,6 +5510,8 @@ again:
 	if (hrtick_enabled(rq))
 		hrtick_start_fair(rq, p);
 
+	update_misfit_status(p, rq);
+
 	return p;
 simple:
 	cfs_rq = &rq->cfs;
@@ -4911,9 +5533,13 @@ simple:
 	if (hrtick_enabled(rq))
 		hrtick_start_fair(rq, p);
 
+	update_misfit_status(p, rq);
+
 	return p;
 
 idle:
+	update_misfit_status(NULL, rq);
+
 	new_tasks = idle_balance(rq);
 	/*
 	 * Because idle_balance() releases (and re-acquires) rq->lock, it is
@@ -5123,6 +5749,13 @@ enum fbq_type { regular, remote, all };
 #define LBF_DST_PINNED  0x04
 #define LBF_SOME_PINNED	0x08
 
+enum group_type {
+	group_other = 0,
+	group_misfit_task,
+	group_imbalanced,
+	group_overloaded,
+};
+
 struct lb_env {
 	struct sched_domain	*sd;
 
@@ -5146,6 +5779,7 @@ struct lb_env {
 	unsigned int		loop_max;
 
 	enum fbq_type		fbq_type;
+	enum group_type		src_grp_type;
 	struct list_head	tasks;
 };
 
@@ -5639,12 +6273,6 @@ static unsigned long task_h_load(struct task_struct *p)
 
 /********** Helpers for find_busiest_group ************************/
 
-enum group_type {
-	group_other = 0,
-	group_imbalanced,
-	group_overloaded,
-};
-
 /*
  * sg_lb_stats - stats of a sched_group required for load_balancing
  */
@@ -5660,6 +6288,8 @@ struct sg_lb_stats {
 	unsigned int group_weight;
 	enum group_type group_type;
 	int group_has_free_capacity;
+	/* A cpu has a task too big for its capacity */
+	unsigned long group_misfit_task_load;
 #ifdef CONFIG_NUMA_BALANCING
 	unsigned int nr_numa_running;
 	unsigned int nr_preferred_running;
@@ -5742,7 +6372,7 @@ unsigned long __weak arch_scale_freq_capacity(struct sched_domain *sd, int cpu)
 
 static unsigned long default_scale_cpu_capacity(struct sched_domain *sd, int cpu)
 {
-	if ((sd->flags & SD_SHARE_CPUCAPACITY) && (sd->span_weight > 1))
+	if (sd && (sd->flags & SD_SHARE_CPUCAPACITY) && (sd->span_weight > 1))
 		return sd->smt_gain / sd->span_weight;
 
 	return SCHED_CAPACITY_SCALE;
@@ -5799,6 +6429,7 @@ static void update_cpu_capacity(struct sched_domain *sd, int cpu)
 
 	capacity >>= SCHED_CAPACITY_SHIFT;
 
+	cpu_rq(cpu)->cpu_capacity_orig = capacity;
 	sdg->sgc->capacity_orig = capacity;
 
 	if (sched_feat(ARCH_CAPACITY))
@@ -5816,13 +6447,14 @@ static void update_cpu_capacity(struct sched_domain *sd, int cpu)
 
 	cpu_rq(cpu)->cpu_capacity = capacity;
 	sdg->sgc->capacity = capacity;
+	sdg->sgc->max_capacity = capacity;
 }
 
 void update_group_capacity(struct sched_domain *sd, int cpu)
 {
 	struct sched_domain *child = sd->child;
 	struct sched_group *group, *sdg = sd->groups;
-	unsigned long capacity, capacity_orig;
+	unsigned long capacity, capacity_orig, max_capacity;
 	unsigned long interval;
 
 	interval = msecs_to_jiffies(sd->balance_interval);
@@ -5834,7 +6466,7 @@ void update_group_capacity(struct sched_domain *sd, int cpu)
 		return;
 	}
 
-	capacity_orig = capacity = 0;
+	capacity_orig = capacity = max_capacity = 0;
 
 	if (child->flags & SD_OVERLAP) {
 		/*
@@ -5862,12 +6494,14 @@ void update_group_capacity(struct sched_domain *sd, int cpu)
 			if (unlikely(!rq->sd)) {
 				capacity_orig += capacity_of(cpu);
 				capacity += capacity_of(cpu);
+				max_capacity = max(capacity_of(cpu), max_capacity);
 				continue;
 			}
 
 			sgc = rq->sd->groups->sgc;
 			capacity_orig += sgc->capacity_orig;
 			capacity += sgc->capacity;
+			max_capacity = max(sgc->max_capacity, max_capacity);
 		}
 	} else  {
 		/*
@@ -5879,12 +6513,14 @@ void update_group_capacity(struct sched_domain *sd, int cpu)
 		do {
 			capacity_orig += group->sgc->capacity_orig;
 			capacity += group->sgc->capacity;
+			max_capacity = max(group->sgc->max_capacity, max_capacity);
 			group = group->next;
 		} while (group != child->groups);
 	}
 
 	sdg->sgc->capacity_orig = capacity_orig;
 	sdg->sgc->capacity = capacity;
+	sdg->sgc->max_capacity = max_capacity;
 }
 
 /*
@@ -5983,6 +6619,9 @@ group_classify(struct sched_group *group, struct sg_lb_stats *sgs)
 	if (sg_imbalanced(group))
 		return group_imbalanced;
 
+	if (sgs->group_misfit_task_load)
+		return group_misfit_task;
+
 	return group_other;
 }
 
@@ -5994,11 +6633,12 @@ group_classify(struct sched_group *group, struct sg_lb_stats *sgs)
  * @local_group: Does group contain this_cpu.
  * @sgs: variable to hold the statistics for this group.
  * @overload: Indicate more than one runnable task for any CPU.
+ * @overutilized: Indicate overutilization for any CPU.
  */
 static inline void update_sg_lb_stats(struct lb_env *env,
 			struct sched_group *group, int load_idx,
 			int local_group, struct sg_lb_stats *sgs,
-			bool *overload)
+			bool *overload, bool *overutilized)
 {
 	unsigned long load;
 	int i;
@@ -6027,6 +6667,15 @@ static inline void update_sg_lb_stats(struct lb_env *env,
 		sgs->sum_weighted_load += weighted_cpuload(i);
 		if (idle_cpu(i))
 			sgs->idle_cpus++;
+
+		if (env->sd->flags & SD_ASYM_CPUCAPACITY &&
+		    sgs->group_misfit_task_load < rq->misfit_task_load) {
+			sgs->group_misfit_task_load = rq->misfit_task_load;
+			*overload = true;
+		}
+
+		if (cpu_overutilized(i))
+			*overutilized = true;
 	}
 
 	/* Adjust by relative CPU capacity of the group */
@@ -6044,6 +6693,17 @@ static inline void update_sg_lb_stats(struct lb_env *env,
 		sgs->group_has_free_capacity = 1;
 }
 
+/*
+ * group_smaller_cpu_capacity: Returns true if sched_group sg has smaller
+ * per-CPU capacity than sched_group ref.
+ */
+static inline bool
+group_smaller_cpu_capacity(struct sched_group *sg, struct sched_group *ref)
+{
+	return sg->sgc->max_capacity * capacity_margin <
+						ref->sgc->max_capacity * 1024;
+}
+
 /**
  * update_sd_pick_busiest - return 1 on busiest group
  * @env: The load balancing environment.
@@ -6064,12 +6724,26 @@ static bool update_sd_pick_busiest(struct lb_env *env,
 {
 	struct sg_lb_stats *busiest = &sds->busiest_stat;
 
+	/*
+	 * Don't try to pull misfit tasks we can't help: only a group of
+	 * bigger cpus with some room left can take them.
+	 */
+	if (sgs->group_type == group_misfit_task &&
+	    (!sds->local || !group_smaller_cpu_capacity(sg, sds->local) ||
+	     !sds->local_stat.group_has_free_capacity))
+		return false;
+
 	if (sgs->group_type > busiest->group_type)
 		return true;
 
 	if (sgs->group_type < busiest->group_type)
 		return false;
 
+	/* If we have more than one misfit group go with the biggest misfit. */
+	if (sgs->group_type == group_misfit_task)
+		return sgs->group_misfit_task_load >
+			busiest->group_misfit_task_load;
+
 	if (sgs->avg_load <= busiest->avg_load)
 		return false;
 
@@ -6134,7 +6808,7 @@ static inline void update_sd_lb_stats(struct lb_env *env, struct sd_lb_stats *sd
 	struct sched_group *sg = env->sd->groups;
 	struct sg_lb_stats tmp_sgs;
 	int load_idx, prefer_sibling = 0;
-	bool overload = false;
+	bool overload = false, overutilized = false;
 
 	if (child && child->flags & SD_PREFER_SIBLING)
 		prefer_sibling = 1;
@@ -6156,7 +6830,7 @@ static inline void update_sd_lb_stats(struct lb_env *env, struct sd_lb_stats *sd
 		}
 
 		update_sg_lb_stats(env, sg, load_idx, local_group, sgs,
-						&overload);
+						&overload, &overutilized);
 
 		if (local_group)
 			goto next_group;
@@ -6195,8 +6869,13 @@ next_group:
 		/* update overload indicator if we are at root domain */
 		if (env->dst_rq->rd->overload != overload)
 			env->dst_rq->rd->overload = overload;
-	}
 
+		/* Update the over-utilization indicator */
+		if (env->dst_rq->rd->overutilized != overutilized)
+			env->dst_rq->rd->overutilized = overutilized;
+	} else if (overutilized && !env->dst_rq->rd->overutilized) {
+		env->dst_rq->rd->overutilized = true;
+	}
 }
 
 /**
@@ -6327,6 +7006,12 @@ static inline void calculate_imbalance(struct lb_env *env, struct sd_lb_stats *s
 	local = &sds->local_stat;
 	busiest = &sds->busiest_stat;
 
+	/* Pull the misfit task, whatever the average load says */
+	if (busiest->group_type == group_misfit_task) {
+		env->imbalance = busiest->group_misfit_task_load;
+		return;
+	}
+
 	if (busiest->group_type == group_imbalanced) {
 		/*
 		 * In the group_imb case we cannot rely on group-wide averages
@@ -6419,6 +7104,15 @@ static struct sched_group *find_busiest_group(struct lb_env *env)
 	local = &sds.local_stat;
 	busiest = &sds.busiest_stat;
 
+	/*
+	 * When the energy-aware wake-up path is in charge, leave the task
+	 * placement alone until some cpu gets over-utilized.
+	 */
+	if (sched_feat(ENERGY_AWARE) &&
+	    static_key_false(&sched_asym_cpucapacity) &&
+	    em_cpu_get(env->dst_cpu) && !env->dst_rq->rd->overutilized)
+		goto out_balanced;
+
 	if ((env->idle == CPU_IDLE || env->idle == CPU_NEWLY_IDLE) &&
 	    check_asym_packing(env, &sds))
 		return sds.busiest;
@@ -6430,6 +7124,10 @@ static struct sched_group *find_busiest_group(struct lb_env *env)
 	sds.avg_load = (SCHED_CAPACITY_SCALE * sds.total_load)
 						/ sds.total_capacity;
 
+	/* Misfit tasks should be dealt with regardless of the avg load */
+	if (busiest->group_type == group_misfit_task)
+		goto force_balance;
+
 	/*
 	 * If the busiest group is imbalanced the below checks don't
 	 * work because they assume all things are equal, which typically
@@ -6480,6 +7178,7 @@ static struct sched_group *find_busiest_group(struct lb_env *env)
 
 force_balance:
 	/* Looks like there is an imbalance. Compute it */
+	env->src_grp_type = busiest->group_type;
 	calculate_imbalance(env, &sds);
 	return sds.busiest;
 
@@ -6527,7 +7226,32 @@ static struct rq *find_busiest_queue(struct lb_env *env,
 		if (rt > env->fbq_type)
 			continue;
 
+		/*
+		 * For ASYM_CPUCAPACITY domains with misfit tasks we simply
+		 * seek the "biggest" misfit task.
+		 */
+		if (env->src_grp_type == group_misfit_task) {
+			if (rq->misfit_task_load > busiest_load) {
+				busiest_load = rq->misfit_task_load;
+				busiest = rq;
+			}
+
+			continue;
+		}
+
 		capacity = capacity_of(i);
+
+		/*
+		 * For ASYM_CPUCAPACITY domains, don't pick a cpu that could
+		 * eventually lead to active_balancing high->low capacity.
+		 * Higher per-cpu capacity is considered better than balancing
+		 * average load.
+		 */
+		if (env->sd->flags & SD_ASYM_CPUCAPACITY &&
+		    capacity_of(env->dst_cpu) < capacity &&
+		    rq->nr_running == 1)
+			continue;
+
 		capacity_factor = DIV_ROUND_CLOSEST(capacity, SCHED_CAPACITY_SCALE);
 		if (!capacity_factor)
 			capacity_factor = fix_small_capacity(env->sd, group);
@@ -6586,6 +7310,10 @@ static int need_active_balance(struct lb_env *env)
 			return 1;
 	}
 
+	/* A misfit task is running: only active balance can move it. */
+	if (env->src_grp_type == group_misfit_task)
+		return 1;
+
 	return unlikely(sd->nr_balance_failed > sd->cache_nice_tries+2);
 }
 
@@ -7532,6 +8260,9 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		task_tick_numa(rq, curr);
 
 	update_rq_runnable_avg(rq, 1);
+
+	update_misfit_status(curr, rq);
+	update_overutilized_status(rq);
 }
 
 /*
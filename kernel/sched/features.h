@@ -56,10 +56,22 @@ SCHED_FEAT(NONTASK_CAPACITY, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * When doing wakeups, limit the scan of the LLC domain for an idle CPU
+ * to what the average idle time of this CPU can pay for.
+ */
+SCHED_FEAT(SIS_PROP, true)
+
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
 
+/*
+ * Place waking tasks on the CPU that minimizes the estimated energy when
+ * the CPU capacities are asymmetric and an Energy Model is available.
+ */
+SCHED_FEAT(ENERGY_AWARE, true)
+
 /*
  * Apply the automatic NUMA scheduling policy. Enabled automatically
  * at runtime if running on a NUMA machine. Can be controlled via
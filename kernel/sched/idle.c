@@ -80,6 +80,7 @@ static void cpuidle_idle_call(void)
 	struct cpuidle_driver *drv = cpuidle_get_cpu_driver(dev);
 	int next_state, entered_state;
 	unsigned int broadcast;
+	bool stop_tick = true;
 
 	/*
 	 * Check if the idle task must be rescheduled. If it is the
@@ -96,6 +97,20 @@ static void cpuidle_idle_call(void)
 	 */
 	stop_critical_timings();
 
+	/*
+	 * Ask the cpuidle framework to choose a convenient idle state.
+	 * Fall back to the default arch idle method on errors.
+	 */
+	next_state = cpuidle_select(drv, dev, &stop_tick);
+
+	/*
+	 * Stop the tick unless the governor expects a short sleep. Once
+	 * stopped it is only reprogrammed, restarting it is left to
+	 * tick_nohz_idle_exit().
+	 */
+	if (next_state < 0 || stop_tick || tick_nohz_tick_stopped())
+		tick_nohz_idle_stop_tick();
+
 	/*
 	 * Tell the RCU framework we are entering an idle section,
 	 * so no more rcu read side critical sections and one more
@@ -103,11 +118,6 @@ static void cpuidle_idle_call(void)
 	 */
 	rcu_idle_enter();
 
-	/*
-	 * Ask the cpuidle framework to choose a convenient idle state.
-	 * Fall back to the default arch idle method on errors.
-	 */
-	next_state = cpuidle_select(drv, dev);
 	if (next_state < 0) {
 use_default:
 		/*
@@ -220,9 +230,10 @@ static void cpu_idle_loop(void)
 			 * know that the IPI is going to arrive right
 			 * away
 			 */
-			if (cpu_idle_force_poll || tick_check_broadcast_expired())
+			if (cpu_idle_force_poll || tick_check_broadcast_expired()) {
+				tick_nohz_idle_stop_tick();
 				cpu_idle_poll();
-			else
+			} else
 				cpuidle_idle_call();
 
 			arch_cpu_idle_exit();
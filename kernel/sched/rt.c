@@ -931,6 +931,9 @@ static void update_curr_rt(struct rq *rq)
 	if (unlikely((s64)delta_exec <= 0))
 		return;
 
+	/* RT tasks run at the maximum frequency the clamps allow */
+	cpufreq_update_util(rq, ULONG_MAX, SCHED_CAPACITY_SCALE);
+
 	schedstat_set(curr->se.statistics.exec_max,
 		      max(curr->se.statistics.exec_max, delta_exec));
 
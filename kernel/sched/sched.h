@@ -8,6 +8,7 @@
 #include <linux/stop_machine.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -176,6 +177,13 @@ struct dl_bw {
 	u64 bw, total_bw;
 };
 
+/* bandwidths are fixed point, with BW_SHIFT fractional bits */
+#define BW_SHIFT	20
+#define BW_UNIT		(1 << BW_SHIFT)
+#define RATIO_SHIFT	8
+
+extern void dl_release_bw(struct dl_bw *dl_b, struct task_struct *p);
+
 extern struct mutex sched_domains_mutex;
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -229,6 +237,22 @@ struct task_group {
 	struct rt_bandwidth rt_bandwidth;
 #endif
 
+	/*
+	 * -deadline bandwidth reserved for the tasks of the group
+	 * (dl_bw.bw, -1 if none), and used by them (dl_bw.total_bw).
+	 */
+	struct dl_bandwidth dl_bandwidth;
+	struct dl_bw dl_bw;
+
+#ifdef CONFIG_UCLAMP_TASK_GROUP
+	/*
+	 * Utilization clamps requested for the group, and the effective
+	 * ones, which the parent's effective clamps restrict.
+	 */
+	unsigned int uclamp_req[UCLAMP_CNT];
+	unsigned int uclamp[UCLAMP_CNT];
+#endif
+
 	struct rcu_head rcu;
 	struct list_head list;
 
@@ -345,6 +369,8 @@ struct cfs_rq {
 	 * the FAIR_GROUP_SCHED case).
 	 */
 	unsigned long runnable_load_avg, blocked_load_avg;
+	/* sum of the utilization_avg_contrib of the entities on this cfs_rq */
+	unsigned long utilization_load_avg;
 	atomic64_t decay_counter;
 	u64 last_decay;
 	atomic_long_t removed_load;
@@ -466,6 +492,14 @@ struct dl_rq {
 #else
 	struct dl_bw dl_bw;
 #endif
+	/*
+	 * Sum of the bandwidths of the -deadline tasks that are runnable
+	 * on this rq (see sched_dl_entity::dl_contending), and the inverse
+	 * of the maximum -deadline bandwidth, 1/Umax, with RATIO_SHIFT
+	 * fractional bits.  Both are used by GRUB reclaiming.
+	 */
+	u64 running_bw;
+	u64 bw_ratio;
 };
 
 #ifdef CONFIG_SMP
@@ -488,6 +522,9 @@ struct root_domain {
 	/* Indicate more than one runnable task for any CPU */
 	bool overload;
 
+	/* Indicate one or more cpus over-utilized (tipping point) */
+	bool overutilized;
+
 	/*
 	 * The bit corresponding to a CPU gets set here if such CPU has more
 	 * than one runnable -deadline task (as it is below for RT tasks).
@@ -516,6 +553,30 @@ extern struct root_domain def_root_domain;
  * (such as the load balancing or the thread migration code), lock
  * acquire operations must be ordered by ascending &runqueue.
  */
+#ifdef CONFIG_UCLAMP_TASK
+/*
+ * The clamp values of the queued tasks are refcounted in UCLAMP_BUCKETS
+ * buckets, each covering a UCLAMP_BUCKET_DELTA wide range of values, so
+ * that enqueue and dequeue stay O(1) and the rq clamp is the value of its
+ * highest non-empty bucket.  A bucket remembers the highest value enqueued
+ * into it since it last went empty, so the rq clamp can be a little high
+ * until the bucket drains; it is never lower than any queued task asks.
+ */
+#define UCLAMP_BUCKETS		5
+#define UCLAMP_BUCKET_DELTA	DIV_ROUND_CLOSEST(SCHED_CAPACITY_SCALE, \
+						  UCLAMP_BUCKETS)
+
+struct uclamp_bucket {
+	unsigned long value;
+	unsigned long tasks;
+};
+
+struct uclamp_rq {
+	unsigned int value;
+	struct uclamp_bucket bucket[UCLAMP_BUCKETS];
+};
+#endif /* CONFIG_UCLAMP_TASK */
+
 struct rq {
 	/* runqueue lock: */
 	raw_spinlock_t lock;
@@ -535,9 +596,6 @@ struct rq {
 #ifdef CONFIG_NO_HZ_COMMON
 	u64 nohz_stamp;
 	unsigned long nohz_flags;
-#endif
-#ifdef CONFIG_NO_HZ_FULL
-	unsigned long last_sched_tick;
 #endif
 	int skip_clock_update;
 
@@ -550,6 +608,11 @@ struct rq {
 	struct rt_rq rt;
 	struct dl_rq dl;
 
+#ifdef CONFIG_UCLAMP_TASK
+	/* max-aggregated clamps of the tasks queued on this rq */
+	struct uclamp_rq uclamp[UCLAMP_CNT];
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -579,6 +642,10 @@ struct rq {
 	struct sched_domain *sd;
 
 	unsigned long cpu_capacity;
+	unsigned long cpu_capacity_orig;
+
+	/* utilization of the current task if it doesn't fit this cpu */
+	unsigned long misfit_task_load;
 
 	unsigned char idle_balance;
 	/* For active balancing */
@@ -668,6 +735,17 @@ DECLARE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
 #define cpu_curr(cpu)		(cpu_rq(cpu)->curr)
 #define raw_rq()		raw_cpu_ptr(&runqueues)
 
+struct rq *__task_rq_lock(struct task_struct *p)
+	__acquires(rq->lock);
+struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
+	__acquires(p->pi_lock)
+	__acquires(rq->lock);
+void __task_rq_unlock(struct rq *rq)
+	__releases(rq->lock);
+void task_rq_unlock(struct rq *rq, struct task_struct *p, unsigned long *flags)
+	__releases(rq->lock)
+	__releases(p->pi_lock);
+
 static inline u64 rq_clock(struct rq *rq)
 {
 	return rq->clock;
@@ -742,9 +820,12 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
+DECLARE_PER_CPU(struct sched_domain *, sd_asym_cpucapacity);
+extern struct static_key sched_asym_cpucapacity;
 
 struct sched_group_capacity {
 	atomic_t ref;
@@ -753,6 +834,7 @@ struct sched_group_capacity {
 	 * for a single CPU.
 	 */
 	unsigned int capacity, capacity_orig;
+	unsigned long max_capacity; /* Max per-cpu capacity in group */
 	unsigned long next_update;
 	int imbalance; /* XXX unrelated to capacity but shared group state */
 	/*
@@ -1174,6 +1256,12 @@ static inline void idle_exit_fair(struct rq *rq) { }
 
 #endif
 
+#if defined(CONFIG_SMP) && defined(CONFIG_SCHED_SMT)
+extern void update_idle_core(struct rq *rq);
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
+
 #ifdef CONFIG_CPU_IDLE
 static inline void idle_set_state(struct rq *rq,
 				  struct cpuidle_state *idle_state)
@@ -1256,13 +1344,6 @@ static inline void sub_nr_running(struct rq *rq, unsigned count)
 	rq->nr_running -= count;
 }
 
-static inline void rq_last_tick_reset(struct rq *rq)
-{
-#ifdef CONFIG_NO_HZ_FULL
-	rq->last_sched_tick = jiffies;
-#endif
-}
-
 extern void update_rq_clock(struct rq *rq);
 
 extern void activate_task(struct rq *rq, struct task_struct *p, int flags);
@@ -1508,6 +1589,7 @@ extern void print_rt_stats(struct seq_file *m, int cpu);
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
 extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
+extern void init_dl_rq_bw_ratio(struct dl_rq *dl_rq);
 
 extern void cfs_bandwidth_usage_inc(void);
 extern void cfs_bandwidth_usage_dec(void);
@@ -1569,3 +1651,56 @@ static inline u64 irq_time_read(int cpu)
 }
 #endif /* CONFIG_64BIT */
 #endif /* CONFIG_IRQ_TIME_ACCOUNTING */
+
+#ifdef CONFIG_UCLAMP_TASK
+static inline unsigned long uclamp_rq_min(struct rq *rq)
+{
+	return ACCESS_ONCE(rq->uclamp[UCLAMP_MIN].value);
+}
+
+static inline unsigned long uclamp_rq_max(struct rq *rq)
+{
+	return ACCESS_ONCE(rq->uclamp[UCLAMP_MAX].value);
+}
+#else
+static inline unsigned long uclamp_rq_min(struct rq *rq)
+{
+	return 0;
+}
+
+static inline unsigned long uclamp_rq_max(struct rq *rq)
+{
+	return SCHED_CAPACITY_SCALE;
+}
+#endif /* CONFIG_UCLAMP_TASK */
+
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_update_util - Take a note about CPU utilization changes.
+ * @rq: Runqueue whose utilization changed.
+ * @util: Current utilization.
+ * @max: Utilization ceiling.
+ *
+ * Called by the scheduler classes, with @rq locked, whenever the
+ * utilization they see on @rq changes.  Only changes on the local CPU are
+ * passed on: the governor's per-CPU state is not protected against remote
+ * updates, and the local CPU reports again soon enough anyway.
+ */
+static inline void cpufreq_update_util(struct rq *rq, unsigned long util,
+				       unsigned long max)
+{
+	struct update_util_data *data;
+
+	if (cpu_of(rq) != smp_processor_id())
+		return;
+
+	data = rcu_dereference_sched(*this_cpu_ptr(&cpufreq_update_util_data));
+	if (data)
+		data->func(data, rq_clock(rq), util, max);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq, unsigned long util,
+				       unsigned long max) {}
+#endif /* CONFIG_CPU_FREQ */
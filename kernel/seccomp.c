@@ -33,6 +33,12 @@
 #include <linux/tracehook.h>
 #include <linux/uaccess.h>
 
+/*
+ * Syscall numbers covered by the per-filter allow cache.  Larger ones
+ * are still handled correctly, they just always run the filters.
+ */
+#define SECCOMP_CACHE_NR	512
+
 /**
  * struct seccomp_filter - container for seccomp BPF programs
  *
@@ -41,8 +47,10 @@
  *         outside of a lifetime-guarded section.  In general, this
  *         is only needed for handling filters shared across tasks.
  * @prev: points to a previously installed, or inherited, filter
- * @len: the number of instructions in the program
- * @insnsi: the BPF program instructions to evaluate
+ * @prog: the BPF program to evaluate
+ * @cache_arch: the AUDIT_ARCH_* value @cache_allow was computed for
+ * @cache_allow: syscall numbers for which this filter and all of its
+ *               ancestors return SECCOMP_RET_ALLOW whatever the arguments
  *
  * seccomp_filter objects are organized in a tree linked via the @prev
  * pointer.  For any task, it appears to be a singly-linked list starting
@@ -58,6 +66,8 @@ struct seccomp_filter {
 	atomic_t usage;
 	struct seccomp_filter *prev;
 	struct bpf_prog *prog;
+	u32 cache_arch;
+	DECLARE_BITMAP(cache_allow, SECCOMP_CACHE_NR);
 };
 
 /* Limit any path through the tree to 256KB worth of instructions. */
@@ -167,6 +177,122 @@ static int seccomp_check_filter(struct sock_filter *filter, unsigned int flen)
 	return 0;
 }
 
+/**
+ * seccomp_is_const_allow - emulates a filter on a syscall number alone
+ * @filter: filter already rewritten by seccomp_check_filter
+ * @flen: length of filter
+ * @sd: seccomp data with only @nr and @arch filled in
+ *
+ * Returns true if every path the filter can take for @sd->nr and
+ * @sd->arch ends in SECCOMP_RET_ALLOW, i.e. the outcome cannot depend
+ * on the arguments or the instruction pointer.  Anything but the
+ * instructions emitted for a plain syscall number switch is treated as
+ * data dependent.
+ */
+static bool seccomp_is_const_allow(const struct sock_filter *filter,
+				   unsigned int flen,
+				   const struct seccomp_data *sd)
+{
+	u32 reg_value = 0;
+	unsigned int pc;
+	bool op_res;
+
+	for (pc = 0; pc < flen; pc++) {
+		const struct sock_filter *insn = &filter[pc];
+		u16 code = insn->code;
+		u32 k = insn->k;
+
+		switch (code) {
+		/* BPF_LD | BPF_W | BPF_ABS after seccomp_check_filter() */
+		case BPF_LDX | BPF_W | BPF_ABS:
+			switch (k) {
+			case offsetof(struct seccomp_data, nr):
+				reg_value = sd->nr;
+				break;
+			case offsetof(struct seccomp_data, arch):
+				reg_value = sd->arch;
+				break;
+			default:
+				return false;
+			}
+			break;
+		case BPF_RET | BPF_K:
+			return (k & SECCOMP_RET_ACTION) == SECCOMP_RET_ALLOW;
+		case BPF_JMP | BPF_JA:
+			pc += k;
+			break;
+		case BPF_JMP | BPF_JEQ | BPF_K:
+		case BPF_JMP | BPF_JGE | BPF_K:
+		case BPF_JMP | BPF_JGT | BPF_K:
+		case BPF_JMP | BPF_JSET | BPF_K:
+			switch (BPF_OP(code)) {
+			case BPF_JEQ:
+				op_res = reg_value == k;
+				break;
+			case BPF_JGE:
+				op_res = reg_value >= k;
+				break;
+			case BPF_JGT:
+				op_res = reg_value > k;
+				break;
+			default:
+				op_res = !!(reg_value & k);
+				break;
+			}
+			pc += op_res ? insn->jt : insn->jf;
+			break;
+		case BPF_ALU | BPF_AND | BPF_K:
+			reg_value &= k;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	/* bpf_check_classic() guarantees the program ends in a return. */
+	WARN_ON_ONCE(1);
+	return false;
+}
+
+/**
+ * seccomp_cache_prepare - finds the syscalls a new filter always allows
+ * @filter: seccomp filter being prepared
+ * @fp: its classic BPF program, as rewritten by seccomp_check_filter
+ * @flen: length of @fp
+ *
+ * The result only covers the calling task's current syscall ABI;
+ * seccomp_run_filters() ignores the cache for any other one.
+ */
+static void seccomp_cache_prepare(struct seccomp_filter *filter,
+				  const struct sock_filter *fp,
+				  unsigned int flen)
+{
+	struct seccomp_data sd = {};
+	int nr;
+
+	filter->cache_arch = syscall_get_arch();
+	sd.arch = filter->cache_arch;
+	for (nr = 0; nr < SECCOMP_CACHE_NR; nr++) {
+		sd.nr = nr;
+		if (seccomp_is_const_allow(fp, flen, &sd))
+			__set_bit(nr, filter->cache_allow);
+	}
+}
+
+/*
+ * Returns true if all filters attached to the task are known to allow
+ * @nr for @arch, so that running them can be skipped.
+ */
+static inline bool seccomp_cache_check_allow(const struct seccomp_filter *f,
+					     u32 arch, int nr)
+{
+	if (unlikely(arch != f->cache_arch))
+		return false;
+	if (unlikely((unsigned int)nr >= SECCOMP_CACHE_NR))
+		return false;
+	return test_bit(nr, f->cache_allow);
+}
+
 /**
  * seccomp_run_filters - evaluates all seccomp filters against @syscall
  * @syscall: number of the current system call
@@ -178,6 +304,8 @@ static u32 seccomp_run_filters(struct seccomp_data *sd)
 	struct seccomp_filter *f = ACCESS_ONCE(current->seccomp.filter);
 	struct seccomp_data sd_local;
 	u32 ret = SECCOMP_RET_ALLOW;
+	u32 arch;
+	int nr;
 
 	/* Ensure unexpected behavior doesn't result in failing open. */
 	if (unlikely(WARN_ON(f == NULL)))
@@ -186,6 +314,16 @@ static u32 seccomp_run_filters(struct seccomp_data *sd)
 	/* Make sure cross-thread synced filter points somewhere sane. */
 	smp_read_barrier_depends();
 
+	if (sd) {
+		nr = sd->nr;
+		arch = sd->arch;
+	} else {
+		nr = syscall_get_nr(current, task_pt_regs(current));
+		arch = syscall_get_arch();
+	}
+	if (seccomp_cache_check_allow(f, arch, nr))
+		return SECCOMP_RET_ALLOW;
+
 	if (!sd) {
 		populate_seccomp_data(&sd_local);
 		sd = &sd_local;
@@ -407,6 +545,8 @@ static struct seccomp_filter *seccomp_prepare_filter(struct sock_fprog *fprog)
 	if (ret)
 		goto free_filter_prog;
 
+	seccomp_cache_prepare(filter, fp, fprog->len);
+
 	kfree(fp);
 	atomic_set(&filter->usage, 1);
 	filter->prog->len = new_len;
@@ -485,6 +625,19 @@ static long seccomp_attach_filter(unsigned int flags,
 			return ret;
 	}
 
+	/*
+	 * A syscall only skips the filters if every one of them allows it
+	 * unconditionally, so fold in what the ancestors allow.
+	 */
+	walker = current->seccomp.filter;
+	if (walker) {
+		if (walker->cache_arch == filter->cache_arch)
+			bitmap_and(filter->cache_allow, filter->cache_allow,
+				   walker->cache_allow, SECCOMP_CACHE_NR);
+		else
+			bitmap_zero(filter->cache_allow, SECCOMP_CACHE_NR);
+	}
+
 	/*
 	 * If there is an existing filter, make it the prev and don't drop its
 	 * task reference.
@@ -14,6 +14,9 @@
 #include <linux/smp.h>
 #include <linux/cpu.h>
 #include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include "smpboot.h"
 
@@ -25,6 +28,7 @@ enum {
 struct call_function_data {
 	struct call_single_data	__percpu *csd;
 	cpumask_var_t		cpumask;
+	cpumask_var_t		cpumask_ipi;
 };
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_function_data, cfd_data);
@@ -45,9 +49,15 @@ hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 		if (!zalloc_cpumask_var_node(&cfd->cpumask, GFP_KERNEL,
 				cpu_to_node(cpu)))
 			return notifier_from_errno(-ENOMEM);
+		if (!zalloc_cpumask_var_node(&cfd->cpumask_ipi, GFP_KERNEL,
+				cpu_to_node(cpu))) {
+			free_cpumask_var(cfd->cpumask);
+			return notifier_from_errno(-ENOMEM);
+		}
 		cfd->csd = alloc_percpu(struct call_single_data);
 		if (!cfd->csd) {
 			free_cpumask_var(cfd->cpumask);
+			free_cpumask_var(cfd->cpumask_ipi);
 			return notifier_from_errno(-ENOMEM);
 		}
 		break;
@@ -60,6 +70,7 @@ hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
 		free_cpumask_var(cfd->cpumask);
+		free_cpumask_var(cfd->cpumask_ipi);
 		free_percpu(cfd->csd);
 		break;
 
@@ -138,13 +149,110 @@ static void csd_unlock(struct call_single_data *csd)
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_single_data, csd_data);
 
+#ifdef CONFIG_SMP_CALL_STATS
+/*
+ * Per-cpu accounting of the cross calls issued by this CPU, keyed by the
+ * return address of the smp_call_function*() caller. "sent" counts the
+ * target CPUs which got an IPI, "coalesced" those whose request was queued
+ * behind one still pending and so didn't need another.
+ */
+#define SMP_CALL_STAT_BITS	5
+#define SMP_CALL_STAT_SLOTS	(1 << SMP_CALL_STAT_BITS)
+
+struct smp_call_stat {
+	unsigned long	site;
+	unsigned long	sent;
+	unsigned long	coalesced;
+};
+
+/* The extra last slot collects the call sites which found no free slot */
+static DEFINE_PER_CPU(struct smp_call_stat [SMP_CALL_STAT_SLOTS + 1],
+		      smp_call_stats);
+
+static void smp_call_stat_account(unsigned long site, unsigned int sent,
+				  unsigned int coalesced)
+{
+	struct smp_call_stat *stats, *stat;
+	unsigned long flags;
+	unsigned int i, h;
+
+	h = hash_long(site, SMP_CALL_STAT_BITS);
+
+	local_irq_save(flags);
+	stats = this_cpu_ptr(&smp_call_stats[0]);
+	for (i = 0; i < SMP_CALL_STAT_SLOTS; i++) {
+		stat = &stats[(h + i) & (SMP_CALL_STAT_SLOTS - 1)];
+		if (stat->site == site)
+			goto found;
+		if (!stat->site) {
+			stat->site = site;
+			goto found;
+		}
+	}
+	stat = &stats[SMP_CALL_STAT_SLOTS];
+found:
+	stat->sent += sent;
+	stat->coalesced += coalesced;
+	local_irq_restore(flags);
+}
+
+static int smp_call_stats_show(struct seq_file *m, void *v)
+{
+	int cpu, i;
+
+	seq_puts(m, "cpu       sent  coalesced  site\n");
+	for_each_online_cpu(cpu) {
+		struct smp_call_stat *stats = per_cpu(smp_call_stats, cpu);
+
+		for (i = 0; i <= SMP_CALL_STAT_SLOTS; i++) {
+			struct smp_call_stat *stat = &stats[i];
+
+			if (!stat->sent && !stat->coalesced)
+				continue;
+			seq_printf(m, "%3d %10lu %10lu  ", cpu,
+				   stat->sent, stat->coalesced);
+			if (i < SMP_CALL_STAT_SLOTS)
+				seq_printf(m, "%pS\n", (void *)stat->site);
+			else
+				seq_puts(m, "other\n");
+		}
+	}
+	return 0;
+}
+
+static int smp_call_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smp_call_stats_show, NULL);
+}
+
+static const struct file_operations smp_call_stats_fops = {
+	.open		= smp_call_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init smp_call_stats_init(void)
+{
+	proc_create("smp_call_stats", 0444, NULL, &smp_call_stats_fops);
+	return 0;
+}
+subsys_initcall(smp_call_stats_init);
+#else
+static inline void smp_call_stat_account(unsigned long site, unsigned int sent,
+					 unsigned int coalesced)
+{
+}
+#endif
+
 /*
  * Insert a previously allocated call_single_data element
  * for execution on the given CPU. data must already have
  * ->func, ->info, and ->flags set.
  */
 static int generic_exec_single(int cpu, struct call_single_data *csd,
-			       smp_call_func_t func, void *info, int wait)
+			       smp_call_func_t func, void *info, int wait,
+			       unsigned long site)
 {
 	struct call_single_data csd_stack = { .flags = 0 };
 	unsigned long flags;
@@ -186,9 +294,16 @@ static int generic_exec_single(int cpu, struct call_single_data *csd,
 	 * to arch code to make it appear to obey cache coherency WRT
 	 * locking and barrier primitives. Generic code isn't really
 	 * equipped to do the right thing...
+	 *
+	 * If the queue wasn't empty, the IPI sent for the first entry hasn't
+	 * been handled yet and will run this one too.
 	 */
-	if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
+	if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu))) {
 		arch_send_call_function_single_ipi(cpu);
+		smp_call_stat_account(site, 1, 0);
+	} else {
+		smp_call_stat_account(site, 0, 1);
+	}
 
 	if (wait)
 		csd_lock_wait(csd);
@@ -292,7 +407,7 @@ int smp_call_function_single(int cpu, smp_call_func_t func, void *info,
 	WARN_ON_ONCE(cpu_online(this_cpu) && irqs_disabled()
 		     && !oops_in_progress);
 
-	err = generic_exec_single(cpu, NULL, func, info, wait);
+	err = generic_exec_single(cpu, NULL, func, info, wait, _RET_IP_);
 
 	put_cpu();
 
@@ -321,7 +436,7 @@ int smp_call_function_single_async(int cpu, struct call_single_data *csd)
 	int err = 0;
 
 	preempt_disable();
-	err = generic_exec_single(cpu, csd, csd->func, csd->info, 0);
+	err = generic_exec_single(cpu, csd, csd->func, csd->info, 0, _RET_IP_);
 	preempt_enable();
 
 	return err;
@@ -390,6 +505,7 @@ void smp_call_function_many(const struct cpumask *mask,
 {
 	struct call_function_data *cfd;
 	int cpu, next_cpu, this_cpu = smp_processor_id();
+	unsigned int nr_ipi, nr_queued = 0;
 
 	/*
 	 * Can deadlock when called with interrupts disabled.
@@ -416,7 +532,7 @@ void smp_call_function_many(const struct cpumask *mask,
 
 	/* Fastpath: do that cpu by itself. */
 	if (next_cpu >= nr_cpu_ids) {
-		smp_call_function_single(cpu, func, info, wait);
+		generic_exec_single(cpu, NULL, func, info, wait, _RET_IP_);
 		return;
 	}
 
@@ -429,17 +545,27 @@ void smp_call_function_many(const struct cpumask *mask,
 	if (unlikely(!cpumask_weight(cfd->cpumask)))
 		return;
 
+	/*
+	 * Only CPUs whose queue was empty need an IPI. The others still have
+	 * one pending, whose handler will pick up this request as well.
+	 */
+	cpumask_clear(cfd->cpumask_ipi);
 	for_each_cpu(cpu, cfd->cpumask) {
 		struct call_single_data *csd = per_cpu_ptr(cfd->csd, cpu);
 
 		csd_lock(csd);
 		csd->func = func;
 		csd->info = info;
-		llist_add(&csd->llist, &per_cpu(call_single_queue, cpu));
+		if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
+			cpumask_set_cpu(cpu, cfd->cpumask_ipi);
+		nr_queued++;
 	}
 
-	/* Send a message to all CPUs in the map */
-	arch_send_call_function_ipi_mask(cfd->cpumask);
+	/* Send a message to all CPUs in the map which need one */
+	nr_ipi = cpumask_weight(cfd->cpumask_ipi);
+	if (nr_ipi)
+		arch_send_call_function_ipi_mask(cfd->cpumask_ipi);
+	smp_call_stat_account(_RET_IP_, nr_ipi, nr_queued - nr_ipi);
 
 	if (wait) {
 		for_each_cpu(cpu, cfd->cpumask) {
@@ -93,11 +93,15 @@ cond_syscall(sys_mq_open);
 cond_syscall(sys_mq_unlink);
 cond_syscall(sys_mq_timedsend);
 cond_syscall(sys_mq_timedreceive);
+cond_syscall(sys_mq_timedsend_batch);
+cond_syscall(sys_mq_timedreceive_batch);
 cond_syscall(sys_mq_notify);
 cond_syscall(sys_mq_getsetattr);
 cond_syscall(compat_sys_mq_open);
 cond_syscall(compat_sys_mq_timedsend);
 cond_syscall(compat_sys_mq_timedreceive);
+cond_syscall(compat_sys_mq_timedsend_batch);
+cond_syscall(compat_sys_mq_timedreceive_batch);
 cond_syscall(compat_sys_mq_notify);
 cond_syscall(compat_sys_mq_getsetattr);
 cond_syscall(sys_mbind);
@@ -149,6 +153,8 @@ cond_syscall(sys_io_destroy);
 cond_syscall(sys_io_submit);
 cond_syscall(sys_io_cancel);
 cond_syscall(sys_io_getevents);
+cond_syscall(sys_io_setup2);
+cond_syscall(sys_io_ring_enter);
 cond_syscall(sys_sysfs);
 cond_syscall(sys_syslog);
 cond_syscall(sys_process_vm_readv);
@@ -224,3 +230,6 @@ cond_syscall(sys_seccomp);
 
 /* access BPF programs and maps */
 cond_syscall(sys_bpf);
+
+/* userspace page fault handling */
+cond_syscall(sys_userfaultfd);
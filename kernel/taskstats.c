@@ -588,6 +588,72 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * Dump the per-pid stats of every task in the caller's pid namespace, or
+ * of the threads of one process if TASKSTATS_CMD_ATTR_TGID is given, as
+ * a stream of TASKSTATS_CMD_NEW messages.  cb->args[0] holds the pid to
+ * resume from when the dump spans several skbs.
+ */
+static int taskstats_user_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct pid_namespace *ns = task_active_pid_ns(current);
+	struct user_namespace *user_ns = current_user_ns();
+	struct nlattr *attrs[TASKSTATS_CMD_ATTR_MAX + 1];
+	struct task_struct *tsk;
+	struct taskstats *stats;
+	struct pid *pid;
+	void *reply;
+	pid_t nr = cb->args[0];
+	u32 tgid = 0;
+	int rc;
+
+	rc = nlmsg_parse(cb->nlh, GENL_HDRLEN, attrs, TASKSTATS_CMD_ATTR_MAX,
+			 taskstats_cmd_get_policy);
+	if (rc < 0)
+		return rc;
+	if (attrs[TASKSTATS_CMD_ATTR_TGID])
+		tgid = nla_get_u32(attrs[TASKSTATS_CMD_ATTR_TGID]);
+
+	for (;; nr++) {
+		rcu_read_lock();
+		pid = find_ge_pid(nr, ns);
+		tsk = NULL;
+		if (pid) {
+			nr = pid_nr_ns(pid, ns);
+			tsk = pid_task(pid, PIDTYPE_PID);
+			if (tsk && tgid && task_tgid_nr_ns(tsk, ns) != tgid)
+				tsk = NULL;
+			if (tsk)
+				get_task_struct(tsk);
+		}
+		rcu_read_unlock();
+		if (!pid)
+			break;
+		if (!tsk)
+			continue;
+
+		reply = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+				    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+				    TASKSTATS_CMD_NEW);
+		if (!reply) {
+			put_task_struct(tsk);
+			break;
+		}
+		stats = mk_reply(skb, TASKSTATS_TYPE_PID, nr);
+		if (!stats) {
+			genlmsg_cancel(skb, reply);
+			put_task_struct(tsk);
+			break;
+		}
+		fill_stats(user_ns, ns, tsk, stats);
+		put_task_struct(tsk);
+		genlmsg_end(skb, reply);
+	}
+
+	cb->args[0] = nr;
+	return skb->len;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -677,6 +743,7 @@ static const struct genl_ops taskstats_ops[] = {
 	{
 		.cmd		= TASKSTATS_CMD_GET,
 		.doit		= taskstats_user_cmd,
+		.dumpit		= taskstats_user_dump,
 		.policy		= taskstats_cmd_get_policy,
 		.flags		= GENL_ADMIN_PERM,
 	},
@@ -147,6 +147,8 @@ static void tick_sched_handle(struct tick_sched *ts, struct pt_regs *regs)
 		if (is_idle_task(current))
 			ts->idle_jiffies++;
 	}
+	if (ts->inidle)
+		ts->got_idle_tick = 1;
 #endif
 	update_process_times(user_mode(regs));
 	profile_tick(CPU_PROFILING);
@@ -632,13 +634,6 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 			time_delta = KTIME_MAX;
 		}
 
-#ifdef CONFIG_NO_HZ_FULL
-		if (!ts->inidle) {
-			time_delta = min(time_delta,
-					 scheduler_tick_max_deferment());
-		}
-#endif
-
 		/*
 		 * calculate the expiry time for the next timer wheel
 		 * timer. delta_jiffies >= NEXT_TIMER_MAX_DELTA signals
@@ -790,12 +785,12 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	return true;
 }
 
-static void __tick_nohz_idle_enter(struct tick_sched *ts)
+static void __tick_nohz_idle_stop_tick(struct tick_sched *ts)
 {
 	ktime_t now, expires;
 	int cpu = smp_processor_id();
 
-	now = tick_nohz_start_idle(ts);
+	now = ktime_get();
 
 	if (can_stop_idle_tick(cpu, ts)) {
 		int was_stopped = ts->tick_stopped;
@@ -814,10 +809,24 @@ static void __tick_nohz_idle_enter(struct tick_sched *ts)
 }
 
 /**
- * tick_nohz_idle_enter - stop the idle tick from the idle task
+ * tick_nohz_idle_stop_tick - stop the idle tick from the idle task
  *
  * When the next event is more than a tick into the future, stop the idle tick
- * Called when we start the idle loop.
+ * Called with interrupts disabled, once the idle governor (if any) has
+ * decided that the CPU is going to sleep long enough for that to pay off.
+ */
+void tick_nohz_idle_stop_tick(void)
+{
+	__tick_nohz_idle_stop_tick(this_cpu_ptr(&tick_cpu_sched));
+}
+EXPORT_SYMBOL_GPL(tick_nohz_idle_stop_tick);
+
+/**
+ * tick_nohz_idle_enter - prepare for entering idle on the current CPU
+ *
+ * Called when we start the idle loop. This only starts the idle time
+ * accounting, the tick is left running until tick_nohz_idle_stop_tick()
+ * is called.
  *
  * The arch is responsible of calling:
  *
@@ -843,7 +852,7 @@ void tick_nohz_idle_enter(void)
 
 	ts = this_cpu_ptr(&tick_cpu_sched);
 	ts->inidle = 1;
-	__tick_nohz_idle_enter(ts);
+	tick_nohz_start_idle(ts);
 
 	local_irq_enable();
 }
@@ -855,28 +864,119 @@ EXPORT_SYMBOL_GPL(tick_nohz_idle_enter);
  * When an interrupt fires while we are idle and it doesn't cause
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
- * So we need to re-calculate and reprogram the next tick event.
+ * So we need to re-calculate and reprogram the next tick event. If the
+ * tick is still running, the idle loop gets to decide again whether to
+ * stop it before the CPU goes back to sleep.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = this_cpu_ptr(&tick_cpu_sched);
 
-	if (ts->inidle)
-		__tick_nohz_idle_enter(ts);
-	else
+	if (ts->inidle) {
+		tick_nohz_start_idle(ts);
+		if (ts->tick_stopped)
+			__tick_nohz_idle_stop_tick(ts);
+	} else {
 		tick_nohz_full_stop_tick(ts);
+	}
+}
+
+/**
+ * tick_nohz_idle_got_tick - check whether or not the tick handler has run
+ *
+ * Returns true and clears the indication if the tick has fired on this
+ * CPU since the last call while the CPU was idle.
+ */
+bool tick_nohz_idle_got_tick(void)
+{
+	struct tick_sched *ts = this_cpu_ptr(&tick_cpu_sched);
+
+	if (ts->got_idle_tick) {
+		ts->got_idle_tick = 0;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Compute when the next timer event would be due on this CPU if the
+ * tick was stopped now, following what tick_nohz_stop_sched_tick()
+ * would program, without touching the tick or the do_timer duty.
+ */
+static ktime_t tick_nohz_next_event(struct tick_sched *ts, int cpu)
+{
+	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	unsigned long rcu_delta_jiffies;
+	ktime_t last_update, expires;
+	u64 time_delta;
+
+	do {
+		seq = read_seqbegin(&jiffies_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&jiffies_lock, seq));
+
+	if (rcu_needs_cpu(cpu, &rcu_delta_jiffies) ||
+	    arch_needs_cpu() || irq_work_needs_cpu()) {
+		delta_jiffies = 1;
+	} else {
+		next_jiffies = get_next_timer_interrupt(last_jiffies);
+		delta_jiffies = next_jiffies - last_jiffies;
+		if (rcu_delta_jiffies < delta_jiffies)
+			delta_jiffies = rcu_delta_jiffies;
+	}
+
+	if ((long)delta_jiffies <= 1)
+		return ktime_add(last_update, tick_period);
+
+	if (cpu == tick_do_timer_cpu ||
+	    (tick_do_timer_cpu == TICK_DO_TIMER_NONE && ts->do_timer_last))
+		time_delta = timekeeping_max_deferment();
+	else
+		time_delta = KTIME_MAX;
+
+	if (likely(delta_jiffies < NEXT_TIMER_MAX_DELTA))
+		time_delta = min_t(u64, time_delta,
+				   tick_period.tv64 * delta_jiffies);
+
+	if (time_delta < KTIME_MAX)
+		expires = ktime_add_ns(last_update, time_delta);
+	else
+		expires.tv64 = KTIME_MAX;
+
+	return expires;
 }
 
 /**
  * tick_nohz_get_sleep_length - return the length of the current sleep
  *
- * Called from power state control code with interrupts disabled
+ * Called from power state control code with interrupts disabled, before
+ * the decision to stop the tick has been made. The value returned is the
+ * time until the next timer event assuming the tick gets stopped.
  */
 ktime_t tick_nohz_get_sleep_length(void)
 {
+	struct clock_event_device *dev = __this_cpu_read(tick_cpu_device.evtdev);
 	struct tick_sched *ts = this_cpu_ptr(&tick_cpu_sched);
+	int cpu = smp_processor_id();
+	ktime_t now = ktime_get();
+	ktime_t next_event;
+
+	/* A stopped tick has been reprogrammed to the next event already */
+	if (ts->tick_stopped || !can_stop_idle_tick(cpu, ts))
+		return ktime_sub(dev->next_event, now);
+
+	next_event = tick_nohz_next_event(ts, cpu);
+
+	/*
+	 * In high resolution mode hrtimers are not accounted for by the
+	 * timer wheel. Catch the ones that are due before the tick.
+	 */
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES &&
+	    dev->next_event.tv64 < hrtimer_get_expires_tv64(&ts->sched_timer))
+		next_event.tv64 = min(next_event.tv64, dev->next_event.tv64);
 
-	return ts->sleep_length;
+	return ktime_sub(next_event, now);
 }
 
 static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
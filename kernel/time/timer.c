@@ -57,37 +57,86 @@ __visible u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each. Every
+ * level runs on its own clock, LVL_CLK_DIV times slower than the level
+ * below, so the granularity of a bucket grows with the distance of its
+ * expiry time:
+ *
+ *   level granularity:	LVL_CLK_DIV ^ level jiffies
+ *
+ * A timer is queued once, in the level whose range covers its relative
+ * expiry time, and its expiry is rounded up to the granularity of that
+ * level. Unlike the classic cascading wheel, timers are never moved back
+ * down to finer levels: a timer fires at most one granule of its level
+ * late, and never early. That is the right trade-off for the bulk of the
+ * timers, timeouts which are canceled long before they expire, and it
+ * removes the periodic cascading bursts.
+ *
+ * HZ 1000: level  granularity   range
+ *            0       1 ms         0 ms -  62 ms
+ *            1       8 ms        63 ms - 503 ms
+ *            2      64 ms       504 ms -   4 s
+ *            3     512 ms         4 s  -  32 s
+ *            4       4 s         32 s  -   4 m
+ *            5      32 s          4 m  -  34 m
+ *            6       4 m         34 m  -   4 h
+ *            7      34 m          4 h  -   1 d
+ *            8       4 h          1 d  -  12 d
+ *
+ * Timers beyond the range of the last level are clamped to its end.
+ */
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The first relative expiry time handled by level n (n > 0) */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
+
+/*
+ * Deferrable timers live in a wheel of their own, so that looking up the
+ * next expiry for NOHZ idle never has to look at them.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
+enum {
+	WHEEL_STD,
+	WHEEL_DEF,
+	NR_WHEELS,
 };
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
+/*
+ * A bit in pending_map is set when a timer is queued in the bucket, and
+ * only cleared when the bucket is expired or found empty: removing a timer
+ * does not know its bucket index.
+ */
+struct tvec_wheel {
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 };
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
-	unsigned long next_timer;
 	unsigned long active_timers;
 	unsigned long all_timers;
 	int cpu;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	struct tvec_wheel wheels[NR_WHEELS];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -353,48 +402,62 @@ static bool catchup_timer_jiffies(struct tvec_base *base)
 	return false;
 }
 
+static inline struct tvec_wheel *timer_wheel(struct tvec_base *base,
+					     struct timer_list *timer)
+{
+	if (tbase_get_deferrable(timer->base))
+		return &base->wheels[WHEEL_DEF];
+	return &base->wheels[WHEEL_STD];
+}
+
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
+{
+	/*
+	 * Round up to the granularity of the level, so that a timer
+	 * truncated to a coarser level never expires early. Level 0
+	 * buckets are exact.
+	 */
+	if (lvl)
+		expires = (expires >> LVL_SHIFT(lvl)) + 1;
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	/*
+	 * Can happen if you add a timer with expires == jiffies,
+	 * or you set a timer to go off in the past
+	 */
+	if ((long)delta < 0)
+		return clk & LVL_MASK;
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
+	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
+	}
+	return calc_index(expires, lvl);
+}
+
 static void
 __internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
-		/*
-		 * Can happen if you add a timer with expires == jiffies,
-		 * or you set a timer to go off in the past
-		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
-	}
+	struct tvec_wheel *wheel = timer_wheel(base, timer);
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies);
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, wheel->vectors + idx);
+	__set_bit(idx, wheel->pending_map);
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
@@ -402,13 +465,10 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	(void)catchup_timer_jiffies(base);
 	__internal_add_timer(base, timer);
 	/*
-	 * Update base->active_timers and base->next_timer
+	 * Update base->active_timers
 	 */
-	if (!tbase_get_deferrable(timer->base)) {
-		if (!base->active_timers++ ||
-		    time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
-	}
+	if (!tbase_get_deferrable(timer->base))
+		base->active_timers++;
 	base->all_timers++;
 
 	/*
@@ -716,11 +776,8 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 		return 0;
 
 	detach_timer(timer, clear_pending);
-	if (!tbase_get_deferrable(timer->base)) {
+	if (!tbase_get_deferrable(timer->base))
 		base->active_timers--;
-		if (timer->expires == base->next_timer)
-			base->next_timer = base->timer_jiffies;
-	}
 	base->all_timers--;
 	(void)catchup_timer_jiffies(base);
 	return 1;
@@ -732,7 +789,7 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found on the wheel lists.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -1092,27 +1149,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1156,18 +1192,160 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Find the distance from @clk to the next bucket with timers queued in
+ * the level starting at @offset, clearing pending bits of buckets that
+ * were emptied by timer removal on the way. Returns -1 if there is none.
+ */
+static int next_pending_bucket(struct tvec_wheel *wheel, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	for (;;) {
+		pos = find_next_bit(wheel->pending_map, end, start);
+		if (pos >= end) {
+			pos = find_next_bit(wheel->pending_map, start, offset);
+			if (pos >= start)
+				return -1;
+		}
+		if (!list_empty(wheel->vectors + pos))
+			return pos >= start ? pos - start : pos + LVL_SIZE - start;
+		__clear_bit(pos, wheel->pending_map);
+	}
+}
+
+/*
+ * Search the first expiring bucket of a wheel. Since the bucket expiry
+ * times are rounded to the level granularity this is just a walk over
+ * the pending bitmap of each level, without touching any timer.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base,
+					    struct tvec_wheel *wheel)
+{
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
+
+	clk = base->timer_jiffies;
+	next = clk + NEXT_TIMER_MAX_DELTA;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(wheel, offset, clk & LVL_MASK);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long)pos;
+
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * Clock of the next level. If the low bits of the current
+		 * level clock are zero, the next level looks at its current
+		 * bucket, which has not been expired yet. Otherwise that
+		 * bucket was expired already and the next one is due.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
+	}
+	return next;
+}
+
+/*
+ * Move the due buckets of all levels and wheels to @heads. A level is
+ * only due when the clocks of all the levels below it wrapped.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	int i, w, levels = 0;
+	unsigned int idx;
+
+	/*
+	 * After a NOHZ idle period timer_jiffies can be far behind
+	 * jiffies. Rather than stepping through every empty jiffy, go
+	 * straight to the next pending bucket.
+	 */
+	if ((long)(jiffies - clk) > 2) {
+		unsigned long next = __next_timer_interrupt(base,
+						&base->wheels[WHEEL_STD]);
+		unsigned long next_def = __next_timer_interrupt(base,
+						&base->wheels[WHEEL_DEF]);
+
+		if (time_before(next_def, next))
+			next = next_def;
+		if (time_after(next, jiffies)) {
+			/* The caller increments the clock */
+			base->timer_jiffies = jiffies - 1;
+			return 0;
+		}
+		base->timer_jiffies = clk = next;
+	}
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + LVL_OFFS(i);
+
+		for (w = 0; w < NR_WHEELS; w++) {
+			struct tvec_wheel *wheel = &base->wheels[w];
+
+			if (__test_and_clear_bit(idx, wheel->pending_map) &&
+			    !list_empty(wheel->vectors + idx))
+				list_replace_init(wheel->vectors + idx,
+						  heads + levels++);
+		}
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
+
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+		bool irqsafe;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+		irqsafe = tbase_get_irqsafe(timer->base);
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
+
+		if (irqsafe) {
+			spin_unlock(&base->lock);
+			call_timer_fn(timer, fn, data);
+			spin_lock(&base->lock);
+		} else {
+			spin_unlock_irq(&base->lock);
+			call_timer_fn(timer, fn, data);
+			spin_lock_irq(&base->lock);
+		}
+	}
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function expires the due buckets of all the wheel levels and
+ * executes their timers.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH * NR_WHEELS];
+	int levels;
 
 	spin_lock_irq(&base->lock);
 	if (catchup_timer_jiffies(base)) {
@@ -1175,126 +1353,17 @@ static inline void __run_timers(struct tvec_base *base)
 		return;
 	}
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
+		levels = collect_expired_timers(base, heads);
+		base->timer_jiffies++;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, head);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-			bool irqsafe;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-			irqsafe = tbase_get_irqsafe(timer->base);
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
-
-			if (irqsafe) {
-				spin_unlock(&base->lock);
-				call_timer_fn(timer, fn, data);
-				spin_lock(&base->lock);
-			} else {
-				spin_unlock_irq(&base->lock);
-				call_timer_fn(timer, fn, data);
-				spin_lock_irq(&base->lock);
-			}
-		}
+		while (levels--)
+			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
 }
 
 #ifdef CONFIG_NO_HZ_COMMON
-/*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
- */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
-}
-
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1356,11 +1425,9 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 		return expires;
 
 	spin_lock(&base->lock);
-	if (base->active_timers) {
-		if (time_before_eq(base->next_timer, base->timer_jiffies))
-			base->next_timer = __next_timer_interrupt(base);
-		expires = base->next_timer;
-	}
+	if (base->active_timers)
+		expires = __next_timer_interrupt(base,
+						 &base->wheels[WHEEL_STD]);
 	spin_unlock(&base->lock);
 
 	if (time_before_eq(expires, now))
@@ -1535,7 +1602,7 @@ EXPORT_SYMBOL(schedule_timeout_uninterruptible);
 
 static int init_timers_cpu(int cpu)
 {
-	int j;
+	int j, w;
 	struct tvec_base *base;
 	static char tvec_base_done[NR_CPUS];
 
@@ -1575,17 +1642,15 @@ static int init_timers_cpu(int cpu)
 	}
 
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
+	for (w = 0; w < NR_WHEELS; w++) {
+		struct tvec_wheel *wheel = &base->wheels[w];
+
+		bitmap_zero(wheel->pending_map, WHEEL_SIZE);
+		for (j = 0; j < WHEEL_SIZE; j++)
+			INIT_LIST_HEAD(wheel->vectors + j);
 	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
 
 	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
 	base->active_timers = 0;
 	base->all_timers = 0;
 	return 0;
@@ -1609,7 +1674,7 @@ static void migrate_timers(int cpu)
 {
 	struct tvec_base *old_base;
 	struct tvec_base *new_base;
-	int i;
+	int i, w;
 
 	BUG_ON(cpu_online(cpu));
 	old_base = per_cpu(tvec_bases, cpu);
@@ -1623,13 +1688,10 @@ static void migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
+	for (w = 0; w < NR_WHEELS; w++) {
+		for (i = 0; i < WHEEL_SIZE; i++)
+			migrate_timer_list(new_base,
+					   old_base->wheels[w].vectors + i);
 	}
 
 	spin_unlock(&old_base->lock);
@@ -18,6 +18,8 @@
 #include <linux/kernel.h>
 #include <linux/blkdev.h>
 #include <linux/blktrace_api.h>
+#include <linux/cgroup.h>
+#include <linux/kernfs.h>
 #include <linux/percpu.h>
 #include <linux/init.h>
 #include <linux/mutex.h>
@@ -178,10 +180,85 @@ static int act_log_check(struct blk_trace *bt, u32 what, sector_t sector,
 		return 1;
 	if (bt->pid && pid != bt->pid)
 		return 1;
+	if (bt->latency_only &&
+	    (what & ((1 << BLK_TC_SHIFT) - 1)) != __BLK_TA_LATENCY)
+		return 1;
 
 	return 0;
 }
 
+#ifdef CONFIG_BLK_CGROUP
+/*
+ * Is @css the blkio cgroup selected with the "cgroup" attribute, or one of
+ * its descendants?  The attribute takes the inode number of the cgroup's
+ * directory.
+ */
+static bool blk_trace_css_match(struct blk_trace *bt,
+				struct cgroup_subsys_state *css)
+{
+	for (; css; css = css->parent)
+		if (css->cgroup->kn->ino == bt->cgroup)
+			return true;
+	return false;
+}
+
+/* for events issued in the context of the task doing the io */
+static bool blk_trace_task_skip(struct blk_trace *bt)
+{
+	bool skip;
+
+	if (!bt->cgroup)
+		return false;
+
+	rcu_read_lock();
+	skip = !blk_trace_css_match(bt, task_css(current, blkio_cgrp_id));
+	rcu_read_unlock();
+	return skip;
+}
+
+static bool blk_trace_bio_skip(struct blk_trace *bt, struct bio *bio)
+{
+	if (!bt->cgroup)
+		return false;
+	if (bio->bi_css)
+		return !blk_trace_css_match(bt, bio->bi_css);
+	return blk_trace_task_skip(bt);
+}
+
+/*
+ * Requests are charged to the blkcg of their request_list, fall back to
+ * the bio for those without one.  Requests we can't tell are not logged.
+ */
+static bool blk_trace_rq_skip(struct blk_trace *bt, struct request *rq)
+{
+	struct cgroup_subsys_state *css;
+
+	if (!bt->cgroup)
+		return false;
+
+	css = blk_rq_blkcg_css(rq);
+	if (!css && rq->bio)
+		css = rq->bio->bi_css;
+	return !css || !blk_trace_css_match(bt, css);
+}
+#else
+static inline bool blk_trace_task_skip(struct blk_trace *bt)
+{
+	return false;
+}
+
+static inline bool blk_trace_bio_skip(struct blk_trace *bt, struct bio *bio)
+{
+	return false;
+}
+
+static inline bool blk_trace_rq_skip(struct blk_trace *bt,
+				     struct request *rq)
+{
+	return false;
+}
+#endif
+
 /*
  * Data direction bit lookup
  */
@@ -717,6 +794,9 @@ static void blk_add_trace_rq(struct request_queue *q, struct request *rq,
 	if (likely(!bt))
 		return;
 
+	if (blk_trace_rq_skip(bt, rq))
+		return;
+
 	if (rq->cmd_type == REQ_TYPE_BLOCK_PC) {
 		what |= BLK_TC_ACT(BLK_TC_PC);
 		__blk_add_trace(bt, 0, nr_bytes, rq->cmd_flags,
@@ -753,12 +833,58 @@ static void blk_add_trace_rq_requeue(void *ignore,
 	blk_add_trace_rq(q, rq, blk_rq_bytes(rq), BLK_TA_REQUEUE);
 }
 
+static void blk_trace_rq_latency(struct request *rq,
+				 struct blk_io_trace_latency *lat)
+{
+#ifdef CONFIG_BLK_CGROUP
+	u64 now = sched_clock();
+	u64 start = rq_start_time_ns(rq), io_start = rq_io_start_time_ns(rq);
+
+	lat->total_ns = now > start ? now - start : 0;
+	lat->io_ns = io_start && now > io_start ? now - io_start : 0;
+#else
+	lat->total_ns = jiffies_to_nsecs(jiffies - rq->start_time);
+	lat->io_ns = 0;
+#endif
+}
+
 static void blk_add_trace_rq_complete(void *ignore,
 				      struct request_queue *q,
 				      struct request *rq,
 				      unsigned int nr_bytes)
 {
-	blk_add_trace_rq(q, rq, nr_bytes, BLK_TA_COMPLETE);
+	struct blk_trace *bt = q->blk_trace;
+	struct blk_io_trace_latency lat;
+	u32 what = BLK_TA_LATENCY;
+
+	if (likely(!bt))
+		return;
+
+	if (bt->min_latency || bt->latency_only) {
+		blk_trace_rq_latency(rq, &lat);
+		if (lat.total_ns < bt->min_latency)
+			return;
+	}
+
+	if (!bt->latency_only) {
+		blk_add_trace_rq(q, rq, nr_bytes, BLK_TA_COMPLETE);
+		return;
+	}
+
+	if (blk_trace_rq_skip(bt, rq))
+		return;
+
+	lat.total_ns = cpu_to_be64(lat.total_ns);
+	lat.io_ns = cpu_to_be64(lat.io_ns);
+
+	if (rq->cmd_type == REQ_TYPE_BLOCK_PC)
+		__blk_add_trace(bt, 0, nr_bytes, rq->cmd_flags,
+				what | BLK_TC_ACT(BLK_TC_PC), rq->errors,
+				sizeof(lat), &lat);
+	else
+		__blk_add_trace(bt, blk_rq_pos(rq), nr_bytes, rq->cmd_flags,
+				what | BLK_TC_ACT(BLK_TC_FS), rq->errors,
+				sizeof(lat), &lat);
 }
 
 /**
@@ -780,6 +906,9 @@ static void blk_add_trace_bio(struct request_queue *q, struct bio *bio,
 	if (likely(!bt))
 		return;
 
+	if (blk_trace_bio_skip(bt, bio))
+		return;
+
 	if (!error && !bio_flagged(bio, BIO_UPTODATE))
 		error = EIO;
 
@@ -831,7 +960,7 @@ static void blk_add_trace_getrq(void *ignore,
 	else {
 		struct blk_trace *bt = q->blk_trace;
 
-		if (bt)
+		if (bt && !blk_trace_task_skip(bt))
 			__blk_add_trace(bt, 0, 0, rw, BLK_TA_GETRQ, 0, 0, NULL);
 	}
 }
@@ -846,7 +975,7 @@ static void blk_add_trace_sleeprq(void *ignore,
 	else {
 		struct blk_trace *bt = q->blk_trace;
 
-		if (bt)
+		if (bt && !blk_trace_task_skip(bt))
 			__blk_add_trace(bt, 0, 0, rw, BLK_TA_SLEEPRQ,
 					0, 0, NULL);
 	}
@@ -856,7 +985,7 @@ static void blk_add_trace_plug(void *ignore, struct request_queue *q)
 {
 	struct blk_trace *bt = q->blk_trace;
 
-	if (bt)
+	if (bt && !blk_trace_task_skip(bt))
 		__blk_add_trace(bt, 0, 0, 0, BLK_TA_PLUG, 0, 0, NULL);
 }
 
@@ -865,7 +994,7 @@ static void blk_add_trace_unplug(void *ignore, struct request_queue *q,
 {
 	struct blk_trace *bt = q->blk_trace;
 
-	if (bt) {
+	if (bt && !blk_trace_task_skip(bt)) {
 		__be64 rpdu = cpu_to_be64(depth);
 		u32 what;
 
@@ -884,7 +1013,7 @@ static void blk_add_trace_split(void *ignore,
 {
 	struct blk_trace *bt = q->blk_trace;
 
-	if (bt) {
+	if (bt && !blk_trace_bio_skip(bt, bio)) {
 		__be64 rpdu = cpu_to_be64(pdu);
 
 		__blk_add_trace(bt, bio->bi_iter.bi_sector,
@@ -914,7 +1043,7 @@ static void blk_add_trace_bio_remap(void *ignore,
 	struct blk_trace *bt = q->blk_trace;
 	struct blk_io_trace_remap r;
 
-	if (likely(!bt))
+	if (likely(!bt) || blk_trace_bio_skip(bt, bio))
 		return;
 
 	r.device_from = cpu_to_be32(dev);
@@ -947,7 +1076,7 @@ static void blk_add_trace_rq_remap(void *ignore,
 	struct blk_trace *bt = q->blk_trace;
 	struct blk_io_trace_remap r;
 
-	if (likely(!bt))
+	if (likely(!bt) || blk_trace_rq_skip(bt, rq))
 		return;
 
 	r.device_from = cpu_to_be32(dev);
@@ -976,7 +1105,7 @@ void blk_add_driver_data(struct request_queue *q,
 {
 	struct blk_trace *bt = q->blk_trace;
 
-	if (likely(!bt))
+	if (likely(!bt) || blk_trace_rq_skip(bt, rq))
 		return;
 
 	if (rq->cmd_type == REQ_TYPE_BLOCK_PC)
@@ -1292,6 +1421,20 @@ static int blk_log_split(struct trace_seq *s, const struct trace_entry *ent)
 				get_pdu_int(ent), cmd);
 }
 
+static int blk_log_latency(struct trace_seq *s, const struct trace_entry *ent)
+{
+	const struct blk_io_trace_latency *lat = pdu_start(ent);
+	unsigned long long total = be64_to_cpu(lat->total_ns);
+	unsigned long long io = be64_to_cpu(lat->io_ns);
+
+	if (t_action(ent) & BLK_TC_ACT(BLK_TC_PC))
+		return trace_seq_printf(s, "%u %llu (%llu) [%d]\n",
+					t_bytes(ent), total, io, t_error(ent));
+	return trace_seq_printf(s, "%llu + %u %llu (%llu) [%d]\n",
+				t_sector(ent), t_sec(ent), total, io,
+				t_error(ent));
+}
+
 static int blk_log_msg(struct trace_seq *s, const struct trace_entry *ent)
 {
 	int ret;
@@ -1356,6 +1499,7 @@ static const struct {
 	[__BLK_TA_SPLIT]	= {{  "X", "split" },	   blk_log_split },
 	[__BLK_TA_BOUNCE]	= {{  "B", "bounce" },	   blk_log_generic },
 	[__BLK_TA_REMAP]	= {{  "A", "remap" },	   blk_log_remap },
+	[__BLK_TA_LATENCY]	= {{  "L", "latency" },	   blk_log_latency },
 };
 
 static enum print_line_t print_one_line(struct trace_iterator *iter,
@@ -1380,7 +1524,8 @@ static enum print_line_t print_one_line(struct trace_iterator *iter,
 		goto out;
 	}
 
-	if (unlikely(what == 0 || what >= ARRAY_SIZE(what2act)))
+	if (unlikely(what == 0 || what >= ARRAY_SIZE(what2act) ||
+		     !what2act[what].print))
 		ret = trace_seq_printf(s, "Unknown action %x\n", what);
 	else {
 		ret = log_action(iter, what2act[what].act[long_act]);
@@ -1558,6 +1703,9 @@ static BLK_TRACE_DEVICE_ATTR(act_mask);
 static BLK_TRACE_DEVICE_ATTR(pid);
 static BLK_TRACE_DEVICE_ATTR(start_lba);
 static BLK_TRACE_DEVICE_ATTR(end_lba);
+static BLK_TRACE_DEVICE_ATTR(cgroup);
+static BLK_TRACE_DEVICE_ATTR(min_latency_us);
+static BLK_TRACE_DEVICE_ATTR(latency_only);
 
 static struct attribute *blk_trace_attrs[] = {
 	&dev_attr_enable.attr,
@@ -1565,6 +1713,11 @@ static struct attribute *blk_trace_attrs[] = {
 	&dev_attr_pid.attr,
 	&dev_attr_start_lba.attr,
 	&dev_attr_end_lba.attr,
+#ifdef CONFIG_BLK_CGROUP
+	&dev_attr_cgroup.attr,
+#endif
+	&dev_attr_min_latency_us.attr,
+	&dev_attr_latency_only.attr,
 	NULL
 };
 
@@ -1687,6 +1840,14 @@ static ssize_t sysfs_blk_trace_attr_show(struct device *dev,
 		ret = sprintf(buf, "%llu\n", q->blk_trace->start_lba);
 	else if (attr == &dev_attr_end_lba)
 		ret = sprintf(buf, "%llu\n", q->blk_trace->end_lba);
+	else if (attr == &dev_attr_cgroup)
+		ret = sprintf(buf, "%llu\n", q->blk_trace->cgroup);
+	else if (attr == &dev_attr_min_latency_us)
+		ret = sprintf(buf, "%llu\n",
+			      div_u64(q->blk_trace->min_latency,
+				      NSEC_PER_USEC));
+	else if (attr == &dev_attr_latency_only)
+		ret = sprintf(buf, "%u\n", q->blk_trace->latency_only);
 
 out_unlock_bdev:
 	mutex_unlock(&bdev->bd_mutex);
@@ -1754,6 +1915,12 @@ static ssize_t sysfs_blk_trace_attr_store(struct device *dev,
 			q->blk_trace->start_lba = value;
 		else if (attr == &dev_attr_end_lba)
 			q->blk_trace->end_lba = value;
+		else if (attr == &dev_attr_cgroup)
+			q->blk_trace->cgroup = value;
+		else if (attr == &dev_attr_min_latency_us)
+			q->blk_trace->min_latency = value * NSEC_PER_USEC;
+		else if (attr == &dev_attr_latency_only)
+			q->blk_trace->latency_only = !!value;
 	}
 
 out_unlock_bdev:
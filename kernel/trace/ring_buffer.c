@@ -6,6 +6,7 @@
 #include <linux/ftrace_event.h>
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
 #include <linux/irq_work.h>
@@ -14,6 +15,7 @@
 #include <linux/hardirq.h>
 #include <linux/kthread.h>	/* for self test */
 #include <linux/kmemcheck.h>
+#include <linux/highmem.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/mutex.h>
@@ -356,6 +358,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* sub-buffer id when mapped */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -489,6 +492,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mappings, see ring_buffer_map() */
+	unsigned int			mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* id to page address */
 };
 
 struct ring_buffer {
@@ -1694,6 +1702,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 	/* prevent another thread from changing buffer sizes */
 	mutex_lock(&buffer->mutex);
 
+	/* ring_buffer_map() may have disabled resizing meanwhile */
+	if (atomic_read(&buffer->resize_disabled)) {
+		mutex_unlock(&buffer->mutex);
+		return -EBUSY;
+	}
+
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
 		for_each_buffer_cpu(buffer, cpu) {
@@ -4141,6 +4155,19 @@ unsigned long ring_buffer_size(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_size);
 
+/* Must be called with the reader_lock held */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	flush_dcache_page(virt_to_page(meta));
+}
+
 static void
 rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4213,6 +4240,13 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped) {
+		cpu_buffer->meta_page->reader.lost_events = 0;
+		cpu_buffer->meta_page->reader.read = 0;
+		cpu_buffer->meta_page->reader.commit = 0;
+		rb_update_meta_page(cpu_buffer);
+	}
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4326,6 +4360,11 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* User space must keep seeing the pages it has mapped */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (ring_buffer_flags != RB_BUFFERS_ON)
@@ -4505,12 +4544,14 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the pages are mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -4619,6 +4660,278 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * Give each page the id user space addresses it by: the reader page
+ * is 0 and the ring follows from the head page.  The reader_lock must
+ * be held so that no reader swaps pages meanwhile, and buffer->mutex
+ * so that the ring cannot be resized.
+ */
+static int rb_setup_ids(struct ring_buffer_per_cpu *cpu_buffer,
+			unsigned long *subbuf_ids)
+{
+	struct buffer_page *first, *bpage;
+	unsigned id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first = bpage = rb_set_head_page(cpu_buffer);
+	if (!first)
+		return -ENODEV;
+
+	do {
+		if (RB_WARN_ON(cpu_buffer, id > cpu_buffer->nr_pages))
+			return -EINVAL;
+		subbuf_ids[id] = (unsigned long)bpage->page;
+		bpage->id = id++;
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (bpage != first);
+
+	return 0;
+}
+
+static void rb_setup_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = cpu_buffer->nr_pages + 1;
+
+	/* Nothing is handed out until the first ioctl */
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.commit = meta->reader.read;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+/* Must be called with buffer->mutex held */
+static void rb_get_mapped(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped++;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+}
+
+/* Must be called with buffer->mutex held */
+static void rb_put_mapped(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (--cpu_buffer->mapped) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return;
+	}
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+	atomic_dec(&cpu_buffer->buffer->resize_disabled);
+}
+
+/**
+ * ring_buffer_map - map a per CPU buffer read-only into user space
+ * @buffer: the buffer the CPU buffer belongs to
+ * @cpu: the CPU buffer to map
+ * @vma: the mapping to populate, starting at offset 0
+ *
+ * The first page of the mapping is a struct trace_buffer_meta, the
+ * sub-buffers follow in id order.  As long as any mapping exists the
+ * buffer cannot be resized, swapped or spliced from without copying,
+ * so that user space keeps seeing the pages the ids refer to.
+ *
+ * Returns 0 on success, or a negative errno.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta = NULL;
+	unsigned long *subbuf_ids = NULL;
+	unsigned long flags, i;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	mutex_lock(&buffer->mutex);
+
+	if (vma->vm_pgoff || vma_pages(vma) > cpu_buffer->nr_pages + 2) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	if (cpu_buffer->mapped) {
+		rb_get_mapped(cpu_buffer);
+		goto map;
+	}
+
+	err = -ENOMEM;
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!meta || !subbuf_ids)
+		goto out_free;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	err = rb_setup_ids(cpu_buffer, subbuf_ids);
+	if (!err) {
+		cpu_buffer->meta_page = meta;
+		cpu_buffer->subbuf_ids = subbuf_ids;
+		rb_setup_meta_page(cpu_buffer);
+		cpu_buffer->mapped = 1;
+	}
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+	if (err)
+		goto out_free;
+
+	atomic_inc(&buffer->resize_disabled);
+
+ map:
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+
+	err = vm_insert_page(vma, vma->vm_start,
+			     virt_to_page(cpu_buffer->meta_page));
+	for (i = 1; !err && i < vma_pages(vma); i++) {
+		void *page = (void *)cpu_buffer->subbuf_ids[i - 1];
+
+		err = vm_insert_page(vma, vma->vm_start + i * PAGE_SIZE,
+				     virt_to_page(page));
+	}
+	if (err)
+		rb_put_mapped(cpu_buffer);
+	goto out;
+
+ out_free:
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of an existing mapping
+ * @buffer: the buffer the CPU buffer belongs to
+ * @cpu: the mapped CPU buffer
+ *
+ * For the vm open() callback, when a mapping is split in two.
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		rb_get_mapped(cpu_buffer);
+	mutex_unlock(&buffer->mutex);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - drop a mapping set up by ring_buffer_map()
+ * @buffer: the buffer the CPU buffer belongs to
+ * @cpu: the mapped CPU buffer
+ *
+ * Returns 0 on success, or -ENODEV if @cpu was not mapped.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+	if (cpu_buffer->mapped)
+		rb_put_mapped(cpu_buffer);
+	else
+		err = -ENODEV;
+	mutex_unlock(&buffer->mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events to a mapped reader
+ * @buffer: the buffer the CPU buffer belongs to
+ * @cpu: the mapped CPU buffer
+ *
+ * The range announced by the previous call is considered consumed.
+ * Everything committed to the reader page since is handed out next,
+ * and if there is nothing left on it, the next page is swapped in
+ * first.  The meta page tells where the new range is.
+ *
+ * Returns 0 on success, or -EINVAL if @cpu is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned commit;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return -EINVAL;
+	}
+
+	meta = cpu_buffer->meta_page;
+	reader = rb_get_reader_page(cpu_buffer);
+	if (reader) {
+		meta->reader.read = reader->read;
+		meta->reader.lost_events = cpu_buffer->lost_events;
+		cpu_buffer->lost_events = 0;
+
+		/* Whatever user space is being given is consumed */
+		commit = rb_page_size(reader);
+		while (reader->read < commit)
+			rb_advance_reader(cpu_buffer);
+		meta->reader.commit = commit;
+
+		flush_dcache_page(virt_to_page(reader->page));
+	} else {
+		meta->reader.read = cpu_buffer->reader_page->read;
+		meta->reader.commit = meta->reader.read;
+		meta->reader.lost_events = 0;
+	}
+	rb_update_meta_page(cpu_buffer);
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
@@ -39,6 +39,7 @@
 #include <linux/nmi.h>
 #include <linux/fs.h>
 #include <linux/sched/rt.h>
+#include <linux/trace_mmap.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -601,6 +602,10 @@ static int alloc_snapshot(struct trace_array *tr)
 
 	if (!tr->allocated_snapshot) {
 
+		/* The mapped pages must not be swapped away */
+		if (atomic_read(&tr->mapped))
+			return -EBUSY;
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->trace_buffer, RING_BUFFER_ALL_CPUS);
@@ -5694,12 +5699,78 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	return ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					  iter->cpu_file);
+}
+
+/*
+ * vm_private_data records the ring buffer that was mapped, the
+ * iterator's one may be swapped with the snapshot buffer later.
+ */
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	ring_buffer_map_dup(vma->vm_private_data, info->iter.cpu_file);
+	atomic_inc(&info->iter.tr->mapped);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	WARN_ON(ring_buffer_unmap(vma->vm_private_data, info->iter.cpu_file));
+	atomic_dec(&info->iter.tr->mapped);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	if (iter->tr->allocated_snapshot)
+		return -EBUSY;
+#endif
+
+	vma->vm_private_data = iter->trace_buffer->buffer;
+	ret = ring_buffer_map(vma->vm_private_data, iter->cpu_file, vma);
+	if (ret)
+		return ret;
+
+	vma->vm_ops = &tracing_buffers_vmops;
+	atomic_inc(&iter->tr->mapped);
+
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.compat_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -207,6 +207,8 @@ struct trace_array {
 	 */
 	arch_spinlock_t		max_lock;
 	int			buffer_disabled;
+	/* number of trace_pipe_raw mappings, which exclude snapshots */
+	atomic_t		mapped;
 #ifdef CONFIG_FTRACE_SYSCALLS
 	int			sys_refcount_enter;
 	int			sys_refcount_exit;
@@ -993,6 +995,7 @@ struct event_filter {
 	int			a_preds;	/* allocated */
 	struct filter_pred	*preds;
 	struct filter_pred	*root;
+	struct bpf_prog		*prog;		/* compiled preds, if any */
 	char			*filter_string;
 };
 
@@ -1124,7 +1127,9 @@ struct event_trigger_data {
  * @func: The trigger 'probe' function called when the triggering
  *	event occurs.  The data passed into this callback is the data
  *	that was supplied to the event_command @reg() function that
- *	registered the trigger (see struct event_command).
+ *	registered the trigger (see struct event_command), along with
+ *	the trace record of the event, or NULL when the trigger is
+ *	invoked unconditionally or after the record has been committed.
  *
  * @init: An optional initialization function called for the trigger
  *	when the trigger is registered (via the event_command reg()
@@ -1149,7 +1154,8 @@ struct event_trigger_data {
  *	(see trace_event_triggers.c).
  */
 struct event_trigger_ops {
-	void			(*func)(struct event_trigger_data *data);
+	void			(*func)(struct event_trigger_data *data,
+					void *rec);
 	int			(*init)(struct event_trigger_ops *ops,
 					struct event_trigger_data *data);
 	void			(*free)(struct event_trigger_ops *ops,
@@ -1212,6 +1218,12 @@ struct event_trigger_ops {
  *	itself logs to the trace buffer, this flag should be set,
  *	otherwise it can be left unspecified.
  *
+ * @needs_rec: A flag that says whether or not this command needs
+ *	the trace record of the event to be passed to its @func()
+ *	probe even when it has no filter, such as a command that
+ *	reads the event fields.  Such commands make the event go
+ *	through the conditional, post-record path every time.
+ *
  * All the methods below, except for @set_filter(), must be
  * implemented.
  *
@@ -1252,6 +1264,7 @@ struct event_command {
 	char			*name;
 	enum event_trigger_type	trigger_type;
 	bool			post_trigger;
+	bool			needs_rec;
 	int			(*func)(struct event_command *cmd_ops,
 					struct ftrace_event_file *file,
 					char *glob, char *cmd, char *params);
@@ -1271,6 +1284,25 @@ struct event_command {
 
 extern int trace_event_enable_disable(struct ftrace_event_file *file,
 				      int enable, int soft_disable);
+
+extern void trigger_data_free(struct event_trigger_data *data);
+extern int register_trigger(char *glob, struct event_trigger_ops *ops,
+			    struct event_trigger_data *data,
+			    struct ftrace_event_file *file);
+extern void unregister_trigger(char *glob, struct event_trigger_ops *ops,
+			       struct event_trigger_data *test,
+			       struct ftrace_event_file *file);
+extern int set_trigger_filter(char *filter_str,
+			      struct event_trigger_data *trigger_data,
+			      struct ftrace_event_file *file);
+extern int register_event_command(struct event_command *cmd);
+
+#ifdef CONFIG_HIST_TRIGGERS
+extern const struct file_operations event_hist_fops;
+extern int register_trigger_hist_cmd(void);
+#else
+static inline int register_trigger_hist_cmd(void) { return 0; }
+#endif
 extern int tracing_alloc_snapshot(void);
 
 extern const char *__start___trace_bprintk_fmt[];
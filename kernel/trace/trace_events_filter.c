@@ -22,6 +22,7 @@
 #include <linux/ctype.h>
 #include <linux/mutex.h>
 #include <linux/perf_event.h>
+#include <linux/filter.h>
 #include <linux/slab.h>
 
 #include "trace.h"
@@ -535,17 +536,29 @@ static int filter_match_preds_cb(enum move_type move, struct filter_pred *pred,
 	return WALK_PRED_DEFAULT;
 }
 
-/* return 1 if event matches, 0 otherwise (discard) */
-int filter_match_preds(struct event_filter *filter, void *rec)
+static int __filter_match_preds(struct filter_pred *preds,
+				struct filter_pred *root, void *rec)
 {
-	struct filter_pred *preds;
-	struct filter_pred *root;
 	struct filter_match_preds_data data = {
+		.preds = preds,
 		/* match is currently meaningless */
 		.match = -1,
 		.rec   = rec,
 	};
-	int n_preds, ret;
+	int ret;
+
+	ret = walk_pred_tree(preds, root, filter_match_preds_cb, &data);
+	WARN_ON(ret);
+	return data.match;
+}
+
+/* return 1 if event matches, 0 otherwise (discard) */
+int filter_match_preds(struct event_filter *filter, void *rec)
+{
+	struct filter_pred *preds;
+	struct filter_pred *root;
+	struct bpf_prog *prog;
+	int n_preds;
 
 	/* no filter is considered a match */
 	if (!filter)
@@ -562,10 +575,12 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 	if (!root)
 		return 1;
 
-	data.preds = preds = rcu_dereference_sched(filter->preds);
-	ret = walk_pred_tree(preds, root, filter_match_preds_cb, &data);
-	WARN_ON(ret);
-	return data.match;
+	prog = rcu_dereference_sched(filter->prog);
+	if (prog)
+		return BPF_PROG_RUN(prog, rec);
+
+	preds = rcu_dereference_sched(filter->preds);
+	return __filter_match_preds(preds, root, rec);
 }
 EXPORT_SYMBOL_GPL(filter_match_preds);
 
@@ -770,6 +785,10 @@ static void __free_preds(struct event_filter *filter)
 		kfree(filter->preds);
 		filter->preds = NULL;
 	}
+	if (filter->prog) {
+		bpf_prog_free(filter->prog);
+		filter->prog = NULL;
+	}
 	filter->a_preds = 0;
 	filter->n_preds = 0;
 }
@@ -1543,6 +1562,207 @@ static int fold_pred_tree(struct event_filter *filter,
 			      filter->preds);
 }
 
+/*
+ * Once the tree is built it is also compiled to eBPF, so matching an
+ * event runs straight line (and possibly JITed) code rather than
+ * walking the tree.  The record comes in R1 and is kept in R6, every
+ * leaf leaves its match in R0, and AND/OR short circuit on it.  Integer
+ * compares are inlined, the other preds call their filter_pred_fn_t.
+ * Anything that does not fit in BPF_MAXINSNS is left to the tree walk.
+ */
+struct filter_bpf_data {
+	struct filter_pred	*preds;
+	struct bpf_insn		*insns;
+	int			len;
+	int			*jmps;	/* pending forward jump, by pred */
+};
+
+static void filter_bpf_emit(struct filter_bpf_data *d, struct bpf_insn insn)
+{
+	if (d->len < BPF_MAXINSNS)
+		d->insns[d->len] = insn;
+	d->len++;
+}
+
+/* Point the jump at @jmp to the next insn to be emitted */
+static void filter_bpf_fixup(struct filter_bpf_data *d, int jmp)
+{
+	if (jmp < BPF_MAXINSNS)
+		d->insns[jmp].off = d->len - jmp - 1;
+}
+
+static void filter_bpf_jmp(struct filter_bpf_data *d, int idx, int op)
+{
+	d->jmps[idx] = d->len;
+	filter_bpf_emit(d, BPF_JMP_IMM(op == OP_OR ? BPF_JNE : BPF_JEQ,
+				       BPF_REG_0, 0, 0));
+}
+
+static u64 filter_bpf_call_pred(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct filter_pred *pred = (struct filter_pred *) (unsigned long) r1;
+
+	return pred->fn(pred, (void *) (unsigned long) r2);
+}
+
+static void filter_bpf_call(struct filter_bpf_data *d, struct filter_pred *pred)
+{
+	struct bpf_insn ld[] = { BPF_LD_IMM64(BPF_REG_1, (unsigned long) pred) };
+
+	filter_bpf_emit(d, ld[0]);
+	filter_bpf_emit(d, ld[1]);
+	filter_bpf_emit(d, BPF_MOV64_REG(BPF_REG_2, BPF_REG_6));
+	filter_bpf_emit(d, BPF_EMIT_CALL(filter_bpf_call_pred));
+}
+
+static int filter_bpf_size(int size)
+{
+	switch (size) {
+	case 8:
+		return BPF_DW;
+	case 4:
+		return BPF_W;
+	case 2:
+		return BPF_H;
+	default:
+		return BPF_B;
+	}
+}
+
+/* Same as the DEFINE_COMPARISON_PRED/DEFINE_EQUALITY_PRED preds */
+static void filter_bpf_leaf(struct filter_bpf_data *d, struct filter_pred *pred)
+{
+	struct ftrace_event_field *field = pred->field;
+	int shift = 64 - field->size * 8;
+	bool is_signed = field->is_signed;
+	bool invert = false;
+	u64 val = pred->val << shift;
+	int op;
+
+	if (is_string_field(field) || is_function_field(field) ||
+	    pred->fn == filter_pred_none) {
+		filter_bpf_call(d, pred);
+		return;
+	}
+
+	switch (pred->op) {
+	case OP_EQ:
+		op = BPF_JEQ;
+		is_signed = false;
+		break;
+	case OP_NE:
+		op = BPF_JNE;
+		is_signed = false;
+		break;
+	case OP_LT:
+		invert = true;
+		/* fall through */
+	case OP_GE:
+		op = is_signed ? BPF_JSGE : BPF_JGE;
+		break;
+	case OP_LE:
+		invert = true;
+		/* fall through */
+	case OP_GT:
+		op = is_signed ? BPF_JSGT : BPF_JGT;
+		break;
+	default:
+		op = BPF_JSET;
+		break;
+	}
+
+	/* Both sides are extended from the field size to 64 bits */
+	val = is_signed ? (u64) ((s64) val >> shift) : val >> shift;
+
+	filter_bpf_emit(d, BPF_LDX_MEM(filter_bpf_size(field->size),
+				       BPF_REG_2, BPF_REG_6, pred->offset));
+	if (is_signed && shift) {
+		filter_bpf_emit(d, BPF_ALU64_IMM(BPF_LSH, BPF_REG_2, shift));
+		filter_bpf_emit(d, BPF_ALU64_IMM(BPF_ARSH, BPF_REG_2, shift));
+	}
+	filter_bpf_emit(d, BPF_MOV64_IMM(BPF_REG_0, !invert));
+	if ((s64) (s32) val == (s64) val) {
+		filter_bpf_emit(d, BPF_JMP_IMM(op, BPF_REG_2, val, 1));
+	} else {
+		struct bpf_insn ld[] = { BPF_LD_IMM64(BPF_REG_3, val) };
+
+		filter_bpf_emit(d, ld[0]);
+		filter_bpf_emit(d, ld[1]);
+		filter_bpf_emit(d, BPF_JMP_REG(op, BPF_REG_2, BPF_REG_3, 1));
+	}
+	filter_bpf_emit(d, BPF_MOV64_IMM(BPF_REG_0, invert));
+}
+
+static int filter_bpf_cb(enum move_type move, struct filter_pred *pred,
+			 int *err, void *data)
+{
+	struct filter_bpf_data *d = data;
+	int idx = pred - d->preds;
+	int i;
+
+	*err = 0;
+	switch (move) {
+	case MOVE_DOWN:
+		if (pred->left == FILTER_PRED_INVALID) {
+			filter_bpf_leaf(d, pred);
+			return WALK_PRED_PARENT;
+		}
+		if (!pred->ops)
+			return WALK_PRED_DEFAULT;
+
+		/* Folded ops short circuit straight to their end */
+		for (i = 0; i < pred->val; i++) {
+			filter_bpf_leaf(d, &d->preds[pred->ops[i]]);
+			if (i < pred->val - 1)
+				filter_bpf_jmp(d, pred->ops[i], pred->op);
+		}
+		for (i = 0; i < pred->val - 1; i++)
+			filter_bpf_fixup(d, d->jmps[pred->ops[i]]);
+		return WALK_PRED_PARENT;
+	case MOVE_UP_FROM_LEFT:
+		filter_bpf_jmp(d, idx, pred->op);
+		break;
+	case MOVE_UP_FROM_RIGHT:
+		filter_bpf_fixup(d, d->jmps[idx]);
+		break;
+	}
+
+	return WALK_PRED_DEFAULT;
+}
+
+static void filter_compile_bpf(struct event_filter *filter,
+			       struct filter_pred *root)
+{
+	struct filter_bpf_data d = {
+		.preds = filter->preds,
+	};
+	struct bpf_prog *prog;
+	int err;
+
+	d.insns = kmalloc_array(BPF_MAXINSNS, sizeof(*d.insns), GFP_KERNEL);
+	d.jmps = kmalloc_array(filter->n_preds, sizeof(*d.jmps), GFP_KERNEL);
+	if (!d.insns || !d.jmps)
+		goto out;
+
+	filter_bpf_emit(&d, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	err = walk_pred_tree(filter->preds, root, filter_bpf_cb, &d);
+	filter_bpf_emit(&d, BPF_EXIT_INSN());
+	if (err || d.len > BPF_MAXINSNS)
+		goto out;
+
+	prog = bpf_prog_alloc(bpf_prog_size(d.len), 0);
+	if (!prog)
+		goto out;
+
+	prog->len = d.len;
+	memcpy(prog->insnsi, d.insns, d.len * sizeof(*d.insns));
+	bpf_prog_select_runtime(prog);
+	filter->prog = prog;
+out:
+	kfree(d.jmps);
+	kfree(d.insns);
+}
+
 static int replace_preds(struct ftrace_event_call *call,
 			 struct event_filter *filter,
 			 struct filter_parse_state *ps,
@@ -1634,6 +1854,9 @@ static int replace_preds(struct ftrace_event_call *call,
 		if (err)
 			goto fail;
 
+		/* Failing to compile just leaves matching to the tree */
+		filter_compile_bpf(filter, root);
+
 		/* We don't set root until we know it works */
 		barrier();
 		filter->root = root;
@@ -2354,6 +2577,7 @@ static __init int ftrace_test_event_filter(void)
 	for (i = 0; i < DATA_CNT; i++) {
 		struct event_filter *filter = NULL;
 		struct test_filter_data_t *d = &test_filter_data[i];
+		int prog_err = 0;
 		int err;
 
 		err = create_filter(&event_ftrace_test_filter, d->filter,
@@ -2371,15 +2595,27 @@ static __init int ftrace_test_event_filter(void)
 		 * tests, but the rcu dereference will complain without it.
 		 */
 		preempt_disable();
+		if (filter->prog)
+			prog_err = BPF_PROG_RUN(filter->prog, &d->rec);
+
 		if (*d->not_visited)
 			walk_pred_tree(filter->preds, filter->root,
 				       test_walk_pred_cb,
 				       d->not_visited);
 
 		test_pred_visited = 0;
-		err = filter_match_preds(filter, &d->rec);
+		err = __filter_match_preds(filter->preds, filter->root,
+					   &d->rec);
 		preempt_enable();
 
+		if (filter->prog && prog_err != d->match) {
+			printk(KERN_INFO
+			       "Failed to match compiled filter '%s', expected %d\n",
+			       d->filter, d->match);
+			__free_filter(filter);
+			break;
+		}
+
 		__free_filter(filter);
 
 		if (test_pred_visited) {
@@ -0,0 +1,1260 @@
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/trace_clock.h>
+
+#include "trace.h"
+
+/*
+ * A hist trigger aggregates the events it is hit by into a hash map,
+ * keyed by up to HIST_KEYS_MAX event fields, counting hits and summing
+ * up to HIST_VALS_MAX values per key:
+ *
+ *   hist:keys=<field>[,<field>]...[:vals=<expr>[,<expr>]...]
+ *	[:<var>=<expr>]...[:sort=<field>[.descending]][:size=<entries>]
+ *	[:pause|:cont|:clear] [if <filter>]
+ *
+ * An <expr> is a numeric field, common_timestamp, a $<var> reference,
+ * or the difference of two of those.  Fields take .hex, .sym or .usecs
+ * modifiers.  A <var> is saved per key, and an expression on another
+ * event (with the same kind of key) refers to it as $<var>, which is
+ * what allows computing latencies between two events.  A variable is
+ * consumed when it is referenced; events whose key has no saved value
+ * for a referenced variable are not counted.
+ *
+ * The map is preallocated and lock-free, so that it can be updated
+ * from any context the event fires in.  It is read through the 'hist'
+ * file of the event.
+ */
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		4
+#define HIST_VARS_MAX		4
+#define HIST_REFS_MAX		4
+#define HIST_SORT_KEYS_MAX	2
+#define HIST_KEY_STR_MAX	32	/* bytes of a string field in the key */
+
+#define HIST_BITS_DEFAULT	11
+#define HIST_BITS_MIN		7
+#define HIST_BITS_MAX		17
+
+enum hist_field_flags {
+	HIST_FIELD_FL_STRING	= 1 << 0,
+	HIST_FIELD_FL_HEX	= 1 << 1,
+	HIST_FIELD_FL_SYM	= 1 << 2,
+	HIST_FIELD_FL_TIMESTAMP	= 1 << 3,
+	HIST_FIELD_FL_USECS	= 1 << 4,
+	HIST_FIELD_FL_VAR_REF	= 1 << 5,
+};
+
+struct hist_operand;
+
+typedef u64 (*hist_operand_fn_t) (struct hist_operand *op, void *rec);
+
+/* An event field, the timestamp, or a reference to a variable */
+struct hist_operand {
+	hist_operand_fn_t		fn;
+	struct ftrace_event_field	*field;
+	unsigned long			flags;
+	unsigned int			ref;	/* index in refs[] */
+};
+
+/* A key, a value or a variable: an operand or a difference of two */
+struct hist_field {
+	char			*name;
+	char			*var_name;
+	struct hist_operand	operands[2];
+	unsigned int		n_operands;
+	unsigned long		flags;
+	unsigned int		offset;	/* of a key in the compound key */
+	unsigned int		size;
+};
+
+struct hist_trigger_data;
+
+struct hist_var_ref {
+	struct hist_trigger_data	*hist_data;	/* defining the var */
+	unsigned int			idx;
+};
+
+enum hist_sort_type {
+	HIST_SORT_HITCOUNT,
+	HIST_SORT_KEY,
+	HIST_SORT_VAL,
+};
+
+struct hist_sort_key {
+	enum hist_sort_type	type;
+	unsigned int		idx;
+	bool			descending;
+};
+
+struct hist_elt {
+	struct hist_trigger_data	*hist_data;
+	atomic64_t			hitcount;
+	atomic64_t			sums[HIST_VALS_MAX];
+	u64				vars[HIST_VARS_MAX];
+	unsigned long			vars_set;
+	char				key[];
+};
+
+struct hist_map_entry {
+	u32			key;	/* hash of elt->key, 0 if free */
+	struct hist_elt		*elt;
+};
+
+struct hist_map {
+	unsigned int		max_elts;
+	unsigned int		size;		/* 2 * max_elts entries */
+	atomic_t		next_elt;
+	atomic64_t		hits;
+	atomic64_t		drops;
+	struct hist_map_entry	*entries;
+	struct hist_elt		**elts;		/* preallocated */
+};
+
+struct hist_trigger_data {
+	struct hist_field	keys[HIST_KEYS_MAX];
+	struct hist_field	vals[HIST_VALS_MAX];
+	struct hist_field	vars[HIST_VARS_MAX];
+	struct hist_var_ref	refs[HIST_REFS_MAX];
+	struct hist_sort_key	sort_keys[HIST_SORT_KEYS_MAX];
+	unsigned int		n_keys;
+	unsigned int		n_vals;
+	unsigned int		n_vars;
+	unsigned int		n_refs;
+	unsigned int		n_sort_keys;
+	unsigned int		key_size;
+	unsigned int		map_bits;
+	char			*sort_str;
+	bool			paused;
+	int			ref;		/* self and referencing hists */
+	struct ftrace_event_file *file;
+	struct hist_map		*map;
+	struct list_head	list;		/* on hist_var_list */
+};
+
+struct hist_trigger_attrs {
+	char			*keys_str;
+	char			*vals_str;
+	char			*sort_str;
+	char			*assignments[HIST_VARS_MAX];
+	unsigned int		n_assignments;
+	unsigned int		map_bits;
+	bool			pause;
+	bool			cont;
+	bool			clear;
+};
+
+/* Hist triggers defining variables, protected by event_mutex */
+static LIST_HEAD(hist_var_list);
+
+#define DEFINE_HIST_OPERAND_FN(type)					\
+static u64 hist_operand_##type(struct hist_operand *op, void *rec)	\
+{									\
+	type *addr = (type *)(rec + op->field->offset);			\
+									\
+	return (u64)*addr;						\
+}
+
+DEFINE_HIST_OPERAND_FN(s64);
+DEFINE_HIST_OPERAND_FN(u64);
+DEFINE_HIST_OPERAND_FN(s32);
+DEFINE_HIST_OPERAND_FN(u32);
+DEFINE_HIST_OPERAND_FN(s16);
+DEFINE_HIST_OPERAND_FN(u16);
+DEFINE_HIST_OPERAND_FN(s8);
+DEFINE_HIST_OPERAND_FN(u8);
+
+static u64 hist_operand_timestamp(struct hist_operand *op, void *rec)
+{
+	return trace_clock_local();
+}
+
+static hist_operand_fn_t select_operand_fn(int field_size, int field_is_signed)
+{
+	hist_operand_fn_t fn = NULL;
+
+	switch (field_size) {
+	case 8:
+		fn = field_is_signed ? hist_operand_s64 : hist_operand_u64;
+		break;
+	case 4:
+		fn = field_is_signed ? hist_operand_s32 : hist_operand_u32;
+		break;
+	case 2:
+		fn = field_is_signed ? hist_operand_s16 : hist_operand_u16;
+		break;
+	case 1:
+		fn = field_is_signed ? hist_operand_s8 : hist_operand_u8;
+		break;
+	}
+
+	return fn;
+}
+
+static u64 hist_operand_value(struct hist_operand *op, void *rec,
+			      u64 *ref_vals)
+{
+	u64 val;
+
+	if (op->flags & HIST_FIELD_FL_VAR_REF)
+		return ref_vals[op->ref];
+
+	val = op->fn(op, rec);
+	if (op->flags & HIST_FIELD_FL_USECS)
+		do_div(val, NSEC_PER_USEC);
+
+	return val;
+}
+
+static u64 hist_field_value(struct hist_field *hist_field, void *rec,
+			    u64 *ref_vals)
+{
+	u64 val = hist_operand_value(&hist_field->operands[0], rec, ref_vals);
+
+	if (hist_field->n_operands > 1)
+		val -= hist_operand_value(&hist_field->operands[1], rec,
+					  ref_vals);
+
+	return val;
+}
+
+/* Copy a string field, see the filter_pred_{string,strloc,pchar}() preds */
+static void hist_key_string(struct hist_field *key, void *rec, char *buf)
+{
+	struct ftrace_event_field *field = key->operands[0].field;
+	u32 str_item;
+	char *str;
+	int len;
+
+	switch (field->filter_type) {
+	case FILTER_DYN_STRING:
+		str_item = *(u32 *)(rec + field->offset);
+		str = rec + (str_item & 0xffff);
+		len = str_item >> 16;
+		break;
+	case FILTER_PTR_STRING:
+		str = *(char **)(rec + field->offset);
+		len = key->size;
+		break;
+	default:
+		str = rec + field->offset;
+		len = field->size;
+		break;
+	}
+
+	/* buf is zeroed, so this keeps it NUL terminated */
+	if (str)
+		strncpy(buf, str, min_t(int, len, key->size - 1));
+}
+
+static void hist_map_free(struct hist_map *map)
+{
+	unsigned int i;
+
+	if (map->elts) {
+		for (i = 0; i < map->max_elts; i++)
+			kfree(map->elts[i]);
+	}
+	vfree(map->elts);
+	vfree(map->entries);
+	kfree(map);
+}
+
+static struct hist_map *hist_map_alloc(struct hist_trigger_data *hist_data)
+{
+	struct hist_map *map;
+	unsigned int i;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return NULL;
+
+	map->max_elts = 1 << hist_data->map_bits;
+	map->size = 2 * map->max_elts;
+
+	map->entries = vzalloc(map->size * sizeof(*map->entries));
+	map->elts = vzalloc(map->max_elts * sizeof(*map->elts));
+	if (!map->entries || !map->elts)
+		goto free;
+
+	for (i = 0; i < map->max_elts; i++) {
+		map->elts[i] = kzalloc(sizeof(struct hist_elt) +
+				       hist_data->key_size, GFP_KERNEL);
+		if (!map->elts[i])
+			goto free;
+		map->elts[i]->hist_data = hist_data;
+	}
+
+	return map;
+ free:
+	hist_map_free(map);
+	return NULL;
+}
+
+/* Only called with the hist paused and no updater left */
+static void hist_map_clear(struct hist_map *map, unsigned int key_size)
+{
+	struct hist_trigger_data *hist_data;
+	unsigned int i;
+
+	for (i = 0; i < map->max_elts; i++) {
+		hist_data = map->elts[i]->hist_data;
+		memset(map->elts[i], 0, sizeof(struct hist_elt) + key_size);
+		map->elts[i]->hist_data = hist_data;
+	}
+	memset(map->entries, 0, map->size * sizeof(*map->entries));
+	atomic_set(&map->next_elt, 0);
+	atomic64_set(&map->hits, 0);
+	atomic64_set(&map->drops, 0);
+}
+
+/*
+ * Find the element for @key, adding it unless @lookup_only.  Slots are
+ * claimed with cmpxchg() on their hash and never freed, so a lookup can
+ * stop at the first free slot.  Two cpus adding the same key at once
+ * may end up with an element each, which the output just shows twice.
+ */
+static struct hist_elt *hist_map_insert(struct hist_map *map, void *key,
+					unsigned int key_size,
+					bool lookup_only)
+{
+	u32 key_hash = jhash(key, key_size, 0);
+	struct hist_map_entry *entry;
+	struct hist_elt *elt;
+	unsigned int probes;
+	u32 idx, test_key;
+	int i;
+
+	if (!key_hash)
+		key_hash = 1;
+
+	idx = key_hash;
+	for (probes = 0; probes < map->size; probes++, idx++) {
+		entry = &map->entries[idx & (map->size - 1)];
+		test_key = ACCESS_ONCE(entry->key);
+
+		if (test_key == key_hash) {
+			elt = ACCESS_ONCE(entry->elt);
+			smp_read_barrier_depends();
+			if (elt && !memcmp(elt->key, key, key_size))
+				return elt;
+			continue;
+		}
+
+		if (test_key)
+			continue;
+		if (lookup_only)
+			return NULL;
+		if (cmpxchg(&entry->key, 0, key_hash))
+			continue;
+
+		i = atomic_inc_return(&map->next_elt) - 1;
+		if (i >= map->max_elts) {
+			/* a full map keeps the slot so that probing ends */
+			atomic64_inc(&map->drops);
+			return NULL;
+		}
+
+		elt = map->elts[i];
+		memcpy(elt->key, key, key_size);
+		smp_wmb();
+		entry->elt = elt;
+
+		return elt;
+	}
+
+	atomic64_inc(&map->drops);
+	return NULL;
+}
+
+static void
+event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	char key[HIST_KEYS_MAX * HIST_KEY_STR_MAX];
+	u64 ref_vals[HIST_REFS_MAX];
+	struct hist_field *key_field;
+	struct hist_var_ref *ref;
+	struct hist_elt *elt;
+	unsigned int i;
+	u64 val;
+
+	if (!rec || ACCESS_ONCE(hist_data->paused))
+		return;
+
+	memset(key, 0, hist_data->key_size);
+	for (i = 0; i < hist_data->n_keys; i++) {
+		key_field = &hist_data->keys[i];
+		if (key_field->flags & HIST_FIELD_FL_STRING) {
+			hist_key_string(key_field, rec,
+					key + key_field->offset);
+		} else {
+			val = hist_field_value(key_field, rec, NULL);
+			memcpy(key + key_field->offset, &val, sizeof(val));
+		}
+	}
+
+	for (i = 0; i < hist_data->n_refs; i++) {
+		ref = &hist_data->refs[i];
+		elt = hist_map_insert(ref->hist_data->map, key,
+				      hist_data->key_size, true);
+		if (!elt || !test_and_clear_bit(ref->idx, &elt->vars_set))
+			return;
+		ref_vals[i] = elt->vars[ref->idx];
+	}
+
+	elt = hist_map_insert(hist_data->map, key, hist_data->key_size, false);
+	if (!elt)
+		return;
+
+	atomic64_inc(&hist_data->map->hits);
+	atomic64_inc(&elt->hitcount);
+
+	for (i = 0; i < hist_data->n_vals; i++) {
+		val = hist_field_value(&hist_data->vals[i], rec, ref_vals);
+		atomic64_add(val, &elt->sums[i]);
+	}
+
+	for (i = 0; i < hist_data->n_vars; i++) {
+		elt->vars[i] = hist_field_value(&hist_data->vars[i], rec,
+						ref_vals);
+		smp_wmb();
+		set_bit(i, &elt->vars_set);
+	}
+}
+
+static struct hist_trigger_data *
+find_var(struct trace_array *tr, const char *name, unsigned int *idx)
+{
+	struct hist_trigger_data *hist_data;
+	unsigned int i;
+
+	list_for_each_entry(hist_data, &hist_var_list, list) {
+		if (hist_data->file->tr != tr)
+			continue;
+		for (i = 0; i < hist_data->n_vars; i++) {
+			if (!strcmp(hist_data->vars[i].var_name, name)) {
+				*idx = i;
+				return hist_data;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void hist_data_put(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	if (--hist_data->ref)
+		return;
+
+	for (i = 0; i < hist_data->n_refs; i++)
+		hist_data_put(hist_data->refs[i].hist_data);
+
+	for (i = 0; i < hist_data->n_keys; i++)
+		kfree(hist_data->keys[i].name);
+	for (i = 0; i < hist_data->n_vals; i++)
+		kfree(hist_data->vals[i].name);
+	for (i = 0; i < hist_data->n_vars; i++) {
+		kfree(hist_data->vars[i].name);
+		kfree(hist_data->vars[i].var_name);
+	}
+	kfree(hist_data->sort_str);
+
+	if (hist_data->map)
+		hist_map_free(hist_data->map);
+	kfree(hist_data);
+}
+
+/* The variable is looked up with this hist's key, so keys have to agree */
+static int hist_ref_var(struct hist_trigger_data *hist_data,
+			struct hist_operand *op, const char *name)
+{
+	struct hist_trigger_data *var_data;
+	struct hist_var_ref *ref;
+	unsigned int i, idx;
+
+	var_data = find_var(hist_data->file->tr, name, &idx);
+	if (!var_data)
+		return -EINVAL;
+
+	if (var_data->n_keys != hist_data->n_keys ||
+	    var_data->key_size != hist_data->key_size)
+		return -EINVAL;
+
+	for (i = 0; i < hist_data->n_keys; i++) {
+		if ((var_data->keys[i].flags ^ hist_data->keys[i].flags) &
+		    HIST_FIELD_FL_STRING)
+			return -EINVAL;
+	}
+
+	if (hist_data->n_refs == HIST_REFS_MAX)
+		return -EINVAL;
+
+	ref = &hist_data->refs[hist_data->n_refs];
+	ref->hist_data = var_data;
+	ref->idx = idx;
+	var_data->ref++;
+
+	op->flags |= HIST_FIELD_FL_VAR_REF;
+	op->ref = hist_data->n_refs++;
+
+	return 0;
+}
+
+static int parse_hist_operand(struct hist_trigger_data *hist_data,
+			      struct hist_operand *op, char *str)
+{
+	struct ftrace_event_field *field;
+	char *field_name, *modifier;
+
+	field_name = strsep(&str, ".");
+	modifier = str;
+
+	if (field_name[0] == '$') {
+		if (modifier)
+			return -EINVAL;
+		return hist_ref_var(hist_data, op, field_name + 1);
+	}
+
+	if (!strcmp(field_name, "common_timestamp")) {
+		op->flags |= HIST_FIELD_FL_TIMESTAMP;
+		op->fn = hist_operand_timestamp;
+	} else {
+		field = trace_find_event_field(hist_data->file->event_call,
+					       field_name);
+		if (!field)
+			return -EINVAL;
+
+		op->field = field;
+		if (field->filter_type == FILTER_STATIC_STRING ||
+		    field->filter_type == FILTER_DYN_STRING ||
+		    field->filter_type == FILTER_PTR_STRING) {
+			op->flags |= HIST_FIELD_FL_STRING;
+		} else {
+			op->fn = select_operand_fn(field->size,
+						   field->is_signed);
+			if (!op->fn)
+				return -EINVAL;
+		}
+	}
+
+	if (!modifier)
+		return 0;
+
+	if (op->flags & HIST_FIELD_FL_STRING)
+		return -EINVAL;
+
+	if (!strcmp(modifier, "hex"))
+		op->flags |= HIST_FIELD_FL_HEX;
+	else if (!strcmp(modifier, "sym"))
+		op->flags |= HIST_FIELD_FL_SYM;
+	else if (!strcmp(modifier, "usecs"))
+		op->flags |= HIST_FIELD_FL_USECS;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int parse_hist_expr(struct hist_trigger_data *hist_data,
+			   struct hist_field *hist_field, char *str)
+{
+	char *operand;
+	int ret;
+
+	operand = strsep(&str, "-");
+	ret = parse_hist_operand(hist_data, &hist_field->operands[0], operand);
+	hist_field->n_operands = 1;
+	if (!ret && str) {
+		ret = parse_hist_operand(hist_data, &hist_field->operands[1],
+					 str);
+		hist_field->n_operands = 2;
+	}
+	if (ret)
+		return ret;
+
+	if ((hist_field->operands[0].flags |
+	     hist_field->operands[1].flags) & HIST_FIELD_FL_STRING)
+		return -EINVAL;
+
+	hist_field->flags = hist_field->operands[0].flags;
+
+	return 0;
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     char *keys_str)
+{
+	struct hist_field *key;
+	char *str;
+	int ret;
+
+	while ((str = strsep(&keys_str, ","))) {
+		if (hist_data->n_keys == HIST_KEYS_MAX || str[0] == '$')
+			return -EINVAL;
+
+		key = &hist_data->keys[hist_data->n_keys++];
+		key->name = kstrdup(str, GFP_KERNEL);
+		if (!key->name)
+			return -ENOMEM;
+
+		ret = parse_hist_operand(hist_data, &key->operands[0], str);
+		if (ret)
+			return ret;
+
+		key->n_operands = 1;
+		key->flags = key->operands[0].flags;
+		key->size = key->flags & HIST_FIELD_FL_STRING ?
+			HIST_KEY_STR_MAX : sizeof(u64);
+		key->offset = hist_data->key_size;
+		hist_data->key_size += key->size;
+	}
+
+	return hist_data->n_keys ? 0 : -EINVAL;
+}
+
+static int create_val_fields(struct hist_trigger_data *hist_data,
+			     char *vals_str)
+{
+	struct hist_field *val;
+	char *str;
+	int ret;
+
+	while ((str = strsep(&vals_str, ","))) {
+		/* the hitcount is always kept */
+		if (!strcmp(str, "hitcount"))
+			continue;
+
+		if (hist_data->n_vals == HIST_VALS_MAX)
+			return -EINVAL;
+
+		val = &hist_data->vals[hist_data->n_vals++];
+		val->name = kstrdup(str, GFP_KERNEL);
+		if (!val->name)
+			return -ENOMEM;
+
+		ret = parse_hist_expr(hist_data, val, str);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int create_var_fields(struct hist_trigger_data *hist_data,
+			     struct hist_trigger_attrs *attrs)
+{
+	struct hist_field *var;
+	unsigned int i, j, idx;
+	char *str, *name;
+	int ret;
+
+	for (i = 0; i < attrs->n_assignments; i++) {
+		str = attrs->assignments[i];
+		name = strsep(&str, "=");
+		if (!*name || !str)
+			return -EINVAL;
+
+		for (j = 0; j < hist_data->n_vars; j++) {
+			if (!strcmp(hist_data->vars[j].var_name, name))
+				return -EEXIST;
+		}
+		if (find_var(hist_data->file->tr, name, &idx))
+			return -EEXIST;
+
+		var = &hist_data->vars[hist_data->n_vars++];
+		var->var_name = kstrdup(name, GFP_KERNEL);
+		var->name = kstrdup(str, GFP_KERNEL);
+		if (!var->var_name || !var->name)
+			return -ENOMEM;
+
+		ret = parse_hist_expr(hist_data, var, str);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Match a field by its name, with or without the modifier */
+static int find_hist_field(struct hist_field *fields, unsigned int n,
+			   const char *name)
+{
+	unsigned int i;
+	size_t len;
+
+	for (i = 0; i < n; i++) {
+		len = strcspn(fields[i].name, ".");
+		if (!strcmp(fields[i].name, name))
+			return i;
+		if (strlen(name) == len && !strncmp(fields[i].name, name, len))
+			return i;
+	}
+
+	return -1;
+}
+
+static int create_sort_keys(struct hist_trigger_data *hist_data,
+			    char *sort_str)
+{
+	struct hist_sort_key *sort_key;
+	char *str, *modifier;
+	int idx;
+
+	if (!sort_str) {
+		hist_data->sort_keys[0].type = HIST_SORT_HITCOUNT;
+		hist_data->n_sort_keys = 1;
+		return 0;
+	}
+
+	hist_data->sort_str = kstrdup(sort_str, GFP_KERNEL);
+	if (!hist_data->sort_str)
+		return -ENOMEM;
+
+	while ((str = strsep(&sort_str, ","))) {
+		if (hist_data->n_sort_keys == HIST_SORT_KEYS_MAX)
+			return -EINVAL;
+
+		sort_key = &hist_data->sort_keys[hist_data->n_sort_keys++];
+
+		modifier = strrchr(str, '.');
+		if (modifier && (!strcmp(modifier, ".descending") ||
+				 !strcmp(modifier, ".ascending"))) {
+			sort_key->descending = modifier[1] == 'd';
+			*modifier = '\0';
+		}
+
+		if (!strcmp(str, "hitcount")) {
+			sort_key->type = HIST_SORT_HITCOUNT;
+			continue;
+		}
+
+		idx = find_hist_field(hist_data->keys, hist_data->n_keys, str);
+		if (idx >= 0) {
+			sort_key->type = HIST_SORT_KEY;
+			sort_key->idx = idx;
+			continue;
+		}
+
+		idx = find_hist_field(hist_data->vals, hist_data->n_vals, str);
+		if (idx < 0)
+			return -EINVAL;
+
+		sort_key->type = HIST_SORT_VAL;
+		sort_key->idx = idx;
+	}
+
+	return 0;
+}
+
+static struct hist_trigger_data *
+create_hist_data(struct hist_trigger_attrs *attrs,
+		 struct ftrace_event_file *file)
+{
+	struct hist_trigger_data *hist_data;
+	int ret;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	hist_data->ref = 1;
+	hist_data->file = file;
+	hist_data->map_bits = attrs->map_bits;
+	hist_data->paused = attrs->pause;
+	INIT_LIST_HEAD(&hist_data->list);
+
+	/* keys first, variable references are checked against them */
+	ret = create_key_fields(hist_data, attrs->keys_str);
+	if (ret)
+		goto free;
+
+	ret = create_val_fields(hist_data, attrs->vals_str);
+	if (ret)
+		goto free;
+
+	ret = create_var_fields(hist_data, attrs);
+	if (ret)
+		goto free;
+
+	ret = create_sort_keys(hist_data, attrs->sort_str);
+	if (ret)
+		goto free;
+
+	ret = -ENOMEM;
+	hist_data->map = hist_map_alloc(hist_data);
+	if (!hist_data->map)
+		goto free;
+
+	return hist_data;
+ free:
+	hist_data_put(hist_data);
+	return ERR_PTR(ret);
+}
+
+static int parse_hist_trigger_attrs(char *trigger,
+				    struct hist_trigger_attrs *attrs)
+{
+	unsigned int size;
+	char *str;
+	int ret;
+
+	attrs->map_bits = HIST_BITS_DEFAULT;
+
+	while ((str = strsep(&trigger, ":"))) {
+		if (!*str)
+			continue;
+
+		if (!strncmp(str, "keys=", 5) || !strncmp(str, "key=", 4)) {
+			attrs->keys_str = strchr(str, '=') + 1;
+		} else if (!strncmp(str, "vals=", 5) ||
+			   !strncmp(str, "values=", 7)) {
+			attrs->vals_str = strchr(str, '=') + 1;
+		} else if (!strncmp(str, "sort=", 5)) {
+			attrs->sort_str = str + 5;
+		} else if (!strncmp(str, "size=", 5)) {
+			ret = kstrtouint(str + 5, 0, &size);
+			if (ret)
+				return ret;
+			if (!size || size > (1 << HIST_BITS_MAX))
+				return -EINVAL;
+			attrs->map_bits = max_t(unsigned int, HIST_BITS_MIN,
+					ilog2(roundup_pow_of_two(size)));
+		} else if (!strcmp(str, "pause")) {
+			attrs->pause = true;
+		} else if (!strcmp(str, "cont") || !strcmp(str, "continue")) {
+			attrs->cont = true;
+		} else if (!strcmp(str, "clear")) {
+			attrs->clear = true;
+		} else if (strchr(str, '=')) {
+			if (attrs->n_assignments == HIST_VARS_MAX)
+				return -EINVAL;
+			attrs->assignments[attrs->n_assignments++] = str;
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	return attrs->keys_str ? 0 : -EINVAL;
+}
+
+static void hist_clear(struct hist_trigger_data *hist_data)
+{
+	bool paused = hist_data->paused;
+
+	hist_data->paused = true;
+	synchronize_sched(); /* make sure the trigger is done with the map */
+	hist_map_clear(hist_data->map, hist_data->key_size);
+	hist_data->paused = paused;
+}
+
+static int
+event_hist_trigger_print(struct seq_file *m, struct event_trigger_ops *ops,
+			 struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned int i;
+
+	seq_puts(m, "hist:keys=");
+	for (i = 0; i < hist_data->n_keys; i++)
+		seq_printf(m, "%s%s", i ? "," : "", hist_data->keys[i].name);
+
+	seq_puts(m, ":vals=hitcount");
+	for (i = 0; i < hist_data->n_vals; i++)
+		seq_printf(m, ",%s", hist_data->vals[i].name);
+
+	for (i = 0; i < hist_data->n_vars; i++)
+		seq_printf(m, ":%s=%s", hist_data->vars[i].var_name,
+			   hist_data->vars[i].name);
+
+	seq_printf(m, ":sort=%s", hist_data->sort_str ?: "hitcount");
+	seq_printf(m, ":size=%u", 1 << hist_data->map_bits);
+
+	if (data->filter_str)
+		seq_printf(m, " if %s", data->filter_str);
+
+	if (hist_data->paused)
+		seq_puts(m, " [paused]");
+	else
+		seq_puts(m, " [active]");
+
+	seq_putc(m, '\n');
+
+	return 0;
+}
+
+static int
+event_hist_trigger_init(struct event_trigger_ops *ops,
+			struct event_trigger_data *data)
+{
+	data->ref++;
+	return 0;
+}
+
+static void
+event_hist_trigger_free(struct event_trigger_ops *ops,
+			struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		/* no new references, the current ones keep the map */
+		list_del_init(&hist_data->list);
+		trigger_data_free(data);
+		hist_data_put(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_hist_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *
+event_hist_get_trigger_ops(char *cmd, char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static struct event_trigger_data *
+find_hist_trigger(struct ftrace_event_file *file)
+{
+	struct event_trigger_data *data;
+
+	list_for_each_entry_rcu(data, &file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			return data;
+	}
+
+	return NULL;
+}
+
+static int
+event_hist_trigger_func(struct event_command *cmd_ops,
+			struct ftrace_event_file *file,
+			char *glob, char *cmd, char *param)
+{
+	struct hist_trigger_attrs attrs = { };
+	struct event_trigger_data *trigger_data = NULL;
+	struct hist_trigger_data *hist_data;
+	struct event_trigger_data *test;
+	char *trigger;
+	int ret;
+
+	if (!param)
+		return -EINVAL;
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+	if (!trigger)
+		return -EINVAL;
+
+	test = find_hist_trigger(file);
+
+	if (glob[0] == '!') {
+		if (!test)
+			return -ENOENT;
+		hist_data = test->private_data;
+		/* other hists still read our variables */
+		if (hist_data->ref > 1)
+			return -EBUSY;
+		cmd_ops->unreg(glob + 1, test->ops, test, file);
+		return 0;
+	}
+
+	ret = parse_hist_trigger_attrs(trigger, &attrs);
+	if (ret)
+		return ret;
+
+	if (test) {
+		if (!attrs.pause && !attrs.cont && !attrs.clear)
+			return -EEXIST;
+
+		hist_data = test->private_data;
+		if (attrs.clear)
+			hist_clear(hist_data);
+		if (attrs.pause)
+			hist_data->paused = true;
+		else if (attrs.cont)
+			hist_data->paused = false;
+		return 0;
+	}
+
+	hist_data = create_hist_data(&attrs, file);
+	if (IS_ERR(hist_data))
+		return PTR_ERR(hist_data);
+
+	ret = -ENOMEM;
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		goto out_free;
+
+	trigger_data->count = -1;
+	trigger_data->ops = &event_hist_trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	trigger_data->private_data = hist_data;
+	INIT_LIST_HEAD(&trigger_data->list);
+
+	if (param) {
+		ret = cmd_ops->set_filter(param, trigger_data, file);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = cmd_ops->reg(glob, trigger_data->ops, trigger_data, file);
+	if (!ret) {
+		ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+
+	if (hist_data->n_vars)
+		list_add(&hist_data->list, &hist_var_list);
+
+	return 0;
+ out_free:
+	if (trigger_data) {
+		cmd_ops->set_filter(NULL, trigger_data, NULL);
+		kfree(trigger_data);
+	}
+	hist_data_put(hist_data);
+	return ret;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
+
+/* 'hist' file output */
+
+static int cmp_hist_sort_key(struct hist_trigger_data *hist_data,
+			     struct hist_sort_key *sort_key,
+			     const struct hist_elt *a,
+			     const struct hist_elt *b)
+{
+	struct hist_field *key;
+	u64 val_a, val_b;
+
+	switch (sort_key->type) {
+	case HIST_SORT_HITCOUNT:
+		val_a = atomic64_read(&a->hitcount);
+		val_b = atomic64_read(&b->hitcount);
+		break;
+	case HIST_SORT_VAL:
+		val_a = atomic64_read(&a->sums[sort_key->idx]);
+		val_b = atomic64_read(&b->sums[sort_key->idx]);
+		break;
+	default:
+		key = &hist_data->keys[sort_key->idx];
+		if (key->flags & HIST_FIELD_FL_STRING)
+			return strncmp(a->key + key->offset,
+				       b->key + key->offset, key->size);
+
+		memcpy(&val_a, a->key + key->offset, sizeof(val_a));
+		memcpy(&val_b, b->key + key->offset, sizeof(val_b));
+		if (key->operands[0].field &&
+		    key->operands[0].field->is_signed) {
+			if ((s64)val_a == (s64)val_b)
+				return 0;
+			return (s64)val_a < (s64)val_b ? -1 : 1;
+		}
+		break;
+	}
+
+	if (val_a == val_b)
+		return 0;
+
+	return val_a < val_b ? -1 : 1;
+}
+
+static int cmp_hist_elts(const void *a, const void *b)
+{
+	const struct hist_elt *elt_a = *(const struct hist_elt **)a;
+	const struct hist_elt *elt_b = *(const struct hist_elt **)b;
+	struct hist_trigger_data *hist_data = elt_a->hist_data;
+	struct hist_sort_key *sort_key;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < hist_data->n_sort_keys; i++) {
+		sort_key = &hist_data->sort_keys[i];
+		ret = cmp_hist_sort_key(hist_data, sort_key, elt_a, elt_b);
+		if (ret)
+			return sort_key->descending ? -ret : ret;
+	}
+
+	return 0;
+}
+
+static void hist_elt_print(struct seq_file *m,
+			   struct hist_trigger_data *hist_data,
+			   struct hist_elt *elt)
+{
+	char str[KSYM_SYMBOL_LEN];
+	struct hist_field *field;
+	unsigned int i;
+	u64 uval;
+
+	seq_puts(m, "{ ");
+	for (i = 0; i < hist_data->n_keys; i++) {
+		field = &hist_data->keys[i];
+		if (i)
+			seq_puts(m, ", ");
+
+		if (field->flags & HIST_FIELD_FL_STRING) {
+			seq_printf(m, "%s: %-20s", field->name,
+				   elt->key + field->offset);
+			continue;
+		}
+
+		memcpy(&uval, elt->key + field->offset, sizeof(uval));
+		if (field->flags & HIST_FIELD_FL_SYM) {
+			sprint_symbol_no_offset(str, uval);
+			seq_printf(m, "%s: [%llx] %-45s", field->name,
+				   uval, str);
+		} else if (field->flags & HIST_FIELD_FL_HEX) {
+			seq_printf(m, "%s: %llx", field->name, uval);
+		} else if (field->operands[0].field &&
+			   field->operands[0].field->is_signed) {
+			seq_printf(m, "%s: %10lld", field->name, (s64)uval);
+		} else {
+			seq_printf(m, "%s: %10llu", field->name, uval);
+		}
+	}
+	seq_puts(m, " }");
+
+	seq_printf(m, " hitcount: %10llu",
+		   (u64)atomic64_read(&elt->hitcount));
+
+	for (i = 0; i < hist_data->n_vals; i++) {
+		field = &hist_data->vals[i];
+		uval = atomic64_read(&elt->sums[i]);
+		if (field->flags & HIST_FIELD_FL_HEX)
+			seq_printf(m, "  %s: %10llx", field->name, uval);
+		else
+			seq_printf(m, "  %s: %10llu", field->name, uval);
+	}
+
+	seq_putc(m, '\n');
+}
+
+static int hist_trigger_show(struct seq_file *m,
+			     struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct hist_map *map = hist_data->map;
+	struct hist_elt **elts;
+	struct hist_elt *elt;
+	unsigned int i, n = 0;
+
+	seq_puts(m, "# event histogram\n#\n# trigger info: ");
+	data->ops->print(m, data->ops, data);
+	seq_puts(m, "#\n\n");
+
+	elts = vmalloc(map->max_elts * sizeof(*elts));
+	if (!elts)
+		return -ENOMEM;
+
+	for (i = 0; i < map->size && n < map->max_elts; i++) {
+		elt = ACCESS_ONCE(map->entries[i].elt);
+		if (elt)
+			elts[n++] = elt;
+	}
+
+	sort(elts, n, sizeof(*elts), cmp_hist_elts, NULL);
+
+	for (i = 0; i < n; i++)
+		hist_elt_print(m, hist_data, elts[i]);
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n"
+		   "    Dropped: %llu\n",
+		   (u64)atomic64_read(&map->hits), n,
+		   (u64)atomic64_read(&map->drops));
+
+	vfree(elts);
+
+	return 0;
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct event_trigger_data *data;
+	struct ftrace_event_file *file;
+	int ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	file = event_file_data(m->private);
+	if (unlikely(!file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	data = find_hist_trigger(file);
+	if (data)
+		ret = hist_trigger_show(m, data);
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
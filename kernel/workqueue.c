@@ -48,6 +48,8 @@
 #include <linux/nodemask.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_internal.h"
 
@@ -123,6 +125,9 @@ enum {
  *
  * A: pool->attach_mutex protected.
  *
+ * K: Written by the worker itself and while it is being woken up.  Read
+ *    by the worker and from the scheduler tick interrupting it.
+ *
  * PL: wq_pool_mutex protected.
  *
  * PR: wq_pool_mutex protected for writes.  Sched-RCU protected for reads.
@@ -280,6 +285,16 @@ static bool wq_power_efficient;
 
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
+/*
+ * Per-cpu work items running longer than this without sleeping are taken
+ * out of concurrency management as if their workqueue were CPU_INTENSIVE,
+ * so that they don't hold up the other work items of their pool.  0
+ * disables the detection.
+ */
+static unsigned long wq_cpu_intensive_thresh_us = 10000;
+module_param_named(cpu_intensive_thresh_us, wq_cpu_intensive_thresh_us,
+		   ulong, 0644);
+
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
 
 /* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
@@ -805,6 +820,9 @@ void wq_worker_waking_up(struct task_struct *task, int cpu)
 {
 	struct worker *worker = kthread_data(task);
 
+	/* only consecutive runtime counts towards CPU hogging */
+	worker->current_at = task->se.sum_exec_runtime;
+
 	if (!(worker->flags & WORKER_NOT_RUNNING)) {
 		WARN_ON_ONCE(worker->pool->cpu != cpu);
 		atomic_inc(&worker->pool->nr_running);
@@ -862,6 +880,27 @@ struct task_struct *wq_worker_sleeping(struct task_struct *task, int cpu)
 	return to_wakeup ? to_wakeup->task : NULL;
 }
 
+/**
+ * wq_worker_last_func - retrieve worker's last work function
+ * @task: Task to retrieve last work function of.
+ *
+ * Determine the last function a worker executed.  This is called from
+ * the scheduler to get a worker's last known identity.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * Return:
+ * The last work function %current executed as a worker, NULL if it
+ * hasn't executed any work yet.
+ */
+work_func_t wq_worker_last_func(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+
+	return worker->last_func;
+}
+
 /**
  * worker_set_flags - set worker flags and adjust nr_running accordingly
  * @worker: self
@@ -916,6 +955,135 @@ static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
 			atomic_inc(&pool->nr_running);
 }
 
+/*
+ * Work functions which were found hogging a CPU, listed in debugfs as
+ * "workqueue_cpu_intensive".  Entries are only ever added, from the
+ * scheduler tick, and readers go without the lock.
+ */
+#define WCI_MAX_ENTS	128
+
+struct wci_ent {
+	work_func_t		func;
+	atomic64_t		cnt;
+};
+
+static struct wci_ent wci_ents[WCI_MAX_ENTS];
+static int wci_nr_ents;
+static DEFINE_RAW_SPINLOCK(wci_lock);
+
+static struct wci_ent *wci_find_ent(work_func_t func)
+{
+	int i, nr = ACCESS_ONCE(wci_nr_ents);
+
+	smp_rmb();	/* pairs with smp_wmb() in wq_cpu_intensive_report() */
+	for (i = 0; i < nr; i++)
+		if (wci_ents[i].func == func)
+			return &wci_ents[i];
+	return NULL;
+}
+
+static void wq_cpu_intensive_report(work_func_t func)
+{
+	struct wci_ent *ent;
+
+	ent = wci_find_ent(func);
+	if (likely(ent)) {
+		atomic64_inc(&ent->cnt);
+		return;
+	}
+
+	raw_spin_lock(&wci_lock);
+	if (!wci_find_ent(func) && wci_nr_ents < WCI_MAX_ENTS) {
+		ent = &wci_ents[wci_nr_ents];
+		ent->func = func;
+		atomic64_set(&ent->cnt, 0);
+		smp_wmb();
+		wci_nr_ents++;
+	}
+	raw_spin_unlock(&wci_lock);
+
+	ent = wci_find_ent(func);
+	if (ent)
+		atomic64_inc(&ent->cnt);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int wci_show(struct seq_file *m, void *v)
+{
+	int i, nr = ACCESS_ONCE(wci_nr_ents);
+
+	smp_rmb();
+	seq_printf(m, "# threshold %luus\n", wq_cpu_intensive_thresh_us);
+	for (i = 0; i < nr; i++)
+		seq_printf(m, "%12lld %pf\n",
+			   (long long)atomic64_read(&wci_ents[i].cnt),
+			   wci_ents[i].func);
+	return 0;
+}
+
+static int wci_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wci_show, NULL);
+}
+
+static const struct file_operations wci_fops = {
+	.open		= wci_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_cpu_intensive_debugfs_init(void)
+{
+	debugfs_create_file("workqueue_cpu_intensive", 0444, NULL, NULL,
+			    &wci_fops);
+	return 0;
+}
+late_initcall(wq_cpu_intensive_debugfs_init);
+#endif
+
+/**
+ * wq_worker_tick - a scheduler tick occurred while a worker is running
+ * @task: task currently running
+ *
+ * Called from scheduler_tick() with @task being %current.  If the work
+ * item being executed has been running longer than
+ * wq_cpu_intensive_thresh_us without sleeping, mark the worker
+ * CPU_INTENSIVE so that it stops counting towards the pool's concurrency
+ * level, and wake up another worker if work items are waiting.
+ *
+ * CONTEXT:
+ * hardirq.
+ */
+void wq_worker_tick(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+	unsigned long thresh = ACCESS_ONCE(wq_cpu_intensive_thresh_us);
+	struct worker_pool *pool = worker->pool;
+
+	/*
+	 * Rescuers, unbound workers and those already CPU_INTENSIVE are
+	 * outside concurrency management anyway.
+	 */
+	if (!thresh || !worker->current_func ||
+	    (worker->flags & WORKER_NOT_RUNNING))
+		return;
+
+	if (task->se.sum_exec_runtime - worker->current_at <
+	    (u64)thresh * NSEC_PER_USEC)
+		return;
+
+	spin_lock(&pool->lock);
+
+	worker_set_flags(worker, WORKER_CPU_INTENSIVE);
+	wq_cpu_intensive_report(worker->current_func);
+
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+
+	spin_unlock(&pool->lock);
+}
+
 /**
  * find_worker_executing_work - find worker which is executing a work
  * @pool: pool of interest
@@ -1984,6 +2152,7 @@ __acquires(&pool->lock)
 	worker->current_work = work;
 	worker->current_func = work->func;
 	worker->current_pwq = pwq;
+	worker->current_at = worker->task->se.sum_exec_runtime;
 	work_color = get_work_color(work);
 
 	list_del_init(&work->entry);
@@ -2050,13 +2219,16 @@ __acquires(&pool->lock)
 
 	spin_lock_irq(&pool->lock);
 
-	/* clear cpu intensive status */
-	if (unlikely(cpu_intensive))
-		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
+	/*
+	 * Clear cpu intensive status, which wq_worker_tick() may also have
+	 * set for a work item that ran too long.
+	 */
+	worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
 
 	/* we're done with it, release */
 	hash_del(&worker->hentry);
 	worker->current_work = NULL;
+	worker->last_func = worker->current_func;
 	worker->current_func = NULL;
 	worker->current_pwq = NULL;
 	worker->desc_valid = false;
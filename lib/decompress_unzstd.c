@@ -0,0 +1,326 @@
+/*
+ * Wrapper for decompressing zstd-compressed kernel, initramfs, and initrd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#define PREBOOT
+#include "zstd/zstd_decompress.c"
+#else
+#include <linux/decompress/unzstd.h>
+#endif
+#include <linux/types.h>
+#include <linux/zstd.h>
+#include <linux/decompress/mm.h>
+#include <linux/compiler.h>
+
+#include <asm/unaligned.h>
+
+#ifdef PREBOOT
+/*
+ * The kernel image is decompressed in one go, its size appended to the
+ * input by the build.  The output may overlap the end of the input, so
+ * literals are kept in a buffer of their own rather than ahead of the
+ * output.
+ */
+STATIC int INIT unzstd(u8 *input, long in_len,
+		       long (*fill)(void *, unsigned long),
+		       long (*flush)(void *, unsigned long),
+		       u8 *output, long *posp,
+		       void (*error)(char *x))
+{
+	size_t out_len = get_unaligned_le32(input + in_len), out = 0;
+	u8 *inp = input, *litbuf;
+	void *wrkmem;
+	int ret = -1;
+
+	if (fill || flush || !output) {
+		error("zstd only decompresses whole images at boot");
+		return -1;
+	}
+
+	wrkmem = malloc(ZSTD_MEM_DECOMPRESS);
+	litbuf = malloc(ZSTD_BLOCK_MAX);
+	if (!wrkmem || !litbuf) {
+		error("Could not allocate decompression state");
+		goto exit;
+	}
+
+	while (in_len > 0) {
+		struct zstd_frame_header fh;
+		size_t start = out;
+		bool last = false;
+
+		if (zstd_frame_header(inp, in_len, &fh) ||
+		    fh.header_size > in_len) {
+			error("invalid header");
+			goto exit;
+		}
+		inp += fh.header_size;
+		in_len -= fh.header_size;
+		if (fh.skippable)
+			continue;
+
+		zstd_decompress_begin(wrkmem);
+		((struct zstd_dctx *)wrkmem)->litbuf = litbuf;
+		while (!last) {
+			size_t size = in_len, len = out_len - out;
+
+			if (zstd_decompress_block(wrkmem, inp, &size,
+						  output + start, out - start,
+						  &len, &last)) {
+				error("Decoding failed");
+				goto exit;
+			}
+			inp += size;
+			in_len -= size;
+			out += len;
+		}
+		if (fh.checksum) {
+			inp += 4;
+			in_len -= 4;
+		}
+	}
+	if (in_len < 0) {
+		error("data corrupted");
+		goto exit;
+	}
+
+	if (posp)
+		*posp = inp - input;
+	ret = 0;
+exit:
+	free(litbuf);
+	free(wrkmem);
+	return ret;
+}
+
+STATIC int INIT decompress(unsigned char *buf, long in_len,
+			      long (*fill)(void*, unsigned long),
+			      long (*flush)(void*, unsigned long),
+			      unsigned char *output,
+			      long *posp,
+			      void(*error)(char *x)
+	)
+{
+	return unzstd(buf, in_len - 4, fill, flush, output, posp, error);
+}
+#else
+
+/* Every block fits the input buffer along with its header */
+#define ZSTD_IOBUF_SIZE		(ZSTD_BLOCK_MAX + 3)
+
+/*
+ * Flushed output is decoded into a buffer holding the frame's window and
+ * a block beyond it.  Like the reference decoder, frames that need more
+ * than 128MB of history are refused.
+ */
+#define ZSTD_WINDOW_MAX		(1ULL << 27)
+
+struct unzstd_input {
+	u8 *buf;		/* for fill() to read into */
+	u8 *ptr;		/* next byte to decode */
+	long len;		/* bytes left at ptr */
+	long *posp;
+	long (*fill)(void *, unsigned long);
+};
+
+/* Makes 'need' bytes available at in->ptr unless the input ends first */
+static long INIT unzstd_more(struct unzstd_input *in, long need)
+{
+	long ret;
+
+	if (!in->fill || in->len >= need)
+		return in->len;
+
+	memmove(in->buf, in->ptr, in->len);
+	in->ptr = in->buf;
+	while (in->len < need) {
+		ret = in->fill(in->buf + in->len, ZSTD_IOBUF_SIZE - in->len);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		in->len += ret;
+	}
+	return in->len;
+}
+
+static void INIT unzstd_consume(struct unzstd_input *in, long len)
+{
+	in->ptr += len;
+	in->len -= len;
+	if (in->posp)
+		*in->posp += len;
+}
+
+static int INIT unzstd_skip(struct unzstd_input *in, unsigned long long len)
+{
+	while (len) {
+		long chunk = min_t(unsigned long long, len, ZSTD_IOBUF_SIZE);
+
+		if (unzstd_more(in, chunk) < chunk)
+			return -1;
+		unzstd_consume(in, chunk);
+		len -= chunk;
+	}
+	return 0;
+}
+
+STATIC int INIT unzstd(u8 *input, long in_len,
+		       long (*fill)(void *, unsigned long),
+		       long (*flush)(void *, unsigned long),
+		       u8 *output, long *posp,
+		       void (*error)(char *x))
+{
+	struct unzstd_input in = {
+		.ptr = input,
+		.len = fill ? 0 : in_len,
+		.posp = posp,
+		.fill = fill,
+	};
+	u8 *outp = NULL;
+	bool frames = false;
+	void *wrkmem;
+	int ret = -1;
+
+	if (posp)
+		*posp = 0;
+
+	if (!output && !flush) {
+		error("NULL output pointer and no flush function provided");
+		return -1;
+	}
+	if (!input && !fill) {
+		error("NULL input pointer and missing fill function");
+		return -1;
+	}
+
+	wrkmem = malloc(ZSTD_MEM_DECOMPRESS);
+	if (!wrkmem) {
+		error("Could not allocate decompression state");
+		return -1;
+	}
+	if (fill) {
+		in.buf = input ? input : large_malloc(ZSTD_IOBUF_SIZE);
+		if (!in.buf) {
+			error("Could not allocate input buffer");
+			goto exit_0;
+		}
+		in.ptr = in.buf;
+	}
+
+	for (;;) {
+		struct zstd_frame_header fh;
+		size_t size, window = 0, pos = 0, total = 0;
+		bool last = false;
+		long avail;
+
+		avail = unzstd_more(&in, 18);
+		if (avail < 0) {
+			error("read error");
+			goto exit_1;
+		}
+		if (zstd_frame_header(in.ptr, avail, &fh)) {
+			/* anything but another frame ends the stream */
+			if (frames)
+				break;
+			error("invalid header");
+			goto exit_1;
+		}
+		frames = true;
+
+		if (fh.skippable) {
+			if (unzstd_skip(&in, fh.header_size)) {
+				error("data corrupted");
+				goto exit_1;
+			}
+			continue;
+		}
+		unzstd_consume(&in, fh.header_size);
+
+		if (output) {
+			if (fh.content_size == ZSTD_CONTENT_SIZE_UNKNOWN) {
+				error("uncompressed size not stored");
+				goto exit_1;
+			}
+			outp = output;
+			size = fh.content_size;
+		} else {
+			if (fh.window_size > ZSTD_WINDOW_MAX) {
+				error("window size is too large");
+				goto exit_1;
+			}
+			window = fh.window_size;
+			size = window + ZSTD_BLOCK_MAX;
+			if (fh.content_size < size)
+				size = fh.content_size;
+			outp = large_malloc(size ? size : 1);
+			if (!outp) {
+				error("Could not allocate output buffer");
+				goto exit_1;
+			}
+		}
+
+		zstd_decompress_begin(wrkmem);
+		while (!last) {
+			size_t used, len;
+
+			/* slide the window down once a block may not fit */
+			if (!output && size - pos < ZSTD_BLOCK_MAX &&
+			    pos > window) {
+				memmove(outp, outp + pos - window, window);
+				pos = window;
+			}
+
+			avail = unzstd_more(&in, ZSTD_IOBUF_SIZE);
+			if (avail < 0) {
+				error("read error");
+				goto exit_2;
+			}
+			used = avail;
+			len = size - pos;
+			if (zstd_decompress_block(wrkmem, in.ptr, &used, outp,
+						  pos, &len, &last)) {
+				error("Decoding failed");
+				goto exit_2;
+			}
+			unzstd_consume(&in, used);
+			if (flush && flush(outp + pos, len) != len)
+				goto exit_2;
+			pos += len;
+			total += len;
+		}
+
+		if (fh.checksum && unzstd_skip(&in, 4)) {
+			error("data corrupted");
+			goto exit_2;
+		}
+		if (fh.content_size != ZSTD_CONTENT_SIZE_UNKNOWN &&
+		    fh.content_size != total) {
+			error("data corrupted");
+			goto exit_2;
+		}
+
+		if (output)
+			output += total;
+		else
+			large_free(outp);
+		outp = NULL;
+	}
+
+	ret = 0;
+exit_2:
+	if (!output)
+		large_free(outp);
+exit_1:
+	if (fill && !input)
+		large_free(in.buf);
+exit_0:
+	free(wrkmem);
+	return ret;
+}
+#endif
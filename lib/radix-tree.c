@@ -79,6 +79,77 @@ static inline void *indirect_to_ptr(void *ptr)
 	return (void *)((unsigned long)ptr & ~RADIX_TREE_INDIRECT_PTR);
 }
 
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+/* Sibling slots point directly to another slot in the same node */
+static inline bool is_sibling_entry(struct radix_tree_node *parent, void *node)
+{
+	void **ptr = node;
+
+	return radix_tree_is_indirect_ptr(node) &&
+		(parent->slots <= ptr) &&
+		(ptr < parent->slots + RADIX_TREE_MAP_SIZE);
+}
+
+/* Offset of the last slot covered by the item in canonical slot @offset */
+static inline unsigned long sibling_last(struct radix_tree_node *node,
+					 unsigned long offset)
+{
+	void *sibling = ptr_to_indirect(node->slots + offset);
+
+	while (offset + 1 < RADIX_TREE_MAP_SIZE &&
+	       node->slots[offset + 1] == sibling)
+		offset++;
+	return offset;
+}
+
+static inline void delete_sibling_entries(struct radix_tree_node *node,
+					  unsigned long offset)
+{
+	unsigned long i, last = sibling_last(node, offset);
+
+	for (i = offset + 1; i <= last; i++) {
+		node->slots[i] = NULL;
+		node->count--;
+	}
+}
+#else
+static inline bool is_sibling_entry(struct radix_tree_node *parent, void *node)
+{
+	return false;
+}
+
+static inline void delete_sibling_entries(struct radix_tree_node *node,
+					  unsigned long offset)
+{
+}
+#endif
+
+static inline unsigned long get_slot_offset(struct radix_tree_node *parent,
+						 void **slot)
+{
+	return slot - parent->slots;
+}
+
+/*
+ * Read slot @offset of @parent into *@nodep.  A sibling entry is followed
+ * to the canonical slot of its item, whose offset is returned.
+ */
+static inline unsigned radix_tree_descend(struct radix_tree_node *parent,
+				struct radix_tree_node **nodep, unsigned offset)
+{
+	void **entry = rcu_dereference_raw(parent->slots[offset]);
+
+	if (is_sibling_entry(parent, entry)) {
+		void **sibentry = (void **)indirect_to_ptr(entry);
+
+		offset = get_slot_offset(parent, sibentry);
+		entry = rcu_dereference_raw(*sibentry);
+	}
+
+	*nodep = (void *)entry;
+	return offset;
+}
+
 static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 {
 	return root->gfp_mask & __GFP_BITS_MASK;
@@ -316,9 +387,11 @@ static inline unsigned long radix_tree_maxindex(unsigned int height)
 }
 
 /*
- *	Extend a radix tree so it can store key @index.
+ *	Extend a radix tree so it can store key @index, and an item of
+ *	@order in a slot below the root node.
  */
-static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
+static int radix_tree_extend(struct radix_tree_root *root, unsigned long index,
+			     unsigned order)
 {
 	struct radix_tree_node *node;
 	struct radix_tree_node *slot;
@@ -327,7 +400,8 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 
 	/* Figure out what the height should be.  */
 	height = root->height + 1;
-	while (index > radix_tree_maxindex(height))
+	while (index > radix_tree_maxindex(height) ||
+	       (order && order >= height * RADIX_TREE_MAP_SHIFT))
 		height++;
 
 	if (root->rnode == NULL) {
@@ -356,6 +430,7 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 		if (newheight > 1) {
 			slot = indirect_to_ptr(slot);
 			slot->parent = node;
+			slot = ptr_to_indirect(slot);
 		}
 		node->slots[0] = slot;
 		node = ptr_to_indirect(node);
@@ -370,39 +445,51 @@ out:
  *	__radix_tree_create	-	create a slot in a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		the item covers 2^@order indices from @index
  *	@nodep:		returns node
  *	@slotp:		returns slot
  *
  *	Create, if necessary, and return the node and slot for an item
  *	at position @index in the radix tree @root.
  *
+ *	An item of non-zero @order lives in the node whose slots cover
+ *	2^order indices or less; the other slots it spans in that node are
+ *	filled with sibling entries by this function.
+ *
  *	Until there is more than one item in the tree, no nodes are
  *	allocated and @root->rnode is used as a direct slot instead of
  *	pointing to a node, in which case *@nodep will be NULL.
  *
- *	Returns -ENOMEM, or 0 for success.
+ *	Returns -ENOMEM, -EEXIST if another item overlaps the range, or
+ *	0 for success.
  */
 int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
-			struct radix_tree_node **nodep, void ***slotp)
+			unsigned order, struct radix_tree_node **nodep,
+			void ***slotp)
 {
 	struct radix_tree_node *node = NULL, *slot;
+	unsigned long max = index | ((1UL << order) - 1);
 	unsigned int height, shift, offset;
 	int error;
 
+	BUG_ON(order && !IS_ENABLED(CONFIG_RADIX_TREE_MULTIORDER));
+	BUG_ON(index & ((1UL << order) - 1));
+
 	/* Make sure the tree is high enough.  */
-	if (index > radix_tree_maxindex(root->height)) {
-		error = radix_tree_extend(root, index);
+	if (max > radix_tree_maxindex(root->height) ||
+	    (order && order >= root->height * RADIX_TREE_MAP_SHIFT)) {
+		error = radix_tree_extend(root, max, order);
 		if (error)
 			return error;
 	}
 
-	slot = indirect_to_ptr(root->rnode);
+	slot = root->rnode;
 
 	height = root->height;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	shift = height * RADIX_TREE_MAP_SHIFT;
 
 	offset = 0;			/* uninitialised var warning */
-	while (height > 0) {
+	while (shift > order) {
 		if (slot == NULL) {
 			/* Have to add a child node.  */
 			if (!(slot = radix_tree_node_alloc(root)))
@@ -410,21 +497,44 @@ int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
 			slot->path = height;
 			slot->parent = node;
 			if (node) {
-				rcu_assign_pointer(node->slots[offset], slot);
+				rcu_assign_pointer(node->slots[offset],
+						   ptr_to_indirect(slot));
 				node->count++;
 				slot->path |= offset << RADIX_TREE_HEIGHT_SHIFT;
 			} else
 				rcu_assign_pointer(root->rnode, ptr_to_indirect(slot));
-		}
+		} else if (!radix_tree_is_indirect_ptr(slot)) {
+			/* A multi-order item already covers @index */
+			break;
+		} else
+			slot = indirect_to_ptr(slot);
 
 		/* Go a level down */
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		node = slot;
-		slot = node->slots[offset];
 		shift -= RADIX_TREE_MAP_SHIFT;
+		node = slot;
+		offset = radix_tree_descend(node, &slot,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
 		height--;
 	}
 
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+	if (order > shift) {
+		unsigned i, n = 1 << (order - shift);
+
+		for (i = 0; i < n; i++) {
+			if (node->slots[offset + i])
+				return -EEXIST;
+		}
+
+		/* Point the rest of the range at the canonical slot */
+		slot = ptr_to_indirect(node->slots + offset);
+		for (i = 1; i < n; i++) {
+			rcu_assign_pointer(node->slots[offset + i], slot);
+			node->count++;
+		}
+	}
+#endif
+
 	if (nodep)
 		*nodep = node;
 	if (slotp)
@@ -433,15 +543,18 @@ int __radix_tree_create(struct radix_tree_root *root, unsigned long index,
 }
 
 /**
- *	radix_tree_insert    -    insert into a radix tree
+ *	__radix_tree_insert    -    insert into a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		key covers the 2^order indices starting at @index
  *	@item:		item to insert
  *
- *	Insert an item into the radix tree at position @index.
+ *	Insert an item into the radix tree at position @index.  @index
+ *	must be aligned to 2^@order; a lookup of any index in the range
+ *	then finds @item.
  */
-int radix_tree_insert(struct radix_tree_root *root,
-			unsigned long index, void *item)
+int __radix_tree_insert(struct radix_tree_root *root, unsigned long index,
+			unsigned order, void *item)
 {
 	struct radix_tree_node *node;
 	void **slot;
@@ -449,7 +562,7 @@ int radix_tree_insert(struct radix_tree_root *root,
 
 	BUG_ON(radix_tree_is_indirect_ptr(item));
 
-	error = __radix_tree_create(root, index, &node, &slot);
+	error = __radix_tree_create(root, index, order, &node, &slot);
 	if (error)
 		return error;
 	if (*slot != NULL)
@@ -457,9 +570,11 @@ int radix_tree_insert(struct radix_tree_root *root,
 	rcu_assign_pointer(*slot, item);
 
 	if (node) {
+		unsigned long offset = get_slot_offset(node, slot);
+
 		node->count++;
-		BUG_ON(tag_get(node, 0, index & RADIX_TREE_MAP_MASK));
-		BUG_ON(tag_get(node, 1, index & RADIX_TREE_MAP_MASK));
+		BUG_ON(tag_get(node, 0, offset));
+		BUG_ON(tag_get(node, 1, offset));
 	} else {
 		BUG_ON(root_tag_get(root, 0));
 		BUG_ON(root_tag_get(root, 1));
@@ -467,7 +582,7 @@ int radix_tree_insert(struct radix_tree_root *root,
 
 	return 0;
 }
-EXPORT_SYMBOL(radix_tree_insert);
+EXPORT_SYMBOL(__radix_tree_insert);
 
 /**
  *	__radix_tree_lookup	-	lookup an item in a radix tree
@@ -512,16 +627,22 @@ void *__radix_tree_lookup(struct radix_tree_root *root, unsigned long index,
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
 
-	do {
+	for (;;) {
+		unsigned offset;
+
 		parent = node;
-		slot = node->slots + ((index >> shift) & RADIX_TREE_MAP_MASK);
-		node = rcu_dereference_raw(*slot);
+		offset = radix_tree_descend(parent, &node,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		slot = parent->slots + offset;
 		if (node == NULL)
 			return NULL;
 
+		/* Stop at the leaf level, or at a multi-order item above it */
+		if (!shift || !radix_tree_is_indirect_ptr(node))
+			break;
+		node = indirect_to_ptr(node);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
-	} while (height > 0);
+	}
 
 	if (nodep)
 		*nodep = parent;
@@ -597,13 +718,18 @@ void *radix_tree_tag_set(struct radix_tree_root *root,
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	while (height > 0) {
-		int offset;
+		struct radix_tree_node *node = slot;
+		unsigned offset;
 
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!tag_get(slot, tag, offset))
-			tag_set(slot, tag, offset);
-		slot = slot->slots[offset];
+		offset = radix_tree_descend(node, &slot,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		if (!tag_get(node, tag, offset))
+			tag_set(node, tag, offset);
 		BUG_ON(slot == NULL);
+		/* A multi-order item is tagged in the slot that holds it */
+		if (!radix_tree_is_indirect_ptr(slot))
+			break;
+		slot = indirect_to_ptr(slot);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
@@ -636,7 +762,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 	struct radix_tree_node *node = NULL;
 	struct radix_tree_node *slot = NULL;
 	unsigned int height, shift;
-	int uninitialized_var(offset);
+	unsigned uninitialized_var(offset);
 
 	height = root->height;
 	if (index > radix_tree_maxindex(height))
@@ -650,9 +776,12 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 			goto out;
 
 		shift -= RADIX_TREE_MAP_SHIFT;
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 		node = slot;
-		slot = slot->slots[offset];
+		offset = radix_tree_descend(node, &slot,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
+		if (!radix_tree_is_indirect_ptr(slot))
+			break;
+		slot = indirect_to_ptr(slot);
 	}
 
 	if (slot == NULL)
@@ -665,8 +794,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		if (any_tag_set(node, tag))
 			goto out;
 
-		index >>= RADIX_TREE_MAP_SHIFT;
-		offset = index & RADIX_TREE_MAP_MASK;
+		offset = node->path >> RADIX_TREE_HEIGHT_SHIFT;
 		node = node->parent;
 	}
 
@@ -719,17 +847,22 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	for ( ; ; ) {
-		int offset;
+		struct radix_tree_node *child;
+		unsigned offset;
 
 		if (node == NULL)
 			return 0;
 
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		offset = radix_tree_descend(node, &child,
+				(index >> shift) & RADIX_TREE_MAP_MASK);
 		if (!tag_get(node, tag, offset))
 			return 0;
 		if (height == 1)
 			return 1;
-		node = rcu_dereference_raw(node->slots[offset]);
+		/* A multi-order item above the leaf level */
+		if (child && !radix_tree_is_indirect_ptr(child))
+			return 1;
+		node = indirect_to_ptr(child);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
@@ -749,7 +882,7 @@ void **radix_tree_next_chunk(struct radix_tree_root *root,
 {
 	unsigned shift, tag = flags & RADIX_TREE_ITER_TAG_MASK;
 	struct radix_tree_node *rnode, *node;
-	unsigned long index, offset, height;
+	unsigned long index, offset, canon, height;
 
 	if ((flags & RADIX_TREE_ITER_TAGGED) && !root_tag_get(root, tag))
 		return NULL;
@@ -790,9 +923,12 @@ restart:
 
 	node = rnode;
 	while (1) {
+		struct radix_tree_node *child;
+
+		canon = radix_tree_descend(node, &child, offset);
 		if ((flags & RADIX_TREE_ITER_TAGGED) ?
-				!test_bit(offset, node->tags[tag]) :
-				!node->slots[offset]) {
+				!test_bit(canon, node->tags[tag]) :
+				!child) {
 			/* Hole detected */
 			if (flags & RADIX_TREE_ITER_CONTIG)
 				return NULL;
@@ -804,7 +940,10 @@ restart:
 						offset + 1);
 			else
 				while (++offset	< RADIX_TREE_MAP_SIZE) {
-					if (node->slots[offset])
+					void *entry = node->slots[offset];
+
+					if (entry &&
+					    !is_sibling_entry(node, entry))
 						break;
 				}
 			index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
@@ -814,21 +953,40 @@ restart:
 				return NULL;
 			if (offset == RADIX_TREE_MAP_SIZE)
 				goto restart;
+			canon = radix_tree_descend(node, &child, offset);
 		}
 
 		/* This is leaf-node */
 		if (!shift)
 			break;
 
-		node = rcu_dereference_raw(node->slots[offset]);
-		if (node == NULL)
+		if (child == NULL)
 			goto restart;
+		/* Or a multi-order item above the leaf level */
+		if (!radix_tree_is_indirect_ptr(child))
+			break;
+		node = indirect_to_ptr(child);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 	}
 
 	/* Update the iterator state */
 	iter->index = index;
+#ifdef CONFIG_RADIX_TREE_MULTIORDER
+	iter->shift = shift;
+	if (shift || canon != offset) {
+		/*
+		 * A multi-order item above the leaf level, or one entered
+		 * through a sibling slot: return its canonical slot as a
+		 * chunk of its own, ending where the item does.
+		 */
+		index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
+		iter->next_index = index +
+				((sibling_last(node, canon) + 1) << shift);
+		iter->tags = 1;
+		return node->slots + canon;
+	}
+#endif
 	iter->next_index = (index | RADIX_TREE_MAP_MASK) + 1;
 
 	/* Construct iter->tags bit-mask from node->tags[tag] array */
@@ -911,28 +1069,37 @@ unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
 	slot = indirect_to_ptr(root->rnode);
 
 	for (;;) {
+		struct radix_tree_node *child;
 		unsigned long upindex;
-		int offset;
+		unsigned offset, canon;
 
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!slot->slots[offset])
+		canon = radix_tree_descend(slot, &child, offset);
+		if (!child)
 			goto next;
+		/*
+		 * A sibling slot is only of interest when the range starts
+		 * inside its item; otherwise the canonical slot was seen.
+		 */
+		if (canon != offset && index != *first_indexp)
+			goto next;
+		offset = canon;
 		if (!tag_get(slot, iftag, offset))
 			goto next;
-		if (shift) {
+		if (shift && radix_tree_is_indirect_ptr(child)) {
 			/* Go down one level */
 			shift -= RADIX_TREE_MAP_SHIFT;
 			node = slot;
-			slot = slot->slots[offset];
+			slot = indirect_to_ptr(child);
 			continue;
 		}
 
-		/* tag the leaf */
+		/* tag the leaf, or the multi-order item */
 		tagged++;
 		tag_set(slot, settag, offset);
 
 		/* walk back up the path tagging interior nodes */
-		upindex = index;
+		upindex = index >> shift;
 		while (node) {
 			upindex >>= RADIX_TREE_MAP_SHIFT;
 			offset = upindex & RADIX_TREE_MAP_MASK;
@@ -969,6 +1136,12 @@ next:
 			 */
 			slot = slot->parent;
 			shift += RADIX_TREE_MAP_SHIFT;
+			/*
+			 * Keep the path to walk back up in step, a
+			 * multi-order item may be tagged at this level.
+			 */
+			if (node)
+				node = slot->parent;
 		}
 	}
 	/*
@@ -1157,9 +1330,18 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 	for ( ; height > 1; height--) {
 		i = (index >> shift) & RADIX_TREE_MAP_MASK;
 		for (;;) {
-			if (slot->slots[i] != NULL)
+			void *entry = slot->slots[i];
+
+			if (radix_tree_is_indirect_ptr(entry) &&
+			    !is_sibling_entry(slot, entry))
 				break;
 			index &= ~((1UL << shift) - 1);
+			/* A multi-order item above the leaf level */
+			if (entry == item) {
+				*found_index = index;
+				index = 0;
+				goto out;
+			}
 			index += 1UL << shift;
 			if (index == 0)
 				goto out;	/* 32-bit wraparound */
@@ -1169,7 +1351,7 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 		}
 
 		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference_raw(slot->slots[i]);
+		slot = indirect_to_ptr(rcu_dereference_raw(slot->slots[i]));
 		if (slot == NULL)
 			goto out;
 	}
@@ -1251,11 +1433,15 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 
 		/*
 		 * The candidate node has more than one child, or its child
-		 * is not at the leftmost slot, we cannot shrink.
+		 * is not at the leftmost slot, or the child is a multi-order
+		 * item, we cannot shrink.
 		 */
 		if (to_free->count != 1)
 			break;
-		if (!to_free->slots[0])
+		slot = to_free->slots[0];
+		if (!slot)
+			break;
+		if (!radix_tree_is_indirect_ptr(slot) && root->height > 1)
 			break;
 
 		/*
@@ -1265,8 +1451,8 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		 * (to_free->slots[0]), it will be safe to dereference the new
 		 * one (root->rnode) as far as dependent read barriers go.
 		 */
-		slot = to_free->slots[0];
 		if (root->height > 1) {
+			slot = indirect_to_ptr(slot);
 			slot->parent = NULL;
 			slot = ptr_to_indirect(slot);
 		}
@@ -1382,7 +1568,7 @@ void *radix_tree_delete_item(struct radix_tree_root *root,
 		return entry;
 	}
 
-	offset = index & RADIX_TREE_MAP_MASK;
+	offset = get_slot_offset(node, slot);
 
 	/*
 	 * Clear all tags associated with the item to be deleted.
@@ -1393,6 +1579,7 @@ void *radix_tree_delete_item(struct radix_tree_root *root,
 			radix_tree_tag_clear(root, index, tag);
 	}
 
+	delete_sibling_entries(node, offset);
 	node->slots[offset] = NULL;
 	node->count--;
 
@@ -26,15 +26,48 @@
 
 #define HASH_DEFAULT_SIZE	64UL
 #define HASH_MIN_SIZE		4UL
+#define BUCKET_LOCKS_PER_CPU	128UL
+
+/*
+ * Locking overview:
+ *
+ * Each bucket table carries an array of spinlocks, a bucket being covered
+ * by locks[hash & locks_mask].  Inserts and removals take the lock of the
+ * object's bucket in ht->tbl.  While a resize is in progress, ht->future_tbl
+ * points to the table under construction; mutations then also take the
+ * lock of the object's bucket in the future table, nested inside the first
+ * one, and insertions go into the future table.
+ *
+ * The resize steps done by the deferred worker take the same pair of locks,
+ * so they never race with a mutation of the buckets they are relinking.
+ * Lookups search the future table first and the current one second, which
+ * leaves them consistent while the tables are being rehashed.  ht->mutex
+ * serializes the resizes themselves.
+ */
 
 #define ASSERT_RHT_MUTEX(HT) BUG_ON(!lockdep_rht_mutex_is_held(HT))
+#define ASSERT_BUCKET_LOCK(TBL, HASH) \
+	BUG_ON(!lockdep_rht_bucket_is_held(TBL, HASH))
+
+static spinlock_t *bucket_lock(const struct bucket_table *tbl, u32 hash)
+{
+	return &tbl->locks[hash & tbl->locks_mask];
+}
 
 #ifdef CONFIG_PROVE_LOCKING
-int lockdep_rht_mutex_is_held(const struct rhashtable *ht)
+int lockdep_rht_mutex_is_held(struct rhashtable *ht)
 {
-	return ht->p.mutex_is_held();
+	return (debug_locks) ? lockdep_is_held(&ht->mutex) : 1;
 }
 EXPORT_SYMBOL_GPL(lockdep_rht_mutex_is_held);
+
+int lockdep_rht_bucket_is_held(const struct bucket_table *tbl, u32 hash)
+{
+	spinlock_t *lock = bucket_lock(tbl, hash);
+
+	return (debug_locks) ? lockdep_is_held(lock) : 1;
+}
+EXPORT_SYMBOL_GPL(lockdep_rht_bucket_is_held);
 #endif
 
 static void *rht_obj(const struct rhashtable *ht, const struct rhash_head *he)
@@ -42,78 +75,77 @@ static void *rht_obj(const struct rhashtable *ht, const struct rhash_head *he)
 	return (void *) he - ht->p.head_offset;
 }
 
-static u32 __hashfn(const struct rhashtable *ht, const void *key,
-		      u32 len, u32 hsize)
+static u32 rht_bucket_index(const struct bucket_table *tbl, u32 hash)
 {
-	u32 h;
+	return hash & (tbl->size - 1);
+}
 
-	h = ht->p.hashfn(key, len, ht->p.hash_rnd);
+static u32 obj_raw_hashfn(const struct rhashtable *ht, const void *ptr)
+{
+	if (unlikely(!ht->p.key_len))
+		return ht->p.obj_hashfn(ptr, ht->p.hash_rnd);
 
-	return h & (hsize - 1);
+	return ht->p.hashfn(ptr + ht->p.key_offset, ht->p.key_len,
+			    ht->p.hash_rnd);
 }
 
-/**
- * rhashtable_hashfn - compute hash for key of given length
- * @ht:		hash table to compute for
- * @key:	pointer to key
- * @len:	length of key
- *
- * Computes the hash value using the hash function provided in the 'hashfn'
- * of struct rhashtable_params. The returned value is guaranteed to be
- * smaller than the number of buckets in the hash table.
- */
-u32 rhashtable_hashfn(const struct rhashtable *ht, const void *key, u32 len)
+static u32 key_hashfn(const struct rhashtable *ht, const void *key, u32 len)
 {
-	struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+	return ht->p.hashfn(key, len, ht->p.hash_rnd);
+}
 
-	return __hashfn(ht, key, len, tbl->size);
+static u32 head_hashfn(const struct rhashtable *ht,
+		       const struct bucket_table *tbl,
+		       const struct rhash_head *he)
+{
+	return rht_bucket_index(tbl, obj_raw_hashfn(ht, rht_obj(ht, he)));
 }
-EXPORT_SYMBOL_GPL(rhashtable_hashfn);
 
-static u32 obj_hashfn(const struct rhashtable *ht, const void *ptr, u32 hsize)
+static int alloc_bucket_locks(struct rhashtable *ht, struct bucket_table *tbl)
 {
-	if (unlikely(!ht->p.key_len)) {
-		u32 h;
+	unsigned int i, size;
+	unsigned int nr_pcpus = num_possible_cpus();
+
+	nr_pcpus = min_t(unsigned int, nr_pcpus, 32UL);
+	size = roundup_pow_of_two(nr_pcpus * ht->p.locks_mul);
 
-		h = ht->p.obj_hashfn(ptr, ht->p.hash_rnd);
+	/* Never allocate more than one lock per bucket */
+	size = min_t(unsigned int, size, tbl->size);
 
-		return h & (hsize - 1);
+	if (sizeof(spinlock_t) != 0) {
+#ifdef CONFIG_NUMA
+		if (size * sizeof(spinlock_t) > PAGE_SIZE)
+			tbl->locks = vmalloc(size * sizeof(spinlock_t));
+		else
+#endif
+		tbl->locks = kmalloc_array(size, sizeof(spinlock_t),
+					   GFP_KERNEL);
+		if (!tbl->locks)
+			return -ENOMEM;
+		for (i = 0; i < size; i++)
+			spin_lock_init(&tbl->locks[i]);
 	}
+	tbl->locks_mask = size - 1;
 
-	return __hashfn(ht, ptr + ht->p.key_offset, ht->p.key_len, hsize);
+	return 0;
 }
 
-/**
- * rhashtable_obj_hashfn - compute hash for hashed object
- * @ht:		hash table to compute for
- * @ptr:	pointer to hashed object
- *
- * Computes the hash value using the hash function `hashfn` respectively
- * 'obj_hashfn' depending on whether the hash table is set up to work with
- * a fixed length key. The returned value is guaranteed to be smaller than
- * the number of buckets in the hash table.
- */
-u32 rhashtable_obj_hashfn(const struct rhashtable *ht, void *ptr)
+static void bucket_table_free(const struct bucket_table *tbl)
 {
-	struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
-
-	return obj_hashfn(ht, ptr, tbl->size);
-}
-EXPORT_SYMBOL_GPL(rhashtable_obj_hashfn);
+	if (tbl)
+		kvfree(tbl->locks);
 
-static u32 head_hashfn(const struct rhashtable *ht,
-		       const struct rhash_head *he, u32 hsize)
-{
-	return obj_hashfn(ht, rht_obj(ht, he), hsize);
+	kvfree(tbl);
 }
 
-static struct bucket_table *bucket_table_alloc(size_t nbuckets, gfp_t flags)
+static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
+					       size_t nbuckets)
 {
 	struct bucket_table *tbl;
 	size_t size;
 
 	size = sizeof(*tbl) + nbuckets * sizeof(tbl->buckets[0]);
-	tbl = kzalloc(size, flags);
+	tbl = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
 	if (tbl == NULL)
 		tbl = vzalloc(size);
 
@@ -122,12 +154,12 @@ static struct bucket_table *bucket_table_alloc(size_t nbuckets, gfp_t flags)
 
 	tbl->size = nbuckets;
 
-	return tbl;
-}
+	if (alloc_bucket_locks(ht, tbl) < 0) {
+		bucket_table_free(tbl);
+		return NULL;
+	}
 
-static void bucket_table_free(const struct bucket_table *tbl)
-{
-	kvfree(tbl);
+	return tbl;
 }
 
 /**
@@ -138,7 +170,7 @@ static void bucket_table_free(const struct bucket_table *tbl)
 bool rht_grow_above_75(const struct rhashtable *ht, size_t new_size)
 {
 	/* Expand table when exceeding 75% load */
-	return ht->nelems > (new_size / 4 * 3);
+	return atomic_read(&ht->nelems) > (new_size / 4 * 3);
 }
 EXPORT_SYMBOL_GPL(rht_grow_above_75);
 
@@ -150,7 +182,7 @@ EXPORT_SYMBOL_GPL(rht_grow_above_75);
 bool rht_shrink_below_30(const struct rhashtable *ht, size_t new_size)
 {
 	/* Shrink table beneath 30% load */
-	return ht->nelems < (new_size * 3 / 10);
+	return atomic_read(&ht->nelems) < (new_size * 3 / 10);
 }
 EXPORT_SYMBOL_GPL(rht_shrink_below_30);
 
@@ -161,8 +193,10 @@ static void hashtable_chain_unzip(const struct rhashtable *ht,
 	struct rhash_head *he, *p, *next;
 	unsigned int h;
 
+	ASSERT_BUCKET_LOCK(old_tbl, n);
+
 	/* Old bucket empty, no work needed. */
-	p = rht_dereference(old_tbl->buckets[n], ht);
+	p = rht_dereference_bucket(old_tbl->buckets[n], old_tbl, n);
 	if (!p)
 		return;
 
@@ -170,9 +204,9 @@ static void hashtable_chain_unzip(const struct rhashtable *ht,
 	 * reaches a node that doesn't hash to the same bucket as the
 	 * previous node p. Call the previous node p;
 	 */
-	h = head_hashfn(ht, p, new_tbl->size);
-	rht_for_each(he, p->next, ht) {
-		if (head_hashfn(ht, he, new_tbl->size) != h)
+	h = head_hashfn(ht, new_tbl, p);
+	rht_for_each_continue(he, p->next, old_tbl, n) {
+		if (head_hashfn(ht, new_tbl, he) != h)
 			break;
 		p = he;
 	}
@@ -183,8 +217,8 @@ static void hashtable_chain_unzip(const struct rhashtable *ht,
 	 */
 	next = NULL;
 	if (he) {
-		rht_for_each(he, he->next, ht) {
-			if (head_hashfn(ht, he, new_tbl->size) == h) {
+		rht_for_each_continue(he, he->next, old_tbl, n) {
+			if (head_hashfn(ht, new_tbl, he) == h) {
 				next = he;
 				break;
 			}
@@ -197,10 +231,27 @@ static void hashtable_chain_unzip(const struct rhashtable *ht,
 	RCU_INIT_POINTER(p->next, next);
 }
 
+/* Appends the old chain starting at @entry to the end of the chain in
+ * bucket @new_hash of @new_tbl, which may already hold entries inserted
+ * since the resize started.  The caller holds the old bucket's lock.
+ */
+static void link_old_to_new(struct bucket_table *new_tbl,
+			    unsigned int new_hash, struct rhash_head *entry)
+{
+	spinlock_t *new_bucket_lock = bucket_lock(new_tbl, new_hash);
+	struct rhash_head __rcu **pprev = &new_tbl->buckets[new_hash];
+	struct rhash_head *he;
+
+	spin_lock_nested(new_bucket_lock, SINGLE_DEPTH_NESTING);
+	rht_for_each(he, new_tbl, new_hash)
+		pprev = &he->next;
+	rcu_assign_pointer(*pprev, entry);
+	spin_unlock(new_bucket_lock);
+}
+
 /**
  * rhashtable_expand - Expand hash table while allowing concurrent lookups
  * @ht:		the hash table to expand
- * @flags:	allocation flags
  *
  * A secondary bucket array is allocated and the hash entries are migrated
  * while keeping them on both lists until the end of the RCU grace period.
@@ -208,14 +259,16 @@ static void hashtable_chain_unzip(const struct rhashtable *ht,
  * This function may only be called in a context where it is safe to call
  * synchronize_rcu(), e.g. not within a rcu_read_lock() section.
  *
- * The caller must ensure that no concurrent table mutations take place.
- * It is however valid to have concurrent lookups if they are RCU protected.
+ * The caller must hold ht->mutex. Concurrent insertions, removals and
+ * RCU protected lookups are permitted; they take the bucket locks of both
+ * tables while the expansion is in progress.
  */
-int rhashtable_expand(struct rhashtable *ht, gfp_t flags)
+int rhashtable_expand(struct rhashtable *ht)
 {
 	struct bucket_table *new_tbl, *old_tbl = rht_dereference(ht->tbl, ht);
 	struct rhash_head *he;
-	unsigned int i, h;
+	spinlock_t *old_bucket_lock;
+	unsigned int new_hash, old_hash;
 	bool complete;
 
 	ASSERT_RHT_MUTEX(ht);
@@ -223,41 +276,48 @@ int rhashtable_expand(struct rhashtable *ht, gfp_t flags)
 	if (ht->p.max_shift && ht->shift >= ht->p.max_shift)
 		return 0;
 
-	new_tbl = bucket_table_alloc(old_tbl->size * 2, flags);
+	new_tbl = bucket_table_alloc(ht, old_tbl->size * 2);
 	if (new_tbl == NULL)
 		return -ENOMEM;
 
 	ht->shift++;
 
-	/* For each new bucket, search the corresponding old bucket
-	 * for the first entry that hashes to the new bucket, and
-	 * link the new bucket to that entry. Since all the entries
-	 * which will end up in the new bucket appear in the same
-	 * old bucket, this constructs an entirely valid new hash
-	 * table, but with multiple buckets "zipped" together into a
-	 * single imprecise chain.
+	/* Make insertions go into the new, empty table right away. Removals
+	 * and lookups will be attempted in both tables until ht->tbl is
+	 * switched over. The synchronize_rcu() guarantees that the new table
+	 * has been picked up, so no insertion into the old table is still in
+	 * flight while we relink.
 	 */
-	for (i = 0; i < new_tbl->size; i++) {
-		h = i & (old_tbl->size - 1);
-		rht_for_each(he, old_tbl->buckets[h], ht) {
-			if (head_hashfn(ht, he, new_tbl->size) == i) {
-				RCU_INIT_POINTER(new_tbl->buckets[i], he);
+	rcu_assign_pointer(ht->future_tbl, new_tbl);
+	synchronize_rcu();
+
+	/* For each new bucket, search the corresponding old bucket for the
+	 * first entry that hashes to the new bucket, and link the end of
+	 * newly formed bucket chain (containing entries added to future
+	 * table) to that entry. Since all the entries which will end up in
+	 * the new bucket appear in the same old bucket, this constructs an
+	 * entirely valid new hash table, but with multiple buckets
+	 * "zipped" together into a single imprecise chain.
+	 */
+	for (new_hash = 0; new_hash < new_tbl->size; new_hash++) {
+		old_hash = rht_bucket_index(old_tbl, new_hash);
+		old_bucket_lock = bucket_lock(old_tbl, old_hash);
+
+		spin_lock_bh(old_bucket_lock);
+		rht_for_each(he, old_tbl, old_hash) {
+			if (head_hashfn(ht, new_tbl, he) == new_hash) {
+				link_old_to_new(new_tbl, new_hash, he);
 				break;
 			}
 		}
+		spin_unlock_bh(old_bucket_lock);
 	}
 
-	/* Publish the new table pointer. Lookups may now traverse
-	 * the new table, but they will not benefit from any
-	 * additional efficiency until later steps unzip the buckets.
-	 */
-	rcu_assign_pointer(ht->tbl, new_tbl);
-
 	/* Unzip interleaved hash chains */
 	do {
-		/* Wait for readers. All new readers will see the new
-		 * table, and thus no references to the old table will
-		 * remain.
+		/* Wait for readers. All new readers find every entry in the
+		 * new table, and lookups that ran before it was fully linked
+		 * and fell back to the intact old chains are gone.
 		 */
 		synchronize_rcu();
 
@@ -266,13 +326,24 @@ int rhashtable_expand(struct rhashtable *ht, gfp_t flags)
 		 * table): ...
 		 */
 		complete = true;
-		for (i = 0; i < old_tbl->size; i++) {
-			hashtable_chain_unzip(ht, new_tbl, old_tbl, i);
-			if (old_tbl->buckets[i] != NULL)
+		for (old_hash = 0; old_hash < old_tbl->size; old_hash++) {
+			old_bucket_lock = bucket_lock(old_tbl, old_hash);
+			spin_lock_bh(old_bucket_lock);
+
+			hashtable_chain_unzip(ht, new_tbl, old_tbl, old_hash);
+			if (old_tbl->buckets[old_hash] != NULL)
 				complete = false;
+
+			spin_unlock_bh(old_bucket_lock);
 		}
 	} while (!complete);
 
+	/* Publish the new table pointer. Mutations stop taking the old
+	 * bucket locks, which may only be freed once they are all done.
+	 */
+	rcu_assign_pointer(ht->tbl, new_tbl);
+	synchronize_rcu();
+
 	bucket_table_free(old_tbl);
 	return 0;
 }
@@ -281,53 +352,61 @@ EXPORT_SYMBOL_GPL(rhashtable_expand);
 /**
  * rhashtable_shrink - Shrink hash table while allowing concurrent lookups
  * @ht:		the hash table to shrink
- * @flags:	allocation flags
  *
  * This function may only be called in a context where it is safe to call
  * synchronize_rcu(), e.g. not within a rcu_read_lock() section.
  *
- * The caller must ensure that no concurrent table mutations take place.
- * It is however valid to have concurrent lookups if they are RCU protected.
+ * The caller must hold ht->mutex. Concurrent insertions, removals and
+ * RCU protected lookups are permitted; they take the bucket locks of both
+ * tables while the shrinking is in progress.
  */
-int rhashtable_shrink(struct rhashtable *ht, gfp_t flags)
+int rhashtable_shrink(struct rhashtable *ht)
 {
-	struct bucket_table *ntbl, *tbl = rht_dereference(ht->tbl, ht);
-	struct rhash_head __rcu **pprev;
-	unsigned int i;
+	struct bucket_table *new_tbl, *tbl = rht_dereference(ht->tbl, ht);
+	struct rhash_head *he;
+	spinlock_t *old_bucket_lock;
+	unsigned int new_hash, old_hash;
 
 	ASSERT_RHT_MUTEX(ht);
 
 	if (ht->shift <= ht->p.min_shift)
 		return 0;
 
-	ntbl = bucket_table_alloc(tbl->size / 2, flags);
-	if (ntbl == NULL)
+	new_tbl = bucket_table_alloc(ht, tbl->size / 2);
+	if (new_tbl == NULL)
 		return -ENOMEM;
 
 	ht->shift--;
 
-	/* Link each bucket in the new table to the first bucket
-	 * in the old table that contains entries which will hash
-	 * to the new bucket.
-	 */
-	for (i = 0; i < ntbl->size; i++) {
-		ntbl->buckets[i] = tbl->buckets[i];
+	/* Redirect insertions to the new table, see rhashtable_expand() */
+	rcu_assign_pointer(ht->future_tbl, new_tbl);
+	synchronize_rcu();
 
-		/* Link each bucket in the new table to the first bucket
-		 * in the old table that contains entries which will hash
-		 * to the new bucket.
-		 */
-		for (pprev = &ntbl->buckets[i]; *pprev != NULL;
-		     pprev = &rht_dereference(*pprev, ht)->next)
-			;
-		RCU_INIT_POINTER(*pprev, tbl->buckets[i + ntbl->size]);
+	/* Link the first entry in the old bucket to the end of the
+	 * bucket in the new table. As entries are concurrently being
+	 * added to the new table, lock down the new bucket. As we
+	 * always divide the size in half when shrinking, each bucket
+	 * in the new table maps to exactly two buckets in the old table.
+	 */
+	for (new_hash = 0; new_hash < new_tbl->size; new_hash++) {
+		for (old_hash = new_hash; old_hash < tbl->size;
+		     old_hash += new_tbl->size) {
+			old_bucket_lock = bucket_lock(tbl, old_hash);
+
+			spin_lock_bh(old_bucket_lock);
+			he = rht_dereference_bucket(tbl->buckets[old_hash],
+						    tbl, old_hash);
+			if (he)
+				link_old_to_new(new_tbl, new_hash, he);
+			spin_unlock_bh(old_bucket_lock);
+		}
 	}
 
 	/* Publish the new, valid hash table */
-	rcu_assign_pointer(ht->tbl, ntbl);
+	rcu_assign_pointer(ht->tbl, new_tbl);
 
-	/* Wait for readers. No new readers will have references to the
-	 * old hash table.
+	/* Wait for readers and mutations. None of them will have references
+	 * to the old hash table or its bucket locks afterwards.
 	 */
 	synchronize_rcu();
 
@@ -337,103 +416,238 @@ int rhashtable_shrink(struct rhashtable *ht, gfp_t flags)
 }
 EXPORT_SYMBOL_GPL(rhashtable_shrink);
 
+static void rht_deferred_worker(struct work_struct *work)
+{
+	struct rhashtable *ht;
+	struct bucket_table *tbl;
+
+	ht = container_of(work, struct rhashtable, run_work.work);
+	mutex_lock(&ht->mutex);
+	if (ht->being_destroyed)
+		goto unlock;
+
+	tbl = rht_dereference(ht->tbl, ht);
+
+	if (ht->p.grow_decision && ht->p.grow_decision(ht, tbl->size))
+		rhashtable_expand(ht);
+	else if (ht->p.shrink_decision && ht->p.shrink_decision(ht, tbl->size))
+		rhashtable_shrink(ht);
+
+unlock:
+	mutex_unlock(&ht->mutex);
+}
+
+/* Takes the bucket lock of @hash in ht->tbl and, during a resize, in
+ * ht->future_tbl as well. Returns the table new entries go into, which is
+ * stored in @new_tbl, while @tbl receives ht->tbl. Must be called under
+ * rcu_read_lock(), which keeps both tables and their locks alive.
+ */
+static void rht_lock_buckets(struct rhashtable *ht, u32 hash,
+			     struct bucket_table **tbl,
+			     struct bucket_table **new_tbl)
+{
+	*tbl = rht_dereference_rcu(ht->tbl, ht);
+	spin_lock_bh(bucket_lock(*tbl, rht_bucket_index(*tbl, hash)));
+
+	*new_tbl = rht_dereference_rcu(ht->future_tbl, ht);
+	if (*new_tbl != *tbl)
+		spin_lock_nested(bucket_lock(*new_tbl,
+					     rht_bucket_index(*new_tbl, hash)),
+				 SINGLE_DEPTH_NESTING);
+}
+
+static void rht_unlock_buckets(u32 hash, struct bucket_table *tbl,
+			       struct bucket_table *new_tbl)
+{
+	if (new_tbl != tbl)
+		spin_unlock(bucket_lock(new_tbl,
+					rht_bucket_index(new_tbl, hash)));
+	spin_unlock_bh(bucket_lock(tbl, rht_bucket_index(tbl, hash)));
+}
+
 /**
  * rhashtable_insert - insert object into hash hash table
  * @ht:		hash table
  * @obj:	pointer to hash head inside object
- * @flags:	allocation flags (table expansion)
  *
- * Will automatically grow the table via rhashtable_expand() if the the
- * grow_decision function specified at rhashtable_init() returns true.
+ * Will take a per bucket spinlock to protect against mutual mutations
+ * on the same bucket. Multiple insertions may occur in parallel unless
+ * they map to the same bucket lock.
+ *
+ * It is safe to call this function from atomic context.
  *
- * The caller must ensure that no concurrent table mutations occur. It is
- * however valid to have concurrent lookups if they are RCU protected.
+ * Will trigger an automatic deferred table resizing if the grow_decision
+ * function specified at rhashtable_init() returns true.
  */
-void rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj,
-		       gfp_t flags)
+void rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj)
 {
-	struct bucket_table *tbl = rht_dereference(ht->tbl, ht);
-	u32 hash;
+	struct bucket_table *tbl, *new_tbl;
+	u32 hash, new_hash;
 
-	ASSERT_RHT_MUTEX(ht);
+	hash = obj_raw_hashfn(ht, rht_obj(ht, obj));
+
+	rcu_read_lock();
+	rht_lock_buckets(ht, hash, &tbl, &new_tbl);
 
-	hash = head_hashfn(ht, obj, tbl->size);
-	RCU_INIT_POINTER(obj->next, tbl->buckets[hash]);
-	rcu_assign_pointer(tbl->buckets[hash], obj);
-	ht->nelems++;
+	new_hash = rht_bucket_index(new_tbl, hash);
+	RCU_INIT_POINTER(obj->next,
+			 rht_dereference_bucket(new_tbl->buckets[new_hash],
+						new_tbl, new_hash));
+	rcu_assign_pointer(new_tbl->buckets[new_hash], obj);
+	atomic_inc(&ht->nelems);
 
-	if (ht->p.grow_decision && ht->p.grow_decision(ht, tbl->size))
-		rhashtable_expand(ht, flags);
+	rht_unlock_buckets(hash, tbl, new_tbl);
+
+	/* Only grow the table if no resizing is currently in progress. */
+	if (tbl == new_tbl && ht->p.grow_decision &&
+	    ht->p.grow_decision(ht, tbl->size))
+		schedule_delayed_work(&ht->run_work, 0);
+
+	rcu_read_unlock();
 }
 EXPORT_SYMBOL_GPL(rhashtable_insert);
 
+static void *rht_bucket_find_key(struct rhashtable *ht,
+				 const struct bucket_table *tbl, u32 hash,
+				 const void *key)
+{
+	struct rhash_head *he;
+	u32 idx = rht_bucket_index(tbl, hash);
+
+	rht_for_each(he, tbl, idx) {
+		if (!memcmp(rht_obj(ht, he) + ht->p.key_offset, key,
+			    ht->p.key_len))
+			return rht_obj(ht, he);
+	}
+
+	return NULL;
+}
+
 /**
- * rhashtable_remove_pprev - remove object from hash table given previous element
+ * rhashtable_lookup_get_insert - insert object unless its key is present
  * @ht:		hash table
  * @obj:	pointer to hash head inside object
- * @pprev:	pointer to previous element
- * @flags:	allocation flags (table expansion)
  *
- * Identical to rhashtable_remove() but caller is alreayd aware of the element
- * in front of the element to be deleted. This is in particular useful for
- * deletion when combined with walking or lookup.
+ * Looks up the key of @obj and inserts it only if no entry with the same
+ * key exists, with the bucket locks held across both steps so that
+ * concurrent callers never insert duplicates.
+ *
+ * This function may only be used for fixed key hash tables (key_len
+ * parameter set). It will BUG() if used inappropriately.
+ *
+ * Returns NULL if @obj was inserted, or the entry already present
+ * otherwise. As for rhashtable_lookup(), the caller must ensure that the
+ * returned object is not freed meanwhile, e.g. by holding rcu_read_lock().
  */
-void rhashtable_remove_pprev(struct rhashtable *ht, struct rhash_head *obj,
-			     struct rhash_head __rcu **pprev, gfp_t flags)
+void *rhashtable_lookup_get_insert(struct rhashtable *ht,
+				   struct rhash_head *obj)
 {
-	struct bucket_table *tbl = rht_dereference(ht->tbl, ht);
+	struct bucket_table *tbl, *new_tbl;
+	const void *key;
+	void *old;
+	u32 hash, new_hash;
 
-	ASSERT_RHT_MUTEX(ht);
+	BUG_ON(!ht->p.key_len);
 
-	RCU_INIT_POINTER(*pprev, obj->next);
-	ht->nelems--;
+	key = rht_obj(ht, obj) + ht->p.key_offset;
+	hash = obj_raw_hashfn(ht, rht_obj(ht, obj));
 
-	if (ht->p.shrink_decision &&
-	    ht->p.shrink_decision(ht, tbl->size))
-		rhashtable_shrink(ht, flags);
+	rcu_read_lock();
+	rht_lock_buckets(ht, hash, &tbl, &new_tbl);
+
+	old = rht_bucket_find_key(ht, new_tbl, hash, key);
+	if (!old && tbl != new_tbl)
+		old = rht_bucket_find_key(ht, tbl, hash, key);
+	if (old) {
+		rht_unlock_buckets(hash, tbl, new_tbl);
+		rcu_read_unlock();
+		return old;
+	}
+
+	new_hash = rht_bucket_index(new_tbl, hash);
+	RCU_INIT_POINTER(obj->next,
+			 rht_dereference_bucket(new_tbl->buckets[new_hash],
+						new_tbl, new_hash));
+	rcu_assign_pointer(new_tbl->buckets[new_hash], obj);
+	atomic_inc(&ht->nelems);
+
+	rht_unlock_buckets(hash, tbl, new_tbl);
+
+	if (tbl == new_tbl && ht->p.grow_decision &&
+	    ht->p.grow_decision(ht, tbl->size))
+		schedule_delayed_work(&ht->run_work, 0);
+
+	rcu_read_unlock();
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_get_insert);
+
+static bool __rhashtable_remove(struct bucket_table *tbl, u32 hash,
+				struct rhash_head *obj)
+{
+	struct rhash_head __rcu **pprev = &tbl->buckets[hash];
+	struct rhash_head *he;
+
+	rht_for_each(he, tbl, hash) {
+		if (he != obj) {
+			pprev = &he->next;
+			continue;
+		}
+
+		RCU_INIT_POINTER(*pprev, rht_dereference_bucket(obj->next,
+								tbl, hash));
+		return true;
+	}
+
+	return false;
 }
-EXPORT_SYMBOL_GPL(rhashtable_remove_pprev);
 
 /**
  * rhashtable_remove - remove object from hash table
  * @ht:		hash table
  * @obj:	pointer to hash head inside object
- * @flags:	allocation flags (table expansion)
  *
  * Since the hash chain is single linked, the removal operation needs to
  * walk the bucket chain upon removal. The removal operation is thus
  * considerable slow if the hash table is not correctly sized.
  *
- * Will automatically shrink the table via rhashtable_expand() if the the
- * shrink_decision function specified at rhashtable_init() returns true.
+ * While a resize is in progress the object may be linked from the chains
+ * of both tables, so it is unlinked from each of them.
  *
- * The caller must ensure that no concurrent table mutations occur. It is
- * however valid to have concurrent lookups if they are RCU protected.
+ * Will trigger an automatic deferred table resizing if the shrink_decision
+ * function specified at rhashtable_init() returns true.
+ *
+ * Returns true if the object was found and removed.
  */
-bool rhashtable_remove(struct rhashtable *ht, struct rhash_head *obj,
-		       gfp_t flags)
+bool rhashtable_remove(struct rhashtable *ht, struct rhash_head *obj)
 {
-	struct bucket_table *tbl = rht_dereference(ht->tbl, ht);
-	struct rhash_head __rcu **pprev;
-	struct rhash_head *he;
-	u32 h;
+	struct bucket_table *tbl, *new_tbl;
+	bool found;
+	u32 hash;
 
-	ASSERT_RHT_MUTEX(ht);
+	hash = obj_raw_hashfn(ht, rht_obj(ht, obj));
 
-	h = head_hashfn(ht, obj, tbl->size);
+	rcu_read_lock();
+	rht_lock_buckets(ht, hash, &tbl, &new_tbl);
 
-	pprev = &tbl->buckets[h];
-	rht_for_each(he, tbl->buckets[h], ht) {
-		if (he != obj) {
-			pprev = &he->next;
-			continue;
-		}
+	found = __rhashtable_remove(tbl, rht_bucket_index(tbl, hash), obj);
+	if (new_tbl != tbl)
+		found |= __rhashtable_remove(new_tbl,
+					     rht_bucket_index(new_tbl, hash),
+					     obj);
+	if (found)
+		atomic_dec(&ht->nelems);
 
-		rhashtable_remove_pprev(ht, he, pprev, flags);
-		return true;
-	}
+	rht_unlock_buckets(hash, tbl, new_tbl);
 
-	return false;
+	if (found && tbl == new_tbl && ht->p.shrink_decision &&
+	    ht->p.shrink_decision(ht, tbl->size))
+		schedule_delayed_work(&ht->run_work, 0);
+
+	rcu_read_unlock();
+
+	return found;
 }
 EXPORT_SYMBOL_GPL(rhashtable_remove);
 
@@ -448,25 +662,37 @@ EXPORT_SYMBOL_GPL(rhashtable_remove);
  * This lookup function may only be used for fixed key hash table (key_len
  * paramter set). It will BUG() if used inappropriately.
  *
- * Lookups may occur in parallel with hash mutations as long as the lookup is
- * guarded by rcu_read_lock(). The caller must take care of this.
+ * Lookups may occur in parallel with hash mutations and resizing. The
+ * caller must ensure that the returned object is not freed meanwhile,
+ * e.g. by holding rcu_read_lock() across the lookup and its use.
  */
-void *rhashtable_lookup(const struct rhashtable *ht, const void *key)
+void *rhashtable_lookup(struct rhashtable *ht, const void *key)
 {
-	const struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+	const struct bucket_table *tbl, *old_tbl;
 	struct rhash_head *he;
-	u32 h;
+	u32 hash;
 
 	BUG_ON(!ht->p.key_len);
 
-	h = __hashfn(ht, key, ht->p.key_len, tbl->size);
-	rht_for_each_rcu(he, tbl->buckets[h], ht) {
+	rcu_read_lock();
+	old_tbl = rht_dereference_rcu(ht->tbl, ht);
+	tbl = rht_dereference_rcu(ht->future_tbl, ht);
+	hash = key_hashfn(ht, key, ht->p.key_len);
+restart:
+	rht_for_each_rcu(he, tbl, rht_bucket_index(tbl, hash)) {
 		if (memcmp(rht_obj(ht, he) + ht->p.key_offset, key,
 			   ht->p.key_len))
 			continue;
-		return (void *) he - ht->p.head_offset;
+		rcu_read_unlock();
+		return rht_obj(ht, he);
+	}
+
+	if (unlikely(tbl != old_tbl)) {
+		tbl = old_tbl;
+		goto restart;
 	}
 
+	rcu_read_unlock();
 	return NULL;
 }
 EXPORT_SYMBOL_GPL(rhashtable_lookup);
@@ -474,33 +700,44 @@ EXPORT_SYMBOL_GPL(rhashtable_lookup);
 /**
  * rhashtable_lookup_compare - search hash table with compare function
  * @ht:		hash table
- * @hash:	hash value of desired entry
+ * @key:	the pointer to the key
  * @compare:	compare function, must return true on match
  * @arg:	argument passed on to compare function
  *
  * Traverses the bucket chain behind the provided hash value and calls the
  * specified compare function for each entry.
  *
- * Lookups may occur in parallel with hash mutations as long as the lookup is
- * guarded by rcu_read_lock(). The caller must take care of this.
+ * Lookups may occur in parallel with hash mutations and resizing. The
+ * caller must ensure that the returned object is not freed meanwhile,
+ * e.g. by holding rcu_read_lock() across the lookup and its use.
  *
  * Returns the first entry on which the compare function returned true.
  */
-void *rhashtable_lookup_compare(const struct rhashtable *ht, u32 hash,
+void *rhashtable_lookup_compare(struct rhashtable *ht, const void *key,
 				bool (*compare)(void *, void *), void *arg)
 {
-	const struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+	const struct bucket_table *tbl, *old_tbl;
 	struct rhash_head *he;
+	u32 hash;
 
-	if (unlikely(hash >= tbl->size))
-		return NULL;
-
-	rht_for_each_rcu(he, tbl->buckets[hash], ht) {
+	rcu_read_lock();
+	old_tbl = rht_dereference_rcu(ht->tbl, ht);
+	tbl = rht_dereference_rcu(ht->future_tbl, ht);
+	hash = key_hashfn(ht, key, ht->p.key_len);
+restart:
+	rht_for_each_rcu(he, tbl, rht_bucket_index(tbl, hash)) {
 		if (!compare(rht_obj(ht, he), arg))
 			continue;
-		return (void *) he - ht->p.head_offset;
+		rcu_read_unlock();
+		return rht_obj(ht, he);
 	}
 
+	if (unlikely(tbl != old_tbl)) {
+		tbl = old_tbl;
+		goto restart;
+	}
+
+	rcu_read_unlock();
 	return NULL;
 }
 EXPORT_SYMBOL_GPL(rhashtable_lookup_compare);
@@ -532,7 +769,6 @@ static size_t rounded_hashtable_size(struct rhashtable_params *params)
  *	.key_offset = offsetof(struct test_obj, key),
  *	.key_len = sizeof(int),
  *	.hashfn = arch_fast_hash,
- *	.mutex_is_held = &my_mutex_is_held,
  * };
  *
  * Configuration Example 2: Variable length keys
@@ -552,7 +788,6 @@ static size_t rounded_hashtable_size(struct rhashtable_params *params)
  *	.head_offset = offsetof(struct test_obj, node),
  *	.hashfn = arch_fast_hash,
  *	.obj_hashfn = my_hash_fn,
- *	.mutex_is_held = &my_mutex_is_held,
  * };
  */
 int rhashtable_init(struct rhashtable *ht, struct rhashtable_params *params)
@@ -572,18 +807,28 @@ int rhashtable_init(struct rhashtable *ht, struct rhashtable_params *params)
 	if (params->nelem_hint)
 		size = rounded_hashtable_size(params);
 
-	tbl = bucket_table_alloc(size, GFP_KERNEL);
+	memset(ht, 0, sizeof(*ht));
+	mutex_init(&ht->mutex);
+	memcpy(&ht->p, params, sizeof(*params));
+
+	if (params->locks_mul)
+		ht->p.locks_mul = roundup_pow_of_two(params->locks_mul);
+	else
+		ht->p.locks_mul = BUCKET_LOCKS_PER_CPU;
+
+	tbl = bucket_table_alloc(ht, size);
 	if (tbl == NULL)
 		return -ENOMEM;
 
-	memset(ht, 0, sizeof(*ht));
 	ht->shift = ilog2(tbl->size);
-	memcpy(&ht->p, params, sizeof(*params));
 	RCU_INIT_POINTER(ht->tbl, tbl);
+	RCU_INIT_POINTER(ht->future_tbl, tbl);
 
 	if (!ht->p.hash_rnd)
 		get_random_bytes(&ht->p.hash_rnd, sizeof(ht->p.hash_rnd));
 
+	INIT_DELAYED_WORK(&ht->run_work, rht_deferred_worker);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(rhashtable_init);
@@ -592,16 +837,65 @@ EXPORT_SYMBOL_GPL(rhashtable_init);
  * rhashtable_destroy - destroy hash table
  * @ht:		the hash table to destroy
  *
- * Frees the bucket array. This function is not rcu safe, therefore the caller
- * has to make sure that no resizing may happen by unpublishing the hashtable
- * and waiting for the quiescent cycle before releasing the bucket array.
+ * Stops any pending or running deferred resize and frees the bucket array.
+ * This function is not rcu safe, therefore the caller has to make sure that
+ * no mutations may happen anymore by unpublishing the hashtable and waiting
+ * for the quiescent cycle before releasing the bucket array.
  */
-void rhashtable_destroy(const struct rhashtable *ht)
+void rhashtable_destroy(struct rhashtable *ht)
 {
-	bucket_table_free(ht->tbl);
+	ht->being_destroyed = true;
+	cancel_delayed_work_sync(&ht->run_work);
+
+	mutex_lock(&ht->mutex);
+	bucket_table_free(rht_dereference(ht->tbl, ht));
+	mutex_unlock(&ht->mutex);
 }
 EXPORT_SYMBOL_GPL(rhashtable_destroy);
 
+/**
+ * rhashtable_free_and_destroy - free the remaining elements and destroy
+ * @ht:		the hash table to destroy
+ * @free_fn:	callback invoked for each element still in the table
+ * @arg:	argument passed on to @free_fn
+ *
+ * Like rhashtable_destroy(), but hands every element left in the table to
+ * @free_fn first. The walk runs under rcu_read_lock() and @free_fn may
+ * remove the element it is given, or have it removed concurrently, but
+ * no new elements may be inserted meanwhile. @free_fn must not sleep.
+ */
+void rhashtable_free_and_destroy(struct rhashtable *ht,
+				 void (*free_fn)(void *ptr, void *arg),
+				 void *arg)
+{
+	const struct bucket_table *tbl;
+	struct rhash_head *pos, *next;
+	unsigned int i;
+
+	ht->being_destroyed = true;
+	cancel_delayed_work_sync(&ht->run_work);
+
+	rcu_read_lock();
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (i = 0; i < tbl->size; i++) {
+		pos = rht_dereference_rcu(tbl->buckets[i], ht);
+		while (pos) {
+			next = rht_dereference_rcu(pos->next, ht);
+			free_fn(rht_obj(ht, pos), arg);
+			pos = next;
+		}
+	}
+	rcu_read_unlock();
+
+	/* removals done by free_fn may have queued a shrink again */
+	cancel_delayed_work_sync(&ht->run_work);
+
+	mutex_lock(&ht->mutex);
+	bucket_table_free(rht_dereference(ht->tbl, ht));
+	mutex_unlock(&ht->mutex);
+}
+EXPORT_SYMBOL_GPL(rhashtable_free_and_destroy);
+
 /**************************************************************************
  * Self Test
  **************************************************************************/
@@ -613,11 +907,6 @@ EXPORT_SYMBOL_GPL(rhashtable_destroy);
 #define TEST_PTR	((void *) 0xdeadbeef)
 #define TEST_NEXPANDS	4
 
-static int test_mutex_is_held(void)
-{
-	return 1;
-}
-
 struct test_obj {
 	void			*ptr;
 	int			value;
@@ -659,6 +948,7 @@ static void test_bucket_stats(struct rhashtable *ht,
 				     bool quiet)
 {
 	unsigned int cnt, i, total = 0;
+	struct rhash_head *pos;
 	struct test_obj *obj;
 
 	for (i = 0; i < tbl->size; i++) {
@@ -667,7 +957,7 @@ static void test_bucket_stats(struct rhashtable *ht,
 		if (!quiet)
 			pr_info(" [%#4x/%zu]", i, tbl->size);
 
-		rht_for_each_entry_rcu(obj, tbl->buckets[i], node) {
+		rht_for_each_entry_rcu(obj, pos, tbl, i, node) {
 			cnt++;
 			total++;
 			if (!quiet)
@@ -679,14 +969,15 @@ static void test_bucket_stats(struct rhashtable *ht,
 				i, tbl->buckets[i], cnt);
 	}
 
-	pr_info("  Traversal complete: counted=%u, nelems=%zu, entries=%d\n",
-		total, ht->nelems, TEST_ENTRIES);
+	pr_info("  Traversal complete: counted=%u, nelems=%u, entries=%d\n",
+		total, atomic_read(&ht->nelems), TEST_ENTRIES);
 }
 
 static int __init test_rhashtable(struct rhashtable *ht)
 {
 	struct bucket_table *tbl;
-	struct test_obj *obj, *next;
+	struct test_obj *obj;
+	struct rhash_head *pos, *next;
 	int err;
 	unsigned int i;
 
@@ -707,7 +998,7 @@ static int __init test_rhashtable(struct rhashtable *ht)
 		obj->ptr = TEST_PTR;
 		obj->value = i * 2;
 
-		rhashtable_insert(ht, &obj->node, GFP_KERNEL);
+		rhashtable_insert(ht, &obj->node);
 	}
 
 	rcu_read_lock();
@@ -718,7 +1009,9 @@ static int __init test_rhashtable(struct rhashtable *ht)
 
 	for (i = 0; i < TEST_NEXPANDS; i++) {
 		pr_info("  Table expansion iteration %u...\n", i);
-		rhashtable_expand(ht, GFP_KERNEL);
+		mutex_lock(&ht->mutex);
+		rhashtable_expand(ht);
+		mutex_unlock(&ht->mutex);
 
 		rcu_read_lock();
 		pr_info("  Verifying lookups...\n");
@@ -728,7 +1021,9 @@ static int __init test_rhashtable(struct rhashtable *ht)
 
 	for (i = 0; i < TEST_NEXPANDS; i++) {
 		pr_info("  Table shrinkage iteration %u...\n", i);
-		rhashtable_shrink(ht, GFP_KERNEL);
+		mutex_lock(&ht->mutex);
+		rhashtable_shrink(ht);
+		mutex_unlock(&ht->mutex);
 
 		rcu_read_lock();
 		pr_info("  Verifying lookups...\n");
@@ -743,17 +1038,22 @@ static int __init test_rhashtable(struct rhashtable *ht)
 		obj = rhashtable_lookup(ht, &key);
 		BUG_ON(!obj);
 
-		rhashtable_remove(ht, &obj->node, GFP_KERNEL);
+		rhashtable_remove(ht, &obj->node);
 		kfree(obj);
 	}
 
 	return 0;
 
 error:
-	tbl = rht_dereference_rcu(ht->tbl, ht);
-	for (i = 0; i < tbl->size; i++)
-		rht_for_each_entry_safe(obj, next, tbl->buckets[i], ht, node)
+	mutex_lock(&ht->mutex);
+	tbl = rht_dereference(ht->tbl, ht);
+	for (i = 0; i < tbl->size; i++) {
+		spin_lock_bh(bucket_lock(tbl, i));
+		rht_for_each_entry_safe(obj, pos, next, tbl, i, node)
 			kfree(obj);
+		spin_unlock_bh(bucket_lock(tbl, i));
+	}
+	mutex_unlock(&ht->mutex);
 
 	return err;
 }
@@ -767,7 +1067,6 @@ static int __init test_rht_init(void)
 		.key_offset = offsetof(struct test_obj, value),
 		.key_len = sizeof(int),
 		.hashfn = arch_fast_hash,
-		.mutex_is_held = &test_mutex_is_held,
 		.grow_decision = rht_grow_above_75,
 		.shrink_decision = rht_shrink_below_30,
 	};
@@ -0,0 +1,1081 @@
+/*
+ * Zstandard compressor
+ *
+ * Produces single frames in the format of RFC 8478.  Matches are found
+ * with hash chains over a 64KB window, literals are Huffman coded and the
+ * sequences use either the predefined FSE tables or ones fitted to the
+ * block, whichever is estimated to be cheaper.  Blocks that do not shrink
+ * are stored raw.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/sort.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#include "zstd_internal.h"
+
+#define ZSTD_C_WINDOW_LOG	16
+#define ZSTD_C_MAX_OFFSET	((1 << ZSTD_C_WINDOW_LOG) - 1)
+#define ZSTD_C_HASH_LOG		14
+#define ZSTD_C_HASH_LOG_MIN	10
+#define ZSTD_C_BLOCK		(32 * 1024)
+#define ZSTD_C_MIN_MATCH	4
+#define ZSTD_C_MAX_SEQ		(ZSTD_C_BLOCK / ZSTD_C_MIN_MATCH)
+#define ZSTD_C_SEARCH_DEPTH	16
+/* fewer literals than this are cheaper to store than to describe a tree */
+#define ZSTD_C_HUF_MIN		64
+
+struct zstd_seq {
+	u32 off_value;		/* offset + 3, or a repeated offset code */
+	u16 ll;
+	u16 ml;
+};
+
+struct zstd_fse_ctable {
+	u16 state[1 << ZSTD_LL_LOG_MAX];
+	struct {
+		s32 find_state;
+		u32 delta_nb_bits;
+	} sym[ZSTD_ML_MAX + 1];
+	unsigned int log;
+};
+
+struct zstd_fse_cstate {
+	u32 value;
+	const struct zstd_fse_ctable *ct;
+};
+
+struct zstd_cctx {
+	u32 hash[1 << ZSTD_C_HASH_LOG];		/* position + 1 */
+	u16 chain[1 << ZSTD_C_WINDOW_LOG];	/* distance to the previous */
+	struct zstd_seq seqs[ZSTD_C_MAX_SEQ];
+	u8 lits[ZSTD_C_BLOCK];
+	struct zstd_fse_ctable ll_ct, of_ct, ml_ct;
+	u32 count[256];
+	u16 huf_code[256];
+	u8 huf_bits[256];
+	/* Huffman tree: leaves sorted by count, then the inner nodes */
+	u32 huf_key[256];
+	u32 huf_weight[511];
+	u16 huf_parent[511];
+	u8 huf_depth[511];
+	u32 rep[3];
+	unsigned int hash_log;
+	u32 next_insert;
+	unsigned int nb_seq;
+	size_t nb_lits;
+};
+
+struct zstd_bitwr {
+	u64 bits;
+	unsigned int nb;
+	u8 *start;
+	u8 *ptr;
+	u8 *end;
+	bool overflow;
+};
+
+static void zstd_bitwr_init(struct zstd_bitwr *bw, u8 *dst, size_t cap)
+{
+	bw->bits = 0;
+	bw->nb = 0;
+	bw->start = dst;
+	bw->ptr = dst;
+	bw->end = dst + cap;
+	bw->overflow = false;
+}
+
+/* At most 56 bits may be added between flushes */
+static inline void zstd_bitwr_add(struct zstd_bitwr *bw, u32 v,
+				  unsigned int nb)
+{
+	bw->bits |= (v & ((1ULL << nb) - 1)) << bw->nb;
+	bw->nb += nb;
+}
+
+static inline void zstd_bitwr_flush(struct zstd_bitwr *bw)
+{
+	unsigned int bytes = bw->nb >> 3;
+
+	if (bw->end - bw->ptr < sizeof(u64)) {
+		bw->overflow = true;
+		bw->ptr = bw->start;
+	}
+	put_unaligned_le64(bw->bits, bw->ptr);
+	bw->ptr += bytes;
+	bw->bits >>= bytes * 8;
+	bw->nb &= 7;
+}
+
+/* Ends the stream with the marker bit, returns its size or 0 */
+static size_t zstd_bitwr_close(struct zstd_bitwr *bw)
+{
+	zstd_bitwr_add(bw, 1, 1);
+	zstd_bitwr_flush(bw);
+	if (bw->overflow)
+		return 0;
+	return bw->ptr - bw->start + (bw->nb > 0);
+}
+
+static unsigned int zstd_fse_optimal_log(unsigned int log_max, u32 total,
+					 unsigned int max_sym)
+{
+	int src_bits = (int)zstd_highbit(total - 1) - 2;
+	unsigned int min_bits = min(zstd_highbit(total) + 1,
+				    zstd_highbit(max_sym) + 2);
+	unsigned int log = log_max;
+
+	if (src_bits < (int)log)
+		log = max(src_bits, 0);
+	if (min_bits > log)
+		log = min_bits;
+	return clamp_t(unsigned int, log, ZSTD_FSE_LOG_MIN, log_max);
+}
+
+/*
+ * Scales the counts to probabilities summing to 1 << log, every symbol
+ * present getting at least one cell.  With 'cap_half' no symbol gets more
+ * than half of them, so that every state transition reads a bit.
+ */
+static void zstd_fse_normalize(s16 *norm, const u32 *count,
+			       unsigned int max_sym, u32 total,
+			       unsigned int log, bool cap_half)
+{
+	int size = 1 << log, sum = 0, limit = cap_half ? size / 2 : size;
+	unsigned int s, best;
+
+	for (s = 0; s <= max_sym; s++) {
+		if (!count[s]) {
+			norm[s] = 0;
+			continue;
+		}
+		norm[s] = max_t(u32, 1, ((u64)count[s] * size + total / 2) /
+				total);
+		if (norm[s] > limit)
+			norm[s] = limit;
+		sum += norm[s];
+	}
+
+	while (sum > size) {
+		for (best = 0, s = 1; s <= max_sym; s++)
+			if (norm[s] > norm[best])
+				best = s;
+		norm[best]--;
+		sum--;
+	}
+	while (sum < size) {
+		best = max_sym + 1;
+		for (s = 0; s <= max_sym; s++)
+			if (count[s] && norm[s] < limit &&
+			    (best > max_sym || count[s] > count[best]))
+				best = s;
+		norm[best]++;
+		sum++;
+	}
+}
+
+static int zstd_write_ncount(u8 *dst, size_t cap, const s16 *norm,
+			     unsigned int max_sym, unsigned int log)
+{
+	unsigned int threshold = 1 << log, nb_bits = log + 1, sym = 0;
+	int remaining = (1 << log) + 1;
+	u32 bits = log - ZSTD_FSE_LOG_MIN;
+	unsigned int nb = 4;
+	bool prev0 = false;
+	u8 *op = dst;
+
+#define ZSTD_NCOUNT_FLUSH()						\
+	do {								\
+		if (nb >= 16) {						\
+			if (cap - (op - dst) < 2)			\
+				return -ENOSPC;				\
+			*op++ = bits;					\
+			*op++ = bits >> 8;				\
+			bits >>= 16;					\
+			nb -= 16;					\
+		}							\
+	} while (0)
+
+	while (sym <= max_sym && remaining > 1) {
+		int count, max;
+
+		if (prev0) {
+			unsigned int start = sym;
+
+			while (!norm[sym])
+				sym++;
+			while (sym >= start + 3) {
+				start += 3;
+				bits |= 3 << nb;
+				nb += 2;
+				ZSTD_NCOUNT_FLUSH();
+			}
+			bits |= (sym - start) << nb;
+			nb += 2;
+			ZSTD_NCOUNT_FLUSH();
+		}
+
+		count = norm[sym++];
+		max = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= (int)threshold)
+			count += max;
+		bits |= count << nb;
+		nb += nb_bits;
+		nb -= count < max;
+		prev0 = count == 1;
+		while (remaining < (int)threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+		ZSTD_NCOUNT_FLUSH();
+	}
+
+#undef ZSTD_NCOUNT_FLUSH
+
+	for (; nb; nb = nb > 8 ? nb - 8 : 0) {
+		if (op - dst == cap)
+			return -ENOSPC;
+		*op++ = bits;
+		bits >>= 8;
+	}
+	return op - dst;
+}
+
+static void zstd_fse_build_ctable(struct zstd_fse_ctable *ct, const s16 *norm,
+				  unsigned int max_sym, unsigned int log)
+{
+	u8 spread[1 << ZSTD_LL_LOG_MAX];
+	u16 cumul[ZSTD_ML_MAX + 2];
+	unsigned int size = 1 << log, high = size - 1, mask = size - 1;
+	unsigned int step = zstd_fse_step(size), pos = 0, s, u;
+	int n, total = 0;
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_sym; s++) {
+		if (norm[s] == -1) {
+			cumul[s + 1] = cumul[s] + 1;
+			spread[high--] = s;
+		} else {
+			cumul[s + 1] = cumul[s] + norm[s];
+		}
+	}
+	for (s = 0; s <= max_sym; s++) {
+		for (n = 0; n < norm[s]; n++) {
+			spread[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+	for (u = 0; u < size; u++)
+		ct->state[cumul[spread[u]]++] = size + u;
+
+	for (s = 0; s <= max_sym; s++) {
+		switch (norm[s]) {
+		case 0:
+			ct->sym[s].delta_nb_bits = ((log + 1) << 16) - size;
+			break;
+		case -1:
+		case 1:
+			ct->sym[s].delta_nb_bits = (log << 16) - size;
+			ct->sym[s].find_state = total - 1;
+			total++;
+			break;
+		default: {
+			unsigned int bits_out = log - zstd_highbit(norm[s] - 1);
+
+			ct->sym[s].delta_nb_bits = (bits_out << 16) -
+						   (norm[s] << bits_out);
+			ct->sym[s].find_state = total - norm[s];
+			total += norm[s];
+			break;
+		}
+		}
+	}
+	ct->log = log;
+}
+
+static inline void zstd_fse_init_state(struct zstd_fse_cstate *st,
+				       const struct zstd_fse_ctable *ct,
+				       unsigned int sym)
+{
+	u32 bits_out = (ct->sym[sym].delta_nb_bits + (1 << 15)) >> 16;
+	u32 value = (bits_out << 16) - ct->sym[sym].delta_nb_bits;
+
+	st->ct = ct;
+	st->value = ct->state[(value >> bits_out) + ct->sym[sym].find_state];
+}
+
+static inline void zstd_fse_encode(struct zstd_bitwr *bw,
+				   struct zstd_fse_cstate *st,
+				   unsigned int sym)
+{
+	const struct zstd_fse_ctable *ct = st->ct;
+	u32 bits_out = (st->value + ct->sym[sym].delta_nb_bits) >> 16;
+
+	zstd_bitwr_add(bw, st->value, bits_out);
+	st->value = ct->state[(st->value >> bits_out) +
+			      ct->sym[sym].find_state];
+}
+
+static inline void zstd_fse_flush_state(struct zstd_bitwr *bw,
+					const struct zstd_fse_cstate *st)
+{
+	zstd_bitwr_add(bw, st->value, st->ct->log);
+}
+
+static int zstd_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Builds a Huffman code for the literal counts, no longer than
+ * ZSTD_HUF_LOG_MAX bits and complete, as the format needs the weights of
+ * all symbols to add up to a power of two.  Returns the longest length.
+ */
+static unsigned int zstd_huf_build(struct zstd_cctx *cctx,
+				   unsigned int max_sym)
+{
+	const u32 full = 1 << ZSTD_HUF_LOG_MAX;
+	unsigned int n = 0, leaf = 0, node, next, i, s, k, best, log = 0;
+	u32 total = 0;
+
+	for (s = 0; s <= max_sym; s++) {
+		cctx->huf_bits[s] = 0;
+		if (cctx->count[s])
+			cctx->huf_key[n++] = cctx->count[s] << 8 | s;
+	}
+	sort(cctx->huf_key, n, sizeof(u32), zstd_cmp_u32, NULL);
+
+	/* two queues: the sorted leaves and the inner nodes as they form */
+	for (i = 0; i < n; i++)
+		cctx->huf_weight[i] = cctx->huf_key[i] >> 8;
+	for (node = next = n; next < 2 * n - 1; next++) {
+		u32 w = 0;
+
+		for (k = 0; k < 2; k++) {
+			unsigned int pick;
+
+			if (leaf < n && (node >= next ||
+			    cctx->huf_weight[leaf] <= cctx->huf_weight[node]))
+				pick = leaf++;
+			else
+				pick = node++;
+			cctx->huf_parent[pick] = next;
+			w += cctx->huf_weight[pick];
+		}
+		cctx->huf_weight[next] = w;
+	}
+	cctx->huf_depth[2 * n - 2] = 0;
+	for (i = 2 * n - 2; i-- > 0;)
+		cctx->huf_depth[i] = cctx->huf_depth[cctx->huf_parent[i]] + 1;
+
+	for (i = 0; i < n; i++) {
+		s = cctx->huf_key[i] & 0xff;
+		cctx->huf_bits[s] = min_t(unsigned int, cctx->huf_depth[i],
+					  ZSTD_HUF_LOG_MAX);
+		total += full >> cctx->huf_bits[s];
+	}
+
+	/* clamping oversubscribed the code: lengthen the rarest codes */
+	while (total > full) {
+		best = 0;
+		for (i = 0; i < n; i++) {
+			s = cctx->huf_key[i] & 0xff;
+			if (cctx->huf_bits[s] < ZSTD_HUF_LOG_MAX &&
+			    (!best ||
+			     cctx->huf_bits[s] > cctx->huf_bits[best - 1]))
+				best = s + 1;
+		}
+		s = best - 1;
+		total -= full >> (cctx->huf_bits[s] + 1);
+		cctx->huf_bits[s]++;
+	}
+	/* and fill what that left over by shortening the most frequent */
+	while (total < full) {
+		for (i = n; i-- > 0;) {
+			s = cctx->huf_key[i] & 0xff;
+			if (cctx->huf_bits[s] > 1 &&
+			    (full >> cctx->huf_bits[s]) <= full - total)
+				break;
+		}
+		total += full >> cctx->huf_bits[s];
+		cctx->huf_bits[s]--;
+	}
+
+	for (s = 0; s <= max_sym; s++)
+		log = max_t(unsigned int, log, cctx->huf_bits[s]);
+	return log;
+}
+
+/* Hands out the codes the decoder's table layout implies */
+static void zstd_huf_assign_codes(struct zstd_cctx *cctx, u8 *weights,
+				  unsigned int max_sym, unsigned int log)
+{
+	u32 rank[ZSTD_HUF_LOG_MAX + 2] = { 0 }, next = 0, cur;
+	unsigned int s, w;
+
+	for (s = 0; s <= max_sym; s++) {
+		weights[s] = cctx->huf_bits[s] ?
+			     log + 1 - cctx->huf_bits[s] : 0;
+		rank[weights[s]]++;
+	}
+	for (w = 1; w <= log; w++) {
+		cur = next;
+		next += rank[w] << (w - 1);
+		rank[w] = cur;
+	}
+	for (s = 0; s <= max_sym; s++) {
+		w = weights[s];
+		if (!w)
+			continue;
+		cctx->huf_code[s] = rank[w] >> (w - 1);
+		rank[w] += 1 << (w - 1);
+	}
+}
+
+/* Weights compressed with two interleaved FSE states, 0 if not possible */
+static size_t zstd_huf_write_fse_weights(u8 *dst, size_t cap,
+					 const u8 *weights, unsigned int nb)
+{
+	struct zstd_fse_ctable ct;
+	struct zstd_fse_cstate s1, s2;
+	struct zstd_bitwr bw;
+	s16 norm[ZSTD_HUF_LOG_MAX + 1];
+	u32 count[ZSTD_HUF_LOG_MAX + 1] = { 0 };
+	unsigned int max_w = 0, log, i;
+	int ret;
+	size_t size;
+
+	for (i = 0; i < nb; i++) {
+		count[weights[i]]++;
+		max_w = max_t(unsigned int, max_w, weights[i]);
+	}
+	if (nb < 2 || count[max_w] == nb || count[weights[0]] == nb)
+		return 0;
+
+	log = zstd_fse_optimal_log(ZSTD_HUF_WEIGHT_LOG_MAX, nb, max_w);
+	zstd_fse_normalize(norm, count, max_w, nb, log, true);
+	ret = zstd_write_ncount(dst, cap, norm, max_w, log);
+	if (ret < 0)
+		return 0;
+	zstd_fse_build_ctable(&ct, norm, max_w, log);
+
+	zstd_bitwr_init(&bw, dst + ret, cap - ret);
+	i = nb;
+	if (nb & 1) {
+		zstd_fse_init_state(&s1, &ct, weights[--i]);
+		zstd_fse_init_state(&s2, &ct, weights[--i]);
+		zstd_fse_encode(&bw, &s1, weights[--i]);
+	} else {
+		zstd_fse_init_state(&s2, &ct, weights[--i]);
+		zstd_fse_init_state(&s1, &ct, weights[--i]);
+	}
+	while (i) {
+		zstd_fse_encode(&bw, &s2, weights[--i]);
+		zstd_fse_encode(&bw, &s1, weights[--i]);
+		zstd_bitwr_flush(&bw);
+	}
+	zstd_fse_flush_state(&bw, &s2);
+	zstd_fse_flush_state(&bw, &s1);
+	size = zstd_bitwr_close(&bw);
+	return size ? ret + size : 0;
+}
+
+static size_t zstd_huf_encode_stream(const struct zstd_cctx *cctx, u8 *dst,
+				     size_t cap, const u8 *src, size_t n)
+{
+	struct zstd_bitwr bw;
+	size_t i = n;
+
+	/* the decoder reads backwards, so the last literal goes first */
+	zstd_bitwr_init(&bw, dst, cap);
+	while (i & 3) {
+		i--;
+		zstd_bitwr_add(&bw, cctx->huf_code[src[i]],
+			       cctx->huf_bits[src[i]]);
+	}
+	zstd_bitwr_flush(&bw);
+	while (i) {
+		zstd_bitwr_add(&bw, cctx->huf_code[src[i - 1]],
+			       cctx->huf_bits[src[i - 1]]);
+		zstd_bitwr_add(&bw, cctx->huf_code[src[i - 2]],
+			       cctx->huf_bits[src[i - 2]]);
+		zstd_bitwr_add(&bw, cctx->huf_code[src[i - 3]],
+			       cctx->huf_bits[src[i - 3]]);
+		zstd_bitwr_add(&bw, cctx->huf_code[src[i - 4]],
+			       cctx->huf_bits[src[i - 4]]);
+		zstd_bitwr_flush(&bw);
+		i -= 4;
+	}
+	return zstd_bitwr_close(&bw);
+}
+
+/* Huffman coded literals section, 0 if it does not beat 'limit' */
+static size_t zstd_encode_huf_literals(struct zstd_cctx *cctx, u8 *dst,
+				       size_t cap, unsigned int max_sym,
+				       size_t limit)
+{
+	const u8 *lit = cctx->lits;
+	size_t n = cctx->nb_lits, hsize, size, pos;
+	unsigned int log, format, bits, i;
+	u8 weights[256];
+	u64 header;
+
+	/* Size_Format 0 is a single stream, the others four */
+	if (n < 256) {
+		format = 0;
+		hsize = 3;
+		bits = 10;
+	} else if (n < 1024) {
+		format = 1;
+		hsize = 3;
+		bits = 10;
+	} else if (n < 16384) {
+		format = 2;
+		hsize = 4;
+		bits = 14;
+	} else {
+		format = 3;
+		hsize = 5;
+		bits = 18;
+	}
+	limit = min(limit, cap);
+	if (limit <= hsize + 1)
+		return 0;
+
+	log = zstd_huf_build(cctx, max_sym);
+	zstd_huf_assign_codes(cctx, weights, max_sym, log);
+
+	/* the weight of the last symbol is implied */
+	pos = hsize;
+	size = zstd_huf_write_fse_weights(dst + pos + 1, limit - pos - 1,
+					  weights, max_sym);
+	if (size && size <= 127 &&
+	    (max_sym > 128 || size < (max_sym + 1) / 2)) {
+		dst[pos] = size;
+		pos += 1 + size;
+	} else if (max_sym <= 128 && limit - pos > 1 + (max_sym + 1) / 2) {
+		dst[pos++] = 127 + max_sym;
+		for (i = 0; i < max_sym; i += 2)
+			dst[pos++] = weights[i] << 4 |
+				     (i + 1 < max_sym ? weights[i + 1] : 0);
+	} else {
+		return 0;
+	}
+
+	if (!format) {
+		size = zstd_huf_encode_stream(cctx, dst + pos, limit - pos,
+					      lit, n);
+		if (!size)
+			return 0;
+		pos += size;
+	} else {
+		size_t segment = (n + 3) / 4, jump = pos;
+
+		if (limit - pos <= 6)
+			return 0;
+		pos += 6;
+		for (i = 0; i < 4; i++) {
+			size_t len = i < 3 ? segment : n - 3 * segment;
+
+			size = zstd_huf_encode_stream(cctx, dst + pos,
+						      limit - pos, lit, len);
+			if (!size)
+				return 0;
+			if (i < 3)
+				put_unaligned_le16(size, dst + jump + 2 * i);
+			lit += len;
+			pos += size;
+		}
+	}
+	if (pos >= limit)
+		return 0;
+
+	header = ZSTD_LIT_COMPRESSED | format << 2 | (u64)n << 4 |
+		 (u64)(pos - hsize) << (4 + bits);
+	for (i = 0; i < hsize; i++)
+		dst[i] = header >> (8 * i);
+	return pos;
+}
+
+static int zstd_encode_literals(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	size_t n = cctx->nb_lits, hsize, size, i;
+	unsigned int max_sym = 0, type = ZSTD_LIT_RAW, s;
+
+	hsize = n < 32 ? 1 : n < 4096 ? 2 : 3;
+
+	if (n) {
+		memset(cctx->count, 0, sizeof(cctx->count));
+		for (i = 0; i < n; i++)
+			cctx->count[cctx->lits[i]]++;
+		for (s = 0; s < 256; s++)
+			if (cctx->count[s])
+				max_sym = s;
+		if (cctx->count[max_sym] == n)
+			type = ZSTD_LIT_RLE;
+	}
+
+	if (type == ZSTD_LIT_RAW && n >= ZSTD_C_HUF_MIN) {
+		size = zstd_encode_huf_literals(cctx, dst, cap, max_sym,
+						hsize + n);
+		if (size)
+			return size;
+	}
+
+	size = type == ZSTD_LIT_RLE ? 1 : n;
+	if (hsize + size > cap)
+		return -ENOSPC;
+	switch (hsize) {
+	case 1:
+		dst[0] = type | n << 3;
+		break;
+	case 2:
+		dst[0] = type | 1 << 2 | n << 4;
+		dst[1] = n >> 4;
+		break;
+	default:
+		dst[0] = type | 3 << 2 | n << 4;
+		dst[1] = n >> 4;
+		dst[2] = n >> 12;
+		break;
+	}
+	if (type == ZSTD_LIT_RLE)
+		dst[hsize] = cctx->lits[0];
+	else
+		memcpy(dst + hsize, cctx->lits, n);
+	return hsize + size;
+}
+
+static inline unsigned int zstd_ll_code(u32 ll)
+{
+	unsigned int c;
+
+	if (ll < 16)
+		return ll;
+	if (ll >= 64)
+		return zstd_highbit(ll) + 19;
+	for (c = 16; zstd_ll_base[c + 1] <= ll; c++)
+		;
+	return c;
+}
+
+static inline unsigned int zstd_ml_code(u32 ml)
+{
+	u32 base = ml - ZSTD_MIN_MATCH;
+	unsigned int c;
+
+	if (base < 32)
+		return base;
+	if (base >= 128)
+		return zstd_highbit(base) + 36;
+	for (c = 32; zstd_ml_base[c + 1] <= ml; c++)
+		;
+	return c;
+}
+
+static inline void zstd_seq_add_bits(struct zstd_bitwr *bw,
+				     const struct zstd_seq *seq)
+{
+	unsigned int ll = zstd_ll_code(seq->ll);
+	unsigned int ml = zstd_ml_code(seq->ml);
+	unsigned int of = zstd_highbit(seq->off_value);
+
+	zstd_bitwr_add(bw, seq->ll - zstd_ll_base[ll], zstd_ll_bits[ll]);
+	zstd_bitwr_add(bw, seq->ml - zstd_ml_base[ml], zstd_ml_bits[ml]);
+	zstd_bitwr_add(bw, seq->off_value - (1U << of), of);
+	zstd_bitwr_flush(bw);
+}
+
+/* Rough cost in bits of coding 'count' with the distribution 'norm' */
+static u32 zstd_fse_cost(const u32 *count, const s16 *norm,
+			 unsigned int max_sym, unsigned int log)
+{
+	u32 cost = 0;
+	unsigned int s;
+
+	for (s = 0; s <= max_sym; s++)
+		if (count[s])
+			cost += count[s] *
+				(log - zstd_highbit(norm[s] > 0 ? norm[s] : 1));
+	return cost;
+}
+
+/*
+ * Picks the table for one of the three sequence fields, writes its
+ * description to 'dst' and builds the encoding table.  Returns the size of
+ * the description or a negative errno.
+ */
+static int zstd_seq_choose(struct zstd_fse_ctable *ct, enum zstd_seq_mode *mode,
+			   u8 *dst, size_t cap, const u32 *count,
+			   unsigned int max, unsigned int nb,
+			   const s16 *def, unsigned int def_max,
+			   unsigned int def_log, unsigned int log_max)
+{
+	s16 norm[ZSTD_ML_MAX + 1];
+	unsigned int s, log;
+	u32 def_cost = ~0U, cost;
+	int ret;
+
+	if (count[max] == nb && nb > 1) {
+		if (!cap)
+			return -ENOSPC;
+		memset(norm, 0, sizeof(norm));
+		norm[max] = 1;
+		zstd_fse_build_ctable(ct, norm, max, 0);
+		*mode = ZSTD_SEQ_RLE;
+		*dst = max;
+		return 1;
+	}
+
+	if (max <= def_max)
+		def_cost = zstd_fse_cost(count, def, max, def_log);
+
+	log = zstd_fse_optimal_log(log_max, nb, max);
+	zstd_fse_normalize(norm, count, max, nb, log, false);
+	ret = zstd_write_ncount(dst, cap, norm, max, log);
+	if (ret >= 0) {
+		cost = zstd_fse_cost(count, norm, max, log) + 8 * ret;
+		if (cost < def_cost) {
+			zstd_fse_build_ctable(ct, norm, max, log);
+			*mode = ZSTD_SEQ_FSE;
+			return ret;
+		}
+	} else if (def_cost == ~0U) {
+		return ret;
+	}
+
+	for (s = 0; s <= def_max; s++)
+		norm[s] = def[s];
+	zstd_fse_build_ctable(ct, norm, def_max, def_log);
+	*mode = ZSTD_SEQ_PREDEFINED;
+	return 0;
+}
+
+static int zstd_encode_sequences(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	u32 ll_count[ZSTD_LL_MAX + 1] = { 0 };
+	u32 ml_count[ZSTD_ML_MAX + 1] = { 0 };
+	u32 of_count[ZSTD_OF_MAX + 1] = { 0 };
+	unsigned int nb = cctx->nb_seq, ll_max = 0, ml_max = 0, of_max = 0;
+	enum zstd_seq_mode ll_mode, of_mode, ml_mode;
+	struct zstd_fse_cstate ll_st, of_st, ml_st;
+	const struct zstd_seq *seq;
+	struct zstd_bitwr bw;
+	size_t pos, size;
+	u8 *modes;
+	int ret;
+
+	if (cap < 4)
+		return -ENOSPC;
+	if (nb < 128) {
+		dst[0] = nb;
+		pos = 1;
+	} else if (nb < 0x7f00) {
+		dst[0] = (nb >> 8) + 128;
+		dst[1] = nb;
+		pos = 2;
+	} else {
+		dst[0] = 255;
+		put_unaligned_le16(nb - 0x7f00, dst + 1);
+		pos = 3;
+	}
+	if (!nb)
+		return pos;
+
+	for (seq = cctx->seqs; seq < cctx->seqs + nb; seq++) {
+		unsigned int ll = zstd_ll_code(seq->ll);
+		unsigned int ml = zstd_ml_code(seq->ml);
+		unsigned int of = zstd_highbit(seq->off_value);
+
+		ll_count[ll]++;
+		ml_count[ml]++;
+		of_count[of]++;
+		ll_max = max(ll_max, ll);
+		ml_max = max(ml_max, ml);
+		of_max = max(of_max, of);
+	}
+
+	modes = dst + pos++;
+	ret = zstd_seq_choose(&cctx->ll_ct, &ll_mode, dst + pos, cap - pos,
+			      ll_count, ll_max, nb, zstd_ll_default,
+			      ZSTD_LL_MAX, ZSTD_LL_LOG_DEFAULT,
+			      ZSTD_LL_LOG_MAX);
+	if (ret < 0)
+		return ret;
+	pos += ret;
+	ret = zstd_seq_choose(&cctx->of_ct, &of_mode, dst + pos, cap - pos,
+			      of_count, of_max, nb, zstd_of_default,
+			      ZSTD_OF_DEFAULT_MAX, ZSTD_OF_LOG_DEFAULT,
+			      ZSTD_OF_LOG_MAX);
+	if (ret < 0)
+		return ret;
+	pos += ret;
+	ret = zstd_seq_choose(&cctx->ml_ct, &ml_mode, dst + pos, cap - pos,
+			      ml_count, ml_max, nb, zstd_ml_default,
+			      ZSTD_ML_MAX, ZSTD_ML_LOG_DEFAULT,
+			      ZSTD_ML_LOG_MAX);
+	if (ret < 0)
+		return ret;
+	pos += ret;
+	*modes = ll_mode << 6 | of_mode << 4 | ml_mode << 2;
+
+	/* sequences are coded last first, each field's state after its bits */
+	zstd_bitwr_init(&bw, dst + pos, cap - pos);
+	seq = cctx->seqs + nb - 1;
+	zstd_fse_init_state(&ml_st, &cctx->ml_ct, zstd_ml_code(seq->ml));
+	zstd_fse_init_state(&of_st, &cctx->of_ct, zstd_highbit(seq->off_value));
+	zstd_fse_init_state(&ll_st, &cctx->ll_ct, zstd_ll_code(seq->ll));
+	zstd_seq_add_bits(&bw, seq);
+	while (seq-- > cctx->seqs) {
+		zstd_fse_encode(&bw, &of_st, zstd_highbit(seq->off_value));
+		zstd_fse_encode(&bw, &ml_st, zstd_ml_code(seq->ml));
+		zstd_fse_encode(&bw, &ll_st, zstd_ll_code(seq->ll));
+		zstd_bitwr_flush(&bw);
+		zstd_seq_add_bits(&bw, seq);
+	}
+	zstd_fse_flush_state(&bw, &ml_st);
+	zstd_fse_flush_state(&bw, &of_st);
+	zstd_fse_flush_state(&bw, &ll_st);
+	size = zstd_bitwr_close(&bw);
+	if (!size)
+		return -ENOSPC;
+	return pos + size;
+}
+
+static inline u32 zstd_hash(const struct zstd_cctx *cctx, const u8 *p)
+{
+	return (get_unaligned_le32(p) * 2654435761U) >>
+	       (32 - cctx->hash_log);
+}
+
+static inline size_t zstd_count(const u8 *ip, const u8 *match,
+				const u8 *iend)
+{
+	const u8 *start = ip;
+
+	while (iend - ip >= sizeof(u64)) {
+		u64 diff = get_unaligned_le64(ip) ^ get_unaligned_le64(match);
+
+		if (diff)
+			return ip - start + (__ffs64(diff) >> 3);
+		ip += sizeof(u64);
+		match += sizeof(u64);
+	}
+	while (ip < iend && *ip == *match) {
+		ip++;
+		match++;
+	}
+	return ip - start;
+}
+
+/* Longest match for 'pos' in the window, inserting everything up to it */
+static size_t zstd_find_match(struct zstd_cctx *cctx, const u8 *base,
+			      u32 pos, const u8 *iend, u32 *offset)
+{
+	unsigned int depth = ZSTD_C_SEARCH_DEPTH;
+	const u8 *ip = base + pos;
+	size_t best = 0, len;
+	u32 cand, delta;
+
+	for (; cctx->next_insert <= pos; cctx->next_insert++) {
+		u32 p = cctx->next_insert, h = zstd_hash(cctx, base + p);
+
+		delta = cctx->hash[h] ? p - (cctx->hash[h] - 1) : 0;
+		cctx->chain[p & ZSTD_C_MAX_OFFSET] =
+			delta > ZSTD_C_MAX_OFFSET ? 0 : delta;
+		cctx->hash[h] = p + 1;
+	}
+
+	for (delta = cctx->chain[pos & ZSTD_C_MAX_OFFSET], cand = pos - delta;
+	     delta && pos - cand <= ZSTD_C_MAX_OFFSET && depth--;
+	     delta = cctx->chain[cand & ZSTD_C_MAX_OFFSET], cand -= delta) {
+		const u8 *match = base + cand;
+
+		if (match[best] != ip[best] ||
+		    get_unaligned_le32(match) != get_unaligned_le32(ip))
+			continue;
+		len = zstd_count(ip, match, iend);
+		if (len > best) {
+			best = len;
+			*offset = pos - cand;
+			if (ip + len == iend)
+				break;
+		}
+	}
+	return best;
+}
+
+static void zstd_parse_block(struct zstd_cctx *cctx, const u8 *base,
+			     u32 start, u32 end)
+{
+	const u8 *iend = base + end;
+	u32 ip = start, anchor = start, limit = end > 8 ? end - 8 : 0;
+	struct zstd_seq *seq = cctx->seqs;
+	u8 *lits = cctx->lits;
+
+	while (ip < limit) {
+		u32 rep = cctx->rep[0], off = 0;
+		size_t len = 0;
+
+		/* a repeat of the last offset costs nearly nothing */
+		if (ip > anchor && ip >= rep &&
+		    get_unaligned_le32(base + ip) ==
+		    get_unaligned_le32(base + ip - rep)) {
+			len = zstd_count(base + ip, base + ip - rep, iend);
+			seq->off_value = 1;
+		} else {
+			len = zstd_find_match(cctx, base, ip, iend, &off);
+			if (len < ZSTD_C_MIN_MATCH) {
+				/* skip faster through incompressible data */
+				ip += 1 + ((ip - anchor) >> 8);
+				continue;
+			}
+			while (ip > anchor && ip > off &&
+			       base[ip - 1] == base[ip - off - 1]) {
+				ip--;
+				len++;
+			}
+			seq->off_value = off + 3;
+			cctx->rep[2] = cctx->rep[1];
+			cctx->rep[1] = cctx->rep[0];
+			cctx->rep[0] = off;
+		}
+
+		seq->ll = ip - anchor;
+		seq->ml = len;
+		memcpy(lits, base + anchor, ip - anchor);
+		lits += ip - anchor;
+		seq++;
+		ip += len;
+		anchor = ip;
+	}
+
+	memcpy(lits, base + anchor, end - anchor);
+	lits += end - anchor;
+	cctx->nb_lits = lits - cctx->lits;
+	cctx->nb_seq = seq - cctx->seqs;
+}
+
+/* Compressed block body, 0 if it would not be smaller than 'cap' */
+static size_t zstd_compress_block(struct zstd_cctx *cctx, const u8 *base,
+				  u32 start, u32 end, u8 *dst, size_t cap)
+{
+	u32 rep[3];
+	int ret;
+	size_t pos;
+
+	memcpy(rep, cctx->rep, sizeof(rep));
+	zstd_parse_block(cctx, base, start, end);
+
+	ret = zstd_encode_literals(cctx, dst, cap);
+	if (ret < 0)
+		goto raw;
+	pos = ret;
+	ret = zstd_encode_sequences(cctx, dst + pos, cap - pos);
+	if (ret < 0 || pos + ret >= cap)
+		goto raw;
+	return pos + ret;
+
+raw:
+	/* the decoder will not see these offsets */
+	memcpy(cctx->rep, rep, sizeof(rep));
+	return 0;
+}
+
+int zstd_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	static const u32 rep_init[3] = ZSTD_REP_INIT;
+	struct zstd_cctx *cctx = wrkmem;
+	size_t cap = *dst_len, pos, done = 0;
+	unsigned int fcs;
+
+	BUILD_BUG_ON(sizeof(struct zstd_cctx) > ZSTD_MEM_COMPRESS);
+
+	/* blocks address the input by u32 positions */
+	if (src_len > U32_MAX)
+		return -EFBIG;
+	if (cap < 4 + 1 + 4 + 3)
+		return -ENOSPC;
+
+	/* single segment: the content size doubles as the window size */
+	if (src_len < 256)
+		fcs = 0;
+	else if (src_len < 65536 + 256)
+		fcs = 1;
+	else
+		fcs = 2;
+	put_unaligned_le32(ZSTD_MAGIC, dst);
+	dst[4] = fcs << 6 | 1 << 5;
+	pos = 5;
+	switch (fcs) {
+	case 0:
+		dst[pos++] = src_len;
+		break;
+	case 1:
+		put_unaligned_le16(src_len - 256, dst + pos);
+		pos += 2;
+		break;
+	default:
+		put_unaligned_le32(src_len, dst + pos);
+		pos += 4;
+		break;
+	}
+
+	cctx->hash_log = clamp_t(unsigned int, zstd_highbit(src_len | 1),
+				 ZSTD_C_HASH_LOG_MIN, ZSTD_C_HASH_LOG);
+	memset(cctx->hash, 0, sizeof(u32) << cctx->hash_log);
+	memcpy(cctx->rep, rep_init, sizeof(cctx->rep));
+	cctx->next_insert = 0;
+
+	do {
+		size_t len = min_t(size_t, src_len - done, ZSTD_C_BLOCK);
+		bool last = done + len == src_len;
+		size_t size = 0;
+		u32 header;
+
+		if (cap - pos < 3)
+			return -ENOSPC;
+		if (len >= ZSTD_C_HUF_MIN)
+			size = zstd_compress_block(cctx, src, done, done + len,
+					dst + pos + 3,
+					min(cap - pos - 3, len));
+		if (size) {
+			header = last | ZSTD_BLOCK_COMPRESSED << 1 | size << 3;
+		} else {
+			if (cap - pos - 3 < len)
+				return -ENOSPC;
+			memcpy(dst + pos + 3, src + done, len);
+			size = len;
+			header = last | ZSTD_BLOCK_RAW << 1 | size << 3;
+		}
+		dst[pos] = header;
+		dst[pos + 1] = header >> 8;
+		dst[pos + 2] = header >> 16;
+		pos += 3 + size;
+		done += len;
+	} while (done < src_len);
+
+	*dst_len = pos;
+	return 0;
+}
+
+EXPORT_SYMBOL(zstd_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Compressor");
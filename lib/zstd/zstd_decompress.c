@@ -0,0 +1,1006 @@
+/*
+ * Zstandard decompressor
+ *
+ * Decodes the frame format of RFC 8478 in full, except for dictionaries.
+ * The content checksum of a frame is skipped rather than verified.
+ *
+ * Output goes to a flat buffer that also serves as the history, so the
+ * only working memory needed are the entropy tables.  Huffman coded
+ * literals are decoded into the end of the space the block decompresses
+ * to and consumed from there, staying ahead of the output.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#endif
+#include <linux/errno.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+
+#include "zstd_internal.h"
+
+struct zstd_fse_entry {
+	u16 new_state;
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_huf_entry {
+	u8 symbol;
+	u8 nb_bits;
+};
+
+struct zstd_seq_table {
+	struct zstd_fse_entry *entries;
+	unsigned int log;
+	bool valid;
+};
+
+struct zstd_dctx {
+	struct zstd_fse_entry ll_entries[1 << ZSTD_LL_LOG_MAX];
+	struct zstd_fse_entry of_entries[1 << ZSTD_OF_LOG_MAX];
+	struct zstd_fse_entry ml_entries[1 << ZSTD_ML_LOG_MAX];
+	struct zstd_huf_entry huf_table[1 << ZSTD_HUF_LOG_MAX];
+	struct zstd_seq_table ll, of, ml;
+	unsigned int huf_log;
+	bool huf_valid;
+	u32 rep[3];
+	/* ZSTD_BLOCK_MAX bytes for literals when the output cannot hold them */
+	u8 *litbuf;
+};
+
+/*
+ * Entropy coded streams are written forwards and read backwards, starting
+ * below the highest set bit of their last byte.
+ */
+struct zstd_bitrd {
+	u64 bits;
+	unsigned int consumed;	/* from the top of bits */
+	const u8 *ptr;
+	const u8 *start;
+};
+
+static int zstd_bitrd_init(struct zstd_bitrd *br, const u8 *src, size_t len)
+{
+	size_t i;
+
+	if (!len || !src[len - 1])
+		return -EINVAL;
+
+	br->start = src;
+	if (len >= sizeof(u64)) {
+		br->ptr = src + len - sizeof(u64);
+		br->bits = get_unaligned_le64(br->ptr);
+		br->consumed = 0;
+	} else {
+		br->ptr = src;
+		br->bits = 0;
+		for (i = 0; i < len; i++)
+			br->bits |= (u64)src[i] << (8 * i);
+		br->consumed = (sizeof(u64) - len) * 8;
+	}
+	br->consumed += 8 - zstd_highbit(src[len - 1]);
+	return 0;
+}
+
+static inline u32 zstd_bitrd_read(struct zstd_bitrd *br, unsigned int nb)
+{
+	u64 v = ((br->bits << (br->consumed & 63)) >> 1) >> (63 - nb);
+
+	br->consumed += nb;
+	return v;
+}
+
+/*
+ * Refills the container, which then holds at least 56 unread bits unless
+ * the start of the stream was reached.  Returns false once more bits were
+ * read than the stream holds.
+ */
+static inline bool zstd_bitrd_reload(struct zstd_bitrd *br)
+{
+	size_t nb = br->consumed >> 3;
+
+	if (br->consumed > 64)
+		return false;
+	if (nb > br->ptr - br->start)
+		nb = br->ptr - br->start;
+	if (nb) {
+		br->ptr -= nb;
+		br->consumed -= nb * 8;
+		br->bits = get_unaligned_le64(br->ptr);
+	}
+	return true;
+}
+
+static inline bool zstd_bitrd_finished(const struct zstd_bitrd *br)
+{
+	return br->ptr == br->start && br->consumed == 64;
+}
+
+/* The table descriptions are read forwards, low bits first */
+static u32 zstd_peek_bits(const u8 *src, size_t len, size_t pos,
+			  unsigned int nb)
+{
+	size_t byte = pos >> 3;
+	u32 v = 0;
+	unsigned int i;
+
+	for (i = 0; i < 4 && byte + i < len; i++)
+		v |= (u32)src[byte + i] << (8 * i);
+	return (v >> (pos & 7)) & ((1U << nb) - 1);
+}
+
+/*
+ * Reads the normalized counts of an FSE table, at most *max_sym + 1 of
+ * them.  Returns the number of bytes used.
+ */
+static int zstd_read_ncount(s16 *norm, unsigned int *max_sym,
+			    unsigned int *log, unsigned int log_max,
+			    const u8 *src, size_t len)
+{
+	unsigned int sym = 0, nb_bits, threshold;
+	bool prev0 = false;
+	size_t pos = 4;
+	int remaining;
+
+	if (!len)
+		return -EINVAL;
+	*log = (src[0] & 0xf) + ZSTD_FSE_LOG_MIN;
+	if (*log > log_max)
+		return -EINVAL;
+
+	remaining = (1 << *log) + 1;
+	threshold = 1 << *log;
+	nb_bits = *log + 1;
+
+	while (remaining > 1 && sym <= *max_sym) {
+		int max, count;
+		u32 v;
+
+		if (prev0) {
+			unsigned int n0 = sym, repeat;
+
+			do {
+				repeat = zstd_peek_bits(src, len, pos, 2);
+				pos += 2;
+				n0 += repeat;
+			} while (repeat == 3);
+			if (n0 > *max_sym)
+				return -EINVAL;
+			while (sym < n0)
+				norm[sym++] = 0;
+		}
+
+		max = (2 * threshold - 1) - remaining;
+		v = zstd_peek_bits(src, len, pos, nb_bits);
+		if ((int)(v & (threshold - 1)) < max) {
+			count = v & (threshold - 1);
+			pos += nb_bits - 1;
+		} else {
+			count = v & (2 * threshold - 1);
+			if (count >= (int)threshold)
+				count -= max;
+			pos += nb_bits;
+		}
+		count--;
+		remaining -= count < 0 ? -count : count;
+		if (remaining < 1)
+			return -EINVAL;
+		norm[sym++] = count;
+		prev0 = !count;
+		while (remaining < threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1 || pos > len * 8)
+		return -EINVAL;
+	*max_sym = sym - 1;
+	return (pos + 7) >> 3;
+}
+
+static int zstd_fse_build(struct zstd_fse_entry *table, const s16 *norm,
+			  unsigned int max_sym, unsigned int log)
+{
+	u16 next[ZSTD_ML_MAX + 1];
+	unsigned int size = 1 << log, high = size - 1, mask = size - 1;
+	unsigned int step = zstd_fse_step(size), pos = 0, s, i;
+	int n;
+
+	for (s = 0; s <= max_sym; s++) {
+		if (norm[s] == -1) {
+			table[high--].symbol = s;
+			next[s] = 1;
+		} else {
+			next[s] = norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_sym; s++) {
+		for (n = 0; n < norm[s]; n++) {
+			table[pos].symbol = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+	if (pos)
+		return -EINVAL;
+
+	for (i = 0; i < size; i++) {
+		u32 state = next[table[i].symbol]++;
+
+		table[i].nb_bits = log - zstd_highbit(state);
+		table[i].new_state = (state << table[i].nb_bits) - size;
+	}
+	return 0;
+}
+
+/* Returns the number of bytes the table description used */
+static int zstd_seq_table_load(struct zstd_seq_table *t, unsigned int mode,
+			       const s16 *def, unsigned int def_max,
+			       unsigned int def_log, unsigned int max_sym,
+			       unsigned int log_max, const u8 *src, size_t len)
+{
+	s16 norm[ZSTD_ML_MAX + 1];
+	int ret;
+
+	switch (mode) {
+	case ZSTD_SEQ_PREDEFINED:
+		t->log = def_log;
+		ret = zstd_fse_build(t->entries, def, def_max, def_log);
+		break;
+	case ZSTD_SEQ_RLE:
+		if (!len || src[0] > max_sym)
+			return -EINVAL;
+		t->entries[0].symbol = src[0];
+		t->entries[0].nb_bits = 0;
+		t->entries[0].new_state = 0;
+		t->log = 0;
+		ret = 1;
+		break;
+	case ZSTD_SEQ_FSE:
+		ret = zstd_read_ncount(norm, &max_sym, &t->log, log_max,
+				       src, len);
+		if (ret < 0)
+			return ret;
+		if (zstd_fse_build(t->entries, norm, max_sym, t->log))
+			return -EINVAL;
+		break;
+	default:
+		return t->valid ? 0 : -EINVAL;
+	}
+
+	if (ret >= 0)
+		t->valid = true;
+	return ret;
+}
+
+/*
+ * Huffman weights compressed with FSE are decoded by two interleaved
+ * states until the stream runs dry.
+ */
+static int zstd_huf_read_fse_weights(u8 *weights, const u8 *src, size_t len)
+{
+	struct zstd_fse_entry table[1 << ZSTD_HUF_WEIGHT_LOG_MAX];
+	s16 norm[ZSTD_HUF_LOG_MAX + 1];
+	unsigned int max_sym = ZSTD_HUF_LOG_MAX, log, s1, s2, n = 0;
+	struct zstd_bitrd br;
+	int ret;
+
+	ret = zstd_read_ncount(norm, &max_sym, &log, ZSTD_HUF_WEIGHT_LOG_MAX,
+			       src, len);
+	if (ret < 0)
+		return ret;
+	if (zstd_fse_build(table, norm, max_sym, log))
+		return -EINVAL;
+	if (zstd_bitrd_init(&br, src + ret, len - ret))
+		return -EINVAL;
+
+	s1 = zstd_bitrd_read(&br, log);
+	s2 = zstd_bitrd_read(&br, log);
+	zstd_bitrd_reload(&br);
+
+	for (;;) {
+		if (n + 2 > 255)
+			return -EINVAL;
+
+		weights[n++] = table[s1].symbol;
+		s1 = table[s1].new_state +
+			zstd_bitrd_read(&br, table[s1].nb_bits);
+		if (!zstd_bitrd_reload(&br)) {
+			weights[n++] = table[s2].symbol;
+			break;
+		}
+
+		weights[n++] = table[s2].symbol;
+		s2 = table[s2].new_state +
+			zstd_bitrd_read(&br, table[s2].nb_bits);
+		if (!zstd_bitrd_reload(&br)) {
+			weights[n++] = table[s1].symbol;
+			break;
+		}
+	}
+	return n;
+}
+
+/* Returns the number of bytes the tree description used */
+static int zstd_huf_read_table(struct zstd_dctx *dctx, const u8 *src,
+			       size_t len)
+{
+	u8 weights[256];
+	u32 rank[ZSTD_HUF_LOG_MAX + 1] = { 0 };
+	u32 total = 0, rest, next = 0;
+	unsigned int nb, log, used, s, w, i;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+
+	if (src[0] >= 128) {
+		nb = src[0] - 127;
+		used = 1 + (nb + 1) / 2;
+		if (used > len)
+			return -EINVAL;
+		for (i = 0; i < nb; i++)
+			weights[i] = i & 1 ? src[1 + i / 2] & 0xf :
+					     src[1 + i / 2] >> 4;
+	} else {
+		used = 1 + src[0];
+		if (used > len)
+			return -EINVAL;
+		ret = zstd_huf_read_fse_weights(weights, src + 1, src[0]);
+		if (ret < 0)
+			return ret;
+		nb = ret;
+	}
+
+	for (i = 0; i < nb; i++) {
+		if (weights[i] > ZSTD_HUF_LOG_MAX)
+			return -EINVAL;
+		rank[weights[i]]++;
+		total += (1 << weights[i]) >> 1;
+	}
+	if (!total)
+		return -EINVAL;
+
+	/* the weight of the last symbol completes a power of two */
+	log = zstd_highbit(total) + 1;
+	if (log > ZSTD_HUF_LOG_MAX)
+		return -EINVAL;
+	rest = (1 << log) - total;
+	if (rest & (rest - 1))
+		return -EINVAL;
+	weights[nb] = zstd_highbit(rest) + 1;
+	rank[weights[nb]]++;
+	nb++;
+	if (rank[1] < 2 || rank[1] & 1)
+		return -EINVAL;
+
+	/* codes of the same length are handed out in symbol order */
+	for (w = 1; w <= log; w++) {
+		u32 cur = next;
+
+		next += rank[w] << (w - 1);
+		rank[w] = cur;
+	}
+	for (s = 0; s < nb; s++) {
+		u32 n;
+
+		w = weights[s];
+		if (!w)
+			continue;
+		for (n = 0; n < (1U << (w - 1)); n++) {
+			dctx->huf_table[rank[w] + n].symbol = s;
+			dctx->huf_table[rank[w] + n].nb_bits = log + 1 - w;
+		}
+		rank[w] += 1 << (w - 1);
+	}
+
+	dctx->huf_log = log;
+	dctx->huf_valid = true;
+	return used;
+}
+
+static int zstd_huf_decode_stream(const struct zstd_dctx *dctx, u8 *dst,
+				  size_t n, const u8 *src, size_t len)
+{
+	const struct zstd_huf_entry *table = dctx->huf_table;
+	unsigned int log = dctx->huf_log;
+	struct zstd_bitrd br;
+	u8 *end = dst + n;
+
+	if (zstd_bitrd_init(&br, src, len))
+		return -EINVAL;
+
+#define ZSTD_HUF_DECODE_SYMBOL()					\
+	do {								\
+		const struct zstd_huf_entry *e = &table[		\
+			((br.bits << (br.consumed & 63)) >> 1) >> (63 - log)]; \
+		br.consumed += e->nb_bits;				\
+		*dst++ = e->symbol;					\
+	} while (0)
+
+	/* four symbols fit in what a reload guarantees */
+	while (end - dst >= 4) {
+		if (!zstd_bitrd_reload(&br))
+			return -EINVAL;
+		ZSTD_HUF_DECODE_SYMBOL();
+		ZSTD_HUF_DECODE_SYMBOL();
+		ZSTD_HUF_DECODE_SYMBOL();
+		ZSTD_HUF_DECODE_SYMBOL();
+	}
+	while (dst < end) {
+		if (!zstd_bitrd_reload(&br))
+			return -EINVAL;
+		ZSTD_HUF_DECODE_SYMBOL();
+	}
+
+#undef ZSTD_HUF_DECODE_SYMBOL
+
+	zstd_bitrd_reload(&br);
+	return zstd_bitrd_finished(&br) ? 0 : -EINVAL;
+}
+
+/*
+ * Decodes the literals section of a block.  Raw literals are used in
+ * place, the others are written to dctx->litbuf if there is one or end at
+ * 'tail' otherwise.  Returns the number of bytes the section used.
+ */
+static int zstd_decode_literals(struct zstd_dctx *dctx, const u8 *src,
+				size_t len, u8 *tail, size_t space,
+				const u8 **lit, size_t *lit_len)
+{
+	unsigned int type, format, hsize, bits, streams, i;
+	size_t regen, csize;
+	u8 *buf;
+	u64 v;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	type = src[0] & 3;
+	format = (src[0] >> 2) & 3;
+
+	if (type == ZSTD_LIT_RAW || type == ZSTD_LIT_RLE) {
+		switch (format) {
+		case 1:
+			hsize = 2;
+			break;
+		case 3:
+			hsize = 3;
+			break;
+		default:
+			hsize = 1;
+			break;
+		}
+		if (hsize > len)
+			return -EINVAL;
+		if (hsize == 1)
+			regen = src[0] >> 3;
+		else if (hsize == 2)
+			regen = (src[0] >> 4) + (src[1] << 4);
+		else
+			regen = (src[0] >> 4) + (src[1] << 4) + (src[2] << 12);
+		if (regen > ZSTD_BLOCK_MAX)
+			return -EINVAL;
+		*lit_len = regen;
+
+		if (type == ZSTD_LIT_RAW) {
+			if (regen > len - hsize)
+				return -EINVAL;
+			*lit = src + hsize;
+			return hsize + regen;
+		}
+
+		if (hsize == len)
+			return -EINVAL;
+		if (dctx->litbuf) {
+			buf = dctx->litbuf;
+		} else {
+			if (regen > space)
+				return -ENOSPC;
+			buf = tail - regen;
+		}
+		memset(buf, src[hsize], regen);
+		*lit = buf;
+		return hsize + 1;
+	}
+
+	switch (format) {
+	case 0:
+		streams = 1;
+		hsize = 3;
+		bits = 10;
+		break;
+	case 1:
+		streams = 4;
+		hsize = 3;
+		bits = 10;
+		break;
+	case 2:
+		streams = 4;
+		hsize = 4;
+		bits = 14;
+		break;
+	default:
+		streams = 4;
+		hsize = 5;
+		bits = 18;
+		break;
+	}
+	if (hsize > len)
+		return -EINVAL;
+	for (v = 0, i = 0; i < hsize; i++)
+		v |= (u64)src[i] << (8 * i);
+	regen = (v >> 4) & ((1 << bits) - 1);
+	csize = (v >> (4 + bits)) & ((1 << bits) - 1);
+	if (regen > ZSTD_BLOCK_MAX || csize > len - hsize)
+		return -EINVAL;
+	*lit_len = regen;
+
+	if (dctx->litbuf) {
+		buf = dctx->litbuf;
+	} else {
+		if (regen > space)
+			return -ENOSPC;
+		buf = tail - regen;
+	}
+	*lit = buf;
+
+	src += hsize;
+	len = csize;
+	if (type == ZSTD_LIT_COMPRESSED) {
+		ret = zstd_huf_read_table(dctx, src, len);
+		if (ret < 0)
+			return ret;
+		src += ret;
+		len -= ret;
+	} else if (!dctx->huf_valid) {
+		return -EINVAL;
+	}
+
+	if (streams == 1) {
+		ret = zstd_huf_decode_stream(dctx, buf, regen, src, len);
+	} else {
+		size_t size[4], segment = (regen + 3) / 4;
+
+		if (len < 6 || segment * 3 > regen)
+			return -EINVAL;
+		size[0] = get_unaligned_le16(src);
+		size[1] = get_unaligned_le16(src + 2);
+		size[2] = get_unaligned_le16(src + 4);
+		src += 6;
+		len -= 6;
+		if (size[0] + size[1] + size[2] > len)
+			return -EINVAL;
+		size[3] = len - size[0] - size[1] - size[2];
+
+		for (i = 0; i < 4; i++) {
+			size_t n = i < 3 ? segment : regen - 3 * segment;
+
+			ret = zstd_huf_decode_stream(dctx, buf, n, src,
+						     size[i]);
+			if (ret)
+				break;
+			buf += n;
+			src += size[i];
+		}
+	}
+	return ret ? ret : hsize + csize;
+}
+
+/*
+ * Copies low to high, so that a match may overlap its own output and
+ * literals may move down onto the space they were decoded to.
+ */
+static inline void zstd_copy(u8 *op, const u8 *ip, size_t n)
+{
+	if ((op > ip ? op - ip : ip - op) >= n) {
+		memcpy(op, ip, n);
+		return;
+	}
+	while (n--)
+		*op++ = *ip++;
+}
+
+static int zstd_decode_sequences(struct zstd_dctx *dctx, const u8 *src,
+				 size_t len, u8 *dst, size_t pos,
+				 size_t space, const u8 *lit, size_t lit_len,
+				 size_t *out_len)
+{
+	const u8 *lend = lit + lit_len;
+	u8 *op = dst + pos, *oend = op + space;
+	/* literals decoded into the output must not be overwritten */
+	bool lit_in_dst = lit >= op && lit < oend;
+	unsigned int nb_seq, mode, ll_state, of_state, ml_state, i;
+	struct zstd_bitrd br;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	nb_seq = src[0];
+	if (nb_seq < 128) {
+		src++;
+		len--;
+	} else if (nb_seq < 255) {
+		if (len < 2)
+			return -EINVAL;
+		nb_seq = ((nb_seq - 128) << 8) + src[1];
+		src += 2;
+		len -= 2;
+	} else {
+		if (len < 3)
+			return -EINVAL;
+		nb_seq = src[1] + (src[2] << 8) + 0x7f00;
+		src += 3;
+		len -= 3;
+	}
+
+	if (!nb_seq) {
+		if (len)
+			return -EINVAL;
+		goto last_literals;
+	}
+
+	if (!len)
+		return -EINVAL;
+	mode = src[0];
+	if (mode & 3)
+		return -EINVAL;
+	src++;
+	len--;
+
+	ret = zstd_seq_table_load(&dctx->ll, mode >> 6, zstd_ll_default,
+				  ZSTD_LL_MAX, ZSTD_LL_LOG_DEFAULT, ZSTD_LL_MAX,
+				  ZSTD_LL_LOG_MAX, src, len);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	len -= ret;
+	ret = zstd_seq_table_load(&dctx->of, (mode >> 4) & 3, zstd_of_default,
+				  ZSTD_OF_DEFAULT_MAX, ZSTD_OF_LOG_DEFAULT,
+				  ZSTD_OF_MAX, ZSTD_OF_LOG_MAX, src, len);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	len -= ret;
+	ret = zstd_seq_table_load(&dctx->ml, (mode >> 2) & 3, zstd_ml_default,
+				  ZSTD_ML_MAX, ZSTD_ML_LOG_DEFAULT, ZSTD_ML_MAX,
+				  ZSTD_ML_LOG_MAX, src, len);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	len -= ret;
+
+	if (zstd_bitrd_init(&br, src, len))
+		return -EINVAL;
+	ll_state = zstd_bitrd_read(&br, dctx->ll.log);
+	of_state = zstd_bitrd_read(&br, dctx->of.log);
+	ml_state = zstd_bitrd_read(&br, dctx->ml.log);
+
+	for (i = 0; i < nb_seq; i++) {
+		const struct zstd_fse_entry *lle = &dctx->ll.entries[ll_state];
+		const struct zstd_fse_entry *ofe = &dctx->of.entries[of_state];
+		const struct zstd_fse_entry *mle = &dctx->ml.entries[ml_state];
+		size_t ll, ml, offset;
+		const u8 *match;
+
+		if (!zstd_bitrd_reload(&br))
+			return -EINVAL;
+		offset = (1UL << ofe->symbol) +
+			zstd_bitrd_read(&br, ofe->symbol);
+		zstd_bitrd_reload(&br);
+		ml = zstd_ml_base[mle->symbol] +
+			zstd_bitrd_read(&br, zstd_ml_bits[mle->symbol]);
+		ll = zstd_ll_base[lle->symbol] +
+			zstd_bitrd_read(&br, zstd_ll_bits[lle->symbol]);
+		zstd_bitrd_reload(&br);
+
+		if (i + 1 < nb_seq) {
+			ll_state = lle->new_state +
+				zstd_bitrd_read(&br, lle->nb_bits);
+			ml_state = mle->new_state +
+				zstd_bitrd_read(&br, mle->nb_bits);
+			of_state = ofe->new_state +
+				zstd_bitrd_read(&br, ofe->nb_bits);
+		}
+
+		if (offset > 3) {
+			offset -= 3;
+			dctx->rep[2] = dctx->rep[1];
+			dctx->rep[1] = dctx->rep[0];
+			dctx->rep[0] = offset;
+		} else {
+			/* a repeated offset, shifted by one without literals */
+			unsigned int idx = offset - 1 + !ll;
+
+			if (idx) {
+				offset = idx == 3 ? dctx->rep[0] - 1 :
+						    dctx->rep[idx];
+				if (!offset)
+					return -EINVAL;
+				if (idx != 1)
+					dctx->rep[2] = dctx->rep[1];
+				dctx->rep[1] = dctx->rep[0];
+				dctx->rep[0] = offset;
+			} else {
+				offset = dctx->rep[0];
+			}
+		}
+
+		if (ll > lend - lit || ll > oend - op)
+			return -EINVAL;
+		zstd_copy(op, lit, ll);
+		op += ll;
+		lit += ll;
+
+		if (ml > (lit_in_dst ? (u8 *)lit : oend) - op)
+			return -ENOSPC;
+		if (offset > op - dst)
+			return -EINVAL;
+		match = op - offset;
+		zstd_copy(op, match, ml);
+		op += ml;
+	}
+	if (!zstd_bitrd_finished(&br))
+		return -EINVAL;
+
+last_literals:
+	if (lend - lit > oend - op)
+		return -ENOSPC;
+	zstd_copy(op, lit, lend - lit);
+	op += lend - lit;
+
+	*out_len = op - (dst + pos);
+	return 0;
+}
+
+static int zstd_decode_compressed_block(struct zstd_dctx *dctx,
+					const u8 *src, size_t len, u8 *dst,
+					size_t pos, size_t space,
+					size_t *out_len)
+{
+	size_t room = min_t(size_t, space, ZSTD_BLOCK_MAX), lit_len;
+	const u8 *lit;
+	int ret;
+
+	ret = zstd_decode_literals(dctx, src, len, dst + pos + room, room,
+				   &lit, &lit_len);
+	if (ret < 0)
+		return ret;
+	return zstd_decode_sequences(dctx, src + ret, len - ret, dst, pos,
+				     space, lit, lit_len, out_len);
+}
+
+int zstd_frame_header(const unsigned char *src, size_t src_len,
+		      struct zstd_frame_header *fh)
+{
+	static const u8 dict_id_size[4] = { 0, 1, 2, 4 };
+	static const u8 fcs_size[4] = { 0, 2, 4, 8 };
+	unsigned int size, fcs, dict;
+	const u8 *p;
+	bool single;
+	u32 magic;
+	u8 fhd;
+
+	if (src_len < 4)
+		return -EAGAIN;
+	magic = get_unaligned_le32(src);
+
+	if ((magic & ~0xfU) == ZSTD_MAGIC_SKIPPABLE) {
+		u32 skip;
+
+		if (src_len < 8)
+			return -EAGAIN;
+		skip = get_unaligned_le32(src + 4);
+		if (skip > UINT_MAX - 8)
+			return -EINVAL;
+		fh->content_size = 0;
+		fh->window_size = 0;
+		fh->header_size = 8 + skip;
+		fh->checksum = false;
+		fh->skippable = true;
+		return 0;
+	}
+
+	if (magic != ZSTD_MAGIC)
+		return -EINVAL;
+	if (src_len < 5)
+		return -EAGAIN;
+	fhd = src[4];
+	if (fhd & 0x08)
+		return -EINVAL;
+
+	single = fhd & 0x20;
+	dict = dict_id_size[fhd & 3];
+	fcs = fcs_size[fhd >> 6];
+	if (!fcs && single)
+		fcs = 1;
+	size = 5 + !single + dict + fcs;
+	if (src_len < size)
+		return -EAGAIN;
+	p = src + 5;
+
+	if (!single) {
+		unsigned int log = ZSTD_WINDOWLOG_MIN + (*p >> 3);
+		unsigned long long base = 1ULL << log;
+
+		fh->window_size = base + (base >> 3) * (*p & 7);
+		p++;
+	}
+
+	if (dict) {
+		u32 id = dict == 1 ? *p : dict == 2 ? get_unaligned_le16(p) :
+			 get_unaligned_le32(p);
+
+		if (id)
+			return -EOPNOTSUPP;
+		p += dict;
+	}
+
+	switch (fcs) {
+	case 0:
+		fh->content_size = ZSTD_CONTENT_SIZE_UNKNOWN;
+		break;
+	case 1:
+		fh->content_size = *p;
+		break;
+	case 2:
+		fh->content_size = get_unaligned_le16(p) + 256;
+		break;
+	case 4:
+		fh->content_size = get_unaligned_le32(p);
+		break;
+	default:
+		fh->content_size = get_unaligned_le64(p);
+		break;
+	}
+	if (single)
+		fh->window_size = fh->content_size;
+
+	fh->header_size = size;
+	fh->checksum = fhd & 0x04;
+	fh->skippable = false;
+	return 0;
+}
+
+void zstd_decompress_begin(void *wrkmem)
+{
+	static const u32 rep[3] = ZSTD_REP_INIT;
+	struct zstd_dctx *dctx = wrkmem;
+
+	BUILD_BUG_ON(sizeof(struct zstd_dctx) > ZSTD_MEM_DECOMPRESS);
+
+	dctx->ll.entries = dctx->ll_entries;
+	dctx->of.entries = dctx->of_entries;
+	dctx->ml.entries = dctx->ml_entries;
+	dctx->ll.valid = false;
+	dctx->of.valid = false;
+	dctx->ml.valid = false;
+	dctx->huf_valid = false;
+	memcpy(dctx->rep, rep, sizeof(rep));
+	dctx->litbuf = NULL;
+}
+
+int zstd_decompress_block(void *wrkmem, const unsigned char *src,
+			  size_t *src_len, unsigned char *dst, size_t pos,
+			  size_t *dst_len, bool *last)
+{
+	size_t avail = *src_len, space = *dst_len, size;
+	u32 header;
+	int ret;
+
+	if (avail < 3)
+		return -EAGAIN;
+	header = src[0] | (src[1] << 8) | (src[2] << 16);
+	size = header >> 3;
+	if (size > ZSTD_BLOCK_MAX)
+		return -EINVAL;
+
+	switch ((header >> 1) & 3) {
+	case ZSTD_BLOCK_RAW:
+		if (avail - 3 < size)
+			return -EAGAIN;
+		if (size > space)
+			return -ENOSPC;
+		memcpy(dst + pos, src + 3, size);
+		*src_len = 3 + size;
+		*dst_len = size;
+		break;
+	case ZSTD_BLOCK_RLE:
+		if (avail < 4)
+			return -EAGAIN;
+		if (size > space)
+			return -ENOSPC;
+		memset(dst + pos, src[3], size);
+		*src_len = 4;
+		*dst_len = size;
+		break;
+	case ZSTD_BLOCK_COMPRESSED:
+		if (avail - 3 < size)
+			return -EAGAIN;
+		ret = zstd_decode_compressed_block(wrkmem, src + 3, size, dst,
+						   pos, space, dst_len);
+		if (ret)
+			return ret;
+		*src_len = 3 + size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	*last = header & 1;
+	return 0;
+}
+
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		    unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	size_t cap = *dst_len, out = 0;
+	bool frames = false;
+	int ret;
+
+	while (src_len) {
+		struct zstd_frame_header fh;
+		size_t start = out;
+		bool last = false;
+
+		ret = zstd_frame_header(src, src_len, &fh);
+		if (ret)
+			return ret == -EAGAIN ? -EINVAL : ret;
+		if (fh.header_size > src_len)
+			return -EINVAL;
+		src += fh.header_size;
+		src_len -= fh.header_size;
+		if (fh.skippable)
+			continue;
+
+		zstd_decompress_begin(wrkmem);
+		while (!last) {
+			size_t in = src_len, len = cap - out;
+
+			ret = zstd_decompress_block(wrkmem, src, &in,
+						    dst + start, out - start,
+						    &len, &last);
+			if (ret)
+				return ret == -EAGAIN ? -EINVAL : ret;
+			src += in;
+			src_len -= in;
+			out += len;
+		}
+
+		if (fh.checksum) {
+			if (src_len < 4)
+				return -EINVAL;
+			src += 4;
+			src_len -= 4;
+		}
+		if (fh.content_size != ZSTD_CONTENT_SIZE_UNKNOWN &&
+		    fh.content_size != out - start)
+			return -EINVAL;
+		frames = true;
+	}
+
+	if (!frames)
+		return -EINVAL;
+	*dst_len = out;
+	return 0;
+}
+
+#ifndef STATIC
+EXPORT_SYMBOL(zstd_decompress);
+EXPORT_SYMBOL(zstd_frame_header);
+EXPORT_SYMBOL(zstd_decompress_begin);
+EXPORT_SYMBOL(zstd_decompress_block);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Decompressor");
+#endif
@@ -0,0 +1,119 @@
+/*
+ * zstd_internal.h -- definitions shared by the zstd encoder and decoder
+ *
+ * The format is described in RFC 8478, "Zstandard Compression and the
+ * application/zstd Media Type".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef ZSTD_INTERNAL_H
+#define ZSTD_INTERNAL_H
+
+#define ZSTD_MAGIC		0xFD2FB528U
+#define ZSTD_MAGIC_SKIPPABLE	0x184D2A50U	/* low four bits are free */
+
+#define ZSTD_WINDOWLOG_MIN	10
+
+enum zstd_block_type {
+	ZSTD_BLOCK_RAW,
+	ZSTD_BLOCK_RLE,
+	ZSTD_BLOCK_COMPRESSED,
+	ZSTD_BLOCK_RESERVED,
+};
+
+enum zstd_lit_type {
+	ZSTD_LIT_RAW,
+	ZSTD_LIT_RLE,
+	ZSTD_LIT_COMPRESSED,
+	ZSTD_LIT_TREELESS,
+};
+
+enum zstd_seq_mode {
+	ZSTD_SEQ_PREDEFINED,
+	ZSTD_SEQ_RLE,
+	ZSTD_SEQ_FSE,
+	ZSTD_SEQ_REPEAT,
+};
+
+#define ZSTD_HUF_LOG_MAX	11
+#define ZSTD_HUF_WEIGHT_LOG_MAX	6
+
+#define ZSTD_FSE_LOG_MIN	5
+
+#define ZSTD_LL_MAX		35
+#define ZSTD_ML_MAX		52
+#define ZSTD_OF_MAX		31
+
+#define ZSTD_LL_LOG_MAX		9
+#define ZSTD_ML_LOG_MAX		9
+#define ZSTD_OF_LOG_MAX		8
+
+#define ZSTD_LL_LOG_DEFAULT	6
+#define ZSTD_ML_LOG_DEFAULT	6
+#define ZSTD_OF_LOG_DEFAULT	5
+
+#define ZSTD_MIN_MATCH		3
+
+/* Initial values of the three repeated offsets of a frame */
+#define ZSTD_REP_INIT		{ 1, 4, 8 }
+
+static const u32 zstd_ll_base[ZSTD_LL_MAX + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048,
+	4096, 8192, 16384, 32768, 65536
+};
+
+static const u8 zstd_ll_bits[ZSTD_LL_MAX + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+};
+
+static const u32 zstd_ml_base[ZSTD_ML_MAX + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027,
+	2051, 4099, 8195, 16387, 32771, 65539
+};
+
+static const u8 zstd_ml_bits[ZSTD_ML_MAX + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+};
+
+/* Predefined distributions, -1 stands for a probability below 1 */
+static const s16 zstd_ll_default[ZSTD_LL_MAX + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1
+};
+
+static const s16 zstd_ml_default[ZSTD_ML_MAX + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1
+};
+
+#define ZSTD_OF_DEFAULT_MAX	28
+
+static const s16 zstd_of_default[ZSTD_OF_DEFAULT_MAX + 1] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static inline unsigned int zstd_highbit(u32 v)
+{
+	return fls(v) - 1;
+}
+
+/* Distance between consecutive cells the symbols are spread over */
+static inline unsigned int zstd_fse_step(unsigned int table_size)
+{
+	return (table_size >> 1) + (table_size >> 3) + 3;
+}
+
+#endif /* ZSTD_INTERNAL_H */
@@ -0,0 +1,314 @@
+/*
+ * mm/kcompactd.c - background memory compaction
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * One kcompactd thread per node does compaction on behalf of high-order
+ * allocations, so that they find free pages instead of stalling in direct
+ * compaction.  It is woken by kswapd once reclaim for a high-order request
+ * has balanced the node, and it also wakes up periodically to compact
+ * proactively when the node's fragmentation score rises above the level
+ * set by vm.compaction_proactiveness.
+ */
+
+#include <linux/compaction.h>
+#include <linux/cpumask.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/memory.h>
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/sched.h>
+#include <linux/topology.h>
+#include <linux/wait.h>
+
+/*
+ * How aggressively to compact in the background, 0 to 100.  Zero disables
+ * proactive compaction; higher values keep the fragmentation score lower.
+ */
+int sysctl_compaction_proactiveness = 20;
+
+/* the order whose availability the fragmentation score measures */
+#define COMPACTION_HPAGE_ORDER	pageblock_order
+
+/* how often to check the fragmentation score */
+#define HPAGE_FRAG_CHECK_INTERVAL_MSEC	500
+
+/*
+ * The percentage of free memory in @zone that is not part of a free block
+ * of at least @order pages.  This is an unlocked snapshot, which is fine
+ * for a heuristic.
+ */
+static unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	unsigned long free_pages = 0, suitable_pages = 0;
+	unsigned int o;
+
+	for (o = 0; o < MAX_ORDER; o++) {
+		unsigned long pages = zone->free_area[o].nr_free << o;
+
+		free_pages += pages;
+		if (o >= order)
+			suitable_pages += pages;
+	}
+
+	if (!free_pages)
+		return 0;
+
+	return div64_ul((free_pages - suitable_pages) * 100, free_pages);
+}
+
+/*
+ * A zone's score is its external fragmentation weighted by its share of the
+ * node, so that small zones such as ZONE_DMA barely count.
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	unsigned long score;
+
+	score = zone->present_pages *
+		extfrag_for_order(zone, COMPACTION_HPAGE_ORDER);
+	return div64_ul(score, zone->zone_pgdat->node_present_pages + 1);
+}
+
+/* 0 (no fragmentation) to 100 (no free hugepage-sized block at all) */
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		score += fragmentation_score_zone(zone);
+	}
+
+	return score;
+}
+
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	/*
+	 * Cap the low watermark to avoid excessive compaction activity
+	 * when proactiveness is at its maximum.
+	 */
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness)
+		return false;
+
+	return fragmentation_score_node(pgdat) > fragmentation_score_wmark(false);
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+
+	/*
+	 * Reset before compacting so that a wakeup for a higher order that
+	 * races with us is not lost.
+	 */
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = 0;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	compact_pgdat(pgdat, order);
+}
+
+/*
+ * Compact every zone of the node asynchronously, as the compact_memory
+ * sysctl does, until the migrate and free scanners meet.  The score is
+ * rechecked by the caller to decide whether it was worth it.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	compact_pgdat(pgdat, -1);
+}
+
+/*
+ * The background compaction daemon, started as a kernel thread
+ * from the init process.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	long default_timeout = msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC);
+	long timeout = default_timeout;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		unsigned int prev_score, score;
+
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout)) {
+			if (kthread_should_stop())
+				break;
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/* timed out: see whether proactive compaction is due */
+		timeout = default_timeout;
+		if (!should_proactive_compact_node(pgdat))
+			continue;
+
+		prev_score = fragmentation_score_node(pgdat);
+		proactive_compact_node(pgdat);
+		score = fragmentation_score_node(pgdat);
+
+		/*
+		 * Defer proactive compaction if the fragmentation score did
+		 * not go down, i.e. no progress was made.
+		 */
+		if (score >= prev_score)
+			timeout = default_timeout << COMPACT_MAX_DEFER_SHIFT;
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - ask kcompactd to compact a node for an allocation
+ * @pgdat:	the node to compact
+ * @order:	the order of the allocation that needs contiguous pages
+ * @classzone_idx: the highest zone the allocation may use
+ *
+ * Called by kswapd after it has balanced @pgdat for a high-order
+ * allocation, so that the freed pages get merged before another allocation
+ * has to compact them directly.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order || !pgdat->kcompactd)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx < classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.  Caller
+ * must hold mem_hotplug_begin/end().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int kcompactd_memory_callback(struct notifier_block *self,
+				     unsigned long action, void *arg)
+{
+	struct memory_notify *mn = arg;
+	int nid = mn->status_change_nid;
+
+	if (nid < 0)
+		return NOTIFY_OK;
+
+	switch (action) {
+	case MEM_ONLINE:
+		kcompactd_run(nid);
+		break;
+	case MEM_OFFLINE:
+		if (!node_state(nid, N_MEMORY))
+			kcompactd_stop(nid);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_MEMORY)
+		kcompactd_run(nid);
+
+	hotplug_memory_notifier(kcompactd_memory_callback, 0);
+	return 0;
+}
+subsys_initcall(kcompactd_init)
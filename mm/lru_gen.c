@@ -0,0 +1,619 @@
+/*
+ * mm/lru_gen.c - multi-generational LRU
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Instead of the active and inactive lists, evictable pages are sorted into
+ * generations.  Aging creates a new generation and walks the page tables of
+ * all processes, moving pages whose accessed bit is set into it; eviction
+ * isolates pages from the oldest generation.  Walking the page tables is
+ * much cheaper than the rmap walks the two-list scheme relies on, and a
+ * bloom filter of the page tables that were densely populated with young
+ * entries during the previous walk lets us skip the sparse ones.
+ */
+
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/mmzone.h>
+#include <linux/memcontrol.h>
+#include <linux/pagevec.h>
+#include <linux/swap.h>
+#include <linux/sched.h>
+#include <linux/hugetlb.h>
+#include <linux/hash.h>
+#include <linux/bitmap.h>
+#include <linux/jiffies.h>
+#include <linux/jump_label.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/init.h>
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+struct static_key lru_gen_key = STATIC_KEY_INIT_TRUE;
+#else
+struct static_key lru_gen_key = STATIC_KEY_INIT_FALSE;
+#endif
+
+/* serializes switching the multi-generational LRU on and off */
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type;
+
+	lrugen->max_seq = MIN_NR_GENS;
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		lrugen->min_seq[type] = 0;
+		for (gen = 0; gen < MAX_NR_GENS; gen++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+	}
+}
+
+/******************************************************************************
+ *                          the list of mm_structs
+ ******************************************************************************/
+
+static DEFINE_SPINLOCK(mm_list_lock);
+static LIST_HEAD(mm_list);
+/* the last mm_struct handed out by get_next_mm(), or &mm_list */
+static struct list_head *mm_list_cursor = &mm_list;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&mm_list_lock);
+	list_add_tail(&mm->lru_gen_list, &mm_list);
+	spin_unlock(&mm_list_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&mm_list_lock);
+	if (mm_list_cursor == &mm->lru_gen_list)
+		mm_list_cursor = mm_list_cursor->next;
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&mm_list_lock);
+}
+
+/*
+ * Return the next mm_struct with a reference held on mm_users, or NULL once
+ * a full pass over the list has been made.  The caller must drop the
+ * reference with mmput() outside of mm_list_lock, since the last mmput()
+ * takes it to delete the mm_struct from the list.
+ */
+static struct mm_struct *get_next_mm(void)
+{
+	struct mm_struct *mm = NULL;
+	struct list_head *pos;
+
+	spin_lock(&mm_list_lock);
+	for (pos = mm_list_cursor->next; pos != &mm_list; pos = pos->next) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		if (atomic_inc_not_zero(&mm->mm_users))
+			break;
+		mm = NULL;
+	}
+	mm_list_cursor = mm ? pos : &mm_list;
+	spin_unlock(&mm_list_lock);
+
+	return mm;
+}
+
+/******************************************************************************
+ *                          the bloom filter
+ ******************************************************************************/
+
+/*
+ * Two filters rotate per walk: the one filled during the previous walk is
+ * tested to decide which page tables to scan, the other one is filled for
+ * the next walk.  Both are protected by walk_mutex.
+ */
+#define BLOOM_FILTER_SHIFT	15
+#define BLOOM_FILTER_MASK	((1UL << BLOOM_FILTER_SHIFT) - 1)
+
+static unsigned long bloom_filters[2][BITS_TO_LONGS(1UL << BLOOM_FILTER_SHIFT)];
+static int bloom_fill;
+
+static void bloom_keys(void *item, unsigned long *k0, unsigned long *k1)
+{
+	unsigned long key = hash_ptr(item, BLOOM_FILTER_SHIFT * 2);
+
+	*k0 = key & BLOOM_FILTER_MASK;
+	*k1 = key >> BLOOM_FILTER_SHIFT;
+}
+
+static bool bloom_test(void *item)
+{
+	unsigned long *filter = bloom_filters[!bloom_fill];
+	unsigned long k0, k1;
+
+	bloom_keys(item, &k0, &k1);
+	return test_bit(k0, filter) && test_bit(k1, filter);
+}
+
+static void bloom_add(void *item)
+{
+	unsigned long *filter = bloom_filters[bloom_fill];
+	unsigned long k0, k1;
+
+	bloom_keys(item, &k0, &k1);
+	__set_bit(k0, filter);
+	__set_bit(k1, filter);
+}
+
+static void bloom_rotate(void)
+{
+	bloom_fill = !bloom_fill;
+	bitmap_zero(bloom_filters[bloom_fill], 1UL << BLOOM_FILTER_SHIFT);
+}
+
+/******************************************************************************
+ *                          aging
+ ******************************************************************************/
+
+/* every FULL_SCAN_INTERVAL walks, page tables are scanned regardless */
+#define FULL_SCAN_INTERVAL	8
+/* do not walk the page tables more often than this */
+#define WALK_INTERVAL		(HZ / 10)
+
+static DEFINE_MUTEX(walk_mutex);
+static unsigned long last_walk;
+static unsigned int nr_walks;
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	struct pagevec pvec;
+	bool full_scan;
+};
+
+/*
+ * Move pages found young by the page table walk into the youngest
+ * generation of their lruvec.  The counters are unaffected since all
+ * generations are accounted as the inactive list of their type.
+ */
+static void promote_pages(struct pagevec *pvec)
+{
+	struct zone *zone = NULL;
+	unsigned long flags = 0;
+	int i;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+		struct lruvec *lruvec;
+		int gen, type;
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irqrestore(&zone->lru_lock, flags);
+			zone = pagezone;
+			spin_lock_irqsave(&zone->lru_lock, flags);
+		}
+
+		if (!PageLRU(page) || page_lru_gen(page) < 0)
+			continue;
+
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		gen = lru_gen_from_seq(lruvec->lrugen.max_seq);
+		type = page_is_file_cache(page);
+		page_set_lru_gen(page, gen);
+		list_move(&page->lru, &lruvec->lrugen.lists[gen][type]);
+	}
+	if (zone)
+		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+static int walk_pmd_range(pmd_t *pmd, unsigned long addr, unsigned long end,
+			  struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = args->vma;
+	int young = 0, total = 0;
+	spinlock_t *ptl;
+	pte_t *pte, *orig_pte;
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	if (!args->full_scan && !bloom_test(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		total++;
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || !PageLRU(page))
+			continue;
+
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+
+		young++;
+		get_page(page);
+		if (!pagevec_add(&args->pvec, page))
+			promote_pages(&args->pvec);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	/*
+	 * Only remember page tables where young entries are dense enough
+	 * that scanning them beats the cache misses of skipping around.
+	 */
+	if (young * clamp_t(int, cache_line_size() / sizeof(pte_t), 2, 8) >= total)
+		bloom_add(pmd);
+
+	return 0;
+}
+
+static void walk_mm(struct mm_struct *mm, struct lru_gen_walk *args)
+{
+	struct mm_walk walk = {
+		.pmd_entry = walk_pmd_range,
+		.mm = mm,
+		.private = args,
+	};
+	struct vm_area_struct *vma;
+
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if ((vma->vm_flags & VM_SPECIAL) || is_vm_hugetlb_page(vma))
+			continue;
+
+		args->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+	up_read(&mm->mmap_sem);
+
+	if (pagevec_count(&args->pvec))
+		promote_pages(&args->pvec);
+}
+
+static void walk_mm_list(void)
+{
+	struct lru_gen_walk args = {
+		.full_scan = !(nr_walks++ % FULL_SCAN_INTERVAL),
+	};
+	struct mm_struct *mm, *prev = NULL;
+
+	pagevec_init(&args.pvec, 0);
+	bloom_rotate();
+
+	while ((mm = get_next_mm())) {
+		if (prev)
+			mmput(prev);
+		prev = mm;
+
+		walk_mm(mm, &args);
+		cond_resched();
+	}
+	if (prev)
+		mmput(prev);
+}
+
+static bool try_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+	if (lrugen->max_seq - lrugen->min_seq[type] < MIN_NR_GENS)
+		return false;
+
+	if (!list_empty(&lrugen->lists[gen][type]))
+		return false;
+
+	lrugen->min_seq[type]++;
+	return true;
+}
+
+/*
+ * Create a new generation.  If a type already has MAX_NR_GENS generations,
+ * its oldest generation is folded into the next one to make room.
+ */
+static void inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		struct page *page;
+		int old_gen, new_gen;
+
+		if (try_inc_min_seq(lruvec, type))
+			continue;
+
+		if (lrugen->max_seq - lrugen->min_seq[type] + 1 < MAX_NR_GENS)
+			continue;
+
+		old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+		new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+		list_for_each_entry(page, &lrugen->lists[old_gen][type], lru)
+			page_set_lru_gen(page, new_gen);
+		list_splice_tail_init(&lrugen->lists[old_gen][type],
+				      &lrugen->lists[new_gen][type]);
+		lrugen->min_seq[type]++;
+	}
+	lrugen->max_seq++;
+}
+
+/**
+ * lru_gen_age_lruvec - create a new generation and fill it
+ * @lruvec: the lruvec to age
+ *
+ * Pages found young in the page tables are moved to the youngest generation
+ * of their own lruvec, so one walk serves every lruvec.  The walk is skipped
+ * if another one is running or one has completed recently.  May sleep.
+ */
+void lru_gen_age_lruvec(struct lruvec *lruvec)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+
+	spin_lock_irq(&zone->lru_lock);
+	inc_max_seq(lruvec);
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (time_before(jiffies, last_walk + WALK_INTERVAL))
+		return;
+
+	if (!mutex_trylock(&walk_mutex))
+		return;
+
+	walk_mm_list();
+	last_walk = jiffies;
+	mutex_unlock(&walk_mutex);
+}
+
+/******************************************************************************
+ *                          eviction
+ ******************************************************************************/
+
+/* the oldest generation may be evicted only if MIN_NR_GENS remain after it */
+static bool can_evict(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return lrugen->max_seq - lrugen->min_seq[type] >= MIN_NR_GENS;
+}
+
+/*
+ * Pick the type with the older oldest generation, file on a tie, or
+ * whatever is left if anon cannot be reclaimed.  Returns -1 if neither
+ * type has a generation to spare.
+ */
+static int get_type_to_evict(struct lruvec *lruvec, int swappiness)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	bool anon = swappiness && get_nr_swap_pages() > 0 &&
+		    can_evict(lruvec, 0);
+	bool file = can_evict(lruvec, 1);
+
+	if (anon && file)
+		return lrugen->min_seq[0] < lrugen->min_seq[1] ? 0 : 1;
+	if (file)
+		return 1;
+	if (anon)
+		return 0;
+	return -1;
+}
+
+/**
+ * lru_gen_need_aging - check whether @lruvec needs a new generation
+ * @lruvec: the lruvec to check
+ * @swappiness: the reclaim's swappiness
+ *
+ * Must be called with the zone lru_lock held.
+ */
+bool lru_gen_need_aging(struct lruvec *lruvec, int swappiness)
+{
+	return get_type_to_evict(lruvec, swappiness) < 0;
+}
+
+/**
+ * lru_gen_isolate_pages - isolate pages from the oldest generation
+ * @nr_to_scan:	the number of pages to look through
+ * @lruvec:	the lruvec to pull pages from
+ * @dst:	the list to put isolated pages on
+ * @nr_scanned:	the number of pages that were scanned
+ * @mode:	one of the LRU isolation modes
+ * @swappiness: the reclaim's swappiness
+ * @file:	set to the type of the isolated pages
+ *
+ * The counterpart of isolate_lru_pages() for the multi-generational LRU, with
+ * the same locking and accounting rules: the caller holds the zone lru_lock
+ * and updates the NR_LRU and NR_ISOLATED zone counters of *@file.
+ *
+ * Returns how many pages were moved onto *@dst.
+ */
+unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+				    struct lruvec *lruvec,
+				    struct list_head *dst,
+				    unsigned long *nr_scanned,
+				    isolate_mode_t mode,
+				    int swappiness, int *file)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long nr_taken = 0;
+	unsigned long scan = 0;
+	struct list_head *head;
+	int type, gen;
+
+	*nr_scanned = 0;
+	type = get_type_to_evict(lruvec, swappiness);
+	if (type < 0)
+		return 0;
+
+	gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	head = &lrugen->lists[gen][type];
+
+	for (scan = 0; scan < nr_to_scan && !list_empty(head); scan++) {
+		struct page *page = list_entry(head->prev, struct page, lru);
+		int nr_pages = hpage_nr_pages(page);
+
+		VM_BUG_ON_PAGE(!PageLRU(page), page);
+
+		switch (__isolate_lru_page(page, mode)) {
+		case 0:
+			page_set_lru_gen(page, -1);
+			list_move(&page->lru, dst);
+			nr_taken += nr_pages;
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, head);
+			continue;
+
+		default:
+			BUG();
+		}
+	}
+
+	*nr_scanned = scan;
+	*file = type;
+	mem_cgroup_update_lru_size(lruvec, type * LRU_FILE, -nr_taken);
+
+	if (list_empty(head))
+		try_inc_min_seq(lruvec, type);
+
+	return nr_taken;
+}
+
+/******************************************************************************
+ *                          state change
+ ******************************************************************************/
+
+/* pages moved between the two schemes before the lru_lock is dropped */
+#define DRAIN_BATCH		64
+
+static void drain_list(struct lruvec *lruvec, struct list_head *head,
+		       bool active)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+	int batch = 0;
+
+	while (!list_empty(head)) {
+		struct page *page = list_entry(head->prev, struct page, lru);
+
+		del_page_from_lru_list(page, lruvec, page_lru(page));
+		if (active)
+			SetPageActive(page);
+		add_page_to_lru_list(page, lruvec, page_lru(page));
+
+		if (++batch == DRAIN_BATCH) {
+			batch = 0;
+			spin_unlock_irq(&zone->lru_lock);
+			cond_resched();
+			spin_lock_irq(&zone->lru_lock);
+		}
+	}
+}
+
+/*
+ * Move every evictable page of @lruvec onto the lists of the scheme that is
+ * now in effect.  Pages added concurrently already go to the right place and
+ * removal works for either scheme, so only pages left behind need moving.
+ */
+static void drain_lruvec(struct lruvec *lruvec, bool enable)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type;
+
+	if (enable) {
+		enum lru_list lru;
+
+		for_each_evictable_lru(lru)
+			drain_list(lruvec, &lruvec->lists[lru], false);
+		return;
+	}
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			bool youngest = gen == lru_gen_from_seq(lrugen->max_seq);
+
+			drain_list(lruvec, &lrugen->lists[gen][type], youngest);
+		}
+	}
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct zone *zone;
+
+	if (enable == lru_gen_enabled())
+		return;
+
+	if (enable)
+		static_key_slow_inc(&lru_gen_key);
+	else
+		static_key_slow_dec(&lru_gen_key);
+
+	for_each_populated_zone(zone) {
+		struct mem_cgroup *memcg = mem_cgroup_iter(NULL, NULL, NULL);
+
+		do {
+			struct lruvec *lruvec = mem_cgroup_zone_lruvec(zone, memcg);
+
+			spin_lock_irq(&zone->lru_lock);
+			drain_lruvec(lruvec, enable);
+			spin_unlock_irq(&zone->lru_lock);
+
+			cond_resched();
+		} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+	}
+}
+
+static ssize_t enabled_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t enabled_store(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t len)
+{
+	bool enable;
+
+	if (strtobool(buf, &enable))
+		return -EINVAL;
+
+	mutex_lock(&lru_gen_state_mutex);
+	lru_gen_change_state(enable);
+	mutex_unlock(&lru_gen_state_mutex);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init init_lru_gen(void)
+{
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	return 0;
+}
+late_initcall(init_lru_gen);
@@ -0,0 +1,227 @@
+/*
+ * mm/migrate_copy.c - copy pages for migration, optionally with a DMA engine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Migrating huge pages, for NUMA balancing, compaction or THP collapse,
+ * keeps a cpu busy copying for as long as the migration runs.  When
+ * enabled through /sys/kernel/mm/migrate_dma/enabled, large batches are
+ * handed to a DMA_MEMCPY channel of the dmaengine instead, and the caller
+ * sleeps until the copy completes.  Small batches, and batches the channel
+ * cannot take, are copied by the cpu as before.
+ */
+
+#include <linux/completion.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/highmem.h>
+#include <linux/kobject.h>
+#include <linux/migrate.h>
+#include <linux/mm.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+
+/* below this the DMA setup costs more than the copy */
+#define MIGRATE_DMA_MIN_SIZE	(64UL << 10)
+
+static bool migrate_dma_enabled __read_mostly;
+/* keeps the dmaengine client reference while copies use a channel */
+static DECLARE_RWSEM(migrate_dma_rwsem);
+
+static void migrate_copy_pages_cpu(struct page **to, struct page **from,
+				   int nr)
+{
+	int i, j, n;
+
+	for (i = 0; i < nr; i++) {
+		n = 1 << compound_order(from[i]);
+		for (j = 0; j < n; j++) {
+			cond_resched();
+			copy_highpage(nth_page(to[i], j), nth_page(from[i], j));
+		}
+	}
+}
+
+static void migrate_dma_done(void *arg)
+{
+	complete(arg);
+}
+
+/*
+ * Queues one memcpy per entry on @chan, with an interrupt on the last one
+ * only: descriptors of a channel complete in order.  Returns 0 once all
+ * copies are done, or an error after waiting for those already submitted.
+ */
+static int migrate_copy_pages_dma(struct dma_chan *chan, struct page **to,
+				  struct page **from, int nr)
+{
+	struct dma_device *dev = chan->device;
+	struct dmaengine_unmap_data *unmap;
+	struct dma_async_tx_descriptor *tx;
+	DECLARE_COMPLETION_ONSTACK(done);
+	dma_cookie_t cookie = -EINVAL;
+	int i, ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		size_t len = PAGE_SIZE << compound_order(from[i]);
+		unsigned long flags = DMA_CTRL_ACK;
+		dma_cookie_t c;
+
+		if (!is_dma_copy_aligned(dev, 0, 0, len)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		unmap = dmaengine_get_unmap_data(dev->dev, 2, GFP_NOIO);
+		if (!unmap) {
+			ret = -ENOMEM;
+			break;
+		}
+		unmap->len = len;
+
+		unmap->addr[0] = dma_map_page(dev->dev, from[i], 0, len,
+					      DMA_TO_DEVICE);
+		if (dma_mapping_error(dev->dev, unmap->addr[0])) {
+			dmaengine_unmap_put(unmap);
+			ret = -ENOMEM;
+			break;
+		}
+		unmap->to_cnt = 1;
+
+		unmap->addr[1] = dma_map_page(dev->dev, to[i], 0, len,
+					      DMA_FROM_DEVICE);
+		if (dma_mapping_error(dev->dev, unmap->addr[1])) {
+			dmaengine_unmap_put(unmap);
+			ret = -ENOMEM;
+			break;
+		}
+		unmap->from_cnt = 1;
+
+		if (i == nr - 1)
+			flags |= DMA_PREP_INTERRUPT;
+
+		tx = dev->device_prep_dma_memcpy(chan, unmap->addr[1],
+						 unmap->addr[0], len, flags);
+		if (!tx) {
+			dmaengine_unmap_put(unmap);
+			ret = -EBUSY;
+			break;
+		}
+
+		dma_set_unmap(tx, unmap);
+		if (flags & DMA_PREP_INTERRUPT) {
+			tx->callback = migrate_dma_done;
+			tx->callback_param = &done;
+		}
+		c = dmaengine_submit(tx);
+		dmaengine_unmap_put(unmap);
+		if (dma_submit_error(c)) {
+			ret = -EIO;
+			break;
+		}
+		cookie = c;
+	}
+
+	if (dma_submit_error(cookie))
+		return ret;
+
+	dma_async_issue_pending(chan);
+	if (ret) {
+		dma_sync_wait(chan, cookie);
+		return ret;
+	}
+
+	wait_for_completion(&done);
+	if (dma_async_is_tx_complete(chan, cookie, NULL, NULL) != DMA_COMPLETE)
+		return -EIO;
+	return 0;
+}
+
+/**
+ * migrate_copy_pages - copy a batch of pages for migration
+ * @to: destination pages
+ * @from: source pages, compound pages are copied as a whole
+ * @nr: number of entries in @to and @from
+ *
+ * Offloads the copy to a DMA engine memcpy channel if that is enabled and
+ * the batch is large enough, and falls back to copying with the cpu.
+ * Must be called from process context, it may sleep.
+ */
+void migrate_copy_pages(struct page **to, struct page **from, int nr)
+{
+	struct dma_chan *chan;
+	unsigned long size = 0;
+	int i;
+
+	might_sleep();
+
+	if (!ACCESS_ONCE(migrate_dma_enabled))
+		goto cpu;
+
+	for (i = 0; i < nr; i++)
+		size += PAGE_SIZE << compound_order(from[i]);
+	if (size < MIGRATE_DMA_MIN_SIZE)
+		goto cpu;
+
+	down_read(&migrate_dma_rwsem);
+	chan = migrate_dma_enabled ? dma_find_channel(DMA_MEMCPY) : NULL;
+	if (chan && !migrate_copy_pages_dma(chan, to, from, nr)) {
+		up_read(&migrate_dma_rwsem);
+		return;
+	}
+	up_read(&migrate_dma_rwsem);
+cpu:
+	migrate_copy_pages_cpu(to, from, nr);
+}
+
+static ssize_t enabled_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	return sprintf(buf, "%d\n", migrate_dma_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t len)
+{
+	bool enable;
+
+	if (strtobool(buf, &enable))
+		return -EINVAL;
+
+	down_write(&migrate_dma_rwsem);
+	if (enable != migrate_dma_enabled) {
+		/* publishes the memcpy channels to dma_find_channel() */
+		if (enable)
+			dmaengine_get();
+		else
+			dmaengine_put();
+		migrate_dma_enabled = enable;
+	}
+	up_write(&migrate_dma_rwsem);
+
+	return len;
+}
+
+static struct kobj_attribute migrate_dma_enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static struct attribute *migrate_dma_attrs[] = {
+	&migrate_dma_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group migrate_dma_attr_group = {
+	.name = "migrate_dma",
+	.attrs = migrate_dma_attrs,
+};
+
+static int __init init_migrate_dma(void)
+{
+	if (sysfs_create_group(mm_kobj, &migrate_dma_attr_group))
+		pr_err("migrate_dma: failed to create sysfs group\n");
+
+	return 0;
+}
+late_initcall(init_migrate_dma);
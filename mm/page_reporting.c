@@ -0,0 +1,254 @@
+/*
+ * mm/page_reporting.c - report free memory to a hypervisor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A guest frees memory the host cannot reclaim, since the host does not
+ * know that the guest stopped using it.  Once enough blocks of at least
+ * PAGE_REPORTING_MIN_ORDER have gone back to the buddy lists, a delayed
+ * work takes such blocks out of the allocator, hands them to the device in
+ * batches of PAGE_REPORTING_CAPACITY, so the host can discard their
+ * backing, and frees them again.
+ *
+ * Reported blocks are remembered in a bitmap with one bit per pageblock.
+ * Freeing a block clears its bit, since it was allocated and may have been
+ * written to, so only memory that became free since the last report is
+ * reported again.  The bitmap is only a hint: discarding happens while the
+ * reporting work owns the blocks, so a stale bit can cost a missed report
+ * but never data.
+ */
+
+#include <linux/bootmem.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/page_reporting.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+/* free blocks to see before starting a report */
+#define PAGE_REPORTING_THRESHOLD	PAGE_REPORTING_CAPACITY
+
+/* delay before reporting, to batch frees and stay off the free path */
+#define PAGE_REPORTING_DELAY		(2 * HZ)
+
+/* most blocks a single pass holds on to, reported or not */
+#define PAGE_REPORTING_MAX_HELD		(2 * PAGE_REPORTING_CAPACITY)
+
+/*
+ * Taking blocks for a report must neither reclaim nor eat into the
+ * reserves, it only gets what is free anyway.
+ */
+#define PAGE_REPORTING_GFP	(GFP_NOWAIT | __GFP_HIGHMEM | __GFP_MOVABLE | \
+				 __GFP_NOWARN | __GFP_NORETRY | \
+				 __GFP_NOMEMALLOC | __GFP_NO_KSWAPD)
+
+struct static_key page_reporting_enabled = STATIC_KEY_INIT_FALSE;
+
+static struct page_reporting_dev_info __rcu *pr_dev_info;
+static DEFINE_MUTEX(page_reporting_mutex);
+
+/* blocks freed since the last pass started */
+static atomic_t page_reporting_pending;
+
+/* one bit per pageblock below page_reporting_max_pfn, set once reported */
+static unsigned long *page_reporting_bitmap;
+static unsigned long page_reporting_max_pfn;
+
+static void page_reporting_set(struct page *page)
+{
+	unsigned long pfn = page_to_pfn(page);
+
+	if (pfn < page_reporting_max_pfn)
+		set_bit(pfn >> pageblock_order, page_reporting_bitmap);
+}
+
+static bool page_reporting_test(struct page *page)
+{
+	unsigned long pfn = page_to_pfn(page);
+
+	return pfn < page_reporting_max_pfn &&
+	       test_bit(pfn >> pageblock_order, page_reporting_bitmap);
+}
+
+void __page_reporting_notify_free(struct page *page, unsigned int order)
+{
+	struct page_reporting_dev_info *prdev;
+	unsigned long pfn = page_to_pfn(page);
+	unsigned long end = pfn + (1UL << order);
+
+	rcu_read_lock();
+	prdev = rcu_dereference(pr_dev_info);
+	if (!prdev)
+		goto out;
+
+	/* the block may have been written to while it was allocated */
+	for (; pfn < end && pfn < page_reporting_max_pfn;
+	     pfn += pageblock_nr_pages)
+		clear_bit(pfn >> pageblock_order, page_reporting_bitmap);
+
+	if (atomic_inc_return(&page_reporting_pending) ==
+	    PAGE_REPORTING_THRESHOLD)
+		schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+out:
+	rcu_read_unlock();
+}
+
+static int page_reporting_report(struct page_reporting_dev_info *prdev,
+				 struct scatterlist *sgl, unsigned int nents)
+{
+	struct scatterlist *sg;
+	unsigned int i;
+	int err;
+
+	err = prdev->report(prdev, sgl, nents);
+	if (err)
+		return err;
+
+	for_each_sg(sgl, sg, nents, i)
+		set_page_private(sg_page(sg), 1);
+	return 0;
+}
+
+static void page_reporting_process(struct work_struct *work)
+{
+	struct delayed_work *d_work = to_delayed_work(work);
+	struct page_reporting_dev_info *prdev =
+		container_of(d_work, struct page_reporting_dev_info, work);
+	const unsigned int order = PAGE_REPORTING_MIN_ORDER;
+	struct scatterlist *sgl;
+	struct page *page, *next;
+	unsigned int nents = 0, held = 0, nr_reported = 0;
+	LIST_HEAD(pages);
+	int budget, err = 0;
+
+	sgl = kmalloc_array(PAGE_REPORTING_CAPACITY, sizeof(*sgl), GFP_KERNEL);
+	if (!sgl)
+		return;
+	sg_init_table(sgl, PAGE_REPORTING_CAPACITY);
+
+	budget = atomic_xchg(&page_reporting_pending, 0);
+	while (budget > 0 && held < PAGE_REPORTING_MAX_HELD) {
+		page = alloc_pages(PAGE_REPORTING_GFP, order);
+		if (!page)
+			break;
+
+		/*
+		 * Keep every block until the end of the pass, so the
+		 * allocator does not hand the same ones out again.
+		 */
+		list_add(&page->lru, &pages);
+		held++;
+		if (page_reporting_test(page)) {
+			set_page_private(page, 1);
+			continue;
+		}
+
+		sg_set_page(&sgl[nents++], page, PAGE_SIZE << order, 0);
+		budget--;
+		if (nents < PAGE_REPORTING_CAPACITY)
+			continue;
+
+		err = page_reporting_report(prdev, sgl, nents);
+		if (err)
+			break;
+		nr_reported += nents;
+		nents = 0;
+	}
+
+	if (nents && !err) {
+		sg_mark_end(&sgl[nents - 1]);
+		err = page_reporting_report(prdev, sgl, nents);
+		if (!err)
+			nr_reported += nents;
+	}
+
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		bool reported = page_private(page);
+
+		list_del(&page->lru);
+		set_page_private(page, 0);
+		__free_pages(page, order);
+		/* after the free, which cleared the bit */
+		if (reported)
+			page_reporting_set(page);
+	}
+
+	/* our own frees above were counted as well */
+	atomic_sub(held, &page_reporting_pending);
+
+	/*
+	 * More was freed than one pass could take.  Come back for the rest,
+	 * unless this pass only ran into blocks reported before.
+	 */
+	if (!err && budget > 0 && nr_reported) {
+		atomic_add(budget, &page_reporting_pending);
+		schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+	}
+
+	kfree(sgl);
+}
+
+/**
+ * page_reporting_register - register a free page reporting device
+ * @prdev: the device, with ->report set
+ *
+ * Only one device can report at a time.  Returns 0 on success, -EBUSY if
+ * another device is registered or -ENOMEM.
+ */
+int page_reporting_register(struct page_reporting_dev_info *prdev)
+{
+	int err = 0;
+
+	mutex_lock(&page_reporting_mutex);
+	if (rcu_access_pointer(pr_dev_info)) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	page_reporting_max_pfn = ALIGN(max_pfn, pageblock_nr_pages);
+	page_reporting_bitmap = vzalloc(BITS_TO_LONGS(page_reporting_max_pfn >>
+						      pageblock_order) *
+					sizeof(unsigned long));
+	if (!page_reporting_bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* start with a pass over whatever is free already */
+	INIT_DELAYED_WORK(&prdev->work, page_reporting_process);
+	atomic_set(&page_reporting_pending,
+		   page_reporting_max_pfn >> pageblock_order);
+	rcu_assign_pointer(pr_dev_info, prdev);
+	static_key_slow_inc(&page_reporting_enabled);
+	schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+out:
+	mutex_unlock(&page_reporting_mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(page_reporting_register);
+
+/**
+ * page_reporting_unregister - stop reporting to a device
+ * @prdev: the device passed to page_reporting_register()
+ *
+ * No report() calls are in progress or will be made once this returns.
+ */
+void page_reporting_unregister(struct page_reporting_dev_info *prdev)
+{
+	mutex_lock(&page_reporting_mutex);
+	if (rcu_access_pointer(pr_dev_info) == prdev) {
+		RCU_INIT_POINTER(pr_dev_info, NULL);
+		synchronize_rcu();
+		cancel_delayed_work_sync(&prdev->work);
+		static_key_slow_dec(&page_reporting_enabled);
+		vfree(page_reporting_bitmap);
+		page_reporting_bitmap = NULL;
+		page_reporting_max_pfn = 0;
+	}
+	mutex_unlock(&page_reporting_mutex);
+}
+EXPORT_SYMBOL_GPL(page_reporting_unregister);
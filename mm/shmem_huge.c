@@ -0,0 +1,188 @@
+/*
+ * mm/shmem_huge.c - huge page policy for tmpfs and SysV shared memory
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Each tmpfs mount chooses with huge=never|always|within_size|advise
+ * whether its page cache is allocated in huge pages.  The internal mount
+ * behind SysV shm and shared anonymous mappings follows the
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled knob, which also
+ * provides "deny" and "force" to override every mount at once.
+ */
+
+#include <linux/fs.h>
+#include <linux/huge_mm.h>
+#include <linux/khugepaged.h>
+#include <linux/kobject.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/shmem_fs.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+/* policy of the internal shm_mnt, and the deny/force overrides */
+int shmem_huge __read_mostly;
+
+int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+
+/**
+ * shmem_huge_allowed - may the page cache at @index be a huge page
+ * @inode:	the shmem inode
+ * @index:	page cache index of the fault or write
+ * @advised:	the caller asked with madvise(MADV_HUGEPAGE)
+ *
+ * Called by shmem_getpage_gfp() before allocating a new page, and by
+ * khugepaged before collapsing a range of small ones.
+ */
+bool shmem_huge_allowed(struct inode *inode, pgoff_t index, bool advised)
+{
+	int huge = SHMEM_SB(inode->i_sb)->huge;
+	loff_t i_size;
+	pgoff_t off;
+
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+
+	/* the internal mount has no mount options, it follows the sysfs knob */
+	if (inode->i_sb->s_flags & MS_KERNMOUNT)
+		huge = shmem_huge;
+
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return false;
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		off = round_up(index + 1, HPAGE_PMD_NR);
+		i_size = round_up(i_size_read(inode), PAGE_SIZE);
+		if (i_size >= HPAGE_PMD_SIZE &&
+		    i_size >> PAGE_SHIFT >= off)
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return advised;
+	default:
+		VM_BUG_ON(1);
+		return false;
+	}
+}
+
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_NOHUGEPAGE)
+		return false;
+
+	return shmem_huge_allowed(file_inode(vma->vm_file), vma->vm_pgoff,
+				  vma->vm_flags & VM_HUGEPAGE);
+}
+
+/*
+ * Called from shmem_mmap(): hand the mm to khugepaged if the mapping
+ * covers at least one aligned huge page and the policy allows huge pages,
+ * so that page cache filled in small pages gets collapsed later.
+ */
+int shmem_khugepaged_enter(struct vm_area_struct *vma)
+{
+	if (((vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK) >=
+	    (vma->vm_end & HPAGE_PMD_MASK))
+		return 0;
+
+	if (test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags))
+		return 0;
+
+	if (!shmem_huge_enabled(vma))
+		return 0;
+
+	return __khugepaged_enter(vma->vm_mm);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				 shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	return count;
+}
+
+/* added to the transparent_hugepage attribute group by huge_memory.c */
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_SYSFS */
@@ -0,0 +1,63 @@
+/*
+ * Generic bulk allocation and freeing of slab objects.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/slab.h>
+#include <linux/irqflags.h>
+#include <linux/bug.h>
+#include <linux/export.h>
+
+/**
+ * kmem_cache_free_bulk - free an array of objects
+ * @s: the cache the objects belong to, or NULL for kmalloc()ed objects
+ * @size: the number of objects in @p
+ * @p: the objects
+ *
+ * Allocators that can drain a whole array into their per-cpu freelists
+ * or slab pages at once do so; this is the fallback that works for all.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (s)
+			kmem_cache_free(s, p[i]);
+		else
+			kfree(p[i]);
+	}
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/**
+ * kmem_cache_alloc_bulk - allocate an array of objects
+ * @s: the cache to allocate from
+ * @flags: gfp flags for the allocation
+ * @size: the number of objects to allocate
+ * @p: the array to fill
+ *
+ * Returns @size on success.  On failure nothing is left allocated and 0
+ * is returned, sparing callers the handling of partial results.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	size_t i;
+
+	WARN_ON_ONCE(irqs_disabled());
+
+	for (i = 0; i < size; i++) {
+		void *x = p[i] = kmem_cache_alloc(s, flags);
+
+		if (!x) {
+			kmem_cache_free_bulk(s, i, p);
+			return 0;
+		}
+	}
+	return i;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
@@ -0,0 +1,108 @@
+/*
+ * mm/vma_lock.c - VMA lookup for page faults without mmap_sem
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A page fault first looks up its VMA under RCU and read-locks just that
+ * VMA.  Only when this fails, because the VMA tree or the VMA is being
+ * changed, does it go on to take mmap_sem.  For this to be safe, whoever
+ * changes mm->mm_rb does so inside mm->mm_rb_seq, VMAs are freed after an
+ * RCU grace period, and a VMA is write-locked with vma_start_write()
+ * before it is modified or unlinked.
+ */
+
+#include <linux/mm.h>
+#include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/userfaultfd_k.h>
+
+/*
+ * find_vma() for readers that do not hold mmap_sem.  The walk gives up as
+ * soon as a writer shows up, so it cannot loop on a tree that is being
+ * rebalanced under it; RCU keeps the nodes it steps on from being freed.
+ */
+static struct vm_area_struct *find_vma_rcu(struct mm_struct *mm,
+					   unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+	unsigned int seq;
+
+	seq = raw_read_seqcount_begin(&mm->mm_rb_seq);
+	if (seq & 1)
+		return NULL;
+
+	rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (tmp->vm_end > addr) {
+			vma = tmp;
+			if (tmp->vm_start <= addr)
+				break;
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		} else
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+
+		if (read_seqcount_retry(&mm->mm_rb_seq, seq))
+			return NULL;
+	}
+
+	if (read_seqcount_retry(&mm->mm_rb_seq, seq))
+		return NULL;
+
+	return vma;
+}
+
+/**
+ * lock_vma_under_rcu - find and read-lock the VMA for a page fault
+ * @mm:		the faulting mm
+ * @address:	the faulting address
+ *
+ * Returns the VMA covering @address with its lock held for reading, or
+ * NULL if the fault has to be handled under mmap_sem instead.  Only
+ * anonymous VMAs that already have an anon_vma and are not registered
+ * with a userfaultfd are handled: file faults may sleep on I/O and drop
+ * mmap_sem for retry, and anon_vma_prepare() relies on mmap_sem.  The
+ * caller releases the VMA with vma_end_read().
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	vma = find_vma_rcu(mm, address);
+	if (!vma)
+		goto inval;
+
+	if (vma->vm_ops || !vma->anon_vma)
+		goto inval;
+
+	/* handle_userfault() drops mmap_sem, so it cannot run from here */
+	if (userfaultfd_armed(vma))
+		goto inval;
+
+	if (!vma_start_read(vma))
+		goto inval;
+
+	/*
+	 * The VMA may have been unlinked, or split or moved, between the
+	 * lookup and taking its lock; recheck now that it is stable.
+	 */
+	if (unlikely(vma->detached || vma->vm_mm != mm ||
+		     address < vma->vm_start || address >= vma->vm_end)) {
+		vma_end_read(vma);
+		goto inval;
+	}
+
+	rcu_read_unlock();
+	return vma;
+inval:
+	rcu_read_unlock();
+	return NULL;
+}
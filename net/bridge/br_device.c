@@ -95,10 +95,20 @@ static int br_dev_init(struct net_device *dev)
 	if (!br->stats)
 		return -ENOMEM;
 
+	err = br_fdb_hash_init(br);
+	if (err)
+		goto err_fdb;
+
 	err = br_vlan_init(br);
 	if (err)
-		free_percpu(br->stats);
+		goto err_vlan;
 
+	return 0;
+
+err_vlan:
+	br_fdb_hash_fini(br);
+err_fdb:
+	free_percpu(br->stats);
 	return err;
 }
 
@@ -344,6 +354,7 @@ static void br_dev_free(struct net_device *dev)
 {
 	struct net_bridge *br = netdev_priv(dev);
 
+	br_fdb_hash_fini(br);
 	free_percpu(br->stats);
 	free_netdev(dev);
 }
@@ -19,15 +19,20 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/jhash.h>
+#include <linux/log2.h>
 #include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/atomic.h>
 #include <asm/unaligned.h>
 #include <linux/if_vlan.h>
 #include "br_private.h"
 
+/* Most buckets the forwarding table grows to */
+#define BR_FDB_HASH_MAX		(1 << 20)
+
 static struct kmem_cache *br_fdb_cache __read_mostly;
-static struct net_bridge_fdb_entry *fdb_find(struct hlist_head *head,
+static struct net_bridge_fdb_entry *fdb_find(struct net_bridge *br,
 					     const unsigned char *addr,
 					     __u16 vid);
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
@@ -71,11 +76,126 @@ static inline int has_expired(const struct net_bridge *br,
 		time_before_eq(fdb->updated + hold_time(br), jiffies);
 }
 
-static inline int br_mac_hash(const unsigned char *mac, __u16 vid)
+static inline int br_mac_hash(const struct net_bridge_fdb_htable *tbl,
+			      const unsigned char *mac, __u16 vid)
 {
 	/* use 1 byte of OUI and 3 bytes of NIC */
 	u32 key = get_unaligned((u32 *)(mac + 2));
-	return jhash_2words(key, vid, fdb_salt) & (BR_HASH_SIZE - 1);
+	return jhash_2words(key, vid, fdb_salt) & (tbl->max - 1);
+}
+
+/* The table is only replaced by br_fdb_rehash(), under hash_lock */
+#define fdb_hash_dereference(br) \
+	rcu_dereference_protected((br)->fdb_hash, \
+				  lockdep_is_held(&(br)->hash_lock))
+
+#define fdb_hash_dereference_rcu(br) \
+	rcu_dereference_check((br)->fdb_hash, \
+			      lockdep_is_held(&(br)->hash_lock))
+
+static struct net_bridge_fdb_htable *fdb_hash_alloc(u32 max)
+{
+	struct net_bridge_fdb_htable *tbl;
+	size_t sz = max * sizeof(*tbl->hash);
+
+	tbl = kzalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	tbl->hash = kzalloc(sz, GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl->hash)
+		tbl->hash = vzalloc(sz);
+	if (!tbl->hash) {
+		kfree(tbl);
+		return NULL;
+	}
+	tbl->max = max;
+
+	return tbl;
+}
+
+static void fdb_hash_free(struct net_bridge_fdb_htable *tbl)
+{
+	kvfree(tbl->hash);
+	kfree(tbl);
+}
+
+/* Buckets for @size entries, at most one entry per bucket on average */
+static u32 fdb_hash_max(u32 size)
+{
+	if (size <= BR_HASH_SIZE)
+		return BR_HASH_SIZE;
+	if (size >= BR_FDB_HASH_MAX)
+		return BR_FDB_HASH_MAX;
+	return roundup_pow_of_two(size);
+}
+
+/* Resize the table to the number of entries.  Entries are relinked under
+ * hash_lock, so learning just waits for the copy; lookups keep walking the
+ * old chains until the grace period ends.
+ */
+static void br_fdb_rehash(struct work_struct *work)
+{
+	struct net_bridge *br = container_of(work, struct net_bridge,
+					     fdb_rehash_work);
+	struct net_bridge_fdb_htable *old, *tbl;
+	struct net_bridge_fdb_entry *f;
+	u32 max;
+	int i;
+
+	/* nothing else replaces the table, so it is stable here */
+	old = rcu_dereference_protected(br->fdb_hash, 1);
+	max = fdb_hash_max(ACCESS_ONCE(old->size));
+	if (max == old->max)
+		return;
+
+	tbl = fdb_hash_alloc(max);
+	if (!tbl)
+		return;
+	tbl->ver = old->ver ^ 1;
+
+	spin_lock_bh(&br->hash_lock);
+	for (i = 0; i < old->max; i++)
+		hlist_for_each_entry(f, &old->hash[i], hlist[old->ver])
+			hlist_add_head(&f->hlist[tbl->ver],
+				       &tbl->hash[br_mac_hash(tbl, f->addr.addr,
+							      f->vlan_id)]);
+	tbl->size = old->size;
+	rcu_assign_pointer(br->fdb_hash, tbl);
+	spin_unlock_bh(&br->hash_lock);
+
+	/* hlist[old->ver] may be reused by the next rehash */
+	synchronize_rcu();
+	fdb_hash_free(old);
+}
+
+int br_fdb_hash_init(struct net_bridge *br)
+{
+	struct net_bridge_fdb_htable *tbl;
+
+	tbl = fdb_hash_alloc(BR_HASH_SIZE);
+	if (!tbl)
+		return -ENOMEM;
+
+	INIT_WORK(&br->fdb_rehash_work, br_fdb_rehash);
+	RCU_INIT_POINTER(br->fdb_hash, tbl);
+	return 0;
+}
+
+/* All entries must be gone and no more can be learned */
+void br_fdb_hash_fini(struct net_bridge *br)
+{
+	struct net_bridge_fdb_htable *tbl;
+
+	tbl = rcu_dereference_protected(br->fdb_hash, 1);
+	if (!tbl)
+		return;
+
+	cancel_work_sync(&br->fdb_rehash_work);
+	/* the work may have replaced it meanwhile */
+	tbl = rcu_dereference_protected(br->fdb_hash, 1);
+	RCU_INIT_POINTER(br->fdb_hash, NULL);
+	fdb_hash_free(tbl);
 }
 
 static void fdb_rcu_free(struct rcu_head *head)
@@ -132,10 +252,15 @@ static void fdb_del_hw(struct net_bridge *br, const unsigned char *addr)
 
 static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_hash_dereference(br);
+
 	if (f->is_static)
 		fdb_del_hw(br, f->addr.addr);
 
-	hlist_del_rcu(&f->hlist);
+	hlist_del_rcu(&f->hlist[tbl->ver]);
+	tbl->size--;
+	if (unlikely(tbl->size < tbl->max / 4 && tbl->max > BR_HASH_SIZE))
+		schedule_work(&br->fdb_rehash_work);
 	fdb_notify(br, f, RTM_DELNEIGH);
 	call_rcu(&f->rcu, fdb_rcu_free);
 }
@@ -174,11 +299,10 @@ void br_fdb_find_delete_local(struct net_bridge *br,
 			      const struct net_bridge_port *p,
 			      const unsigned char *addr, u16 vid)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr, vid)];
 	struct net_bridge_fdb_entry *f;
 
 	spin_lock_bh(&br->hash_lock);
-	f = fdb_find(head, addr, vid);
+	f = fdb_find(br, addr, vid);
 	if (f && f->is_local && !f->added_by_user && f->dst == p)
 		fdb_delete_local(br, p, f);
 	spin_unlock_bh(&br->hash_lock);
@@ -188,19 +312,19 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 {
 	struct net_bridge *br = p->br;
 	struct net_port_vlans *pv = nbp_get_vlan_info(p);
+	struct net_bridge_fdb_htable *tbl;
 	bool no_vlan = !pv;
 	int i;
 	u16 vid;
 
 	spin_lock_bh(&br->hash_lock);
+	tbl = fdb_hash_dereference(br);
 
 	/* Search all chains since old address/hash is unknown */
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		struct hlist_node *h;
-		hlist_for_each(h, &br->hash[i]) {
-			struct net_bridge_fdb_entry *f;
+	for (i = 0; i < tbl->max; i++) {
+		struct net_bridge_fdb_entry *f;
 
-			f = hlist_entry(h, struct net_bridge_fdb_entry, hlist);
+		hlist_for_each_entry(f, &tbl->hash[i], hlist[tbl->ver]) {
 			if (f->dst == p && f->is_local && !f->added_by_user) {
 				/* delete old one */
 				fdb_delete_local(br, p, f);
@@ -271,14 +395,17 @@ void br_fdb_cleanup(unsigned long _data)
 	struct net_bridge *br = (struct net_bridge *)_data;
 	unsigned long delay = hold_time(br);
 	unsigned long next_timer = jiffies + br->ageing_time;
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	tbl = fdb_hash_dereference(br);
+	for (i = 0; i < tbl->max; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *n;
 
-		hlist_for_each_entry_safe(f, n, &br->hash[i], hlist) {
+		hlist_for_each_entry_safe(f, n, &tbl->hash[i],
+					  hlist[tbl->ver]) {
 			unsigned long this_timer;
 			if (f->is_static)
 				continue;
@@ -297,13 +424,16 @@ void br_fdb_cleanup(unsigned long _data)
 /* Completely flush all dynamic entries in forwarding database.*/
 void br_fdb_flush(struct net_bridge *br)
 {
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	tbl = fdb_hash_dereference(br);
+	for (i = 0; i < tbl->max; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *n;
-		hlist_for_each_entry_safe(f, n, &br->hash[i], hlist) {
+		hlist_for_each_entry_safe(f, n, &tbl->hash[i],
+					  hlist[tbl->ver]) {
 			if (!f->is_static)
 				fdb_delete(br, f);
 		}
@@ -318,15 +448,17 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 			   const struct net_bridge_port *p,
 			   int do_all)
 {
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		struct hlist_node *h, *g;
+	tbl = fdb_hash_dereference(br);
+	for (i = 0; i < tbl->max; i++) {
+		struct net_bridge_fdb_entry *f;
+		struct hlist_node *n;
 
-		hlist_for_each_safe(h, g, &br->hash[i]) {
-			struct net_bridge_fdb_entry *f
-				= hlist_entry(h, struct net_bridge_fdb_entry, hlist);
+		hlist_for_each_entry_safe(f, n, &tbl->hash[i],
+					  hlist[tbl->ver]) {
 			if (f->dst != p)
 				continue;
 
@@ -347,10 +479,11 @@ struct net_bridge_fdb_entry *__br_fdb_get(struct net_bridge *br,
 					  const unsigned char *addr,
 					  __u16 vid)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_hash_dereference_rcu(br);
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry_rcu(fdb,
-				&br->hash[br_mac_hash(addr, vid)], hlist) {
+	hlist_for_each_entry_rcu(fdb, &tbl->hash[br_mac_hash(tbl, addr, vid)],
+				 hlist[tbl->ver]) {
 		if (ether_addr_equal(fdb->addr.addr, addr) &&
 		    fdb->vlan_id == vid) {
 			if (unlikely(has_expired(br, fdb)))
@@ -395,13 +528,15 @@ int br_fdb_fillbuf(struct net_bridge *br, void *buf,
 {
 	struct __fdb_entry *fe = buf;
 	int i, num = 0;
+	struct net_bridge_fdb_htable *tbl;
 	struct net_bridge_fdb_entry *f;
 
 	memset(buf, 0, maxnum*sizeof(struct __fdb_entry));
 
 	rcu_read_lock();
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		hlist_for_each_entry_rcu(f, &br->hash[i], hlist) {
+	tbl = rcu_dereference(br->fdb_hash);
+	for (i = 0; i < tbl->max; i++) {
+		hlist_for_each_entry_rcu(f, &tbl->hash[i], hlist[tbl->ver]) {
 			if (num >= maxnum)
 				goto out;
 
@@ -438,13 +573,15 @@ int br_fdb_fillbuf(struct net_bridge *br, void *buf,
 	return num;
 }
 
-static struct net_bridge_fdb_entry *fdb_find(struct hlist_head *head,
+static struct net_bridge_fdb_entry *fdb_find(struct net_bridge *br,
 					     const unsigned char *addr,
 					     __u16 vid)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_hash_dereference(br);
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry(fdb, head, hlist) {
+	hlist_for_each_entry(fdb, &tbl->hash[br_mac_hash(tbl, addr, vid)],
+			     hlist[tbl->ver]) {
 		if (ether_addr_equal(fdb->addr.addr, addr) &&
 		    fdb->vlan_id == vid)
 			return fdb;
@@ -452,13 +589,15 @@ static struct net_bridge_fdb_entry *fdb_find(struct hlist_head *head,
 	return NULL;
 }
 
-static struct net_bridge_fdb_entry *fdb_find_rcu(struct hlist_head *head,
+static struct net_bridge_fdb_entry *fdb_find_rcu(struct net_bridge *br,
 						 const unsigned char *addr,
 						 __u16 vid)
 {
+	struct net_bridge_fdb_htable *tbl = rcu_dereference(br->fdb_hash);
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry_rcu(fdb, head, hlist) {
+	hlist_for_each_entry_rcu(fdb, &tbl->hash[br_mac_hash(tbl, addr, vid)],
+				 hlist[tbl->ver]) {
 		if (ether_addr_equal(fdb->addr.addr, addr) &&
 		    fdb->vlan_id == vid)
 			return fdb;
@@ -466,11 +605,12 @@ static struct net_bridge_fdb_entry *fdb_find_rcu(struct hlist_head *head,
 	return NULL;
 }
 
-static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
+static struct net_bridge_fdb_entry *fdb_create(struct net_bridge *br,
 					       struct net_bridge_port *source,
 					       const unsigned char *addr,
 					       __u16 vid)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_hash_dereference(br);
 	struct net_bridge_fdb_entry *fdb;
 
 	fdb = kmem_cache_alloc(br_fdb_cache, GFP_ATOMIC);
@@ -482,7 +622,12 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 		fdb->is_static = 0;
 		fdb->added_by_user = 0;
 		fdb->updated = fdb->used = jiffies;
-		hlist_add_head_rcu(&fdb->hlist, head);
+		hlist_add_head_rcu(&fdb->hlist[tbl->ver],
+				   &tbl->hash[br_mac_hash(tbl, addr, vid)]);
+		tbl->size++;
+		if (unlikely(tbl->size > tbl->max &&
+			     tbl->max < BR_FDB_HASH_MAX))
+			schedule_work(&br->fdb_rehash_work);
 	}
 	return fdb;
 }
@@ -490,13 +635,12 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		  const unsigned char *addr, u16 vid)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr, vid)];
 	struct net_bridge_fdb_entry *fdb;
 
 	if (!is_valid_ether_addr(addr))
 		return -EINVAL;
 
-	fdb = fdb_find(head, addr, vid);
+	fdb = fdb_find(br, addr, vid);
 	if (fdb) {
 		/* it is okay to have multiple ports with same
 		 * address, just use the first one.
@@ -509,7 +653,7 @@ static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		fdb_delete(br, fdb);
 	}
 
-	fdb = fdb_create(head, source, addr, vid);
+	fdb = fdb_create(br, source, addr, vid);
 	if (!fdb)
 		return -ENOMEM;
 
@@ -534,7 +678,6 @@ int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr, u16 vid, bool added_by_user)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr, vid)];
 	struct net_bridge_fdb_entry *fdb;
 	bool fdb_modified = false;
 
@@ -547,7 +690,7 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 	      source->state == BR_STATE_FORWARDING))
 		return;
 
-	fdb = fdb_find_rcu(head, addr, vid);
+	fdb = fdb_find_rcu(br, addr, vid);
 	if (likely(fdb)) {
 		/* attempt to update an entry for a local interface */
 		if (unlikely(fdb->is_local)) {
@@ -569,8 +712,8 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		}
 	} else {
 		spin_lock(&br->hash_lock);
-		if (likely(!fdb_find(head, addr, vid))) {
-			fdb = fdb_create(head, source, addr, vid);
+		if (likely(!fdb_find(br, addr, vid))) {
+			fdb = fdb_create(br, source, addr, vid);
 			if (fdb) {
 				if (unlikely(added_by_user))
 					fdb->added_by_user = 1;
@@ -680,15 +823,18 @@ int br_fdb_dump(struct sk_buff *skb,
 		int idx)
 {
 	struct net_bridge *br = netdev_priv(dev);
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	if (!(dev->priv_flags & IFF_EBRIDGE))
 		goto out;
 
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	rcu_read_lock();
+	tbl = rcu_dereference(br->fdb_hash);
+	for (i = 0; i < tbl->max; i++) {
 		struct net_bridge_fdb_entry *f;
 
-		hlist_for_each_entry_rcu(f, &br->hash[i], hlist) {
+		hlist_for_each_entry_rcu(f, &tbl->hash[i], hlist[tbl->ver]) {
 			if (idx < cb->args[0])
 				goto skip;
 
@@ -715,6 +861,7 @@ skip:
 			++idx;
 		}
 	}
+	rcu_read_unlock();
 
 out:
 	return idx;
@@ -725,16 +872,15 @@ static int fdb_add_entry(struct net_bridge_port *source, const __u8 *addr,
 			 __u16 state, __u16 flags, __u16 vid)
 {
 	struct net_bridge *br = source->br;
-	struct hlist_head *head = &br->hash[br_mac_hash(addr, vid)];
 	struct net_bridge_fdb_entry *fdb;
 	bool modified = false;
 
-	fdb = fdb_find(head, addr, vid);
+	fdb = fdb_find(br, addr, vid);
 	if (fdb == NULL) {
 		if (!(flags & NLM_F_CREATE))
 			return -ENOENT;
 
-		fdb = fdb_create(head, source, addr, vid);
+		fdb = fdb_create(br, source, addr, vid);
 		if (!fdb)
 			return -ENOMEM;
 
@@ -877,10 +1023,9 @@ out:
 
 static int fdb_delete_by_addr(struct net_bridge *br, const u8 *addr, u16 vlan)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr, vlan)];
 	struct net_bridge_fdb_entry *fdb;
 
-	fdb = fdb_find(head, addr, vlan);
+	fdb = fdb_find(br, addr, vlan);
 	if (!fdb)
 		return -ENOENT;
 
@@ -962,13 +1107,17 @@ out:
 int br_fdb_sync_static(struct net_bridge *br, struct net_bridge_port *p)
 {
 	struct net_bridge_fdb_entry *fdb, *tmp;
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 	int err;
 
 	ASSERT_RTNL();
 
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		hlist_for_each_entry(fdb, &br->hash[i], hlist) {
+	/* static entries only change under RTNL, the table may be rehashed */
+	rcu_read_lock();
+	tbl = rcu_dereference(br->fdb_hash);
+	for (i = 0; i < tbl->max; i++) {
+		hlist_for_each_entry_rcu(fdb, &tbl->hash[i], hlist[tbl->ver]) {
 			/* We only care for static entries */
 			if (!fdb->is_static)
 				continue;
@@ -978,11 +1127,12 @@ int br_fdb_sync_static(struct net_bridge *br, struct net_bridge_port *p)
 				goto rollback;
 		}
 	}
+	rcu_read_unlock();
 	return 0;
 
 rollback:
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		hlist_for_each_entry(tmp, &br->hash[i], hlist) {
+	for (i = 0; i < tbl->max; i++) {
+		hlist_for_each_entry_rcu(tmp, &tbl->hash[i], hlist[tbl->ver]) {
 			/* If we reached the fdb that failed, we can stop */
 			if (tmp == fdb)
 				break;
@@ -994,18 +1144,22 @@ rollback:
 			dev_uc_del(p->dev, tmp->addr.addr);
 		}
 	}
+	rcu_read_unlock();
 	return err;
 }
 
 void br_fdb_unsync_static(struct net_bridge *br, struct net_bridge_port *p)
 {
 	struct net_bridge_fdb_entry *fdb;
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	ASSERT_RTNL();
 
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		hlist_for_each_entry_rcu(fdb, &br->hash[i], hlist) {
+	rcu_read_lock();
+	tbl = rcu_dereference(br->fdb_hash);
+	for (i = 0; i < tbl->max; i++) {
+		hlist_for_each_entry_rcu(fdb, &tbl->hash[i], hlist[tbl->ver]) {
 			/* We only care for static entries */
 			if (!fdb->is_static)
 				continue;
@@ -1013,4 +1167,5 @@ void br_fdb_unsync_static(struct net_bridge *br, struct net_bridge_port *p)
 			dev_uc_del(p->dev, fdb->addr.addr);
 		}
 	}
+	rcu_read_unlock();
 }
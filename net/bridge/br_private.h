@@ -91,7 +91,7 @@ struct net_port_vlans {
 
 struct net_bridge_fdb_entry
 {
-	struct hlist_node		hlist;
+	struct hlist_node		hlist[2];
 	struct net_bridge_port		*dst;
 
 	struct rcu_head			rcu;
@@ -104,6 +104,17 @@ struct net_bridge_fdb_entry
 	__u16				vlan_id;
 };
 
+/* Entries are linked through hlist[ver]; a rehash links them into the new
+ * table through the other node, so RCU readers of the old one are safe.
+ */
+struct net_bridge_fdb_htable
+{
+	struct hlist_head		*hash;
+	u32				size;
+	u32				max;
+	u32				ver;
+};
+
 struct net_bridge_port_group {
 	struct net_bridge_port		*port;
 	struct net_bridge_port_group __rcu *next;
@@ -220,7 +231,8 @@ struct net_bridge
 
 	struct pcpu_sw_netstats		__percpu *stats;
 	spinlock_t			hash_lock;
-	struct hlist_head		hash[BR_HASH_SIZE];
+	struct net_bridge_fdb_htable __rcu *fdb_hash;
+	struct work_struct		fdb_rehash_work;
 #if IS_ENABLED(CONFIG_BRIDGE_NETFILTER)
 	struct rtable 			fake_rtable;
 	bool				nf_call_iptables;
@@ -383,6 +395,8 @@ static inline void br_netpoll_disable(struct net_bridge_port *p)
 /* br_fdb.c */
 int br_fdb_init(void);
 void br_fdb_fini(void);
+int br_fdb_hash_init(struct net_bridge *br);
+void br_fdb_hash_fini(struct net_bridge *br);
 void br_fdb_flush(struct net_bridge *br);
 void br_fdb_find_delete_local(struct net_bridge *br,
 			      const struct net_bridge_port *p,
@@ -1471,11 +1471,14 @@ static void __send_queued(struct ceph_osd_client *osdc)
 }
 
 /*
+ * Register and map a request.  Returns 1 if it's queued for sending,
+ * 0 if it has to wait for a new osdmap, or a negative error.
+ *
  * Caller should hold map_sem for read and request_mutex.
  */
-static int __ceph_osdc_start_request(struct ceph_osd_client *osdc,
-				     struct ceph_osd_request *req,
-				     bool nofail)
+static int __ceph_osdc_prepare_request(struct ceph_osd_client *osdc,
+				       struct ceph_osd_request *req,
+				       bool nofail)
 {
 	int rc;
 
@@ -1497,10 +1500,26 @@ static int __ceph_osdc_start_request(struct ceph_osd_client *osdc,
 	if (req->r_osd == NULL) {
 		dout("send_request %p no up osds in pg\n", req);
 		ceph_monc_request_next_osdmap(&osdc->client->monc);
-	} else {
-		__send_queued(osdc);
+		return 0;
 	}
 
+	return 1;
+}
+
+/*
+ * Caller should hold map_sem for read and request_mutex.
+ */
+static int __ceph_osdc_start_request(struct ceph_osd_client *osdc,
+				     struct ceph_osd_request *req,
+				     bool nofail)
+{
+	int rc;
+
+	rc = __ceph_osdc_prepare_request(osdc, req, nofail);
+	if (rc <= 0)
+		return rc;
+
+	__send_queued(osdc);
 	return 0;
 }
 
@@ -2441,6 +2460,42 @@ int ceph_osdc_start_request(struct ceph_osd_client *osdc,
 }
 EXPORT_SYMBOL(ceph_osdc_start_request);
 
+/*
+ * Start a batch of requests.  The locks are taken and the unsent list is
+ * walked only once for the whole batch, and requests headed for the same
+ * OSD end up back to back on its session, so they go out in a single
+ * pass of the connection worker.  Stops at the first failure; requests
+ * before it have been started.
+ */
+int ceph_osdc_start_requests(struct ceph_osd_client *osdc,
+			     struct ceph_osd_request **reqs, int nr_reqs,
+			     bool nofail)
+{
+	bool queued = false;
+	int i, rc = 0;
+
+	down_read(&osdc->map_sem);
+	mutex_lock(&osdc->request_mutex);
+
+	for (i = 0; i < nr_reqs; i++) {
+		rc = __ceph_osdc_prepare_request(osdc, reqs[i], nofail);
+		if (rc < 0)
+			break;
+		if (rc)
+			queued = true;
+		rc = 0;
+	}
+
+	if (queued)
+		__send_queued(osdc);
+
+	mutex_unlock(&osdc->request_mutex);
+	up_read(&osdc->map_sem);
+
+	return rc;
+}
+EXPORT_SYMBOL(ceph_osdc_start_requests);
+
 /*
  * Unregister a registered request.  The request is not completed (i.e.
  * no callbacks or wakeups) - higher layers are supposed to know what
@@ -574,6 +574,67 @@ fault:
 }
 EXPORT_SYMBOL(skb_copy_datagram_from_iovec);
 
+/**
+ *	__zerocopy_sg_from_user - pin a user buffer into skb frags
+ *	@sk: socket to charge the pages to, %NULL to charge skb->sk
+ *	@skb: buffer to append to
+ *	@from: user buffer
+ *	@length: number of bytes to pin
+ *
+ *	Pins the pages backing @from and appends them to the frags of @skb,
+ *	charging their truesize to the send buffer of the socket.
+ *
+ *	Returns 0, -EFAULT, or -EMSGSIZE if @skb ran out of frags before
+ *	all of @length was attached.
+ */
+int __zerocopy_sg_from_user(struct sock *sk, struct sk_buff *skb,
+			    unsigned char __user *from, size_t length)
+{
+	int frag = skb_shinfo(skb)->nr_frags;
+
+	while (length) {
+		struct page *pages[MAX_SKB_FRAGS];
+		unsigned long base = (unsigned long)from;
+		unsigned long truesize;
+		int off = base & ~PAGE_MASK;
+		size_t copied;
+		int n, refs, i;
+
+		if (frag == MAX_SKB_FRAGS)
+			return -EMSGSIZE;
+
+		n = min_t(int, MAX_SKB_FRAGS - frag,
+			  (off + length + PAGE_SIZE - 1) >> PAGE_SHIFT);
+		refs = get_user_pages_fast(base, n, 0, pages);
+		if (refs <= 0)
+			return -EFAULT;
+
+		copied = min_t(size_t, length, refs * PAGE_SIZE - off);
+		truesize = PAGE_ALIGN(copied + off);
+		skb->data_len += copied;
+		skb->len += copied;
+		skb->truesize += truesize;
+		if (sk && sk->sk_type == SOCK_STREAM) {
+			sk->sk_wmem_queued += truesize;
+			sk_mem_charge(sk, truesize);
+		} else {
+			atomic_add(truesize, &skb->sk->sk_wmem_alloc);
+		}
+
+		from += copied;
+		length -= copied;
+		for (i = 0; copied; i++) {
+			int size = min_t(int, copied, PAGE_SIZE - off);
+
+			skb_fill_page_desc(skb, frag++, pages[i], off, size);
+			copied -= size;
+			off = 0;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL(__zerocopy_sg_from_user);
+
 /**
  *	zerocopy_sg_from_iovec - Build a zerocopy datagram from an iovec
  *	@skb: buffer to copy
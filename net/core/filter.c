@@ -44,6 +44,12 @@
 #include <linux/ratelimit.h>
 #include <linux/seccomp.h>
 #include <linux/if_vlan.h>
+#include <linux/if_ether.h>
+#include <linux/bpf.h>
+#include <net/sock_reuseport.h>
+#include <net/checksum.h>
+#include <net/sch_generic.h>
+#include <linux/pkt_cls.h>
 
 /**
  *	sk_filter - run a packet through a socket filter
@@ -813,8 +819,12 @@ static void bpf_release_orig_filter(struct bpf_prog *fp)
 
 static void __bpf_prog_release(struct bpf_prog *prog)
 {
-	bpf_release_orig_filter(prog);
-	bpf_prog_free(prog);
+	if (prog->aux->prog_type == BPF_PROG_TYPE_SOCKET_FILTER) {
+		bpf_prog_put(prog);
+	} else {
+		bpf_release_orig_filter(prog);
+		bpf_prog_free(prog);
+	}
 }
 
 static void __sk_filter_release(struct sk_filter *fp)
@@ -1014,38 +1024,28 @@ void bpf_prog_destroy(struct bpf_prog *fp)
 }
 EXPORT_SYMBOL_GPL(bpf_prog_destroy);
 
-/**
- *	sk_attach_filter - attach a socket filter
- *	@fprog: the filter program
- *	@sk: the socket to use
- *
- * Attach the user's filter code. We first run some sanity checks on
- * it to make sure it does not explode on us later. If an error
- * occurs or there is insufficient memory for the filter a negative
- * errno code is returned. On success the return is zero.
- */
-int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+static struct bpf_prog *__get_filter(struct sock_fprog *fprog,
+				     struct sock *sk)
 {
-	struct sk_filter *fp, *old_fp;
 	unsigned int fsize = bpf_classic_proglen(fprog);
 	unsigned int bpf_fsize = bpf_prog_size(fprog->len);
 	struct bpf_prog *prog;
 	int err;
 
 	if (sock_flag(sk, SOCK_FILTER_LOCKED))
-		return -EPERM;
+		return ERR_PTR(-EPERM);
 
 	/* Make sure new filter is there and in the right amounts. */
 	if (fprog->filter == NULL)
-		return -EINVAL;
+		return ERR_PTR(-EINVAL);
 
 	prog = bpf_prog_alloc(bpf_fsize, 0);
 	if (!prog)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	if (copy_from_user(prog->insns, fprog->filter, fsize)) {
 		__bpf_prog_free(prog);
-		return -EFAULT;
+		return ERR_PTR(-EFAULT);
 	}
 
 	prog->len = fprog->len;
@@ -1053,13 +1053,30 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 	err = bpf_prog_store_orig_filter(prog, fprog);
 	if (err) {
 		__bpf_prog_free(prog);
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 	}
 
 	/* bpf_prepare_filter() already takes care of freeing
 	 * memory in case something goes wrong.
 	 */
-	prog = bpf_prepare_filter(prog);
+	return bpf_prepare_filter(prog);
+}
+
+/**
+ *	sk_attach_filter - attach a socket filter
+ *	@fprog: the filter program
+ *	@sk: the socket to use
+ *
+ * Attach the user's filter code. We first run some sanity checks on
+ * it to make sure it does not explode on us later. If an error
+ * occurs or there is insufficient memory for the filter a negative
+ * errno code is returned. On success the return is zero.
+ */
+int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+{
+	struct sk_filter *fp, *old_fp;
+	struct bpf_prog *prog = __get_filter(fprog, sk);
+
 	if (IS_ERR(prog))
 		return PTR_ERR(prog);
 
@@ -1088,6 +1105,81 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(sk_attach_filter);
 
+static int __reuseport_attach_prog(struct bpf_prog *prog, struct sock *sk)
+{
+	struct bpf_prog *old_prog;
+	int err;
+
+	if (bpf_prog_size(prog->len) > sysctl_optmem_max)
+		return -ENOMEM;
+
+	if (sk_unhashed(sk) && sk->sk_reuseport) {
+		err = reuseport_alloc(sk);
+		if (err)
+			return err;
+	} else if (!rcu_access_pointer(sk->sk_reuseport_cb)) {
+		/* The socket wasn't bound with SO_REUSEPORT */
+		return -EINVAL;
+	}
+
+	old_prog = reuseport_attach_prog(sk, prog);
+	if (old_prog) {
+		/* lookups may still be running the old program */
+		synchronize_rcu();
+		__bpf_prog_release(old_prog);
+	}
+
+	return 0;
+}
+
+/**
+ *	sk_reuseport_attach_filter - attach a reuseport selection filter
+ *	@fprog: the filter program
+ *	@sk: the socket to use
+ *
+ * The program runs on the first packet of each connection with the skb
+ * data pointing past the transport header, and returns the index of
+ * the listener in the reuseport group that should get it.  Out of range
+ * results fall back to the flow hash.
+ */
+int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+{
+	struct bpf_prog *prog = __get_filter(fprog, sk);
+	int err;
+
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	err = __reuseport_attach_prog(prog, sk);
+	if (err < 0) {
+		__bpf_prog_release(prog);
+		return err;
+	}
+
+	return 0;
+}
+
+int sk_reuseport_attach_bpf(u32 ufd, struct sock *sk)
+{
+	struct bpf_prog *prog;
+	int err;
+
+	if (sock_flag(sk, SOCK_FILTER_LOCKED))
+		return -EPERM;
+
+	prog = bpf_prog_get_type(ufd, BPF_PROG_TYPE_SOCKET_FILTER);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	err = __reuseport_attach_prog(prog, sk);
+	if (err < 0) {
+		bpf_prog_put(prog);
+		return err;
+	}
+
+	return 0;
+}
+
 int sk_detach_filter(struct sock *sk)
 {
 	int ret = -ENOENT;
@@ -1147,3 +1239,616 @@ out:
 	release_sock(sk);
 	return ret;
 }
+
+/* target of the last bpf_redirect() call made by an XDP or tc program on
+ * this cpu, consumed by xdp_do_redirect() or skb_do_redirect() right after
+ * the program returned
+ */
+struct redirect_info {
+	u32 ifindex;
+	u32 flags;
+};
+
+static DEFINE_PER_CPU(struct redirect_info, redirect_info);
+
+static u64 bpf_redirect(u64 ifindex, u64 flags, u64 r3, u64 r4, u64 r5)
+{
+	struct redirect_info *ri = this_cpu_ptr(&redirect_info);
+
+	if (unlikely(flags))
+		return XDP_ABORTED;
+
+	ri->ifindex = ifindex;
+	ri->flags = flags;
+	return XDP_REDIRECT;
+}
+
+static const struct bpf_func_proto bpf_redirect_proto = {
+	.func		= bpf_redirect,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_ANYTHING,
+	.arg2_type	= ARG_ANYTHING,
+};
+
+/* transmit a copy of the XDP buffer out of 'dev'. The caller keeps
+ * ownership of the receive buffer and can recycle it right away
+ */
+static int __xdp_xmit_copy(struct net_device *dev, struct xdp_buff *xdp,
+			   u16 queue_index)
+{
+	unsigned int len = xdp->data_end - xdp->data;
+	struct sk_buff *skb;
+
+	if (unlikely(!(dev->flags & IFF_UP)))
+		return -ENETDOWN;
+
+	if (unlikely(len < ETH_HLEN || len > dev->mtu + dev->hard_header_len))
+		return -EMSGSIZE;
+
+	skb = netdev_alloc_skb(dev, len);
+	if (unlikely(!skb))
+		return -ENOMEM;
+
+	memcpy(skb_put(skb, len), xdp->data, len);
+	skb_reset_mac_header(skb);
+	skb->protocol = eth_hdr(skb)->h_proto;
+	skb->dev = dev;
+	/* make the tx queue selection pick the queue the frame came in on */
+	skb_record_rx_queue(skb, queue_index);
+
+	return dev_queue_xmit(skb);
+}
+
+/**
+ *	xdp_do_tx - handle XDP_TX verdict
+ *	@dev: device the frame was received on
+ *	@xdp: frame the program returned XDP_TX for
+ *	@queue_index: receive queue of the frame
+ *
+ * Send the (possibly rewritten) frame back out of the receiving port.
+ * Returns 0 on success, the caller recycles the buffer in either case.
+ */
+int xdp_do_tx(struct net_device *dev, struct xdp_buff *xdp, u16 queue_index)
+{
+	return __xdp_xmit_copy(dev, xdp, queue_index);
+}
+EXPORT_SYMBOL_GPL(xdp_do_tx);
+
+/**
+ *	xdp_do_redirect - handle XDP_REDIRECT verdict
+ *	@dev: device the frame was received on
+ *	@xdp: frame the program returned XDP_REDIRECT for
+ *
+ * Send the frame out of the device selected by bpf_redirect(). Must be
+ * called on the cpu that ran the program, right after it returned.
+ * Returns 0 on success, the caller recycles the buffer in either case.
+ */
+int xdp_do_redirect(struct net_device *dev, struct xdp_buff *xdp)
+{
+	struct redirect_info *ri = this_cpu_ptr(&redirect_info);
+	struct net_device *fwd;
+	int err;
+
+	rcu_read_lock();
+	fwd = dev_get_by_index_rcu(dev_net(dev), ri->ifindex);
+	ri->ifindex = 0;
+	if (unlikely(!fwd))
+		err = -EINVAL;
+	else
+		err = __xdp_xmit_copy(fwd, xdp, 0);
+	rcu_read_unlock();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(xdp_do_redirect);
+
+static const struct bpf_func_proto *xdp_func_proto(enum bpf_func_id func_id)
+{
+	switch (func_id) {
+	case BPF_FUNC_redirect:
+		return &bpf_redirect_proto;
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_tail_call:
+		return &bpf_tail_call_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool xdp_is_valid_access(int off, int size, enum bpf_access_type type,
+				enum bpf_reg_type *reg_type)
+{
+	if (type != BPF_READ || size != sizeof(__u32))
+		return false;
+
+	switch (off) {
+	case offsetof(struct xdp_md, data):
+		*reg_type = PTR_TO_PACKET;
+		return true;
+	case offsetof(struct xdp_md, data_end):
+		*reg_type = PTR_TO_PACKET_END;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void xdp_convert_ctx_access(enum bpf_access_type type, int dst_reg,
+				   int src_reg, int ctx_off,
+				   struct bpf_insn *insn)
+{
+	switch (ctx_off) {
+	case offsetof(struct xdp_md, data):
+		*insn = BPF_LDX_MEM(bytes_to_bpf_size(FIELD_SIZEOF(struct xdp_buff, data)),
+				    dst_reg, src_reg,
+				    offsetof(struct xdp_buff, data));
+		break;
+	case offsetof(struct xdp_md, data_end):
+		*insn = BPF_LDX_MEM(bytes_to_bpf_size(FIELD_SIZEOF(struct xdp_buff, data_end)),
+				    dst_reg, src_reg,
+				    offsetof(struct xdp_buff, data_end));
+		break;
+	}
+}
+
+static const struct bpf_func_proto *
+sk_filter_func_proto(enum bpf_func_id func_id)
+{
+	switch (func_id) {
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_get_smp_processor_id:
+		return &bpf_get_smp_processor_id_proto;
+	case BPF_FUNC_tail_call:
+		return &bpf_tail_call_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool sk_filter_is_valid_access(int off, int size,
+				      enum bpf_access_type type,
+				      enum bpf_reg_type *reg_type)
+{
+	if (type != BPF_READ || size != sizeof(__u32))
+		return false;
+
+	switch (off) {
+	case offsetof(struct __sk_buff, len):
+	case offsetof(struct __sk_buff, mark):
+	case offsetof(struct __sk_buff, queue_mapping):
+	case offsetof(struct __sk_buff, protocol):
+	case offsetof(struct __sk_buff, hash):
+	case offsetof(struct __sk_buff, priority):
+	case offsetof(struct __sk_buff, ingress_ifindex):
+	case offsetof(struct __sk_buff, tc_index):
+		return true;
+	default:
+		return false;
+	}
+}
+
+#define SKB_FIELD_LOAD(dst_reg, src_reg, field)				\
+	BPF_LDX_MEM(bytes_to_bpf_size(FIELD_SIZEOF(struct sk_buff, field)), \
+		    dst_reg, src_reg, offsetof(struct sk_buff, field))
+
+#define SKB_FIELD_STORE(dst_reg, src_reg, field)			\
+	BPF_STX_MEM(bytes_to_bpf_size(FIELD_SIZEOF(struct sk_buff, field)), \
+		    dst_reg, src_reg, offsetof(struct sk_buff, field))
+
+#define SKB_FIELD_ACCESS(type, dst_reg, src_reg, field)			\
+	((type) == BPF_WRITE ? SKB_FIELD_STORE(dst_reg, src_reg, field) :	\
+			       SKB_FIELD_LOAD(dst_reg, src_reg, field))
+
+/* only sched_cls programs get write access, is_valid_access() of the
+ * other program types never lets a store into the ctx through
+ */
+static void sk_filter_convert_ctx_access(enum bpf_access_type type,
+					 int dst_reg, int src_reg,
+					 int ctx_off, struct bpf_insn *insn)
+{
+	switch (ctx_off) {
+	case offsetof(struct __sk_buff, len):
+		*insn = SKB_FIELD_LOAD(dst_reg, src_reg, len);
+		break;
+	case offsetof(struct __sk_buff, mark):
+		*insn = SKB_FIELD_ACCESS(type, dst_reg, src_reg, mark);
+		break;
+	case offsetof(struct __sk_buff, queue_mapping):
+		*insn = SKB_FIELD_LOAD(dst_reg, src_reg, queue_mapping);
+		break;
+	case offsetof(struct __sk_buff, protocol):
+		*insn = SKB_FIELD_LOAD(dst_reg, src_reg, protocol);
+		break;
+	case offsetof(struct __sk_buff, hash):
+		*insn = SKB_FIELD_LOAD(dst_reg, src_reg, hash);
+		break;
+	case offsetof(struct __sk_buff, priority):
+		*insn = SKB_FIELD_ACCESS(type, dst_reg, src_reg, priority);
+		break;
+	case offsetof(struct __sk_buff, ingress_ifindex):
+		*insn = SKB_FIELD_LOAD(dst_reg, src_reg, skb_iif);
+		break;
+	case offsetof(struct __sk_buff, tc_index):
+#ifdef CONFIG_NET_SCHED
+		*insn = SKB_FIELD_ACCESS(type, dst_reg, src_reg, tc_index);
+#else
+		if (type == BPF_WRITE)
+			*insn = BPF_MOV64_REG(dst_reg, dst_reg);
+		else
+			*insn = BPF_MOV64_IMM(dst_reg, 0);
+#endif
+		break;
+	case offsetof(struct __sk_buff, tc_classid):
+		ctx_off = offsetof(struct sk_buff, cb) +
+			  offsetof(struct qdisc_skb_cb, tc_classid);
+		if (type == BPF_WRITE)
+			*insn = BPF_STX_MEM(BPF_H, dst_reg, src_reg, ctx_off);
+		else
+			*insn = BPF_LDX_MEM(BPF_H, dst_reg, src_reg, ctx_off);
+		break;
+	}
+}
+
+/* packets at both tc hooks have their data pointing to the mac header while
+ * the program runs, as dev_forward_skb() and dev_queue_xmit() expect it
+ */
+static int __skb_redirect(struct sk_buff *skb, struct net_device *dev,
+			  u32 flags)
+{
+	if (flags & BPF_F_INGRESS)
+		return dev_forward_skb(dev, skb);
+
+	skb->dev = dev;
+	return dev_queue_xmit(skb);
+}
+
+static u64 bpf_skb_redirect(u64 ifindex, u64 flags, u64 r3, u64 r4, u64 r5)
+{
+	struct redirect_info *ri = this_cpu_ptr(&redirect_info);
+
+	if (unlikely(flags & ~(BPF_F_INGRESS)))
+		return TC_ACT_SHOT;
+
+	ri->ifindex = ifindex;
+	ri->flags = flags;
+	return TC_ACT_REDIRECT;
+}
+
+static const struct bpf_func_proto bpf_skb_redirect_proto = {
+	.func		= bpf_skb_redirect,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_ANYTHING,
+	.arg2_type	= ARG_ANYTHING,
+};
+
+/**
+ *	skb_do_redirect - handle TC_ACT_REDIRECT verdict
+ *	@skb: packet the sched_cls program returned TC_ACT_REDIRECT for
+ *
+ * Send @skb to the device selected by bpf_redirect(), into its receive path
+ * when BPF_F_INGRESS was given, out of it otherwise. Must be called on the
+ * cpu that ran the program, with data pointing to the mac header. @skb is
+ * consumed in all cases.
+ */
+int skb_do_redirect(struct sk_buff *skb)
+{
+	struct redirect_info *ri = this_cpu_ptr(&redirect_info);
+	struct net_device *dev;
+
+	dev = dev_get_by_index_rcu(dev_net(skb->dev), ri->ifindex);
+	ri->ifindex = 0;
+	if (unlikely(!dev)) {
+		kfree_skb(skb);
+		return -EINVAL;
+	}
+
+	return __skb_redirect(skb, dev, ri->flags);
+}
+EXPORT_SYMBOL_GPL(skb_do_redirect);
+
+static u64 bpf_clone_redirect(u64 r1, u64 ifindex, u64 flags, u64 r4, u64 r5)
+{
+	struct sk_buff *skb = (struct sk_buff *) (long) r1, *skb2;
+	struct net_device *dev;
+
+	if (unlikely(flags & ~(BPF_F_INGRESS)))
+		return -EINVAL;
+
+	dev = dev_get_by_index_rcu(dev_net(skb->dev), ifindex);
+	if (unlikely(!dev))
+		return -EINVAL;
+
+	skb2 = skb_clone(skb, GFP_ATOMIC);
+	if (unlikely(!skb2))
+		return -ENOMEM;
+
+	return __skb_redirect(skb2, dev, flags);
+}
+
+static const struct bpf_func_proto bpf_clone_redirect_proto = {
+	.func		= bpf_clone_redirect,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+/* make the first 'len' bytes of a cloned skb private before they are
+ * written to
+ */
+static int bpf_skb_make_writable(struct sk_buff *skb, unsigned int len)
+{
+	return skb_cloned(skb) && !skb_clone_writable(skb, len) &&
+	       pskb_expand_head(skb, 0, 0, GFP_ATOMIC);
+}
+
+static u64 bpf_skb_load_bytes(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	const struct sk_buff *skb = (const struct sk_buff *) (long) r1;
+	int offset = (int) r2;
+	void *to = (void *) (long) r3;
+	unsigned int len = (unsigned int) r4;
+	void *ptr;
+
+	if (unlikely((u32) offset > 0xffff || len > MAX_BPF_STACK))
+		return -EFAULT;
+
+	ptr = skb_header_pointer(skb, offset, len, to);
+	if (unlikely(!ptr))
+		return -EFAULT;
+	if (ptr != to)
+		memcpy(to, ptr, len);
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_skb_load_bytes_proto = {
+	.func		= bpf_skb_load_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_STACK,
+	.arg4_type	= ARG_CONST_STACK_SIZE,
+};
+
+static u64 bpf_skb_store_bytes(u64 r1, u64 r2, u64 r3, u64 r4, u64 flags)
+{
+	struct sk_buff *skb = (struct sk_buff *) (long) r1;
+	int offset = (int) r2;
+	void *from = (void *) (long) r3;
+	unsigned int len = (unsigned int) r4;
+	char buf[16];
+	void *ptr;
+
+	if (unlikely(flags & ~(BPF_F_RECOMPUTE_CSUM)))
+		return -EINVAL;
+	if (unlikely((u32) offset > 0xffff || len > sizeof(buf)))
+		return -EFAULT;
+	if (unlikely(bpf_skb_make_writable(skb, offset + len)))
+		return -EFAULT;
+
+	ptr = skb_header_pointer(skb, offset, len, buf);
+	if (unlikely(!ptr))
+		return -EFAULT;
+
+	if (flags & BPF_F_RECOMPUTE_CSUM)
+		skb_postpull_rcsum(skb, ptr, len);
+
+	memcpy(ptr, from, len);
+
+	if (ptr == buf)
+		/* skb_store_bits cannot return -EFAULT here */
+		skb_store_bits(skb, offset, ptr, len);
+
+	if ((flags & BPF_F_RECOMPUTE_CSUM) &&
+	    skb->ip_summed == CHECKSUM_COMPLETE)
+		skb->csum = csum_add(skb->csum, csum_partial(ptr, len, 0));
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_skb_store_bytes_proto = {
+	.func		= bpf_skb_store_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_STACK,
+	.arg4_type	= ARG_CONST_STACK_SIZE,
+	.arg5_type	= ARG_ANYTHING,
+};
+
+static u64 bpf_l3_csum_replace(u64 r1, u64 r2, u64 from, u64 to, u64 flags)
+{
+	struct sk_buff *skb = (struct sk_buff *) (long) r1;
+	int offset = (int) r2;
+	__sum16 sum, *ptr;
+
+	if (unlikely(flags & ~(BPF_F_HDR_FIELD_MASK)))
+		return -EINVAL;
+	if (unlikely((u32) offset > 0xffff))
+		return -EFAULT;
+	if (unlikely(bpf_skb_make_writable(skb, offset + sizeof(sum))))
+		return -EFAULT;
+
+	ptr = skb_header_pointer(skb, offset, sizeof(sum), &sum);
+	if (unlikely(!ptr))
+		return -EFAULT;
+
+	switch (flags & BPF_F_HDR_FIELD_MASK) {
+	case 2:
+		csum_replace2(ptr, from, to);
+		break;
+	case 4:
+		csum_replace4(ptr, from, to);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (ptr == &sum)
+		/* skb_store_bits guaranteed to not return -EFAULT here */
+		skb_store_bits(skb, offset, ptr, sizeof(sum));
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_l3_csum_replace_proto = {
+	.func		= bpf_l3_csum_replace,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+	.arg4_type	= ARG_ANYTHING,
+	.arg5_type	= ARG_ANYTHING,
+};
+
+static u64 bpf_l4_csum_replace(u64 r1, u64 r2, u64 from, u64 to, u64 flags)
+{
+	struct sk_buff *skb = (struct sk_buff *) (long) r1;
+	bool is_pseudo = flags & BPF_F_PSEUDO_HDR;
+	int offset = (int) r2;
+	__sum16 sum, *ptr;
+
+	if (unlikely(flags & ~(BPF_F_PSEUDO_HDR | BPF_F_HDR_FIELD_MASK)))
+		return -EINVAL;
+	if (unlikely((u32) offset > 0xffff))
+		return -EFAULT;
+	if (unlikely(bpf_skb_make_writable(skb, offset + sizeof(sum))))
+		return -EFAULT;
+
+	ptr = skb_header_pointer(skb, offset, sizeof(sum), &sum);
+	if (unlikely(!ptr))
+		return -EFAULT;
+
+	switch (flags & BPF_F_HDR_FIELD_MASK) {
+	case 2:
+		inet_proto_csum_replace2(ptr, skb, from, to, is_pseudo);
+		break;
+	case 4:
+		inet_proto_csum_replace4(ptr, skb, from, to, is_pseudo);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (ptr == &sum)
+		/* skb_store_bits guaranteed to not return -EFAULT here */
+		skb_store_bits(skb, offset, ptr, sizeof(sum));
+
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_l4_csum_replace_proto = {
+	.func		= bpf_l4_csum_replace,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_ANYTHING,
+	.arg4_type	= ARG_ANYTHING,
+	.arg5_type	= ARG_ANYTHING,
+};
+
+static const struct bpf_func_proto *
+sched_cls_func_proto(enum bpf_func_id func_id)
+{
+	switch (func_id) {
+	case BPF_FUNC_redirect:
+		return &bpf_skb_redirect_proto;
+	case BPF_FUNC_clone_redirect:
+		return &bpf_clone_redirect_proto;
+	case BPF_FUNC_skb_load_bytes:
+		return &bpf_skb_load_bytes_proto;
+	case BPF_FUNC_skb_store_bytes:
+		return &bpf_skb_store_bytes_proto;
+	case BPF_FUNC_l3_csum_replace:
+		return &bpf_l3_csum_replace_proto;
+	case BPF_FUNC_l4_csum_replace:
+		return &bpf_l4_csum_replace_proto;
+	default:
+		return sk_filter_func_proto(func_id);
+	}
+}
+
+static bool sched_cls_is_valid_access(int off, int size,
+				      enum bpf_access_type type,
+				      enum bpf_reg_type *reg_type)
+{
+	if (size != sizeof(__u32))
+		return false;
+
+	if (type == BPF_WRITE) {
+		switch (off) {
+		case offsetof(struct __sk_buff, mark):
+		case offsetof(struct __sk_buff, priority):
+		case offsetof(struct __sk_buff, tc_index):
+		case offsetof(struct __sk_buff, tc_classid):
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	if (off == offsetof(struct __sk_buff, tc_classid))
+		return true;
+
+	return sk_filter_is_valid_access(off, size, type, reg_type);
+}
+
+static struct bpf_verifier_ops sk_filter_ops = {
+	.get_func_proto		= sk_filter_func_proto,
+	.is_valid_access	= sk_filter_is_valid_access,
+	.convert_ctx_access	= sk_filter_convert_ctx_access,
+};
+
+static struct bpf_prog_type_list sk_filter_type __read_mostly = {
+	.ops	= &sk_filter_ops,
+	.type	= BPF_PROG_TYPE_SOCKET_FILTER,
+};
+
+static struct bpf_verifier_ops sched_cls_ops = {
+	.get_func_proto		= sched_cls_func_proto,
+	.is_valid_access	= sched_cls_is_valid_access,
+	.convert_ctx_access	= sk_filter_convert_ctx_access,
+};
+
+static struct bpf_prog_type_list sched_cls_type __read_mostly = {
+	.ops	= &sched_cls_ops,
+	.type	= BPF_PROG_TYPE_SCHED_CLS,
+};
+
+static struct bpf_verifier_ops xdp_ops = {
+	.get_func_proto		= xdp_func_proto,
+	.is_valid_access	= xdp_is_valid_access,
+	.convert_ctx_access	= xdp_convert_ctx_access,
+};
+
+static struct bpf_prog_type_list xdp_type __read_mostly = {
+	.ops	= &xdp_ops,
+	.type	= BPF_PROG_TYPE_XDP,
+};
+
+static int __init register_sk_filter_ops(void)
+{
+	bpf_register_prog_type(&sk_filter_type);
+	bpf_register_prog_type(&sched_cls_type);
+	bpf_register_prog_type(&xdp_type);
+	return 0;
+}
+late_initcall(register_sk_filter_ops);
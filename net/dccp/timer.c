@@ -161,15 +161,6 @@ out:
 	sock_put(sk);
 }
 
-/*
- *	Timer for listening sockets
- */
-static void dccp_response_timer(struct sock *sk)
-{
-	inet_csk_reqsk_queue_prune(sk, TCP_SYNQ_INTERVAL, DCCP_TIMEOUT_INIT,
-				   DCCP_RTO_MAX);
-}
-
 static void dccp_keepalive_timer(unsigned long data)
 {
 	struct sock *sk = (struct sock *)data;
@@ -183,7 +174,7 @@ static void dccp_keepalive_timer(unsigned long data)
 	}
 
 	if (sk->sk_state == DCCP_LISTEN) {
-		dccp_response_timer(sk);
+		pr_err("dccp should not use a keepalive timer !\n");
 		goto out;
 	}
 out:
@@ -135,9 +135,13 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	int sglists;
 	int seqhilen;
 	__be32 *seqhi;
+	bool offload;
+	u8 proto;
 
 	/* skb is pure payload to encrypt */
 
+	offload = xfrm_dev_offload_ok(skb, x);
+
 	aead = x->data;
 	alen = crypto_aead_authsize(aead);
 
@@ -159,28 +163,6 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 		goto error;
 	nfrags = err;
 
-	assoclen = sizeof(*esph);
-	sglists = 1;
-	seqhilen = 0;
-
-	if (x->props.flags & XFRM_STATE_ESN) {
-		sglists += 2;
-		seqhilen += sizeof(__be32);
-		assoclen += seqhilen;
-	}
-
-	tmp = esp_alloc_tmp(aead, nfrags + sglists, seqhilen);
-	if (!tmp) {
-		err = -ENOMEM;
-		goto error;
-	}
-
-	seqhi = esp_tmp_seqhi(tmp);
-	iv = esp_tmp_iv(aead, tmp, seqhilen);
-	req = esp_tmp_givreq(aead, iv);
-	asg = esp_givreq_sg(aead, req);
-	sg = asg + sglists;
-
 	/* Fill padding... */
 	tail = skb_tail_pointer(trailer);
 	if (tfclen) {
@@ -192,8 +174,9 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 		for (i = 0; i < plen - 2; i++)
 			tail[i] = i + 1;
 	} while (0);
+	proto = *skb_mac_header(skb);
 	tail[plen - 2] = plen - 2;
-	tail[plen - 1] = *skb_mac_header(skb);
+	tail[plen - 1] = proto;
 	pskb_put(skb, trailer, clen - skb->len + alen);
 
 	skb_push(skb, -skb_network_offset(skb));
@@ -238,6 +221,43 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	esph->spi = x->id.spi;
 	esph->seq_no = htonl(XFRM_SKB_CB(skb)->seq.output.low);
 
+	/* The device generates the IV and the ICV, in the space left for
+	 * them, and encrypts. Without a sec_path to tell it so, software
+	 * crypto has to do it.
+	 */
+	if (offload) {
+		struct xfrm_offload *xo = xfrm_dev_offload_attach(skb, x);
+
+		if (xo) {
+			xo->seq.low = XFRM_SKB_CB(skb)->seq.output.low;
+			xo->seq.hi = XFRM_SKB_CB(skb)->seq.output.hi;
+			xo->proto = proto;
+			return 0;
+		}
+	}
+
+	assoclen = sizeof(*esph);
+	sglists = 1;
+	seqhilen = 0;
+
+	if (x->props.flags & XFRM_STATE_ESN) {
+		sglists += 2;
+		seqhilen += sizeof(__be32);
+		assoclen += seqhilen;
+	}
+
+	tmp = esp_alloc_tmp(aead, nfrags + sglists, seqhilen);
+	if (!tmp) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	seqhi = esp_tmp_seqhi(tmp);
+	iv = esp_tmp_iv(aead, tmp, seqhilen);
+	req = esp_tmp_givreq(aead, iv);
+	asg = esp_givreq_sg(aead, req);
+	sg = asg + sglists;
+
 	sg_init_table(sg, nfrags);
 	skb_to_sgvec(skb, sg,
 		     esph->enc_data + crypto_aead_ivsize(aead) - skb->data,
@@ -384,6 +404,7 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 	u8 *iv;
 	struct scatterlist *sg;
 	struct scatterlist *asg;
+	struct xfrm_offload *xo;
 	int err = -EINVAL;
 
 	if (!pskb_may_pull(skb, sizeof(*esph) + crypto_aead_ivsize(aead)))
@@ -392,6 +413,18 @@ static int esp_input(struct xfrm_state *x, struct sk_buff *skb)
 	if (elen <= 0)
 		goto out;
 
+	/* decrypted in place by the device, xfrm_input() already checked
+	 * the outcome: only the ESP framing is left to strip
+	 */
+	xo = xfrm_offload(skb);
+	if (xo && (xo->flags & CRYPTO_DONE)) {
+		if (skb->ip_summed == CHECKSUM_COMPLETE)
+			skb->ip_summed = CHECKSUM_NONE;
+		ESP_SKB_CB(skb)->tmp = NULL;
+		err = esp_input_done2(skb, 0);
+		goto out;
+	}
+
 	if ((err = skb_cow_data(skb, 0, &trailer)) < 0)
 		goto out;
 	nfrags = err;
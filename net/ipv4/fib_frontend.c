@@ -650,9 +650,48 @@ errout:
 	return err;
 }
 
+/* A dump request carrying a full struct rtmsg may ask for one table
+ * (rtm_table or RTA_TABLE) and for the routes inside a prefix (RTA_DST
+ * and rtm_dst_len).  Older tools send a struct ifinfomsg here, whose
+ * fields read as zero, and whose attributes are not looked at as they
+ * do not start where ours would.
+ */
+static void fib_dump_get_filter(const struct nlmsghdr *nlh,
+				struct fib_dump_filter *filter)
+{
+	const struct rtmsg *rtm = nlmsg_data(nlh);
+	struct nlattr *attr;
+
+	memset(filter, 0, sizeof(*filter));
+	filter->flags = NLM_F_MULTI;
+
+	if (nlmsg_len(nlh) < sizeof(*rtm))
+		return;
+
+	filter->table = rtm->rtm_table;
+	attr = nlmsg_find_attr(nlh, sizeof(*rtm), RTA_TABLE);
+	if (attr && nla_len(attr) >= sizeof(u32))
+		filter->table = nla_get_u32(attr);
+
+	attr = nlmsg_find_attr(nlh, sizeof(*rtm), RTA_DST);
+	if (attr && nla_len(attr) >= sizeof(__be32) &&
+	    rtm->rtm_dst_len <= 32) {
+		filter->dst = nla_get_be32(attr);
+		filter->dst_len = rtm->rtm_dst_len;
+	}
+
+	if (filter->table || filter->dst_len)
+		filter->flags |= NLM_F_DUMP_FILTERED;
+}
+
+/* Registered with RTNL_FLAG_DUMP_UNLOCKED: the table hash and the tries
+ * are walked under RCU, and the position is kept in cb->args so that a
+ * dump of a large table can be resumed after any route changes.
+ */
 static int inet_dump_fib(struct sk_buff *skb, struct netlink_callback *cb)
 {
 	struct net *net = sock_net(skb->sk);
+	struct fib_dump_filter filter;
 	unsigned int h, s_h;
 	unsigned int e = 0, s_e;
 	struct fib_table *tb;
@@ -663,19 +702,32 @@ static int inet_dump_fib(struct sk_buff *skb, struct netlink_callback *cb)
 	    ((struct rtmsg *) nlmsg_data(cb->nlh))->rtm_flags & RTM_F_CLONED)
 		return skb->len;
 
+	fib_dump_get_filter(cb->nlh, &filter);
+
+	rcu_read_lock();
+
+	if (filter.table) {
+		/* cb->args[0] is set once the table is dumped in full */
+		tb = fib_get_table(net, filter.table);
+		if (tb && !cb->args[0] &&
+		    fib_table_dump(tb, skb, cb, &filter) >= 0)
+			cb->args[0] = 1;
+		goto out_unlock;
+	}
+
 	s_h = cb->args[0];
 	s_e = cb->args[1];
 
 	for (h = s_h; h < FIB_TABLE_HASHSZ; h++, s_e = 0) {
 		e = 0;
 		head = &net->ipv4.fib_table_hash[h];
-		hlist_for_each_entry(tb, head, tb_hlist) {
+		hlist_for_each_entry_rcu(tb, head, tb_hlist) {
 			if (e < s_e)
 				goto next;
 			if (dumped)
 				memset(&cb->args[2], 0, sizeof(cb->args) -
 						 2 * sizeof(cb->args[0]));
-			if (fib_table_dump(tb, skb, cb) < 0)
+			if (fib_table_dump(tb, skb, cb, &filter) < 0)
 				goto out;
 			dumped = 1;
 next:
@@ -685,6 +737,8 @@ next:
 out:
 	cb->args[1] = e;
 	cb->args[0] = h;
+out_unlock:
+	rcu_read_unlock();
 
 	return skb->len;
 }
@@ -1171,7 +1225,8 @@ void __init ip_fib_init(void)
 {
 	rtnl_register(PF_INET, RTM_NEWROUTE, inet_rtm_newroute, NULL, NULL);
 	rtnl_register(PF_INET, RTM_DELROUTE, inet_rtm_delroute, NULL, NULL);
-	rtnl_register(PF_INET, RTM_GETROUTE, NULL, inet_dump_fib, NULL);
+	rtnl_register_flags(PF_INET, RTM_GETROUTE, NULL, inet_dump_fib, NULL,
+			    RTNL_FLAG_DUMP_UNLOCKED);
 
 	register_pernet_subsys(&fib_net_ops);
 	register_netdevice_notifier(&fib_netdev_notifier);
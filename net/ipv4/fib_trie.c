@@ -1834,7 +1834,8 @@ void fib_free_table(struct fib_table *tb)
 
 static int fn_trie_dump_fa(t_key key, int plen, struct list_head *fah,
 			   struct fib_table *tb,
-			   struct sk_buff *skb, struct netlink_callback *cb)
+			   struct sk_buff *skb, struct netlink_callback *cb,
+			   const struct fib_dump_filter *filter)
 {
 	int i, s_i;
 	struct fib_alias *fa;
@@ -1859,7 +1860,7 @@ static int fn_trie_dump_fa(t_key key, int plen, struct list_head *fah,
 				  xkey,
 				  plen,
 				  fa->fa_tos,
-				  fa->fa_info, NLM_F_MULTI) < 0) {
+				  fa->fa_info, filter->flags) < 0) {
 			cb->args[5] = i;
 			return -1;
 		}
@@ -1870,7 +1871,8 @@ static int fn_trie_dump_fa(t_key key, int plen, struct list_head *fah,
 }
 
 static int fn_trie_dump_leaf(struct leaf *l, struct fib_table *tb,
-			struct sk_buff *skb, struct netlink_callback *cb)
+			struct sk_buff *skb, struct netlink_callback *cb,
+			const struct fib_dump_filter *filter)
 {
 	struct leaf_info *li;
 	int i, s_i;
@@ -1888,10 +1890,11 @@ static int fn_trie_dump_leaf(struct leaf *l, struct fib_table *tb,
 		if (i > s_i)
 			cb->args[5] = 0;
 
-		if (list_empty(&li->falh))
+		if (list_empty(&li->falh) || li->plen < filter->dst_len)
 			continue;
 
-		if (fn_trie_dump_fa(l->key, li->plen, &li->falh, tb, skb, cb) < 0) {
+		if (fn_trie_dump_fa(l->key, li->plen, &li->falh, tb, skb, cb,
+				    filter) < 0) {
 			cb->args[4] = i;
 			return -1;
 		}
@@ -1903,12 +1906,15 @@ static int fn_trie_dump_leaf(struct leaf *l, struct fib_table *tb,
 }
 
 int fib_table_dump(struct fib_table *tb, struct sk_buff *skb,
-		   struct netlink_callback *cb)
+		   struct netlink_callback *cb,
+		   const struct fib_dump_filter *filter)
 {
 	struct leaf *l;
 	struct trie *t = (struct trie *) tb->tb_data;
 	t_key key = cb->args[2];
 	int count = cb->args[3];
+	t_key mask = filter->dst_len ? ~0U << (32 - filter->dst_len) : 0;
+	t_key prefix = ntohl(filter->dst) & mask;
 
 	rcu_read_lock();
 	/* Dump starting at last key.
@@ -1926,8 +1932,13 @@ int fib_table_dump(struct fib_table *tb, struct sk_buff *skb,
 	}
 
 	while (l) {
+		/* leaves come in key order, none past the prefix matches */
+		if ((l->key & mask) > prefix)
+			break;
+
 		cb->args[2] = l->key;
-		if (fn_trie_dump_leaf(l, tb, skb, cb) < 0) {
+		if ((l->key & mask) == prefix &&
+		    fn_trie_dump_leaf(l, tb, skb, cb, filter) < 0) {
 			cb->args[3] = count;
 			rcu_read_unlock();
 			return -1;
@@ -23,10 +23,12 @@
 #include <net/inet_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/sock_reuseport.h>
 
-static unsigned int inet_ehashfn(struct net *net, const __be32 laddr,
-				 const __u16 lport, const __be32 faddr,
-				 const __be16 fport)
+unsigned int inet_ehashfn(struct net *net, const __be32 laddr,
+			  const __u16 lport, const __be32 faddr,
+			  const __be16 fport)
 {
 	static u32 inet_ehash_secret __read_mostly;
 
@@ -201,6 +203,7 @@ static inline int compute_score(struct sock *sk, struct net *net,
 
 struct sock *__inet_lookup_listener(struct net *net,
 				    struct inet_hashinfo *hashinfo,
+				    struct sk_buff *skb, int doff,
 				    const __be32 saddr, __be16 sport,
 				    const __be32 daddr, const unsigned short hnum,
 				    const int dif)
@@ -210,6 +213,7 @@ struct sock *__inet_lookup_listener(struct net *net,
 	unsigned int hash = inet_lhashfn(net, hnum);
 	struct inet_listen_hashbucket *ilb = &hashinfo->listening_hash[hash];
 	int score, hiscore, matches = 0, reuseport = 0;
+	bool select_ok = true;
 	u32 phash = 0;
 
 	rcu_read_lock();
@@ -225,6 +229,20 @@ begin:
 			if (reuseport) {
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
+				if (select_ok) {
+					struct sock *sk2;
+
+					sk2 = reuseport_select_sock(sk, phash,
+								    skb, doff);
+					if (sk2) {
+						/* the rest of the group
+						 * can not beat this pick
+						 */
+						result = sk2;
+						reuseport = 0;
+						continue;
+					}
+				}
 				matches = 1;
 			}
 		} else if (score == hiscore && reuseport) {
@@ -247,6 +265,7 @@ begin:
 		else if (unlikely(compute_score(result, net, hnum, daddr,
 				  dif) < hiscore)) {
 			sock_put(result);
+			select_ok = false;
 			goto begin;
 		}
 	}
@@ -263,6 +282,8 @@ void sock_gen_put(struct sock *sk)
 
 	if (sk->sk_state == TCP_TIME_WAIT)
 		inet_twsk_free(inet_twsk(sk));
+	else if (sk->sk_state == TCP_NEW_SYN_RECV)
+		reqsk_free(inet_reqsk(sk));
 	else
 		sk_free(sk);
 }
@@ -423,6 +444,95 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 }
 EXPORT_SYMBOL_GPL(__inet_hash_nolisten);
 
+/* Insert a socket into the ehash, and eventually remove another one
+ * (a request sock) it takes over from.  Without @osk the caller must
+ * have set sk->sk_hash.
+ */
+bool inet_ehash_insert(struct sock *sk, struct sock *osk)
+{
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	struct inet_ehash_bucket *head;
+	spinlock_t *lock;
+	bool ret = true;
+
+	WARN_ON_ONCE(!sk_unhashed(sk));
+
+	if (osk)
+		sk->sk_hash = osk->sk_hash;
+	head = inet_ehash_bucket(hashinfo, sk->sk_hash);
+	lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
+
+	spin_lock(lock);
+	if (osk)
+		ret = sk_nulls_del_node_init_rcu(osk);
+	if (ret)
+		__sk_nulls_add_node_rcu(sk, &head->chain);
+	spin_unlock(lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_insert);
+
+/* Hash a child in place of the request sock @osk.  Only one of the CPUs
+ * racing on the same request may win; the losers' children are destroyed
+ * here and false is returned.
+ */
+bool inet_ehash_nolisten(struct sock *sk, struct sock *osk)
+{
+	bool ok = inet_ehash_insert(sk, osk);
+
+	if (ok) {
+		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
+	} else {
+		percpu_counter_inc(sk->sk_prot->orphan_count);
+		sk->sk_state = TCP_CLOSE;
+		sock_set_flag(sk, SOCK_DEAD);
+		inet_csk_destroy_sock(sk);
+	}
+	return ok;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_nolisten);
+
+static bool inet_rcv_saddr_same(const struct sock *sk, const struct sock *sk2)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6)
+		return ipv6_addr_equal(&sk->sk_v6_rcv_saddr,
+				       &sk2->sk_v6_rcv_saddr);
+#endif
+	return inet_sk(sk)->inet_rcv_saddr == inet_sk(sk2)->inet_rcv_saddr;
+}
+
+/* Make a new listener part of the reuseport group of the listeners bound
+ * to the same address and port, or start a new group with it.  Called
+ * with the listening bucket lock held.  A listener left out of any group
+ * because of an allocation failure is still found by the list walk in
+ * the lookup.
+ */
+int inet_reuseport_add_sock(struct sock *sk, struct inet_listen_hashbucket *ilb)
+{
+	struct inet_bind_bucket *tb = inet_csk(sk)->icsk_bind_hash;
+	struct hlist_nulls_node *node;
+	kuid_t uid = sock_i_uid(sk);
+	struct sock *sk2;
+
+	sk_nulls_for_each_rcu(sk2, node, &ilb->head) {
+		if (sk2 != sk &&
+		    sk2->sk_family == sk->sk_family &&
+		    ipv6_only_sock(sk2) == ipv6_only_sock(sk) &&
+		    sk2->sk_bound_dev_if == sk->sk_bound_dev_if &&
+		    inet_csk(sk2)->icsk_bind_hash == tb &&
+		    sk2->sk_reuseport && uid_eq(uid, sock_i_uid(sk2)) &&
+		    inet_rcv_saddr_same(sk, sk2))
+			return reuseport_add_sock(sk, sk2);
+	}
+
+	/* Initial allocation may have already happened via setsockopt */
+	if (!rcu_access_pointer(sk->sk_reuseport_cb))
+		return reuseport_alloc(sk);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(inet_reuseport_add_sock);
+
 static void __inet_hash(struct sock *sk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -437,6 +547,8 @@ static void __inet_hash(struct sock *sk)
 	ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 
 	spin_lock(&ilb->lock);
+	if (sk->sk_reuseport)
+		inet_reuseport_add_sock(sk, ilb);
 	__sk_nulls_add_node_rcu(sk, &ilb->head);
 	sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	spin_unlock(&ilb->lock);
@@ -467,6 +579,8 @@ void inet_unhash(struct sock *sk)
 		lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock_bh(lock);
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		reuseport_detach_sock(sk);
 	done = __sk_nulls_del_node_init_rcu(sk);
 	if (done)
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
@@ -491,20 +605,26 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 	if (!snum) {
 		int i, remaining, low, high, port;
 		static u32 hint;
-		u32 offset = hint + port_offset;
+		u32 offset;
 		struct inet_timewait_sock *tw = NULL;
 
 		inet_get_local_port_range(net, &low, &high);
 		remaining = (high - low) + 1;
 
-		local_bh_disable();
-		for (i = 1; i <= remaining; i++) {
-			port = low + (i + offset) % remaining;
+		/* In the first pass only try every other port, at an even
+		 * offset from @low.  inet_csk_get_port() tries the odd ones
+		 * first, so while the range is not full, connect() mostly
+		 * finds free ports here instead of walking bind() users.
+		 */
+		offset = ((hint + port_offset) % remaining) & ~1U;
+other_parity_scan:
+		for (i = 0; i < remaining; i += 2) {
+			port = low + (offset + i) % remaining;
 			if (inet_is_local_reserved_port(net, port))
 				continue;
 			head = &hinfo->bhash[inet_bhashfn(net, port,
 					hinfo->bhash_size)];
-			spin_lock(&head->lock);
+			spin_lock_bh(&head->lock);
 
 			/* Does not bother with rcv_saddr checks,
 			 * because the established check is already
@@ -527,22 +647,26 @@ int __inet_hash_connect(struct inet_timewait_death_row *death_row,
 			tb = inet_bind_bucket_create(hinfo->bind_bucket_cachep,
 					net, head, port);
 			if (!tb) {
-				spin_unlock(&head->lock);
-				break;
+				spin_unlock_bh(&head->lock);
+				return -EADDRNOTAVAIL;
 			}
 			tb->fastreuse = -1;
 			tb->fastreuseport = -1;
 			goto ok;
 
 		next_port:
-			spin_unlock(&head->lock);
+			spin_unlock_bh(&head->lock);
+			cond_resched();
 		}
-		local_bh_enable();
+
+		offset++;
+		if ((offset & 1) && remaining > 1)
+			goto other_parity_scan;
 
 		return -EADDRNOTAVAIL;
 
 ok:
-		hint += i;
+		hint += i + 2;
 
 		/* Head lock still held and bh's disabled */
 		inet_bind_hash(sk, tb, port);
@@ -0,0 +1,477 @@
+/*
+ * IPv4 forwarding fast path through the netfilter flow table
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The "flow_offload" expression, used in a forward chain, moves
+ * established TCP and UDP connections into the flow table.  Until the
+ * flow is torn down, a PRE_ROUTING hook that runs ahead of defrag and
+ * conntrack applies the connection's NAT, decrements the TTL and hands
+ * its packets to the neighbour layer of the cached route directly.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter/nf_tables.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <net/arp.h>
+#include <net/ip.h>
+#include <net/neighbour.h>
+#include <net/route.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_table.h>
+#include <net/netfilter/nf_tables.h>
+
+struct flow_ports {
+	__be16 source, dest;
+};
+
+static __sum16 *nf_flow_l4_check(struct sk_buff *skb, u8 proto,
+				 unsigned int thoff)
+{
+	struct udphdr *udph;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+		return &((struct tcphdr *)(skb_network_header(skb) +
+					   thoff))->check;
+	case IPPROTO_UDP:
+		udph = (struct udphdr *)(skb_network_header(skb) + thoff);
+		/* no checksum to fix up */
+		if (!udph->check && skb->ip_summed != CHECKSUM_PARTIAL)
+			return NULL;
+		return &udph->check;
+	}
+
+	return NULL;
+}
+
+static void nf_flow_nat_csum_addr(struct sk_buff *skb, __sum16 *check,
+				  u8 proto, __be32 addr, __be32 new_addr)
+{
+	if (!check)
+		return;
+
+	inet_proto_csum_replace4(check, skb, addr, new_addr, 1);
+	if (proto == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+static void nf_flow_nat_csum_port(struct sk_buff *skb, __sum16 *check,
+				  u8 proto, __be16 port, __be16 new_port)
+{
+	if (!check)
+		return;
+
+	inet_proto_csum_replace2(check, skb, port, new_port, 0);
+	if (proto == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+static void nf_flow_snat(const struct flow_offload *flow,
+			 struct sk_buff *skb, unsigned int thoff,
+			 enum flow_offload_tuple_dir dir)
+{
+	struct iphdr *iph = ip_hdr(skb);
+	struct flow_ports *ports;
+	__be32 addr, new_addr;
+	__be16 port, new_port;
+	__sum16 *check;
+
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+	check = nf_flow_l4_check(skb, iph->protocol, thoff);
+
+	if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+		addr = iph->saddr;
+		new_addr = flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_v4;
+		iph->saddr = new_addr;
+		port = ports->source;
+		new_port = flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_port;
+		ports->source = new_port;
+	} else {
+		addr = iph->daddr;
+		new_addr = flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.src_v4;
+		iph->daddr = new_addr;
+		port = ports->dest;
+		new_port = flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.src_port;
+		ports->dest = new_port;
+	}
+
+	csum_replace4(&iph->check, addr, new_addr);
+	nf_flow_nat_csum_addr(skb, check, iph->protocol, addr, new_addr);
+	nf_flow_nat_csum_port(skb, check, iph->protocol, port, new_port);
+}
+
+static void nf_flow_dnat(const struct flow_offload *flow,
+			 struct sk_buff *skb, unsigned int thoff,
+			 enum flow_offload_tuple_dir dir)
+{
+	struct iphdr *iph = ip_hdr(skb);
+	struct flow_ports *ports;
+	__be32 addr, new_addr;
+	__be16 port, new_port;
+	__sum16 *check;
+
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+	check = nf_flow_l4_check(skb, iph->protocol, thoff);
+
+	if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+		addr = iph->daddr;
+		new_addr = flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.src_v4;
+		iph->daddr = new_addr;
+		port = ports->dest;
+		new_port = flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.src_port;
+		ports->dest = new_port;
+	} else {
+		addr = iph->saddr;
+		new_addr = flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_v4;
+		iph->saddr = new_addr;
+		port = ports->source;
+		new_port = flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_port;
+		ports->source = new_port;
+	}
+
+	csum_replace4(&iph->check, addr, new_addr);
+	nf_flow_nat_csum_addr(skb, check, iph->protocol, addr, new_addr);
+	nf_flow_nat_csum_port(skb, check, iph->protocol, port, new_port);
+}
+
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple)
+{
+	struct flow_ports *ports;
+	unsigned int thoff;
+	struct iphdr *iph;
+
+	iph = ip_hdr(skb);
+	thoff = iph->ihl * 4;
+
+	/* leave fragments and options to the slow path */
+	if (ip_is_fragment(iph) || unlikely(thoff != sizeof(*iph)))
+		return -1;
+
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return -1;
+
+	if (!pskb_may_pull(skb, thoff + sizeof(*ports)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	ports = (struct flow_ports *)(skb_network_header(skb) + thoff);
+
+	memset(tuple, 0, sizeof(*tuple));
+	tuple->src_v4 = iph->saddr;
+	tuple->dst_v4 = iph->daddr;
+	tuple->src_port = ports->source;
+	tuple->dst_port = ports->dest;
+	tuple->iifidx = dev->ifindex;
+	tuple->l3proto = AF_INET;
+	tuple->l4proto = iph->protocol;
+
+	return 0;
+}
+
+static bool nf_flow_exceeds_mtu(const struct sk_buff *skb, unsigned int mtu)
+{
+	if (skb->len <= mtu)
+		return false;
+
+	if (skb_is_gso(skb) && skb_gso_network_seglen(skb) <= mtu)
+		return false;
+
+	return true;
+}
+
+/* FIN and RST go through conntrack, which also ends the offload */
+static int nf_flow_tcp_state_check(struct flow_offload *flow,
+				   struct sk_buff *skb, unsigned int thoff)
+{
+	struct tcphdr *tcph;
+
+	if (!pskb_may_pull(skb, thoff + sizeof(*tcph)))
+		return -1;
+
+	tcph = (struct tcphdr *)(skb_network_header(skb) + thoff);
+	if (unlikely(tcph->fin || tcph->rst)) {
+		flow_offload_teardown(flow);
+		return -1;
+	}
+
+	return 0;
+}
+
+static unsigned int nf_flow_offload_ip_hook(const struct nf_hook_ops *ops,
+					    struct sk_buff *skb,
+					    const struct net_device *in,
+					    const struct net_device *out,
+					    int (*okfn)(struct sk_buff *))
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload_tuple tuple;
+	struct flow_offload *flow;
+	struct net_device *outdev;
+	struct neighbour *neigh;
+	unsigned int thoff;
+	struct rtable *rt;
+	struct iphdr *iph;
+	u32 nexthop;
+
+	if (skb->pkt_type != PACKET_HOST)
+		return NF_ACCEPT;
+
+	if (nf_flow_tuple_ip(skb, in, &tuple) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = flow_offload_lookup(dev_net(in), &tuple);
+	if (!tuplehash)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = flow_offload_from_tuplehash(tuplehash);
+	rt = (struct rtable *)tuplehash->tuple.dst_cache;
+	outdev = rt->dst.dev;
+
+	/* the route went stale, let the slow path find the new one */
+	if (rt->dst.obsolete && !dst_check(&rt->dst, 0)) {
+		flow_offload_teardown(flow);
+		return NF_ACCEPT;
+	}
+
+	if (unlikely(nf_flow_exceeds_mtu(skb, dst_mtu(&rt->dst))))
+		return NF_ACCEPT;
+
+	thoff = ip_hdr(skb)->ihl * 4;
+	if (tuple.l4proto == IPPROTO_TCP &&
+	    nf_flow_tcp_state_check(flow, skb, thoff) < 0)
+		return NF_ACCEPT;
+
+	if (ip_hdr(skb)->ttl <= 1)
+		return NF_ACCEPT;
+
+	/* makes the headers writable as well */
+	if (skb_cow(skb, LL_RESERVED_SPACE(outdev)))
+		return NF_DROP;
+
+	flow_offload_refresh(flow);
+	skb_forward_csum(skb);
+
+	if (flow->flags & FLOW_OFFLOAD_SNAT)
+		nf_flow_snat(flow, skb, thoff, dir);
+	if (flow->flags & FLOW_OFFLOAD_DNAT)
+		nf_flow_dnat(flow, skb, thoff, dir);
+
+	iph = ip_hdr(skb);
+	ip_decrease_ttl(iph);
+
+	skb->dev = outdev;
+	skb_dst_drop(skb);
+	skb_dst_set_noref(skb, &rt->dst);
+
+	rcu_read_lock_bh();
+	nexthop = (__force u32)rt_nexthop(rt, iph->daddr);
+	neigh = __ipv4_neigh_lookup_noref(outdev, nexthop);
+	if (unlikely(!neigh))
+		neigh = __neigh_create(&arp_tbl, &nexthop, outdev, false);
+	if (IS_ERR(neigh)) {
+		rcu_read_unlock_bh();
+		return NF_DROP;
+	}
+	dst_neigh_output(&rt->dst, neigh, skb);
+	rcu_read_unlock_bh();
+
+	return NF_STOLEN;
+}
+
+static struct nf_hook_ops nf_flow_offload_ip_ops __read_mostly = {
+	.hook		= nf_flow_offload_ip_hook,
+	.owner		= THIS_MODULE,
+	.pf		= NFPROTO_IPV4,
+	.hooknum	= NF_INET_PRE_ROUTING,
+	.priority	= NF_IP_PRI_CONNTRACK_DEFRAG - 1,
+};
+
+/* The hook is only registered while some rule can add flows */
+static DEFINE_MUTEX(nf_flow_hook_mutex);
+static unsigned int nf_flow_hook_users;
+
+static int nf_flow_hook_get(void)
+{
+	int err = 0;
+
+	mutex_lock(&nf_flow_hook_mutex);
+	if (nf_flow_hook_users++ == 0) {
+		err = nf_register_hook(&nf_flow_offload_ip_ops);
+		if (err < 0)
+			nf_flow_hook_users--;
+	}
+	mutex_unlock(&nf_flow_hook_mutex);
+
+	return err;
+}
+
+static void nf_flow_hook_put(void)
+{
+	mutex_lock(&nf_flow_hook_mutex);
+	if (--nf_flow_hook_users == 0)
+		nf_unregister_hook(&nf_flow_offload_ip_ops);
+	mutex_unlock(&nf_flow_hook_mutex);
+}
+
+static int nft_flow_route(const struct nft_pktinfo *pkt,
+			  const struct nf_conn *ct,
+			  struct nf_flow_route *route,
+			  enum ip_conntrack_dir dir)
+{
+	struct dst_entry *this_dst = skb_dst(pkt->skb);
+	struct flowi4 fl4;
+	struct rtable *rt;
+
+	if (!this_dst || this_dst->xfrm)
+		return -ENOENT;
+
+	memset(&fl4, 0, sizeof(fl4));
+	fl4.daddr = ct->tuplehash[dir].tuple.src.u3.ip;
+	rt = ip_route_output_key(dev_net(pkt->in), &fl4);
+	if (IS_ERR(rt))
+		return PTR_ERR(rt);
+
+	if (rt->dst.xfrm) {
+		ip_rt_put(rt);
+		return -ENOENT;
+	}
+
+	route->tuple[dir].dst = this_dst;
+	route->tuple[dir].ifindex = pkt->in->ifindex;
+	route->tuple[!dir].dst = &rt->dst;
+	route->tuple[!dir].ifindex = pkt->out->ifindex;
+
+	return 0;
+}
+
+static bool nft_flow_offload_skip(const struct nf_conn *ct,
+				  enum ip_conntrack_info ctinfo)
+{
+	/* helpers need to see every packet */
+	if (nfct_help(ct))
+		return true;
+
+	if (ctinfo != IP_CT_ESTABLISHED && ctinfo != IP_CT_ESTABLISHED_REPLY)
+		return true;
+
+	switch (nf_ct_protonum(ct)) {
+	case IPPROTO_TCP:
+		return ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED;
+	case IPPROTO_UDP:
+		return false;
+	}
+
+	return true;
+}
+
+static void nft_flow_offload_eval(const struct nft_expr *expr,
+				  struct nft_data data[NFT_REG_MAX + 1],
+				  const struct nft_pktinfo *pkt)
+{
+	enum ip_conntrack_info ctinfo;
+	struct nf_flow_route route;
+	struct flow_offload *flow;
+	enum ip_conntrack_dir dir;
+	struct nf_conn *ct;
+
+	if (pkt->ops->hooknum != NF_INET_FORWARD)
+		return;
+
+	ct = nf_ct_get(pkt->skb, &ctinfo);
+	if (!ct || nf_ct_is_untracked(ct) || !nf_ct_is_confirmed(ct))
+		return;
+
+	if (nft_flow_offload_skip(ct, ctinfo))
+		return;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		return;
+
+	dir = CTINFO2DIR(ctinfo);
+	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+		goto err_flow_route;
+
+	flow = flow_offload_alloc(ct, &route);
+	if (!flow)
+		goto err_flow_alloc;
+
+	if (flow_offload_add(dev_net(pkt->out), flow) < 0)
+		goto err_flow_add;
+
+	dst_release(route.tuple[!dir].dst);
+	return;
+
+err_flow_add:
+	flow_offload_free(flow);
+err_flow_alloc:
+	dst_release(route.tuple[!dir].dst);
+err_flow_route:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+}
+
+static int nft_flow_offload_init(const struct nft_ctx *ctx,
+				 const struct nft_expr *expr,
+				 const struct nlattr * const tb[])
+{
+	return nf_flow_hook_get();
+}
+
+static void nft_flow_offload_destroy(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr)
+{
+	nf_flow_hook_put();
+}
+
+static int nft_flow_offload_dump(struct sk_buff *skb,
+				 const struct nft_expr *expr)
+{
+	return 0;
+}
+
+static struct nft_expr_type nft_flow_offload_type;
+static const struct nft_expr_ops nft_flow_offload_ops = {
+	.type		= &nft_flow_offload_type,
+	.size		= NFT_EXPR_SIZE(0),
+	.eval		= nft_flow_offload_eval,
+	.init		= nft_flow_offload_init,
+	.destroy	= nft_flow_offload_destroy,
+	.dump		= nft_flow_offload_dump,
+};
+
+static struct nft_expr_type nft_flow_offload_type __read_mostly = {
+	.family		= NFPROTO_IPV4,
+	.name		= "flow_offload",
+	.ops		= &nft_flow_offload_ops,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nf_flow_ipv4_module_init(void)
+{
+	return nft_register_expr(&nft_flow_offload_type);
+}
+
+static void __exit nf_flow_ipv4_module_exit(void)
+{
+	nft_unregister_expr(&nft_flow_offload_type);
+}
+
+module_init(nf_flow_ipv4_module_init);
+module_exit(nf_flow_ipv4_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Netfilter flow table IPv4 fast path");
+MODULE_ALIAS_NFT_AF_EXPR(AF_INET, "flow_offload");
@@ -98,6 +98,7 @@
 #include <net/inetpeer.h>
 #include <net/sock.h>
 #include <net/ip_fib.h>
+#include <net/flow_keys.h>
 #include <net/arp.h>
 #include <net/tcp.h>
 #include <net/icmp.h>
@@ -1618,6 +1619,39 @@ out:
 	return err;
 }
 
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+/*
+ * Flow hash used to pick a multipath nexthop, 31 bits wide.  Policy 0
+ * hashes the addresses only, policy 1 adds the protocol ports, taken
+ * from @skb on input and from @fl4 on output.
+ */
+int fib_multipath_hash(const struct net *net, const struct flowi4 *fl4,
+		       const struct sk_buff *skb)
+{
+	struct flow_keys keys;
+
+	memset(&keys, 0, sizeof(keys));
+
+	if (net->ipv4.sysctl_fib_multipath_hash_policy) {
+		if (skb) {
+			if (skb->l4_hash)
+				return skb_get_hash_raw(skb) >> 1;
+			if (skb_flow_dissect(skb, &keys) && keys.ports)
+				goto hash;
+			memset(&keys, 0, sizeof(keys));
+		} else {
+			keys.port16[0] = fl4->fl4_sport;
+			keys.port16[1] = fl4->fl4_dport;
+		}
+	}
+
+	keys.src = fl4->saddr;
+	keys.dst = fl4->daddr;
+hash:
+	return flow_hash_from_keys(&keys) >> 1;
+}
+#endif
+
 static int ip_mkroute_input(struct sk_buff *skb,
 			    struct fib_result *res,
 			    const struct flowi4 *fl4,
@@ -1625,8 +1659,11 @@ static int ip_mkroute_input(struct sk_buff *skb,
 			    __be32 daddr, __be32 saddr, u32 tos)
 {
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
-	if (res->fi && res->fi->fib_nhs > 1)
-		fib_select_multipath(res);
+	if (res->fi && res->fi->fib_nhs > 1) {
+		int h = fib_multipath_hash(dev_net(in_dev->dev), fl4, skb);
+
+		fib_select_multipath(res, h);
+	}
 #endif
 
 	/* create a routing cache entry */
@@ -2156,7 +2193,7 @@ struct rtable *__ip_route_output_key(struct net *net, struct flowi4 *fl4)
 
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 	if (res.fi->fib_nhs > 1 && fl4->flowi4_oif == 0)
-		fib_select_multipath(&res);
+		fib_select_multipath(&res, fib_multipath_hash(net, fl4, NULL));
 	else
 #endif
 	if (!res.prefixlen &&
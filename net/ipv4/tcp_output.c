@@ -748,6 +748,10 @@ static void tcp_tasklet_func(unsigned long data)
 		list_del(&tp->tsq_node);
 
 		sk = (struct sock *)tp;
+		/* cleared first, so that a pacing timer firing while we run
+		 * queues the socket again rather than being lost
+		 */
+		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
 		bh_lock_sock(sk);
 
 		if (!sock_owned_by_user(sk)) {
@@ -758,7 +762,6 @@ static void tcp_tasklet_func(unsigned long data)
 		}
 		bh_unlock_sock(sk);
 
-		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
 		sk_free(sk);
 	}
 }
@@ -873,6 +876,60 @@ out:
 	sk_free(sk);
 }
 
+enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+{
+	struct tcp_sock *tp = container_of(timer, struct tcp_sock,
+					   pacing_timer);
+	struct sock *sk = (struct sock *)tp;
+	struct tsq_tasklet *tsq;
+	unsigned long flags;
+
+	/* A queued socket is run by the tasklet soon enough */
+	if (test_and_set_bit(TSQ_QUEUED, &tp->tsq_flags))
+		return HRTIMER_NORESTART;
+
+	/* Keep one reference on sk_wmem_alloc, released by
+	 * tcp_tasklet_func(), unless the socket is being freed.
+	 */
+	if (!atomic_inc_not_zero(&sk->sk_wmem_alloc)) {
+		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
+		return HRTIMER_NORESTART;
+	}
+
+	/* queue this socket to tasklet queue */
+	local_irq_save(flags);
+	tsq = this_cpu_ptr(&tsq_tasklet);
+	list_add(&tp->tsq_node, &tsq->head);
+	tasklet_schedule(&tsq->tasklet);
+	local_irq_restore(flags);
+	return HRTIMER_NORESTART;
+}
+
+/* When no qdisc (sch_fq) paces the flow, TCP arms an hrtimer for the
+ * time the packet just sent takes at sk_pacing_rate, and sends nothing
+ * more until it fires (see tcp_pacing_check()).
+ */
+static void tcp_internal_pacing(struct sock *sk, const struct sk_buff *skb)
+{
+	u64 len_ns;
+	u32 rate;
+
+	if (!tcp_needs_internal_pacing(sk))
+		return;
+	rate = sk->sk_pacing_rate;
+	if (!rate || rate == ~0U)
+		return;
+
+	/* Should account for header sizes as sch_fq does,
+	 * but lets make things simple.
+	 */
+	len_ns = (u64)skb->len * NSEC_PER_SEC;
+	do_div(len_ns, rate);
+	hrtimer_start(&tcp_sk(sk)->pacing_timer,
+		      ktime_add_ns(ktime_get(), len_ns),
+		      HRTIMER_MODE_ABS_PINNED);
+}
+
 /* This routine actually transmits TCP packets queued in by
  * tcp_do_sendmsg().  This is used by both the initial
  * transmission and possible later retransmissions.
@@ -901,6 +958,7 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 
 	if (clone_it) {
 		skb_mstamp_get(&skb->skb_mstamp);
+		tcp_rate_skb_sent(sk, skb);
 
 		if (unlikely(skb_cloned(skb)))
 			skb = pskb_copy(skb, gfp_mask);
@@ -992,8 +1050,10 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	if (likely(tcb->tcp_flags & TCPHDR_ACK))
 		tcp_event_ack_sent(sk, tcp_skb_pcount(skb));
 
-	if (skb->len != tcp_header_size)
+	if (skb->len != tcp_header_size) {
 		tcp_event_data_sent(tp, sk);
+		tcp_internal_pacing(sk, skb);
+	}
 
 	if (after(tcb->end_seq, tp->snd_nxt) || tcb->seq == tcb->end_seq)
 		TCP_ADD_STATS(sock_net(sk), TCP_MIB_OUTSEGS,
@@ -1183,6 +1243,7 @@ int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 
 	buff->tstamp = skb->tstamp;
 	tcp_fragment_tstamp(skb, buff);
+	TCP_SKB_CB(buff)->tx = TCP_SKB_CB(skb)->tx;
 
 	old_factor = tcp_skb_pcount(skb);
 
@@ -1923,6 +1984,13 @@ static int tcp_mtu_probe(struct sock *sk)
 	return -1;
 }
 
+/* Nothing may be sent while the pacing timer runs for the last packet */
+static bool tcp_pacing_check(const struct sock *sk)
+{
+	return tcp_needs_internal_pacing(sk) &&
+	       hrtimer_active(&tcp_sk(sk)->pacing_timer);
+}
+
 /* This routine writes packets to the network.  It advances the
  * send_head.  This happens as incoming acks open up the remote
  * window for us.
@@ -1962,6 +2030,9 @@ static bool tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 	while ((skb = tcp_send_head(sk))) {
 		unsigned int limit;
 
+		if (tcp_pacing_check(sk))
+			break;
+
 		tso_segs = tcp_init_tso_segs(sk, skb, mss_now);
 		BUG_ON(!tso_segs);
 
@@ -2654,6 +2725,10 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 
 		if (skb == tcp_send_head(sk))
 			break;
+
+		if (tcp_pacing_check(sk))
+			break;
+
 		/* we could do better than to assign each time */
 		if (hole == NULL)
 			tp->retransmit_skb_hint = skb;
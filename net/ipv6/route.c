@@ -44,6 +44,7 @@
 #include <linux/seq_file.h>
 #include <linux/nsproxy.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
 #include <net/net_namespace.h>
 #include <net/snmp.h>
 #include <net/ipv6.h>
@@ -58,6 +59,7 @@
 #include <net/netevent.h>
 #include <net/netlink.h>
 #include <net/nexthop.h>
+#include <net/flow_keys.h>
 
 #include <asm/uaccess.h>
 
@@ -301,10 +303,10 @@ static const struct rt6_info ip6_blk_hole_entry_template = {
 #endif
 
 /* allocate dst with ip6_dst_ops */
-static inline struct rt6_info *ip6_dst_alloc(struct net *net,
-					     struct net_device *dev,
-					     int flags,
-					     struct fib6_table *table)
+static struct rt6_info *__ip6_dst_alloc(struct net *net,
+					struct net_device *dev,
+					int flags,
+					struct fib6_table *table)
 {
 	struct rt6_info *rt = dst_alloc(&net->ipv6.ip6_dst_ops, dev,
 					0, DST_OBSOLETE_FORCE_CHK, flags);
@@ -319,6 +321,24 @@ static inline struct rt6_info *ip6_dst_alloc(struct net *net,
 	return rt;
 }
 
+/* allocate a route for the fib6 tree, with room for its per-CPU copies */
+static struct rt6_info *ip6_dst_alloc(struct net *net,
+				      struct net_device *dev,
+				      int flags,
+				      struct fib6_table *table)
+{
+	struct rt6_info *rt = __ip6_dst_alloc(net, dev, flags, table);
+
+	if (rt) {
+		rt->rt6i_pcpu = alloc_percpu_gfp(struct rt6_info *, GFP_ATOMIC);
+		if (!rt->rt6i_pcpu) {
+			dst_destroy(&rt->dst);
+			return NULL;
+		}
+	}
+	return rt;
+}
+
 static void ip6_dst_destroy(struct dst_entry *dst)
 {
 	struct rt6_info *rt = (struct rt6_info *)dst;
@@ -328,6 +348,8 @@ static void ip6_dst_destroy(struct dst_entry *dst)
 	if (!(rt->dst.flags & DST_HOST))
 		dst_destroy_metrics_generic(dst);
 
+	free_percpu(rt->rt6i_pcpu);
+
 	if (idev) {
 		rt->rt6i_idev = NULL;
 		in6_dev_put(idev);
@@ -374,47 +396,55 @@ static bool rt6_check_expired(const struct rt6_info *rt)
 }
 
 /* Multipath route selection:
- *   Hash based function using packet header and flowlabel.
- * Adapted from fib_info_hashfn()
+ *   Hash based function using the addresses and flowlabel (RFC 6438),
+ *   plus the ports when net.ipv6.fib_multipath_hash_policy is set.
+ *   The traffic class is left out so that ECN marking cannot move a flow.
  */
-static int rt6_info_hash_nhsfn(unsigned int candidate_count,
-			       const struct flowi6 *fl6)
+static u32 rt6_multipath_hashrnd __read_mostly;
+
+static unsigned int rt6_info_hash_nhsfn(const struct net *net,
+					unsigned int candidate_count,
+					const struct flowi6 *fl6)
 {
-	unsigned int val = fl6->flowi6_proto;
+	u32 val = (__force u32)(fl6->flowlabel & IPV6_FLOWLABEL_MASK);
 
-	val ^= ipv6_addr_hash(&fl6->daddr);
-	val ^= ipv6_addr_hash(&fl6->saddr);
+	net_get_random_once(&rt6_multipath_hashrnd,
+			    sizeof(rt6_multipath_hashrnd));
 
-	/* Work only if this not encapsulated */
-	switch (fl6->flowi6_proto) {
-	case IPPROTO_UDP:
-	case IPPROTO_TCP:
-	case IPPROTO_SCTP:
-		val ^= (__force u16)fl6->fl6_sport;
-		val ^= (__force u16)fl6->fl6_dport;
-		break;
+	if (net->ipv6.sysctl.multipath_hash_policy) {
+		/* Work only if this not encapsulated */
+		switch (fl6->flowi6_proto) {
+		case IPPROTO_UDP:
+		case IPPROTO_TCP:
+		case IPPROTO_SCTP:
+			val ^= (__force u32)fl6->fl6_sport << 16;
+			val ^= (__force u16)fl6->fl6_dport;
+			break;
 
-	case IPPROTO_ICMPV6:
-		val ^= (__force u16)fl6->fl6_icmp_type;
-		val ^= (__force u16)fl6->fl6_icmp_code;
-		break;
+		case IPPROTO_ICMPV6:
+			val ^= (u32)fl6->fl6_icmp_type << 16;
+			val ^= fl6->fl6_icmp_code;
+			break;
+		}
+		val ^= (u32)fl6->flowi6_proto << 20;
 	}
-	/* RFC6438 recommands to use flowlabel */
-	val ^= (__force u32)fl6->flowlabel;
 
-	/* Perhaps, we need to tune, this function? */
-	val = val ^ (val >> 7) ^ (val >> 12);
-	return val % candidate_count;
+	val = jhash_3words(ipv6_addr_hash(&fl6->saddr),
+			   ipv6_addr_hash(&fl6->daddr), val,
+			   rt6_multipath_hashrnd);
+	return reciprocal_scale(val, candidate_count);
 }
 
-static struct rt6_info *rt6_multipath_select(struct rt6_info *match,
+static struct rt6_info *rt6_multipath_select(struct net *net,
+					     struct rt6_info *match,
 					     struct flowi6 *fl6, int oif,
 					     int strict)
 {
 	struct rt6_info *sibling, *next_sibling;
 	int route_choosen;
 
-	route_choosen = rt6_info_hash_nhsfn(match->rt6i_nsiblings + 1, fl6);
+	route_choosen = rt6_info_hash_nhsfn(net, match->rt6i_nsiblings + 1,
+					    fl6);
 	/* Don't change the route, if route_choosen == 0
 	 * (siblings does not include ourself)
 	 */
@@ -803,7 +833,8 @@ restart:
 	rt = fn->leaf;
 	rt = rt6_device_match(net, rt, &fl6->saddr, fl6->flowi6_oif, flags);
 	if (rt->rt6i_nsiblings && fl6->flowi6_oif == 0)
-		rt = rt6_multipath_select(rt, fl6, fl6->flowi6_oif, flags);
+		rt = rt6_multipath_select(net, rt, fl6, fl6->flowi6_oif,
+					  flags);
 	BACKTRACK(net, &fl6->saddr);
 out:
 	dst_use(&rt->dst, jiffies);
@@ -912,11 +943,101 @@ static struct rt6_info *rt6_alloc_clone(struct rt6_info *ort,
 	return rt;
 }
 
+static struct rt6_info *ip6_rt_pcpu_alloc(struct rt6_info *rt)
+{
+	struct rt6_info *pcpu_rt;
+
+	pcpu_rt = __ip6_dst_alloc(dev_net(rt->dst.dev), rt->dst.dev,
+				  rt->dst.flags, rt->rt6i_table);
+	if (!pcpu_rt)
+		return NULL;
+
+	pcpu_rt->dst.input = rt->dst.input;
+	pcpu_rt->dst.output = rt->dst.output;
+	pcpu_rt->dst.error = rt->dst.error;
+	pcpu_rt->dst.lastuse = jiffies;
+	/* share the metrics of the tree entry, see rt6_dst_from_metrics_check */
+	dst_init_metrics(&pcpu_rt->dst, dst_metrics_ptr(&rt->dst), true);
+	pcpu_rt->rt6i_idev = rt->rt6i_idev;
+	if (pcpu_rt->rt6i_idev)
+		in6_dev_hold(pcpu_rt->rt6i_idev);
+
+	pcpu_rt->rt6i_dst = rt->rt6i_dst;
+#ifdef CONFIG_IPV6_SUBTREES
+	pcpu_rt->rt6i_src = rt->rt6i_src;
+#endif
+	pcpu_rt->rt6i_prefsrc = rt->rt6i_prefsrc;
+	pcpu_rt->rt6i_gateway = rt->rt6i_gateway;
+	pcpu_rt->rt6i_flags = rt->rt6i_flags | RTF_PCPU;
+	rt6_set_from(pcpu_rt, rt);
+	pcpu_rt->rt6i_metric = rt->rt6i_metric;
+	pcpu_rt->rt6i_protocol = rt->rt6i_protocol;
+	pcpu_rt->rt6i_table = rt->rt6i_table;
+
+	return pcpu_rt;
+}
+
+static void rt6_dst_from_metrics_check(struct rt6_info *rt)
+{
+	if (rt->rt6i_flags & RTF_PCPU &&
+	    dst_metrics_ptr(&rt->dst) != dst_metrics_ptr(rt->dst.from))
+		dst_init_metrics(&rt->dst, dst_metrics_ptr(rt->dst.from), true);
+}
+
+/* It should be called with read_lock_bh(&tb6_lock) acquired */
+static struct rt6_info *rt6_get_pcpu_route(struct rt6_info *rt)
+{
+	struct rt6_info *pcpu_rt;
+
+	pcpu_rt = *this_cpu_ptr(rt->rt6i_pcpu);
+	if (pcpu_rt) {
+		dst_hold(&pcpu_rt->dst);
+		rt6_dst_from_metrics_check(pcpu_rt);
+	}
+	return pcpu_rt;
+}
+
+static struct rt6_info *rt6_make_pcpu_route(struct rt6_info *rt)
+{
+	struct fib6_table *table = rt->rt6i_table;
+	struct rt6_info *pcpu_rt, *prev, **p;
+
+	pcpu_rt = ip6_rt_pcpu_alloc(rt);
+	if (!pcpu_rt) {
+		struct net *net = dev_net(rt->dst.dev);
+
+		dst_hold(&net->ipv6.ip6_null_entry->dst);
+		return net->ipv6.ip6_null_entry;
+	}
+
+	read_lock_bh(&table->tb6_lock);
+	if (rt->rt6i_pcpu) {
+		p = this_cpu_ptr(rt->rt6i_pcpu);
+		prev = cmpxchg(p, NULL, pcpu_rt);
+		if (prev) {
+			/* If someone did it before us, return prev instead */
+			dst_destroy(&pcpu_rt->dst);
+			pcpu_rt = prev;
+		}
+	} else {
+		/* rt was removed from the tree before we took the lock: it
+		 * is going away anyway, so hand it out itself and let the
+		 * next dst_check() trigger a new lookup.
+		 */
+		dst_destroy(&pcpu_rt->dst);
+		pcpu_rt = rt;
+	}
+	dst_hold(&pcpu_rt->dst);
+	rt6_dst_from_metrics_check(pcpu_rt);
+	read_unlock_bh(&table->tb6_lock);
+	return pcpu_rt;
+}
+
 static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
 				      struct flowi6 *fl6, int flags)
 {
 	struct fib6_node *fn;
-	struct rt6_info *rt, *nrt;
+	struct rt6_info *rt, *nrt, *pcpu_rt;
 	int strict = 0;
 	int attempts = 3;
 	int err;
@@ -933,22 +1054,42 @@ restart_2:
 restart:
 	rt = rt6_select(fn, oif, strict | reachable);
 	if (rt->rt6i_nsiblings)
-		rt = rt6_multipath_select(rt, fl6, oif, strict | reachable);
+		rt = rt6_multipath_select(net, rt, fl6, oif,
+					  strict | reachable);
 	BACKTRACK(net, &fl6->saddr);
 	if (rt == net->ipv6.ip6_null_entry ||
 	    rt->rt6i_flags & RTF_CACHE)
 		goto out;
 
+	if (likely(!(fl6->flowi6_flags & FLOWI_FLAG_KNOWN_NH) ||
+		   rt->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY))) {
+		/* The route is shared by all destinations it covers: hand
+		 * out this CPU's copy of it, which keeps the refcount and
+		 * use accounting of the tree entry untouched.
+		 */
+		pcpu_rt = rt6_get_pcpu_route(rt);
+		if (pcpu_rt) {
+			read_unlock_bh(&table->tb6_lock);
+		} else {
+			/* rt6_make_pcpu_route() may trigger ip6_dst_gc(),
+			 * which takes the table lock for writing.
+			 */
+			dst_hold(&rt->dst);
+			read_unlock_bh(&table->tb6_lock);
+			pcpu_rt = rt6_make_pcpu_route(rt);
+			ip6_rt_put(rt);
+		}
+		rt = pcpu_rt;
+		goto out2;
+	}
+
+	/* The caller knows the nexthop is the flow destination rather than
+	 * the one of its packets: that needs a clone for the destination.
+	 */
 	dst_hold(&rt->dst);
 	read_unlock_bh(&table->tb6_lock);
 
-	if (!(rt->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY)))
-		nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
-	else if (!(rt->dst.flags & DST_HOST))
-		nrt = rt6_alloc_clone(rt, &fl6->daddr);
-	else
-		goto out2;
-
+	nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
 	ip6_rt_put(rt);
 	rt = nrt ? : net->ipv6.ip6_null_entry;
 
@@ -1013,6 +1154,17 @@ void ip6_route_input(struct sk_buff *skb)
 		.flowi6_proto = iph->nexthdr,
 	};
 
+	/* The ports only matter to multipath routes hashing by L4. */
+	if (net->ipv6.sysctl.multipath_hash_policy) {
+		struct flow_keys keys;
+
+		if (skb_flow_dissect(skb, &keys) && keys.ports) {
+			fl6.flowi6_proto = keys.ip_proto;
+			fl6.fl6_sport = keys.port16[0];
+			fl6.fl6_dport = keys.port16[1];
+		}
+	}
+
 	skb_dst_set(skb, ip6_route_input_lookup(net, skb->dev, &fl6, flags));
 }
 
@@ -1066,7 +1218,7 @@ struct dst_entry *ip6_blackhole_route(struct net *net, struct dst_entry *dst_ori
 			in6_dev_hold(rt->rt6i_idev);
 
 		rt->rt6i_gateway = ort->rt6i_gateway;
-		rt->rt6i_flags = ort->rt6i_flags;
+		rt->rt6i_flags = ort->rt6i_flags & ~RTF_PCPU;
 		rt->rt6i_metric = 0;
 
 		memcpy(&rt->rt6i_dst, &ort->rt6i_dst, sizeof(struct rt6key));
@@ -1085,6 +1237,17 @@ struct dst_entry *ip6_blackhole_route(struct net *net, struct dst_entry *dst_ori
  *	Destination cache support functions
  */
 
+static struct dst_entry *rt6_check(struct rt6_info *rt, u32 cookie)
+{
+	if (!rt->rt6i_node || (rt->rt6i_node->fn_sernum != cookie))
+		return NULL;
+
+	if (rt6_check_expired(rt))
+		return NULL;
+
+	return &rt->dst;
+}
+
 static struct dst_entry *ip6_dst_check(struct dst_entry *dst, u32 cookie)
 {
 	struct rt6_info *rt;
@@ -1095,13 +1258,19 @@ static struct dst_entry *ip6_dst_check(struct dst_entry *dst, u32 cookie)
 	 * DST_OBSOLETE_FORCE_CHK which forces validation calls down
 	 * into this function always.
 	 */
-	if (!rt->rt6i_node || (rt->rt6i_node->fn_sernum != cookie))
-		return NULL;
+	if (rt->rt6i_flags & RTF_PCPU) {
+		/* A per-CPU copy is valid for as long as its tree entry,
+		 * unless it was freed along with the entry.
+		 */
+		if (dst->obsolete != DST_OBSOLETE_FORCE_CHK ||
+		    !rt6_check((struct rt6_info *)dst->from, cookie))
+			return NULL;
 
-	if (rt6_check_expired(rt))
-		return NULL;
+		rt6_dst_from_metrics_check(rt);
+		return dst;
+	}
 
-	return dst;
+	return rt6_check(rt, cookie);
 }
 
 static struct dst_entry *ip6_negative_advice(struct dst_entry *dst)
@@ -1134,33 +1303,82 @@ static void ip6_link_failure(struct sk_buff *skb)
 			dst_hold(&rt->dst);
 			if (ip6_del_rt(rt))
 				dst_free(&rt->dst);
-		} else if (rt->rt6i_node && (rt->rt6i_flags & RTF_DEFAULT)) {
-			rt->rt6i_node->fn_sernum = -1;
+		} else {
+			if (rt->rt6i_flags & RTF_PCPU)
+				rt = (struct rt6_info *)rt->dst.from;
+			if (rt->rt6i_node && (rt->rt6i_flags & RTF_DEFAULT))
+				rt->rt6i_node->fn_sernum = -1;
 		}
 	}
 }
 
-static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
-			       struct sk_buff *skb, u32 mtu)
+static void rt6_do_update_pmtu(struct rt6_info *rt6, u32 mtu)
+{
+	struct dst_entry *dst = &rt6->dst;
+	struct net *net = dev_net(dst->dev);
+
+	rt6->rt6i_flags |= RTF_MODIFIED;
+	if (mtu < IPV6_MIN_MTU) {
+		u32 features = dst_metric(dst, RTAX_FEATURES);
+		mtu = IPV6_MIN_MTU;
+		features |= RTAX_FEATURE_ALLFRAG;
+		dst_metric_set(dst, RTAX_FEATURES, features);
+	}
+	dst_metric_set(dst, RTAX_MTU, mtu);
+	rt6_update_expires(rt6, net->ipv6.sysctl.ip6_rt_mtu_expires);
+}
+
+static void __ip6_rt_update_pmtu(struct dst_entry *dst, const struct sock *sk,
+				 const struct ipv6hdr *iph, u32 mtu)
 {
 	struct rt6_info *rt6 = (struct rt6_info *)dst;
+	const struct in6_addr *daddr, *saddr;
+	struct rt6_info *nrt6;
 
 	dst_confirm(dst);
-	if (mtu < dst_mtu(dst) && rt6->rt6i_dst.plen == 128) {
-		struct net *net = dev_net(dst->dev);
-
-		rt6->rt6i_flags |= RTF_MODIFIED;
-		if (mtu < IPV6_MIN_MTU) {
-			u32 features = dst_metric(dst, RTAX_FEATURES);
-			mtu = IPV6_MIN_MTU;
-			features |= RTAX_FEATURE_ALLFRAG;
-			dst_metric_set(dst, RTAX_FEATURES, features);
-		}
-		dst_metric_set(dst, RTAX_MTU, mtu);
-		rt6_update_expires(rt6, net->ipv6.sysctl.ip6_rt_mtu_expires);
+	if (mtu >= dst_mtu(dst))
+		return;
+
+	if (rt6->rt6i_flags & RTF_CACHE ||
+	    (rt6->rt6i_dst.plen == 128 && !(rt6->rt6i_flags & RTF_PCPU))) {
+		rt6_do_update_pmtu(rt6, mtu);
+		return;
+	}
+
+	/* The path MTU is that of one destination, while a per-CPU copy
+	 * shares its metrics with the whole route: give the destination a
+	 * clone of the route of its own.
+	 */
+	if (iph) {
+		daddr = &iph->daddr;
+		saddr = &iph->saddr;
+	} else if (sk) {
+		daddr = &sk->sk_v6_daddr;
+		saddr = &inet6_sk(sk)->saddr;
+	} else {
+		return;
+	}
+
+	if (rt6->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY))
+		nrt6 = rt6_alloc_clone(rt6, daddr);
+	else
+		nrt6 = rt6_alloc_cow(rt6, daddr, saddr);
+	if (nrt6) {
+		rt6_do_update_pmtu(nrt6, mtu);
+
+		/* Inserting the clone bumps the serial number of the node,
+		 * which makes sockets caching the route look it up again.
+		 */
+		ip6_ins_rt(nrt6);
 	}
 }
 
+static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
+			       struct sk_buff *skb, u32 mtu)
+{
+	__ip6_rt_update_pmtu(dst, sk, skb ? ipv6_hdr(skb) : NULL, mtu);
+}
+
 void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 		     int oif, u32 mark)
 {
@@ -1177,7 +1395,7 @@ void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 
 	dst = ip6_route_output(net, NULL, &fl6);
 	if (!dst->error)
-		ip6_rt_update_pmtu(dst, NULL, skb, ntohl(mtu));
+		__ip6_rt_update_pmtu(dst, NULL, iph, ntohl(mtu));
 	dst_release(dst);
 }
 EXPORT_SYMBOL_GPL(ip6_update_pmtu);
@@ -1362,7 +1580,7 @@ struct dst_entry *icmp6_dst_alloc(struct net_device *dev,
 	if (unlikely(!idev))
 		return ERR_PTR(-ENODEV);
 
-	rt = ip6_dst_alloc(net, dev, 0, NULL);
+	rt = __ip6_dst_alloc(net, dev, 0, NULL);
 	if (unlikely(!rt)) {
 		in6_dev_put(idev);
 		dst = ERR_PTR(-ENOMEM);
@@ -1474,6 +1692,9 @@ int ip6_route_add(struct fib6_config *cfg)
 
 	if (cfg->fc_dst_len > 128 || cfg->fc_src_len > 128)
 		return -EINVAL;
+	/* RTF_PCPU is an internal flag; can not be set by userspace */
+	if (cfg->fc_flags & RTF_PCPU)
+		return -EINVAL;
 #ifndef CONFIG_IPV6_SUBTREES
 	if (cfg->fc_src_len)
 		return -EINVAL;
@@ -1870,9 +2091,13 @@ static struct rt6_info *ip6_rt_copy(struct rt6_info *ort,
 				    const struct in6_addr *dest)
 {
 	struct net *net = dev_net(ort->dst.dev);
-	struct rt6_info *rt = ip6_dst_alloc(net, ort->dst.dev, 0,
-					    ort->rt6i_table);
+	struct rt6_info *rt;
+
+	/* clone the tree entry, not the per-CPU copy of it */
+	if (ort->rt6i_flags & RTF_PCPU)
+		ort = (struct rt6_info *)ort->dst.from;
 
+	rt = __ip6_dst_alloc(net, ort->dst.dev, 0, ort->rt6i_table);
 	if (rt) {
 		rt->dst.input = ort->dst.input;
 		rt->dst.output = ort->dst.output;
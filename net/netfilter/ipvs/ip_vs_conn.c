@@ -31,7 +31,6 @@
 #include <linux/net.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
-#include <linux/vmalloc.h>
 #include <linux/proc_fs.h>		/* for proc_net_* */
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -47,20 +46,19 @@
 #endif
 
 /*
- * Connection hash size. Default is what was selected at compile time.
+ * Initial connection hash size. Default is what was selected at compile
+ * time. The per netns tables grow and shrink with the number of
+ * connections, between IP_VS_CONN_TAB_MIN_BITS and IP_VS_CONN_TAB_MAX_BITS.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' initial hash size");
 
-/* size and mask values */
-int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
+#define IP_VS_CONN_TAB_MIN_BITS	8
+#define IP_VS_CONN_TAB_MAX_BITS	24
 
-/*
- *  Connection hash table: for input and output packets lookups of IPVS
- */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+/* initial size value */
+int ip_vs_conn_tab_size __read_mostly;
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -71,13 +69,6 @@ static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 /* random value for IPVS connection hash */
 static unsigned int ip_vs_conn_rnd __read_mostly;
 
-/*
- *  Fine locking granularity for big connection hash table
- */
-#define CT_LOCKARRAY_BITS  5
-#define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
-#define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
-
 /* We need an addrstrlen that works with or without v6 */
 #ifdef CONFIG_IP_VS_IPV6
 #define IP_VS_ADDRSTRLEN INET6_ADDRSTRLEN
@@ -85,53 +76,29 @@ static unsigned int ip_vs_conn_rnd __read_mostly;
 #define IP_VS_ADDRSTRLEN (8+1)
 #endif
 
-struct ip_vs_aligned_lock
-{
-	spinlock_t	l;
-} __attribute__((__aligned__(SMP_CACHE_BYTES)));
-
-/* lock array for conn table */
-static struct ip_vs_aligned_lock
-__ip_vs_conntbl_lock_array[CT_LOCKARRAY_SIZE] __cacheline_aligned;
-
-static inline void ct_write_lock_bh(unsigned int key)
-{
-	spin_lock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
-static inline void ct_write_unlock_bh(unsigned int key)
-{
-	spin_unlock_bh(&__ip_vs_conntbl_lock_array[key&CT_LOCKARRAY_MASK].l);
-}
-
-
 /*
  *	Returns hash value for IPVS connection entry
  */
-static unsigned int ip_vs_conn_hashkey(struct net *net, int af, unsigned int proto,
-				       const union nf_inet_addr *addr,
-				       __be16 port)
+static u32 ip_vs_conn_hashkey(int af, unsigned int proto,
+			      const union nf_inet_addr *addr, __be16 port)
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
-				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)net>>8)) & ip_vs_conn_tab_mask;
+		return jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
+				    (__force u32)port, proto, ip_vs_conn_rnd);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
-			    ip_vs_conn_rnd) ^
-		((size_t)net>>8)) & ip_vs_conn_tab_mask;
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+			    ip_vs_conn_rnd);
 }
 
-static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
-					     bool inverse)
+static u32 ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
+				    bool inverse)
 {
 	const union nf_inet_addr *addr;
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -141,10 +108,10 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 		port = p->vport;
 	}
 
-	return ip_vs_conn_hashkey(p->net, p->af, p->protocol, addr, port);
+	return ip_vs_conn_hashkey(p->af, p->protocol, addr, port);
 }
 
-static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
+static u32 ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
 {
 	struct ip_vs_conn_param p;
 
@@ -161,27 +128,46 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
 }
 
 /*
- *	Hashes ip_vs_conn in ip_vs_conn_tab by netns,proto,addr,port.
+ * The connection table is keyed by the precomputed hashkey, which already
+ * mixes in ip_vs_conn_rnd, so the table itself does not hash it again.
+ */
+static u32 ip_vs_conn_rht_hashfn(const void *data, u32 len, u32 seed)
+{
+	return *(const u32 *)data;
+}
+
+static inline struct rhashtable *ip_vs_conn_tab(struct net *net)
+{
+	return &net_ipvs(net)->conn_tab;
+}
+
+/* Index of the bucket @cp belongs to in @tbl */
+static inline unsigned int ip_vs_conn_bucket(const struct bucket_table *tbl,
+					     const struct ip_vs_conn *cp)
+{
+	return cp->hashkey & (tbl->size - 1);
+}
+
+/*
+ *	Hashes ip_vs_conn in the netns conn_tab by proto,addr,port.
  *	returns bool success.
  */
 static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	if (cp->flags & IP_VS_CONN_F_ONE_PACKET)
 		return 0;
 
-	/* Hash by protocol, client address and port */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
+		/* Hash by protocol, client address and port */
+		cp->hashkey = ip_vs_conn_hashkey_conn(cp);
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		atomic_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
+		rhashtable_insert(ip_vs_conn_tab(ip_vs_conn_net(cp)),
+				  &cp->c_node);
 		ret = 1;
 	} else {
 		pr_err("%s(): request for already hashed, called from %pF\n",
@@ -189,75 +175,118 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 		ret = 0;
 	}
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
 
 /*
- *	UNhashes ip_vs_conn from ip_vs_conn_tab.
+ *	UNhashes ip_vs_conn from the netns conn_tab.
  *	returns bool success. Caller should hold conn reference.
  */
 static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	int ret;
 
 	/* unhash it and decrease its reference counter */
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		hlist_del_rcu(&cp->c_list);
+		rhashtable_remove(ip_vs_conn_tab(ip_vs_conn_net(cp)),
+				  &cp->c_node);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
 	} else
 		ret = 0;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
-/* Try to unlink ip_vs_conn from ip_vs_conn_tab.
+/* Try to unlink ip_vs_conn from the netns conn_tab.
  * returns bool success.
  */
 static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 {
-	unsigned int hash;
 	bool ret;
 
-	hash = ip_vs_conn_hashkey_conn(cp);
-
-	ct_write_lock_bh(hash);
-	spin_lock(&cp->lock);
+	spin_lock_bh(&cp->lock);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
 		ret = false;
 		/* Decrease refcnt and unlink conn only if we are last user */
 		if (atomic_cmpxchg(&cp->refcnt, 1, 0) == 1) {
-			hlist_del_rcu(&cp->c_list);
+			rhashtable_remove(ip_vs_conn_tab(ip_vs_conn_net(cp)),
+					  &cp->c_node);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
 			ret = true;
 		}
 	} else
 		ret = atomic_read(&cp->refcnt) ? false : true;
 
-	spin_unlock(&cp->lock);
-	ct_write_unlock_bh(hash);
+	spin_unlock_bh(&cp->lock);
 
 	return ret;
 }
 
 
 /*
- *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
+ * Lookup compare functions, called under RCU for each entry of the bucket.
+ * An entry only matches once a reference to it could be taken.
+ */
+static bool ip_vs_conn_in_cmp(void *obj, void *arg)
+{
+	const struct ip_vs_conn_param *p = arg;
+	struct ip_vs_conn *cp = obj;
+
+	return p->cport == cp->cport && p->vport == cp->vport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
+	       ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+	       p->protocol == cp->protocol &&
+	       __ip_vs_conn_get(cp);
+}
+
+static bool ip_vs_ct_in_cmp(void *obj, void *arg)
+{
+	const struct ip_vs_conn_param *p = arg;
+	struct ip_vs_conn *cp = obj;
+
+	if (unlikely(p->pe_data && p->pe->ct_match))
+		return p->pe == cp->pe && p->pe->ct_match(p, cp) &&
+		       __ip_vs_conn_get(cp);
+
+	return cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+	       /* protocol should only be IPPROTO_IP if
+		* p->vaddr is a fwmark */
+	       ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
+				p->af, p->vaddr, &cp->vaddr) &&
+	       p->vport == cp->vport && p->cport == cp->cport &&
+	       cp->flags & IP_VS_CONN_F_TEMPLATE &&
+	       p->protocol == cp->protocol &&
+	       __ip_vs_conn_get(cp);
+}
+
+static bool ip_vs_conn_out_cmp(void *obj, void *arg)
+{
+	const struct ip_vs_conn_param *p = arg;
+	struct ip_vs_conn *cp = obj;
+
+	return p->vport == cp->cport && p->cport == cp->dport &&
+	       cp->af == p->af &&
+	       ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
+	       ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
+	       p->protocol == cp->protocol &&
+	       __ip_vs_conn_get(cp);
+}
+
+/*
+ *  Gets ip_vs_conn associated with supplied parameters in the conn_tab.
  *  Called for pkts coming from OUTside-to-INside.
  *	p->caddr, p->cport: pkt source address (foreign host)
  *	p->vaddr, p->vport: pkt dest address (load balancer)
@@ -265,32 +294,10 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 static inline struct ip_vs_conn *
 __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
-	struct ip_vs_conn *cp;
-
-	hash = ip_vs_conn_hashkey_param(p, false);
-
-	rcu_read_lock();
+	u32 hash = ip_vs_conn_hashkey_param(p, false);
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    ip_vs_conn_net_eq(cp, p->net)) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			rcu_read_unlock();
-			return cp;
-		}
-	}
-
-	rcu_read_unlock();
-
-	return NULL;
+	return rhashtable_lookup_compare(ip_vs_conn_tab(p->net), &hash,
+					 ip_vs_conn_in_cmp, (void *)p);
 }
 
 struct ip_vs_conn *ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
@@ -350,42 +357,11 @@ EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
+	u32 hash = ip_vs_conn_hashkey_param(p, false);
 	struct ip_vs_conn *cp;
 
-	hash = ip_vs_conn_hashkey_param(p, false);
-
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (!ip_vs_conn_net_eq(cp, p->net))
-				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
-				if (__ip_vs_conn_get(cp))
-					goto out;
-			}
-			continue;
-		}
-
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    ip_vs_conn_net_eq(cp, p->net)) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
-		}
-	}
-	cp = NULL;
-
-  out:
-	rcu_read_unlock();
+	cp = rhashtable_lookup_compare(ip_vs_conn_tab(p->net), &hash,
+				       ip_vs_ct_in_cmp, (void *)p);
 
 	IP_VS_DBG_BUF(9, "template lookup/in %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -396,38 +372,22 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 	return cp;
 }
 
-/* Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
+/* Gets ip_vs_conn associated with supplied parameters in the conn_tab.
  * Called for pkts coming from inside-to-OUTside.
  *	p->caddr, p->cport: pkt source address (inside host)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
-	struct ip_vs_conn *cp, *ret=NULL;
+	u32 hash;
+	struct ip_vs_conn *ret;
 
 	/*
 	 *	Check for "full" addressed entries
 	 */
 	hash = ip_vs_conn_hashkey_param(p, true);
 
-	rcu_read_lock();
-
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    ip_vs_conn_net_eq(cp, p->net)) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
-		}
-	}
-
-	rcu_read_unlock();
+	ret = rhashtable_lookup_compare(ip_vs_conn_tab(p->net), &hash,
+					ip_vs_conn_out_cmp, (void *)p);
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
 		      ip_vs_proto_name(p->protocol),
@@ -867,7 +827,7 @@ void ip_vs_conn_expire_now(struct ip_vs_conn *cp)
 
 
 /*
- *	Create a new connection entry and hash it into the ip_vs_conn_tab
+ *	Create a new connection entry and hash it into the conn_tab
  */
 struct ip_vs_conn *
 ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
@@ -885,7 +845,6 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		return NULL;
 	}
 
-	INIT_HLIST_NODE(&cp->c_list);
 	setup_timer(&cp->timer, ip_vs_conn_expire, (unsigned long)cp);
 	ip_vs_conn_net_set(cp, p->net);
 	cp->af		   = p->af;
@@ -966,7 +925,7 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 	if (ip_vs_conntrack_enabled(ipvs))
 		cp->flags |= IP_VS_CONN_F_NFCT;
 
-	/* Hash it in the ip_vs_conn_tab finally */
+	/* Hash it in the conn_tab finally */
 	ip_vs_conn_hash(cp);
 
 	return cp;
@@ -978,26 +937,71 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 #ifdef CONFIG_PROC_FS
 struct ip_vs_iter_state {
 	struct seq_net_private	p;
-	struct hlist_head	*l;
+	unsigned int		bucket;
 };
 
-static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
+/*
+ * Returns the first entry from @pos on that belongs to @bucket of @tbl.
+ * While the table is being resized its chains may lead into entries of
+ * other buckets, those are skipped. Entries may still be missed or shown
+ * twice when the table is resized between two reads.
+ */
+static struct ip_vs_conn *
+ip_vs_conn_chain_next(const struct bucket_table *tbl, unsigned int bucket,
+		      struct rhash_head *pos)
 {
-	int idx;
 	struct ip_vs_conn *cp;
+
+	for (; pos; pos = rcu_dereference(pos->next)) {
+		cp = container_of(pos, struct ip_vs_conn, c_node);
+		if (ip_vs_conn_bucket(tbl, cp) == bucket)
+			return cp;
+	}
+
+	return NULL;
+}
+
+static struct ip_vs_conn *
+ip_vs_conn_bucket_first(struct rhashtable *ht, unsigned int *bucket)
+{
+	const struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+	struct ip_vs_conn *cp;
+
+	for (; *bucket < tbl->size; ++*bucket) {
+		cp = ip_vs_conn_chain_next(tbl, *bucket,
+				rcu_dereference(tbl->buckets[*bucket]));
+		if (cp)
+			return cp;
+		cond_resched_rcu();
+		tbl = rht_dereference_rcu(ht->tbl, ht);
+	}
+
+	return NULL;
+}
+
+static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
+{
+	struct rhashtable *ht = ip_vs_conn_tab(seq_file_net(seq));
 	struct ip_vs_iter_state *iter = seq->private;
+	const struct bucket_table *tbl;
+	struct ip_vs_conn *cp;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			/* __ip_vs_conn_get() is not needed by
-			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
-			 */
-			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
-				return cp;
-			}
+	iter->bucket = 0;
+	cp = ip_vs_conn_bucket_first(ht, &iter->bucket);
+	while (cp) {
+		/* __ip_vs_conn_get() is not needed by
+		 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
+		 */
+		if (pos-- == 0)
+			return cp;
+
+		tbl = rht_dereference_rcu(ht->tbl, ht);
+		cp = ip_vs_conn_chain_next(tbl, iter->bucket,
+					   rcu_dereference(cp->c_node.next));
+		if (!cp) {
+			iter->bucket++;
+			cp = ip_vs_conn_bucket_first(ht, &iter->bucket);
 		}
-		cond_resched_rcu();
 	}
 
 	return NULL;
@@ -1006,40 +1010,30 @@ static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 	__acquires(RCU)
 {
-	struct ip_vs_iter_state *iter = seq->private;
-
-	iter->l = NULL;
 	rcu_read_lock();
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
 
 static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
-	struct ip_vs_conn *cp = v;
+	struct rhashtable *ht = ip_vs_conn_tab(seq_file_net(seq));
 	struct ip_vs_iter_state *iter = seq->private;
-	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
+	const struct bucket_table *tbl;
+	struct ip_vs_conn *cp = v;
 
 	++*pos;
 	if (v == SEQ_START_TOKEN)
 		return ip_vs_conn_array(seq, 0);
 
 	/* more on same hash chain? */
-	e = rcu_dereference(hlist_next_rcu(&cp->c_list));
-	if (e)
-		return hlist_entry(e, struct ip_vs_conn, c_list);
-
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
-			return cp;
-		}
-		cond_resched_rcu();
-	}
-	iter->l = NULL;
-	return NULL;
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	cp = ip_vs_conn_chain_next(tbl, iter->bucket,
+				   rcu_dereference(cp->c_node.next));
+	if (cp)
+		return cp;
+
+	iter->bucket++;
+	return ip_vs_conn_bucket_first(ht, &iter->bucket);
 }
 
 static void ip_vs_conn_seq_stop(struct seq_file *seq, void *v)
@@ -1056,13 +1050,10 @@ static int ip_vs_conn_seq_show(struct seq_file *seq, void *v)
    "Pro FromIP   FPrt ToIP     TPrt DestIP   DPrt State       Expires PEName PEData\n");
 	else {
 		const struct ip_vs_conn *cp = v;
-		struct net *net = seq_file_net(seq);
 		char pe_data[IP_VS_PENAME_MAXLEN + IP_VS_PEDATA_MAXLEN + 3];
 		size_t len = 0;
 		char dbuf[IP_VS_ADDRSTRLEN];
 
-		if (!ip_vs_conn_net_eq(cp, net))
-			return 0;
 		if (cp->pe_data) {
 			pe_data[0] = ' ';
 			len = strlen(cp->pe->name);
@@ -1144,10 +1135,6 @@ static int ip_vs_conn_sync_seq_show(struct seq_file *seq, void *v)
    "Pro FromIP   FPrt ToIP     TPrt DestIP   DPrt State       Origin Expires\n");
 	else {
 		const struct ip_vs_conn *cp = v;
-		struct net *net = seq_file_net(seq);
-
-		if (!ip_vs_conn_net_eq(cp, net))
-			return 0;
 
 #ifdef CONFIG_IP_VS_IPV6
 		if (cp->daf == AF_INET6)
@@ -1242,22 +1229,24 @@ static inline int todrop_entry(struct ip_vs_conn *cp)
 /* Called from keventd and must protect itself from softirqs */
 void ip_vs_random_dropentry(struct net *net)
 {
-	int idx;
+	struct rhashtable *ht = ip_vs_conn_tab(net);
+	const struct bucket_table *tbl;
 	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *pos;
+	int idx;
 
 	rcu_read_lock();
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (idx = 0; idx < (tbl->size >> 5); idx++) {
+		unsigned int hash = prandom_u32() & (tbl->size - 1);
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		rht_for_each_entry_rcu(cp, pos, tbl, hash, c_node) {
 			if (cp->flags & IP_VS_CONN_F_TEMPLATE)
 				/* connection template */
 				continue;
-			if (!ip_vs_conn_net_eq(cp, net))
-				continue;
 			if (cp->protocol == IPPROTO_TCP) {
 				switch(cp->state) {
 				case IP_VS_TCP_S_SYN_RECV:
@@ -1300,27 +1289,32 @@ void ip_vs_random_dropentry(struct net *net)
 			}
 		}
 		cond_resched_rcu();
+		tbl = rht_dereference_rcu(ht->tbl, ht);
 	}
 	rcu_read_unlock();
 }
 
 
 /*
- *      Flush all the connection entries in the ip_vs_conn_tab
+ *      Flush all the connection entries in the conn_tab
  */
 static void ip_vs_conn_flush(struct net *net)
 {
-	int idx;
-	struct ip_vs_conn *cp, *cp_c;
 	struct netns_ipvs *ipvs = net_ipvs(net);
+	struct rhashtable *ht = &ipvs->conn_tab;
+	const struct bucket_table *tbl;
+	struct ip_vs_conn *cp, *cp_c;
+	struct rhash_head *pos;
+	unsigned int idx;
 
 flush_again:
+	/* keep the table from being resized under the walk */
+	mutex_lock(&ht->mutex);
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	tbl = rht_dereference(ht->tbl, ht);
+	for (idx = 0; idx < tbl->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			if (!ip_vs_conn_net_eq(cp, net))
-				continue;
+		rht_for_each_entry_rcu(cp, pos, tbl, idx, c_node) {
 			IP_VS_DBG(4, "del connection\n");
 			ip_vs_conn_expire_now(cp);
 			cp_c = cp->control;
@@ -1334,6 +1328,7 @@ flush_again:
 		cond_resched_rcu();
 	}
 	rcu_read_unlock();
+	mutex_unlock(&ht->mutex);
 
 	/* the counter may be not NULL, because maybe some conn entries
 	   are run by slow timer handler or unhashed but still referred */
@@ -1348,9 +1343,25 @@ flush_again:
 int __net_init ip_vs_conn_net_init(struct net *net)
 {
 	struct netns_ipvs *ipvs = net_ipvs(net);
+	struct rhashtable_params params = {
+		.nelem_hint	= ip_vs_conn_tab_size / 4 * 3,
+		.key_len	= sizeof(u32),
+		.key_offset	= offsetof(struct ip_vs_conn, hashkey),
+		.head_offset	= offsetof(struct ip_vs_conn, c_node),
+		.hashfn		= ip_vs_conn_rht_hashfn,
+		.max_shift	= IP_VS_CONN_TAB_MAX_BITS,
+		.min_shift	= IP_VS_CONN_TAB_MIN_BITS,
+		.grow_decision	= rht_grow_above_75,
+		.shrink_decision = rht_shrink_below_30,
+	};
+	int err;
 
 	atomic_set(&ipvs->conn_count, 0);
 
+	err = rhashtable_init(&ipvs->conn_tab, &params);
+	if (err)
+		return err;
+
 	proc_create("ip_vs_conn", 0, net->proc_net, &ip_vs_conn_fops);
 	proc_create("ip_vs_conn_sync", 0, net->proc_net, &ip_vs_conn_sync_fops);
 	return 0;
@@ -1362,46 +1373,31 @@ void __net_exit ip_vs_conn_net_cleanup(struct net *net)
 	ip_vs_conn_flush(net);
 	remove_proc_entry("ip_vs_conn", net->proc_net);
 	remove_proc_entry("ip_vs_conn_sync", net->proc_net);
+	rhashtable_destroy(&net_ipvs(net)->conn_tab);
 }
 
 int __init ip_vs_conn_init(void)
 {
-	int idx;
-
-	/* Compute size and mask */
+	/* Compute the initial size, the tables resize on their own */
+	ip_vs_conn_tab_bits = clamp(ip_vs_conn_tab_bits,
+				    IP_VS_CONN_TAB_MIN_BITS,
+				    IP_VS_CONN_TAB_MAX_BITS);
 	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
-
-	/*
-	 * Allocate the connection hash table and initialize its list heads
-	 */
-	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size * sizeof(*ip_vs_conn_tab));
-	if (!ip_vs_conn_tab)
-		return -ENOMEM;
 
 	/* Allocate ip_vs_conn slab cache */
 	ip_vs_conn_cachep = kmem_cache_create("ip_vs_conn",
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
-	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+	if (!ip_vs_conn_cachep)
 		return -ENOMEM;
-	}
 
 	pr_info("Connection hash table configured "
-		"(size=%d, memory=%ldKbytes)\n",
+		"(initial size=%d, memory=%ldKbytes)\n",
 		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+		(long)(ip_vs_conn_tab_size*sizeof(struct rhash_head *))/1024);
 	IP_VS_DBG(0, "Each connection entry needs %Zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
-
-	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
-		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
-	}
-
 	/* calculate the random value for connection hash */
 	get_random_bytes(&ip_vs_conn_rnd, sizeof(ip_vs_conn_rnd));
 
@@ -1414,5 +1410,4 @@ void ip_vs_conn_cleanup(void)
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
 }
@@ -0,0 +1,397 @@
+/*
+ * Flow table for the netfilter forwarding fast path
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Each offloaded conntrack entry is hashed once per direction, keyed by
+ * its addresses, ports and input device.  Packets that hit an entry are
+ * never seen by conntrack, so a garbage collector runs every
+ * NF_FLOW_GC_INTERVAL to keep the conntrack timers of busy flows from
+ * expiring, and to hand idle, torn down or killed flows back to the slow
+ * path.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+#include <net/netfilter/nf_flow_table.h>
+
+#define NF_FLOW_HSIZE		4096
+#define NF_FLOW_MAX		(4 * NF_FLOW_HSIZE)
+#define NF_FLOW_GC_INTERVAL	HZ
+
+struct nf_flow_table {
+	struct hlist_head	*hash;
+	unsigned int		hsize;
+	u32			seed;
+	atomic_t		count;
+	spinlock_t		lock;
+	struct delayed_work	gc_work;
+};
+
+static int nf_flow_table_net_id __read_mostly;
+
+static struct nf_flow_table *nf_flow_table_pernet(struct net *net)
+{
+	return net_generic(net, nf_flow_table_net_id);
+}
+
+static struct hlist_head *
+flow_offload_bucket(const struct nf_flow_table *table,
+		    const struct flow_offload_tuple *tuple)
+{
+	u32 hash = jhash(tuple, NF_FLOW_TUPLE_KEY_LEN, table->seed);
+
+	return &table->hash[hash & (table->hsize - 1)];
+}
+
+static void flow_offload_fill_dir(struct flow_offload *flow,
+				  struct nf_conn *ct,
+				  struct nf_flow_route *route,
+				  enum flow_offload_tuple_dir dir)
+{
+	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
+	struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
+
+	ft->src_v4 = ctt->src.u3.ip;
+	ft->dst_v4 = ctt->dst.u3.ip;
+	ft->src_port = ctt->src.u.tcp.port;
+	ft->dst_port = ctt->dst.u.tcp.port;
+	ft->iifidx = route->tuple[dir].ifindex;
+	ft->l3proto = ctt->src.l3num;
+	ft->l4proto = ctt->dst.protonum;
+	ft->dir = dir;
+	ft->oifidx = route->tuple[dir].dst->dev->ifindex;
+	ft->dst_cache = route->tuple[dir].dst;
+}
+
+/**
+ * flow_offload_alloc - set up a flow table entry for a conntrack entry
+ * @ct: the confirmed conntrack entry to offload
+ * @route: per direction, the input device and the route to transmit on
+ *
+ * Takes references on @ct and both routes.  Returns NULL if @ct is going
+ * away or no memory is left.
+ */
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route)
+{
+	struct flow_offload *flow;
+
+	if (unlikely(nf_ct_is_dying(ct) ||
+		     !atomic_inc_not_zero(&ct->ct_general.use)))
+		return NULL;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow) {
+		nf_ct_put(ct);
+		return NULL;
+	}
+
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_REPLY].dst);
+
+	flow->ct = ct;
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_REPLY);
+
+	if (ct->status & IPS_SRC_NAT)
+		flow->flags |= FLOW_OFFLOAD_SNAT;
+	if (ct->status & IPS_DST_NAT)
+		flow->flags |= FLOW_OFFLOAD_DNAT;
+
+	return flow;
+}
+EXPORT_SYMBOL_GPL(flow_offload_alloc);
+
+static void flow_offload_free_rcu(struct rcu_head *head)
+{
+	struct flow_offload *flow = container_of(head, struct flow_offload,
+						 rcu_head);
+
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_cache);
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_cache);
+	nf_ct_put(flow->ct);
+	kfree(flow);
+}
+
+void flow_offload_free(struct flow_offload *flow)
+{
+	call_rcu(&flow->rcu_head, flow_offload_free_rcu);
+}
+EXPORT_SYMBOL_GPL(flow_offload_free);
+
+/**
+ * flow_offload_add - start switching a flow in the fast path
+ * @net: the namespace the flow is forwarded in
+ * @flow: entry from flow_offload_alloc(), owned by the table on success
+ *
+ * Returns -ENOSPC once the table holds NF_FLOW_MAX flows.
+ */
+int flow_offload_add(struct net *net, struct flow_offload *flow)
+{
+	struct nf_flow_table *table = nf_flow_table_pernet(net);
+	int dir;
+
+	if (atomic_inc_return(&table->count) > NF_FLOW_MAX) {
+		atomic_dec(&table->count);
+		return -ENOSPC;
+	}
+
+	flow->timeout = jiffies + NF_FLOW_TIMEOUT;
+
+	spin_lock_bh(&table->lock);
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++)
+		hlist_add_head_rcu(&flow->tuplehash[dir].node,
+				   flow_offload_bucket(table,
+						       &flow->tuplehash[dir].tuple));
+	spin_unlock_bh(&table->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+/*
+ * The slow path has not tracked the TCP windows while the flow was
+ * offloaded, let it pick them up again from the next packets.
+ */
+static void flow_offload_fixup_tcp(struct nf_conn *ct)
+{
+	struct ip_ct_tcp *tcp = &ct->proto.tcp;
+
+	spin_lock(&ct->lock);
+	tcp->seen[0].td_maxwin = 0;
+	tcp->seen[1].td_maxwin = 0;
+	spin_unlock(&ct->lock);
+}
+
+/* Called with the table lock held */
+static void flow_offload_del(struct nf_flow_table *table,
+			     struct flow_offload *flow)
+{
+	struct nf_conn *ct = flow->ct;
+
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node);
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node);
+	atomic_dec(&table->count);
+
+	if (nf_ct_protonum(ct) == IPPROTO_TCP)
+		flow_offload_fixup_tcp(ct);
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+
+	flow_offload_free(flow);
+}
+
+/**
+ * flow_offload_teardown - send a flow back to the slow path
+ * @flow: the flow
+ *
+ * The flow stops matching right away and is removed by the next garbage
+ * collection run.
+ */
+void flow_offload_teardown(struct flow_offload *flow)
+{
+	flow->flags |= FLOW_OFFLOAD_TEARDOWN;
+}
+EXPORT_SYMBOL_GPL(flow_offload_teardown);
+
+/* Called under rcu_read_lock() */
+struct flow_offload_tuple_rhash *flow_offload_lookup(struct net *net,
+						     struct flow_offload_tuple *tuple)
+{
+	struct nf_flow_table *table = nf_flow_table_pernet(net);
+	struct flow_offload_tuple_rhash *tuplehash;
+
+	hlist_for_each_entry_rcu(tuplehash, flow_offload_bucket(table, tuple),
+				 node) {
+		struct flow_offload *flow;
+
+		if (memcmp(&tuplehash->tuple, tuple, NF_FLOW_TUPLE_KEY_LEN))
+			continue;
+
+		flow = flow_offload_from_tuplehash(tuplehash);
+		if (flow->flags & FLOW_OFFLOAD_TEARDOWN)
+			return NULL;
+
+		return tuplehash;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(flow_offload_lookup);
+
+/* Remove the flows @fn returns true for */
+static void nf_flow_table_iterate(struct nf_flow_table *table,
+				  bool (*fn)(struct flow_offload *flow,
+					     void *data),
+				  void *data)
+{
+	struct flow_offload_tuple_rhash *tuplehash;
+	struct hlist_node *n;
+	unsigned int i;
+
+	rcu_read_lock();
+	for (i = 0; i < table->hsize; i++) {
+		spin_lock_bh(&table->lock);
+		hlist_for_each_entry_safe(tuplehash, n, &table->hash[i], node) {
+			struct flow_offload *flow;
+
+			/* visit each flow once, through its original tuple */
+			if (tuplehash->tuple.dir != FLOW_OFFLOAD_DIR_ORIGINAL)
+				continue;
+
+			flow = flow_offload_from_tuplehash(tuplehash);
+			if (fn(flow, data))
+				flow_offload_del(table, flow);
+		}
+		spin_unlock_bh(&table->lock);
+	}
+	rcu_read_unlock();
+}
+
+/* Never shorten the timeout conntrack itself would have used */
+static void nf_flow_ct_refresh(struct nf_conn *ct)
+{
+	unsigned long expires = jiffies + NF_FLOW_TIMEOUT + NF_FLOW_GC_INTERVAL;
+
+	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
+		return;
+
+	if (time_after(expires, ct->timeout.expires + HZ))
+		mod_timer_pending(&ct->timeout, expires);
+}
+
+static bool nf_flow_offload_gc_flow(struct flow_offload *flow, void *data)
+{
+	struct nf_conn *ct = flow->ct;
+
+	if ((flow->flags & FLOW_OFFLOAD_TEARDOWN) || nf_ct_is_dying(ct) ||
+	    time_after(jiffies, flow->timeout))
+		return true;
+
+	nf_flow_ct_refresh(ct);
+	return false;
+}
+
+static void nf_flow_offload_gc(struct work_struct *work)
+{
+	struct nf_flow_table *table = container_of(work, struct nf_flow_table,
+						   gc_work.work);
+
+	nf_flow_table_iterate(table, nf_flow_offload_gc_flow, NULL);
+	queue_delayed_work(system_power_efficient_wq, &table->gc_work,
+			   NF_FLOW_GC_INTERVAL);
+}
+
+static bool nf_flow_table_match_dev(struct flow_offload *flow, void *data)
+{
+	struct net_device *dev = data;
+	int dir;
+
+	/* no device flushes the whole table */
+	if (!dev)
+		return true;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++) {
+		struct flow_offload_tuple *tuple = &flow->tuplehash[dir].tuple;
+
+		if (tuple->iifidx == dev->ifindex ||
+		    tuple->oifidx == dev->ifindex)
+			return true;
+	}
+
+	return false;
+}
+
+static int nf_flow_table_netdev_event(struct notifier_block *this,
+				      unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	/* the cached routes hold on to the device */
+	if (event == NETDEV_DOWN)
+		nf_flow_table_iterate(nf_flow_table_pernet(dev_net(dev)),
+				      nf_flow_table_match_dev, dev);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nf_flow_table_netdev_notifier = {
+	.notifier_call	= nf_flow_table_netdev_event,
+};
+
+static int __net_init nf_flow_table_net_init(struct net *net)
+{
+	struct nf_flow_table *table = nf_flow_table_pernet(net);
+
+	table->hsize = NF_FLOW_HSIZE;
+	table->hash = vzalloc(table->hsize * sizeof(struct hlist_head));
+	if (!table->hash)
+		return -ENOMEM;
+
+	get_random_bytes(&table->seed, sizeof(table->seed));
+	atomic_set(&table->count, 0);
+	spin_lock_init(&table->lock);
+	INIT_DEFERRABLE_WORK(&table->gc_work, nf_flow_offload_gc);
+	queue_delayed_work(system_power_efficient_wq, &table->gc_work,
+			   NF_FLOW_GC_INTERVAL);
+
+	return 0;
+}
+
+static void __net_exit nf_flow_table_net_exit(struct net *net)
+{
+	struct nf_flow_table *table = nf_flow_table_pernet(net);
+
+	cancel_delayed_work_sync(&table->gc_work);
+	nf_flow_table_iterate(table, nf_flow_table_match_dev, NULL);
+	WARN_ON(atomic_read(&table->count));
+	vfree(table->hash);
+}
+
+static struct pernet_operations nf_flow_table_net_ops = {
+	.init	= nf_flow_table_net_init,
+	.exit	= nf_flow_table_net_exit,
+	.id	= &nf_flow_table_net_id,
+	.size	= sizeof(struct nf_flow_table),
+};
+
+static int __init nf_flow_table_module_init(void)
+{
+	int err;
+
+	err = register_pernet_subsys(&nf_flow_table_net_ops);
+	if (err < 0)
+		return err;
+
+	err = register_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	if (err < 0)
+		unregister_pernet_subsys(&nf_flow_table_net_ops);
+
+	return err;
+}
+
+static void __exit nf_flow_table_module_exit(void)
+{
+	unregister_netdevice_notifier(&nf_flow_table_netdev_notifier);
+	unregister_pernet_subsys(&nf_flow_table_net_ops);
+	/* wait for flow_offload_free_rcu() */
+	rcu_barrier();
+}
+
+module_init(nf_flow_table_module_init);
+module_exit(nf_flow_table_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Netfilter flow table for the forwarding fast path");
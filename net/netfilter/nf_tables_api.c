@@ -2137,7 +2137,7 @@ nft_select_set_ops(const struct nlattr * const nla[],
 	features = 0;
 	if (nla[NFTA_SET_FLAGS] != NULL) {
 		features = ntohl(nla_get_be32(nla[NFTA_SET_FLAGS]));
-		features &= NFT_SET_INTERVAL | NFT_SET_MAP;
+		features &= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_CONCAT;
 	}
 
 	bops	   = NULL;
@@ -2198,6 +2198,11 @@ static const struct nla_policy nft_set_policy[NFTA_SET_MAX + 1] = {
 
 static const struct nla_policy nft_set_desc_policy[NFTA_SET_DESC_MAX + 1] = {
 	[NFTA_SET_DESC_SIZE]		= { .type = NLA_U32 },
+	[NFTA_SET_DESC_CONCAT]		= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy nft_set_field_policy[NFTA_SET_FIELD_MAX + 1] = {
+	[NFTA_SET_FIELD_LEN]		= { .type = NLA_U32 },
 };
 
 static int nft_ctx_init_from_setattr(struct nft_ctx *ctx,
@@ -2305,6 +2310,30 @@ cont:
 	return 0;
 }
 
+static int nf_tables_fill_set_concat(struct sk_buff *skb,
+				     const struct nft_set *set)
+{
+	struct nlattr *concat, *field;
+	int i;
+
+	concat = nla_nest_start(skb, NFTA_SET_DESC_CONCAT);
+	if (concat == NULL)
+		return -1;
+
+	for (i = 0; i < set->field_count; i++) {
+		field = nla_nest_start(skb, NFTA_LIST_ELEM);
+		if (field == NULL)
+			return -1;
+		if (nla_put_be32(skb, NFTA_SET_FIELD_LEN,
+				 htonl(set->field_len[i])))
+			return -1;
+		nla_nest_end(skb, field);
+	}
+
+	nla_nest_end(skb, concat);
+	return 0;
+}
+
 static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 			      const struct nft_set *set, u16 event, u16 flags)
 {
@@ -2355,6 +2384,9 @@ static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 	if (set->size &&
 	    nla_put_be32(skb, NFTA_SET_DESC_SIZE, htonl(set->size)))
 		goto nla_put_failure;
+	if (set->field_count &&
+	    nf_tables_fill_set_concat(skb, set) < 0)
+		goto nla_put_failure;
 	nla_nest_end(skb, desc);
 
 	return nlmsg_end(skb, nlh);
@@ -2524,6 +2556,57 @@ err:
 	return err;
 }
 
+static int nf_tables_set_field_parse(struct nft_set_desc *desc,
+				     const struct nlattr *nla)
+{
+	struct nlattr *tb[NFTA_SET_FIELD_MAX + 1];
+	u32 len;
+	int err;
+
+	if (desc->field_count >= ARRAY_SIZE(desc->field_len))
+		return -E2BIG;
+
+	err = nla_parse_nested(tb, NFTA_SET_FIELD_MAX, nla,
+			       nft_set_field_policy);
+	if (err < 0)
+		return err;
+
+	if (tb[NFTA_SET_FIELD_LEN] == NULL)
+		return -EINVAL;
+
+	len = ntohl(nla_get_be32(tb[NFTA_SET_FIELD_LEN]));
+	if (len == 0 || len > FIELD_SIZEOF(struct nft_data, data))
+		return -EINVAL;
+
+	desc->field_len[desc->field_count++] = len;
+	return 0;
+}
+
+static int nf_tables_set_desc_concat_parse(struct nft_set_desc *desc,
+					   const struct nlattr *nla)
+{
+	const struct nlattr *attr;
+	unsigned int i, len = 0;
+	int rem, err;
+
+	nla_for_each_nested(attr, nla, rem) {
+		if (nla_type(attr) != NFTA_LIST_ELEM)
+			return -EINVAL;
+
+		err = nf_tables_set_field_parse(desc, attr);
+		if (err < 0)
+			return err;
+	}
+
+	/* the fields have to cover the key exactly */
+	for (i = 0; i < desc->field_count; i++)
+		len += desc->field_len[i];
+	if (len != desc->klen)
+		return -EINVAL;
+
+	return 0;
+}
+
 static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 				    struct nft_set_desc *desc,
 				    const struct nlattr *nla)
@@ -2538,6 +2621,13 @@ static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 	if (da[NFTA_SET_DESC_SIZE] != NULL)
 		desc->size = ntohl(nla_get_be32(da[NFTA_SET_DESC_SIZE]));
 
+	if (da[NFTA_SET_DESC_CONCAT] != NULL) {
+		err = nf_tables_set_desc_concat_parse(desc,
+						      da[NFTA_SET_DESC_CONCAT]);
+		if (err < 0)
+			return err;
+	}
+
 	return 0;
 }
 
@@ -2582,7 +2672,10 @@ static int nf_tables_newset(struct sock *nlsk, struct sk_buff *skb,
 	if (nla[NFTA_SET_FLAGS] != NULL) {
 		flags = ntohl(nla_get_be32(nla[NFTA_SET_FLAGS]));
 		if (flags & ~(NFT_SET_ANONYMOUS | NFT_SET_CONSTANT |
-			      NFT_SET_INTERVAL | NFT_SET_MAP))
+			      NFT_SET_INTERVAL | NFT_SET_MAP |
+			      NFT_SET_CONCAT))
+			return -EINVAL;
+		if (flags & NFT_SET_CONCAT && !(flags & NFT_SET_INTERVAL))
 			return -EINVAL;
 	}
 
@@ -2618,6 +2711,9 @@ static int nf_tables_newset(struct sock *nlsk, struct sk_buff *skb,
 			return err;
 	}
 
+	if (!!(flags & NFT_SET_CONCAT) != (desc.field_count > 1))
+		return -EINVAL;
+
 	create = nlh->nlmsg_flags & NLM_F_CREATE ? true : false;
 
 	afi = nf_tables_afinfo_lookup(net, nfmsg->nfgen_family, create);
@@ -2667,6 +2763,7 @@ static int nf_tables_newset(struct sock *nlsk, struct sk_buff *skb,
 		goto err2;
 
 	INIT_LIST_HEAD(&set->bindings);
+	INIT_LIST_HEAD(&set->pending_update);
 	set->ops   = ops;
 	set->ktype = ktype;
 	set->klen  = desc.klen;
@@ -2675,6 +2772,8 @@ static int nf_tables_newset(struct sock *nlsk, struct sk_buff *skb,
 	set->flags = flags;
 	set->size  = desc.size;
 	set->policy = policy;
+	memcpy(set->field_len, desc.field_len, sizeof(set->field_len));
+	set->field_count = desc.field_count;
 
 	err = ops->init(set, &desc, nla);
 	if (err < 0)
@@ -2807,6 +2906,7 @@ static const struct nla_policy nft_set_elem_policy[NFTA_SET_ELEM_MAX + 1] = {
 	[NFTA_SET_ELEM_KEY]		= { .type = NLA_NESTED },
 	[NFTA_SET_ELEM_DATA]		= { .type = NLA_NESTED },
 	[NFTA_SET_ELEM_FLAGS]		= { .type = NLA_U32 },
+	[NFTA_SET_ELEM_KEY_END]		= { .type = NLA_NESTED },
 };
 
 static const struct nla_policy nft_set_elem_list_policy[NFTA_SET_ELEM_LIST_MAX + 1] = {
@@ -2856,6 +2956,11 @@ static int nf_tables_fill_setelem(struct sk_buff *skb,
 			  set->klen) < 0)
 		goto nla_put_failure;
 
+	if (set->flags & NFT_SET_CONCAT &&
+	    nft_data_dump(skb, NFTA_SET_ELEM_KEY_END, &elem->key_end,
+			  NFT_DATA_VALUE, set->klen) < 0)
+		goto nla_put_failure;
+
 	if (set->flags & NFT_SET_MAP &&
 	    !(elem->flags & NFT_SET_ELEM_INTERVAL_END) &&
 	    nft_data_dump(skb, NFTA_SET_ELEM_DATA, &elem->data,
@@ -3085,6 +3190,34 @@ static struct nft_trans *nft_trans_elem_alloc(struct nft_ctx *ctx,
 	return trans;
 }
 
+/*
+ * Ranges of concatenated sets carry their closing key in a separate
+ * attribute, single values in such sets only have a key.
+ */
+static int nft_setelem_parse_key_end(struct nft_ctx *ctx, struct nft_set *set,
+				     struct nft_set_elem *elem,
+				     const struct nlattr *nla)
+{
+	struct nft_data_desc desc;
+	int err;
+
+	nft_data_copy(&elem->key_end, &elem->key);
+	if (nla == NULL)
+		return 0;
+	if (!(set->flags & NFT_SET_CONCAT))
+		return -EINVAL;
+
+	err = nft_data_init(ctx, &elem->key_end, &desc, nla);
+	if (err < 0)
+		return err;
+
+	if (desc.type != NFT_DATA_VALUE || desc.len != set->klen) {
+		nft_data_uninit(&elem->key_end, desc.type);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 			    const struct nlattr *attr)
 {
@@ -3133,6 +3266,11 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 	if (d1.type != NFT_DATA_VALUE || d1.len != set->klen)
 		goto err2;
 
+	err = nft_setelem_parse_key_end(ctx, set, &elem,
+					nla[NFTA_SET_ELEM_KEY_END]);
+	if (err < 0)
+		goto err2;
+
 	err = -EEXIST;
 	if (set->ops->get(set, &elem) == 0)
 		goto err2;
@@ -3250,6 +3388,11 @@ static int nft_del_setelem(struct nft_ctx *ctx, struct nft_set *set,
 	if (desc.type != NFT_DATA_VALUE || desc.len != set->klen)
 		goto err2;
 
+	err = nft_setelem_parse_key_end(ctx, set, &elem,
+					nla[NFTA_SET_ELEM_KEY_END]);
+	if (err < 0)
+		goto err2;
+
 	err = set->ops->get(set, &elem);
 	if (err < 0)
 		goto err2;
@@ -3503,11 +3646,20 @@ static void nf_tables_commit_release(struct nft_trans *trans)
 	kfree(trans);
 }
 
+static void nft_set_mark_pending(struct nft_set *set,
+				 struct list_head *pending)
+{
+	if (set->ops->commit != NULL && list_empty(&set->pending_update))
+		list_add_tail(&set->pending_update, pending);
+}
+
 static int nf_tables_commit(struct sk_buff *skb)
 {
 	struct net *net = sock_net(skb->sk);
 	struct nft_trans *trans, *next;
+	struct nft_set *set, *snext;
 	struct nft_trans_elem *te;
+	LIST_HEAD(pending);
 
 	/* Bump generation counter, invalidate any dump in progress */
 	while (++net->nft.base_seq == 0);
@@ -3584,6 +3736,8 @@ static int nf_tables_commit(struct sk_buff *skb)
 					     NFT_MSG_DELSET, GFP_KERNEL);
 			break;
 		case NFT_MSG_NEWSETELEM:
+			nft_set_mark_pending(nft_trans_elem_set(trans),
+					     &pending);
 			nf_tables_setelem_notify(&trans->ctx,
 						 nft_trans_elem_set(trans),
 						 &nft_trans_elem(trans),
@@ -3597,6 +3751,7 @@ static int nf_tables_commit(struct sk_buff *skb)
 						 NFT_MSG_DELSETELEM, 0);
 			te->set->ops->get(te->set, &te->elem);
 			te->set->ops->remove(te->set, &te->elem);
+			nft_set_mark_pending(te->set, &pending);
 			nft_data_uninit(&te->elem.key, NFT_DATA_VALUE);
 			if (te->elem.flags & NFT_SET_MAP) {
 				nft_data_uninit(&te->elem.data,
@@ -3607,6 +3762,12 @@ static int nf_tables_commit(struct sk_buff *skb)
 		}
 	}
 
+	/* Publish the element changes of set types that stage them */
+	list_for_each_entry_safe(set, snext, &pending, pending_update) {
+		list_del_init(&set->pending_update);
+		set->ops->commit(set);
+	}
+
 	synchronize_rcu();
 
 	list_for_each_entry_safe(trans, next, &net->nft.commit_list, list) {
@@ -0,0 +1,827 @@
+/*
+ * nf_tables set type for concatenated ranges: PIle PAcket POlicies
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Elements of these sets are tuples of ranges, one per field of the key,
+ * e.g. a destination address range, a port range and a protocol.  Lookups
+ * don't compare the key against each element: every field is split into
+ * 4-bit groups, and for each group and each of the 16 values a group can
+ * take, a lookup table holds a bitmap of the rules matching that value.
+ * ANDing the bitmaps selected by the groups of a key field yields the
+ * rules matching the field, and a mapping table translates them into the
+ * rules to consider in the next field.  The first rule left after the
+ * last field points to the matching element.
+ *
+ * A range of a field is inserted as the set of prefixes covering it, one
+ * rule each, so the number of rules of a field grows with the number of
+ * prefixes needed by the ranges, at most 2 * 8 * length - 2 per range.
+ * The cost of a lookup is then bound by the number of groups times the
+ * size of the bitmaps, which are matched a long word at a time, and does
+ * not depend on how ranges overlap.
+ *
+ * Insertions and removals are applied to a working copy of the matching
+ * data, which replaces the copy used by lookups when the transaction is
+ * committed.  Lookups run under RCU, with per-CPU scratch maps.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+
+#define NFT_PIPAPO_GROUP_BITS	4
+#define NFT_PIPAPO_BUCKETS	(1 << NFT_PIPAPO_GROUP_BITS)
+#define NFT_PIPAPO_MAX_BYTES	FIELD_SIZEOF(struct nft_data, data)
+
+/*
+ * Mapping table entry: rules of all fields but the last map to a range of
+ * rules of the next field, rules of the last field to an element.
+ */
+union nft_pipapo_map_bucket {
+	struct {
+		unsigned int	to;
+		unsigned int	n;
+	};
+	struct nft_pipapo_elem	*e;
+};
+
+struct nft_pipapo_field {
+	unsigned int			groups;
+	unsigned int			rules;
+	size_t				bsize;	/* longs per bucket */
+	unsigned long			*lt;
+	union nft_pipapo_map_bucket	*mt;
+};
+
+struct nft_pipapo_match {
+	unsigned int			field_count;
+	size_t				bsize_max;
+	unsigned long * __percpu	*scratch;
+	struct list_head		gc;
+	struct rcu_head			rcu;
+	struct nft_pipapo_field		f[];
+};
+
+struct nft_pipapo {
+	struct nft_pipapo_match __rcu	*match;
+	struct nft_pipapo_match		*clone;
+	struct list_head		gc;
+	struct mutex			lock;
+	bool				dirty;
+};
+
+struct nft_pipapo_elem {
+	struct list_head		gc;
+	struct nft_data			key;
+	struct nft_data			key_end;
+	struct nft_data			data[];
+};
+
+static unsigned long *pipapo_bucket(const struct nft_pipapo_field *f,
+				    unsigned int group, unsigned int value)
+{
+	return f->lt + (group * NFT_PIPAPO_BUCKETS + value) * f->bsize;
+}
+
+static u8 pipapo_group_value(const u8 *data, unsigned int group)
+{
+	u8 v = data[group / 2];
+
+	return group & 1 ? v & 0x0f : v >> 4;
+}
+
+/* AND @src into @dst, return whether any bit is left */
+static bool pipapo_and(unsigned long *dst, const unsigned long *src,
+		       size_t len)
+{
+	unsigned long any = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] &= src[i];
+		any |= dst[i];
+	}
+	return any;
+}
+
+/* Set the bits of @fill for the next field rules mapped by @res */
+static bool pipapo_refill(const unsigned long *res,
+			  const struct nft_pipapo_field *f,
+			  unsigned long *fill)
+{
+	bool found = false;
+	unsigned int r;
+
+	for_each_set_bit(r, res, f->rules) {
+		bitmap_set(fill, f->mt[r].to, f->mt[r].n);
+		found = true;
+	}
+	return found;
+}
+
+static bool nft_pipapo_lookup(const struct nft_set *set,
+			      const struct nft_data *key,
+			      struct nft_data *data)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const u8 *p = (const u8 *)key->data;
+	const struct nft_pipapo_match *m;
+	const struct nft_pipapo_field *f;
+	const struct nft_pipapo_elem *e;
+	unsigned long *res, *fill;
+	unsigned int i, g, r;
+	bool ret = false;
+
+	local_bh_disable();
+	rcu_read_lock();
+	m = rcu_dereference(priv->match);
+	res = *this_cpu_ptr(m->scratch);
+	fill = res + m->bsize_max;
+
+	memset(res, 0xff, m->f[0].bsize * sizeof(*res));
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		for (g = 0; g < f->groups; g++) {
+			if (!pipapo_and(res, pipapo_bucket(f, g,
+						pipapo_group_value(p, g)),
+					f->bsize))
+				goto out;
+		}
+		p += f->groups / 2;
+
+		if (i == m->field_count - 1) {
+			r = find_first_bit(res, f->rules);
+			if (r >= f->rules)
+				goto out;
+
+			e = f->mt[r].e;
+			if (set->flags & NFT_SET_MAP)
+				nft_data_copy(data, e->data);
+			ret = true;
+			goto out;
+		}
+
+		memset(fill, 0, f[1].bsize * sizeof(*fill));
+		if (!pipapo_refill(res, f, fill))
+			goto out;
+		swap(res, fill);
+	}
+out:
+	rcu_read_unlock();
+	local_bh_enable();
+	return ret;
+}
+
+static void *pipapo_zalloc(size_t size)
+{
+	void *p;
+
+	p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (p == NULL)
+		p = vzalloc(size);
+	return p;
+}
+
+static void pipapo_free_scratch(unsigned long * __percpu *scratch)
+{
+	int cpu;
+
+	if (scratch == NULL)
+		return;
+
+	for_each_possible_cpu(cpu)
+		kfree(*per_cpu_ptr(scratch, cpu));
+	free_percpu(scratch);
+}
+
+/* Give each CPU room for the result and fill maps of the largest field */
+static int pipapo_realloc_scratch(struct nft_pipapo_match *m,
+				  size_t bsize_max)
+{
+	unsigned long * __percpu *scratch;
+	unsigned long *s;
+	int cpu;
+
+	scratch = alloc_percpu(unsigned long *);
+	if (scratch == NULL)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		s = kzalloc_node(2 * max_t(size_t, bsize_max, 1) * sizeof(*s),
+				 GFP_KERNEL, cpu_to_node(cpu));
+		if (s == NULL) {
+			pipapo_free_scratch(scratch);
+			return -ENOMEM;
+		}
+		*per_cpu_ptr(scratch, cpu) = s;
+	}
+
+	pipapo_free_scratch(m->scratch);
+	m->scratch   = scratch;
+	m->bsize_max = bsize_max;
+	return 0;
+}
+
+static void pipapo_free_match(struct nft_pipapo_match *m)
+{
+	unsigned int i;
+
+	for (i = 0; i < m->field_count; i++) {
+		kvfree(m->f[i].lt);
+		kvfree(m->f[i].mt);
+	}
+	pipapo_free_scratch(m->scratch);
+	kfree(m);
+}
+
+static void pipapo_reclaim(struct rcu_head *rcu)
+{
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_elem *e, *next;
+
+	m = container_of(rcu, struct nft_pipapo_match, rcu);
+	list_for_each_entry_safe(e, next, &m->gc, gc)
+		kfree(e);
+	pipapo_free_match(m);
+}
+
+static struct nft_pipapo_match *pipapo_clone(const struct nft_pipapo_match *old)
+{
+	const struct nft_pipapo_field *src;
+	struct nft_pipapo_field *dst;
+	struct nft_pipapo_match *new;
+	unsigned int i;
+	size_t size;
+
+	new = kzalloc(sizeof(*new) + old->field_count * sizeof(new->f[0]),
+		      GFP_KERNEL);
+	if (new == NULL)
+		return NULL;
+
+	new->field_count = old->field_count;
+	INIT_LIST_HEAD(&new->gc);
+
+	for (i = 0; i < old->field_count; i++) {
+		src = &old->f[i];
+		dst = &new->f[i];
+
+		dst->groups = src->groups;
+		dst->rules  = src->rules;
+		dst->bsize  = src->bsize;
+
+		size = src->groups * NFT_PIPAPO_BUCKETS * src->bsize *
+		       sizeof(*src->lt);
+		dst->lt = pipapo_zalloc(size);
+		if (dst->lt == NULL)
+			goto err;
+		memcpy(dst->lt, src->lt, size);
+
+		size = src->rules * sizeof(*src->mt);
+		dst->mt = pipapo_zalloc(size);
+		if (dst->mt == NULL)
+			goto err;
+		memcpy(dst->mt, src->mt, size);
+	}
+
+	if (pipapo_realloc_scratch(new, old->bsize_max) < 0)
+		goto err;
+
+	return new;
+err:
+	pipapo_free_match(new);
+	return NULL;
+}
+
+/*
+ * Reallocate the tables of a field for @rules rules, keeping the ones in
+ * use.  The rule count itself is left to the caller.
+ */
+static int pipapo_resize(struct nft_pipapo_field *f, unsigned int rules)
+{
+	union nft_pipapo_map_bucket *new_mt;
+	unsigned long *new_lt = NULL;
+	size_t new_bsize, copy;
+	unsigned int g, b;
+
+	new_mt = pipapo_zalloc(rules * sizeof(*new_mt));
+	if (new_mt == NULL)
+		return -ENOMEM;
+
+	new_bsize = BITS_TO_LONGS(rules);
+	if (new_bsize != f->bsize) {
+		new_lt = pipapo_zalloc(f->groups * NFT_PIPAPO_BUCKETS *
+				       new_bsize * sizeof(*new_lt));
+		if (new_lt == NULL) {
+			kvfree(new_mt);
+			return -ENOMEM;
+		}
+
+		copy = min(f->bsize, new_bsize);
+		for (g = 0; g < f->groups; g++) {
+			for (b = 0; b < NFT_PIPAPO_BUCKETS; b++) {
+				memcpy(new_lt + (g * NFT_PIPAPO_BUCKETS + b) *
+						new_bsize,
+				       pipapo_bucket(f, g, b),
+				       copy * sizeof(*new_lt));
+			}
+		}
+
+		kvfree(f->lt);
+		f->lt	 = new_lt;
+		f->bsize = new_bsize;
+	}
+
+	memcpy(new_mt, f->mt, min(f->rules, rules) * sizeof(*new_mt));
+	kvfree(f->mt);
+	f->mt = new_mt;
+	return 0;
+}
+
+/* Make rule @rule match the first @plen bits of @v in all groups */
+static void pipapo_insert_prefix(struct nft_pipapo_field *f, unsigned int rule,
+				 const u8 *v, int plen)
+{
+	unsigned int g, b, mask;
+	int fixed;
+
+	for (g = 0; g < f->groups; g++) {
+		fixed = clamp_t(int, plen - g * NFT_PIPAPO_GROUP_BITS,
+				0, NFT_PIPAPO_GROUP_BITS);
+		mask = (NFT_PIPAPO_BUCKETS - 1) <<
+		       (NFT_PIPAPO_GROUP_BITS - fixed);
+		mask &= NFT_PIPAPO_BUCKETS - 1;
+
+		for (b = 0; b < NFT_PIPAPO_BUCKETS; b++) {
+			if ((b & mask) == (pipapo_group_value(v, g) & mask))
+				__set_bit(rule, pipapo_bucket(f, g, b));
+		}
+	}
+}
+
+static bool pipapo_low_bits_clear(const u8 *v, int len, int bits)
+{
+	int i;
+
+	for (i = len - 1; bits >= BITS_PER_BYTE; i--, bits -= BITS_PER_BYTE) {
+		if (v[i])
+			return false;
+	}
+	return !bits || !(v[i] & ((1 << bits) - 1));
+}
+
+static void pipapo_set_low_bits(u8 *v, int len, int bits)
+{
+	int i;
+
+	for (i = len - 1; bits >= BITS_PER_BYTE; i--, bits -= BITS_PER_BYTE)
+		v[i] = 0xff;
+	if (bits)
+		v[i] |= (1 << bits) - 1;
+}
+
+static void pipapo_inc(u8 *v, int len)
+{
+	int i;
+
+	for (i = len - 1; i >= 0; i--) {
+		if (++v[i])
+			break;
+	}
+}
+
+/*
+ * Split the big-endian range [@start, @end] into the prefixes covering it
+ * and insert them into @f from rule @rule on.  Return the number of
+ * prefixes; with a NULL @f, nothing is inserted.
+ */
+static int pipapo_expand(struct nft_pipapo_field *f, unsigned int rule,
+			 const u8 *start, const u8 *end, int len)
+{
+	u8 base[NFT_PIPAPO_MAX_BYTES], top[NFT_PIPAPO_MAX_BYTES];
+	int step, n = 0;
+
+	memcpy(base, start, len);
+	for (;;) {
+		/* widest aligned block at base not going past end */
+		for (step = len * BITS_PER_BYTE; step > 0; step--) {
+			if (!pipapo_low_bits_clear(base, len, step))
+				continue;
+			memcpy(top, base, len);
+			pipapo_set_low_bits(top, len, step);
+			if (memcmp(top, end, len) <= 0)
+				break;
+		}
+		if (step == 0)
+			memcpy(top, base, len);
+
+		if (f != NULL)
+			pipapo_insert_prefix(f, rule + n, base,
+					     len * BITS_PER_BYTE - step);
+		n++;
+
+		if (!memcmp(top, end, len))
+			break;
+		memcpy(base, top, len);
+		pipapo_inc(base, len);
+	}
+	return n;
+}
+
+static int nft_pipapo_insert(const struct nft_set *set,
+			     const struct nft_set_elem *elem)
+{
+	const u8 *start = (const u8 *)elem->key.data;
+	const u8 *end = (const u8 *)elem->key_end.data;
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned int first[NFT_SET_MAXFIELDS];
+	unsigned int n[NFT_SET_MAXFIELDS];
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	struct nft_pipapo_elem *e;
+	unsigned int i, r, size;
+	size_t bsize_max;
+	int len, err;
+
+	if (elem->flags & NFT_SET_ELEM_INTERVAL_END)
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < set->field_count; i++) {
+		len = set->field_len[i];
+		if (memcmp(start, end, len) > 0)
+			return -EINVAL;
+		n[i] = pipapo_expand(NULL, 0, start, end, len);
+		start += len;
+		end += len;
+	}
+
+	size = sizeof(*e);
+	if (set->flags & NFT_SET_MAP)
+		size += sizeof(e->data[0]);
+
+	e = kzalloc(size, GFP_KERNEL);
+	if (e == NULL)
+		return -ENOMEM;
+
+	nft_data_copy(&e->key, &elem->key);
+	nft_data_copy(&e->key_end, &elem->key_end);
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(e->data, &elem->data);
+
+	mutex_lock(&priv->lock);
+	m = priv->clone;
+
+	bsize_max = m->bsize_max;
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		err = pipapo_resize(f, f->rules + n[i]);
+		if (err < 0)
+			goto err;
+		bsize_max = max(bsize_max, f->bsize);
+	}
+
+	if (bsize_max > m->bsize_max) {
+		err = pipapo_realloc_scratch(m, bsize_max);
+		if (err < 0)
+			goto err;
+	}
+
+	start = (const u8 *)elem->key.data;
+	end = (const u8 *)elem->key_end.data;
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		first[i] = f->rules;
+		pipapo_expand(f, first[i], start, end, set->field_len[i]);
+		f->rules += n[i];
+		start += set->field_len[i];
+		end += set->field_len[i];
+	}
+
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		for (r = first[i]; r < first[i] + n[i]; r++) {
+			if (i == m->field_count - 1) {
+				f->mt[r].e = e;
+			} else {
+				f->mt[r].to = first[i + 1];
+				f->mt[r].n  = n[i + 1];
+			}
+		}
+	}
+
+	priv->dirty = true;
+	mutex_unlock(&priv->lock);
+	return 0;
+err:
+	mutex_unlock(&priv->lock);
+	kfree(e);
+	return err;
+}
+
+/* Drop rules [@first, @first + @n) from @f, renumbering the ones after */
+static void pipapo_drop(struct nft_pipapo_field *f, unsigned int first,
+			unsigned int n)
+{
+	unsigned long *bucket;
+	unsigned int g, b, r;
+
+	for (g = 0; g < f->groups; g++) {
+		for (b = 0; b < NFT_PIPAPO_BUCKETS; b++) {
+			bucket = pipapo_bucket(f, g, b);
+			for (r = first; r + n < f->rules; r++) {
+				if (test_bit(r + n, bucket))
+					__set_bit(r, bucket);
+				else
+					__clear_bit(r, bucket);
+			}
+			bitmap_clear(bucket, f->rules - n, n);
+		}
+	}
+
+	memmove(f->mt + first, f->mt + first + n,
+		(f->rules - first - n) * sizeof(*f->mt));
+	f->rules -= n;
+
+	/* shrinking is best effort, the tables stay valid if it fails */
+	pipapo_resize(f, f->rules);
+}
+
+static void nft_pipapo_remove(const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e = elem->cookie;
+	unsigned int first[NFT_SET_MAXFIELDS];
+	unsigned int n[NFT_SET_MAXFIELDS];
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	unsigned int r;
+	int i;
+
+	mutex_lock(&priv->lock);
+	m = priv->clone;
+
+	/* The rules of an element are contiguous in each field: find them
+	 * in the last field, then follow the mappings back to the first.
+	 */
+	i = m->field_count - 1;
+	f = &m->f[i];
+	for (r = 0; r < f->rules && f->mt[r].e != e; r++)
+		;
+	if (WARN_ON_ONCE(r == f->rules)) {
+		mutex_unlock(&priv->lock);
+		return;
+	}
+	for (first[i] = r, n[i] = 0; r < f->rules && f->mt[r].e == e; r++)
+		n[i]++;
+
+	for (i--; i >= 0; i--) {
+		f = &m->f[i];
+		for (r = 0; r < f->rules && f->mt[r].to != first[i + 1]; r++)
+			;
+		for (first[i] = r, n[i] = 0;
+		     r < f->rules && f->mt[r].to == first[i + 1]; r++)
+			n[i]++;
+	}
+
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		pipapo_drop(f, first[i], n[i]);
+		if (i == 0)
+			continue;
+
+		for (r = 0; r < f[-1].rules; r++) {
+			if (f[-1].mt[r].to > first[i])
+				f[-1].mt[r].to -= n[i];
+		}
+	}
+
+	/* lookups may still see the element until the next commit */
+	list_add(&e->gc, &priv->gc);
+	priv->dirty = true;
+	mutex_unlock(&priv->lock);
+}
+
+static void nft_pipapo_commit(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *clone, *old;
+
+	mutex_lock(&priv->lock);
+	if (!priv->dirty)
+		goto out;
+
+	/* Without a new working copy, the changes stay pending until the
+	 * next commit.
+	 */
+	clone = pipapo_clone(priv->clone);
+	if (clone == NULL)
+		goto out;
+
+	old = rcu_dereference_protected(priv->match,
+					lockdep_is_held(&priv->lock));
+	rcu_assign_pointer(priv->match, priv->clone);
+	list_splice_init(&priv->gc, &old->gc);
+	priv->clone = clone;
+	priv->dirty = false;
+	call_rcu(&old->rcu, pipapo_reclaim);
+out:
+	mutex_unlock(&priv->lock);
+}
+
+static int nft_pipapo_get(const struct nft_set *set, struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_field *f;
+	struct nft_pipapo_elem *e;
+	unsigned int r;
+
+	mutex_lock(&priv->lock);
+	f = &priv->clone->f[priv->clone->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		e = f->mt[r].e;
+		if (nft_data_cmp(&e->key, &elem->key, set->klen) ||
+		    nft_data_cmp(&e->key_end, &elem->key_end, set->klen))
+			continue;
+
+		elem->cookie = e;
+		if (set->flags & NFT_SET_MAP)
+			nft_data_copy(&elem->data, e->data);
+		elem->flags = 0;
+		mutex_unlock(&priv->lock);
+		return 0;
+	}
+	mutex_unlock(&priv->lock);
+	return -ENOENT;
+}
+
+static void nft_pipapo_walk(const struct nft_ctx *ctx,
+			    const struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_field *f;
+	const struct nft_pipapo_elem *e;
+	struct nft_set_elem elem;
+	unsigned int r;
+
+	mutex_lock(&priv->lock);
+	f = &priv->clone->f[priv->clone->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		if (r && f->mt[r].e == f->mt[r - 1].e)
+			continue;
+		if (iter->count < iter->skip)
+			goto cont;
+
+		e = f->mt[r].e;
+		nft_data_copy(&elem.key, &e->key);
+		nft_data_copy(&elem.key_end, &e->key_end);
+		if (set->flags & NFT_SET_MAP)
+			nft_data_copy(&elem.data, e->data);
+		elem.flags = 0;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			break;
+cont:
+		iter->count++;
+	}
+	mutex_unlock(&priv->lock);
+}
+
+static unsigned int nft_pipapo_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_pipapo);
+}
+
+static int nft_pipapo_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+	unsigned int i;
+
+	if (desc->field_count < 2)
+		return -EINVAL;
+
+	m = kzalloc(sizeof(*m) + desc->field_count * sizeof(m->f[0]),
+		    GFP_KERNEL);
+	if (m == NULL)
+		return -ENOMEM;
+
+	m->field_count = desc->field_count;
+	INIT_LIST_HEAD(&m->gc);
+	for (i = 0; i < m->field_count; i++)
+		m->f[i].groups = desc->field_len[i] * BITS_PER_BYTE /
+				 NFT_PIPAPO_GROUP_BITS;
+
+	if (pipapo_realloc_scratch(m, 0) < 0)
+		goto err1;
+
+	priv->clone = pipapo_clone(m);
+	if (priv->clone == NULL)
+		goto err1;
+
+	RCU_INIT_POINTER(priv->match, m);
+	INIT_LIST_HEAD(&priv->gc);
+	mutex_init(&priv->lock);
+	priv->dirty = false;
+	return 0;
+
+err1:
+	pipapo_free_match(m);
+	return -ENOMEM;
+}
+
+static void nft_pipapo_destroy(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e, *next;
+	const struct nft_pipapo_field *f;
+	unsigned int r;
+
+	/* the working copy holds all elements not yet queued for freeing */
+	f = &priv->clone->f[priv->clone->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		if (r < f->rules - 1 && f->mt[r].e == f->mt[r + 1].e)
+			continue;
+
+		e = f->mt[r].e;
+		nft_data_uninit(&e->key, NFT_DATA_VALUE);
+		if (set->flags & NFT_SET_MAP)
+			nft_data_uninit(e->data, set->dtype);
+		kfree(e);
+	}
+
+	list_for_each_entry_safe(e, next, &priv->gc, gc)
+		kfree(e);
+
+	pipapo_free_match(rcu_dereference_protected(priv->match, 1));
+	pipapo_free_match(priv->clone);
+}
+
+static bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	unsigned int nsize, i, rules = 0;
+
+	if (!(features & NFT_SET_INTERVAL) || desc->field_count < 2)
+		return false;
+
+	/* worst case of one range needing all the prefixes it can */
+	for (i = 0; i < desc->field_count; i++)
+		rules += 2 * BITS_PER_BYTE * desc->field_len[i];
+
+	nsize = sizeof(struct nft_pipapo_elem) +
+		rules * sizeof(union nft_pipapo_map_bucket);
+	if (features & NFT_SET_MAP)
+		nsize += FIELD_SIZEOF(struct nft_pipapo_elem, data[0]);
+
+	if (desc->size)
+		est->size = sizeof(struct nft_pipapo) + desc->size * nsize;
+	else
+		est->size = nsize;
+
+	est->class = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+static struct nft_set_ops nft_pipapo_ops __read_mostly = {
+	.privsize	= nft_pipapo_privsize,
+	.estimate	= nft_pipapo_estimate,
+	.init		= nft_pipapo_init,
+	.destroy	= nft_pipapo_destroy,
+	.insert		= nft_pipapo_insert,
+	.remove		= nft_pipapo_remove,
+	.get		= nft_pipapo_get,
+	.lookup		= nft_pipapo_lookup,
+	.walk		= nft_pipapo_walk,
+	.commit		= nft_pipapo_commit,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_CONCAT,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_pipapo_module_init(void)
+{
+	return nft_register_set(&nft_pipapo_ops);
+}
+
+static void __exit nft_pipapo_module_exit(void)
+{
+	nft_unregister_set(&nft_pipapo_ops);
+	rcu_barrier();
+}
+
+module_init(nft_pipapo_module_init);
+module_exit(nft_pipapo_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
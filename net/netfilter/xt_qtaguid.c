@@ -1601,10 +1601,10 @@ static struct sock *qtaguid_find_sk(const struct sk_buff *skb,
 		MT_DEBUG("qtaguid: %p->sk_proto=%u "
 			 "->sk_state=%d\n", sk, sk->sk_protocol, sk->sk_state);
 		/*
-		 * When in TCP_TIME_WAIT the sk is not a "struct sock" but
-		 * "struct inet_timewait_sock" which is missing fields.
+		 * When in TCP_TIME_WAIT or TCP_NEW_SYN_RECV the sk is not a
+		 * "struct sock" but a mini socket which is missing fields.
 		 */
-		if (sk->sk_state  == TCP_TIME_WAIT) {
+		if (!sk_fullsock(sk)) {
 			if (sk != skb->sk)
 				sock_gen_put(sk);
 			sk = NULL;
@@ -1689,11 +1689,11 @@ static bool qtaguid_mt(const struct sk_buff *skb, struct xt_action_param *par)
 
 	sk = skb->sk;
 	/*
-	 * When in TCP_TIME_WAIT the sk is not a "struct sock" but
-	 * "struct inet_timewait_sock" which is missing fields.
+	 * When in TCP_TIME_WAIT or TCP_NEW_SYN_RECV the sk is not a
+	 * "struct sock" but a mini socket which is missing fields.
 	 * So we ignore it.
 	 */
-	if (sk && sk->sk_state == TCP_TIME_WAIT)
+	if (sk && !sk_fullsock(sk))
 		sk = NULL;
 	if (sk == NULL) {
 		/*
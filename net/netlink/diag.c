@@ -103,17 +103,24 @@ static int __netlink_diag_dump(struct sk_buff *skb, struct netlink_callback *cb,
 {
 	struct netlink_table *tbl = &nl_table[protocol];
 	struct rhashtable *ht = &tbl->hash;
-	const struct bucket_table *htbl = rht_dereference(ht->tbl, ht);
+	const struct bucket_table *htbl;
 	struct net *net = sock_net(skb->sk);
 	struct netlink_diag_req *req;
 	struct netlink_sock *nlsk;
+	struct rhash_head *node;
 	struct sock *sk;
 	int ret = 0, num = 0, i;
 
 	req = nlmsg_data(cb->nlh);
 
+	/* Hold off resizing so that every socket is visited exactly once */
+	mutex_lock(&ht->mutex);
+	read_lock(&nl_table_lock);
+	rcu_read_lock();
+
+	htbl = rht_dereference(ht->tbl, ht);
 	for (i = 0; i < htbl->size; i++) {
-		rht_for_each_entry(nlsk, htbl->buckets[i], ht, node) {
+		rht_for_each_entry_rcu(nlsk, node, htbl, i, node) {
 			sk = (struct sock *)nlsk;
 
 			if (!net_eq(sock_net(sk), net))
@@ -157,6 +164,10 @@ static int __netlink_diag_dump(struct sk_buff *skb, struct netlink_callback *cb,
 		num++;
 	}
 done:
+	rcu_read_unlock();
+	read_unlock(&nl_table_lock);
+	mutex_unlock(&ht->mutex);
+
 	cb->args[0] = num;
 	cb->args[1] = protocol;
 
@@ -170,9 +181,6 @@ static int netlink_diag_dump(struct sk_buff *skb, struct netlink_callback *cb)
 
 	req = nlmsg_data(cb->nlh);
 
-	mutex_lock(&nl_sk_hash_lock);
-	read_lock(&nl_table_lock);
-
 	if (req->sdiag_protocol == NDIAG_PROTO_ALL) {
 		int i;
 
@@ -182,18 +190,12 @@ static int netlink_diag_dump(struct sk_buff *skb, struct netlink_callback *cb)
 			s_num = 0;
 		}
 	} else {
-		if (req->sdiag_protocol >= MAX_LINKS) {
-			read_unlock(&nl_table_lock);
-			mutex_unlock(&nl_sk_hash_lock);
+		if (req->sdiag_protocol >= MAX_LINKS)
 			return -ENOENT;
-		}
 
 		__netlink_diag_dump(skb, cb, req->sdiag_protocol, s_num);
 	}
 
-	read_unlock(&nl_table_lock);
-	mutex_unlock(&nl_sk_hash_lock);
-
 	return skb->len;
 }
 
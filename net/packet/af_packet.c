@@ -274,6 +274,67 @@ drop:
 	return NET_XMIT_DROP;
 }
 
+/* Number of TX ring frames handed to the driver under one tx lock when
+ * the qdisc layer is bypassed; all but the last one carry xmit_more.
+ */
+#define TPACKET_TX_BATCH	32
+
+/* Transmit the skbs queued in @batch, which all map to the same tx queue.
+ * Frames the driver did not accept are left on @batch.
+ */
+static int packet_direct_xmit_batch(struct sk_buff_head *batch)
+{
+	struct sk_buff *skb = skb_peek(batch);
+	struct net_device *dev = skb->dev;
+	netdev_features_t features;
+	struct sk_buff *next;
+	struct netdev_queue *txq;
+	int ret = NETDEV_TX_OK;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev)))
+		return NET_XMIT_DROP;
+
+	/* Linearize up front: once a frame went out with xmit_more set,
+	 * another one must follow it to the driver.
+	 */
+	skb_queue_walk_safe(batch, skb, next) {
+		features = netif_skb_features(skb);
+		if (skb_needs_linearize(skb, features) &&
+		    __skb_linearize(skb)) {
+			__skb_unlink(skb, batch);
+			atomic_long_inc(&dev->tx_dropped);
+			kfree_skb(skb);
+		}
+	}
+	if (skb_queue_empty(batch))
+		return NET_XMIT_DROP;
+
+	txq = skb_get_tx_queue(dev, skb_peek(batch));
+
+	local_bh_disable();
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while ((skb = __skb_dequeue(batch)) != NULL) {
+		if (netif_xmit_frozen_or_drv_stopped(txq)) {
+			ret = NETDEV_TX_BUSY;
+			__skb_queue_head(batch, skb);
+			break;
+		}
+		ret = netdev_start_xmit(skb, dev, txq,
+					!skb_queue_empty(batch));
+		if (!dev_xmit_complete(ret)) {
+			__skb_queue_head(batch, skb);
+			break;
+		}
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	local_bh_enable();
+
+	return ret;
+}
+
 static struct net_device *packet_cached_dev_get(struct packet_sock *po)
 {
 	struct net_device *dev;
@@ -2219,6 +2280,31 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	return tp_len;
 }
 
+/* Send the frames collected by tpacket_snd(). Frames the driver did not
+ * take are handed back to user space as TP_STATUS_SEND_REQUEST and the
+ * ring head is rewound to the first of them, as for a single frame.
+ */
+static int tpacket_flush_batch(struct packet_sock *po,
+			       struct sk_buff_head *batch)
+{
+	struct packet_ring_buffer *rb = &po->tx_ring;
+	struct sk_buff *skb;
+
+	packet_direct_xmit_batch(batch);
+	if (skb_queue_empty(batch))
+		return 0;
+
+	while ((skb = __skb_dequeue_tail(batch)) != NULL) {
+		void *ph = skb_shinfo(skb)->destructor_arg;
+
+		kfree_skb(skb);
+		__packet_set_status(po, ph, TP_STATUS_SEND_REQUEST);
+		rb->head = rb->head ? rb->head - 1 : rb->frame_max;
+	}
+
+	return -ENOBUFS;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
 	struct sk_buff *skb;
@@ -2233,7 +2319,10 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	int len_sum = 0;
 	int status = TP_STATUS_AVAILABLE;
 	int hlen, tlen;
+	struct sk_buff_head batch;
+	bool batching = packet_use_direct_xmit(po);
 
+	__skb_queue_head_init(&batch);
 	mutex_lock(&po->pg_vec_lock);
 
 	if (likely(saddr == NULL)) {
@@ -2271,6 +2360,12 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			/* Frames we still hold count as pending */
+			if (!skb_queue_empty(&batch)) {
+				err = tpacket_flush_batch(po, &batch);
+				if (unlikely(err))
+					goto out_put;
+			}
 			if (need_wait && need_resched())
 				schedule();
 			continue;
@@ -2316,11 +2411,40 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 
 		packet_pick_tx_queue(dev, skb);
 
+		if (!skb_queue_empty(&batch) &&
+		    skb_get_queue_mapping(skb) !=
+		    skb_get_queue_mapping(skb_peek(&batch))) {
+			err = tpacket_flush_batch(po, &batch);
+			if (unlikely(err))
+				goto out_status;
+		}
+
 		skb->destructor = tpacket_destruct_skb;
 		__packet_set_status(po, ph, TP_STATUS_SENDING);
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (batching) {
+			__skb_queue_tail(&batch, skb);
+			skb = NULL;
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+
+			/* Keep building while user space has more frames
+			 * ready, so the driver sees them with xmit_more.
+			 */
+			if (skb_queue_len(&batch) < TPACKET_TX_BATCH &&
+			    packet_current_frame(po, &po->tx_ring,
+						 TP_STATUS_SEND_REQUEST))
+				continue;
+
+			err = tpacket_flush_batch(po, &batch);
+			if (unlikely(err)) {
+				ph = NULL;
+				goto out_status;
+			}
+			continue;
+		}
 		err = po->xmit(skb);
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
@@ -2351,7 +2475,14 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	goto out_put;
 
 out_status:
-	__packet_set_status(po, ph, status);
+	if (!skb_queue_empty(&batch)) {
+		int batch_err = tpacket_flush_batch(po, &batch);
+
+		if (!err)
+			err = batch_err;
+	}
+	if (ph)
+		__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
 	dev_put(dev);
@@ -868,6 +868,23 @@ static int qdisc_graft(struct net_device *dev, struct Qdisc *parent,
 static struct lock_class_key qdisc_tx_lock;
 static struct lock_class_key qdisc_rx_lock;
 
+/* Below another qdisc a TCQ_F_NOLOCK qdisc runs under that qdisc's
+ * lock like any other, and keeps plain statistics that its parent and
+ * class dumps can read.
+ */
+static void qdisc_clear_nolock(struct Qdisc *sch)
+{
+	sch->flags &= ~TCQ_F_NOLOCK;
+	if (!qdisc_is_percpu_stats(sch))
+		return;
+
+	free_percpu(sch->cpu_bstats);
+	free_percpu(sch->cpu_qstats);
+	sch->cpu_bstats = NULL;
+	sch->cpu_qstats = NULL;
+	sch->flags &= ~TCQ_F_CPUSTATS;
+}
+
 /*
    Allocate and initialize new qdisc.
 
@@ -944,8 +961,13 @@ qdisc_create(struct net_device *dev, struct netdev_queue *dev_queue,
 
 	sch->handle = handle;
 
+	if ((sch->flags & TCQ_F_NOLOCK) && sch->parent != TC_H_ROOT &&
+	    (!p || !(p->flags & TCQ_F_MQROOT)))
+		qdisc_clear_nolock(sch);
+
 	if (!ops->init || (err = ops->init(sch, tca[TCA_OPTIONS])) == 0) {
-		if (qdisc_is_percpu_stats(sch)) {
+		/* qdisc_alloc() took care of ops->static_flags */
+		if (qdisc_is_percpu_stats(sch) && !sch->cpu_bstats) {
 			sch->cpu_bstats =
 				netdev_alloc_pcpu_stats(struct gnet_stats_basic_cpu);
 			if (!sch->cpu_bstats)
@@ -992,6 +1014,10 @@ qdisc_create(struct net_device *dev, struct netdev_queue *dev_queue,
 		return sch;
 	}
 err_out3:
+	if (qdisc_is_percpu_stats(sch)) {
+		free_percpu(sch->cpu_bstats);
+		free_percpu(sch->cpu_qstats);
+	}
 	dev_put(dev);
 	kfree((char *) sch - sch->padded);
 err_out2:
@@ -1001,8 +1027,6 @@ err_out:
 	return NULL;
 
 err_out4:
-	free_percpu(sch->cpu_bstats);
-	free_percpu(sch->cpu_qstats);
 	/*
 	 * Any broken qdiscs that would require a ops->reset() here?
 	 * The qdisc was never in action so it shouldn't be necessary.
@@ -1345,7 +1369,7 @@ static int tc_fill_qdisc(struct sk_buff *skb, struct Qdisc *q, u32 clid,
 		goto nla_put_failure;
 	if (q->ops->dump && q->ops->dump(q, skb) < 0)
 		goto nla_put_failure;
-	qlen = q->q.qlen;
+	qlen = qdisc_qlen_sum(q);
 
 	stab = rtnl_dereference(q->stab);
 	if (stab && qdisc_dump_stab(skb, stab) < 0)
@@ -211,6 +211,13 @@ static void fq_gc(struct fq_sched_data *q,
 	}
 }
 
+/* We pace the flow, so TCP does not need to do it itself */
+static void fq_claim_pacing(struct sock *sk, const struct fq_sched_data *q)
+{
+	if (q->rate_enable && sk_fullsock(sk))
+		smp_store_release(&sk->sk_pacing_status, SK_PACING_FQ);
+}
+
 static struct fq_flow *fq_classify(struct sk_buff *skb, struct fq_sched_data *q)
 {
 	struct rb_node **p, *parent;
@@ -251,6 +258,7 @@ static struct fq_flow *fq_classify(struct sk_buff *skb, struct fq_sched_data *q)
 				     f->socket_hash != sk->sk_hash)) {
 				f->credit = q->initial_quantum;
 				f->socket_hash = sk->sk_hash;
+				fq_claim_pacing(sk, q);
 				f->time_next_packet = 0ULL;
 			}
 			return f;
@@ -268,8 +276,10 @@ static struct fq_flow *fq_classify(struct sk_buff *skb, struct fq_sched_data *q)
 	}
 	fq_flow_set_detached(f);
 	f->sk = sk;
-	if (skb->sk)
+	if (skb->sk) {
 		f->socket_hash = sk->sk_hash;
+		fq_claim_pacing(sk, q);
+	}
 	f->credit = q->initial_quantum;
 
 	rb_link_node(&f->fq_node, parent, p);
@@ -471,7 +481,7 @@ begin:
 		goto out;
 
 	rate = q->flow_max_rate;
-	if (skb->sk && skb->sk->sk_state != TCP_TIME_WAIT)
+	if (skb->sk && sk_fullsock(skb->sk))
 		rate = min(skb->sk->sk_pacing_rate, rate);
 
 	if (rate != ~0U) {
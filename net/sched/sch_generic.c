@@ -26,6 +26,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/if_vlan.h>
+#include <linux/ptr_ring.h>
 #include <net/sch_generic.h>
 #include <net/pkt_sched.h>
 #include <net/dst.h>
@@ -43,18 +44,38 @@ EXPORT_SYMBOL(default_qdisc_ops);
  * - enqueue, dequeue are serialized via qdisc root lock
  * - ingress filtering is also serialized via qdisc root lock
  * - updates to tree and tree walking are only done under the rtnl mutex.
+ *
+ * TCQ_F_NOLOCK qdiscs serialize enqueue and dequeue themselves, and the
+ * seqlock held between qdisc_run_begin() and qdisc_run_end() stands in for
+ * the root lock on the dequeue side: only its owner dequeues or touches
+ * q->gso_skb.
  */
 
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
 	q->gso_skb = skb;
-	q->qstats.requeues++;
-	q->q.qlen++;	/* it's still part of the queue */
+	if (q->flags & TCQ_F_NOLOCK) {
+		qdisc_qstats_cpu_requeues_inc(q);
+		qdisc_qstats_cpu_qlen_inc(q);
+	} else {
+		q->qstats.requeues++;
+		q->q.qlen++;	/* it's still part of the queue */
+	}
 	__netif_schedule(q);
 
 	return 0;
 }
 
+/* Non-zero while there may be more to send.  A lockless qdisc can not
+ * tell cheaply, so keep going until its dequeue comes back empty.
+ */
+static inline int qdisc_restart_qlen(const struct Qdisc *q)
+{
+	if (q->flags & TCQ_F_NOLOCK)
+		return 1;
+	return qdisc_qlen(q);
+}
+
 static void try_bulk_dequeue_skb(struct Qdisc *q,
 				 struct sk_buff *skb,
 				 const struct netdev_queue *txq,
@@ -92,7 +113,10 @@ static struct sk_buff *dequeue_skb(struct Qdisc *q, bool *validate,
 		txq = skb_get_tx_queue(txq->dev, skb);
 		if (!netif_xmit_frozen_or_stopped(txq)) {
 			q->gso_skb = NULL;
-			q->q.qlen--;
+			if (q->flags & TCQ_F_NOLOCK)
+				qdisc_qstats_cpu_qlen_dec(q);
+			else
+				q->q.qlen--;
 		} else
 			skb = NULL;
 		/* skb in gso_skb were already validated */
@@ -124,7 +148,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		kfree_skb_list(skb);
 		net_warn_ratelimited("Dead loop on netdevice %s, fix it urgently!\n",
 				     dev_queue->dev->name);
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else {
 		/*
 		 * Another cpu is holding lock, requeue & delay xmits for
@@ -140,7 +164,8 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 /*
  * Transmit possibly several skbs, and handle the return status as
  * required. Holding the __QDISC___STATE_RUNNING bit guarantees that
- * only one CPU can execute this function.
+ * only one CPU can execute this function.  @root_lock is NULL for
+ * TCQ_F_NOLOCK qdiscs.
  *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
@@ -153,7 +178,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 	int ret = NETDEV_TX_BUSY;
 
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (root_lock)
+		spin_unlock(root_lock);
 
 	/* Note that we validate skb (GSO, checksum, ...) outside of locks */
 	if (validate)
@@ -166,11 +192,12 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 
 		HARD_TX_UNLOCK(dev, txq);
 	}
-	spin_lock(root_lock);
+	if (root_lock)
+		spin_lock(root_lock);
 
 	if (dev_xmit_complete(ret)) {
 		/* Driver sent out skb successfully or skb was consumed */
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
 		ret = handle_dev_cpu_collision(skb, txq, q);
@@ -190,7 +217,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH, or with
+ * q->seqlock held for TCQ_F_NOLOCK qdiscs.
  *
  * __QDISC___STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -221,7 +249,7 @@ static inline int qdisc_restart(struct Qdisc *q, int *packets)
 	if (unlikely(!skb))
 		return 0;
 
-	root_lock = qdisc_lock(q);
+	root_lock = (q->flags & TCQ_F_NOLOCK) ? NULL : qdisc_lock(q);
 	dev = qdisc_dev(q);
 	txq = skb_get_tx_queue(dev, skb);
 
@@ -233,6 +261,14 @@ void __qdisc_run(struct Qdisc *q)
 	int quota = weight_p;
 	int packets;
 
+	if (q->flags & TCQ_F_NOLOCK) {
+		/* Anything enqueued from here on either is seen below, or
+		 * sets the bit again and gets us rescheduled.
+		 */
+		clear_bit(__QDISC_STATE_MISSED, &q->state);
+		smp_mb__after_atomic();
+	}
+
 	while (qdisc_restart(q, &packets)) {
 		/*
 		 * Ordered by possible occurrence: Postpone processing if
@@ -449,93 +485,129 @@ static const u8 prio2band[TC_PRIO_MAX + 1] = {
 
 /* 3-band FIFO queue: old style, but should be a bit faster than
    generic prio+fifo combination.
+
+   Each band is a ring of tx_queue_len entries, so at the root of a tx
+   queue enqueue and dequeue need no qdisc lock (TCQ_F_NOLOCK): producers
+   only contend with each other per band, and the single dequeuing CPU
+   does not take the producers' lock at all.  Below another qdisc it is
+   run under that qdisc's lock as usual.
  */
 
 #define PFIFO_FAST_BANDS 3
 
 /*
  * Private data for a pfifo_fast scheduler containing:
- * 	- queues for the three band
- * 	- bitmap indicating which of the bands contain skbs
+ * 	- rings for the three bands
  */
 struct pfifo_fast_priv {
-	u32 bitmap;
-	struct sk_buff_head q[PFIFO_FAST_BANDS];
+	struct ptr_ring q[PFIFO_FAST_BANDS];
 };
 
-/*
- * Convert a bitmap to the first band number where an skb is queued, where:
- * 	bitmap=0 means there are no skbs on any band.
- * 	bitmap=1 means there is an skb on band 0.
- *	bitmap=7 means there are skbs on all 3 bands, etc.
- */
-static const int bitmap2band[] = {-1, 0, 1, 0, 2, 0, 1, 0};
-
-static inline struct sk_buff_head *band2list(struct pfifo_fast_priv *priv,
-					     int band)
+static inline struct ptr_ring *band2list(struct pfifo_fast_priv *priv,
+					 int band)
 {
 	return priv->q + band;
 }
 
 static int pfifo_fast_enqueue(struct sk_buff *skb, struct Qdisc *qdisc)
 {
-	if (skb_queue_len(&qdisc->q) < qdisc_dev(qdisc)->tx_queue_len) {
-		int band = prio2band[skb->priority & TC_PRIO_MAX];
-		struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-		struct sk_buff_head *list = band2list(priv, band);
+	int band = prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct ptr_ring *ring = band2list(priv, band);
+	unsigned int pkt_len = qdisc_pkt_len(skb);
+
+	if (unlikely(ptr_ring_produce(ring, skb))) {
+		if (!qdisc_is_percpu_stats(qdisc))
+			return qdisc_drop(skb, qdisc);
+
+		qdisc_qstats_drop_cpu(qdisc);
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
+	}
 
-		priv->bitmap |= (1 << band);
+	/* From here on skb may already be dequeued by another CPU. */
+	if (qdisc_is_percpu_stats(qdisc)) {
+		qdisc_qstats_cpu_backlog_add(qdisc, pkt_len);
+		qdisc_qstats_cpu_qlen_inc(qdisc);
+	} else {
+		qdisc->qstats.backlog += pkt_len;
 		qdisc->q.qlen++;
-		return __qdisc_enqueue_tail(skb, qdisc, list);
 	}
 
-	return qdisc_drop(skb, qdisc);
+	return NET_XMIT_SUCCESS;
 }
 
 static struct sk_buff *pfifo_fast_dequeue(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
+	struct sk_buff *skb = NULL;
+	int band;
 
-	if (likely(band >= 0)) {
-		struct sk_buff_head *list = band2list(priv, band);
-		struct sk_buff *skb = __qdisc_dequeue_head(qdisc, list);
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++) {
+		struct ptr_ring *ring = band2list(priv, band);
 
-		qdisc->q.qlen--;
-		if (skb_queue_empty(list))
-			priv->bitmap &= ~(1 << band);
+		if (__ptr_ring_empty(ring))
+			continue;
+		skb = ptr_ring_consume(ring);
+	}
 
-		return skb;
+	if (likely(skb)) {
+		if (qdisc_is_percpu_stats(qdisc)) {
+			qdisc_qstats_cpu_backlog_dec(qdisc, skb);
+			qdisc_bstats_update_cpu(qdisc, skb);
+			qdisc_qstats_cpu_qlen_dec(qdisc);
+		} else {
+			qdisc_qstats_backlog_dec(qdisc, skb);
+			qdisc_bstats_update(qdisc, skb);
+			qdisc->q.qlen--;
+		}
 	}
 
-	return NULL;
+	return skb;
 }
 
+/* Only called by a parent qdisc, under its lock. */
 static struct sk_buff *pfifo_fast_peek(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
+	struct sk_buff *skb = NULL;
+	int band;
 
-	if (band >= 0) {
-		struct sk_buff_head *list = band2list(priv, band);
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++)
+		skb = __ptr_ring_peek(band2list(priv, band));
 
-		return skb_peek(list);
-	}
-
-	return NULL;
+	return skb;
 }
 
 static void pfifo_fast_reset(struct Qdisc *qdisc)
 {
-	int prio;
+	int i, band;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__qdisc_reset_queue(qdisc, band2list(priv, prio));
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		struct ptr_ring *ring = band2list(priv, band);
+		struct sk_buff *skb;
+
+		/* only set up if init got to this band */
+		if (!ring->queue)
+			continue;
 
-	priv->bitmap = 0;
-	qdisc->qstats.backlog = 0;
-	qdisc->q.qlen = 0;
+		while ((skb = ptr_ring_consume_bh(ring)) != NULL)
+			kfree_skb(skb);
+	}
+
+	if (qdisc_is_percpu_stats(qdisc)) {
+		for_each_possible_cpu(i) {
+			struct gnet_stats_queue *q;
+
+			q = per_cpu_ptr(qdisc->cpu_qstats, i);
+			q->backlog = 0;
+			q->qlen = 0;
+		}
+	} else {
+		qdisc->qstats.backlog = 0;
+		qdisc->q.qlen = 0;
+	}
 }
 
 static int pfifo_fast_dump(struct Qdisc *qdisc, struct sk_buff *skb)
@@ -551,27 +623,48 @@ nla_put_failure:
 	return -1;
 }
 
+static void pfifo_fast_destroy(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int band;
+
+	/* qdisc_destroy() has already emptied the rings through reset */
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		ptr_ring_cleanup(band2list(priv, band), NULL);
+}
+
 static int pfifo_fast_init(struct Qdisc *qdisc, struct nlattr *opt)
 {
-	int prio;
+	unsigned int qlen = qdisc_dev(qdisc)->tx_queue_len;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int band, err;
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__skb_queue_head_init(band2list(priv, prio));
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		err = ptr_ring_init(band2list(priv, band), qlen, GFP_KERNEL);
+		if (err)
+			goto err_rings;
+	}
 
 	/* Can by-pass the queue discipline */
 	qdisc->flags |= TCQ_F_CAN_BYPASS;
 	return 0;
+
+err_rings:
+	while (--band >= 0)
+		ptr_ring_cleanup(band2list(priv, band), NULL);
+	return err;
 }
 
 struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 	.id		=	"pfifo_fast",
 	.priv_size	=	sizeof(struct pfifo_fast_priv),
+	.static_flags	=	TCQ_F_NOLOCK | TCQ_F_CPUSTATS,
 	.enqueue	=	pfifo_fast_enqueue,
 	.dequeue	=	pfifo_fast_dequeue,
 	.peek		=	pfifo_fast_peek,
 	.init		=	pfifo_fast_init,
 	.reset		=	pfifo_fast_reset,
+	.destroy	=	pfifo_fast_destroy,
 	.dump		=	pfifo_fast_dump,
 	.owner		=	THIS_MODULE,
 };
@@ -609,6 +702,19 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	spin_lock_init(&sch->busylock);
 	lockdep_set_class(&sch->busylock,
 			  dev->qdisc_tx_busylock ?: &qdisc_tx_busylock);
+	spin_lock_init(&sch->seqlock);
+
+	sch->flags = ops->static_flags;
+	if (qdisc_is_percpu_stats(sch)) {
+		sch->cpu_bstats =
+			netdev_alloc_pcpu_stats(struct gnet_stats_basic_cpu);
+		if (!sch->cpu_bstats)
+			goto errout1;
+
+		sch->cpu_qstats = alloc_percpu(struct gnet_stats_queue);
+		if (!sch->cpu_qstats)
+			goto errout2;
+	}
 
 	sch->ops = ops;
 	sch->enqueue = ops->enqueue;
@@ -618,6 +724,10 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	atomic_set(&sch->refcnt, 1);
 
 	return sch;
+errout2:
+	free_percpu(sch->cpu_bstats);
+errout1:
+	kfree(p);
 errout:
 	return ERR_PTR(err);
 }
@@ -666,8 +776,10 @@ static void qdisc_rcu_free(struct rcu_head *head)
 {
 	struct Qdisc *qdisc = container_of(head, struct Qdisc, rcu_head);
 
-	if (qdisc_is_percpu_stats(qdisc))
+	if (qdisc_is_percpu_stats(qdisc)) {
 		free_percpu(qdisc->cpu_bstats);
+		free_percpu(qdisc->cpu_qstats);
+	}
 
 	kfree((char *) qdisc - qdisc->padded);
 }
@@ -822,6 +934,11 @@ static void dev_deactivate_queue(struct net_device *dev,
 
 	qdisc = rtnl_dereference(dev_queue->qdisc);
 	if (qdisc) {
+		bool nolock = qdisc->flags & TCQ_F_NOLOCK;
+
+		/* keep a running lockless qdisc off q->gso_skb */
+		if (nolock)
+			spin_lock_bh(&qdisc->seqlock);
 		spin_lock_bh(qdisc_lock(qdisc));
 
 		if (!(qdisc->flags & TCQ_F_BUILTIN))
@@ -831,6 +948,8 @@ static void dev_deactivate_queue(struct net_device *dev,
 		qdisc_reset(qdisc);
 
 		spin_unlock_bh(qdisc_lock(qdisc));
+		if (nolock)
+			spin_unlock_bh(&qdisc->seqlock);
 	}
 }
 
@@ -233,13 +233,8 @@ static int mqprio_dump(struct Qdisc *sch, struct sk_buff *skb)
 	for (i = 0; i < dev->num_tx_queues; i++) {
 		qdisc = rtnl_dereference(netdev_get_tx_queue(dev, i)->qdisc);
 		spin_lock_bh(qdisc_lock(qdisc));
-		sch->q.qlen		+= qdisc->q.qlen;
-		sch->bstats.bytes	+= qdisc->bstats.bytes;
-		sch->bstats.packets	+= qdisc->bstats.packets;
-		sch->qstats.backlog	+= qdisc->qstats.backlog;
-		sch->qstats.drops	+= qdisc->qstats.drops;
-		sch->qstats.requeues	+= qdisc->qstats.requeues;
-		sch->qstats.overlimits	+= qdisc->qstats.overlimits;
+		sch->q.qlen		+= qdisc_qlen_sum(qdisc);
+		qdisc_stats_add(&sch->bstats, &sch->qstats, qdisc);
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 
@@ -344,13 +339,8 @@ static int mqprio_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 
 			qdisc = rtnl_dereference(q->qdisc);
 			spin_lock_bh(qdisc_lock(qdisc));
-			qlen		  += qdisc->q.qlen;
-			bstats.bytes      += qdisc->bstats.bytes;
-			bstats.packets    += qdisc->bstats.packets;
-			qstats.backlog    += qdisc->qstats.backlog;
-			qstats.drops      += qdisc->qstats.drops;
-			qstats.requeues   += qdisc->qstats.requeues;
-			qstats.overlimits += qdisc->qstats.overlimits;
+			qlen += qdisc_qlen_sum(qdisc);
+			qdisc_stats_add(&bstats, &qstats, qdisc);
 			spin_unlock_bh(qdisc_lock(qdisc));
 		}
 		/* Reclaim root sleeping lock before completing stats */
@@ -360,11 +350,18 @@ static int mqprio_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 			return -1;
 	} else {
 		struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
+		struct gnet_stats_basic_cpu __percpu *cpu_bstats = NULL;
+		struct gnet_stats_queue __percpu *cpu_qstats = NULL;
 
 		sch = dev_queue->qdisc_sleeping;
-		if (gnet_stats_copy_basic(d, NULL, &sch->bstats) < 0 ||
-		    gnet_stats_copy_queue(d, NULL,
-					  &sch->qstats, sch->q.qlen) < 0)
+		if (qdisc_is_percpu_stats(sch)) {
+			cpu_bstats = sch->cpu_bstats;
+			cpu_qstats = sch->cpu_qstats;
+		}
+
+		if (gnet_stats_copy_basic(d, cpu_bstats, &sch->bstats) < 0 ||
+		    gnet_stats_copy_queue(d, cpu_qstats,
+					  &sch->qstats, qdisc_qlen_sum(sch)) < 0)
 			return -1;
 	}
 	return 0;
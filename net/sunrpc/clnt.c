@@ -352,6 +352,101 @@ static void rpc_free_clid(struct rpc_clnt *clnt)
 	ida_simple_remove(&rpc_clids, clnt->cl_clid);
 }
 
+static void rpc_free_xprt_set(struct rpc_xprt_set *set)
+{
+	unsigned int i;
+
+	if (set == NULL)
+		return;
+	for (i = 0; i < set->nr; i++)
+		xprt_put(set->xprt[i]);
+	kfree(set);
+}
+
+/*
+ * Open @nr more transports to the server of @clnt.  Tasks are spread
+ * over them and cl_xprt in turn, so that traffic to one server is not
+ * bound to a single connection.
+ */
+static int rpc_clnt_add_xprts(struct rpc_clnt *clnt, struct xprt_create *args,
+		unsigned int nr, int resvport)
+{
+	struct rpc_xprt_set *set;
+	struct rpc_xprt *xprt;
+
+	set = kzalloc(sizeof(*set) + nr * sizeof(set->xprt[0]), GFP_KERNEL);
+	if (set == NULL)
+		return -ENOMEM;
+	while (set->nr < nr) {
+		xprt = xprt_create_transport(args);
+		if (IS_ERR(xprt)) {
+			rpc_free_xprt_set(set);
+			return PTR_ERR(xprt);
+		}
+		xprt->resvport = resvport;
+		set->xprt[set->nr++] = xprt;
+	}
+	rcu_assign_pointer(clnt->cl_xprt_set, set);
+	return 0;
+}
+
+/*
+ * Let a clone share the extra transports of its parent.
+ */
+static int rpc_clnt_clone_xprts(struct rpc_clnt *new, struct rpc_clnt *clnt)
+{
+	struct rpc_xprt_set *set, *old;
+	struct rpc_xprt *xprt;
+	unsigned int i;
+
+	rcu_read_lock();
+	old = rcu_dereference(clnt->cl_xprt_set);
+	if (old == NULL) {
+		rcu_read_unlock();
+		return 0;
+	}
+	set = kzalloc(sizeof(*set) + old->nr * sizeof(set->xprt[0]),
+			GFP_ATOMIC);
+	if (set == NULL) {
+		rcu_read_unlock();
+		return -ENOMEM;
+	}
+	for (i = 0; i < old->nr; i++) {
+		xprt = xprt_get(old->xprt[i]);
+		if (xprt != NULL)
+			set->xprt[set->nr++] = xprt;
+	}
+	rcu_read_unlock();
+	rcu_assign_pointer(new->cl_xprt_set, set);
+	return 0;
+}
+
+/*
+ * Pick the transport a new task will use.  Swap is only set up on
+ * cl_xprt, so a client used for swap keeps every task on it.
+ */
+static struct rpc_xprt *rpc_task_get_xprt(struct rpc_clnt *clnt)
+{
+	struct rpc_xprt_set *set;
+	struct rpc_xprt *xprt, *primary;
+	unsigned int n;
+
+	rcu_read_lock();
+	primary = rcu_dereference(clnt->cl_xprt);
+	xprt = NULL;
+	set = rcu_dereference(clnt->cl_xprt_set);
+	if (set != NULL && set->nr != 0 && !primary->swapper) {
+		n = (unsigned int)atomic_inc_return(&clnt->cl_xprt_next) %
+			(set->nr + 1);
+		if (n != 0)
+			xprt = xprt_get(set->xprt[n - 1]);
+	}
+	if (xprt == NULL)
+		xprt = xprt_get(primary);
+	rcu_read_unlock();
+	return xprt;
+}
+
 static struct rpc_clnt * rpc_new_client(const struct rpc_create_args *args,
 		struct rpc_xprt *xprt,
 		struct rpc_clnt *parent)
@@ -485,6 +580,8 @@ EXPORT_SYMBOL_GPL(rpc_create_xprt);
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
 	struct rpc_xprt *xprt;
+	struct rpc_clnt *clnt;
+	int err;
 	struct xprt_create xprtargs = {
 		.net = args->net,
 		.ident = args->protocol,
@@ -548,7 +645,17 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt) || args->nconnect <= 1)
+		return clnt;
+
+	err = rpc_clnt_add_xprts(clnt, &xprtargs, args->nconnect - 1,
+			!(args->flags & RPC_CLNT_CREATE_NONPRIVPORT));
+	if (err) {
+		rpc_shutdown_client(clnt);
+		return ERR_PTR(err);
+	}
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -578,6 +685,12 @@ static struct rpc_clnt *__rpc_clone_client(struct rpc_create_args *args,
 		goto out_err;
 	}
 
+	err = rpc_clnt_clone_xprts(new, clnt);
+	if (err) {
+		rpc_release_client(new);
+		goto out_err;
+	}
+
 	/* Turn off autobind on clones */
 	new->cl_autobind = 0;
 	new->cl_softrtry = clnt->cl_softrtry;
@@ -652,6 +765,7 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 {
 	const struct rpc_timeout *old_timeo;
 	rpc_authflavor_t pseudoflavor;
+	struct rpc_xprt_set *old_set;
 	struct rpc_xprt *xprt, *old;
 	struct rpc_clnt *parent;
 	int err;
@@ -688,10 +802,15 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 	if (err)
 		goto out_revert;
 
+	/* The extra transports still lead to the old server */
+	old_set = rcu_dereference_protected(clnt->cl_xprt_set, 1);
+	RCU_INIT_POINTER(clnt->cl_xprt_set, NULL);
+
 	synchronize_rcu();
 	if (parent != clnt)
 		rpc_release_client(parent);
 	xprt_put(old);
+	rpc_free_xprt_set(old_set);
 	dprintk("RPC:       replaced xprt for clnt %p\n", clnt);
 	return 0;
 
@@ -776,6 +895,7 @@ rpc_free_client(struct rpc_clnt *clnt)
 	rpc_free_iostats(clnt->cl_metrics);
 	clnt->cl_metrics = NULL;
 	xprt_put(rcu_dereference_raw(clnt->cl_xprt));
+	rpc_free_xprt_set(rcu_dereference_raw(clnt->cl_xprt_set));
 	rpciod_down();
 	rpc_free_clid(clnt);
 	kfree(clnt);
@@ -869,6 +989,10 @@ void rpc_task_release_client(struct rpc_task *task)
 		spin_unlock(&clnt->cl_lock);
 		task->tk_client = NULL;
 
+		if (task->tk_xprt != NULL) {
+			xprt_put(task->tk_xprt);
+			task->tk_xprt = NULL;
+		}
 		rpc_release_client(clnt);
 	}
 }
@@ -880,19 +1004,13 @@ void rpc_task_set_client(struct rpc_task *task, struct rpc_clnt *clnt)
 		rpc_task_release_client(task);
 		task->tk_client = clnt;
 		atomic_inc(&clnt->cl_count);
+		task->tk_xprt = rpc_task_get_xprt(clnt);
 		if (clnt->cl_softrtry)
 			task->tk_flags |= RPC_TASK_SOFT;
 		if (clnt->cl_noretranstimeo)
 			task->tk_flags |= RPC_TASK_NO_RETRANS_TIMEOUT;
-		if (sk_memalloc_socks()) {
-			struct rpc_xprt *xprt;
-
-			rcu_read_lock();
-			xprt = rcu_dereference(clnt->cl_xprt);
-			if (xprt->swapper)
-				task->tk_flags |= RPC_TASK_SWAPPER;
-			rcu_read_unlock();
-		}
+		if (sk_memalloc_socks() && task->tk_xprt->swapper)
+			task->tk_flags |= RPC_TASK_SWAPPER;
 		/* Add to the client's list of all tasks */
 		spin_lock(&clnt->cl_lock);
 		list_add_tail(&task->tk_task, &clnt->cl_tasks);
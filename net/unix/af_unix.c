@@ -520,6 +520,8 @@ static int unix_stream_sendmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t);
 static int unix_stream_recvmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t, int);
+static ssize_t unix_stream_sendpage(struct socket *, struct page *, int offset,
+				    size_t size, int flags);
 static int unix_dgram_sendmsg(struct kiocb *, struct socket *,
 			      struct msghdr *, size_t);
 static int unix_dgram_recvmsg(struct kiocb *, struct socket *,
@@ -563,7 +565,7 @@ static const struct proto_ops unix_stream_ops = {
 	.sendmsg =	unix_stream_sendmsg,
 	.recvmsg =	unix_stream_recvmsg,
 	.mmap =		sock_no_mmap,
-	.sendpage =	sock_no_sendpage,
+	.sendpage =	unix_stream_sendpage,
 	.set_peek_off =	unix_set_peek_off,
 };
 
@@ -1420,6 +1422,14 @@ static int unix_scm_to_skb(struct scm_cookie *scm, struct sk_buff *skb, bool sen
 	return err;
 }
 
+static bool unix_passcred_enabled(const struct socket *sock,
+				  const struct sock *other)
+{
+	return test_bit(SOCK_PASSCRED, &sock->flags) ||
+	       !other->sk_socket ||
+	       test_bit(SOCK_PASSCRED, &other->sk_socket->flags);
+}
+
 /*
  * Some apps rely on write() giving SCM_CREDENTIALS
  * We include credentials if source or destination socket
@@ -1430,14 +1440,26 @@ static void maybe_add_creds(struct sk_buff *skb, const struct socket *sock,
 {
 	if (UNIXCB(skb).pid)
 		return;
-	if (test_bit(SOCK_PASSCRED, &sock->flags) ||
-	    !other->sk_socket ||
-	    test_bit(SOCK_PASSCRED, &other->sk_socket->flags)) {
+	if (unix_passcred_enabled(sock, other)) {
 		UNIXCB(skb).pid  = get_pid(task_tgid(current));
 		current_uid_gid(&UNIXCB(skb).uid, &UNIXCB(skb).gid);
 	}
 }
 
+/* Same as maybe_add_creds(), but on the cookie, so that the credentials
+ * of data about to be sent can be compared with those of a queued skb.
+ */
+static void maybe_init_creds(struct scm_cookie *scm, const struct socket *sock,
+			     const struct sock *other)
+{
+	if (scm->pid)
+		return;
+	if (unix_passcred_enabled(sock, other)) {
+		scm->pid = get_pid(task_tgid(current));
+		current_uid_gid(&scm->creds.uid, &scm->creds.gid);
+	}
+}
+
 /*
  *	Send AF_UNIX data.
  */
@@ -1625,6 +1647,102 @@ out:
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* Writes up to this size are appended to the last skb of the peer rather
+ * than getting an skb of their own.
+ */
+#define UNIX_SKB_COALESCE_MAX	1024
+
+/* Data may be glued to a queued skb only if the reader could not tell it
+ * from data sent in the same write: same credentials and no fds, which
+ * end a read.
+ */
+static bool unix_skb_can_append(const struct sk_buff *skb,
+				const struct scm_cookie *scm, size_t size)
+{
+	return !UNIXCB(skb).fp &&
+	       UNIXCB(skb).pid == scm->pid &&
+	       uid_eq(UNIXCB(skb).uid, scm->creds.uid) &&
+	       gid_eq(UNIXCB(skb).gid, scm->creds.gid) &&
+	       skb->len + size <= UNIX_SKB_FRAGS_SZ;
+}
+
+/* Queue @size bytes at @offset in @page to the peer of @sock, by reference.
+ * They are appended to the last skb of the peer's receive queue when it
+ * can take them, otherwise to a new skb.  The peer's readlock is taken as
+ * the skb may be read concurrently otherwise.
+ */
+static int unix_stream_append_page(struct socket *sock, struct sock *other,
+				   struct page *page, int offset, size_t size,
+				   struct scm_cookie *scm, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct unix_sock *u = unix_sk(other);
+	struct sk_buff *skb, *newskb = NULL;
+	int err;
+
+	for (;;) {
+		if (mutex_lock_interruptible(&u->readlock)) {
+			err = flags & MSG_DONTWAIT ? -EAGAIN : -ERESTARTSYS;
+			goto out;
+		}
+		unix_state_lock(other);
+
+		err = -EPIPE;
+		if (sock_flag(other, SOCK_DEAD) ||
+		    (other->sk_shutdown & RCV_SHUTDOWN))
+			goto out_unlock;
+
+		maybe_init_creds(scm, sock, other);
+
+		skb = skb_peek_tail(&other->sk_receive_queue);
+		if (skb &&
+		    atomic_read(&sk->sk_wmem_alloc) < sk->sk_sndbuf &&
+		    unix_skb_can_append(skb, scm, size) &&
+		    !skb_append_pagefrags(skb, page, offset, size))
+			break;
+
+		if (newskb) {
+			skb = newskb;
+			skb_append_pagefrags(skb, page, offset, size);
+			break;
+		}
+
+		unix_state_unlock(other);
+		mutex_unlock(&u->readlock);
+
+		/* blocks for sndbuf space, unlike appending to the tail */
+		newskb = sock_alloc_send_pskb(sk, 0, 0, flags & MSG_DONTWAIT,
+					      &err, 0);
+		if (!newskb)
+			goto out;
+		unix_scm_to_skb(scm, newskb, false);
+	}
+
+	skb->len += size;
+	skb->data_len += size;
+	skb->truesize += size;
+	atomic_add(size, &sk->sk_wmem_alloc);
+
+	if (skb == newskb) {
+		skb_queue_tail(&other->sk_receive_queue, newskb);
+		newskb = NULL;
+	}
+
+	unix_state_unlock(other);
+	mutex_unlock(&u->readlock);
+	other->sk_data_ready(other);
+	err = 0;
+	goto out;
+
+out_unlock:
+	unix_state_unlock(other);
+	mutex_unlock(&u->readlock);
+out:
+	/* the tail was usable again by the time newskb was allocated */
+	consume_skb(newskb);
+	return err;
+}
+
 static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			       struct msghdr *msg, size_t len)
 {
@@ -1663,6 +1781,30 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if (len && len <= UNIX_SKB_COALESCE_MAX && !siocb->scm->fp) {
+		/* per task, so concurrent writers on sk never share it */
+		struct page_frag *pfrag = &current->task_frag;
+		int offset;
+
+		err = -ENOMEM;
+		if (!skb_page_frag_refill(len, pfrag, sk->sk_allocation))
+			goto out_err;
+		offset = pfrag->offset;
+		err = memcpy_fromiovecend(page_address(pfrag->page) + offset,
+					  msg->msg_iov, 0, len);
+		if (err)
+			goto out_err;
+		pfrag->offset += len;
+
+		err = unix_stream_append_page(sock, other, pfrag->page, offset,
+					      len, siocb->scm, msg->msg_flags);
+		if (err == -EPIPE)
+			goto pipe_err;
+		if (err)
+			goto out_err;
+		sent = len;
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
@@ -1734,6 +1876,41 @@ out_err:
 	return sent ? : err;
 }
 
+static ssize_t unix_stream_sendpage(struct socket *sock, struct page *page,
+				    int offset, size_t size, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct msghdr msg = { .msg_controllen = 0 };
+	struct scm_cookie scm;
+	struct sock *other;
+	int err;
+
+	if (flags & MSG_OOB)
+		return -EOPNOTSUPP;
+
+	other = unix_peer(sk);
+	if (!other || sk->sk_state != TCP_ESTABLISHED)
+		return -ENOTCONN;
+
+	err = -EPIPE;
+	if (sk->sk_shutdown & SEND_SHUTDOWN)
+		goto pipe_err;
+
+	err = scm_send(sock, &msg, &scm, false);
+	if (err < 0)
+		return err;
+	err = unix_stream_append_page(sock, other, page, offset, size, &scm,
+				      flags);
+	scm_destroy(&scm);
+	if (!err)
+		return size;
+
+pipe_err:
+	if (err == -EPIPE && !(flags & MSG_NOSIGNAL))
+		send_sig(SIGPIPE, current, 0);
+	return err;
+}
+
 static int unix_seqpacket_sendmsg(struct kiocb *kiocb, struct socket *sock,
 				  struct msghdr *msg, size_t len)
 {
@@ -1879,8 +2056,9 @@ out:
  *	Sleep until more data has arrived. But check for races..
  */
 static long unix_stream_data_wait(struct sock *sk, long timeo,
-				  struct sk_buff *last)
+				  struct sk_buff *last, unsigned int last_len)
 {
+	struct sk_buff *tail;
 	DEFINE_WAIT(wait);
 
 	unix_state_lock(sk);
@@ -1888,7 +2066,10 @@ static long unix_stream_data_wait(struct sock *sk, long timeo,
 	for (;;) {
 		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
 
-		if (skb_peek_tail(&sk->sk_receive_queue) != last ||
+		/* writers may also append to the last skb */
+		tail = skb_peek_tail(&sk->sk_receive_queue);
+		if (tail != last ||
+		    (tail && tail->len != last_len) ||
 		    sk->sk_err ||
 		    (sk->sk_shutdown & RCV_SHUTDOWN) ||
 		    signal_pending(current) ||
@@ -1928,6 +2109,7 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 	int err = 0;
 	long timeo;
 	int skip;
+	unsigned int last_len;
 
 	err = -EINVAL;
 	if (sk->sk_state != TCP_ESTABLISHED)
@@ -1964,6 +2146,7 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 
 		unix_state_lock(sk);
 		last = skb = skb_peek(&sk->sk_receive_queue);
+		last_len = last ? last->len : 0;
 again:
 		if (skb == NULL) {
 			unix_sk(sk)->recursion_level = 0;
@@ -1986,7 +2169,8 @@ again:
 				break;
 			mutex_unlock(&u->readlock);
 
-			timeo = unix_stream_data_wait(sk, timeo, last);
+			timeo = unix_stream_data_wait(sk, timeo, last,
+						      last_len);
 
 			if (signal_pending(current)
 			    ||  mutex_lock_interruptible(&u->readlock)) {
@@ -2004,6 +2188,7 @@ again:
 		while (skip >= unix_skb_len(skb)) {
 			skip -= unix_skb_len(skb);
 			last = skb;
+			last_len = skb->len;
 			skb = skb_peek_next(skb, &sk->sk_receive_queue);
 			if (!skb)
 				goto again;
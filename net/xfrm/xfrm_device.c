@@ -0,0 +1,113 @@
+/*
+ * xfrm_device.c - IPsec crypto offload to network devices.
+ *
+ * A state bound to a device through XFRMA_OFFLOAD_DEV is installed in
+ * the device, which then does the encryption or decryption of its
+ * packets: ESP headers, trailers and sequence numbers stay with the
+ * stack, only the crypto is skipped in software. Keys are kept in the
+ * state as usual, so packets the device can not handle still go through
+ * software crypto.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <net/dst.h>
+#include <net/xfrm.h>
+
+int xfrm_dev_state_add(struct net *net, struct xfrm_state *x,
+		       struct xfrm_user_offload *xuo)
+{
+	struct xfrm_state_offload *xso = &x->xso;
+	struct net_device *dev;
+	int err;
+
+	/* only ESP over IPv4 knows how to skip its crypto so far */
+	if (x->id.proto != IPPROTO_ESP || x->props.family != AF_INET ||
+	    x->encap)
+		return -EINVAL;
+
+	if (xuo->flags & ~XFRM_OFFLOAD_INBOUND)
+		return -EINVAL;
+
+	dev = dev_get_by_index(net, xuo->ifindex);
+	if (!dev)
+		return -ENODEV;
+
+	if (!dev->xfrmdev_ops || !dev->xfrmdev_ops->xdo_dev_state_add ||
+	    !(dev->features & NETIF_F_HW_ESP)) {
+		dev_put(dev);
+		return -EOPNOTSUPP;
+	}
+
+	xso->dev = dev;
+	xso->flags = xuo->flags;
+
+	err = dev->xfrmdev_ops->xdo_dev_state_add(x);
+	if (err) {
+		xso->dev = NULL;
+		dev_put(dev);
+		return err;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xfrm_dev_state_add);
+
+/* Tell whether the crypto of an outgoing packet can be left to the device
+ * of its state: the packet must leave through that device with this state
+ * as its outermost transformation.
+ */
+bool xfrm_dev_offload_ok(struct sk_buff *skb, struct xfrm_state *x)
+{
+	struct dst_entry *dst = skb_dst(skb);
+	struct net_device *dev = x->xso.dev;
+
+	if (!dev || (x->xso.flags & XFRM_OFFLOAD_INBOUND))
+		return false;
+
+	if (!dst || dst->path->dev != dev || dst->child->xfrm)
+		return false;
+
+	if (!(dev->features & NETIF_F_HW_ESP))
+		return false;
+
+	if (dev->xfrmdev_ops->xdo_dev_offload_ok)
+		return dev->xfrmdev_ops->xdo_dev_offload_ok(skb, x);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(xfrm_dev_offload_ok);
+
+/* Give an outgoing packet the sec_path its driver finds the state and the
+ * offload parameters in. Returns NULL if none could be allocated, the
+ * packet then has to be encrypted in software.
+ */
+struct xfrm_offload *xfrm_dev_offload_attach(struct sk_buff *skb,
+					     struct xfrm_state *x)
+{
+	struct xfrm_offload *xo;
+	struct sec_path *sp;
+
+	sp = secpath_dup(NULL);
+	if (!sp)
+		return NULL;
+
+	xfrm_state_hold(x);
+	sp->xvec[sp->len++] = x;
+	xo = &sp->ovec[sp->olen++];
+	memset(xo, 0, sizeof(*xo));
+
+	/* whatever the packet was received with is of no use anymore */
+	secpath_put(skb->sp);
+	skb->sp = sp;
+
+	return xo;
+}
+EXPORT_SYMBOL_GPL(xfrm_dev_offload_attach);
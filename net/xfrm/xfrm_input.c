@@ -109,6 +109,7 @@ struct sec_path *secpath_dup(struct sec_path *src)
 		return NULL;
 
 	sp->len = 0;
+	sp->olen = 0;
 	if (src) {
 		int i;
 
@@ -186,6 +187,8 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 	struct xfrm_state *x = NULL;
 	xfrm_address_t *daddr;
 	struct xfrm_mode *inner_mode;
+	struct xfrm_offload *xo;
+	bool crypto_done = false;
 	unsigned int family;
 	int decaps = 0;
 	int async = 0;
@@ -223,20 +226,49 @@ int xfrm_input(struct sk_buff *skb, int nexthdr, __be32 spi, int encap_type)
 		goto drop;
 	}
 
+	/* the driver of a device that decrypted the packet already put the
+	 * state it used on the sec_path
+	 */
+	xo = xfrm_offload(skb);
+	if (xo && (xo->flags & CRYPTO_DONE))
+		crypto_done = true;
+
 	do {
-		if (skb->sp->len == XFRM_MAX_DEPTH) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMINBUFFERERROR);
-			goto drop;
-		}
+		if (crypto_done) {
+			x = xfrm_input_state(skb);
 
-		x = xfrm_state_lookup(net, skb->mark, daddr, spi, nexthdr, family);
-		if (x == NULL) {
-			XFRM_INC_STATS(net, LINUX_MIB_XFRMINNOSTATES);
-			xfrm_audit_state_notfound(skb, family, spi, seq);
-			goto drop;
-		}
+			if (unlikely(x->id.spi != spi)) {
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINNOSTATES);
+				goto drop;
+			}
 
-		skb->sp->xvec[skb->sp->len++] = x;
+			if (!(xo->status & CRYPTO_SUCCESS)) {
+				if (xo->status & CRYPTO_AUTH_FAILED) {
+					xfrm_audit_state_icvfail(x, skb,
+								 x->type->proto);
+					x->stats.integrity_failed++;
+					XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEPROTOERROR);
+				} else {
+					XFRM_INC_STATS(net, LINUX_MIB_XFRMINBUFFERERROR);
+				}
+				goto drop;
+			}
+		} else {
+			if (skb->sp->len == XFRM_MAX_DEPTH) {
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINBUFFERERROR);
+				goto drop;
+			}
+
+			x = xfrm_state_lookup(net, skb->mark, daddr, spi,
+					      nexthdr, family);
+			if (x == NULL) {
+				XFRM_INC_STATS(net, LINUX_MIB_XFRMINNOSTATES);
+				xfrm_audit_state_notfound(skb, family, spi, seq);
+				goto drop;
+			}
+
+			skb->sp->xvec[skb->sp->len++] = x;
+		}
 
 		if (xfrm_tunnel_check(skb, x, family)) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATEMODEERROR);
@@ -294,8 +326,11 @@ resume:
 			goto drop_unlock;
 		}
 
-		/* only the first xfrm gets the encap type */
+		/* only the first xfrm gets the encap type, and can have
+		 * been decrypted by the device
+		 */
 		encap_type = 0;
+		crypto_done = false;
 
 		if (async && x->repl->recheck(x, skb, seq)) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATESEQERROR);
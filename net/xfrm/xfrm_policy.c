@@ -2909,7 +2909,13 @@ static int xfrm_dev_event(struct notifier_block *this, unsigned long event, void
 
 	switch (event) {
 	case NETDEV_DOWN:
+		xfrm_dev_state_flush(dev_net(dev), dev);
 		xfrm_garbage_collect(dev_net(dev));
+		break;
+	case NETDEV_UNREGISTER:
+		/* the states hold a reference on the device they use */
+		xfrm_dev_state_flush(dev_net(dev), dev);
+		break;
 	}
 	return NOTIFY_DONE;
 }
@@ -87,7 +87,7 @@ static void xfrm_hash_transfer(struct hlist_head *list,
 			h = __xfrm_spi_hash(&x->id.daddr, x->id.spi,
 					    x->id.proto, x->props.family,
 					    nhashmask);
-			hlist_add_head(&x->byspi, nspitable+h);
+			hlist_add_head_rcu(&x->byspi, nspitable+h);
 		}
 	}
 }
@@ -122,6 +122,7 @@ static void xfrm_hash_resize(struct work_struct *work)
 	}
 
 	spin_lock_bh(&net->xfrm.xfrm_state_lock);
+	write_seqcount_begin(&net->xfrm.state_hash_generation);
 
 	nhashmask = (nsize / sizeof(struct hlist_head)) - 1U;
 	for (i = net->xfrm.state_hmask; i >= 0; i--)
@@ -136,10 +137,18 @@ static void xfrm_hash_resize(struct work_struct *work)
 	net->xfrm.state_bydst = ndst;
 	net->xfrm.state_bysrc = nsrc;
 	net->xfrm.state_byspi = nspi;
+	/* the bigger table must be visible before its mask,
+	 * see xfrm_state_lookup()
+	 */
+	smp_wmb();
 	net->xfrm.state_hmask = nhashmask;
 
+	write_seqcount_end(&net->xfrm.state_hash_generation);
 	spin_unlock_bh(&net->xfrm.xfrm_state_lock);
 
+	/* lockless lookups may still walk the old spi table */
+	synchronize_rcu();
+
 	osize = (ohashmask + 1) * sizeof(struct hlist_head);
 	xfrm_hash_free(odst, osize);
 	xfrm_hash_free(osrc, osize);
@@ -332,6 +341,7 @@ static void xfrm_state_gc_destroy(struct xfrm_state *x)
 {
 	tasklet_hrtimer_cancel(&x->mtimer);
 	del_timer_sync(&x->rtimer);
+	xfrm_dev_state_free(x);
 	kfree(x->aalg);
 	kfree(x->ealg);
 	kfree(x->calg);
@@ -364,6 +374,11 @@ static void xfrm_state_gc_task(struct work_struct *work)
 	hlist_move_list(&net->xfrm.state_gc_list, &gc_list);
 	spin_unlock_bh(&xfrm_state_gc_lock);
 
+	/* wait for lockless lookups that found a state before it was
+	 * unhashed, xfrm_state_lookup() then failed to take a reference
+	 */
+	synchronize_rcu();
+
 	hlist_for_each_entry_safe(x, tmp, &gc_list, gclist)
 		xfrm_state_gc_destroy(x);
 }
@@ -523,10 +538,12 @@ int __xfrm_state_delete(struct xfrm_state *x)
 		hlist_del(&x->bydst);
 		hlist_del(&x->bysrc);
 		if (x->id.spi)
-			hlist_del(&x->byspi);
+			hlist_del_rcu(&x->byspi);
 		net->xfrm.state_num--;
 		spin_unlock(&net->xfrm.xfrm_state_lock);
 
+		xfrm_dev_state_delete(x);
+
 		/* All xfrm_state objects are created by xfrm_state_alloc.
 		 * The xfrm_state_alloc call gives a reference, and that
 		 * is what we are dropping here.
@@ -619,6 +636,43 @@ out:
 }
 EXPORT_SYMBOL(xfrm_state_flush);
 
+#ifdef CONFIG_XFRM_OFFLOAD
+/* delete the states whose crypto is done by 'dev', which is going away */
+int xfrm_dev_state_flush(struct net *net, struct net_device *dev)
+{
+	int i, err = 0, cnt = 0;
+
+	spin_lock_bh(&net->xfrm.xfrm_state_lock);
+
+	err = -ESRCH;
+	for (i = 0; i <= net->xfrm.state_hmask; i++) {
+		struct xfrm_state *x;
+restart:
+		hlist_for_each_entry(x, net->xfrm.state_bydst+i, bydst) {
+			if (x->xso.dev == dev) {
+				xfrm_state_hold(x);
+				spin_unlock_bh(&net->xfrm.xfrm_state_lock);
+
+				err = xfrm_state_delete(x);
+				xfrm_audit_state_delete(x, err ? 0 : 1, false);
+				xfrm_state_put(x);
+				if (!err)
+					cnt++;
+
+				spin_lock_bh(&net->xfrm.xfrm_state_lock);
+				goto restart;
+			}
+		}
+	}
+	if (cnt)
+		err = 0;
+
+	spin_unlock_bh(&net->xfrm.xfrm_state_lock);
+	return err;
+}
+EXPORT_SYMBOL(xfrm_dev_state_flush);
+#endif
+
 void xfrm_sad_getinfo(struct net *net, struct xfrmk_sadinfo *si)
 {
 	spin_lock_bh(&net->xfrm.xfrm_state_lock);
@@ -857,7 +911,7 @@ found:
 			hlist_add_head(&x->bysrc, net->xfrm.state_bysrc+h);
 			if (x->id.spi) {
 				h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto, encap_family);
-				hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+				hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 			}
 			x->lft.hard_add_expires_seconds = net->xfrm.sysctl_acq_expires;
 			tasklet_hrtimer_start(&x->mtimer, ktime_set(net->xfrm.sysctl_acq_expires, 0), HRTIMER_MODE_REL);
@@ -954,7 +1008,7 @@ static void __xfrm_state_insert(struct xfrm_state *x)
 		h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto,
 				  x->props.family);
 
-		hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+		hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 	}
 
 	tasklet_hrtimer_start(&x->mtimer, ktime_set(1, 0), HRTIMER_MODE_REL);
@@ -1388,15 +1442,56 @@ int xfrm_state_check_expire(struct xfrm_state *x)
 }
 EXPORT_SYMBOL(xfrm_state_check_expire);
 
+/* Lockless version of __xfrm_state_lookup(), run for every received IPsec
+ * packet. A concurrent resize may move states under our feet and make the
+ * walk miss, xfrm_state_hash_generation tells when to look again. The mask
+ * is read before the table: xfrm_hash_resize() publishes them in the
+ * reverse order, so a mask is never used on a table smaller than it.
+ */
+static struct xfrm_state *
+xfrm_state_lookup_rcu(struct net *net, u32 mark, const xfrm_address_t *daddr,
+		      __be32 spi, u8 proto, unsigned short family)
+{
+	struct hlist_head *table;
+	struct xfrm_state *x;
+	unsigned int hmask;
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&net->xfrm.state_hash_generation);
+		hmask = ACCESS_ONCE(net->xfrm.state_hmask);
+		smp_rmb();
+		table = ACCESS_ONCE(net->xfrm.state_byspi);
+		table += __xfrm_spi_hash(daddr, spi, proto, family, hmask);
+
+		hlist_for_each_entry_rcu(x, table, byspi) {
+			if (x->props.family != family ||
+			    x->id.spi       != spi ||
+			    x->id.proto     != proto ||
+			    !xfrm_addr_equal(&x->id.daddr, daddr, family))
+				continue;
+
+			if ((mark & x->mark.m) != x->mark.v)
+				continue;
+			/* a state on its way to the gc is not found */
+			if (!atomic_inc_not_zero(&x->refcnt))
+				continue;
+			return x;
+		}
+	} while (read_seqcount_retry(&net->xfrm.state_hash_generation, seq));
+
+	return NULL;
+}
+
 struct xfrm_state *
 xfrm_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr, __be32 spi,
 		  u8 proto, unsigned short family)
 {
 	struct xfrm_state *x;
 
-	spin_lock_bh(&net->xfrm.xfrm_state_lock);
-	x = __xfrm_state_lookup(net, mark, daddr, spi, proto, family);
-	spin_unlock_bh(&net->xfrm.xfrm_state_lock);
+	rcu_read_lock();
+	x = xfrm_state_lookup_rcu(net, mark, daddr, spi, proto, family);
+	rcu_read_unlock();
 	return x;
 }
 EXPORT_SYMBOL(xfrm_state_lookup);
@@ -1581,7 +1676,7 @@ int xfrm_alloc_spi(struct xfrm_state *x, u32 low, u32 high)
 	if (x->id.spi) {
 		spin_lock_bh(&net->xfrm.xfrm_state_lock);
 		h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto, x->props.family);
-		hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+		hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 		spin_unlock_bh(&net->xfrm.xfrm_state_lock);
 
 		err = 0;
@@ -2096,6 +2191,7 @@ int __net_init xfrm_state_init(struct net *net)
 	if (!net->xfrm.state_byspi)
 		goto out_byspi;
 	net->xfrm.state_hmask = ((sz / sizeof(struct hlist_head)) - 1);
+	seqcount_init(&net->xfrm.state_hash_generation);
 
 	net->xfrm.state_num = 0;
 	INIT_WORK(&net->xfrm.state_hash_work, xfrm_hash_resize);
@@ -57,6 +57,7 @@ static struct addr_range percpu_range = {
 
 static struct sym_entry *table;
 static unsigned int table_size, table_cnt;
+static unsigned int *seqs_of_names;
 static int all_symbols = 0;
 static int absolute_percpu = 0;
 static char symbol_prefix_char = '\0';
@@ -207,6 +208,7 @@ static int symbol_valid(struct sym_entry *s)
 		"kallsyms_markers",
 		"kallsyms_token_table",
 		"kallsyms_token_index",
+		"kallsyms_seqs_of_names",
 
 	/* Exclude linker generated symbols which vary between passes */
 		"_SDA_BASE_",		/* ppc */
@@ -406,6 +408,15 @@ static void write_src(void)
 	for (i = 0; i < 256; i++)
 		printf("\t.short\t%d\n", best_idx[i]);
 	printf("\n");
+
+	/* table positions in name order, 3 bytes each, big endian */
+	output_label("kallsyms_seqs_of_names");
+	for (i = 0; i < table_cnt; i++)
+		printf("\t.byte 0x%02x, 0x%02x, 0x%02x\n",
+			(unsigned char)(seqs_of_names[i] >> 16),
+			(unsigned char)(seqs_of_names[i] >> 8),
+			(unsigned char)(seqs_of_names[i] >> 0));
+	printf("\n");
 }
 
 
@@ -665,6 +676,41 @@ static void sort_symbols(void)
 	qsort(table, table_cnt, sizeof(struct sym_entry), compare_symbols);
 }
 
+static int compare_names(const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned int *)a;
+	unsigned int ib = *(const unsigned int *)b;
+	int ret;
+
+	/* skip the type char, kallsyms_lookup_name() doesn't see it */
+	ret = strcmp((char *)table[ia].sym + 1, (char *)table[ib].sym + 1);
+	if (ret)
+		return ret;
+
+	/* the first of several same-named symbols must come first */
+	return ia < ib ? -1 : ia > ib;
+}
+
+/*
+ * Record the name order of the (address sorted) table, so that the
+ * kernel can binary search it.  This has to happen before the names
+ * are compressed.
+ */
+static void sort_symbols_by_name(void)
+{
+	unsigned int i;
+
+	seqs_of_names = malloc(sizeof(*seqs_of_names) * (table_cnt + 1));
+	if (!seqs_of_names) {
+		fprintf(stderr, "kallsyms failure: "
+			"unable to allocate required memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < table_cnt; i++)
+		seqs_of_names[i] = i;
+	qsort(seqs_of_names, table_cnt, sizeof(*seqs_of_names), compare_names);
+}
+
 static void make_percpus_absolute(void)
 {
 	unsigned int i;
@@ -702,6 +748,7 @@ int main(int argc, char **argv)
 	if (absolute_percpu)
 		make_percpus_absolute();
 	sort_symbols();
+	sort_symbols_by_name();
 	optimize_token_table();
 	write_src();
 
@@ -22,6 +22,11 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/percpu_counter.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,6 +39,8 @@
 #include "classmap.h"
 
 #define AVC_CACHE_SLOTS			512
+#define AVC_CACHE_MIN_SLOTS		16
+#define AVC_CACHE_MAX_SLOTS		65536
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
 
@@ -47,20 +54,30 @@ struct avc_entry {
 	u32			ssid;
 	u32			tsid;
 	u16			tclass;
+	u8			referenced;	/* hit since last reclaim scan */
 	struct av_decision	avd;
 };
 
 struct avc_node {
 	struct avc_entry	ae;
-	struct hlist_node	list; /* anchored in avc_cache->slots[i] */
+	struct hlist_node	list; /* anchored in avc_cache.tbl->slots[i] */
 	struct rcu_head		rhead;
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
+struct avc_table {
+	unsigned int		mask;	/* number of slots - 1 */
+	struct avc_slot		slots[];
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_table __rcu	*tbl;		/* see avc_set_cache_slots() */
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
-	atomic_t		active_nodes;
+	struct percpu_counter	active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
 };
 
@@ -80,10 +97,12 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
+static DEFINE_MUTEX(avc_resize_mutex);
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline int avc_hash(struct avc_table *tbl,
+			   u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return jhash_3words(ssid, tsid, tclass, 0) & tbl->mask;
 }
 
 /**
@@ -153,6 +172,26 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
 	audit_log_format(ab, " tclass=%s", secclass_map[tclass-1].name);
 }
 
+static struct avc_table *avc_alloc_table(unsigned int nslots)
+{
+	struct avc_table *tbl;
+	size_t size = sizeof(*tbl) + nslots * sizeof(tbl->slots[0]);
+	unsigned int i;
+
+	tbl = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl)
+		tbl = vzalloc(size);
+	if (!tbl)
+		return NULL;
+
+	tbl->mask = nslots - 1;
+	for (i = 0; i < nslots; i++) {
+		INIT_HLIST_HEAD(&tbl->slots[i].head);
+		spin_lock_init(&tbl->slots[i].lock);
+	}
+	return tbl;
+}
+
 /**
  * avc_init - Initialize the AVC.
  *
@@ -160,13 +199,12 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_table *tbl;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
-	atomic_set(&avc_cache.active_nodes, 0);
+	tbl = avc_alloc_table(AVC_CACHE_SLOTS);
+	if (!tbl || percpu_counter_init(&avc_cache.active_nodes, 0, GFP_KERNEL))
+		panic("SELinux: unable to allocate the AVC\n");
+	RCU_INIT_POINTER(avc_cache.tbl, tbl);
 	atomic_set(&avc_cache.lru_hint, 0);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
@@ -177,16 +215,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, nslots;
+	struct avc_table *tbl;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	tbl = rcu_dereference(avc_cache.tbl);
+	nslots = tbl->mask + 1;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < nslots; i++) {
+		head = &tbl->slots[i].head;
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -199,10 +240,10 @@ int avc_get_hash_stats(char *page)
 
 	rcu_read_unlock();
 
-	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
+	return scnprintf(page, PAGE_SIZE, "entries: %lld\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
-			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 percpu_counter_sum_positive(&avc_cache.active_nodes),
+			 slots_used, nslots, max_chain_len);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -216,54 +257,65 @@ static void avc_node_delete(struct avc_node *node)
 {
 	hlist_del_rcu(&node->list);
 	call_rcu(&node->rhead, avc_node_free);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
 static void avc_node_kill(struct avc_node *node)
 {
 	kmem_cache_free(avc_node_cachep, node);
 	avc_cache_stats_incr(frees);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
 static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 {
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
-	atomic_dec(&avc_cache.active_nodes);
+	percpu_counter_dec(&avc_cache.active_nodes);
 }
 
+/*
+ * Reclaim is a CLOCK sweep: an entry that was looked up since the hand
+ * last passed it only loses its referenced bit, so hot decisions stay
+ * cached while the cold ones are evicted.  Moving hits within a chain
+ * instead would need the slot lock on every lookup.
+ */
 static inline int avc_reclaim_node(void)
 {
+	struct avc_table *tbl;
 	struct avc_node *node;
 	int hvalue, try, ecx;
 	unsigned long flags;
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	rcu_read_lock();
+	tbl = rcu_dereference(avc_cache.tbl);
+	for (try = 0, ecx = 0; try <= tbl->mask; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & tbl->mask;
+		head = &tbl->slots[hvalue].head;
+		lock = &tbl->slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
 		hlist_for_each_entry(node, head, list) {
+			if (ACCESS_ONCE(node->ae.referenced)) {
+				ACCESS_ONCE(node->ae.referenced) = 0;
+				continue;
+			}
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	rcu_read_unlock();
 	return ecx;
 }
 
@@ -278,7 +330,9 @@ static struct avc_node *avc_alloc_node(void)
 	INIT_HLIST_NODE(&node->list);
 	avc_cache_stats_incr(allocations);
 
-	if (atomic_inc_return(&avc_cache.active_nodes) > avc_cache_threshold)
+	percpu_counter_inc(&avc_cache.active_nodes);
+	if (percpu_counter_read_positive(&avc_cache.active_nodes) >
+	    avc_cache_threshold)
 		avc_reclaim_node();
 
 out:
@@ -295,12 +349,13 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
+	struct avc_table *tbl = rcu_dereference(avc_cache.tbl);
 	struct avc_node *node, *ret = NULL;
 	int hvalue;
 	struct hlist_head *head;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	hvalue = avc_hash(tbl, ssid, tsid, tclass);
+	head = &tbl->slots[hvalue].head;
 	hlist_for_each_entry_rcu(node, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -332,8 +387,12 @@ static struct avc_node *avc_lookup(u32 ssid, u32 tsid, u16 tclass)
 	avc_cache_stats_incr(lookups);
 	node = avc_search_node(ssid, tsid, tclass);
 
-	if (node)
+	if (node) {
+		/* Only dirty the entry when the reclaim hand cleared the bit */
+		if (!ACCESS_ONCE(node->ae.referenced))
+			ACCESS_ONCE(node->ae.referenced) = 1;
 		return node;
+	}
 
 	avc_cache_stats_incr(misses);
 	return NULL;
@@ -389,14 +448,15 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_table *tbl = rcu_dereference(avc_cache.tbl);
 		struct hlist_head *head;
 		spinlock_t *lock;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
+		hvalue = avc_hash(tbl, ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		head = &tbl->slots[hvalue].head;
+		lock = &tbl->slots[hvalue].lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -539,6 +599,7 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 {
 	int hvalue, rc = 0;
 	unsigned long flag;
+	struct avc_table *tbl;
 	struct avc_node *pos, *node, *orig = NULL;
 	struct hlist_head *head;
 	spinlock_t *lock;
@@ -550,10 +611,11 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	tbl = rcu_dereference(avc_cache.tbl);
+	hvalue = avc_hash(tbl, ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &tbl->slots[hvalue].head;
+	lock = &tbl->slots[hvalue].lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -612,27 +674,78 @@ out:
  */
 static void avc_flush(void)
 {
+	struct avc_table *tbl;
 	struct hlist_head *head;
 	struct avc_node *node;
 	spinlock_t *lock;
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	/*
+	 * With preemptable RCU, the slot spinlocks do not prevent RCU
+	 * grace periods from ending; the read lock also keeps the table
+	 * from being freed by avc_set_cache_slots() under us.
+	 */
+	rcu_read_lock();
+	tbl = rcu_dereference(avc_cache.tbl);
+	for (i = 0; i <= tbl->mask; i++) {
+		head = &tbl->slots[i].head;
+		lock = &tbl->slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	rcu_read_unlock();
+}
+
+unsigned int avc_get_cache_slots(void)
+{
+	unsigned int nslots;
+
+	rcu_read_lock();
+	nslots = rcu_dereference(avc_cache.tbl)->mask + 1;
+	rcu_read_unlock();
+	return nslots;
+}
+
+/**
+ * avc_set_cache_slots - Resize the AVC hash table.
+ * @nslots: new number of hash buckets, a power of two
+ *
+ * The cached decisions are dropped rather than rehashed, just as on a
+ * policy reload; they are recomputed on demand.  Returns %0 on success,
+ * -%EINVAL for an unsupported size or -%ENOMEM.
+ */
+int avc_set_cache_slots(unsigned int nslots)
+{
+	struct avc_table *new, *old;
+	struct avc_node *node;
+	struct hlist_node *tmp;
+	unsigned int i;
+
+	if (!is_power_of_2(nslots) || nslots < AVC_CACHE_MIN_SLOTS ||
+	    nslots > AVC_CACHE_MAX_SLOTS)
+		return -EINVAL;
+
+	new = avc_alloc_table(nslots);
+	if (!new)
+		return -ENOMEM;
+
+	mutex_lock(&avc_resize_mutex);
+	old = rcu_dereference_protected(avc_cache.tbl,
+					lockdep_is_held(&avc_resize_mutex));
+	rcu_assign_pointer(avc_cache.tbl, new);
+	synchronize_rcu();
+	mutex_unlock(&avc_resize_mutex);
+
+	/* Every user of the old table has left its RCU read section. */
+	for (i = 0; i <= old->mask; i++)
+		hlist_for_each_entry_safe(node, tmp, &old->slots[i].head, list)
+			avc_node_kill(node);
+	kvfree(old);
+	return 0;
 }
 
 /**
@@ -167,6 +167,8 @@ int avc_add_callback(int (*callback)(u32 event), u32 events);
 /* Exported to selinuxfs */
 int avc_get_hash_stats(char *page);
 extern unsigned int avc_cache_threshold;
+unsigned int avc_get_cache_slots(void);
+int avc_set_cache_slots(unsigned int nslots);
 
 /* Attempt to free avc node cache */
 void avc_disable(void);
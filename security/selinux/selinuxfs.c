@@ -1360,6 +1360,61 @@ out:
 	return ret;
 }
 
+static ssize_t sel_read_avc_cache_slots(struct file *filp, char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	char tmpbuf[TMPBUFLEN];
+	ssize_t length;
+
+	length = scnprintf(tmpbuf, TMPBUFLEN, "%u", avc_get_cache_slots());
+	return simple_read_from_buffer(buf, count, ppos, tmpbuf, length);
+}
+
+static ssize_t sel_write_avc_cache_slots(struct file *file,
+					 const char __user *buf,
+					 size_t count, loff_t *ppos)
+
+{
+	char *page = NULL;
+	ssize_t ret;
+	unsigned int new_value;
+
+	ret = task_has_security(current, SECURITY__SETSECPARAM);
+	if (ret)
+		goto out;
+
+	ret = -ENOMEM;
+	if (count >= PAGE_SIZE)
+		goto out;
+
+	/* No partial writes. */
+	ret = -EINVAL;
+	if (*ppos != 0)
+		goto out;
+
+	ret = -ENOMEM;
+	page = (char *)get_zeroed_page(GFP_KERNEL);
+	if (!page)
+		goto out;
+
+	ret = -EFAULT;
+	if (copy_from_user(page, buf, count))
+		goto out;
+
+	ret = -EINVAL;
+	if (sscanf(page, "%u", &new_value) != 1)
+		goto out;
+
+	ret = avc_set_cache_slots(new_value);
+	if (ret)
+		goto out;
+
+	ret = count;
+out:
+	free_page((unsigned long)page);
+	return ret;
+}
+
 static ssize_t sel_read_avc_hash_stats(struct file *filp, char __user *buf,
 				       size_t count, loff_t *ppos)
 {
@@ -1384,6 +1439,12 @@ static const struct file_operations sel_avc_cache_threshold_ops = {
 	.llseek		= generic_file_llseek,
 };
 
+static const struct file_operations sel_avc_cache_slots_ops = {
+	.read		= sel_read_avc_cache_slots,
+	.write		= sel_write_avc_cache_slots,
+	.llseek		= generic_file_llseek,
+};
+
 static const struct file_operations sel_avc_hash_stats_ops = {
 	.read		= sel_read_avc_hash_stats,
 	.llseek		= generic_file_llseek,
@@ -1465,6 +1526,8 @@ static int sel_make_avc_files(struct dentry *dir)
 	static struct tree_descr files[] = {
 		{ "cache_threshold",
 		  &sel_avc_cache_threshold_ops, S_IRUGO|S_IWUSR },
+		{ "cache_slots",
+		  &sel_avc_cache_slots_ops, S_IRUGO|S_IWUSR },
 		{ "hash_stats", &sel_avc_hash_stats_ops, S_IRUGO },
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 		{ "cache_stats", &sel_avc_cache_stats_ops, S_IRUGO },
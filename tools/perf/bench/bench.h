@@ -34,6 +34,13 @@ extern int bench_mem_memset(int argc, const char **argv, const char *prefix);
 extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
 extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
 extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
+extern int bench_fs_fdalloc(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_ctl(int argc, const char **argv, const char *prefix);
+extern int bench_net_rr(int argc, const char **argv, const char *prefix);
+extern int bench_net_stream(int argc, const char **argv, const char *prefix);
+extern int bench_io_sync(int argc, const char **argv, const char *prefix);
+extern int bench_io_aio(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,291 @@
+/*
+ * epoll-ctl.c
+ *
+ * epoll-ctl: Benchmark epoll_ctl(2) add/mod/del on a shared epoll instance
+ *
+ * Every worker thread owns a set of eventfds and keeps adding, modifying
+ * and removing random ones of them to and from a single epoll instance,
+ * which is what event loops serving many short-lived connections spend
+ * their time doing. Run it with --per-thread to see the cost without the
+ * contention on the instance's locks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 8;
+/* amount of eventfds per thread */
+static unsigned int nfds     = 64;
+static bool per_thread = false, done = false, silent = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+static int shared_epollfd = -1;
+
+enum {
+	OP_EPOLL_ADD,
+	OP_EPOLL_MOD,
+	OP_EPOLL_DEL,
+	EPOLL_NR_OPS,
+};
+
+static const char * const op_names[] = {
+	[OP_EPOLL_ADD] = "ADD",
+	[OP_EPOLL_MOD] = "MOD",
+	[OP_EPOLL_DEL] = "DEL",
+};
+
+struct worker {
+	int tid;
+	int epollfd;
+	int *fds;
+	bool *added;
+	unsigned int seed;
+	pthread_t thread;
+	unsigned long ops[EPOLL_NR_OPS];
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",    &nthreads,   "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime",    &nsecs,      "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",       &nfds,       "Specify amount of eventfds per thread"),
+	OPT_BOOLEAN( 'P', "per-thread", &per_thread, "Use an epoll instance per thread instead of a shared one"),
+	OPT_BOOLEAN( 's', "silent",     &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+static void do_op(struct worker *w, unsigned int i)
+{
+	struct epoll_event ev;
+	int op;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = w->fds[i];
+
+	if (!w->added[i]) {
+		op = OP_EPOLL_ADD;
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, w->fds[i], &ev))
+			err(EXIT_FAILURE, "epoll_ctl(EPOLL_CTL_ADD)");
+		w->added[i] = true;
+	} else if (rand_r(&w->seed) & 1) {
+		op = OP_EPOLL_MOD;
+		ev.events |= EPOLLOUT;
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_MOD, w->fds[i], &ev))
+			err(EXIT_FAILURE, "epoll_ctl(EPOLL_CTL_MOD)");
+	} else {
+		op = OP_EPOLL_DEL;
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_DEL, w->fds[i], &ev))
+			err(EXIT_FAILURE, "epoll_ctl(EPOLL_CTL_DEL)");
+		w->added[i] = false;
+	}
+
+	w->ops[op]++;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		do_op(w, rand_r(&w->seed) % nfds);
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld operations/sec (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int) runtime.tv_sec);
+}
+
+static void setup_worker(struct worker *w)
+{
+	unsigned int i;
+
+	w->fds = calloc(nfds, sizeof(*w->fds));
+	w->added = calloc(nfds, sizeof(*w->added));
+	if (!w->fds || !w->added)
+		err(EXIT_FAILURE, "calloc");
+
+	if (per_thread) {
+		w->epollfd = epoll_create(nfds);
+		if (w->epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create");
+	} else {
+		w->epollfd = shared_epollfd;
+	}
+
+	for (i = 0; i < nfds; i++) {
+		w->fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (w->fds[i] < 0)
+			err(EXIT_FAILURE, "eventfd");
+	}
+
+	w->seed = getpid() ^ w->tid;
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	cpu_set_t cpu;
+	struct sigaction act;
+	unsigned int i, j, ncpus;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_epoll_ctl_usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(bench_epoll_ctl_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	if (!per_thread) {
+		shared_epollfd = epoll_create(nthreads * nfds);
+		if (shared_epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create");
+	}
+
+	printf("Run summary [PID %d]: %d threads doing epoll_ctl ops on %d fds each in %s for %d secs.\n\n",
+	       getpid(), nthreads, nfds, per_thread ? "an epoll instance each" :
+	       "one shared epoll instance", nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		setup_worker(&worker[i]);
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = 0;
+
+		for (j = 0; j < EPOLL_NR_OPS; j++)
+			t += worker[i].ops[j];
+		t /= runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent) {
+			printf("[thread %2d] fds: %d ... %d [ %ld ops/sec ]",
+			       worker[i].tid, worker[i].fds[0],
+			       worker[i].fds[nfds-1], t);
+			for (j = 0; j < EPOLL_NR_OPS; j++)
+				printf(" %s: %ld", op_names[j],
+				       worker[i].ops[j] / runtime.tv_sec);
+			printf("\n");
+		}
+
+		for (j = 0; j < nfds; j++)
+			close(worker[i].fds[j]);
+		free(worker[i].fds);
+		free(worker[i].added);
+		if (per_thread)
+			close(worker[i].epollfd);
+	}
+	if (!per_thread)
+		close(shared_epollfd);
+
+	print_summary();
+
+	free(worker);
+	return ret;
+}
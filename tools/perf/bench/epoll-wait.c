@@ -0,0 +1,292 @@
+/*
+ * epoll-wait.c
+ *
+ * epoll-wait: Benchmark epoll_wait(2) wakeup and event delivery
+ *
+ * Every worker thread owns a set of eventfds and sleeps in epoll_wait(2),
+ * either on its own epoll instance or, with --single, all together on one
+ * shared instance. A single writer thread keeps kicking the eventfds round
+ * robin; each event a worker picks up and drains counts as one operation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 8;
+/* amount of eventfds per thread */
+static unsigned int nfds     = 64;
+static bool single = false, edge = false, done = false, silent = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+static int shared_epollfd = -1;
+
+struct worker {
+	int tid;
+	int epollfd;
+	int *fds;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,     "Specify amount of eventfds per thread"),
+	OPT_BOOLEAN( 'S', "single",  &single,   "Use a single epoll instance shared by all threads"),
+	OPT_BOOLEAN( 'E', "edge",    &edge,     "Use edge-triggered events"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct epoll_event *events;
+	u64 val;
+	int i, n;
+
+	events = calloc(nfds, sizeof(*events));
+	if (!events)
+		err(EXIT_FAILURE, "calloc");
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		/* time out every now and then to notice 'done' */
+		n = epoll_wait(w->epollfd, events, nfds, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "epoll_wait");
+		}
+
+		for (i = 0; i < n; i++) {
+			/*
+			 * With a shared instance another thread may have
+			 * drained the eventfd first, that's not an event.
+			 */
+			if (read(events[i].data.fd, &val, sizeof(val)) ==
+			    sizeof(val))
+				w->ops++;
+		}
+	} while (!done);
+
+	free(events);
+	return NULL;
+}
+
+static void *writerfn(void *arg)
+{
+	struct worker *worker = (struct worker *) arg;
+	unsigned int i, j;
+	u64 val = 1;
+
+	while (!done) {
+		for (j = 0; j < nfds && !done; j++) {
+			for (i = 0; i < nthreads; i++) {
+				if (write(worker[i].fds[j], &val,
+					  sizeof(val)) != sizeof(val))
+					err(EXIT_FAILURE, "write");
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld operations/sec (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int) runtime.tv_sec);
+}
+
+static void setup_worker(struct worker *w)
+{
+	struct epoll_event ev;
+	unsigned int i;
+
+	w->fds = calloc(nfds, sizeof(*w->fds));
+	if (!w->fds)
+		err(EXIT_FAILURE, "calloc");
+
+	if (single) {
+		w->epollfd = shared_epollfd;
+	} else {
+		w->epollfd = epoll_create(nfds);
+		if (w->epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create");
+	}
+
+	for (i = 0; i < nfds; i++) {
+		w->fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (w->fds[i] < 0)
+			err(EXIT_FAILURE, "eventfd");
+
+		ev.events = EPOLLIN | (edge ? EPOLLET : 0);
+		ev.data.fd = w->fds[i];
+		if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD, w->fds[i], &ev))
+			err(EXIT_FAILURE, "epoll_ctl");
+	}
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	cpu_set_t cpu;
+	struct sigaction act;
+	unsigned int i, j, ncpus;
+	pthread_attr_t thread_attr;
+	pthread_t writer;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(bench_epoll_wait_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	if (single) {
+		shared_epollfd = epoll_create(nthreads * nfds);
+		if (shared_epollfd < 0)
+			err(EXIT_FAILURE, "epoll_create");
+	}
+
+	printf("Run summary [PID %d]: %d threads waiting on %s with %d %s-triggered fds each for %d secs.\n\n",
+	       getpid(), nthreads, single ? "one shared epoll instance" :
+	       "an epoll instance each", nfds, edge ? "edge" : "level", nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		setup_worker(&worker[i]);
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	ret = pthread_create(&writer, NULL, writerfn, worker);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_create");
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	ret = pthread_join(writer, NULL);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_join");
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops/runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] fds: %d ... %d [ %ld events/sec ]\n",
+			       worker[i].tid, worker[i].fds[0],
+			       worker[i].fds[nfds-1], t);
+
+		for (j = 0; j < nfds; j++)
+			close(worker[i].fds[j]);
+		free(worker[i].fds);
+		if (!single)
+			close(worker[i].epollfd);
+	}
+	if (single)
+		close(shared_epollfd);
+
+	print_summary();
+
+	free(worker);
+	return ret;
+}
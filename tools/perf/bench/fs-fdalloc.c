@@ -0,0 +1,123 @@
+/*
+ * fs-fdalloc.c
+ *
+ * fdalloc: Benchmark for file descriptor allocation in very large fd tables
+ *
+ * The table is filled with nr_fds descriptors, then each loop frees a
+ * low descriptor, refills it, and allocates once more. The last
+ * allocation has to search from just above the refilled slot all the way
+ * to the top of the table, which is the case that dominates in processes
+ * holding millions of descriptors.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define NR_FDS_DEFAULT		1000000
+#define LOOPS_DEFAULT		10000
+
+static unsigned int nr_fds = NR_FDS_DEFAULT;
+static unsigned int loops = LOOPS_DEFAULT;
+
+static const struct option options[] = {
+	OPT_UINTEGER('n', "nr-fds",	&nr_fds,	"Specify number of open file descriptors"),
+	OPT_UINTEGER('l', "loop",	&loops,		"Specify number of loops"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fdalloc_usage[] = {
+	"perf bench fs fdalloc <options>",
+	NULL
+};
+
+int bench_fs_fdalloc(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	struct rlimit rlim;
+	unsigned int i, lo;
+	int base, fd;
+
+	argc = parse_options(argc, argv, options, bench_fs_fdalloc_usage, 0);
+	if (nr_fds < 16)
+		errx(EXIT_FAILURE, "need at least 16 file descriptors");
+
+	/* one spare slot for the long search to land in */
+	rlim.rlim_cur = rlim.rlim_max = nr_fds + 1;
+	if (setrlimit(RLIMIT_NOFILE, &rlim))
+		err(EXIT_FAILURE, "setrlimit(RLIMIT_NOFILE, %u)", nr_fds + 1);
+
+	base = open("/dev/null", O_RDONLY);
+	if (base < 0)
+		err(EXIT_FAILURE, "open");
+
+	/* fill every slot up to nr_fds */
+	while ((fd = dup(base)) >= 0 && (unsigned int)fd < nr_fds - 1)
+		;
+	if (fd < 0)
+		err(EXIT_FAILURE, "dup");
+
+	lo = base + 1;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < loops; i++) {
+		close(lo);
+		fd = dup(base);
+		BUG_ON(fd != (int)lo);
+		fd = dup(base);
+		BUG_ON(fd != (int)nr_fds);
+		close(fd);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	for (fd = base; fd < (int)nr_fds; fd++)
+		close(fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Allocated %u descriptors at the top of a %u entry table\n\n",
+		       loops, nr_fds);
+
+		result_usec = diff.tv_sec * 1000000;
+		result_usec += diff.tv_usec;
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14d ops/sec\n",
+		       (int)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
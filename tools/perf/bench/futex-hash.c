@@ -25,6 +25,8 @@ static unsigned int nthreads = 0;
 static unsigned int nsecs    = 10;
 /* amount of futexes per thread */
 static unsigned int nfutexes = 1024;
+/* private futex hash slots, -1: let the kernel decide */
+static int nbuckets = -1;
 static bool fshared = false, done = false, silent = false;
 static int futex_flag = 0;
 
@@ -47,6 +49,7 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_INTEGER( 'b', "buckets", &nbuckets, "Specify amount of private futex hash buckets (0: global hash)"),
 	OPT_END()
 };
 
@@ -138,6 +141,9 @@ int bench_futex_hash(int argc, const char **argv,
 	if (!fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
+	if (nbuckets >= 0 && futex_hash_slots_set(nbuckets))
+		err(EXIT_FAILURE, "prctl(PR_FUTEX_HASH)");
+
 	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
 	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
 
@@ -170,6 +176,15 @@ int bench_futex_hash(int argc, const char **argv,
 	}
 	pthread_attr_destroy(&thread_attr);
 
+	if (!fshared) {
+		ret = futex_hash_slots_get();
+		if (ret > 0)
+			printf("Private futex hash: %d buckets\n\n", ret);
+		else
+			printf("Private futex hash: using the global hash\n\n");
+		ret = 0;
+	}
+
 	pthread_mutex_lock(&thread_lock);
 	while (threads_starting)
 		pthread_cond_wait(&thread_parent, &thread_lock);
@@ -10,8 +10,15 @@
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/prctl.h>
 #include <linux/futex.h>
 
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			43
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
 /**
  * futex() - SYS_futex syscall wrapper
  * @uaddr:	address of first futex
@@ -68,4 +75,23 @@ futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2, int nr_wak
 		 val, opflags);
 }
 
+/**
+ * futex_hash_slots_set() - size the private futex hash of this process
+ * @slots:	number of hash slots, 0 to use the global hash table
+ *
+ * Must be called before the process creates any thread.
+ */
+static inline int futex_hash_slots_set(unsigned int slots)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots, 0, 0);
+}
+
+/**
+ * futex_hash_slots_get() - private futex hash slots, 0 for the global table
+ */
+static inline int futex_hash_slots_get(void)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+}
+
 #endif /* _FUTEX_H */
@@ -0,0 +1,413 @@
+/*
+ * io.c
+ *
+ * io: Benchmarks for the block layer submission and completion paths
+ *
+ *  sync : every thread does one pread(2)/pwrite(2) at a time
+ *  aio  : every thread keeps --depth requests in flight with io_submit(2)
+ *
+ * Both run against a block device, null_blk by default, so what's being
+ * measured is the kernel and not the media. Unless told otherwise with
+ * --mode, each of them is run both through the page cache and with
+ * O_DIRECT, giving the sync/aio x buffered/direct matrix.
+ *
+ * Writes destroy the device contents and have to be asked for with
+ * --write.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/posix_types.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <pthread.h>
+
+static const char *device    = "/dev/nullb0";
+static const char *mode_str  = "all";
+static unsigned int nthreads = 1;
+static unsigned int nsecs    = 5;
+static unsigned int bs       = 4096;
+static unsigned int depth    = 32;
+static bool do_write = false, do_random = false, done = false, silent = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned long long dev_size;
+
+struct worker {
+	int tid;
+	int fd;
+	void *buf;
+	unsigned int seed;
+	unsigned long long pos;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_STRING(  'd', "device",  &device,    "path", "Specify block device (default: /dev/nullb0)"),
+	OPT_STRING(  'm', "mode",    &mode_str,  "mode", "Specify mode: buffered, direct or all"),
+	OPT_UINTEGER('t', "threads", &nthreads,  "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,     "Specify runtime (in seconds)"),
+	OPT_UINTEGER('b', "bs",      &bs,        "Specify block size (in bytes)"),
+	OPT_UINTEGER('q', "depth",   &depth,     "Specify aio queue depth per thread"),
+	OPT_BOOLEAN( 'w', "write",   &do_write,  "Write instead of read (destroys the device contents)"),
+	OPT_BOOLEAN( 'R', "random",  &do_random, "Use random instead of sequential offsets"),
+	OPT_BOOLEAN( 's', "silent",  &silent,    "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_io_sync_usage[] = {
+	"perf bench io sync <options>",
+	NULL
+};
+
+static const char * const bench_io_aio_usage[] = {
+	"perf bench io aio <options>",
+	NULL
+};
+
+/*
+ * glibc doesn't wrap the native aio syscalls, and perf-sys.h may not know
+ * their numbers on all arches.
+ */
+#ifdef __NR_io_setup
+static inline int io_setup(unsigned nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long max_nr,
+			       struct io_event *events,
+			       struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
+}
+#endif
+
+static unsigned long long next_offset(struct worker *w)
+{
+	unsigned long long nr_blocks = dev_size / bs;
+	unsigned long long off;
+
+	if (do_random) {
+		off = ((unsigned long long)rand_r(&w->seed) << 31) |
+		      rand_r(&w->seed);
+		return (off % nr_blocks) * bs;
+	}
+
+	off = w->pos;
+	w->pos += bs;
+	if (w->pos + bs > dev_size)
+		w->pos = 0;
+	return off;
+}
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void *sync_workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	ssize_t ret;
+
+	wait_for_start();
+
+	do {
+		if (do_write)
+			ret = pwrite(w->fd, w->buf, bs, next_offset(w));
+		else
+			ret = pread(w->fd, w->buf, bs, next_offset(w));
+		if (ret != (ssize_t)bs)
+			err(EXIT_FAILURE, do_write ? "pwrite" : "pread");
+		w->ops++;
+	} while (!done);
+
+	return NULL;
+}
+
+#ifdef __NR_io_setup
+static void aio_prep(struct worker *w, struct iocb *iocb, unsigned int i)
+{
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_data = i;
+	iocb->aio_lio_opcode = do_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	iocb->aio_fildes = w->fd;
+	iocb->aio_buf = (unsigned long)w->buf + (unsigned long)i * bs;
+	iocb->aio_nbytes = bs;
+	iocb->aio_offset = next_offset(w);
+}
+
+static void *aio_workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct io_event *events;
+	struct iocb *iocbs, **iocbp;
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000000 };
+	aio_context_t ctx = 0;
+	unsigned int i, inflight;
+	int ret;
+
+	events = calloc(depth, sizeof(*events));
+	iocbs = calloc(depth, sizeof(*iocbs));
+	iocbp = calloc(depth, sizeof(*iocbp));
+	if (!events || !iocbs || !iocbp)
+		err(EXIT_FAILURE, "calloc");
+
+	if (io_setup(depth, &ctx))
+		err(EXIT_FAILURE, "io_setup");
+
+	wait_for_start();
+
+	for (i = 0; i < depth; i++) {
+		aio_prep(w, &iocbs[i], i);
+		iocbp[i] = &iocbs[i];
+	}
+	if (io_submit(ctx, depth, iocbp) != (int)depth)
+		err(EXIT_FAILURE, "io_submit");
+	inflight = depth;
+
+	while (inflight) {
+		ret = io_getevents(ctx, 1, depth, events, &ts);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "io_getevents");
+		}
+
+		inflight -= ret;
+		for (i = 0; i < (unsigned int)ret; i++) {
+			if (events[i].res != bs)
+				errx(EXIT_FAILURE, "aio %s failed: %lld",
+				     do_write ? "write" : "read",
+				     (long long)events[i].res);
+			w->ops++;
+			/* resubmit each completed iocb, until we're done */
+			aio_prep(w, &iocbs[events[i].data], events[i].data);
+			iocbp[i] = &iocbs[events[i].data];
+		}
+
+		if (!done && ret) {
+			if (io_submit(ctx, ret, iocbp) != ret)
+				err(EXIT_FAILURE, "io_submit");
+			inflight += ret;
+		}
+	}
+
+	io_destroy(ctx);
+	free(iocbp);
+	free(iocbs);
+	free(events);
+	return NULL;
+}
+#else
+static void *aio_workerfn(void *arg __maybe_unused)
+{
+	errx(EXIT_FAILURE, "aio syscalls not wired up for this arch");
+}
+#endif
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void print_summary(bool direct)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("%s%-8s: averaged %ld IOPS (+- %.2f%%) per thread, %.2f MB/sec total, total secs = %d\n",
+		       !silent ? "\n" : "", direct ? "direct" : "buffered",
+		       avg, rel_stddev_stats(stddev, avg),
+		       (double)avg * nthreads * bs / (1024 * 1024),
+		       (int) runtime.tv_sec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%ld\n", avg);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+static void run_one(void *(*workerfn)(void *), bool direct)
+{
+	int ret, flags = (do_write ? O_WRONLY : O_RDONLY) | (direct ? O_DIRECT : 0);
+	unsigned int i, bufs = workerfn == aio_workerfn ? depth : 1;
+	struct sigaction act;
+	struct worker *worker;
+
+	done = false;
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].seed = getpid() ^ i;
+		/* spread sequential streams over the device */
+		worker[i].pos = (dev_size / bs / nthreads) * i * bs;
+
+		worker[i].fd = open(device, flags);
+		if (worker[i].fd < 0)
+			err(EXIT_FAILURE, "open(%s)", device);
+
+		/* O_DIRECT wants aligned buffers */
+		if (posix_memalign(&worker[i].buf, 4096, (size_t)bufs * bs))
+			errx(EXIT_FAILURE, "posix_memalign");
+
+		ret = pthread_create(&worker[i].thread, NULL, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops/runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] %s %s: %ld IOPS\n", worker[i].tid,
+			       direct ? "direct" : "buffered",
+			       do_write ? "writes" : "reads", t);
+
+		close(worker[i].fd);
+		free(worker[i].buf);
+	}
+
+	print_summary(direct);
+	free(worker);
+}
+
+static int run_matrix(void *(*workerfn)(void *), const char * const *usage,
+		      int argc, const char **argv)
+{
+	bool buffered, direct;
+	int fd;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !nthreads || !depth || !bs || bs % 512) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	buffered = !strcmp(mode_str, "buffered") || !strcmp(mode_str, "all");
+	direct = !strcmp(mode_str, "direct") || !strcmp(mode_str, "all");
+	if (!buffered && !direct)
+		errx(EXIT_FAILURE, "unknown mode '%s'", mode_str);
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0)
+		err(EXIT_FAILURE, "open(%s), try 'modprobe null_blk'", device);
+	if (ioctl(fd, BLKGETSIZE64, &dev_size))
+		err(EXIT_FAILURE, "ioctl(BLKGETSIZE64)");
+	close(fd);
+
+	if (dev_size < (unsigned long long)bs * nthreads)
+		errx(EXIT_FAILURE, "%s is too small", device);
+
+	printf("Run summary [PID %d]: %d threads doing %s %d byte %s%s on %s for %d secs.\n\n",
+	       getpid(), nthreads, do_random ? "random" : "sequential", bs,
+	       do_write ? "writes" : "reads",
+	       workerfn == aio_workerfn ? " with aio" : "", device, nsecs);
+
+	if (buffered)
+		run_one(workerfn, false);
+	if (direct)
+		run_one(workerfn, true);
+
+	return 0;
+}
+
+int bench_io_sync(int argc, const char **argv,
+		  const char *prefix __maybe_unused)
+{
+	return run_matrix(sync_workerfn, bench_io_sync_usage, argc, argv);
+}
+
+int bench_io_aio(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	return run_matrix(aio_workerfn, bench_io_aio_usage, argc, argv);
+}
@@ -0,0 +1,440 @@
+/*
+ * net.c
+ *
+ * net: Benchmarks for loopback TCP, UDP and unix socket traffic
+ *
+ *  rr     : each client sends a message and waits for the server to echo
+ *           it back, one transaction at a time (latency bound)
+ *  stream : each client sends messages as fast as it can, the server just
+ *           reads them (throughput bound)
+ *
+ * Each of the --pairs client/server pairs gets its own connection and its
+ * own two threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+static unsigned int npairs   = 1;
+static unsigned int nsecs    = 8;
+static unsigned int msg_size_opt = 0, msg_size;
+static const char *proto_str = "tcp";
+static bool done = false, silent = false;
+
+static struct timeval start, end, runtime;
+static struct stats throughput_stats;
+
+enum net_proto {
+	NET_TCP,
+	NET_UDP,
+	NET_UNIX,
+};
+
+static enum net_proto proto;
+
+struct pair {
+	int idx;
+	int client_fd;
+	int server_fd;
+	pthread_t client, server;
+	unsigned long ops;
+	unsigned long long bytes;
+};
+
+static const struct option options[] = {
+	OPT_STRING(  'p', "proto",   &proto_str, "tcp", "Specify protocol: tcp, udp or unix"),
+	OPT_UINTEGER('P', "pairs",   &npairs,    "Specify amount of client/server pairs"),
+	OPT_UINTEGER('m', "size",    &msg_size_opt, "Specify message size (in bytes)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,    "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_rr_usage[] = {
+	"perf bench net rr <options>",
+	NULL
+};
+
+static const char * const bench_net_stream_usage[] = {
+	"perf bench net stream <options>",
+	NULL
+};
+
+static void set_timeouts(int fd)
+{
+	/* don't block forever on lost datagrams or once we're done */
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)))
+		err(EXIT_FAILURE, "setsockopt(SO_RCVTIMEO/SO_SNDTIMEO)");
+}
+
+static int loopback_socket(int type, struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0)
+		err(EXIT_FAILURE, "socket");
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)))
+		err(EXIT_FAILURE, "bind");
+	if (getsockname(fd, (struct sockaddr *)addr, &len))
+		err(EXIT_FAILURE, "getsockname");
+
+	return fd;
+}
+
+static void connect_pair(struct pair *p)
+{
+	struct sockaddr_in caddr, saddr;
+	int fds[2], lfd, one = 1;
+
+	switch (proto) {
+	case NET_UNIX:
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+			err(EXIT_FAILURE, "socketpair");
+		p->client_fd = fds[0];
+		p->server_fd = fds[1];
+		break;
+
+	case NET_UDP:
+		p->server_fd = loopback_socket(SOCK_DGRAM, &saddr);
+		p->client_fd = loopback_socket(SOCK_DGRAM, &caddr);
+		if (connect(p->client_fd, (struct sockaddr *)&saddr, sizeof(saddr)) ||
+		    connect(p->server_fd, (struct sockaddr *)&caddr, sizeof(caddr)))
+			err(EXIT_FAILURE, "connect");
+		break;
+
+	case NET_TCP:
+		lfd = loopback_socket(SOCK_STREAM, &saddr);
+		if (listen(lfd, 1))
+			err(EXIT_FAILURE, "listen");
+		p->client_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (p->client_fd < 0)
+			err(EXIT_FAILURE, "socket");
+		if (connect(p->client_fd, (struct sockaddr *)&saddr, sizeof(saddr)))
+			err(EXIT_FAILURE, "connect");
+		p->server_fd = accept(lfd, NULL, NULL);
+		if (p->server_fd < 0)
+			err(EXIT_FAILURE, "accept");
+		close(lfd);
+
+		/* request/response wants every write on the wire right away */
+		if (setsockopt(p->client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ||
+		    setsockopt(p->server_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+			err(EXIT_FAILURE, "setsockopt(TCP_NODELAY)");
+		break;
+	}
+
+	set_timeouts(p->client_fd);
+	set_timeouts(p->server_fd);
+}
+
+/*
+ * Receives one whole message, returns false if the peer went away, the
+ * datagram was lost, or we're done.
+ */
+static bool recv_msg(int fd, char *buf)
+{
+	size_t got = 0;
+	ssize_t ret;
+
+	while (got < msg_size) {
+		ret = recv(fd, buf + got, msg_size - got, 0);
+		if (ret > 0) {
+			got += ret;
+			/* a datagram is a message, whatever its size */
+			if (proto == NET_UDP)
+				break;
+			continue;
+		}
+		if (!ret || done)
+			return false;
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			if (proto == NET_UDP)
+				return false;
+			continue;
+		}
+		err(EXIT_FAILURE, "recv");
+	}
+
+	return true;
+}
+
+static void send_msg(int fd, const char *buf)
+{
+	size_t sent = 0;
+	ssize_t ret;
+
+	while (sent < msg_size && !done) {
+		ret = send(fd, buf + sent, msg_size - sent, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN ||
+			    errno == EWOULDBLOCK)
+				continue;
+			/* the server went away after seeing 'done' */
+			if (errno == EPIPE || errno == ECONNRESET ||
+			    errno == ECONNREFUSED)
+				return;
+			err(EXIT_FAILURE, "send");
+		}
+		sent += ret;
+	}
+}
+
+static void *rr_client(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = calloc(1, msg_size);
+
+	if (!buf)
+		err(EXIT_FAILURE, "calloc");
+
+	while (!done) {
+		send_msg(p->client_fd, buf);
+		/* a lost datagram just costs one transaction */
+		if (recv_msg(p->client_fd, buf))
+			p->ops++;
+	}
+
+	shutdown(p->client_fd, SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static void *rr_server(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = calloc(1, msg_size);
+
+	if (!buf)
+		err(EXIT_FAILURE, "calloc");
+
+	while (!done) {
+		if (recv_msg(p->server_fd, buf))
+			send_msg(p->server_fd, buf);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *stream_client(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = calloc(1, msg_size);
+
+	if (!buf)
+		err(EXIT_FAILURE, "calloc");
+
+	while (!done)
+		send_msg(p->client_fd, buf);
+
+	shutdown(p->client_fd, SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static void *stream_server(void *arg)
+{
+	struct pair *p = arg;
+	char *buf = calloc(1, msg_size);
+	ssize_t ret;
+
+	if (!buf)
+		err(EXIT_FAILURE, "calloc");
+
+	/* count what actually arrived, datagrams may get dropped */
+	while (!done) {
+		ret = recv(p->server_fd, buf, msg_size, 0);
+		if (ret > 0) {
+			p->bytes += ret;
+			p->ops++;
+		} else if (!ret) {
+			break;
+		} else if (errno != EINTR && errno != EAGAIN &&
+			   errno != EWOULDBLOCK) {
+			err(EXIT_FAILURE, "recv");
+		}
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static int run_pairs(bool stream, const char * const *usage,
+		     int argc, const char **argv)
+{
+	void *(*client_fn)(void *) = stream ? stream_client : rr_client;
+	void *(*server_fn)(void *) = stream ? stream_server : rr_server;
+	struct sigaction act;
+	struct pair *pairs;
+	unsigned long avg;
+	double stddev, secs;
+	unsigned long long bytes = 0;
+	unsigned int i;
+	int ret;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !npairs) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!strcmp(proto_str, "tcp"))
+		proto = NET_TCP;
+	else if (!strcmp(proto_str, "udp"))
+		proto = NET_UDP;
+	else if (!strcmp(proto_str, "unix"))
+		proto = NET_UNIX;
+	else
+		errx(EXIT_FAILURE, "unknown protocol '%s'", proto_str);
+
+	/* default to a small request, or a big write */
+	msg_size = msg_size_opt ? msg_size_opt : (stream ? 16384 : 64);
+	if (proto == NET_UDP && msg_size > 65507)
+		errx(EXIT_FAILURE, "UDP messages can't be larger than 65507 bytes");
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	pairs = calloc(npairs, sizeof(*pairs));
+	if (!pairs)
+		err(EXIT_FAILURE, "calloc");
+
+	/* rr and stream run back to back for 'perf bench net all' */
+	done = false;
+
+	printf("Run summary [PID %d]: %d %s %s pairs, %d byte messages, for %d secs.\n\n",
+	       getpid(), npairs, proto_str, stream ? "stream" : "request/response",
+	       msg_size, nsecs);
+
+	init_stats(&throughput_stats);
+
+	for (i = 0; i < npairs; i++) {
+		pairs[i].idx = i;
+		connect_pair(&pairs[i]);
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < npairs; i++) {
+		ret = pthread_create(&pairs[i].server, NULL, server_fn, &pairs[i]);
+		if (!ret)
+			ret = pthread_create(&pairs[i].client, NULL, client_fn,
+					     &pairs[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < npairs; i++) {
+		ret = pthread_join(pairs[i].client, NULL);
+		if (!ret)
+			ret = pthread_join(pairs[i].server, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1000000.0;
+
+	for (i = 0; i < npairs; i++) {
+		unsigned long t = pairs[i].ops / secs;
+
+		update_stats(&throughput_stats, t);
+		bytes += pairs[i].bytes;
+		if (!silent) {
+			if (stream)
+				printf("[pair %2d] %.2f MB/sec [ %ld msgs/sec ]\n",
+				       pairs[i].idx,
+				       pairs[i].bytes / secs / (1024 * 1024), t);
+			else
+				printf("[pair %2d] %ld transactions/sec [ %.2f usecs/transaction ]\n",
+				       pairs[i].idx, t,
+				       t ? 1000000.0 / t : 0.0);
+		}
+
+		close(pairs[i].client_fd);
+		close(pairs[i].server_fd);
+	}
+
+	avg = avg_stats(&throughput_stats);
+	stddev = stddev_stats(&throughput_stats);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("%sAveraged %ld %s/sec (+- %.2f%%) per pair",
+		       !silent ? "\n" : "", avg,
+		       stream ? "msgs" : "transactions",
+		       rel_stddev_stats(stddev, avg));
+		if (stream)
+			printf(", %.2f MB/sec total",
+			       bytes / secs / (1024 * 1024));
+		printf(", total secs = %d\n", (int) runtime.tv_sec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%ld\n", avg);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(pairs);
+	return 0;
+}
+
+int bench_net_rr(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	return run_pairs(false, bench_net_rr_usage, argc, argv);
+}
+
+int bench_net_stream(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	return run_pairs(true, bench_net_stream_usage, argc, argv);
+}
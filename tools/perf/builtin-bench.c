@@ -13,6 +13,10 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  fs    ... File descriptor and VFS performance
+ *  epoll ... Event poll performance
+ *  net   ... Loopback socket performance
+ *  io    ... Block layer performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -63,6 +67,33 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench fs_benchmarks[] = {
+	{ "fdalloc",	"Benchmark for fd allocation in large fd tables",	bench_fs_fdalloc	},
+	{ "all",	"Test all fs benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench epoll_benchmarks[] = {
+	{ "wait",	"Benchmark epoll concurrent epoll_waits",	bench_epoll_wait	},
+	{ "ctl",	"Benchmark epoll concurrent epoll_ctls",	bench_epoll_ctl		},
+	{ "all",	"Test all epoll benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench net_benchmarks[] = {
+	{ "rr",		"Benchmark loopback request/response",		bench_net_rr		},
+	{ "stream",	"Benchmark loopback streaming",			bench_net_stream	},
+	{ "all",	"Test all net benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench io_benchmarks[] = {
+	{ "sync",	"Benchmark synchronous block I/O",		bench_io_sync		},
+	{ "aio",	"Benchmark asynchronous block I/O",		bench_io_aio		},
+	{ "all",	"Test all io benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -76,6 +107,10 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "fs",		"File descriptor and VFS benchmarks",		fs_benchmarks		},
+	{ "epoll",	"Epoll stressing benchmarks",			epoll_benchmarks	},
+	{ "net",	"Loopback socket benchmarks",			net_benchmarks		},
+	{ "io",		"Block layer benchmarks",			io_benchmarks		},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -30,8 +30,28 @@
 
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
+struct record;
+
+/*
+ * With --threads every mmap gets a reader thread of its own, pinned to the
+ * cpu the mmap belongs to and writing to <output>.<idx>, see
+ * HEADER_DATA_FILES.
+ */
+struct record_thread {
+	struct record		*rec;
+	pthread_t		pt;
+	int			idx;
+	int			cpu;
+	struct perf_data_file	file;
+	struct fdarray		pollfd;
+	u64			bytes_written;
+	long			samples;
+	unsigned long		waking;
+	int			err;
+};
 
 struct record {
 	struct perf_tool	tool;
@@ -44,7 +64,11 @@ struct record {
 	int			realtime_prio;
 	bool			no_buildid;
 	bool			no_buildid_cache;
+	bool			threads;
 	long			samples;
+	u64			*lost;		/* per mmap */
+	struct record_thread	*thread_data;
+	int			nr_threads;
 };
 
 static int record__write(struct record *rec, void *bf, size_t size)
@@ -67,7 +91,48 @@ static int process_synthesized_event(struct perf_tool *tool,
 	return record__write(rec, event, event->header.size);
 }
 
-static int record__mmap_read(struct record *rec, int idx)
+static int record__write_mmap(struct record *rec,
+			      struct record_thread *thread,
+			      void *bf, size_t size)
+{
+	if (!thread)
+		return record__write(rec, bf, size);
+
+	if (perf_data_file__write(&thread->file, bf, size) < 0) {
+		pr_err("failed to write perf data, error: %m\n");
+		return -1;
+	}
+
+	thread->bytes_written += size;
+	return 0;
+}
+
+/*
+ * Sum up the PERF_RECORD_LOST events about to be written out, so that the
+ * losses can be reported per mmap.  Records are u64 aligned and the ring
+ * buffer size is a power of two, so no u64 straddles the wrap around.
+ */
+static void record__count_lost(struct record *rec, struct perf_mmap *md,
+			       int idx, unsigned int old, unsigned int head)
+{
+	unsigned char *data = md->base + page_size;
+	struct perf_event_header *hdr;
+
+	while (old != head) {
+		hdr = (struct perf_event_header *)&data[old & md->mask];
+		if (!hdr->size)
+			break;
+
+		if (hdr->type == PERF_RECORD_LOST)
+			rec->lost[idx] += *(u64 *)&data[(old +
+				offsetof(struct lost_event, lost)) & md->mask];
+
+		old += hdr->size;
+	}
+}
+
+static int record__mmap_read(struct record *rec, struct record_thread *thread,
+			     int idx)
 {
 	struct perf_mmap *md = &rec->evlist->mmap[idx];
 	unsigned int head = perf_mmap__read_head(md);
@@ -80,7 +145,12 @@ static int record__mmap_read(struct record *rec, int idx)
 	if (old == head)
 		return 0;
 
-	rec->samples++;
+	if (thread)
+		thread->samples++;
+	else
+		rec->samples++;
+
+	record__count_lost(rec, md, idx, old, head);
 
 	size = head - old;
 
@@ -89,7 +159,7 @@ static int record__mmap_read(struct record *rec, int idx)
 		size = md->mask + 1 - (old & md->mask);
 		old += size;
 
-		if (record__write(rec, buf, size) < 0) {
+		if (record__write_mmap(rec, thread, buf, size) < 0) {
 			rc = -1;
 			goto out;
 		}
@@ -99,7 +169,7 @@ static int record__mmap_read(struct record *rec, int idx)
 	size = head - old;
 	old += size;
 
-	if (record__write(rec, buf, size) < 0) {
+	if (record__write_mmap(rec, thread, buf, size) < 0) {
 		rc = -1;
 		goto out;
 	}
@@ -247,7 +317,7 @@ static int record__mmap_read_all(struct record *rec)
 
 	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
 		if (rec->evlist->mmap[i].base) {
-			if (record__mmap_read(rec, i) != 0) {
+			if (record__mmap_read(rec, NULL, i) != 0) {
 				rc = -1;
 				goto out;
 			}
@@ -265,6 +335,208 @@ out:
 	return rc;
 }
 
+static void *record_thread__main(void *arg)
+{
+	struct record_thread *thread = arg;
+	struct record *rec = thread->rec;
+	bool draining = false;
+	cpu_set_t cpus;
+	sigset_t set;
+
+	/* Leave the signals to the main thread, it is the one waiting. */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	CPU_ZERO(&cpus);
+	CPU_SET(thread->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		pr_debug("failed to bind reader thread to cpu %d\n",
+			 thread->cpu);
+
+	for (;;) {
+		long hits = thread->samples;
+
+		if (record__mmap_read(rec, thread, thread->idx) < 0) {
+			thread->err = -1;
+			break;
+		}
+
+		if (hits == thread->samples) {
+			if (done || draining)
+				break;
+			/*
+			 * Wake up now and then to notice 'done', the signals
+			 * setting it are not delivered to this thread.
+			 */
+			fdarray__poll(&thread->pollfd, 100);
+			thread->waking++;
+
+			if (fdarray__filter(&thread->pollfd,
+					    POLLERR | POLLHUP, NULL) == 0)
+				draining = true;
+		}
+	}
+
+	return NULL;
+}
+
+static int record_thread__init(struct record_thread *thread,
+			       struct record *rec, int idx)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	char *path;
+	int i;
+
+	thread->rec = rec;
+	thread->idx = idx;
+	thread->cpu = evlist->cpus->map[idx];
+
+	fdarray__init(&thread->pollfd, 8);
+	for (i = 0; i < evlist->pollfd.nr; i++) {
+		if (evlist->pollfd.priv[i].idx != idx)
+			continue;
+
+		if (fdarray__add(&thread->pollfd, evlist->pollfd.entries[i].fd,
+				 POLLIN | POLLERR | POLLHUP) < 0)
+			return -ENOMEM;
+	}
+
+	if (asprintf(&path, "%s.%d", rec->file.path, idx) < 0)
+		return -ENOMEM;
+
+	thread->file.path = path;
+	thread->file.mode = PERF_DATA_MODE_WRITE;
+
+	return perf_data_file__open(&thread->file);
+}
+
+static void record_thread__exit(struct record_thread *thread)
+{
+	if (thread->file.path) {
+		perf_data_file__close(&thread->file);
+		free((char *)thread->file.path);
+		thread->file.path = NULL;
+	}
+	fdarray__exit(&thread->pollfd);
+}
+
+static int record__start_threads(struct record *rec)
+{
+	int nr = rec->evlist->nr_mmaps;
+	char sbuf[STRERR_BUFSIZE];
+	int i, err;
+
+	rec->thread_data = zalloc(nr * sizeof(*rec->thread_data));
+	if (rec->thread_data == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		rec->nr_threads++;
+		err = record_thread__init(thread, rec, i);
+		if (err)
+			return err;
+
+		err = pthread_create(&thread->pt, NULL, record_thread__main,
+				     thread);
+		if (err) {
+			pr_err("failed to start reader thread: %s\n",
+			       strerror_r(err, sbuf, sizeof(sbuf)));
+			thread->pt = 0;
+			return -err;
+		}
+	}
+
+	return 0;
+}
+
+static int record__stop_threads(struct record *rec, unsigned long *waking)
+{
+	int i, err = 0;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		if (!thread->pt)
+			continue;
+
+		pthread_join(thread->pt, NULL);
+		thread->pt = 0;
+
+		*waking += thread->waking;
+		if (thread->err)
+			err = thread->err;
+	}
+
+	return err;
+}
+
+/*
+ * Pick up what got in after the reader threads saw 'done' or the events
+ * were disabled.
+ */
+static int record__drain_threads(struct record *rec)
+{
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+		long hits;
+
+		do {
+			hits = thread->samples;
+			if (record__mmap_read(rec, thread, thread->idx) < 0)
+				return -1;
+		} while (hits != thread->samples);
+	}
+
+	return 0;
+}
+
+static void record__free_threads(struct record *rec)
+{
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++)
+		record_thread__exit(&rec->thread_data[i]);
+
+	zfree(&rec->thread_data);
+	rec->nr_threads = 0;
+}
+
+static u64 record__bytes_written(struct record *rec)
+{
+	u64 bytes = rec->bytes_written;
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++)
+		bytes += rec->thread_data[i].bytes_written;
+
+	return bytes;
+}
+
+static void record__print_lost(struct record *rec)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	bool per_cpu = !cpu_map__empty(evlist->cpus);
+	int i;
+
+	for (i = 0; i < evlist->nr_mmaps; i++) {
+		if (!rec->lost[i])
+			continue;
+
+		if (per_cpu)
+			fprintf(stderr,
+				"[ perf record: Lost %" PRIu64 " events on cpu %d ]\n",
+				rec->lost[i], evlist->cpus->map[i]);
+		else
+			fprintf(stderr,
+				"[ perf record: Lost %" PRIu64 " events on thread %d ]\n",
+				rec->lost[i], evlist->threads->map[i]);
+	}
+}
+
 static void record__init_features(struct record *rec)
 {
 	struct perf_session *session = rec->session;
@@ -281,6 +553,9 @@ static void record__init_features(struct record *rec)
 
 	if (!rec->opts.branch_stack)
 		perf_header__clear_feat(&session->header, HEADER_BRANCH_STACK);
+
+	if (!rec->threads)
+		perf_header__clear_feat(&session->header, HEADER_DATA_FILES);
 }
 
 static volatile int workload_exec_errno;
@@ -345,6 +620,22 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		goto out_child;
 	}
 
+	rec->lost = zalloc(rec->evlist->nr_mmaps * sizeof(*rec->lost));
+	if (rec->lost == NULL) {
+		err = -ENOMEM;
+		goto out_child;
+	}
+
+	if (rec->threads) {
+		if (file->is_pipe || cpu_map__empty(rec->evlist->cpus)) {
+			pr_err("--threads needs per-cpu mmaps and a regular output file.\n");
+			err = -EINVAL;
+			goto out_child;
+		}
+
+		session->header.env.nr_data_files = rec->evlist->nr_mmaps;
+	}
+
 	if (!rec->evlist->nr_groups)
 		perf_header__clear_feat(&session->header, HEADER_GROUP_DESC);
 
@@ -431,6 +722,12 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		}
 	}
 
+	if (rec->threads) {
+		err = record__start_threads(rec);
+		if (err)
+			goto out_child;
+	}
+
 	/*
 	 * When perf is starting the traced process, all the events
 	 * (apart from group members) have enable_on_exec=1 set,
@@ -450,7 +747,21 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		perf_evlist__enable(rec->evlist);
 	}
 
-	for (;;) {
+	if (rec->threads) {
+		err = record__stop_threads(rec, &waking);
+		if (err)
+			goto out_child;
+
+		/* See below, not needed when the workload went away. */
+		if (!target__none(&opts->target))
+			perf_evlist__disable(rec->evlist);
+
+		err = record__drain_threads(rec);
+		if (err)
+			goto out_child;
+	}
+
+	while (!rec->threads) {
 		int hits = rec->samples;
 
 		if (record__mmap_read_all(rec) < 0) {
@@ -501,12 +812,20 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		 */
 		fprintf(stderr,
 			"[ perf record: Captured and wrote %.3f MB %s (~%" PRIu64 " samples) ]\n",
-			(double)rec->bytes_written / 1024.0 / 1024.0,
+			(double)record__bytes_written(rec) / 1024.0 / 1024.0,
 			file->path,
-			rec->bytes_written / 24);
+			record__bytes_written(rec) / 24);
+
+		record__print_lost(rec);
 	}
 
 out_child:
+	if (rec->threads) {
+		/* Only left running on the error paths. */
+		done = 1;
+		record__stop_threads(rec, &waking);
+	}
+
 	if (forks) {
 		int exit_status;
 
@@ -534,6 +853,8 @@ out_child:
 	}
 
 out_delete_session:
+	record__free_threads(rec);
+	zfree(&rec->lost);
 	perf_session__delete(session);
 	return status;
 }
@@ -799,6 +1120,8 @@ const struct option record_options[] = {
 		    "sample transaction flags (special events only)"),
 	OPT_BOOLEAN(0, "per-thread", &record.opts.target.per_thread,
 		    "use per-thread mmaps"),
+	OPT_BOOLEAN(0, "threads", &record.threads,
+		    "read each per-cpu mmap from its own thread, into <output>.<n>"),
 	OPT_END()
 };
 
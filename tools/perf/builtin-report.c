@@ -52,6 +52,7 @@ struct report {
 	bool			header;
 	bool			header_only;
 	int			max_stack;
+	int			nr_jobs;
 	struct perf_read_values	show_threads_values;
 	const char		*pretty_printing_style;
 	const char		*cpu_list;
@@ -479,6 +480,15 @@ static int __cmd_report(struct report *rep)
 	if (ret)
 		return ret;
 
+	if (rep->nr_jobs > 1) {
+		struct machine *host = &session->machines.host;
+
+		ret = dsos__load_symbols(&host->user_dsos, host->symbol_filter,
+					 rep->nr_jobs);
+		if (ret)
+			return ret;
+	}
+
 	ret = perf_session__process_events(session, &rep->tool);
 	if (ret)
 		return ret;
@@ -615,6 +625,8 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "load module symbols - WARNING: use only with -k and LIVE kernel"),
 	OPT_BOOLEAN('n', "show-nr-samples", &symbol_conf.show_nr_samples,
 		    "Show a column with the number of samples"),
+	OPT_INTEGER('j', "jobs", &report.nr_jobs,
+		    "load the symbols of the DSOs in the build-id table with this many threads"),
 	OPT_BOOLEAN('T', "threads", &report.show_threads,
 		    "Show per-thread event counters"),
 	OPT_STRING(0, "pretty", &report.pretty_printing_style, "key",
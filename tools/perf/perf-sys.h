@@ -23,6 +23,12 @@
 #ifndef __NR_gettid
 # define __NR_gettid 224
 #endif
+#ifndef __NR_io_setup
+# define __NR_io_setup 245
+# define __NR_io_destroy 246
+# define __NR_io_getevents 247
+# define __NR_io_submit 248
+#endif
 #endif
 
 #if defined(__x86_64__)
@@ -40,6 +46,12 @@
 #ifndef __NR_gettid
 # define __NR_gettid 186
 #endif
+#ifndef __NR_io_setup
+# define __NR_io_setup 206
+# define __NR_io_destroy 207
+# define __NR_io_getevents 208
+# define __NR_io_submit 209
+#endif
 #endif
 
 #ifdef __powerpc__
@@ -1174,6 +1174,21 @@ static int write_group_desc(int fd, struct perf_header *h __maybe_unused,
 	return 0;
 }
 
+/*
+ * File format:
+ *
+ * struct data_files {
+ *	u32	nr;	// events also in <path>.0 .. <path>.<nr - 1>
+ * };
+ */
+static int write_data_files(int fd, struct perf_header *h,
+			    struct perf_evlist *evlist __maybe_unused)
+{
+	u32 nr = h->env.nr_data_files;
+
+	return do_write(fd, &nr, sizeof(nr));
+}
+
 /*
  * default get_cpuid(): nothing gets recorded
  * actual implementation must be in arch/$(ARCH)/util/header.c
@@ -1448,6 +1463,12 @@ static void print_total_mem(struct perf_header *ph, int fd __maybe_unused,
 	fprintf(fp, "# total memory : %Lu kB\n", ph->env.total_mem);
 }
 
+static void print_data_files(struct perf_header *ph, int fd __maybe_unused,
+			     FILE *fp)
+{
+	fprintf(fp, "# data files : %d\n", ph->env.nr_data_files);
+}
+
 static void print_numa_topology(struct perf_header *ph, int fd __maybe_unused,
 				FILE *fp)
 {
@@ -2076,6 +2097,22 @@ error:
 	return -1;
 }
 
+static int process_data_files(struct perf_file_section *section __maybe_unused,
+			      struct perf_header *ph, int fd,
+			      void *data __maybe_unused)
+{
+	u32 nr;
+
+	if (readn(fd, &nr, sizeof(nr)) != sizeof(nr))
+		return -1;
+
+	if (ph->needs_swap)
+		nr = bswap_32(nr);
+
+	ph->env.nr_data_files = nr;
+	return 0;
+}
+
 static int process_group_desc(struct perf_file_section *section __maybe_unused,
 			      struct perf_header *ph, int fd,
 			      void *data __maybe_unused)
@@ -2210,6 +2247,7 @@ static const struct feature_ops feat_ops[HEADER_LAST_FEATURE] = {
 	FEAT_OPA(HEADER_BRANCH_STACK,	branch_stack),
 	FEAT_OPP(HEADER_PMU_MAPPINGS,	pmu_mappings),
 	FEAT_OPP(HEADER_GROUP_DESC,	group_desc),
+	FEAT_OPP(HEADER_DATA_FILES,	data_files),
 };
 
 struct header_print_data {
@@ -2477,6 +2515,7 @@ static const int attr_file_abi_sizes[] = {
 	[1] = PERF_ATTR_SIZE_VER1,
 	[2] = PERF_ATTR_SIZE_VER2,
 	[3] = PERF_ATTR_SIZE_VER3,
+	[4] = PERF_ATTR_SIZE_VER4,
 	0,
 };
 
@@ -30,6 +30,7 @@ enum {
 	HEADER_BRANCH_STACK,
 	HEADER_PMU_MAPPINGS,
 	HEADER_GROUP_DESC,
+	HEADER_DATA_FILES,
 	HEADER_LAST_FEATURE,
 	HEADER_FEAT_BITS	= 256,
 };
@@ -82,6 +83,7 @@ struct perf_session_env {
 	int			nr_numa_nodes;
 	int			nr_pmu_mappings;
 	int			nr_groups;
+	int			nr_data_files;
 	char			*cmdline;
 	char			*sibling_cores;
 	char			*sibling_threads;
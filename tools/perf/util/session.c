@@ -1191,6 +1191,218 @@ fetch_mmaped_event(struct perf_session *session,
 #define NUM_MMAPS 128
 #endif
 
+/*
+ * 'perf record --threads' leaves the events read from each mmap in a
+ * <path>.<n> file next to the main one.  Every such stream is in time
+ * order on its own, so merge them by always delivering the oldest pending
+ * event, and leave the small reorderings inside a stream to the ordered
+ * events queue, flushed every DATA_STREAM_ROUND events as if a
+ * PERF_RECORD_FINISHED_ROUND had been seen.
+ */
+struct data_stream {
+	int		fd;
+	char		*buf;
+	size_t		mmap_size;
+	u64		file_offset;
+	u64		head;
+	u64		end;
+	u64		timestamp;
+};
+
+#define DATA_STREAM_ROUND	4096
+
+static int data_stream__map(struct data_stream *stream, int fd,
+			    u64 offset, u64 size)
+{
+	u64 page_offset = page_size * (offset / page_size);
+
+	stream->file_offset = page_offset;
+	stream->head = offset - page_offset;
+	stream->end = stream->head + size;
+
+	if (!size)
+		return 0;
+
+	stream->mmap_size = stream->end;
+	stream->buf = mmap(NULL, stream->mmap_size, PROT_READ, MAP_SHARED,
+			   fd, page_offset);
+	if (stream->buf == MAP_FAILED) {
+		stream->buf = NULL;
+		pr_err("failed to mmap file\n");
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void data_stream__unmap(struct data_stream *stream)
+{
+	if (stream->buf)
+		munmap(stream->buf, stream->mmap_size);
+	if (stream->fd >= 0)
+		close(stream->fd);
+}
+
+/*
+ * Look at the event at stream->head and note its timestamp, events that
+ * carry none are delivered as soon as they are reached.
+ */
+static int data_stream__peek(struct data_stream *stream,
+			     struct perf_session *session)
+{
+	struct perf_sample sample;
+	union perf_event *event;
+
+	if (stream->head + sizeof(event->header) > stream->end) {
+		stream->head = stream->end;
+		return 0;
+	}
+
+	event = (union perf_event *)(stream->buf + stream->head);
+
+	if (event->header.size < sizeof(struct perf_event_header)) {
+		pr_err("%#" PRIx64 " [%#x]: bad event size\n",
+		       stream->file_offset + stream->head, event->header.size);
+		return -EINVAL;
+	}
+
+	if (stream->head + event->header.size > stream->end) {
+		stream->head = stream->end;
+		return 0;
+	}
+
+	stream->timestamp = 0;
+	if (event->header.type < PERF_RECORD_USER_TYPE_START &&
+	    !perf_evlist__parse_sample(session->evlist, event, &sample) &&
+	    sample.time != -1ULL)
+		stream->timestamp = sample.time;
+
+	return 0;
+}
+
+static int __perf_session__process_data_files(struct perf_session *session,
+					      u64 data_offset, u64 data_size,
+					      struct perf_tool *tool)
+{
+	int nr = session->header.env.nr_data_files + 1;
+	struct data_stream *streams, *stream;
+	char path[PATH_MAX], sbuf[STRERR_BUFSIZE];
+	struct ui_progress prog;
+	u64 total = data_size;
+	int i, err, events = 0;
+
+	if (session->header.needs_swap) {
+		pr_err("cross-endian perf.data with data files is not supported\n");
+		return -EINVAL;
+	}
+
+	streams = zalloc(nr * sizeof(*streams));
+	if (streams == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++)
+		streams[i].fd = -1;
+
+	err = data_stream__map(&streams[0], perf_data_file__fd(session->file),
+			       data_offset, data_size);
+	if (err)
+		goto out_unmap;
+
+	for (i = 1; i < nr; i++) {
+		struct stat st;
+
+		snprintf(path, sizeof(path), "%s.%d",
+			 session->file->path, i - 1);
+		streams[i].fd = open(path, O_RDONLY);
+		if (streams[i].fd < 0 || fstat(streams[i].fd, &st) < 0) {
+			err = -errno;
+			pr_err("failed to open %s: %s\n", path,
+			       strerror_r(errno, sbuf, sizeof(sbuf)));
+			goto out_unmap;
+		}
+
+		err = data_stream__map(&streams[i], streams[i].fd,
+				       0, st.st_size);
+		if (err)
+			goto out_unmap;
+
+		total += st.st_size;
+	}
+
+	perf_tool__fill_defaults(tool);
+
+	for (i = 0; i < nr; i++) {
+		err = data_stream__peek(&streams[i], session);
+		if (err)
+			goto out_unmap;
+	}
+
+	ui_progress__init(&prog, total, "Processing events...");
+
+	for (;;) {
+		union perf_event *event;
+		u64 size;
+		s64 skip;
+
+		stream = NULL;
+		for (i = 0; i < nr; i++) {
+			if (streams[i].head == streams[i].end)
+				continue;
+			if (!stream || streams[i].timestamp < stream->timestamp)
+				stream = &streams[i];
+		}
+
+		if (!stream)
+			break;
+
+		event = (union perf_event *)(stream->buf + stream->head);
+		size = event->header.size;
+
+		skip = perf_session__process_event(session, event, tool,
+						   stream->file_offset +
+						   stream->head);
+		if (skip < 0) {
+			pr_err("%#" PRIx64 " [%#x]: failed to process type: %d\n",
+			       stream->file_offset + stream->head,
+			       event->header.size, event->header.type);
+			err = -EINVAL;
+			goto out_err;
+		}
+
+		size += skip;
+		stream->head += size;
+
+		ui_progress__update(&prog, size);
+
+		if (session_done())
+			break;
+
+		if (tool->ordered_events && ++events == DATA_STREAM_ROUND) {
+			events = 0;
+			err = ordered_events__flush(session, tool,
+						    OE_FLUSH__ROUND);
+			if (err)
+				goto out_err;
+		}
+
+		err = data_stream__peek(stream, session);
+		if (err)
+			goto out_err;
+	}
+
+	/* do the final flush for ordered samples */
+	err = ordered_events__flush(session, tool, OE_FLUSH__FINAL);
+out_err:
+	ui_progress__finish();
+	perf_session__warn_about_errors(session, tool);
+	ordered_events__free(&session->ordered_events);
+out_unmap:
+	for (i = 0; i < nr; i++)
+		data_stream__unmap(&streams[i]);
+	free(streams);
+	return err;
+}
+
 int __perf_session__process_events(struct perf_session *session,
 				   u64 data_offset, u64 data_size,
 				   u64 file_size, struct perf_tool *tool)
@@ -1204,6 +1416,14 @@ int __perf_session__process_events(struct perf_session *session,
 	struct ui_progress prog;
 	s64 skip;
 
+	if (session->header.env.nr_data_files) {
+		if (!data_size || data_offset + data_size > file_size)
+			data_size = file_size - data_offset;
+
+		return __perf_session__process_data_files(session, data_offset,
+							  data_size, tool);
+	}
+
 	perf_tool__fill_defaults(tool);
 
 	page_offset = page_size * (data_offset / page_size);
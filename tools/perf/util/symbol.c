@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include "build-id.h"
 #include "util.h"
 #include "debug.h"
@@ -1448,6 +1449,87 @@ out_free:
 	return ret;
 }
 
+struct dsos_load {
+	pthread_mutex_t		lock;
+	struct list_head	*head;
+	struct list_head	*pos;
+	symbol_filter_t		filter;
+};
+
+static struct dso *dsos_load__next(struct dsos_load *dl)
+{
+	struct dso *dso = NULL;
+
+	pthread_mutex_lock(&dl->lock);
+	while (!dso && dl->pos->next != dl->head) {
+		dl->pos = dl->pos->next;
+		dso = list_entry(dl->pos, struct dso, node);
+		if (dso->kernel || dso__loaded(dso, MAP__FUNCTION))
+			dso = NULL;
+	}
+	pthread_mutex_unlock(&dl->lock);
+
+	return dso;
+}
+
+static void *dsos_load__worker(void *arg)
+{
+	struct dsos_load *dl = arg;
+	struct dso *dso;
+
+	while ((dso = dsos_load__next(dl)) != NULL) {
+		struct map *map = map__new2(0, dso, MAP__FUNCTION);
+
+		if (map == NULL)
+			break;
+
+		dso__load(dso, map, dl->filter);
+		map__delete(map);
+	}
+
+	return NULL;
+}
+
+/*
+ * Load the function symbols of every user space DSO on the list with
+ * nr_jobs threads, so that they are already there when the first sample
+ * hitting each of them is resolved.  Each DSO is loaded by one thread
+ * only, so this is safe as long as nothing else looks at the list.
+ */
+int dsos__load_symbols(struct dsos *dsos, symbol_filter_t filter,
+		       int nr_jobs)
+{
+	struct dsos_load dl = {
+		.head	= &dsos->head,
+		.pos	= &dsos->head,
+		.filter	= filter,
+	};
+	pthread_t *threads;
+	int i;
+
+	threads = calloc(nr_jobs, sizeof(*threads));
+	if (threads == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_init(&dl.lock, NULL);
+
+	/*
+	 * Not being able to start all of them is not fatal, whatever is not
+	 * loaded here is loaded on first use as before.
+	 */
+	for (i = 0; i < nr_jobs; i++) {
+		if (pthread_create(&threads[i], NULL, dsos_load__worker, &dl))
+			break;
+	}
+
+	while (i--)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&dl.lock);
+	free(threads);
+	return 0;
+}
+
 struct map *map_groups__find_by_name(struct map_groups *mg,
 				     enum map_type type, const char *name)
 {
@@ -0,0 +1,128 @@
+/*
+ * Test mq_timedsend_batch(2) and mq_timedreceive_batch(2): a batch of
+ * messages with different priorities is sent in one call and received
+ * back in one call, in priority order.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <mqueue.h>
+#include <sys/syscall.h>
+
+#if defined(__NR_mq_timedsend_batch) && defined(__NR_mq_timedreceive_batch)
+
+#define NR_MSGS		8
+#define MSG_SIZE	64
+
+/* Mirrors struct mq_msgvec in include/uapi/linux/mqueue.h */
+struct mq_msgvec {
+	uint64_t	msg_ptr;
+	uint64_t	msg_len;
+	uint32_t	msg_prio;
+	uint32_t	__reserved;
+};
+
+static const char *queue_name = "/mq_batch_test";
+
+int main(void)
+{
+	char out[NR_MSGS][MSG_SIZE], in[NR_MSGS][MSG_SIZE];
+	struct mq_msgvec vec[NR_MSGS];
+	struct mq_attr attr = {
+		.mq_maxmsg = NR_MSGS,
+		.mq_msgsize = MSG_SIZE,
+	};
+	int i, ret, err = 1;
+	mqd_t q;
+
+	q = mq_open(queue_name, O_RDWR | O_CREAT | O_EXCL | O_NONBLOCK,
+		    0600, &attr);
+	if (q == (mqd_t)-1) {
+		perror("mq_open");
+		return 1;
+	}
+
+	for (i = 0; i < NR_MSGS; i++) {
+		snprintf(out[i], MSG_SIZE, "message %d", i);
+		vec[i].msg_ptr = (uintptr_t)out[i];
+		vec[i].msg_len = strlen(out[i]) + 1;
+		vec[i].msg_prio = i;
+		vec[i].__reserved = 0;
+	}
+
+	ret = syscall(__NR_mq_timedsend_batch, q, vec, NR_MSGS, 0, NULL);
+	if (ret != NR_MSGS) {
+		fprintf(stderr, "send batch returned %d (%s)\n", ret,
+			ret < 0 ? strerror(errno) : "short");
+		goto out;
+	}
+
+	/* the queue is full now */
+	ret = syscall(__NR_mq_timedsend_batch, q, vec, 1, 0, NULL);
+	if (ret != -1 || errno != EAGAIN) {
+		fprintf(stderr, "send to a full queue returned %d\n", ret);
+		goto out;
+	}
+
+	for (i = 0; i < NR_MSGS; i++) {
+		vec[i].msg_ptr = (uintptr_t)in[i];
+		vec[i].msg_len = MSG_SIZE;
+	}
+
+	ret = syscall(__NR_mq_timedreceive_batch, q, vec, NR_MSGS, 0, NULL);
+	if (ret != NR_MSGS) {
+		fprintf(stderr, "receive batch returned %d (%s)\n", ret,
+			ret < 0 ? strerror(errno) : "short");
+		goto out;
+	}
+
+	/* highest priority first */
+	for (i = 0; i < NR_MSGS; i++) {
+		int src = NR_MSGS - 1 - i;
+
+		if (vec[i].msg_prio != (uint32_t)src ||
+		    vec[i].msg_len != strlen(out[src]) + 1 ||
+		    strcmp(in[i], out[src])) {
+			fprintf(stderr, "message %d: got \"%s\" prio %u\n",
+				i, in[i], vec[i].msg_prio);
+			goto out;
+		}
+	}
+
+	ret = syscall(__NR_mq_timedreceive_batch, q, vec, NR_MSGS, 0, NULL);
+	if (ret != -1 || errno != EAGAIN) {
+		fprintf(stderr, "receive from an empty queue returned %d\n",
+			ret);
+		goto out;
+	}
+
+	printf("mq_batch: %d messages sent and received in one call each\n",
+	       NR_MSGS);
+	err = 0;
+out:
+	mq_close(q);
+	mq_unlink(queue_name);
+	return err;
+}
+
+#else
+
+#warning "missing __NR_mq_timedsend_batch definition"
+
+int main(void)
+{
+	printf("skip: Skipping mq_batch test (missing __NR_mq_timedsend_batch)\n");
+	return 0;
+}
+
+#endif
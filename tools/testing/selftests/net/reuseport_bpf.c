@@ -0,0 +1,134 @@
+/*
+ * Test SO_ATTACH_REUSEPORT_CBPF on a group of TCP listeners: a classic
+ * BPF program returning a constant index must steer every connection to
+ * the same listener, and accepted sockets must report the cpu that
+ * handled them through SO_INCOMING_CPU.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU		49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF	51
+#endif
+
+#define NR_LISTENERS	4
+#define NR_CONNS	16
+#define TARGET		2
+
+static void error(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void attach_prog(int fd, unsigned int index)
+{
+	struct sock_filter code[] = {
+		{ BPF_RET | BPF_K, 0, 0, index },
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       &prog, sizeof(prog)))
+		error("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+}
+
+static int listener(struct sockaddr_in *addr, int attach)
+{
+	socklen_t len = sizeof(*addr);
+	int fd, one = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		error("socket");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)))
+		error("setsockopt SO_REUSEPORT");
+	if (bind(fd, (struct sockaddr *)addr, len))
+		error("bind");
+	if (getsockname(fd, (struct sockaddr *)addr, &len))
+		error("getsockname");
+	/* the program is per group, the first listener brings it */
+	if (attach)
+		attach_prog(fd, TARGET);
+	if (listen(fd, NR_CONNS))
+		error("listen");
+	return fd;
+}
+
+int main(void)
+{
+	struct sockaddr_in addr;
+	int fds[NR_LISTENERS];
+	int i, fd, cpu, accepted = 0;
+	socklen_t len;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	/* group members are indexed in listen() order */
+	for (i = 0; i < NR_LISTENERS; i++)
+		fds[i] = listener(&addr, i == 0);
+
+	for (i = 0; i < NR_CONNS; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			error("socket");
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			error("connect");
+		close(fd);
+	}
+	/* let the last handshakes reach the accept queues */
+	usleep(100 * 1000);
+
+	for (i = 0; i < NR_LISTENERS; i++) {
+		while ((fd = accept(fds[i], NULL, NULL)) >= 0) {
+			if (i != TARGET) {
+				fprintf(stderr, "connection on listener %d, "
+					"expected %d\n", i, TARGET);
+				return 1;
+			}
+			len = sizeof(cpu);
+			if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU,
+				       &cpu, &len))
+				error("getsockopt SO_INCOMING_CPU");
+			if (cpu < 0) {
+				fprintf(stderr, "no incoming cpu recorded\n");
+				return 1;
+			}
+			close(fd);
+			accepted++;
+		}
+		if (errno != EAGAIN)
+			error("accept");
+		close(fds[i]);
+	}
+
+	if (accepted != NR_CONNS) {
+		fprintf(stderr, "accepted %d of %d connections\n",
+			accepted, NR_CONNS);
+		return 1;
+	}
+
+	fprintf(stderr, "SUCCESS\n");
+	return 0;
+}
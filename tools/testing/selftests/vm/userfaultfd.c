@@ -0,0 +1,174 @@
+/*
+ * Test userfaultfd(2): a thread resolves the missing-page faults of the
+ * main thread with UFFDIO_COPY, then the contents are checked.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include "../../../../include/uapi/linux/userfaultfd.h"
+
+#ifdef __NR_userfaultfd
+
+#define NR_PAGES 64
+
+static unsigned long page_size;
+static char *area_dst, *area_src;
+static int uffd;
+
+static void *uffd_poll_thread(void *arg)
+{
+	unsigned long nr_faults = 0;
+	struct pollfd pollfd;
+	struct uffd_msg msg;
+	struct uffdio_copy copy;
+	unsigned long offset;
+
+	pollfd.fd = uffd;
+	pollfd.events = POLLIN;
+
+	while (nr_faults < NR_PAGES) {
+		if (poll(&pollfd, 1, -1) < 0) {
+			perror("poll");
+			exit(1);
+		}
+		if (read(uffd, &msg, sizeof(msg)) != sizeof(msg)) {
+			if (errno == EAGAIN)
+				continue;
+			perror("read");
+			exit(1);
+		}
+		if (msg.event != UFFD_EVENT_PAGEFAULT) {
+			fprintf(stderr, "unexpected event %u\n", msg.event);
+			exit(1);
+		}
+
+		offset = (char *)(unsigned long)msg.arg.pagefault.address -
+			 area_dst;
+		offset &= ~(page_size - 1);
+		copy.dst = (unsigned long) area_dst + offset;
+		copy.src = (unsigned long) area_src + offset;
+		copy.len = page_size;
+		copy.mode = 0;
+		copy.copy = 0;
+		if (ioctl(uffd, UFFDIO_COPY, &copy)) {
+			/* another thread may have resolved it already */
+			if (copy.copy != -EEXIST) {
+				fprintf(stderr, "UFFDIO_COPY error %Ld\n",
+					copy.copy);
+				exit(1);
+			}
+		}
+		nr_faults++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct uffdio_api uffdio_api;
+	struct uffdio_register uffdio_register;
+	pthread_t thread;
+	unsigned long nr, len;
+
+	page_size = sysconf(_SC_PAGE_SIZE);
+	len = NR_PAGES * page_size;
+
+	area_src = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	area_dst = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area_src == MAP_FAILED || area_dst == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (nr = 0; nr < NR_PAGES; nr++)
+		memset(area_src + nr * page_size, nr + 1, page_size);
+
+	uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd < 0) {
+		perror("userfaultfd syscall not available in this kernel");
+		return 1;
+	}
+
+	uffdio_api.api = UFFD_API;
+	uffdio_api.features = 0;
+	if (ioctl(uffd, UFFDIO_API, &uffdio_api)) {
+		fprintf(stderr, "UFFDIO_API\n");
+		return 1;
+	}
+	if (uffdio_api.api != UFFD_API) {
+		fprintf(stderr, "UFFDIO_API error %Lu\n", uffdio_api.api);
+		return 1;
+	}
+
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = len;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register)) {
+		fprintf(stderr, "register failure\n");
+		return 1;
+	}
+	if ((uffdio_register.ioctls & UFFD_API_RANGE_IOCTLS) !=
+	    UFFD_API_RANGE_IOCTLS) {
+		fprintf(stderr, "unexpected missing ioctl for anon memory\n");
+		return 1;
+	}
+
+	if (pthread_create(&thread, NULL, uffd_poll_thread, NULL)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	/* every first touch faults and is resolved by the poll thread */
+	for (nr = 0; nr < NR_PAGES; nr++) {
+		char *page = area_dst + nr * page_size;
+
+		if (page[0] != (char)(nr + 1) ||
+		    page[page_size - 1] != (char)(nr + 1)) {
+			fprintf(stderr, "page %lu has wrong contents\n", nr);
+			return 1;
+		}
+	}
+
+	if (pthread_join(thread, NULL)) {
+		perror("pthread_join");
+		return 1;
+	}
+
+	if (ioctl(uffd, UFFDIO_UNREGISTER, &uffdio_register.range)) {
+		fprintf(stderr, "unregister failure\n");
+		return 1;
+	}
+	close(uffd);
+
+	printf("userfaultfd: %d pages copied in on fault\n", NR_PAGES);
+	return 0;
+}
+
+#else /* __NR_userfaultfd */
+
+#warning "missing __NR_userfaultfd definition"
+
+int main(void)
+{
+	printf("skip: Skipping userfaultfd test (missing __NR_userfaultfd)\n");
+	return 0;
+}
+
+#endif /* __NR_userfaultfd */
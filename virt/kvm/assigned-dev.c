@@ -259,6 +259,42 @@ static void deassign_host_irq(struct kvm *kvm,
 	assigned_dev->irq_requested_type &= ~(KVM_DEV_IRQ_HOST_MASK);
 }
 
+/*
+ * Post the MSI or MSI-X interrupts of the device straight to the vCPU
+ * their guest route targets, or put them back in remapped mode towards
+ * the host handlers if @set is false. Needs both the host and the guest
+ * side to be MSI or MSI-X; the routes are looked up again whenever
+ * KVM_SET_GSI_ROUTING changes them.
+ */
+static void kvm_assigned_dev_update_posting(struct kvm *kvm,
+				struct kvm_assigned_dev_kernel *assigned_dev,
+				bool set)
+{
+	unsigned long type = assigned_dev->irq_requested_type;
+	int i;
+
+	if ((type & KVM_DEV_IRQ_HOST_MSI) && (type & KVM_DEV_IRQ_GUEST_MSI))
+		kvm_arch_update_irq_posting(kvm, assigned_dev->host_irq,
+					    assigned_dev->guest_irq, set);
+	else if ((type & KVM_DEV_IRQ_HOST_MSIX) &&
+		 (type & KVM_DEV_IRQ_GUEST_MSIX))
+		for (i = 0; i < assigned_dev->entries_nr; i++)
+			kvm_arch_update_irq_posting(kvm,
+				assigned_dev->host_msix_entries[i].vector,
+				assigned_dev->guest_msix_entries[i].vector,
+				set);
+}
+
+void kvm_assigned_dev_update_routing(struct kvm *kvm)
+{
+	struct kvm_assigned_dev_kernel *assigned_dev;
+
+	mutex_lock(&kvm->lock);
+	list_for_each_entry(assigned_dev, &kvm->arch.assigned_dev_head, list)
+		kvm_assigned_dev_update_posting(kvm, assigned_dev, true);
+	mutex_unlock(&kvm->lock);
+}
+
 static int kvm_deassign_irq(struct kvm *kvm,
 			    struct kvm_assigned_dev_kernel *assigned_dev,
 			    unsigned long irq_requested_type)
@@ -274,6 +310,10 @@ static int kvm_deassign_irq(struct kvm *kvm,
 	host_irq_type = irq_requested_type & KVM_DEV_IRQ_HOST_MASK;
 	guest_irq_type = irq_requested_type & KVM_DEV_IRQ_GUEST_MASK;
 
+	/* The host handlers take over again before either side goes away */
+	if (host_irq_type || guest_irq_type)
+		kvm_assigned_dev_update_posting(kvm, assigned_dev, false);
+
 	if (host_irq_type)
 		deassign_host_irq(kvm, assigned_dev);
 	if (guest_irq_type)
@@ -572,6 +612,8 @@ static int kvm_vm_ioctl_assign_irq(struct kvm *kvm,
 
 	if (guest_irq_type)
 		r = assign_guest_irq(kvm, match, assigned_irq, guest_irq_type);
+	if (!r)
+		kvm_assigned_dev_update_posting(kvm, match, true);
 out:
 	mutex_unlock(&kvm->lock);
 	return r;
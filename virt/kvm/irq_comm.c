@@ -109,8 +109,6 @@ int kvm_irq_delivery_to_apic(struct kvm *kvm, struct kvm_lapic *src,
 static inline void kvm_set_msi_irq(struct kvm_kernel_irq_routing_entry *e,
 				   struct kvm_lapic_irq *irq)
 {
-	trace_kvm_msi_set_irq(e->msi.address_lo, e->msi.data);
-
 	irq->dest_id = (e->msi.address_lo &
 			MSI_ADDR_DEST_ID_MASK) >> MSI_ADDR_DEST_ID_SHIFT;
 	irq->vector = (e->msi.data &
@@ -131,6 +129,7 @@ int kvm_set_msi(struct kvm_kernel_irq_routing_entry *e,
 	if (!level)
 		return -1;
 
+	trace_kvm_msi_set_irq(e->msi.address_lo, e->msi.data);
 	kvm_set_msi_irq(e, &irq);
 
 	return kvm_irq_delivery_to_apic(kvm, NULL, &irq, NULL);
@@ -143,6 +142,7 @@ static int kvm_set_msi_inatomic(struct kvm_kernel_irq_routing_entry *e,
 	struct kvm_lapic_irq irq;
 	int r;
 
+	trace_kvm_msi_set_irq(e->msi.address_lo, e->msi.data);
 	kvm_set_msi_irq(e, &irq);
 
 	if (kvm_irq_delivery_to_apic_fast(kvm, NULL, &irq, &r, NULL))
@@ -151,6 +151,49 @@ static int kvm_set_msi_inatomic(struct kvm_kernel_irq_routing_entry *e,
 		return -EWOULDBLOCK;
 }
 
+#ifdef CONFIG_X86
+/*
+ * Return the only vCPU an edge-triggered fixed or lowest-priority MSI
+ * routed through @gsi can be delivered to, and its vector in @vector.
+ * Anything else, including a lowest-priority MSI with more than one
+ * candidate, returns NULL.
+ */
+struct kvm_vcpu *kvm_msi_route_single_vcpu(struct kvm *kvm, int gsi,
+					    u32 *vector)
+{
+	struct kvm_kernel_irq_routing_entry entries[KVM_NR_IRQCHIPS];
+	struct kvm_vcpu *vcpu, *dest = NULL;
+	struct kvm_lapic_irq irq;
+	int i, n, idx;
+
+	idx = srcu_read_lock(&kvm->irq_srcu);
+	n = kvm_irq_map_gsi(kvm, entries, gsi);
+	srcu_read_unlock(&kvm->irq_srcu, idx);
+
+	if (n != 1 || entries[0].type != KVM_IRQ_ROUTING_MSI)
+		return NULL;
+
+	kvm_set_msi_irq(&entries[0], &irq);
+	if (irq.trig_mode ||
+	    (irq.delivery_mode != APIC_DM_FIXED && !kvm_is_dm_lowest_prio(&irq)))
+		return NULL;
+
+	kvm_for_each_vcpu(i, vcpu, kvm) {
+		if (!kvm_apic_present(vcpu) ||
+		    !kvm_apic_match_dest(vcpu, NULL, irq.shorthand,
+					 irq.dest_id, irq.dest_mode))
+			continue;
+		if (dest)
+			return NULL;
+		dest = vcpu;
+	}
+
+	if (dest)
+		*vector = irq.vector;
+	return dest;
+}
+#endif
+
 /*
  * Deliver an IRQ in an atomic context if we can, or return a failure,
  * user can retry in a process context.